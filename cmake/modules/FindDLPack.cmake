@@ -0,0 +1,38 @@
+################################################################################
+## Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+## DiHydrogen Project Developers. See the top-level LICENSE file for details.
+##
+## SPDX-License-Identifier: Apache-2.0
+################################################################################
+
+# Finds the DLPack header, version 0.6 or later.
+#
+# Sets the following variables
+#
+#   DLPack_FOUND
+#   DLPack_INCLUDE_DIR
+#
+# Defines the following imported target:
+#
+#   DLPack::DLPack
+#
+
+find_path(DLPack_INCLUDE_DIR dlpack/dlpack.h
+  HINTS ${DLPack_DIR} $ENV{DLPack_DIR} ${DLPACK_DIR} $ENV{DLPACK_DIR}
+  PATH_SUFFIXES include
+  DOC "The DLPack include directory."
+  NO_DEFAULT_PATH)
+find_path(DLPack_INCLUDE_DIR dlpack/dlpack.h)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(DLPack
+  DEFAULT_MSG DLPack_INCLUDE_DIR)
+
+if (DLPack_FOUND AND NOT TARGET DLPack::DLPack)
+
+  add_library(DLPack::DLPack INTERFACE IMPORTED)
+
+  set_property(TARGET DLPack::DLPack PROPERTY
+    INTERFACE_INCLUDE_DIRECTORIES "${DLPack_INCLUDE_DIR}")
+
+endif ()
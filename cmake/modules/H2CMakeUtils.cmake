@@ -71,3 +71,39 @@ macro (h2_add_sources_to_target_and_install)
     )
 
 endmacro ()
+
+# Compile a source file that instantiates templates with
+# H2_INSTANTIATE_SHARD (h2/patterns/multimethods/Instantiation.hpp)
+# as several translation units, each instantiating a share of the
+# combinations, so that they build in parallel. The generated sources
+# are appended to VAR. SHARDS defaults to H2_INSTANTIATION_SHARDS, or
+# 1 if that is not set.
+#
+#   h2_add_instantiation_shards(SOURCES SOURCE shuffle_eti.cu SHARDS 4)
+function (h2_add_instantiation_shards VAR)
+  cmake_parse_arguments(_H2_INTERNAL "" "SOURCE;SHARDS" "" ${ARGN})
+  h2_assert_value(_H2_INTERNAL_SOURCE)
+  if (NOT _H2_INTERNAL_SHARDS)
+    if (H2_INSTANTIATION_SHARDS)
+      set(_H2_INTERNAL_SHARDS ${H2_INSTANTIATION_SHARDS})
+    else ()
+      set(_H2_INTERNAL_SHARDS 1)
+    endif ()
+  endif ()
+
+  get_filename_component(_src "${_H2_INTERNAL_SOURCE}" ABSOLUTE)
+  get_filename_component(_name "${_src}" NAME_WE)
+  get_filename_component(_ext "${_src}" LAST_EXT)
+
+  set(_shards)
+  math(EXPR _last "${_H2_INTERNAL_SHARDS} - 1")
+  foreach (_shard RANGE ${_last})
+    set(_out "${CMAKE_CURRENT_BINARY_DIR}/${_name}_shard${_shard}${_ext}")
+    file(CONFIGURE OUTPUT "${_out}" CONTENT
+      "#define H2_INSTANTIATION_SHARD ${_shard}\n#define H2_INSTANTIATION_NUM_SHARDS ${_H2_INTERNAL_SHARDS}\n#include \"${_src}\"\n")
+    list(APPEND _shards "${_out}")
+  endforeach ()
+  set(_all ${${VAR}})
+  list(APPEND _all ${_shards})
+  set(${VAR} "${_all}" PARENT_SCOPE)
+endfunction ()
@@ -31,7 +31,8 @@ target_link_libraries(
   CUDA::nvToolsExt
   CUDA::nvml
   CUDA::cuda_driver
-  CUDA::cudart)
+  CUDA::cudart
+  CUDA::nvrtc)
 
 # Arch flags are now set automatically. Be sure to set
 # CMAKE_CUDA_ARCHITECTURES on the command line.
@@ -60,6 +60,62 @@ mem_copy(void* dst, void const* src, size_t bytes, DeviceStream stream)
     H2_CHECK_CUDA(cudaMemcpyAsync(dst, src, bytes, cudaMemcpyDefault, stream));
 }
 
+// Widths are in bytes, pitches and heights those of the allocations.
+inline void mem_copy_2d(void* dst,
+                        size_t dst_pitch,
+                        void const* src,
+                        size_t src_pitch,
+                        size_t width,
+                        size_t height,
+                        DeviceStream stream)
+{
+    H2_GPU_TRACE("cudaMemcpy2DAsync(dst={}, dpitch={}, src={}, spitch={}, "
+                "width={}, height={}, kind=cudaMemcpyDefault, stream={})",
+                dst,
+                dst_pitch,
+                src,
+                src_pitch,
+                width,
+                height,
+                (void*) stream);
+    H2_CHECK_CUDA(cudaMemcpy2DAsync(dst,
+                                  dst_pitch,
+                                  src,
+                                  src_pitch,
+                                  width,
+                                  height,
+                                  cudaMemcpyDefault,
+                                  stream));
+}
+
+inline void mem_copy_3d(void* dst,
+                        size_t dst_pitch,
+                        size_t dst_height,
+                        void const* src,
+                        size_t src_pitch,
+                        size_t src_height,
+                        size_t width,
+                        size_t height,
+                        size_t depth,
+                        DeviceStream stream)
+{
+    H2_GPU_TRACE("cudaMemcpy3DAsync(dst={}, src={}, width={}, height={}, "
+                "depth={}, kind=cudaMemcpyDefault, stream={})",
+                dst,
+                src,
+                width,
+                height,
+                depth,
+                (void*) stream);
+    cudaMemcpy3DParms params = {};
+    params.srcPtr = make_cudaPitchedPtr(
+        const_cast<void*>(src), src_pitch, width, src_height);
+    params.dstPtr = make_cudaPitchedPtr(dst, dst_pitch, width, dst_height);
+    params.extent = make_cudaExtent(width, height, depth);
+    params.kind = cudaMemcpyDefault;
+    H2_CHECK_CUDA(cudaMemcpy3DAsync(&params, stream));
+}
+
 inline void mem_zero(void* mem, size_t bytes)
 {
     H2_GPU_TRACE("cudaMemset(mem={}, value=0x0, bytes={})", mem, bytes);
@@ -12,6 +12,9 @@
 
 #include <spdlog/spdlog.h>
 
+#include <atomic>
+#include <cstdint>
+
 // We can ignore the SPDLOG level and manage it here.
 
 #define H2_LOG_LEVEL_TRACE SPDLOG_LEVEL_TRACE
@@ -22,9 +25,15 @@
 #define H2_LOG_LEVEL_CRITICAL SPDLOG_LEVEL_CRITICAL
 #define H2_LOG_LEVEL_OFF SPDLOG_LEVEL_OFF
 
+// Trace messages are issued on hot paths (copies, syncs, streams), so
+// release builds compile them out unless a level is given explicitly.
 #ifndef H2_GPU_LOG_ACTIVE_LEVEL
+#ifdef NDEBUG
+#define H2_GPU_LOG_ACTIVE_LEVEL H2_LOG_LEVEL_DEBUG
+#else
 #define H2_GPU_LOG_ACTIVE_LEVEL H2_LOG_LEVEL_TRACE
-#endif
+#endif // NDEBUG
+#endif // H2_GPU_LOG_ACTIVE_LEVEL
 
 #define H2_GPU_LOG(level, ...)                                                 \
     ::h2::gpu::logger().log(                                                   \
@@ -32,8 +41,17 @@
         level,                                                                 \
         __VA_ARGS__)
 
+// Each trace call site logs only 1 of every trace_sample_period()
+// events, and its arguments are only formatted when it does.
 #if H2_GPU_LOG_ACTIVE_LEVEL <= H2_LOG_LEVEL_TRACE
-#define H2_GPU_TRACE(...) H2_GPU_LOG(::spdlog::level::trace, __VA_ARGS__)
+#define H2_GPU_TRACE(...)                                                      \
+    do                                                                         \
+    {                                                                          \
+        static ::std::atomic<::std::uint64_t> h2_gpu_trace_count_{0};          \
+        if (::h2::gpu::logger().should_log(::spdlog::level::trace)             \
+            && ::h2::gpu::sample_trace(h2_gpu_trace_count_))                   \
+            H2_GPU_LOG(::spdlog::level::trace, __VA_ARGS__);                   \
+    } while (0)
 #else
 #define H2_GPU_TRACE(...) (void) 0
 #endif // H2_GPU_LOG_ACTIVE_LEVEL <= H2_LOG_LEVEL_TRACE
@@ -76,6 +94,44 @@ namespace gpu
 /** @brief Get the spdlog::logger being used to track the GPU logs. */
 spdlog::logger& logger();
 
+} // namespace gpu
+} // namespace h2
+
+namespace h2_internal
+{
+extern std::atomic<std::uint64_t> gpu_trace_sample_period;
+} // namespace h2_internal
+
+namespace h2
+{
+namespace gpu
+{
+
+/** @brief The number of events per trace call site of which one is
+ *         logged.
+ *
+ *  Starts as H2_GPU_TRACE_SAMPLE if that is set to a positive integer,
+ *  otherwise 1, which logs every event.
+ */
+inline std::uint64_t trace_sample_period() noexcept
+{
+    return h2_internal::gpu_trace_sample_period.load(
+        std::memory_order_relaxed);
+}
+
+/** @brief Set the trace sampling period; 0 is treated as 1. */
+void set_trace_sample_period(std::uint64_t period) noexcept;
+
+/** @brief Count an event of a trace call site and decide whether it is
+ *         logged.
+ */
+inline bool sample_trace(std::atomic<std::uint64_t>& count) noexcept
+{
+    auto const period = trace_sample_period();
+    auto const n = count.fetch_add(1, std::memory_order_relaxed);
+    return period <= 1 || n % period == 0;
+}
+
 } // namespace gpu
 } // namespace h2
 #endif // H2_INCLUDE_H2_GPU_LOGGER_HPP_INCLUDED
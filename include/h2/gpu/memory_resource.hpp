@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef H2_INCLUDE_H2_GPU_MEMORY_RESOURCE_HPP_INCLUDED
+#define H2_INCLUDE_H2_GPU_MEMORY_RESOURCE_HPP_INCLUDED
+
+/** @file
+ *
+ *  Memory resources shared by the allocators of H2 and of its
+ *  libraries, so that all of them draw from the same pools. They are
+ *  accessible in the h2::gpu namespace.
+ *
+ *  enum class MemoryKind;
+ *  class MemoryResource;
+ *
+ *  MemoryResource& device_memory_resource();
+ *  MemoryResource& pinned_host_memory_resource();
+ *  MemoryResource& managed_memory_resource();
+ *
+ */
+
+#include "h2_config.hpp"
+#include "runtime.hpp"
+
+#include <string>
+
+namespace h2
+{
+namespace gpu
+{
+
+enum class MemoryKind
+{
+    /** Memory of the current device. */
+    DEVICE,
+    /** Page-locked host memory accessible from all devices. */
+    PINNED_HOST,
+    /** Memory migrated between the host and the devices on access. */
+    MANAGED
+};
+
+/** @brief Source of memory of one kind.
+ *
+ *  allocate throws a GPUError if the memory cannot be allocated. The
+ *  stream follows the contract of DeviceAllocator: memory may be used
+ *  by work on it right away and is reused once the work enqueued on it
+ *  before deallocate is done. Resources of host-accessible memory
+ *  ignore it.
+ */
+class MemoryResource
+{
+public:
+    virtual ~MemoryResource() = default;
+
+    virtual MemoryKind kind() const noexcept = 0;
+
+    /** @brief Name used in logs. */
+    virtual std::string const& name() const noexcept = 0;
+
+    virtual void* allocate(size_t bytes, DeviceStream stream) = 0;
+    virtual void deallocate(void* ptr) = 0;
+};
+
+/** @brief Device memory from default_device_allocator(). */
+MemoryResource& device_memory_resource();
+
+/** @brief Pinned host memory from {cuda,hip}HostAlloc.
+ *
+ *  Allocations are not cached; callers allocating often should pool
+ *  them on top of this resource.
+ */
+MemoryResource& pinned_host_memory_resource();
+
+/** @brief Managed memory from {cuda,hip}MallocManaged. */
+MemoryResource& managed_memory_resource();
+
+} // namespace gpu
+} // namespace h2
+#endif // H2_INCLUDE_H2_GPU_MEMORY_RESOURCE_HPP_INCLUDED
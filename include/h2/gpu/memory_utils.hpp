@@ -24,10 +24,29 @@
  *  typedef {cub,hipcub}::CachingDeviceAllocator RawCUBAllocType;
  *  RawCUBAllocType& default_cub_allocator();
  *
+ *  struct DeviceAllocatorStats;
+ *  class DeviceAllocator;
+ *  DeviceAllocator& default_device_allocator();
+ *  std::unique_ptr<DeviceAllocator> make_cub_device_allocator(...);
+ *  std::unique_ptr<DeviceAllocator> make_async_device_allocator(...);
+ *  std::unique_ptr<DeviceAllocator> make_reserved_device_allocator(...);
+ *
  *  void mem_copy(void* dst, void const* src, size_t bytes);
  *  void mem_copy(void* dst, void const* src, size_t bytes,
  *                DeviceStream stream);
  *
+ *  void mem_copy_2d(void* dst, size_t dst_pitch,
+ *                   void const* src, size_t src_pitch,
+ *                   size_t width, size_t height, DeviceStream stream);
+ *  void mem_copy_3d(void* dst, size_t dst_pitch, size_t dst_height,
+ *                   void const* src, size_t src_pitch, size_t src_height,
+ *                   size_t width, size_t height, size_t depth,
+ *                   DeviceStream stream);
+ *
+ *  struct MemCopyDesc;
+ *  void mem_copy_batch(std::vector<MemCopyDesc> const& copies,
+ *                      DeviceStream stream);
+ *
  *  void mem_zero(void* mem, size_t bytes);
  *  void mem_zero(void* mem, size_t bytes, DeviceStream stream);
  *
@@ -47,6 +66,10 @@
 #include "h2_config.hpp"
 #include "runtime.hpp"
 
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace h2
 {
 namespace gpu
@@ -80,6 +103,152 @@ namespace gpu
 
 RawCUBAllocType& default_cub_allocator();
 
+/** @brief Statistics of a DeviceAllocator on one device. */
+struct DeviceAllocatorStats
+{
+    /** Successful allocations and those served from cached memory. */
+    size_t num_allocs = 0;
+    size_t num_cache_hits = 0;
+    /** Requested bytes not deallocated yet and their maximum. */
+    size_t bytes_in_use = 0;
+    size_t peak_bytes_in_use = 0;
+    /** Bytes held for the memory in use, including rounding. */
+    size_t bytes_reserved = 0;
+    /** Bytes held for memory not in use. */
+    size_t bytes_cached = 0;
+
+    double hit_rate() const noexcept
+    {
+        return num_allocs ? static_cast<double>(num_cache_hits) / num_allocs
+                          : 0.0;
+    }
+
+    /** @brief Fraction of the reserved bytes lost to rounding. */
+    double fragmentation() const noexcept
+    {
+        return bytes_reserved ? 1.0
+                                    - static_cast<double>(bytes_in_use)
+                                          / bytes_reserved
+                              : 0.0;
+    }
+};
+
+std::string to_string(DeviceAllocatorStats const& stats);
+
+/** @brief Stream-ordered device memory allocator.
+ *
+ *  Memory returned by allocate may be used by work on the given stream
+ *  right away, and on other streams once they are synchronized with
+ *  it. Memory passed to deallocate may be reused by work ordered after
+ *  the work already enqueued on the stream of its allocation. This is
+ *  the contract of (HIP)CUB's CachingDeviceAllocator, which is one of
+ *  the backends.
+ */
+class DeviceAllocator
+{
+public:
+    enum class Backend
+    {
+        /** (HIP)CUB caching allocator with geometric bins. */
+        CUB,
+        /** Stream-ordered memory pools of the runtime
+         *  ({cuda,hip}MallocFromPoolAsync). Allocations are not rounded
+         *  to bin sizes. */
+        ASYNC,
+        /** One chunk reserved per device on first use and sub-allocated
+         *  with best fit. */
+        RESERVED
+    };
+
+    virtual ~DeviceAllocator() = default;
+
+    virtual Backend backend() const noexcept = 0;
+
+    /** @brief Name used in logs. */
+    virtual std::string const& name() const noexcept = 0;
+
+    virtual DeviceError
+    allocate(void** ptr, size_t bytes, DeviceStream stream) = 0;
+    virtual DeviceError deallocate(void* ptr) = 0;
+
+    /** @brief Return the cached memory not in use to the system.
+     *
+     *  Meant to be called between phases with different memory
+     *  footprints.
+     */
+    virtual void release_unused() = 0;
+
+    /** @brief Statistics of the allocations on the given device. */
+    virtual DeviceAllocatorStats stats(int device) const = 0;
+
+    /** @brief Largest allocation up to limit that the allocator can
+     *         serve on the given device without growing.
+     */
+    virtual size_t max_allocatable_size(size_t limit, int device) const
+    {
+        return limit;
+    }
+
+    /** @brief Log the statistics of all devices used at info level. */
+    void log_stats() const;
+};
+
+/** @brief The allocator selected by H2_DEVICE_ALLOCATOR.
+ *
+ *  Every allocator logs its statistics each
+ *  H2_ALLOCATOR_STATS_INTERVAL allocations if that is set.
+ */
+DeviceAllocator& default_device_allocator();
+
+/** @brief Allocator backed by a new (HIP)CUB caching allocator. */
+std::unique_ptr<DeviceAllocator>
+make_cub_device_allocator(unsigned int bin_growth,
+                          unsigned int min_bin,
+                          unsigned int max_bin,
+                          size_t max_cached_bytes,
+                          bool debug,
+                          std::string name = "cub");
+
+/** @brief Allocator backed by stream-ordered memory pools.
+ *
+ *  One pool is created per device. Pools keep up to release_threshold
+ *  bytes of freed memory cached at stream synchronization points; the
+ *  rest is returned to the system.
+ */
+std::unique_ptr<DeviceAllocator>
+make_async_device_allocator(size_t release_threshold,
+                            std::string name = "async");
+
+/** @brief Allocator backed by one chunk of memory per device.
+ *
+ *  The chunk holds reserve_bytes, or reserve_fraction of the device
+ *  memory if reserve_bytes is 0. It is allocated on the first use on a
+ *  device and kept until the allocator is destroyed. Allocations that
+ *  do not fit in it are served by default_cub_allocator().
+ */
+std::unique_ptr<DeviceAllocator>
+make_reserved_device_allocator(size_t reserve_bytes,
+                               double reserve_fraction,
+                               std::string name = "reserved");
+
+/** @brief One contiguous copy of a batch. */
+struct MemCopyDesc
+{
+    void* dst;
+    void const* src;
+    size_t bytes;
+};
+
+/** @brief Enqueue the copies on stream as one batch.
+ *
+ *  A copy whose source and destination both continue those of the
+ *  previous copy is merged with it. The regions must not overlap. The
+ *  copies are submitted with a single cudaMemcpyBatchAsync where the
+ *  runtime supports it and one by one otherwise.
+ */
+void mem_copy_batch(std::vector<MemCopyDesc> const& copies,
+                    DeviceStream stream);
+
 template <typename T>
 inline void mem_copy(T* dst, T const* src)
 {
@@ -0,0 +1,133 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef H2_INCLUDE_H2_GPU_POOLS_HPP_INCLUDED
+#define H2_INCLUDE_H2_GPU_POOLS_HPP_INCLUDED
+
+/** @file
+ *
+ *  Pools of streams and events that are reused instead of being
+ *  created and destroyed by every user. Handles are acquired on the
+ *  current device and return to the pool of that device when they are
+ *  destroyed. They are accessible in the h2::gpu namespace.
+ *
+ *  PooledStream acquire_stream();
+ *  PooledStream acquire_stream_nonblocking();
+ *  PooledStream acquire_stream_with_priority(int priority);
+ *
+ *  PooledEvent acquire_event();
+ *  PooledEvent acquire_event_notiming();
+ *
+ *  DeviceStream high_priority_stream();
+ *  DeviceStream low_priority_stream();
+ *
+ *  void release_pooled_resources();
+ *
+ *  A stream or event returned to its pool may be handed out again
+ *  right away, so users must not rely on work enqueued on it after
+ *  the handle is released.
+ */
+
+#include "h2_config.hpp"
+#include "runtime.hpp"
+
+namespace h2
+{
+namespace gpu
+{
+
+/** @brief Move-only owner of a stream or event borrowed from a pool. */
+template <typename HandleT>
+class PooledHandle
+{
+public:
+    PooledHandle() noexcept = default;
+    PooledHandle(HandleT handle, int device, int kind) noexcept
+        : m_handle{handle}, m_device{device}, m_kind{kind}
+    {}
+    PooledHandle(PooledHandle const&) = delete;
+    PooledHandle& operator=(PooledHandle const&) = delete;
+    PooledHandle(PooledHandle&& other) noexcept
+        : m_handle{other.m_handle}, m_device{other.m_device},
+          m_kind{other.m_kind}
+    {
+        other.m_handle = nullptr;
+    }
+    PooledHandle& operator=(PooledHandle&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            m_handle = other.m_handle;
+            m_device = other.m_device;
+            m_kind = other.m_kind;
+            other.m_handle = nullptr;
+        }
+        return *this;
+    }
+    ~PooledHandle() { reset(); }
+
+    HandleT get() const noexcept { return m_handle; }
+    operator HandleT() const noexcept { return m_handle; }
+    explicit operator bool() const noexcept { return m_handle != nullptr; }
+    int device() const noexcept { return m_device; }
+
+    /** @brief Return the handle to its pool now. */
+    void reset() noexcept;
+
+private:
+    HandleT m_handle = nullptr;
+    int m_device = -1;
+    // Identifies the pool of the device the handle belongs to.
+    int m_kind = 0;
+};
+
+extern template class PooledHandle<DeviceStream>;
+extern template class PooledHandle<DeviceEvent>;
+
+using PooledStream = PooledHandle<DeviceStream>;
+using PooledEvent = PooledHandle<DeviceEvent>;
+
+PooledStream acquire_stream();
+PooledStream acquire_stream_nonblocking();
+/** @brief Acquire a non-blocking stream with the given priority.
+ *
+ *  The priority is clamped to the range supported by the device;
+ *  lower values mean higher priority.
+ */
+PooledStream acquire_stream_with_priority(int priority);
+
+PooledEvent acquire_event();
+PooledEvent acquire_event_notiming();
+
+/** @brief Non-blocking stream of the current device with its greatest
+ *         priority, shared by all users.
+ *
+ *  Meant for short latency-bound work such as halo packing and
+ *  transfers, which then overtakes the bulk compute queued on streams
+ *  of lower priority. Since all users queue on the same stream, work
+ *  enqueued on it must never wait for something that is only
+ *  released by later work, such as a stream wait on a flag written
+ *  from the same stream.
+ */
+DeviceStream high_priority_stream();
+/** @brief Non-blocking stream of the current device with its least
+ *         priority, shared by all users.
+ */
+DeviceStream low_priority_stream();
+
+/** @brief Destroy the streams and events held idle by the pools.
+ *
+ *  The shared priority streams are destroyed too. Handles still in
+ *  use return to the pools as usual.
+ */
+void release_pooled_resources();
+
+} // namespace gpu
+} // namespace h2
+
+#endif // H2_INCLUDE_H2_GPU_POOLS_HPP_INCLUDED
@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef H2_INCLUDE_H2_GPU_RANGES_HPP_INCLUDED
+#define H2_INCLUDE_H2_GPU_RANGES_HPP_INCLUDED
+
+/** @file
+ *
+ *  Named ranges of host code shown on the timelines of profilers,
+ *  backed by NVTX with CUDA and by roctx with ROCm. Ranges nest per
+ *  thread, so enclosing ranges show the pipeline of a layer as a
+ *  hierarchy.
+ *
+ *  Ranges are off by default. They are turned on by setting
+ *  H2_GPU_RANGES to a truthy value or with set_ranges_enabled. While
+ *  off, a range costs a relaxed load and a branch; without a GPU
+ *  runtime, ranges are only counted.
+ *
+ *  ScopedRange r(domain, "halo_exchange", RangeCategory::HaloExchange);
+ *  H2_GPU_RANGE(domain, "forward", RangeCategory::Compute);
+ */
+
+#include "h2_config.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+namespace h2
+{
+namespace gpu
+{
+
+/** @brief Kind of work in a range, colored alike on timelines. */
+enum class RangeCategory : std::uint32_t
+{
+    Compute = 1,
+    HaloExchange,
+    Shuffle,
+    Collective,
+    Memory,
+    Runtime,
+};
+
+char const* to_string(RangeCategory category) noexcept;
+
+/** @brief A named group of ranges, such as those of a library.
+ *
+ *  NVTX shows each domain separately. roctx has no domains, so the
+ *  names of the ranges are prefixed with that of the domain instead.
+ *  Domains are meant to live as long as the program.
+ */
+class RangeDomain
+{
+public:
+    explicit RangeDomain(char const* name) noexcept : m_name{name} {}
+    RangeDomain(RangeDomain const&) = delete;
+    RangeDomain& operator=(RangeDomain const&) = delete;
+
+    char const* name() const noexcept { return m_name; }
+
+    /** @brief The native handle, created on first use. */
+    void* handle() const;
+
+private:
+    char const* m_name;
+    mutable std::atomic<void*> m_handle{nullptr};
+};
+
+/** @brief The domain of the ranges of H2 itself. */
+RangeDomain const& h2_range_domain();
+
+} // namespace gpu
+} // namespace h2
+
+namespace h2_internal
+{
+extern std::atomic<bool> gpu_ranges_enabled;
+} // namespace h2_internal
+
+namespace h2
+{
+namespace gpu
+{
+
+inline bool ranges_enabled() noexcept
+{
+    return h2_internal::gpu_ranges_enabled.load(std::memory_order_relaxed);
+}
+
+void set_ranges_enabled(bool enabled) noexcept;
+
+/** @brief Open a range on the calling thread regardless of whether
+ *         ranges are enabled. Prefer ScopedRange.
+ */
+void range_push(RangeDomain const& domain,
+                char const* name,
+                RangeCategory category);
+/** @brief Close the innermost range of domain on the calling thread. */
+void range_pop(RangeDomain const& domain);
+
+/** @brief Number of ranges open on the calling thread. */
+int range_depth() noexcept;
+
+/** @brief A range spanning the lifetime of the object if ranges are
+ *         enabled when it is created.
+ */
+class ScopedRange
+{
+public:
+    ScopedRange(RangeDomain const& domain,
+                char const* name,
+                RangeCategory category)
+        : m_domain{ranges_enabled() ? &domain : nullptr}
+    {
+        if (m_domain)
+            range_push(domain, name, category);
+    }
+    ScopedRange(ScopedRange const&) = delete;
+    ScopedRange& operator=(ScopedRange const&) = delete;
+    ~ScopedRange()
+    {
+        if (m_domain)
+            range_pop(*m_domain);
+    }
+
+private:
+    RangeDomain const* m_domain;
+};
+
+} // namespace gpu
+} // namespace h2
+
+#define H2_GPU_RANGE_CONCAT_IMPL(a, b) a##b
+#define H2_GPU_RANGE_CONCAT(a, b) H2_GPU_RANGE_CONCAT_IMPL(a, b)
+
+/** @brief Mark the rest of the enclosing scope as a range. */
+#define H2_GPU_RANGE(domain, name, category)                                   \
+    ::h2::gpu::ScopedRange H2_GPU_RANGE_CONCAT(h2_gpu_range_, __LINE__)        \
+    {                                                                          \
+        domain, name, category                                                 \
+    }
+
+#endif // H2_INCLUDE_H2_GPU_RANGES_HPP_INCLUDED
@@ -62,6 +62,62 @@ inline void mem_copy(void* const dst,
     H2_CHECK_HIP(hipMemcpyAsync(dst, src, bytes, hipMemcpyDefault, stream));
 }
 
+// Widths are in bytes, pitches and heights those of the allocations.
+inline void mem_copy_2d(void* dst,
+                        size_t dst_pitch,
+                        void const* src,
+                        size_t src_pitch,
+                        size_t width,
+                        size_t height,
+                        DeviceStream stream)
+{
+    H2_GPU_TRACE("hipMemcpy2DAsync(dst={}, dpitch={}, src={}, spitch={}, "
+                "width={}, height={}, kind=hipMemcpyDefault, stream={})",
+                dst,
+                dst_pitch,
+                src,
+                src_pitch,
+                width,
+                height,
+                (void*) stream);
+    H2_CHECK_HIP(hipMemcpy2DAsync(dst,
+                                  dst_pitch,
+                                  src,
+                                  src_pitch,
+                                  width,
+                                  height,
+                                  hipMemcpyDefault,
+                                  stream));
+}
+
+inline void mem_copy_3d(void* dst,
+                        size_t dst_pitch,
+                        size_t dst_height,
+                        void const* src,
+                        size_t src_pitch,
+                        size_t src_height,
+                        size_t width,
+                        size_t height,
+                        size_t depth,
+                        DeviceStream stream)
+{
+    H2_GPU_TRACE("hipMemcpy3DAsync(dst={}, src={}, width={}, height={}, "
+                "depth={}, kind=hipMemcpyDefault, stream={})",
+                dst,
+                src,
+                width,
+                height,
+                depth,
+                (void*) stream);
+    hipMemcpy3DParms params = {};
+    params.srcPtr = make_hipPitchedPtr(
+        const_cast<void*>(src), src_pitch, width, src_height);
+    params.dstPtr = make_hipPitchedPtr(dst, dst_pitch, width, dst_height);
+    params.extent = make_hipExtent(width, height, depth);
+    params.kind = hipMemcpyDefault;
+    H2_CHECK_HIP(hipMemcpy3DAsync(&params, stream));
+}
+
 inline void mem_zero(void* mem, size_t bytes)
 {
     H2_GPU_TRACE("hipMemset(mem={}, value=0x0, bytes={})", mem, bytes);
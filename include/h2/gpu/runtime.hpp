@@ -20,29 +20,44 @@
  *  int num_gpus();
  *  int current_gpu();
  *  void set_gpu(int id);
+ *  class DeviceGuard;
  *
  *  void init_runtime();
  *  void finalize_runtime();
  *  bool runtime_is_initialized();
  *  bool runtime_is_finalized();
  *
+ *  void submit_init_task(std::function<void()> task);
+ *  std::future<R> run_at_init(F&& f);
+ *  void wait_for_runtime();
+ *
  *  bool ok(DeviceError) noexcept;
  *
  *  DeviceStream make_stream();
  *  DeviceStream make_stream_nonblocking();
+ *  DeviceStream make_stream_with_priority(int priority); // Non-blocking
+ *  StreamPriorityRange stream_priority_range();
  *  void destroy(DeviceStream);
  *
  *  DeviceEvent make_event();
  *  DeviceEvent make_event_notiming();
  *  void destroy(DeviceEvent);
  *
+ *  void record_event(DeviceEvent, DeviceStream);
+ *
  *  void sync();             // Device Sync
  *  void sync(DeviceEvent);  // Sync on event.
  *  void sync(DeviceStream); // Sync on stream.
+ *  void sync(DeviceStream, DeviceEvent); // Stream waits on event.
  */
 
 #include "h2_config.hpp"
 
+#include <functional>
+#include <future>
+#include <memory>
+#include <utility>
+
 // This adds the runtime-specific stuff.
 #if H2_HAS_CUDA
 #include "cuda/runtime.hpp"
@@ -60,22 +75,99 @@ int num_gpus();
 int current_gpu();
 void set_gpu(int id);
 
+/** @brief Make a device current until the end of the scope.
+ *
+ *  The previously current device is restored on destruction. Meant
+ *  for processes driving several devices, where resources of a device
+ *  are used or released while another one is current.
+ */
+class DeviceGuard
+{
+public:
+    explicit DeviceGuard(int device) : m_prev{current_gpu()}
+    {
+        if (m_prev != device)
+            set_gpu(device);
+    }
+    ~DeviceGuard()
+    {
+        if (m_prev != current_gpu())
+            set_gpu(m_prev);
+    }
+    DeviceGuard(DeviceGuard const&) = delete;
+    DeviceGuard& operator=(DeviceGuard const&) = delete;
+
+private:
+    int const m_prev;
+};
+
 void init_runtime();
 void finalize_runtime();
 bool runtime_is_initialized();
 bool runtime_is_finalized();
 
+/** @brief Run task on the background initialization thread.
+ *
+ *  With H2_ASYNC_INIT, init_runtime creates the device context on a
+ *  separate thread and returns right away. Tasks submitted until
+ *  finalize_runtime run there in order, after the context is created,
+ *  with the device selected by init_runtime. Otherwise, the task runs
+ *  right away on the calling thread.
+ */
+void submit_init_task(std::function<void()> task);
+
+/** @brief Run f as an initialization task and get its result.
+ *
+ *  Meant for setup that is expensive but not needed right away, such
+ *  as creating DNN library handles.
+ */
+template <typename F>
+auto run_at_init(F&& f) -> std::future<decltype(f())>
+{
+    using ResultT = decltype(f());
+    auto task =
+        std::make_shared<std::packaged_task<ResultT()>>(std::forward<F>(f));
+    auto result = task->get_future();
+    submit_init_task([task] { (*task)(); });
+    return result;
+}
+
+/** @brief Block until the initialization tasks submitted so far are
+ *         done.
+ *
+ *  Rethrows the first exception thrown by a task not run through
+ *  run_at_init.
+ */
+void wait_for_runtime();
+
 DeviceStream make_stream();
 DeviceStream make_stream_nonblocking();
+DeviceStream make_stream_with_priority(int priority); // Non-blocking
 void destroy(DeviceStream);
 
+// Lower values mean higher priority, so greatest <= least.
+struct StreamPriorityRange
+{
+    int least;
+    int greatest;
+};
+StreamPriorityRange stream_priority_range();
+
 DeviceEvent make_event();
 DeviceEvent make_event_notiming();
 void destroy(DeviceEvent);
 
+/** @brief Record event after the work enqueued on stream so far. */
+void record_event(DeviceEvent event, DeviceStream stream);
+
 void sync();             // Device Sync
 void sync(DeviceEvent);  // Sync on event.
 void sync(DeviceStream); // Sync on stream.
+/** @brief Order the work enqueued on stream from now on after event.
+ *
+ *  Does not block the host.
+ */
+void sync(DeviceStream stream, DeviceEvent event);
 
 } // namespace gpu
 } // namespace h2
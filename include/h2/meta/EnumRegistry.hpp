@@ -0,0 +1,204 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2020 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef H2_META_ENUMREGISTRY_HPP_
+#define H2_META_ENUMREGISTRY_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace h2
+{
+namespace meta
+{
+
+/** @brief A value of an enumeration and its name. */
+template <typename EnumT>
+struct EnumEntry
+{
+    EnumT value;
+    char const* name;
+};
+
+/** @brief A compile-time table of the names of an enumeration.
+ *
+ *  The registry maps each listed value to its name and back in
+ *  constant expected time, through two open-addressing hash tables
+ *  built when the registry is constructed. Registries are meant to be
+ *  `constexpr` variables, so building the tables costs nothing at
+ *  run time and a duplicate value or name is a compile-time error:
+ *
+ *  @code{.cpp}
+ *  enum class Color { Red, Green };
+ *  inline constexpr auto color_registry =
+ *      h2::meta::make_enum_registry<Color>(
+ *          {{Color::Red, "Red"}, {Color::Green, "Green"}});
+ *  static_assert(*color_registry.find("Green") == Color::Green);
+ *  @endcode
+ *
+ *  Iterating the registry lists its entries in the order they were
+ *  given.
+ */
+template <typename EnumT, std::size_t N>
+class EnumRegistry
+{
+    static_assert(std::is_enum<EnumT>::value,
+                  "EnumRegistry requires an enumeration type.");
+    static_assert(N > 0, "EnumRegistry requires at least one entry.");
+
+public:
+    using enum_type = EnumT;
+    using entry_type = EnumEntry<EnumT>;
+
+    constexpr explicit EnumRegistry(entry_type const (&entries)[N])
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            m_entries[i] = entries[i];
+            insert(m_by_value, hash_value(entries[i].value), i, [&](auto j) {
+                return m_entries[j].value == entries[i].value;
+            });
+            insert(m_by_name, hash_name(entries[i].name), i, [&](auto j) {
+                return std::string_view(m_entries[j].name)
+                       == std::string_view(entries[i].name);
+            });
+        }
+    }
+
+    /** @brief The number of registered values. */
+    static constexpr std::size_t size() noexcept { return N; }
+
+    constexpr entry_type const* begin() const noexcept { return m_entries; }
+    constexpr entry_type const* end() const noexcept { return m_entries + N; }
+
+    /** @brief The name of a value, or nullptr if it is not registered. */
+    constexpr char const* name(EnumT const value) const noexcept
+    {
+        auto const i = lookup(m_by_value, hash_value(value), [&](auto j) {
+            return m_entries[j].value == value;
+        });
+        return i == N ? nullptr : m_entries[i].name;
+    }
+
+    /** @brief The value of a name, or nullptr if it is not registered. */
+    constexpr EnumT const* find(std::string_view const name) const noexcept
+    {
+        auto const i = lookup(m_by_name, hash_name(name), [&](auto j) {
+            return std::string_view(m_entries[j].name) == name;
+        });
+        return i == N ? nullptr : &m_entries[i].value;
+    }
+
+    constexpr bool contains(EnumT const value) const noexcept
+    {
+        return name(value) != nullptr;
+    }
+
+    constexpr bool contains(std::string_view const name) const noexcept
+    {
+        return find(name) != nullptr;
+    }
+
+    /** @brief The registered names joined by the separator. */
+    std::string names(char const* const sep = ", ") const
+    {
+        std::string out;
+        for (auto const& e : *this)
+        {
+            if (!out.empty())
+                out += sep;
+            out += e.name;
+        }
+        return out;
+    }
+
+private:
+    // Twice the number of entries, rounded up to a power of two, so
+    // that probe sequences stay short.
+    static constexpr std::size_t table_size()
+    {
+        std::size_t n = 1;
+        while (n < 2 * N)
+            n *= 2;
+        return n;
+    }
+
+    // Slots hold an entry index plus one; zero marks an empty slot.
+    using TableT = std::size_t[table_size()];
+
+    static constexpr std::size_t hash_value(EnumT const value) noexcept
+    {
+        auto const v = static_cast<std::uint64_t>(
+            static_cast<std::underlying_type_t<EnumT>>(value));
+        return static_cast<std::size_t>((v * 0x9E3779B97F4A7C15ull) >> 32);
+    }
+
+    // FNV-1a.
+    static constexpr std::size_t
+    hash_name(std::string_view const name) noexcept
+    {
+        std::uint64_t h = 0xCBF29CE484222325ull;
+        for (char const c : name)
+        {
+            h ^= static_cast<unsigned char>(c);
+            h *= 0x100000001B3ull;
+        }
+        return static_cast<std::size_t>(h);
+    }
+
+    template <typename EqualF>
+    static constexpr void
+    insert(TableT& table, std::size_t const hash, std::size_t idx, EqualF eq)
+    {
+        for (std::size_t s = hash;; ++s)
+        {
+            auto& slot = table[s & (table_size() - 1)];
+            if (slot == 0)
+            {
+                slot = idx + 1;
+                return;
+            }
+            if (eq(slot - 1))
+                throw std::logic_error("Duplicate entry in EnumRegistry");
+        }
+    }
+
+    // Index of the matching entry, or N.
+    template <typename EqualF>
+    static constexpr std::size_t
+    lookup(TableT const& table, std::size_t const hash, EqualF eq) noexcept
+    {
+        for (std::size_t s = hash;; ++s)
+        {
+            auto const slot = table[s & (table_size() - 1)];
+            if (slot == 0)
+                return N;
+            if (eq(slot - 1))
+                return slot - 1;
+        }
+    }
+
+    entry_type m_entries[N] = {};
+    TableT m_by_value = {};
+    TableT m_by_name = {};
+}; // class EnumRegistry
+
+/** @brief Build an EnumRegistry, deducing its size from the entries. */
+template <typename EnumT, std::size_t N>
+constexpr EnumRegistry<EnumT, N>
+make_enum_registry(EnumEntry<EnumT> const (&entries)[N])
+{
+    return EnumRegistry<EnumT, N>(entries);
+}
+
+} // namespace meta
+} // namespace h2
+#endif // H2_META_ENUMREGISTRY_HPP_
@@ -0,0 +1,74 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2020 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef H2_META_TYPELIST_CARTESIANPRODUCT_HPP_
+#define H2_META_TYPELIST_CARTESIANPRODUCT_HPP_
+
+#include "Append.hpp"
+#include "LispAccessors.hpp"
+#include "TypeList.hpp"
+#include "h2/meta/core/Lazy.hpp"
+
+namespace h2
+{
+namespace meta
+{
+namespace tlist
+{
+/** @brief Form all combinations of one type from each list.
+ *
+ *  The result is a list of typelists, ordered with the last list
+ *  varying fastest. E.g., CartesianProduct<TL<A, B>, TL<X, Y>> is
+ *  TL<TL<A, X>, TL<A, Y>, TL<B, X>, TL<B, Y>>.
+ */
+template <typename... Lists>
+struct CartesianProductT;
+
+/** @brief Form all combinations of one type from each list. */
+template <typename... Lists>
+using CartesianProduct = Force<CartesianProductT<Lists...>>;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+namespace internal
+{
+template <typename T, typename Lists>
+struct ConsToEachT;
+
+template <typename T, typename... Lists>
+struct ConsToEachT<T, TL<Lists...>>
+{
+    using type = TL<Cons<T, Lists>...>;
+};
+
+template <typename T, typename Lists>
+using ConsToEach = Force<ConsToEachT<T, Lists>>;
+} // namespace internal
+
+// Base case: the only combination of no lists is the empty one.
+template <>
+struct CartesianProductT<>
+{
+    using type = TL<Empty>;
+};
+
+// Recursive case
+template <typename... Ts, typename... Lists>
+struct CartesianProductT<TL<Ts...>, Lists...>
+{
+private:
+    using Rest_ = CartesianProduct<Lists...>;
+
+public:
+    using type = Append<Empty, internal::ConsToEach<Ts, Rest_>...>;
+};
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+} // namespace tlist
+} // namespace meta
+} // namespace h2
+#endif // H2_META_TYPELIST_CARTESIANPRODUCT_HPP_
@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2020 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef H2_PATTERNS_FACTORY_BUILDERSTORAGE_HPP_
+#define H2_PATTERNS_FACTORY_BUILDERSTORAGE_HPP_
+
+#include <cstddef>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace h2
+{
+namespace factory
+{
+/** @class HashStorage
+ *  @brief Store values keyed by ID in a hash table.
+ *
+ *  This is the storage policy of factories by default, suitable for
+ *  any hashable ID.
+ */
+template <typename IdType, typename ValueType>
+class HashStorage
+{
+public:
+    using id_type = IdType;
+    using value_type = ValueType;
+    using map_type = std::unordered_map<id_type, value_type>;
+    using size_type = typename map_type::size_type;
+
+public:
+    /** @brief Add a value for @c id unless it already has one. */
+    bool emplace(id_type id, value_type value)
+    {
+        return map_
+            .emplace(std::piecewise_construct,
+                     std::forward_as_tuple(std::move(id)),
+                     std::forward_as_tuple(std::move(value)))
+            .second;
+    }
+
+    /** @brief Remove the value for @c id. */
+    bool erase(id_type const& id) { return (map_.erase(id) == 1); }
+
+    /** @brief Get the value for @c id, or nullptr if there is none. */
+    value_type* find(id_type const& id)
+    {
+        auto it = map_.find(id);
+        return (it != map_.end() ? &(it->second) : nullptr);
+    }
+
+    value_type const* find(id_type const& id) const
+    {
+        auto it = map_.find(id);
+        return (it != map_.end() ? &(it->second) : nullptr);
+    }
+
+    /** @brief Call @c f with each ID and its value. */
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        for (auto const& x : map_)
+            f(x.first, x.second);
+    }
+
+    /** @brief Get the number of values stored. */
+    size_type size() const noexcept { return map_.size(); }
+
+private:
+    map_type map_;
+};
+
+/** @class DenseStorage
+ *  @brief Store values keyed by small non-negative integer or enum IDs
+ *         in a flat array.
+ *
+ *  IDs in [0, max_dense_id) index an array directly, with no hashing.
+ *  Other IDs fall back to a hash table, so sparse IDs are still
+ *  accepted.
+ */
+template <typename IdType, typename ValueType>
+class DenseStorage
+{
+    static_assert(std::is_integral<IdType>::value
+                      || std::is_enum<IdType>::value,
+                  "Dense storage needs integral or enum IDs.");
+
+public:
+    using id_type = IdType;
+    using value_type = ValueType;
+    using size_type = std::size_t;
+
+    /** @brief IDs below this are stored in the flat array. */
+    static constexpr size_type max_dense_id = 256;
+
+public:
+    bool emplace(id_type id, value_type value)
+    {
+        if (!is_dense(id))
+            return sparse_.emplace(id, std::move(value));
+        auto const idx = index(id);
+        if (idx >= dense_.size())
+            dense_.resize(idx + 1);
+        if (dense_[idx])
+            return false;
+        dense_[idx].emplace(std::move(value));
+        ++num_dense_;
+        return true;
+    }
+
+    bool erase(id_type const& id)
+    {
+        if (!is_dense(id))
+            return sparse_.erase(id);
+        auto const idx = index(id);
+        if (idx >= dense_.size() || !dense_[idx])
+            return false;
+        dense_[idx].reset();
+        --num_dense_;
+        return true;
+    }
+
+    value_type* find(id_type const& id)
+    {
+        if (!is_dense(id))
+            return sparse_.find(id);
+        auto const idx = index(id);
+        return (idx < dense_.size() && dense_[idx] ? &(*dense_[idx])
+                                                   : nullptr);
+    }
+
+    value_type const* find(id_type const& id) const
+    {
+        return const_cast<DenseStorage&>(*this).find(id);
+    }
+
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        for (size_type i = 0; i < dense_.size(); ++i)
+            if (dense_[i])
+                f(static_cast<id_type>(i), *dense_[i]);
+        sparse_.for_each(f);
+    }
+
+    size_type size() const noexcept { return num_dense_ + sparse_.size(); }
+
+private:
+    static auto to_integer(id_type const& id) noexcept
+    {
+        if constexpr (std::is_enum<id_type>::value)
+            return static_cast<std::underlying_type_t<id_type>>(id);
+        else
+            return id;
+    }
+
+    static bool is_dense(id_type const& id) noexcept
+    {
+        auto const i = to_integer(id);
+        if constexpr (std::is_signed<decltype(i)>::value)
+            if (i < 0)
+                return false;
+        return static_cast<size_type>(i) < max_dense_id;
+    }
+
+    static size_type index(id_type const& id) noexcept
+    {
+        return static_cast<size_type>(to_integer(id));
+    }
+
+    std::vector<std::optional<value_type>> dense_;
+    size_type num_dense_ = 0;
+    HashStorage<id_type, value_type> sparse_;
+};
+
+} // namespace factory
+} // namespace h2
+#endif // H2_PATTERNS_FACTORY_BUILDERSTORAGE_HPP_
@@ -8,13 +8,15 @@
 #ifndef H2_PATTERNS_FACTORY_OBJECTFACTORY_HPP_
 #define H2_PATTERNS_FACTORY_OBJECTFACTORY_HPP_
 
+#include "BuilderStorage.hpp"
 #include "DefaultErrorPolicy.hpp"
 
 #include <functional>
 #include <list>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
 #include <utility>
+#include <vector>
 
 namespace h2
 {
@@ -27,33 +29,126 @@ namespace factory
  *  @tparam IdType        The index type used to differentiate concrete types.
  *  @tparam BuilderType   The functor type that builds concrete types.
  *  @tparam ErrorPolicy   The policy for handling errors.
+ *  @tparam StoragePolicy The storage of builders (and pooled objects)
+ *                        by ID, HashStorage or, for small dense IDs
+ *                        such as enums, DenseStorage.
  */
 template <typename AbstractType,
           typename IdType,
           typename BuilderType = std::function<std::unique_ptr<AbstractType>()>,
-          template <typename, typename> class ErrorPolicy = DefaultErrorPolicy>
+          template <typename, typename> class ErrorPolicy = DefaultErrorPolicy,
+          template <typename, typename> class StoragePolicy = HashStorage>
 class ObjectFactory : private ErrorPolicy<IdType, AbstractType>
 {
 public:
     using abstract_type = AbstractType;
     using id_type = IdType;
     using builder_type = BuilderType;
-    using map_type = std::unordered_map<id_type, builder_type>;
+    using map_type = StoragePolicy<id_type, builder_type>;
     using size_type = typename map_type::size_type;
 
+private:
+    // Destroyed objects of each ID, kept for reuse.
+    struct ObjectPool
+    {
+        std::mutex mutex;
+        StoragePolicy<id_type, std::vector<std::unique_ptr<AbstractType>>>
+            objects;
+    };
+
+public:
+    /** @brief Deleter of pooled objects, which returns them to the
+     *  pool of their ID, or deletes them if the factory is gone.
+     */
+    class PoolDeleter
+    {
+    public:
+        PoolDeleter() = default;
+        PoolDeleter(std::weak_ptr<ObjectPool> pool, id_type id)
+            : pool_{std::move(pool)}, id_{std::move(id)}
+        {}
+
+        void operator()(AbstractType* obj) const
+        {
+            std::unique_ptr<AbstractType> ptr{obj};
+            auto pool = pool_.lock();
+            if (!pool)
+                return;
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            auto* objects = pool->objects.find(id_);
+            if (!objects)
+            {
+                pool->objects.emplace(id_, {});
+                objects = pool->objects.find(id_);
+            }
+            objects->push_back(std::move(ptr));
+        }
+
+    private:
+        std::weak_ptr<ObjectPool> pool_;
+        id_type id_{};
+    };
+
+    using pooled_ptr = std::unique_ptr<AbstractType, PoolDeleter>;
+
 public:
+    ObjectFactory() = default;
+
+    /** @brief Copy the builders. The copy starts with an empty pool,
+     *  so the two factories never hand out each other's objects.
+     */
+    ObjectFactory(ObjectFactory const& other)
+        : ErrorPolicy<IdType, AbstractType>(other), map_{other.map_}
+    {}
+
+    /** @brief Move the builders and the pool. The moved-from factory
+     *  is left with an empty pool.
+     */
+    ObjectFactory(ObjectFactory&& other)
+        : ErrorPolicy<IdType, AbstractType>(std::move(other)),
+          map_{std::move(other.map_)},
+          pool_{std::exchange(other.pool_, std::make_shared<ObjectPool>())}
+    {}
+
+    ObjectFactory& operator=(ObjectFactory const& other)
+    {
+        if (this != &other)
+        {
+            ErrorPolicy<IdType, AbstractType>::operator=(other);
+            map_ = other.map_;
+            pool_ = std::make_shared<ObjectPool>();
+        }
+        return *this;
+    }
+
+    ObjectFactory& operator=(ObjectFactory&& other)
+    {
+        if (this != &other)
+        {
+            ErrorPolicy<IdType, AbstractType>::operator=(std::move(other));
+            map_ = std::move(other.map_);
+            pool_ = std::exchange(other.pool_, std::make_shared<ObjectPool>());
+        }
+        return *this;
+    }
+
     /** @brief Register a new builder for things of type @c id */
     bool register_builder(id_type id, builder_type builder)
     {
-        return map_
-            .emplace(std::piecewise_construct,
-                     std::forward_as_tuple(std::move(id)),
-                     std::forward_as_tuple(std::move(builder)))
-            .second;
+        return map_.emplace(std::move(id), std::move(builder));
     }
 
-    /** @brief Unregister the current builder for things of type @c id. */
-    bool unregister(id_type const& id) { return (map_.erase(id) == 1); }
+    /** @brief Unregister the current builder for things of type @c id.
+     *  Pooled objects of that type are destroyed.
+     */
+    bool unregister(id_type const& id)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pool_->mutex);
+            pool_->objects.erase(id);
+        }
+        return map_.erase(id);
+    }
 
     /** @brief Construct a new object forwarding extra arguments to
      *  the builder.
@@ -62,19 +157,53 @@ public:
     std::unique_ptr<AbstractType> create_object(IdType const& id,
                                                 Ts&&... Args) const
     {
-        auto it = map_.find(id);
-        if (it != map_.end())
-            return (it->second)(std::forward<Ts>(Args)...);
+        if (auto const* builder = map_.find(id))
+            return (*builder)(std::forward<Ts>(Args)...);
 
         return this->handle_unknown_id(id);
     }
 
+    /** @brief Get an object of type @c id, reusing one that was
+     *  previously destroyed if possible.
+     *
+     *  Destroying the returned object returns it to the pool of the
+     *  factory. Reused objects are returned in the state they were
+     *  destroyed in, without calling the builder, so the extra
+     *  arguments only apply to new objects.
+     */
+    template <typename... Ts>
+    pooled_ptr create_pooled_object(IdType const& id, Ts&&... Args) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(pool_->mutex);
+            auto* objects = pool_->objects.find(id);
+            if (objects && !objects->empty())
+            {
+                auto obj = std::move(objects->back());
+                objects->pop_back();
+                return pooled_ptr{obj.release(), PoolDeleter{pool_, id}};
+            }
+        }
+        return pooled_ptr{create_object(id, std::forward<Ts>(Args)...)
+                              .release(),
+                          PoolDeleter{pool_, id}};
+    }
+
+    /** @brief Destroy all pooled objects. */
+    void clear_pool()
+    {
+        std::lock_guard<std::mutex> lock(pool_->mutex);
+        pool_->objects = {};
+    }
+
     /** @brief Get the names of all builders known to the factory. */
     std::list<id_type> registered_ids() const
     {
         std::list<id_type> names;
-        for (auto const& x : map_)
-            names.push_back(x.first);
+        map_.for_each(
+            [&names](id_type const& id, builder_type const&) {
+                names.push_back(id);
+            });
 
         return names;
     }
@@ -84,6 +213,7 @@ public:
 
 private:
     map_type map_;
+    std::shared_ptr<ObjectPool> pool_ = std::make_shared<ObjectPool>();
 };
 
 } // namespace factory
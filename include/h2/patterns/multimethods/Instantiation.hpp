@@ -0,0 +1,187 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2020 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef H2_PATTERNS_MULTIMETHODS_INSTANTIATION_HPP_
+#define H2_PATTERNS_MULTIMETHODS_INSTANTIATION_HPP_
+
+#include "h2/meta/Core.hpp"
+#include "h2/meta/TypeList.hpp"
+
+#include <array>
+
+/** @file
+ *
+ *  Instantiation of templates over typelists of combinations of
+ *  types, split across translation units.
+ *
+ *  Dispatchers such as SwitchDispatcher and TableDispatcher
+ *  instantiate their functors for every combination of the types they
+ *  deduce. Rather than instantiating all of them wherever the
+ *  templates are used, their definitions can be kept out of headers
+ *  and the combinations instantiated once, by "instantiators":
+ *
+ *  @code{.cpp}
+ *  template <typename T, typename AllocT>
+ *  struct InstantiateShuffle
+ *  {
+ *      static void instantiate()
+ *      {
+ *          // ODR-use everything that must be instantiated.
+ *          (void) &Shuffler<T, AllocT>::shuffle_forward;
+ *          (void) &Shuffler<T, AllocT>::shuffle_backward;
+ *      }
+ *  };
+ *
+ *  using ShuffleTypes = meta::tlist::CartesianProduct<
+ *      TL<float, double, half>, TL<HostAlloc, DeviceAlloc>>;
+ *  H2_INSTANTIATE_SHARD(shuffle_instances, InstantiateShuffle, ShuffleTypes);
+ *  @endcode
+ *
+ *  Compiling that file through h2_add_instantiation_shards (in
+ *  H2CMakeUtils.cmake) with N shards builds N translation units that
+ *  each instantiate every N-th combination, in parallel. Combinations
+ *  that are not needed can be left out of the typelists, e.g. by
+ *  configuration macros, to shrink the binaries.
+ */
+
+namespace h2
+{
+namespace multimethods
+{
+
+/** @brief The combinations instantiated by shard ShardIdx out of
+ *         NumShards: every NumShards-th, starting from ShardIdx.
+ *         Duplicate combinations are removed first.
+ */
+template <typename Combinations,
+          unsigned long ShardIdx,
+          unsigned long NumShards>
+struct ShardT;
+
+/** @brief The combinations instantiated by a shard. */
+template <typename Combinations,
+          unsigned long ShardIdx,
+          unsigned long NumShards>
+using Shard = meta::Force<ShardT<Combinations, ShardIdx, NumShards>>;
+
+/** @brief The `instantiate` functions of an instantiator for each
+ *         combination of types.
+ *
+ *  @tparam InstantiatorT A template whose specializations have a
+ *          static `void instantiate()` that ODR-uses what should be
+ *          instantiated for a combination.
+ *  @tparam Combinations A typelist of typelists of template arguments
+ *          to InstantiatorT.
+ */
+template <template <typename...> class InstantiatorT, typename Combinations>
+struct InstantiateAll;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+namespace internal
+{
+template <typename Combinations,
+          unsigned long Idx,
+          unsigned long ShardIdx,
+          unsigned long NumShards>
+struct ShardFromT;
+
+template <unsigned long Idx, unsigned long ShardIdx, unsigned long NumShards>
+struct ShardFromT<meta::tlist::Empty, Idx, ShardIdx, NumShards>
+{
+    using type = meta::tlist::Empty;
+};
+
+template <typename T,
+          typename... Ts,
+          unsigned long Idx,
+          unsigned long ShardIdx,
+          unsigned long NumShards>
+struct ShardFromT<meta::TL<T, Ts...>, Idx, ShardIdx, NumShards>
+{
+private:
+    using Rest_ = meta::Force<
+        ShardFromT<meta::TL<Ts...>, Idx + 1, ShardIdx, NumShards>>;
+
+public:
+    using type = meta::IfThenElse<Idx % NumShards == ShardIdx,
+                                  meta::tlist::Cons<T, Rest_>,
+                                  Rest_>;
+};
+
+template <template <typename...> class InstantiatorT, typename Combination>
+struct InstantiatorFor;
+
+template <template <typename...> class InstantiatorT, typename... Ts>
+struct InstantiatorFor<InstantiatorT, meta::TL<Ts...>>
+{
+    using type = InstantiatorT<Ts...>;
+};
+} // namespace internal
+
+template <typename Combinations,
+          unsigned long ShardIdx,
+          unsigned long NumShards>
+struct ShardT : internal::ShardFromT<meta::tlist::Unique<Combinations>,
+                                     0UL,
+                                     ShardIdx,
+                                     NumShards>
+{
+    static_assert(NumShards > 0 && ShardIdx < NumShards,
+                  "Shard index out of range.");
+};
+
+template <template <typename...> class InstantiatorT, typename... Combinations>
+struct InstantiateAll<InstantiatorT, meta::TL<Combinations...>>
+{
+    static constexpr std::array<void (*)(), sizeof...(Combinations)> entries =
+        {{&internal::InstantiatorFor<InstantiatorT,
+                                     Combinations>::type::instantiate...}};
+};
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // namespace multimethods
+} // namespace h2
+
+/** @brief Instantiate InstantiatorT for each combination in the
+ *         typelist given last, through a table named NAME with
+ *         external linkage, which keeps the instantiations from
+ *         being discarded.
+ */
+#define H2_INSTANTIATE_ALL(NAME, INSTANTIATOR, ...)                            \
+    extern decltype(::h2::multimethods::                                       \
+                        InstantiateAll<INSTANTIATOR, __VA_ARGS__>::entries)    \
+        NAME;                                                                  \
+    decltype(::h2::multimethods::InstantiateAll<INSTANTIATOR,                  \
+                                                __VA_ARGS__>::entries) NAME =  \
+        ::h2::multimethods::InstantiateAll<INSTANTIATOR, __VA_ARGS__>::entries
+
+// The shard of a translation unit, set by h2_add_instantiation_shards.
+#ifndef H2_INSTANTIATION_SHARD
+#define H2_INSTANTIATION_SHARD 0
+#endif
+#ifndef H2_INSTANTIATION_NUM_SHARDS
+#define H2_INSTANTIATION_NUM_SHARDS 1
+#endif
+
+#define H2_INSTANTIATION_CONCAT_IMPL(a, b) a##_shard##b
+#define H2_INSTANTIATION_CONCAT(a, b) H2_INSTANTIATION_CONCAT_IMPL(a, b)
+
+/** @brief Instantiate the combinations of the shard of this
+ *         translation unit. The table is named NAME_shard<index>, so
+ *         that shards do not clash.
+ */
+#define H2_INSTANTIATE_SHARD(NAME, INSTANTIATOR, ...)                          \
+    H2_INSTANTIATE_ALL(                                                        \
+        H2_INSTANTIATION_CONCAT(NAME, H2_INSTANTIATION_SHARD),                 \
+        INSTANTIATOR,                                                          \
+        ::h2::multimethods::Shard<__VA_ARGS__,                                 \
+                                  H2_INSTANTIATION_SHARD,                      \
+                                  H2_INSTANTIATION_NUM_SHARDS>)
+
+#endif // H2_PATTERNS_MULTIMETHODS_INSTANTIATION_HPP_
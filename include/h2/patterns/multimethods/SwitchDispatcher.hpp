@@ -220,7 +220,9 @@ namespace multimethods
  *  not been taken to prevent this. If this incurs too high a
  *  compilation cost, perhaps consider controlling instantiation via
  *  explicit template instantiation, using ETI declarations where
- *  appropriate.
+ *  appropriate. h2/patterns/multimethods/Instantiation.hpp can
+ *  generate the instantiations from typelists and split them across
+ *  translation units.
  *
  */
 template <typename FunctorT, typename ReturnT, typename... ArgumentTs>
@@ -0,0 +1,241 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2020 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef H2_PATTERNS_MULTIMETHODS_TABLEDISPATCHER_HPP_
+#define H2_PATTERNS_MULTIMETHODS_TABLEDISPATCHER_HPP_
+
+#include "h2/meta/Core.hpp"
+#include "h2/meta/TypeList.hpp"
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+
+namespace h2
+{
+namespace multimethods
+{
+/** @brief Dispatch a functor call based on the dynamic type of the
+ *         arguments through a jump table.
+ *
+ *  This is a drop-in companion to SwitchDispatcher: it takes the same
+ *  template parameters, the same arguments to `Exec(...)`, and places
+ *  the same requirements on the functor, including the
+ *  `DispatchError` and `DeductionError` hooks.
+ *
+ *  @section table-dispatch-algo Algorithm
+ *
+ *  Rather than trying a `dynamic_cast` to each type of each list in
+ *  turn, the dynamic type of each argument is looked up by its
+ *  `std::type_index` in a hash table built once per typelist. The
+ *  positions of the arguments in their typelists then index a table
+ *  of functions generated at compile time for every combination of
+ *  types, which downcast the arguments and call the functor (or its
+ *  `DispatchError`). A dispatch therefore costs one hash lookup per
+ *  argument and one indirect call, regardless of the lengths of the
+ *  typelists, where SwitchDispatcher costs up to the product of
+ *  their lengths in casts.
+ *
+ *  @section table-dispatch-differences Differences from SwitchDispatcher
+ *
+ *  - Deduction matches the exact dynamic type of an argument. A type
+ *    deriving from a member of the typelist is a deduction error
+ *    here, while SwitchDispatcher would deduce the first base of it
+ *    in the typelist.
+ *  - Arguments are downcast with `static_cast`, so the concrete types
+ *    must not derive virtually from their base.
+ *  - `DeductionError` receives the extra arguments followed by all
+ *    deduced arguments as base-class references.
+ *
+ *  @warning The table has one entry per combination of types, all of
+ *  which are instantiated. As with SwitchDispatcher, a templated
+ *  functor may instantiate every combination of its parameters.
+ */
+template <typename FunctorT, typename ReturnT, typename... ArgumentTs>
+class TableDispatcher;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+namespace internal
+{
+
+// Position of types in a typelist by their std::type_index; the
+// length of the list for types that are not in it.
+template <typename List>
+struct TypeIndexTable;
+
+template <typename... Ts>
+struct TypeIndexTable<meta::TL<Ts...>>
+{
+    static std::size_t find(std::type_info const& type)
+    {
+        static std::unordered_map<std::type_index, std::size_t> const table =
+            make_table(std::index_sequence_for<Ts...>{});
+        auto const it = table.find(std::type_index(type));
+        return it == table.cend() ? sizeof...(Ts) : it->second;
+    }
+
+private:
+    template <std::size_t... Is>
+    static std::unordered_map<std::type_index, std::size_t>
+    make_table(std::index_sequence<Is...>)
+    {
+        return {{std::type_index(typeid(Ts)), Is}...};
+    }
+};
+
+// The concrete type with the constness of its base.
+template <typename BaseT, typename T>
+using MatchConst = std::conditional_t<std::is_const<BaseT>::value, T const, T>;
+
+template <typename FunctorT,
+          typename ReturnT,
+          typename Bases,
+          typename Lists,
+          typename Indices>
+class TableDispatcherImpl;
+
+template <typename FunctorT,
+          typename ReturnT,
+          typename... Bases,
+          typename... Lists,
+          std::size_t... Ks>
+class TableDispatcherImpl<FunctorT,
+                          ReturnT,
+                          meta::TL<Bases...>,
+                          meta::TL<Lists...>,
+                          std::index_sequence<Ks...>>
+{
+    static constexpr std::size_t sizes[] = {meta::tlist::Length<Lists>...};
+
+    static constexpr std::size_t num_entries()
+    {
+        std::size_t n = 1;
+        for (auto const s : sizes)
+            n *= s;
+        return n;
+    }
+
+    // Product of the lengths of the typelists after the K-th.
+    static constexpr std::size_t stride(std::size_t k)
+    {
+        std::size_t n = 1;
+        for (std::size_t i = k + 1; i < sizeof...(Lists); ++i)
+            n *= sizes[i];
+        return n;
+    }
+
+    // Type of the K-th argument in the I-th table entry.
+    template <std::size_t I, std::size_t K, typename BaseT, typename List>
+    using Concrete = MatchConst<
+        BaseT,
+        meta::tlist::At<List, (I / stride(K)) % meta::tlist::Length<List>>>;
+
+    template <typename... Args>
+    static ReturnT Invoke(FunctorT& F, Args&&... args)
+    {
+        if constexpr (meta::IsInvocable<FunctorT, Args...>)
+            return F(std::forward<Args>(args)...);
+        else
+            return F.DispatchError(std::forward<Args>(args)...);
+    }
+
+    template <std::size_t I, typename... Args>
+    static ReturnT Call(FunctorT& F, Bases&... args, Args&&... others)
+    {
+        return Invoke(F,
+                      std::forward<Args>(others)...,
+                      static_cast<Concrete<I, Ks, Bases, Lists>&>(args)...);
+    }
+
+    template <typename... Args, std::size_t... Is>
+    static constexpr auto make_table(std::index_sequence<Is...>)
+    {
+        using EntryT = ReturnT (*)(FunctorT&, Bases&..., Args&&...);
+        return std::array<EntryT, sizeof...(Is)>{{&Call<Is, Args...>...}};
+    }
+
+public:
+    template <typename... Args>
+    static ReturnT Exec(FunctorT F, Bases&... args, Args&&... others)
+    {
+        static constexpr auto table =
+            make_table<Args...>(std::make_index_sequence<num_entries()>{});
+
+        std::size_t const idx[] = {
+            TypeIndexTable<Lists>::find(typeid(args))...};
+        std::size_t entry = 0;
+        for (std::size_t k = 0; k < sizeof...(Lists); ++k)
+        {
+            if (idx[k] == sizes[k])
+                return F.DeductionError(std::forward<Args>(others)...,
+                                        args...);
+            entry += idx[k] * stride(k);
+        }
+        return table[entry](F, args..., std::forward<Args>(others)...);
+    }
+};
+
+// Splits (Base, TL<DTypes>) pairs into a list of bases and a list of
+// typelists.
+template <typename Bases, typename Lists, typename... ArgumentTs>
+struct UnzipArguments;
+
+template <typename... Bases, typename... Lists>
+struct UnzipArguments<meta::TL<Bases...>, meta::TL<Lists...>>
+{
+    using BasesT = meta::TL<Bases...>;
+    using ListsT = meta::TL<Lists...>;
+    using IndicesT = std::index_sequence_for<Bases...>;
+};
+
+template <typename... Bases,
+          typename... Lists,
+          typename ThisBase,
+          typename ThisList,
+          typename... ArgumentTs>
+struct UnzipArguments<meta::TL<Bases...>,
+                      meta::TL<Lists...>,
+                      ThisBase,
+                      ThisList,
+                      ArgumentTs...>
+    : UnzipArguments<meta::TL<Bases..., ThisBase>,
+                     meta::TL<Lists..., ThisList>,
+                     ArgumentTs...>
+{};
+
+template <typename FunctorT, typename ReturnT, typename Unzipped>
+using TableDispatcherBase = TableDispatcherImpl<FunctorT,
+                                                ReturnT,
+                                                typename Unzipped::BasesT,
+                                                typename Unzipped::ListsT,
+                                                typename Unzipped::IndicesT>;
+
+} // namespace internal
+
+template <typename FunctorT, typename ReturnT, typename... ArgumentTs>
+class TableDispatcher
+    : public internal::TableDispatcherBase<
+          FunctorT,
+          ReturnT,
+          internal::UnzipArguments<meta::TL<>, meta::TL<>, ArgumentTs...>>
+{
+    static_assert(sizeof...(ArgumentTs) % 2 == 0,
+                  "Must pass ArgumentTs as (Base, TL<DTypes>).");
+    static_assert(sizeof...(ArgumentTs) > 0,
+                  "Must dispatch on at least one argument.");
+};
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+} // namespace multimethods
+} // namespace h2
+#endif // H2_PATTERNS_MULTIMETHODS_TABLEDISPATCHER_HPP_
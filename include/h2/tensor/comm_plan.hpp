@@ -0,0 +1,214 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef H2_INCLUDE_H2_TENSOR_COMM_PLAN_HPP_INCLUDED
+#define H2_INCLUDE_H2_TENSOR_COMM_PLAN_HPP_INCLUDED
+
+/** @file
+ *
+ *  Point-to-point exchange of regions of distributed tensors through
+ *  packed staging buffers, shared by the halo exchange and the
+ *  redistribution.
+ *
+ *  class MPIError;
+ *  template <typename T, int N> class CommPlan;
+ */
+
+#include "h2_config.hpp"
+
+#include "h2/gpu/memory_resource.hpp"
+#include "h2/gpu/pools.hpp"
+#include "h2/gpu/runtime.hpp"
+#include "h2/tensor/dist_tensor.hpp"
+#include "h2/utils/Error.hpp"
+
+#include <mpi.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace h2
+{
+
+H2_DEFINE_FORWARDING_EXCEPTION(MPIError, std::runtime_error);
+
+/** @brief Throw an MPIError if an MPI call failed. */
+#define H2_CHECK_MPI(cmd)                                                      \
+    do                                                                         \
+    {                                                                          \
+        int const h2_check_mpi_status = (cmd);                                 \
+        H2_ASSERT(h2_check_mpi_status == MPI_SUCCESS,                          \
+                  ::h2::MPIError,                                              \
+                  std::string("MPI call failed: ") + #cmd);                    \
+    } while (0)
+
+/** @brief Regions of a tensor sent to and received from other
+ *         processes.
+ *
+ *  Regions are packed into staging buffers on the stream of the
+ *  source tensor before they are sent, and unpacked from them on the
+ *  stream of the destination one once received. The host only waits
+ *  for the packing to be done before posting the sends, so the staging
+ *  resource may hold device memory with a GPU-aware MPI or pinned host
+ *  memory otherwise. Staging buffers are allocated on the first start
+ *  and reused by later ones.
+ */
+template <typename T, int N>
+class CommPlan
+{
+public:
+    CommPlan(MPI_Comm comm, gpu::MemoryResource& staging)
+        : m_comm{comm}, m_staging{&staging}
+    {}
+    CommPlan(CommPlan const&) = delete;
+    CommPlan& operator=(CommPlan const&) = delete;
+    CommPlan(CommPlan&&) = default;
+    CommPlan& operator=(CommPlan&&) = default;
+
+    /** @brief Send the region of extent at local index idx to peer. */
+    void add_send(int peer,
+                  int tag,
+                  DimTuple<N> const& idx,
+                  DimTuple<N> const& extent)
+    {
+        m_sends.push_back(Transfer{peer, tag, idx, extent, {}});
+    }
+    /** @brief Receive the region of extent at local index idx from
+     *         peer. */
+    void add_recv(int peer,
+                  int tag,
+                  DimTuple<N> const& idx,
+                  DimTuple<N> const& extent)
+    {
+        m_recvs.push_back(Transfer{peer, tag, idx, extent, {}});
+    }
+
+    bool empty() const noexcept { return m_sends.empty() && m_recvs.empty(); }
+    bool active() const noexcept { return !m_requests.empty(); }
+
+    /** @brief Post the receives, pack the sent regions of src and post
+     *         the sends.
+     *
+     *  Blocks the host until the packing is done.
+     */
+    void start(DistTensor<T, N> const& src, gpu::DeviceStream recv_stream)
+    {
+        H2_ASSERT(!active(), std::logic_error, "Exchange already started");
+        gpu::DeviceStream const stream = src.stream();
+        m_requests.reserve(m_sends.size() + m_recvs.size());
+        // MPI writes the receive buffers outside of any stream, so the
+        // previous unpacking must be done.
+        if (m_unpacked)
+            gpu::sync(m_unpacked.get());
+        for (auto& r : m_recvs)
+        {
+            prepare(r, recv_stream);
+            m_requests.emplace_back();
+            H2_CHECK_MPI(MPI_Irecv(r.staging.data(),
+                                   static_cast<int>(r.staging.size()),
+                                   MPI_BYTE,
+                                   r.peer,
+                                   r.tag,
+                                   m_comm,
+                                   &m_requests.back()));
+        }
+        if (m_sends.empty())
+            return;
+        for (auto& s : m_sends)
+        {
+            prepare(s, stream);
+            copy_region_async<T, N>(static_cast<T*>(s.staging.data()),
+                                    LocalLayout<N>::packed(s.extent),
+                                    DimTuple<N>{},
+                                    src.buffer(),
+                                    src.local(),
+                                    s.idx,
+                                    s.extent,
+                                    stream);
+        }
+        auto event = gpu::acquire_event_notiming();
+        gpu::record_event(event, stream);
+        gpu::sync(event);
+        for (auto& s : m_sends)
+        {
+            m_requests.emplace_back();
+            H2_CHECK_MPI(MPI_Isend(s.staging.data(),
+                                   static_cast<int>(s.staging.size()),
+                                   MPI_BYTE,
+                                   s.peer,
+                                   s.tag,
+                                   m_comm,
+                                   &m_requests.back()));
+        }
+    }
+
+    /** @brief Wait for the messages and unpack the received regions
+     *         into dst on its stream. */
+    void wait(DistTensor<T, N>& dst)
+    {
+        if (m_requests.empty())
+            return;
+        H2_CHECK_MPI(MPI_Waitall(static_cast<int>(m_requests.size()),
+                                 m_requests.data(),
+                                 MPI_STATUSES_IGNORE));
+        m_requests.clear();
+        for (auto& r : m_recvs)
+        {
+            r.staging.set_stream(dst.stream());
+            copy_region_async<T, N>(dst.buffer(),
+                                    dst.local(),
+                                    r.idx,
+                                    static_cast<T const*>(r.staging.data()),
+                                    LocalLayout<N>::packed(r.extent),
+                                    DimTuple<N>{},
+                                    r.extent,
+                                    dst.stream());
+        }
+        if (!m_recvs.empty())
+        {
+            if (!m_unpacked)
+                m_unpacked = gpu::acquire_event_notiming();
+            gpu::record_event(m_unpacked, dst.stream());
+        }
+    }
+
+private:
+    struct Transfer
+    {
+        int peer;
+        int tag;
+        DimTuple<N> idx;
+        DimTuple<N> extent;
+        StreamBuffer staging;
+    };
+
+    void prepare(Transfer& t, gpu::DeviceStream stream)
+    {
+        if (t.staging.empty())
+        {
+            DimType count = 1;
+            for (int d = 0; d < N; ++d)
+                count *= t.extent[d];
+            t.staging = StreamBuffer(*m_staging, count * sizeof(T), stream);
+        }
+        else
+        {
+            t.staging.set_stream(stream);
+        }
+    }
+
+    MPI_Comm m_comm;
+    gpu::MemoryResource* m_staging;
+    std::vector<Transfer> m_sends;
+    std::vector<Transfer> m_recvs;
+    std::vector<MPI_Request> m_requests;
+    gpu::PooledEvent m_unpacked;
+};
+
+} // namespace h2
+#endif // H2_INCLUDE_H2_TENSOR_COMM_PLAN_HPP_INCLUDED
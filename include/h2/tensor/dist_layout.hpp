@@ -0,0 +1,289 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef H2_INCLUDE_H2_TENSOR_DIST_LAYOUT_HPP_INCLUDED
+#define H2_INCLUDE_H2_TENSOR_DIST_LAYOUT_HPP_INCLUDED
+
+/** @file
+ *
+ *  Metadata of distributed tensors with a compile-time number of
+ *  dimensions. All of it is held in fixed-size arrays, so it is cheap
+ *  to copy and pass by value. Dimension 0 is the innermost one, i.e.,
+ *  contiguous in memory, as in the legacy distconv tensors.
+ *
+ *  template <int N> using DimTuple = std::array<DimType, N>;
+ *  template <int N> struct Box;
+ *  template <int N> class ProcGrid;
+ *  template <int N> struct LocalLayout;
+ *  template <int N> class DistLayout;
+ *
+ *  template <int N, typename F>
+ *  void for_each_plane(DimTuple<N> const& extent, F&& f);
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+namespace h2
+{
+
+using DimType = std::int64_t;
+
+template <int N>
+using DimTuple = std::array<DimType, N>;
+
+/** @brief The index range [offset, offset + extent). */
+template <int N>
+struct Box
+{
+    DimTuple<N> offset = {};
+    DimTuple<N> extent = {};
+
+    DimType size() const noexcept
+    {
+        DimType s = 1;
+        for (int d = 0; d < N; ++d)
+            s *= extent[d];
+        return s;
+    }
+    bool empty() const noexcept { return size() == 0; }
+};
+
+/** @brief The common part of a and b, empty if none. */
+template <int N>
+Box<N> intersect(Box<N> const& a, Box<N> const& b) noexcept
+{
+    Box<N> r;
+    for (int d = 0; d < N; ++d)
+    {
+        DimType const begin = std::max(a.offset[d], b.offset[d]);
+        DimType const end = std::min(a.offset[d] + a.extent[d],
+                                     b.offset[d] + b.extent[d]);
+        r.offset[d] = begin;
+        r.extent[d] = std::max(end - begin, DimType{0});
+    }
+    return r;
+}
+
+/** @brief Cartesian grid of processes.
+ *
+ *  Ranks are ordered with dimension 0 varying the fastest, as the
+ *  ranks of the locales of the legacy tensors.
+ */
+template <int N>
+class ProcGrid
+{
+public:
+    using Coord = std::array<int, N>;
+
+    ProcGrid() noexcept { m_shape.fill(1); }
+    explicit ProcGrid(Coord const& shape) : m_shape{shape}
+    {
+        for (int d = 0; d < N; ++d)
+            if (shape[d] < 1)
+                throw std::invalid_argument("Empty process grid");
+    }
+
+    Coord const& shape() const noexcept { return m_shape; }
+    int shape(int d) const noexcept { return m_shape[d]; }
+
+    int size() const noexcept
+    {
+        int s = 1;
+        for (int d = 0; d < N; ++d)
+            s *= m_shape[d];
+        return s;
+    }
+
+    Coord coord(int rank) const noexcept
+    {
+        Coord c;
+        for (int d = 0; d < N; ++d)
+        {
+            c[d] = rank % m_shape[d];
+            rank /= m_shape[d];
+        }
+        return c;
+    }
+
+    /** @brief Rank at c, or -1 if c is outside of the grid. */
+    int rank(Coord const& c) const noexcept
+    {
+        int r = 0;
+        for (int d = N - 1; d >= 0; --d)
+        {
+            if (c[d] < 0 || c[d] >= m_shape[d])
+                return -1;
+            r = r * m_shape[d] + c[d];
+        }
+        return r;
+    }
+
+    bool operator==(ProcGrid const& other) const noexcept
+    {
+        return m_shape == other.m_shape;
+    }
+    bool operator!=(ProcGrid const& other) const noexcept
+    {
+        return !(*this == other);
+    }
+
+private:
+    Coord m_shape;
+};
+
+/** @brief Layout of the local partition of a tensor in memory.
+ *
+ *  Indices are relative to the first element owned by the process and
+ *  range from -halo to shape + halo - 1 in each dimension. Strides are
+ *  in elements; the stride of dimension 0 is 1.
+ */
+template <int N>
+struct LocalLayout
+{
+    DimTuple<N> shape = {};
+    DimTuple<N> halo = {};
+    DimTuple<N> strides = {};
+
+    /** @brief Densely packed layout of shape with halos. */
+    static LocalLayout packed(DimTuple<N> const& shape,
+                              DimTuple<N> const& halo = {}) noexcept
+    {
+        LocalLayout l;
+        l.shape = shape;
+        l.halo = halo;
+        DimType s = 1;
+        for (int d = 0; d < N; ++d)
+        {
+            l.strides[d] = s;
+            s *= shape[d] + 2 * halo[d];
+        }
+        return l;
+    }
+
+    /** @brief Offset of idx from the first element with halo. */
+    DimType offset(DimTuple<N> const& idx) const noexcept
+    {
+        DimType o = 0;
+        for (int d = 0; d < N; ++d)
+            o += (idx[d] + halo[d]) * strides[d];
+        return o;
+    }
+
+    /** @brief Offset of the first element owned. */
+    DimType origin() const noexcept { return offset(DimTuple<N>{}); }
+
+    /** @brief Elements spanned by the partition with its halo. */
+    DimType span() const noexcept
+    {
+        DimType s = 1;
+        for (int d = 0; d < N; ++d)
+        {
+            DimType const n = shape[d] + 2 * halo[d];
+            if (n == 0)
+                return 0;
+            s += (n - 1) * strides[d];
+        }
+        return s;
+    }
+};
+
+/** @brief Block distribution of a tensor over a process grid.
+ *
+ *  A dimension of n elements split over p processes gives n / p
+ *  elements to each of them and one more to the first n % p ones.
+ *  Each partition has a halo of the same width on both sides of each
+ *  dimension.
+ */
+template <int N>
+class DistLayout
+{
+public:
+    DistLayout() = default;
+    DistLayout(DimTuple<N> const& shape,
+               ProcGrid<N> const& grid,
+               DimTuple<N> const& halo = {})
+        : m_shape{shape}, m_grid{grid}, m_halo{halo}
+    {
+        for (int d = 0; d < N; ++d)
+            if (shape[d] < 0 || halo[d] < 0)
+                throw std::invalid_argument("Negative tensor dimension");
+    }
+
+    DimTuple<N> const& shape() const noexcept { return m_shape; }
+    ProcGrid<N> const& grid() const noexcept { return m_grid; }
+    DimTuple<N> const& halo() const noexcept { return m_halo; }
+
+    /** @brief Global indices owned by rank. */
+    Box<N> local_box(int rank) const noexcept
+    {
+        auto const c = m_grid.coord(rank);
+        Box<N> b;
+        for (int d = 0; d < N; ++d)
+        {
+            DimType const p = m_grid.shape(d);
+            DimType const base = m_shape[d] / p;
+            DimType const rem = m_shape[d] % p;
+            b.offset[d] = c[d] * base + std::min<DimType>(c[d], rem);
+            b.extent[d] = base + (c[d] < rem ? 1 : 0);
+        }
+        return b;
+    }
+
+    /** @brief Densely packed layout of the partition of rank. */
+    LocalLayout<N> local_layout(int rank) const noexcept
+    {
+        return LocalLayout<N>::packed(local_box(rank).extent, m_halo);
+    }
+
+    bool operator==(DistLayout const& other) const noexcept
+    {
+        return m_shape == other.m_shape && m_grid == other.m_grid
+               && m_halo == other.m_halo;
+    }
+    bool operator!=(DistLayout const& other) const noexcept
+    {
+        return !(*this == other);
+    }
+
+private:
+    DimTuple<N> m_shape = {};
+    ProcGrid<N> m_grid;
+    DimTuple<N> m_halo = {};
+};
+
+/** @brief Call f with the index of the first element of each plane of
+ *         dimensions 0 and 1 in a box of extent at the origin.
+ *
+ *  A plane is the unit of a 2D copy; for N == 1, f is called once.
+ */
+template <int N, typename F>
+void for_each_plane(DimTuple<N> const& extent, F&& f)
+{
+    for (int d = 0; d < N; ++d)
+        if (extent[d] == 0)
+            return;
+    DimTuple<N> idx = {};
+    while (true)
+    {
+        f(static_cast<DimTuple<N> const&>(idx));
+        int d = 2;
+        for (; d < N; ++d)
+        {
+            if (++idx[d] < extent[d])
+                break;
+            idx[d] = 0;
+        }
+        if (d >= N)
+            return;
+    }
+}
+
+} // namespace h2
+#endif // H2_INCLUDE_H2_TENSOR_DIST_LAYOUT_HPP_INCLUDED
@@ -0,0 +1,240 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef H2_INCLUDE_H2_TENSOR_DIST_TENSOR_HPP_INCLUDED
+#define H2_INCLUDE_H2_TENSOR_DIST_TENSOR_HPP_INCLUDED
+
+/** @file
+ *
+ *  Distributed tensors with a compile-time number of dimensions whose
+ *  local partitions live in device memory. All operations on them are
+ *  enqueued on the stream of the tensor and return without blocking
+ *  the host.
+ *
+ *  template <typename T, int N> class DistTensor;
+ *
+ *  template <typename T, int N>
+ *  void copy_region_async(T* dst, LocalLayout<N> const& dst_layout,
+ *                         DimTuple<N> const& dst_idx,
+ *                         T const* src, LocalLayout<N> const& src_layout,
+ *                         DimTuple<N> const& src_idx,
+ *                         DimTuple<N> const& extent,
+ *                         gpu::DeviceStream stream);
+ *  template <typename T, int N>
+ *  void copy_async(DistTensor<T, N>& dst, DistTensor<T, N> const& src);
+ */
+
+#include "h2_config.hpp"
+
+#include "h2/gpu/memory_resource.hpp"
+#include "h2/gpu/memory_utils.hpp"
+#include "h2/gpu/runtime.hpp"
+#include "h2/tensor/dist_layout.hpp"
+#include "h2/tensor/stream_buffer.hpp"
+#include "h2/utils/Error.hpp"
+
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+
+namespace h2
+{
+
+/** @brief The local partition of a tensor distributed by a
+ *         DistLayout.
+ *
+ *  A tensor either owns a StreamBuffer or views memory owned by
+ *  someone else, e.g., a legacy distconv tensor. Its metadata is held
+ *  inline. Tensors are move-only, since the memory of an owning one
+ *  cannot be shared; a moved-from tensor holds no memory.
+ */
+template <typename T, int N>
+class DistTensor
+{
+public:
+    static_assert(N > 0, "Tensors need at least one dimension");
+
+    using value_type = T;
+    static constexpr int num_dims = N;
+
+    DistTensor() = default;
+
+    /** @brief Allocate the densely packed partition of rank from
+     *         resource on stream.
+     */
+    DistTensor(DistLayout<N> const& dist,
+               int rank,
+               gpu::DeviceStream stream,
+               gpu::MemoryResource& resource = gpu::device_memory_resource())
+        : m_dist{dist},
+          m_rank{rank},
+          m_local{dist.local_layout(rank)},
+          m_buffer{resource, m_local.span() * sizeof(T), stream},
+          m_ptr{static_cast<T*>(m_buffer.data())},
+          m_stream{stream}
+    {}
+    DistTensor(DistTensor const&) = delete;
+    DistTensor& operator=(DistTensor const&) = delete;
+    DistTensor(DistTensor&& other) noexcept
+        : m_dist{other.m_dist},
+          m_rank{other.m_rank},
+          m_local{other.m_local},
+          m_buffer{std::move(other.m_buffer)},
+          m_ptr{std::exchange(other.m_ptr, nullptr)},
+          m_stream{other.m_stream}
+    {}
+    DistTensor& operator=(DistTensor&& other) noexcept
+    {
+        if (this != &other)
+        {
+            m_dist = other.m_dist;
+            m_rank = other.m_rank;
+            m_local = other.m_local;
+            m_buffer = std::move(other.m_buffer);
+            m_ptr = std::exchange(other.m_ptr, nullptr);
+            m_stream = other.m_stream;
+        }
+        return *this;
+    }
+
+    /** @brief View the partition of rank at buffer, the first element
+     *         with halo, laid out as local.
+     *
+     *  The memory must outlive the view. Only the layout of this
+     *  process is checked against the distribution; the views of the
+     *  other processes are checked where they are created.
+     */
+    static DistTensor view(DistLayout<N> const& dist,
+                           int rank,
+                           LocalLayout<N> const& local,
+                           T* buffer,
+                           gpu::DeviceStream stream)
+    {
+        auto const box = dist.local_box(rank);
+        H2_ASSERT(local.shape == box.extent && local.halo == dist.halo(),
+                  std::invalid_argument,
+                  "Local layout does not match the distribution");
+        DistTensor t;
+        t.m_dist = dist;
+        t.m_rank = rank;
+        t.m_local = local;
+        t.m_ptr = buffer;
+        t.m_stream = stream;
+        return t;
+    }
+
+    DistLayout<N> const& dist() const noexcept { return m_dist; }
+    int proc_rank() const noexcept { return m_rank; }
+    LocalLayout<N> const& local() const noexcept { return m_local; }
+    /** @brief Global indices owned by this process. */
+    Box<N> local_box() const noexcept { return m_dist.local_box(m_rank); }
+    bool is_view() const noexcept { return m_buffer.empty(); }
+
+    /** @brief The first element including the halo. */
+    T* buffer() noexcept { return m_ptr; }
+    T const* buffer() const noexcept { return m_ptr; }
+    /** @brief The first element owned. */
+    T* data() noexcept { return m_ptr + m_local.origin(); }
+    T const* data() const noexcept { return m_ptr + m_local.origin(); }
+
+    gpu::DeviceStream stream() const noexcept { return m_stream; }
+
+    /** @brief Enqueue subsequent work on stream, after the work
+     *         already enqueued on the current one. */
+    void set_stream(gpu::DeviceStream stream)
+    {
+        if (is_view())
+            order_streams(m_stream, stream);
+        else
+            m_buffer.set_stream(stream);
+        m_stream = stream;
+    }
+
+private:
+    DistLayout<N> m_dist;
+    int m_rank = 0;
+    LocalLayout<N> m_local;
+    StreamBuffer m_buffer;
+    T* m_ptr = nullptr;
+    gpu::DeviceStream m_stream = nullptr;
+};
+
+/** @brief Copy the box of extent at dst_idx of dst from src_idx of src
+ *         on stream.
+ *
+ *  Indices are local, as in LocalLayout::offset. Dimension 0 must be
+ *  contiguous in both layouts; each plane of dimensions 0 and 1 is one
+ *  2D copy.
+ */
+template <typename T, int N>
+void copy_region_async(T* dst,
+                       LocalLayout<N> const& dst_layout,
+                       DimTuple<N> const& dst_idx,
+                       T const* src,
+                       LocalLayout<N> const& src_layout,
+                       DimTuple<N> const& src_idx,
+                       DimTuple<N> const& extent,
+                       gpu::DeviceStream stream)
+{
+    H2_ASSERT(dst_layout.strides[0] == 1 && src_layout.strides[0] == 1,
+              std::invalid_argument,
+              "Dimension 0 must be contiguous");
+    size_t const width = extent[0] * sizeof(T);
+    size_t height = 1;
+    size_t dst_pitch = width;
+    size_t src_pitch = width;
+    if constexpr (N > 1)
+    {
+        height = extent[1];
+        dst_pitch = dst_layout.strides[1] * sizeof(T);
+        src_pitch = src_layout.strides[1] * sizeof(T);
+    }
+    for_each_plane<N>(extent, [&](DimTuple<N> const& plane) {
+        DimTuple<N> d = dst_idx;
+        DimTuple<N> s = src_idx;
+        for (int i = 0; i < N; ++i)
+        {
+            d[i] += plane[i];
+            s[i] += plane[i];
+        }
+        gpu::mem_copy_2d(dst + dst_layout.offset(d),
+                         dst_pitch,
+                         src + src_layout.offset(s),
+                         src_pitch,
+                         width,
+                         height,
+                         stream);
+    });
+}
+
+/** @brief Copy the partition of src owned by this process to dst,
+ *         excluding halos.
+ *
+ *  Both must have the same distribution. The copy is enqueued on the
+ *  stream of dst, after the work already enqueued on that of src.
+ */
+template <typename T, int N>
+void copy_async(DistTensor<T, N>& dst, DistTensor<T, N> const& src)
+{
+    H2_ASSERT(dst.dist().shape() == src.dist().shape()
+                  && dst.dist().grid() == src.dist().grid()
+                  && dst.proc_rank() == src.proc_rank(),
+              std::invalid_argument,
+              "Tensors are distributed differently");
+    order_streams(src.stream(), dst.stream());
+    copy_region_async<T, N>(dst.buffer(),
+                            dst.local(),
+                            DimTuple<N>{},
+                            src.buffer(),
+                            src.local(),
+                            DimTuple<N>{},
+                            dst.local().shape,
+                            dst.stream());
+}
+
+} // namespace h2
+#endif // H2_INCLUDE_H2_TENSOR_DIST_TENSOR_HPP_INCLUDED
@@ -0,0 +1,125 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef H2_INCLUDE_H2_TENSOR_HALO_EXCHANGE_HPP_INCLUDED
+#define H2_INCLUDE_H2_TENSOR_HALO_EXCHANGE_HPP_INCLUDED
+
+/** @file
+ *
+ *  Asynchronous halo exchange of distributed tensors.
+ *
+ *  template <typename T, int N> class HaloExchange;
+ */
+
+#include "h2_config.hpp"
+
+#include "h2/gpu/memory_resource.hpp"
+#include "h2/tensor/comm_plan.hpp"
+#include "h2/tensor/dist_tensor.hpp"
+#include "h2/utils/Error.hpp"
+
+#include <mpi.h>
+
+#include <stdexcept>
+
+namespace h2
+{
+
+/** @brief Fills the halos of a tensor with the elements owned by the
+ *         neighboring processes.
+ *
+ *  Faces, edges and corners are exchanged with all the 3^N - 1
+ *  neighbors at once, as the batched halo exchange of legacy distconv
+ *  does, so a single round of messages fills the whole halo. The tag
+ *  of a message identifies its direction from the sender to the
+ *  receiver, so messages between the same pair of processes cannot be
+ *  confused in a grid of 2 processes along some dimension.
+ *
+ *  The ranks of comm must be those of the process grid of the tensor.
+ */
+template <typename T, int N>
+class HaloExchange
+{
+public:
+    HaloExchange(DistTensor<T, N>& tensor,
+                 MPI_Comm comm,
+                 gpu::MemoryResource& staging = gpu::device_memory_resource())
+        : m_tensor{tensor}, m_plan{comm, staging}
+    {
+        auto const& dist = tensor.dist();
+        auto const& grid = dist.grid();
+        auto const& local = tensor.local();
+        auto const coord = grid.coord(tensor.proc_rank());
+        // Checked against the smallest partition of the distribution,
+        // which every process knows, so that all of them agree
+        // without communicating.
+        for (int d = 0; d < N; ++d)
+            H2_ASSERT(grid.shape(d) == 1
+                          || dist.halo()[d] <= dist.shape()[d] / grid.shape(d),
+                      std::invalid_argument,
+                      "Halos wider than the neighboring partitions");
+
+        int num_dirs = 1;
+        for (int d = 0; d < N; ++d)
+            num_dirs *= 3;
+        for (int id = 0; id < num_dirs; ++id)
+        {
+            // Offsets of -1, 0 and +1 along each dimension
+            std::array<int, N> dir;
+            for (int d = 0, rem = id; d < N; ++d, rem /= 3)
+                dir[d] = rem % 3 - 1;
+            auto peer_coord = coord;
+            DimTuple<N> send_idx, recv_idx, extent;
+            bool valid = false;
+            for (int d = 0; d < N; ++d)
+            {
+                peer_coord[d] += dir[d];
+                if (dir[d] == 0)
+                {
+                    send_idx[d] = recv_idx[d] = 0;
+                    extent[d] = local.shape[d];
+                    continue;
+                }
+                valid = true;
+                extent[d] = local.halo[d];
+                send_idx[d] = dir[d] < 0 ? 0 : local.shape[d] - local.halo[d];
+                recv_idx[d] = dir[d] < 0 ? -local.halo[d] : local.shape[d];
+            }
+            int const peer = grid.rank(peer_coord);
+            Box<N> const box{DimTuple<N>{}, extent};
+            if (!valid || peer < 0 || box.empty())
+                continue;
+            // The peer sends in the opposite direction.
+            m_plan.add_send(peer, id, send_idx, extent);
+            m_plan.add_recv(peer, num_dirs - 1 - id, recv_idx, extent);
+        }
+    }
+
+    /** @brief Post the messages of the exchange.
+     *
+     *  The halos are sent as of the work enqueued on the stream of the
+     *  tensor so far. Blocks the host until they are packed.
+     */
+    void start() { m_plan.start(m_tensor, m_tensor.stream()); }
+
+    /** @brief Wait for the messages and enqueue the unpacking of the
+     *         halos on the stream of the tensor. */
+    void wait() { m_plan.wait(m_tensor); }
+
+    void exchange()
+    {
+        start();
+        wait();
+    }
+
+private:
+    DistTensor<T, N>& m_tensor;
+    CommPlan<T, N> m_plan;
+};
+
+} // namespace h2
+#endif // H2_INCLUDE_H2_TENSOR_HALO_EXCHANGE_HPP_INCLUDED
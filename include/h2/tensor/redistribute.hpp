@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef H2_INCLUDE_H2_TENSOR_REDISTRIBUTE_HPP_INCLUDED
+#define H2_INCLUDE_H2_TENSOR_REDISTRIBUTE_HPP_INCLUDED
+
+/** @file
+ *
+ *  Asynchronous redistribution of tensors between process grids.
+ *
+ *  template <typename T, int N> class Redistribution;
+ */
+
+#include "h2_config.hpp"
+
+#include "h2/gpu/memory_resource.hpp"
+#include "h2/tensor/comm_plan.hpp"
+#include "h2/tensor/dist_tensor.hpp"
+#include "h2/utils/Error.hpp"
+
+#include <mpi.h>
+
+#include <stdexcept>
+
+namespace h2
+{
+
+/** @brief Copies the elements owned by each process in src to the
+ *         processes that own them in dst, excluding halos.
+ *
+ *  Each process exchanges with the processes whose partition in the
+ *  other distribution intersects its own; the part it owns in both is
+ *  copied locally on the stream of dst. Both grids must have the
+ *  processes of comm, with the same ranks.
+ */
+template <typename T, int N>
+class Redistribution
+{
+public:
+    Redistribution(DistTensor<T, N> const& src,
+                   DistTensor<T, N>& dst,
+                   MPI_Comm comm,
+                   gpu::MemoryResource& staging = gpu::device_memory_resource())
+        : m_src{src}, m_dst{dst}, m_plan{comm, staging}
+    {
+        H2_ASSERT(src.dist().shape() == dst.dist().shape()
+                      && src.proc_rank() == dst.proc_rank()
+                      && src.dist().grid().size() == dst.dist().grid().size(),
+                  std::invalid_argument,
+                  "Tensors cannot be redistributed");
+        int const rank = src.proc_rank();
+        Box<N> const src_box = src.local_box();
+        Box<N> const dst_box = dst.local_box();
+        int const num_procs = src.dist().grid().size();
+        for (int peer = 0; peer < num_procs; ++peer)
+        {
+            Box<N> const send = intersect(src_box, dst.dist().local_box(peer));
+            Box<N> const recv = intersect(dst_box, src.dist().local_box(peer));
+            if (peer == rank)
+            {
+                m_self = send;
+                continue;
+            }
+            if (!send.empty())
+                m_plan.add_send(peer, 0, to_local(send, src_box), send.extent);
+            if (!recv.empty())
+                m_plan.add_recv(peer, 0, to_local(recv, dst_box), recv.extent);
+        }
+    }
+
+    /** @brief Enqueue the local copy and post the messages.
+     *
+     *  The elements are sent as of the work enqueued on the stream of
+     *  src so far. Blocks the host until they are packed.
+     */
+    void start()
+    {
+        if (!m_self.empty())
+        {
+            order_streams(m_src.stream(), m_dst.stream());
+            copy_region_async<T, N>(m_dst.buffer(),
+                                    m_dst.local(),
+                                    to_local(m_self, m_dst.local_box()),
+                                    m_src.buffer(),
+                                    m_src.local(),
+                                    to_local(m_self, m_src.local_box()),
+                                    m_self.extent,
+                                    m_dst.stream());
+        }
+        m_plan.start(m_src, m_dst.stream());
+    }
+
+    /** @brief Wait for the messages and enqueue the unpacking on the
+     *         stream of dst. */
+    void wait() { m_plan.wait(m_dst); }
+
+    void redistribute()
+    {
+        start();
+        wait();
+    }
+
+private:
+    static DimTuple<N> to_local(Box<N> const& b, Box<N> const& owned)
+    {
+        DimTuple<N> idx;
+        for (int d = 0; d < N; ++d)
+            idx[d] = b.offset[d] - owned.offset[d];
+        return idx;
+    }
+
+    DistTensor<T, N> const& m_src;
+    DistTensor<T, N>& m_dst;
+    CommPlan<T, N> m_plan;
+    Box<N> m_self;
+};
+
+} // namespace h2
+#endif // H2_INCLUDE_H2_TENSOR_REDISTRIBUTE_HPP_INCLUDED
@@ -0,0 +1,76 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef H2_INCLUDE_H2_TENSOR_STREAM_BUFFER_HPP_INCLUDED
+#define H2_INCLUDE_H2_TENSOR_STREAM_BUFFER_HPP_INCLUDED
+
+/** @file
+ *
+ *  Memory tagged with the stream its users enqueue work on.
+ *
+ *  class StreamBuffer;
+ */
+
+#include "h2_config.hpp"
+
+#include "h2/gpu/memory_resource.hpp"
+#include "h2/gpu/runtime.hpp"
+
+#include <cstddef>
+
+namespace h2
+{
+
+/** @brief Move-only owner of memory from a MemoryResource, tagged with
+ *         the stream that work on it is enqueued on.
+ *
+ *  The memory is allocated on the stream it is created with. Changing
+ *  the stream orders the work enqueued on the new one after that on
+ *  the old one, without blocking the host, so the buffer can be handed
+ *  from stream to stream. The memory is released once the work
+ *  enqueued on the current stream is done.
+ */
+class StreamBuffer
+{
+public:
+    StreamBuffer() noexcept = default;
+    StreamBuffer(gpu::MemoryResource& resource,
+                 size_t bytes,
+                 gpu::DeviceStream stream);
+    StreamBuffer(StreamBuffer const&) = delete;
+    StreamBuffer& operator=(StreamBuffer const&) = delete;
+    StreamBuffer(StreamBuffer&& other) noexcept;
+    StreamBuffer& operator=(StreamBuffer&& other) noexcept;
+    ~StreamBuffer();
+
+    void* data() const noexcept { return m_ptr; }
+    size_t size() const noexcept { return m_bytes; }
+    bool empty() const noexcept { return m_ptr == nullptr; }
+    gpu::DeviceStream stream() const noexcept { return m_stream; }
+    /** @brief The resource of the memory, or nullptr if empty. */
+    gpu::MemoryResource* resource() const noexcept { return m_resource; }
+
+    /** @brief Enqueue subsequent work on stream, after the work
+     *         already enqueued on the current one. */
+    void set_stream(gpu::DeviceStream stream);
+
+    /** @brief Release the memory now. */
+    void reset() noexcept;
+
+private:
+    gpu::MemoryResource* m_resource = nullptr;
+    void* m_ptr = nullptr;
+    size_t m_bytes = 0;
+    gpu::DeviceStream m_alloc_stream = nullptr;
+    gpu::DeviceStream m_stream = nullptr;
+};
+
+/** @brief Order the work enqueued on later after that on earlier. */
+void order_streams(gpu::DeviceStream earlier, gpu::DeviceStream later);
+
+} // namespace h2
+#endif // H2_INCLUDE_H2_TENSOR_STREAM_BUFFER_HPP_INCLUDED
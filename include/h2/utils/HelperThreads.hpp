@@ -0,0 +1,72 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+#ifndef H2_INCLUDE_H2_UTILS_HELPERTHREADS_HPP_INCLUDED
+#define H2_INCLUDE_H2_UTILS_HELPERTHREADS_HPP_INCLUDED
+
+/** @file
+ *
+ *  A budget of CPU cores for the helper threads of H2 and DistConv,
+ *  such as communication progress, asynchronous logging and input
+ *  prefetching.
+ *
+ *  A process reserves a few of the cores it may run on for its helper
+ *  threads, which run only there, and stops running the calling
+ *  thread, and the threads it creates afterwards, on them. This keeps
+ *  the helper threads from competing with the compute threads and the
+ *  data loader threads of the framework.
+ *
+ *  Helper threads call register_helper_thread when they start. Until
+ *  cores are reserved, registering does nothing but record the thread,
+ *  which is then pinned once they are.
+ */
+
+#include <vector>
+
+namespace h2
+{
+
+/** @brief Choose the helper cores of a process.
+ *
+ *  cpus holds the CPUs the process may run on. If the process is not
+ *  bound, i.e., shares cpus with the other local_size processes of the
+ *  node, the CPUs are first split evenly among them and the share of
+ *  local_rank is used. The last num_cores CPUs of the share are
+ *  chosen; at least one CPU is always left out.
+ *
+ *  @returns The helper cores, or an empty vector if none can be
+ *           reserved.
+ */
+std::vector<int> choose_helper_cores(std::vector<int> const& cpus,
+                                     int num_cores,
+                                     bool bound,
+                                     int local_rank,
+                                     int local_size);
+
+/** @brief Reserve num_cores cores for the helper threads.
+ *
+ *  The cores are chosen with choose_helper_cores from the affinity
+ *  mask of the process, which is considered not bound if it holds all
+ *  the online CPUs. The calling thread is moved off the helper cores
+ *  and the registered threads are pinned to them. Does nothing if
+ *  num_cores is not positive or cores are already reserved.
+ */
+void reserve_helper_cores(int num_cores, int local_rank, int local_size);
+
+/** @brief The reserved helper cores; empty if none are reserved. */
+std::vector<int> helper_cores();
+
+/** @brief Register the calling thread as a helper thread.
+ *
+ *  The thread is pinned to the helper cores, now or when they are
+ *  reserved. It is unregistered when it exits.
+ */
+void register_helper_thread();
+
+} // namespace h2
+
+#endif // H2_INCLUDE_H2_UTILS_HELPERTHREADS_HPP_INCLUDED
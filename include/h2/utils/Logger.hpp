@@ -9,12 +9,46 @@
 #ifndef H2_UTILS_LOGGER_HPP_INCLUDED
 #define H2_UTILS_LOGGER_HPP_INCLUDED
 
+#include "spdlog/async_logger.h"
 #include "spdlog/pattern_formatter.h"
 #include "spdlog/spdlog.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
 namespace h2
 {
 
+/** @brief Configuration of asynchronous logging.
+ *
+ *  Asynchronous loggers hand their messages to a shared pool of
+ *  background threads, so the calling thread only formats and
+ *  enqueues them. The pool is created the first time a logger turns
+ *  asynchronous; later changes of its queue size and thread count
+ *  have no effect.
+ */
+struct AsyncLogConfig
+{
+    /** @brief Whether loggers are asynchronous. */
+    bool enabled = false;
+    /** @brief Number of messages the queue holds. */
+    std::size_t queue_size = 8192;
+    /** @brief Number of background threads writing the messages. */
+    std::size_t threads = 1;
+    /** @brief What to do when the queue is full. */
+    ::spdlog::async_overflow_policy overflow =
+        ::spdlog::async_overflow_policy::overrun_oldest;
+    /** @brief Interval of the periodic flush of all loggers while
+     *         asynchronous; zero only flushes on errors and at exit.
+     */
+    std::chrono::seconds flush_interval{5};
+}; // struct AsyncLogConfig
+
 /** @brief Logger class to wrap spdlog logger implementation. For spdlog usage
  *  see https://github.com/gabime/spdlog/wiki/1.-QuickStart.
  */
@@ -40,7 +74,8 @@ public:
     {}
     /** @brief Logger constructor.
      *  @param name Name of logger.
-     *  @param sink Name of output/file sink.
+     *  @param sink Name of output/file sink. In file names, "%w" is
+     *              replaced by the rank, giving one file per rank.
      *  @param pattern_prefix Pattern for log message tags.
      *  Default = [<Date> <Time> <Timezone>] [<Hostname> <Rank>] [<Log Level>]
      **/
@@ -65,19 +100,47 @@ public:
      **/
     void set_mask(unsigned char mask);
 
+    /** @brief Get logging mask. */
+    unsigned char mask() const noexcept
+    {
+        return m_mask.load(std::memory_order_relaxed);
+    }
+
     /** @brief Check if log message is within set log levels.
+     *
+     *  This is a single relaxed load, so it is cheap enough to guard
+     *  messages on hot paths; see H2_LOG and H2_LOG_STREAM.
      *  @param LogLevelType level Logging level.
      **/
-    bool should_log(LogLevelType level) const noexcept;
+    bool should_log(LogLevelType level) const noexcept
+    {
+        return ((mask() & level) == level);
+    }
+
+    /** @brief Switch between synchronous and asynchronous logging,
+     *         keeping the sinks of the logger.
+     *  @param config Asynchronous logging configuration.
+     **/
+    void set_async(AsyncLogConfig const& config);
+
+    /** @brief Check if messages are written by background threads. */
+    bool is_async() const noexcept;
+
+    /** @brief Write out the buffered messages. */
+    void flush() { m_logger->flush(); }
 
 private:
 
     std::shared_ptr<::spdlog::logger> m_logger;
-    unsigned char m_mask;
+    std::atomic<unsigned char> m_mask{0};
 
 }; // class Logger
 
 /** @brief Set log levels for multiple loggers (Hierarchical logging levels).
+ *
+ *  Loggers are named hierarchically with dots: a logger named "a.b.c"
+ *  without a level of its own takes that of "a.b", then that of "a",
+ *  then the default.
  *  @param loggers Vector of Logger pointers.
  *  @param level_env_var Name of environmental variable.
  **/
@@ -86,6 +149,9 @@ void setup_levels(std::vector<Logger*>& loggers,
                   h2::Logger::LogLevelType default_level = h2::Logger::LogLevelType::OFF);
 
 /** @brief Set log masks for multiple loggers (Hierarchical logging levels).
+ *
+ *  Loggers without a mask of their own take that of their closest
+ *  parent, as in setup_levels.
  *  @param loggers Vector of Logger pointers.
  *  @param level_env_var Name of environmental variable.
  **/
@@ -93,11 +159,82 @@ void setup_masks(std::vector<Logger*>& loggers,
                  char const* const mask_env_var,
                  unsigned char default_mask = 0);
 
+/** @brief Configure asynchronous logging for multiple loggers.
+ *
+ *  The environment variable holds comma-separated options: "on" or
+ *  "off", "queue=<messages>", "threads=<count>",
+ *  "overflow=block|overrun" and "flush=<seconds>", e.g.
+ *  "on,queue=65536,overflow=block,flush=10". Options that are not
+ *  given are taken from default_config.
+ *  @param loggers Vector of Logger pointers.
+ *  @param async_env_var Name of environmental variable.
+ *  @param default_config Configuration used without the variable.
+ **/
+void setup_async(std::vector<Logger*>& loggers,
+                 char const* const async_env_var,
+                 AsyncLogConfig default_config = AsyncLogConfig{});
+
 /** @brief Get spdlog::level type
  *  @param level H2::Logging level.
  **/
 spdlog::level::level_enum to_spdlog_level(Logger::LogLevelType level);
 
+/** @brief A message streamed to a Logger, which logs it when destroyed.
+ *  Use it through H2_LOG_STREAM, which only creates it when the level
+ *  is enabled.
+ */
+class LogStream
+{
+public:
+    LogStream(Logger& logger, Logger::LogLevelType level)
+        : m_logger{logger}, m_level{level}
+    {}
+    LogStream(LogStream const&) = delete;
+    LogStream& operator=(LogStream const&) = delete;
+    ~LogStream();
+
+    std::ostream& stream() { return m_stream; }
+
+private:
+    Logger& m_logger;
+    Logger::LogLevelType m_level;
+    std::ostringstream m_stream;
+}; // class LogStream
+
 } // namespace h2
 
+namespace h2_internal
+{
+// Turns a streaming expression into void so that it can be used in a
+// conditional expression. It binds more loosely than operator<<.
+struct LogStreamVoidify
+{
+    void operator&(std::ostream&) const noexcept {}
+};
+} // namespace h2_internal
+
+/** @brief Log a message with fmt-style arguments if the level is
+ *         enabled; otherwise the arguments are not evaluated.
+ *
+ *  H2_LOG(logger, DEBUG, "shuffle of {} bytes", bytes);
+ */
+#define H2_LOG(logger, level, ...)                                             \
+    (!(logger).should_log(::h2::Logger::LogLevelType::level)                   \
+         ? (void) 0                                                            \
+         : (logger).get().log(                                                 \
+             ::h2::to_spdlog_level(::h2::Logger::LogLevelType::level),         \
+             __VA_ARGS__))
+
+/** @brief Stream a message to a logger if the level is enabled;
+ *         otherwise nothing after it is evaluated.
+ *
+ *  H2_LOG_STREAM(logger, DEBUG) << "shuffle of " << bytes << " bytes";
+ */
+#define H2_LOG_STREAM(logger, level)                                           \
+    !(logger).should_log(::h2::Logger::LogLevelType::level)                    \
+        ? (void) 0                                                             \
+        : ::h2_internal::LogStreamVoidify()                                   \
+              & ::h2::LogStream((logger), ::h2::Logger::LogLevelType::level)   \
+                    .stream()
+
 #endif // H2_UTILS_LOGGER_HPP_INCLUDED
@@ -0,0 +1,335 @@
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "distconv_config.hpp"
+#include "benchmark_common.hpp"
+
+#include "distconv/base.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/allreduce.hpp"
+#include "distconv/tensor/allreduce_al.hpp"
+#include "distconv/tensor/allreduce_mpi_cuda.hpp"
+#include "distconv/tensor/channel_exchange.hpp"
+#include "distconv/tensor/tensor_mpi_cuda.hpp"
+#include "distconv/util/cxxopts.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+#ifdef DISTCONV_HAS_NVSHMEM
+#include "distconv/tensor/allreduce_nvshmem.hpp"
+#include "distconv/util/nvshmem.hpp"
+#endif // DISTCONV_HAS_NVSHMEM
+
+#include "h2/gpu/memory_utils.hpp"
+#include "h2/gpu/runtime.hpp"
+
+#include <Al.hpp>
+
+/*
+  Times the allreduce implementations of distconv and the channel
+  exchange of channel/filter parallelism over a range of message
+  sizes. Bandwidths follow the convention of nccl-tests: the
+  algorithm bandwidth is the message size over the time, and the bus
+  bandwidth scales it by 2(n-1)/n for allreduce and by (n-1)/n for
+  reduce-scatter and allgather, whose message size is that of the
+  larger buffer. The results are printed as a table and saved to
+  <output-file>_allreduce.csv.
+ */
+
+using namespace distconv;
+using DataType = float;
+
+namespace distconv_benchmark {
+
+const std::vector<std::string> allreduce_methods = {
+  "AllreduceMPICUDA",
+  "AllreduceAlNCCL",
+  "AllreduceAlHierarchical",
+#ifdef DISTCONV_HAS_NVSHMEM
+  "AllreduceNVSHMEM",
+  "AllreduceNVSHMEMNATIVE",
+  "AllreduceNVSHMEMRecursiveDoublingHost",
+  "AllreduceNVSHMEMRecursiveDoubling",
+  "AllreduceNVSHMEMRecursiveDoublingBuffered",
+  "AllreduceNVSHMEMRecursiveDoublingBlock",
+  "AllreduceNVSHMEMRing",
+  "AllreduceNVSHMEMAuto",
+#endif // DISTCONV_HAS_NVSHMEM
+};
+
+bool is_nvshmem_method(const std::string &method) {
+  return method.find("NVSHMEM") != std::string::npos;
+}
+
+std::unique_ptr<tensor::Allreduce<DataType>> make_reducer(
+    const std::string &name, MPI_Comm comm, h2::gpu::DeviceStream stream) {
+  if (name == "AllreduceMPICUDA") {
+    return std::make_unique<tensor::AllreduceMPICUDA<DataType>>(comm, stream);
+  } else if (name == "AllreduceAlNCCL") {
+    return std::make_unique<tensor::AllreduceAlNCCL<DataType>>(
+        std::make_shared<Al::NCCLBackend::comm_type>(comm, stream));
+  } else if (name == "AllreduceAlHierarchical") {
+    return std::make_unique<
+      tensor::AllreduceAlHierarchical<DataType, Al::NCCLBackend>>(
+          comm, stream);
+#ifdef DISTCONV_HAS_NVSHMEM
+  } else if (is_nvshmem_method(name)) {
+    using AllreduceNVSHMEM = tensor::AllreduceNVSHMEM<DataType>;
+    const std::vector<std::pair<std::string, typename AllreduceNVSHMEM::Algo>>
+        algos = {
+      {"AllreduceNVSHMEM", AllreduceNVSHMEM::NAIVE},
+      {"AllreduceNVSHMEMNATIVE", AllreduceNVSHMEM::NATIVE},
+      {"AllreduceNVSHMEMRecursiveDoublingHost",
+       AllreduceNVSHMEM::RECURSIVE_DOUBLING_HOST},
+      {"AllreduceNVSHMEMRecursiveDoubling",
+       AllreduceNVSHMEM::RECURSIVE_DOUBLING},
+      {"AllreduceNVSHMEMRecursiveDoublingBuffered",
+       AllreduceNVSHMEM::RECURSIVE_DOUBLING_BUFFERED},
+      {"AllreduceNVSHMEMRecursiveDoublingBlock",
+       AllreduceNVSHMEM::RECURSIVE_DOUBLING_BLOCK},
+      {"AllreduceNVSHMEMRing", AllreduceNVSHMEM::RING},
+      {"AllreduceNVSHMEMAuto", AllreduceNVSHMEM::AUTO},
+    };
+    for (const auto &a: algos) {
+      if (a.first == name) {
+        return std::make_unique<AllreduceNVSHMEM>(stream, a.second);
+      }
+    }
+#endif // DISTCONV_HAS_NVSHMEM
+  }
+  util::MPIRootPrintStreamError() << "Unknown allreducer name: '" << name
+                                  << "'";
+  std::abort();
+}
+
+// NVSHMEM allreduces need symmetric buffers
+DataType *alloc_buf(const std::string &method, size_t count) {
+  DataType *ptr = nullptr;
+  if (is_nvshmem_method(method)) {
+#ifdef DISTCONV_HAS_NVSHMEM
+    util::nvshmem::barrier();
+    ptr = static_cast<DataType*>(nvshmem_malloc(sizeof(DataType) * count));
+    util::nvshmem::barrier();
+#endif // DISTCONV_HAS_NVSHMEM
+  } else {
+    DISTCONV_CHECK_GPU(GPU_MALLOC(&ptr, sizeof(DataType) * count));
+  }
+  assert_always(ptr != nullptr);
+  h2::gpu::mem_zero(ptr, count);
+  return ptr;
+}
+
+void free_buf(const std::string &method, DataType *ptr) {
+  if (is_nvshmem_method(method)) {
+#ifdef DISTCONV_HAS_NVSHMEM
+    util::nvshmem::barrier();
+    nvshmem_free(ptr);
+    util::nvshmem::barrier();
+#endif // DISTCONV_HAS_NVSHMEM
+  } else {
+    DISTCONV_CHECK_GPU(GPU_FREE(ptr));
+  }
+}
+
+struct Options {
+  size_t min_bytes;
+  size_t max_bytes;
+  int step_factor;
+  int run_count;
+  int warming_up_count;
+  int num_samples;
+  std::vector<std::string> methods;
+  bool channel_exchange;
+  std::string output_file;
+};
+
+// Average time in ms of f over the runs, taking the maximum over the
+// ranks as nccl-tests
+template <typename F>
+double time_op(const Options &opts, F f, h2::gpu::DeviceStream stream,
+               MPI_Comm comm) {
+  for (int i = 0; i < opts.warming_up_count; ++i) {
+    f();
+  }
+  h2::gpu::sync(stream);
+  DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+  const double start = MPI_Wtime();
+  for (int i = 0; i < opts.run_count; ++i) {
+    f();
+  }
+  h2::gpu::sync(stream);
+  double t = (MPI_Wtime() - start) * 1e3 / opts.run_count;
+  DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE,
+                                   MPI_MAX, comm));
+  return t;
+}
+
+Metrics get_metrics(const std::string &method, const std::string &op,
+                    size_t bytes, double time, double bus_factor) {
+  Metrics m;
+  m.add("method", method);
+  m.add("op", op);
+  m.add("bytes", bytes);
+  m.add("count", bytes / sizeof(DataType));
+  m.add("time_us", time * 1e3);
+  const double algbw = bytes / (time * 1e-3) / 1e9;
+  m.add("algbw_gbps", algbw);
+  m.add("busbw_gbps", algbw * bus_factor);
+  return m;
+}
+
+void run_allreduce(const Options &opts, const std::string &method,
+                   MPI_Comm comm, h2::gpu::DeviceStream stream,
+                   MetricsTable &table) {
+  int np;
+  DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &np));
+  util::MPIRootPrintStreamInfo() << "Benchmarking " << method;
+  auto reducer = make_reducer(method, comm, stream);
+  const size_t max_count = opts.max_bytes / sizeof(DataType);
+  DataType *send_buf = alloc_buf(method, max_count);
+  DataType *recv_buf = alloc_buf(method, max_count);
+  for (size_t bytes = opts.min_bytes; bytes <= opts.max_bytes;
+       bytes *= opts.step_factor) {
+    const size_t count = std::max(bytes / sizeof(DataType), size_t(1));
+    const double t = time_op(
+        opts, [&]() { reducer->allreduce(send_buf, recv_buf, count); },
+        stream, comm);
+    table.add(get_metrics(method, "allreduce", count * sizeof(DataType), t,
+                          2.0 * (np - 1) / np));
+  }
+  free_buf(method, send_buf);
+  free_buf(method, recv_buf);
+}
+
+/*
+  The channels of samples split over the ranks are reduce-scattered
+  to tensors whose channels are split over the ranks, and gathered
+  back. Only the local shapes matter to the exchange.
+ */
+void run_channel_exchange(const Options &opts, MPI_Comm comm,
+                          h2::gpu::DeviceStream stream,
+                          MetricsTable &table) {
+  using Tensor = tensor::Tensor<DataType, tensor::LocaleMPI,
+                                tensor::CUDAAllocator>;
+  int np;
+  DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &np));
+  util::MPIRootPrintStreamInfo() << "Benchmarking ChannelExchange";
+  Al::NCCLBackend::comm_type al_comm(comm, stream);
+  tensor::ChannelExchange<DataType> xch;
+  const index_t n = opts.num_samples;
+  const index_t min_size = np * n * sizeof(DataType);
+  for (size_t bytes = std::max<size_t>(opts.min_bytes, min_size);
+       bytes <= opts.max_bytes; bytes *= opts.step_factor) {
+    // Elements per channel of a sample
+    const index_t w = bytes / sizeof(DataType) / (np * n);
+    tensor::LocaleMPI loc(comm);
+    Tensor full(tensor::Shape({w, 1, (index_t)np, n * np}), loc,
+                tensor::Distribution::make_distribution({1, 1, 1, np}));
+    Tensor split(tensor::Shape({w, 1, (index_t)np, n}), loc,
+                 tensor::Distribution::make_distribution({1, 1, np, 1}));
+    assert0(full.allocate());
+    assert0(split.allocate());
+    full.zero();
+    split.zero();
+    const size_t size = full.get_local_size() * sizeof(DataType);
+    const double bus_factor = (double)(np - 1) / np;
+    double t = time_op(opts, [&]() {
+        xch.reduce_scatter(full, split, al_comm, stream); }, stream, comm);
+    table.add(get_metrics("ChannelExchange", "reduce_scatter", size, t,
+                          bus_factor));
+    t = time_op(opts, [&]() {
+        xch.allgather(split, full, al_comm, stream); }, stream, comm);
+    table.add(get_metrics("ChannelExchange", "allgather", size, t,
+                          bus_factor));
+  }
+}
+
+Options process_opt(int argc, char *argv[], int pid) {
+  cxxopts::Options cmd_opts(argv[0], "Allreduce Benchmark");
+  cmd_opts.add_options()
+      ("r,num-runs", "Number of runs", cxxopts::value<int>()->default_value("20"))
+      ("num-warmup-runs", "Number of warming-up runs", cxxopts::value<int>()->default_value("5"))
+      ("o,output-file", "Save results to <file>_allreduce.csv", cxxopts::value<std::string>()->default_value("results"))
+      ("min-bytes", "Minimum message size in bytes", cxxopts::value<size_t>()->default_value("8"))
+      ("max-bytes", "Maximum message size in bytes", cxxopts::value<size_t>()->default_value("268435456"))
+      ("step-factor", "Factor between message sizes", cxxopts::value<int>()->default_value("2"))
+      ("methods", "Allreduce methods, separated by commas", cxxopts::value<std::string>())
+      ("skip-channel-exchange", "Skip the channel exchange")
+      ("num-samples", "Number of local samples of the channel exchange", cxxopts::value<int>()->default_value("8"))
+      ("help", "Print help")
+      ;
+  auto result = cmd_opts.parse(argc, argv);
+  if (result.count("help")) {
+    if (pid == 0) {
+      std::cout << cmd_opts.help() << "\n";
+    }
+    DISTCONV_CHECK_MPI(MPI_Finalize());
+    exit(0);
+  }
+  Options opts;
+  opts.run_count = result["num-runs"].as<int>();
+  opts.warming_up_count = result["num-warmup-runs"].as<int>();
+  opts.output_file = result["output-file"].as<std::string>();
+  opts.min_bytes = result["min-bytes"].as<size_t>();
+  opts.max_bytes = result["max-bytes"].as<size_t>();
+  opts.step_factor = result["step-factor"].as<int>();
+  opts.num_samples = result["num-samples"].as<int>();
+  opts.channel_exchange = result.count("skip-channel-exchange") == 0;
+  opts.methods = allreduce_methods;
+  if (result.count("methods")) {
+    opts.methods = util::split_spaced_array<std::string>(
+        result["methods"].as<std::string>());
+  }
+  assert_always(opts.min_bytes > 0 && opts.step_factor > 1);
+  return opts;
+}
+
+} // namespace distconv_benchmark
+
+int main(int argc, char *argv[]) {
+  h2::gpu::set_gpu(util::choose_gpu());
+  Al::Initialize(argc, argv);
+  int pid;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(MPI_COMM_WORLD, &pid));
+
+  const auto opts = distconv_benchmark::process_opt(argc, argv, pid);
+
+#ifdef DISTCONV_HAS_NVSHMEM
+  bool use_nvshmem = false;
+  for (const auto &m: opts.methods) {
+    use_nvshmem |= distconv_benchmark::is_nvshmem_method(m);
+  }
+  if (use_nvshmem) {
+    util::nvshmem::initialize(MPI_COMM_WORLD);
+  }
+#endif // DISTCONV_HAS_NVSHMEM
+
+  h2::gpu::DeviceStream stream = h2::gpu::make_stream();
+  distconv_benchmark::MetricsTable table;
+  for (const auto &m: opts.methods) {
+    distconv_benchmark::run_allreduce(opts, m, MPI_COMM_WORLD, stream, table);
+  }
+  if (opts.channel_exchange) {
+    distconv_benchmark::run_channel_exchange(opts, MPI_COMM_WORLD, stream,
+                                             table);
+  }
+
+  if (pid == 0) {
+    table.print(std::cout);
+    std::ofstream ofs(opts.output_file + "_allreduce.csv");
+    table.write_csv(ofs);
+  }
+
+  h2::gpu::destroy(stream);
+#ifdef DISTCONV_HAS_NVSHMEM
+  if (use_nvshmem) {
+    util::nvshmem::finalize();
+  }
+#endif // DISTCONV_HAS_NVSHMEM
+  Al::Finalize();
+  return 0;
+}
@@ -8,6 +8,12 @@
 #include <vector>
 #include <algorithm>
 #include <numeric>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
 
 namespace distconv_benchmark {
 
@@ -16,7 +22,7 @@ using distconv::IndexVector;
 using distconv::tensor::Shape;
 using distconv::int_vector;
 
-enum class BenchmarkDataType {FLOAT, DOUBLE, HALF};
+enum class BenchmarkDataType {FLOAT, DOUBLE, HALF, BFLOAT16};
 
 template <BenchmarkDataType type>
 struct GetType;
@@ -156,6 +162,8 @@ class BenchmarkConfig {
 
   bool profiling;
   bool nvtx_marking;
+  // Peak and steady-state device memory per phase
+  bool memory_accounting;
 
   distconv::HaloExchangeMethod halo_exchange_method;
   bool overlap_halo_exchange;
@@ -181,6 +189,38 @@ class BenchmarkConfig {
 
   bool deconv;
 
+  // Derived metrics are written to <metrics_file>.json and appended
+  // to <metrics_file>.csv if not empty
+  std::string metrics_file;
+  // Peak TFLOP/s and GB/s of a device to report efficiencies against
+  double peak_tflops;
+  double peak_bandwidth;
+  // Times in ms measured with one device to report scaling
+  // efficiencies against: forward, backward data and backward filter
+  std::vector<double> baseline_times;
+
+  // Sweep of configurations run within one job. Each list replaces
+  // the corresponding argument; the sweep is their product, except
+  // that image and process grid sizes are paired for weak scaling if
+  // sweep_zip is set.
+  std::vector<std::string> sweep_proc_sizes;
+  std::vector<std::string> sweep_image_sizes;
+  std::vector<std::string> sweep_halo_exchange_methods;
+  std::vector<int> sweep_filter_dims;
+  bool sweep_zip;
+
+  // Cases of halo_exchange_benchmark. All candidate methods of the
+  // halo exchange tuner are measured if no method is given.
+  std::vector<std::string> halo_exchange_methods;
+  int_vector halo_widths;
+  std::vector<std::string> halo_accum_ops;
+
+  // Block of distconv_block_benchmark: the non-overlapping pooling
+  // window, or 0 for no pooling, and whether the block input is added
+  // to the batchnorm output.
+  int block_pool_size;
+  bool block_residual;
+
   // Some initial values are intended to be rewritten by corresponding
   // default/user-given arguments in `cxxopts::ParseResult`.
   BenchmarkConfig(): i_n(-1), i_c(-1), i_s({}),
@@ -206,6 +246,7 @@ class BenchmarkConfig {
             mode(mode_t::NORMAL),
             profiling(false),
             nvtx_marking(false),
+            memory_accounting(false),
             overlap_halo_exchange(false),
             deterministic(false),
             skip_weight_allreduce(false),
@@ -216,7 +257,15 @@ class BenchmarkConfig {
             spin_time_ms(100),
             host(false),
             global_stat(false),
-            deconv(false) {}
+            deconv(false),
+            metrics_file(""),
+            peak_tflops(0),
+            peak_bandwidth(0),
+            sweep_zip(false),
+            halo_widths({1}),
+            halo_accum_ops({"ID"}),
+            block_pool_size(2),
+            block_residual(false) {}
   BenchmarkConfig(const cxxopts::ParseResult &pr, const bool is_conv):
       BenchmarkConfig() {
     // The following arguments are required.
@@ -255,44 +304,13 @@ class BenchmarkConfig {
     }
     halo_exchange_method = distconv::GetHaloExchangeMethod(
         pr["halo-exchange-method"].as<std::string>());
-    { // shuffle-method
-      std::string method = pr["shuffle-method"].as<std::string>();
-      if (method == "MPI") {
-        shuffle_method = distconv::ShuffleMethod::MPI;
-      } else if (method == "AL") {
-        shuffle_method = distconv::ShuffleMethod::AL;
-#ifdef DISTCONV_HAS_P2P
-      } else if (method == "P2P") {
-        shuffle_method = distconv::ShuffleMethod::P2P;
-      } else if (method == "HYBRID") {
-        shuffle_method = distconv::ShuffleMethod::HYBRID;
-#endif // DISTCONV_HAS_P2P
-      } else {
-        std::cerr << "Unknown method name for shuffling\n";
-        abort();
-      }
-    }
-
-    {  // Channel/filter parallelism algorithm.
-      std::string algo = pr["chanfilt-algo"].as<std::string>();
-      if (algo == "NONE") {
-        chanfilt_algo = distconv::ChannelParallelismAlgorithm::NONE;
-      } else if (algo == "AUTO") {
-        chanfilt_algo = distconv::ChannelParallelismAlgorithm::AUTO;
-      } else if (algo == "X") {
-        chanfilt_algo = distconv::ChannelParallelismAlgorithm::X;
-      } else if (algo == "Y") {
-        chanfilt_algo = distconv::ChannelParallelismAlgorithm::Y;
-      } else if (algo == "W") {
-        chanfilt_algo = distconv::ChannelParallelismAlgorithm::W;
-        if (p_f == 0) {
-          std::cerr << "Must specify --filter-dim for stationary-w\n";
-          abort();
-        }
-      } else {
-        std::cerr << "Unknown algorithm name for channel/filter algorithm\n";
-        abort();
-      }
+    shuffle_method = distconv::GetShuffleMethod(
+        pr["shuffle-method"].as<std::string>());
+    chanfilt_algo = distconv::GetChannelParallelismAlgorithm(
+        pr["chanfilt-algo"].as<std::string>());
+    if (chanfilt_algo == distconv::ChannelParallelismAlgorithm::W && p_f == 0) {
+      std::cerr << "Must specify --filter-dim for stationary-w\n";
+      abort();
     }
 
     batchnorm_impl = distconv::GetBatchnormImpl(
@@ -329,6 +347,8 @@ class BenchmarkConfig {
         data_type = BenchmarkDataType::DOUBLE;
       } else if (type_name == "half") {
         data_type = BenchmarkDataType::HALF;
+      } else if (type_name == "bfloat16") {
+        data_type = BenchmarkDataType::BFLOAT16;
       } else {
         std::cerr << "Unknown data type\n";
         abort();
@@ -340,6 +360,9 @@ class BenchmarkConfig {
     if (pr.count("nvtx") > 0) {
       nvtx_marking = pr["nvtx"].as<bool>();
     }
+    if (pr.count("memory") > 0) {
+      memory_accounting = true;
+    }
     if (use_padding) {
       assert_eq((unsigned int) NSD, f_s.size());
       assert_eq((unsigned int) NSD, dilations.size());
@@ -351,8 +374,9 @@ class BenchmarkConfig {
     } else {
       pads = int_vector(NSD, 0);
     }
-    if (backend == "Ref") {
+    if (backend == "Ref" || backend == "CPU") {
       assert_always(data_type != BenchmarkDataType::HALF);
+      assert_always(data_type != BenchmarkDataType::BFLOAT16);
     }
     if (pr.count("overlap") > 0) {
       overlap_halo_exchange = pr["overlap"].as<bool>();
@@ -387,6 +411,49 @@ class BenchmarkConfig {
     if (pr.count("deconv") > 0) {
       deconv = true;
     }
+    metrics_file = pr["metrics-file"].as<std::string>();
+    peak_tflops = pr["peak-tflops"].as<double>();
+    peak_bandwidth = pr["peak-bandwidth"].as<double>();
+    if (pr.count("baseline-times") > 0) {
+      baseline_times = distconv::util::split_spaced_array<double>(
+          pr["baseline-times"].as<std::string>());
+    }
+    if (pr.count("sweep-proc-sizes") > 0) {
+      sweep_proc_sizes = split_sweep(pr["sweep-proc-sizes"].as<std::string>());
+    }
+    if (pr.count("sweep-image-sizes") > 0) {
+      sweep_image_sizes = split_sweep(
+          pr["sweep-image-sizes"].as<std::string>());
+    }
+    if (pr.count("sweep-halo-exchange-methods") > 0) {
+      sweep_halo_exchange_methods = split_sweep(
+          pr["sweep-halo-exchange-methods"].as<std::string>());
+    }
+    if (pr.count("sweep-filter-dims") > 0) {
+      for (const auto &s: split_sweep(
+               pr["sweep-filter-dims"].as<std::string>())) {
+        sweep_filter_dims.push_back(std::stoi(s));
+      }
+    }
+    if (pr.count("halo-exchange-methods") > 0) {
+      halo_exchange_methods = split_sweep(
+          pr["halo-exchange-methods"].as<std::string>());
+    }
+    halo_widths = distconv::util::split_spaced_array<int>(
+        pr["halo-widths"].as<std::string>());
+    halo_accum_ops = split_sweep(pr["halo-accum-ops"].as<std::string>());
+    block_pool_size = pr["block-pool-size"].as<int>();
+    if (pr.count("block-residual") > 0) {
+      block_residual = true;
+    }
+    if (pr.count("sweep-zip") > 0) {
+      sweep_zip = true;
+      if (sweep_proc_sizes.size() != sweep_image_sizes.size()) {
+        std::cerr << "--sweep-zip requires as many image sizes as "
+                  << "process grid sizes\n";
+        abort();
+      }
+    }
 
     assert_num_spatial_dims();
   }
@@ -399,6 +466,58 @@ class BenchmarkConfig {
       assert_eq((unsigned int) NSD, i->size());
   }
 
+  // Return the number of processes of the grid.
+  int get_num_ranks() const {
+    return std::accumulate(p_s.begin(), p_s.end(), 1,
+                           std::multiplies<int>()) * p_c * p_n;
+  }
+
+  bool is_sweep() const {
+    return !sweep_proc_sizes.empty() || !sweep_image_sizes.empty() ||
+        !sweep_halo_exchange_methods.empty() || !sweep_filter_dims.empty();
+  }
+
+  // Return the configurations of the sweep, or this one only if none
+  // is given, with the process grid varying the slowest.
+  std::vector<BenchmarkConfig> get_sweep() const {
+    std::vector<BenchmarkConfig> configs;
+    // Sizes that are not swept are kept as is
+    const std::vector<std::string> keep = {""};
+    const auto &procs = sweep_proc_sizes.empty() ? keep : sweep_proc_sizes;
+    const auto &images = sweep_image_sizes.empty() ? keep : sweep_image_sizes;
+    const auto &methods = sweep_halo_exchange_methods.empty() ?
+        keep : sweep_halo_exchange_methods;
+    const std::vector<int> filter_dims = sweep_filter_dims.empty() ?
+        std::vector<int>{p_f} : sweep_filter_dims;
+    for (size_t i = 0; i < procs.size(); ++i) {
+      for (size_t j = 0; j < images.size(); ++j) {
+        if (sweep_zip && i != j) continue;
+        for (const auto &method: methods) {
+          for (const auto f: filter_dims) {
+            BenchmarkConfig c = *this;
+            c.sweep_proc_sizes.clear();
+            c.sweep_image_sizes.clear();
+            c.sweep_halo_exchange_methods.clear();
+            c.sweep_filter_dims.clear();
+            if (!procs[i].empty()) {
+              substitute_nd_argument(c.p_n, c.p_c, c.p_s, procs[i]);
+            }
+            if (!images[j].empty()) {
+              substitute_nd_argument(c.i_n, c.i_c, c.i_s, images[j]);
+            }
+            if (!method.empty()) {
+              c.halo_exchange_method = distconv::GetHaloExchangeMethod(method);
+            }
+            c.p_f = f;
+            c.assert_num_spatial_dims();
+            configs.push_back(c);
+          }
+        }
+      }
+    }
+    return configs;
+  }
+
   // Return the number of spatial dimensions.
   int get_num_spatial_dims() const {
     assert_num_spatial_dims();
@@ -432,6 +551,7 @@ class BenchmarkConfig {
        << ", testing: " << testing
        << ", global stat: " << global_stat
        << ", deconv: " << deconv
+       << ", metrics file: " << metrics_file
        << std::endl;
     return os << ss.str();
   }
@@ -460,6 +580,17 @@ class BenchmarkConfig {
     return os;
   }
 
+  // Split a sweep argument at semicolons.
+  static std::vector<std::string> split_sweep(const std::string &arg) {
+    std::vector<std::string> items;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ';')) {
+      if (!item.empty()) items.push_back(item);
+    }
+    return items;
+  }
+
   // Parse `arg` as a space-separated int vector and substitute the
   // elements to `spatials`.
   static void substitute_nd_argument(int_vector &spatials,
@@ -493,10 +624,213 @@ class BenchmarkConfig {
 };
 
 template <int NSD>
-std::ostream &operator<<(std::ostream &os, BenchmarkConfig<NSD> &cfg) {
+std::ostream &operator<<(std::ostream &os, const BenchmarkConfig<NSD> &cfg) {
   return cfg.print(os);
 }
 
+/**
+   Named values derived from a benchmark run, such as achieved rates,
+   kept in the order they are added.
+ */
+class Metrics {
+ public:
+  void add(const std::string &name, double value) {
+    m_values.emplace_back(name, value);
+  }
+
+  void add(const std::string &name, const std::string &value) {
+    m_labels.emplace_back(name, value);
+  }
+
+  std::ostream &write_json(std::ostream &os) const {
+    os << "{";
+    bool first = true;
+    for (const auto &l: m_labels) {
+      os << (first ? "" : ", ") << "\"" << l.first << "\": \""
+         << l.second << "\"";
+      first = false;
+    }
+    for (const auto &v: m_values) {
+      os << (first ? "" : ", ") << "\"" << v.first << "\": " << v.second;
+      first = false;
+    }
+    return os << "}";
+  }
+
+  std::ostream &write_csv_header(std::ostream &os) const {
+    bool first = true;
+    for (const auto &l: m_labels) {
+      os << (first ? "" : ",") << l.first;
+      first = false;
+    }
+    for (const auto &v: m_values) {
+      os << (first ? "" : ",") << v.first;
+      first = false;
+    }
+    return os;
+  }
+
+  std::ostream &write_csv_row(std::ostream &os) const {
+    bool first = true;
+    for (const auto &l: m_labels) {
+      os << (first ? "" : ",") << l.second;
+      first = false;
+    }
+    for (const auto &v: m_values) {
+      os << (first ? "" : ",") << v.second;
+      first = false;
+    }
+    return os;
+  }
+
+  const std::vector<std::pair<std::string, std::string>> &get_labels() const {
+    return m_labels;
+  }
+
+  const std::vector<std::pair<std::string, double>> &get_values() const {
+    return m_values;
+  }
+
+  /**
+     Writes path.json and appends a row to path.csv, which is given a
+     header when created.
+   */
+  void save(const std::string &path) const {
+    std::ofstream json(path + ".json");
+    write_json(json) << std::endl;
+    const std::string csv_path = path + ".csv";
+    const bool exists = std::ifstream(csv_path).good();
+    std::ofstream csv(csv_path, std::fstream::app);
+    if (!exists) {
+      write_csv_header(csv) << std::endl;
+    }
+    write_csv_row(csv) << std::endl;
+  }
+
+ private:
+  std::vector<std::pair<std::string, std::string>> m_labels;
+  std::vector<std::pair<std::string, double>> m_values;
+};
+
+/**
+   Metrics of the points of a sweep in one table with the union of
+   their columns.
+ */
+class MetricsTable {
+ public:
+  void add(const Metrics &m) {
+    Row row;
+    for (const auto &l: m.get_labels()) {
+      add_column(l.first);
+      row[l.first] = l.second;
+    }
+    for (const auto &v: m.get_values()) {
+      add_column(v.first);
+      std::stringstream ss;
+      ss << v.second;
+      row[v.first] = ss.str();
+    }
+    m_rows.push_back(row);
+    m_metrics.push_back(m);
+  }
+
+  /**
+     Adds the efficiency of each time column relative to the first
+     row, i.e., t0 * n0 / (t * n) for strong scaling and t0 / t for
+     weak scaling, where n is the number of ranks.
+   */
+  void add_scaling_efficiencies(bool weak) {
+    if (m_metrics.empty()) return;
+    auto get = [](const Metrics &m, const std::string &name) {
+      for (const auto &v: m.get_values()) {
+        if (v.first == name) return v.second;
+      }
+      return 0.0;
+    };
+    const auto &base = m_metrics.front();
+    const double n0 = get(base, "num_ranks");
+    for (const auto &v: base.get_values()) {
+      const auto &name = v.first;
+      const std::string suffix = "_time_ms";
+      if (name.size() <= suffix.size() ||
+          name.compare(name.size() - suffix.size(), suffix.size(),
+                       suffix) != 0 || v.second <= 0) {
+        continue;
+      }
+      const std::string col =
+          name.substr(0, name.size() - suffix.size()) + "_sweep_efficiency";
+      add_column(col);
+      for (size_t i = 0; i < m_rows.size(); ++i) {
+        const double t = get(m_metrics[i], name);
+        const double n = get(m_metrics[i], "num_ranks");
+        if (t <= 0 || n <= 0) continue;
+        const double e = weak ? v.second / t : v.second * n0 / (t * n);
+        std::stringstream ss;
+        ss << e;
+        m_rows[i][col] = ss.str();
+      }
+    }
+  }
+
+  std::ostream &write_csv(std::ostream &os) const {
+    for (size_t i = 0; i < m_columns.size(); ++i) {
+      os << (i ? "," : "") << m_columns[i];
+    }
+    os << std::endl;
+    for (const auto &row: m_rows) {
+      for (size_t i = 0; i < m_columns.size(); ++i) {
+        auto it = row.find(m_columns[i]);
+        os << (i ? "," : "") << (it == row.end() ? "" : it->second);
+      }
+      os << std::endl;
+    }
+    return os;
+  }
+
+  // Prints the columns other than the full configuration aligned
+  std::ostream &print(std::ostream &os) const {
+    std::vector<std::string> columns;
+    for (const auto &c: m_columns) {
+      if (c != "config") columns.push_back(c);
+    }
+    std::vector<size_t> widths;
+    for (const auto &c: columns) {
+      size_t w = c.size();
+      for (const auto &row: m_rows) {
+        auto it = row.find(c);
+        if (it != row.end()) w = std::max(w, it->second.size());
+      }
+      widths.push_back(w);
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+      os << std::setw(widths[i]) << columns[i] << " ";
+    }
+    os << std::endl;
+    for (const auto &row: m_rows) {
+      for (size_t i = 0; i < columns.size(); ++i) {
+        auto it = row.find(columns[i]);
+        os << std::setw(widths[i]) << (it == row.end() ? "" : it->second)
+           << " ";
+      }
+      os << std::endl;
+    }
+    return os;
+  }
+
+ private:
+  using Row = std::map<std::string, std::string>;
+  std::vector<std::string> m_columns;
+  std::vector<Row> m_rows;
+  std::vector<Metrics> m_metrics;
+
+  void add_column(const std::string &name) {
+    if (std::find(m_columns.begin(), m_columns.end(), name) ==
+        m_columns.end()) {
+      m_columns.push_back(name);
+    }
+  }
+};
+
 template <int NSD>
 inline BenchmarkConfig<NSD> process_opt(int argc, char *argv[], int pid,
                                         const bool is_conv) {
@@ -555,6 +889,7 @@ inline BenchmarkConfig<NSD> process_opt(int argc, char *argv[], int pid,
       ("dump-binary", "Dump tensor in a binary format")
       ("profile", "Enable detailed profiling")
       ("nvtx", "Enable NVTX-based region marking")
+      ("memory", "Report peak and steady-state memory per phase")
       ("overlap", "Overlap halo exchanges")
       ("deterministic", "Use deterministic algoirthms")
       ("skip-allreduce", "Skip allreduces of weights")
@@ -567,6 +902,20 @@ inline BenchmarkConfig<NSD> process_opt(int argc, char *argv[], int pid,
       ("host", "Run benchmark on host (only applicable ot shuffle_benchmark")
       ("global-stat", "Use global statistics with batchnorm")
       ("deconv", "Runs deconvolutions instead of normal convolutions")
+      ("metrics-file", "Write derived metrics to <file>.json and <file>.csv", cxxopts::value<std::string>()->default_value(""))
+      ("peak-tflops", "Peak TFLOP/s of a device", cxxopts::value<double>()->default_value("0"))
+      ("peak-bandwidth", "Peak communication bandwidth of a device in GB/s", cxxopts::value<double>()->default_value("0"))
+      ("baseline-times", "Single-device times in ms <fwd,bwd-data,bwd-filter>", cxxopts::value<std::string>())
+      ("sweep-proc-sizes", "Process grid sizes to sweep, separated by semicolons" + shape_notation, cxxopts::value<std::string>())
+      ("sweep-image-sizes", "Image sizes to sweep, separated by semicolons" + shape_notation, cxxopts::value<std::string>())
+      ("sweep-halo-exchange-methods", "Halo exchange methods to sweep, separated by semicolons", cxxopts::value<std::string>())
+      ("sweep-filter-dims", "Process grid filter dimensions to sweep, separated by semicolons", cxxopts::value<std::string>())
+      ("sweep-zip", "Pair the swept image and process grid sizes for weak scaling")
+      ("halo-exchange-methods", "Halo exchange methods to measure, separated by semicolons (only applicable to halo_exchange_benchmark)", cxxopts::value<std::string>())
+      ("halo-widths", "Halo widths to measure (only applicable to halo_exchange_benchmark)", cxxopts::value<std::string>()->default_value("1"))
+      ("halo-accum-ops", "Halo accumulation operations to measure, ID or SUM, separated by semicolons (only applicable to halo_exchange_benchmark)", cxxopts::value<std::string>()->default_value("ID"))
+      ("block-pool-size", "Non-overlapping pooling window of the block, or 0 for no pooling (only applicable to distconv_block_benchmark)", cxxopts::value<int>()->default_value("2"))
+      ("block-residual", "Add the block input to the batchnorm output (only applicable to distconv_block_benchmark)")
       ("help", "Print help")
       ;
   auto result = cmd_opts.parse(argc, argv);
@@ -0,0 +1,188 @@
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "distconv_config.hpp"
+#include "benchmark_common.hpp"
+
+#include "distconv/base.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/tensor_mpi_cuda.hpp"
+#include "distconv/util/cxxopts.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include "h2/gpu/runtime.hpp"
+
+/*
+  Times the N-ary Concatenate and Slice of 4D tensors whose samples
+  are split over the ranks, along each dimension, with the strided
+  copies of contiguous runs and with the kernel. The bandwidth counts
+  the bytes both read and written. The results are printed as a table
+  and saved to <output-file>_concat.csv.
+ */
+
+using namespace distconv;
+using DataType = float;
+using Tensor = tensor::Tensor<DataType, tensor::LocaleMPI,
+                              tensor::CUDAAllocator>;
+
+namespace distconv_benchmark {
+
+struct Options {
+  index_t width;
+  index_t channels;
+  int num_samples;
+  int num_parts;
+  int run_count;
+  int warming_up_count;
+  std::string output_file;
+};
+
+// Average time in ms of f over the runs, taking the maximum over the
+// ranks
+template <typename F>
+double time_op(const Options &opts, F f, h2::gpu::DeviceStream stream,
+               MPI_Comm comm) {
+  for (int i = 0; i < opts.warming_up_count; ++i) {
+    f();
+  }
+  h2::gpu::sync(stream);
+  DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+  const double start = MPI_Wtime();
+  for (int i = 0; i < opts.run_count; ++i) {
+    f();
+  }
+  h2::gpu::sync(stream);
+  double t = (MPI_Wtime() - start) * 1e3 / opts.run_count;
+  DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE,
+                                   MPI_MAX, comm));
+  return t;
+}
+
+Metrics get_metrics(const std::string &path, const std::string &op,
+                    int dim, size_t bytes, double time) {
+  Metrics m;
+  m.add("path", path);
+  m.add("op", op);
+  m.add("dim", dim);
+  m.add("bytes", bytes);
+  m.add("time_us", time * 1e3);
+  m.add("gbps", 2.0 * bytes / (time * 1e-3) / 1e9);
+  return m;
+}
+
+// Splits the whole tensor evenly into opts.num_parts parts along dim,
+// the last part taking the remainder.
+void run_dim(const Options &opts, int dim, MPI_Comm comm,
+             h2::gpu::DeviceStream stream, MetricsTable &table) {
+  int np;
+  DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &np));
+  tensor::LocaleMPI loc(comm);
+  const auto dist = tensor::Distribution::make_distribution({1, 1, 1, np});
+  const tensor::Shape shape({opts.width, opts.width, opts.channels,
+                             (index_t)opts.num_samples * np});
+  if (shape[dim] < opts.num_parts) {
+    util::MPIRootPrintStreamInfo() << "Skipping dimension " << dim
+                                   << ", smaller than the number of parts";
+    return;
+  }
+  if (dim == 3 && np > 1) {
+    // Concatenating along a partitioned dimension is not supported.
+    util::MPIRootPrintStreamInfo() << "Skipping the sample dimension";
+    return;
+  }
+  Tensor whole(shape, loc, dist);
+  assert0(whole.allocate());
+  whole.zero();
+  std::vector<std::unique_ptr<Tensor>> parts;
+  std::vector<Tensor*> dests;
+  std::vector<const Tensor*> srcs;
+  const index_t extent = shape[dim];
+  for (int i = 0; i < opts.num_parts; ++i) {
+    auto part_shape = shape;
+    part_shape[dim] = extent / opts.num_parts;
+    if (i == opts.num_parts - 1) {
+      part_shape[dim] += extent % opts.num_parts;
+    }
+    parts.emplace_back(std::make_unique<Tensor>(part_shape, loc, dist));
+    assert0(parts.back()->allocate());
+    parts.back()->zero();
+    dests.push_back(parts.back().get());
+    srcs.push_back(parts.back().get());
+  }
+  const size_t bytes = whole.get_local_size() * sizeof(DataType);
+  for (const bool copies: {true, false}) {
+    tensor::set_concat_copies_enabled(copies);
+    const std::string path = copies ? "copies" : "kernel";
+    double t = time_op(opts, [&]() {
+        tensor::Concatenate(whole, srcs, stream); }, stream, comm);
+    table.add(get_metrics(path, "concat", dim, bytes, t));
+    t = time_op(opts, [&]() {
+        tensor::Slice(dests, whole, stream); }, stream, comm);
+    table.add(get_metrics(path, "slice", dim, bytes, t));
+  }
+  tensor::set_concat_copies_enabled(true);
+}
+
+Options process_opt(int argc, char *argv[], int pid) {
+  cxxopts::Options cmd_opts(argv[0], "Concat Benchmark");
+  cmd_opts.add_options()
+      ("r,num-runs", "Number of runs", cxxopts::value<int>()->default_value("20"))
+      ("num-warmup-runs", "Number of warming-up runs", cxxopts::value<int>()->default_value("5"))
+      ("o,output-file", "Save results to <file>_concat.csv", cxxopts::value<std::string>()->default_value("results"))
+      ("width", "Width and height of the tensors", cxxopts::value<index_t>()->default_value("64"))
+      ("channels", "Channels of the concatenated tensor", cxxopts::value<index_t>()->default_value("256"))
+      ("num-samples", "Number of local samples", cxxopts::value<int>()->default_value("8"))
+      ("num-parts", "Number of parts", cxxopts::value<int>()->default_value("4"))
+      ("help", "Print help")
+      ;
+  auto result = cmd_opts.parse(argc, argv);
+  if (result.count("help")) {
+    if (pid == 0) {
+      std::cout << cmd_opts.help() << "\n";
+    }
+    DISTCONV_CHECK_MPI(MPI_Finalize());
+    exit(0);
+  }
+  Options opts;
+  opts.run_count = result["num-runs"].as<int>();
+  opts.warming_up_count = result["num-warmup-runs"].as<int>();
+  opts.output_file = result["output-file"].as<std::string>();
+  opts.width = result["width"].as<index_t>();
+  opts.channels = result["channels"].as<index_t>();
+  opts.num_samples = result["num-samples"].as<int>();
+  opts.num_parts = result["num-parts"].as<int>();
+  assert_always(opts.num_parts > 0);
+  return opts;
+}
+
+} // namespace distconv_benchmark
+
+int main(int argc, char *argv[]) {
+  h2::gpu::set_gpu(util::choose_gpu());
+  DISTCONV_CHECK_MPI(MPI_Init(&argc, &argv));
+  int pid;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(MPI_COMM_WORLD, &pid));
+
+  const auto opts = distconv_benchmark::process_opt(argc, argv, pid);
+
+  h2::gpu::DeviceStream stream = h2::gpu::make_stream();
+  distconv_benchmark::MetricsTable table;
+  for (int dim = 0; dim < 4; ++dim) {
+    distconv_benchmark::run_dim(opts, dim, MPI_COMM_WORLD, stream, table);
+  }
+
+  if (pid == 0) {
+    table.print(std::cout);
+    std::ofstream ofs(opts.output_file + "_concat.csv");
+    table.write_csv(ofs);
+  }
+
+  h2::gpu::destroy(stream);
+  DISTCONV_CHECK_MPI(MPI_Finalize());
+  return 0;
+}
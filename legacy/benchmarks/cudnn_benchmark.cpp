@@ -1,254 +1,324 @@
 #include "benchmark_common.hpp"
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/runtime_gpu.hpp"
 #include "distconv/util/cxxopts.hpp"
-#include "distconv/util/stopwatch.h"
 #include "distconv/util/util.hpp"
+#include "distconv/util/util_gpu.hpp"
 #include "distconv/util/util_gpu_dnn.hpp"
 
-#include <cuda.h>
-#include <cudnn.h>
+#include "h2/gpu/memory_utils.hpp"
+#include "h2/gpu/runtime.hpp"
+
+#include <Al.hpp>
 
 #include <algorithm>
 #include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <numeric>
 #include <sstream>
 #include <vector>
 
+/*
+  Single-GPU convolution benchmark, a baseline for the parallel
+  efficiency of distconv and a tool for choosing the algorithms of the
+  DNN library, either cuDNN or MIOpen.
+
+  The algorithms are selected by the backend from their names, so
+  HEURISTIC, AUTOTUNE and DETERMINISTIC work as in distconv. Before
+  measuring, the algorithms the library finds for each pass are
+  listed with their times and workspace sizes; with MIOpen, the
+  solutions of the immediate mode are also listed.
+ */
+
 using namespace distconv;
 using distconv_benchmark::BenchmarkDataType;
 using distconv_benchmark::BenchmarkConfig;
 
-//#define CUDNN_DATA_REAL CUDNN_DATA_FLOAT
-
-cudnnHandle_t cudnn_h;
-cudaStream_t stream;
-//const REAL ONE(1.0);
-//const REAL ZERO(0.0);
 #define BIAS_INIT (0.01)
 
-#if 0
-class Opts {
- public:
-  constexpr static int max_num_spatial_dims = 3;
-  int num_spatial_dims;
-  std::string tensor_fmt;
-
-  int num_samples;
-  int num_channels;
-  std::vector<int> spatial_dims;
-  int num_filters;
-  std::vector<int> filter_dims;
-
-  std::vector<int> strides;
-  std::vector<int> dilations;
-
-  bool use_padding;
-  bool use_bias;
-
-  int warming_up_count;
-  int run_count;
-
-  cudnnConvolutionFwdAlgo_t conv_fwd_algo;
-  cudnnConvolutionBwdDataAlgo_t conv_bwd_data_algo;
-  cudnnConvolutionBwdFilterAlgo_t conv_bwd_filter_algo;
-
-  std::string output_file;
-
-  bool dump_input;
-  bool dump_output;
-  bool dump_binary;
-
-  BenchmarkDataType data_type;
-
-  Opts(): num_spatial_dims(max_num_spatial_dims),
-          tensor_fmt("NCHW"),
-          num_samples(8), num_channels(16),
-          spatial_dims(max_num_spatial_dims, 32),
-          num_filters(16),
-          filter_dims(max_num_spatial_dims, 3),
-          strides(max_num_spatial_dims, 1),
-          dilations(max_num_spatial_dims, 1),
-          use_padding(true), use_bias(false),
-          warming_up_count(2), run_count(5),
-          conv_fwd_algo(CUDNN_CONVOLUTION_FWD_ALGO_IMPLICIT_GEMM),
-          conv_bwd_data_algo(CUDNN_CONVOLUTION_BWD_DATA_ALGO_1),
-          conv_bwd_filter_algo(CUDNN_CONVOLUTION_BWD_FILTER_ALGO_1),
-          output_file(""),
-          dump_input(false),
-          dump_output(false),
-          dump_binary(false),
-          data_type(BenchmarkDataType::FLOAT) {}
-
-  Opts(const cxxopts::ParseResult &pr): Opts() {
-    if (pr.count("num-dims") > 0) {
-      num_spatial_dims = pr["num-dims"].as<int>();
-    } else {
-      num_spatial_dims = 2;
-    }
-    spatial_dims.resize(num_spatial_dims);
-    strides.resize(num_spatial_dims);
-    dilations.resize(num_spatial_dims);
-    filter_dims.resize(num_spatial_dims);
-    if (pr.count("width") > 0) {
-      spatial_dims[num_spatial_dims-1] = pr["width"].as<int>();
-    }
-    if (pr.count("height") > 0) {
-      spatial_dims[num_spatial_dims-2] = pr["height"].as<int>();
-    }
-    if (num_spatial_dims >= 3) {
-      if (pr.count("depth") > 0) {
-        spatial_dims[num_spatial_dims-3] = pr["depth"].as<int>();
-      }
-    }
-    if (pr.count("num-samples") > 0) {
-      num_samples = pr["num-samples"].as<int>();
-    }
-    if (pr.count("num-channels") > 0) {
-      num_channels = pr["num-channels"].as<int>();
-    }
-    if (pr.count("filter-width") > 0) {
-      filter_dims[num_spatial_dims-1] = pr["filter-width"].as<int>();
-    }
-    if (pr.count("filter-height") > 0) {
-      filter_dims[num_spatial_dims-2] = pr["filter-height"].as<int>();
-    }
-    if (num_spatial_dims >= 3) {
-      if (pr.count("filter-depth") > 0) {
-        filter_dims[num_spatial_dims-3] = pr["filter-depth"].as<int>();
-      }
-    }
-    if (pr.count("num-filters") > 0) {
-      num_filters = pr["num-filters"].as<int>();
-    }
-    if (pr.count("stride") > 0) {
-      std::fill(strides.begin(), strides.end(),
-                pr["stride"].as<int>());
+// Largest workspace given to the searches of the library
+constexpr size_t max_find_ws_size = size_t(1) << 30;
+
+// An algorithm or solution timed by the library
+struct AlgoPerf {
+  std::string name;
+  float time;
+  size_t memory;
+  bool ok;
+};
+
+void print_algo_perfs(std::ostream &os, const std::string &title,
+                      const std::vector<AlgoPerf> &perfs) {
+  os << title << ":\n";
+  for (const auto &p: perfs) {
+    os << "  " << p.name << ": ";
+    if (p.ok) {
+      os << p.time << " ms, workspace " << p.memory << " bytes";
     } else {
-      if (pr.count("stride-width") > 0) {
-        strides[num_spatial_dims-1] = pr["stride-width"].as<int>();
-      }
-      if (pr.count("stride-height") > 0) {
-        strides[num_spatial_dims-2] = pr["stride-height"].as<int>();
-      }
-      if (num_spatial_dims >= 3) {
-        if (pr.count("stride-depth") > 0) {
-          strides[num_spatial_dims-3] = pr["stride-depth"].as<int>();
-        }
-      }
+      os << "failed";
     }
-    if (pr.count("dilation") > 0) {
-      std::fill(dilations.begin(), dilations.end(),
-                pr["dilation"].as<int>());
-    } else {
-      if (pr.count("dilation-width") > 0) {
-        dilations[num_spatial_dims-1] = pr["dilation-width"].as<int>();
-      }
-      if (pr.count("dilation-height") > 0) {
-        dilations[num_spatial_dims-2] = pr["dilation-height"].as<int>();
-      }
-      if (num_spatial_dims >= 3) {
-        if (pr.count("dilation-depth") > 0) {
-          dilations[num_spatial_dims-3] = pr["dilation-depth"].as<int>();
-        }
-      }
-    }
-    if (pr.count("no-padding") > 0) {
-      use_padding = !pr["no-padding"].as<bool>();
-    }
-    if (pr.count("use-bias") > 0) {
-      use_bias = pr["use-bias"].as<bool>();
-    }
-    if (pr.count("conv-fwd-algo") > 0) {
-      conv_fwd_algo = util::CUDNNConvolutionFwdAlgorithms::get_algo(
-          pr["conv-fwd-algo"].as<std::string>());
-    }
-    if (pr.count("conv-bwd-data-algo") > 0) {
-      conv_bwd_data_algo = util::CUDNNConvolutionBwdDataAlgorithms::get_algo(
-          pr["conv-bwd-data-algo"].as<std::string>());
-    }
-    if (pr.count("conv-bwd-filter-algo") > 0) {
-      conv_bwd_filter_algo = util::CUDNNConvolutionBwdFilterAlgorithms::get_algo(
-          pr["conv-bwd-filter-algo"].as<std::string>());
-    }
-    if (pr.count("conv-algo") > 0) {
-      conv_fwd_algo = util::CUDNNConvolutionFwdAlgorithms::get_algo(
-          pr["conv-algo"].as<std::string>());
-      conv_bwd_data_algo = util::CUDNNConvolutionBwdDataAlgorithms::get_algo(
-          pr["conv-algo"].as<std::string>());
-      conv_bwd_filter_algo = util::CUDNNConvolutionBwdFilterAlgorithms::get_algo(
-          pr["conv-algo"].as<std::string>());
-    }
-    if (pr.count("num-runs") > 0) {
-      run_count = pr["num-runs"].as<int>();
-    }
-    if (pr.count("output-file") > 0) {
-      output_file = pr["output-file"].as<std::string>();
-    }
-    if (pr.count("dump-input") > 0) {
-      dump_input = true;
-    }
-    if (pr.count("dump-output") > 0) {
-      dump_output = true;
-    }
-    if (pr.count("dump") > 0) {
-      dump_input = true;
-      dump_output = true;
-    }
-    if (pr.count("dump-binary") > 0) {
-      dump_binary = pr["dump-binary"].as<bool>();
-    }
-    if (pr.count("data-type") > 0) {
-      std::string type_name = pr["data-type"].as<std::string>();
-      if (type_name == "float") {
-        data_type = BenchmarkDataType::FLOAT;
-      } else if (type_name == "double") {
-        data_type = BenchmarkDataType::DOUBLE;
-      } else if (type_name == "half") {
-        data_type = BenchmarkDataType::HALF;
-      } else {
-        std::cerr << "Unknown data type\n";
-        abort();
-      }
+    os << "\n";
+  }
+}
+
+#if H2_HAS_CUDA
+
+std::string get_dnn_lib_version() {
+  return "cuDNN v" + util::get_cudnn_version_number_string();
+}
+
+template <typename REAL>
+void set_tensor_desc(dnn_lib::TensorDescriptor_t desc,
+                     const std::vector<int> &dims,
+                     const std::vector<int> &strides) {
+  DISTCONV_CHECK_CUDNN(cudnnSetTensorNdDescriptor(
+      desc, util::get_dnnlib_type<REAL>(), dims.size(),
+      dims.data(), strides.data()));
+}
+
+template <typename REAL>
+void set_filter_desc(dnn_lib::FilterDescriptor_t desc,
+                     const std::vector<int> &dims) {
+  DISTCONV_CHECK_CUDNN(cudnnSetFilterNdDescriptor(
+      desc, util::get_dnnlib_type<REAL>(), CUDNN_TENSOR_NCHW, dims.size(),
+      dims.data()));
+}
+
+// Enables Tensor Cores
+void set_math_type(dnn_lib::ConvolutionDescriptor_t conv_desc) {
+  DISTCONV_CHECK_CUDNN(cudnnSetConvolutionMathType(
+      conv_desc, CUDNN_TENSOR_OP_MATH));
+}
+
+template <typename PerfType>
+std::vector<AlgoPerf> to_algo_perfs(const std::vector<PerfType> &results,
+                                    int count) {
+  std::vector<AlgoPerf> perfs;
+  for (int i = 0; i < count; ++i) {
+    const auto &r = results[i];
+    auto name = util::get_name(r.algo);
+    if (r.determinism == CUDNN_DETERMINISTIC) {
+      name += " (deterministic)";
     }
+    perfs.push_back({name, r.time, r.memory,
+                     r.status == CUDNN_STATUS_SUCCESS});
   }
+  return perfs;
+}
+
+std::vector<AlgoPerf> find_fwd_algorithms(
+    dnn_lib::Handle_t handle,
+    dnn_lib::TensorDescriptor_t x_d, const void *x,
+    dnn_lib::FilterDescriptor_t f_d, const void *f,
+    dnn_lib::ConvolutionDescriptor_t conv_desc,
+    dnn_lib::TensorDescriptor_t y_d, void *y,
+    void *ws, size_t ws_size) {
+  int count;
+  DISTCONV_CHECK_CUDNN(cudnnGetConvolutionForwardAlgorithmMaxCount(
+      handle, &count));
+  std::vector<cudnnConvolutionFwdAlgoPerf_t> results(count);
+  DISTCONV_CHECK_CUDNN(cudnnFindConvolutionForwardAlgorithmEx(
+      handle, x_d, x, f_d, f, conv_desc, y_d, y, count, &count,
+      results.data(), ws, ws_size));
+  return to_algo_perfs(results, count);
+}
+
+std::vector<AlgoPerf> find_bwd_data_algorithms(
+    dnn_lib::Handle_t handle,
+    dnn_lib::FilterDescriptor_t f_d, const void *f,
+    dnn_lib::TensorDescriptor_t dy_d, const void *dy,
+    dnn_lib::ConvolutionDescriptor_t conv_desc,
+    dnn_lib::TensorDescriptor_t dx_d, void *dx,
+    void *ws, size_t ws_size) {
+  int count;
+  DISTCONV_CHECK_CUDNN(cudnnGetConvolutionBackwardDataAlgorithmMaxCount(
+      handle, &count));
+  std::vector<cudnnConvolutionBwdDataAlgoPerf_t> results(count);
+  DISTCONV_CHECK_CUDNN(cudnnFindConvolutionBackwardDataAlgorithmEx(
+      handle, f_d, f, dy_d, dy, conv_desc, dx_d, dx, count, &count,
+      results.data(), ws, ws_size));
+  return to_algo_perfs(results, count);
+}
+
+std::vector<AlgoPerf> find_bwd_filter_algorithms(
+    dnn_lib::Handle_t handle,
+    dnn_lib::TensorDescriptor_t x_d, const void *x,
+    dnn_lib::TensorDescriptor_t dy_d, const void *dy,
+    dnn_lib::ConvolutionDescriptor_t conv_desc,
+    dnn_lib::FilterDescriptor_t df_d, void *df,
+    void *ws, size_t ws_size) {
+  int count;
+  DISTCONV_CHECK_CUDNN(cudnnGetConvolutionBackwardFilterAlgorithmMaxCount(
+      handle, &count));
+  std::vector<cudnnConvolutionBwdFilterAlgoPerf_t> results(count);
+  DISTCONV_CHECK_CUDNN(cudnnFindConvolutionBackwardFilterAlgorithmEx(
+      handle, x_d, x, dy_d, dy, conv_desc, df_d, df, count, &count,
+      results.data(), ws, ws_size));
+  return to_algo_perfs(results, count);
+}
 
-  std::ostream &print(std::ostream &os) {
-    return os << "Number of samples: " << num_samples
-              << ", number of channels: " << num_channels
-              << ", sample dims: "
-              << util::tostring(spatial_dims.begin(), spatial_dims.end())
-              << ", number of filters: " << num_filters
-              << ", filter dims: "
-              << util::tostring(filter_dims.begin(), filter_dims.end())
-              << ", strides: "
-              << util::tostring(strides.begin(), strides.end())
-              << ", dilations: "
-              << util::tostring(dilations.begin(), dilations.end())
-              << ", padding: " << use_padding
-              << ", conv fwd algorithm: " << conv_fwd_algo
-              << ", conv bwd data algorithm: " << conv_bwd_data_algo
-              << ", conv bwd filter algorithm: " << conv_bwd_filter_algo;
+#elif H2_HAS_ROCM
+
+std::string get_dnn_lib_version() {
+  return "MIOpen v" + util::get_miopen_version_number_string();
+}
+
+template <typename REAL>
+void set_tensor_desc(dnn_lib::TensorDescriptor_t desc,
+                     const std::vector<int> &dims,
+                     const std::vector<int> &strides) {
+  DISTCONV_CHECK_MIOPEN(miopenSetTensorDescriptor(
+      desc, util::get_dnnlib_type<REAL>(), dims.size(),
+      dims.data(), strides.data()));
+}
+
+// Filters are described as packed tensors
+template <typename REAL>
+void set_filter_desc(dnn_lib::FilterDescriptor_t desc,
+                     const std::vector<int> &dims);
+
+// MIOpen chooses the math of convolutions by itself
+void set_math_type(dnn_lib::ConvolutionDescriptor_t) {}
+
+// Find returns up to this many algorithms
+constexpr int max_algo_count = 5;
+
+std::vector<AlgoPerf> to_algo_perfs(
+    const std::vector<miopenConvAlgoPerf_t> &results, int count,
+    std::string (*get_algo_name)(const miopenConvAlgoPerf_t &)) {
+  std::vector<AlgoPerf> perfs;
+  for (int i = 0; i < count; ++i) {
+    perfs.push_back({get_algo_name(results[i]), results[i].time,
+                     results[i].memory, true});
   }
+  return perfs;
+}
 
-  std::ostream &print_as_row(std::ostream &os) {
-    os << num_samples << " " << num_channels << " "
-       << util::join(" ", spatial_dims.begin(), spatial_dims.end())
-       << " " << num_filters << " "
-       << util::join(" ", filter_dims.begin(), filter_dims.end())
-       << " "
-       << util::join(" ", strides.begin(), strides.end())
-       << " "
-       << util::join(" ", dilations.begin(), dilations.end())
-       << " " << conv_fwd_algo << " " << conv_bwd_data_algo << " "
-       << conv_bwd_filter_algo;
-    return os;
+std::vector<AlgoPerf> to_algo_perfs(
+    const std::vector<miopenConvSolution_t> &solutions) {
+  std::vector<AlgoPerf> perfs;
+  for (const auto &s: solutions) {
+    std::stringstream ss;
+    ss << "solution " << s.solution_id << " (algorithm " << s.algorithm
+       << ")";
+    perfs.push_back({ss.str(), s.time, s.workspace_size, true});
   }
-};
+  return perfs;
+}
 
-std::ostream &operator<<(std::ostream &os, Opts &o) {
-  return o.print(os);
+std::vector<AlgoPerf> find_fwd_algorithms(
+    dnn_lib::Handle_t handle,
+    dnn_lib::TensorDescriptor_t x_d, const void *x,
+    dnn_lib::FilterDescriptor_t f_d, const void *f,
+    dnn_lib::ConvolutionDescriptor_t conv_desc,
+    dnn_lib::TensorDescriptor_t y_d, void *y,
+    void *ws, size_t ws_size) {
+  std::vector<miopenConvAlgoPerf_t> results(max_algo_count);
+  int count;
+  DISTCONV_CHECK_MIOPEN(miopenFindConvolutionForwardAlgorithm(
+      handle, x_d, x, f_d, f, conv_desc, y_d, y, max_algo_count, &count,
+      results.data(), ws, ws_size, /*exhaustiveSearch=*/1));
+  auto perfs = to_algo_perfs(
+      results, count, [](const miopenConvAlgoPerf_t &p) {
+        return util::get_name(p.fwd_algo);
+      });
+  size_t num_solutions;
+  DISTCONV_CHECK_MIOPEN(miopenConvolutionForwardGetSolutionCount(
+      handle, f_d, x_d, conv_desc, y_d, &num_solutions));
+  std::vector<miopenConvSolution_t> solutions(num_solutions);
+  DISTCONV_CHECK_MIOPEN(miopenConvolutionForwardGetSolution(
+      handle, f_d, x_d, conv_desc, y_d, num_solutions, &num_solutions,
+      solutions.data()));
+  solutions.resize(num_solutions);
+  auto solution_perfs = to_algo_perfs(solutions);
+  perfs.insert(perfs.end(), solution_perfs.begin(), solution_perfs.end());
+  return perfs;
+}
+
+std::vector<AlgoPerf> find_bwd_data_algorithms(
+    dnn_lib::Handle_t handle,
+    dnn_lib::FilterDescriptor_t f_d, const void *f,
+    dnn_lib::TensorDescriptor_t dy_d, const void *dy,
+    dnn_lib::ConvolutionDescriptor_t conv_desc,
+    dnn_lib::TensorDescriptor_t dx_d, void *dx,
+    void *ws, size_t ws_size) {
+  std::vector<miopenConvAlgoPerf_t> results(max_algo_count);
+  int count;
+  DISTCONV_CHECK_MIOPEN(miopenFindConvolutionBackwardDataAlgorithm(
+      handle, dy_d, dy, f_d, f, conv_desc, dx_d, dx, max_algo_count, &count,
+      results.data(), ws, ws_size, /*exhaustiveSearch=*/1));
+  auto perfs = to_algo_perfs(
+      results, count, [](const miopenConvAlgoPerf_t &p) {
+        return util::get_name(p.bwd_data_algo);
+      });
+  size_t num_solutions;
+  DISTCONV_CHECK_MIOPEN(miopenConvolutionBackwardDataGetSolutionCount(
+      handle, dy_d, f_d, conv_desc, dx_d, &num_solutions));
+  std::vector<miopenConvSolution_t> solutions(num_solutions);
+  DISTCONV_CHECK_MIOPEN(miopenConvolutionBackwardDataGetSolution(
+      handle, dy_d, f_d, conv_desc, dx_d, num_solutions, &num_solutions,
+      solutions.data()));
+  solutions.resize(num_solutions);
+  auto solution_perfs = to_algo_perfs(solutions);
+  perfs.insert(perfs.end(), solution_perfs.begin(), solution_perfs.end());
+  return perfs;
+}
+
+std::vector<AlgoPerf> find_bwd_filter_algorithms(
+    dnn_lib::Handle_t handle,
+    dnn_lib::TensorDescriptor_t x_d, const void *x,
+    dnn_lib::TensorDescriptor_t dy_d, const void *dy,
+    dnn_lib::ConvolutionDescriptor_t conv_desc,
+    dnn_lib::FilterDescriptor_t df_d, void *df,
+    void *ws, size_t ws_size) {
+  std::vector<miopenConvAlgoPerf_t> results(max_algo_count);
+  int count;
+  DISTCONV_CHECK_MIOPEN(miopenFindConvolutionBackwardWeightsAlgorithm(
+      handle, dy_d, dy, x_d, x, conv_desc, df_d, df, max_algo_count, &count,
+      results.data(), ws, ws_size, /*exhaustiveSearch=*/1));
+  auto perfs = to_algo_perfs(
+      results, count, [](const miopenConvAlgoPerf_t &p) {
+        return util::get_name(p.bwd_weights_algo);
+      });
+  size_t num_solutions;
+  DISTCONV_CHECK_MIOPEN(miopenConvolutionBackwardWeightsGetSolutionCount(
+      handle, dy_d, x_d, conv_desc, df_d, &num_solutions));
+  std::vector<miopenConvSolution_t> solutions(num_solutions);
+  DISTCONV_CHECK_MIOPEN(miopenConvolutionBackwardWeightsGetSolution(
+      handle, dy_d, x_d, conv_desc, df_d, num_solutions, &num_solutions,
+      solutions.data()));
+  solutions.resize(num_solutions);
+  auto solution_perfs = to_algo_perfs(solutions);
+  perfs.insert(perfs.end(), solution_perfs.begin(), solution_perfs.end());
+  return perfs;
+}
+
+#endif // H2_HAS_CUDA
+
+std::vector<int> get_dims(int n, int c, const std::vector<int> &spatial_dims) {
+  std::vector<int> dims{n, c};
+  dims.insert(dims.end(), spatial_dims.begin(), spatial_dims.end());
+  return dims;
+}
+
+// Strides of a packed NCHW tensor
+std::vector<int> get_packed_strides(const std::vector<int> &dims) {
+  std::vector<int> strides(dims.size(), 1);
+  for (int i = (int) dims.size() - 2; i >= 0; --i) {
+    strides[i] = strides[i + 1] * dims[i + 1];
+  }
+  return strides;
 }
-#endif
+
+#if H2_HAS_ROCM
+template <typename REAL>
+void set_filter_desc(dnn_lib::FilterDescriptor_t desc,
+                     const std::vector<int> &dims) {
+  set_tensor_desc<REAL>(desc, dims, get_packed_strides(dims));
+}
+#endif // H2_HAS_ROCM
 
 template <int NSD>
 class Profile {
@@ -275,32 +345,22 @@ class Profile {
     return os;
   }
 
-  void print_summary(std::ostream &os) {
+  static void print_stats(std::ostream &os, const std::string &name,
+                          const std::vector<float> &times) {
     using namespace distconv_benchmark;
-    std::cout << "Forward mean: " << get_mean(conv_fwd_time)
-              << ", median: " << get_median(conv_fwd_time)
-              << ", min: " << get_min(conv_fwd_time)
-              << ", max: " << get_max(conv_fwd_time)
-              << "\n";
-    std::cout << "Backward data mean: "
-              << get_mean(conv_bwd_data_time)
-              << ", median: " << get_median(conv_bwd_data_time)
-              << ", min: " << get_min(conv_bwd_data_time)
-              << ", max: " << get_max(conv_bwd_data_time)
-              << "\n";
-    std::cout << "Backward filter mean: "
-              << get_mean(conv_bwd_filter_time)
-              << ", median: " << get_median(conv_bwd_filter_time)
-              << ", min: " << get_min(conv_bwd_filter_time)
-              << ", max: " << get_max(conv_bwd_filter_time)
-              << "\n";
+    os << name << " mean: " << get_mean(times)
+       << ", median: " << get_median(times)
+       << ", min: " << get_min(times)
+       << ", max: " << get_max(times)
+       << "\n";
+  }
+
+  void print_summary(std::ostream &os) {
+    print_stats(os, "Forward", conv_fwd_time);
+    print_stats(os, "Backward data", conv_bwd_data_time);
+    print_stats(os, "Backward filter", conv_bwd_filter_time);
     if (m_cfg.use_bias) {
-      std::cout << "Backward bias mean: "
-                << get_mean(conv_bwd_bias_time)
-                << ", median: " << get_median(conv_bwd_bias_time)
-                << ", min: " << get_min(conv_bwd_bias_time)
-                << ", max: " << get_max(conv_bwd_bias_time)
-                << "\n";
+      print_stats(os, "Backward bias", conv_bwd_bias_time);
     }
   }
 };
@@ -334,35 +394,28 @@ class Data {
   REAL *m_dy = nullptr;
   REAL *m_df = nullptr;
   REAL *m_db = nullptr;
-  cudnnTensorDescriptor_t m_x_d;
-  cudnnTensorDescriptor_t m_y_d;
-  cudnnFilterDescriptor_t m_f_d;
-  cudnnTensorDescriptor_t m_b_d;
-  cudnnTensorDescriptor_t m_dx_d;
-  cudnnTensorDescriptor_t m_dy_d;
-  cudnnFilterDescriptor_t m_df_d;
-  cudnnTensorDescriptor_t m_db_d;
+  dnn_lib::TensorDescriptor_t m_x_d;
+  dnn_lib::TensorDescriptor_t m_y_d;
+  dnn_lib::FilterDescriptor_t m_f_d;
+  dnn_lib::TensorDescriptor_t m_b_d;
+  dnn_lib::TensorDescriptor_t m_dx_d;
+  dnn_lib::TensorDescriptor_t m_dy_d;
+  dnn_lib::FilterDescriptor_t m_df_d;
+  dnn_lib::TensorDescriptor_t m_db_d;
 
   template <int NSD>
   Data(const BenchmarkConfig<NSD> &cfg, REAL *x, REAL *y, REAL *f, REAL *b,
        REAL *dx, REAL *dy, REAL *df, REAL *db):
       m_x(x), m_y(y), m_f(f), m_b(b), m_dx(dx), m_dy(dy), m_df(df), m_db(db) {
-    int nd = cfg.get_num_spatial_dims() + 2;
-    DISTCONV_CHECK_CUDNN(cudnnCreateTensorDescriptor(&m_x_d));
-    auto &&x_d_dims = util::get_cudnn_dims(cfg.i_n, cfg.i_c, cfg.i_s);
-    auto &&x_d_strides = util::get_cudnn_strides(cfg.i_n, cfg.i_c,
-                                                 cfg.i_s, "NCHW");
-    DISTCONV_CHECK_CUDNN(cudnnSetTensorNdDescriptor(
-        m_x_d, util::get_cudnn_type<REAL>(), nd,
-        x_d_dims.data(), x_d_strides.data()));
+    const auto x_dims = get_dims(cfg.i_n, cfg.i_c, cfg.i_s);
+    const auto x_strides = get_packed_strides(x_dims);
+    m_x_d = dnn_lib::make_tensor_descriptor();
+    set_tensor_desc<REAL>(m_x_d, x_dims, x_strides);
     std::cout << "x_d: " << util::tostring(m_x_d) << "\n";
 
-    DISTCONV_CHECK_CUDNN(cudnnCreateFilterDescriptor(&m_f_d));
-    auto &&f_d_dims = util::get_cudnn_dims(
-        cfg.f_k, cfg.i_c, cfg.f_s);
-    DISTCONV_CHECK_CUDNN(cudnnSetFilterNdDescriptor(
-        m_f_d, util::get_cudnn_type<REAL>(), CUDNN_TENSOR_NCHW, nd,
-        f_d_dims.data()));
+    const auto f_dims = get_dims(cfg.f_k, cfg.i_c, cfg.f_s);
+    m_f_d = dnn_lib::make_filter_descriptor();
+    set_filter_desc<REAL>(m_f_d, f_dims);
     std::cout << "f_d: " << util::tostring(m_f_d) << "\n";
 
     std::vector<int> output_spatial_dims;
@@ -370,103 +423,45 @@ class Data {
       output_spatial_dims.push_back(
           get_output_dim(cfg.i_s[i], cfg.f_s[i], cfg.strides[i],
                          cfg.dilations[i], cfg.use_padding, cfg.deconv));
-
     }
-
-    DISTCONV_CHECK_CUDNN(cudnnCreateTensorDescriptor(&m_y_d));
-    auto &&y_d_dims = util::get_cudnn_dims(cfg.i_n, cfg.f_k,
-                                           output_spatial_dims);
-    auto &&y_d_strides = util::get_cudnn_strides(
-        cfg.i_n, cfg.f_k, output_spatial_dims, "NCHW");
-    DISTCONV_CHECK_CUDNN(cudnnSetTensorNdDescriptor(
-        m_y_d, util::get_cudnn_type<REAL>(), nd,
-        y_d_dims.data(), y_d_strides.data()));
+    const auto y_dims = get_dims(cfg.i_n, cfg.f_k, output_spatial_dims);
+    const auto y_strides = get_packed_strides(y_dims);
+    m_y_d = dnn_lib::make_tensor_descriptor();
+    set_tensor_desc<REAL>(m_y_d, y_dims, y_strides);
     std::cout << "y_d: " << util::tostring(m_y_d) << "\n";
 
-    DISTCONV_CHECK_CUDNN(cudnnCreateTensorDescriptor(&m_dx_d));
-    DISTCONV_CHECK_CUDNN(cudnnSetTensorNdDescriptor(
-        m_dx_d, util::get_cudnn_type<REAL>(), nd,
-        x_d_dims.data(), x_d_strides.data()));
-    std::cout << "dx_d: " << util::tostring(m_dx_d) << "\n";
-
-    DISTCONV_CHECK_CUDNN(cudnnCreateFilterDescriptor(&m_df_d));
-    DISTCONV_CHECK_CUDNN(cudnnSetFilterNdDescriptor(
-        m_df_d, util::get_cudnn_type<REAL>(), CUDNN_TENSOR_NCHW, nd,
-        f_d_dims.data()));
-    std::cout << "df_d: " << util::tostring(m_df_d) << "\n";
-
-    DISTCONV_CHECK_CUDNN(cudnnCreateTensorDescriptor(&m_dy_d));
-    DISTCONV_CHECK_CUDNN(cudnnSetTensorNdDescriptor(
-        m_dy_d, util::get_cudnn_type<REAL>(), nd,
-        y_d_dims.data(), y_d_strides.data()));
-        std::cout << "dy_d: " << util::tostring(m_dy_d) << "\n";
+    m_dx_d = dnn_lib::make_tensor_descriptor();
+    set_tensor_desc<REAL>(m_dx_d, x_dims, x_strides);
+    m_df_d = dnn_lib::make_filter_descriptor();
+    set_filter_desc<REAL>(m_df_d, f_dims);
+    m_dy_d = dnn_lib::make_tensor_descriptor();
+    set_tensor_desc<REAL>(m_dy_d, y_dims, y_strides);
 
     if (cfg.use_bias) {
-      std::vector<int> bias_dims(nd, 1);
+      std::vector<int> bias_dims(x_dims.size(), 1);
       bias_dims[1] = cfg.f_k;
-      std::vector<int> bias_strides(nd, 1);
-      bias_strides[0] = cfg.f_k;
-      DISTCONV_CHECK_CUDNN(cudnnCreateTensorDescriptor(&m_b_d));
-      DISTCONV_CHECK_CUDNN(cudnnSetTensorNdDescriptor(
-          m_b_d, util::get_cudnn_type<REAL>(), nd,
-          bias_dims.data(), bias_strides.data()));
+      const auto bias_strides = get_packed_strides(bias_dims);
+      m_b_d = dnn_lib::make_tensor_descriptor();
+      set_tensor_desc<REAL>(m_b_d, bias_dims, bias_strides);
+      m_db_d = dnn_lib::make_tensor_descriptor();
+      set_tensor_desc<REAL>(m_db_d, bias_dims, bias_strides);
       std::cout << "b_d: " << util::tostring(m_b_d) << "\n";
-      DISTCONV_CHECK_CUDNN(cudnnCreateTensorDescriptor(&m_db_d));
-      DISTCONV_CHECK_CUDNN(cudnnSetTensorNdDescriptor(
-          m_db_d, util::get_cudnn_type<REAL>(), nd,
-          bias_dims.data(), bias_strides.data()));
-      std::cout << "db_d: " << util::tostring(m_db_d) << "\n";
     }
   }
-};
 
-#if 0
-Opts process_opt(int argc, char *argv[]) {
-  cxxopts::Options cmd_opts("cudnn_benchmark", "CUDNN Benchmark");
-  cmd_opts.add_options()
-      ("r,num-runs", "Number of runs", cxxopts::value<int>())
-      ("o,output-file", "Save performance profile to file", cxxopts::value<std::string>())
-      ("num-dims", "Number of spatial dimensions", cxxopts::value<int>())
-      ("h,height", "Sample height", cxxopts::value<int>())
-      ("w,width", "Sample width", cxxopts::value<int>())
-      ("d,depth", "Sample depth", cxxopts::value<int>())
-      ("n,num-samples", "Number of samples", cxxopts::value<int>())
-      ("c,num-channels", "Number of channels", cxxopts::value<int>())
-      ("filter-height", "Filter height", cxxopts::value<int>())
-      ("filter-width", "Filter width", cxxopts::value<int>())
-      ("filter-depth", "Filter depth", cxxopts::value<int>())
-      ("m,num-filters", "Number of filters", cxxopts::value<int>())
-      ("stride-height", "Vertical filter stride", cxxopts::value<int>())
-      ("stride-width", "Horizontal filter stride", cxxopts::value<int>())
-      ("stride", "Vertical and hotrizontal stride", cxxopts::value<int>())
-      ("dilation-height", "Vertical dilation", cxxopts::value<int>())
-      ("dilation-width", "Horizontal dilation", cxxopts::value<int>())
-      ("dilation", "Vertical and horizontal dilation", cxxopts::value<int>())
-      ("no-padding", "Does not use padding", cxxopts::value<bool>())
-      ("use-bias", "Use bias", cxxopts::value<bool>())
-      ("conv-fwd-algo", "Convolution fwd algorithm",
-       cxxopts::value<std::string>())
-      ("conv-bwd-data-algo", "Convolution bwd data algorithm",
-       cxxopts::value<std::string>())
-      ("conv-bwd-filter-algo", "Convolution bwd filter algorithm",
-       cxxopts::value<std::string>())
-      ("conv-algo", "Convolution algorithm", cxxopts::value<std::string>())
-      ("dump-input", "Dump input tensors")
-      ("dump-output", "Dump output tensors")
-      ("dump", "Dump input and output tensors")
-      ("dump-binary", "Dump binary tensors")
-      ("data-type", "Data type", cxxopts::value<std::string>())
-      ("help", "Print help")
-      ;
-  auto result = cmd_opts.parse(argc, argv);
-  if (result.count("help")) {
-    std::cout << cmd_opts.help() << "\n";
-    exit(0);
+  ~Data() {
+    dnn_lib::destroy_tensor_descriptor(m_x_d);
+    dnn_lib::destroy_tensor_descriptor(m_y_d);
+    dnn_lib::destroy_filter_descriptor(m_f_d);
+    dnn_lib::destroy_tensor_descriptor(m_dx_d);
+    dnn_lib::destroy_tensor_descriptor(m_dy_d);
+    dnn_lib::destroy_filter_descriptor(m_df_d);
+    if (m_b) {
+      dnn_lib::destroy_tensor_descriptor(m_b_d);
+      dnn_lib::destroy_tensor_descriptor(m_db_d);
+    }
   }
-  Opts o(result);
-  return o;
-}
-#endif
+};
 
 size_t calc_len(int n, int c, const std::vector<int> &spatial_dims) {
   size_t s = n * c;
@@ -477,29 +472,10 @@ size_t calc_len(int n, int c, const std::vector<int> &spatial_dims) {
 
 template <typename REAL>
 REAL *make_tensor(int n, int c, const std::vector<int> &spatial_dims) {
-  void *ptr;
+  REAL *ptr;
   size_t s = calc_len(n, c, spatial_dims);
-  DISTCONV_CHECK_CUDA(cudaMalloc(&ptr, sizeof(REAL) * s));
-  DISTCONV_CHECK_CUDA(cudaMemset(ptr, 0, sizeof(REAL) * s));
-  return (REAL*)ptr;
-}
-
-template <typename REAL>
-REAL *make_random_tensor(int n, int c, const std::vector<int> &spatial_dims,
-                         unsigned seed) {
-  REAL *ptr = make_tensor<REAL>(n, c, spatial_dims);
-  assert_always(ptr != nullptr);
-  size_t len = calc_len(n, c, spatial_dims);
-  std::srand(seed);
-  REAL *buf = new REAL[len];
-  {
-    for (size_t i = 0; i < len; i++) {
-      buf[i] = (float)(rand()) / RAND_MAX;
-    }
-  }
-  DISTCONV_CHECK_CUDA(cudaMemcpy(ptr, buf, len * sizeof(REAL),
-                                 cudaMemcpyHostToDevice));
-  delete[] buf;
+  DISTCONV_GPU_MALLOC(&ptr, sizeof(REAL) * s);
+  h2::gpu::mem_zero(ptr, s);
   return ptr;
 }
 
@@ -509,13 +485,8 @@ REAL *make_constant_tensor(int n, int c, const std::vector<int> &spatial_dims,
   REAL *ptr = make_tensor<REAL>(n, c, spatial_dims);
   assert_always(ptr != nullptr);
   size_t len = calc_len(n, c, spatial_dims);
-  REAL *buf = new REAL[len];
-  for (size_t i = 0; i < len; i++) {
-    buf[i] = d;
-  }
-  DISTCONV_CHECK_CUDA(cudaMemcpy(ptr, buf, len * sizeof(REAL),
-                                 cudaMemcpyHostToDevice));
-  delete[] buf;
+  std::vector<REAL> buf(len, d);
+  h2::gpu::mem_copy(ptr, buf.data(), len);
   return ptr;
 }
 
@@ -525,7 +496,7 @@ REAL *make_initialized_tensor(int n, int c, const std::vector<int> &spatial_dims
   REAL *ptr = make_tensor<REAL>(n, c, spatial_dims);
   assert_always(ptr != nullptr);
   size_t len = calc_len(n, c, spatial_dims);
-  REAL *buf = new REAL[len];
+  std::vector<REAL> buf(len);
   distconv_benchmark::Initializer<REAL> init(seed);
   size_t offset = 0;
   int w = spatial_dims[0];
@@ -562,298 +533,207 @@ REAL *make_initialized_tensor(int n, int c, const std::vector<int> &spatial_dims
       }
     }
   }
-  DISTCONV_CHECK_CUDA(cudaMemcpy(ptr, buf, len * sizeof(REAL),
-                                 cudaMemcpyHostToDevice));
-  delete[] buf;
+  h2::gpu::mem_copy(ptr, buf.data(), len);
   return ptr;
 }
 
 template <int NSD, typename REAL>
-cudnnConvolutionDescriptor_t get_conv_desc(const BenchmarkConfig<NSD> &cfg) {
-  cudnnConvolutionDescriptor_t conv_desc;
-  DISTCONV_CHECK_CUDNN(cudnnCreateConvolutionDescriptor(&conv_desc));
-  DISTCONV_CHECK_CUDNN(cudnnSetConvolutionNdDescriptor(
-      conv_desc, cfg.get_num_spatial_dims(),
-      cfg.pads.data(), cfg.strides.data(),
-      cfg.dilations.data(), CUDNN_CROSS_CORRELATION,
-      util::get_cudnn_type<REAL>()));
-  // enable Tensor Cores
-  DISTCONV_CHECK_CUDNN(cudnnSetConvolutionMathType(
-      conv_desc, CUDNN_TENSOR_OP_MATH));
+dnn_lib::ConvolutionDescriptor_t get_conv_desc(const BenchmarkConfig<NSD> &cfg) {
+  auto conv_desc = dnn_lib::make_convolution_descriptor();
+  dnn_lib::set_convolution_descriptor(
+      conv_desc, cfg.get_num_spatial_dims(), cfg.pads.data(),
+      cfg.strides.data(), cfg.dilations.data(), dnn_lib::default_conv_mode,
+      util::get_dnnlib_compute_type<REAL>());
+  set_math_type(conv_desc);
   return conv_desc;
 }
 
-template <int NSD, typename REAL>
-void setup_workspace(const Data<REAL> &d, cudnnConvolutionDescriptor_t conv_desc,
-                     const BenchmarkConfig<NSD> &cfg, size_t &ws_size, void *&ws) {
-  size_t f_size, bd_size, bf_size;
-  if (!cfg.deconv) {
-    DISTCONV_CHECK_CUDNN(cudnnGetConvolutionForwardWorkspaceSize(
-        cudnn_h,
-        d.m_x_d,
-        d.m_f_d,
-        conv_desc,
-        d.m_y_d,
-        util::CUDNNConvolutionFwdAlgorithms::get_algo(cfg.conv_fwd_algo),
-        &f_size));
-    DISTCONV_CHECK_CUDNN(cudnnGetConvolutionBackwardDataWorkspaceSize(
-        cudnn_h,
-        d.m_f_d,
-        d.m_dy_d,
-        conv_desc,
-        d.m_dx_d,
-        util::CUDNNConvolutionBwdDataAlgorithms::get_algo(cfg.conv_bwd_data_algo),
-        &bd_size));
-    DISTCONV_CHECK_CUDNN(cudnnGetConvolutionBackwardFilterWorkspaceSize(
-        cudnn_h,
-        d.m_x_d,
-        d.m_dy_d,
-        conv_desc,
-        d.m_df_d,
-        util::CUDNNConvolutionBwdFilterAlgorithms::get_algo(cfg.conv_bwd_filter_algo),
-        &bf_size));
-  } else {
-    DISTCONV_CHECK_CUDNN(cudnnGetConvolutionBackwardDataWorkspaceSize(
-        cudnn_h,
-        d.m_f_d,
-        d.m_x_d,
-        conv_desc,
-        d.m_y_d,
-        util::CUDNNConvolutionBwdDataAlgorithms::get_algo(cfg.conv_fwd_algo),
-        &f_size));
-    DISTCONV_CHECK_CUDNN(cudnnGetConvolutionForwardWorkspaceSize(
-        cudnn_h,
-        d.m_dy_d,
-        d.m_f_d,
-        conv_desc,
-        d.m_dx_d,
-        util::CUDNNConvolutionFwdAlgorithms::get_algo(cfg.conv_bwd_data_algo),
-        &bd_size));
-    DISTCONV_CHECK_CUDNN(cudnnGetConvolutionBackwardFilterWorkspaceSize(
-        cudnn_h,
-        d.m_dy_d,
-        d.m_x_d,
-        conv_desc,
-        d.m_df_d,
-        util::CUDNNConvolutionBwdFilterAlgorithms::get_algo(cfg.conv_bwd_filter_algo),
-        &bf_size));
-  }
-  ws_size = 0;
-  ws_size = std::max(f_size, bd_size);
-  ws_size = std::max(ws_size, bf_size);
-  DISTCONV_CHECK_CUDA(cudaMalloc(&ws, ws_size));
-  return;
-}
+// One of the passes of a convolution, with the algorithm chosen by
+// the backend
+struct Pass {
+  std::string name;
+  std::string algo_name;
+  size_t ws_size = 0;
+  std::function<void(void *ws, size_t ws_size)> run;
+};
 
+// Lists what the library finds for each pass, selects the algorithms
+// by the names in cfg and sets up the passes with them. A
+// deconvolution runs backward data as its forward pass and forward as
+// its backward data pass.
 template <int NSD, typename REAL>
-void run_forward_convolution(const Data<REAL> &d, cudnnConvolutionDescriptor_t conv_desc,
-                             const BenchmarkConfig<NSD> &cfg, size_t ws_size, void *ws) {
-  REAL zero(0.0);
-  REAL one(1.0);
-  if (!cfg.deconv) {
-    DISTCONV_CHECK_CUDNN(cudnnConvolutionForward(
-        cudnn_h, &one, d.m_x_d, d.m_x,
-        d.m_f_d, d.m_f,
-        conv_desc,
-        util::CUDNNConvolutionFwdAlgorithms::get_algo(cfg.conv_fwd_algo),
-        ws, ws_size, &zero,
-        d.m_y_d, d.m_y));
-  } else {
-    DISTCONV_CHECK_CUDNN(cudnnConvolutionBackwardData(
-        cudnn_h, &one, d.m_f_d, d.m_f,
-        d.m_x_d, d.m_x,
-        conv_desc,
-        util::CUDNNConvolutionBwdDataAlgorithms::get_algo(cfg.conv_fwd_algo),
-        ws, ws_size, &zero,
-        d.m_y_d, d.m_y));
-  }
-  if (cfg.use_bias) {
-    DISTCONV_CHECK_CUDNN(cudnnAddTensor(cudnn_h, &one, d.m_b_d, d.m_b, &one,
-                                        d.m_y_d, d.m_y));
-  }
-}
+std::vector<Pass> setup_passes(BackendDNNLib &be, const Data<REAL> &d,
+                               dnn_lib::ConvolutionDescriptor_t conv_desc,
+                               const BenchmarkConfig<NSD> &cfg) {
+  const auto handle = be.get_handle();
+  const size_t find_ws_size = std::min(dnn_lib::get_available_memory() / 2,
+                                       max_find_ws_size);
+  void *find_ws;
+  DISTCONV_GPU_MALLOC(&find_ws, find_ws_size);
+  // The algorithms selected by the backend may use up to this much
+  const size_t ws_limit = find_ws_size;
+
+  const REAL zero(0.0);
+  const REAL one(1.0);
+  std::vector<Pass> passes(3);
+  passes[0].name = "Forward";
+  passes[1].name = "Backward data";
+  passes[2].name = "Backward filter";
 
-template <int NSD, typename REAL>
-void run_backward_data_convolution(const Data<REAL> &d, cudnnConvolutionDescriptor_t conv_desc,
-                                   const BenchmarkConfig<NSD> &cfg, size_t ws_size, void *ws) {
-  REAL zero(0.0);
-  REAL one(1.0);
   if (!cfg.deconv) {
-    DISTCONV_CHECK_CUDNN(cudnnConvolutionBackwardData(
-        cudnn_h, &one, d.m_f_d, d.m_f,
-        d.m_dy_d, d.m_dy,
-        conv_desc,
-        util::CUDNNConvolutionBwdDataAlgorithms::get_algo(cfg.conv_bwd_data_algo),
-        ws, ws_size, &zero,
-        d.m_dx_d, d.m_dx));
-  } else {
-    DISTCONV_CHECK_CUDNN(cudnnConvolutionForward(
-        cudnn_h, &one, d.m_dy_d, d.m_dy,
-        d.m_f_d, d.m_f,
-        conv_desc,
-        util::CUDNNConvolutionFwdAlgorithms::get_algo(cfg.conv_bwd_data_algo),
-        ws, ws_size, &zero,
-        d.m_dx_d, d.m_dx));
-  }
-}
+    print_algo_perfs(std::cout, "Forward algorithms", find_fwd_algorithms(
+        handle, d.m_x_d, d.m_x, d.m_f_d, d.m_f, conv_desc, d.m_y_d, d.m_y,
+        find_ws, find_ws_size));
+    const auto fwd_algo = be.get_fwd_algorithm(
+        cfg.conv_fwd_algo, d.m_x_d, d.m_x, d.m_f_d, d.m_f, conv_desc,
+        d.m_y_d, d.m_y, ws_limit);
+    passes[0].algo_name = util::get_name(fwd_algo);
+    passes[0].ws_size = dnn_lib::get_conv_forward_workspace_size(
+        handle, d.m_x_d, d.m_f_d, conv_desc, d.m_y_d, fwd_algo);
+    passes[0].run = [=, &d](void *ws, size_t ws_size) {
+      dnn_lib::convolution_forward(handle, one, d.m_x_d, d.m_x, d.m_f_d,
+                                   d.m_f, conv_desc, fwd_algo, ws, ws_size,
+                                   zero, d.m_y_d, d.m_y);
+    };
 
-template <int NSD, typename REAL>
-void run_backward_filter_convolution(const Data<REAL> &d, cudnnConvolutionDescriptor_t conv_desc,
-                                     const BenchmarkConfig<NSD> &cfg, size_t ws_size, void *ws) {
-  REAL zero(0.0);
-  REAL one(1.0);
-  if (!cfg.deconv) {
-    DISTCONV_CHECK_CUDNN(cudnnConvolutionBackwardFilter(
-        cudnn_h, &one, d.m_x_d, d.m_x,
-        d.m_dy_d, d.m_dy,
-        conv_desc,
-        util::CUDNNConvolutionBwdFilterAlgorithms::get_algo(cfg.conv_bwd_filter_algo),
-        ws, ws_size, &zero,
-        d.m_df_d, d.m_df));
-  } else {
-    DISTCONV_CHECK_CUDNN(cudnnConvolutionBackwardFilter(
-        cudnn_h, &one, d.m_dy_d, d.m_dy,
-        d.m_x_d, d.m_x,
-        conv_desc,
-        util::CUDNNConvolutionBwdFilterAlgorithms::get_algo(cfg.conv_bwd_filter_algo),
-        ws, ws_size, &zero,
-        d.m_df_d, d.m_df));
-  }
-}
+    print_algo_perfs(std::cout, "Backward data algorithms",
+                     find_bwd_data_algorithms(
+                         handle, d.m_f_d, d.m_f, d.m_dy_d, d.m_dy,
+                         conv_desc, d.m_dx_d, d.m_dx, find_ws,
+                         find_ws_size));
+    const auto bwd_data_algo = be.get_bwd_data_algorithm(
+        cfg.conv_bwd_data_algo, d.m_f_d, d.m_f, d.m_dy_d, d.m_dy, conv_desc,
+        d.m_dx_d, d.m_dx, ws_limit);
+    passes[1].algo_name = util::get_name(bwd_data_algo);
+    passes[1].ws_size = dnn_lib::get_conv_bwd_data_workspace_size(
+        handle, d.m_f_d, d.m_dy_d, conv_desc, d.m_dx_d, bwd_data_algo);
+    passes[1].run = [=, &d](void *ws, size_t ws_size) {
+      dnn_lib::convolution_bwd_data(handle, one, d.m_f_d, d.m_f, d.m_dy_d,
+                                    d.m_dy, conv_desc, bwd_data_algo, ws,
+                                    ws_size, zero, d.m_dx_d, d.m_dx);
+    };
 
-template <int NSD, typename REAL>
-void run_backward_bias_convolution(const Data<REAL> &d, const BenchmarkConfig<NSD> &cfg) {
-  REAL zero(0.0);
-  REAL one(1.0);
-  DISTCONV_CHECK_CUDNN(cudnnConvolutionBackwardBias(cudnn_h, &one, d.m_dy_d, d.m_dy,
-                                                    &zero, d.m_db_d, d.m_db));
-}
+    print_algo_perfs(std::cout, "Backward filter algorithms",
+                     find_bwd_filter_algorithms(
+                         handle, d.m_x_d, d.m_x, d.m_dy_d, d.m_dy,
+                         conv_desc, d.m_df_d, d.m_df, find_ws,
+                         find_ws_size));
+    const auto bwd_filter_algo = be.get_bwd_filter_algorithm(
+        cfg.conv_bwd_filter_algo, d.m_x_d, d.m_x, d.m_dy_d, d.m_dy,
+        conv_desc, d.m_df_d, d.m_df, ws_limit);
+    passes[2].algo_name = util::get_name(bwd_filter_algo);
+    passes[2].ws_size = dnn_lib::get_conv_bwd_filter_workspace_size(
+        handle, d.m_x_d, d.m_dy_d, conv_desc, d.m_df_d, bwd_filter_algo);
+    passes[2].run = [=, &d](void *ws, size_t ws_size) {
+      dnn_lib::convolution_bwd_filter(handle, one, d.m_x_d, d.m_x, d.m_dy_d,
+                                      d.m_dy, conv_desc, bwd_filter_algo, ws,
+                                      ws_size, zero, d.m_df_d, d.m_df);
+    };
+  } else {
+    print_algo_perfs(std::cout, "Forward algorithms",
+                     find_bwd_data_algorithms(
+                         handle, d.m_f_d, d.m_f, d.m_x_d, d.m_x, conv_desc,
+                         d.m_y_d, d.m_y, find_ws, find_ws_size));
+    const auto fwd_algo = be.get_bwd_data_algorithm(
+        cfg.conv_fwd_algo, d.m_f_d, d.m_f, d.m_x_d, d.m_x, conv_desc,
+        d.m_y_d, d.m_y, ws_limit);
+    passes[0].algo_name = util::get_name(fwd_algo);
+    passes[0].ws_size = dnn_lib::get_conv_bwd_data_workspace_size(
+        handle, d.m_f_d, d.m_x_d, conv_desc, d.m_y_d, fwd_algo);
+    passes[0].run = [=, &d](void *ws, size_t ws_size) {
+      dnn_lib::convolution_bwd_data(handle, one, d.m_f_d, d.m_f, d.m_x_d,
+                                    d.m_x, conv_desc, fwd_algo, ws, ws_size,
+                                    zero, d.m_y_d, d.m_y);
+    };
 
-template <int NSD, typename REAL>
-void measure_forward_convolution(const Data<REAL> &d,
-                                 cudnnConvolutionDescriptor_t conv_desc,
-                                 size_t ws_size, void *ws,
-                                 const BenchmarkConfig<NSD> &cfg,
-                                 Profile<NSD> &prof) {
-  std::vector<util::Clock> clks(cfg.run_count, stream);
-  DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
-  if (cfg.warming_up_count > 0) std::cout << "Warming up\n";
-  for (int i = 0; i < cfg.warming_up_count; ++i) {
-    run_forward_convolution(d, conv_desc, cfg, ws_size, ws);
-  }
-  std::cout << "Starting " << cfg.run_count << " times of measurement\n";
-  for (int i = 0; i < cfg.run_count; ++i) {
-    clks[i].start();
-    run_forward_convolution(d, conv_desc, cfg, ws_size, ws);
-    clks[i].stop();
-  }
-  DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
-  for (int i = 0; i < cfg.run_count; ++i) {
-    float elapsed = clks[i].get_time();
-    prof.conv_fwd_time.push_back(elapsed);
-  }
-  std::cout << "Measurement done\n";
-  return;
-}
+    print_algo_perfs(std::cout, "Backward data algorithms",
+                     find_fwd_algorithms(
+                         handle, d.m_dy_d, d.m_dy, d.m_f_d, d.m_f,
+                         conv_desc, d.m_dx_d, d.m_dx, find_ws,
+                         find_ws_size));
+    const auto bwd_data_algo = be.get_fwd_algorithm(
+        cfg.conv_bwd_data_algo, d.m_dy_d, d.m_dy, d.m_f_d, d.m_f, conv_desc,
+        d.m_dx_d, d.m_dx, ws_limit);
+    passes[1].algo_name = util::get_name(bwd_data_algo);
+    passes[1].ws_size = dnn_lib::get_conv_forward_workspace_size(
+        handle, d.m_dy_d, d.m_f_d, conv_desc, d.m_dx_d, bwd_data_algo);
+    passes[1].run = [=, &d](void *ws, size_t ws_size) {
+      dnn_lib::convolution_forward(handle, one, d.m_dy_d, d.m_dy, d.m_f_d,
+                                   d.m_f, conv_desc, bwd_data_algo, ws,
+                                   ws_size, zero, d.m_dx_d, d.m_dx);
+    };
 
-template <int NSD, typename REAL>
-void measure_backward_data_convolution(const Data<REAL> &d,
-                                       cudnnConvolutionDescriptor_t conv_desc,
-                                       size_t ws_size, void *ws,
-                                       const BenchmarkConfig<NSD> &cfg,
-                                       Profile<NSD> &prof) {
-  std::vector<util::Clock> clks(cfg.run_count, stream);
-  DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
-  if (cfg.warming_up_count > 0) std::cout << "Warming up\n";
-  for (int i = 0; i < cfg.warming_up_count; ++i) {
-    run_backward_data_convolution(d, conv_desc, cfg, ws_size, ws);
-  }
-  std::cout << "Starting " << cfg.run_count << " times of measurement\n";
-  for (int i = 0; i < cfg.run_count; ++i) {
-    clks[i].start();
-    run_backward_data_convolution(d, conv_desc, cfg, ws_size, ws);
-    clks[i].stop();
-  }
-  DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
-  for (int i = 0; i < cfg.run_count; ++i) {
-    float elapsed = clks[i].get_time();
-    prof.conv_bwd_data_time.push_back(elapsed);
+    print_algo_perfs(std::cout, "Backward filter algorithms",
+                     find_bwd_filter_algorithms(
+                         handle, d.m_dy_d, d.m_dy, d.m_x_d, d.m_x,
+                         conv_desc, d.m_df_d, d.m_df, find_ws,
+                         find_ws_size));
+    const auto bwd_filter_algo = be.get_bwd_filter_algorithm(
+        cfg.conv_bwd_filter_algo, d.m_dy_d, d.m_dy, d.m_x_d, d.m_x,
+        conv_desc, d.m_df_d, d.m_df, ws_limit);
+    passes[2].algo_name = util::get_name(bwd_filter_algo);
+    passes[2].ws_size = dnn_lib::get_conv_bwd_filter_workspace_size(
+        handle, d.m_dy_d, d.m_x_d, conv_desc, d.m_df_d, bwd_filter_algo);
+    passes[2].run = [=, &d](void *ws, size_t ws_size) {
+      dnn_lib::convolution_bwd_filter(handle, one, d.m_dy_d, d.m_dy, d.m_x_d,
+                                      d.m_x, conv_desc, bwd_filter_algo, ws,
+                                      ws_size, zero, d.m_df_d, d.m_df);
+    };
   }
-  std::cout << "Measurement done\n";
-  return;
-}
+  DISTCONV_CHECK_GPU(GPU_FREE(find_ws));
 
-template <int NSD, typename REAL>
-void measure_backward_filter_convolution(const Data<REAL> &d,
-                                         cudnnConvolutionDescriptor_t conv_desc,
-                                         size_t ws_size, void *ws,
-                                         const BenchmarkConfig<NSD> &cfg,
-                                         Profile<NSD> &prof) {
-  std::vector<util::Clock> clks(cfg.run_count, stream);
-  DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
-  if (cfg.warming_up_count > 0) std::cout << "Warming up\n";
-  for (int i = 0; i < cfg.warming_up_count; ++i) {
-    run_backward_filter_convolution(d, conv_desc, cfg, ws_size, ws);
-  }
-  std::cout << "Starting " << cfg.run_count << " times of measurement\n";
-  for (int i = 0; i < cfg.run_count; ++i) {
-    clks[i].start();
-    run_backward_filter_convolution(d, conv_desc, cfg, ws_size, ws);
-    clks[i].stop();
-  }
-  DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
-  for (int i = 0; i < cfg.run_count; ++i) {
-    float elapsed = clks[i].get_time();
-    prof.conv_bwd_filter_time.push_back(elapsed);
+  if (cfg.use_bias) {
+    auto &fwd = passes[0].run;
+    fwd = [=, &d, conv = fwd](void *ws, size_t ws_size) {
+      conv(ws, ws_size);
+      dnn_lib::apply_fwd_bias(handle, one, d.m_b_d, d.m_b, one, d.m_y_d,
+                              d.m_y);
+    };
+    Pass bias;
+    bias.name = "Backward bias";
+    bias.algo_name = "-";
+    bias.run = [=, &d](void *, size_t) {
+      dnn_lib::apply_bwd_bias(handle, one, d.m_dy_d, d.m_dy, zero, d.m_db_d,
+                              d.m_db);
+    };
+    passes.push_back(bias);
   }
-  std::cout << "Measurement done\n";
-  return;
+  return passes;
 }
 
-template <int NSD, typename REAL>
-void measure_backward_bias_convolution(const Data<REAL> &d,
-                                       const BenchmarkConfig<NSD> &cfg,
-                                       Profile<NSD> &prof) {
+template <int NSD>
+void measure(const Pass &pass, void *ws, size_t ws_size,
+             h2::gpu::DeviceStream stream, const BenchmarkConfig<NSD> &cfg,
+             std::vector<float> &times) {
   std::vector<util::Clock> clks(cfg.run_count, stream);
-  DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
+  h2::gpu::sync();
   if (cfg.warming_up_count > 0) std::cout << "Warming up\n";
   for (int i = 0; i < cfg.warming_up_count; ++i) {
-    run_backward_bias_convolution(d, cfg);
+    pass.run(ws, ws_size);
   }
   std::cout << "Starting " << cfg.run_count << " times of measurement\n";
   for (int i = 0; i < cfg.run_count; ++i) {
     clks[i].start();
-    run_backward_bias_convolution(d, cfg);
+    pass.run(ws, ws_size);
     clks[i].stop();
   }
-  DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
+  h2::gpu::sync();
   for (int i = 0; i < cfg.run_count; ++i) {
-    float elapsed = clks[i].get_time();
-    prof.conv_bwd_bias_time.push_back(elapsed);
+    times.push_back(clks[i].get_time());
   }
   std::cout << "Measurement done\n";
-  return;
-}
-
-std::ostream &print_version_number(std::ostream &os) {
-  int version[3];
-  cudnnGetProperty(MAJOR_VERSION, &version[0]);
-  cudnnGetProperty(MINOR_VERSION, &version[1]);
-  cudnnGetProperty(PATCH_LEVEL, &version[2]);
-  os << "cuDNN v" << version[0] << "." << version[1] << "." << version[2];
-  return os;
 }
 
 template <typename REAL>
 int dump_tensor(const REAL *t, size_t num_elms,
                 const std::string &file_path,
                 bool binary) {
-  REAL *h = new REAL[num_elms];
-  cudaMemcpy(h, t, num_elms * sizeof(REAL), cudaMemcpyDeviceToHost);
+  std::vector<REAL> h(num_elms);
+  h2::gpu::mem_copy(h.data(), t, num_elms);
   std::ofstream out;
   if (binary) {
     out.open(file_path + ".out", std::ios::out | std::ios::trunc | std::ios::binary);
-    out.write((char *)h, num_elms * sizeof(REAL));
+    out.write((char *)h.data(), num_elms * sizeof(REAL));
   } else {
     out.open(file_path + ".txt", std::ios::out | std::ios::trunc);
     for (size_t i = 0; i < num_elms; ++i) {
@@ -861,16 +741,14 @@ int dump_tensor(const REAL *t, size_t num_elms,
     }
   }
   out.close();
-  delete[] h;
   return 0;
 }
 
 template <int NSD, typename REAL>
-int run(const BenchmarkConfig<NSD> &cfg) {
+int run(const BenchmarkConfig<NSD> &cfg, dnn_lib::Handle_t handle,
+        h2::gpu::DeviceStream stream) {
   std::srand(0);
 
-  //REAL *input_tensor = make_random_tensor(o.i_n, o.i_c, o.i_h,
-  //o.i_w);
   REAL *input_tensor = make_initialized_tensor<REAL>(
       cfg.i_n, cfg.i_c, cfg.i_s,
       distconv_benchmark::input_tensor_seed);
@@ -921,38 +799,38 @@ int run(const BenchmarkConfig<NSD> &cfg) {
     }
   }
 
-  cudnnConvolutionDescriptor_t conv_desc = get_conv_desc<NSD, REAL>(cfg);
+  auto conv_desc = get_conv_desc<NSD, REAL>(cfg);
   std::cout << "conv_desc: " << util::tostring(conv_desc) << "\n";
 
-  std::cout
-      << "Forward algo: "
-      << (cfg.deconv ?
-          util::CUDNNConvolutionBwdDataAlgorithms::get_real_name(cfg.conv_fwd_algo) :
-          util::CUDNNConvolutionFwdAlgorithms::get_real_name(cfg.conv_fwd_algo))
-      << "\n"
-      << "Bacward data algo: "
-      << (cfg.deconv ?
-          util::CUDNNConvolutionFwdAlgorithms::get_real_name(cfg.conv_bwd_data_algo) :
-          util::CUDNNConvolutionBwdDataAlgorithms::get_real_name(cfg.conv_bwd_data_algo))
-      << "\n"
-      << "Bacward filter algo: "
-      << util::CUDNNConvolutionBwdFilterAlgorithms::get_real_name(cfg.conv_bwd_filter_algo)
-      << "\n";
-
-  size_t ws_size;
-  void *ws;
-  setup_workspace(d, conv_desc, cfg, ws_size, ws);
-
+  // Each process benchmarks its own GPU
+  dnn_lib::Options be_opts;
+  be_opts.m_deterministic = cfg.deterministic;
   Profile<NSD> prof(cfg);
-  measure_forward_convolution(d, conv_desc, ws_size, ws, cfg, prof);
-  measure_backward_data_convolution(d, conv_desc, ws_size, ws, cfg, prof);
-  measure_backward_filter_convolution(d, conv_desc, ws_size, ws, cfg, prof);
-  if (cfg.use_bias) {
-    measure_backward_bias_convolution(d, cfg, prof);
-  }
+  {
+    BackendDNNLib be(MPI_COMM_SELF, handle, stream, be_opts);
+    auto passes = setup_passes(be, d, conv_desc, cfg);
+    size_t ws_size = 0;
+    for (const auto &pass: passes) {
+      std::cout << pass.name << " algorithm: " << pass.algo_name
+                << ", workspace " << pass.ws_size << " bytes\n";
+      ws_size = std::max(ws_size, pass.ws_size);
+    }
+    void *ws = nullptr;
+    if (ws_size > 0) {
+      DISTCONV_GPU_MALLOC(&ws, ws_size);
+    }
 
-  std::cout << "Destroying cudnn handle\n";
-  DISTCONV_CHECK_CUDNN(cudnnDestroy(cudnn_h));
+    std::vector<float> *times[] = {
+      &prof.conv_fwd_time, &prof.conv_bwd_data_time,
+      &prof.conv_bwd_filter_time, &prof.conv_bwd_bias_time};
+    for (size_t i = 0; i < passes.size(); ++i) {
+      measure(passes[i], ws, ws_size, stream, cfg, *times[i]);
+    }
+    if (ws) {
+      DISTCONV_CHECK_GPU(GPU_FREE(ws));
+    }
+  }
+  dnn_lib::destroy_convolution_descriptor(conv_desc);
 
   prof.print_summary(std::cout);
 
@@ -982,24 +860,40 @@ int run(const BenchmarkConfig<NSD> &cfg) {
     }
   }
 
+  for (REAL *p: {input_tensor, d_input_tensor, filter_tensor,
+                 d_filter_tensor, output_tensor, d_output_tensor,
+                 bias_tensor, d_bias_tensor}) {
+    if (p) {
+      DISTCONV_CHECK_GPU(GPU_FREE(p));
+    }
+  }
+
   std::cout << "Completed\n";
   return 0;
 }
 
 template <int NSD>
-void run(int argc, char *argv[]) {
+void run(int argc, char *argv[], dnn_lib::Handle_t handle,
+         h2::gpu::DeviceStream stream) {
   auto cfg = distconv_benchmark::process_opt<NSD>(argc, argv, 0, true);
 
   if (cfg.data_type == BenchmarkDataType::FLOAT) {
-    run<NSD, float>(cfg);
+    run<NSD, float>(cfg, handle, stream);
   } else if (cfg.data_type == BenchmarkDataType::DOUBLE) {
-    run<NSD, double>(cfg);
+    run<NSD, double>(cfg, handle, stream);
   } else if (cfg.data_type == BenchmarkDataType::HALF) {
 #ifdef DISTCONV_ENABLE_FP16
-    run<NSD, half>(cfg);
+    run<NSD, half>(cfg, handle, stream);
 #else
     std::cerr << "Error: half precision not supported\n";
     abort();
+#endif
+  } else if (cfg.data_type == BenchmarkDataType::BFLOAT16) {
+#if defined(DISTCONV_ENABLE_FP16) && defined(DISTCONV_HAS_CUDNN_BFLOAT16)
+    run<NSD, __nv_bfloat16>(cfg, handle, stream);
+#else
+    std::cerr << "Error: bfloat16 precision not supported\n";
+    abort();
 #endif
   } else {
     std::cerr << "Error: Unknown data type\n";
@@ -1009,23 +903,27 @@ void run(int argc, char *argv[]) {
 
 int main(int argc, char *argv[]) {
   std::srand(0);
-  int dev = 0;
-  DISTCONV_CHECK_CUDA(cudaSetDevice(dev));
-  DISTCONV_CHECK_CUDNN(cudnnCreate(&cudnn_h));
-  print_version_number(std::cout << "Using ") << std::endl;
-  cudaStreamCreate(&stream);
-  DISTCONV_CHECK_CUDNN(cudnnSetStream(cudnn_h, stream));
+  // The backend needs MPI and Aluminum even for one process
+  Al::Initialize(argc, argv);
+  h2::gpu::set_gpu(0);
+  auto handle = dnn_lib::make_handle();
+  std::cout << "Using " << get_dnn_lib_version() << std::endl;
+  auto stream = h2::gpu::make_stream();
+  dnn_lib::set_stream(handle, stream);
 
   const int nsd = distconv_benchmark::parse_num_dims(argc, argv);
 
   if(nsd == 2) {
-    run<2>(argc, argv);
+    run<2>(argc, argv, handle, stream);
   } else if(nsd == 3) {
-    run<3>(argc, argv);
+    run<3>(argc, argv, handle, stream);
   } else {
     util::PrintStreamError() << "Invalid --num-dims: " << nsd;
     std::exit(1);
   }
 
+  dnn_lib::destroy_handle(handle);
+  h2::gpu::destroy(stream);
+  Al::Finalize();
   return 0;
 }
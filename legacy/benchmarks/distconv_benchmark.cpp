@@ -5,6 +5,7 @@
 #include <numeric>
 #include <cstdlib>
 #include <limits>
+#include <sstream>
 
 #include "distconv_config.hpp"
 #include "distconv_benchmark_common.hpp"
@@ -43,6 +44,16 @@ class Profile {
   std::vector<float> conv_bwd_combined_filter_time;
   std::vector<float> conv_bwd_combined_bias_time;
   std::vector<float> conv_bwd_combined_all_time;
+  // Measured only for derived metrics
+  std::vector<float> conv_fwd_halo_time;
+  std::vector<float> conv_bwd_halo_time;
+  std::vector<float> conv_fwd_no_halo_time;
+  std::vector<float> conv_bwd_data_no_halo_time;
+  // FLOPs of a pass over the global tensors
+  double conv_flops = 0;
+  // Bytes sent by the local rank in one halo exchange
+  double fwd_halo_bytes = 0;
+  double bwd_halo_bytes = 0;
   Profile(const BenchmarkConfig<NSD> &cfg):
       m_cfg(cfg),
       conv_fwd_time(cfg.run_count, 0),
@@ -69,6 +80,106 @@ class Profile {
     return os;
   }
 
+  /**
+     Rates and efficiencies derived from the times, which are the
+     medians of the slowest rank. Collective over comm.
+   */
+  Metrics get_metrics(MPI_Comm comm) const {
+    int np;
+    MPI_Comm_size(comm, &np);
+    // Times of the individual tests unless the combined test was run
+    const auto &bwd_data_time = get_median(conv_bwd_combined_data_time) > 0 ?
+        conv_bwd_combined_data_time : conv_bwd_data_time;
+    const auto &bwd_filter_time =
+        get_median(conv_bwd_combined_filter_time) > 0 ?
+        conv_bwd_combined_filter_time : conv_bwd_filter_time;
+    auto get_max_median = [&](const std::vector<float> &v) {
+      double t = v.empty() ? 0 : get_median(v);
+      DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE,
+                                       MPI_MAX, comm));
+      return t;
+    };
+    auto get_max = [&](double x) {
+      DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &x, 1, MPI_DOUBLE,
+                                       MPI_MAX, comm));
+      return x;
+    };
+    auto get_sum = [&](double x) {
+      DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &x, 1, MPI_DOUBLE,
+                                       MPI_SUM, comm));
+      return x;
+    };
+    const double fwd = get_max_median(conv_fwd_time);
+    const double bwd_data = get_max_median(bwd_data_time);
+    const double bwd_filter = get_max_median(bwd_filter_time);
+    const double fwd_halo = get_max_median(conv_fwd_halo_time);
+    const double bwd_halo = get_max_median(conv_bwd_halo_time);
+    const double fwd_no_halo = get_max_median(conv_fwd_no_halo_time);
+    const double bwd_data_no_halo = get_max_median(conv_bwd_data_no_halo_time);
+    // Measured alike with the backward data time without halo
+    // exchanges
+    const double bwd_data_alone = get_max_median(conv_bwd_data_time);
+    const double max_fwd_halo_bytes = get_max(fwd_halo_bytes);
+    const double max_bwd_halo_bytes = get_max(bwd_halo_bytes);
+
+    Metrics m;
+    std::stringstream ss;
+    m_cfg.print_as_row(ss);
+    m.add("config", ss.str());
+    m.add("num_ranks", np);
+    m.add("flops", conv_flops);
+    auto add_rates = [&](const std::string &name, double time) {
+      m.add(name + "_time_ms", time);
+      if (time <= 0) return;
+      const double tflops = conv_flops / (time * 1e-3) / 1e12;
+      m.add(name + "_tflops", tflops);
+      m.add(name + "_tflops_per_device", tflops / np);
+      if (m_cfg.peak_tflops > 0) {
+        m.add(name + "_peak_fraction", tflops / np / m_cfg.peak_tflops);
+      }
+    };
+    add_rates("fwd", fwd);
+    add_rates("bwd_data", bwd_data);
+    add_rates("bwd_filter", bwd_filter);
+    const std::vector<double> times = {fwd, bwd_data, bwd_filter};
+    const std::vector<std::string> names = {"fwd", "bwd_data", "bwd_filter"};
+    for (size_t i = 0; i < m_cfg.baseline_times.size() && i < times.size();
+         ++i) {
+      if (times[i] > 0) {
+        m.add(names[i] + "_scaling_efficiency",
+              m_cfg.baseline_times[i] / (times[i] * np));
+      }
+    }
+
+    // Halo exchanges: bandwidth of the rank sending the most and the
+    // part of the exchange hidden behind computation, i.e., not
+    // adding to the time over that without halo exchanges
+    auto add_halo = [&](const std::string &name, double bytes,
+                        double max_bytes, double halo_time, double time,
+                        double no_halo_time) {
+      m.add(name + "_halo_bytes", get_sum(bytes));
+      m.add(name + "_halo_bytes_per_rank_max", max_bytes);
+      if (halo_time <= 0) return;
+      m.add(name + "_halo_time_ms", halo_time);
+      const double gbps = max_bytes / (halo_time * 1e-3) / 1e9;
+      m.add(name + "_halo_gbps", gbps);
+      if (m_cfg.peak_bandwidth > 0) {
+        m.add(name + "_halo_peak_fraction", gbps / m_cfg.peak_bandwidth);
+      }
+      if (no_halo_time > 0) {
+        const double exposed = std::max(time - no_halo_time, 0.0);
+        m.add(name + "_halo_exposed_ms", exposed);
+        m.add(name + "_halo_hidden_fraction",
+              std::max(1 - exposed / halo_time, 0.0));
+      }
+    };
+    add_halo("fwd", fwd_halo_bytes, max_fwd_halo_bytes, fwd_halo, fwd,
+             fwd_no_halo);
+    add_halo("bwd", bwd_halo_bytes, max_bwd_halo_bytes, bwd_halo,
+             bwd_data_alone, bwd_data_no_halo);
+    return m;
+  }
+
   void print_summary(std::ostream &os) {
     std::cout << "Forward mean: " << get_mean(conv_fwd_time)
               << ", median: " << get_median(conv_fwd_time)
@@ -167,12 +278,12 @@ class Data {
       << " locale_shape: " << util::join_array(locale_shape, " ");
     input = create_input_tensor<Tensor>(
         input_shape, locale_shape, filter_dims, strides,
-        dilations, cfg.deconv, MPI_COMM_WORLD);
+        dilations, cfg.deconv, comm);
     d_input = create_d_input_tensor<Tensor>(input);
 
     filter = create_filter_tensor<Tensor>(locale_shape, filter_dims, input,
                                           cfg.i_c, cfg.f_k, cfg.num_groups,
-                                          MPI_COMM_WORLD,
+                                          comm,
                                           cfg.chanfilt_algo, cfg.p_f);
     d_filter = create_d_filter_tensor<Tensor>(filter);
 
@@ -187,7 +298,7 @@ class Data {
                                                           strides, pads, dilations,
                                                           cfg.num_groups);
       d_output = create_deconvolution_d_output_tensor<Tensor>(
-          output, filter, dilations);
+          output, filter, strides, pads, dilations);
     }
 
     if (cfg.use_bias) {
@@ -277,6 +388,7 @@ int test_convolution_forward(Data<NSD, Backend, DataType> &d,
   int pid;
   MPI_Comm_rank(comm, &pid);
 
+  util::memory_accounting::PhaseScope phase("forward");
   util::MPIRootPrintStreamInfo()
       << "Executing test_convolution_forward with "
       << be.get_name();
@@ -343,6 +455,7 @@ int test_convolution_backward_data(Data<NSD, Backend, DataType> &d,
   int pid;
   MPI_Comm_rank(comm, &pid);
 
+  util::memory_accounting::PhaseScope phase("backward data");
   util::MPIRootPrintStreamInfo()
       << "Executing test_convolution_backward_data with "
       << be.get_name();
@@ -412,6 +525,7 @@ int test_convolution_backward_filter(Data<NSD, Backend, DataType> &d,
   int pid;
   MPI_Comm_rank(comm, &pid);
 
+  util::memory_accounting::PhaseScope phase("backward filter");
   util::MPIRootPrintStreamInfo()
       << "Executing test_convolution_backward_filter with "
       << be.get_name();
@@ -459,6 +573,7 @@ int test_convolution_backward_bias(Data<NSD, Backend, DataType> &d,
   int pid;
   MPI_Comm_rank(comm, &pid);
 
+  util::memory_accounting::PhaseScope phase("backward bias");
   util::MPIRootPrintStreamInfo()
       << "Executing test_convolution_backward_bias with "
       << be.get_name();
@@ -503,6 +618,7 @@ int test_convolution_backward(Data<NSD, Backend, DataType> &d,
   int pid;
   MPI_Comm_rank(comm, &pid);
 
+  util::memory_accounting::PhaseScope phase("backward");
   util::MPIRootPrintStreamInfo()
       << "Executing test_convolution_backward with "
       << be.get_name();
@@ -616,6 +732,102 @@ int test_convolution_backward(Data<NSD, Backend, DataType> &d,
   return 0;
 }
 
+// Bytes the local rank sends in one halo exchange of t, not counting
+// the corners exchanged with the halos of preceding dimensions
+template <typename Tensor>
+double get_halo_bytes(const Tensor &t) {
+  const auto local_shape = t.get_local_shape();
+  const auto local_size = local_shape.get_size();
+  if (local_size == 0) return 0;
+  const auto &split_shape = t.get_distribution().get_split_shape();
+  const auto &split_idx = t.get_split_index();
+  double bytes = 0;
+  for (int i = 0; i < t.get_num_spatial_dims(); ++i) {
+    const int dim = t.get_spatial_dim(i);
+    const int num_peers = (split_idx[dim] > 0 ? 1 : 0)
+        + (split_idx[dim] < (index_t)split_shape[dim] - 1 ? 1 : 0);
+    bytes += (double)num_peers * t.get_halo_width(dim)
+        * (local_size / local_shape[dim])
+        * sizeof(typename Tensor::data_type);
+  }
+  return bytes;
+}
+
+// FLOPs of a convolution pass, which are the same for all passes. The
+// deconvolution input plays the role of the convolution output.
+template <int NSD, typename Backend, typename DataType>
+double get_conv_flops(const Data<NSD, Backend, DataType> &d, bool deconv) {
+  const auto &y = deconv ? d.input : d.output;
+  const double pixels = (double)y.get_size()
+      / y.get_shape()[y.get_channel_dim()];
+  return 2 * pixels * d.filter.get_size();
+}
+
+// Times the halo exchanges alone and the layer without them, from
+// which the part of the exchanges hidden behind computation is derived
+template <int NSD, typename Backend, typename DataType>
+int measure_halo_exchange(Data<NSD, Backend, DataType> &d,
+                          const BenchmarkConfig<NSD> &cfg,
+                          MPI_Comm comm,
+                          Backend &be,
+                          Convolution<Backend, DataType> &conv,
+                          Profile<NSD> &prof) {
+  util::MPIRootPrintStreamInfo() << "Measuring halo exchanges";
+  Clock<Backend> clk(be);
+  for (int i = 0; i < cfg.run_count; ++i) {
+    complete_async<Backend>();
+    DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+    clk.start();
+    conv.forward_exchange_halo(d.input);
+    conv.wait();
+    clk.stop();
+    prof.conv_fwd_halo_time.push_back(clk.get_time());
+    complete_async<Backend>();
+    DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+    clk.start();
+    conv.backward_data_exchange_halo(d.d_output);
+    conv.wait();
+    clk.stop();
+    prof.conv_bwd_halo_time.push_back(clk.get_time());
+  }
+
+  // The backward data times with and without halo exchanges are both
+  // taken with the individual test to compare alike
+  test_convolution_backward_data<NSD, Backend, DataType>(
+      d, cfg, comm, be, conv, prof);
+  auto no_halo_cfg = cfg;
+  no_halo_cfg.skip_halo_exchange = true;
+  Profile<NSD> no_halo_prof(no_halo_cfg);
+  test_convolution_forward<NSD, Backend, DataType>(
+      d, no_halo_cfg, comm, be, conv, no_halo_prof);
+  test_convolution_backward_data<NSD, Backend, DataType>(
+      d, no_halo_cfg, comm, be, conv, no_halo_prof);
+  prof.conv_fwd_no_halo_time = no_halo_prof.conv_fwd_time;
+  prof.conv_bwd_data_no_halo_time = no_halo_prof.conv_bwd_data_time;
+  return 0;
+}
+
+// Prints the derived metrics and saves them if requested
+template <int NSD, typename Backend, typename DataType>
+void report_metrics(const Data<NSD, Backend, DataType> &d,
+                    const BenchmarkConfig<NSD> &cfg,
+                    MPI_Comm comm,
+                    Profile<NSD> &prof) {
+  int pid;
+  MPI_Comm_rank(comm, &pid);
+  prof.conv_flops = get_conv_flops(d, cfg.deconv);
+  prof.fwd_halo_bytes = get_halo_bytes(d.input);
+  prof.bwd_halo_bytes = get_halo_bytes(d.d_output);
+  const auto m = prof.get_metrics(comm);
+  if (pid == 0) {
+    std::cout << "Metrics: ";
+    m.write_json(std::cout) << std::endl;
+    if (!cfg.metrics_file.empty()) {
+      m.save(cfg.metrics_file);
+    }
+  }
+}
+
 template <int NSD, typename Backend, typename DataType>
 struct ConvolutionTester;
 
@@ -649,6 +861,46 @@ struct ConvolutionTester<NSD, ref::Backend, DataType> {
         d, cfg, comm, be, conv, prof);
     test_convolution_backward_filter<NSD, ref::Backend, DataType>(
         d, cfg, comm, be, conv, prof);
+    report_metrics(d, cfg, comm, prof);
+    return 0;
+  }
+};
+
+template <int NSD, typename DataType>
+struct ConvolutionTester<NSD, cpu::Backend, DataType> {
+  ConvolutionTester() {}
+  int operator()(Data<NSD, cpu::Backend, DataType> &d,
+                 const BenchmarkConfig<NSD> &cfg,
+                 MPI_Comm comm,
+                 Profile<NSD> &prof) {
+    cpu::Backend be(comm);
+    util::MPIRootPrintStreamInfo()
+        << "Using " << be.get_num_threads() << " threads per process";
+    Convolution<cpu::Backend, DataType> conv(
+        be, 2 + NSD, cfg.halo_exchange_method);
+    conv.setup(d.input, d.filter, d.output,
+               d.d_input, d.d_filter, d.d_output,
+               cfg.pads,
+               cfg.strides,
+               cfg.dilations,
+               cfg.num_groups,
+               cfg.conv_fwd_algo, cfg.conv_bwd_data_algo,
+               cfg.conv_bwd_filter_algo, 0);
+    if (cfg.use_bias) {
+      conv.setup_bias(d.bias);
+      conv.setup_bias_gradient(d.d_bias);
+    }
+    d.initialize();
+
+    test_convolution_forward<NSD, cpu::Backend, DataType>(
+        d, cfg, comm, be, conv, prof);
+    test_convolution_backward<NSD, cpu::Backend, DataType>(
+        d, cfg, comm, be, conv, prof);
+    if (!cfg.metrics_file.empty() && !cfg.skip_halo_exchange) {
+      measure_halo_exchange<NSD, cpu::Backend, DataType>(
+          d, cfg, comm, be, conv, prof);
+    }
+    report_metrics(d, cfg, comm, prof);
     return 0;
   }
 };
@@ -661,13 +913,13 @@ struct ConvolutionTester<NSD, cudnn::BackendCUDNN, DataType> {
                  const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
                  Profile<NSD> &prof) {
     int pid;
-    DISTCONV_CHECK_MPI(MPI_Comm_rank(MPI_COMM_WORLD, &pid));
-    cudnnHandle_t cudnn_h;
-    DISTCONV_CHECK_CUDNN(cudnnCreate(&cudnn_h));
+    DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &pid));
     cudnn::Options be_opts(cfg.overlap_halo_exchange,
                            cfg.deterministic,
                            cfg.profiling);
-    cudnn::BackendCUDNN be(comm, cudnn_h, be_opts);
+    cudnn::BackendCUDNN be(comm, cudnn::make_handle_async(), be_opts);
+    // Includes the workspaces of autotuning
+    util::memory_accounting::begin_phase("setup");
     Convolution<cudnn::BackendCUDNN, DataType> conv(
         be, 2 + NSD, cfg.halo_exchange_method, cfg.chanfilt_algo);
     conv.setup(d.input, d.filter, d.output,
@@ -683,6 +935,7 @@ struct ConvolutionTester<NSD, cudnn::BackendCUDNN, DataType> {
       conv.setup_bias(d.bias);
       conv.setup_bias_gradient(d.d_bias);
     }
+    util::memory_accounting::end_phase();
     if (pid == 0) {
       std::cout
           << "Forward algorithm: " <<
@@ -702,6 +955,8 @@ struct ConvolutionTester<NSD, cudnn::BackendCUDNN, DataType> {
         cfg.conv_bwd_filter_algo == "AUTOTUNE") {
       d.initialize();
     }
+    // Persist autotuned algorithms if DISTCONV_ALGO_CACHE_PATH is set
+    be.save_algo_cache();
     start_profiler<cudnn::BackendCUDNN>();
     if (cfg.nvtx_marking) {
       be.enable_nvtx_marking();
@@ -722,6 +977,11 @@ struct ConvolutionTester<NSD, cudnn::BackendCUDNN, DataType> {
 #endif
     test_convolution_backward<NSD, cudnn::BackendCUDNN, DataType>(
       d, cfg, comm, be, conv, prof);
+    if (!cfg.metrics_file.empty() && !cfg.skip_halo_exchange) {
+      measure_halo_exchange<NSD, cudnn::BackendCUDNN, DataType>(
+          d, cfg, comm, be, conv, prof);
+    }
+    report_metrics(d, cfg, comm, prof);
     // This seems necessary to avoid hang using NVSHMEM v0.3.3
     DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
     return 0;
@@ -736,11 +996,7 @@ void run(int argc, char *argv[], int pid, int np) {
     std::cout << cfg << std::endl;
   }
 
-  if (std::accumulate(cfg.p_s.begin(),
-                      cfg.p_s.end(),
-                      1,
-                      std::multiplies<int>())
-      * cfg.p_c * cfg.p_n != np) {
+  if (!cfg.is_sweep() && cfg.get_num_ranks() != np) {
     util::MPIRootPrintStreamError()
         << "Number of ranks does not match with the number of tensor partitions";
     DISTCONV_CHECK_MPI(MPI_Finalize());
@@ -748,17 +1004,30 @@ void run(int argc, char *argv[], int pid, int np) {
   }
 
 #ifdef DISTCONV_HAS_NVSHMEM
-  if (IsNVSHMEMUsed(cfg.halo_exchange_method)) {
+  bool use_nvshmem = false;
+  for (const auto &c: cfg.get_sweep()) {
+    use_nvshmem |= IsNVSHMEMUsed(c.halo_exchange_method);
+  }
+  if (use_nvshmem) {
     util::nvshmem::initialize(MPI_COMM_WORLD);
   }
 #endif // DISTCONV_HAS_NVSHMEM
 
-  run_test<NSD, Data, Profile, ConvolutionTester>(cfg, MPI_COMM_WORLD);
+  if (cfg.is_sweep()) {
+    run_sweep(cfg, MPI_COMM_WORLD,
+              [](const BenchmarkConfig<NSD> &c, MPI_Comm comm,
+                 Metrics *m) {
+                return run_test<NSD, Data, Profile, ConvolutionTester>(
+                    c, comm, m);
+              });
+  } else {
+    run_test<NSD, Data, Profile, ConvolutionTester>(cfg, MPI_COMM_WORLD);
+  }
 
   util::MPIRootPrintStreamInfo() << "Finishing";
 
 #ifdef DISTCONV_HAS_NVSHMEM
-  if (IsNVSHMEMUsed(cfg.halo_exchange_method)) {
+  if (use_nvshmem) {
     util::nvshmem::finalize();
   }
 #endif // DISTCONV_HAS_NVSHMEM
@@ -77,6 +77,28 @@ class Profile {
               << ", max: " << get_max(bwd_allreduce_time)
               << std::endl;
   }
+
+  // Medians of the slowest rank. Collective over comm.
+  Metrics get_metrics(MPI_Comm comm) const {
+    int np;
+    MPI_Comm_size(comm, &np);
+    Metrics m;
+    std::stringstream ss;
+    m_cfg.print_as_row(ss);
+    m.add("config", ss.str());
+    m.add("num_ranks", np);
+    auto add = [&](const std::string &name, const std::vector<float> &v) {
+      double t = v.empty() ? 0 : get_median(v);
+      DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE,
+                                       MPI_MAX, comm));
+      m.add(name + "_time_ms", t);
+    };
+    add("fwd", fwd_time);
+    add("fwd_allreduce", fwd_allreduce_time);
+    add("bwd", bwd_time);
+    add("bwd_allreduce", bwd_allreduce_time);
+    return m;
+  }
 };
 
 template <int NSD, typename Backend, typename DataType>
@@ -231,6 +253,16 @@ class Data {
   }
 };
 
+#ifdef DISTCONV_HAS_NVSHMEM
+template <typename Backend>
+void launch_nvshmem_barrier(Backend &be) {
+  util::nvshmem::launch_barrier(be.get_stream());
+}
+
+// The CPU backend does not use NVSHMEM
+inline void launch_nvshmem_barrier(cpu::Backend &be) {}
+#endif // DISTCONV_HAS_NVSHMEM
+
 template <int NSD, typename Backend, typename DataType>
 int test_forward(Data<NSD, Backend, DataType> &d,
                  const BenchmarkConfig<NSD> &cfg,
@@ -241,6 +273,7 @@ int test_forward(Data<NSD, Backend, DataType> &d,
   int pid;
   MPI_Comm_rank(comm, &pid);
 
+  util::memory_accounting::PhaseScope phase("forward");
   util::MPIRootPrintStreamInfo()
       << "Executing test_forward with "
       << be.get_name();
@@ -274,7 +307,7 @@ int test_forward(Data<NSD, Backend, DataType> &d,
     bn.forward_allreduce(d.mean, d.var, is_training);
 #ifdef DISTCONV_HAS_NVSHMEM
     if (IsNVSHMEMUsed(cfg.batchnorm_impl)) {
-      util::nvshmem::launch_barrier(be.get_stream());
+      launch_nvshmem_barrier(be);
     }
 #endif // DISTCONV_HAS_NVSHMEM
     // Start measurement
@@ -283,7 +316,7 @@ int test_forward(Data<NSD, Backend, DataType> &d,
     clk_allreduce.stop();
 #ifdef DISTCONV_HAS_NVSHMEM
     if (IsNVSHMEMUsed(cfg.batchnorm_impl)) {
-      util::nvshmem::launch_barrier(be.get_stream());
+      launch_nvshmem_barrier(be);
     }
 #endif // DISTCONV_HAS_NVSHMEM
     clk.start();
@@ -314,6 +347,7 @@ int test_backward(Data<NSD, Backend, DataType> &d,
   int pid;
   MPI_Comm_rank(comm, &pid);
 
+  util::memory_accounting::PhaseScope phase("backward");
   util::MPIRootPrintStreamInfo()
       << "Executing test_backward with "
       << be.get_name();
@@ -347,7 +381,7 @@ int test_backward(Data<NSD, Backend, DataType> &d,
     bn.backward_allreduce(d.d_scale, d.d_bias, d.d_mean, d.d_var);
 #ifdef DISTCONV_HAS_NVSHMEM
     if (IsNVSHMEMUsed(cfg.batchnorm_impl)) {
-      util::nvshmem::launch_barrier(be.get_stream());
+      launch_nvshmem_barrier(be);
     }
 #endif // DISTCONV_HAS_NVSHMEM
     clk_allreduce.start();
@@ -356,7 +390,7 @@ int test_backward(Data<NSD, Backend, DataType> &d,
     clk_allreduce.stop();
 #ifdef DISTCONV_HAS_NVSHMEM
     if (IsNVSHMEMUsed(cfg.batchnorm_impl)) {
-      util::nvshmem::launch_barrier(be.get_stream());
+      launch_nvshmem_barrier(be);
     }
 #endif // DISTCONV_HAS_NVSHMEM
     clk.start();
@@ -395,6 +429,24 @@ struct BNTester<NSD, ref::Backend, DataType> {
   }
 };
 
+template <int NSD, typename DataType>
+struct BNTester<NSD, cpu::Backend, DataType> {
+  BNTester() {}
+  int operator()(Data<NSD, cpu::Backend, DataType> &d,
+                 const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
+                 Profile<NSD> &prof) {
+    cpu::Backend be(comm);
+    BatchNormalization<cpu::Backend, DataType> bn(
+        be, 2 + NSD, 0.9, 1e-5, cfg.global_stat);
+    bn.set_num_samples(d.input.get_shape()[-1]);
+    test_forward<NSD, cpu::Backend, DataType>(
+        d, cfg, comm, be, bn, prof);
+    test_backward<NSD, cpu::Backend, DataType>(
+        d, cfg, comm, be, bn, prof);
+    return 0;
+  }
+};
+
 #ifdef DISTCONV_HAS_CUDNN
 template <int NSD, typename DataType>
 struct BNTester<NSD, cudnn::BackendCUDNN, DataType> {
@@ -403,13 +455,11 @@ struct BNTester<NSD, cudnn::BackendCUDNN, DataType> {
                  const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
                  Profile<NSD> &prof) {
     int pid;
-    DISTCONV_CHECK_MPI(MPI_Comm_rank(MPI_COMM_WORLD, &pid));
-    cudnnHandle_t cudnn_h;
-    DISTCONV_CHECK_CUDNN(cudnnCreate(&cudnn_h));
+    DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &pid));
     cudnn::Options be_opts(cfg.overlap_halo_exchange,
                            cfg.deterministic,
                            cfg.profiling);
-    cudnn::BackendCUDNN be(comm, cudnn_h, be_opts);
+    cudnn::BackendCUDNN be(comm, cudnn::make_handle_async(), be_opts);
     BatchNormalization<cudnn::BackendCUDNN, DataType> bn(
         be, 2 + NSD, 0.9, 1e-5, cfg.global_stat, cfg.batchnorm_impl);
     bn.set_num_samples(d.input.get_shape()[-1]);
@@ -470,11 +520,7 @@ void run(int argc, char *argv[], int pid, int np) {
     std::cout << cfg << std::endl;
   }
 
-  if (std::accumulate(cfg.p_s.begin(),
-                      cfg.p_s.end(),
-                      1,
-                      std::multiplies<int>())
-      * cfg.p_c * cfg.p_n != np) {
+  if (!cfg.is_sweep() && cfg.get_num_ranks() != np) {
     util::MPIRootPrintStreamError()
         << "Number of ranks does not match with the number of tensor partitions";
     DISTCONV_CHECK_MPI(MPI_Finalize());
@@ -487,7 +533,19 @@ void run(int argc, char *argv[], int pid, int np) {
   }
 #endif // DISTCONV_HAS_NVSHMEM
 
-  run_test<NSD, Data, Profile, BNTester>(cfg, MPI_COMM_WORLD);
+  if (cfg.is_sweep()) {
+    run_sweep(cfg, MPI_COMM_WORLD,
+              [](const BenchmarkConfig<NSD> &c, MPI_Comm comm,
+                 Metrics *m) {
+                return run_test<NSD, Data, Profile, BNTester>(c, comm, m);
+              });
+  } else {
+    Metrics m;
+    run_test<NSD, Data, Profile, BNTester>(cfg, MPI_COMM_WORLD, &m);
+    if (pid == 0 && !cfg.metrics_file.empty()) {
+      m.save(cfg.metrics_file);
+    }
+  }
 
   util::MPIRootPrintStreamInfo() << "Finishing";
 
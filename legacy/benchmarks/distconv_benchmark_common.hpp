@@ -9,6 +9,7 @@
 #include "distconv/tensor/tensor_mpi.hpp"
 #include "distconv/distconv.hpp"
 #include "distconv/util/cxxopts.hpp"
+#include "distconv/util/memory_accounting.hpp"
 #include "distconv/util/stopwatch.h"
 #include "distconv/util/util.hpp"
 
@@ -21,6 +22,10 @@
 #include "distconv/dnn_backend/relu.hpp"
 #include "distconv/dnn_backend/softmax.hpp"
 
+#ifdef DISTCONV_HAS_NVSHMEM
+#include "distconv/util/nvshmem.hpp"
+#endif
+
 /*
   Miscellaneous structures and functions that should be only used for
   benchmarks using Distconv. cudnn_benchmark, e.g., should not used
@@ -55,6 +60,67 @@ struct TensorType<distconv::ref::Backend, DataType> {
                                distconv::tensor::BaseAllocator>;
 };
 
+template <typename DataType>
+struct TensorType<distconv::cpu::Backend, DataType> {
+  using type =
+      distconv::tensor::Tensor<DataType,
+                               distconv::tensor::LocaleMPI,
+                               distconv::tensor::BaseAllocator>;
+};
+
+// Turns memory accounting on if requested and discards the phases of
+// previous runs
+template <int NSD>
+inline void start_memory_accounting(const BenchmarkConfig<NSD> &cfg) {
+  namespace ma = util::memory_accounting;
+  if (cfg.memory_accounting) {
+    ma::set_enabled(true);
+  }
+  ma::clear_phases();
+}
+
+// Prints the memory of the phases recorded so far, the maximum over
+// the ranks of comm. All ranks must have recorded the same
+// phases. Collective over comm.
+inline void print_memory_usage(MPI_Comm comm, std::ostream &os) {
+  namespace ma = util::memory_accounting;
+  if (!ma::is_enabled()) return;
+  auto phases = ma::get_phases();
+  std::vector<unsigned long> counts;
+  auto usages = [&](ma::PhaseRecord &p) {
+    return std::vector<ma::Usage*>{&p.peak, &p.steady};
+  };
+  for (auto &p: phases) {
+    for (auto *u: usages(p)) {
+      counts.insert(counts.end(), u->owners.begin(), u->owners.end());
+      counts.push_back(u->total);
+      counts.push_back(u->symmetric);
+    }
+  }
+  DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(),
+                                   MPI_UNSIGNED_LONG, MPI_MAX, comm));
+  auto it = counts.begin();
+  for (auto &p: phases) {
+    for (auto *u: usages(p)) {
+      std::copy(it, it + ma::num_owners, u->owners.begin());
+      it += ma::num_owners;
+      u->total = *it++;
+      u->symmetric = *it++;
+    }
+  }
+  int pid;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &pid));
+  if (pid == 0) {
+    os << "Memory per rank, maximum over ranks:\n";
+    ma::print(os, phases);
+#ifdef DISTCONV_HAS_NVSHMEM
+    os << "NVSHMEM symmetric heap: "
+       << util::nvshmem::SymmetricHeap::get_instance().get_capacity()
+       << " bytes\n";
+#endif
+  }
+}
+
 inline void set_device() {
 #ifdef DISTCONV_HAS_CUDA
   int dev = distconv::util::choose_gpu();
@@ -214,6 +280,23 @@ struct Clock<ref::Backend> {
   }
 };
 
+template <>
+struct Clock<cpu::Backend> {
+  cpu::Backend &m_be;
+  util::stopwatch_t m_st;
+  float m_elapsed;
+  Clock(cpu::Backend &be): m_be(be), m_elapsed(0) {}
+  void start() {
+    util::stopwatch_start(&m_st);
+  }
+  void stop() {
+    m_elapsed = util::stopwatch_stop(&m_st);
+  }
+  float get_time() {
+    return m_elapsed;
+  }
+};
+
 #ifdef DISTCONV_HAS_CUDNN
 template <>
 struct Clock<cudnn::BackendCUDNN> {
@@ -280,14 +363,18 @@ inline void stop_profiler<cudnn::BackendCUDNN>() {
 
 template <int NSD, typename Backend, typename DataType, typename Data,
           typename Profile, typename Tester>
-inline int run_test_with_type(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm) {
+inline int run_test_with_type(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
+                              Metrics *metrics=nullptr) {
   int pid;
   int np;
   DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &pid));
   DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &np));
 
+  start_memory_accounting(cfg);
   Profile prof(cfg);
+  util::memory_accounting::begin_phase("allocation");
   Data d(cfg, comm);
+  util::memory_accounting::end_phase();
   if (d.is_empty()) {
     util::MPIRootPrintStreamDebug()
         << "No computation is done as input/output tensors are empty.";
@@ -307,6 +394,7 @@ inline int run_test_with_type(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm) {
   if (pid == 0) {
     prof.print_summary(std::cout);
   }
+  print_memory_usage(comm, std::cout);
 
   std::ofstream ofs;
   std::stringstream ss;
@@ -314,6 +402,10 @@ inline int run_test_with_type(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm) {
   ofs.open(ss.str(), std::fstream::app);
   prof.print_as_row(ofs);
 
+  if (metrics) {
+    *metrics = prof.get_metrics(comm);
+  }
+
   // Dump result
   if (cfg.dump_output) {
     d.dump_output(cfg.dump_binary);
@@ -328,18 +420,28 @@ template <int NSD,
           template<int, typename, typename> class Data,
           template<int> class Profile,
           template<int, typename, typename> class Tester>
-inline int run_test_with_backend(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm) {
+inline int run_test_with_backend(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
+                                 Metrics *metrics=nullptr) {
   if (cfg.data_type == BenchmarkDataType::FLOAT) {
     return run_test_with_type<NSD, Backend, float, Data<NSD, Backend, float>,
-                              Profile<NSD>, Tester<NSD, Backend, float>>(cfg, comm);
+                              Profile<NSD>, Tester<NSD, Backend, float>>(cfg, comm, metrics);
   } else if (cfg.data_type == BenchmarkDataType::DOUBLE) {
     return run_test_with_type<NSD, Backend, double, Data<NSD, Backend, double>,
-                              Profile<NSD>, Tester<NSD, Backend, double>>(cfg, comm);
+                              Profile<NSD>, Tester<NSD, Backend, double>>(cfg, comm, metrics);
 #ifdef DISTCONV_ENABLE_FP16
   } else if (cfg.backend == "CUDNN" &&
              cfg.data_type == BenchmarkDataType::HALF) {
     return run_test_with_type<NSD, Backend, half, Data<NSD, Backend, half>,
-                              Profile<NSD>, Tester<NSD, Backend, half>>(cfg, comm);
+                              Profile<NSD>, Tester<NSD, Backend, half>>(cfg, comm, metrics);
+#endif
+#if defined(DISTCONV_ENABLE_FP16) && defined(DISTCONV_HAS_CUDNN_BFLOAT16)
+  } else if (cfg.backend == "CUDNN" &&
+             cfg.data_type == BenchmarkDataType::BFLOAT16) {
+    return run_test_with_type<NSD, Backend, __nv_bfloat16,
+                              Data<NSD, Backend, __nv_bfloat16>,
+                              Profile<NSD>,
+                              Tester<NSD, Backend, __nv_bfloat16>>(
+                                  cfg, comm, metrics);
 #endif
   } else {
     util::MPIPrintStreamError() << "Unknown data type name\n";
@@ -351,16 +453,20 @@ template <int NSD,
           template<int, typename, typename> class Data,
           template<int> class Profile,
           template<int, typename, typename> class Tester>
-inline int run_test(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm) {
+inline int run_test(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
+                    Metrics *metrics=nullptr) {
   if (cfg.backend == "Ref") {
     return run_test_with_backend<NSD, ref::Backend, Data, Profile, Tester>(
-        cfg, MPI_COMM_WORLD);
+        cfg, comm, metrics);
+  } else if (cfg.backend == "CPU") {
+    return run_test_with_backend<NSD, cpu::Backend, Data, Profile, Tester>(
+        cfg, comm, metrics);
 #ifdef DISTCONV_HAS_CUDNN
   } else if (cfg.backend == "CUDNN") {
     util::MPIRootPrintStreamInfo() << "Using " <<
         util::get_cudnn_version_number_string();
     return run_test_with_backend<NSD, cudnn::BackendCUDNN, Data, Profile, Tester>(
-        cfg, MPI_COMM_WORLD);
+        cfg, comm, metrics);
 #endif
   } else {
     util::MPIRootPrintStreamError() << "Unknown backend name";
@@ -368,4 +474,82 @@ inline int run_test(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm) {
   }
 }
 
+/**
+   Runs each configuration of the sweep of cfg with run_point on the
+   first ranks of comm, all in this job, and reports their metrics in
+   one table, which is saved to <output-file>_sweep.csv. run_point
+   takes a configuration, a communicator and a Metrics pointer to
+   fill, like run_test. Collective over comm.
+ */
+template <int NSD, typename RunPoint>
+inline int run_sweep(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
+                     RunPoint run_point) {
+  int pid;
+  int np;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &pid));
+  DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &np));
+
+  // Autotune each configuration once, also across repeated sweeps
+  if (!std::getenv("DISTCONV_ALGO_CACHE_PATH")) {
+    const auto path = cfg.output_file + "_algo_cache";
+    setenv("DISTCONV_ALGO_CACHE_PATH", path.c_str(), 0);
+  }
+
+  const auto configs = cfg.get_sweep();
+  for (const auto &c: configs) {
+    if (c.get_num_ranks() > np) {
+      util::MPIRootPrintStreamError()
+          << "Sweep needs " << c.get_num_ranks() << " ranks but only "
+          << np << " are available";
+      return 1;
+    }
+  }
+
+  MetricsTable table;
+  for (size_t i = 0; i < configs.size(); ++i) {
+    const auto &c = configs[i];
+    const int n = c.get_num_ranks();
+    util::MPIRootPrintStreamInfo()
+        << "Sweep point " << i + 1 << "/" << configs.size() << ": " << c;
+    MPI_Comm point_comm;
+    DISTCONV_CHECK_MPI(MPI_Comm_split(comm, pid < n ? 0 : MPI_UNDEFINED,
+                                      pid, &point_comm));
+    Metrics m;
+    if (point_comm != MPI_COMM_NULL) {
+      run_point(c, point_comm, &m);
+      DISTCONV_CHECK_MPI(MPI_Comm_free(&point_comm));
+    }
+    if (pid == 0) {
+      // Identify the point in the printed table
+      auto join_nd = [](int n, int ch, const int_vector &s) {
+        int_vector v = {n, ch};
+        v.insert(v.end(), s.rbegin(), s.rend());
+        return util::join_xd_array(v);
+      };
+      Metrics row;
+      std::stringstream method;
+      method << c.halo_exchange_method;
+      row.add("proc_size", join_nd(c.p_n, c.p_c, c.p_s));
+      row.add("image_size", join_nd(c.i_n, c.i_c, c.i_s));
+      row.add("halo_exchange_method", method.str());
+      for (const auto &l: m.get_labels()) row.add(l.first, l.second);
+      for (const auto &v: m.get_values()) row.add(v.first, v.second);
+      table.add(row);
+    }
+    DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+  }
+
+  if (pid == 0) {
+    table.add_scaling_efficiencies(cfg.sweep_zip);
+    std::cout << "Sweep results ("
+              << (cfg.sweep_zip ? "weak" : "strong")
+              << " scaling efficiency relative to the first point):"
+              << std::endl;
+    table.print(std::cout);
+    std::ofstream ofs(cfg.output_file + "_sweep.csv");
+    table.write_csv(ofs);
+  }
+  return 0;
+}
+
 } // namespace distconv_benchmark
@@ -38,6 +38,26 @@ class Profile {
        << std::endl;
     os << ss.str();
   }
+
+  // Medians of the slowest rank. Collective over comm.
+  Metrics get_metrics(MPI_Comm comm) const {
+    int np;
+    MPI_Comm_size(comm, &np);
+    Metrics m;
+    std::stringstream ss;
+    m_cfg.print_as_row(ss);
+    m.add("config", ss.str());
+    m.add("num_ranks", np);
+    auto add = [&](const std::string &name, const std::vector<float> &v) {
+      double t = v.empty() ? 0 : get_median(v);
+      DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE,
+                                       MPI_MAX, comm));
+      m.add(name + "_time_ms", t);
+    };
+    add("fwd", fwd_time);
+    add("bwd", bwd_time);
+    return m;
+  }
 };
 
 template <int NSD, typename Backend, typename DataType>
@@ -81,7 +101,7 @@ class Data {
     const int_vector dilations(cfg.get_num_spatial_dims(), 1);
     input = create_input_tensor<Tensor>(
         input_shape, locale_shape, window, strides,
-        dilations, false, MPI_COMM_WORLD);
+        dilations, false, comm);
     d_input = create_d_input_tensor<Tensor>(input);
     output = create_pooling_output_tensor<Tensor>(input, window, strides, pads);
     d_output = create_pooling_d_output_tensor<Tensor>(output);
@@ -170,6 +190,7 @@ int test_forward(Data<NSD, Backend, DataType> &d,
   int pid;
   MPI_Comm_rank(comm, &pid);
 
+  util::memory_accounting::PhaseScope phase("forward");
   util::MPIRootPrintStreamInfo()
       << "Executing test_forward with " << be.get_name();
 
@@ -220,6 +241,7 @@ int test_backward(Data<NSD, Backend, DataType> &d,
   int pid;
   MPI_Comm_rank(comm, &pid);
 
+  util::memory_accounting::PhaseScope phase("backward");
   util::MPIRootPrintStreamInfo()
       << "Executing test_backward with " << be.get_name();
 
@@ -264,6 +286,21 @@ int test_backward(Data<NSD, Backend, DataType> &d,
   return 0;
 }
 
+template <int NSD, typename DataType>
+struct PoolingTester<NSD, cpu::Backend, DataType> {
+  PoolingTester() {}
+  int operator()(Data<NSD, cpu::Backend, DataType> &d,
+                 const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
+                 Profile<NSD> &prof) {
+    cpu::Backend be(comm);
+    test_forward<NSD, cpu::Backend, DataType>(
+        d, cfg, comm, be, prof);
+    test_backward<NSD, cpu::Backend, DataType>(
+        d, cfg, comm, be, prof);
+    return 0;
+  }
+};
+
 #ifdef DISTCONV_HAS_CUDNN
 template <int NSD, typename DataType>
 struct PoolingTester<NSD, cudnn::BackendCUDNN, DataType> {
@@ -272,12 +309,10 @@ struct PoolingTester<NSD, cudnn::BackendCUDNN, DataType> {
                  const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
                  Profile<NSD> &prof) {
     int pid;
-    DISTCONV_CHECK_MPI(MPI_Comm_rank(MPI_COMM_WORLD, &pid));
-    cudnnHandle_t cudnn_h;
-    DISTCONV_CHECK_CUDNN(cudnnCreate(&cudnn_h));
+    DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &pid));
     cudnn::Options be_opts(cfg.overlap_halo_exchange,
                            cfg.deterministic);
-    cudnn::BackendCUDNN be(comm, cudnn_h, be_opts);
+    cudnn::BackendCUDNN be(comm, cudnn::make_handle_async(), be_opts);
     if (cfg.nvtx_marking) {
       be.enable_nvtx_marking();
     }
@@ -297,7 +332,20 @@ void run(int argc, char *argv[], int pid) {
     std::cout << cfg << std::endl;
   }
 
-  run_test<NSD, Data, Profile, PoolingTester>(cfg, MPI_COMM_WORLD);
+  if (cfg.is_sweep()) {
+    run_sweep(cfg, MPI_COMM_WORLD,
+              [](const BenchmarkConfig<NSD> &c, MPI_Comm comm,
+                 Metrics *m) {
+                return run_test<NSD, Data, Profile, PoolingTester>(
+                    c, comm, m);
+              });
+  } else {
+    Metrics m;
+    run_test<NSD, Data, Profile, PoolingTester>(cfg, MPI_COMM_WORLD, &m);
+    if (pid == 0 && !cfg.metrics_file.empty()) {
+      m.save(cfg.metrics_file);
+    }
+  }
 
   util::MPIRootPrintStreamInfo() << "Finishing";
 }
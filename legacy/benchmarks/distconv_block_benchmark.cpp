@@ -0,0 +1,854 @@
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <utility>
+
+#include "distconv_config.hpp"
+#include "distconv_benchmark_common.hpp"
+#include "benchmark_common.hpp"
+
+#include "distconv/tensor/tensor.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/distconv.hpp"
+#include "distconv/util/instrumentation.hpp"
+#include "distconv/util/util_mpi.hpp"
+#ifdef DISTCONV_HAS_CUDA
+#include "distconv/tensor/tensor_cuda.hpp"
+#include "distconv/util/util_cuda.hpp"
+#endif
+#if H2_HAS_ROCM
+#include "distconv/util/util_rocm.hpp"
+#endif
+#ifdef DISTCONV_HAS_CUDNN
+#include "distconv/util/util_gpu_dnn.hpp"
+#endif
+
+#include <Al.hpp>
+
+/*
+  Benchmark of a block of layers run back to back:
+
+    conv -> batchnorm [-> + block input] -> ReLU [-> pooling]
+
+  The forward and backward passes of the whole block are timed and
+  compared with the sum of the times of its layers run in isolation,
+  so that the difference is the time saved by overlapping the layers,
+  e.g., the halo exchanges and allreduces of one layer with the
+  computation of another.
+
+  The critical path of the block is broken down with the per-layer
+  instrumentation: for each layer, the time covered by its records
+  (busy) and the time covered only by them (exposed), which the block
+  would save if the layer were free. Communication phases are reported
+  by their total time over the layers.
+ */
+
+namespace distconv_benchmark {
+
+enum class BlockLayer {CONV, BN, RESIDUAL, RELU, POOL};
+
+inline std::string to_string(BlockLayer l) {
+  switch (l) {
+    case BlockLayer::CONV: return "conv";
+    case BlockLayer::BN: return "bn";
+    case BlockLayer::RESIDUAL: return "residual";
+    case BlockLayer::RELU: return "relu";
+    case BlockLayer::POOL: return "pool";
+  }
+  return "unknown";
+}
+
+// Layers of the block in the order of the forward pass
+template <int NSD>
+std::vector<BlockLayer> get_block_layers(const BenchmarkConfig<NSD> &cfg) {
+  std::vector<BlockLayer> layers = {BlockLayer::CONV, BlockLayer::BN};
+  if (cfg.block_residual) {
+    layers.push_back(BlockLayer::RESIDUAL);
+  }
+  layers.push_back(BlockLayer::RELU);
+  if (cfg.block_pool_size > 0) {
+    layers.push_back(BlockLayer::POOL);
+  }
+  return layers;
+}
+
+const std::vector<util::instrumentation::Phase> comm_phases = {
+  util::instrumentation::Phase::HALO_PACK,
+  util::instrumentation::Phase::HALO_TRANSFER,
+  util::instrumentation::Phase::HALO_UNPACK,
+  util::instrumentation::Phase::ALLREDUCE,
+};
+
+// Breakdown of one pass of the block in ms
+struct Breakdown {
+  // From the first start to the last end of the records
+  double span = 0;
+  // Time covered by at least one record
+  double busy = 0;
+  // Time covered by the records of each layer, and by them only
+  std::vector<double> layer_busy;
+  std::vector<double> layer_exposed;
+  // Total time of each of comm_phases
+  std::vector<double> comm;
+};
+
+// Length of the union of the intervals
+inline double get_covered_time(std::vector<std::pair<double, double>> iv) {
+  std::sort(iv.begin(), iv.end());
+  double total = 0;
+  double begin = 0;
+  double end = 0;
+  for (size_t i = 0; i < iv.size(); ++i) {
+    if (i == 0 || iv[i].first > end) {
+      total += end - begin;
+      begin = iv[i].first;
+      end = iv[i].second;
+    } else {
+      end = std::max(end, iv[i].second);
+    }
+  }
+  return total + end - begin;
+}
+
+// Breaks down the records of the passes since the last clear
+inline Breakdown get_breakdown(const std::vector<BlockLayer> &layers) {
+  util::instrumentation::collect(true);
+  const auto records = util::instrumentation::get_records();
+  Breakdown b;
+  std::vector<std::pair<double, double>> all;
+  for (const auto &r: records) {
+    all.emplace_back(r.start, r.start + r.duration);
+  }
+  if (!all.empty()) {
+    double first = std::numeric_limits<double>::max();
+    double last = std::numeric_limits<double>::lowest();
+    for (const auto &i: all) {
+      first = std::min(first, i.first);
+      last = std::max(last, i.second);
+    }
+    b.span = last - first;
+    b.busy = get_covered_time(all);
+  }
+  for (const auto l: layers) {
+    std::vector<std::pair<double, double>> mine;
+    std::vector<std::pair<double, double>> others;
+    for (const auto &r: records) {
+      (r.layer == to_string(l) ? mine : others).emplace_back(
+          r.start, r.start + r.duration);
+    }
+    b.layer_busy.push_back(get_covered_time(mine));
+    b.layer_exposed.push_back(b.busy - get_covered_time(others));
+  }
+  for (const auto p: comm_phases) {
+    b.comm.push_back(util::instrumentation::get_stats(p).total);
+  }
+  return b;
+}
+
+template <int NSD>
+class Profile {
+ public:
+  BenchmarkConfig<NSD> m_cfg;
+  std::vector<BlockLayer> layers;
+  // Whole block
+  std::vector<float> fwd_time;
+  std::vector<float> bwd_time;
+  // Each layer in isolation, indexed as layers
+  std::vector<std::vector<float>> layer_fwd_time;
+  std::vector<std::vector<float>> layer_bwd_time;
+  // One per pass, with the instrumentation enabled
+  std::vector<Breakdown> fwd_breakdowns;
+  std::vector<Breakdown> bwd_breakdowns;
+  Profile(const BenchmarkConfig<NSD> &cfg):
+      m_cfg(cfg),
+      layers(get_block_layers(cfg)),
+      fwd_time(cfg.run_count, 0),
+      bwd_time(cfg.run_count, 0),
+      layer_fwd_time(layers.size(), std::vector<float>(cfg.run_count, 0)),
+      layer_bwd_time(layers.size(), std::vector<float>(cfg.run_count, 0)) {}
+
+  // Sum over the layers of their times in isolation of each run
+  std::vector<float> get_isolated_sum(
+      const std::vector<std::vector<float>> &layer_time) const {
+    std::vector<float> sum(fwd_time.size(), 0);
+    for (const auto &t: layer_time) {
+      for (size_t i = 0; i < sum.size(); ++i) {
+        sum[i] += t[i];
+      }
+    }
+    return sum;
+  }
+
+  std::ostream &print_as_row(std::ostream &os) {
+    const auto fwd_sum = get_isolated_sum(layer_fwd_time);
+    const auto bwd_sum = get_isolated_sum(layer_bwd_time);
+    for (size_t i = 0; i < fwd_time.size(); ++i) {
+      m_cfg.print_as_row(os) << " " << fwd_time[i]
+                             << " " << fwd_sum[i]
+                             << " " << bwd_time[i]
+                             << " " << bwd_sum[i];
+      os << std::endl;
+    }
+    return os;
+  }
+
+  void print_pass_summary(std::ostream &os, const std::string &name,
+                          const std::vector<float> &block_time,
+                          const std::vector<std::vector<float>> &layer_time,
+                          const std::vector<Breakdown> &breakdowns) {
+    const auto sum = get_isolated_sum(layer_time);
+    os << name << " block median: " << get_median(block_time)
+       << ", isolated sum median: " << get_median(sum)
+       << ", overlap: " << get_median(sum) - get_median(block_time)
+       << "\n";
+    auto median_of = [&](auto get) {
+      std::vector<double> v;
+      for (const auto &b: breakdowns) v.push_back(get(b));
+      return v.empty() ? 0 : get_median(v);
+    };
+    os << "  critical path span: "
+       << median_of([](const Breakdown &b) { return b.span; })
+       << ", busy: "
+       << median_of([](const Breakdown &b) { return b.busy; }) << "\n";
+    for (size_t i = 0; i < layers.size(); ++i) {
+      os << "  " << to_string(layers[i])
+         << " isolated: " << get_median(layer_time[i])
+         << ", busy: "
+         << median_of([i](const Breakdown &b) { return b.layer_busy[i]; })
+         << ", exposed: "
+         << median_of([i](const Breakdown &b) { return b.layer_exposed[i]; })
+         << "\n";
+    }
+    for (size_t i = 0; i < comm_phases.size(); ++i) {
+      os << "  " << util::instrumentation::to_string(comm_phases[i])
+         << ": " << median_of([i](const Breakdown &b) { return b.comm[i]; })
+         << "\n";
+    }
+  }
+
+  void print_summary(std::ostream &os) {
+    print_pass_summary(os, "Forward", fwd_time, layer_fwd_time,
+                       fwd_breakdowns);
+    print_pass_summary(os, "Backward", bwd_time, layer_bwd_time,
+                       bwd_breakdowns);
+    os << std::flush;
+  }
+
+  // Medians of the slowest rank. Collective over comm.
+  Metrics get_metrics(MPI_Comm comm) const {
+    int np;
+    MPI_Comm_size(comm, &np);
+    Metrics m;
+    std::stringstream ss;
+    m_cfg.print_as_row(ss);
+    m.add("config", ss.str());
+    m.add("num_ranks", np);
+    auto add = [&](const std::string &name, double t) {
+      DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE,
+                                       MPI_MAX, comm));
+      m.add(name + "_time_ms", t);
+    };
+    auto median = [](const auto &v) {
+      return v.empty() ? 0.0 : (double)get_median(v);
+    };
+    auto add_pass = [&](const std::string &name,
+                        const std::vector<float> &block_time,
+                        const std::vector<std::vector<float>> &layer_time,
+                        const std::vector<Breakdown> &breakdowns) {
+      const auto sum = get_isolated_sum(layer_time);
+      add(name, median(block_time));
+      add(name + "_isolated_sum", median(sum));
+      add(name + "_overlap", median(sum) - median(block_time));
+      for (size_t i = 0; i < layers.size(); ++i) {
+        std::vector<double> exposed;
+        for (const auto &b: breakdowns) {
+          exposed.push_back(b.layer_exposed[i]);
+        }
+        add(name + "_" + to_string(layers[i]), median(layer_time[i]));
+        add(name + "_" + to_string(layers[i]) + "_exposed",
+            median(exposed));
+      }
+    };
+    add_pass("fwd", fwd_time, layer_fwd_time, fwd_breakdowns);
+    add_pass("bwd", bwd_time, layer_bwd_time, bwd_breakdowns);
+    return m;
+  }
+};
+
+template <int NSD, typename Backend, typename DataType>
+class Data {
+ public:
+  const BenchmarkConfig<NSD> &m_cfg;
+  using Tensor = typename TensorType<Backend, DataType>::type;
+  Tensor input;
+  Tensor d_input;
+  Tensor filter;
+  Tensor d_filter;
+  Tensor conv_output;
+  Tensor d_conv_output;
+  Tensor mean_and_var;
+  Tensor mean;
+  Tensor var;
+  Tensor running_mean;
+  Tensor running_var;
+  Tensor scale;
+  Tensor bias;
+  Tensor d_scale;
+  Tensor d_bias;
+  Tensor d_mean_and_var;
+  Tensor d_mean;
+  Tensor d_var;
+  Tensor bn_output;
+  Tensor d_bn_output;
+  Tensor relu_output;
+  Tensor d_relu_output;
+  // Pooling
+  Tensor output;
+  Tensor d_output;
+
+  Data(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm): m_cfg(cfg) {
+    int pid;
+    int np;
+    MPI_Comm_rank(comm, &pid);
+    MPI_Comm_size(comm, &np);
+
+    assert_eq(std::accumulate(cfg.p_s.begin(),
+                              cfg.p_s.end(),
+                              1,
+                              std::multiplies<int>())
+              * cfg.p_c * cfg.p_n, np);
+    // Non-overlapping even windows need no halo on the pooling input
+    assert_always(cfg.block_pool_size >= 0 && cfg.block_pool_size % 2 == 0);
+    if (cfg.block_residual) {
+      // The convolution must preserve the shape of the input
+      assert_eq(cfg.f_k, cfg.i_c);
+      assert_always(cfg.use_padding);
+      for (const auto s: cfg.strides) {
+        assert_eq(s, 1);
+      }
+    }
+
+    const auto vector_concat = [](const int_vector v, const int c, const int n) {
+                                 int_vector cn({c, n});
+                                 cn.insert(cn.begin(), v.begin(), v.end());
+                                 return (const int_vector) cn;
+                               };
+
+    const auto input_shape  = vector_concat(cfg.i_s, cfg.i_c, cfg.i_n);
+    const auto locale_shape = vector_concat(cfg.p_s, cfg.p_c, cfg.p_n);
+    util::MPIPrintStreamDebug()
+      << "input_shape: " << util::join_array(input_shape, " ")
+      << " locale_shape: " << util::join_array(locale_shape, " ");
+
+    input = create_input_tensor<Tensor>(
+        input_shape, locale_shape, cfg.f_s, cfg.strides,
+        cfg.dilations, false, comm);
+    d_input = create_d_input_tensor<Tensor>(input);
+    filter = create_filter_tensor<Tensor>(locale_shape, cfg.f_s, input,
+                                          cfg.i_c, cfg.f_k, cfg.num_groups,
+                                          comm, cfg.chanfilt_algo, cfg.p_f);
+    d_filter = create_d_filter_tensor<Tensor>(filter);
+    conv_output = create_convolution_output_tensor<Tensor>(
+        input, filter, cfg.strides, cfg.pads, cfg.dilations,
+        cfg.num_groups);
+    d_conv_output = create_convolution_d_output_tensor<Tensor>(
+        conv_output, filter, cfg.dilations);
+
+    // This assumes no partitioning of the channel dimension
+    const auto shared_dist = tensor::Distribution::make_shared_distribution(
+        tensor::Shape(locale_shape));
+    const auto loc = tensor::LocaleMPI(comm);
+    tensor::Shape ch_stat_shape(NSD + 2, 1);
+    ch_stat_shape[-2] = cfg.f_k;
+    tensor::Shape ch_stat_shape2(NSD + 2, 1);
+    ch_stat_shape2[-2] = cfg.f_k * 2;
+    mean_and_var = Tensor(ch_stat_shape2, loc, shared_dist);
+    mean = Tensor(ch_stat_shape, loc, shared_dist);
+    var = Tensor(ch_stat_shape, loc, shared_dist);
+    running_mean = Tensor(ch_stat_shape, loc, shared_dist);
+    running_var = Tensor(ch_stat_shape, loc, shared_dist);
+    scale = Tensor(ch_stat_shape, loc, shared_dist);
+    bias = Tensor(ch_stat_shape, loc, shared_dist);
+    d_scale = Tensor(ch_stat_shape, loc, shared_dist);
+    d_bias = Tensor(ch_stat_shape, loc, shared_dist);
+    d_mean_and_var = Tensor(ch_stat_shape2, loc, shared_dist);
+    d_mean = Tensor(ch_stat_shape, loc, shared_dist);
+    d_var = Tensor(ch_stat_shape, loc, shared_dist);
+
+    bn_output = create_d_input_tensor<Tensor>(conv_output);
+    d_bn_output = create_d_input_tensor<Tensor>(conv_output);
+    relu_output = create_d_input_tensor<Tensor>(conv_output);
+    d_relu_output = create_d_input_tensor<Tensor>(conv_output);
+
+    if (cfg.block_pool_size > 0) {
+      const int_vector window(NSD, cfg.block_pool_size);
+      output = create_pooling_output_tensor<Tensor>(
+          relu_output, window, window, int_vector(NSD, 0));
+      d_output = create_pooling_d_output_tensor<Tensor>(output);
+    }
+
+    if (pid == 0) {
+      std::cout << "Input tensor shape: " << input.get_shape()
+                << ", distribution: " << input.get_distribution() << "\n";
+      std::cout << "Filter tensor shape: " << filter.get_shape()
+                << ", distribution: " << filter.get_distribution() << "\n";
+      std::cout << "Convolution output tensor shape: "
+                << conv_output.get_shape()
+                << ", distribution: " << conv_output.get_distribution()
+                << "\n";
+      if (cfg.block_pool_size > 0) {
+        std::cout << "Pooling output tensor shape: " << output.get_shape()
+                  << ", distribution: " << output.get_distribution()
+                  << "\n";
+      }
+    }
+
+    if (is_empty()) return;
+    // Allocate
+    assert0(input.allocate());
+    input.zero();
+    assert0(d_input.allocate());
+    d_input.zero();
+    assert0(filter.allocate());
+    filter.zero();
+    assert0(d_filter.allocate());
+    d_filter.zero();
+    assert0(conv_output.allocate());
+    conv_output.zero();
+    assert0(d_conv_output.allocate());
+    d_conv_output.zero();
+    assert0(mean_and_var.allocate());
+    mean_and_var.zero();
+    assert0(tensor::View(mean, mean_and_var.get_buffer()));
+    assert0(tensor::View(var, mean_and_var.get_buffer() +
+                         ch_stat_shape.get_size()));
+    assert0(running_mean.allocate());
+    running_mean.zero();
+    assert0(running_var.allocate());
+    running_var.zero();
+    assert0(scale.allocate());
+    scale.zero();
+    assert0(bias.allocate());
+    bias.zero();
+    assert0(d_scale.allocate());
+    d_scale.zero();
+    assert0(d_bias.allocate());
+    d_bias.zero();
+    assert0(d_mean_and_var.allocate());
+    d_mean_and_var.zero();
+    assert0(tensor::View(d_mean, d_mean_and_var.get_buffer()));
+    assert0(tensor::View(d_var, d_mean_and_var.get_buffer() +
+                         ch_stat_shape.get_size()));
+    assert0(bn_output.allocate());
+    bn_output.zero();
+    assert0(d_bn_output.allocate());
+    d_bn_output.zero();
+    assert0(relu_output.allocate());
+    relu_output.zero();
+    assert0(d_relu_output.allocate());
+    d_relu_output.zero();
+    if (m_cfg.block_pool_size > 0) {
+      assert0(output.allocate());
+      output.zero();
+      assert0(d_output.allocate());
+      d_output.zero();
+    }
+  }
+  bool is_empty() const {
+    return conv_output.get_size() == 0 ||
+        (m_cfg.block_pool_size > 0 && output.get_size() == 0);
+  }
+  // Gradient of the output of the block
+  Tensor &get_d_block_output() {
+    return m_cfg.block_pool_size > 0 ? d_output : d_relu_output;
+  }
+  void initialize() {
+    if (m_cfg.mode == BenchmarkConfig<NSD>::mode_t::SIMPLE) {
+      init_tensor_constant(input, DataType(1.0));
+      init_tensor_offset(filter);
+      init_tensor_constant(get_d_block_output(), DataType(1.0));
+    } else {
+      init_input_tensor(input, input_tensor_seed);
+      init_input_tensor(filter, filter_tensor_seed);
+      init_input_tensor(get_d_block_output(), d_output_tensor_seed);
+    }
+    init_tensor_constant(scale, 1);
+    init_tensor_constant(bias, 0);
+    init_tensor_constant(running_mean, 0);
+    init_tensor_constant(running_var, 1);
+  }
+  void dump_input(bool dump_binary) {
+    dump_tensor(input, "input_tensor", dump_binary);
+    dump_tensor(filter, "filter_tensor", dump_binary);
+    dump_tensor(get_d_block_output(), "d_output_tensor", dump_binary);
+  }
+  void dump_output(bool dump_binary) {
+    dump_tensor(m_cfg.block_pool_size > 0 ? output : relu_output,
+                "output_tensor", dump_binary);
+    dump_tensor(d_input, "d_input_tensor", dump_binary);
+    if (!m_cfg.skip_weight_allreduce) {
+      dump_shared_tensor(d_filter, "d_filter_tensor", dump_binary);
+    }
+  }
+};
+
+template <int NSD, typename Backend, typename DataType>
+struct BlockTester;
+
+template <int NSD, typename DataType>
+struct BlockTester<NSD, ref::Backend, DataType> {
+  BlockTester() {}
+  int operator()(Data<NSD, ref::Backend, DataType> &d,
+                 const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
+                 Profile<NSD> &prof) {
+    util::MPIRootPrintStreamError() << "Not implemented";
+    std::abort();
+    return 0;
+  }
+};
+
+template <int NSD, typename DataType>
+struct BlockTester<NSD, cpu::Backend, DataType> {
+  BlockTester() {}
+  int operator()(Data<NSD, cpu::Backend, DataType> &d,
+                 const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
+                 Profile<NSD> &prof) {
+    util::MPIRootPrintStreamError() << "Not implemented";
+    std::abort();
+    return 0;
+  }
+};
+
+#ifdef DISTCONV_HAS_CUDNN
+// The layers of the block. Layers that have no instrumentation of
+// their own are timed here under their names.
+template <int NSD, typename DataType>
+class Block {
+ public:
+  using Backend = cudnn::BackendCUDNN;
+
+  Block(Data<NSD, Backend, DataType> &d, const BenchmarkConfig<NSD> &cfg,
+        Backend &be):
+      m_d(d), m_cfg(cfg), m_be(be), m_layers(get_block_layers(cfg)),
+      m_conv(be, 2 + NSD, cfg.halo_exchange_method, cfg.chanfilt_algo),
+      m_bn(be, 2 + NSD, 0.9, 1e-5, cfg.global_stat, cfg.batchnorm_impl),
+      m_relu(be),
+      m_pool(be, 2 + NSD, cfg.halo_exchange_method),
+      m_residual_src_d(backend::make_tensor_descriptor()),
+      m_residual_dst_d(backend::make_tensor_descriptor()) {
+    m_conv.set_name(to_string(BlockLayer::CONV));
+    m_conv.setup(d.input, d.filter, d.conv_output,
+                 d.d_input, d.d_filter, d.d_conv_output,
+                 cfg.pads, cfg.strides, cfg.dilations, cfg.num_groups,
+                 cfg.conv_fwd_algo, cfg.conv_bwd_data_algo,
+                 cfg.conv_bwd_filter_algo, 0);
+    m_bn.set_num_samples(d.conv_output.get_shape()[-1]);
+    m_relu.setup(d.bn_output, d.relu_output, d.d_bn_output,
+                 d.d_relu_output);
+    if (cfg.block_pool_size > 0) {
+      const int_vector window(NSD, cfg.block_pool_size);
+      m_pool.setup(d.relu_output, d.output, d.d_relu_output, d.d_output,
+                   window, int_vector(NSD, 0), window, cfg.pooling_mode);
+    }
+    if (cfg.block_residual) {
+      // The gradient tensors have the same local shapes
+      backend::setup_tensor_descriptor(m_residual_src_d, d.input, false);
+      backend::setup_tensor_descriptor(m_residual_dst_d, d.bn_output, false);
+    }
+  }
+  Block(const Block &) = delete;
+  Block &operator=(const Block &) = delete;
+  ~Block() {
+    backend::destroy_tensor_descriptor(m_residual_dst_d);
+    backend::destroy_tensor_descriptor(m_residual_src_d);
+  }
+
+  Convolution<Backend, DataType> &get_conv() { return m_conv; }
+  const std::vector<BlockLayer> &get_layers() const { return m_layers; }
+
+  void forward() {
+    for (const auto l: m_layers) {
+      forward(l);
+    }
+  }
+
+  void backward() {
+    for (auto it = m_layers.rbegin(); it != m_layers.rend(); ++it) {
+      backward(*it);
+    }
+  }
+
+  void forward(BlockLayer l) {
+    auto &d = m_d;
+    if (l == BlockLayer::CONV) {
+      m_conv.forward(DataType(1.0), d.input, d.filter, DataType(0.0),
+                     d.conv_output, m_cfg.skip_halo_exchange,
+                     m_cfg.skip_chanfilt_comm);
+      return;
+    }
+    util::instrumentation::ScopedTimer timer(
+        to_string(l), util::instrumentation::Phase::FORWARD,
+        m_be.get_stream());
+    switch (l) {
+      case BlockLayer::BN:
+        m_bn.forward(d.conv_output, d.mean, d.var, d.running_mean,
+                     d.running_var, d.scale, d.bias, d.bn_output, true);
+        break;
+      case BlockLayer::RESIDUAL:
+        add(d.input, m_residual_src_d, DataType(1.0), d.bn_output,
+            m_residual_dst_d);
+        break;
+      case BlockLayer::RELU:
+        m_relu.forward(DataType(1.0), d.bn_output, DataType(0.0),
+                       d.relu_output);
+        break;
+      case BlockLayer::POOL:
+        m_pool.forward(DataType(1.0), d.relu_output, DataType(0.0),
+                       d.output);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // With the residual, the gradient of the block input is first set
+  // to that of the batchnorm output, and the convolution adds to it.
+  void backward(BlockLayer l) {
+    auto &d = m_d;
+    if (l == BlockLayer::CONV) {
+      m_conv.backward_filter(DataType(1.0), d.input, d.d_conv_output,
+                             DataType(0.0), d.d_filter,
+                             !m_cfg.skip_weight_allreduce,
+                             m_cfg.skip_chanfilt_comm);
+      if (m_conv.is_overlap_bwd_halo_exchange_enabled() &&
+          !m_cfg.skip_halo_exchange) {
+        m_conv.backward_data_exchange_halo(d.d_conv_output);
+      }
+      m_conv.backward_data(DataType(1.0), d.filter, d.d_conv_output,
+                           DataType(m_cfg.block_residual ? 1.0 : 0.0),
+                           d.d_input, m_cfg.skip_halo_exchange,
+                           m_cfg.skip_chanfilt_comm);
+      return;
+    }
+    util::instrumentation::ScopedTimer timer(
+        to_string(l), util::instrumentation::Phase::BACKWARD_DATA,
+        m_be.get_stream());
+    switch (l) {
+      case BlockLayer::BN:
+        m_bn.backward_stage1(d.conv_output, d.d_bn_output, d.mean, d.var,
+                             d.scale, d.d_scale, d.d_bias, d.d_mean,
+                             d.d_var);
+        m_bn.backward_allreduce(d.d_scale, d.d_bias, d.d_mean, d.d_var,
+                                m_cfg.skip_weight_allreduce);
+        m_bn.backward_stage2(d.conv_output, d.d_bn_output, d.mean, d.var,
+                             d.scale, d.d_mean, d.d_var, d.d_conv_output);
+        break;
+      case BlockLayer::RESIDUAL:
+        add(d.d_bn_output, m_residual_dst_d, DataType(0.0), d.d_input,
+            m_residual_src_d);
+        break;
+      case BlockLayer::RELU:
+        m_relu.backward(DataType(1.0), d.relu_output, d.d_relu_output,
+                        d.bn_output, DataType(0.0), d.d_bn_output);
+        break;
+      case BlockLayer::POOL:
+        m_pool.backward(DataType(1.0), d.output, d.d_output,
+                        d.relu_output, DataType(0.0), d.d_relu_output);
+        break;
+      default:
+        break;
+    }
+  }
+
+ private:
+  Data<NSD, Backend, DataType> &m_d;
+  const BenchmarkConfig<NSD> &m_cfg;
+  Backend &m_be;
+  std::vector<BlockLayer> m_layers;
+  Convolution<Backend, DataType> m_conv;
+  BatchNormalization<Backend, DataType> m_bn;
+  ReLU<Backend> m_relu;
+  Pooling<Backend, DataType> m_pool;
+  // Block input and batchnorm output without their halos
+  backend::TensorDescriptor_t m_residual_src_d;
+  backend::TensorDescriptor_t m_residual_dst_d;
+
+  using Tensor = typename Data<NSD, Backend, DataType>::Tensor;
+
+  // dst = src + beta * dst
+  void add(const Tensor &src, backend::TensorDescriptor_t const &src_d,
+           DataType beta, Tensor &dst,
+           backend::TensorDescriptor_t const &dst_d) {
+    if (dst.get_local_size() == 0) return;
+    backend::apply_fwd_bias(m_be.get_handle(), DataType(1.0), src_d,
+                            src.get_const_base_ptr(), beta, dst_d,
+                            dst.get_base_ptr());
+  }
+};
+
+template <int NSD, typename DataType>
+int test_block(Block<NSD, DataType> &block,
+               const BenchmarkConfig<NSD> &cfg,
+               MPI_Comm comm,
+               cudnn::BackendCUDNN &be,
+               Profile<NSD> &prof) {
+  util::memory_accounting::PhaseScope phase("block");
+  util::MPIRootPrintStreamInfo()
+      << "Executing test_block with " << be.get_name();
+
+  if (cfg.warming_up_count > 0) {
+    util::MPIRootPrintStreamInfo() << "Warming up";
+  }
+  for (int i = 0; i < cfg.warming_up_count; ++i) {
+    block.forward();
+    block.backward();
+  }
+  be.wait();
+  util::check_for_device_runtime_error();
+
+  util::MPIRootPrintStreamInfo() << "Starting " << cfg.run_count
+                                 << " times of measurement";
+
+  Clock<cudnn::BackendCUDNN> clk(be);
+  // Runs f once to synchronize the processes and then times it
+  auto measure = [&](auto f) {
+    complete_async<cudnn::BackendCUDNN>();
+    DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+    if (!cfg.testing) {
+      spin_async_device(cfg.spin_time_ms, be);
+    }
+    f();
+    clk.start();
+    f();
+    clk.stop();
+    return clk.get_time();
+  };
+  const auto &layers = block.get_layers();
+  for (int i = 0; i < cfg.run_count; ++i) {
+    prof.fwd_time[i] = measure([&]() { block.forward(); });
+    prof.bwd_time[i] = measure([&]() { block.backward(); });
+    for (size_t j = 0; j < layers.size(); ++j) {
+      prof.layer_fwd_time[j][i] = measure(
+          [&]() { block.forward(layers[j]); });
+      prof.layer_bwd_time[j][i] = measure(
+          [&]() { block.backward(layers[j]); });
+    }
+  }
+  DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+
+  // Breakdowns are taken separately as the instrumentation adds
+  // events to the timed passes
+  util::MPIRootPrintStreamInfo() << "Breaking down the critical path";
+  const bool instrumentation_enabled = util::instrumentation::is_enabled();
+  util::instrumentation::set_enabled(true);
+  auto break_down = [&](auto f) {
+    complete_async<cudnn::BackendCUDNN>();
+    DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+    util::instrumentation::clear();
+    f();
+    return get_breakdown(layers);
+  };
+  for (int i = 0; i < cfg.run_count; ++i) {
+    prof.fwd_breakdowns.push_back(break_down([&]() { block.forward(); }));
+    prof.bwd_breakdowns.push_back(break_down([&]() { block.backward(); }));
+  }
+  util::instrumentation::clear();
+  util::instrumentation::set_enabled(instrumentation_enabled);
+  DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+  util::MPIRootPrintStreamInfo() << "Measurement done";
+  return 0;
+}
+
+template <int NSD, typename DataType>
+struct BlockTester<NSD, cudnn::BackendCUDNN, DataType> {
+  BlockTester() {}
+  int operator()(Data<NSD, cudnn::BackendCUDNN, DataType> &d,
+                 const BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
+                 Profile<NSD> &prof) {
+    int pid;
+    DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &pid));
+    cudnn::Options be_opts(cfg.overlap_halo_exchange,
+                           cfg.deterministic,
+                           cfg.profiling);
+    cudnn::BackendCUDNN be(comm, cudnn::make_handle_async(), be_opts);
+    util::memory_accounting::begin_phase("setup");
+    Block<NSD, DataType> block(d, cfg, be);
+    util::memory_accounting::end_phase();
+    // AUTOTUNE may modify tensors
+    if (cfg.conv_fwd_algo == "AUTOTUNE" ||
+        cfg.conv_bwd_data_algo == "AUTOTUNE" ||
+        cfg.conv_bwd_filter_algo == "AUTOTUNE") {
+      d.initialize();
+    }
+    be.save_algo_cache();
+    start_profiler<cudnn::BackendCUDNN>();
+    if (cfg.nvtx_marking) {
+      be.enable_nvtx_marking();
+    }
+    test_block<NSD, DataType>(block, cfg, comm, be, prof);
+    return 0;
+  }
+};
+#endif
+
+template <int NSD>
+void run(int argc, char *argv[], int pid, int np) {
+  auto cfg = process_opt<NSD>(argc, argv, pid, true);
+  if (pid == 0) {
+    std::cout << cfg << std::endl;
+  }
+
+  if (!cfg.is_sweep() && cfg.get_num_ranks() != np) {
+    util::MPIRootPrintStreamError()
+        << "Number of ranks does not match with the number of tensor partitions";
+    DISTCONV_CHECK_MPI(MPI_Finalize());
+    std::exit(1);
+  }
+
+  if (cfg.is_sweep()) {
+    run_sweep(cfg, MPI_COMM_WORLD,
+              [](const BenchmarkConfig<NSD> &c, MPI_Comm comm,
+                 Metrics *m) {
+                return run_test<NSD, Data, Profile, BlockTester>(c, comm, m);
+              });
+  } else {
+    Metrics m;
+    run_test<NSD, Data, Profile, BlockTester>(cfg, MPI_COMM_WORLD, &m);
+    if (pid == 0 && !cfg.metrics_file.empty()) {
+      m.save(cfg.metrics_file);
+    }
+  }
+
+  util::MPIRootPrintStreamInfo() << "Finishing";
+}
+
+} // namespace distconv_benchmark
+
+int main(int argc, char *argv[]) {
+  distconv_benchmark::set_device();
+  int pid;
+  int np;
+  Al::Initialize(argc, argv);
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(MPI_COMM_WORLD, &pid));
+  DISTCONV_CHECK_MPI(MPI_Comm_size(MPI_COMM_WORLD, &np));
+
+  const int nsd = distconv_benchmark::parse_num_dims(argc, argv);
+
+  if(nsd == 2) {
+    distconv_benchmark::run<2>(argc, argv, pid, np);
+  } else if(nsd == 3) {
+    distconv_benchmark::run<3>(argc, argv, pid, np);
+  } else {
+    distconv::util::MPIRootPrintStreamError() << "Invalid --num-dims: " << nsd;
+    DISTCONV_CHECK_MPI(MPI_Finalize());
+    std::exit(1);
+  }
+
+  Al::Finalize();
+  return 0;
+}
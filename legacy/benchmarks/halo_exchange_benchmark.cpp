@@ -0,0 +1,321 @@
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <sstream>
+
+#include "distconv_config.hpp"
+#include "distconv_benchmark_common.hpp"
+#include "benchmark_common.hpp"
+
+#include "distconv/tensor/tensor.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/tensor/tensor_mpi_cuda.hpp"
+#include "distconv/distconv.hpp"
+#include "distconv/dnn_backend/halo_exchange_tuner.hpp"
+#include "distconv/util/instrumentation.hpp"
+#include "distconv/util/util_mpi.hpp"
+#include "distconv/util/util_gpu.hpp"
+#ifdef DISTCONV_HAS_NVSHMEM
+#include "distconv/util/nvshmem.hpp"
+#endif // DISTCONV_HAS_NVSHMEM
+
+#include <Al.hpp>
+
+/*
+  Times each halo exchange method for every split spatial dimension,
+  halo width and accumulation operation of a tensor with the given
+  image size and process grid. The pack, transfer and unpack phases
+  are measured separately with the instrumentation of distconv, and
+  the results are printed as a table and saved to
+  <output-file>_halo.csv.
+
+  If DISTCONV_ALGO_CACHE_PATH is set, the fastest method of each
+  dimension and width is also saved as the selection of the AUTO
+  halo exchange method, which then does not time the methods again.
+ */
+
+using namespace distconv;
+
+namespace distconv_benchmark {
+
+namespace instr = util::instrumentation;
+
+inline tensor::HaloExchangeAccumOp get_accum_op(const std::string &name) {
+  if (name == "ID") {
+    return tensor::HaloExchangeAccumOp::ID;
+  } else if (name == "SUM") {
+    return tensor::HaloExchangeAccumOp::SUM;
+  } else {
+    util::MPIRootPrintStreamError()
+        << "Unknown halo accumulation operation: " << name;
+    std::abort();
+  }
+}
+
+template <int NSD>
+std::vector<HaloExchangeMethod> get_methods(const BenchmarkConfig<NSD> &cfg) {
+  if (cfg.halo_exchange_methods.empty()) {
+    return HaloExchangeTuner<float>::get_candidates();
+  }
+  std::vector<HaloExchangeMethod> methods;
+  for (const auto &m: cfg.halo_exchange_methods) {
+    methods.push_back(GetHaloExchangeMethod(m));
+  }
+  return methods;
+}
+
+// Medians over the runs, taking the maximum over the ranks
+struct HaloProfile {
+  double time = 0;
+  double pack = 0;
+  double transfer = 0;
+  double unpack = 0;
+};
+
+inline double get_rank_max(double x, MPI_Comm comm) {
+  DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &x, 1, MPI_DOUBLE,
+                                   MPI_MAX, comm));
+  return x;
+}
+
+// Time per exchange in ms of phase, summed over both sides
+inline double get_phase_time(instr::Phase phase, int num_runs) {
+  return instr::get_stats(phase).total / num_runs;
+}
+
+template <int NSD, typename HaloExchange, typename CommType>
+HaloProfile time_exchange(const BenchmarkConfig<NSD> &cfg,
+                          HaloExchange &xch, int dim,
+                          CommType &comm_rhs, CommType &comm_lhs,
+                          tensor::HaloExchangeAccumOp op,
+                          MPI_Comm comm) {
+  // Accumulating halos is the reverse exchange, as with pooling
+  const bool is_reverse = op != tensor::HaloExchangeAccumOp::ID;
+  auto exchange = [&]() {
+    xch.exchange(dim, comm_rhs, comm_lhs, false, is_reverse, false, op);
+  };
+  for (int i = 0; i < cfg.warming_up_count; ++i) {
+    exchange();
+  }
+  h2::gpu::sync();
+  DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+
+  // End-to-end times without instrumentation overhead
+  const bool instr_enabled = instr::is_enabled();
+  instr::set_enabled(false);
+  std::vector<double> times;
+  for (int i = 0; i < cfg.run_count; ++i) {
+    const double start = MPI_Wtime();
+    exchange();
+    h2::gpu::sync();
+    times.push_back((MPI_Wtime() - start) * 1e3);
+  }
+
+  // Phases
+  instr::set_enabled(true);
+  instr::clear();
+  for (int i = 0; i < cfg.run_count; ++i) {
+    exchange();
+  }
+  h2::gpu::sync();
+  instr::collect(true);
+  HaloProfile prof;
+  prof.time = get_rank_max(get_median(times), comm);
+  prof.pack = get_rank_max(
+      get_phase_time(instr::Phase::HALO_PACK, cfg.run_count), comm);
+  prof.transfer = get_rank_max(
+      get_phase_time(instr::Phase::HALO_TRANSFER, cfg.run_count), comm);
+  prof.unpack = get_rank_max(
+      get_phase_time(instr::Phase::HALO_UNPACK, cfg.run_count), comm);
+  instr::clear();
+  instr::set_enabled(instr_enabled);
+  return prof;
+}
+
+// Bytes sent by the local rank in an exchange of dim
+template <typename Tensor>
+double get_send_bytes(const Tensor &t, int dim, int width) {
+  using DataType = typename Tensor::data_type;
+  if (t.get_local_size() == 0) return 0;
+  const int idx = t.get_proc_index()[dim];
+  const int num_splits = t.get_distribution().get_locale_shape()[dim];
+  const int num_peers = (idx > 0) + (idx < num_splits - 1);
+  auto shape = t.get_local_real_shape();
+  shape[dim] = width;
+  return (double)shape.get_size() * sizeof(DataType) * num_peers;
+}
+
+template <int NSD, typename DataType>
+int run_test(const BenchmarkConfig<NSD> &cfg, MPI_Comm comm) {
+  using Tensor = tensor::Tensor<DataType, tensor::LocaleMPI,
+                                tensor::CUDAAllocator>;
+  int pid;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &pid));
+
+  cudnnHandle_t cudnn_h;
+  DISTCONV_CHECK_CUDNN(cudnnCreate(&cudnn_h));
+  cudnn::Options be_opts(cfg.overlap_halo_exchange,
+                         cfg.deterministic,
+                         cfg.profiling);
+  cudnn::BackendCUDNN be(comm, cudnn_h, be_opts);
+  HaloExchangeTuner<DataType> tuner(be);
+
+  const auto methods = get_methods(cfg);
+  int_vector input_shape(cfg.i_s);
+  input_shape.push_back(cfg.i_c);
+  input_shape.push_back(cfg.i_n);
+  int_vector locale_shape(cfg.p_s);
+  locale_shape.push_back(cfg.p_c);
+  locale_shape.push_back(cfg.p_n);
+
+  MetricsTable table;
+  for (const auto width: cfg.halo_widths) {
+    IntVector overlap(NSD + 2, 0);
+    for (int i = 0; i < NSD; ++i) {
+      if (locale_shape[i] > 1) overlap[i] = width;
+    }
+    auto dist = tensor::Distribution::make_overlapped_distribution(
+        tensor::Shape(locale_shape), overlap);
+    Tensor t(tensor::Shape(input_shape), tensor::LocaleMPI(comm), dist);
+    assert0(t.allocate());
+    init_tensor_random(t);
+
+    // Constructed in the same order on all ranks as NVSHMEM allocates
+    // its buffers collectively
+    using HaloExchange = typename HaloExchangeTuner<DataType>::HaloExchange;
+    std::vector<std::shared_ptr<HaloExchange>> impls;
+    for (const auto m: methods) {
+      impls.push_back(tuner.make(m, t));
+    }
+    auto comms = tuner.get_comms(t);
+
+    for (int dim = 0; dim < NSD; ++dim) {
+      if (overlap[dim] == 0) continue;
+      const double bytes = get_rank_max(get_send_bytes(t, dim, width), comm);
+      for (const auto &op_name: cfg.halo_accum_ops) {
+        const auto op = get_accum_op(op_name);
+        HaloExchangeMethod best = methods.front();
+        double best_time = std::numeric_limits<double>::max();
+        for (size_t i = 0; i < methods.size(); ++i) {
+          const auto prof = time_exchange(cfg, *impls[i], dim,
+                                          comms(dim, RHS), comms(dim, LHS),
+                                          op, comm);
+          if (prof.time < best_time) {
+            best = methods[i];
+            best_time = prof.time;
+          }
+          std::stringstream method;
+          method << methods[i];
+          Metrics m;
+          m.add("method", method.str());
+          m.add("dim", std::to_string(dim));
+          m.add("width", std::to_string(width));
+          m.add("op", op_name);
+          m.add("bytes", bytes);
+          m.add("time_us", prof.time * 1e3);
+          m.add("pack_us", prof.pack * 1e3);
+          m.add("transfer_us", prof.transfer * 1e3);
+          m.add("unpack_us", prof.unpack * 1e3);
+          if (prof.time > 0) {
+            const double gbps = bytes / (prof.time * 1e-3) / 1e9;
+            m.add("gbps", gbps);
+            if (cfg.peak_bandwidth > 0) {
+              m.add("peak_fraction", gbps / cfg.peak_bandwidth);
+            }
+          }
+          table.add(m);
+        }
+        util::MPIRootPrintStreamInfo()
+            << "Fastest halo exchange of dimension " << dim
+            << " with width " << width << " and " << op_name << ": "
+            << best << " (" << best_time * 1e3 << " us)";
+        // The AUTO method tunes the exchanges without accumulation
+        if (op == tensor::HaloExchangeAccumOp::ID) {
+          tuner.set_selection(t, dim, best);
+        }
+      }
+    }
+  }
+  // Saved only if DISTCONV_ALGO_CACHE_PATH is set
+  be.save_algo_cache();
+
+  if (pid == 0) {
+    table.print(std::cout);
+    std::ofstream ofs(cfg.output_file + "_halo.csv");
+    table.write_csv(ofs);
+  }
+  DISTCONV_CHECK_CUDNN(cudnnDestroy(cudnn_h));
+  return 0;
+}
+
+template <int NSD>
+void run(int argc, char *argv[], int pid, int np) {
+  auto cfg = process_opt<NSD>(argc, argv, pid, true);
+  if (pid == 0) {
+    std::cout << cfg << std::endl;
+  }
+
+  if (cfg.get_num_ranks() != np) {
+    util::MPIRootPrintStreamError()
+        << "Number of ranks does not match with the number of tensor partitions";
+    DISTCONV_CHECK_MPI(MPI_Finalize());
+    std::exit(1);
+  }
+
+#ifdef DISTCONV_HAS_NVSHMEM
+  bool use_nvshmem = false;
+  for (const auto m: get_methods(cfg)) {
+    use_nvshmem |= IsNVSHMEMUsed(m);
+  }
+  if (use_nvshmem) {
+    util::nvshmem::initialize(MPI_COMM_WORLD);
+  }
+#endif // DISTCONV_HAS_NVSHMEM
+
+  if (cfg.data_type == BenchmarkDataType::FLOAT) {
+    run_test<NSD, float>(cfg, MPI_COMM_WORLD);
+  } else if (cfg.data_type == BenchmarkDataType::DOUBLE) {
+    run_test<NSD, double>(cfg, MPI_COMM_WORLD);
+  } else {
+    util::MPIRootPrintStreamError() << "Unsupported data type";
+  }
+
+  util::MPIRootPrintStreamInfo() << "Finishing";
+
+#ifdef DISTCONV_HAS_NVSHMEM
+  if (use_nvshmem) {
+    util::nvshmem::finalize();
+  }
+#endif // DISTCONV_HAS_NVSHMEM
+}
+
+} // namespace distconv_benchmark
+
+int main(int argc, char *argv[]) {
+  distconv_benchmark::set_device();
+  int pid;
+  int np;
+  Al::Initialize(argc, argv);
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(MPI_COMM_WORLD, &pid));
+  DISTCONV_CHECK_MPI(MPI_Comm_size(MPI_COMM_WORLD, &np));
+
+  const int nsd = distconv_benchmark::parse_num_dims(argc, argv);
+
+  if(nsd == 2) {
+    distconv_benchmark::run<2>(argc, argv, pid, np);
+  } else if(nsd == 3) {
+    distconv_benchmark::run<3>(argc, argv, pid, np);
+  } else {
+    util::MPIRootPrintStreamError() << "Invalid --num-dims: " << nsd;
+    DISTCONV_CHECK_MPI(MPI_Finalize());
+    std::exit(1);
+  }
+
+  Al::Finalize();
+  return 0;
+}
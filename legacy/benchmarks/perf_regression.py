@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+
+"""
+Compare the times measured by the benchmarks with a stored baseline.
+
+Each case is a directory of CSV files written by the benchmarks, i.e.,
+the metrics files, to which each repetition appends a row, and the
+tables of halo_exchange_benchmark. Rows are told apart by their label
+columns and KEY_COLUMNS, and every column whose name ends with time_ms
+or time_us is
+a time, of which the median and the median absolute deviation (MAD)
+over the repetitions are computed.
+
+A time regresses when its median is larger than that of the baseline
+by both the relative tolerance and the threshold times the combined
+noise of the two, estimated from the MADs. The exit status is 1 if any
+time regresses, and 2 if there is no baseline to compare with.
+"""
+
+import argparse
+import csv
+import glob
+import json
+import math
+import os
+import socket
+import statistics
+import sys
+
+TIME_SUFFIXES = ("time_ms", "time_us")
+# Labels that do not identify a measurement
+IGNORED_LABELS = ("config",)
+# Numeric columns that do
+KEY_COLUMNS = ("dim", "width")
+# Scale of the MAD to the standard deviation of a normal distribution
+MAD_SCALE = 1.4826
+
+
+def is_number(s):
+    try:
+        float(s)
+        return True
+    except ValueError:
+        return False
+
+
+def read_case(path):
+    """Return a dict from metric names to the samples of the case at path."""
+    case = os.path.basename(os.path.normpath(path))
+    samples = {}
+    for f in sorted(glob.glob(os.path.join(path, "*.csv"))):
+        with open(f) as ifs:
+            for row in csv.DictReader(ifs):
+                labels = ["{}={}".format(k, v) for k, v in row.items()
+                          if k not in IGNORED_LABELS and v is not None
+                          and (k in KEY_COLUMNS or not is_number(v))]
+                for k, v in row.items():
+                    if not k.endswith(TIME_SUFFIXES) or not is_number(v):
+                        continue
+                    # Zero times are of the phases not measured
+                    if float(v) <= 0:
+                        continue
+                    name = "/".join([case] + labels + [k])
+                    samples.setdefault(name, []).append(float(v))
+    return samples
+
+
+def get_stats(samples):
+    median = statistics.median(samples)
+    mad = statistics.median([abs(x - median) for x in samples])
+    return {"median": median, "mad": mad, "n": len(samples)}
+
+
+def compare(base, cur, tolerance, threshold):
+    """Return the status of cur relative to base and the relative change."""
+    diff = cur["median"] - base["median"]
+    change = diff / base["median"] if base["median"] > 0 else 0
+    noise = MAD_SCALE * math.sqrt(base["mad"] ** 2 + cur["mad"] ** 2)
+    if abs(change) <= tolerance or abs(diff) <= threshold * noise:
+        return "ok", change
+    return ("REGRESSION" if diff > 0 else "improved"), change
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compare benchmark times with a stored baseline.")
+    parser.add_argument("cases", nargs="+",
+                        help="Directories of the CSV files of each case")
+    parser.add_argument("--baseline", required=True,
+                        help="Baseline file of this machine")
+    parser.add_argument("--update", action="store_true",
+                        help="Save the times as the baseline instead")
+    parser.add_argument("--tolerance", type=float, default=0.05,
+                        help="Relative slowdown tolerated (default: 0.05)")
+    parser.add_argument("--threshold", type=float, default=3.0,
+                        help="Slowdown tolerated in units of the noise "
+                        "(default: 3)")
+    args = parser.parse_args()
+
+    current = {}
+    for c in args.cases:
+        for name, samples in read_case(c).items():
+            current[name] = get_stats(samples)
+    if not current:
+        print("No times found in {}".format(" ".join(args.cases)))
+        return 2
+
+    if args.update:
+        baseline = {"machine": socket.gethostname(), "metrics": {}}
+        if os.path.exists(args.baseline):
+            with open(args.baseline) as ifs:
+                baseline = json.load(ifs)
+        baseline["metrics"].update(current)
+        os.makedirs(os.path.dirname(os.path.abspath(args.baseline)),
+                    exist_ok=True)
+        with open(args.baseline, "w") as ofs:
+            json.dump(baseline, ofs, indent=2, sort_keys=True)
+        print("Saved {} times to {}".format(len(current), args.baseline))
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print("No baseline found at {}; run with --update to create it"
+              .format(args.baseline))
+        return 2
+    with open(args.baseline) as ifs:
+        baseline = json.load(ifs)["metrics"]
+
+    num_regressions = 0
+    width = max(len(n) for n in current)
+    print("{:<{w}}  {:>12}  {:>12}  {:>8}  {}".format(
+        "time", "baseline", "current", "change", "status", w=width))
+    for name in sorted(current):
+        cur = current[name]
+        if name not in baseline:
+            print("{:<{w}}  {:>12}  {:>12.4g}  {:>8}  new".format(
+                name, "-", cur["median"], "-", w=width))
+            continue
+        status, change = compare(baseline[name], cur,
+                                 args.tolerance, args.threshold)
+        if status == "REGRESSION":
+            num_regressions += 1
+        print("{:<{w}}  {:>12.4g}  {:>12.4g}  {:>+7.1f}%  {}".format(
+            name, baseline[name]["median"], cur["median"], change * 100,
+            status, w=width))
+    for name in sorted(set(baseline) - set(current)):
+        print("{:<{w}}  {:>12.4g}  {:>12}  {:>8}  missing".format(
+            name, baseline[name]["median"], "-", "-", w=width))
+
+    if num_regressions > 0:
+        print("{} regression(s) found".format(num_regressions))
+        return 1
+    print("No regression found")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -13,13 +13,19 @@
 #include "distconv/tensor/shuffle_mpi_cuda_p2p.hpp"
 #include "distconv/tensor/shuffle_mpi_cuda_hybrid.hpp"
 #endif // DISTCONV_HAS_P2P
+#ifdef DISTCONV_HAS_NVSHMEM
+#include "distconv/tensor/shuffle_mpi_cuda_nvshmem.hpp"
+#include "distconv/util/nvshmem.hpp"
+#endif // DISTCONV_HAS_NVSHMEM
 #include "distconv/distconv.hpp"
 #include "distconv/util/cxxopts.hpp"
+#include "distconv/util/instrumentation.hpp"
 #include "distconv/util/stopwatch.h"
 
 #include <Al.hpp>
 
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <typeinfo>
 
@@ -37,6 +43,11 @@ class Profile {
  public:
   std::vector<float> fwd_time;
   std::vector<float> bwd_time;
+  // Median times of the pack and unpack kernels; zero if not measured
+  double fwd_pack_time = 0;
+  double fwd_unpack_time = 0;
+  double bwd_pack_time = 0;
+  double bwd_unpack_time = 0;
   distconv_benchmark::BenchmarkConfig<NSD> m_cfg;
   Profile(const distconv_benchmark::BenchmarkConfig<NSD> &cfg):
       m_cfg(cfg) {}
@@ -73,8 +84,8 @@ class Profile {
 
 template <typename Allocator>
 class Data {
-  using Tensor = tensor::Tensor<DataType, tensor::LocaleMPI, Allocator>;
  public:
+  using Tensor = tensor::Tensor<DataType, tensor::LocaleMPI, Allocator>;
   Tensor sample;
   Tensor spatial;
   Tensor output_sample;
@@ -284,6 +295,13 @@ int test_shuffler(Data<tensor::CUDAAllocator> &d,
           d.sample, d.spatial, *p2p_h, *al_comm);
       break;
 #endif // DISTCONV_HAS_P2P
+#ifdef DISTCONV_HAS_NVSHMEM
+    case ShuffleMethod::NVSHMEM:
+      // The locale must span all PEs
+      shfl = new tensor::TensorMPICUDAShufflerNVSHMEM<DataType>(
+          d.sample, d.spatial);
+      break;
+#endif // DISTCONV_HAS_NVSHMEM
     default:
       util::MPIRootPrintStreamError() << "Unknown shuffle method";
       std::abort();
@@ -299,9 +317,17 @@ int test_shuffler(Data<tensor::CUDAAllocator> &d,
                            d.output_sample.get_base_ptr());
   }
 
+  // The pack and unpack kernels are timed to report their memory
+  // throughput.
+  namespace inst = util::instrumentation;
+  const bool instrumented = inst::is_enabled();
+  inst::set_enabled(true);
+  inst::clear();
+
   util::MPIRootPrintStreamInfo() << "Starting " << cfg.run_count
                                  << " times of measurements";
   util::MPIRootPrintStreamInfo() << "Measuring shuffle_forward";
+  util::memory_accounting::begin_phase("forward");
   std::vector<util::Clock> clks(cfg.run_count, stream);
   for (int i = 0; i < cfg.run_count; ++i) {
       h2::gpu::sync();
@@ -312,11 +338,17 @@ int test_shuffler(Data<tensor::CUDAAllocator> &d,
       clks[i].stop();
   }
   h2::gpu::sync();
+  util::memory_accounting::end_phase();
   for (int i = 0; i < cfg.run_count; ++i) {
     prof.fwd_time.push_back(clks[i].get_time());
   }
+  inst::collect(true);
+  prof.fwd_pack_time = inst::get_stats(inst::Phase::SHUFFLE_PACK).p50;
+  prof.fwd_unpack_time = inst::get_stats(inst::Phase::SHUFFLE_UNPACK).p50;
+  inst::clear();
 
   util::MPIRootPrintStreamInfo() << "Measuring shuffle_backward";
+  util::memory_accounting::begin_phase("backward");
   for (int i = 0; i < cfg.run_count; ++i) {
       h2::gpu::sync();
       DISTCONV_CHECK_MPI(MPI_Barrier(comm));
@@ -326,9 +358,15 @@ int test_shuffler(Data<tensor::CUDAAllocator> &d,
       clks[i].stop();
   }
   h2::gpu::sync();
+  util::memory_accounting::end_phase();
   for (int i = 0; i < cfg.run_count; ++i) {
     prof.bwd_time.push_back(clks[i].get_time());
   }
+  inst::collect(true);
+  prof.bwd_pack_time = inst::get_stats(inst::Phase::SHUFFLE_PACK).p50;
+  prof.bwd_unpack_time = inst::get_stats(inst::Phase::SHUFFLE_UNPACK).p50;
+  inst::clear();
+  inst::set_enabled(instrumented);
 
   delete shfl;
 #ifdef DISTCONV_HAS_P2P
@@ -343,6 +381,92 @@ int test_shuffler(Data<tensor::CUDAAllocator> &d,
   return 0;
 }
 
+// Bytes the local rank sends when shuffling src to dst, i.e., those of
+// its part of src outside of its part of dst
+template <typename Tensor>
+double get_shuffle_bytes(const Tensor &src, const Tensor &dst) {
+  const auto src_begin = src.get_global_index();
+  const auto dst_begin = dst.get_global_index();
+  const auto src_shape = src.get_local_shape();
+  const auto dst_shape = dst.get_local_shape();
+  double kept = 1;
+  for (int i = 0; i < src.get_num_dims(); ++i) {
+    const auto begin = std::max(src_begin[i], dst_begin[i]);
+    const auto end = std::min(src_begin[i] + src_shape[i],
+                              dst_begin[i] + dst_shape[i]);
+    kept *= end > begin ? end - begin : 0;
+  }
+  return ((double)src_shape.get_size() - kept) * sizeof(DataType);
+}
+
+// Prints the achieved bandwidths and saves them if requested
+template <int NSD, typename Allocator>
+Metrics report_metrics(const Data<Allocator> &d, const Profile<NSD> &prof,
+                    const distconv_benchmark::BenchmarkConfig<NSD> &cfg,
+                    MPI_Comm comm) {
+  int pid;
+  int np;
+  MPI_Comm_rank(comm, &pid);
+  MPI_Comm_size(comm, &np);
+  Metrics m;
+  std::stringstream ss;
+  cfg.print_as_row(ss);
+  m.add("config", ss.str());
+  m.add("num_ranks", np);
+  auto add = [&](const std::string &name, const std::vector<float> &times,
+                 double bytes) {
+    // The slowest rank and the rank sending the most
+    double t = times.empty() ? 0 : get_median(times);
+    double max_bytes = bytes;
+    double total_bytes = bytes;
+    DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE,
+                                     MPI_MAX, comm));
+    DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &max_bytes, 1, MPI_DOUBLE,
+                                     MPI_MAX, comm));
+    DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &total_bytes, 1,
+                                     MPI_DOUBLE, MPI_SUM, comm));
+    m.add(name + "_bytes", total_bytes);
+    m.add(name + "_bytes_per_rank_max", max_bytes);
+    if (t <= 0) return;
+    m.add(name + "_time_ms", t);
+    const double gbps = max_bytes / (t * 1e-3) / 1e9;
+    m.add(name + "_gbps", gbps);
+    if (cfg.peak_bandwidth > 0) {
+      m.add(name + "_peak_fraction", gbps / cfg.peak_bandwidth);
+    }
+  };
+  add("fwd", prof.fwd_time, get_shuffle_bytes(d.sample, d.spatial));
+  add("bwd", prof.bwd_time, get_shuffle_bytes(d.spatial, d.output_sample));
+  // Memory throughput of the slowest rank in packing or unpacking,
+  // which reads and writes each element of its local tensor once
+  auto add_kernel = [&](const std::string &name, double t,
+                        const typename Data<Allocator>::Tensor &tensor) {
+    double gbps = t > 0 ?
+        2.0 * tensor.get_local_size() * sizeof(DataType) / (t * 1e-3) / 1e9 :
+        0;
+    DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE,
+                                     MPI_MAX, comm));
+    if (t <= 0) return;
+    if (gbps <= 0) gbps = std::numeric_limits<double>::max();
+    DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &gbps, 1, MPI_DOUBLE,
+                                     MPI_MIN, comm));
+    m.add(name + "_time_ms", t);
+    m.add(name + "_gbps", gbps);
+  };
+  add_kernel("fwd_pack", prof.fwd_pack_time, d.sample);
+  add_kernel("fwd_unpack", prof.fwd_unpack_time, d.spatial);
+  add_kernel("bwd_pack", prof.bwd_pack_time, d.spatial);
+  add_kernel("bwd_unpack", prof.bwd_unpack_time, d.output_sample);
+  if (pid == 0) {
+    std::cout << "Metrics: ";
+    m.write_json(std::cout) << std::endl;
+    if (!cfg.metrics_file.empty()) {
+      m.save(cfg.metrics_file);
+    }
+  }
+  return m;
+}
+
 template <int NSD>
 void dump_prof(const Profile<NSD> &prof, int pid,
                const distconv_benchmark::BenchmarkConfig<NSD> &cfg) {
@@ -354,14 +478,18 @@ void dump_prof(const Profile<NSD> &prof, int pid,
 }
 
 template <int NSD, typename Allocator>
-int run_test(const distconv_benchmark::BenchmarkConfig<NSD> &cfg, MPI_Comm comm) {
+int run_test(const distconv_benchmark::BenchmarkConfig<NSD> &cfg, MPI_Comm comm,
+             Metrics *metrics=nullptr) {
   int pid;
   int np;
   DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &pid));
   DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &np));
 
+  distconv_benchmark::start_memory_accounting(cfg);
+  util::memory_accounting::begin_phase("allocation");
   Data<Allocator> d;
   setup<NSD, Allocator>(cfg, comm, d);
+  util::memory_accounting::end_phase();
 
   if (cfg.dump_input) {
     util::MPIPrintStreamDebug() << "Dumping input tensors";
@@ -373,6 +501,11 @@ int run_test(const distconv_benchmark::BenchmarkConfig<NSD> &cfg, MPI_Comm comm)
   d.output_sample.zero();
   test_shuffler<NSD>(d, cfg, comm, prof);
   dump_prof(prof, pid, cfg);
+  distconv_benchmark::print_memory_usage(comm, std::cout);
+  const auto m = report_metrics(d, prof, cfg, comm);
+  if (metrics) {
+    *metrics = m;
+  }
 
   if (cfg.dump_output) {
     dump_tensor(d.spatial, "output_spatial_tensor", true);
@@ -388,18 +521,18 @@ void run(int argc, char *argv[], int pid, int np) {
     std::cout << cfg << std::endl;
   }
 
-  if (std::accumulate(cfg.p_s.begin(),
-                      cfg.p_s.end(),
-                      1,
-                      std::multiplies<int>())
-      * cfg.p_c * cfg.p_n != np) {
+  if (!cfg.is_sweep() && cfg.get_num_ranks() != np) {
     util::MPIRootPrintStreamError()
         << "Number of ranks does not match with the number of tensor partitions";
     DISTCONV_CHECK_MPI(MPI_Finalize());
     std::exit(1);
   }
 
-  if (cfg.p_c != 1) {
+  bool partitions_channels = false;
+  for (const auto &c: cfg.get_sweep()) {
+    partitions_channels |= c.p_c != 1;
+  }
+  if (partitions_channels) {
     util::MPIRootPrintStreamError()
         << "Partitioning channel dimension not supported";
     DISTCONV_CHECK_MPI(MPI_Finalize());
@@ -409,10 +542,27 @@ void run(int argc, char *argv[], int pid, int np) {
   if (cfg.host) {
     // Only MPI is supported for host tensors
     cfg.shuffle_method = ShuffleMethod::MPI;
-    run_test<NSD, tensor::BaseAllocator>(cfg, MPI_COMM_WORLD);
+  }
+  auto run_point = [](const BenchmarkConfig<NSD> &c, MPI_Comm comm,
+                      Metrics *m) {
+    return c.host ? run_test<NSD, tensor::BaseAllocator>(c, comm, m) :
+        run_test<NSD, tensor::CUDAAllocator>(c, comm, m);
+  };
+#ifdef DISTCONV_HAS_NVSHMEM
+  if (cfg.shuffle_method == ShuffleMethod::NVSHMEM) {
+    util::nvshmem::initialize(MPI_COMM_WORLD);
+  }
+#endif // DISTCONV_HAS_NVSHMEM
+  if (cfg.is_sweep()) {
+    run_sweep(cfg, MPI_COMM_WORLD, run_point);
   } else {
-    run_test<NSD, tensor::CUDAAllocator>(cfg, MPI_COMM_WORLD);
+    run_point(cfg, MPI_COMM_WORLD, nullptr);
+  }
+#ifdef DISTCONV_HAS_NVSHMEM
+  if (cfg.shuffle_method == ShuffleMethod::NVSHMEM) {
+    util::nvshmem::finalize();
   }
+#endif // DISTCONV_HAS_NVSHMEM
 
   util::MPIRootPrintStreamInfo() << "Completed";
 }
@@ -0,0 +1,94 @@
+#include "distconv/util/cxxopts.hpp"
+#include "distconv/util/topology.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include "h2/gpu/runtime.hpp"
+
+#include <Al.hpp>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+/*
+  Profiles the links among all the processes of the job, or loads them
+  from the cache of the allocation, and prints the bandwidth and
+  latency of each measured pair. Run at job start to populate the
+  cache that later runs load.
+ */
+
+using namespace distconv;
+
+int main(int argc, char *argv[]) {
+  h2::gpu::set_gpu(util::choose_gpu());
+  Al::Initialize(argc, argv);
+  int pid;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(MPI_COMM_WORLD, &pid));
+
+  cxxopts::Options cmd_opts(argv[0], "Topology Profiler");
+  cmd_opts.add_options()
+      ("b,budget", "Time budget in seconds", cxxopts::value<double>()->default_value("10"))
+      ("large-bytes", "Message size of the bandwidth measurements", cxxopts::value<size_t>()->default_value("16777216"))
+      ("num-trials", "Number of measurements per link", cxxopts::value<int>()->default_value("5"))
+      ("c,cache", "Cache file; defaults to DISTCONV_TOPOLOGY_CACHE or one per job", cxxopts::value<std::string>())
+      ("force", "Profile even if the cache matches")
+      ("o,output-file", "Save the links to <file>_topology.csv", cxxopts::value<std::string>()->default_value("results"))
+      ("help", "Print help")
+      ;
+  auto result = cmd_opts.parse(argc, argv);
+  if (result.count("help")) {
+    if (pid == 0) {
+      std::cout << cmd_opts.help() << "\n";
+    }
+    Al::Finalize();
+    return 0;
+  }
+
+  util::TopologyMap::Options opts;
+  opts.budget = result["budget"].as<double>();
+  opts.large_bytes = result["large-bytes"].as<size_t>();
+  opts.num_trials = result["num-trials"].as<int>();
+  const std::string path = result.count("cache")
+      ? result["cache"].as<std::string>()
+      : util::TopologyMap::get_default_cache_path();
+
+  util::TopologyMap map;
+  if (result.count("force")) {
+    map = util::TopologyMap::profile(MPI_COMM_WORLD, opts);
+    if (pid == 0) {
+      std::ofstream ofs(path);
+      map.save(ofs);
+    }
+  } else {
+    map = util::TopologyMap::load_or_profile(MPI_COMM_WORLD, path, opts);
+  }
+
+  if (pid == 0) {
+    const auto file = result["output-file"].as<std::string>()
+        + "_topology.csv";
+    std::ofstream ofs(file);
+    ofs << "src,dst,intra_node,measured,latency_us,bandwidth_GBps\n";
+    std::cout << "Measured links (" << map.get_num_measured_shifts()
+              << " shifts), all saved to " << file << "\n";
+    for (int src = 0; src < map.get_size(); ++src) {
+      for (int dst = 0; dst < map.get_size(); ++dst) {
+        if (src == dst) continue;
+        const auto &link = map.get_link(src, dst);
+        ofs << src << "," << dst << "," << map.is_intra_node(src, dst)
+            << "," << link.measured << "," << link.latency * 1e6 << ","
+            << link.bandwidth / 1e9 << "\n";
+        if (!link.measured) continue;
+        std::cout << std::setw(5) << src << " -> " << std::setw(5) << dst
+                  << (map.is_intra_node(src, dst) ? " intra" : " inter")
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(10) << link.latency * 1e6 << " us"
+                  << std::setw(10) << link.bandwidth / 1e9 << " GB/s\n";
+      }
+    }
+  }
+
+  Al::Finalize();
+  return 0;
+}
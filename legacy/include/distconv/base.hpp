@@ -1,12 +1,14 @@
 #pragma once
 
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <array>
 
 #include "distconv_config.hpp"
 #include "distconv/util/util.hpp"
 #include "distconv/util/util_mpi.hpp"
+#include "h2/meta/EnumRegistry.hpp"
 
 #ifdef __CUDACC__
 #define HOST_DEV_FUNC __host__ __device__
@@ -173,68 +175,89 @@ class BoundaryAttributesV {
   }
 };
 
+// Prints the name of v, a value of an enum listed in registry, and
+// aborts if it is not listed.
+template <typename Registry>
+inline std::ostream &print_enum(std::ostream &os, const Registry &registry,
+                                typename Registry::enum_type v,
+                                const char *what) {
+  const char *name = registry.name(v);
+  if (name == nullptr) {
+    util::PrintStreamError() << "Unknown " << what;
+    std::abort();
+  }
+  return os << name;
+}
+
+// Parses the name of a value listed in registry, and aborts with the
+// valid names if it is not listed.
+template <typename Registry>
+inline typename Registry::enum_type parse_enum(const Registry &registry,
+                                               const std::string &name,
+                                               const char *what) {
+  if (const auto *v = registry.find(name)) {
+    return *v;
+  }
+  util::PrintStreamError() << "Unknown " << what << ": " << name
+                           << " (expected one of " << registry.names() << ")";
+  std::abort();
+}
+
+// The values are fixed as methods selected by AUTO are stored in the
+// algorithm cache.
 enum class HaloExchangeMethod {
-  MPI, AL,
+  MPI = 0, AL = 1,
 #ifdef DISTCONV_HAS_P2P
-  P2P, HYBRID,
+  P2P = 2, HYBRID = 3,
 #endif // DISTCONV_HAS_P2P
 #ifdef DISTCONV_HAS_NVSHMEM
-  NVSHMEM, NVSHMEM_GRAPH, NVSHMEM_DIRECT, NVSHMEM_FUSED_NOTIFY
+  NVSHMEM = 4, NVSHMEM_GRAPH = 5, NVSHMEM_DIRECT = 6,
+  NVSHMEM_FUSED_NOTIFY = 7,
 #endif // DISTCONV_HAS_NVSHMEM
+  // Exchanges all dimensions, including edges and corners, at once
+  AL_BATCHED = 8,
+  // Selects the fastest of the above for each dimension at setup
+  AUTO = 9,
+#ifdef DISTCONV_HAS_P2P
+  // P2P with fused pack, put and notify kernels when possible
+  P2P_FUSED_NOTIFY = 10,
+#endif // DISTCONV_HAS_P2P
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+  // AL replayed as a single CUDA graph over all dimensions
+  AL_GRAPH = 11,
+#endif // DISTCONV_HAS_CUDA_GRAPH
 };
 
-inline std::ostream& operator<<(std::ostream &os, const HaloExchangeMethod &m) {
-  if (m == HaloExchangeMethod::MPI) {
-    return os << "MPI";
-  } else if (m == HaloExchangeMethod::AL) {
-    return os << "AL";
+inline constexpr auto halo_exchange_method_registry =
+    h2::meta::make_enum_registry<HaloExchangeMethod>({
+        {HaloExchangeMethod::MPI, "MPI"},
+        {HaloExchangeMethod::AL, "AL"},
 #ifdef DISTCONV_HAS_P2P
-  } else if (m == HaloExchangeMethod::P2P) {
-    return os << "P2P";
-  } else if (m == HaloExchangeMethod::HYBRID) {
-    return os << "HYBRID";
+        {HaloExchangeMethod::P2P, "P2P"},
+        {HaloExchangeMethod::HYBRID, "HYBRID"},
+        {HaloExchangeMethod::P2P_FUSED_NOTIFY, "P2P_FUSED_NOTIFY"},
 #endif // DISTCONV_HAS_P2P
 #ifdef DISTCONV_HAS_NVSHMEM
-  } else if (m == HaloExchangeMethod::NVSHMEM) {
-    return os << "NVSHMEM";
-  } else if (m == HaloExchangeMethod::NVSHMEM_GRAPH) {
-    return os << "NVSHMEM_GRAPH";
-  } else if (m == HaloExchangeMethod::NVSHMEM_DIRECT) {
-    return os << "NVSHMEM_DIRECT";
-  } else if (m == HaloExchangeMethod::NVSHMEM_FUSED_NOTIFY) {
-    return os << "NVSHMEM_FUSED_NOTIFY";
+        {HaloExchangeMethod::NVSHMEM, "NVSHMEM"},
+        {HaloExchangeMethod::NVSHMEM_GRAPH, "NVSHMEM_GRAPH"},
+        {HaloExchangeMethod::NVSHMEM_DIRECT, "NVSHMEM_DIRECT"},
+        {HaloExchangeMethod::NVSHMEM_FUSED_NOTIFY, "NVSHMEM_FUSED_NOTIFY"},
 #endif // DISTCONV_HAS_NVSHMEM
-  } else {
-    util::PrintStreamError() << "Unknown halo exchange method";
-    std::abort();
-  }
+        {HaloExchangeMethod::AL_BATCHED, "AL_BATCHED"},
+        {HaloExchangeMethod::AUTO, "AUTO"},
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        {HaloExchangeMethod::AL_GRAPH, "AL_GRAPH"},
+#endif // DISTCONV_HAS_CUDA_GRAPH
+      });
+
+inline std::ostream& operator<<(std::ostream &os, const HaloExchangeMethod &m) {
+  return print_enum(os, halo_exchange_method_registry, m,
+                    "halo exchange method");
 }
 
 inline HaloExchangeMethod GetHaloExchangeMethod(const std::string &method) {
-  if (method == "MPI") {
-    return HaloExchangeMethod::MPI;
-  } else if (method == "AL") {
-    return HaloExchangeMethod::AL;
-#ifdef DISTCONV_HAS_P2P
-  } else if (method == "P2P") {
-    return HaloExchangeMethod::P2P;
-  } else if (method == "HYBRID") {
-    return HaloExchangeMethod::HYBRID;
-#endif // DISTCONV_HAS_P2P
-#ifdef DISTCONV_HAS_NVSHMEM
-  } else if (method == "NVSHMEM") {
-    return HaloExchangeMethod::NVSHMEM;
-  } else if (method == "NVSHMEM_GRAPH") {
-    return HaloExchangeMethod::NVSHMEM_GRAPH;
-  } else if (method == "NVSHMEM_DIRECT") {
-    return HaloExchangeMethod::NVSHMEM_DIRECT;
-  } else if (method == "NVSHMEM_FUSED_NOTIFY") {
-    return HaloExchangeMethod::NVSHMEM_FUSED_NOTIFY;
-#endif // DISTCONV_HAS_NVSHMEM
-  } else {
-    util::PrintStreamError() << "Unknown method name for halo exchange: " << method;
-    std::abort();
-  }
+  return parse_enum(halo_exchange_method_registry, method,
+                    "method name for halo exchange");
 }
 
 inline bool IsNVSHMEMUsed(HaloExchangeMethod m) {
@@ -244,6 +267,8 @@ inline bool IsNVSHMEMUsed(HaloExchangeMethod m) {
     case HaloExchangeMethod::NVSHMEM_GRAPH:
     case HaloExchangeMethod::NVSHMEM_DIRECT:
     case HaloExchangeMethod::NVSHMEM_FUSED_NOTIFY:
+    // NVSHMEM methods are among the candidates
+    case HaloExchangeMethod::AUTO:
       return true;
     default:
       return false;
@@ -256,65 +281,98 @@ inline bool IsNVSHMEMUsed(HaloExchangeMethod m) {
 enum class ShuffleMethod {
   MPI, AL,
 #ifdef DISTCONV_HAS_P2P
-  P2P, HYBRID
+  P2P, HYBRID,
 #endif // DISTCONV_HAS_P2P
+#ifdef DISTCONV_HAS_NVSHMEM
+  NVSHMEM,
+#endif // DISTCONV_HAS_NVSHMEM
 };
 
-inline std::ostream& operator<<(std::ostream &os, const ShuffleMethod &m) {
-  if (m == ShuffleMethod::MPI) {
-    return os << "MPI";
-  } else if (m == ShuffleMethod::AL) {
-    return os << "AL";
+inline constexpr auto shuffle_method_registry =
+    h2::meta::make_enum_registry<ShuffleMethod>({
+        {ShuffleMethod::MPI, "MPI"},
+        {ShuffleMethod::AL, "AL"},
 #ifdef DISTCONV_HAS_P2P
-  } else if (m == ShuffleMethod::P2P) {
-    return os << "P2P";
-  } else if (m == ShuffleMethod::HYBRID) {
-    return os << "HYBRID";
+        {ShuffleMethod::P2P, "P2P"},
+        {ShuffleMethod::HYBRID, "HYBRID"},
 #endif // DISTCONV_HAS_P2P
-  } else {
-    util::PrintStreamError() << "Unknown shuffle method";
-    std::abort();
-  }
+#ifdef DISTCONV_HAS_NVSHMEM
+        {ShuffleMethod::NVSHMEM, "NVSHMEM"},
+#endif // DISTCONV_HAS_NVSHMEM
+      });
+
+inline std::ostream& operator<<(std::ostream &os, const ShuffleMethod &m) {
+  return print_enum(os, shuffle_method_registry, m, "shuffle method");
 }
 
 inline ShuffleMethod GetShuffleMethod(const std::string &method) {
-  if (method == "MPI") {
-    return ShuffleMethod::MPI;
-  } else if (method == "AL") {
-    return ShuffleMethod::AL;
-#ifdef DISTCONV_HAS_P2P
-  } else if (method == "P2P") {
-    return ShuffleMethod::P2P;
-  } else if (method == "HYBRID") {
-    return ShuffleMethod::HYBRID;
-#endif // DISTCONV_HAS_P2P
-  } else {
-    util::PrintStreamError() << "Unknown shuffle method: " << method;
-    std::abort();
+  return parse_enum(shuffle_method_registry, method, "shuffle method");
+}
+
+// Element type of packed halo and shuffle payloads. FP16 and BF16
+// halve the bytes of FP32 payloads, and quarter those of FP64, by
+// rounding the values when packed; unpacking converts them back and
+// accumulates in the tensor type.
+enum class CommPrecision {FULL, FP16, BF16, FP8};
+
+inline constexpr auto comm_precision_registry =
+    h2::meta::make_enum_registry<CommPrecision>({
+        {CommPrecision::FULL, "FULL"},
+        {CommPrecision::FP16, "FP16"},
+        {CommPrecision::BF16, "BF16"},
+        {CommPrecision::FP8, "FP8"},
+      });
+
+inline std::ostream& operator<<(std::ostream &os, const CommPrecision &p) {
+  return print_enum(os, comm_precision_registry, p,
+                    "communication precision");
+}
+
+inline CommPrecision GetCommPrecision(const std::string &precision) {
+  return parse_enum(comm_precision_registry, precision,
+                    "communication precision");
+}
+
+// Bytes of an element of DataType packed with precision p
+template <typename DataType>
+inline size_t get_comm_element_size(CommPrecision p) {
+  switch (p) {
+    case CommPrecision::FULL: return sizeof(DataType);
+    case CommPrecision::FP8: return 1;
+    default: return 2;
   }
 }
 
+// Reduced precisions apply to floating-point tensors only
+template <typename DataType>
+inline bool is_comm_precision_supported(CommPrecision p) {
+  return p == CommPrecision::FULL || std::is_floating_point<DataType>::value;
+}
+
 enum class ChannelParallelismAlgorithm {NONE, AUTO, X, Y, W};
 
+inline constexpr auto channel_parallelism_algorithm_registry =
+    h2::meta::make_enum_registry<ChannelParallelismAlgorithm>({
+        {ChannelParallelismAlgorithm::NONE, "NONE"},
+        {ChannelParallelismAlgorithm::AUTO, "AUTO"},
+        {ChannelParallelismAlgorithm::X, "X"},
+        {ChannelParallelismAlgorithm::Y, "Y"},
+        {ChannelParallelismAlgorithm::W, "W"},
+      });
+
 inline std::ostream& operator<<(std::ostream& os, const ChannelParallelismAlgorithm &a) {
-  if (a == ChannelParallelismAlgorithm::NONE) {
-    return os << "NONE";
-  } else if (a == ChannelParallelismAlgorithm::AUTO) {
-    return os << "AUTO";
-  } else if (a == ChannelParallelismAlgorithm::X) {
-    return os << "X";
-  } else if (a == ChannelParallelismAlgorithm::Y) {
-    return os << "Y";
-  } else if (a == ChannelParallelismAlgorithm::W) {
-    return os << "W";
-  } else {
-    util::PrintStreamError() << "Unknown channel parallelism algorithm";
-    std::abort();
-  }
+  return print_enum(os, channel_parallelism_algorithm_registry, a,
+                    "channel parallelism algorithm");
+}
+
+inline ChannelParallelismAlgorithm GetChannelParallelismAlgorithm(
+    const std::string &algo) {
+  return parse_enum(channel_parallelism_algorithm_registry, algo,
+                    "channel parallelism algorithm");
 }
 
 enum class BatchnormImpl {
-  MPI, AL_NCCL,
+  MPI, AL_NCCL, AL_NCCL_HIERARCHICAL, AL_AUTO,
 #ifdef DISTCONV_HAS_NVSHMEM
   NVSHMEM_NATIVE,
   NVSHMEM_RECURSIVE_DOUBLING_HOST,
@@ -322,57 +380,40 @@ enum class BatchnormImpl {
   NVSHMEM_RECURSIVE_DOUBLING_BUFFERED,
   NVSHMEM_RECURSIVE_DOUBLING_BLOCK,
   FUSED_NVSHMEM_RECURSIVE_DOUBLING,
+  NVSHMEM_AUTO,
 #endif // DISTCONV_HAS_NVSHMEM
 };
 
-inline std::ostream& operator<<(std::ostream &os, const BatchnormImpl &v) {
-  if (v == BatchnormImpl::MPI) {
-    return os << "MPI";
-  } else if (v == BatchnormImpl::AL_NCCL) {
-    return os << "AL_NCCL";
+inline constexpr auto batchnorm_impl_registry =
+    h2::meta::make_enum_registry<BatchnormImpl>({
+        {BatchnormImpl::MPI, "MPI"},
+        {BatchnormImpl::AL_NCCL, "AL_NCCL"},
+        {BatchnormImpl::AL_NCCL_HIERARCHICAL, "AL_NCCL_HIERARCHICAL"},
+        {BatchnormImpl::AL_AUTO, "AL_AUTO"},
 #ifdef DISTCONV_HAS_NVSHMEM
-  } else if (v == BatchnormImpl::NVSHMEM_NATIVE) {
-    return os << "NVSHMEM_RECURSIVE_NATIVE";
-  } else if (v == BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING_HOST) {
-    return os << "NVSHMEM_RECURSIVE_DOUBLING_HOST";
-  } else if (v == BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING) {
-    return os << "NVSHMEM_RECURSIVE_DOUBLING";
-  } else if (v == BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING_BUFFERED) {
-    return os << "NVSHMEM_RECURSIVE_DOUBLING_BUFFERED";
-  } else if (v == BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING_BLOCK) {
-    return os << "NVSHMEM_RECURSIVE_DOUBLING_BLOCK";
-  } else if (v == BatchnormImpl::FUSED_NVSHMEM_RECURSIVE_DOUBLING) {
-    return os << "FUSED_NVSHMEM_RECURSIVE_DOUBLING";
+        {BatchnormImpl::NVSHMEM_NATIVE, "NVSHMEM_NATIVE"},
+        {BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING_HOST,
+         "NVSHMEM_RECURSIVE_DOUBLING_HOST"},
+        {BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING,
+         "NVSHMEM_RECURSIVE_DOUBLING"},
+        {BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING_BUFFERED,
+         "NVSHMEM_RECURSIVE_DOUBLING_BUFFERED"},
+        {BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING_BLOCK,
+         "NVSHMEM_RECURSIVE_DOUBLING_BLOCK"},
+        {BatchnormImpl::FUSED_NVSHMEM_RECURSIVE_DOUBLING,
+         "FUSED_NVSHMEM_RECURSIVE_DOUBLING"},
+        {BatchnormImpl::NVSHMEM_AUTO, "NVSHMEM_AUTO"},
 #endif // DISTCONV_HAS_NVSHMEM
-  } else {
-    util::PrintStreamError() << "Unknown batchnorm implementation";
-    std::abort();
-  }
+      });
+
+inline std::ostream& operator<<(std::ostream &os, const BatchnormImpl &v) {
+  return print_enum(os, batchnorm_impl_registry, v,
+                    "batchnorm implementation");
 }
 
 inline BatchnormImpl GetBatchnormImpl(const std::string &impl) {
-  if (impl == "MPI") {
-    return BatchnormImpl::MPI;
-  } else if (impl == "AL_NCCL") {
-    return BatchnormImpl::AL_NCCL;
-#ifdef DISTCONV_HAS_NVSHMEM
-  } else if (impl == "NVSHMEM_NATIVE") {
-    return BatchnormImpl::NVSHMEM_NATIVE;
-  } else if (impl == "NVSHMEM_RECURSIVE_DOUBLING_HOST") {
-    return BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING_HOST;
-  } else if (impl == "NVSHMEM_RECURSIVE_DOUBLING") {
-    return BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING;
-  } else if (impl == "NVSHMEM_RECURSIVE_DOUBLING_BUFFERED") {
-    return BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING_BUFFERED;
-  } else if (impl == "NVSHMEM_RECURSIVE_DOUBLING_BLOCK") {
-    return BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING_BLOCK;
-  } else if (impl == "FUSED_NVSHMEM_RECURSIVE_DOUBLING") {
-    return BatchnormImpl::FUSED_NVSHMEM_RECURSIVE_DOUBLING;
-#endif // DISTCONV_HAS_NVSHMEM
-  } else {
-    util::PrintStreamError() << "Unknown implementation name for batchnorm: " << impl;
-    std::abort();
-  }
+  return parse_enum(batchnorm_impl_registry, impl,
+                    "implementation name for batchnorm");
 }
 
 inline bool IsNVSHMEMUsed(BatchnormImpl m) {
@@ -384,6 +425,7 @@ inline bool IsNVSHMEMUsed(BatchnormImpl m) {
     case BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING_BUFFERED:
     case BatchnormImpl::NVSHMEM_RECURSIVE_DOUBLING_BLOCK:
     case BatchnormImpl::FUSED_NVSHMEM_RECURSIVE_DOUBLING:
+    case BatchnormImpl::NVSHMEM_AUTO:
       return true;
     default:
       return false;
@@ -0,0 +1,295 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/layers.hpp"
+#include "distconv/tensor/halo_exchange_host.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace distconv {
+namespace cpu {
+
+/*
+  Backend running the layers on host tensors, i.e., tensors with
+  BaseAllocator, with OpenMP threads. Unlike the reference backend,
+  halos are exchanged with the neighbors over MPI, so spatially
+  partitioned tensors are supported. Tensors are redistributed between
+  layers with TensorMPIShuffler<DataType, BaseAllocator>.
+
+  Only the CHANNELS_FIRST layout is supported, and channels must not
+  be partitioned.
+ */
+class Backend {
+ public:
+  Backend(MPI_Comm comm=MPI_COMM_WORLD): m_comm(comm) {}
+
+  std::string get_name() const {
+    return std::string("CPU");
+  }
+
+  MPI_Comm get_comm() {
+    return m_comm;
+  }
+
+  int get_num_threads() const {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+  }
+
+  // Kernels are synchronous
+  void wait() {}
+
+ protected:
+  MPI_Comm m_comm;
+};
+
+namespace internal {
+
+// The kernels handle 4D tensors as 5D ones with a depth of one. The
+// spatial dimensions are indexed W, H, D.
+constexpr int num_spatial_dims = 3;
+
+// Elements of a tile of output rows accumulated in a thread-local
+// buffer, which keeps it in the L1/L2 cache while the input channels
+// and filter taps are swept.
+constexpr index_t tile_size = 4096;
+
+inline int64_t floor_div(int64_t a, int64_t b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Extent of a local tensor along a spatial dimension
+struct Extent {
+  int64_t len = 1;
+  int64_t real_len = 1;
+  int64_t halo = 0;
+  int64_t global_offset = 0;
+  int64_t global_len = 1;
+  // Elements between consecutive indices of the real tensor
+  int64_t stride = 0;
+};
+
+// Sliding window along a spatial dimension
+struct Window {
+  int size = 1;
+  int stride = 1;
+  int pad = 0;
+  int dilation = 1;
+};
+
+/*
+  Local shape of a host tensor as seen by the kernels: the extents of
+  the W, H and D dimensions and the strides of the channel and sample
+  dimensions.
+ */
+struct Geometry {
+  Extent spatial[num_spatial_dims];
+  int64_t num_channels = 0;
+  int64_t num_samples = 0;
+  int64_t channel_stride = 0;
+  int64_t sample_stride = 0;
+
+  int64_t get_plane_size() const {
+    return spatial[0].len * spatial[1].len * spatial[2].len;
+  }
+
+  int64_t get_num_rows() const {
+    return spatial[1].len * spatial[2].len;
+  }
+
+  // Offset of the real index of local row r, i.e., the first
+  // element of a W row indexed by D and H
+  int64_t get_row_offset(int64_t r) const {
+    const int64_t d = r / spatial[1].len;
+    const int64_t h = r % spatial[1].len;
+    return (d + spatial[2].halo) * spatial[2].stride
+        + (h + spatial[1].halo) * spatial[1].stride
+        + spatial[0].halo;
+  }
+};
+
+template <typename Tensor>
+Geometry get_geometry(const Tensor &t) {
+  assert_always(t.get_layout() == tensor::Layout::CHANNELS_FIRST);
+  const int nd = t.get_num_dims();
+  const int nsd = nd - 2;
+  assert_always(nsd == 2 || nsd == 3);
+  // Halo exchanges assume rows are not padded
+  assert_eq(t.get_pitch(), t.get_local_real_shape()[0]);
+  // The channel and sample dimensions must not have halos
+  assert0(t.get_halo_width(nd - 2));
+  assert0(t.get_halo_width(nd - 1));
+  const auto real_shape = t.get_local_real_shape();
+  const auto local_shape = t.get_local_shape();
+  Geometry g;
+  int64_t stride = 1;
+  for (int i = 0; i < nsd; ++i) {
+    auto &e = g.spatial[i];
+    e.len = local_shape[i];
+    e.real_len = real_shape[i];
+    e.halo = t.get_halo_width(i);
+    e.global_offset = t.get_global_index(i, 0);
+    e.global_len = t.get_shape()[i];
+    e.stride = stride;
+    stride *= real_shape[i];
+  }
+  for (int i = nsd; i < num_spatial_dims; ++i) {
+    g.spatial[i].stride = stride;
+  }
+  g.num_channels = local_shape[-2];
+  g.num_samples = local_shape[-1];
+  g.channel_stride = stride;
+  g.sample_stride = stride * real_shape[-2];
+  return g;
+}
+
+// Extends the spatial extents of g by widths into their halos, within
+// the global tensor, so that the kernels compute the halos along with
+// the interior
+inline void extend_into_halo(Geometry &g, const int_vector &widths) {
+  for (size_t i = 0; i < widths.size(); ++i) {
+    auto &e = g.spatial[i];
+    if (widths[i] == 0 || e.len == 0) continue;
+    const int64_t begin = std::max<int64_t>(0, e.global_offset - widths[i]);
+    const int64_t end = std::min(e.global_len,
+                                 e.global_offset + e.len + widths[i]);
+    // Dimensions that are not split have no halos to extend into, nor
+    // anything beyond the global tensor
+    assert_always(e.global_offset - begin <= e.halo);
+    assert_always(end - e.global_offset - e.len <= e.halo);
+    e.halo -= e.global_offset - begin;
+    e.global_offset = begin;
+    e.len = end - begin;
+  }
+}
+
+/*
+  Local outputs [begin, begin + count) of a window tap f whose input is
+  inside the global tensor, i.e., is not padding, and the real index
+  of the input of the first of them. The input index advances by the
+  window stride per output.
+ */
+struct ForwardTap {
+  int64_t begin = 0;
+  int64_t count = 0;
+  int64_t x_begin = 0;
+};
+
+inline ForwardTap get_forward_tap(const Extent &x, const Extent &y,
+                                  const Window &w, int f) {
+  const int64_t s = w.stride;
+  // Global input index of local output 0
+  const int64_t g0 = y.global_offset * s - w.pad + f * w.dilation;
+  const int64_t begin = g0 >= 0 ? 0 : -floor_div(g0, s);
+  const int64_t end = std::min(y.len, floor_div(x.global_len - 1 - g0, s) + 1);
+  ForwardTap tap;
+  if (begin >= end) return tap;
+  tap.begin = begin;
+  tap.count = end - begin;
+  tap.x_begin = g0 + begin * s - x.global_offset + x.halo;
+  // The inputs must be local or in the halo
+  assert_always(tap.x_begin >= 0);
+  assert_always(tap.x_begin + (tap.count - 1) * s < x.real_len);
+  return tap;
+}
+
+/*
+  Local inputs whose gradient takes the output of a window tap f,
+  from begin with a step of the window stride, and the real index of
+  the output of the first of them. The output index advances by one
+  per input.
+ */
+struct BackwardTap {
+  int64_t begin = 0;
+  int64_t count = 0;
+  int64_t y_begin = 0;
+};
+
+inline BackwardTap get_backward_tap(const Extent &x, const Extent &y,
+                                    const Window &w, int f) {
+  const int64_t s = w.stride;
+  // Global output index of local input 0 times the stride
+  const int64_t t0 = x.global_offset + w.pad - f * w.dilation;
+  int64_t begin = std::max<int64_t>(0, -t0);
+  const int64_t r = (t0 + begin) % s;
+  if (r != 0) begin += s - r;
+  const int64_t end = std::min(x.len, y.global_len * s - t0);
+  BackwardTap tap;
+  if (begin >= end) return tap;
+  tap.begin = begin;
+  tap.count = (end - begin + s - 1) / s;
+  tap.y_begin = (t0 + begin) / s - y.global_offset + y.halo;
+  // The outputs must be local or in the halo
+  assert_always(tap.y_begin >= 0);
+  assert_always(tap.y_begin + tap.count - 1 < y.real_len);
+  return tap;
+}
+
+// Windows of the spatial dimensions, with unit windows for the
+// missing ones
+inline void get_windows(const int_vector &sizes, const int_vector &strides,
+                        const int_vector &pads, const int_vector &dilations,
+                        Window (&windows)[num_spatial_dims]) {
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    windows[i].size = sizes[i];
+    windows[i].stride = strides[i];
+    windows[i].pad = pads[i];
+    windows[i].dilation = dilations[i];
+  }
+  for (int i = sizes.size(); i < num_spatial_dims; ++i) {
+    windows[i] = Window();
+  }
+}
+
+// Taps of each spatial dimension, indexed by the tap offset
+template <typename Tap, typename F>
+void get_taps(const Window (&windows)[num_spatial_dims],
+              std::vector<Tap> (&taps)[num_spatial_dims], F &&get_tap) {
+  for (int i = 0; i < num_spatial_dims; ++i) {
+    taps[i].resize(windows[i].size);
+    for (int f = 0; f < windows[i].size; ++f) {
+      taps[i][f] = get_tap(i, f);
+    }
+  }
+}
+
+// Exchanges the halos of t, or accumulates them into the neighbors
+// with reverse, remaking xch when t is not its tensor
+template <typename DataType>
+void exchange_halo(
+    tensor::Tensor<DataType, tensor::LocaleMPI, tensor::BaseAllocator> &t,
+    std::unique_ptr<tensor::HaloExchangeHost<DataType>> &xch,
+    bool reverse=false) {
+  if (xch == nullptr || &xch->get_tensor() != &t) {
+    xch = util::make_unique<tensor::HaloExchangeHost<DataType>>(t);
+  }
+  if (reverse) {
+    xch->exchange_reverse();
+  } else {
+    xch->exchange();
+  }
+}
+
+template <typename DataType>
+void allreduce(DataType *buf, int count, MPI_Comm comm) {
+  DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, buf, count,
+                                   util::get_mpi_data_type<DataType>(),
+                                   MPI_SUM, comm));
+}
+
+} // namespace internal
+} // namespace cpu
+} // namespace distconv
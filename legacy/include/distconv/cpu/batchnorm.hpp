@@ -0,0 +1,348 @@
+#pragma once
+
+#include "distconv/cpu/backend.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace distconv {
+
+/*
+  Batch normalization of host tensors.
+
+  Each channel is reduced by the OpenMP threads over its samples and
+  rows. With global statistics, the partial sums are allreduced over
+  the communicator of the backend, as the DNN library backend does.
+ */
+template <typename DataType>
+class BatchNormalization<cpu::Backend, DataType> {
+ public:
+  BatchNormalization(cpu::Backend &be, int num_dims,
+                     DataType decay, DataType epsilon,
+                     bool global_stats,
+                     BatchnormImpl impl=BatchnormImpl::MPI):
+      m_be(be), m_num_dims(num_dims), m_decay(decay), m_epsilon(epsilon),
+      m_global_stats(global_stats) {}
+
+  template <typename Tensor>
+  int forward_stage1(const Tensor &input, Tensor &mean, Tensor &var,
+                     bool is_training) {
+    set_num_samples(input.get_local_shape()[-1]);
+    if (!is_training) {
+      return 0;
+    }
+    const auto x = cpu::internal::get_geometry(input);
+    DataType *mean_buf = mean.get_base_ptr();
+    DataType *var_buf = var.get_base_ptr();
+    const DataType *x_buf = input.get_const_buffer();
+#pragma omp parallel for schedule(static)
+    for (int64_t c = 0; c < x.num_channels; ++c) {
+      DataType sum = 0, sqsum = 0;
+      for_each_row(x, c, [&](int64_t offset) {
+          const DataType *xrow = x_buf + offset;
+#pragma omp simd reduction(+:sum,sqsum)
+          for (int64_t i = 0; i < x.spatial[0].len; ++i) {
+            sum += xrow[i];
+            sqsum += xrow[i] * xrow[i];
+          }
+        });
+      mean_buf[c] = sum;
+      var_buf[c] = sqsum;
+    }
+    return 0;
+  }
+
+  template <typename Tensor>
+  int forward_allreduce(Tensor &mean, Tensor &var, bool is_training) {
+    if (!is_training || !m_global_stats) {
+      return 0;
+    }
+    allreduce(mean, var);
+    return 0;
+  }
+
+  template <typename Tensor>
+  int forward_stage2(const Tensor &input,
+                     Tensor &mean,
+                     Tensor &var,
+                     Tensor &running_mean,
+                     Tensor &running_var,
+                     Tensor &scale,
+                     Tensor &bias,
+                     Tensor &output,
+                     bool is_training) {
+    if (is_training) {
+      sums_to_statistics(get_num_per_sum(input), mean, var,
+                         running_mean, running_var);
+      batch_normalization(input, mean, var, scale, bias, output);
+    } else {
+      batch_normalization(input, running_mean, running_var, scale, bias,
+                          output);
+    }
+    return 0;
+  }
+
+  template <typename Tensor>
+  int forward(const Tensor &input,
+              Tensor &mean,
+              Tensor &var,
+              Tensor &running_mean,
+              Tensor &running_var,
+              Tensor &scale,
+              Tensor &bias,
+              Tensor &output,
+              bool is_training) {
+    forward_stage1(input, mean, var, is_training);
+    forward_allreduce(mean, var, is_training);
+    forward_stage2(input, mean, var, running_mean, running_var, scale, bias,
+                   output, is_training);
+    return 0;
+  }
+
+  template <typename Tensor>
+  int backward_stage1(const Tensor &input,
+                      const Tensor &d_output,
+                      const Tensor &mean,
+                      const Tensor &var,
+                      const Tensor &scale,
+                      Tensor &scale_gradient,
+                      Tensor &bias_gradient,
+                      Tensor &mean_gradient,
+                      Tensor &var_gradient) {
+    set_num_samples(input.get_local_shape()[-1]);
+    const auto x = cpu::internal::get_geometry(input);
+    // The output gradients are indexed as the input
+    assert_always(input.get_local_real_shape() ==
+                  d_output.get_local_real_shape());
+    const DataType *x_buf = input.get_const_buffer();
+    const DataType *dy_buf = d_output.get_const_buffer();
+    const DataType *mean_buf = mean.get_const_base_ptr();
+    const DataType *var_buf = var.get_const_base_ptr();
+    const DataType *scale_buf = scale.get_const_base_ptr();
+    DataType *ds_buf = scale_gradient.get_base_ptr();
+    DataType *db_buf = bias_gradient.get_base_ptr();
+    DataType *dm_buf = mean_gradient.get_base_ptr();
+    DataType *dv_buf = var_gradient.get_base_ptr();
+#pragma omp parallel for schedule(static)
+    for (int64_t c = 0; c < x.num_channels; ++c) {
+      const DataType m = mean_buf[c];
+      const DataType inv = DataType(1) / std::sqrt(var_buf[c] + m_epsilon);
+      DataType ds = 0, db = 0, dvx = 0;
+      for_each_row(x, c, [&](int64_t offset) {
+          const DataType *xrow = x_buf + offset;
+          const DataType *dyrow = dy_buf + offset;
+#pragma omp simd reduction(+:ds,db,dvx)
+          for (int64_t i = 0; i < x.spatial[0].len; ++i) {
+            const DataType xm = xrow[i] - m;
+            ds += dyrow[i] * xm * inv;
+            db += dyrow[i];
+            dvx += dyrow[i] * xm;
+          }
+        });
+      const DataType s = scale_buf[c];
+      ds_buf[c] = ds;
+      db_buf[c] = db;
+      dm_buf[c] = -db * s * inv;
+      dv_buf[c] = -dvx * s * inv * inv * inv / DataType(2);
+    }
+    return 0;
+  }
+
+  template <typename Tensor>
+  int backward_allreduce(Tensor &scale_gradient,
+                         Tensor &bias_gradient,
+                         Tensor &mean_gradient,
+                         Tensor &var_gradient,
+                         bool skip_weights=false) {
+    if (!m_global_stats) {
+      return 0;
+    }
+    allreduce(mean_gradient, var_gradient);
+    if (!skip_weights) {
+      allreduce(scale_gradient, bias_gradient);
+    }
+    return 0;
+  }
+
+  template <typename Tensor>
+  int backward_stage2(const Tensor &input,
+                      const Tensor &d_output,
+                      const Tensor &mean,
+                      const Tensor &var,
+                      const Tensor &scale,
+                      const Tensor &mean_gradient,
+                      const Tensor &var_gradient,
+                      Tensor &d_input) {
+    const auto x = cpu::internal::get_geometry(input);
+    assert_always(input.get_local_real_shape() ==
+                  d_output.get_local_real_shape());
+    assert_always(input.get_local_real_shape() ==
+                  d_input.get_local_real_shape());
+    const DataType m = get_num_per_sum(input);
+    const DataType *x_buf = input.get_const_buffer();
+    const DataType *dy_buf = d_output.get_const_buffer();
+    const DataType *mean_buf = mean.get_const_base_ptr();
+    const DataType *var_buf = var.get_const_base_ptr();
+    const DataType *scale_buf = scale.get_const_base_ptr();
+    const DataType *dm_buf = mean_gradient.get_const_base_ptr();
+    const DataType *dv_buf = var_gradient.get_const_base_ptr();
+    DataType *dx_buf = d_input.get_buffer();
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int64_t n = 0; n < x.num_samples; ++n) {
+      for (int64_t c = 0; c < x.num_channels; ++c) {
+        const DataType mc = mean_buf[c];
+        const DataType inv = DataType(1) / std::sqrt(var_buf[c] + m_epsilon);
+        const DataType a = scale_buf[c] * inv;
+        const DataType dm = dm_buf[c] / m;
+        const DataType dv = dv_buf[c] * DataType(2) / (m - DataType(1));
+        const int64_t offset = n * x.sample_stride + c * x.channel_stride;
+        for (int64_t r = 0; r < x.get_num_rows(); ++r) {
+          const int64_t row = offset + x.get_row_offset(r);
+          const DataType *xrow = x_buf + row;
+          const DataType *dyrow = dy_buf + row;
+          DataType *dxrow = dx_buf + row;
+#pragma omp simd
+          for (int64_t i = 0; i < x.spatial[0].len; ++i) {
+            dxrow[i] = dyrow[i] * a + dm + dv * (xrow[i] - mc);
+          }
+        }
+      }
+    }
+    return 0;
+  }
+
+  template <typename Tensor>
+  int backward(const Tensor &input,
+               const Tensor &d_output,
+               const Tensor &mean,
+               const Tensor &var,
+               const Tensor &scale,
+               Tensor &scale_gradient,
+               Tensor &bias_gradient,
+               Tensor &mean_gradient,
+               Tensor &var_gradient,
+               Tensor &d_input) {
+    backward_stage1(input, d_output, mean, var, scale, scale_gradient,
+                    bias_gradient, mean_gradient, var_gradient);
+    backward_allreduce(scale_gradient, bias_gradient, mean_gradient,
+                       var_gradient);
+    backward_stage2(input, d_output, mean, var, scale, mean_gradient,
+                    var_gradient, d_input);
+    return 0;
+  }
+
+  // n: the number of the current local minibatch samples
+  void set_num_samples(int n) {
+    m_num_current_samples = n;
+  }
+
+  // Wait for asynchronous tasks
+  void wait() {}
+
+ protected:
+  cpu::Backend &m_be;
+  int m_num_dims;
+  DataType m_decay;
+  DataType m_epsilon;
+  bool m_global_stats;
+  int m_num_current_samples = 0;
+
+  // Calls f with the offset of each local row of channel c
+  template <typename F>
+  static void for_each_row(const cpu::internal::Geometry &x, int64_t c,
+                           F &&f) {
+    for (int64_t n = 0; n < x.num_samples; ++n) {
+      const int64_t offset = n * x.sample_stride + c * x.channel_stride;
+      for (int64_t r = 0; r < x.get_num_rows(); ++r) {
+        f(offset + x.get_row_offset(r));
+      }
+    }
+  }
+
+  // Number of elements per channel. Note that the channel dimension
+  // is assumed to be at the second to last dimension.
+  template <typename Tensor>
+  index_t get_num_per_sum(const Tensor &input) const {
+    auto stat_shape =
+        m_global_stats ? input.get_shape() : input.get_local_shape();
+    return stat_shape.get_size() / stat_shape[-2];
+  }
+
+  // Reduces the channel values of a and b with a single allreduce
+  // when they are contiguous
+  template <typename Tensor>
+  void allreduce(Tensor &a, Tensor &b) {
+    DataType *a_ptr = a.get_base_ptr();
+    DataType *b_ptr = b.get_base_ptr();
+    const int count = a.get_local_size();
+    assert_eq(count, (int)b.get_local_size());
+    if (a_ptr + count == b_ptr) {
+      cpu::internal::allreduce(a_ptr, count * 2, m_be.get_comm());
+    } else if (a_ptr == b_ptr + count) {
+      cpu::internal::allreduce(b_ptr, count * 2, m_be.get_comm());
+    } else {
+      cpu::internal::allreduce(a_ptr, count, m_be.get_comm());
+      cpu::internal::allreduce(b_ptr, count, m_be.get_comm());
+    }
+  }
+
+  template <typename Tensor>
+  void sums_to_statistics(index_t num_per_sum, Tensor &mean, Tensor &var,
+                          Tensor &running_mean, Tensor &running_var) {
+    const int64_t num_channels = mean.get_local_size();
+    DataType *mean_buf = mean.get_base_ptr();
+    DataType *var_buf = var.get_base_ptr();
+    DataType *rm_buf = running_mean.get_base_ptr();
+    DataType *rv_buf = running_var.get_base_ptr();
+    const DataType m = num_per_sum;
+    for (int64_t c = 0; c < num_channels; ++c) {
+      DataType mc = 0, vc = 0;
+      if (num_per_sum > 0) {
+        mc = mean_buf[c] / m;
+        // Unbiased variance
+        vc = std::max(var_buf[c] / m - mc * mc, DataType(0))
+            * m / (m - DataType(1));
+      }
+      mean_buf[c] = mc;
+      var_buf[c] = vc;
+      rm_buf[c] = m_decay * rm_buf[c] + (DataType(1) - m_decay) * mc;
+      rv_buf[c] = m_decay * rv_buf[c] + (DataType(1) - m_decay) * vc;
+    }
+  }
+
+  template <typename Tensor>
+  void batch_normalization(const Tensor &input, const Tensor &mean,
+                           const Tensor &var, const Tensor &scale,
+                           const Tensor &bias, Tensor &output) {
+    const auto x = cpu::internal::get_geometry(input);
+    assert_always(input.get_local_real_shape() ==
+                  output.get_local_real_shape());
+    const DataType *x_buf = input.get_const_buffer();
+    const DataType *mean_buf = mean.get_const_base_ptr();
+    const DataType *var_buf = var.get_const_base_ptr();
+    const DataType *scale_buf = scale.get_const_base_ptr();
+    const DataType *bias_buf = bias.get_const_base_ptr();
+    DataType *y_buf = output.get_buffer();
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int64_t n = 0; n < x.num_samples; ++n) {
+      for (int64_t c = 0; c < x.num_channels; ++c) {
+        const DataType a = scale_buf[c]
+            / std::sqrt(var_buf[c] + m_epsilon);
+        const DataType b = bias_buf[c] - a * mean_buf[c];
+        const int64_t offset = n * x.sample_stride + c * x.channel_stride;
+        for (int64_t r = 0; r < x.get_num_rows(); ++r) {
+          const int64_t row = offset + x.get_row_offset(r);
+          const DataType *xrow = x_buf + row;
+          DataType *yrow = y_buf + row;
+#pragma omp simd
+          for (int64_t i = 0; i < x.spatial[0].len; ++i) {
+            yrow[i] = a * xrow[i] + b;
+          }
+        }
+      }
+    }
+  }
+};
+
+} // namespace distconv
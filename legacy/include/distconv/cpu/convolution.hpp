@@ -0,0 +1,557 @@
+#pragma once
+
+#include "distconv/cpu/backend.hpp"
+#include "distconv/cpu/deep_halo.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace distconv {
+
+/*
+  Direct convolution of host tensors.
+
+  Each thread accumulates a tile of rows of one output channel of one
+  sample, sweeping the input channels and filter taps, so that the
+  tile stays in cache. Along W, the range of outputs whose inputs are
+  not padding is computed per tap, which leaves the innermost loop
+  without branches to be vectorized. The backward data pass gathers
+  the gradients of each input in the same way rather than scattering
+  them, so no two threads write the same element.
+
+  The input halos are exchanged by the forward pass and those of the
+  output gradients by the backward data pass. The backward filter pass
+  uses the input halos of the forward pass. In a chain of layers with
+  deep halos (see DeepHaloPlan), only the first layer exchanges, and
+  each layer computes the halos that the following layers read.
+ */
+template <typename DataType>
+class Convolution<cpu::Backend, DataType> {
+  using Window = cpu::internal::Window;
+  using Geometry = cpu::internal::Geometry;
+  using ForwardTap = cpu::internal::ForwardTap;
+  using BackwardTap = cpu::internal::BackwardTap;
+  using HaloExchangeType = tensor::HaloExchangeHost<DataType>;
+  static constexpr int NSD = cpu::internal::num_spatial_dims;
+
+ public:
+  Convolution(cpu::Backend &be,
+              int num_dims,
+              HaloExchangeMethod m=HaloExchangeMethod::MPI,
+              bool overlap_halo_exchange=false,
+              bool enable_profiling=false): m_be(be), m_num_dims(num_dims) {
+    // Halos of host tensors are always exchanged with MPI
+    if (m != HaloExchangeMethod::MPI) {
+      util::MPIRootPrintStreamInfo()
+          << "Ignoring halo exchange method " << m << " of the CPU backend";
+    }
+  }
+
+  template <typename Tensor>
+  void setup(const Tensor &input,
+             const Tensor &filter,
+             const Tensor &output,
+             const Tensor &d_input,
+             const Tensor &d_filter,
+             const Tensor &d_output,
+             const int_vector &pads,
+             const int_vector &strides,
+             const int_vector dilations,
+             int num_groups,
+             const std::string &fwd_algo,
+             const std::string &bwd_data_algo,
+             const std::string &bwd_filter_algo,
+             size_t ws_size) {
+    const int nsd = m_num_dims - 2;
+    assert_eq((int)pads.size(), nsd);
+    assert_eq((int)strides.size(), nsd);
+    assert_eq((int)dilations.size(), nsd);
+    int_vector filter_dims;
+    for (int i = 0; i < nsd; ++i) {
+      filter_dims.push_back(filter.get_shape()[i]);
+    }
+    cpu::internal::get_windows(filter_dims, strides, pads, dilations,
+                               m_windows);
+    // Channel and filter parallelism is not supported
+    assert_always(input.get_distribution().get_split_shape()[-2] == 1);
+    assert_always(output.get_distribution().get_split_shape()[-2] == 1);
+    m_num_groups = num_groups;
+    m_num_filter_channels = filter.get_shape()[-2];
+    assert_eq((index_t)m_num_filter_channels * num_groups,
+              input.get_shape()[-2]);
+    assert_eq(filter.get_shape()[-1], output.get_shape()[-2]);
+    assert0(output.get_shape()[-2] % num_groups);
+  }
+
+  // Makes this layer the layer-th one of a chain with deep halos
+  void set_deep_halo(const cpu::DeepHaloPlan &plan, int layer) {
+    for (const auto &w: m_windows) {
+      assert_eq(w.stride, 1);
+    }
+    m_fwd_compute_width = plan.get_forward_compute_width(layer);
+    m_fwd_exchange = plan.is_forward_exchange_required(layer);
+    m_bwd_compute_width = plan.get_backward_compute_width(layer);
+    m_bwd_exchange = plan.is_backward_exchange_required(layer);
+  }
+
+  template <typename Tensor>
+  void setup_bias(const Tensor &bias) {}
+
+  template <typename Tensor>
+  void setup_bias_gradient(const Tensor &bias_gradient) {}
+
+  template <typename Tensor>
+  int forward_exchange_halo(Tensor &input) {
+    if (!m_fwd_exchange) {
+      return 0;
+    }
+    cpu::internal::exchange_halo(input, m_halo_xch_input);
+    return 0;
+  }
+
+  template <typename Tensor>
+  int forward(
+      typename Tensor::data_type alpha,
+      Tensor &input,
+      Tensor &filter,
+      typename Tensor::data_type beta,
+      Tensor &output,
+      bool skip_halo_exchange=false,
+      bool skip_chanfilt_comm=false,
+      bool dump_profile=false) {
+    // Even when the local output is empty, the halos of the
+    // neighbors may need to be sent
+    if (!skip_halo_exchange) {
+      forward_exchange_halo(input);
+    }
+    if (output.get_local_size() == 0) {
+      return 0;
+    }
+    const auto x = cpu::internal::get_geometry(input);
+    auto y = cpu::internal::get_geometry(output);
+    cpu::internal::extend_into_halo(y, m_fwd_compute_width);
+    assert_eq(x.num_samples, y.num_samples);
+    std::vector<ForwardTap> taps[NSD];
+    cpu::internal::get_taps(m_windows, taps, [&](int i, int f) {
+        return cpu::internal::get_forward_tap(x.spatial[i], y.spatial[i],
+                                              m_windows[i], f);
+      });
+    const int64_t cg = m_num_filter_channels;
+    const int64_t kg = y.num_channels / m_num_groups;
+    const int64_t filter_size = get_filter_size();
+    const DataType *x_buf = input.get_const_buffer();
+    const DataType *f_buf = filter.get_const_base_ptr();
+    DataType *y_buf = output.get_buffer();
+    apply_tiled(y, y.num_channels,
+                [&](int64_t n, int64_t k, int64_t r_begin, int64_t r_end,
+                    DataType *acc) {
+      const int64_t c_begin = k / kg * cg;
+      for (int64_t c = 0; c < cg; ++c) {
+        const DataType *xc = x_buf + n * x.sample_stride
+            + (c_begin + c) * x.channel_stride;
+        const DataType *fc = f_buf + (k * cg + c) * filter_size;
+        for_each_tap(taps, fc, [&](const ForwardTap &td, const ForwardTap &th,
+                                   const ForwardTap &tw, DataType wv) {
+          for (int64_t r = r_begin; r < r_end; ++r) {
+            const int64_t od = r / y.spatial[1].len - td.begin;
+            const int64_t oh = r % y.spatial[1].len - th.begin;
+            if (od < 0 || od >= td.count || oh < 0 || oh >= th.count) {
+              continue;
+            }
+            const DataType *xrow = xc
+                + (td.x_begin + od * m_windows[2].stride) * x.spatial[2].stride
+                + (th.x_begin + oh * m_windows[1].stride) * x.spatial[1].stride
+                + tw.x_begin;
+            DataType *arow = acc + (r - r_begin) * y.spatial[0].len
+                + tw.begin;
+            axpy(tw.count, wv, xrow, m_windows[0].stride, arow, 1);
+          }
+        });
+      }
+    }, alpha, beta, y_buf);
+    return 0;
+  }
+
+  template <typename TensorType>
+  int apply_bias(
+      typename TensorType::data_type alpha,
+      TensorType &bias,
+      typename TensorType::data_type beta,
+      TensorType &output) {
+    if (output.get_local_size() == 0) {
+      return 0;
+    }
+    // The computed output halos are biased as well
+    auto y = cpu::internal::get_geometry(output);
+    cpu::internal::extend_into_halo(y, m_fwd_compute_width);
+    const DataType *b_buf = bias.get_const_base_ptr();
+    DataType *y_buf = output.get_buffer();
+    const int64_t num_rows = y.get_num_rows();
+    const int64_t w = y.spatial[0].len;
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int64_t n = 0; n < y.num_samples; ++n) {
+      for (int64_t k = 0; k < y.num_channels; ++k) {
+        DataType *yk = y_buf + n * y.sample_stride + k * y.channel_stride;
+        const DataType b = alpha * b_buf[k];
+        for (int64_t r = 0; r < num_rows; ++r) {
+          DataType *yrow = yk + y.get_row_offset(r);
+#pragma omp simd
+          for (int64_t i = 0; i < w; ++i) {
+            yrow[i] = b + beta * yrow[i];
+          }
+        }
+      }
+    }
+    return 0;
+  }
+
+  template <typename Tensor>
+  int backward_data_exchange_halo(Tensor &d_output) {
+    if (!m_bwd_exchange) {
+      return 0;
+    }
+    cpu::internal::exchange_halo(d_output, m_halo_xch_d_output);
+    return 0;
+  }
+
+  template <typename Tensor>
+  int backward_data(
+      typename Tensor::data_type alpha,
+      Tensor &filter,
+      Tensor &d_output,
+      typename Tensor::data_type beta,
+      Tensor &d_input,
+      bool skip_halo_exchange=false,
+      bool skip_chanfilt_comm=false,
+      bool dump_profile=false) {
+    if (!skip_halo_exchange) {
+      backward_data_exchange_halo(d_output);
+    }
+    if (d_input.get_local_size() == 0) {
+      return 0;
+    }
+    auto dx = cpu::internal::get_geometry(d_input);
+    cpu::internal::extend_into_halo(dx, m_bwd_compute_width);
+    const auto dy = cpu::internal::get_geometry(d_output);
+    assert_eq(dx.num_samples, dy.num_samples);
+    std::vector<BackwardTap> taps[NSD];
+    cpu::internal::get_taps(m_windows, taps, [&](int i, int f) {
+        return cpu::internal::get_backward_tap(dx.spatial[i], dy.spatial[i],
+                                               m_windows[i], f);
+      });
+    const int64_t cg = m_num_filter_channels;
+    const int64_t kg = dy.num_channels / m_num_groups;
+    const int64_t filter_size = get_filter_size();
+    const DataType *dy_buf = d_output.get_const_buffer();
+    const DataType *f_buf = filter.get_const_base_ptr();
+    DataType *dx_buf = d_input.get_buffer();
+    const int sd = m_windows[2].stride;
+    const int sh = m_windows[1].stride;
+    apply_tiled(dx, dx.num_channels,
+                [&](int64_t n, int64_t c, int64_t r_begin, int64_t r_end,
+                    DataType *acc) {
+      const int64_t k_begin = c / cg * kg;
+      for (int64_t k = k_begin; k < k_begin + kg; ++k) {
+        const DataType *dyk = dy_buf + n * dy.sample_stride
+            + k * dy.channel_stride;
+        const DataType *fk = f_buf + (k * cg + c % cg) * filter_size;
+        for_each_tap(taps, fk, [&](const BackwardTap &td,
+                                   const BackwardTap &th,
+                                   const BackwardTap &tw, DataType wv) {
+          for (int64_t r = r_begin; r < r_end; ++r) {
+            const int64_t id = r / dx.spatial[1].len - td.begin;
+            const int64_t ih = r % dx.spatial[1].len - th.begin;
+            if (id < 0 || id % sd || id / sd >= td.count ||
+                ih < 0 || ih % sh || ih / sh >= th.count) {
+              continue;
+            }
+            const DataType *dyrow = dyk
+                + (td.y_begin + id / sd) * dy.spatial[2].stride
+                + (th.y_begin + ih / sh) * dy.spatial[1].stride
+                + tw.y_begin;
+            DataType *arow = acc + (r - r_begin) * dx.spatial[0].len
+                + tw.begin;
+            axpy(tw.count, wv, dyrow, 1, arow, m_windows[0].stride);
+          }
+        });
+      }
+    }, alpha, beta, dx_buf);
+    return 0;
+  }
+
+  template <typename Tensor>
+  int backward_filter(
+      typename Tensor::data_type alpha,
+      Tensor &input,
+      Tensor &d_output,
+      typename Tensor::data_type beta,
+      Tensor &d_filter,
+      bool reduce=true,
+      bool skip_chanfilt_comm=false,
+      bool dump_profile=false) {
+    const int64_t cg = m_num_filter_channels;
+    const int64_t num_filters = d_filter.get_shape()[-1];
+    const int64_t filter_size = get_filter_size();
+    const int64_t size = num_filters * cg * filter_size;
+    assert_eq((int64_t)d_filter.get_local_size(), size);
+    DataType *df_buf = d_filter.get_base_ptr();
+    std::vector<DataType> prev;
+    if (beta != DataType(0)) {
+      prev.assign(df_buf, df_buf + size);
+    }
+    if (d_output.get_local_size() > 0) {
+      backward_filter_local(input, d_output, df_buf);
+    } else {
+      std::fill(df_buf, df_buf + size, DataType(0));
+    }
+    if (reduce) {
+      cpu::internal::allreduce(df_buf, size, m_be.get_comm());
+    }
+    scale_and_add(df_buf, size, alpha, beta, prev);
+    return 0;
+  }
+
+  template <typename Tensor>
+  int backward_bias(
+      typename Tensor::data_type alpha,
+      Tensor &d_output,
+      typename Tensor::data_type beta,
+      Tensor &bias_gradient,
+      bool reduce=true,
+      bool dump_profile=false) {
+    const int64_t num_filters = bias_gradient.get_local_size();
+    DataType *db_buf = bias_gradient.get_base_ptr();
+    std::vector<DataType> prev;
+    if (beta != DataType(0)) {
+      prev.assign(db_buf, db_buf + num_filters);
+    }
+    std::fill(db_buf, db_buf + num_filters, DataType(0));
+    if (d_output.get_local_size() > 0) {
+      const auto dy = cpu::internal::get_geometry(d_output);
+      assert_eq(dy.num_channels, num_filters);
+      const DataType *dy_buf = d_output.get_const_buffer();
+      const int64_t num_rows = dy.get_num_rows();
+      const int64_t w = dy.spatial[0].len;
+#pragma omp parallel for schedule(static)
+      for (int64_t k = 0; k < num_filters; ++k) {
+        DataType sum = 0;
+        for (int64_t n = 0; n < dy.num_samples; ++n) {
+          const DataType *dyk = dy_buf + n * dy.sample_stride
+              + k * dy.channel_stride;
+          for (int64_t r = 0; r < num_rows; ++r) {
+            const DataType *dyrow = dyk + dy.get_row_offset(r);
+#pragma omp simd reduction(+:sum)
+            for (int64_t i = 0; i < w; ++i) {
+              sum += dyrow[i];
+            }
+          }
+        }
+        db_buf[k] = sum;
+      }
+    }
+    if (reduce) {
+      cpu::internal::allreduce(db_buf, num_filters, m_be.get_comm());
+    }
+    scale_and_add(db_buf, num_filters, alpha, beta, prev);
+    return 0;
+  }
+
+  // Wait for asynchronous tasks
+  void wait() {}
+
+  bool is_overlap_fwd_halo_exchange_enabled() const {
+    return false;
+  }
+
+  bool is_overlap_bwd_halo_exchange_enabled() const {
+    return false;
+  }
+
+ protected:
+  cpu::Backend &m_be;
+  int m_num_dims;
+  Window m_windows[NSD];
+  int m_num_groups = 1;
+  // Input channels of a group
+  int m_num_filter_channels = 0;
+  std::unique_ptr<HaloExchangeType> m_halo_xch_input;
+  std::unique_ptr<HaloExchangeType> m_halo_xch_d_output;
+  // Deep halos: the output (input gradient) halo widths computed
+  // along with the interior, and whether the input (output gradient)
+  // halos are exchanged
+  int_vector m_fwd_compute_width;
+  bool m_fwd_exchange = true;
+  int_vector m_bwd_compute_width;
+  bool m_bwd_exchange = true;
+
+  int64_t get_filter_size() const {
+    return (int64_t)m_windows[0].size * m_windows[1].size
+        * m_windows[2].size;
+  }
+
+  // y[i * incy] += a * x[i * incx]
+  static void axpy(int64_t n, DataType a, const DataType *x, int incx,
+                   DataType *y, int incy) {
+    if (incx == 1 && incy == 1) {
+#pragma omp simd
+      for (int64_t i = 0; i < n; ++i) {
+        y[i] += a * x[i];
+      }
+    } else {
+#pragma omp simd
+      for (int64_t i = 0; i < n; ++i) {
+        y[i * incy] += a * x[i * incx];
+      }
+    }
+  }
+
+  // Calls f for each combination of taps of the D, H and W
+  // dimensions with some points, with the filter value of the
+  // taps. filter points to the taps of a filter and input channel.
+  template <typename Tap, typename F>
+  void for_each_tap(const std::vector<Tap> (&taps)[NSD],
+                    const DataType *filter, F &&f) const {
+    for (int fd = 0; fd < m_windows[2].size; ++fd) {
+      const auto &td = taps[2][fd];
+      if (td.count == 0) continue;
+      for (int fh = 0; fh < m_windows[1].size; ++fh) {
+        const auto &th = taps[1][fh];
+        if (th.count == 0) continue;
+        for (int fw = 0; fw < m_windows[0].size; ++fw) {
+          const auto &tw = taps[0][fw];
+          if (tw.count == 0) continue;
+          f(td, th, tw, filter[(fd * m_windows[1].size + fh)
+                               * m_windows[0].size + fw]);
+        }
+      }
+    }
+  }
+
+  /*
+    Runs f(n, c, r_begin, r_end, acc) over the tiles of rows
+    [r_begin, r_end) of channel c of sample n of y, in parallel, and
+    stores alpha * acc + beta * y to the tile. acc is a zeroed buffer
+    of the tile.
+   */
+  template <typename F>
+  void apply_tiled(const Geometry &y, int64_t num_channels, F &&f,
+                   DataType alpha, DataType beta, DataType *y_buf) const {
+    const int64_t w = y.spatial[0].len;
+    const int64_t num_rows = y.get_num_rows();
+    const int64_t tile_rows = std::max<int64_t>(
+        1, cpu::internal::tile_size / w);
+    const int64_t num_tiles = (num_rows + tile_rows - 1) / tile_rows;
+#pragma omp parallel
+    {
+      std::vector<DataType> acc(std::min(tile_rows, num_rows) * w);
+#pragma omp for collapse(3) schedule(static)
+      for (int64_t n = 0; n < y.num_samples; ++n) {
+        for (int64_t c = 0; c < num_channels; ++c) {
+          for (int64_t t = 0; t < num_tiles; ++t) {
+            const int64_t r_begin = t * tile_rows;
+            const int64_t r_end = std::min(num_rows, r_begin + tile_rows);
+            std::fill(acc.begin(), acc.begin() + (r_end - r_begin) * w,
+                      DataType(0));
+            f(n, c, r_begin, r_end, acc.data());
+            DataType *yc = y_buf + n * y.sample_stride + c * y.channel_stride;
+            for (int64_t r = r_begin; r < r_end; ++r) {
+              DataType *yrow = yc + y.get_row_offset(r);
+              const DataType *arow = acc.data() + (r - r_begin) * w;
+              // y is not read with a zero beta, so that it may be
+              // uninitialized
+              if (beta == DataType(0)) {
+#pragma omp simd
+                for (int64_t i = 0; i < w; ++i) {
+                  yrow[i] = alpha * arow[i];
+                }
+              } else {
+#pragma omp simd
+                for (int64_t i = 0; i < w; ++i) {
+                  yrow[i] = alpha * arow[i] + beta * yrow[i];
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  template <typename Tensor>
+  void backward_filter_local(const Tensor &input, const Tensor &d_output,
+                             DataType *df_buf) const {
+    const auto x = cpu::internal::get_geometry(input);
+    const auto dy = cpu::internal::get_geometry(d_output);
+    assert_eq(x.num_samples, dy.num_samples);
+    std::vector<ForwardTap> taps[NSD];
+    cpu::internal::get_taps(m_windows, taps, [&](int i, int f) {
+        return cpu::internal::get_forward_tap(x.spatial[i], dy.spatial[i],
+                                              m_windows[i], f);
+      });
+    const int64_t cg = m_num_filter_channels;
+    const int64_t num_filters = dy.num_channels;
+    const int64_t kg = num_filters / m_num_groups;
+    const int64_t filter_size = get_filter_size();
+    const DataType *x_buf = input.get_const_buffer();
+    const DataType *dy_buf = d_output.get_const_buffer();
+    const int sd = m_windows[2].stride;
+    const int sh = m_windows[1].stride;
+    const int sw = m_windows[0].stride;
+#pragma omp parallel for collapse(2) schedule(dynamic)
+    for (int64_t k = 0; k < num_filters; ++k) {
+      for (int64_t c = 0; c < cg; ++c) {
+        const int64_t c_in = k / kg * cg + c;
+        DataType *dfc = df_buf + (k * cg + c) * filter_size;
+        std::fill(dfc, dfc + filter_size, DataType(0));
+        for (int64_t n = 0; n < x.num_samples; ++n) {
+          const DataType *xc = x_buf + n * x.sample_stride
+              + c_in * x.channel_stride;
+          const DataType *dyk = dy_buf + n * dy.sample_stride
+              + k * dy.channel_stride;
+          for (int fd = 0; fd < m_windows[2].size; ++fd) {
+            const auto &td = taps[2][fd];
+            for (int fh = 0; fh < m_windows[1].size; ++fh) {
+              const auto &th = taps[1][fh];
+              for (int fw = 0; fw < m_windows[0].size; ++fw) {
+                const auto &tw = taps[0][fw];
+                DataType sum = 0;
+                for (int64_t od = 0; od < td.count; ++od) {
+                  for (int64_t oh = 0; oh < th.count; ++oh) {
+                    const DataType *xrow = xc
+                        + (td.x_begin + od * sd) * x.spatial[2].stride
+                        + (th.x_begin + oh * sh) * x.spatial[1].stride
+                        + tw.x_begin;
+                    const DataType *dyrow = dyk
+                        + (td.begin + od + dy.spatial[2].halo)
+                        * dy.spatial[2].stride
+                        + (th.begin + oh + dy.spatial[1].halo)
+                        * dy.spatial[1].stride
+                        + tw.begin + dy.spatial[0].halo;
+#pragma omp simd reduction(+:sum)
+                    for (int64_t i = 0; i < tw.count; ++i) {
+                      sum += xrow[i * sw] * dyrow[i];
+                    }
+                  }
+                }
+                dfc[(fd * m_windows[1].size + fh) * m_windows[0].size + fw]
+                    += sum;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // buf = alpha * buf + beta * prev, where prev is empty with a zero
+  // beta
+  static void scale_and_add(DataType *buf, int64_t size, DataType alpha,
+                            DataType beta, const std::vector<DataType> &prev) {
+    for (int64_t i = 0; i < size; ++i) {
+      buf[i] = alpha * buf[i] + (prev.empty() ? DataType(0) : beta * prev[i]);
+    }
+  }
+};
+
+} // namespace distconv
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/util/util.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace distconv {
+namespace cpu {
+
+/*
+  Halo widths of a chain of stencil layers that exchange halos once
+  for the whole chain.
+
+  The input of the first layer is exchanged with a halo as wide as the
+  sum of the radii of all the layers. Each layer then computes its
+  output over the interior and the part of its halo that the
+  remaining layers read, so that the following layers find their
+  input halos already filled. This trades redundant computation of
+  the boundaries for fewer latency-bound exchanges.
+
+  With backward enabled, the gradients are propagated in the same way
+  from the last layer, whose output gradients are exchanged once. This
+  requires every layer of the chain to compute its input gradients by
+  gathering, which convolutions do but pooling does not.
+
+  Tensor t is the input of layer t, and tensor num_layers is the
+  output of the last layer. The layers must have unit strides. The
+  halos may be wider than the local tensors, in which case they are
+  exchanged with the processes further away as well.
+ */
+class DeepHaloPlan {
+ public:
+  // radii[i][d] is the radius of layer i along spatial dimension d
+  DeepHaloPlan(const std::vector<int_vector> &radii, bool backward=false):
+      m_radii(radii), m_backward(backward) {
+    assert_always(!m_radii.empty());
+    for (const auto &r: m_radii) {
+      assert_eq(r.size(), m_radii[0].size());
+    }
+  }
+
+  // Radii of a window of sizes with dilations
+  static int_vector get_radii(const int_vector &sizes,
+                              const int_vector &dilations) {
+    int_vector radii;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+      const int size = (sizes[i] - 1) * dilations[i] + 1;
+      // Even windows have no center to compute halos around
+      assert_always(size % 2 == 1);
+      radii.push_back((size - 1) / 2);
+    }
+    return radii;
+  }
+
+  int get_num_layers() const {
+    return m_radii.size();
+  }
+
+  int get_num_spatial_dims() const {
+    return m_radii[0].size();
+  }
+
+  bool is_backward_enabled() const {
+    return m_backward;
+  }
+
+  // Halo width that tensor t and its gradient must be allocated
+  // with
+  int_vector get_halo_width(int t) const {
+    const int n = get_num_layers();
+    assert_always(t >= 0 && t <= n);
+    auto width = sum_radii(t, n);
+    // The gradient of tensor t is the output gradient of layer t-1
+    const auto bwd = m_backward ? sum_radii(0, t) :
+        (t > 0 ? m_radii[t - 1] : int_vector(get_num_spatial_dims(), 0));
+    for (int i = 0; i < get_num_spatial_dims(); ++i) {
+      width[i] = std::max(width[i], bwd[i]);
+    }
+    return width;
+  }
+
+  // Width of the output halo that the forward pass of layer i
+  // computes
+  int_vector get_forward_compute_width(int i) const {
+    return sum_radii(i + 1, get_num_layers());
+  }
+
+  bool is_forward_exchange_required(int i) const {
+    return i == 0;
+  }
+
+  // Width of the input gradient halo that the backward data pass of
+  // layer i computes
+  int_vector get_backward_compute_width(int i) const {
+    return m_backward ? sum_radii(0, i) :
+        int_vector(get_num_spatial_dims(), 0);
+  }
+
+  bool is_backward_exchange_required(int i) const {
+    return !m_backward || i == get_num_layers() - 1;
+  }
+
+ protected:
+  std::vector<int_vector> m_radii;
+  bool m_backward;
+
+  // Sum of the radii of layers [begin, end)
+  int_vector sum_radii(int begin, int end) const {
+    int_vector sum(get_num_spatial_dims(), 0);
+    for (int i = begin; i < end; ++i) {
+      for (int d = 0; d < get_num_spatial_dims(); ++d) {
+        sum[d] += m_radii[i][d];
+      }
+    }
+    return sum;
+  }
+};
+
+} // namespace cpu
+} // namespace distconv
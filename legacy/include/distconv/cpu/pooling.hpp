@@ -0,0 +1,280 @@
+#pragma once
+
+#include "distconv/cpu/backend.hpp"
+#include "distconv/cpu/deep_halo.hpp"
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace distconv {
+
+/*
+  Pooling of host tensors.
+
+  The forward pass computes each output from the taps of its window
+  that are inside the global tensor, as the convolution does. The
+  backward pass scatters the gradients into the real region of the
+  input gradients, including the halos, which are then accumulated
+  into the neighbors with a reverse halo exchange. Deep halos are
+  supported in the forward pass only, since the scattered gradients
+  are complete only after the exchange.
+ */
+template <typename DataType>
+class Pooling<cpu::Backend, DataType> {
+  using Window = cpu::internal::Window;
+  using ForwardTap = cpu::internal::ForwardTap;
+  using HaloExchangeType = tensor::HaloExchangeHost<DataType>;
+  static constexpr int NSD = cpu::internal::num_spatial_dims;
+
+ public:
+  enum class Mode {MAX, AVERAGE, AVERAGE_NO_PAD};
+
+  Pooling(cpu::Backend &be, int num_dims,
+          HaloExchangeMethod m=HaloExchangeMethod::MPI):
+      m_be(be), m_num_dims(num_dims) {}
+
+  template <typename Tensor>
+  void setup(Tensor &input,
+             Tensor &output,
+             Tensor &d_input,
+             Tensor &d_output,
+             const int_vector &windows,
+             const int_vector &pads,
+             const int_vector &strides,
+             const std::string &mode) {
+    const int nsd = m_num_dims - 2;
+    assert_eq((int)windows.size(), nsd);
+    cpu::internal::get_windows(windows, strides, pads, int_vector(nsd, 1),
+                               m_windows);
+    if (mode == "MAX") {
+      m_mode = Mode::MAX;
+    } else if (mode == "AVERAGE") {
+      m_mode = Mode::AVERAGE;
+    } else if (mode == "AVERAGE_NO_PAD") {
+      m_mode = Mode::AVERAGE_NO_PAD;
+    } else {
+      util::MPIPrintStreamError() << "No matching pooling mode found: "
+                                  << mode;
+      throw std::exception();
+    }
+  }
+
+  // Makes this layer the layer-th one of a chain with deep halos
+  void set_deep_halo(const cpu::DeepHaloPlan &plan, int layer) {
+    assert_always(!plan.is_backward_enabled());
+    for (const auto &w: m_windows) {
+      assert_eq(w.stride, 1);
+    }
+    m_fwd_compute_width = plan.get_forward_compute_width(layer);
+    m_fwd_exchange = plan.is_forward_exchange_required(layer);
+  }
+
+  template <typename Tensor>
+  int forward(
+      typename Tensor::data_type alpha,
+      Tensor &input,
+      typename Tensor::data_type beta,
+      Tensor &output,
+      bool training=true) {
+    if (m_fwd_exchange) {
+      cpu::internal::exchange_halo(input, m_halo_xch_input);
+    }
+    if (output.get_local_size() == 0) {
+      return 0;
+    }
+    const auto x = cpu::internal::get_geometry(input);
+    auto y = cpu::internal::get_geometry(output);
+    cpu::internal::extend_into_halo(y, m_fwd_compute_width);
+    assert_eq(x.num_channels, y.num_channels);
+    assert_eq(x.num_samples, y.num_samples);
+    std::vector<ForwardTap> taps[NSD];
+    get_taps(x, y, taps);
+    const DataType *x_buf = input.get_const_buffer();
+    DataType *y_buf = output.get_buffer();
+    const int64_t num_rows = y.get_num_rows();
+#pragma omp parallel for collapse(3) schedule(static)
+    for (int64_t n = 0; n < y.num_samples; ++n) {
+      for (int64_t c = 0; c < y.num_channels; ++c) {
+        for (int64_t r = 0; r < num_rows; ++r) {
+          const int64_t od = r / y.spatial[1].len;
+          const int64_t oh = r % y.spatial[1].len;
+          const DataType *xc = x_buf + n * x.sample_stride
+              + c * x.channel_stride;
+          DataType *yrow = y_buf + n * y.sample_stride + c * y.channel_stride
+              + y.get_row_offset(r);
+          for (int64_t ow = 0; ow < y.spatial[0].len; ++ow) {
+            DataType v = m_mode == Mode::MAX ?
+                std::numeric_limits<DataType>::lowest() : DataType(0);
+            int64_t count = 0;
+            for_each_input(taps, x, od, oh, ow, [&](int64_t offset) {
+                const DataType xv = xc[offset];
+                v = m_mode == Mode::MAX ? std::max(v, xv) : v + xv;
+                ++count;
+              });
+            if (m_mode != Mode::MAX) {
+              v /= get_divisor(count);
+            }
+            yrow[ow] = beta == DataType(0) ?
+                alpha * v : alpha * v + beta * yrow[ow];
+          }
+        }
+      }
+    }
+    return 0;
+  }
+
+  template <typename Tensor>
+  int backward(
+      typename Tensor::data_type alpha,
+      Tensor &output,
+      Tensor &d_output,
+      Tensor &input,
+      typename Tensor::data_type beta,
+      Tensor &d_input) {
+    if (d_input.get_local_size() > 0) {
+      backward_local(alpha, d_output, input, beta, d_input);
+    }
+    // Even when the local tensor is empty, the neighbors may expect
+    // to receive halos
+    cpu::internal::exchange_halo(d_input, m_halo_xch_d_input, true);
+    return 0;
+  }
+
+  // Wait for asynchronous tasks
+  void wait() {}
+
+ protected:
+  cpu::Backend &m_be;
+  int m_num_dims;
+  Window m_windows[NSD];
+  Mode m_mode = Mode::MAX;
+  std::unique_ptr<HaloExchangeType> m_halo_xch_input;
+  std::unique_ptr<HaloExchangeType> m_halo_xch_d_input;
+  // Deep halos: the output halo widths computed along with the
+  // interior, and whether the input halos are exchanged
+  int_vector m_fwd_compute_width;
+  bool m_fwd_exchange = true;
+
+  void get_taps(const cpu::internal::Geometry &x,
+                const cpu::internal::Geometry &y,
+                std::vector<ForwardTap> (&taps)[NSD]) const {
+    cpu::internal::get_taps(m_windows, taps, [&](int i, int f) {
+        return cpu::internal::get_forward_tap(x.spatial[i], y.spatial[i],
+                                              m_windows[i], f);
+      });
+  }
+
+  DataType get_divisor(int64_t count) const {
+    if (m_mode == Mode::AVERAGE_NO_PAD) {
+      return DataType(count);
+    }
+    return DataType(m_windows[0].size * m_windows[1].size
+                    * m_windows[2].size);
+  }
+
+  // Calls f with the offset from the channel of the real input of
+  // each tap of output (od, oh, ow) that is not padding
+  template <typename F>
+  void for_each_input(const std::vector<ForwardTap> (&taps)[NSD],
+                      const cpu::internal::Geometry &x,
+                      int64_t od, int64_t oh, int64_t ow, F &&f) const {
+    for (int fd = 0; fd < m_windows[2].size; ++fd) {
+      const auto &td = taps[2][fd];
+      if (od < td.begin || od >= td.begin + td.count) continue;
+      const int64_t xd = td.x_begin + (od - td.begin) * m_windows[2].stride;
+      for (int fh = 0; fh < m_windows[1].size; ++fh) {
+        const auto &th = taps[1][fh];
+        if (oh < th.begin || oh >= th.begin + th.count) continue;
+        const int64_t xh = th.x_begin + (oh - th.begin) * m_windows[1].stride;
+        for (int fw = 0; fw < m_windows[0].size; ++fw) {
+          const auto &tw = taps[0][fw];
+          if (ow < tw.begin || ow >= tw.begin + tw.count) continue;
+          const int64_t xw = tw.x_begin
+              + (ow - tw.begin) * m_windows[0].stride;
+          f(xd * x.spatial[2].stride + xh * x.spatial[1].stride + xw);
+        }
+      }
+    }
+  }
+
+  template <typename Tensor>
+  void backward_local(DataType alpha, const Tensor &d_output,
+                      const Tensor &input, DataType beta, Tensor &d_input) {
+    const auto x = cpu::internal::get_geometry(input);
+    const auto dx = cpu::internal::get_geometry(d_input);
+    const auto dy = cpu::internal::get_geometry(d_output);
+    // The input gradients are indexed as the input
+    assert_always(input.get_local_real_shape() ==
+                  d_input.get_local_real_shape());
+    std::vector<ForwardTap> taps[NSD];
+    get_taps(x, dy, taps);
+    const DataType *x_buf = input.get_const_buffer();
+    const DataType *dy_buf = d_output.get_const_buffer();
+    DataType *dx_buf = d_input.get_buffer();
+    const int64_t channel_size = dx.channel_stride;
+    const int64_t dy_rows = dy.get_num_rows();
+    const int64_t dx_rows = dx.get_num_rows();
+    // The gradients of a channel are scattered by one thread, so that
+    // no two threads update the same element
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int64_t n = 0; n < dx.num_samples; ++n) {
+      for (int64_t c = 0; c < dx.num_channels; ++c) {
+        const int64_t offset = n * dx.sample_stride + c * dx.channel_stride;
+        const DataType *xc = x_buf + offset;
+        DataType *dxc = dx_buf + offset;
+        // The halos only receive the scattered gradients, and the
+        // interior is scaled by beta
+        if (beta == DataType(0)) {
+          std::fill(dxc, dxc + channel_size, DataType(0));
+        } else {
+          std::vector<DataType> interior(dx.get_plane_size());
+          for (int64_t r = 0; r < dx_rows; ++r) {
+            const DataType *dxrow = dxc + dx.get_row_offset(r);
+            for (int64_t i = 0; i < dx.spatial[0].len; ++i) {
+              interior[r * dx.spatial[0].len + i] = beta * dxrow[i];
+            }
+          }
+          std::fill(dxc, dxc + channel_size, DataType(0));
+          for (int64_t r = 0; r < dx_rows; ++r) {
+            std::copy(interior.begin() + r * dx.spatial[0].len,
+                      interior.begin() + (r + 1) * dx.spatial[0].len,
+                      dxc + dx.get_row_offset(r));
+          }
+        }
+        const DataType *dyc = dy_buf + n * dy.sample_stride
+            + c * dy.channel_stride;
+        for (int64_t r = 0; r < dy_rows; ++r) {
+          const int64_t od = r / dy.spatial[1].len;
+          const int64_t oh = r % dy.spatial[1].len;
+          const DataType *dyrow = dyc + dy.get_row_offset(r);
+          for (int64_t ow = 0; ow < dy.spatial[0].len; ++ow) {
+            const DataType g = alpha * dyrow[ow];
+            if (m_mode == Mode::MAX) {
+              // The gradient goes to the first maximum only
+              int64_t argmax = -1;
+              DataType v = std::numeric_limits<DataType>::lowest();
+              for_each_input(taps, x, od, oh, ow, [&](int64_t i) {
+                  if (argmax < 0 || xc[i] > v) {
+                    v = xc[i];
+                    argmax = i;
+                  }
+                });
+              if (argmax >= 0) dxc[argmax] += g;
+            } else {
+              int64_t count = 0;
+              for_each_input(taps, x, od, oh, ow, [&](int64_t) { ++count; });
+              const DataType v = g / get_divisor(count);
+              for_each_input(taps, x, od, oh, ow, [&](int64_t i) {
+                  dxc[i] += v;
+                });
+            }
+          }
+        }
+      }
+    }
+  }
+};
+
+} // namespace distconv
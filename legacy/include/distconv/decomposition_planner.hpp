@@ -0,0 +1,173 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/tensor/distribution.hpp"
+#include "distconv/util/topology.hpp"
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+  Planner of the decomposition of a whole network.
+
+  Given the layers of a network, the topology map of the processes
+  and per-layer compute benchmarks, the planner chooses for each layer
+  the partitioning of its input over the sample, spatial and channel
+  dimensions, and where tensors are shuffled between layers, so that
+  the predicted time of a training step is minimal while the memory
+  of each process stays within a cap.
+
+  The time of a layer is the sum of its computation, halo exchanges,
+  channel/filter parallelism collectives and gradient allreduce.
+  Computation is calibrated with ComputeProfile from the times of
+  distconv_benchmark; communication is estimated link by link with
+  TopologyMap, with processes mapped to the grid in rank order as
+  the tensors do. Each layer is given a shortlist of candidate
+  decompositions, and the plan over the sequence of layers, including
+  the shuffles between differently decomposed neighbors, is found by
+  dynamic programming. The memory cap is enforced by penalizing
+  memory with a multiplier searched by bisection.
+
+  Planning does no communication, so all processes obtain the same
+  plan from the same inputs.
+ */
+
+namespace distconv {
+
+/**
+   Time of the computation of a layer as a function of the floating
+   point operations of a process, fitted as a + b * flops from
+   benchmark runs.
+ */
+class ComputeProfile {
+ public:
+  /** Seconds of forward and backward with flops per process. */
+  void add_sample(double flops, double seconds);
+
+  /**
+     Adds the rows of a metrics CSV file written by distconv_benchmark
+     with --metrics-file. Returns false if the file cannot be read or
+     has no flops, num_ranks and time columns.
+   */
+  bool load_benchmark_metrics(const std::string &path);
+
+  bool empty() const { return m_samples.empty(); }
+
+  /** Seconds of flops per process; zero without samples. */
+  double estimate(double flops) const;
+
+ private:
+  std::vector<std::pair<double, double>> m_samples;
+};
+
+class DecompositionPlanner {
+ public:
+  enum class LayerKind {CONVOLUTION, POOLING, ELEMENTWISE};
+
+  /**
+     Layer of a sequence, each taking the output of the previous one.
+     Shapes are in the tensor order, i.e., spatial dimensions from the
+     innermost, then channels and samples.
+   */
+  struct Layer {
+    std::string name;
+    LayerKind kind = LayerKind::ELEMENTWISE;
+    int_vector input_shape;
+    int_vector output_shape;
+    // Spatial dimensions of the filter or pooling window
+    int_vector kernel;
+    int_vector strides;
+    int_vector dilations;
+    ComputeProfile profile;
+  };
+
+  struct Options {
+    std::size_t type_size = sizeof(float);
+    // Bytes per process; zero for no cap
+    std::size_t memory_cap = 0;
+    // Decompositions kept per layer
+    int max_candidates = 16;
+    // Link model without a topology map
+    double latency = 5e-6;
+    double bandwidth = 1e10;
+  };
+
+  struct LayerPlan {
+    tensor::Shape locale_shape;
+    ChannelParallelismAlgorithm chanfilt_algo =
+        ChannelParallelismAlgorithm::NONE;
+    // Whether the input is shuffled from the output of the previous
+    // layer
+    bool shuffle_input = false;
+    tensor::Distribution input_dist;
+    tensor::Distribution output_dist;
+    // Predicted seconds
+    double compute_time = 0;
+    double halo_time = 0;
+    double chanfilt_time = 0;
+    double allreduce_time = 0;
+    double shuffle_time = 0;
+    // Bytes per process
+    std::size_t memory = 0;
+
+    double get_time() const {
+      return compute_time + halo_time + chanfilt_time + allreduce_time
+          + shuffle_time;
+    }
+  };
+
+  struct Plan {
+    std::vector<LayerPlan> layers;
+    double step_time = 0;
+    std::size_t memory = 0;
+  };
+
+  /**
+     Plans for num_procs processes. topology may be empty, in which
+     case all links follow the latency and bandwidth of opts.
+   */
+  DecompositionPlanner(int num_procs, const util::TopologyMap &topology,
+                       const Options &opts);
+  DecompositionPlanner(int num_procs, const util::TopologyMap &topology):
+      DecompositionPlanner(num_procs, topology, Options()) {}
+
+  /** Returns the index of layer. */
+  int add_layer(const Layer &layer);
+
+  /** Profile of the layers without samples of their own. */
+  void set_default_profile(const ComputeProfile &profile) {
+    m_default_profile = profile;
+  }
+
+  /**
+     Throws if no sequence of decompositions fits the memory cap.
+   */
+  Plan plan() const;
+
+  std::ostream &print(std::ostream &os, const Plan &plan) const;
+
+ private:
+  struct Candidate;
+
+  int m_num_procs;
+  const util::TopologyMap &m_topology;
+  Options m_opts;
+  std::vector<Layer> m_layers;
+  ComputeProfile m_default_profile;
+
+  std::vector<Candidate> get_candidates(int layer_idx) const;
+  void estimate(int layer_idx, Candidate &c) const;
+  double estimate_shuffle(const tensor::Shape &shape,
+                          const tensor::Shape &src_locale_shape,
+                          const tensor::Shape &dst_locale_shape) const;
+  double get_link_time(int src, int dst, std::size_t bytes) const;
+  double get_ring_step_time(const std::vector<int> &ranks,
+                            std::size_t bytes) const;
+  IntVector get_overlap(const Layer &layer,
+                        const tensor::Shape &locale_shape) const;
+};
+
+} // namespace distconv
@@ -8,6 +8,11 @@
 #include "distconv/tensor/tensor.hpp"
 #include "distconv/tensor/tensor_mpi.hpp"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
 namespace distconv {
 
 namespace internal {
@@ -17,7 +22,9 @@ inline IntType get_dilated_filter_size(IntType filter_size, IntType dilation) {
 }
 
 // Assumption: padding must match the size of the filter radius or not
-// used at all
+// used at all. filter_dims, strides and dilations are indexed by the
+// spatial dimension, whereas the halo sizes are indexed by the tensor
+// dimension.
 template <typename DataType, typename Locale, typename Allocator> inline
 void get_halo_sizes(const tensor::Tensor<DataType, Locale, Allocator> &input,
                     const IntVector &filter_dims,
@@ -39,18 +46,19 @@ void get_halo_sizes(const tensor::Tensor<DataType, Locale, Allocator> &input,
   const auto offset = input.get_global_index();
   // The spatial domains will shrink or expand based on the filter and
   // stride sizes
-  for (int i = 0; i < input.get_num_spatial_dims(); ++i) {
+  for (int si = 0; si < input.get_num_spatial_dims(); ++si) {
+    const int i = input.get_spatial_dim(si);
     // No halo required if not decomposed
     if (split_shape[i] == 1) continue;
     auto dilated_filter_dim = internal::get_dilated_filter_size(
-        filter_dims[i], dilations[i]);
+        filter_dims[si], dilations[si]);
     // allow even-shaped filter when no halo needed
     if (dilated_filter_dim % 2 == 0) {
-      assert_eq(strides[i], dilated_filter_dim);
+      assert_eq(strides[si], dilated_filter_dim);
       continue;
     }
     const auto radius = (dilated_filter_dim - 1) / 2;
-    const auto s = strides[i];
+    const auto s = strides[si];
     const auto off = offset[i];
     // Check the backward direction.
     if (split_idx[i] == 0) {
@@ -95,6 +103,153 @@ void get_halo_sizes(const tensor::Tensor<DataType, Locale, Allocator> &input,
     bwd_halo_send[i] = std::max(bwd_halo_send[i], 0);
     bwd_halo_recv[i] = std::max(bwd_halo_recv[i], 0);
 
+    // Partitions need not be even, but each must hold the halos it
+    // sends
+    if ((index_t)fwd_halo_send[i] > local_shape[i] ||
+        (index_t)bwd_halo_send[i] > local_shape[i]) {
+      util::MPIPrintStreamError()
+          << "Local partition smaller than its halo. Dim: " << i
+          << ", local shape: " << local_shape
+          << ", halo send: " << bwd_halo_send[i] << "/" << fwd_halo_send[i];
+      std::abort();
+    }
+  }
+}
+
+// Halo sizes of a transposed convolution (deconvolution) of input into
+// output. Output element j receives input element i when j = i * stride
+// - pad + f * dilation for a filter offset f, so unlike convolutions the
+// halos depend on the partitions of both tensors. When of_input is
+// true, the halo of the input whose elements the local output receives
+// is computed; otherwise, that of the output the local input reads in
+// the backward direction. Arguments are indexed as get_halo_sizes.
+template <typename DataType, typename Locale, typename Allocator> inline
+void get_deconv_halo_sizes(
+    const tensor::Tensor<DataType, Locale, Allocator> &input,
+    const tensor::Tensor<DataType, Locale, Allocator> &output,
+    const IntVector &filter_dims,
+    const IntVector &strides,
+    const IntVector &dilations,
+    const IntVector &pads,
+    bool of_input,
+    IntVector &fwd_halo_send,
+    IntVector &bwd_halo_send,
+    IntVector &fwd_halo_recv,
+    IntVector &bwd_halo_recv) {
+  const int ND = input.get_num_dims();
+  fwd_halo_send = IntVector(ND, 0);
+  bwd_halo_send = IntVector(ND, 0);
+  fwd_halo_recv = IntVector(ND, 0);
+  bwd_halo_recv = IntVector(ND, 0);
+  const auto &halo_tensor = of_input ? input : output;
+  const auto &split_shape = input.get_distribution().get_split_shape();
+  const auto proc_idx = input.get_proc_index();
+  const auto locale_shape = input.get_locale_shape();
+  for (int si = 0; si < input.get_num_spatial_dims(); ++si) {
+    const int i = input.get_spatial_dim(si);
+    if (split_shape[i] == 1) continue;
+    // Signed as the ranges can begin before the first element
+    using sindex_t = std::int64_t;
+    const sindex_t window = internal::get_dilated_filter_size(
+        filter_dims[si], dilations[si]);
+    const sindex_t s = strides[si];
+    const sindex_t p = pads[si];
+    const sindex_t in_dim = input.get_shape()[i];
+    const sindex_t out_dim = output.get_shape()[i];
+    // Halo widths received by the rank at index r of dimension i
+    auto get_recv = [&](index_t r) {
+      const sindex_t in_begin = input.get_dimension_rank_offset(i, r);
+      const sindex_t in_end = in_begin + input.get_remote_dimension(i, r);
+      const sindex_t out_begin = output.get_dimension_rank_offset(i, r);
+      const sindex_t out_end = out_begin + output.get_remote_dimension(i, r);
+      if (in_begin == in_end || out_begin == out_end) {
+        return std::make_pair(0, 0);
+      }
+      sindex_t begin, end, local_begin, local_end;
+      if (of_input) {
+        // Inputs received by the outputs [out_begin, out_end)
+        const sindex_t x = out_begin + p - (window - 1);
+        begin = x <= 0 ? 0 : (x + s - 1) / s;
+        end = std::min((out_end - 1 + p) / s + 1, in_dim);
+        local_begin = in_begin;
+        local_end = in_end;
+      } else {
+        // Outputs read by the inputs [in_begin, in_end)
+        begin = std::max(in_begin * s - p, sindex_t(0));
+        end = std::min((in_end - 1) * s - p + window, out_dim);
+        local_begin = out_begin;
+        local_end = out_end;
+      }
+      return std::make_pair(
+          (int)std::max(local_begin - begin, sindex_t(0)),
+          (int)std::max(end - local_end, sindex_t(0)));
+    };
+    const index_t r = proc_idx[i];
+    const auto recv = get_recv(r);
+    bwd_halo_recv[i] = recv.first;
+    fwd_halo_recv[i] = recv.second;
+    if (r > 0) {
+      bwd_halo_send[i] = get_recv(r - 1).second;
+    }
+    if (r < (index_t)locale_shape[i] - 1) {
+      fwd_halo_send[i] = get_recv(r + 1).first;
+    }
+    assert_always(bwd_halo_recv[i] <= halo_tensor.get_halo_width(i) &&
+                  fwd_halo_recv[i] <= halo_tensor.get_halo_width(i));
+  }
+}
+
+// Halo sizes of a causal convolution of stride one, where output
+// element j reads the input elements [j - (window - 1), j], i.e., the
+// input is padded only at the beginning. The input reads only the
+// halo of its backward neighbor and the output gradient only that of
+// its forward neighbor, so when of_input is true, the input halo is
+// computed, and otherwise that of the output gradient. The received
+// halo widths are set also at the ends of the dimensions, where they
+// stand for the padding. Arguments are indexed as get_halo_sizes.
+template <typename DataType, typename Locale, typename Allocator> inline
+void get_causal_halo_sizes(
+    const tensor::Tensor<DataType, Locale, Allocator> &tensor,
+    const IntVector &filter_dims,
+    const IntVector &strides,
+    const IntVector &dilations,
+    bool of_input,
+    IntVector &fwd_halo_send,
+    IntVector &bwd_halo_send,
+    IntVector &fwd_halo_recv,
+    IntVector &bwd_halo_recv) {
+  const int ND = tensor.get_num_dims();
+  fwd_halo_send = IntVector(ND, 0);
+  bwd_halo_send = IntVector(ND, 0);
+  fwd_halo_recv = IntVector(ND, 0);
+  bwd_halo_recv = IntVector(ND, 0);
+  const auto &split_shape = tensor.get_distribution().get_split_shape();
+  const auto split_idx = tensor.get_split_index();
+  const auto local_shape = tensor.get_local_shape();
+  for (int si = 0; si < tensor.get_num_spatial_dims(); ++si) {
+    const int i = tensor.get_spatial_dim(si);
+    assert_eq(strides[si], 1);
+    const int width = internal::get_dilated_filter_size(
+        filter_dims[si], dilations[si]) - 1;
+    const bool has_bwd = split_idx[i] > 0;
+    const bool has_fwd = split_idx[i] < split_shape[i] - 1;
+    if (of_input) {
+      bwd_halo_recv[i] = width;
+      fwd_halo_send[i] = has_fwd ? width : 0;
+    } else {
+      fwd_halo_recv[i] = width;
+      bwd_halo_send[i] = has_bwd ? width : 0;
+    }
+    if (tensor.get_halo_width(i) != width ||
+        (index_t)std::max(fwd_halo_send[i], bwd_halo_send[i]) >
+        local_shape[i]) {
+      util::MPIPrintStreamError()
+          << "Causal convolution requires halos as wide as the dilated "
+             "filter minus one and partitions no smaller than them. Dim: "
+          << i << ", halo width: " << tensor.get_halo_width(i)
+          << ", required: " << width << ", local shape: " << local_shape;
+      std::abort();
+    }
   }
 }
 
@@ -132,6 +287,145 @@ inline tensor::Distribution make_strided_sample_distribution(
       proc_shape, split_shape);
 }
 
+namespace internal {
+// Node of each process of comm, identified by the lowest rank on the
+// node
+inline int_vector get_node_ids(MPI_Comm comm) {
+  int rank;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &rank));
+  MPI_Comm node_comm;
+  DISTCONV_CHECK_MPI(MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank,
+                                         MPI_INFO_NULL, &node_comm));
+  int node_id = rank;
+  DISTCONV_CHECK_MPI(MPI_Bcast(&node_id, 1, MPI_INT, 0, node_comm));
+  DISTCONV_CHECK_MPI(MPI_Comm_free(&node_comm));
+  int num_procs;
+  DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &num_procs));
+  int_vector node_ids(num_procs);
+  DISTCONV_CHECK_MPI(MPI_Allgather(&node_id, 1, MPI_INT, node_ids.data(), 1,
+                                   MPI_INT, comm));
+  return node_ids;
+}
+
+// Halo elements sent by all processes with locale_shape, and those
+// sent across nodes
+inline void get_halo_volumes(const int_vector &shape,
+                             const IntVector &overlap,
+                             const tensor::Shape &locale_shape,
+                             const int_vector &node_ids,
+                             size_t &total, size_t &inter_node) {
+  const int nd = shape.size();
+  total = 0;
+  inter_node = 0;
+  for (int rank = 0; rank < (int)node_ids.size(); ++rank) {
+    IndexVector idx(nd, 0);
+    for (int i = 0, r = rank; i < nd; ++i) {
+      idx[i] = r % locale_shape[i];
+      r /= locale_shape[i];
+    }
+    for (int d = 0; d < nd; ++d) {
+      if (overlap[d] == 0 || locale_shape[d] == 1) continue;
+      size_t face = overlap[d];
+      for (int e = 0; e < nd; ++e) {
+        if (e == d) continue;
+        face *= util::ceil(shape[e], (int)locale_shape[e]);
+      }
+      // Both directions between the process and its RHS neighbor
+      if (idx[d] + 1 == locale_shape[d]) continue;
+      auto peer_idx = idx;
+      ++peer_idx[d];
+      const int peer = tensor::get_offset(peer_idx, locale_shape);
+      total += face * 2;
+      if (node_ids[rank] != node_ids[peer]) {
+        inter_node += face * 2;
+      }
+    }
+  }
+}
+
+inline void find_spatial_locale_shape(const int_vector &shape,
+                                      const IntVector &overlap,
+                                      const int_vector &spatial_dims,
+                                      int num_procs, int si,
+                                      tensor::Shape &locale_shape,
+                                      const int_vector &node_ids,
+                                      tensor::Shape &best,
+                                      size_t &best_total,
+                                      size_t &best_inter_node) {
+  const int d = spatial_dims[si];
+  if (si + 1 == (int)spatial_dims.size()) {
+    // Each process must have at least its halo width of the dimension
+    if (num_procs > shape[d] / std::max(overlap[d], 1)) return;
+    locale_shape[d] = num_procs;
+    size_t total, inter_node;
+    get_halo_volumes(shape, overlap, locale_shape, node_ids,
+                     total, inter_node);
+    if (inter_node < best_inter_node ||
+        (inter_node == best_inter_node && total < best_total)) {
+      best = locale_shape;
+      best_total = total;
+      best_inter_node = inter_node;
+    }
+    return;
+  }
+  for (int p = 1; p <= num_procs; ++p) {
+    if (num_procs % p || p > shape[d] / std::max(overlap[d], 1)) continue;
+    locale_shape[d] = p;
+    find_spatial_locale_shape(shape, overlap, spatial_dims, num_procs / p,
+                              si + 1, locale_shape, node_ids, best,
+                              best_total, best_inter_node);
+  }
+}
+} // namespace internal
+
+// Partitions each sample over num_spatial_procs processes and the
+// samples over the rest. The spatial partitioning minimizes the halo
+// volume exchanged across nodes, and then the total halo volume,
+// given the nodes where the processes of comm actually are. Processes
+// map to the grid in rank order, so this keeps the largest faces
+// within a node, where P2P can exchange them. overlap is the halo
+// width of each tensor dimension. Collective over comm.
+inline tensor::Distribution make_topology_aware_distribution(
+    const int_vector &shape, const IntVector &overlap,
+    int num_spatial_procs, MPI_Comm comm,
+    tensor::Layout layout=tensor::Layout::CHANNELS_FIRST) {
+  const int nd = shape.size();
+  assert_always(nd > 2);
+  int num_procs;
+  DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &num_procs));
+  assert0(num_procs % num_spatial_procs);
+  const auto node_ids = internal::get_node_ids(comm);
+  int_vector spatial_dims;
+  for (int i = 0; i < nd - 2; ++i) {
+    spatial_dims.push_back(tensor::get_spatial_dim(layout, i));
+  }
+  tensor::Shape locale_shape(nd, 1);
+  locale_shape[get_sample_dim()] = num_procs / num_spatial_procs;
+  auto best = locale_shape;
+  size_t best_total = std::numeric_limits<size_t>::max();
+  size_t best_inter_node = std::numeric_limits<size_t>::max();
+  internal::find_spatial_locale_shape(shape, overlap, spatial_dims,
+                                      num_spatial_procs, 0, locale_shape,
+                                      node_ids, best, best_total,
+                                      best_inter_node);
+  if (best_total == std::numeric_limits<size_t>::max()) {
+    util::MPIPrintStreamError()
+        << "No spatial partitioning of " << util::join_array(shape, " ")
+        << " over " << num_spatial_procs << " processes";
+    std::abort();
+  }
+  IntVector locale_overlap(nd, 0);
+  for (int d: spatial_dims) {
+    if (best[d] > 1) locale_overlap[d] = overlap[d];
+  }
+  util::MPIRootPrintStreamInfo()
+      << "Topology-aware locale shape: " << best
+      << ", halo volume across nodes: " << best_inter_node
+      << " of " << best_total;
+  return tensor::Distribution::make_overlapped_distribution(best,
+                                                            locale_overlap);
+}
+
 template <typename DataType, typename Locale, typename Alloccator> inline
 tensor::Shape get_pooling_output_local_tensor_shape(
     const tensor::Tensor<DataType, Locale, Alloccator> &input,
@@ -146,16 +440,17 @@ tensor::Shape get_pooling_output_local_tensor_shape(
                            fwd_halo_send, bwd_halo_send,
                            fwd_halo_recv, bwd_halo_recv, with_padding);
 
-  for (int i = 0; i < nsd; ++i) {
+  for (int si = 0; si < nsd; ++si) {
+    const int i = input.get_spatial_dim(si);
     util::MPIPrintStreamDebug()
         << "i: " << i
         << ", input_local_shape: " << input_local_shape[i]
         << ", bwd_halo_recv: " << bwd_halo_recv[i]
         << ", fwd_halo_recv: " << fwd_halo_recv[i]
-        << ", filter_dims: " << filter_dims[i]
+        << ", filter_dims: " << filter_dims[si]
         << ", padding: " << with_padding;
     int dilated_filter_dim = internal::get_dilated_filter_size(
-        filter_dims[i], dilations[i]);
+        filter_dims[si], dilations[si]);
     int dim_with_halo_padding = input_local_shape[i] +
         bwd_halo_recv[i] + fwd_halo_recv[i];
     // Halo size is 0 when not partitioned, but its logical size
@@ -171,12 +466,14 @@ tensor::Shape get_pooling_output_local_tensor_shape(
       output_local_shape[i] = 0;
     } else {
       output_local_shape[i] = util::ceil(
-          dim_with_halo_padding - dilated_filter_dim + 1, strides[i]);
+          dim_with_halo_padding - dilated_filter_dim + 1, strides[si]);
     }
   }
   return output_local_shape;
 }
 
+// filter_shape is in the order of channels-first tensors regardless of
+// the layout of input.
 template <typename DataType, typename Locale, typename Allocator>
 tensor::Shape get_convolution_output_local_tensor_shape(
     const tensor::Tensor<DataType, Locale, Allocator> &input,
@@ -187,18 +484,21 @@ tensor::Shape get_convolution_output_local_tensor_shape(
       get_pooling_output_local_tensor_shape(
           input, filter_shape, strides, with_padding, dilations);
   // channel size - only if not doing channel parallelism.
+  const int cd = input.get_channel_dim();
   auto input_split_shape = input.get_distribution().get_split_shape();
-  if (input_split_shape[-2] == 1) {
-    assert_eq((int)output_local_shape[-2],
+  if (input_split_shape[cd] == 1) {
+    assert_eq((int)output_local_shape[cd],
               *(filter_shape.rbegin() + 1) * num_groups);
-    output_local_shape[-2] = filter_shape.back();
+    output_local_shape[cd] = filter_shape.back();
   } else {
-    assert0(filter_shape.back() % input_split_shape[-2]);
-    output_local_shape[-2] = filter_shape.back() / input_split_shape[-2];
+    assert0(filter_shape.back() % input_split_shape[cd]);
+    output_local_shape[cd] = filter_shape.back() / input_split_shape[cd];
   }
   return output_local_shape;
 }
 
+// filter_dims is in the order of channels-first tensors regardless of
+// the layout of input.
 template <typename DataType, typename Locale, typename Allocator>
 tensor::Shape get_deconvolution_output_local_tensor_shape(
     const tensor::Tensor<DataType, Locale, Allocator> &input,
@@ -208,43 +508,44 @@ tensor::Shape get_deconvolution_output_local_tensor_shape(
   const int nsd = input.get_num_spatial_dims();
   const auto input_local_shape = input.get_local_shape();
   auto output_local_shape = input.get_local_shape();
-  IntVector fwd_halo_send, bwd_halo_send, fwd_halo_recv, bwd_halo_recv;
-  internal::get_halo_sizes(input, IntVector(filter_dims),
-                           IntVector(strides), IntVector(dilations),
-                           fwd_halo_send, bwd_halo_send,
-                           fwd_halo_recv, bwd_halo_recv, with_padding);
+  const auto &split_idx = input.get_split_index();
+  const auto &split_shape = input.get_distribution().get_split_shape();
 
-  for (int i = 0; i < nsd; ++i) {
+  for (int si = 0; si < nsd; ++si) {
+    const int i = input.get_spatial_dim(si);
     util::MPIPrintStreamDebug()
         << "i: " << i
         << ", input_local_shape: " << input_local_shape[i]
-        << ", bwd_halo_recv: " << bwd_halo_recv[i]
-        << ", fwd_halo_recv: " << fwd_halo_recv[i]
-        << ", filter_dims: " << filter_dims[i]
+        << ", filter_dims: " << filter_dims[si]
         << ", padding: " << with_padding;
     int dilated_filter_dim = internal::get_dilated_filter_size(
-        filter_dims[i], dilations[i]);
-    int dim = (input_local_shape[i]-1) * strides[i] + dilated_filter_dim;
-    dim -= bwd_halo_recv[i] + fwd_halo_recv[i];
-    // Halo size is 0 when not partitioned, but its logical size
-    // includes the padding. At this point, padding size is either
-    // zero or exact match with the stencil size.
-    if (with_padding &&
-        input.get_distribution().get_split_shape()[i] == 1) {
-      dim -= dilated_filter_dim - 1;
+        filter_dims[si], dilations[si]);
+    // Each partition of the output begins at the stride times the
+    // beginning of that of the input, so the library deconvolution
+    // of the local domains only differs from the global one in its
+    // padding. The last one ends where the global output ends.
+    int dim = input_local_shape[i] * strides[si];
+    if (split_idx[i] == split_shape[i] - 1) {
+      dim += dilated_filter_dim - strides[si];
+      // At this point, padding size is either zero or exact match
+      // with the stencil size.
+      if (with_padding) {
+        dim -= dilated_filter_dim - 1;
+      }
     }
     output_local_shape[i] = dim;
   }
 
   // channel size - only if not doing channel parallelism.
+  const int cd = input.get_channel_dim();
   auto input_split_shape = input.get_distribution().get_split_shape();
-  if (input_split_shape[-2] == 1) {
-    assert_eq((int)output_local_shape[-2],
+  if (input_split_shape[cd] == 1) {
+    assert_eq((int)output_local_shape[cd],
               filter_dims.back() * num_groups);
-    output_local_shape[-2] = *(filter_dims.rbegin() + 1);
+    output_local_shape[cd] = *(filter_dims.rbegin() + 1);
   } else {
-    assert0(*(filter_dims.rbegin()+1) % input_split_shape[-2]);
-    output_local_shape[-2] = *(filter_dims.rbegin()+1) / input_split_shape[-2];
+    assert0(*(filter_dims.rbegin()+1) % input_split_shape[cd]);
+    output_local_shape[cd] = *(filter_dims.rbegin()+1) / input_split_shape[cd];
   }
 
   return output_local_shape;
@@ -257,23 +558,29 @@ Tensor create_input_tensor(const int_vector &shape,
                            const int_vector &strides,
                            const int_vector &dilations,
                            bool deconv,
-                           MPI_Comm comm) {
+                           MPI_Comm comm,
+                           tensor::Layout layout =
+                           tensor::Layout::CHANNELS_FIRST) {
   const int nd = shape.size();
   const int nsd = nd - 2;
   IntVector overlap(nd, 0);
-  if (!deconv) {
-    for (int i = 0; i < nsd; ++i) {
-      if (locale_shape[i] == 1) continue;
-      auto df = internal::get_dilated_filter_size(
-          filter_dims[i], dilations[i]);
-      if (df % 2) {
-        int overlap_i = (df - 1) / 2;
-        overlap[i] = overlap_i;
-      } else {
-        // allows even-shaped filters when a stride of the equal size
-        // is used
-        assert_always(df == strides[i]);
+  for (int i = 0; i < nsd; ++i) {
+    const int d = tensor::get_spatial_dim(layout, i);
+    if (locale_shape[d] == 1) continue;
+    auto df = internal::get_dilated_filter_size(
+        filter_dims[i], dilations[i]);
+    if (df % 2) {
+      int overlap_i = (df - 1) / 2;
+      // A deconvolution output receives an input element for every
+      // stride output elements
+      if (deconv) {
+        overlap_i = util::ceil(overlap_i, strides[i]);
       }
+      overlap[d] = overlap_i;
+    } else {
+      // allows even-shaped filters when a stride of the equal size
+      // is used
+      assert_always(df == strides[i]);
     }
   }
   auto dist = tensor::Distribution::make_overlapped_distribution(
@@ -283,6 +590,7 @@ Tensor create_input_tensor(const int_vector &shape,
   tensor::Shape division_block(nd, 0);
   Tensor t = Tensor(tensor::Shape(shape), loc, dist,
                     division_shape, division_block);
+  t.set_layout(layout);
   util::MPIPrintStreamDebug() << "Input tensor: " << t;
   return t;
 }
@@ -293,6 +601,7 @@ Tensor create_d_input_tensor(const Tensor &input) {
                     input.get_distribution(),
                     input.get_requested_local_shape(),
                     input.get_requested_local_block());
+  t.set_layout(input.get_layout());
   util::MPIPrintStreamDebug() << "D_input tensor: " << t;
   return t;
 }
@@ -308,15 +617,18 @@ Tensor create_filter_tensor(const int_vector &locale_shape,
   const int nd = locale_shape.size();
   const int nsd = nd - 2;
   assert_eq(nsd, (int)filter_dims.size());
+  // Filters are stored in the same layout as input
+  const int cd = input.get_channel_dim();
   tensor::Shape filter_shape(nd, 0);
   for (int i = 0; i < nsd; ++i) {
-    filter_shape[i] = filter_dims[i];
+    filter_shape[input.get_spatial_dim(i)] = filter_dims[i];
   }
   auto filter_locale_shape = tensor::Shape(locale_shape);
   auto split_shape = tensor::Shape(nd, 1);
-  if (filter_locale_shape[-2] > 1) {
+  if (filter_locale_shape[cd] > 1) {
     // Handle channel/filter parallelism.
     assert(num_groups == 1);  // No grouped convolution for now.
+    assert_always(input.get_layout() == tensor::Layout::CHANNELS_FIRST);
     if (chanfilt_algo == ChannelParallelismAlgorithm::X) {
       filter_locale_shape[-1] = 1;
       split_shape[-2] = filter_locale_shape[-2];
@@ -341,7 +653,7 @@ Tensor create_filter_tensor(const int_vector &locale_shape,
       split_shape[-2] = filter_locale_shape[-2];
     }
   }
-  filter_shape[-2] = num_channels / num_groups;
+  filter_shape[cd] = num_channels / num_groups;
   filter_shape[-1] = num_filters;
   auto dist = tensor::Distribution::make_shared_distribution(
     filter_locale_shape, split_shape);
@@ -350,6 +662,7 @@ Tensor create_filter_tensor(const int_vector &locale_shape,
     << " split shape: " << dist.get_split_shape();
   Tensor t = Tensor(filter_shape, input.get_sub_locale_except_dim(-1),
                     dist);
+  t.set_layout(input.get_layout());
   util::MPIPrintStreamDebug() << "Filter tensor: " << t;
   return t;
 }
@@ -358,6 +671,7 @@ template <typename Tensor>
 Tensor create_d_filter_tensor(const Tensor &filter) {
   Tensor t = Tensor(filter.get_shape(), filter.get_locale(),
                     filter.get_distribution());
+  t.set_layout(filter.get_layout());
   util::MPIPrintStreamDebug() << "D_filter tensor: " << t;
   return t;
 }
@@ -373,16 +687,19 @@ Tensor create_convolution_output_tensor(
   const int nsd = input.get_num_spatial_dims();
   const bool use_padding = pad[0] != 0;
 
+  assert_always(filter.get_layout() == input.get_layout());
+
   tensor::Shape output_shape(nd, 0);
   for (int i = 0; i < nsd; ++i) {
+    const int d = input.get_spatial_dim(i);
     auto df = internal::get_dilated_filter_size<int>(
-        filter.get_shape()[i], dilations[i]);
+        filter.get_shape()[d], dilations[i]);
     assert0((df - 1) % 2);
     assert_always(pad[i] * 2 + 1 == df || pad[i] == 0);
-    if (input.get_shape()[i] + pad[i] * 2 < (index_t)df) {
-      output_shape[i] = 0;
+    if (input.get_shape()[d] + pad[i] * 2 < (index_t)df) {
+      output_shape[d] = 0;
     } else {
-      output_shape[i] = util::ceil(input.get_shape()[i] - df + 1 + pad[i] * 2,
+      output_shape[d] = util::ceil(input.get_shape()[d] - df + 1 + pad[i] * 2,
                                    (index_t)strides[i]);
     }
     // padding only for height or width is not considered
@@ -392,22 +709,27 @@ Tensor create_convolution_output_tensor(
       assert0(pad[i]);
     }
   }
-  output_shape[-2] = filter.get_shape()[-1];
+  output_shape[input.get_channel_dim()] = filter.get_shape()[-1];
   output_shape[-1] = input.get_shape()[-1];
 
   auto dist = input.get_distribution();
   dist.clear_overlap();
+  // The local shape follows the partition of input
+  dist.clear_partitions();
 
   util::MPIPrintStreamDebug() << "output_tensor: output_shape: " << output_shape << " dist: " << dist;
 
   tensor::Shape division_shape =
       get_convolution_output_local_tensor_shape(
-          input, filter.get_shape().template get_vector<int>(),
+          input,
+          tensor::to_channels_first(filter.get_layout(), filter.get_shape(),
+                                    nd).template get_vector<int>(),
           strides, use_padding, dilations, num_groups);
   tensor::Shape division_block(nd, 0);
 
   Tensor t = Tensor(output_shape, input.get_locale(),
                     dist, division_shape, division_block);
+  t.set_layout(input.get_layout());
   util::MPIPrintStreamDebug() << "Output tensor: " << t;
   return t;
 }
@@ -423,31 +745,38 @@ Tensor create_deconvolution_output_tensor(
   const int nsd = input.get_num_spatial_dims();
   const bool use_padding = pad[0] != 0;
 
-  // no padding is assumed
-  assert_always(!use_padding);
+  assert_always(filter.get_layout() == input.get_layout());
 
   tensor::Shape output_shape(nd, 0);
   for (int i = 0; i < nsd; ++i) {
+    const int d = input.get_spatial_dim(i);
     auto df = internal::get_dilated_filter_size<int>(
-        filter.get_shape()[i], dilations[i]);
-    output_shape[i] = (input.get_shape()[i] - 1) * strides[i]  + df;
+        filter.get_shape()[d], dilations[i]);
+    output_shape[d] = (input.get_shape()[d] - 1) * strides[i]  + df
+        - 2 * pad[i];
   }
-  output_shape[-2] = filter.get_shape()[-2];
+  output_shape[input.get_channel_dim()] =
+      filter.get_shape()[filter.get_channel_dim()];
   output_shape[-1] = input.get_shape()[-1];
 
   auto dist = input.get_distribution();
   dist.clear_overlap();
+  // The local shape follows the partition of input
+  dist.clear_partitions();
 
   util::MPIPrintStreamDebug() << "output_tensor: output_shape: " << output_shape << " dist: " << dist;
 
   tensor::Shape division_shape =
       get_deconvolution_output_local_tensor_shape(
-          input, filter.get_shape().template get_vector<int>(),
+          input,
+          tensor::to_channels_first(filter.get_layout(), filter.get_shape(),
+                                    nd).template get_vector<int>(),
           strides, use_padding, dilations, num_groups);
   tensor::Shape division_block(nd, 0);
 
   Tensor t = Tensor(output_shape, input.get_locale(),
                     dist, division_shape, division_block);
+  t.set_layout(input.get_layout());
   util::MPIPrintStreamDebug() << "Output tensor: " << t;
   return t;
 }
@@ -462,12 +791,13 @@ Tensor create_convolution_d_output_tensor(const Tensor &output,
   IntVector overlap(nd, 0);
 
   for (int i = 0; i < nsd; ++i) {
+    const int d = output.get_spatial_dim(i);
     int f = internal::get_dilated_filter_size(
-        (int)filter.get_shape()[i], dilations[i]);
+        (int)filter.get_shape()[d], dilations[i]);
     index_t stencil = (f - 1) / 2;
     assert0((f - 1) % 2);
-    if (dist.get_locale_shape()[i] > 1) {
-      overlap[i] = stencil;
+    if (dist.get_locale_shape()[d] > 1) {
+      overlap[d] = stencil;
     }
   }
   dist.set_overlap(overlap);
@@ -476,6 +806,7 @@ Tensor create_convolution_d_output_tensor(const Tensor &output,
   Tensor t = Tensor(output.get_shape(), output.get_locale(),
                     dist, output.get_local_shape(),
                     division_block);
+  t.set_layout(output.get_layout());
   util::MPIPrintStreamDebug() << "D_output tensor: " << t;
   return t;
 }
@@ -483,15 +814,28 @@ Tensor create_convolution_d_output_tensor(const Tensor &output,
 template <typename Tensor>
 Tensor create_deconvolution_d_output_tensor(const Tensor &output,
                                             const Tensor &filter,
+                                            const int_vector &strides,
+                                            const int_vector &pads,
                                             const int_vector &dilations) {
-  // This only works for the U-Net case
   const int nd = output.get_num_dims();
+  const int nsd = output.get_num_spatial_dims();
   auto dist = output.get_distribution();
   IntVector overlap(nd, 0);
+  for (int i = 0; i < nsd; ++i) {
+    const int d = output.get_spatial_dim(i);
+    if (dist.get_locale_shape()[d] == 1) continue;
+    int f = internal::get_dilated_filter_size(
+        (int)filter.get_shape()[d], dilations[i]);
+    // The local d_input reads pads[i] elements before the local
+    // d_output and f - pads[i] - strides[i] after it
+    overlap[d] = std::max(std::max(pads[i], f - pads[i] - strides[i]), 0);
+  }
+  dist.set_overlap(overlap);
   tensor::Shape division_block(nd, 0);
   Tensor t = Tensor(output.get_shape(), output.get_locale(),
                     dist, output.get_local_shape(),
                     division_block);
+  t.set_layout(output.get_layout());
   util::MPIPrintStreamDebug() << "D_output tensor: " << t;
   return t;
 }
@@ -501,8 +845,10 @@ Tensor create_bias_tensor(const Tensor &output) {
   auto dist = tensor::Distribution::make_shared_distribution(
       output.get_distribution().get_locale_shape());
   tensor::Shape bias_shape(output.get_num_dims(), 1);
-  bias_shape[get_channel_dim()] = output.get_shape()[get_channel_dim()];
+  const int cd = output.get_channel_dim();
+  bias_shape[cd] = output.get_shape()[cd];
   Tensor t = Tensor(bias_shape, output.get_locale(), dist);
+  t.set_layout(output.get_layout());
   util::MPIPrintStreamDebug() << "Bias tensor: " << t;
   return t;
 }
@@ -524,8 +870,9 @@ Tensor create_pooling_output_tensor(const Tensor &input,
   bool use_padding = pad[0] != 0;
   auto output_shape = input.get_shape();
   for (int i = 0; i < nsd; ++i) {
-    if (output_shape[i] + pad[i] * 2 < (index_t)window[i]) {
-      output_shape[i] = 0;
+    const int d = input.get_spatial_dim(i);
+    if (output_shape[d] + pad[i] * 2 < (index_t)window[i]) {
+      output_shape[d] = 0;
       continue;
     }
     if (window[i] % 2) {
@@ -536,17 +883,19 @@ Tensor create_pooling_output_tensor(const Tensor &input,
       } else {
         assert0(pad[i]);
       }
-      output_shape[i] = util::ceil(
-          output_shape[i] - window[i] + 1 + pad[i] * 2,
+      output_shape[d] = util::ceil(
+          output_shape[d] - window[i] + 1 + pad[i] * 2,
           (index_t)strides[i]);
     } else {
       assert_always(pad[i] == 0);
       assert_always(strides[i] == window[i]);
-      output_shape[i] /= strides[i];
+      output_shape[d] /= strides[i];
     }
   }
   auto dist = input.get_distribution();
   dist.clear_overlap();
+  // The local shape follows the partition of input
+  dist.clear_partitions();
 
   int_vector dilations(nsd, 1);
   tensor::Shape division_shape =
@@ -561,6 +910,7 @@ Tensor create_pooling_output_tensor(const Tensor &input,
 
   Tensor t = Tensor(output_shape, input.get_locale(),
                     dist, division_shape, division_block);
+  t.set_layout(input.get_layout());
   return t;
 }
 
@@ -569,6 +919,7 @@ Tensor create_pooling_d_output_tensor(const Tensor &output) {
   Tensor t = Tensor(output.get_shape(), output.get_locale(),
                     output.get_distribution(), output.get_local_shape(),
                     tensor::Shape(output.get_num_dims(), 0));
+  t.set_layout(output.get_layout());
   util::MPIPrintStreamDebug()
       << "D_output tensor. global_shape: "
       << t.get_shape()
@@ -578,11 +929,14 @@ Tensor create_pooling_d_output_tensor(const Tensor &output) {
   return t;
 }
 
+// With parallel_io, binary dumps of distributed tensors are written by
+// all ranks through MPI-IO instead of being gathered to rank 0.
 template <typename DataType, typename Alloccator>
 inline int dump_tensor(
     const tensor::Tensor<DataType, tensor::LocaleMPI, Alloccator> &t_mpi,
     std::string file_path,
-    bool binary=false) {
+    bool binary=false,
+    bool parallel_io=false) {
 
   if (binary) {
     file_path += ".out";
@@ -595,6 +949,10 @@ inline int dump_tensor(
         << "Dumping " << t_mpi << " to " << file_path;
   }
 
+  if (binary && parallel_io && t_mpi.get_distribution().is_distributed()) {
+    return tensor::WriteFile(t_mpi, file_path);
+  }
+
   using TensorProcType = tensor::Tensor<DataType,
                                         tensor::LocaleProcess,
                                         tensor::BaseAllocator>;
@@ -675,6 +1033,13 @@ inline int dump_local_tensor(
 // Reference backend
 #include "distconv/ref/backend.hpp"
 
+// Multithreaded CPU backend
+#include "distconv/cpu/backend.hpp"
+#include "distconv/cpu/batchnorm.hpp"
+#include "distconv/cpu/convolution.hpp"
+#include "distconv/cpu/deep_halo.hpp"
+#include "distconv/cpu/pooling.hpp"
+
 #ifdef DISTCONV_HAS_CUDNN
 #include "distconv/dnn_backend/backend.hpp"
 #endif
@@ -0,0 +1,114 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <mpi.h>
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace distconv
+{
+
+/** @brief Persistent cache of autotuned convolution algorithms.
+ *
+ *  Entries are keyed by a string that fully describes a convolution
+ *  problem (direction, descriptors, group count, library version and
+ *  device architecture) and record the selected algorithm together
+ *  with the workspace size it requires. Algorithms are stored as
+ *  plain integers so that the cache does not depend on the DNN
+ *  library in use.
+ *
+ *  The cache can be read from and written to a text file with one
+ *  entry per line: "<algo> <workspace size> <key>".
+ *
+ *  Lookups and insertions may be made concurrently by layers run from
+ *  different threads. A problem missed by several of them at once is
+ *  tuned by each.
+ */
+class ConvAlgoCache
+{
+public:
+    struct Entry
+    {
+        int algo;
+        size_t ws_size;
+    };
+
+    /** @brief Runs the actual search under a workspace limit. */
+    using TuneFunc = std::function<Entry(size_t ws_limit)>;
+
+    /** @brief Find the algorithm cached for key.
+     *
+     *  An entry is only returned if its workspace requirement fits in
+     *  ws_limit.
+     */
+    bool lookup(const std::string& key, size_t ws_limit, int& algo) const;
+
+    void insert(const std::string& key, int algo, size_t ws_size);
+
+    /** @brief Return the cached algorithm for key, calling tune and
+     *  caching its result on a miss.
+     */
+    int get_or_tune(const std::string& key, size_t ws_limit, TuneFunc tune);
+
+    /** @brief Collective version of get_or_tune.
+     *
+     *  Ranks of comm that pass the same key form a group. Only the
+     *  first rank of each group looks up the cache or runs tune,
+     *  using the smallest ws_limit of the group, and the result is
+     *  broadcast to the other members. All ranks of comm must call
+     *  this in the same order.
+     */
+    int get_or_tune_collectively(const std::string& key,
+                                 size_t ws_limit,
+                                 MPI_Comm comm,
+                                 TuneFunc tune);
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
+
+    /** @brief Whether entries were added since the last load/save. */
+    bool is_dirty() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_dirty;
+    }
+
+    /** @brief Read the cache file at path on rank 0 of comm and
+     *  broadcast the entries. Collective over comm.
+     *
+     *  A missing file is not an error; the cache is left empty.
+     */
+    void load(const std::string& path, MPI_Comm comm);
+
+    /** @brief Merge the entries of all ranks in comm and write them
+     *  to path from rank 0. Collective over comm.
+     */
+    void save(const std::string& path, MPI_Comm comm);
+
+private:
+    mutable std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries;
+    bool m_dirty = false;
+
+    bool lookup_entry(const std::string& key,
+                      size_t ws_limit,
+                      Entry& entry) const;
+
+    std::string serialize() const;
+    static MPI_Comm split_comm_by_key(const std::string& key, MPI_Comm comm);
+    void deserialize(const std::string& str);
+};
+
+} // namespace distconv
@@ -5,6 +5,7 @@
 #include <distconv_config.hpp>
 
 #include "pack_unpack.hpp"
+#include "distconv/util/ranges.hpp"
 
 #if H2_HAS_CUDA
 #include "backend_cudnn.hpp"
@@ -15,9 +16,6 @@ namespace dnn_lib = cudnn;
 namespace backend = dnn_lib;
 } // namespace distconv
 
-#define GPU_PROFILE_RANGE_POP nvtxRangePop
-#define GPU_PROFILE_RANGE_PUSH nvtxRangePushA
-
 #elif H2_HAS_ROCM
 #include "backend_miopen.hpp"
 namespace distconv
@@ -27,9 +25,15 @@ namespace dnn_lib = miopen;
 namespace backend = dnn_lib;
 } // namespace distconv
 
-#define GPU_PROFILE_RANGE_POP roctxRangePop
-#define GPU_PROFILE_RANGE_PUSH roctxRangePushA
-
 #endif
 
+// Ranges of the layer operations, which are pushed when the NVTX
+// marking of the backend is enabled
+#define GPU_PROFILE_RANGE_PUSH(name)                                           \
+    ::h2::gpu::range_push(::distconv::util::get_range_domain(),                \
+                          name,                                                \
+                          ::h2::gpu::RangeCategory::Compute)
+#define GPU_PROFILE_RANGE_POP()                                                \
+    ::h2::gpu::range_pop(::distconv::util::get_range_domain())
+
 #endif // H2_LEGACY_INCLUDE_DISTCONV_CUDNN_BACKEND_HPP_INCLUDED
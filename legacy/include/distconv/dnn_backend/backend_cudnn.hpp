@@ -7,14 +7,20 @@
 #pragma once
 
 #include "distconv/base.hpp"
+#include "distconv/dnn_backend/algo_cache.hpp"
+#include "distconv/dnn_backend/cudnn_graph.hpp"
+#include "distconv/dnn_backend/workspace_arena.hpp"
 #include "distconv/layers.hpp"
+#include "distconv/tensor/algorithms/common.hpp"
 #include "distconv/tensor/memory.hpp"
 #include "distconv/tensor/tensor_cuda.hpp"
 #include "distconv/tensor/tensor_mpi.hpp"
 #include "distconv/tensor/tensor_mpi_cuda.hpp"
+#include "distconv/util/memory_accounting.hpp"
 #include "distconv/util/util.hpp"
 #include "distconv/util/util_cuda.hpp"
 #include "distconv/util/util_cudnn.hpp"
+#include "h2/gpu/runtime.hpp"
 
 #ifdef DISTCONV_HAS_P2P
 #include "p2p/p2p.hpp"
@@ -23,9 +29,17 @@
 #include <cudnn.h>
 #include <nvToolsExt.h>
 
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <cuda_profiler_api.h>
 
@@ -88,6 +102,16 @@ inline Handle_t make_handle()
     return handle;
 }
 
+/** @brief Create a handle on the initialization thread of H2.
+ *
+ *  Handles take a while to create, so this lets startup go on until
+ *  the handle is first needed. See h2::gpu::submit_init_task.
+ */
+inline std::future<Handle_t> make_handle_async()
+{
+    return h2::gpu::run_at_init([] { return make_handle(); });
+}
+
 inline void destroy_handle(cudnnHandle_t handle)
 {
     DISTCONV_CHECK_CUDNN(cudnnDestroy(handle));
@@ -125,14 +149,22 @@ inline void setup_filter_descriptor(FilterDescriptor_t& desc,
 {
     // Lifted out of convolution.hpp; modified to not use data members.
     cudnnDataType_t dt = util::get_cudnn_type<typename Tensor::data_type>();
-    const int_vector shape =
-        tensor.get_local_real_shape().template get_vector<int>();
-    DISTCONV_CHECK_CUDNN(
-        cudnnSetFilterNdDescriptor(desc,
-                                   dt,
-                                   CUDNN_TENSOR_NCHW,
-                                   shape.size(),
-                                   util::reverse(shape).data()));
+    const int nd = tensor.get_num_dims();
+    // The dimensions are passed in the KCHW order regardless of the
+    // layout, which is specified by the format.
+    int_vector shape = tensor::to_channels_first(
+        tensor.get_layout(),
+        tensor.get_local_real_shape().template get_vector<int>(),
+        nd);
+    // 1D filters are described as 2D; see set_convolution_descriptor
+    if (nd == 3)
+        shape = tensor::insert_unit_spatial_dim(shape, 1);
+    const cudnnTensorFormat_t fmt =
+        tensor.get_layout() == tensor::Layout::CHANNELS_LAST
+            ? CUDNN_TENSOR_NHWC
+            : CUDNN_TENSOR_NCHW;
+    DISTCONV_CHECK_CUDNN(cudnnSetFilterNdDescriptor(
+        desc, dt, fmt, shape.size(), util::reverse(shape).data()));
 }
 
 inline cudnnTensorDescriptor_t make_tensor_descriptor()
@@ -169,11 +201,27 @@ inline void setup_tensor_descriptor(cudnnTensorDescriptor_t& desc,
         << "tensor: " << tensor << ", shape: " << util::join_array(shape, ", ")
         << ", strides: " << util::join_array(strides, ", ") << "\n";
 
+    // Descriptors are always in the NCHW order; a channels-last
+    // tensor is described by its strides.
+    int nd = shape.num_dims();
+    IntVector desc_shape =
+        tensor::to_channels_first(tensor.get_layout(), IntVector(shape), nd);
+    strides = tensor::to_channels_first(tensor.get_layout(), strides, nd);
+    // 1D tensors are described as 2D; see set_convolution_descriptor
+    if (nd == 3)
+    {
+        const index_t unit_stride =
+            tensor::get_unit_spatial_stride(strides, desc_shape[0]);
+        desc_shape = tensor::insert_unit_spatial_dim(desc_shape, 1);
+        strides = tensor::insert_unit_spatial_dim(strides, unit_stride);
+        nd = 4;
+    }
+
     DISTCONV_CHECK_CUDNN(cudnnSetTensorNdDescriptor(
         desc,
         dt,
-        shape.num_dims(),
-        util::reverse(IntVector(shape)).data(),
+        nd,
+        util::reverse(desc_shape).data(),
         util::reverse(strides).get_vector<int>().data()));
 }
 
@@ -240,6 +288,9 @@ inline void set_tensor_dimension(cudnnTensorDescriptor_t& desc, int d, int n)
         desc, nb_dims_requested, &dt, &nbdims, dims, strides));
     d = d < 0 ? nbdims + d : d;
     assert_always(d < nbdims);
+    // Setting a descriptor is not free, so unchanged ones are kept
+    if (dims[nbdims - d - 1] == n)
+        return;
     dims[nbdims - d - 1] = n;
     DISTCONV_CHECK_CUDNN(
         cudnnSetTensorNdDescriptor(desc, dt, nbdims, dims, strides));
@@ -260,6 +311,24 @@ inline void set_tensor_num_samples(cudnnTensorDescriptor_t& desc, int n)
     set_tensor_dimension(desc, num_sample_dim, n);
 }
 
+// Sets the number of samples along with their distance in elements,
+// which may then address regions of a tensor apart from each other
+inline void set_tensor_num_samples(cudnnTensorDescriptor_t& desc,
+                                   int n,
+                                   int stride)
+{
+    cudnnDataType_t dt;
+    int dims[nb_dims_requested];
+    int strides[nb_dims_requested];
+    int nbdims;
+    DISTCONV_CHECK_CUDNN(cudnnGetTensorNdDescriptor(
+        desc, nb_dims_requested, &dt, &nbdims, dims, strides));
+    dims[0] = n;
+    strides[0] = stride;
+    DISTCONV_CHECK_CUDNN(
+        cudnnSetTensorNdDescriptor(desc, dt, nbdims, dims, strides));
+}
+
 inline int get_tensor_num_samples(const cudnnTensorDescriptor_t& desc)
 {
     int num_sample_dim = get_tensor_num_dimensions(desc) - 1;
@@ -334,6 +403,24 @@ inline void set_convolution_descriptor(ConvolutionDescriptor_t& conv_desc,
                                        ConvolutionMode_t const& mode,
                                        DataType_t const& data_type)
 {
+    // cuDNN convolves no fewer than two spatial dimensions, so 1D
+    // convolutions are run as 2D ones with a unit dimension outside of
+    // the spatial one, which is inserted into the tensor and filter
+    // descriptors too.
+    if (array_len == 1)
+    {
+        int const unit_pad[] = {0, pad[0]};
+        int const unit_stride[] = {1, stride[0]};
+        int const unit_dilation[] = {1, dilation[0]};
+        set_convolution_descriptor(conv_desc,
+                                   2,
+                                   unit_pad,
+                                   unit_stride,
+                                   unit_dilation,
+                                   mode,
+                                   data_type);
+        return;
+    }
     DISTCONV_CHECK_CUDNN(
         cudnnSetConvolutionNdDescriptor(conv_desc,
                                         array_len,
@@ -396,6 +483,53 @@ void convolution_forward(Handle_t handle,
                                                  out_data));
 }
 
+/** @brief Convolution followed by bias addition and activation in a
+ *  single kernel: out = act(alpha * conv(in) + beta * out + bias).
+ *
+ *  The activation must be ReLU unless conv_algo is
+ *  CUDNN_CONVOLUTION_FWD_ALGO_IMPLICIT_PRECOMP_GEMM.
+ */
+template <typename T>
+void convolution_bias_activation_forward(
+    Handle_t handle,
+    T const& alpha,
+    TensorDescriptor_t const& in_desc,
+    void const* in_data,
+    FilterDescriptor_t const& filter_desc,
+    void const* filter_data,
+    ConvolutionDescriptor_t const& conv_desc,
+    ConvFwdAlgo_t const& conv_algo,
+    void* work_data,
+    size_t work_data_size,
+    T const& beta,
+    TensorDescriptor_t const& bias_desc,
+    void const* bias_data,
+    ActivationDescriptor_t const& act_desc,
+    TensorDescriptor_t const& out_desc,
+    void* out_data)
+{
+    // The residual input z aliases the output so that beta scales
+    // the previous output values as in convolution_forward.
+    DISTCONV_CHECK_CUDNN(cudnnConvolutionBiasActivationForward(handle,
+                                                               &alpha,
+                                                               in_desc,
+                                                               in_data,
+                                                               filter_desc,
+                                                               filter_data,
+                                                               conv_desc,
+                                                               conv_algo,
+                                                               work_data,
+                                                               work_data_size,
+                                                               &beta,
+                                                               out_desc,
+                                                               out_data,
+                                                               bias_desc,
+                                                               bias_data,
+                                                               act_desc,
+                                                               out_desc,
+                                                               out_data));
+}
+
 template <typename T>
 void convolution_bwd_data(Handle_t handle,
                           T const& alpha,
@@ -545,6 +679,16 @@ inline void setup_pooling_descriptor(cudnnPoolingDescriptor_t& desc,
                                      int* pad,
                                      int* stride)
 {
+    // 1D poolings are run as 2D ones; see set_convolution_descriptor
+    if (nb_dims == 1)
+    {
+        int unit_window[] = {1, window_dim[0]};
+        int unit_pad[] = {0, pad[0]};
+        int unit_stride[] = {1, stride[0]};
+        setup_pooling_descriptor(
+            desc, mode, 2, unit_window, unit_pad, unit_stride);
+        return;
+    }
     auto const max_pooling_nan_opt = CUDNN_PROPAGATE_NAN;
     DISTCONV_CHECK_CUDNN(cudnnSetPoolingNdDescriptor(
         desc, mode, max_pooling_nan_opt, nb_dims, window_dim, pad, stride));
@@ -709,9 +853,37 @@ inline void activation_backward(cudnnHandle_t handle,
 struct Options
 {
     bool m_overlap_halo_exchange = false;
+    // Also restricts autotuning to deterministic algorithms
     bool m_deterministic = false;
     bool m_enable_profiling = false;
     float m_ws_capacity_factor = 1.0;
+    // Path of the persistent convolution algorithm cache; disabled
+    // when empty.
+    std::string m_algo_cache_path;
+    // Ranks with identical convolution problems autotune once and
+    // share the result.
+    bool m_collective_autotune = false;
+    // Upper bound in bytes of the convolution workspaces selected for
+    // the model, summed over the streams of the workspace arena; no
+    // bound when zero.
+    size_t m_ws_budget = 0;
+    // Capture convolution steps into CUDA graphs and replay them; only
+    // effective when CUDA graphs are available.
+    bool m_enable_graph_capture = false;
+    // Run convolutions with execution plans of the cuDNN graph API,
+    // falling back to the legacy API for unsupported problems.
+    bool m_use_graph_api = false;
+    // Pool with halos read directly from the NVSHMEM receive buffers
+    // instead of unpacking them; only effective with the
+    // NVSHMEM_FUSED_NOTIFY halo exchange.
+    bool m_fuse_halo_exchange = false;
+    // Exchange only the input halo rows read by convolutions whose
+    // stride and dilation have a common factor; see
+    // HaloExchange::set_row_subset.
+    bool m_halo_row_subset = false;
+    // Number of sample chunks the forward convolution pipelines its
+    // halo exchange with; no chunking when one.
+    int m_fwd_sample_chunks = 1;
     Options(bool overlap_halo_exchange = false,
             bool deterministic = false,
             bool enable_profiling = false,
@@ -725,39 +897,67 @@ struct Options
     }
     void set_by_environment_variables()
     {
-        if (std::getenv("DISTCONV_OVERLAP_HALO_EXCHANGE"))
+        static constexpr Flag flags[] = {
+            {"DISTCONV_OVERLAP_HALO_EXCHANGE", &Options::m_overlap_halo_exchange},
+            {"DISTCONV_DETERMINISTIC", &Options::m_deterministic},
+            {"DISTCONV_ENABLE_PROFILING", &Options::m_enable_profiling},
+            {"DISTCONV_COLLECTIVE_AUTOTUNE", &Options::m_collective_autotune},
+            {"DISTCONV_ENABLE_GRAPH_CAPTURE", &Options::m_enable_graph_capture},
+            {"DISTCONV_USE_CUDNN_GRAPH_API", &Options::m_use_graph_api},
+            {"DISTCONV_FUSE_HALO_EXCHANGE", &Options::m_fuse_halo_exchange},
+            {"DISTCONV_HALO_ROW_SUBSET", &Options::m_halo_row_subset},
+        };
+        for (const auto& f : flags)
         {
-            util::MPIRootPrintStreamDebug() << "Environment variable: "
-                                            << "DISTCONV_OVERLAP_HALO_EXCHANGE"
-                                            << " detected";
-            m_overlap_halo_exchange = true;
+            if (std::getenv(f.var))
+            {
+                log_detected(f.var);
+                this->*f.member = true;
+            }
         }
-        if (std::getenv("DISTCONV_DETERMINISTIC"))
+        if (const char* v = std::getenv("DISTCONV_WS_CAPACITY_FACTOR"))
         {
-            util::MPIRootPrintStreamDebug() << "Environment variable: "
-                                            << "DISTCONV_DETERMINISTIC"
-                                            << " detected";
-            m_deterministic = true;
+            log_detected("DISTCONV_WS_CAPACITY_FACTOR");
+            m_ws_capacity_factor = atof(v);
         }
-        if (std::getenv("DISTCONV_ENABLE_PROFILING"))
+        if (const char* v = std::getenv("DISTCONV_ALGO_CACHE_PATH"))
         {
-            util::MPIRootPrintStreamDebug() << "Environment variable: "
-                                            << "DISTCONV_ENABLE_PROFILING"
-                                            << " detected";
-            m_enable_profiling = true;
+            log_detected("DISTCONV_ALGO_CACHE_PATH");
+            m_algo_cache_path = v;
         }
-        if (std::getenv("DISTCONV_WS_CAPACITY_FACTOR"))
+        if (const char* v = std::getenv("DISTCONV_WS_BUDGET_MB"))
         {
-            util::MPIRootPrintStreamDebug() << "Environment variable: "
-                                            << "DISTCONV_WS_CAPACITY_FACTOR"
-                                            << " detected";
-            m_ws_capacity_factor =
-                atof(std::getenv("DISTCONV_WS_CAPACITY_FACTOR"));
+            log_detected("DISTCONV_WS_BUDGET_MB");
+            m_ws_budget = static_cast<size_t>(atof(v) * 1024 * 1024);
         }
+        if (const char* v = std::getenv("DISTCONV_FWD_SAMPLE_CHUNKS"))
+        {
+            log_detected("DISTCONV_FWD_SAMPLE_CHUNKS");
+            m_fwd_sample_chunks = atoi(v);
+        }
+    }
+
+private:
+    // Boolean options turned on by the presence of a variable
+    struct Flag
+    {
+        const char* var;
+        bool Options::*member;
+    };
+
+    static void log_detected(const char* var)
+    {
+        util::MPIRootPrintStreamDebug()
+            << "Environment variable: " << var << " detected";
     }
 };
 
-// Backend context
+// Backend context, bound to the device current at its construction,
+// which holds its streams and workspace. Backends of different
+// devices may be used by one process, each with its device current,
+// e.g., with h2::gpu::DeviceGuard guard(be.get_device()). Halos are
+// exchanged with peers in the same process by direct copies between
+// the devices (see p2p::ConnectionIPC).
 class BackendCUDNN
 {
 public:
@@ -790,18 +990,53 @@ public:
         init(comm);
     }
 
+    /** @brief Backend that takes over a handle still being created,
+     *  e.g., by make_handle_async.
+     *
+     *  The communicators are set up in the meantime, and the handle is
+     *  waited for, along with the background initialization of the
+     *  runtime, only once they are. The backend destroys the handle.
+     */
+    BackendCUDNN(MPI_Comm comm,
+                 std::future<cudnnHandle_t> cudnn_h,
+                 Options const& opts = Options())
+        : m_cudnn_h(nullptr),
+          m_enable_nvtx(false),
+#ifdef DISTCONV_HAS_P2P
+          m_p2p(comm),
+#endif // DISTCONV_HAS_P2P
+          m_opts(opts)
+    {
+        m_owns_handle = true;
+        DISTCONV_CHECK_CUDA(cudaStreamCreate(&m_stream));
+        init(comm, &cudnn_h);
+    }
+
     ~BackendCUDNN()
     {
+        {
+            std::lock_guard<std::mutex> lock(m_thread_contexts_mutex);
+            for (auto& kv : m_thread_contexts)
+                destroy_thread_context(*kv.second);
+            m_thread_contexts.clear();
+        }
 #ifdef DISTCONV_HAS_P2P
         m_p2p.disconnect_all();
 #endif // DISTCONV_HAS_P2P
+        if (m_owns_handle)
+        {
+            h2::gpu::DeviceGuard guard(m_device);
+            destroy_handle(m_cudnn_h);
+        }
     }
 
     std::string get_name() const { return std::string("CUDNN"); }
 
     const Options& get_options() { return m_opts; }
 
-    void wait() { DISTCONV_CHECK_CUDA(cudaStreamSynchronize(m_stream)); }
+    void wait() { DISTCONV_CHECK_CUDA(cudaStreamSynchronize(get_stream())); }
+
+    int get_device() const { return m_device; }
 
     MPI_Comm get_comm() { return m_comm; }
 
@@ -812,16 +1047,106 @@ public:
 
     Al::NCCLBackend::comm_type& get_al_nccl_comm() { return *m_al_nccl_comm; }
 
-    cudnnHandle_t get_handle() { return m_cudnn_h; }
+    /** @brief Communicator for gradient reductions overlapped with
+     *  computation, bound to get_grad_stream().
+     */
+    Al::NCCLBackend::comm_type& get_al_grad_comm() { return *m_al_grad_comm; }
 
-    cudaStream_t get_stream() { return m_stream; }
+    cudaStream_t get_grad_stream() { return m_grad_stream; }
+
+    cudnnHandle_t get_handle()
+    {
+        auto* ctx = get_thread_context();
+        return ctx ? ctx->handle : m_cudnn_h;
+    }
+
+    cudaStream_t get_stream()
+    {
+        auto* ctx = get_thread_context();
+        return ctx ? ctx->stream : m_stream;
+    }
+
+    /** @brief Make the layers issue their work to stream, e.g., to run
+     *  independent layers concurrently. The communicators keep the
+     *  streams they were created with, so layers reducing through them
+     *  must run on the stream the backend was created with. Only
+     *  changes the stream of the calling thread if it is attached.
+     */
+    void set_stream(cudaStream_t stream)
+    {
+        if (auto* ctx = get_thread_context())
+        {
+            ctx->stream = stream;
+            cudnn::set_stream(ctx->handle, stream);
+            return;
+        }
+        m_stream = stream;
+        cudnn::set_stream(m_cudnn_h, stream);
+    }
+
+    /** @brief Give the calling thread its own stream, handle and
+     *  workspaces, so that independent layers, e.g., of parallel
+     *  branches, can be run concurrently from several host threads.
+     *
+     *  The layers run by an attached thread issue their work to its
+     *  stream and tune their algorithms without the other processes.
+     *  The communicators of the backend are shared, so the halos of
+     *  layers run concurrently must be exchanged with
+     *  HaloExchangeMethod::MPI over tensors with a communicator of
+     *  their own, e.g., duplicated for each thread.
+     */
+    void attach_thread()
+    {
+        std::lock_guard<std::mutex> lock(m_thread_contexts_mutex);
+        auto& ctx = m_thread_contexts[std::this_thread::get_id()];
+        if (ctx)
+            return;
+        h2::gpu::DeviceGuard guard(m_device);
+        ctx = std::make_unique<ThreadContext>();
+        ctx->owned_stream = h2::gpu::make_stream_nonblocking();
+        ctx->stream = ctx->owned_stream;
+        ctx->handle = make_handle();
+        cudnn::set_stream(ctx->handle, ctx->stream);
+        local_thread_contexts().emplace_back(m_id, ctx.get());
+        ++m_num_thread_contexts;
+    }
+
+    /** @brief Wait for the work of the calling thread and release its
+     *  stream, handle and workspaces.
+     */
+    void detach_thread()
+    {
+        std::lock_guard<std::mutex> lock(m_thread_contexts_mutex);
+        auto it = m_thread_contexts.find(std::this_thread::get_id());
+        if (it == m_thread_contexts.end())
+            return;
+        auto& local = local_thread_contexts();
+        for (auto l = local.begin(); l != local.end(); ++l)
+        {
+            if (l->first == m_id)
+            {
+                local.erase(l);
+                break;
+            }
+        }
+        destroy_thread_context(*it->second);
+        m_thread_contexts.erase(it);
+        --m_num_thread_contexts;
+    }
+
+    bool is_thread_attached() { return get_thread_context() != nullptr; }
 
     void ensure_workspace(size_t size)
     {
+        auto* ctx = get_thread_context();
+        auto& ws = ctx ? ctx->ws : m_ws;
         // util::PrintStreamDebug() << "Requested Workspace: " << size << "\n";
-        if (m_ws.get_size() < size)
+        if (ws.get_size() < size)
         {
-            m_ws.allocate(size);
+            h2::gpu::DeviceGuard guard(m_device);
+            util::memory_accounting::OwnerScope owner(
+                util::memory_accounting::Owner::WORKSPACE);
+            ws.allocate(size);
         }
         // util::PrintStreamDebug() << "Workspace: " << size << "\n";
     }
@@ -829,10 +1154,26 @@ public:
     void* get_workspace(size_t size)
     {
         ensure_workspace(size);
-        return m_ws.get();
+        auto* ctx = get_thread_context();
+        return ctx ? ctx->ws.get() : m_ws.get();
     }
 
-    void enable_nvtx_marking(bool b = true) { m_enable_nvtx = b; }
+    /** @brief Workspace for convolutions, shared by all layers run by
+     *  the calling thread.
+     */
+    WorkspaceArena& get_workspace_arena()
+    {
+        auto* ctx = get_thread_context();
+        return ctx ? ctx->ws_arena : m_ws_arena;
+    }
+
+    // Also marks the halo exchange, shuffle and collective phases of
+    // the process, which use the h2::gpu ranges.
+    void enable_nvtx_marking(bool b = true)
+    {
+        m_enable_nvtx = b;
+        h2::gpu::set_ranges_enabled(b);
+    }
 
     void disable_nvtx_marking() { enable_nvtx_marking(false); }
 
@@ -863,32 +1204,32 @@ public:
 
     void wait_main_stream(int idx)
     {
-        util::wait_stream(m_stream, get_internal_stream(idx));
+        util::wait_stream(get_stream(), get_internal_stream(idx));
     }
 
     void wait_main_stream_pr(int idx)
     {
-        util::wait_stream(m_stream, get_internal_stream_pr(idx));
+        util::wait_stream(get_stream(), get_internal_stream_pr(idx));
     }
 
     void wait_internal_stream(int idx)
     {
-        util::wait_stream(get_internal_stream(idx), m_stream);
+        util::wait_stream(get_internal_stream(idx), get_stream());
     }
 
     void wait_internal_stream_pr(int idx)
     {
-        util::wait_stream(get_internal_stream_pr(idx), m_stream);
+        util::wait_stream(get_internal_stream_pr(idx), get_stream());
     }
 
     void sync_internal_stream(int idx)
     {
-        util::sync_stream(m_stream, get_internal_stream(idx));
+        util::sync_stream(get_stream(), get_internal_stream(idx));
     }
 
     void sync_internal_stream_pr(int idx)
     {
-        util::sync_stream(m_stream, get_internal_stream_pr(idx));
+        util::sync_stream(get_stream(), get_internal_stream_pr(idx));
     }
 
     cudnnConvolutionFwdAlgo_t
@@ -900,7 +1241,8 @@ public:
                       cudnnConvolutionDescriptor_t conv_desc,
                       cudnnTensorDescriptor_t output_desc,
                       void* output,
-                      size_t ws_size);
+                      size_t ws_size,
+                      std::string const& key_prefix = "");
 
     cudnnConvolutionBwdDataAlgo_t
     get_bwd_data_algorithm(std::string name,
@@ -911,7 +1253,8 @@ public:
                            cudnnConvolutionDescriptor_t conv_desc,
                            cudnnTensorDescriptor_t d_input_desc,
                            void* d_input,
-                           size_t ws_size);
+                           size_t ws_size,
+                           std::string const& key_prefix = "");
 
     cudnnConvolutionBwdFilterAlgo_t
     get_bwd_filter_algorithm(std::string name,
@@ -922,7 +1265,237 @@ public:
                              cudnnConvolutionDescriptor_t conv_desc,
                              cudnnFilterDescriptor_t d_filter_desc,
                              void* d_filter,
-                             size_t ws_size);
+                             size_t ws_size,
+                             std::string const& key_prefix = "");
+
+    ConvAlgoCache& get_algo_cache() { return m_algo_cache; }
+
+    // Convolutions issued by layers. They run with the graph API when
+    // enabled and supported, and with the legacy API otherwise. The
+    // legacy algorithm and workspace are used either way, so the
+    // graph API only picks engines that fit into that workspace.
+    template <typename T>
+    void convolution_forward(Handle_t handle,
+                             T const& alpha,
+                             TensorDescriptor_t const& in_desc,
+                             void const* in_data,
+                             FilterDescriptor_t const& filter_desc,
+                             void const* filter_data,
+                             ConvolutionDescriptor_t const& conv_desc,
+                             ConvFwdAlgo_t const& conv_algo,
+                             void* work_data,
+                             size_t work_data_size,
+                             T const& beta,
+                             TensorDescriptor_t const& out_desc,
+                             void* out_data)
+    {
+#ifdef DISTCONV_HAS_CUDNN_GRAPH_API
+        if (m_opts.m_use_graph_api
+            && execute_graph_conv(handle,
+                                  GraphConvProblem{GraphConvKind::FWD,
+                                                   in_desc,
+                                                   in_data,
+                                                   filter_desc,
+                                                   filter_data,
+                                                   conv_desc,
+                                                   out_desc,
+                                                   out_data,
+                                                   double(alpha),
+                                                   double(beta)},
+                                  work_data,
+                                  work_data_size))
+            return;
+#endif // DISTCONV_HAS_CUDNN_GRAPH_API
+        cudnn::convolution_forward(handle,
+                                   alpha,
+                                   in_desc,
+                                   in_data,
+                                   filter_desc,
+                                   filter_data,
+                                   conv_desc,
+                                   conv_algo,
+                                   work_data,
+                                   work_data_size,
+                                   beta,
+                                   out_desc,
+                                   out_data);
+    }
+
+    template <typename T>
+    void convolution_bias_activation_forward(
+        Handle_t handle,
+        T const& alpha,
+        TensorDescriptor_t const& in_desc,
+        void const* in_data,
+        FilterDescriptor_t const& filter_desc,
+        void const* filter_data,
+        ConvolutionDescriptor_t const& conv_desc,
+        ConvFwdAlgo_t const& conv_algo,
+        void* work_data,
+        size_t work_data_size,
+        T const& beta,
+        TensorDescriptor_t const& bias_desc,
+        void const* bias_data,
+        ActivationDescriptor_t const& act_desc,
+        TensorDescriptor_t const& out_desc,
+        void* out_data)
+    {
+#ifdef DISTCONV_HAS_CUDNN_GRAPH_API
+        // The fused graph adds no residual, so beta must be zero.
+        if (m_opts.m_use_graph_api && beta == T(0) && is_relu(act_desc))
+        {
+            GraphConvProblem p{GraphConvKind::FWD,
+                               in_desc,
+                               in_data,
+                               filter_desc,
+                               filter_data,
+                               conv_desc,
+                               out_desc,
+                               out_data,
+                               double(alpha),
+                               0.0,
+                               bias_desc,
+                               bias_data};
+            if (execute_graph_conv(handle, p, work_data, work_data_size))
+                return;
+        }
+#endif // DISTCONV_HAS_CUDNN_GRAPH_API
+        cudnn::convolution_bias_activation_forward(handle,
+                                                   alpha,
+                                                   in_desc,
+                                                   in_data,
+                                                   filter_desc,
+                                                   filter_data,
+                                                   conv_desc,
+                                                   conv_algo,
+                                                   work_data,
+                                                   work_data_size,
+                                                   beta,
+                                                   bias_desc,
+                                                   bias_data,
+                                                   act_desc,
+                                                   out_desc,
+                                                   out_data);
+    }
+
+    template <typename T>
+    void convolution_bwd_data(Handle_t handle,
+                              T const& alpha,
+                              FilterDescriptor_t const& filter_desc,
+                              void const* filter_data,
+                              TensorDescriptor_t const& dy_desc,
+                              void const* dy_data,
+                              ConvolutionDescriptor_t const& conv_desc,
+                              ConvBwdDataAlgo_t const& conv_algo,
+                              void* work_data,
+                              size_t work_data_size,
+                              T const& beta,
+                              TensorDescriptor_t const& dx_desc,
+                              void* dx_data)
+    {
+#ifdef DISTCONV_HAS_CUDNN_GRAPH_API
+        if (m_opts.m_use_graph_api
+            && execute_graph_conv(handle,
+                                  GraphConvProblem{GraphConvKind::BWD_DATA,
+                                                   dx_desc,
+                                                   dx_data,
+                                                   filter_desc,
+                                                   filter_data,
+                                                   conv_desc,
+                                                   dy_desc,
+                                                   dy_data,
+                                                   double(alpha),
+                                                   double(beta)},
+                                  work_data,
+                                  work_data_size))
+            return;
+#endif // DISTCONV_HAS_CUDNN_GRAPH_API
+        cudnn::convolution_bwd_data(handle,
+                                    alpha,
+                                    filter_desc,
+                                    filter_data,
+                                    dy_desc,
+                                    dy_data,
+                                    conv_desc,
+                                    conv_algo,
+                                    work_data,
+                                    work_data_size,
+                                    beta,
+                                    dx_desc,
+                                    dx_data);
+    }
+
+    template <typename T>
+    void convolution_bwd_filter(Handle_t handle,
+                                T const& alpha,
+                                TensorDescriptor_t const& in_desc,
+                                void const* in_data,
+                                TensorDescriptor_t const& dy_desc,
+                                void const* dy_data,
+                                ConvolutionDescriptor_t const& conv_desc,
+                                ConvBwdFilterAlgo_t const& conv_algo,
+                                void* work_data,
+                                size_t work_data_size,
+                                T const& beta,
+                                FilterDescriptor_t const& dw_desc,
+                                void* dw_data)
+    {
+#ifdef DISTCONV_HAS_CUDNN_GRAPH_API
+        if (m_opts.m_use_graph_api
+            && execute_graph_conv(handle,
+                                  GraphConvProblem{GraphConvKind::BWD_FILTER,
+                                                   in_desc,
+                                                   in_data,
+                                                   dw_desc,
+                                                   dw_data,
+                                                   conv_desc,
+                                                   dy_desc,
+                                                   dy_data,
+                                                   double(alpha),
+                                                   double(beta)},
+                                  work_data,
+                                  work_data_size))
+            return;
+#endif // DISTCONV_HAS_CUDNN_GRAPH_API
+        cudnn::convolution_bwd_filter(handle,
+                                      alpha,
+                                      in_desc,
+                                      in_data,
+                                      dy_desc,
+                                      dy_data,
+                                      conv_desc,
+                                      conv_algo,
+                                      work_data,
+                                      work_data_size,
+                                      beta,
+                                      dw_desc,
+                                      dw_data);
+    }
+
+    /** @brief Temporarily fall back to per-rank autotuning.
+     *
+     *  Collective autotuning requires all ranks to search for
+     *  algorithms in the same order. Callers whose searches depend on
+     *  the rank must suspend it around them.
+     */
+    void suspend_collective_autotune(bool b)
+    {
+        m_collective_autotune_suspended = b;
+    }
+
+    /** @brief Write autotuned algorithms to the persistent cache.
+     *
+     *  Collective over the communicator of this backend. Does nothing
+     *  when no cache path is configured.
+     */
+    void save_algo_cache()
+    {
+        if (m_opts.m_algo_cache_path.empty())
+        {
+            return;
+        }
+        m_algo_cache.save(m_opts.m_algo_cache_path, m_comm);
+    }
 
     void init_chanfilt_channel_comm(index_t seg, MPI_Comm comm)
     {
@@ -985,12 +1558,15 @@ public:
     }
 
 protected:
+    int m_device = h2::gpu::current_gpu();
     MPI_Comm m_comm;
     std::shared_ptr<Al::NCCLBackend::comm_type> m_al_mpi_cuda_comm;
     // Keeps a heap object as copying a NCCLCommunicator destroys
     // ncclComm_t
     std::unique_ptr<Al::NCCLBackend::comm_type> m_al_nccl_comm;
     cudnnHandle_t m_cudnn_h;
+    // Whether m_cudnn_h was handed over by a future
+    bool m_owns_handle = false;
     cudaStream_t m_stream;
     tensor::Memory<tensor::CUDAAllocator> m_ws;
     bool m_enable_nvtx;
@@ -1008,7 +1584,16 @@ protected:
     // objects prevent that.
     std::vector<std::shared_ptr<Al::NCCLBackend::comm_type>>
         m_internal_al_mpi_cuda_comms;
+    // Stream and communicator for asynchronous gradient reductions
+    cudaStream_t m_grad_stream;
+    std::unique_ptr<Al::NCCLBackend::comm_type> m_al_grad_comm;
     Options m_opts;
+    ConvAlgoCache m_algo_cache;
+    WorkspaceArena m_ws_arena;
+    bool m_collective_autotune_suspended = false;
+#ifdef DISTCONV_HAS_CUDNN_GRAPH_API
+    GraphPlanCache m_graph_plans;
+#endif // DISTCONV_HAS_CUDNN_GRAPH_API
 
     // Segmented communicators for channel/filter communication.
     // Communicators for ranks within a single channel/filter domain with the
@@ -1021,16 +1606,90 @@ protected:
     std::unordered_map<index_t, std::unique_ptr<Al::NCCLBackend::comm_type>>
         m_segmented_ar_comms;
 
-    void init(MPI_Comm comm)
+    // Stream, handle and workspaces of a thread given by attach_thread
+    struct ThreadContext
+    {
+        // Current stream, which set_stream may make one of the caller
+        cudaStream_t stream;
+        // Stream created by attach_thread
+        cudaStream_t owned_stream;
+        cudnnHandle_t handle;
+        tensor::Memory<tensor::CUDAAllocator> ws;
+        WorkspaceArena ws_arena;
+    };
+    std::map<std::thread::id, std::unique_ptr<ThreadContext>>
+        m_thread_contexts;
+    std::mutex m_thread_contexts_mutex;
+    // Lets the threads of a process that attaches none skip the lookup
+    std::atomic<int> m_num_thread_contexts{0};
+    // Identifies the backend in the contexts of the threads. Unlike
+    // its address, it is never reused by another backend.
+    std::uint64_t const m_id = next_id();
+
+    static std::uint64_t next_id()
+    {
+        static std::atomic<std::uint64_t> id{0};
+        return ++id;
+    }
+
+    // Contexts of the calling thread by backend, so that looking them
+    // up on every call takes no lock. Threads attach to few backends.
+    static std::vector<std::pair<std::uint64_t, ThreadContext*>>&
+    local_thread_contexts()
+    {
+        static thread_local std::vector<
+            std::pair<std::uint64_t, ThreadContext*>>
+            contexts;
+        return contexts;
+    }
+
+    ThreadContext* get_thread_context()
+    {
+        if (m_num_thread_contexts.load(std::memory_order_relaxed) == 0)
+            return nullptr;
+        for (auto const& l : local_thread_contexts())
+        {
+            if (l.first == m_id)
+                return l.second;
+        }
+        return nullptr;
+    }
+
+    void destroy_thread_context(ThreadContext& ctx)
+    {
+        h2::gpu::DeviceGuard guard(m_device);
+        h2::gpu::sync(ctx.stream);
+        if (ctx.owned_stream != ctx.stream)
+            h2::gpu::sync(ctx.owned_stream);
+        ctx.ws.nullify();
+        destroy_handle(ctx.handle);
+        h2::gpu::destroy(ctx.owned_stream);
+    }
+
+    // pending_handle is the handle still being created, if any.
+    void init(MPI_Comm comm,
+              std::future<cudnnHandle_t>* pending_handle = nullptr)
     {
         DISTCONV_CHECK_MPI(MPI_Comm_dup(comm, &m_comm));
         m_al_mpi_cuda_comm =
             std::make_shared<Al::NCCLBackend::comm_type>(m_comm,
                                                                  m_stream);
         m_al_nccl_comm.reset(new Al::NCCLBackend::comm_type(m_comm, m_stream));
-        DISTCONV_CHECK_CUDNN(cudnnSetStream(m_cudnn_h, m_stream));
         setup_internal_streams();
         setup_al_comms();
+        if (pending_handle)
+        {
+            m_cudnn_h = pending_handle->get();
+            // Surfaces the errors of the background initialization.
+            h2::gpu::wait_for_runtime();
+        }
+        DISTCONV_CHECK_CUDNN(cudnnSetStream(m_cudnn_h, m_stream));
+        if (m_opts.m_deterministic)
+            tensor::algorithms::set_deterministic_reduction(true);
+        if (!m_opts.m_algo_cache_path.empty())
+        {
+            m_algo_cache.load(m_opts.m_algo_cache_path, m_comm);
+        }
     }
 
     void setup_internal_streams()
@@ -1046,6 +1705,7 @@ protected:
         {
             m_internal_streams_pr.push_back(util::create_priority_stream());
         }
+        m_grad_stream = util::create_priority_stream();
     }
 
     void setup_al_comms()
@@ -1056,7 +1716,33 @@ protected:
                 std::make_shared<Al::NCCLBackend::comm_type>(
                     m_comm, m_internal_streams_pr[i]));
         }
+        m_al_grad_comm.reset(
+            new Al::NCCLBackend::comm_type(m_comm, m_grad_stream));
+    }
+
+    // Looks up the algorithm cache, autotuning on a miss. Depending on
+    // the options, the search is shared by ranks with the same key.
+    int get_or_tune_algorithm(const std::string& key,
+                              size_t ws_size,
+                              ConvAlgoCache::TuneFunc tune);
+
+#ifdef DISTCONV_HAS_CUDNN_GRAPH_API
+    // Returns false if the graph API cannot run p within ws_size.
+    bool execute_graph_conv(cudnnHandle_t handle,
+                            const GraphConvProblem& p,
+                            void* ws,
+                            size_t ws_size);
+
+    static bool is_relu(const cudnnActivationDescriptor_t& desc)
+    {
+        cudnnActivationMode_t mode;
+        cudnnNanPropagation_t nan_prop;
+        double coef;
+        DISTCONV_CHECK_CUDNN(
+            cudnnGetActivationDescriptor(desc, &mode, &nan_prop, &coef));
+        return mode == CUDNN_ACTIVATION_RELU;
     }
+#endif // DISTCONV_HAS_CUDNN_GRAPH_API
 
     cudnnConvolutionFwdAlgo_t get_fwd_algorithm_by_heuristics(
         const cudnnTensorDescriptor_t& input_desc,
@@ -1073,7 +1759,8 @@ protected:
                            const cudnnConvolutionDescriptor_t& conv_desc,
                            const cudnnTensorDescriptor_t& output_desc,
                            void* output,
-                           size_t ws_size);
+                           size_t ws_size,
+                           bool deterministic);
 
     cudnnConvolutionBwdDataAlgo_t get_bwd_data_algorithm_by_heuristics(
         const cudnnFilterDescriptor_t& filter_desc,
@@ -1090,7 +1777,8 @@ protected:
                                 const cudnnConvolutionDescriptor_t& conv_desc,
                                 const cudnnTensorDescriptor_t& d_input_desc,
                                 void* d_input,
-                                size_t ws_size);
+                                size_t ws_size,
+                                bool deterministic);
 
     cudnnConvolutionBwdFilterAlgo_t get_bwd_filter_algorithm_by_heuristics(
         const cudnnTensorDescriptor_t& input_desc,
@@ -1107,7 +1795,8 @@ protected:
                                   const cudnnConvolutionDescriptor_t& conv_desc,
                                   const cudnnFilterDescriptor_t& d_filter_desc,
                                   void* d_filter,
-                                  size_t ws_size);
+                                  size_t ws_size,
+                                  bool deterministic);
 };
 
 } // namespace cudnn
@@ -10,11 +10,15 @@
 #include "h2/gpu/runtime.hpp"
 
 #include "distconv/base.hpp"
+#include "distconv/dnn_backend/algo_cache.hpp"
+#include "distconv/dnn_backend/workspace_arena.hpp"
 #include "distconv/layers.hpp"
+#include "distconv/tensor/algorithms/common.hpp"
 #include "distconv/tensor/memory.hpp"
 #include "distconv/tensor/tensor_cuda.hpp"
 #include "distconv/tensor/tensor_mpi.hpp"
 #include "distconv/tensor/tensor_mpi_cuda.hpp"
+#include "distconv/util/memory_accounting.hpp"
 #include "distconv/util/util.hpp"
 #include "distconv/util/util_miopen.hpp"
 #include "distconv/util/util_rocm.hpp"
@@ -25,10 +29,18 @@
 
 #include <Al.hpp>
 
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <type_traits>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <miopen/miopen.h>
 
@@ -83,6 +95,16 @@ inline Handle_t make_handle()
     return handle;
 }
 
+/** @brief Create a handle on the initialization thread of H2.
+ *
+ *  Handles take a while to create, so this lets startup go on until
+ *  the handle is first needed. See h2::gpu::submit_init_task.
+ */
+inline std::future<Handle_t> make_handle_async()
+{
+    return h2::gpu::run_at_init([] { return make_handle(); });
+}
+
 inline void destroy_handle(miopenHandle_t handle)
 {
     DISTCONV_CHECK_MIOPEN(miopenDestroy(handle));
@@ -147,9 +169,24 @@ inline void setup_filter_descriptor(FilterDescriptor_t& desc,
                      shape.end() - 1,
                      std::back_inserter(strides),
                      std::multiplies<int>());
+    // Descriptors are always in the KCHW order; a channels-last
+    // filter is described by its strides.
+    int nd = shape.size();
+    int_vector desc_shape =
+        tensor::to_channels_first(tensor.get_layout(), shape, nd);
+    strides = tensor::to_channels_first(tensor.get_layout(), strides, nd);
+    // 1D filters are described as 2D; see set_convolution_descriptor
+    if (nd == 3)
+    {
+        int const unit_stride =
+            tensor::get_unit_spatial_stride(strides, desc_shape[0]);
+        desc_shape = tensor::insert_unit_spatial_dim(desc_shape, 1);
+        strides = tensor::insert_unit_spatial_dim(strides, unit_stride);
+        nd = 4;
+    }
     std::reverse(begin(strides), end(strides));
     DISTCONV_CHECK_MIOPEN(miopenSetTensorDescriptor(
-        desc, dt, shape.size(), util::reverse(shape).data(), strides.data()));
+        desc, dt, nd, util::reverse(desc_shape).data(), strides.data()));
 }
 
 template <typename Tensor, typename ShapeType>
@@ -175,11 +212,27 @@ inline void setup_tensor_descriptor(miopenTensorDescriptor_t& desc,
         << "tensor: " << tensor << ", shape: " << util::join_array(shape, ", ")
         << ", strides: " << util::join_array(strides, ", ") << "\n";
 
+    // Descriptors are always in the NCHW order; a channels-last
+    // tensor is described by its strides.
+    int nd = shape.num_dims();
+    IntVector desc_shape =
+        tensor::to_channels_first(tensor.get_layout(), IntVector(shape), nd);
+    strides = tensor::to_channels_first(tensor.get_layout(), strides, nd);
+    // 1D tensors are described as 2D; see set_convolution_descriptor
+    if (nd == 3)
+    {
+        index_t const unit_stride =
+            tensor::get_unit_spatial_stride(strides, desc_shape[0]);
+        desc_shape = tensor::insert_unit_spatial_dim(desc_shape, 1);
+        strides = tensor::insert_unit_spatial_dim(strides, unit_stride);
+        nd = 4;
+    }
+
     DISTCONV_CHECK_MIOPEN(miopenSetTensorDescriptor(
         desc,
         dt,
-        shape.num_dims(),
-        util::reverse(IntVector(shape)).data(),
+        nd,
+        util::reverse(desc_shape).data(),
         util::reverse(strides).get_vector<int>().data()));
 }
 
@@ -254,12 +307,13 @@ inline void set_tensor_dimension(miopenTensorDescriptor_t& desc, int d, int n)
     assert_always(d < num_dims);
 
     miopenDataType_t dt;
-    std::vector<int> dims, strides;
-    dims.reserve(num_dims);
-    strides.reserve(num_dims);
+    std::vector<int> dims(num_dims), strides(num_dims);
 
     DISTCONV_CHECK_MIOPEN(
         miopenGetTensorDescriptor(desc, &dt, dims.data(), strides.data()));
+    // Setting a descriptor is not free, so unchanged ones are kept
+    if (dims[num_dims - d - 1] == n)
+        return;
     dims[num_dims - d - 1] = n;
     // FIXME (TRB): Need to recompute strides??
     DISTCONV_CHECK_MIOPEN(miopenSetTensorDescriptor(
@@ -277,6 +331,22 @@ inline void set_tensor_num_samples(miopenTensorDescriptor_t& desc, int n)
     set_tensor_dimension(desc, num_sample_dim, n);
 }
 
+// Sets the number of samples along with their distance in elements,
+// which may then address regions of a tensor apart from each other
+inline void
+set_tensor_num_samples(miopenTensorDescriptor_t& desc, int n, int stride)
+{
+    int const num_dims = get_tensor_rank(desc);
+    miopenDataType_t dt;
+    std::vector<int> dims(num_dims), strides(num_dims);
+    DISTCONV_CHECK_MIOPEN(
+        miopenGetTensorDescriptor(desc, &dt, dims.data(), strides.data()));
+    dims[0] = n;
+    strides[0] = stride;
+    DISTCONV_CHECK_MIOPEN(miopenSetTensorDescriptor(
+        desc, dt, num_dims, dims.data(), strides.data()));
+}
+
 inline int get_tensor_num_samples(miopenTensorDescriptor_t const& desc)
 {
     int const num_sample_dim = get_tensor_num_dimensions(desc) - 1;
@@ -338,8 +408,25 @@ inline void set_convolution_descriptor(ConvolutionDescriptor_t& conv_desc,
                                        int const* const stride,
                                        int const* const dilation,
                                        ConvolutionMode_t const& mode,
-                                       DataType_t const& /*data_type*/)
+                                       DataType_t const& data_type)
 {
+    // 1D convolutions are run as 2D ones with a unit dimension outside
+    // of the spatial one, which is inserted into the tensor and filter
+    // descriptors too.
+    if (array_len == 1)
+    {
+        int const unit_pad[] = {0, pad[0]};
+        int const unit_stride[] = {1, stride[0]};
+        int const unit_dilation[] = {1, dilation[0]};
+        set_convolution_descriptor(conv_desc,
+                                   2,
+                                   unit_pad,
+                                   unit_stride,
+                                   unit_dilation,
+                                   mode,
+                                   data_type);
+        return;
+    }
     DISTCONV_CHECK_MIOPEN(
         miopenInitConvolutionNdDescriptor(conv_desc,
                                           array_len,
@@ -358,8 +445,7 @@ copy_convolution_descriptor(miopenConvolutionDescriptor_t& dst,
     DISTCONV_CHECK_MIOPEN(miopenGetConvolutionNdDescriptor(
         src, 0, &spatial_dims, nullptr, nullptr, nullptr, nullptr));
 
-    std::vector<int> data;
-    data.reserve(3 * spatial_dims);
+    std::vector<int> data(3 * spatial_dims);
     int* const pads = data.data();
     int* const strides = data.data() + spatial_dims;
     int* const dilations = data.data() + 2 * spatial_dims;
@@ -370,6 +456,14 @@ copy_convolution_descriptor(miopenConvolutionDescriptor_t& dst,
         dst, spatial_dims, pads, strides, dilations, mode));
 }
 
+// Makes Find return only the solutions that produce the same results
+// in every run.
+inline void set_convolution_deterministic(ConvolutionDescriptor_t const& desc)
+{
+    DISTCONV_CHECK_MIOPEN(miopenSetConvolutionAttribute(
+        desc, MIOPEN_CONVOLUTION_ATTRIB_DETERMINISTIC, 1));
+}
+
 template <typename T>
 void convolution_forward(Handle_t handle,
                          T const& alpha,
@@ -400,6 +494,52 @@ void convolution_forward(Handle_t handle,
                                                    work_data_size));
 }
 
+/** @brief Convolution followed by bias addition and activation:
+ *  out = act(alpha * conv(in) + beta * out + bias).
+ *
+ *  MIOpen's fusion API needs a separate fusion plan per problem, so
+ *  this is implemented as three consecutive library calls.
+ */
+template <typename T>
+void convolution_bias_activation_forward(
+    Handle_t handle,
+    T const& alpha,
+    TensorDescriptor_t const& in_desc,
+    void const* in_data,
+    FilterDescriptor_t const& filter_desc,
+    void const* filter_data,
+    ConvolutionDescriptor_t const& conv_desc,
+    ConvFwdAlgo_t const& conv_algo,
+    void* work_data,
+    size_t work_data_size,
+    T const& beta,
+    TensorDescriptor_t const& bias_desc,
+    void const* bias_data,
+    ActivationDescriptor_t const& act_desc,
+    TensorDescriptor_t const& out_desc,
+    void* out_data)
+{
+    convolution_forward(handle,
+                        alpha,
+                        in_desc,
+                        in_data,
+                        filter_desc,
+                        filter_data,
+                        conv_desc,
+                        conv_algo,
+                        work_data,
+                        work_data_size,
+                        beta,
+                        out_desc,
+                        out_data);
+    T const one = 1;
+    DISTCONV_CHECK_MIOPEN(miopenConvolutionForwardBias(
+        handle, &one, bias_desc, bias_data, &one, out_desc, out_data));
+    T const zero = 0;
+    DISTCONV_CHECK_MIOPEN(miopenActivationForward(
+        handle, act_desc, &one, out_desc, out_data, &zero, out_desc, out_data));
+}
+
 template <typename T>
 void convolution_bwd_data(Handle_t handle,
                           T const& alpha,
@@ -580,6 +720,16 @@ inline void setup_pooling_descriptor(miopenPoolingDescriptor_t& desc,
                                      int* pad,
                                      int* stride)
 {
+    // 1D poolings are run as 2D ones; see set_convolution_descriptor
+    if (nb_dims == 1)
+    {
+        int unit_window[] = {1, window_dim[0]};
+        int unit_pad[] = {0, pad[0]};
+        int unit_stride[] = {1, stride[0]};
+        setup_pooling_descriptor(
+            desc, mode, 2, unit_window, unit_pad, unit_stride);
+        return;
+    }
     DISTCONV_CHECK_MIOPEN(miopenSetNdPoolingDescriptor(
         desc, mode, nb_dims, window_dim, pad, stride));
     DISTCONV_CHECK_MIOPEN(
@@ -764,9 +914,34 @@ inline void activation_backward(miopenHandle_t handle,
 struct Options
 {
     bool m_overlap_halo_exchange = false;
+    // Also restricts autotuning to deterministic algorithms
     bool m_deterministic = false;
     bool m_enable_profiling = false;
     float m_ws_capacity_factor = 1.0;
+    // Path of the persistent convolution algorithm cache; disabled
+    // when empty.
+    std::string m_algo_cache_path;
+    // Ranks with identical convolution problems autotune once and
+    // share the result.
+    bool m_collective_autotune = false;
+    // Upper bound in bytes of the convolution workspaces selected for
+    // the model, summed over the streams of the workspace arena; no
+    // bound when zero.
+    size_t m_ws_budget = 0;
+    // Capture convolution steps into CUDA graphs and replay them; only
+    // effective when CUDA graphs are available.
+    bool m_enable_graph_capture = false;
+    // Run convolutions with the immediate-mode API of MIOpen, using
+    // the solutions of its find-db instead of searching with
+    // miopenFind*.
+    bool m_miopen_immediate = false;
+    // Exchange only the input halo rows read by convolutions whose
+    // stride and dilation have a common factor; see
+    // HaloExchange::set_row_subset.
+    bool m_halo_row_subset = false;
+    // Number of sample chunks the forward convolution pipelines its
+    // halo exchange with; no chunking when one.
+    int m_fwd_sample_chunks = 1;
     Options(bool overlap_halo_exchange = false,
             bool deterministic = false,
             bool enable_profiling = false,
@@ -780,39 +955,66 @@ struct Options
     }
     void set_by_environment_variables()
     {
-        if (std::getenv("DISTCONV_OVERLAP_HALO_EXCHANGE"))
+        static constexpr Flag flags[] = {
+            {"DISTCONV_OVERLAP_HALO_EXCHANGE", &Options::m_overlap_halo_exchange},
+            {"DISTCONV_DETERMINISTIC", &Options::m_deterministic},
+            {"DISTCONV_ENABLE_PROFILING", &Options::m_enable_profiling},
+            {"DISTCONV_COLLECTIVE_AUTOTUNE", &Options::m_collective_autotune},
+            {"DISTCONV_ENABLE_GRAPH_CAPTURE", &Options::m_enable_graph_capture},
+            {"DISTCONV_MIOPEN_IMMEDIATE", &Options::m_miopen_immediate},
+            {"DISTCONV_HALO_ROW_SUBSET", &Options::m_halo_row_subset},
+        };
+        for (const auto& f : flags)
+        {
+            if (std::getenv(f.var))
+            {
+                log_detected(f.var);
+                this->*f.member = true;
+            }
+        }
+        if (const char* v = std::getenv("DISTCONV_WS_CAPACITY_FACTOR"))
         {
-            util::MPIRootPrintStreamDebug() << "Environment variable: "
-                                            << "DISTCONV_OVERLAP_HALO_EXCHANGE"
-                                            << " detected";
-            m_overlap_halo_exchange = true;
+            log_detected("DISTCONV_WS_CAPACITY_FACTOR");
+            m_ws_capacity_factor = atof(v);
         }
-        if (std::getenv("DISTCONV_DETERMINISTIC"))
+        if (const char* v = std::getenv("DISTCONV_ALGO_CACHE_PATH"))
         {
-            util::MPIRootPrintStreamDebug() << "Environment variable: "
-                                            << "DISTCONV_DETERMINISTIC"
-                                            << " detected";
-            m_deterministic = true;
+            log_detected("DISTCONV_ALGO_CACHE_PATH");
+            m_algo_cache_path = v;
         }
-        if (std::getenv("DISTCONV_ENABLE_PROFILING"))
+        if (const char* v = std::getenv("DISTCONV_WS_BUDGET_MB"))
         {
-            util::MPIRootPrintStreamDebug() << "Environment variable: "
-                                            << "DISTCONV_ENABLE_PROFILING"
-                                            << " detected";
-            m_enable_profiling = true;
+            log_detected("DISTCONV_WS_BUDGET_MB");
+            m_ws_budget = static_cast<size_t>(atof(v) * 1024 * 1024);
         }
-        if (std::getenv("DISTCONV_WS_CAPACITY_FACTOR"))
+        if (const char* v = std::getenv("DISTCONV_FWD_SAMPLE_CHUNKS"))
         {
-            util::MPIRootPrintStreamDebug() << "Environment variable: "
-                                            << "DISTCONV_WS_CAPACITY_FACTOR"
-                                            << " detected";
-            m_ws_capacity_factor =
-                atof(std::getenv("DISTCONV_WS_CAPACITY_FACTOR"));
+            log_detected("DISTCONV_FWD_SAMPLE_CHUNKS");
+            m_fwd_sample_chunks = atoi(v);
         }
     }
+
+private:
+    // Boolean options turned on by the presence of a variable
+    struct Flag
+    {
+        const char* var;
+        bool Options::*member;
+    };
+
+    static void log_detected(const char* var)
+    {
+        util::MPIRootPrintStreamDebug()
+            << "Environment variable: " << var << " detected";
+    }
 };
 
-// Backend context
+// Backend context, bound to the device current at its construction,
+// which holds its streams and workspace. Backends of different
+// devices may be used by one process, each with its device current,
+// e.g., with h2::gpu::DeviceGuard guard(be.get_device()). Halos are
+// exchanged with peers in the same process by direct copies between
+// the devices (see p2p::ConnectionIPC).
 class BackendMIOpen
 {
 public:
@@ -845,18 +1047,61 @@ public:
         init(comm);
     }
 
+    /** @brief Backend that takes over a handle still being created,
+     *  e.g., by make_handle_async.
+     *
+     *  The communicators are set up in the meantime, and the handle is
+     *  waited for, along with the background initialization of the
+     *  runtime, only once they are. The backend destroys the handle.
+     */
+    BackendMIOpen(MPI_Comm comm,
+                  std::future<miopenHandle_t> miopen_h,
+                  Options const& opts = Options())
+        : m_miopen_h(nullptr),
+          m_stream(h2::gpu::make_stream()),
+          m_enable_nvtx(false),
+#ifdef DISTCONV_HAS_P2P
+          m_p2p(comm),
+#endif // DISTCONV_HAS_P2P
+          m_opts(opts)
+    {
+        m_owns_handle = true;
+        init(comm, &miopen_h);
+    }
+
     ~BackendMIOpen()
     {
+        // Precompilation tasks refer to this backend.
+        for (auto& [key, entry] : m_immediate_solutions)
+            entry.solution.wait();
+        if (m_precompile_handle)
+        {
+            h2::gpu::DeviceGuard guard(m_device);
+            destroy_handle(m_precompile_handle);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_thread_contexts_mutex);
+            for (auto& kv : m_thread_contexts)
+                destroy_thread_context(*kv.second);
+            m_thread_contexts.clear();
+        }
 #ifdef DISTCONV_HAS_P2P
         m_p2p.disconnect_all();
 #endif // DISTCONV_HAS_P2P
+        if (m_owns_handle)
+        {
+            h2::gpu::DeviceGuard guard(m_device);
+            destroy_handle(m_miopen_h);
+        }
     }
 
     std::string get_name() const { return std::string("MIOPEN"); }
 
     Options const& get_options() { return m_opts; }
 
-    void wait() { h2::gpu::sync(m_stream); }
+    void wait() { h2::gpu::sync(get_stream()); }
+
+    int get_device() const { return m_device; }
 
     MPI_Comm get_comm() { return m_comm; }
 
@@ -867,25 +1112,128 @@ public:
 
     Al::NCCLBackend::comm_type& get_al_nccl_comm() { return *m_al_nccl_comm; }
 
-    miopenHandle_t get_handle() { return m_miopen_h; }
+    /** @brief Communicator for gradient reductions overlapped with
+     *  computation, bound to get_grad_stream().
+     */
+    Al::NCCLBackend::comm_type& get_al_grad_comm() { return *m_al_grad_comm; }
+
+    hipStream_t get_grad_stream() { return m_grad_stream; }
 
-    hipStream_t get_stream() { return m_stream; }
+    miopenHandle_t get_handle()
+    {
+        auto* ctx = get_thread_context();
+        return ctx ? ctx->handle : m_miopen_h;
+    }
+
+    hipStream_t get_stream()
+    {
+        auto* ctx = get_thread_context();
+        return ctx ? ctx->stream : m_stream;
+    }
+
+    /** @brief Make the layers issue their work to stream, e.g., to run
+     *  independent layers concurrently. The communicators keep the
+     *  streams they were created with, so layers reducing through them
+     *  must run on the stream the backend was created with. Only
+     *  changes the stream of the calling thread if it is attached.
+     */
+    void set_stream(hipStream_t stream)
+    {
+        if (auto* ctx = get_thread_context())
+        {
+            ctx->stream = stream;
+            miopen::set_stream(ctx->handle, stream);
+            return;
+        }
+        m_stream = stream;
+        miopen::set_stream(m_miopen_h, stream);
+    }
+
+    /** @brief Give the calling thread its own stream, handle and
+     *  workspaces, so that independent layers, e.g., of parallel
+     *  branches, can be run concurrently from several host threads.
+     *
+     *  See BackendCUDNN::attach_thread.
+     */
+    void attach_thread()
+    {
+        std::lock_guard<std::mutex> lock(m_thread_contexts_mutex);
+        auto& ctx = m_thread_contexts[std::this_thread::get_id()];
+        if (ctx)
+            return;
+        h2::gpu::DeviceGuard guard(m_device);
+        ctx = std::make_unique<ThreadContext>();
+        ctx->owned_stream = h2::gpu::make_stream_nonblocking();
+        ctx->stream = ctx->owned_stream;
+        ctx->handle = make_handle();
+        miopen::set_stream(ctx->handle, ctx->stream);
+        local_thread_contexts().emplace_back(m_id, ctx.get());
+        ++m_num_thread_contexts;
+    }
+
+    /** @brief Wait for the work of the calling thread and release its
+     *  stream, handle and workspaces.
+     */
+    void detach_thread()
+    {
+        std::lock_guard<std::mutex> lock(m_thread_contexts_mutex);
+        auto it = m_thread_contexts.find(std::this_thread::get_id());
+        if (it == m_thread_contexts.end())
+            return;
+        auto& local = local_thread_contexts();
+        for (auto l = local.begin(); l != local.end(); ++l)
+        {
+            if (l->first == m_id)
+            {
+                local.erase(l);
+                break;
+            }
+        }
+        destroy_thread_context(*it->second);
+        m_thread_contexts.erase(it);
+        --m_num_thread_contexts;
+    }
+
+    bool is_thread_attached() { return get_thread_context() != nullptr; }
 
     void ensure_workspace(size_t size)
     {
+        auto* ctx = get_thread_context();
+        auto& ws = ctx ? ctx->ws : m_ws;
         // util::PrintStreamDebug() << "Requested Workspace: " << size << "\n";
-        if (m_ws.get_size() < size)
-            m_ws.allocate(size);
+        if (ws.get_size() < size)
+        {
+            h2::gpu::DeviceGuard guard(m_device);
+            util::memory_accounting::OwnerScope owner(
+                util::memory_accounting::Owner::WORKSPACE);
+            ws.allocate(size);
+        }
         // util::PrintStreamDebug() << "Workspace: " << size << "\n";
     }
 
     void* get_workspace(size_t size)
     {
         ensure_workspace(size);
-        return m_ws.get();
+        auto* ctx = get_thread_context();
+        return ctx ? ctx->ws.get() : m_ws.get();
+    }
+
+    /** @brief Workspace for convolutions, shared by all layers run by
+     *  the calling thread.
+     */
+    WorkspaceArena& get_workspace_arena()
+    {
+        auto* ctx = get_thread_context();
+        return ctx ? ctx->ws_arena : m_ws_arena;
     }
 
-    void enable_nvtx_marking(bool b = true) { m_enable_nvtx = b; }
+    // Also marks the halo exchange, shuffle and collective phases of
+    // the process, which use the h2::gpu ranges.
+    void enable_nvtx_marking(bool b = true)
+    {
+        m_enable_nvtx = b;
+        h2::gpu::set_ranges_enabled(b);
+    }
 
     void disable_nvtx_marking() { enable_nvtx_marking(false); }
 
@@ -916,32 +1264,32 @@ public:
 
     void wait_main_stream(int idx)
     {
-        util::wait_stream(m_stream, get_internal_stream(idx));
+        util::wait_stream(get_stream(), get_internal_stream(idx));
     }
 
     void wait_main_stream_pr(int idx)
     {
-        util::wait_stream(m_stream, get_internal_stream_pr(idx));
+        util::wait_stream(get_stream(), get_internal_stream_pr(idx));
     }
 
     void wait_internal_stream(int idx)
     {
-        util::wait_stream(get_internal_stream(idx), m_stream);
+        util::wait_stream(get_internal_stream(idx), get_stream());
     }
 
     void wait_internal_stream_pr(int idx)
     {
-        util::wait_stream(get_internal_stream_pr(idx), m_stream);
+        util::wait_stream(get_internal_stream_pr(idx), get_stream());
     }
 
     void sync_internal_stream(int idx)
     {
-        util::sync_stream(m_stream, get_internal_stream(idx));
+        util::sync_stream(get_stream(), get_internal_stream(idx));
     }
 
     void sync_internal_stream_pr(int idx)
     {
-        util::sync_stream(m_stream, get_internal_stream_pr(idx));
+        util::sync_stream(get_stream(), get_internal_stream_pr(idx));
     }
 
     miopenConvFwdAlgorithm_t
@@ -953,7 +1301,8 @@ public:
                       miopenConvolutionDescriptor_t conv_desc,
                       miopenTensorDescriptor_t output_desc,
                       void* output,
-                      size_t ws_size);
+                      size_t ws_size,
+                      std::string const& key_prefix = "");
 
     miopenConvBwdDataAlgorithm_t
     get_bwd_data_algorithm(std::string name,
@@ -964,7 +1313,8 @@ public:
                            miopenConvolutionDescriptor_t conv_desc,
                            miopenTensorDescriptor_t d_input_desc,
                            void* d_input,
-                           size_t ws_size);
+                           size_t ws_size,
+                           std::string const& key_prefix = "");
 
     miopenConvBwdWeightsAlgorithm_t
     get_bwd_filter_algorithm(std::string name,
@@ -975,7 +1325,221 @@ public:
                              miopenConvolutionDescriptor_t conv_desc,
                              miopenTensorDescriptor_t d_filter_desc,
                              void* d_filter,
-                             size_t ws_size);
+                             size_t ws_size,
+                             std::string const& key_prefix = "");
+
+    ConvAlgoCache& get_algo_cache() { return m_algo_cache; }
+
+    enum class ConvDirection
+    {
+        FORWARD,
+        BACKWARD_DATA,
+        BACKWARD_FILTER
+    };
+
+    // An immediate-mode solution, compiled for this process.
+    struct ImmediateSolution
+    {
+        uint64_t id;
+        // Upper bound of the workspace the solution needs.
+        size_t ws_size;
+        // Whether it came from the algorithm cache.
+        bool cached;
+    };
+
+    // Convolutions issued by layers. They forward to the library
+    // calls, or to the immediate-mode API when that is enabled and
+    // the problem needs neither alpha nor beta, which it lacks.
+    template <typename T>
+    void convolution_forward(Handle_t handle,
+                             T const& alpha,
+                             TensorDescriptor_t const& in_desc,
+                             void const* in_data,
+                             FilterDescriptor_t const& filter_desc,
+                             void const* filter_data,
+                             ConvolutionDescriptor_t const& conv_desc,
+                             ConvFwdAlgo_t const& conv_algo,
+                             void* work_data,
+                             size_t work_data_size,
+                             T const& beta,
+                             TensorDescriptor_t const& out_desc,
+                             void* out_data)
+    {
+        if (use_immediate_mode(alpha, beta))
+        {
+            auto const solution =
+                get_immediate_solution(ConvDirection::FORWARD,
+                                       in_desc,
+                                       filter_desc,
+                                       conv_desc,
+                                       out_desc,
+                                       work_data_size);
+            DISTCONV_CHECK_MIOPEN(
+                miopenConvolutionForwardImmediate(handle,
+                                                  filter_desc,
+                                                  filter_data,
+                                                  in_desc,
+                                                  in_data,
+                                                  conv_desc,
+                                                  out_desc,
+                                                  out_data,
+                                                  work_data,
+                                                  work_data_size,
+                                                  solution));
+            return;
+        }
+        miopen::convolution_forward(handle,
+                                    alpha,
+                                    in_desc,
+                                    in_data,
+                                    filter_desc,
+                                    filter_data,
+                                    conv_desc,
+                                    conv_algo,
+                                    work_data,
+                                    work_data_size,
+                                    beta,
+                                    out_desc,
+                                    out_data);
+    }
+
+    template <typename... Args>
+    void convolution_bias_activation_forward(Args&&... args)
+    {
+        miopen::convolution_bias_activation_forward(
+            std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    void convolution_bwd_data(Handle_t handle,
+                              T const& alpha,
+                              FilterDescriptor_t const& filter_desc,
+                              void const* filter_data,
+                              TensorDescriptor_t const& dy_desc,
+                              void const* dy_data,
+                              ConvolutionDescriptor_t const& conv_desc,
+                              ConvBwdDataAlgo_t const& conv_algo,
+                              void* work_data,
+                              size_t work_data_size,
+                              T const& beta,
+                              TensorDescriptor_t const& dx_desc,
+                              void* dx_data)
+    {
+        if (use_immediate_mode(alpha, beta))
+        {
+            auto const solution =
+                get_immediate_solution(ConvDirection::BACKWARD_DATA,
+                                       dx_desc,
+                                       filter_desc,
+                                       conv_desc,
+                                       dy_desc,
+                                       work_data_size);
+            DISTCONV_CHECK_MIOPEN(
+                miopenConvolutionBackwardDataImmediate(handle,
+                                                       dy_desc,
+                                                       dy_data,
+                                                       filter_desc,
+                                                       filter_data,
+                                                       conv_desc,
+                                                       dx_desc,
+                                                       dx_data,
+                                                       work_data,
+                                                       work_data_size,
+                                                       solution));
+            return;
+        }
+        miopen::convolution_bwd_data(handle,
+                                     alpha,
+                                     filter_desc,
+                                     filter_data,
+                                     dy_desc,
+                                     dy_data,
+                                     conv_desc,
+                                     conv_algo,
+                                     work_data,
+                                     work_data_size,
+                                     beta,
+                                     dx_desc,
+                                     dx_data);
+    }
+
+    template <typename T>
+    void convolution_bwd_filter(Handle_t handle,
+                                T const& alpha,
+                                TensorDescriptor_t const& in_desc,
+                                void const* in_data,
+                                TensorDescriptor_t const& dy_desc,
+                                void const* dy_data,
+                                ConvolutionDescriptor_t const& conv_desc,
+                                ConvBwdFilterAlgo_t const& conv_algo,
+                                void* work_data,
+                                size_t work_data_size,
+                                T const& beta,
+                                FilterDescriptor_t const& dw_desc,
+                                void* dw_data)
+    {
+        if (use_immediate_mode(alpha, beta))
+        {
+            auto const solution =
+                get_immediate_solution(ConvDirection::BACKWARD_FILTER,
+                                       in_desc,
+                                       dw_desc,
+                                       conv_desc,
+                                       dy_desc,
+                                       work_data_size);
+            DISTCONV_CHECK_MIOPEN(
+                miopenConvolutionBackwardWeightsImmediate(handle,
+                                                          dy_desc,
+                                                          dy_data,
+                                                          in_desc,
+                                                          in_data,
+                                                          conv_desc,
+                                                          dw_desc,
+                                                          dw_data,
+                                                          work_data,
+                                                          work_data_size,
+                                                          solution));
+            return;
+        }
+        miopen::convolution_bwd_filter(handle,
+                                       alpha,
+                                       in_desc,
+                                       in_data,
+                                       dy_desc,
+                                       dy_data,
+                                       conv_desc,
+                                       conv_algo,
+                                       work_data,
+                                       work_data_size,
+                                       beta,
+                                       dw_desc,
+                                       dw_data);
+    }
+
+    /** @brief Temporarily fall back to per-rank autotuning.
+     *
+     *  Collective autotuning requires all ranks to search for
+     *  algorithms in the same order. Callers whose searches depend on
+     *  the rank must suspend it around them.
+     */
+    void suspend_collective_autotune(bool b)
+    {
+        m_collective_autotune_suspended = b;
+    }
+
+    /** @brief Write autotuned algorithms to the persistent cache.
+     *
+     *  Collective over the communicator of this backend. Does nothing
+     *  when no cache path is configured.
+     */
+    void save_algo_cache()
+    {
+        if (m_opts.m_algo_cache_path.empty())
+        {
+            return;
+        }
+        m_algo_cache.save(m_opts.m_algo_cache_path, m_comm);
+    }
 
     void init_chanfilt_channel_comm(index_t seg, MPI_Comm comm)
     {
@@ -1038,12 +1602,15 @@ public:
     }
 
 protected:
+    int m_device = h2::gpu::current_gpu();
     MPI_Comm m_comm;
     std::shared_ptr<Al::NCCLBackend::comm_type> m_al_mpi_cuda_comm;
     // Keeps a heap object as copying a NCCLCommunicator destroys
     // ncclComm_t
     std::unique_ptr<Al::NCCLBackend::comm_type> m_al_nccl_comm;
     miopenHandle_t m_miopen_h;
+    // Whether m_miopen_h was handed over by a future
+    bool m_owns_handle = false;
     hipStream_t m_stream;
     tensor::Memory<tensor::CUDAAllocator> m_ws;
     bool m_enable_nvtx;
@@ -1061,7 +1628,28 @@ protected:
     // objects prevent that.
     std::vector<std::shared_ptr<Al::NCCLBackend::comm_type>>
         m_internal_al_mpi_cuda_comms;
+    // Stream and communicator for asynchronous gradient reductions
+    hipStream_t m_grad_stream;
+    std::unique_ptr<Al::NCCLBackend::comm_type> m_al_grad_comm;
     Options m_opts;
+    ConvAlgoCache m_algo_cache;
+    WorkspaceArena m_ws_arena;
+    bool m_collective_autotune_suspended = false;
+
+    struct ImmediateEntry
+    {
+        // Ready unless being precompiled.
+        std::shared_future<ImmediateSolution> solution;
+        bool persisted;
+    };
+
+    // Immediate-mode solutions by algorithm cache key, accessed by the
+    // threads issuing convolutions under m_immediate_mutex;
+    // precompilation tasks only fulfill the futures.
+    std::map<std::string, ImmediateEntry> m_immediate_solutions;
+    std::mutex m_immediate_mutex;
+    // Handle of the precompilation tasks, which run one at a time.
+    Handle_t m_precompile_handle = nullptr;
 
     // Segmented communicators for channel/filter communication.
     // Communicators for ranks within a single channel/filter domain with the
@@ -1074,16 +1662,90 @@ protected:
     std::unordered_map<index_t, std::unique_ptr<Al::NCCLBackend::comm_type>>
         m_segmented_ar_comms;
 
-    void init(MPI_Comm comm)
+    // Stream, handle and workspaces of a thread given by attach_thread
+    struct ThreadContext
+    {
+        // Current stream, which set_stream may make one of the caller
+        hipStream_t stream;
+        // Stream created by attach_thread
+        hipStream_t owned_stream;
+        miopenHandle_t handle;
+        tensor::Memory<tensor::CUDAAllocator> ws;
+        WorkspaceArena ws_arena;
+    };
+    std::map<std::thread::id, std::unique_ptr<ThreadContext>>
+        m_thread_contexts;
+    std::mutex m_thread_contexts_mutex;
+    // Lets the threads of a process that attaches none skip the lookup
+    std::atomic<int> m_num_thread_contexts{0};
+    // Identifies the backend in the contexts of the threads. Unlike
+    // its address, it is never reused by another backend.
+    std::uint64_t const m_id = next_id();
+
+    static std::uint64_t next_id()
+    {
+        static std::atomic<std::uint64_t> id{0};
+        return ++id;
+    }
+
+    // Contexts of the calling thread by backend, so that looking them
+    // up on every call takes no lock. Threads attach to few backends.
+    static std::vector<std::pair<std::uint64_t, ThreadContext*>>&
+    local_thread_contexts()
+    {
+        static thread_local std::vector<
+            std::pair<std::uint64_t, ThreadContext*>>
+            contexts;
+        return contexts;
+    }
+
+    ThreadContext* get_thread_context()
+    {
+        if (m_num_thread_contexts.load(std::memory_order_relaxed) == 0)
+            return nullptr;
+        for (auto const& l : local_thread_contexts())
+        {
+            if (l.first == m_id)
+                return l.second;
+        }
+        return nullptr;
+    }
+
+    void destroy_thread_context(ThreadContext& ctx)
+    {
+        h2::gpu::DeviceGuard guard(m_device);
+        h2::gpu::sync(ctx.stream);
+        if (ctx.owned_stream != ctx.stream)
+            h2::gpu::sync(ctx.owned_stream);
+        ctx.ws.nullify();
+        destroy_handle(ctx.handle);
+        h2::gpu::destroy(ctx.owned_stream);
+    }
+
+    // pending_handle is the handle still being created, if any.
+    void init(MPI_Comm comm,
+              std::future<miopenHandle_t>* pending_handle = nullptr)
     {
         DISTCONV_CHECK_MPI(MPI_Comm_dup(comm, &m_comm));
         m_al_mpi_cuda_comm =
             std::make_shared<Al::NCCLBackend::comm_type>(m_comm,
                                                                  m_stream);
         m_al_nccl_comm.reset(new Al::NCCLBackend::comm_type(m_comm, m_stream));
-        DISTCONV_CHECK_MIOPEN(miopenSetStream(m_miopen_h, m_stream));
         setup_internal_streams();
         setup_al_comms();
+        if (pending_handle)
+        {
+            m_miopen_h = pending_handle->get();
+            // Surfaces the errors of the background initialization.
+            h2::gpu::wait_for_runtime();
+        }
+        DISTCONV_CHECK_MIOPEN(miopenSetStream(m_miopen_h, m_stream));
+        if (m_opts.m_deterministic)
+            tensor::algorithms::set_deterministic_reduction(true);
+        if (!m_opts.m_algo_cache_path.empty())
+        {
+            m_algo_cache.load(m_opts.m_algo_cache_path, m_comm);
+        }
     }
 
     void setup_internal_streams()
@@ -1096,6 +1758,7 @@ protected:
         {
             m_internal_streams_pr.push_back(util::create_priority_stream());
         }
+        m_grad_stream = util::create_priority_stream();
     }
 
     void setup_al_comms()
@@ -1106,8 +1769,47 @@ protected:
                 std::make_shared<Al::NCCLBackend::comm_type>(
                     m_comm, m_internal_streams_pr[i]));
         }
+        m_al_grad_comm.reset(
+            new Al::NCCLBackend::comm_type(m_comm, m_grad_stream));
     }
 
+    // Looks up the algorithm cache, autotuning on a miss. Depending on
+    // the options, the search is shared by ranks with the same key.
+    int get_or_tune_algorithm(const std::string& key,
+                              size_t ws_size,
+                              ConvAlgoCache::TuneFunc tune);
+
+    // Immediate-mode solutions do not guarantee determinism.
+    template <typename T>
+    bool use_immediate_mode(T const& alpha, T const& beta) const
+    {
+        return m_opts.m_miopen_immediate && !m_opts.m_deterministic
+               && alpha == T(1) && beta == T(0);
+    }
+
+    // Descriptors are in the order of the forward problem: x is the
+    // input (or its gradient), w the filter (or its gradient) and y
+    // the output (or its gradient).
+
+    // Returns the id of the solution for a problem, finding and
+    // compiling it on first use.
+    uint64_t get_immediate_solution(ConvDirection dir,
+                                    miopenTensorDescriptor_t xdesc,
+                                    miopenTensorDescriptor_t wdesc,
+                                    miopenConvolutionDescriptor_t conv_desc,
+                                    miopenTensorDescriptor_t ydesc,
+                                    size_t ws_limit);
+
+    // Finds and compiles the solution for a problem as an
+    // initialization task, so that compilation overlaps the setup of
+    // the other layers. Called when algorithms are selected.
+    void precompile_immediate_solution(ConvDirection dir,
+                                       miopenTensorDescriptor_t xdesc,
+                                       miopenTensorDescriptor_t wdesc,
+                                       miopenConvolutionDescriptor_t conv_desc,
+                                       miopenTensorDescriptor_t ydesc,
+                                       size_t ws_limit);
+
     // miopenConvFwdAlgorithm_t get_fwd_algorithm_by_heuristics(
     //     miopenTensorDescriptor_t const& input_desc,
     //     miopenTensorDescriptor_t const& filter_desc,
@@ -2,14 +2,18 @@
 
 #include "distconv/dnn_backend/backend.hpp"
 #include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/al_collectives.hpp"
 #include "distconv/tensor/algorithms.hpp"
 #include "distconv/tensor/allreduce.hpp"
 #include "distconv/tensor/allreduce_al.hpp"
+#include "distconv/tensor/allreduce_fused.hpp"
 #include "distconv/tensor/allreduce_mpi_cuda.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
 #ifdef DISTCONV_HAS_NVSHMEM
 #include "distconv/tensor/allreduce_nvshmem.hpp"
 #endif // DISTCONV_HAS_NVSHMEM
 
+#include <cstdlib>
 #include <memory>
 #include <numeric>
 
@@ -35,6 +39,48 @@ void sums_to_statistics(index_t num_per_sum,
                         TensorType& running_var,
                         h2::gpu::DeviceStream stream);
 
+// Channel means and sums of squared deviations, which stay accurate
+// when the variance is small relative to the mean
+template <typename TensorType>
+void channel_moments(int num_dims,
+                     int num_samples,
+                     const TensorType& input,
+                     TensorType& mean,
+                     TensorType& m2,
+                     h2::gpu::DeviceStream stream);
+
+// Scales the local means to sums for allreducing, keeping a copy of
+// them in local_mean
+template <typename DataType>
+void moments_to_sums(index_t count,
+                     index_t num_per_sum,
+                     DataType* mean,
+                     DataType* local_mean,
+                     h2::gpu::DeviceStream stream);
+
+// Turns the allreduced sums into the global means, and adds the
+// deviation of the local means from them to the local m2
+template <typename DataType>
+void sums_to_moments(index_t count,
+                     index_t local_num_per_sum,
+                     index_t num_per_sum,
+                     DataType* mean,
+                     DataType* m2,
+                     const DataType* local_mean,
+                     h2::gpu::DeviceStream stream);
+
+template <typename TensorType>
+void moments_to_statistics(index_t num_per_sum,
+                           typename TensorType::data_type decay,
+                           TensorType& global_mean,
+                           TensorType& global_var,
+                           TensorType& running_mean,
+                           TensorType& running_var,
+                           h2::gpu::DeviceStream stream);
+
+// With relu, the output is activated by a ReLU. The output may have
+// halos, e.g., when it is the input of the next convolution, in which
+// case only its interior is written.
 template <typename TensorType>
 void batch_normalization(int num_dims,
                          int num_samples,
@@ -45,8 +91,40 @@ void batch_normalization(int num_dims,
                          const TensorType& bias,
                          TensorType& output,
                          typename TensorType::data_type epsilon,
+                         bool relu,
                          h2::gpu::DeviceStream stream);
 
+// Normalization with the running statistics in a single pass, where
+// the statistics, the scale and the bias are folded into a factor and
+// a shift per channel. Otherwise the same as batch_normalization.
+template <typename TensorType>
+void batch_normalization_inference(int num_dims,
+                                   int num_samples,
+                                   const TensorType& input,
+                                   const TensorType& running_mean,
+                                   const TensorType& running_var,
+                                   const TensorType& scale,
+                                   const TensorType& bias,
+                                   TensorType& output,
+                                   typename TensorType::data_type epsilon,
+                                   bool relu,
+                                   h2::gpu::DeviceStream stream);
+
+template <typename TensorType>
+void forward_local(int num_dims,
+                   const TensorType& input,
+                   TensorType& mean,
+                   TensorType& var,
+                   TensorType& running_mean,
+                   TensorType& running_var,
+                   const TensorType& scale,
+                   const TensorType& bias,
+                   TensorType& output,
+                   typename TensorType::data_type decay,
+                   typename TensorType::data_type epsilon,
+                   bool relu,
+                   h2::gpu::DeviceStream stream);
+
 #ifdef DISTCONV_HAS_NVSHMEM
 template <typename TensorType>
 void forward_all(int num_dims,
@@ -64,6 +142,9 @@ void forward_all(int num_dims,
                  tensor::AllreduceNVSHMEM<typename TensorType::data_type>& ar);
 #endif
 
+// With relu_bias, the output was activated by a fused ReLU, which is
+// recomputed from the input and the bias, and d_output is the gradient
+// of the activated output. The same holds for backprop2.
 template <typename TensorType>
 void backprop1(int num_dims,
                int num_samples,
@@ -77,6 +158,7 @@ void backprop1(int num_dims,
                TensorType& mean_gradient,
                TensorType& var_gradient,
                typename TensorType::data_type epsilon,
+               const TensorType* relu_bias,
                h2::gpu::DeviceStream stream);
 
 template <typename TensorType>
@@ -92,6 +174,7 @@ void backprop2(int num_dims,
                const TensorType& var_gradient,
                TensorType& d_input,
                typename TensorType::data_type epsilon,
+               const TensorType* relu_bias,
                h2::gpu::DeviceStream stream);
 
 } // namespace batchnorm
@@ -112,7 +195,8 @@ public:
           m_epsilon(epsilon),
           m_global_stats(global_stats),
           m_impl(impl),
-          m_allreducer(nullptr)
+          m_allreducer(nullptr),
+          m_welford(std::getenv("DISTCONV_BN_WELFORD") != nullptr)
     {
         if (m_impl == BatchnormImpl::MPI)
         {
@@ -124,6 +208,17 @@ public:
         {
             m_allreducer = util::make_unique<tensor::AllreduceAlNCCL<DataType>>(
                 m_be.get_al_nccl_comm());
+        }
+        else if (m_impl == BatchnormImpl::AL_NCCL_HIERARCHICAL)
+        {
+            m_allreducer = util::make_unique<
+                tensor::AllreduceAlNCCLHierarchical<DataType>>(
+                m_be.get_comm(), m_be.get_stream());
+        }
+        else if (m_impl == BatchnormImpl::AL_AUTO)
+        {
+            m_allreducer = util::make_unique<tensor::AllreduceAlAuto<DataType>>(
+                m_be.get_comm(), m_be.get_stream());
 #ifdef DISTCONV_HAS_NVSHMEM
         }
         else if (m_impl == BatchnormImpl::NVSHMEM_NATIVE)
@@ -168,8 +263,17 @@ public:
                 tensor::AllreduceNVSHMEM<DataType>>(
                 m_be.get_stream(),
                 tensor::AllreduceNVSHMEM<DataType>::RECURSIVE_DOUBLING_BLOCK);
+        }
+        else if (m_impl == BatchnormImpl::NVSHMEM_AUTO)
+        {
+            m_allreducer =
+                util::make_unique<tensor::AllreduceNVSHMEM<DataType>>(
+                    m_be.get_stream(), tensor::AllreduceNVSHMEM<DataType>::AUTO);
 #endif // DISTCONV_HAS_NVSHMEM
         }
+        m_fused_allreducer =
+            util::make_unique<tensor::AllreduceFused<DataType>>(
+                *m_allreducer, m_be.get_stream());
     }
 #if 0
   BatchNormalization(BackendDNNLib &backend,
@@ -191,6 +295,7 @@ public:
         m_num_current_samples = x.m_num_current_samples;
         m_global_stats = x.m_global_stats;
         m_impl = x.impl;
+        m_welford = x.m_welford;
         return *this;
     }
 
@@ -200,10 +305,19 @@ public:
                        Tensor& var,
                        bool is_training)
     {
+        DISTCONV_RANGE("batchnorm/forward_stage1", Compute);
+        check_layout(input);
         set_num_samples(input.get_local_shape()[-1]);
         if (is_training)
         {
-            channel_sums_and_sqsums(input, mean, var);
+            if (m_welford)
+            {
+                channel_moments(input, mean, var);
+            }
+            else
+            {
+                channel_sums_and_sqsums(input, mean, var);
+            }
         }
         return 0;
     }
@@ -214,11 +328,19 @@ public:
         if (!is_training || !m_global_stats)
             return 0;
 
+        DISTCONV_RANGE("batchnorm/forward_allreduce", Collective);
+
         auto mean_ptr = mean.get_buffer();
         auto var_ptr = var.get_buffer();
         auto count = mean.get_local_pitched_size();
         assert_eq(count, var.get_local_pitched_size());
 
+        if (m_welford)
+        {
+            allreduce_moments(mean_ptr, var_ptr, count);
+            return 0;
+        }
+
         // Combine allreduces of mean and var if possible
         if (mean_ptr + count == var_ptr)
         {
@@ -248,8 +370,10 @@ public:
                        Tensor& scale,
                        Tensor& bias,
                        Tensor& output,
-                       bool is_training)
+                       bool is_training,
+                       bool relu = false)
     {
+        DISTCONV_RANGE("batchnorm/forward_stage2", Compute);
         if (is_training)
         {
             // the sample dimension of the input tensor is assumed to be
@@ -261,15 +385,28 @@ public:
             // dimension is assumed to be at the second to last dimension.
             index_t num_per_sum = stat_shape.get_size() / stat_shape[-2];
 
-            // Sums to statistics
-            sums_to_statistics(
-                num_per_sum, mean, var, running_mean, running_var);
-            batch_normalization(input, mean, var, scale, bias, output);
+            if (m_welford)
+            {
+                batchnorm::moments_to_statistics<Tensor>(num_per_sum,
+                                                         m_decay,
+                                                         mean,
+                                                         var,
+                                                         running_mean,
+                                                         running_var,
+                                                         m_be.get_stream());
+            }
+            else
+            {
+                // Sums to statistics
+                sums_to_statistics(
+                    num_per_sum, mean, var, running_mean, running_var);
+            }
+            batch_normalization(input, mean, var, scale, bias, output, relu);
         }
         else
         {
-            batch_normalization(
-                input, running_mean, running_var, scale, bias, output);
+            batch_normalization_inference(
+                input, running_mean, running_var, scale, bias, output, relu);
         }
 
         return 0;
@@ -287,6 +424,8 @@ public:
                     Tensor& output,
                     bool is_training)
     {
+        DISTCONV_RANGE("batchnorm/forward_all", Compute);
+        check_layout(input);
         set_num_samples(input.get_local_shape()[-1]);
         if (is_training)
         {
@@ -316,6 +455,10 @@ public:
     }
 #endif
 
+    // With relu, the output is activated by a ReLU fused into the
+    // normalization, and may be the input of the next convolution with
+    // halos, whose interior is written. The backward pass is then
+    // given the bias to mask the gradients with.
     template <typename Tensor>
     int forward(const Tensor& input,
                 Tensor& mean,
@@ -325,12 +468,24 @@ public:
                 Tensor& scale,
                 Tensor& bias,
                 Tensor& output,
-                bool is_training)
+                bool is_training,
+                bool relu = false)
     {
+        DISTCONV_RANGE("batchnorm/forward", Compute);
         util::MPIPrintStreamDebug()
             << "BatchNormalization: " << input << ", " << output;
+        if (!is_training)
+        {
+            // The running statistics need neither the staged kernels
+            // nor the allreduce
+            check_layout(input);
+            set_num_samples(input.get_local_shape()[-1]);
+            batch_normalization_inference(
+                input, running_mean, running_var, scale, bias, output, relu);
+            return 0;
+        }
 #ifdef DISTCONV_HAS_NVSHMEM
-        if (m_impl == BatchnormImpl::FUSED_NVSHMEM_RECURSIVE_DOUBLING)
+        if (m_impl == BatchnormImpl::FUSED_NVSHMEM_RECURSIVE_DOUBLING && !relu)
         {
             forward_all(input,
                         mean,
@@ -344,6 +499,25 @@ public:
             return 0;
         }
 #endif // DISTCONV_HAS_NVSHMEM
+        if (is_training && is_forward_local_eligible(input, output))
+        {
+            check_layout(input);
+            set_num_samples(input.get_local_shape()[-1]);
+            batchnorm::forward_local<Tensor>(m_num_dims,
+                                             input,
+                                             mean,
+                                             var,
+                                             running_mean,
+                                             running_var,
+                                             scale,
+                                             bias,
+                                             output,
+                                             m_decay,
+                                             m_epsilon,
+                                             relu,
+                                             m_be.get_stream());
+            return 0;
+        }
         forward_stage1(input, mean, var, is_training);
         forward_allreduce(mean, var, is_training);
         forward_stage2(input,
@@ -354,7 +528,8 @@ public:
                        scale,
                        bias,
                        output,
-                       is_training);
+                       is_training,
+                       relu);
         return 0;
     }
 
@@ -367,9 +542,12 @@ public:
                         Tensor& scale_gradient,
                         Tensor& bias_gradient,
                         Tensor& mean_gradient,
-                        Tensor& var_gradient)
+                        Tensor& var_gradient,
+                        const Tensor* relu_bias = nullptr)
     {
+        DISTCONV_RANGE("batchnorm/backward_stage1", Compute);
         util::MPIPrintStreamDebug() << "BatchNormalization BP stage 1";
+        check_layout(input);
         set_num_samples(input.get_local_shape()[-1]);
         backprop1(input,
                   d_output,
@@ -379,7 +557,8 @@ public:
                   scale_gradient,
                   bias_gradient,
                   mean_gradient,
-                  var_gradient);
+                  var_gradient,
+                  relu_bias);
         return 0;
     }
 
@@ -393,34 +572,38 @@ public:
         if (!m_global_stats)
             return 0;
 
+        DISTCONV_RANGE("batchnorm/backward_allreduce", Collective);
+
         auto mean_ptr = mean_gradient.get_buffer();
         auto var_ptr = var_gradient.get_buffer();
         auto count = mean_gradient.get_local_pitched_size();
         assert_eq(count, var_gradient.get_local_pitched_size());
 
+        // All the gradients are reduced with a single allreduce
         if (mean_ptr + count == var_ptr)
         {
             // var comes immediately after mean
-            m_allreducer->allreduce(mean_ptr, count * 2);
+            m_fused_allreducer->add(mean_ptr, count * 2);
         }
         else if (mean_ptr == var_ptr + count)
         {
             // mean comes immediately after var
-            m_allreducer->allreduce(var_ptr, count * 2);
+            m_fused_allreducer->add(var_ptr, count * 2);
         }
         else
         {
-            m_allreducer->allreduce(mean_ptr, count);
-            m_allreducer->allreduce(var_ptr, count);
+            m_fused_allreducer->add(mean_ptr, count);
+            m_fused_allreducer->add(var_ptr, count);
         }
 
         if (!skip_weights)
         {
-            m_allreducer->allreduce(scale_gradient.get_buffer(),
+            m_fused_allreducer->add(scale_gradient.get_buffer(),
                                     scale_gradient.get_local_pitched_size());
-            m_allreducer->allreduce(bias_gradient.get_buffer(),
+            m_fused_allreducer->add(bias_gradient.get_buffer(),
                                     bias_gradient.get_local_pitched_size());
         }
+        m_fused_allreducer->flush();
 
         return 0;
     }
@@ -433,8 +616,10 @@ public:
                         const Tensor& scale,
                         const Tensor& mean_gradient,
                         const Tensor& var_gradient,
-                        Tensor& d_input)
+                        Tensor& d_input,
+                        const Tensor* relu_bias = nullptr)
     {
+        DISTCONV_RANGE("batchnorm/backward_stage2", Compute);
         util::MPIPrintStreamDebug() << "BatchNormalization BP stage 2";
 
         auto stat_shape =
@@ -451,10 +636,13 @@ public:
                   scale,
                   mean_gradient,
                   var_gradient,
-                  d_input);
+                  d_input,
+                  relu_bias);
         return 0;
     }
 
+    // relu_bias is the bias of a forward pass with a fused ReLU, in
+    // which case d_output is the gradient of the activated output
     template <typename Tensor>
     int backward(const Tensor& input,
                  const Tensor& d_output,
@@ -465,8 +653,10 @@ public:
                  Tensor& bias_gradient,
                  Tensor& mean_gradient,
                  Tensor& var_gradient,
-                 Tensor& d_input)
+                 Tensor& d_input,
+                 const Tensor* relu_bias = nullptr)
     {
+        DISTCONV_RANGE("batchnorm/backward", Compute);
         backward_stage1(input,
                         d_output,
                         mean,
@@ -475,7 +665,8 @@ public:
                         scale_gradient,
                         bias_gradient,
                         mean_gradient,
-                        var_gradient);
+                        var_gradient,
+                        relu_bias);
         backward_allreduce(
             scale_gradient, bias_gradient, mean_gradient, var_gradient);
         backward_stage2(input,
@@ -485,10 +676,40 @@ public:
                         scale,
                         mean_gradient,
                         var_gradient,
-                        d_input);
+                        d_input,
+                        relu_bias);
         return 0;
     }
 
+    // The kernels assume the channel dimension is the second
+    // outermost one
+    template <typename Tensor>
+    void check_layout(const Tensor& input) const
+    {
+        assert_always(input.get_layout() == tensor::Layout::CHANNELS_FIRST);
+    }
+
+    // Whether the statistics can be computed from the local tensor
+    // alone, so that the forward pass is fused into a single kernel
+    template <typename Tensor>
+    bool is_forward_local_eligible(const Tensor& input,
+                                   const Tensor& output) const
+    {
+        if (m_global_stats)
+        {
+            int num_procs;
+            DISTCONV_CHECK_MPI(MPI_Comm_size(m_be.get_comm(), &num_procs));
+            if (num_procs > 1)
+            {
+                return false;
+            }
+        }
+        return !m_welford && input.is_split_root()
+               && input.get_overlap().reduce_sum() == 0
+               && output.get_overlap().reduce_sum() == 0
+               && std::getenv("DISTCONV_DISABLE_BN_OPT") == nullptr;
+    }
+
     // n: the number of the current local minibatch samples
     void set_num_samples(int n)
     {
@@ -509,6 +730,55 @@ protected:
     bool m_global_stats;
     BatchnormImpl m_impl;
     std::unique_ptr<tensor::Allreduce<DataType>> m_allreducer;
+    std::unique_ptr<tensor::AllreduceFused<DataType>> m_fused_allreducer;
+    // Computes the statistics from Welford moments rather than sums
+    // of squares. Enabled by DISTCONV_BN_WELFORD.
+    bool m_welford;
+    // Elements per channel of the local and global tensors, set in
+    // forward_stage1 with m_welford
+    index_t m_local_num_per_sum = 0;
+    index_t m_num_per_sum = 0;
+    tensor::Memory<tensor::CUDAAllocator> m_local_mean;
+
+    template <typename Tensor>
+    void channel_moments(const Tensor& input, Tensor& mean, Tensor& m2)
+    {
+        const auto& local_shape = input.get_local_shape();
+        m_local_num_per_sum =
+            input.is_split_root() && input.get_local_size() > 0
+                ? input.get_local_size() / local_shape[-2]
+                : 0;
+        m_num_per_sum = input.get_size() / input.get_shape()[-2];
+        batchnorm::channel_moments<Tensor>(m_num_dims,
+                                           m_num_current_samples,
+                                           input,
+                                           mean,
+                                           m2,
+                                           m_be.get_stream());
+    }
+
+    // Merges the moments of the processes by allreducing the sums and
+    // then the sums of squared deviations from the global means
+    void allreduce_moments(DataType* mean, DataType* m2, size_t count)
+    {
+        const size_t size = count * sizeof(DataType);
+        if (m_local_mean.get_size() < size)
+        {
+            m_local_mean.allocate(size);
+        }
+        auto local_mean = static_cast<DataType*>(m_local_mean.get());
+        batchnorm::moments_to_sums<DataType>(
+            count, m_local_num_per_sum, mean, local_mean, m_be.get_stream());
+        m_allreducer->allreduce(mean, count);
+        batchnorm::sums_to_moments<DataType>(count,
+                                             m_local_num_per_sum,
+                                             m_num_per_sum,
+                                             mean,
+                                             m2,
+                                             local_mean,
+                                             m_be.get_stream());
+        m_allreducer->allreduce(m2, count);
+    }
 
     template <typename Tensor>
     void channel_sums_and_sqsums(const Tensor& input, Tensor& mean, Tensor& var)
@@ -543,7 +813,8 @@ protected:
                              const Tensor& var,
                              const Tensor& scale,
                              const Tensor& bias,
-                             Tensor& output)
+                             Tensor& output,
+                             bool relu)
     {
         batchnorm::batch_normalization<Tensor>(m_num_dims,
                                                m_num_current_samples,
@@ -554,9 +825,33 @@ protected:
                                                bias,
                                                output,
                                                m_epsilon,
+                                               relu,
                                                m_be.get_stream());
     }
 
+    template <typename Tensor>
+    void batch_normalization_inference(const Tensor& input,
+                                       const Tensor& running_mean,
+                                       const Tensor& running_var,
+                                       const Tensor& scale,
+                                       const Tensor& bias,
+                                       Tensor& output,
+                                       bool relu)
+    {
+        batchnorm::batch_normalization_inference<Tensor>(
+            m_num_dims,
+            m_num_current_samples,
+            input,
+            running_mean,
+            running_var,
+            scale,
+            bias,
+            output,
+            m_epsilon,
+            relu,
+            m_be.get_stream());
+    }
+
     template <typename Tensor>
     void backprop1(const Tensor& input,
                    const Tensor& d_output,
@@ -566,7 +861,8 @@ protected:
                    Tensor& scale_gradient,
                    Tensor& bias_gradient,
                    Tensor& mean_gradient,
-                   Tensor& var_gradient)
+                   Tensor& var_gradient,
+                   const Tensor* relu_bias)
     {
         batchnorm::backprop1<Tensor>(m_num_dims,
                                      m_num_current_samples,
@@ -580,6 +876,7 @@ protected:
                                      mean_gradient,
                                      var_gradient,
                                      m_epsilon,
+                                     relu_bias,
                                      m_be.get_stream());
     }
 
@@ -592,7 +889,8 @@ protected:
                    const Tensor& scale,
                    const Tensor& mean_gradient,
                    const Tensor& var_gradient,
-                   Tensor& d_input)
+                   Tensor& d_input,
+                   const Tensor* relu_bias)
     {
         batchnorm::backprop2<Tensor>(m_num_dims,
                                      m_num_current_samples,
@@ -606,6 +904,7 @@ protected:
                                      var_gradient,
                                      d_input,
                                      m_epsilon,
+                                     relu_bias,
                                      m_be.get_stream());
     }
 };
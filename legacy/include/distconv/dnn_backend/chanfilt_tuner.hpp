@@ -0,0 +1,202 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <Al.hpp>
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace distconv
+{
+
+/** @brief Selection of the channel/filter parallelism algorithm.
+ *
+ *  Stationary-x (X) reduce-scatters the outputs of all filters in
+ *  forward and allgathers the output gradients in backward data, while
+ *  stationary-y (Y) allgathers the input in forward and reduce-scatters
+ *  the input gradients in backward data. The local convolutions do the
+ *  same number of operations in both, so the one with the smaller
+ *  communication time is used.
+ *
+ *  The time of each candidate is predicted with a latency-bandwidth
+ *  model of the channel communicator, measured once per communicator
+ *  size, and then measured by running its collectives at the actual
+ *  sizes. Selections are stored in the algorithm cache of the backend.
+ *  Collective over the processes of the tensors.
+ */
+template <typename DataType>
+class ChanfiltTuner
+{
+public:
+    struct Estimate
+    {
+        double predicted = 0;
+        double measured = 0;
+    };
+
+    explicit ChanfiltTuner(BackendDNNLib& backend) : m_be(backend) {}
+
+    /** @brief Select X or Y.
+     *
+     *  @param input_count Local size of the input.
+     *  @param output_count Local size of the output.
+     *  @param chan_comm The communicator of the channel dimension.
+     *  @param comm The communicator of all the processes.
+     */
+    ChannelParallelismAlgorithm tune(size_t input_count,
+                                     size_t output_count,
+                                     Al::NCCLBackend::comm_type& chan_comm,
+                                     MPI_Comm comm)
+    {
+        size_t counts[2] = {input_count, output_count};
+        DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE,
+                                         counts,
+                                         2,
+                                         util::get_mpi_data_type<size_t>(),
+                                         MPI_MAX,
+                                         comm));
+        const int np = chan_comm.size();
+        std::stringstream ss;
+        ss << "chanfilt np=" << np << " input=" << counts[0]
+           << " output=" << counts[1] << " type_size=" << sizeof(DataType);
+        const auto key = ss.str();
+        int algo;
+        int cached = m_be.get_algo_cache().lookup(key, 0, algo);
+        DISTCONV_CHECK_MPI(
+            MPI_Allreduce(MPI_IN_PLACE, &cached, 1, MPI_INT, MPI_LAND, comm));
+        if (cached)
+        {
+            return static_cast<ChannelParallelismAlgorithm>(algo);
+        }
+
+        const auto& link = get_link(chan_comm, comm);
+        // X exchanges outputs and Y exchanges inputs, both once
+        // gathered and once reduce-scattered.
+        m_estimates[ChannelParallelismAlgorithm::X].predicted =
+            predict(link, np, counts[1]);
+        m_estimates[ChannelParallelismAlgorithm::Y].predicted =
+            predict(link, np, counts[0]);
+        m_estimates[ChannelParallelismAlgorithm::X].measured =
+            measure(chan_comm, comm, counts[1]);
+        m_estimates[ChannelParallelismAlgorithm::Y].measured =
+            measure(chan_comm, comm, counts[0]);
+        for (const auto& x : m_estimates)
+        {
+            util::MPIRootPrintStreamDebug()
+                << "Channel/filter parallelism " << x.first
+                << " predicted: " << x.second.predicted
+                << " s, measured: " << x.second.measured << " s for " << key;
+        }
+        const auto best =
+            m_estimates[ChannelParallelismAlgorithm::X].measured
+                    <= m_estimates[ChannelParallelismAlgorithm::Y].measured
+                ? ChannelParallelismAlgorithm::X
+                : ChannelParallelismAlgorithm::Y;
+        m_be.get_algo_cache().insert(key, static_cast<int>(best), 0);
+        return best;
+    }
+
+    /** @brief Estimates of the last tuning. Empty when the selection
+     *  was found in the cache. */
+    const std::map<ChannelParallelismAlgorithm, Estimate>&
+    get_estimates() const
+    {
+        return m_estimates;
+    }
+
+private:
+    struct Link
+    {
+        // Seconds per step and per byte
+        double latency;
+        double inv_bandwidth;
+    };
+
+    BackendDNNLib& m_be;
+    std::map<ChannelParallelismAlgorithm, Estimate> m_estimates;
+    static constexpr int m_num_warmup = 2;
+    static constexpr int m_num_trials = 5;
+    // Per-rank count of the bandwidth measurement
+    static constexpr size_t m_large_count = 1 << 22;
+
+    // Ring collectives have np - 1 steps, each receiving count elements
+    static double predict(const Link& link, int np, size_t count)
+    {
+        return 2 * (np - 1)
+               * (link.latency + count * sizeof(DataType) * link.inv_bandwidth);
+    }
+
+    // Measured once per size of the channel communicators
+    const Link& get_link(Al::NCCLBackend::comm_type& chan_comm, MPI_Comm comm)
+    {
+        static std::map<int, Link> links;
+        const int np = chan_comm.size();
+        auto it = links.find(np);
+        if (it != links.end())
+        {
+            return it->second;
+        }
+        const double t_small = measure(chan_comm, comm, 1);
+        const double t_large = measure(chan_comm, comm, m_large_count);
+        Link link;
+        link.latency = t_small / (2 * (np - 1));
+        link.inv_bandwidth = std::max(t_large - t_small, 0.0)
+                             / (2 * (np - 1) * m_large_count * sizeof(DataType));
+        util::MPIRootPrintStreamInfo()
+            << "Channel communicator of " << np
+            << " processes, latency: " << link.latency
+            << " s, bandwidth: " << 1 / link.inv_bandwidth << " B/s";
+        return links[np] = link;
+    }
+
+    // Time of an allgather and a reduce-scatter receiving count
+    // elements per rank, maximized over comm
+    static double measure(Al::NCCLBackend::comm_type& chan_comm,
+                          MPI_Comm comm,
+                          size_t count)
+    {
+        const int np = chan_comm.size();
+        auto& pool = internal::RuntimeGPU::get_device_memory_pool();
+        auto stream = chan_comm.get_stream();
+        DataType* buf = static_cast<DataType*>(
+            pool.get(count * np * sizeof(DataType), stream));
+        DataType* local_buf = buf + count * chan_comm.rank();
+        auto run = [&]() {
+            Al::Allgather<Al::NCCLBackend, DataType>(
+                local_buf, buf, count, chan_comm);
+            Al::Reduce_scatter<Al::NCCLBackend, DataType>(
+                buf, local_buf, count, Al::ReductionOperator::sum, chan_comm);
+        };
+        for (int i = 0; i < m_num_warmup; ++i)
+        {
+            run();
+        }
+        h2::gpu::sync(stream);
+        DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+        const double start = MPI_Wtime();
+        for (int i = 0; i < m_num_trials; ++i)
+        {
+            run();
+        }
+        h2::gpu::sync(stream);
+        double t = (MPI_Wtime() - start) / m_num_trials;
+        pool.release(buf);
+        DISTCONV_CHECK_MPI(
+            MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, comm));
+        return t;
+    }
+};
+
+} // namespace distconv
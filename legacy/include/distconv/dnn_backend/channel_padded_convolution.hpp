@@ -0,0 +1,450 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/dnn_backend/convolution.hpp"
+#include "distconv/dnn_backend/halo_exchange_tuner.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/halo_exchange_cuda.hpp"
+#include "distconv/util/util.hpp"
+
+#include <Al.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+namespace distconv
+{
+namespace channel_padding
+{
+
+constexpr int max_num_dims = 5;
+
+/** @brief Elements copied between two local buffers of the same rank.
+ *
+ *  dims is the extent of the copy, which is at most the shape of
+ *  either buffer, and the strides are those of each buffer.
+ */
+struct Region
+{
+    int num_dims = 0;
+    int dims[max_num_dims];
+    index_t src_strides[max_num_dims];
+    index_t dst_strides[max_num_dims];
+};
+
+/** @brief dst = src + beta * dst over region
+ *
+ *  dst is not read with beta == 0.
+ */
+template <typename DataType>
+void copy(Region const& region,
+          DataType const* src,
+          DataType beta,
+          DataType* dst,
+          h2::gpu::DeviceStream stream);
+
+/** @brief Copies the overlapping channels of two local tensors that
+ *  differ only in their channel and outermost dimensions.
+ *
+ *  With include_halo, the halos are copied as well. At most
+ *  num_samples entries of the outermost dimension are copied, unless
+ *  it is negative.
+ */
+template <typename Tensor>
+void copy_channels(Tensor const& src,
+                   Tensor& dst,
+                   typename Tensor::data_type beta,
+                   bool include_halo,
+                   int num_samples,
+                   h2::gpu::DeviceStream stream)
+{
+    const int nd = src.get_num_dims();
+    assert_eq(nd, dst.get_num_dims());
+    assert_always(nd <= max_num_dims);
+    auto const src_shape =
+        include_halo ? src.get_local_real_shape() : src.get_local_shape();
+    auto const dst_shape =
+        include_halo ? dst.get_local_real_shape() : dst.get_local_shape();
+    auto const src_strides = src.get_strides();
+    auto const dst_strides = dst.get_strides();
+    Region region;
+    region.num_dims = nd;
+    for (int i = 0; i < nd; ++i)
+    {
+        region.dims[i] = std::min(src_shape[i], dst_shape[i]);
+        region.src_strides[i] = src_strides[i];
+        region.dst_strides[i] = dst_strides[i];
+    }
+    if (num_samples >= 0)
+        region.dims[nd - 1] = std::min(region.dims[nd - 1], num_samples);
+    copy(region,
+         src.get_const_buffer(!include_halo),
+         beta,
+         dst.get_buffer(!include_halo),
+         stream);
+}
+
+} // namespace channel_padding
+
+/** @brief A convolution with its channels and filters padded to a
+ *  multiple, e.g., for the tensor-core kernels of FP16 and BF16.
+ *
+ *  The input, filter and output channels are zero-padded up to the
+ *  next multiple of pad_multiple in internal tensors, which are
+ *  allocated at setup, and the wrapped convolution runs on them. The
+ *  padding is stripped when copying the results to the tensors of the
+ *  caller, which keep the original channel counts. Halos are exchanged
+ *  on the tensors of the caller before they are copied with their
+ *  halos, so the padded channels are never communicated, and neither
+ *  are they in the reduction of the filter gradients.
+ *
+ *  If both counts are already multiples, the wrapped convolution runs
+ *  on the tensors of the caller directly.
+ *
+ *  Grouped, transposed and channel/filter-parallel convolutions are
+ *  not supported, nor are partitioned channels or bias.
+ */
+template <typename DataType>
+class ChannelPaddedConvolution<BackendDNNLib, DataType>
+{
+    using TensorType =
+        tensor::Tensor<DataType, tensor::LocaleMPI, tensor::CUDAAllocator>;
+    using HaloExchange = tensor::
+        HaloExchange<DataType, tensor::CUDAAllocator, Al::NCCLBackend>;
+
+public:
+    ChannelPaddedConvolution(BackendDNNLib& backend,
+                             int num_dims,
+                             HaloExchangeMethod method,
+                             int pad_multiple = 8)
+        : m_be(backend),
+          m_num_dims(num_dims),
+          m_halo_xch_method(method),
+          m_pad_multiple(pad_multiple),
+          m_conv(backend,
+                 num_dims,
+                 method,
+                 false,
+                 backend.get_options().m_enable_profiling,
+                 ChannelParallelismAlgorithm::NONE)
+    {
+        assert_always(m_pad_multiple > 0);
+    }
+
+    ChannelPaddedConvolution(const ChannelPaddedConvolution&) = delete;
+    ChannelPaddedConvolution&
+    operator=(const ChannelPaddedConvolution&) = delete;
+
+    /** @brief The arguments are those of Convolution::setup. */
+    void setup(TensorType& input,
+               const TensorType& filter,
+               const TensorType& output,
+               const TensorType& d_input,
+               TensorType& d_filter,
+               TensorType& d_output,
+               const int_vector& pads,
+               const int_vector& strides,
+               const int_vector& dilations,
+               const std::string& fwd_algo,
+               const std::string& bwd_data_algo,
+               const std::string& bwd_filter_algo,
+               size_t ws_size,
+               bool skip_bp_data = false)
+    {
+        assert_eq(input.get_num_dims(), m_num_dims);
+        const int cd = input.get_channel_dim();
+        assert_eq(input.get_locale_shape()[cd], 1);
+        assert_eq(output.get_locale_shape()[cd], 1);
+        const index_t num_channels = input.get_shape()[cd];
+        const index_t num_filters = output.get_shape()[cd];
+        m_padded = pad(num_channels) != num_channels
+                   || pad(num_filters) != num_filters;
+        m_num_samples = -1;
+        m_skip_bp_data = skip_bp_data;
+        if (!m_padded)
+        {
+            m_conv.setup(input,
+                         filter,
+                         output,
+                         d_input,
+                         d_filter,
+                         d_output,
+                         pads,
+                         strides,
+                         dilations,
+                         1,
+                         fwd_algo,
+                         bwd_data_algo,
+                         bwd_filter_algo,
+                         ws_size,
+                         skip_bp_data);
+            return;
+        }
+        util::MPIRootPrintStreamInfo()
+            << "Padding channels/filters from " << num_channels << "/"
+            << num_filters << " to " << pad(num_channels) << "/"
+            << pad(num_filters);
+
+        // The filter is (..., C, K) in either layout
+        const int fcd = filter.get_channel_dim();
+        m_input_t = make_padded(input, cd, num_channels, -1, 0);
+        m_d_input_t = make_padded(d_input, cd, num_channels, -1, 0);
+        m_output_t = make_padded(output, cd, num_filters, -1, 0);
+        m_d_output_t = make_padded(d_output, cd, num_filters, -1, 0);
+        m_filter_t = make_padded(filter, fcd, num_channels, -1, num_filters);
+        m_d_filter_t =
+            make_padded(d_filter, fcd, num_channels, -1, num_filters);
+
+        m_conv.setup(m_input_t,
+                     m_filter_t,
+                     m_output_t,
+                     m_d_input_t,
+                     m_d_filter_t,
+                     m_d_output_t,
+                     pads,
+                     strides,
+                     dilations,
+                     1,
+                     fwd_algo,
+                     bwd_data_algo,
+                     bwd_filter_algo,
+                     ws_size,
+                     skip_bp_data);
+        setup_halo_xch(input, d_output);
+    }
+
+    int forward(DataType alpha,
+                TensorType& input,
+                const TensorType& filter,
+                DataType beta,
+                TensorType& output,
+                bool skip_halo_exchange = false)
+    {
+        if (!m_padded)
+        {
+            return m_conv.forward(
+                alpha, input, filter, beta, output, skip_halo_exchange);
+        }
+        DISTCONV_RANGE("channel_padded_conv/forward", Compute);
+        if (!skip_halo_exchange)
+            exchange_halo(m_halo_xch_input);
+        auto const stream = m_be.get_stream();
+        copy_in(input, m_input_t, true);
+        copy_in(filter, m_filter_t, false);
+        int const ret = m_conv.forward(
+            alpha, m_input_t, m_filter_t, DataType(0), m_output_t, true);
+        if (ret != 0 || output.get_local_size() == 0)
+            return ret;
+        channel_padding::copy_channels(
+            m_output_t, output, beta, false, m_num_samples, stream);
+        return 0;
+    }
+
+    int backward_data(DataType alpha,
+                      const TensorType& filter,
+                      TensorType& d_output,
+                      DataType beta,
+                      TensorType& d_input,
+                      bool skip_halo_exchange = false)
+    {
+        if (!m_padded)
+        {
+            return m_conv.backward_data(
+                alpha, filter, d_output, beta, d_input, skip_halo_exchange);
+        }
+        if (m_skip_bp_data)
+            return 0;
+        DISTCONV_RANGE("channel_padded_conv/backward_data", Compute);
+        if (!skip_halo_exchange)
+            exchange_halo(m_halo_xch_d_output);
+        copy_in(d_output, m_d_output_t, true);
+        copy_in(filter, m_filter_t, false);
+        int const ret = m_conv.backward_data(
+            alpha, m_filter_t, m_d_output_t, DataType(0), m_d_input_t, true);
+        if (ret != 0 || d_input.get_local_size() == 0)
+            return ret;
+        channel_padding::copy_channels(m_d_input_t,
+                                       d_input,
+                                       beta,
+                                       false,
+                                       m_num_samples,
+                                       m_be.get_stream());
+        return 0;
+    }
+
+    int backward_filter(DataType alpha,
+                        const TensorType& input,
+                        TensorType& d_output,
+                        DataType beta,
+                        TensorType& d_filter,
+                        bool reduce = true)
+    {
+        if (!m_padded)
+        {
+            return m_conv.backward_filter(
+                alpha, input, d_output, beta, d_filter, reduce);
+        }
+        DISTCONV_RANGE("channel_padded_conv/backward_filter", Compute);
+        // The input with its halos was copied by forward
+        copy_in(d_output, m_d_output_t, true);
+        int const ret = m_conv.backward_filter(
+            alpha, m_input_t, m_d_output_t, DataType(0), m_d_filter_t, false);
+        if (ret != 0)
+            return ret;
+        channel_padding::copy_channels(
+            m_d_filter_t, d_filter, beta, false, -1, m_be.get_stream());
+        if (reduce)
+        {
+            auto& comm = m_be.get_al_nccl_comm();
+            Al::Allreduce<Al::NCCLBackend, DataType>(d_filter.get_base_ptr(),
+                                                     d_filter.get_size(),
+                                                     Al::ReductionOperator::sum,
+                                                     comm);
+        }
+        return 0;
+    }
+
+    /** @brief Backward filter and then backward data; see those. */
+    int backward(DataType alpha,
+                 const TensorType& input,
+                 const TensorType& filter,
+                 TensorType& d_output,
+                 DataType beta_filter,
+                 TensorType& d_filter,
+                 DataType beta_data,
+                 TensorType& d_input,
+                 bool reduce = true,
+                 bool skip_halo_exchange = false)
+    {
+        if (!m_padded)
+        {
+            return m_conv.backward(alpha,
+                                   input,
+                                   filter,
+                                   d_output,
+                                   beta_filter,
+                                   d_filter,
+                                   beta_data,
+                                   d_input,
+                                   reduce,
+                                   skip_halo_exchange);
+        }
+        int const ret = backward_filter(
+            alpha, input, d_output, beta_filter, d_filter, reduce);
+        if (ret != 0)
+            return ret;
+        return backward_data(
+            alpha, filter, d_output, beta_data, d_input, skip_halo_exchange);
+    }
+
+    void set_num_samples(int n)
+    {
+        m_conv.set_num_samples(n);
+        if (m_padded)
+            m_num_samples = n;
+    }
+
+    void wait() { m_be.wait(); }
+
+    /** @brief Whether the channels or filters are padded. */
+    bool is_padded() const { return m_padded; }
+
+    Convolution<BackendDNNLib, DataType>& get_convolution() { return m_conv; }
+
+private:
+    BackendDNNLib& m_be;
+    const int m_num_dims;
+    HaloExchangeMethod m_halo_xch_method;
+    const int m_pad_multiple;
+    Convolution<BackendDNNLib, DataType> m_conv;
+    bool m_padded = false;
+    bool m_skip_bp_data = false;
+    // Number of samples copied, all if negative
+    int m_num_samples = -1;
+    // Padded tensors the wrapped convolution runs on
+    TensorType m_input_t;
+    TensorType m_filter_t;
+    TensorType m_output_t;
+    TensorType m_d_input_t;
+    TensorType m_d_filter_t;
+    TensorType m_d_output_t;
+    std::shared_ptr<HaloExchange> m_halo_xch_input;
+    std::shared_ptr<HaloExchange> m_halo_xch_d_output;
+    BoundaryAttributesV<typename HaloExchangeTuner<DataType>::CommType>
+        m_boundary_comms;
+
+    index_t pad(index_t n) const
+    {
+        return util::ceil(n, (index_t) m_pad_multiple) * m_pad_multiple;
+    }
+
+    // Allocates a zero-cleared copy of t with the dimension dim padded
+    // from n, and the outermost one from outer_n if positive. The
+    // padded elements are never written afterwards, so they remain
+    // zero.
+    TensorType make_padded(const TensorType& t,
+                           int dim,
+                           index_t n,
+                           int outer_dim,
+                           index_t outer_n)
+    {
+        assert_eq(t.get_shape()[dim], n);
+        auto shape = t.get_shape();
+        shape[dim] = pad(n);
+        if (outer_n > 0)
+        {
+            assert_eq(t.get_shape()[outer_dim], outer_n);
+            shape[outer_dim] = pad(outer_n);
+        }
+        TensorType padded(shape, t.get_locale(), t.get_distribution());
+        padded.set_layout(t.get_layout());
+        assert0(padded.allocate());
+        padded.zero(m_be.get_stream());
+        return padded;
+    }
+
+    void copy_in(const TensorType& t, TensorType& padded, bool include_halo)
+    {
+        if (t.get_local_size() == 0)
+            return;
+        channel_padding::copy_channels(t,
+                                       padded,
+                                       DataType(0),
+                                       include_halo,
+                                       include_halo ? m_num_samples : -1,
+                                       m_be.get_stream());
+    }
+
+    void setup_halo_xch(TensorType& input, TensorType& d_output)
+    {
+        HaloExchangeTuner<DataType> tuner(m_be);
+        if (m_halo_xch_method == HaloExchangeMethod::AUTO)
+        {
+            m_halo_xch_input = tuner.tune(input);
+            m_halo_xch_d_output = tuner.tune(d_output);
+        }
+        else
+        {
+            m_halo_xch_input = tuner.make(m_halo_xch_method, input);
+            m_halo_xch_d_output = tuner.make(m_halo_xch_method, d_output);
+        }
+        m_boundary_comms = tuner.get_comms(input);
+    }
+
+    void exchange_halo(std::shared_ptr<HaloExchange>& xch)
+    {
+        if (!xch)
+            return;
+        xch->exchange(
+            m_boundary_comms, m_be.get_stream(), false, true, false, false);
+    }
+};
+
+} // namespace distconv
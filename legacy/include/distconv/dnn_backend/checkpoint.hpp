@@ -0,0 +1,140 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace distconv
+{
+
+/** @brief Activation checkpointing for a segment of layers.
+ *
+ *  Outputs added with add_recomputed() are freed by drop() after the
+ *  forward pass and recomputed by restore() before the backward pass
+ *  of the segment needs them. Each is recomputed by its function, in
+ *  the order they were added, which typically re-runs the forward
+ *  pass of a Convolution, BatchNormalization or ReLU. Forward passes
+ *  exchange the halos of their inputs through the layers' own
+ *  HaloExchange objects, so recomputed inputs get their halos back.
+ *  Batch normalization should be recomputed with the statistics of
+ *  the original pass, e.g., with forward_stage2(), so that the running
+ *  statistics are not updated twice.
+ *
+ *  Inputs of the segment added with add_compact() are kept while
+ *  dropped, but without halos and padding, and are copied back by
+ *  restore() before the recomputation.
+ *
+ *  Restored tensors get new memory, so the layers must not have
+ *  captured their addresses, e.g., in CUDA graphs.
+ */
+template <typename Tensor>
+class ActivationCheckpoint
+{
+public:
+    using Recompute = std::function<int()>;
+
+    /** @brief Drop t after the forward pass and recompute it with
+     *  recompute, which must write all of t.
+     */
+    void add_recomputed(Tensor& t, Recompute recompute)
+    {
+        m_recomputed.push_back(RecomputedTensor{&t, std::move(recompute)});
+    }
+
+    /** @brief Keep only the interior of t while dropped. */
+    void add_compact(Tensor& t)
+    {
+        m_compact.push_back(CompactTensor{&t, nullptr});
+    }
+
+    /** @brief Free the recomputed tensors and compact the others. */
+    int drop(h2::gpu::DeviceStream stream)
+    {
+        assert_always(!m_dropped);
+        for (auto& c : m_compact)
+        {
+            const Tensor& t = *c.tensor;
+            c.packed = std::make_unique<Tensor>(
+                t.get_shape(),
+                t.get_locale(),
+                t.get_distribution().get_non_overlapped_distribution(),
+                t.get_requested_local_shape(),
+                t.get_requested_local_block());
+            c.packed->set_layout(t.get_layout());
+            if (tensor::Copy(*c.packed, t, stream))
+                return 1;
+        }
+        // The copies and any work on the dropped tensors must be done
+        // before their memory is freed.
+        h2::gpu::sync(stream);
+        for (auto& c : m_compact)
+        {
+            c.tensor->nullify();
+        }
+        for (auto& r : m_recomputed)
+        {
+            r.tensor->nullify();
+        }
+        m_dropped = true;
+        return 0;
+    }
+
+    /** @brief Copy back the compacted tensors and recompute the
+     *  dropped ones.
+     */
+    int restore(h2::gpu::DeviceStream stream)
+    {
+        assert_always(m_dropped);
+        for (auto& c : m_compact)
+        {
+            if (tensor::Copy(*c.tensor, *c.packed, stream))
+                return 1;
+        }
+        for (auto& r : m_recomputed)
+        {
+            if (r.tensor->allocate())
+                return 1;
+            if (r.recompute())
+                return 1;
+        }
+        h2::gpu::sync(stream);
+        for (auto& c : m_compact)
+        {
+            c.packed.reset();
+        }
+        m_dropped = false;
+        return 0;
+    }
+
+    bool is_dropped() const { return m_dropped; }
+
+private:
+    struct RecomputedTensor
+    {
+        Tensor* tensor;
+        Recompute recompute;
+    };
+
+    struct CompactTensor
+    {
+        Tensor* tensor;
+        std::unique_ptr<Tensor> packed;
+    };
+
+    std::vector<RecomputedTensor> m_recomputed;
+    std::vector<CompactTensor> m_compact;
+    bool m_dropped = false;
+};
+
+} // namespace distconv
@@ -1,11 +1,20 @@
 #pragma once
 
 #include "distconv/dnn_backend/backend.hpp"
+#include "distconv/dnn_backend/chanfilt_tuner.hpp"
+#include "distconv/dnn_backend/grad_reducer.hpp"
+#include "distconv/dnn_backend/graph_cache.hpp"
+#include "distconv/dnn_backend/grouped_convolution.hpp"
+#include "distconv/dnn_backend/halo_exchange_tuner.hpp"
 #include "distconv/distconv.hpp"
 #include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/allreduce.hpp"
 #include "distconv/tensor/halo_exchange_cuda.hpp"
 #include "distconv/tensor/halo_exchange_cuda_al.hpp"
+#include "distconv/tensor/halo_exchange_cuda_batched.hpp"
+#include "distconv/tensor/halo_exchange_cuda_graph.hpp"
 #include "distconv/tensor/halo_exchange_cuda_mpi.hpp"
+#include "distconv/tensor/occupancy.hpp"
 #ifdef DISTCONV_HAS_P2P
 #include "distconv/tensor/halo_exchange_cuda_hybrid.hpp"
 #include "distconv/tensor/halo_exchange_cuda_p2p.hpp"
@@ -14,12 +23,23 @@
 #ifdef DISTCONV_HAS_NVSHMEM
 #include "distconv/tensor/halo_exchange_cuda_nvshmem.hpp"
 #endif // DISTCONV_HAS_NVSHMEM
+#include "distconv/util/instrumentation.hpp"
 #include "distconv/util/util_gpu.hpp"
 #include "distconv/util/util_gpu_dnn.hpp"
 
 #include <Al.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <map>
 #include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
 namespace distconv
 {
@@ -50,6 +70,7 @@ public:
           m_d_output_no_halo_d{backend::make_tensor_descriptor()},
           m_bias_d{backend::make_tensor_descriptor()},
           m_d_bias_d{backend::make_tensor_descriptor()},
+          m_activation_d{backend::make_activation_descriptor()},
           m_conv_fwd_d{backend::make_convolution_descriptor()},
           m_conv_bwd_d{backend::make_convolution_descriptor()},
           m_conv_bwd_filter_d{backend::make_convolution_descriptor()},
@@ -71,10 +92,13 @@ public:
           m_d_output_gathered_d{backend::make_tensor_descriptor()},
           m_d_input_all_channels_d{backend::make_tensor_descriptor()}
     {
-        apply_to_spatial_sides(m_num_dims, [this](int i, Side side) {
+        // The layout is known only at setup, so the descriptors are
+        // made for the spatial dimensions of either layout.
+        apply_to_sides(m_num_dims - 1, [this](int i, Side side) {
             m_input_boundaries_d(i, side) = backend::make_tensor_descriptor();
             m_output_boundaries_d(i, side) = backend::make_tensor_descriptor();
         });
+        backend::setup_relu_activation_descriptor(m_activation_d);
 
         setup_profiling_events();
     }
@@ -104,6 +128,7 @@ public:
         backend::destroy_tensor_descriptor(m_d_output_d);
         backend::destroy_tensor_descriptor(m_d_output_no_halo_d);
         backend::destroy_tensor_descriptor(m_d_bias_d);
+        backend::destroy_activation_descriptor(m_activation_d);
         backend::destroy_convolution_descriptor(m_conv_fwd_d);
         backend::destroy_convolution_descriptor(m_conv_bwd_d);
         backend::destroy_convolution_descriptor(m_conv_bwd_filter_d);
@@ -129,6 +154,7 @@ public:
         backend::copy_tensor_descriptor(m_d_output_no_halo_d,
                                         x.m_d_output_no_halo_d);
         backend::copy_tensor_descriptor(m_d_bias_d, x.m_d_bias_d);
+        backend::copy_activation_descriptor(m_activation_d, x.m_activation_d);
         backend::copy_convolution_descriptor(m_conv_fwd_d, x.m_conv_fwd_d);
         backend::copy_convolution_descriptor(m_conv_bwd_d, x.m_conv_bwd_d);
         backend::copy_convolution_descriptor(m_conv_bwd_filter_d,
@@ -149,6 +175,27 @@ public:
         m_ws_size_bwd_data = x.m_ws_size_bwd_data;
         m_ws_size_bwd_filter = x.m_ws_size_bwd_filter;
         m_ws_size_fwd_boundaries = x.m_ws_size_fwd_boundaries;
+        m_pads_fp = x.m_pads_fp;
+        m_pads_bp = x.m_pads_bp;
+        m_deconv_pads = x.m_deconv_pads;
+        m_causal = x.m_causal;
+        m_d_output_halo_fwd_send = x.m_d_output_halo_fwd_send;
+        m_d_output_halo_bwd_send = x.m_d_output_halo_bwd_send;
+        m_d_output_halo_fwd_recv = x.m_d_output_halo_fwd_recv;
+        m_d_output_halo_bwd_recv = x.m_d_output_halo_bwd_recv;
+        m_deconv_fwd_slabs = x.m_deconv_fwd_slabs;
+        m_deconv_bwd_data_slabs = x.m_deconv_bwd_data_slabs;
+        m_deconv_bwd_filter_slabs = x.m_deconv_bwd_filter_slabs;
+        m_grouped_supported = x.m_grouped_supported;
+        m_grouped_fwd_p = x.m_grouped_fwd_p;
+        m_grouped_bwd_data_p = x.m_grouped_bwd_data_p;
+        m_grouped_bwd_filter_p = x.m_grouped_bwd_filter_p;
+        m_fwd_grouped = x.m_fwd_grouped;
+        m_bwd_data_grouped = x.m_bwd_data_grouped;
+        m_bwd_filter_grouped = x.m_bwd_filter_grouped;
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        clear_graphs();
+#endif // DISTCONV_HAS_CUDA_GRAPH
 #if 0
     for (int i = 0; i < 2; ++i) {
       m_ddt_fwd[i] = x.m_ddt_fwd[i];
@@ -156,6 +203,12 @@ public:
     }
 #endif
         m_halo_xch_method = x.m_halo_xch_method;
+        m_num_fwd_sample_chunks = x.m_num_fwd_sample_chunks;
+        // The chunks view the input of x and are recreated on demand
+        m_fwd_sample_chunks.clear();
+        m_halo_comm_precision = x.m_halo_comm_precision;
+        m_halo_row_steps = x.m_halo_row_steps;
+        m_occupancy = x.m_occupancy;
         switch (m_halo_xch_method)
         {
         case HaloExchangeMethod::MPI:
@@ -180,6 +233,32 @@ public:
                     new HaloExchangeAL(x.m_halo_xch_d_output));
             }
             break;
+        case HaloExchangeMethod::AL_BATCHED:
+            if (x.m_halo_xch_input)
+            {
+                m_halo_xch_input.reset(
+                    new HaloExchangeALBatched(x.m_halo_xch_input));
+            }
+            if (x.m_halo_xch_d_output)
+            {
+                m_halo_xch_d_output.reset(
+                    new HaloExchangeALBatched(x.m_halo_xch_d_output));
+            }
+            break;
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        case HaloExchangeMethod::AL_GRAPH:
+            if (x.m_halo_xch_input)
+            {
+                m_halo_xch_input.reset(
+                    new HaloExchangeALGraph(x.m_halo_xch_input));
+            }
+            if (x.m_halo_xch_d_output)
+            {
+                m_halo_xch_d_output.reset(
+                    new HaloExchangeALGraph(x.m_halo_xch_d_output));
+            }
+            break;
+#endif // DISTCONV_HAS_CUDA_GRAPH
 #ifdef DISTCONV_HAS_P2P
         case HaloExchangeMethod::P2P:
             if (x.m_halo_xch_input)
@@ -204,6 +283,18 @@ public:
                     new HaloExchangeHybrid(x.m_halo_xch_d_output));
             }
             break;
+        case HaloExchangeMethod::P2P_FUSED_NOTIFY:
+            if (x.m_halo_xch_input)
+            {
+                m_halo_xch_input.reset(
+                    new HaloExchangeP2PFusedNotify(x.m_halo_xch_input));
+            }
+            if (x.m_halo_xch_d_output)
+            {
+                m_halo_xch_d_output.reset(
+                    new HaloExchangeP2PFusedNotify(x.m_halo_xch_d_output));
+            }
+            break;
 #endif // DISTCONV_HAS_P2P
 #ifdef DISTCONV_HAS_NVSHMEM
         case HaloExchangeMethod::NVSHMEM:
@@ -257,12 +348,20 @@ public:
             }
             break;
 #endif // DISTCONV_HAS_NVSHMEM
+        case HaloExchangeMethod::AUTO:
+            // Tuned again at setup
+            m_halo_xch_input.reset();
+            m_halo_xch_d_output.reset();
+            break;
         default:
             util::MPIPrintStreamError()
                 << "Invalid halo exchange method: " << m_halo_xch_method;
             std::abort();
         }
         m_chanfilt_algo = x.m_chanfilt_algo;
+        m_inference_only = x.m_inference_only;
+        m_chanfilt_estimates = x.m_chanfilt_estimates;
+        m_layout = x.m_layout;
         return *this;
     }
 
@@ -282,13 +381,22 @@ public:
                const std::string& bwd_filter_algo,
                size_t ws_size,
                bool skip_bp_data = false,
-               bool deconv = false)
+               bool deconv = false,
+               bool causal = false)
     {
         // NVSHMEM-exchange requires all processes join the allocation of
         // halo buffers, so this must be called even the local buffer is
         // empty.
         setup_halo_xch(input, d_output);
 
+        m_layout = input.get_layout();
+        assert_always(filter.get_layout() == m_layout);
+        assert_always(output.get_layout() == m_layout);
+
+        // All processes must exchange the same halo rows, so this is
+        // set even if the local tensors are empty
+        setup_halo_row_subset(strides, dilations, deconv);
+
         if (input.get_local_size() == 0 || output.get_local_size() == 0)
         {
             util::MPIPrintStreamInfo() << "Empty tensor detected";
@@ -298,16 +406,28 @@ public:
         }
 
         select_chanfilt_algorithm(input, filter, output);
+        // Channel/filter parallelism assumes the channels-first layout
+        assert_always(m_chanfilt_algo == ChannelParallelismAlgorithm::NONE
+                      || m_layout == tensor::Layout::CHANNELS_FIRST);
 
         m_skip_bp_data = skip_bp_data;
         m_deconv = deconv;
+        m_causal = causal;
+        assert_always(!(m_deconv && m_causal));
 
         std::vector<int> stencil_dims(m_num_spatial_dims, 0);
         for (int i = 0; i < m_num_spatial_dims; ++i)
         {
             auto window_dim = internal::get_dilated_filter_size(
-                (int) filter.get_shape()[i], dilations[i]);
-            if (window_dim % 2)
+                (int) filter.get_shape()[get_spatial_dim(i)], dilations[i]);
+            if (m_causal)
+            {
+                // Causal convolutions pad only the beginning by the
+                // whole window
+                assert_eq(pads[i], window_dim - 1);
+                stencil_dims[i] = window_dim - 1;
+            }
+            else if (window_dim % 2)
             {
                 stencil_dims[i] = (window_dim - 1) / 2;
             }
@@ -321,26 +441,49 @@ public:
         }
 
         auto p = pads[0];
-        for (int i = 0; i < m_num_spatial_dims; ++i)
+        for (int i = 0; i < m_num_spatial_dims && !m_causal; ++i)
         {
             assert_eq(pads[i], p);
             assert_always(pads[i] == stencil_dims[i] || pads[i] == 0);
         }
         bool use_padding = p != 0;
 
-        internal::get_halo_sizes(input,
-                                 IntVector(filter.get_shape()),
-                                 IntVector(strides),
-                                 IntVector(dilations),
-                                 m_halo_fwd_send,
-                                 m_halo_bwd_send,
-                                 m_halo_fwd_recv,
-                                 m_halo_bwd_recv,
-                                 use_padding);
+        const IntVector filter_dims(get_channels_first(filter.get_shape()));
+        if (m_causal)
+        {
+            setup_causal_halos(input, d_output, filter_dims, strides, dilations);
+        }
+        else if (!m_deconv)
+        {
+            internal::get_halo_sizes(input,
+                                     filter_dims,
+                                     IntVector(strides),
+                                     IntVector(dilations),
+                                     m_halo_fwd_send,
+                                     m_halo_bwd_send,
+                                     m_halo_fwd_recv,
+                                     m_halo_bwd_recv,
+                                     use_padding);
+        }
+        else
+        {
+            setup_deconv_halos(
+                input, output, filter_dims, pads, strides, dilations);
+        }
 
         util::MPIPrintStreamDebug() << "halo size: " << m_halo_fwd_recv[1]
                                     << ", " << m_halo_bwd_recv[1];
 
+        if (m_causal
+            && (m_overlap_halo_exchange_fwd || m_overlap_halo_exchange_bwd))
+        {
+            // The interior/boundary split assumes centered halos
+            util::MPIRootPrintStreamInfo()
+                << "Overlapped halo exchange disabled in causal convolution";
+            m_overlap_halo_exchange_fwd = false;
+            m_overlap_halo_exchange_bwd = false;
+        }
+
         if (m_overlap_halo_exchange_fwd)
         {
             // Disables fwd overlapping for tensors with small spatial domains
@@ -348,7 +491,8 @@ public:
             for (int i = 0; i < m_num_spatial_dims; ++i)
             {
                 // TODO: Parameterize the constant "3"?
-                if (input.get_local_shape()[i] < (index_t) stencil_dims[i] * 3)
+                if (input.get_local_shape()[get_spatial_dim(i)]
+                    < (index_t) stencil_dims[i] * 3)
                 {
                     util::MPIRootPrintStreamInfo()
                         << "Overlapped halo exchange in forward convolution "
@@ -368,7 +512,7 @@ public:
             int num_partitioned_dims = 0;
             for (int i = 0; i < m_num_spatial_dims; ++i)
             {
-                if (dist.get_locale_shape()[i] > 1)
+                if (dist.get_locale_shape()[get_spatial_dim(i)] > 1)
                     ++num_partitioned_dims;
             }
             if (num_partitioned_dims > 1)
@@ -387,7 +531,9 @@ public:
         for (int i = 0; i < m_num_spatial_dims; ++i)
         {
             if (stencil_dims[i] > 0
-                && input.get_distribution().get_split_shape()[i] > 1)
+                && input.get_distribution()
+                           .get_split_shape()[get_spatial_dim(i)]
+                       > 1)
             {
                 halo_exchange_required = true;
                 break;
@@ -400,6 +546,8 @@ public:
             m_overlap_halo_exchange_bwd = false;
         }
 
+        setup_fwd_sample_chunks(input, halo_exchange_required);
+
         if (m_overlap_halo_exchange_fwd)
         {
             util::MPIRootPrintStreamDebug() << "Overlapping of halo exchanges "
@@ -421,8 +569,8 @@ public:
                                  strides,
                                  dilations);
 
-        setup_convolution_descriptor(input.get_overlap(),
-                                     filter.get_shape(),
+        setup_convolution_descriptor(get_channels_first(input.get_overlap()),
+                                     get_channels_first(filter.get_shape()),
                                      pads,
                                      strides,
                                      dilations,
@@ -434,6 +582,28 @@ public:
                                     << "\n bwd data: " << m_conv_bwd_d
                                     << "\n bwd filter: " << m_conv_bwd_filter_d;
 
+        setup_grouped_problems(input,
+                               filter,
+                               output,
+                               d_input,
+                               d_output,
+                               strides,
+                               dilations,
+                               num_groups);
+
+        if (m_deconv)
+        {
+            setup_deconv_slabs(input,
+                               filter,
+                               output,
+                               d_input,
+                               d_output,
+                               pads,
+                               strides,
+                               dilations,
+                               num_groups);
+        }
+
         m_fwd_find_algo = fwd_algo;
         m_bwd_data_find_algo = bwd_data_algo;
         m_bwd_filter_find_algo = bwd_filter_algo;
@@ -467,6 +637,7 @@ public:
             return 0;
         }
         exchange_halo(input, m_halo_xch_input, m_overlap_halo_exchange_fwd);
+        record_input_halo(input);
         return 0;
     }
 
@@ -481,6 +652,39 @@ public:
                 bool dump_profile = false,
                 bool inference = false)
     {
+        util::instrumentation::ScopedTimer timer(
+            m_name, util::instrumentation::Phase::FORWARD, m_be.get_stream());
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        if (is_graph_capture_enabled(skip_halo_exchange))
+        {
+            int const num_samples = input.get_local_shape()[-1];
+            auto const key = get_graph_key("fwd",
+                                           num_samples,
+                                           {input.get_const_buffer(),
+                                            filter.get_const_buffer(),
+                                            output.get_const_buffer()},
+                                           alpha,
+                                           beta,
+                                           {skip_halo_exchange,
+                                            skip_chanfilt_comm,
+                                            dump_profile,
+                                            inference});
+            int const ret = run_graph(key, num_samples, [&]() {
+                return forward(alpha,
+                               input,
+                               filter,
+                               beta,
+                               output,
+                               skip_halo_exchange,
+                               skip_chanfilt_comm,
+                               dump_profile,
+                               inference);
+            });
+            // Replays fill the halo without running this function
+            record_input_halo(input);
+            return ret;
+        }
+#endif // DISTCONV_HAS_CUDA_GRAPH
         if (input.get_local_size() == 0 || filter.get_local_size() == 0
             || output.get_local_size() == 0)
         {
@@ -489,6 +693,15 @@ public:
             return 0;
         }
 
+        if (is_fwd_sample_chunked(input, skip_halo_exchange))
+        {
+            int const ret = forward_sample_chunked(
+                alpha, input, filter, beta, output, dump_profile);
+            // The chunks exchange the halo of the whole input
+            record_input_halo(input);
+            return ret;
+        }
+
         if (m_be.is_nvtx_enabled())
         {
             GPU_PROFILE_RANGE_PUSH("conv/forward");
@@ -523,18 +736,23 @@ public:
         setup_workspace_size_fwd();
         setup_workspace_size_fwd_boundaries();
 
-        void* ws = internal::RuntimeGPU::get_device_memory_pool().get(
-            m_ws_size_fwd, m_be.get_stream());
+        void* ws = m_be.get_workspace_arena().get(m_ws_size_fwd,
+                                                  m_be.get_stream());
 
-        if (ws == nullptr)
+        if (ws == nullptr && m_ws_size_fwd > 0)
             return -1;
 
+        // Skipping the exchange means the caller has filled the halo
         if (!skip_halo_exchange)
             forward_exchange_halo(input);
+        else
+            record_input_halo(input);
 
         const void* input_ptr =
-            input.get_const_base_ptr()
-            - input.get_local_offset(IndexVector(m_halo_bwd_recv), true);
+            m_deconv ? input.get_const_base_ptr()
+                     : input.get_const_base_ptr()
+                           - input.get_local_offset(
+                               IndexVector(m_halo_bwd_recv), true);
 
         if (m_be.is_nvtx_enabled())
         {
@@ -542,7 +760,7 @@ public:
         }
 
         auto const handle = m_be.get_handle();
-        if (!m_overlap_halo_exchange_fwd)
+        if (!is_fwd_split_for_overlap())
         {
             record_start_comp();
             if (m_chanfilt_algo == ChannelParallelismAlgorithm::X)
@@ -561,7 +779,7 @@ public:
                     m_output_all_filters_d,
                     m_output_all_filters_t.get_base_ptr(),
                     beta);
-                backend::convolution_forward(
+                m_be.convolution_forward(
                     handle,
                     alpha,
                     input_proxy.desc(),
@@ -592,19 +810,19 @@ public:
                                                 m_output_d,
                                                 output.get_base_ptr(),
                                                 beta);
-                backend::convolution_forward(handle,
-                                             alpha,
-                                             input_proxy.desc(),
-                                             input_proxy.ptr(),
-                                             m_filter_d,
-                                             filter.get_const_base_ptr(),
-                                             m_conv_fwd_d,
-                                             m_fwd_algo,
-                                             ws,
-                                             m_ws_size_fwd,
-                                             beta,
-                                             output_proxy.desc(),
-                                             output_proxy.ptr());
+                m_be.convolution_forward(handle,
+                                         alpha,
+                                         input_proxy.desc(),
+                                         input_proxy.ptr(),
+                                         m_filter_d,
+                                         filter.get_const_base_ptr(),
+                                         m_conv_fwd_d,
+                                         m_fwd_algo,
+                                         ws,
+                                         m_ws_size_fwd,
+                                         beta,
+                                         output_proxy.desc(),
+                                         output_proxy.ptr());
             }
             else if (m_chanfilt_algo == ChannelParallelismAlgorithm::W)
             {
@@ -625,7 +843,7 @@ public:
                     m_output_all_filters_d,
                     m_output_all_filters_t.get_base_ptr(),
                     beta);
-                backend::convolution_forward(
+                m_be.convolution_forward(
                     handle,
                     alpha,
                     input_proxy.desc(),
@@ -643,7 +861,21 @@ public:
             else
             {
                 // REFACTORING: Temporary adds deconv only this case
-                if (!m_deconv)
+                if (m_fwd_grouped)
+                {
+                    run_grouped_fwd(alpha,
+                                    input_ptr,
+                                    filter.get_const_base_ptr(),
+                                    beta,
+                                    output.get_base_ptr());
+                }
+                else if (!m_deconv
+                         && skip_forward(
+                             beta, output, !skip_halo_exchange))
+                {
+                    // The output of an empty input is zero
+                }
+                else if (!m_deconv)
                 {
                     ensure_tensors_conform(input, output, filter, "forward");
                     ensure_tensor_descriptors_conform(
@@ -654,19 +886,19 @@ public:
                         m_output_d,
                         output.get_base_ptr(),
                         beta);
-                    backend::convolution_forward(handle,
-                                                 alpha,
-                                                 input_proxy.desc(),
-                                                 input_proxy.ptr(),
-                                                 m_filter_d,
-                                                 filter.get_const_base_ptr(),
-                                                 m_conv_fwd_d,
-                                                 m_fwd_algo,
-                                                 ws,
-                                                 m_ws_size_fwd,
-                                                 beta,
-                                                 output_proxy.desc(),
-                                                 output_proxy.ptr());
+                    m_be.convolution_forward(handle,
+                                             alpha,
+                                             input_proxy.desc(),
+                                             input_proxy.ptr(),
+                                             m_filter_d,
+                                             filter.get_const_base_ptr(),
+                                             m_conv_fwd_d,
+                                             m_fwd_algo,
+                                             ws,
+                                             m_ws_size_fwd,
+                                             beta,
+                                             output_proxy.desc(),
+                                             output_proxy.ptr());
                }
                 else
                 {
@@ -676,19 +908,19 @@ public:
                         m_output_d,
                         output.get_base_ptr(),
                         beta);
-                    backend::convolution_bwd_data(handle,
-                                                  alpha,
-                                                  m_filter_d,
-                                                  filter.get_const_base_ptr(),
-                                                  input_proxy.desc(),
-                                                  input_proxy.ptr(),
-                                                  m_conv_fwd_d,
-                                                  m_bwd_data_algo,
-                                                  ws,
-                                                  m_ws_size_fwd,
-                                                  beta,
-                                                  output_proxy.desc(),
-                                                  output_proxy.ptr());
+                    m_be.convolution_bwd_data(handle,
+                                              alpha,
+                                              m_filter_d,
+                                              filter.get_const_base_ptr(),
+                                              input_proxy.desc(),
+                                              input_proxy.ptr(),
+                                              m_conv_fwd_d,
+                                              m_bwd_data_algo,
+                                              ws,
+                                              m_ws_size_fwd,
+                                              beta,
+                                              output_proxy.desc(),
+                                              output_proxy.ptr());
                 }
             }
             record_end_comp();
@@ -710,22 +942,22 @@ public:
                     m_output_interior_d,
                     output_interior_ptr,
                     beta);
-                backend::convolution_forward(handle,
-                                             alpha,
-                                             input_proxy.desc(),
-                                             input_proxy.ptr(),
-                                             m_filter_d,
-                                             filter.get_const_base_ptr(),
-                                             m_conv_fwd_d,
-                                             m_fwd_algo,
-                                             ws,
-                                             m_ws_size_fwd,
-                                             beta,
-                                             output_proxy.desc(),
-                                             output_proxy.ptr());
+                m_be.convolution_forward(handle,
+                                         alpha,
+                                         input_proxy.desc(),
+                                         input_proxy.ptr(),
+                                         m_filter_d,
+                                         filter.get_const_base_ptr(),
+                                         m_conv_fwd_d,
+                                         m_fwd_algo,
+                                         ws,
+                                         m_ws_size_fwd,
+                                         beta,
+                                         output_proxy.desc(),
+                                         output_proxy.ptr());
             }
             record_end_comp();
-            apply_to_spatial_sides(m_num_dims, [&](int i, Side side) {
+            apply_to_spatial_sides([&](int i, Side side) {
                 if (!m_boundary_req(i, side))
                     return;
                 const void* boundary_input_ptr =
@@ -735,9 +967,12 @@ public:
                     output.get_buffer() + m_output_boundary_offsets(i, side);
                 h2::gpu::DeviceStream st_boundary =
                     get_boundary_stream(i, side);
-                void* ws_boundary =
-                    internal::RuntimeGPU::get_device_memory_pool().get(
-                        m_ws_size_fwd_boundaries(i, side), st_boundary);
+                void* ws_boundary = m_be.get_workspace_arena().get(
+                    m_ws_size_fwd_boundaries(i, side), st_boundary);
+                // Waits for the halo of the other side as well
+                if (m_boundary_paired[i])
+                    util::wait_stream(get_boundary_stream(i, RHS),
+                                      st_boundary);
                 util::MPIPrintStreamDebug()
                     << "Launching convolution of boundary at dimension " << i
                     << ", side: " << side;
@@ -753,27 +988,36 @@ public:
                     m_output_boundaries_d(i, side),
                     boundary_output_ptr,
                     beta);
-                backend::convolution_forward(handle,
-                                             alpha,
-                                             input_proxy.desc(),
-                                             input_proxy.ptr(),
-                                             m_filter_d,
-                                             filter.get_const_base_ptr(),
-                                             m_conv_fwd_d,
-                                             m_fwd_boundary_algos(i, side),
-                                             ws_boundary,
-                                             m_ws_size_fwd_boundaries(i, side),
-                                             beta,
-                                             output_proxy.desc(),
-                                             output_proxy.ptr());
+                m_be.convolution_forward(handle,
+                                         alpha,
+                                         input_proxy.desc(),
+                                         input_proxy.ptr(),
+                                         m_filter_d,
+                                         filter.get_const_base_ptr(),
+                                         m_conv_fwd_d,
+                                         m_fwd_boundary_algos(i, side),
+                                         ws_boundary,
+                                         m_ws_size_fwd_boundaries(i, side),
+                                         beta,
+                                         output_proxy.desc(),
+                                         output_proxy.ptr());
                 record_end_boundary(i, side);
-                internal::RuntimeGPU::get_device_memory_pool().release(
-                    ws_boundary);
                 util::wait_stream(st_boundary, m_be.get_stream());
             });
             backend::set_stream(handle, m_be.get_stream());
         }
 
+        if (m_deconv && !m_deconv_fwd_slabs.empty())
+        {
+            // The exchange overlaps the library call when asynchronous
+            if (m_overlap_halo_exchange_fwd)
+                wait_halo_exchange(m_be.get_stream());
+            run_deconv_halo_fwd(alpha,
+                                input.get_const_base_ptr(),
+                                filter.get_const_base_ptr(),
+                                output.get_base_ptr());
+        }
+
         if (!skip_chanfilt_comm
             && (m_chanfilt_algo == ChannelParallelismAlgorithm::X
                 || m_chanfilt_algo == ChannelParallelismAlgorithm::W))
@@ -795,8 +1039,6 @@ public:
             release_tmp_tensor_buffer(m_input_gathered_t);
         }
 
-        internal::RuntimeGPU::get_device_memory_pool().release(ws);
-
         if (m_be.is_nvtx_enabled())
         {
             m_be.wait();
@@ -835,6 +1077,256 @@ public:
         return 0;
     }
 
+    /** @brief Forward convolution with bias and ReLU applied in the
+     *  same pass: output = relu(alpha * conv(input) + beta * output +
+     *  bias).
+     *
+     *  The interior (or the whole local domain when halo exchange is
+     *  not overlapped) is computed with a single fused library call.
+     *  Boundary regions run on their own streams, so their epilogue is
+     *  applied right after each boundary convolution on the same
+     *  stream. The boundary regions of different dimensions overlap at
+     *  the edges and corners, which would get the bias more than once,
+     *  so with more than one partitioned spatial dimension this falls
+     *  back, as channel/filter parallelism and deconvolution do, to
+     *  forward followed by separate bias and activation kernels.
+     */
+    template <typename Allocator>
+    int
+    forward_bias_relu(DataType alpha,
+                      tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+                      const tensor::Tensor<DataType, LocaleMPI, Allocator>& filter,
+                      const tensor::Tensor<DataType, LocaleMPI, Allocator>& bias,
+                      DataType beta,
+                      tensor::Tensor<DataType, LocaleMPI, Allocator>& output,
+                      bool skip_halo_exchange = false,
+                      bool dump_profile = false)
+    {
+        if (m_chanfilt_algo != ChannelParallelismAlgorithm::NONE || m_deconv
+            || (m_overlap_halo_exchange_fwd
+                && has_overlapping_fwd_boundaries()))
+        {
+            int const ret = forward(alpha,
+                                    input,
+                                    filter,
+                                    beta,
+                                    output,
+                                    skip_halo_exchange,
+                                    false,
+                                    dump_profile);
+            if (ret != 0 || output.get_local_size() == 0)
+                return ret;
+            apply_bias(DataType(1), bias, DataType(1), output);
+            apply_relu_epilogue(m_output_d, output.get_base_ptr());
+            return 0;
+        }
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        if (is_graph_capture_enabled(skip_halo_exchange))
+        {
+            int const num_samples = input.get_local_shape()[-1];
+            auto const key = get_graph_key("fwd_bias_relu",
+                                           num_samples,
+                                           {input.get_const_buffer(),
+                                            filter.get_const_buffer(),
+                                            bias.get_const_buffer(),
+                                            output.get_const_buffer()},
+                                           alpha,
+                                           beta,
+                                           {skip_halo_exchange, dump_profile});
+            return run_graph(key, num_samples, [&]() {
+                return forward_bias_relu(alpha,
+                                         input,
+                                         filter,
+                                         bias,
+                                         beta,
+                                         output,
+                                         skip_halo_exchange,
+                                         dump_profile);
+            });
+        }
+#endif // DISTCONV_HAS_CUDA_GRAPH
+        if (input.get_local_size() == 0 || filter.get_local_size() == 0
+            || output.get_local_size() == 0)
+        {
+            util::MPIPrintStreamDebug()
+                << "Skipping forward convolution with an empty tensor";
+            return 0;
+        }
+
+        if (m_be.is_nvtx_enabled())
+        {
+            GPU_PROFILE_RANGE_PUSH("conv/forward_bias_relu");
+        }
+
+        set_num_samples(input.get_local_shape()[-1]);
+
+        setup_algorithms_fwd(input.get_buffer(),
+                             filter.get_buffer(),
+                             output.get_buffer());
+        setup_workspace_size_fwd();
+        setup_workspace_size_fwd_boundaries();
+
+        void* ws = m_be.get_workspace_arena().get(m_ws_size_fwd,
+                                                  m_be.get_stream());
+
+        if (ws == nullptr && m_ws_size_fwd > 0)
+            return -1;
+
+        if (!skip_halo_exchange)
+            forward_exchange_halo(input);
+
+        auto const handle = m_be.get_handle();
+        record_start_comp();
+        if (!m_overlap_halo_exchange_fwd && m_fwd_grouped)
+        {
+            const void* input_ptr =
+                input.get_const_base_ptr()
+                - input.get_local_offset(IndexVector(m_halo_bwd_recv), true);
+            run_grouped_fwd(alpha,
+                            input_ptr,
+                            filter.get_const_base_ptr(),
+                            beta,
+                            output.get_base_ptr());
+            backend::apply_fwd_bias(handle,
+                                    DataType(1),
+                                    m_bias_d,
+                                    bias.get_const_base_ptr(),
+                                    DataType(1),
+                                    m_output_d,
+                                    output.get_base_ptr());
+            apply_relu_epilogue(m_output_d, output.get_base_ptr());
+            record_end_comp();
+        }
+        else if (!m_overlap_halo_exchange_fwd)
+        {
+            const void* input_ptr =
+                input.get_const_base_ptr()
+                - input.get_local_offset(IndexVector(m_halo_bwd_recv), true);
+            auto input_proxy =
+                dnn_lib::read_proxy(handle, m_input_d, input_ptr);
+            auto output_proxy = dnn_lib::write_proxy(
+                handle, m_output_d, output.get_base_ptr(), beta);
+            m_be.convolution_bias_activation_forward(
+                handle,
+                alpha,
+                input_proxy.desc(),
+                input_proxy.ptr(),
+                m_filter_d,
+                filter.get_const_base_ptr(),
+                m_conv_fwd_d,
+                m_fwd_algo,
+                ws,
+                m_ws_size_fwd,
+                beta,
+                m_bias_d,
+                bias.get_const_base_ptr(),
+                m_activation_d,
+                output_proxy.desc(),
+                output_proxy.ptr());
+            record_end_comp();
+        }
+        else
+        {
+            if (m_interior_req)
+            {
+                const void* input_interior_ptr =
+                    input.get_const_buffer() + m_input_interior_offset;
+                void* output_interior_ptr =
+                    output.get_buffer() + m_output_interior_offset;
+                auto input_proxy = dnn_lib::read_proxy(
+                    handle, m_input_interior_d, input_interior_ptr);
+                auto output_proxy = dnn_lib::write_proxy(
+                    handle, m_output_interior_d, output_interior_ptr, beta);
+                m_be.convolution_bias_activation_forward(
+                    handle,
+                    alpha,
+                    input_proxy.desc(),
+                    input_proxy.ptr(),
+                    m_filter_d,
+                    filter.get_const_base_ptr(),
+                    m_conv_fwd_d,
+                    m_fwd_algo,
+                    ws,
+                    m_ws_size_fwd,
+                    beta,
+                    m_bias_d,
+                    bias.get_const_base_ptr(),
+                    m_activation_d,
+                    output_proxy.desc(),
+                    output_proxy.ptr());
+            }
+            record_end_comp();
+            apply_to_spatial_sides([&](int i, Side side) {
+                if (!m_boundary_req(i, side))
+                    return;
+                const void* boundary_input_ptr =
+                    input.get_const_buffer()
+                    + m_input_boundary_offsets(i, side);
+                void* boundary_output_ptr =
+                    output.get_buffer() + m_output_boundary_offsets(i, side);
+                h2::gpu::DeviceStream st_boundary =
+                    get_boundary_stream(i, side);
+                void* ws_boundary = m_be.get_workspace_arena().get(
+                    m_ws_size_fwd_boundaries(i, side), st_boundary);
+                if (m_boundary_paired[i])
+                    util::wait_stream(get_boundary_stream(i, RHS),
+                                      st_boundary);
+                record_start_boundary(i, side);
+                backend::set_stream(handle, st_boundary);
+                {
+                    auto input_proxy = dnn_lib::read_proxy(
+                        handle,
+                        m_input_boundaries_d(i, side),
+                        boundary_input_ptr);
+                    auto output_proxy = dnn_lib::write_proxy(
+                        handle,
+                        m_output_boundaries_d(i, side),
+                        boundary_output_ptr,
+                        beta);
+                    // Boundary algorithms are searched without fusion,
+                    // so the epilogue is not fused into them.
+                    m_be.convolution_forward(
+                        handle,
+                        alpha,
+                        input_proxy.desc(),
+                        input_proxy.ptr(),
+                        m_filter_d,
+                        filter.get_const_base_ptr(),
+                        m_conv_fwd_d,
+                        m_fwd_boundary_algos(i, side),
+                        ws_boundary,
+                        m_ws_size_fwd_boundaries(i, side),
+                        beta,
+                        output_proxy.desc(),
+                        output_proxy.ptr());
+                }
+                backend::apply_fwd_bias(handle,
+                                        DataType(1),
+                                        m_bias_d,
+                                        bias.get_const_base_ptr(),
+                                        DataType(1),
+                                        m_output_boundaries_d(i, side),
+                                        static_cast<DataType*>(
+                                            boundary_output_ptr));
+                apply_relu_epilogue(m_output_boundaries_d(i, side),
+                                    boundary_output_ptr);
+                record_end_boundary(i, side);
+                util::wait_stream(st_boundary, m_be.get_stream());
+            });
+            backend::set_stream(handle, m_be.get_stream());
+        }
+
+        if (m_be.is_nvtx_enabled())
+        {
+            GPU_PROFILE_RANGE_POP();
+        }
+
+        if (dump_profile)
+            dump_profile_statistics(true, true, true);
+
+        return 0;
+    }
+
     // Start halo exchange for backward data
     template <typename Allocator>
     int backward_data_exchange_halo(
@@ -847,11 +1339,12 @@ public:
         set_num_samples(d_output.get_local_shape()[-1]);
         // When done asynchronously, the halo regions must not be modified
         // yet as they are read by the backward filter convolution, so the
-        // skip option must be used
+        // skip option must be used. The library calls of deconvolution
+        // do not read them.
         exchange_halo(d_output,
                       m_halo_xch_d_output,
                       m_overlap_halo_exchange_bwd,
-                      m_overlap_halo_exchange_bwd);
+                      m_overlap_halo_exchange_bwd && !m_deconv);
         return 0;
     }
 
@@ -866,6 +1359,36 @@ public:
                   bool skip_chanfilt_comm = false,
                   bool dump_profile = false)
     {
+        util::instrumentation::ScopedTimer timer(
+            m_name,
+            util::instrumentation::Phase::BACKWARD_DATA,
+            m_be.get_stream());
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        if (!m_skip_bp_data && is_graph_capture_enabled(skip_halo_exchange))
+        {
+            int const num_samples = d_output.get_local_shape()[-1];
+            auto const key = get_graph_key("bwd_data",
+                                           num_samples,
+                                           {filter.get_const_buffer(),
+                                            d_output.get_const_buffer(),
+                                            d_input.get_const_buffer()},
+                                           alpha,
+                                           beta,
+                                           {skip_halo_exchange,
+                                            skip_chanfilt_comm,
+                                            dump_profile});
+            return run_graph(key, num_samples, [&]() {
+                return backward_data(alpha,
+                                     filter,
+                                     d_output,
+                                     beta,
+                                     d_input,
+                                     skip_halo_exchange,
+                                     skip_chanfilt_comm,
+                                     dump_profile);
+            });
+        }
+#endif // DISTCONV_HAS_CUDA_GRAPH
         if (m_skip_bp_data)
         {
             util::MPIRootPrintStreamInfo()
@@ -902,15 +1425,17 @@ public:
                                   d_output.get_buffer());
         setup_workspace_size_bwd_data();
 
-        void* ws = internal::RuntimeGPU::get_device_memory_pool().get(
-            m_ws_size_bwd_data, m_be.get_stream());
-        if (ws == nullptr)
+        void* ws = m_be.get_workspace_arena().get(m_ws_size_bwd_data,
+                                                  m_be.get_stream());
+        if (ws == nullptr && m_ws_size_bwd_data > 0)
             return -1;
 
-        void* d_input_ptr = d_input.get_base_ptr()
-                            - d_input.get_local_offset(m_halo_bwd_recv, true);
+        void* d_input_ptr =
+            m_deconv ? d_input.get_base_ptr()
+                     : d_input.get_base_ptr()
+                           - d_input.get_local_offset(m_halo_bwd_recv, true);
 
-        if (m_overlap_halo_exchange_bwd)
+        if (m_overlap_halo_exchange_bwd && !m_deconv)
         {
             unpack_halo(d_output, m_halo_xch_d_output);
         }
@@ -938,7 +1463,7 @@ public:
                 m_d_input_d,
                 d_input_ptr,
                 beta);
-            backend::convolution_bwd_data(
+            m_be.convolution_bwd_data(
                 m_be.get_handle(),
                 alpha,
                 m_filter_d,
@@ -973,7 +1498,7 @@ public:
                 m_d_input_all_channels_d,
                 m_d_input_all_channels_t.get_base_ptr(),
                 beta);
-            backend::convolution_bwd_data(
+            m_be.convolution_bwd_data(
                 m_be.get_handle(),
                 alpha,
                 m_filter_d,
@@ -1009,7 +1534,7 @@ public:
                 m_d_input_all_channels_d,
                 m_d_input_all_channels_t.get_base_ptr(),
                 beta);
-            backend::convolution_bwd_data(
+            m_be.convolution_bwd_data(
                 m_be.get_handle(),
                 alpha,
                 m_filter_d,
@@ -1026,7 +1551,15 @@ public:
         }
         else
         {
-            if (!m_deconv)
+            if (m_bwd_data_grouped)
+            {
+                run_grouped_bwd_data(alpha,
+                                     filter.get_const_base_ptr(),
+                                     d_output.get_const_buffer(),
+                                     beta,
+                                     d_input_ptr);
+            }
+            else if (!m_deconv)
             {
                 ensure_tensors_conform(
                     d_input, d_output, filter, "backward-data");
@@ -1041,44 +1574,53 @@ public:
                     m_d_input_d,
                     d_input_ptr,
                     beta);
-                backend::convolution_bwd_data(m_be.get_handle(),
-                                              alpha,
-                                              m_filter_d,
-                                              filter.get_const_base_ptr(),
-                                              dy_proxy.desc(),
-                                              dy_proxy.ptr(),
-                                              m_conv_bwd_d,
-                                              m_bwd_data_algo,
-                                              ws,
-                                              m_ws_size_bwd_data,
-                                              beta,
-                                              dx_proxy.desc(),
-                                              dx_proxy.ptr());
+                m_be.convolution_bwd_data(m_be.get_handle(),
+                                          alpha,
+                                          m_filter_d,
+                                          filter.get_const_base_ptr(),
+                                          dy_proxy.desc(),
+                                          dy_proxy.ptr(),
+                                          m_conv_bwd_d,
+                                          m_bwd_data_algo,
+                                          ws,
+                                          m_ws_size_bwd_data,
+                                          beta,
+                                          dx_proxy.desc(),
+                                          dx_proxy.ptr());
             }
             else
             {
                 auto dy_proxy = dnn_lib::read_proxy(
                     handle,
                     m_d_output_d,
-                    d_output.get_const_buffer());
+                    d_output.get_const_base_ptr());
                 auto dx_proxy = dnn_lib::write_proxy(
                     handle,
                     m_d_input_d,
                     d_input_ptr,
                     beta);
-                backend::convolution_forward(m_be.get_handle(),
-                                             alpha,
-                                             dy_proxy.desc(),
-                                             dy_proxy.ptr(),
-                                             m_filter_d,
+                m_be.convolution_forward(m_be.get_handle(),
+                                         alpha,
+                                         dy_proxy.desc(),
+                                         dy_proxy.ptr(),
+                                         m_filter_d,
+                                         filter.get_const_base_ptr(),
+                                         m_conv_bwd_d,
+                                         m_fwd_algo,
+                                         ws,
+                                         m_ws_size_bwd_data,
+                                         beta,
+                                         dx_proxy.desc(),
+                                         dx_proxy.ptr());
+                if (!m_deconv_bwd_data_slabs.empty())
+                {
+                    if (m_overlap_halo_exchange_bwd)
+                        wait_halo_exchange(m_be.get_stream());
+                    run_deconv_halo_bwd_data(alpha,
                                              filter.get_const_base_ptr(),
-                                             m_conv_bwd_d,
-                                             m_fwd_algo,
-                                             ws,
-                                             m_ws_size_bwd_data,
-                                             beta,
-                                             dx_proxy.desc(),
-                                             dx_proxy.ptr());
+                                             d_output.get_const_base_ptr(),
+                                             d_input.get_base_ptr());
+                }
             }
         }
         if (!skip_chanfilt_comm
@@ -1099,8 +1641,6 @@ public:
         {
             release_tmp_tensor_buffer(m_d_input_all_channels_t);
         }
-        internal::RuntimeGPU::get_device_memory_pool().release(ws);
-
         if (dump_profile)
             dump_profile_statistics(true, false, false);
         return 0;
@@ -1117,12 +1657,46 @@ public:
                     bool skip_chanfilt_comm = false,
                     bool dump_profile = false)
     {
+        util::instrumentation::ScopedTimer timer(
+            m_name,
+            util::instrumentation::Phase::BACKWARD_FILTER,
+            m_be.get_stream());
+        // Outside of the graph as it may need to exchange the halo
+        ensure_input_halo(input);
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        // The halo of d_output is exchanged separately, so only the
+        // gradient allreduce needs to be capturable.
+        if (is_graph_capture_enabled(!reduce))
+        {
+            int const num_samples = input.get_local_shape()[-1];
+            auto const key = get_graph_key("bwd_filter",
+                                           num_samples,
+                                           {input.get_const_buffer(),
+                                            d_output.get_const_buffer(),
+                                            d_filter.get_const_buffer()},
+                                           alpha,
+                                           beta,
+                                           {reduce,
+                                            skip_chanfilt_comm,
+                                            dump_profile});
+            return run_graph(key, num_samples, [&]() {
+                return backward_filter(alpha,
+                                       input,
+                                       d_output,
+                                       beta,
+                                       d_filter,
+                                       reduce,
+                                       skip_chanfilt_comm,
+                                       dump_profile);
+            });
+        }
+#endif // DISTCONV_HAS_CUDA_GRAPH
         if (input.get_local_size() == 0 || d_output.get_local_size() == 0
             || d_filter.get_local_size() == 0 || !input.is_split_root())
         {
             d_filter.zero(m_be.get_stream());
             if (reduce)
-                allreduce_gradients(d_filter);
+                allreduce_gradients(d_filter, m_filter_norm_slot);
             return 0;
         }
 
@@ -1174,16 +1748,21 @@ public:
         }
         else
         {
-            void* ws = internal::RuntimeGPU::get_device_memory_pool().get(
-                m_ws_size_bwd_filter, m_be.get_stream());
-            if (ws == nullptr)
+            void* ws = m_be.get_workspace_arena().get(m_ws_size_bwd_filter,
+                                                      m_be.get_stream());
+            if (ws == nullptr && m_ws_size_bwd_filter > 0)
                 return -1;
 
-            // Zero-clear the halo region of the d_output
-            for (int dim = 0; dim < m_num_spatial_dims; ++dim)
+            // Zero-clear the halo region of the d_output. Deconvolution
+            // reads the halo only in its halo slabs, which need it.
+            // Causal convolutions read it also when not partitioned.
+            for (int i = 0; i < m_num_spatial_dims && !m_deconv; ++i)
             {
+                const int dim = get_spatial_dim(i);
                 const auto& dist = d_output.get_distribution();
-                if (dist.is_distributed(dim) && dist.get_locale_shape()[dim] > 1
+                if (((dist.is_distributed(dim)
+                      && dist.get_locale_shape()[dim] > 1)
+                     || m_causal)
                     && dist.get_overlap(dim) > 0)
                 {
                     d_output.clear_halo(dim, m_be.get_stream());
@@ -1191,8 +1770,9 @@ public:
             }
 
             const void* input_ptr =
-                input.get_const_base_ptr()
-                - input.get_local_offset(m_halo_bwd_recv, true);
+                m_deconv ? input.get_const_base_ptr()
+                         : input.get_const_base_ptr()
+                               - input.get_local_offset(m_halo_bwd_recv, true);
             assert_always(input_ptr != nullptr);
             assert_always(d_output.get_const_buffer() != nullptr);
             assert_always(d_filter.get_buffer() != nullptr);
@@ -1222,7 +1802,7 @@ public:
                 // against cuDNN anyway, we are already guaranteed
                 // that we have a fully-packed tensor for the filters
                 // and thus we don't need to ever proxy them.
-                backend::convolution_bwd_filter(
+                m_be.convolution_bwd_filter(
                     m_be.get_handle(),
                     alpha,
                     x_proxy.desc(),
@@ -1256,7 +1836,7 @@ public:
                     handle,
                     m_d_output_d,
                     d_output.get_const_buffer());
-                backend::convolution_bwd_filter(
+                m_be.convolution_bwd_filter(
                     m_be.get_handle(),
                     alpha,
                     x_proxy.desc(),
@@ -1290,7 +1870,7 @@ public:
                     handle,
                     m_d_output_gathered_d,
                     m_d_output_gathered_t.get_const_buffer());
-                backend::convolution_bwd_filter(
+                m_be.convolution_bwd_filter(
                     m_be.get_handle(),
                     alpha,
                     x_proxy.desc(),
@@ -1307,7 +1887,15 @@ public:
             }
             else
             {
-                if (!m_deconv)
+                if (m_bwd_filter_grouped)
+                {
+                    run_grouped_bwd_filter(alpha,
+                                           input_ptr,
+                                           d_output.get_const_buffer(),
+                                           beta,
+                                           d_filter.get_buffer());
+                }
+                else if (!m_deconv)
                 {
                     ensure_tensors_conform(
                         input, d_output, d_filter, "backward-filter");
@@ -1321,48 +1909,56 @@ public:
                         handle,
                         m_d_output_d,
                         d_output.get_const_buffer());
-                    backend::convolution_bwd_filter(m_be.get_handle(),
-                                                    alpha,
-                                                    x_proxy.desc(),
-                                                    x_proxy.ptr(),
-                                                    dy_proxy.desc(),
-                                                    dy_proxy.ptr(),
-                                                    m_conv_bwd_filter_d,
-                                                    m_bwd_filter_algo,
-                                                    ws,
-                                                    m_ws_size_bwd_filter,
-                                                    beta,
-                                                    m_d_filter_d,
-                                                    d_filter.get_buffer());
+                    m_be.convolution_bwd_filter(m_be.get_handle(),
+                                                alpha,
+                                                x_proxy.desc(),
+                                                x_proxy.ptr(),
+                                                dy_proxy.desc(),
+                                                dy_proxy.ptr(),
+                                                m_conv_bwd_filter_d,
+                                                m_bwd_filter_algo,
+                                                ws,
+                                                m_ws_size_bwd_filter,
+                                                beta,
+                                                m_d_filter_d,
+                                                d_filter.get_buffer());
                 }
                 else
                 {
                     auto x_proxy = dnn_lib::read_proxy(
                         handle,
                         m_d_output_d,
-                        d_output.get_const_buffer());
+                        d_output.get_const_base_ptr());
                     auto dy_proxy = dnn_lib::read_proxy(
                         handle,
                         m_input_d,
                         input_ptr);
-                    backend::convolution_bwd_filter(m_be.get_handle(),
-                                                    alpha,
-                                                    x_proxy.desc(),
-                                                    x_proxy.ptr(),
-                                                    dy_proxy.desc(),
-                                                    dy_proxy.ptr(),
-                                                    m_conv_bwd_filter_d,
-                                                    m_bwd_filter_algo,
-                                                    ws,
-                                                    m_ws_size_bwd_filter,
-                                                    beta,
-                                                    m_d_filter_d,
-                                                    d_filter.get_buffer());
+                    m_be.convolution_bwd_filter(m_be.get_handle(),
+                                                alpha,
+                                                x_proxy.desc(),
+                                                x_proxy.ptr(),
+                                                dy_proxy.desc(),
+                                                dy_proxy.ptr(),
+                                                m_conv_bwd_filter_d,
+                                                m_bwd_filter_algo,
+                                                ws,
+                                                m_ws_size_bwd_filter,
+                                                beta,
+                                                m_d_filter_d,
+                                                d_filter.get_buffer());
+                    if (!m_deconv_bwd_filter_slabs.empty())
+                    {
+                        if (m_overlap_halo_exchange_bwd)
+                            wait_halo_exchange(m_be.get_stream());
+                        run_deconv_halo_bwd_filter(
+                            alpha,
+                            input.get_const_base_ptr(),
+                            d_output.get_const_base_ptr(),
+                            d_filter.get_buffer());
+                    }
                 }
             }
 
-            internal::RuntimeGPU::get_device_memory_pool().release(ws);
-
             util::MPIPrintStreamDebug() << "Bp filter done";
         }
 
@@ -1375,7 +1971,7 @@ public:
         record_end_comp();
 
         if (reduce)
-            allreduce_gradients(d_filter);
+            allreduce_gradients(d_filter, m_filter_norm_slot);
 
         if (dump_profile)
             dump_profile_statistics(false, false, false);
@@ -1383,6 +1979,141 @@ public:
         return 0;
     }
 
+    /** @brief Backward filter whose gradient reduction overlaps with
+     *  the following work of the main stream.
+     *
+     *  The reduction is started on reducer; d_filter must not be used
+     *  until the main stream waits for the returned handle.
+     */
+    template <typename Allocator>
+    typename GradientReducer<DataType>::Handle backward_filter_async(
+        DataType alpha,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& d_output,
+        DataType beta,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& d_filter,
+        GradientReducer<DataType>& reducer,
+        bool skip_chanfilt_comm = false,
+        bool dump_profile = false)
+    {
+        backward_filter(alpha,
+                        input,
+                        d_output,
+                        beta,
+                        d_filter,
+                        false,
+                        skip_chanfilt_comm,
+                        dump_profile);
+        return start_gradient_reduction(d_filter, reducer, m_filter_norm_slot);
+    }
+
+    /** @brief Backward filter and backward data on two streams.
+     *
+     *  The data convolution is issued to an internal stream of the
+     *  backend with its own workspace, and the filter convolution and
+     *  the gradient reduction to the main stream. The data convolution
+     *  runs concurrently with the filter convolution unless the latter
+     *  zero-clears the halos of d_output, which the data convolution
+     *  reads once exchanged, or allgathers d_output by filters for it;
+     *  it then starts after the filter convolution and overlaps with
+     *  the reduction. The main stream waits for both at return.
+     *
+     *  The arguments are those of backward_filter and backward_data.
+     */
+    template <typename Allocator>
+    int backward(DataType alpha,
+                 const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+                 const tensor::Tensor<DataType, LocaleMPI, Allocator>& filter,
+                 tensor::Tensor<DataType, LocaleMPI, Allocator>& d_output,
+                 DataType beta_filter,
+                 tensor::Tensor<DataType, LocaleMPI, Allocator>& d_filter,
+                 DataType beta_data,
+                 tensor::Tensor<DataType, LocaleMPI, Allocator>& d_input,
+                 bool reduce = true,
+                 bool skip_halo_exchange = false,
+                 bool skip_chanfilt_comm = false,
+                 bool dump_profile = false)
+    {
+        if (m_skip_bp_data)
+        {
+            return backward_filter(alpha,
+                                   input,
+                                   d_output,
+                                   beta_filter,
+                                   d_filter,
+                                   reduce,
+                                   skip_chanfilt_comm,
+                                   dump_profile);
+        }
+        auto const main_stream = m_be.get_stream();
+        auto const data_stream =
+            m_be.get_internal_stream(m_bwd_data_stream_index);
+        bool const after_filter =
+            bwd_filter_clears_halo(d_output)
+            || m_chanfilt_algo == ChannelParallelismAlgorithm::X
+            || m_chanfilt_algo == ChannelParallelismAlgorithm::W;
+        auto run_data = [&]() {
+            util::wait_stream(main_stream, data_stream);
+            m_be.set_stream(data_stream);
+            m_bwd_main_stream = main_stream;
+            int const ret = backward_data(alpha,
+                                          filter,
+                                          d_output,
+                                          beta_data,
+                                          d_input,
+                                          skip_halo_exchange,
+                                          skip_chanfilt_comm,
+                                          dump_profile);
+            m_bwd_main_stream = nullptr;
+            m_be.set_stream(main_stream);
+            return ret;
+        };
+        int ret = 0;
+        if (!after_filter)
+            ret = run_data();
+        // The reduction is issued separately to overlap with the data
+        // convolution when it follows.
+        int const ret_filter = backward_filter(alpha,
+                                               input,
+                                               d_output,
+                                               beta_filter,
+                                               d_filter,
+                                               false,
+                                               skip_chanfilt_comm,
+                                               dump_profile);
+        if (after_filter && ret_filter == 0)
+            ret = run_data();
+        if (reduce)
+            allreduce_gradients(d_filter, m_filter_norm_slot);
+        util::wait_stream(data_stream, main_stream);
+        return ret_filter != 0 ? ret_filter : ret;
+    }
+
+    /** @brief Backward filter keeping only a shard of the reduced
+     *  gradient, e.g., for sharded optimizers.
+     *
+     *  shard receives reducer.get_shard_count(d_filter.get_size())
+     *  elements; see tensor::ReduceScatterAlHierarchical. The reducer
+     *  must be bound to the main stream. d_filter holds the local
+     *  gradient only.
+     */
+    template <typename Allocator>
+    int backward_filter_sharded(
+        DataType alpha,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& d_output,
+        DataType beta,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& d_filter,
+        tensor::Allreduce<DataType>& reducer,
+        DataType* shard,
+        bool dump_profile = false)
+    {
+        backward_filter(
+            alpha, input, d_output, beta, d_filter, false, false, dump_profile);
+        reduce_scatter_gradients(d_filter, reducer, shard, m_filter_norm_slot);
+        return 0;
+    }
+
     template <typename Allocator>
     int backward_bias(
         DataType alpha,
@@ -1392,11 +2123,32 @@ public:
         bool reduce = true,
         bool dump_profile = false)
     {
+        util::instrumentation::ScopedTimer timer(
+            m_name,
+            util::instrumentation::Phase::BACKWARD_BIAS,
+            m_be.get_stream());
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        if (is_graph_capture_enabled(!reduce))
+        {
+            int const num_samples = d_output.get_local_shape()[-1];
+            auto const key = get_graph_key("bwd_bias",
+                                           num_samples,
+                                           {d_output.get_const_buffer(),
+                                            bias_gradient.get_const_buffer()},
+                                           alpha,
+                                           beta,
+                                           {reduce, dump_profile});
+            return run_graph(key, num_samples, [&]() {
+                return backward_bias(
+                    alpha, d_output, beta, bias_gradient, reduce, dump_profile);
+            });
+        }
+#endif // DISTCONV_HAS_CUDA_GRAPH
         if (d_output.get_local_size() == 0)
         {
             bias_gradient.zero(m_be.get_stream());
             if (reduce)
-                allreduce_gradients(bias_gradient);
+                allreduce_gradients(bias_gradient, m_bias_norm_slot);
             return 0;
         }
 
@@ -1412,16 +2164,137 @@ public:
         record_end_comp();
 
         if (reduce)
-            allreduce_gradients(bias_gradient);
+            allreduce_gradients(bias_gradient, m_bias_norm_slot);
 
         if (dump_profile)
             dump_profile_statistics(false, false, false);
         return 0;
     }
 
+    /** @brief Backward bias with the gradient reduction started on
+     *  reducer; see backward_filter_async.
+     */
+    template <typename Allocator>
+    typename GradientReducer<DataType>::Handle backward_bias_async(
+        DataType alpha,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& d_output,
+        DataType beta,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& bias_gradient,
+        GradientReducer<DataType>& reducer,
+        bool dump_profile = false)
+    {
+        backward_bias(alpha, d_output, beta, bias_gradient, false, dump_profile);
+        return start_gradient_reduction(
+            bias_gradient, reducer, m_bias_norm_slot);
+    }
+
+    /** @brief Backward bias keeping only a shard of the reduced
+     *  gradient; see backward_filter_sharded.
+     */
+    template <typename Allocator>
+    int backward_bias_sharded(
+        DataType alpha,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& d_output,
+        DataType beta,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& bias_gradient,
+        tensor::Allreduce<DataType>& reducer,
+        DataType* shard,
+        bool dump_profile = false)
+    {
+        backward_bias(alpha, d_output, beta, bias_gradient, false, dump_profile);
+        reduce_scatter_gradients(
+            bias_gradient, reducer, shard, m_bias_norm_slot);
+        return 0;
+    }
+
     // Wait for asynchronous tasks
     void wait() { m_be.wait(); }
 
+    /** @brief Add the squares of the reduced filter and bias gradients
+     *  to slots of norm, which must outlive their reductions.
+     *
+     *  Gradients reduced by a GradientReducer are added only if norm
+     *  is set to it too. A negative slot skips the gradient; null
+     *  norm disables it.
+     */
+    void set_gradient_norm(GradientNorm<DataType>* norm,
+                           int filter_slot,
+                           int bias_slot = -1)
+    {
+        m_grad_norm = norm;
+        m_filter_norm_slot = filter_slot;
+        m_bias_norm_slot = bias_slot;
+    }
+
+    /** @brief Snapshot the received halo of input, which forward has
+     *  filled, so that backward_filter can restore it once the buffer
+     *  of input is reused.
+     *
+     *  Only the halo slabs are copied, not the interior, which the
+     *  caller has to restore, e.g., by recomputation. backward_filter
+     *  reuses the halo exchanged by forward while its version is
+     *  unchanged (see Tensor::get_halo_version), restores the snapshot
+     *  otherwise, and exchanges it again only without the snapshot.
+     */
+    template <typename Allocator>
+    void
+    save_input_halo(const tensor::Tensor<DataType, LocaleMPI, Allocator>& input)
+    {
+        assert_always(is_input_halo_recorded(input));
+        size_t size = 0;
+        apply_to_input_halo_slabs(
+            input, [&](index_t, index_t width, index_t height, index_t) {
+                size += width * height;
+            });
+        m_input_halo_saved = false;
+        if (size == 0)
+        {
+            return;
+        }
+        if (m_input_halo_snapshot.get_size() < size * sizeof(DataType))
+        {
+            m_input_halo_snapshot.allocate(size * sizeof(DataType));
+        }
+        auto* snapshot = static_cast<DataType*>(m_input_halo_snapshot.get());
+        const DataType* buf = input.get_const_buffer();
+        apply_to_input_halo_slabs(
+            input,
+            [&](index_t offset, index_t width, index_t height, index_t pitch) {
+                h2::gpu::mem_copy_2d(snapshot,
+                                     width * sizeof(DataType),
+                                     buf + offset,
+                                     pitch * sizeof(DataType),
+                                     width * sizeof(DataType),
+                                     height,
+                                     m_be.get_stream());
+                snapshot += width * height;
+            });
+        m_input_halo_saved = true;
+    }
+
+    // Precision the halos of this layer are packed with; see
+    // HaloExchange::set_comm_precision
+    void set_halo_comm_precision(CommPrecision precision)
+    {
+        m_halo_comm_precision = precision;
+        apply_halo_comm_precision();
+    }
+
+    /** @brief Occupancy of the input, kept by the caller and computed
+     *  before each forward, with which the forward convolution of an
+     *  empty tile is skipped; see tensor/occupancy.hpp. Null disables
+     *  it. */
+    void set_occupancy(tensor::Occupancy const* occupancy)
+    {
+        m_occupancy = occupancy;
+        apply_occupancy();
+    }
+
+    /** @brief Name the timings of this layer are recorded with; see
+     *  util/instrumentation.hpp. */
+    void set_name(std::string const& name) { m_name = name; }
+    std::string const& get_name() const { return m_name; }
+
     void set_num_samples(int n)
     {
         assert_ne(n, 0);
@@ -1432,6 +2305,13 @@ public:
             util::MPIPrintStreamDebug()
                 << "Setting #sample to " << n << " from "
                 << backend::get_tensor_num_samples(m_input_d);
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+            // Captured graphs embed the old descriptors.
+            if (!m_in_graph_capture
+                && !are_num_samples_planned(
+                    backend::get_tensor_num_samples(m_input_d), n))
+                clear_graphs();
+#endif // DISTCONV_HAS_CUDA_GRAPH
             backend::set_tensor_num_samples(m_input_d, n);
             backend::set_tensor_num_samples(m_input_no_halo_d, n);
             backend::set_tensor_num_samples(m_output_d, n);
@@ -1440,6 +2320,16 @@ public:
                 backend::set_tensor_num_samples(m_d_input_d, n);
             }
             backend::set_tensor_num_samples(m_d_output_d, n);
+            m_grouped_fwd_p.set_num_samples(n);
+            m_grouped_bwd_data_p.set_num_samples(n);
+            m_grouped_bwd_filter_p.set_num_samples(n);
+            for (auto* slabs : {&m_deconv_fwd_slabs,
+                                &m_deconv_bwd_data_slabs,
+                                &m_deconv_bwd_filter_slabs})
+            {
+                for (auto& slab : *slabs)
+                    slab.p.set_num_samples(n);
+            }
             if (m_chanfilt_algo == ChannelParallelismAlgorithm::X
                 || m_chanfilt_algo == ChannelParallelismAlgorithm::W)
             {
@@ -1455,6 +2345,90 @@ public:
         }
     }
 
+    /** @brief Prepare the local mini-batch sizes in num_samples
+     *  ahead of use, e.g., the size of the last partial mini-batch.
+     *
+     *  The algorithms of each size are found and cached with the given
+     *  tensors, which must be allocated for the largest size, and the
+     *  workspace arena of the backend grows to the largest workspace
+     *  they need. A later change to a planned size then only updates
+     *  the descriptors, and the graphs captured for planned sizes are
+     *  kept across the changes.
+     */
+    template <typename Allocator>
+    void plan_num_samples(
+        const std::vector<int>& num_samples,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& filter,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& output,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& d_input,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& d_filter,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& d_output)
+    {
+        assert_always(!m_inference_only);
+        plan_num_samples(num_samples,
+                         input,
+                         filter,
+                         output,
+                         d_input.get_buffer(),
+                         d_filter.get_buffer(),
+                         d_output.get_const_buffer());
+    }
+
+    /** @brief Prepare the forward pass only of the local mini-batch
+     *  sizes in num_samples; see setup_inference.
+     */
+    template <typename Allocator>
+    void plan_num_samples(
+        const std::vector<int>& num_samples,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& filter,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& output)
+    {
+        assert_always(m_inference_only);
+        plan_num_samples(
+            num_samples, input, filter, output, nullptr, nullptr, nullptr);
+    }
+
+    /** @brief Setup for inference only.
+     *
+     *  No backward state is set up: the halos of the output gradients
+     *  are not exchanged and no backward algorithm is ever searched.
+     *  The backward passes must not be called.
+     */
+    template <typename Allocator>
+    void setup_inference(tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+                         tensor::Tensor<DataType, LocaleMPI, Allocator>& filter,
+                         tensor::Tensor<DataType, LocaleMPI, Allocator>& output,
+                         const int_vector& pads,
+                         const int_vector& strides,
+                         const int_vector& dilations,
+                         int num_groups,
+                         const std::string& fwd_algo,
+                         size_t ws_size)
+    {
+        m_inference_only = true;
+        // The forward tensors stand in for the gradients, whose
+        // descriptors the forward pass does not use
+        setup(input,
+              filter,
+              output,
+              input,
+              filter,
+              output,
+              pads,
+              strides,
+              dilations,
+              num_groups,
+              fwd_algo,
+              "",
+              "",
+              ws_size,
+              true);
+    }
+
+    bool is_inference_only() const { return m_inference_only; }
+
     bool is_overlap_fwd_halo_exchange_enabled() const
     {
         return m_overlap_halo_exchange_fwd;
@@ -1477,11 +2451,27 @@ public:
         return m_bwd_filter_algo;
     }
 
+    ChannelParallelismAlgorithm get_chanfilt_algo() const
+    {
+        return m_chanfilt_algo;
+    }
+
+    /** @brief Predicted and measured times of the channel/filter
+     *  parallelism algorithms considered by AUTO. */
+    const std::map<ChannelParallelismAlgorithm,
+                   typename ChanfiltTuner<DataType>::Estimate>&
+    get_chanfilt_estimates() const
+    {
+        return m_chanfilt_estimates;
+    }
+
 protected:
     BackendDNNLib& m_be;
     const int m_num_dims;
     const int m_num_spatial_dims;
+    tensor::Layout m_layout = tensor::Layout::CHANNELS_FIRST;
     bool m_skip_bp_data;
+    bool m_inference_only = false;
     bool m_deconv;
     backend::TensorDescriptor_t m_input_d;
     backend::TensorDescriptor_t m_input_no_halo_d;
@@ -1493,6 +2483,8 @@ protected:
     backend::TensorDescriptor_t m_d_output_no_halo_d;
     backend::TensorDescriptor_t m_bias_d;
     backend::TensorDescriptor_t m_d_bias_d;
+    // ReLU descriptor for the fused forward epilogue
+    backend::ActivationDescriptor_t m_activation_d;
     backend::ConvolutionDescriptor_t m_conv_fwd_d;
     backend::ConvolutionDescriptor_t m_conv_bwd_d;
     backend::ConvolutionDescriptor_t m_conv_bwd_filter_d;
@@ -1508,20 +2500,98 @@ protected:
     IntVector m_halo_fwd_recv;
     IntVector m_halo_bwd_recv;
 
+    // Paddings of the forward and backward convolution descriptors
+    int_vector m_pads_fp;
+    int_vector m_pads_bp;
+    // Paddings of the library deconvolution of the local domains,
+    // which depend on where the partitions of input and output begin
+    int_vector m_deconv_pads;
+
+    // Causal convolutions read the input halo only from the backward
+    // neighbor and the d_output halo only from the forward one
+    bool m_causal = false;
+
+    // Buffer and halo version of the input whose halo forward has
+    // filled, which backward_filter reads without exchanging it again
+    const void* m_input_halo_buffer = nullptr;
+    std::uint64_t m_input_halo_version = 0;
+    // Received halo slabs of that input; see save_input_halo
+    tensor::Memory<tensor::CUDAAllocator> m_input_halo_snapshot;
+    bool m_input_halo_saved = false;
+
+    // Norm the reduced gradients are added to; see set_gradient_norm
+    GradientNorm<DataType>* m_grad_norm = nullptr;
+    int m_filter_norm_slot = -1;
+    int m_bias_norm_slot = -1;
+
+    // Deconvolution exchanges the halo of d_output needed by the local
+    // d_input, which differs from that of input in the forward
+    // direction as the two sides of a strided deconvolution differ
+    IntVector m_d_output_halo_fwd_send;
+    IntVector m_d_output_halo_bwd_send;
+    IntVector m_d_output_halo_fwd_recv;
+    IntVector m_d_output_halo_bwd_recv;
+
+    // Deconvolution runs the library on the local domains only, so
+    // that it does not wait for halo exchange, and then adds what the
+    // halos contribute with the direct engine, slab by slab. x_offset
+    // and y_offset are the offsets of the slab operands from the base
+    // pointers of the tensors.
+    struct DeconvHaloSlab
+    {
+        grouped_conv::Problem p;
+        // Relative to the base pointers, so negative for halos
+        std::int64_t x_offset;
+        std::int64_t y_offset;
+    };
+    std::vector<DeconvHaloSlab> m_deconv_fwd_slabs;
+    std::vector<DeconvHaloSlab> m_deconv_bwd_data_slabs;
+    std::vector<DeconvHaloSlab> m_deconv_bwd_filter_slabs;
+
+    // Problems of the grouped convolution engine, which runs the
+    // library convolutions of the paths without overlapped halo
+    // exchange or channel/filter parallelism, and whether it is used
+    // in each direction
+    bool m_grouped_supported = false;
+    grouped_conv::Problem m_grouped_fwd_p;
+    grouped_conv::Problem m_grouped_bwd_data_p;
+    grouped_conv::Problem m_grouped_bwd_filter_p;
+    bool m_fwd_grouped = false;
+    bool m_bwd_data_grouped = false;
+    bool m_bwd_filter_grouped = false;
+
     using AlgoTuple = std::tuple<backend::ConvFwdAlgo_t,
                                  backend::ConvBwdDataAlgo_t,
                                  backend::ConvBwdFilterAlgo_t,
-                                 BoundaryAttributesV<backend::ConvFwdAlgo_t>>;
+                                 BoundaryAttributesV<backend::ConvFwdAlgo_t>,
+                                 std::array<bool, 3>>;
     using AlgoCache = std::unordered_map<int, AlgoTuple>;
 
     AlgoCache m_fwd_algo_cache;
     AlgoCache m_bwd_data_algo_cache;
     AlgoCache m_bwd_filter_algo_cache;
+    // Local mini-batch sizes prepared by plan_num_samples
+    std::unordered_set<int> m_planned_num_samples;
+
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+    GraphCache m_graphs;
+    // Keys that have run once without capturing
+    std::unordered_set<std::string> m_graph_warm_keys;
+    bool m_in_graph_capture = false;
+    int m_graph_num_samples = 0;
+    // Generation of the workspace arena the graphs were captured with
+    size_t m_graph_ws_generation = 0;
+#endif // DISTCONV_HAS_CUDA_GRAPH
     std::string m_fwd_find_algo;
     std::string m_bwd_data_find_algo;
     std::string m_bwd_filter_find_algo;
 
     HaloExchangeMethod m_halo_xch_method;
+    CommPrecision m_halo_comm_precision = CommPrecision::FULL;
+    // Step of the input halo rows exchanged per dimension; see
+    // setup_halo_row_subset
+    IntVector m_halo_row_steps;
+    tensor::Occupancy const* m_occupancy = nullptr;
     using HaloExchange = tensor::
         HaloExchange<DataType, tensor::CUDAAllocator, Al::NCCLBackend>;
     using HaloExchangeMPI = tensor::HaloExchangeMPI<DataType,
@@ -1530,6 +2600,13 @@ protected:
     using HaloExchangeAL = tensor::HaloExchangeAL<DataType,
                                                   tensor::CUDAAllocator,
                                                   Al::NCCLBackend>;
+    using HaloExchangeALBatched =
+        tensor::HaloExchangeALBatched<DataType,
+                                      tensor::CUDAAllocator,
+                                      Al::NCCLBackend>;
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+    using HaloExchangeALGraph = tensor::HaloExchangeGraph<HaloExchangeAL>;
+#endif // DISTCONV_HAS_CUDA_GRAPH
 #ifdef DISTCONV_HAS_P2P
     using HaloExchangeP2P = tensor::HaloExchangeP2P<DataType,
                                                     tensor::CUDAAllocator,
@@ -1538,6 +2615,10 @@ protected:
         tensor::HaloExchangeHybrid<DataType,
                                    tensor::CUDAAllocator,
                                    Al::NCCLBackend>;
+    using HaloExchangeP2PFusedNotify =
+        tensor::HaloExchangeP2PFusedNotify<DataType,
+                                           tensor::CUDAAllocator,
+                                           Al::NCCLBackend>;
 #endif // DISTCONV_HAS_P2P
 #ifdef DISTCONV_HAS_NVSHMEM
     using HaloExchangeNVSHMEM =
@@ -1562,12 +2643,29 @@ protected:
     std::unique_ptr<HaloExchange> m_halo_xch_input;
     std::unique_ptr<HaloExchange> m_halo_xch_d_output;
 
+    // A view of the samples [offset, offset + num_samples) of the
+    // local input, with its own halo exchange
+    struct SampleChunk
+    {
+        std::unique_ptr<tensor::Tensor<DataType, LocaleMPI, tensor::CUDAAllocator>>
+            input;
+        std::unique_ptr<HaloExchange> xch;
+        index_t offset;
+        int num_samples;
+    };
+    int m_num_fwd_sample_chunks = 1;
+    std::vector<SampleChunk> m_fwd_sample_chunks;
+    const DataType* m_fwd_sample_chunks_input = nullptr;
+
     bool m_overlap_halo_exchange_fwd;
     bool m_overlap_halo_exchange_bwd;
     backend::TensorDescriptor_t m_input_interior_d;
     backend::TensorDescriptor_t m_output_interior_d;
     bool m_interior_req;
     BoundaryAttributesV<bool> m_boundary_req = false;
+    // Dimensions whose boundaries of both sides are convolved in a
+    // single call with the descriptors of the LHS boundary
+    std::vector<bool> m_boundary_paired;
     BoundaryAttributesV<backend::TensorDescriptor_t> m_input_boundaries_d;
     BoundaryAttributesV<backend::TensorDescriptor_t> m_output_boundaries_d;
     BoundaryAttributesV<backend::ConvFwdAlgo_t> m_fwd_boundary_algos;
@@ -1576,9 +2674,17 @@ protected:
     BoundaryAttributesV<index_t> m_input_boundary_offsets = 0;
     BoundaryAttributesV<index_t> m_output_boundary_offsets = 0;
     BoundaryAttributesV<h2::gpu::DeviceStream> m_boundary_streams;
+    // Internal stream of backward data in backward. The last one, as
+    // execution graphs take theirs from the first.
+    static constexpr int m_bwd_data_stream_index = 7;
+    // Stream of the backend while backward data runs on the internal
+    // one within backward
+    h2::gpu::DeviceStream m_bwd_main_stream = nullptr;
     BoundaryAttributesV<std::shared_ptr<Al::NCCLBackend::comm_type>>
         m_boundary_comms;
 
+    std::string m_name = "convolution";
+
     bool m_enable_profiling;
     backend::Event_t m_event_comp_start;
     backend::Event_t m_event_comp_end;
@@ -1602,6 +2708,11 @@ protected:
         m_d_input_all_channels_t;
     backend::TensorDescriptor_t m_d_input_all_channels_d;
     index_t m_chanfilt_segments = 1;
+    // Predicted and measured times of the candidates when AUTO is
+    // requested
+    std::map<ChannelParallelismAlgorithm,
+             typename ChanfiltTuner<DataType>::Estimate>
+        m_chanfilt_estimates;
     tensor::ChannelExchange<DataType> m_channel_exchange;
 
     void setup_profiling_events()
@@ -1612,7 +2723,7 @@ protected:
         m_event_comp_end = backend::make_event();
         m_event_exchange_start = backend::make_event();
         m_event_exchange_end = backend::make_event();
-        apply_to_spatial_sides(m_num_dims, [this](int i, Side side) {
+        apply_to_sides(m_num_dims - 1, [this](int i, Side side) {
             m_event_start_boundaries(i, side) = backend::make_event();
             m_event_end_boundaries(i, side) = backend::make_event();
         });
@@ -1688,11 +2799,11 @@ protected:
         }
         if (has_boundary)
         {
-            if ((is_forward && m_overlap_halo_exchange_fwd)
+            if ((is_forward && is_fwd_split_for_overlap())
                 || (!is_forward && m_overlap_halo_exchange_bwd))
             {
                 apply_to_spatial_sides(
-                    m_num_dims, [&ss, this](int i, Side side) {
+                    [&ss, this](int i, Side side) {
                         if (!m_boundary_req(i, side))
                             return;
                         float const elapsed = backend::elapsed_time(
@@ -1714,7 +2825,7 @@ protected:
         backend::destroy_event(m_event_comp_end);
         backend::destroy_event(m_event_exchange_start);
         backend::destroy_event(m_event_exchange_end);
-        apply_to_spatial_sides(m_num_dims, [this](int i, Side side) {
+        apply_to_sides(m_num_dims - 1, [this](int i, Side side) {
             backend::destroy_event(m_event_start_boundaries(i, side));
             backend::destroy_event(m_event_end_boundaries(i, side));
         });
@@ -1731,23 +2842,26 @@ protected:
         const int_vector& strides,
         const int_vector& dilations)
     {
-        backend::setup_tensor_descriptor(
-            m_input_d, input, m_halo_fwd_recv, m_halo_bwd_recv);
+        // The library calls of deconvolution read no halo
+        const IntVector no_halo(m_num_dims, 0);
+        const auto& halo_fwd = m_deconv ? no_halo : m_halo_fwd_recv;
+        const auto& halo_bwd = m_deconv ? no_halo : m_halo_bwd_recv;
+        backend::setup_tensor_descriptor(m_input_d, input, halo_fwd, halo_bwd);
         backend::setup_tensor_descriptor(m_input_no_halo_d, input, false);
         if (!m_skip_bp_data)
         {
             backend::setup_tensor_descriptor(
-                m_d_input_d, d_input, m_halo_fwd_recv, m_halo_bwd_recv);
+                m_d_input_d, d_input, halo_fwd, halo_bwd);
         }
         setup_filter_descriptor(m_filter_d, filter);
         setup_filter_descriptor(m_d_filter_d, d_filter);
         backend::setup_tensor_descriptor(m_output_d, output, false);
-        backend::setup_tensor_descriptor(m_d_output_d, d_output);
+        backend::setup_tensor_descriptor(m_d_output_d, d_output, !m_deconv);
         backend::setup_tensor_descriptor(m_d_output_no_halo_d, d_output, false);
 
         // tensor descriptors for interior and boundary regions. only used
         // when overlapping is enabled
-        if (m_overlap_halo_exchange_fwd)
+        if (is_fwd_split_for_overlap())
         {
             setup_tensors_overlap(input, filter, output, strides, dilations);
         }
@@ -1755,11 +2869,11 @@ protected:
         setup_boundary_streams(input.get_split_index());
         util::MPIPrintStreamDebug() << "input: " << m_input_d;
         util::MPIPrintStreamDebug() << "input (no halo): " << m_input_no_halo_d;
-        if (m_overlap_halo_exchange_fwd)
+        if (is_fwd_split_for_overlap())
         {
             util::MPIPrintStreamDebug()
                 << "input interior: " << m_input_interior_d;
-            apply_to_spatial_sides(m_num_dims, [this](int i, Side side) {
+            apply_to_spatial_sides([this](int i, Side side) {
                 if (m_boundary_req(i, side))
                 {
                     util::MPIPrintStreamDebug()
@@ -1775,11 +2889,11 @@ protected:
         util::MPIPrintStreamDebug() << "filter: " << m_filter_d;
         util::MPIPrintStreamDebug() << "d_filter: " << m_d_filter_d;
         util::MPIPrintStreamDebug() << "output: " << m_output_d;
-        if (m_overlap_halo_exchange_fwd)
+        if (is_fwd_split_for_overlap())
         {
             util::MPIPrintStreamDebug()
                 << "output interior: " << m_output_interior_d;
-            apply_to_spatial_sides(m_num_dims, [this](int i, Side side) {
+            apply_to_spatial_sides([this](int i, Side side) {
                 if (m_boundary_req(i, side))
                 {
                     util::MPIPrintStreamDebug()
@@ -1812,10 +2926,11 @@ protected:
         auto output_shape = output.get_local_shape();
         IndexVector input_interior_idx(m_num_dims, 0);
         IndexVector output_interior_idx(m_num_dims, 0);
-        apply_to_spatial_sides(m_num_dims, [&](int dim, Side side) {
+        apply_to_spatial_sides([&](int dim, Side side) {
+            const int si = tensor::get_spatial_index(m_layout, dim);
             auto filter_dim = internal::get_dilated_filter_size(
-                static_cast<int>(filter.get_shape()[dim]), dilations[dim]);
-            int st = strides[dim];
+                static_cast<int>(filter.get_shape()[dim]), dilations[si]);
+            int st = strides[si];
             int h = get_input_halo_recv(dim, side);
             // set default value
             m_boundary_req(dim, side) = false;
@@ -1858,12 +2973,16 @@ protected:
             m_boundary_req(dim, side) = true;
             backend::copy_tensor_descriptor(m_input_boundaries_d(dim, side),
                                             m_input_d);
+            // Descriptors are in the channels-first order
+            const int desc_dim =
+                tensor::get_channels_first_dim(m_layout, m_num_dims, dim);
             backend::set_tensor_dimension(
-                m_input_boundaries_d(dim, side), dim, input_boundary_dim);
+                m_input_boundaries_d(dim, side), desc_dim, input_boundary_dim);
             backend::copy_tensor_descriptor(m_output_boundaries_d(dim, side),
                                             m_output_d);
-            backend::set_tensor_dimension(
-                m_output_boundaries_d(dim, side), dim, output_boundary_dim);
+            backend::set_tensor_dimension(m_output_boundaries_d(dim, side),
+                                          desc_dim,
+                                          output_boundary_dim);
             setup_boundary_offsets(dim,
                                    side,
                                    input,
@@ -1871,6 +2990,7 @@ protected:
                                    input_boundary_dim,
                                    output_boundary_dim);
         });
+        pair_boundaries(output);
         if (input_shape.is_empty() || output_shape.is_empty())
         {
             m_interior_req = false;
@@ -1889,6 +3009,59 @@ protected:
         }
     }
 
+    // The boundaries of both sides of a dimension have the same shape
+    // when the halos do. With a single local sample, they are then
+    // convolved as two samples whose stride is the distance between
+    // them, which halves the boundary library calls.
+    template <typename Allocator>
+    void
+    pair_boundaries(const tensor::Tensor<DataType, LocaleMPI, Allocator>& output)
+    {
+        m_boundary_paired.assign(m_num_dims, false);
+        if (backend::get_tensor_num_samples(m_input_d) != 1)
+            return;
+        for (int i = 0; i < m_num_spatial_dims; ++i)
+        {
+            const int dim = get_spatial_dim(i);
+            if (!m_boundary_req(dim, LHS) || !m_boundary_req(dim, RHS))
+                continue;
+            const int desc_dim =
+                tensor::get_channels_first_dim(m_layout, m_num_dims, dim);
+            const int input_boundary_dim = backend::get_tensor_dimension(
+                m_input_boundaries_d(dim, LHS), desc_dim);
+            const int output_boundary_dim = backend::get_tensor_dimension(
+                m_output_boundaries_d(dim, LHS), desc_dim);
+            const index_t input_stride = m_input_boundary_offsets(dim, RHS)
+                                         - m_input_boundary_offsets(dim, LHS);
+            const index_t output_stride =
+                m_output_boundary_offsets(dim, RHS)
+                - m_output_boundary_offsets(dim, LHS);
+            // The output boundaries must not overlap
+            if (input_boundary_dim
+                    != backend::get_tensor_dimension(
+                        m_input_boundaries_d(dim, RHS), desc_dim)
+                || output_boundary_dim
+                       != backend::get_tensor_dimension(
+                           m_output_boundaries_d(dim, RHS), desc_dim)
+                || (index_t) output.get_local_shape()[dim]
+                       < (index_t) output_boundary_dim * 2
+                || input_stride <= 0 || output_stride <= 0
+                || input_stride > std::numeric_limits<int>::max()
+                || output_stride > std::numeric_limits<int>::max())
+            {
+                continue;
+            }
+            backend::set_tensor_num_samples(
+                m_input_boundaries_d(dim, LHS), 2, input_stride);
+            backend::set_tensor_num_samples(
+                m_output_boundaries_d(dim, LHS), 2, output_stride);
+            m_boundary_req(dim, RHS) = false;
+            m_boundary_paired[dim] = true;
+            util::MPIPrintStreamDebug()
+                << "Paired the boundaries of dimension " << dim;
+        }
+    }
+
     template <typename Allocator>
     void setup_chanfilt_tensors(
         const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
@@ -2163,11 +3336,14 @@ protected:
     {
         if (check_cache_and_restore_algos(m_fwd_algo_cache)) return;
 
-        set_find_workspace_size(ws_size);
+        set_find_workspace_size(ws_size,
+                                get_find_workspace_limit({m_be.get_stream()}));
+        m_fwd_grouped = false;
+        auto const fwd_find_algo = get_library_find_algo(m_fwd_find_algo);
 
         // Note that m_bwd algo is set when deconv is used. Support for
         // deconv is partial.
-        if (!m_overlap_halo_exchange_fwd)
+        if (!is_fwd_split_for_overlap())
         {
             if (m_chanfilt_algo == ChannelParallelismAlgorithm::X)
             {
@@ -2178,7 +3354,7 @@ protected:
                     "stationary-x setup algos forward");
                 get_tmp_tensor_buffer(m_output_all_filters_t);
                 m_fwd_algo =
-                    m_be.get_fwd_algorithm(m_fwd_find_algo,
+                    m_be.get_fwd_algorithm(fwd_find_algo,
                                            dnn_lib::read_proxy(m_input_d).desc(),
                                            input,
                                            m_filter_d,
@@ -2198,7 +3374,7 @@ protected:
                     "stationary-y setup algos forward");
                 get_tmp_tensor_buffer(m_input_gathered_t);
                 m_fwd_algo =
-                    m_be.get_fwd_algorithm(m_fwd_find_algo,
+                    m_be.get_fwd_algorithm(fwd_find_algo,
                                            dnn_lib::read_proxy(m_input_gathered_d).desc(),
                                            m_input_gathered_t.get_buffer(),
                                            m_filter_d,
@@ -2219,7 +3395,7 @@ protected:
                 get_tmp_tensor_buffer(m_input_gathered_t);
                 get_tmp_tensor_buffer(m_output_all_filters_t);
                 m_fwd_algo =
-                    m_be.get_fwd_algorithm(m_fwd_find_algo,
+                    m_be.get_fwd_algorithm(fwd_find_algo,
                                            dnn_lib::read_proxy(m_input_gathered_d).desc(),
                                            m_input_gathered_t.get_buffer(),
                                            m_filter_d,
@@ -2239,7 +3415,7 @@ protected:
                                                       m_output_d,
                                                       m_filter_d,
                                                       "setup algos forward");
-                    m_fwd_algo = m_be.get_fwd_algorithm(m_fwd_find_algo,
+                    m_fwd_algo = m_be.get_fwd_algorithm(fwd_find_algo,
                                                         dnn_lib::read_proxy(m_input_d).desc(),
                                                         input,
                                                         m_filter_d,
@@ -2248,10 +3424,48 @@ protected:
                                                         dnn_lib::write_proxy(m_output_d).desc(),
                                                         output,
                                                         ws_size);
+                    m_fwd_grouped = select_grouped_engine(
+                        "fwd",
+                        m_fwd_find_algo,
+                        m_grouped_fwd_p,
+                        [&]() {
+                            auto const handle = m_be.get_handle();
+                            auto x_proxy =
+                                dnn_lib::read_proxy(handle, m_input_d, input);
+                            auto y_proxy =
+                                dnn_lib::write_proxy(handle, m_output_d, output);
+                            size_t const ws_size_fwd =
+                                backend::get_conv_forward_workspace_size(
+                                    handle,
+                                    x_proxy.desc(),
+                                    m_filter_d,
+                                    m_conv_fwd_d,
+                                    y_proxy.desc(),
+                                    m_fwd_algo);
+                            m_be.convolution_forward(
+                                handle,
+                                DataType(1),
+                                x_proxy.desc(),
+                                x_proxy.ptr(),
+                                m_filter_d,
+                                filter,
+                                m_conv_fwd_d,
+                                m_fwd_algo,
+                                m_be.get_workspace_arena().get(
+                                    ws_size_fwd, m_be.get_stream()),
+                                ws_size_fwd,
+                                DataType(0),
+                                y_proxy.desc(),
+                                y_proxy.ptr());
+                        },
+                        [&]() {
+                            run_grouped_fwd(
+                                DataType(1), input, filter, DataType(0), output);
+                        });
                 }
                 else
                 {
-                    m_bwd_data_algo = m_be.get_bwd_data_algorithm(m_fwd_find_algo,
+                    m_bwd_data_algo = m_be.get_bwd_data_algorithm(fwd_find_algo,
                                                                   m_filter_d,
                                                                   filter,
                                                                   dnn_lib::read_proxy(m_input_d).desc(),
@@ -2259,7 +3473,8 @@ protected:
                                                                   m_conv_fwd_d,
                                                                   dnn_lib::write_proxy(m_output_d).desc(),
                                                                   output,
-                                                                  ws_size);
+                                                                  ws_size,
+                                                                  "deconv_");
                 }
             }
             util::MPIPrintStreamDebug()
@@ -2269,9 +3484,12 @@ protected:
         }
         else
         {
+            // Whether the interior and boundary regions exist differs
+            // by rank, so the searches cannot be done collectively.
+            m_be.suspend_collective_autotune(true);
             if (m_interior_req)
             {
-                m_fwd_algo = m_be.get_fwd_algorithm(m_fwd_find_algo,
+                m_fwd_algo = m_be.get_fwd_algorithm(fwd_find_algo,
                                                     dnn_lib::read_proxy(m_input_interior_d).desc(),
                                                     input,
                                                     m_filter_d,
@@ -2284,15 +3502,27 @@ protected:
                     << "Convolution forward interior algorithm: "
                     << util::get_name(m_fwd_algo);
             }
+            // Reserves the interior workspace, so that the boundary
+            // searches only see what it leaves of the budget.
+            setup_workspace_size_fwd();
+            int num_boundaries = 0;
+            apply_to_spatial_sides([&](int i, Side side) {
+                if (m_boundary_req(i, side))
+                    ++num_boundaries;
+            });
             // TODO: Need to support this with chanfilt.
-            apply_to_spatial_sides(m_num_dims, [&](int i, Side side) {
+            apply_to_spatial_sides([&](int i, Side side) {
                 if (m_boundary_req(i, side))
                 {
-                    // The workspace is reserved for the interior
-                    // sub-tensor. To be more robust, workspace sizes for
-                    // boundary regions should be set.
+                    // Without a workspace budget, the workspace is
+                    // reserved for the interior sub-tensor and the
+                    // boundary searches are unconstrained.
+                    size_t const boundary_ws_size =
+                        get_boundary_find_workspace_size(i,
+                                                         side,
+                                                         num_boundaries--);
                     m_fwd_boundary_algos(i, side) =
-                        m_be.get_fwd_algorithm(m_fwd_find_algo,
+                        m_be.get_fwd_algorithm(fwd_find_algo,
                                                dnn_lib::read_proxy(m_input_boundaries_d(i, side)).desc(),
                                                input,
                                                m_filter_d,
@@ -2300,13 +3530,16 @@ protected:
                                                m_conv_fwd_d,
                                                dnn_lib::write_proxy(m_output_boundaries_d(i, side)).desc(),
                                                output,
-                                               0);
+                                               boundary_ws_size);
                     util::MPIPrintStreamDebug()
                         << "Convolution forward boundary algorithm for (" << i
                         << ", " << side << "): "
                         << util::get_name(m_fwd_boundary_algos(i, side));
+                    reserve_workspace(get_workspace_size_fwd_boundary(i, side),
+                                      {get_boundary_stream(i, side)});
                 }
             });
+            m_be.suspend_collective_autotune(false);
         }
 
         cache_algos(m_fwd_algo_cache);
@@ -2319,7 +3552,11 @@ protected:
     {
         if (check_cache_and_restore_algos(m_bwd_data_algo_cache)) return;
 
-        set_find_workspace_size(ws_size);
+        set_find_workspace_size(
+            ws_size, get_find_workspace_limit(get_bwd_data_streams()));
+        m_bwd_data_grouped = false;
+        auto const bwd_data_find_algo =
+            get_library_find_algo(m_bwd_data_find_algo);
 
         // Similarly to setup_algorithms_fwd, m_fwd_algo is set when
         // deconv is used.
@@ -2334,7 +3571,7 @@ protected:
                     m_filter_d,
                     "stationary-x setup algos backward-data");
                 m_bwd_data_algo = m_be.get_bwd_data_algorithm(
-                    m_bwd_data_find_algo,
+                    bwd_data_find_algo,
                     m_filter_d,
                     filter,
                     dnn_lib::read_proxy(m_d_output_gathered_d).desc(),
@@ -2357,7 +3594,7 @@ protected:
                     m_filter_d,
                     "stationary-y setup algos backward-data");
                 m_bwd_data_algo = m_be.get_bwd_data_algorithm(
-                    m_bwd_data_find_algo,
+                    bwd_data_find_algo,
                     m_filter_d,
                     filter,
                     dnn_lib::read_proxy(m_d_output_d).desc(),
@@ -2381,7 +3618,7 @@ protected:
                     m_filter_d,
                     "stationary-w setup algos backward-data");
                 m_bwd_data_algo = m_be.get_bwd_data_algorithm(
-                    m_bwd_data_find_algo,
+                    bwd_data_find_algo,
                     m_filter_d,
                     filter,
                     dnn_lib::read_proxy(m_d_output_gathered_d).desc(),
@@ -2405,7 +3642,7 @@ protected:
                         m_d_output_d,
                         m_filter_d,
                         "setup algos backward-data");
-                    m_bwd_data_algo = m_be.get_bwd_data_algorithm(m_bwd_data_find_algo,
+                    m_bwd_data_algo = m_be.get_bwd_data_algorithm(bwd_data_find_algo,
                                                                   m_filter_d,
                                                                   filter,
                                                                   dnn_lib::read_proxy(m_d_output_d).desc(),
@@ -2414,10 +3651,48 @@ protected:
                                                                   dnn_lib::write_proxy(m_d_input_d).desc(),
                                                                   input,
                                                                   ws_size);
+                    m_bwd_data_grouped = select_grouped_engine(
+                        "bwd_data",
+                        m_bwd_data_find_algo,
+                        m_grouped_bwd_data_p,
+                        [&]() {
+                            auto const handle = m_be.get_handle();
+                            auto dy_proxy =
+                                dnn_lib::read_proxy(handle, m_d_output_d, output);
+                            auto dx_proxy =
+                                dnn_lib::write_proxy(handle, m_d_input_d, input);
+                            size_t const ws_size_bwd_data =
+                                backend::get_conv_bwd_data_workspace_size(
+                                    handle,
+                                    m_filter_d,
+                                    dy_proxy.desc(),
+                                    m_conv_bwd_d,
+                                    dx_proxy.desc(),
+                                    m_bwd_data_algo);
+                            m_be.convolution_bwd_data(
+                                handle,
+                                DataType(1),
+                                m_filter_d,
+                                filter,
+                                dy_proxy.desc(),
+                                dy_proxy.ptr(),
+                                m_conv_bwd_d,
+                                m_bwd_data_algo,
+                                m_be.get_workspace_arena().get(
+                                    ws_size_bwd_data, m_be.get_stream()),
+                                ws_size_bwd_data,
+                                DataType(0),
+                                dx_proxy.desc(),
+                                dx_proxy.ptr());
+                        },
+                        [&]() {
+                            run_grouped_bwd_data(
+                                DataType(1), filter, output, DataType(0), input);
+                        });
                 }
                 else
                 {
-                    m_fwd_algo = m_be.get_fwd_algorithm(m_bwd_data_find_algo,
+                    m_fwd_algo = m_be.get_fwd_algorithm(bwd_data_find_algo,
                                                         dnn_lib::read_proxy(m_d_output_d).desc(),
                                                         output,
                                                         m_filter_d,
@@ -2425,7 +3700,8 @@ protected:
                                                         m_conv_bwd_d,
                                                         dnn_lib::write_proxy(m_d_input_d).desc(),
                                                         input,
-                                                        ws_size);
+                                                        ws_size,
+                                                        "deconv_");
                 }
             }
         }
@@ -2447,7 +3723,11 @@ protected:
     {
         if (check_cache_and_restore_algos(m_bwd_filter_algo_cache)) return;
 
-        set_find_workspace_size(ws_size);
+        set_find_workspace_size(ws_size,
+                                get_find_workspace_limit({m_be.get_stream()}));
+        m_bwd_filter_grouped = false;
+        auto const bwd_filter_find_algo =
+            get_library_find_algo(m_bwd_filter_find_algo);
 
         // Similarly to setup_algorithms_fwd, m_fwd_algo is set when
         // deconv is used.
@@ -2460,7 +3740,7 @@ protected:
                 m_filter_d,
                 "stationary-x setup algos backward-filter");
             m_bwd_filter_algo = m_be.get_bwd_filter_algorithm(
-                m_bwd_filter_find_algo,
+                bwd_filter_find_algo,
                 dnn_lib::read_proxy(m_input_d).desc(),
                 input,
                 dnn_lib::read_proxy(m_d_output_gathered_d).desc(),
@@ -2480,7 +3760,7 @@ protected:
                 m_filter_d,
                 "stationary-y setup algos backward-filter");
             m_bwd_filter_algo =
-                m_be.get_bwd_filter_algorithm(m_bwd_filter_find_algo,
+                m_be.get_bwd_filter_algorithm(bwd_filter_find_algo,
                                               dnn_lib::read_proxy(m_input_gathered_d).desc(),
                                               m_input_gathered_t.get_buffer(),
                                               dnn_lib::read_proxy(m_d_output_d).desc(),
@@ -2501,7 +3781,7 @@ protected:
                 m_filter_d,
                 "stationary-w setup algos backward-filter");
             m_bwd_filter_algo = m_be.get_bwd_filter_algorithm(
-                m_bwd_filter_find_algo,
+                bwd_filter_find_algo,
                 dnn_lib::read_proxy(m_input_gathered_d).desc(),
                 m_input_gathered_t.get_buffer(),
                 dnn_lib::read_proxy(m_d_output_gathered_d).desc(),
@@ -2523,7 +3803,7 @@ protected:
                     m_filter_d,
                     "setup algos backward-filter");
                 m_bwd_filter_algo =
-                    m_be.get_bwd_filter_algorithm(m_bwd_filter_find_algo,
+                    m_be.get_bwd_filter_algorithm(bwd_filter_find_algo,
                                                   dnn_lib::read_proxy(m_input_d).desc(),
                                                   input,
                                                   dnn_lib::read_proxy(m_d_output_d).desc(),
@@ -2532,11 +3812,49 @@ protected:
                                                   m_d_filter_d,
                                                   filter,
                                                   ws_size);
+                m_bwd_filter_grouped = select_grouped_engine(
+                    "bwd_filter",
+                    m_bwd_filter_find_algo,
+                    m_grouped_bwd_filter_p,
+                    [&]() {
+                        auto const handle = m_be.get_handle();
+                        auto x_proxy =
+                            dnn_lib::read_proxy(handle, m_input_d, input);
+                        auto dy_proxy =
+                            dnn_lib::read_proxy(handle, m_d_output_d, output);
+                        size_t const ws_size_bwd_filter =
+                            backend::get_conv_bwd_filter_workspace_size(
+                                handle,
+                                x_proxy.desc(),
+                                dy_proxy.desc(),
+                                m_conv_bwd_filter_d,
+                                m_d_filter_d,
+                                m_bwd_filter_algo);
+                        m_be.convolution_bwd_filter(
+                            handle,
+                            DataType(1),
+                            x_proxy.desc(),
+                            x_proxy.ptr(),
+                            dy_proxy.desc(),
+                            dy_proxy.ptr(),
+                            m_conv_bwd_filter_d,
+                            m_bwd_filter_algo,
+                            m_be.get_workspace_arena().get(
+                                ws_size_bwd_filter, m_be.get_stream()),
+                            ws_size_bwd_filter,
+                            DataType(0),
+                            m_d_filter_d,
+                            filter);
+                    },
+                    [&]() {
+                        run_grouped_bwd_filter(
+                            DataType(1), input, output, DataType(0), filter);
+                    });
             }
             else
             {
                 m_bwd_filter_algo =
-                    m_be.get_bwd_filter_algorithm(m_bwd_filter_find_algo,
+                    m_be.get_bwd_filter_algorithm(bwd_filter_find_algo,
                                                   dnn_lib::read_proxy(m_d_output_d).desc(),
                                                   output,
                                                   dnn_lib::read_proxy(m_input_d).desc(),
@@ -2544,7 +3862,8 @@ protected:
                                                   m_conv_bwd_filter_d,
                                                   m_d_filter_d,
                                                   filter,
-                                                  ws_size);
+                                                  ws_size,
+                                                  "deconv_");
             }
         }
         util::MPIPrintStreamDebug() << "Convolution backward filter algorithm: "
@@ -2564,12 +3883,17 @@ protected:
 
     void setup_workspace_size_fwd()
     {
+        if (m_fwd_grouped)
+        {
+            m_ws_size_fwd = 0;
+            return;
+        }
         size_t s;
         util::MPIPrintStreamDebug()
             << "setup_workspace_size_fwd; "
             << "input: " << m_input_d << ", filter: " << m_filter_d
             << ", conv desc: " << m_conv_fwd_d << ", output: " << m_output_d;
-        if (!m_overlap_halo_exchange_fwd)
+        if (!is_fwd_split_for_overlap())
         {
             if (m_chanfilt_algo == ChannelParallelismAlgorithm::X)
             {
@@ -2643,6 +3967,7 @@ protected:
             }
         }
         m_ws_size_fwd = s;
+        reserve_workspace(s, {m_be.get_stream()});
     }
 
     size_t get_workspace_size_fwd(backend::TensorDescriptor_t input,
@@ -2674,27 +3999,38 @@ protected:
     void setup_workspace_size_fwd_boundaries()
     {
         // TODO: Handle with chanfilt.
-        if (!m_overlap_halo_exchange_fwd)
+        if (!is_fwd_split_for_overlap())
             return;
-        apply_to_spatial_sides(m_num_dims, [this](int i, Side side) {
+        apply_to_spatial_sides([this](int i, Side side) {
             if (m_boundary_req(i, side))
             {
-                size_t const s = backend::get_conv_forward_workspace_size(
-                    m_be.get_handle(),
-                    dnn_lib::read_proxy(m_input_boundaries_d(i, side)).desc(),
-                    m_filter_d,
-                    m_conv_fwd_d,
-                    dnn_lib::write_proxy(m_output_boundaries_d(i, side)).desc(),
-                    m_fwd_boundary_algos(i, side));
+                size_t const s = get_workspace_size_fwd_boundary(i, side);
                 m_ws_size_fwd_boundaries(i, side) = s;
+                reserve_workspace(s, {get_boundary_stream(i, side)});
             }
         });
     }
 
+    size_t get_workspace_size_fwd_boundary(int i, Side side)
+    {
+        return backend::get_conv_forward_workspace_size(
+            m_be.get_handle(),
+            dnn_lib::read_proxy(m_input_boundaries_d(i, side)).desc(),
+            m_filter_d,
+            m_conv_fwd_d,
+            dnn_lib::write_proxy(m_output_boundaries_d(i, side)).desc(),
+            m_fwd_boundary_algos(i, side));
+    }
+
     void setup_workspace_size_bwd_data()
     {
         if (m_skip_bp_data)
             return;
+        if (m_bwd_data_grouped)
+        {
+            m_ws_size_bwd_data = 0;
+            return;
+        }
         size_t s;
         if (m_chanfilt_algo == ChannelParallelismAlgorithm::X)
         {
@@ -2752,6 +4088,7 @@ protected:
                 m_d_input_d);
         }
         m_ws_size_bwd_data = s;
+        reserve_workspace(s, get_bwd_data_streams());
     }
 
     size_t get_workspace_size_bwd_data(backend::FilterDescriptor_t filter,
@@ -2782,6 +4119,11 @@ protected:
 
     void setup_workspace_size_bwd_filter()
     {
+        if (m_bwd_filter_grouped)
+        {
+            m_ws_size_bwd_filter = 0;
+            return;
+        }
         size_t s;
         util::MPIPrintStreamDebug() << "setup_workspace_size_bwd_filter; "
                                     << "input_no_halo: " << m_input_no_halo_d
@@ -2842,6 +4184,7 @@ protected:
                 m_input_d, m_d_output_d, m_d_filter_d);
         }
         m_ws_size_bwd_filter = s;
+        reserve_workspace(s, {m_be.get_stream()});
     }
 
     size_t get_workspace_size_bwd_filter(backend::TensorDescriptor_t input,
@@ -2877,6 +4220,7 @@ protected:
         backend::setup_filter_descriptor(desc, tensor);
     }
 
+    // overlap and filter_shape are in the channels-first order
     void setup_convolution_descriptor(
         const IntVector& overlap,
         const tensor::Shape& filter_shape,
@@ -2889,13 +4233,15 @@ protected:
         backend::ConvolutionDescriptor_t& desc_bp_filter)
     {
         auto const mode = backend::default_conv_mode;
-        auto const dt = util::get_dnnlib_type<DataType>();
+        // Reduced-precision convolutions accumulate in FP32
+        auto const dt = util::get_dnnlib_compute_type<DataType>();
 
         for (int i = 0; i < m_num_spatial_dims; ++i)
         {
             auto df = internal::get_dilated_filter_size((int) filter_shape[i],
                                                         dilations[i]);
-            if (!(pads[i] * 2 + 1 == df || pads[i] == 0))
+            if (!(pads[i] * 2 + 1 == df || pads[i] == 0
+                  || (m_causal && pads[i] + 1 == df)))
             {
                 util::MPIPrintStreamError()
                     << "Padding size must be zero or must match the filter "
@@ -2911,7 +4257,11 @@ protected:
         {
             auto window_dim = internal::get_dilated_filter_size<int>(
                 stencil_dims[i], dilations[i]);
-            if (window_dim % 2)
+            if (m_causal)
+            {
+                stencil_dims[i] = window_dim - 1;
+            }
+            else if (window_dim % 2)
             {
                 stencil_dims[i] = (window_dim - 1) / 2;
             }
@@ -2963,6 +4313,26 @@ protected:
             }
         }
 
+        if (m_deconv)
+        {
+            // The library deconvolves the local domains in all
+            // directions
+            pads_fp = m_deconv_pads;
+            pads_bp = m_deconv_pads;
+        }
+        else if (m_causal)
+        {
+            // The input descriptor begins with the whole padding, and
+            // the d_output one has halos as wide as it on both sides,
+            // of which the library reads the forward one in backward
+            // data and the zero-cleared ones in backward filter
+            pads_fp = int_vector(m_num_spatial_dims, 0);
+            pads_bp = pads;
+        }
+
+        m_pads_fp = pads_fp;
+        m_pads_bp = pads_bp;
+
         const auto r_pads_fp = util::reverse(pads_fp);
         const auto r_pads_bp = util::reverse(pads_bp);
         const auto r_strides = util::reverse(strides);
@@ -3024,6 +4394,16 @@ protected:
             m_halo_xch_input.reset(new HaloExchangeAL(input));
             m_halo_xch_d_output.reset(new HaloExchangeAL(d_output));
             break;
+        case HaloExchangeMethod::AL_BATCHED:
+            m_halo_xch_input.reset(new HaloExchangeALBatched(input));
+            m_halo_xch_d_output.reset(new HaloExchangeALBatched(d_output));
+            break;
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        case HaloExchangeMethod::AL_GRAPH:
+            m_halo_xch_input.reset(new HaloExchangeALGraph(input));
+            m_halo_xch_d_output.reset(new HaloExchangeALGraph(d_output));
+            break;
+#endif // DISTCONV_HAS_CUDA_GRAPH
 #ifdef DISTCONV_HAS_P2P
         case HaloExchangeMethod::P2P:
             m_halo_xch_input.reset(new HaloExchangeP2P(input, m_be.get_p2p()));
@@ -3036,6 +4416,12 @@ protected:
             m_halo_xch_d_output.reset(
                 new HaloExchangeHybrid(d_output, m_be.get_p2p()));
             break;
+        case HaloExchangeMethod::P2P_FUSED_NOTIFY:
+            m_halo_xch_input.reset(
+                new HaloExchangeP2PFusedNotify(input, m_be.get_p2p()));
+            m_halo_xch_d_output.reset(
+                new HaloExchangeP2PFusedNotify(d_output, m_be.get_p2p()));
+            break;
 #endif // DISTCONV_HAS_P2P
 #ifdef DISTCONV_HAS_NVSHMEM
         case HaloExchangeMethod::NVSHMEM:
@@ -3058,11 +4444,93 @@ protected:
                 new HaloExchangeNVSHMEMFusedNotify(d_output));
             break;
 #endif // DISTCONV_HAS_NVSHMEM
+        case HaloExchangeMethod::AUTO:
+        {
+            HaloExchangeTuner<DataType> tuner(m_be);
+            m_halo_xch_input = tuner.tune(input);
+            if (!m_inference_only)
+                m_halo_xch_d_output = tuner.tune(d_output);
+            break;
+        }
         default:
             util::MPIPrintStreamError()
                 << "Invalid halo exchange method: " << m_halo_xch_method;
             std::abort();
         }
+        // Inference keeps no halo buffers of the gradients
+        if (m_inference_only)
+            m_halo_xch_d_output.reset();
+        apply_halo_comm_precision();
+        apply_occupancy();
+    }
+
+    void apply_halo_comm_precision()
+    {
+        for (auto* xch : {m_halo_xch_input.get(), m_halo_xch_d_output.get()})
+        {
+            if (xch != nullptr)
+                xch->set_comm_precision(m_halo_comm_precision);
+        }
+    }
+
+    // The forward convolution reads the input rows at the window
+    // centers, which are multiples of the stride from the first one, at
+    // zero or at the radius, plus multiples of the dilation. The radius
+    // is a multiple of the dilation, so only the rows at multiples of
+    // gcd(stride, dilation) are read, and the others need not be
+    // exchanged. The backward filter convolution reads the same rows.
+    void setup_halo_row_subset(const int_vector& strides,
+                               const int_vector& dilations,
+                               bool deconv)
+    {
+        m_halo_row_steps = IntVector(m_num_dims, 1);
+        if (!m_be.get_options().m_halo_row_subset || deconv)
+            return;
+        for (int i = 0; i < m_num_spatial_dims; ++i)
+        {
+            m_halo_row_steps[get_spatial_dim(i)] =
+                std::gcd(strides[i], dilations[i]);
+        }
+        if (m_halo_xch_input != nullptr)
+            apply_halo_row_subset(*m_halo_xch_input);
+    }
+
+    // Does nothing before setup
+    void apply_halo_row_subset(HaloExchange& xch)
+    {
+        for (int i = 0; i < m_halo_row_steps.length(); ++i)
+            xch.set_row_subset(i, m_halo_row_steps[i], 0);
+    }
+
+    // Only the input is forward-exchanged
+    void apply_occupancy()
+    {
+        if (m_halo_xch_input != nullptr)
+            m_halo_xch_input->set_occupancy(m_occupancy);
+    }
+
+    // Whether the forward convolution is skipped since its input,
+    // including the halos received if halo_exchanged, is empty. Clears
+    // the output instead if beta is zero.
+    template <typename Allocator>
+    bool skip_forward(DataType beta,
+                      tensor::Tensor<DataType, LocaleMPI, Allocator>& output,
+                      bool halo_exchanged)
+    {
+        if (m_occupancy == nullptr)
+            return false;
+        auto& stats = tensor::OccupancyStats::get_instance();
+        ++stats.num_ops;
+        if (!m_occupancy->is_empty()
+            || (beta != DataType(0) && beta != DataType(1)))
+            return false;
+        if (m_halo_xch_input != nullptr
+            && !(halo_exchanged && m_halo_xch_input->received_zero_halos()))
+            return false;
+        if (beta == DataType(0))
+            output.zero(m_be.get_stream());
+        ++stats.num_skipped_ops;
+        return true;
     }
 
     template <typename Allocator>
@@ -3077,12 +4545,32 @@ protected:
             GPU_PROFILE_RANGE_PUSH("conv/forward/exchange_halo");
         }
         assert_always(xch != nullptr);
-        xch->exchange(m_boundary_comms,
-                      m_be.get_stream(),
-                      false,
-                      !async,
-                      false,
-                      skip_unpack);
+        if (m_deconv || m_causal)
+        {
+            // Only the halo the deconvolution or the causal convolution
+            // reads is exchanged
+            bool const of_input = &xch == &m_halo_xch_input;
+            xch->exchange(
+                of_input ? m_halo_fwd_send : m_d_output_halo_fwd_send,
+                of_input ? m_halo_fwd_recv : m_d_output_halo_fwd_recv,
+                of_input ? m_halo_bwd_send : m_d_output_halo_bwd_send,
+                of_input ? m_halo_bwd_recv : m_d_output_halo_bwd_recv,
+                m_boundary_comms,
+                m_be.get_stream(),
+                false,
+                !async,
+                false,
+                skip_unpack);
+        }
+        else
+        {
+            xch->exchange(m_boundary_comms,
+                          m_be.get_stream(),
+                          false,
+                          !async,
+                          false,
+                          skip_unpack);
+        }
         if (m_be.is_nvtx_enabled())
         {
             GPU_PROFILE_RANGE_POP();
@@ -3091,29 +4579,403 @@ protected:
     }
 
     template <typename Allocator>
-    void unpack_halo(tensor::Tensor<DataType, LocaleMPI, Allocator>& tensor,
-                     std::unique_ptr<HaloExchange>& xch)
+    void record_input_halo(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input)
     {
-        xch->unpack(m_boundary_streams, m_be.get_stream(), true, false);
+        m_input_halo_buffer = input.get_const_buffer();
+        m_input_halo_version = input.get_halo_version();
+        m_input_halo_saved = false;
     }
 
-    void wait_boundaries(h2::gpu::DeviceStream s)
+    template <typename Allocator>
+    bool is_input_halo_recorded(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input) const
     {
-        apply_to_spatial_sides(m_num_dims, [&](int i, Side side) {
-            if (m_boundary_req(i, side))
-            {
-                util::wait_stream(m_boundary_streams(i, side), s);
-            }
-        });
+        return m_input_halo_buffer == input.get_const_buffer()
+               && m_input_halo_version == input.get_halo_version();
     }
 
-    int get_input_halo_recv(int dim, Side side)
+    // Calls f(offset, width, height, pitch) for each received halo
+    // slab of input, which is height rows of width elements, pitch
+    // elements apart, from offset in the buffer
+    template <typename Allocator, typename F>
+    void apply_to_input_halo_slabs(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        F&& f) const
     {
-        return side == LHS ? m_halo_bwd_recv[dim] : m_halo_fwd_recv[dim];
-    }
-
-    template <typename Allocator>
-    void setup_boundary_offsets(
+        const int nd = input.get_num_dims();
+        const auto real_shape = input.get_local_real_shape();
+        const auto local_shape = input.get_local_shape();
+        const auto strides = input.get_strides();
+        for (int i = 0; i < m_num_spatial_dims; ++i)
+        {
+            const int dim = get_spatial_dim(i);
+            assert_always(dim + 1 < nd);
+            index_t height = 1;
+            for (int j = dim + 1; j < nd; ++j)
+            {
+                height *= real_shape[j];
+            }
+            const index_t halo = input.get_halo_width(dim);
+            const index_t pitch = strides[dim + 1];
+            if (m_halo_bwd_recv[dim] > 0)
+            {
+                f((halo - m_halo_bwd_recv[dim]) * strides[dim],
+                  m_halo_bwd_recv[dim] * strides[dim],
+                  height,
+                  pitch);
+            }
+            if (m_halo_fwd_recv[dim] > 0)
+            {
+                f((halo + local_shape[dim]) * strides[dim],
+                  m_halo_fwd_recv[dim] * strides[dim],
+                  height,
+                  pitch);
+            }
+        }
+    }
+
+    // Makes the halo of input hold what forward read. The exchange is
+    // collective, so the processes exchanging with each other must
+    // change the halo version of input alike.
+    template <typename Allocator>
+    void ensure_input_halo(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input)
+    {
+        if (m_halo_xch_input == nullptr || input.get_local_size() == 0
+            || is_input_halo_recorded(input))
+        {
+            return;
+        }
+        if (m_input_halo_saved)
+        {
+            const auto* snapshot =
+                static_cast<const DataType*>(m_input_halo_snapshot.get());
+            // Only the halo is written
+            auto* buf = const_cast<DataType*>(input.get_const_buffer());
+            apply_to_input_halo_slabs(
+                input,
+                [&](index_t offset,
+                    index_t width,
+                    index_t height,
+                    index_t pitch) {
+                    h2::gpu::mem_copy_2d(buf + offset,
+                                         pitch * sizeof(DataType),
+                                         snapshot,
+                                         width * sizeof(DataType),
+                                         width * sizeof(DataType),
+                                         height,
+                                         m_be.get_stream());
+                    snapshot += width * height;
+                });
+            m_input_halo_buffer = input.get_const_buffer();
+            m_input_halo_version = input.get_halo_version();
+            return;
+        }
+        util::MPIPrintStreamDebug()
+            << "Exchanging the input halo again as it has changed since "
+               "forward";
+        // The exchange writes only the halo
+        exchange_halo(
+            const_cast<tensor::Tensor<DataType, LocaleMPI, Allocator>&>(input),
+            m_halo_xch_input,
+            false);
+        record_input_halo(input);
+    }
+
+    template <typename Allocator>
+    void unpack_halo(tensor::Tensor<DataType, LocaleMPI, Allocator>& tensor,
+                     std::unique_ptr<HaloExchange>& xch)
+    {
+        xch->unpack(m_boundary_streams, m_be.get_stream(), true, false);
+    }
+
+    // Makes s wait for the halo exchange started asynchronously
+    void wait_halo_exchange(h2::gpu::DeviceStream s)
+    {
+        apply_to_spatial_sides([&](int i, Side side) {
+            util::wait_stream(m_boundary_comms(i, side)->get_stream(), s);
+        });
+    }
+
+    // Whether the forward convolution is split into the interior and
+    // boundary regions to overlap the halo exchange. Deconvolution
+    // overlaps it without the split as its library call reads no halo.
+    bool is_fwd_split_for_overlap() const
+    {
+        return m_overlap_halo_exchange_fwd && !m_deconv;
+    }
+
+    // Whether the boundary regions of several dimensions overlap at the
+    // edges and corners of the output.
+    bool has_overlapping_fwd_boundaries() const
+    {
+        int num_dims = 0;
+        for (int i = 0; i < m_num_spatial_dims; ++i)
+        {
+            if (m_boundary_req(i, LHS) || m_boundary_req(i, RHS))
+                ++num_dims;
+        }
+        return num_dims > 1;
+    }
+
+    /*
+      Sample-chunked pipelining of the forward convolution: the local
+      mini-batch is split into chunks of samples, and the halos of
+      chunk i + 1 are exchanged while chunk i is convolved. Unlike the
+      interior/boundary split, this overlaps the exchange with the
+      whole convolution, so it also pays off when the boundaries are a
+      large fraction of the local tensor. It replaces the split, and
+      is used only with the halo exchanges that work on views of the
+      input.
+     */
+    template <typename Allocator>
+    void setup_fwd_sample_chunks(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        bool halo_exchange_required)
+    {
+        m_num_fwd_sample_chunks = 1;
+        m_fwd_sample_chunks.clear();
+        int const num_chunks = m_be.get_options().m_fwd_sample_chunks;
+        if (num_chunks <= 1 || !halo_exchange_required || m_deconv || m_causal
+            || m_chanfilt_algo != ChannelParallelismAlgorithm::NONE)
+            return;
+        if (m_halo_xch_method != HaloExchangeMethod::MPI
+            && m_halo_xch_method != HaloExchangeMethod::AL)
+        {
+            util::MPIRootPrintStreamInfo()
+                << "Sample-chunked forward convolution disabled as "
+                << m_halo_xch_method << " does not support it";
+            return;
+        }
+        // The chunks are partitioned as evenly as the samples
+        if (input.get_distribution().has_partition(-1))
+        {
+            util::MPIRootPrintStreamInfo()
+                << "Sample-chunked forward convolution disabled as the "
+                   "samples are explicitly partitioned";
+            return;
+        }
+        m_num_fwd_sample_chunks = num_chunks;
+        m_overlap_halo_exchange_fwd = false;
+        util::MPIRootPrintStreamDebug()
+            << "Forward convolution pipelined with " << num_chunks
+            << " sample chunks";
+    }
+
+    template <typename Allocator>
+    bool is_fwd_sample_chunked(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        bool skip_halo_exchange) const
+    {
+        return m_num_fwd_sample_chunks > 1 && !skip_halo_exchange
+               && input.get_local_shape()[-1] > 1;
+    }
+
+    // Makes the chunks view the current input. The processes
+    // exchanging halos with each other hold the same number of
+    // samples, so they split them into the same chunks.
+    template <typename Allocator>
+    void setup_fwd_sample_chunk_views(
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& input)
+    {
+        int const num_samples = input.get_local_shape()[-1];
+        int const num_chunks = std::min(m_num_fwd_sample_chunks, num_samples);
+        if (!m_fwd_sample_chunks.empty()
+            && m_fwd_sample_chunks_input == input.get_const_buffer()
+            && (int) m_fwd_sample_chunks.size() == num_chunks
+            && m_fwd_sample_chunks.back().offset
+                       + m_fwd_sample_chunks.back().num_samples
+                   == (index_t) num_samples)
+            return;
+        m_fwd_sample_chunks.clear();
+        index_t const num_splits =
+            input.get_distribution().get_split_shape()[-1];
+        index_t offset = 0;
+        for (int i = 0; i < num_chunks; ++i)
+        {
+            SampleChunk chunk;
+            chunk.offset = offset;
+            chunk.num_samples =
+                num_samples / num_chunks + (i < num_samples % num_chunks);
+            chunk.input.reset(
+                new tensor::Tensor<DataType, LocaleMPI, tensor::CUDAAllocator>());
+            tensor::View(*chunk.input, input);
+            // Only the local extent matters to the halo exchange, so the
+            // global one is made a multiple of the splits
+            chunk.input->set_outermost_dimension(chunk.num_samples
+                                                 * num_splits);
+            IndexVector idx(input.get_num_dims(), 0);
+            idx[-1] = offset;
+            chunk.input->set_view(input.get_buffer()
+                                      + input.get_local_offset(idx, true),
+                                  input.get_pitch());
+            if (m_halo_xch_method == HaloExchangeMethod::MPI)
+                chunk.xch.reset(new HaloExchangeMPI(*chunk.input));
+            else
+                chunk.xch.reset(new HaloExchangeAL(*chunk.input));
+            chunk.xch->set_comm_precision(m_halo_comm_precision);
+            apply_halo_row_subset(*chunk.xch);
+            offset += chunk.num_samples;
+            m_fwd_sample_chunks.push_back(std::move(chunk));
+        }
+        m_fwd_sample_chunks_input = input.get_const_buffer();
+    }
+
+    template <typename Allocator>
+    int forward_sample_chunked(
+        DataType alpha,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& filter,
+        DataType beta,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& output,
+        bool dump_profile)
+    {
+        if (m_be.is_nvtx_enabled())
+        {
+            GPU_PROFILE_RANGE_PUSH("conv/forward/sample_chunked");
+        }
+        setup_fwd_sample_chunk_views(input);
+        auto const handle = m_be.get_handle();
+        h2::gpu::DeviceStream const main_stream = m_be.get_stream();
+        // The exchanges are issued from a boundary stream, which is
+        // otherwise idle without the interior/boundary split, so that
+        // they do not wait for the convolutions of the preceding chunks
+        h2::gpu::DeviceStream const xch_stream =
+            get_boundary_stream(get_spatial_dim(0), LHS);
+        auto const exchange_chunk = [&](SampleChunk& chunk) {
+            chunk.xch->exchange(
+                m_boundary_comms, xch_stream, false, true, false, false);
+        };
+        util::wait_stream(main_stream, xch_stream);
+        exchange_chunk(m_fwd_sample_chunks[0]);
+        record_start_comp();
+        for (size_t i = 0; i < m_fwd_sample_chunks.size(); ++i)
+        {
+            auto& chunk = m_fwd_sample_chunks[i];
+            // Waits for the exchange of this chunk only
+            util::wait_stream(xch_stream, main_stream);
+            if (i + 1 < m_fwd_sample_chunks.size())
+                exchange_chunk(m_fwd_sample_chunks[i + 1]);
+
+            IndexVector idx(output.get_num_dims(), 0);
+            idx[-1] = chunk.offset;
+            void* output_ptr =
+                output.get_buffer() + output.get_local_offset(idx);
+            const void* input_ptr =
+                chunk.input->get_const_base_ptr()
+                - chunk.input->get_local_offset(IndexVector(m_halo_bwd_recv),
+                                                true);
+            // The algorithms are cached per chunk size
+            set_num_samples(chunk.num_samples);
+            setup_algorithms_fwd(
+                chunk.input->get_buffer(), filter.get_buffer(), output_ptr);
+            setup_workspace_size_fwd();
+            void* ws =
+                m_be.get_workspace_arena().get(m_ws_size_fwd, main_stream);
+            if (ws == nullptr && m_ws_size_fwd > 0)
+                return -1;
+            if (m_fwd_grouped)
+            {
+                run_grouped_fwd(alpha,
+                                input_ptr,
+                                filter.get_const_base_ptr(),
+                                beta,
+                                output_ptr);
+                continue;
+            }
+            auto input_proxy = dnn_lib::read_proxy(handle, m_input_d, input_ptr);
+            auto output_proxy =
+                dnn_lib::write_proxy(handle, m_output_d, output_ptr, beta);
+            m_be.convolution_forward(handle,
+                                     alpha,
+                                     input_proxy.desc(),
+                                     input_proxy.ptr(),
+                                     m_filter_d,
+                                     filter.get_const_base_ptr(),
+                                     m_conv_fwd_d,
+                                     m_fwd_algo,
+                                     ws,
+                                     m_ws_size_fwd,
+                                     beta,
+                                     output_proxy.desc(),
+                                     output_proxy.ptr());
+        }
+        record_end_comp();
+        // The other passes expect the descriptors of the whole
+        // mini-batch
+        set_num_samples(input.get_local_shape()[-1]);
+
+        if (m_be.is_nvtx_enabled())
+        {
+            m_be.wait();
+            GPU_PROFILE_RANGE_POP();
+        }
+        if (dump_profile)
+            dump_profile_statistics(false, false, true);
+        return 0;
+    }
+
+    void wait_boundaries(h2::gpu::DeviceStream s)
+    {
+        apply_to_spatial_sides([&](int i, Side side) {
+            if (m_boundary_req(i, side))
+            {
+                util::wait_stream(m_boundary_streams(i, side), s);
+            }
+        });
+    }
+
+    // Whether backward filter zero-clears the halos of d_output
+    template <typename Allocator>
+    bool bwd_filter_clears_halo(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& d_output) const
+    {
+        if (m_deconv)
+            return false;
+        const auto& dist = d_output.get_distribution();
+        for (int i = 0; i < m_num_spatial_dims; ++i)
+        {
+            const int dim = get_spatial_dim(i);
+            if (((dist.is_distributed(dim) && dist.get_locale_shape()[dim] > 1)
+                 || m_causal)
+                && dist.get_overlap(dim) > 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Tensor dimension of the i-th spatial dimension
+    int get_spatial_dim(int i) const
+    {
+        return tensor::get_spatial_dim(m_layout, i);
+    }
+
+    // Apply f to each side of the spatial tensor dimensions
+    template <typename F>
+    void apply_to_spatial_sides(F&& f) const
+    {
+        distconv::apply_to_spatial_sides(
+            m_num_dims, [&](int i, Side side) { f(get_spatial_dim(i), side); });
+    }
+
+    // Reorder a per-dimension vector of the tensors so that the
+    // spatial dimensions come first
+    template <typename VectorType>
+    VectorType get_channels_first(const VectorType& v) const
+    {
+        return tensor::to_channels_first(m_layout, v, m_num_dims);
+    }
+
+    int get_input_halo_recv(int dim, Side side)
+    {
+        return side == LHS ? m_halo_bwd_recv[dim] : m_halo_fwd_recv[dim];
+    }
+
+    template <typename Allocator>
+    void setup_boundary_offsets(
         int dim,
         Side side,
         const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
@@ -3147,18 +5009,20 @@ protected:
 
     void setup_boundary_streams(const IndexVector& split_idx)
     {
-        apply_to_spatial_sides(m_num_dims, [this](int i, Side side) {
+        apply_to_spatial_sides([this](int i, Side side) {
             int idx = get_boundary_stream_index(i, side);
             m_boundary_streams(i, side) = m_be.get_internal_stream_pr(idx);
             m_boundary_comms(i, side) = m_be.get_internal_al_mpi_cuda_comm(idx);
         });
         for (int i = 0; i < m_num_spatial_dims; ++i)
         {
-            if (split_idx[i] % 2)
+            const int dim = get_spatial_dim(i);
+            if (split_idx[dim] % 2)
             {
-                std::swap(m_boundary_streams(i, LHS),
-                          m_boundary_streams(i, RHS));
-                std::swap(m_boundary_comms(i, LHS), m_boundary_comms(i, RHS));
+                std::swap(m_boundary_streams(dim, LHS),
+                          m_boundary_streams(dim, RHS));
+                std::swap(m_boundary_comms(dim, LHS),
+                          m_boundary_comms(dim, RHS));
             }
         }
     }
@@ -3179,19 +5043,93 @@ protected:
     {
         if (m_chanfilt_algo == ChannelParallelismAlgorithm::NONE)
         {
+            auto& comm = m_be.get_al_nccl_comm();
+            util::instrumentation::ScopedTimer timer(
+                util::instrumentation::Phase::ALLREDUCE, comm.get_stream());
             Al::Allreduce<Al::NCCLBackend, DataType>(gradients.get_base_ptr(),
                                                      gradients.get_size(),
                                                      Al::ReductionOperator::sum,
-                                                     m_be.get_al_nccl_comm());
+                                                     comm);
         }
         else
         {
+            auto& comm = *m_be.get_segmented_ar_comm(m_chanfilt_segments);
+            util::instrumentation::ScopedTimer timer(
+                util::instrumentation::Phase::ALLREDUCE, comm.get_stream());
             Al::Allreduce<Al::NCCLBackend, DataType>(
                 gradients.get_base_ptr(),
                 gradients.get_local_size(),
                 Al::ReductionOperator::sum,
-                *m_be.get_segmented_ar_comm(m_chanfilt_segments));
+                comm);
+        }
+    }
+
+    // Allreduce the gradients and add their norm to norm_slot
+    template <typename Allocator>
+    void allreduce_gradients(
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& gradients,
+        int norm_slot)
+    {
+        allreduce_gradients(gradients);
+        if (m_grad_norm != nullptr && norm_slot >= 0)
+        {
+            // Channel/filter parallel gradients are partitioned and
+            // replicated over different processes
+            assert_always(m_chanfilt_algo == ChannelParallelismAlgorithm::NONE);
+            m_grad_norm->accumulate(norm_slot,
+                                    gradients.get_const_base_ptr(),
+                                    gradients.get_size(),
+                                    false,
+                                    m_be.get_stream());
+        }
+    }
+
+    template <typename Allocator>
+    void reduce_scatter_gradients(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& gradients,
+        tensor::Allreduce<DataType>& reducer,
+        DataType* shard,
+        int norm_slot)
+    {
+        // Channel/filter parallel gradients are partitioned already
+        assert_always(m_chanfilt_algo == ChannelParallelismAlgorithm::NONE);
+        util::instrumentation::ScopedTimer timer(
+            util::instrumentation::Phase::ALLREDUCE, m_be.get_stream());
+        const size_t count = gradients.get_size();
+        reducer.reduce_scatter(gradients.get_const_base_ptr(), shard, count);
+        if (m_grad_norm != nullptr && norm_slot >= 0)
+        {
+            // Shards past count hold only padding, and reducers
+            // without sharding leave the whole sum everywhere
+            const size_t shard_count = reducer.get_shard_count(count);
+            const size_t offset = reducer.get_shard_offset(count);
+            const size_t valid_count =
+                offset < count ? std::min(shard_count, count - offset) : 0;
+            m_grad_norm->accumulate(norm_slot,
+                                    shard,
+                                    valid_count,
+                                    shard_count < count,
+                                    m_be.get_stream());
+        }
+    }
+
+    template <typename Allocator>
+    typename GradientReducer<DataType>::Handle start_gradient_reduction(
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& gradients,
+        GradientReducer<DataType>& reducer,
+        int norm_slot)
+    {
+        // The segmented communicators are bound to the main stream, so
+        // channel/filter parallel layers reduce synchronously.
+        if (m_chanfilt_algo != ChannelParallelismAlgorithm::NONE)
+        {
+            allreduce_gradients(gradients, norm_slot);
+            return typename GradientReducer<DataType>::Handle();
         }
+        return reducer.start(gradients.get_base_ptr(),
+                             gradients.get_size(),
+                             m_be.get_stream(),
+                             norm_slot);
     }
 
     template <typename Allocator>
@@ -3214,8 +5152,23 @@ protected:
         }
         if (m_chanfilt_algo == ChannelParallelismAlgorithm::AUTO)
         {
-            // Force this for now.
-            m_chanfilt_algo = ChannelParallelismAlgorithm::X;
+            // W is only used when requested explicitly.
+            const index_t segments =
+                input.get_distribution().get_split_shape()[-2];
+            if (m_be.get_chanfilt_channel_comm(segments) == nullptr)
+            {
+                m_be.init_chanfilt_channel_comm(
+                    segments, input.get_sub_locale(-2).get_comm());
+            }
+            ChanfiltTuner<DataType> tuner(m_be);
+            m_chanfilt_algo =
+                tuner.tune(input.get_local_size(),
+                           output.get_local_size(),
+                           *m_be.get_chanfilt_channel_comm(segments),
+                           input.get_locale().get_comm());
+            m_chanfilt_estimates = tuner.get_estimates();
+            util::MPIRootPrintStreamDebug()
+                << "Using channel/filter parallelism " << m_chanfilt_algo;
         }
     }
 
@@ -3303,7 +5256,8 @@ protected:
         const backend::FilterDescriptor_t& weights_d,
         const std::string& context)
     {
-        if (m_num_dims == 4)
+        // 1D descriptors are set up as 2D ones
+        if (m_num_dims == 3 || m_num_dims == 4)
         {
             if (backend::get_tensor_dimension(channel_d, -2)
                     != backend::get_filter_descriptor_dimension<4>(weights_d,
@@ -3345,6 +5299,67 @@ protected:
         }
     }
 
+    // The backward passes are not planned if d_filter is null
+    template <typename Allocator>
+    void plan_num_samples(
+        const std::vector<int>& num_samples,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& filter,
+        tensor::Tensor<DataType, LocaleMPI, Allocator>& output,
+        void* d_input,
+        void* d_filter,
+        const void* d_output)
+    {
+        // Channel/filter parallelism finds its algorithms with
+        // temporary tensors that are only allocated by the passes
+        assert_always(m_chanfilt_algo == ChannelParallelismAlgorithm::NONE);
+        if (input.get_local_size() == 0 || output.get_local_size() == 0)
+            return;
+        int const current = backend::get_tensor_num_samples(m_input_d);
+        auto& arena = m_be.get_workspace_arena();
+        for (int n : num_samples)
+        {
+            assert_always(n > 0 && n <= (int) input.get_local_shape()[-1]);
+            set_num_samples(n);
+            setup_algorithms_fwd(input.get_buffer(),
+                                 filter.get_buffer(),
+                                 output.get_buffer());
+            setup_workspace_size_fwd();
+            setup_workspace_size_fwd_boundaries();
+            arena.get(m_ws_size_fwd, m_be.get_stream());
+            apply_to_spatial_sides([&](int i, Side side) {
+                if (m_boundary_req(i, side))
+                    arena.get(m_ws_size_fwd_boundaries(i, side),
+                              get_boundary_stream(i, side));
+            });
+            if (d_filter != nullptr)
+            {
+                if (!m_skip_bp_data)
+                {
+                    setup_algorithms_bwd_data(d_input, filter.get_buffer(),
+                                              d_output);
+                    setup_workspace_size_bwd_data();
+                    arena.get(m_ws_size_bwd_data, m_be.get_stream());
+                }
+                setup_algorithms_bwd_filter(input.get_buffer(), d_filter,
+                                            d_output);
+                setup_workspace_size_bwd_filter();
+                arena.get(m_ws_size_bwd_filter, m_be.get_stream());
+            }
+            m_planned_num_samples.insert(n);
+        }
+        if (current > 0)
+            set_num_samples(current);
+    }
+
+    // Whether both sizes were prepared by plan_num_samples, so that
+    // the workspaces of their graphs do not move
+    bool are_num_samples_planned(int n1, int n2) const
+    {
+        return m_planned_num_samples.count(n1) > 0
+               && m_planned_num_samples.count(n2) > 0;
+    }
+
     bool check_cache_and_restore_algos(const AlgoCache& cache){
         int num_samples = backend::get_tensor_num_samples(m_input_d);
 
@@ -3355,6 +5370,9 @@ protected:
             m_bwd_data_algo = std::get<1>(algos);
             m_bwd_filter_algo = std::get<2>(algos);
             m_fwd_boundary_algos = std::get<3>(algos);
+            m_fwd_grouped = std::get<4>(algos)[0];
+            m_bwd_data_grouped = std::get<4>(algos)[1];
+            m_bwd_filter_grouped = std::get<4>(algos)[2];
 
             return true;
         }
@@ -3362,20 +5380,733 @@ protected:
         return false;
     }
 
+    // In-place ReLU on the current stream of the handle
+    void apply_relu_epilogue(const backend::TensorDescriptor_t& desc,
+                             void* ptr)
+    {
+        backend::activation_forward(m_be.get_handle(),
+                                    m_activation_d,
+                                    DataType(1),
+                                    desc,
+                                    ptr,
+                                    DataType(0),
+                                    desc,
+                                    ptr);
+    }
+
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+    // Graph capture requires all work to be issued to streams without
+    // host synchronization. MPI- and P2P-based halo exchanges
+    // synchronize on the host, and channel/filter parallelism
+    // allocates temporary buffers on each call.
+    bool is_graph_capture_enabled(bool skip_halo_exchange)
+    {
+        if (!m_be.get_options().m_enable_graph_capture || m_in_graph_capture
+            || m_enable_profiling || m_occupancy != nullptr
+            || m_chanfilt_algo != ChannelParallelismAlgorithm::NONE
+            || m_num_fwd_sample_chunks > 1)
+            return false;
+        if (skip_halo_exchange)
+            return true;
+        switch (m_halo_xch_method)
+        {
+        case HaloExchangeMethod::AL:
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        case HaloExchangeMethod::AL_GRAPH:
+#endif // DISTCONV_HAS_CUDA_GRAPH
+#ifdef DISTCONV_HAS_NVSHMEM
+        case HaloExchangeMethod::NVSHMEM:
+        case HaloExchangeMethod::NVSHMEM_GRAPH:
+        case HaloExchangeMethod::NVSHMEM_DIRECT:
+        case HaloExchangeMethod::NVSHMEM_FUSED_NOTIFY:
+#endif // DISTCONV_HAS_NVSHMEM
+            return true;
+        default: return false;
+        }
+    }
+
+    std::string get_graph_key(const char* op,
+                              int num_samples,
+                              std::initializer_list<const void*> ptrs,
+                              DataType alpha,
+                              DataType beta,
+                              std::initializer_list<bool> flags)
+    {
+        std::ostringstream oss;
+        oss << op << ";" << num_samples;
+        for (auto p : ptrs)
+            oss << ";" << p;
+        oss << ";" << static_cast<float>(alpha) << ";"
+            << static_cast<float>(beta) << ";";
+        for (auto f : flags)
+            oss << f;
+        return oss.str();
+    }
+
+    // The first call for a key runs eagerly as it may select algorithms
+    // and allocate buffers, which cannot be captured. The second call
+    // is captured, and later ones replay the graph. Graphs hold the
+    // workspace of the arena shared by all layers, so they are dropped
+    // whenever any layer makes the arena reallocate.
+    template <typename Func>
+    int run_graph(const std::string& key, int num_samples, Func&& f)
+    {
+        if (num_samples != m_graph_num_samples)
+        {
+            if (!are_num_samples_planned(m_graph_num_samples, num_samples))
+                clear_graphs();
+            m_graph_num_samples = num_samples;
+        }
+        sync_graphs_with_workspace();
+        if (m_graphs.contains(key))
+        {
+            m_graphs.launch(key, m_be.get_stream());
+            return 0;
+        }
+        m_in_graph_capture = true;
+        int ret;
+        if (m_graph_warm_keys.count(key) == 0)
+        {
+            ret = f();
+            if (ret == 0)
+                m_graph_warm_keys.insert(key);
+        }
+        else
+        {
+            std::vector<h2::gpu::DeviceStream> aux_streams;
+            apply_to_spatial_sides([&](int i, Side side) {
+                aux_streams.push_back(get_boundary_stream(i, side));
+            });
+            ret = m_graphs.capture(key, m_be.get_stream(), aux_streams, f);
+        }
+        m_in_graph_capture = false;
+        sync_graphs_with_workspace();
+        return ret;
+    }
+
+    void sync_graphs_with_workspace()
+    {
+        size_t const generation = m_be.get_workspace_arena().get_generation();
+        if (generation != m_graph_ws_generation)
+        {
+            m_graphs.clear();
+            m_graph_ws_generation = generation;
+        }
+    }
+
+    void clear_graphs()
+    {
+        m_graphs.clear();
+        m_graph_warm_keys.clear();
+    }
+#endif // DISTCONV_HAS_CUDA_GRAPH
+
+    // Boundary convolutions run concurrently with the interior one on
+    // their own streams. The one of side (i, side) gets its fair share
+    // of what the other workspaces leave of the budget, with
+    // num_boundaries still to be searched. Zero means unconstrained.
+    size_t get_boundary_find_workspace_size(int i,
+                                            Side side,
+                                            int num_boundaries)
+    {
+        size_t const limit =
+            get_find_workspace_limit({get_boundary_stream(i, side)});
+        if (limit == 0)
+            return 0;
+        // At least one byte, as in get_find_workspace_limit
+        return std::max<size_t>(limit / std::max(num_boundaries, 1), 1);
+    }
+
+    // Streams backward data may run on: that of the backend, or its
+    // internal one within backward. Its workspace is budgeted on both.
+    std::vector<h2::gpu::DeviceStream> get_bwd_data_streams()
+    {
+        h2::gpu::DeviceStream const main =
+            m_bwd_main_stream != nullptr ? m_bwd_main_stream
+                                         : m_be.get_stream();
+        return {main, m_be.get_internal_stream(m_bwd_data_stream_index)};
+    }
+
+    // Largest workspace a search may pick for work that runs on any of
+    // streams, so that the regions of the workspace arena stay within
+    // the budget in total. Zero means unconstrained.
+    size_t
+    get_find_workspace_limit(std::vector<h2::gpu::DeviceStream> const& streams)
+    {
+        size_t const budget = m_be.get_options().m_ws_budget;
+        if (budget == 0)
+            return 0;
+        auto const& arena = m_be.get_workspace_arena();
+        size_t limit = budget;
+        for (auto const st : streams)
+            limit = std::min(limit, arena.get_limit(budget, st));
+        // A zero size would lift the limit, so at least one byte is
+        // passed, which restricts the search to algorithms that need
+        // no workspace.
+        return std::max<size_t>(limit, 1);
+    }
+
+    // Makes the later searches under the budget account for a
+    // workspace of size on each of streams
+    void reserve_workspace(size_t size,
+                           std::vector<h2::gpu::DeviceStream> const& streams)
+    {
+        if (m_be.get_options().m_ws_budget == 0)
+            return;
+        for (auto const st : streams)
+            m_be.get_workspace_arena().reserve(size, st);
+    }
+
     void cache_algos(AlgoCache& cache){
         int num_samples = backend::get_tensor_num_samples(m_input_d);
-        cache[num_samples] = AlgoTuple(m_fwd_algo,
-                                       m_bwd_data_algo,
-                                       m_bwd_filter_algo,
-                                       m_fwd_boundary_algos);
+        cache[num_samples] = AlgoTuple(
+            m_fwd_algo,
+            m_bwd_data_algo,
+            m_bwd_filter_algo,
+            m_fwd_boundary_algos,
+            {m_fwd_grouped, m_bwd_data_grouped, m_bwd_filter_grouped});
+    }
+
+    template <typename Allocator>
+    void setup_grouped_problems(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& filter,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& output,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& d_input,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& d_output,
+        const int_vector& strides,
+        const int_vector& dilations,
+        int num_groups)
+    {
+        m_grouped_supported = false;
+        if (!grouped_conv::is_data_type_supported<DataType>()
+            || num_groups <= 1
+            || m_chanfilt_algo != ChannelParallelismAlgorithm::NONE
+            || m_deconv
+            || m_num_spatial_dims > grouped_conv::max_num_spatial_dims)
+        {
+            return;
+        }
+
+        // Same geometries as the tensor descriptors
+        const IntVector no_halo(m_num_dims, 0);
+        auto make_problem = [&](const int_vector& pads) {
+            grouped_conv::Problem p;
+            p.num_spatial_dims = m_num_spatial_dims;
+            p.num_groups = num_groups;
+            p.w = grouped_conv::make_geometry(filter, no_halo, no_halo);
+            for (int i = 0; i < m_num_spatial_dims; ++i)
+            {
+                p.pads[i] = pads[i];
+                p.strides[i] = strides[i];
+                p.dilations[i] = dilations[i];
+            }
+            return p;
+        };
+        const auto x = grouped_conv::make_geometry(
+            input, m_halo_fwd_recv, m_halo_bwd_recv);
+        const auto dy = grouped_conv::make_geometry(
+            d_output, d_output.get_overlap(), d_output.get_overlap());
+
+        m_grouped_fwd_p = make_problem(m_pads_fp);
+        m_grouped_fwd_p.x = x;
+        m_grouped_fwd_p.y =
+            grouped_conv::make_geometry(output, no_halo, no_halo);
+
+        m_grouped_bwd_filter_p = make_problem(m_pads_bp);
+        m_grouped_bwd_filter_p.x = x;
+        m_grouped_bwd_filter_p.y = dy;
+
+        m_grouped_supported = grouped_conv::is_supported(m_grouped_fwd_p)
+                              && grouped_conv::is_supported(
+                                  m_grouped_bwd_filter_p);
+
+        if (!m_skip_bp_data)
+        {
+            m_grouped_bwd_data_p = make_problem(m_pads_bp);
+            m_grouped_bwd_data_p.x = grouped_conv::make_geometry(
+                d_input, m_halo_fwd_recv, m_halo_bwd_recv);
+            m_grouped_bwd_data_p.y = dy;
+            m_grouped_supported &=
+                grouped_conv::is_supported(m_grouped_bwd_data_p);
+        }
+    }
+
+    // The library chooses the fallback algorithm when the grouped
+    // convolution engine is requested by name.
+    static std::string get_library_find_algo(const std::string& name)
+    {
+        return name == grouped_conv::algo_name ? "DEFAULT" : name;
+    }
+
+    /** @brief Whether the grouped convolution engine is used for p.
+     *
+     *  It is used when requested by name, and with AUTOTUNE when it is
+     *  faster than the library algorithm already found. Both are timed
+     *  on the buffers the library algorithm was searched with, and the
+     *  choice is stored in the algorithm cache of the backend.
+     */
+    template <typename RunLibrary, typename RunGrouped>
+    bool select_grouped_engine(const std::string& direction,
+                               const std::string& find_algo,
+                               const grouped_conv::Problem& p,
+                               RunLibrary run_library,
+                               RunGrouped run_grouped)
+    {
+        if (!m_grouped_supported)
+            return false;
+        if (find_algo == grouped_conv::algo_name)
+            return true;
+        if (find_algo != "AUTOTUNE")
+            return false;
+
+        std::stringstream ss;
+        ss << "grouped_conv " << direction << " " << p
+           << " type_size=" << sizeof(DataType);
+        auto const key = ss.str();
+        int use_grouped;
+        if (!m_be.get_algo_cache().lookup(key, 0, use_grouped))
+        {
+            double const library_time = time_engine(run_library);
+            double const grouped_time = time_engine(run_grouped);
+            util::MPIPrintStreamDebug()
+                << "Convolution " << direction
+                << " library: " << library_time
+                << " s, grouped: " << grouped_time << " s";
+            use_grouped = grouped_time < library_time;
+            m_be.get_algo_cache().insert(key, use_grouped, 0);
+        }
+        if (use_grouped)
+        {
+            util::MPIPrintStreamDebug() << "Convolution " << direction
+                                        << " algorithm: "
+                                        << grouped_conv::algo_name;
+        }
+        return use_grouped;
+    }
+
+    template <typename F>
+    static double time_engine(F f)
+    {
+        constexpr int num_warmup = 2;
+        constexpr int num_trials = 10;
+        for (int i = 0; i < num_warmup; ++i)
+        {
+            f();
+        }
+        h2::gpu::sync();
+        double const start = MPI_Wtime();
+        for (int i = 0; i < num_trials; ++i)
+        {
+            f();
+        }
+        h2::gpu::sync();
+        return (MPI_Wtime() - start) / num_trials;
+    }
+
+    // The engine is only built for the types it supports, which are
+    // the only ones it is selected for.
+    void run_grouped_fwd(
+        DataType alpha, const void* x, const void* w, DataType beta, void* y)
+    {
+        if constexpr (grouped_conv::is_data_type_supported<DataType>())
+        {
+            grouped_conv::forward(m_grouped_fwd_p,
+                                  alpha,
+                                  static_cast<const DataType*>(x),
+                                  static_cast<const DataType*>(w),
+                                  beta,
+                                  static_cast<DataType*>(y),
+                                  m_be.get_stream());
+        }
+    }
+
+    void run_grouped_bwd_data(
+        DataType alpha, const void* w, const void* dy, DataType beta, void* dx)
+    {
+        if constexpr (grouped_conv::is_data_type_supported<DataType>())
+        {
+            grouped_conv::backward_data(m_grouped_bwd_data_p,
+                                        alpha,
+                                        static_cast<const DataType*>(w),
+                                        static_cast<const DataType*>(dy),
+                                        beta,
+                                        static_cast<DataType*>(dx),
+                                        m_be.get_stream());
+        }
+    }
+
+    void run_grouped_bwd_filter(
+        DataType alpha, const void* x, const void* dy, DataType beta, void* dw)
+    {
+        if constexpr (grouped_conv::is_data_type_supported<DataType>())
+        {
+            grouped_conv::backward_filter(m_grouped_bwd_filter_p,
+                                          alpha,
+                                          static_cast<const DataType*>(x),
+                                          static_cast<const DataType*>(dy),
+                                          beta,
+                                          static_cast<DataType*>(dw),
+                                          m_be.get_stream());
+        }
+    }
+
+    // Halos and paddings of deconvolution (see
+    // internal::get_deconv_halo_sizes)
+    template <typename Allocator>
+    void setup_deconv_halos(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& output,
+        const IntVector& filter_dims,
+        const int_vector& pads,
+        const int_vector& strides,
+        const int_vector& dilations)
+    {
+        assert_always(m_chanfilt_algo == ChannelParallelismAlgorithm::NONE);
+        internal::get_deconv_halo_sizes(input,
+                                        output,
+                                        filter_dims,
+                                        IntVector(strides),
+                                        IntVector(dilations),
+                                        IntVector(pads),
+                                        true,
+                                        m_halo_fwd_send,
+                                        m_halo_bwd_send,
+                                        m_halo_fwd_recv,
+                                        m_halo_bwd_recv);
+        internal::get_deconv_halo_sizes(input,
+                                        output,
+                                        filter_dims,
+                                        IntVector(strides),
+                                        IntVector(dilations),
+                                        IntVector(pads),
+                                        false,
+                                        m_d_output_halo_fwd_send,
+                                        m_d_output_halo_bwd_send,
+                                        m_d_output_halo_fwd_recv,
+                                        m_d_output_halo_bwd_recv);
+
+        // The library deconvolution of the local domains is the global
+        // one with the padding shifted by the offsets of the domains,
+        // which must give back the local input shape as the library
+        // does not take separate paddings for the two ends.
+        const auto input_offset = input.get_global_index();
+        const auto output_offset = output.get_global_index();
+        m_deconv_pads.clear();
+        for (int i = 0; i < m_num_spatial_dims; ++i)
+        {
+            const int dim = get_spatial_dim(i);
+            using sindex_t = std::int64_t;
+            const sindex_t window =
+                internal::get_dilated_filter_size(filter_dims[i], dilations[i]);
+            const sindex_t pad = pads[i] + (sindex_t) output_offset[dim]
+                                 - strides[i] * (sindex_t) input_offset[dim];
+            const sindex_t x =
+                (sindex_t) output.get_local_shape()[dim] + 2 * pad - window;
+            if (pad < 0 || x < 0
+                || x / strides[i] + 1
+                       != (sindex_t) input.get_local_shape()[dim])
+            {
+                util::MPIPrintStreamError()
+                    << "Deconvolution requires each output partition to "
+                       "begin at the stride times the beginning of the "
+                       "input partition: input offset: "
+                    << input_offset << ", local shape: "
+                    << input.get_local_shape()
+                    << ", output offset: " << output_offset
+                    << ", local shape: " << output.get_local_shape();
+                throw std::exception();
+            }
+            m_deconv_pads.push_back((int) pad);
+        }
+    }
+
+    template <typename Allocator>
+    void setup_causal_halos(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& d_output,
+        const IntVector& filter_dims,
+        const int_vector& strides,
+        const int_vector& dilations)
+    {
+        assert_always(m_chanfilt_algo == ChannelParallelismAlgorithm::NONE);
+        internal::get_causal_halo_sizes(input,
+                                        filter_dims,
+                                        IntVector(strides),
+                                        IntVector(dilations),
+                                        true,
+                                        m_halo_fwd_send,
+                                        m_halo_bwd_send,
+                                        m_halo_fwd_recv,
+                                        m_halo_bwd_recv);
+        internal::get_causal_halo_sizes(d_output,
+                                        filter_dims,
+                                        IntVector(strides),
+                                        IntVector(dilations),
+                                        false,
+                                        m_d_output_halo_fwd_send,
+                                        m_d_output_halo_bwd_send,
+                                        m_d_output_halo_fwd_recv,
+                                        m_d_output_halo_bwd_recv);
+    }
+
+    template <typename Allocator>
+    void setup_deconv_slabs(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& filter,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& output,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& d_input,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& d_output,
+        const int_vector& pads,
+        const int_vector& strides,
+        const int_vector& dilations,
+        int num_groups)
+    {
+        auto make_slabs = [&](const auto& x,
+                              const auto& y,
+                              const IntVector& halo_fwd,
+                              const IntVector& halo_bwd,
+                              bool halo_of_x) {
+            return make_deconv_halo_slabs(x,
+                                          y,
+                                          filter,
+                                          halo_fwd,
+                                          halo_bwd,
+                                          halo_of_x,
+                                          pads,
+                                          strides,
+                                          dilations,
+                                          num_groups);
+        };
+        m_deconv_fwd_slabs = make_slabs(
+            output, input, m_halo_fwd_recv, m_halo_bwd_recv, false);
+        m_deconv_bwd_data_slabs.clear();
+        if (!m_skip_bp_data)
+        {
+            m_deconv_bwd_data_slabs = make_slabs(d_output,
+                                                 d_input,
+                                                 m_d_output_halo_fwd_recv,
+                                                 m_d_output_halo_bwd_recv,
+                                                 true);
+        }
+        m_deconv_bwd_filter_slabs = make_slabs(d_output,
+                                               input,
+                                               m_d_output_halo_fwd_recv,
+                                               m_d_output_halo_bwd_recv,
+                                               true);
+
+        if (!grouped_conv::is_data_type_supported<DataType>()
+            && (!m_deconv_fwd_slabs.empty()
+                || !m_deconv_bwd_data_slabs.empty()
+                || !m_deconv_bwd_filter_slabs.empty()))
+        {
+            util::MPIPrintStreamError()
+                << "Deconvolution with halo exchange is not supported for "
+                   "this data type";
+            throw std::exception();
+        }
+    }
+
+    /** @brief Slabs that partition the halo of one operand of a
+     *  deconvolution, each paired with the region of the local domain
+     *  of the other operand it interacts with.
+     *
+     *  x is the output side of the deconvolution and y the input side.
+     *  The slab of a spatial dimension spans the local domain in the
+     *  preceding dimensions and the domain extended by the halo in the
+     *  following ones, so every halo element, including the diagonal
+     *  ones, is in exactly one slab.
+     */
+    template <typename Allocator>
+    std::vector<DeconvHaloSlab> make_deconv_halo_slabs(
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& x,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& y,
+        const tensor::Tensor<DataType, LocaleMPI, Allocator>& filter,
+        const IntVector& halo_fwd,
+        const IntVector& halo_bwd,
+        bool halo_of_x,
+        const int_vector& pads,
+        const int_vector& strides,
+        const int_vector& dilations,
+        int num_groups)
+    {
+        std::vector<DeconvHaloSlab> slabs;
+        const IntVector no_halo(m_num_dims, 0);
+        const auto& h = halo_of_x ? x : y;
+        const auto& l = halo_of_x ? y : x;
+        // Signed as the slabs begin before the local domains
+        using sindex_t = std::int64_t;
+        const auto h_offset = h.get_global_index();
+        const auto l_offset = l.get_global_index();
+        const auto h_shape = h.get_local_shape();
+        const auto l_shape = l.get_local_shape();
+        for (int si = 0; si < m_num_spatial_dims; ++si)
+        {
+            for (Side side : SIDES)
+            {
+                const int dim = get_spatial_dim(si);
+                const int width =
+                    side == LHS ? halo_bwd[dim] : halo_fwd[dim];
+                if (width == 0)
+                    continue;
+                DeconvHaloSlab slab;
+                auto& p = slab.p;
+                p.num_spatial_dims = m_num_spatial_dims;
+                p.num_groups = num_groups;
+                p.w = grouped_conv::make_geometry(filter, no_halo, no_halo);
+                auto hg = grouped_conv::make_geometry(h, no_halo, no_halo);
+                auto lg = grouped_conv::make_geometry(l, no_halo, no_halo);
+                sindex_t h_ptr_offset = 0;
+                sindex_t l_ptr_offset = 0;
+                bool empty = false;
+                for (int sj = 0; sj < m_num_spatial_dims && !empty; ++sj)
+                {
+                    const int dj = get_spatial_dim(sj);
+                    const sindex_t s = strides[sj];
+                    const sindex_t pad = pads[sj];
+                    const sindex_t window = internal::get_dilated_filter_size(
+                        (int) filter.get_shape()[dj], dilations[sj]);
+                    // Slab relative to the local domain
+                    sindex_t begin = 0;
+                    sindex_t size = h_shape[dj];
+                    if (sj == si)
+                    {
+                        begin = side == LHS ? -width : (sindex_t) h_shape[dj];
+                        size = width;
+                    }
+                    else if (sj > si)
+                    {
+                        begin = -halo_bwd[dj];
+                        size = h_shape[dj] + halo_bwd[dj] + halo_fwd[dj];
+                    }
+                    // Global range of the other operand interacting with
+                    // the slab
+                    const sindex_t g_begin = h_offset[dj] + begin;
+                    const sindex_t g_end = g_begin + size;
+                    sindex_t o_begin, o_end;
+                    if (halo_of_x)
+                    {
+                        const sindex_t t = g_begin + pad - (window - 1);
+                        o_begin = t <= 0 ? 0 : (t + s - 1) / s;
+                        o_end = (g_end - 1 + pad) / s + 1;
+                    }
+                    else
+                    {
+                        o_begin = g_begin * s - pad;
+                        o_end = (g_end - 1) * s - pad + window;
+                    }
+                    o_begin = std::max(o_begin, (sindex_t) l_offset[dj]);
+                    o_end = std::min(
+                        o_end, (sindex_t) (l_offset[dj] + l_shape[dj]));
+                    if (o_begin >= o_end)
+                    {
+                        empty = true;
+                        break;
+                    }
+                    hg.dims[sj] = size;
+                    h_ptr_offset += begin * (sindex_t) hg.strides[sj];
+                    lg.dims[sj] = o_end - o_begin;
+                    l_ptr_offset +=
+                        (o_begin - (sindex_t) l_offset[dj])
+                        * (sindex_t) lg.strides[sj];
+                    // x element q pairs with y element o when
+                    // q = o * s + f * d - pads
+                    const sindex_t x_begin = halo_of_x ? g_begin : o_begin;
+                    const sindex_t y_begin = halo_of_x ? o_begin : g_begin;
+                    p.pads[sj] = pad + x_begin - s * y_begin;
+                    p.strides[sj] = s;
+                    p.dilations[sj] = dilations[sj];
+                }
+                if (empty)
+                    continue;
+                p.x = halo_of_x ? hg : lg;
+                p.y = halo_of_x ? lg : hg;
+                slab.x_offset = halo_of_x ? h_ptr_offset : l_ptr_offset;
+                slab.y_offset = halo_of_x ? l_ptr_offset : h_ptr_offset;
+                slabs.push_back(slab);
+            }
+        }
+        return slabs;
+    }
+
+    // The halo slabs of deconvolution are added to what the library
+    // computes from the local domains.
+    void run_deconv_halo_fwd(DataType alpha,
+                             const DataType* input,
+                             const DataType* filter,
+                             DataType* output)
+    {
+        if constexpr (grouped_conv::is_data_type_supported<DataType>())
+        {
+            for (const auto& slab : m_deconv_fwd_slabs)
+            {
+                grouped_conv::backward_data(slab.p,
+                                            alpha,
+                                            filter,
+                                            input + slab.y_offset,
+                                            DataType(1),
+                                            output + slab.x_offset,
+                                            m_be.get_stream());
+            }
+        }
+    }
+
+    void run_deconv_halo_bwd_data(DataType alpha,
+                                  const DataType* filter,
+                                  const DataType* d_output,
+                                  DataType* d_input)
+    {
+        if constexpr (grouped_conv::is_data_type_supported<DataType>())
+        {
+            for (const auto& slab : m_deconv_bwd_data_slabs)
+            {
+                grouped_conv::forward(slab.p,
+                                      alpha,
+                                      d_output + slab.x_offset,
+                                      filter,
+                                      DataType(1),
+                                      d_input + slab.y_offset,
+                                      m_be.get_stream());
+            }
+        }
     }
 
-    void set_find_workspace_size(size_t& ws_size){
+    void run_deconv_halo_bwd_filter(DataType alpha,
+                                    const DataType* input,
+                                    const DataType* d_output,
+                                    DataType* d_filter)
+    {
+        if constexpr (grouped_conv::is_data_type_supported<DataType>())
+        {
+            for (const auto& slab : m_deconv_bwd_filter_slabs)
+            {
+                grouped_conv::backward_filter(slab.p,
+                                              alpha,
+                                              d_output + slab.x_offset,
+                                              input + slab.y_offset,
+                                              DataType(1),
+                                              d_filter,
+                                              m_be.get_stream());
+            }
+        }
+    }
+
+    // limit is from get_find_workspace_limit
+    void set_find_workspace_size(size_t& ws_size, size_t limit){
         if (ws_size == 0)
         {
             size_t const available = backend::get_available_memory();
             ws_size = available * 0.8;
         }
+        // All layers share the workspace arena of the backend, which
+        // holds one region per stream and packs them all into one
+        // allocation. The budget thus bounds the sum of the regions:
+        // each search is limited to what the other regions leave, and
+        // the workspace it picks is reserved on its streams.
+        if (limit > 0)
+        {
+            ws_size = std::min(ws_size, limit);
+        }
 
         auto& mempool = internal::RuntimeGPU::get_device_memory_pool();
         // take the maximum size that does not exceed the request size
@@ -3383,6 +6114,11 @@ protected:
         // adjust the size with an option value
         actual_ws_size *= m_be.get_options().m_ws_capacity_factor;
         actual_ws_size = mempool.get_max_allocatable_size(actual_ws_size);
+        // The factor may be larger than one
+        if (limit > 0)
+        {
+            actual_ws_size = std::min(actual_ws_size, limit);
+        }
 
         util::MPIRootPrintStreamDebug()
             << "Requested workspace size: " << ws_size << " ("
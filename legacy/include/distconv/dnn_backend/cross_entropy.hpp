@@ -2,6 +2,7 @@
 
 #include "distconv/dnn_backend/backend.hpp"
 #include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/al_collectives.hpp"
 
 #include <Al.hpp>
 
@@ -72,8 +73,8 @@ public:
         if (m_num_procs_per_sample > 1)
         {
             auto sample_loc = x_pred.get_sub_locale_except_dim(-1);
-            m_al.reset(new Al::NCCLBackend::comm_type(sample_loc.get_comm(),
-                                                      m_be.get_stream()));
+            m_al = tensor::get_al_collectives(
+                sample_loc.get_comm(), m_be.get_stream());
         }
     }
 
@@ -91,7 +92,7 @@ protected:
     BackendDNNLib& m_be;
     const bool m_use_labels;
     int m_num_procs_per_sample;
-    std::unique_ptr<Al::NCCLBackend::comm_type> m_al;
+    std::shared_ptr<tensor::AlCollectives> m_al;
 };
 
 } // namespace distconv
@@ -0,0 +1,157 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/dnn_backend/algo_cache.hpp"
+
+#include <cudnn.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The backend graph API is available since cuDNN 8.
+#if CUDNN_MAJOR >= 8
+#define DISTCONV_HAS_CUDNN_GRAPH_API
+#endif
+
+#ifdef DISTCONV_HAS_CUDNN_GRAPH_API
+
+namespace distconv
+{
+namespace cudnn
+{
+
+enum class GraphConvKind
+{
+    FWD,
+    BWD_DATA,
+    BWD_FILTER
+};
+
+/** @brief A convolution described by legacy descriptors.
+ *
+ *  x, w and y are the input, filter and output of the forward
+ *  convolution; for backward data, x is the input gradient and y is
+ *  the output gradient, and for backward filter, w is the filter
+ *  gradient. When bias_desc is set, the bias is added to the forward
+ *  output followed by ReLU.
+ */
+struct GraphConvProblem
+{
+    GraphConvKind kind;
+    cudnnTensorDescriptor_t x_desc;
+    const void* x;
+    cudnnFilterDescriptor_t w_desc;
+    const void* w;
+    cudnnConvolutionDescriptor_t conv_desc;
+    cudnnTensorDescriptor_t y_desc;
+    const void* y;
+    double alpha;
+    double beta;
+    cudnnTensorDescriptor_t bias_desc = nullptr;
+    const void* bias = nullptr;
+};
+
+/** @brief Owner of a cuDNN backend descriptor. */
+class GraphDescriptor
+{
+public:
+    GraphDescriptor() = default;
+    explicit GraphDescriptor(cudnnBackendDescriptorType_t type);
+    GraphDescriptor(const GraphDescriptor&) = delete;
+    GraphDescriptor& operator=(const GraphDescriptor&) = delete;
+    GraphDescriptor(GraphDescriptor&& d) noexcept;
+    GraphDescriptor& operator=(GraphDescriptor&& d) noexcept;
+    ~GraphDescriptor();
+
+    cudnnBackendDescriptor_t get() const { return m_desc; }
+
+    void set(cudnnBackendAttributeName_t name,
+             cudnnBackendAttributeType_t type,
+             int64_t count,
+             const void* values);
+    void set(cudnnBackendAttributeName_t name, const GraphDescriptor& d);
+    void finalize();
+    /** @brief Finalize, returning false if cuDNN does not support the
+     *  configuration.
+     */
+    bool try_finalize();
+
+private:
+    cudnnBackendDescriptor_t m_desc = nullptr;
+};
+
+/** @brief Execution plans of the cuDNN graph API.
+ *
+ *  A plan is built once per problem and reused. The engine of a plan
+ *  is selected by the heuristics of cuDNN among those whose workspace
+ *  fits into the given size, and its global index is recorded in the
+ *  algorithm cache, so plans can be rebuilt without the heuristics in
+ *  later runs.
+ */
+class GraphPlanCache
+{
+public:
+    GraphPlanCache() = default;
+    GraphPlanCache(const GraphPlanCache&) = delete;
+    GraphPlanCache& operator=(const GraphPlanCache&) = delete;
+
+    /** @brief Run p with the plan cached for key, building it first if
+     *  needed.
+     *
+     *  Returns false without doing anything when no engine supports
+     *  the problem within ws_size, in which case the caller must fall
+     *  back to the legacy API.
+     */
+    bool execute(cudnnHandle_t handle,
+                 const GraphConvProblem& p,
+                 const std::string& key,
+                 void* ws,
+                 size_t ws_size,
+                 ConvAlgoCache& algo_cache);
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_plans.clear();
+        m_unsupported.clear();
+    }
+
+private:
+    struct Plan
+    {
+        GraphDescriptor plan;
+        // Descriptors the plan was built from
+        std::vector<GraphDescriptor> deps;
+        size_t ws_size = 0;
+    };
+    // Held while a plan is looked up, built and executed, which
+    // serializes the graph convolutions of concurrent threads
+    std::mutex m_mutex;
+    std::map<std::string, Plan> m_plans;
+    // Largest workspace size with which building a plan failed
+    std::map<std::string, size_t> m_unsupported;
+
+    static bool build_plan(cudnnHandle_t handle,
+                           const GraphConvProblem& p,
+                           int64_t alignment,
+                           const std::string& key,
+                           size_t ws_size,
+                           ConvAlgoCache& algo_cache,
+                           Plan& plan);
+    static bool finalize_plan(cudnnHandle_t handle,
+                              const GraphDescriptor& cfg,
+                              Plan& plan);
+};
+
+} // namespace cudnn
+} // namespace distconv
+
+#endif // DISTCONV_HAS_CUDNN_GRAPH_API
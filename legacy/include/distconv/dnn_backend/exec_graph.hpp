@@ -0,0 +1,242 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace distconv
+{
+
+/** @brief Layer-level execution graph issued over a pool of streams.
+ *
+ *  Ops are calls to layers, e.g., Convolution::forward, registered
+ *  with the buffers of the tensors they read and write. An op depends
+ *  on the earlier ops writing what it reads (read after write) and on
+ *  the earlier ops accessing what it writes (write after read and
+ *  write after write), in registration order, plus any explicit
+ *  dependencies.
+ *
+ *  run() issues the ops in registration order. An op continues on the
+ *  stream of a dependency it directly follows, and otherwise goes to
+ *  the next stream of the pool in turn, so independent branches such
+ *  as skip connections or backward data and backward filter run
+ *  concurrently. Dependencies across streams are enforced
+ *  with one event per op. The backend issues the work of each op to
+ *  its stream through BackendDNNLib::set_stream, and the graph as a
+ *  whole is ordered after and before the work of the default stream
+ *  of the backend.
+ *
+ *  Halo exchanges write the halos of the exchanged tensor, so a layer
+ *  exchanging the halos of its input must list the input as written.
+ *  Ops reducing through the communicators of the backend, which are
+ *  bound to its default stream, must be registered to run on the
+ *  default stream.
+ */
+class ExecutionGraph
+{
+public:
+    using Func = std::function<void()>;
+    using Buffers = std::vector<const void*>;
+
+    ExecutionGraph(BackendDNNLib& backend, int num_streams = 4)
+        : m_be(backend)
+    {
+        assert_always(num_streams > 0);
+        for (int i = 0; i < num_streams; ++i)
+        {
+            m_streams.push_back(m_be.get_internal_stream(i));
+        }
+    }
+
+    ExecutionGraph(const ExecutionGraph&) = delete;
+    ExecutionGraph& operator=(const ExecutionGraph&) = delete;
+
+    ~ExecutionGraph() { clear(); }
+
+    /** @brief Register op f reading and writing the given buffers.
+     *
+     *  @return the index of the op.
+     */
+    int add_op(const std::string& name,
+               Func f,
+               const Buffers& reads,
+               const Buffers& writes,
+               bool on_default_stream = false)
+    {
+        int const idx = m_ops.size();
+        Op op;
+        op.name = name;
+        op.func = std::move(f);
+        op.on_default_stream = on_default_stream;
+        op.event = backend::make_event();
+        m_ops.push_back(std::move(op));
+        for (const void* buf : reads)
+        {
+            auto& b = m_buffers[buf];
+            add_dependency(b.last_writer, idx);
+            b.readers.push_back(idx);
+        }
+        for (const void* buf : writes)
+        {
+            auto& b = m_buffers[buf];
+            add_dependency(b.last_writer, idx);
+            for (int r : b.readers)
+            {
+                add_dependency(r, idx);
+            }
+            b.last_writer = idx;
+            b.readers.clear();
+        }
+        return idx;
+    }
+
+    /** @brief Make op after wait for op before. */
+    void add_dependency(int before, int after)
+    {
+        if (before < 0 || before == after)
+            return;
+        assert_always(before < after && after < (int) m_ops.size());
+        auto& deps = m_ops[after].deps;
+        if (std::find(deps.begin(), deps.end(), before) == deps.end())
+        {
+            deps.push_back(before);
+        }
+    }
+
+    int get_num_ops() const { return m_ops.size(); }
+
+    /** @brief Stream op idx was issued to by the last run. */
+    backend::Stream_t get_stream(int idx) const
+    {
+        return m_ops.at(idx).stream;
+    }
+
+    /** @brief Issue all ops without blocking the host. */
+    void run()
+    {
+        backend::Stream_t const default_stream = m_be.get_stream();
+        // The inputs of the graph are produced on the default stream
+        util::wait_stream(default_stream, m_streams.data(), m_streams.size());
+        // Last op issued to each stream of the pool
+        std::vector<int> tails(m_streams.size(), -1);
+        int default_tail = -1;
+        for (int i = 0; i < (int) m_ops.size(); ++i)
+        {
+            auto& op = m_ops[i];
+            op.stream = select_stream(op, default_stream, default_tail, tails);
+            for (int d : op.deps)
+            {
+                if (m_ops[d].stream != op.stream)
+                {
+                    DISTCONV_CHECK_GPU(
+                        GPU_STREAM_WAIT_EVENT(op.stream, m_ops[d].event, 0));
+                }
+            }
+            util::MPIPrintStreamDebug()
+                << "Issuing " << op.name << " to stream " << op.stream;
+            m_be.set_stream(op.stream);
+            op.func();
+            m_be.set_stream(default_stream);
+            backend::record_event(op.event, op.stream);
+            util::sync_if_synchronous(op.stream);
+            if (op.stream == default_stream)
+            {
+                default_tail = i;
+            }
+            else
+            {
+                for (size_t s = 0; s < m_streams.size(); ++s)
+                {
+                    if (m_streams[s] == op.stream)
+                        tails[s] = i;
+                }
+            }
+        }
+        // The default stream joins the work of the pool
+        for (size_t s = 0; s < m_streams.size(); ++s)
+        {
+            if (tails[s] >= 0)
+            {
+                util::wait_stream(m_streams[s], default_stream);
+            }
+        }
+    }
+
+    /** @brief Remove all ops. */
+    void clear()
+    {
+        for (auto& op : m_ops)
+        {
+            backend::destroy_event(op.event);
+        }
+        m_ops.clear();
+        m_buffers.clear();
+        m_next_stream = 0;
+    }
+
+private:
+    struct Op
+    {
+        std::string name;
+        Func func;
+        std::vector<int> deps;
+        bool on_default_stream = false;
+        backend::Event_t event;
+        backend::Stream_t stream = nullptr;
+    };
+
+    // Accesses of a buffer by the ops registered so far
+    struct BufferAccess
+    {
+        int last_writer = -1;
+        // Readers since the last write
+        std::vector<int> readers;
+    };
+
+    BackendDNNLib& m_be;
+    std::vector<backend::Stream_t> m_streams;
+    std::vector<Op> m_ops;
+    std::unordered_map<const void*, BufferAccess> m_buffers;
+    size_t m_next_stream = 0;
+
+    backend::Stream_t select_stream(const Op& op,
+                                    backend::Stream_t default_stream,
+                                    int default_tail,
+                                    const std::vector<int>& tails)
+    {
+        if (op.on_default_stream)
+            return default_stream;
+        // Continue on the stream of a dependency issued last to it, so
+        // that no event is waited for
+        for (int d : op.deps)
+        {
+            if (d == default_tail)
+                return default_stream;
+            for (size_t s = 0; s < m_streams.size(); ++s)
+            {
+                if (tails[s] == d)
+                    return m_streams[s];
+            }
+        }
+        auto const s = m_streams[m_next_stream];
+        m_next_stream = (m_next_stream + 1) % m_streams.size();
+        return s;
+    }
+};
+
+} // namespace distconv
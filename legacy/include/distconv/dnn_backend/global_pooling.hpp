@@ -0,0 +1,154 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/al_collectives.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
+
+#include <Al.hpp>
+
+#include <memory>
+
+namespace distconv
+{
+namespace global_pooling
+{
+
+// Reduces each local plane of the input to the element of its
+// channel and sample in the output, multiplied by scale when
+// averaging
+template <typename TensorType>
+void reduce_planes(GlobalPoolingMode mode,
+                   const TensorType& input,
+                   TensorType& output,
+                   typename TensorType::data_type scale,
+                   h2::gpu::DeviceStream stream);
+
+// Broadcasts the output gradients over the planes of the input
+// gradients. With MAX, the gradient goes to each element equal to the
+// pooled maximum.
+template <typename TensorType>
+void backprop(GlobalPoolingMode mode,
+              const TensorType& input,
+              const TensorType& output,
+              const TensorType& d_output,
+              TensorType& d_input,
+              typename TensorType::data_type scale,
+              h2::gpu::DeviceStream stream);
+
+} // namespace global_pooling
+
+/** @brief Global average or max pooling of spatially distributed samples.
+ *
+ *  Each channel of a sample is reduced to a single value. The local
+ *  planes are reduced in a deterministic order, and the partial
+ *  results of all the local samples and channels are then combined
+ *  with a single allreduce among the processes sharing a sample. The
+ *  backward pass needs no communication, as the pooled values and
+ *  their gradients are replicated over those processes.
+ *
+ *  The channel dimension must not be partitioned. The output must
+ *  have a spatial extent of one, without halos, and hold all the local
+ *  channels and samples on every process. Only the outermost spatial
+ *  dimension of the input may have halos, which are not read or
+ *  written.
+ */
+template <typename DataType>
+class GlobalPooling<BackendDNNLib, DataType>
+{
+public:
+    GlobalPooling(BackendDNNLib& backend, int num_dims, GlobalPoolingMode mode)
+        : m_be(backend), m_num_dims(num_dims), m_mode(mode)
+    {}
+
+    GlobalPooling(const GlobalPooling&) = delete;
+    GlobalPooling& operator=(const GlobalPooling&) = delete;
+
+    template <typename Tensor>
+    void setup(const Tensor& input)
+    {
+        assert_eq(input.get_num_dims(), m_num_dims);
+        assert_always(input.get_layout() == tensor::Layout::CHANNELS_FIRST);
+        const auto& loc_shape = input.get_locale_shape();
+        assert_eq(loc_shape[-2], 1);
+        m_num_procs_per_sample = loc_shape.get_size() / loc_shape[-1];
+        if (m_num_procs_per_sample > 1)
+        {
+            auto sample_loc = input.get_sub_locale_except_dim(-1);
+            m_sample_al = tensor::get_al_collectives(
+                sample_loc.get_comm(), m_be.get_stream());
+        }
+        const auto& shape = input.get_shape();
+        const index_t spatial_size = shape.get_size() / shape[-1] / shape[-2];
+        m_scale = m_mode == GlobalPoolingMode::AVERAGE
+                      ? DataType(1) / static_cast<DataType>(spatial_size)
+                      : DataType(1);
+    }
+
+    template <typename Tensor>
+    int forward(const Tensor& input, Tensor& output)
+    {
+        DISTCONV_RANGE("global_pooling/forward", Compute);
+        util::MPIPrintStreamDebug()
+            << "GlobalPooling: " << input << ", " << output;
+        const auto& shape = input.get_local_shape();
+        assert_eq((index_t) output.get_local_real_size(),
+                  (index_t) shape[-1] * shape[-2]);
+        if (output.get_local_size() == 0)
+            return 0;
+        global_pooling::reduce_planes<Tensor>(
+            m_mode, input, output, m_scale, m_be.get_stream());
+        allreduce_sample(output.get_base_ptr(), output.get_local_size());
+        return 0;
+    }
+
+    /** @brief Backward pass with the input and output of the forward pass. */
+    template <typename Tensor>
+    int backward(const Tensor& input,
+                 const Tensor& output,
+                 const Tensor& d_output,
+                 Tensor& d_input)
+    {
+        DISTCONV_RANGE("global_pooling/backward", Compute);
+        util::MPIPrintStreamDebug() << "GlobalPooling BP";
+        if (d_input.get_local_size() == 0)
+            return 0;
+        global_pooling::backprop<Tensor>(m_mode,
+                                         input,
+                                         output,
+                                         d_output,
+                                         d_input,
+                                         m_scale,
+                                         m_be.get_stream());
+        return 0;
+    }
+
+protected:
+    BackendDNNLib& m_be;
+    int m_num_dims;
+    GlobalPoolingMode m_mode;
+    // Reciprocal of the spatial size of a sample when averaging
+    DataType m_scale = DataType(1);
+    int m_num_procs_per_sample = 1;
+    std::shared_ptr<tensor::AlCollectives> m_sample_al;
+
+    void allreduce_sample(DataType* values, int count)
+    {
+        if (m_num_procs_per_sample < 2)
+            return;
+        DISTCONV_RANGE("global_pooling/allreduce", Collective);
+        m_sample_al->allreduce(values,
+                               count,
+                               m_mode == GlobalPoolingMode::MAX
+                                   ? Al::ReductionOperator::max
+                                   : Al::ReductionOperator::sum);
+    }
+};
+
+} // namespace distconv
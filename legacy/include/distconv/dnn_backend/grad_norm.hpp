@@ -0,0 +1,199 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+#include <Al.hpp>
+#include <h2/gpu/memory_utils.hpp>
+#include <h2/gpu/runtime.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace distconv
+{
+
+namespace grad_norm
+{
+
+// Sums of squares are accumulated in double for double gradients and
+// in float otherwise
+template <typename DataType>
+using AccType = typename std::
+    conditional<std::is_same<DataType, double>::value, double, float>::type;
+
+/** @brief A reduced gradient copied from src to dst. */
+template <typename DataType>
+struct Slice
+{
+    const DataType* src;
+    DataType* dst;
+    size_t count;
+    // Slot the squares are added to; negative when not accumulated
+    int slot;
+};
+
+/** @brief Add the sum of squares of count elements of buf to
+ *  sums[slot] and sums[total]. */
+template <typename DataType>
+void accumulate(const DataType* buf,
+                size_t count,
+                AccType<DataType>* sums,
+                int slot,
+                int total,
+                h2::gpu::DeviceStream stream);
+
+/** @brief Copy the num_slices slices in device memory, adding their
+ *  squares to sums as accumulate does if with_sums. */
+template <typename DataType>
+void scatter(const Slice<DataType>* slices,
+             int num_slices,
+             size_t max_count,
+             AccType<DataType>* sums,
+             int total,
+             bool with_sums,
+             h2::gpu::DeviceStream stream);
+
+} // namespace grad_norm
+
+/** @brief Global L2 norm of the gradients, e.g., for gradient
+ *  clipping, accumulated while the gradients are reduced.
+ *
+ *  Each slot, e.g., a layer, accumulates the sum of squares of its
+ *  reduced gradients in a device array, whose last element sums all
+ *  the slots. GradientReducer adds them while copying its buckets
+ *  back, so the bucketed gradients are not read again; gradients
+ *  reduced in place are read once more on the stream of the
+ *  reduction.
+ *
+ *  Reduced gradients are the same on all processes, so only the root
+ *  of the communicator of the backend adds them, while shards of
+ *  reduce-scattered gradients are added by every process. A single
+ *  allreduce of the array then gives the global sums.
+ */
+template <typename DataType>
+class GradientNorm
+{
+public:
+    using AccType = grad_norm::AccType<DataType>;
+    using Slice = grad_norm::Slice<DataType>;
+
+    GradientNorm(BackendDNNLib& backend, int num_slots)
+        : m_be(backend),
+          m_num_slots(num_slots),
+          m_is_root(backend.get_al_nccl_comm().rank() == 0)
+    {
+        assert_always(num_slots > 0);
+        m_sums.allocate((num_slots + 1) * sizeof(AccType));
+        m_sums.memset(0, m_be.get_stream());
+    }
+    GradientNorm(const GradientNorm&) = delete;
+    GradientNorm& operator=(const GradientNorm&) = delete;
+
+    int get_num_slots() const { return m_num_slots; }
+
+    /** @brief Zero the sums, e.g., at the beginning of a step. */
+    void reset(backend::Stream_t stream) { m_sums.memset(0, stream); }
+
+    /** @brief Add the squares of count elements of a reduced gradient
+     *  to slot.
+     *
+     *  A sharded gradient holds only the elements of this process,
+     *  which are added on every process.
+     */
+    void accumulate(int slot,
+                    const DataType* buf,
+                    size_t count,
+                    bool sharded,
+                    backend::Stream_t stream)
+    {
+        assert_always(slot >= 0 && slot < m_num_slots);
+        if (count == 0 || (!sharded && !m_is_root))
+        {
+            return;
+        }
+        grad_norm::accumulate(
+            buf, count, get_sums(), slot, m_num_slots, stream);
+    }
+
+    /** @brief Copy reduced gradients, adding those with a slot. */
+    void scatter(const std::vector<Slice>& slices, backend::Stream_t stream)
+    {
+        if (slices.empty())
+        {
+            return;
+        }
+        // CUDA grid dimension limitation
+        assert_always(slices.size() <= 65535);
+        const size_t len = slices.size() * sizeof(Slice);
+        if (m_slices_d.get_size() < len)
+        {
+            m_slices_d.allocate(len);
+        }
+        // slices can be modified once this returns as the source is
+        // pageable memory.
+        h2::gpu::mem_copy(static_cast<Slice*>(m_slices_d.get()),
+                          slices.data(),
+                          slices.size(),
+                          stream);
+        size_t max_count = 0;
+        for (const auto& s : slices)
+        {
+            max_count = std::max(max_count, s.count);
+        }
+        grad_norm::scatter(static_cast<const Slice*>(m_slices_d.get()),
+                           (int) slices.size(),
+                           max_count,
+                           get_sums(),
+                           m_num_slots,
+                           m_is_root,
+                           stream);
+    }
+
+    /** @brief Sum the slots over the processes on the main stream.
+     *
+     *  The main stream must be ordered after the accumulations.
+     */
+    void allreduce()
+    {
+        Al::Allreduce<Al::NCCLBackend, AccType>(get_sums(),
+                                                m_num_slots + 1,
+                                                Al::ReductionOperator::sum,
+                                                m_be.get_al_nccl_comm());
+    }
+
+    /** @brief Sums of squares of the slots followed by their total, in
+     *  device memory. */
+    AccType* get_sums() { return static_cast<AccType*>(m_sums.get()); }
+
+    /** @brief Global norm after allreduce; blocks the host until the
+     *  main stream reaches it. */
+    AccType get_norm()
+    {
+        AccType total;
+        h2::gpu::mem_copy(
+            &total, get_sums() + m_num_slots, 1, m_be.get_stream());
+        h2::gpu::sync(m_be.get_stream());
+        return std::sqrt(total);
+    }
+
+private:
+    BackendDNNLib& m_be;
+    int m_num_slots;
+    bool m_is_root;
+    tensor::Memory<tensor::CUDAAllocator> m_sums;
+    tensor::Memory<tensor::CUDAAllocator> m_slices_d;
+};
+
+} // namespace distconv
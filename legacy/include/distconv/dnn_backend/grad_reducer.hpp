@@ -0,0 +1,235 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/dnn_backend/grad_norm.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/util/instrumentation.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <Al.hpp>
+#include <h2/gpu/memory_utils.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace distconv
+{
+
+/** @brief Gradient allreduces overlapped with the rest of backward
+ *  propagation.
+ *
+ *  Reductions run on the gradient stream of the backend. Starting a
+ *  reduction only orders the gradient stream after the work queued so
+ *  far on the stream producing the gradient, so the producer can go on
+ *  with, e.g., backward data of the same layer.
+ *
+ *  Gradients smaller than the bucket size are copied into a bucket
+ *  and reduced with a single collective once the bucket is full or is
+ *  waited for. All ranks must start the same reductions in the same
+ *  order.
+ *
+ *  With a GradientNorm set, reductions started with a slot add the
+ *  squares of the reduced gradient to it.
+ */
+template <typename DataType>
+class GradientReducer
+{
+public:
+    /** @brief Identifies a started reduction. */
+    class Handle
+    {
+    public:
+        Handle() = default;
+        bool is_valid() const { return m_bucket >= 0; }
+
+    private:
+        friend class GradientReducer;
+        explicit Handle(int bucket) : m_bucket(bucket) {}
+        // Bucket of the reduction; negative when reduced in place
+        int m_bucket = -1;
+    };
+
+    GradientReducer(BackendDNNLib& backend, size_t bucket_size)
+        : m_be(backend),
+          m_bucket_count(bucket_size / sizeof(DataType))
+    {}
+    GradientReducer(const GradientReducer&) = delete;
+    GradientReducer& operator=(const GradientReducer&) = delete;
+
+    ~GradientReducer()
+    {
+        for (auto& b : m_buckets)
+        {
+            if (b.buf)
+            {
+                internal::RuntimeGPU::get_device_memory_pool().release(b.buf);
+            }
+        }
+    }
+
+    /** @brief Accumulate the norms of the reduced gradients into norm,
+     *  which must outlive the reductions; null disables it.
+     */
+    void set_gradient_norm(GradientNorm<DataType>* norm) { m_norm = norm; }
+
+    /** @brief Start reducing count elements at buf once the work queued
+     *  on stream is done.
+     *
+     *  norm_slot is the slot of the gradient norm the reduced
+     *  gradient is added to, if any.
+     */
+    Handle start(DataType* buf,
+                 size_t count,
+                 backend::Stream_t stream,
+                 int norm_slot = -1)
+    {
+        if (count == 0)
+        {
+            return Handle();
+        }
+        util::wait_stream(stream, m_be.get_grad_stream());
+        if (count >= m_bucket_count)
+        {
+            allreduce(buf, count);
+            if (m_norm != nullptr && norm_slot >= 0)
+            {
+                m_norm->accumulate(
+                    norm_slot, buf, count, false, m_be.get_grad_stream());
+            }
+            return Handle();
+        }
+        if (m_cur < 0 || m_buckets[m_cur].count + count > m_bucket_count)
+        {
+            flush();
+            m_cur = get_free_bucket();
+        }
+        auto& b = m_buckets[m_cur];
+        h2::gpu::mem_copy(
+            b.buf + b.count, buf, count, m_be.get_grad_stream());
+        b.slices.push_back(Slice{buf, b.count, count, norm_slot});
+        b.count += count;
+        return Handle(m_cur);
+    }
+
+    /** @brief Reduce the bucket being filled. */
+    void flush()
+    {
+        if (m_cur < 0)
+        {
+            return;
+        }
+        auto& b = m_buckets[m_cur];
+        allreduce(b.buf, b.count);
+        m_cur = -1;
+        if (m_norm != nullptr)
+        {
+            // The norms are summed while copying back
+            std::vector<typename GradientNorm<DataType>::Slice> slices;
+            slices.reserve(b.slices.size());
+            for (const auto& s : b.slices)
+            {
+                slices.push_back({b.buf + s.offset, s.dst, s.count, s.slot});
+            }
+            m_norm->scatter(slices, m_be.get_grad_stream());
+            return;
+        }
+        std::vector<h2::gpu::MemCopyDesc> copies;
+        copies.reserve(b.slices.size());
+        for (const auto& s : b.slices)
+        {
+            copies.push_back(
+                {s.dst, b.buf + s.offset, s.count * sizeof(DataType)});
+        }
+        h2::gpu::mem_copy_batch(copies, m_be.get_grad_stream());
+    }
+
+    /** @brief Make stream wait for the reduction of h. */
+    void wait(const Handle& h, backend::Stream_t stream)
+    {
+        if (h.is_valid() && h.m_bucket == m_cur)
+        {
+            flush();
+        }
+        util::wait_stream(m_be.get_grad_stream(), stream);
+    }
+
+    /** @brief Make stream wait for all started reductions.
+     *
+     *  Handles obtained so far must not be used afterwards.
+     */
+    void wait_all(backend::Stream_t stream)
+    {
+        flush();
+        util::wait_stream(m_be.get_grad_stream(), stream);
+        for (auto& b : m_buckets)
+        {
+            b.count = 0;
+            b.slices.clear();
+        }
+        m_num_used = 0;
+    }
+
+private:
+    struct Slice
+    {
+        DataType* dst;
+        size_t offset;
+        size_t count;
+        int slot;
+    };
+    struct Bucket
+    {
+        DataType* buf = nullptr;
+        size_t count = 0;
+        std::vector<Slice> slices;
+    };
+
+    BackendDNNLib& m_be;
+    // Number of elements of each bucket
+    size_t m_bucket_count;
+    std::vector<Bucket> m_buckets;
+    // Buckets used since the last wait_all
+    int m_num_used = 0;
+    // Bucket being filled, if any
+    int m_cur = -1;
+    GradientNorm<DataType>* m_norm = nullptr;
+
+    void allreduce(DataType* buf, size_t count)
+    {
+        auto& comm = m_be.get_al_grad_comm();
+        util::instrumentation::ScopedTimer timer(
+            util::instrumentation::Phase::ALLREDUCE, comm.get_stream());
+        Al::Allreduce<Al::NCCLBackend, DataType>(
+            buf, count, Al::ReductionOperator::sum, comm);
+    }
+
+    // Buckets are not reused until wait_all since their slices may
+    // not be copied back yet.
+    int get_free_bucket()
+    {
+        if (m_num_used == (int) m_buckets.size())
+        {
+            Bucket b;
+            b.buf = static_cast<DataType*>(
+                internal::RuntimeGPU::get_device_memory_pool().get(
+                    m_bucket_count * sizeof(DataType),
+                    m_be.get_grad_stream()));
+            assert_always(b.buf != nullptr);
+            m_buckets.push_back(std::move(b));
+            util::MPIPrintStreamDebug()
+                << "Gradient reduction bucket allocated: "
+                << m_bucket_count * sizeof(DataType) << " bytes";
+        }
+        return m_num_used++;
+    }
+};
+
+} // namespace distconv
@@ -0,0 +1,106 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv_config.hpp"
+
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+
+#include "distconv/util/util_cuda.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <cuda_runtime.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace distconv
+{
+
+/** @brief Captured CUDA graphs of multi-stream operation sequences.
+ *
+ *  A sequence is captured from a main stream. Auxiliary streams are
+ *  forked from the main stream before the sequence and joined back
+ *  after it, so work they receive in between becomes part of the
+ *  graph.
+ */
+class GraphCache
+{
+public:
+    GraphCache() = default;
+    GraphCache(const GraphCache&) = delete;
+    GraphCache& operator=(const GraphCache&) = delete;
+
+    ~GraphCache() { clear(); }
+
+    bool contains(const std::string& key) const
+    {
+        return m_graphs.count(key) > 0;
+    }
+
+    /** @brief Capture the work issued by f and launch it.
+     *
+     *  f returns a status code; nothing is cached if it is non-zero.
+     */
+    template <typename Func>
+    int capture(const std::string& key,
+                cudaStream_t stream,
+                std::vector<cudaStream_t> aux_streams,
+                Func&& f)
+    {
+        DISTCONV_CHECK_CUDA(
+            cudaStreamBeginCapture(stream, cudaStreamCaptureModeThreadLocal));
+        util::wait_stream(
+            stream, aux_streams.data(), static_cast<int>(aux_streams.size()));
+        const int ret = f();
+        for (auto s : aux_streams)
+        {
+            util::wait_stream(s, stream);
+        }
+        Entry e;
+        DISTCONV_CHECK_CUDA(cudaStreamEndCapture(stream, &e.graph));
+        if (ret != 0)
+        {
+            DISTCONV_CHECK_CUDA(cudaGraphDestroy(e.graph));
+            return ret;
+        }
+        DISTCONV_CHECK_CUDA(
+            cudaGraphInstantiate(&e.exec, e.graph, nullptr, nullptr, 0));
+        m_graphs[key] = e;
+        util::MPIPrintStreamDebug() << "Captured graph for " << key;
+        launch(key, stream);
+        return 0;
+    }
+
+    void launch(const std::string& key, cudaStream_t stream)
+    {
+        DISTCONV_CHECK_CUDA(cudaGraphLaunch(m_graphs.at(key).exec, stream));
+    }
+
+    void clear()
+    {
+        for (auto& x : m_graphs)
+        {
+            DISTCONV_CHECK_CUDA(cudaGraphExecDestroy(x.second.exec));
+            DISTCONV_CHECK_CUDA(cudaGraphDestroy(x.second.graph));
+        }
+        m_graphs.clear();
+    }
+
+private:
+    struct Entry
+    {
+        cudaGraph_t graph;
+        cudaGraphExec_t exec;
+    };
+    std::unordered_map<std::string, Entry> m_graphs;
+};
+
+} // namespace distconv
+
+#endif // DISTCONV_HAS_CUDA_GRAPH
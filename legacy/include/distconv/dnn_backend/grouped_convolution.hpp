@@ -0,0 +1,160 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/tensor/tensor_base.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+#include <ostream>
+#include <type_traits>
+
+namespace distconv
+{
+namespace grouped_conv
+{
+
+/** Name of the engine in the algorithm choosers of Convolution */
+constexpr char const* algo_name = "GROUPED_DIRECT";
+
+constexpr int max_num_spatial_dims = 3;
+constexpr int max_num_dims = max_num_spatial_dims + 2;
+
+/** @brief Dimensions and strides of a convolution operand.
+ *
+ *  Both are in the channels-first order from the innermost dimension,
+ *  i.e., (W, H, D, C, N), as in the library descriptors, whatever the
+ *  layout of the tensor. Filters are (W, H, D, C / groups, K).
+ */
+struct Geometry
+{
+    int dims[max_num_dims];
+    index_t strides[max_num_dims];
+};
+
+/** @brief A grouped convolution with the semantics of the library
+ *  convolution of the same descriptors.
+ *
+ *  Input positions outside of x are treated as zero, so x can include
+ *  halo regions, which are then read directly from the overlap area
+ *  of the tensor.
+ */
+struct Problem
+{
+    int num_spatial_dims = 0;
+    int num_groups = 1;
+    Geometry x;
+    Geometry w;
+    Geometry y;
+    int pads[max_num_spatial_dims];
+    int strides[max_num_spatial_dims];
+    int dilations[max_num_spatial_dims];
+
+    void set_num_samples(int n)
+    {
+        x.dims[num_spatial_dims + 1] = n;
+        y.dims[num_spatial_dims + 1] = n;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, Problem const& p)
+{
+    auto const nd = p.num_spatial_dims + 2;
+    auto print = [&](char const* name, Geometry const& g) {
+        os << name << "=(";
+        for (int i = 0; i < nd; ++i)
+            os << (i ? "," : "") << g.dims[i] << ":" << g.strides[i];
+        os << ") ";
+    };
+    print("x", p.x);
+    print("w", p.w);
+    print("y", p.y);
+    os << "groups=" << p.num_groups << " pads/strides/dilations=";
+    for (int i = 0; i < p.num_spatial_dims; ++i)
+        os << (i ? "," : "") << p.pads[i] << "/" << p.strides[i] << "/"
+           << p.dilations[i];
+    return os;
+}
+
+/** @brief Geometry of the local tensor extended by the given halos,
+ *  the same as the library descriptor of the tensor.
+ */
+template <typename Tensor>
+Geometry make_geometry(Tensor const& t,
+                       IntVector const& halo_fwd,
+                       IntVector const& halo_bwd)
+{
+    const int nd = t.get_num_dims();
+    assert_always(nd <= max_num_dims);
+    auto const shape =
+        t.get_local_shape() + tensor::Shape(halo_fwd) + tensor::Shape(halo_bwd);
+    IndexVector const strides = tensor::get_strides(
+        t.get_local_shape(), t.get_halo_width(), t.get_pitch());
+    auto const cf_shape =
+        tensor::to_channels_first(t.get_layout(), IntVector(shape), nd);
+    auto const cf_strides =
+        tensor::to_channels_first(t.get_layout(), strides, nd);
+    Geometry g;
+    for (int i = 0; i < nd; ++i)
+    {
+        g.dims[i] = cf_shape[i];
+        g.strides[i] = cf_strides[i];
+    }
+    return g;
+}
+
+template <typename DataType>
+constexpr bool is_data_type_supported()
+{
+    return std::is_same<DataType, float>::value
+           || std::is_same<DataType, double>::value;
+}
+
+/** @brief Whether the engine can run p */
+inline bool is_supported(Problem const& p)
+{
+    const int nsd = p.num_spatial_dims;
+    if (nsd < 1 || nsd > max_num_spatial_dims || p.num_groups < 1)
+        return false;
+    const int c = p.x.dims[nsd];
+    const int k = p.y.dims[nsd];
+    return c % p.num_groups == 0 && k % p.num_groups == 0
+           && p.w.dims[nsd] == c / p.num_groups && p.w.dims[nsd + 1] == k;
+}
+
+/** @brief y = alpha * conv(x, w) + beta * y */
+template <typename DataType>
+void forward(Problem const& p,
+             DataType alpha,
+             DataType const* x,
+             DataType const* w,
+             DataType beta,
+             DataType* y,
+             h2::gpu::DeviceStream stream);
+
+/** @brief dx = alpha * conv_bwd_data(w, dy) + beta * dx
+ *
+ *  p.x and p.y are the geometries of dx and dy.
+ */
+template <typename DataType>
+void backward_data(Problem const& p,
+                   DataType alpha,
+                   DataType const* w,
+                   DataType const* dy,
+                   DataType beta,
+                   DataType* dx,
+                   h2::gpu::DeviceStream stream);
+
+/** @brief dw = alpha * conv_bwd_filter(x, dy) + beta * dw
+ *
+ *  p.w is the geometry of dw and p.y that of dy.
+ */
+template <typename DataType>
+void backward_filter(Problem const& p,
+                     DataType alpha,
+                     DataType const* x,
+                     DataType const* dy,
+                     DataType beta,
+                     DataType* dw,
+                     h2::gpu::DeviceStream stream);
+
+} // namespace grouped_conv
+} // namespace distconv
@@ -0,0 +1,249 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/allreduce.hpp"
+#include "distconv/tensor/al_collectives.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
+
+#include <Al.hpp>
+
+#include <memory>
+
+namespace distconv
+{
+namespace groupnorm
+{
+
+// The statistics of sample n and group g are at n * num_groups + g,
+// with the sums of squares following the num_stats sums
+
+// Local sums and sums of squares of the groups
+template <typename TensorType>
+void group_sums(int num_groups,
+                const TensorType& input,
+                typename TensorType::data_type* sums,
+                h2::gpu::DeviceStream stream);
+
+template <typename TensorType>
+void group_normalization(int num_groups,
+                         index_t num_per_group,
+                         const TensorType& input,
+                         const typename TensorType::data_type* sums,
+                         const TensorType& scale,
+                         const TensorType& bias,
+                         TensorType& output,
+                         typename TensorType::data_type epsilon,
+                         h2::gpu::DeviceStream stream);
+
+// Local sums of the gradients of the normalized values, and of their
+// products with the input, per group. The scale and bias gradients
+// are accumulated as well.
+template <typename TensorType>
+void backprop_group_sums(int num_groups,
+                         index_t num_per_group,
+                         const TensorType& input,
+                         const TensorType& d_output,
+                         const typename TensorType::data_type* sums,
+                         const TensorType& scale,
+                         TensorType& scale_gradient,
+                         TensorType& bias_gradient,
+                         typename TensorType::data_type* grad_sums,
+                         typename TensorType::data_type epsilon,
+                         h2::gpu::DeviceStream stream);
+
+template <typename TensorType>
+void backprop_group_normalization(
+    int num_groups,
+    index_t num_per_group,
+    const TensorType& input,
+    const TensorType& d_output,
+    const typename TensorType::data_type* sums,
+    const TensorType& scale,
+    const typename TensorType::data_type* grad_sums,
+    TensorType& d_input,
+    typename TensorType::data_type epsilon,
+    h2::gpu::DeviceStream stream);
+
+} // namespace groupnorm
+
+/** @brief Group normalization of spatially distributed samples.
+ *
+ *  The channels of each sample are normalized in num_groups groups,
+ *  with a scale and a bias per channel. Instance normalization is the
+ *  case of one channel per group. Unlike batch normalization, the
+ *  statistics do not depend on the other samples, so they are reduced
+ *  only among the processes sharing a sample, with a single allreduce
+ *  of the sums of all the local samples and groups. The backward pass
+ *  does the same with the gradient sums. The scale and bias gradients
+ *  are reduced over the communicator of the backend unless skipped,
+ *  e.g., to be reduced together with the other weights.
+ *
+ *  The channel dimension must not be partitioned. Only the outermost
+ *  spatial dimension may have halos, which are not read or written.
+ */
+template <typename DataType>
+class GroupNormalization<BackendDNNLib, DataType>
+{
+public:
+    GroupNormalization(BackendDNNLib& backend,
+                       int num_dims,
+                       int num_groups,
+                       DataType epsilon)
+        : m_be(backend),
+          m_num_dims(num_dims),
+          m_num_groups(num_groups),
+          m_epsilon(epsilon)
+    {
+        assert_always(m_num_groups > 0);
+        m_allreducer = util::make_unique<tensor::AllreduceAlNCCL<DataType>>(
+            m_be.get_al_nccl_comm());
+    }
+
+    GroupNormalization(const GroupNormalization&) = delete;
+    GroupNormalization& operator=(const GroupNormalization&) = delete;
+
+    template <typename Tensor>
+    void setup(const Tensor& input)
+    {
+        assert_eq(input.get_num_dims(), m_num_dims);
+        assert_always(input.get_layout() == tensor::Layout::CHANNELS_FIRST);
+        assert_eq(input.get_shape()[-2] % m_num_groups, 0);
+        const auto& loc_shape = input.get_locale_shape();
+        assert_eq(loc_shape[-2], 1);
+        m_num_procs_per_sample = loc_shape.get_size() / loc_shape[-1];
+        if (m_num_procs_per_sample > 1)
+        {
+            auto sample_loc = input.get_sub_locale_except_dim(-1);
+            m_sample_al = tensor::get_al_collectives(
+                sample_loc.get_comm(), m_be.get_stream());
+        }
+        const auto& shape = input.get_shape();
+        m_num_per_group = shape.get_size() / shape[-1] / m_num_groups;
+    }
+
+    /** @brief Normalize the input, keeping the statistics for backward. */
+    template <typename Tensor>
+    int forward(const Tensor& input,
+                const Tensor& scale,
+                const Tensor& bias,
+                Tensor& output)
+    {
+        DISTCONV_RANGE("groupnorm/forward", Compute);
+        util::MPIPrintStreamDebug()
+            << "GroupNormalization: " << input << ", " << output;
+        const int num_stats = get_num_stats(input);
+        if (num_stats == 0)
+            return 0;
+        if (m_stats.get_size() < num_stats * 2 * sizeof(DataType))
+        {
+            m_stats.allocate(num_stats * 2 * sizeof(DataType));
+        }
+        auto sums = static_cast<DataType*>(m_stats.get());
+        groupnorm::group_sums<Tensor>(
+            m_num_groups, input, sums, m_be.get_stream());
+        allreduce_sample(sums, num_stats * 2);
+        groupnorm::group_normalization<Tensor>(m_num_groups,
+                                               m_num_per_group,
+                                               input,
+                                               sums,
+                                               scale,
+                                               bias,
+                                               output,
+                                               m_epsilon,
+                                               m_be.get_stream());
+        return 0;
+    }
+
+    /** @brief Backward pass with the statistics of the last forward. */
+    template <typename Tensor>
+    int backward(const Tensor& input,
+                 const Tensor& d_output,
+                 const Tensor& scale,
+                 Tensor& scale_gradient,
+                 Tensor& bias_gradient,
+                 Tensor& d_input,
+                 bool skip_weights = false)
+    {
+        DISTCONV_RANGE("groupnorm/backward", Compute);
+        util::MPIPrintStreamDebug() << "GroupNormalization BP";
+        const int num_stats = get_num_stats(input);
+        auto stream = m_be.get_stream();
+        auto& pool = internal::RuntimeGPU::get_device_memory_pool();
+        DataType* grad_sums =
+            num_stats > 0 ? static_cast<DataType*>(pool.get(
+                num_stats * 2 * sizeof(DataType), stream))
+                          : nullptr;
+        auto sums = static_cast<const DataType*>(m_stats.get());
+        groupnorm::backprop_group_sums<Tensor>(m_num_groups,
+                                               m_num_per_group,
+                                               input,
+                                               d_output,
+                                               sums,
+                                               scale,
+                                               scale_gradient,
+                                               bias_gradient,
+                                               grad_sums,
+                                               m_epsilon,
+                                               stream);
+        if (num_stats > 0)
+        {
+            allreduce_sample(grad_sums, num_stats * 2);
+            groupnorm::backprop_group_normalization<Tensor>(m_num_groups,
+                                                            m_num_per_group,
+                                                            input,
+                                                            d_output,
+                                                            sums,
+                                                            scale,
+                                                            grad_sums,
+                                                            d_input,
+                                                            m_epsilon,
+                                                            stream);
+            pool.release(grad_sums);
+        }
+        if (!skip_weights)
+        {
+            DISTCONV_RANGE("groupnorm/backward_allreduce", Collective);
+            m_allreducer->allreduce(scale_gradient.get_buffer(),
+                                    scale_gradient.get_local_pitched_size());
+            m_allreducer->allreduce(bias_gradient.get_buffer(),
+                                    bias_gradient.get_local_pitched_size());
+        }
+        return 0;
+    }
+
+protected:
+    BackendDNNLib& m_be;
+    int m_num_dims;
+    int m_num_groups;
+    DataType m_epsilon;
+    // Elements of a group in a sample, over all the processes
+    index_t m_num_per_group = 0;
+    int m_num_procs_per_sample = 1;
+    std::shared_ptr<tensor::AlCollectives> m_sample_al;
+    std::unique_ptr<tensor::Allreduce<DataType>> m_allreducer;
+    // Sums and sums of squares of the last forward pass
+    tensor::Memory<tensor::CUDAAllocator> m_stats;
+
+    template <typename Tensor>
+    int get_num_stats(const Tensor& input) const
+    {
+        return input.get_local_shape()[-1] * m_num_groups;
+    }
+
+    void allreduce_sample(DataType* values, int count)
+    {
+        if (m_num_procs_per_sample < 2)
+            return;
+        DISTCONV_RANGE("groupnorm/allreduce", Collective);
+        m_sample_al->allreduce(values, count, Al::ReductionOperator::sum);
+    }
+};
+
+} // namespace distconv
@@ -0,0 +1,345 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/tensor/halo_exchange_cuda.hpp"
+#include "distconv/tensor/halo_exchange_cuda_al.hpp"
+#include "distconv/tensor/halo_exchange_cuda_auto.hpp"
+#include "distconv/tensor/halo_exchange_cuda_mpi.hpp"
+#ifdef DISTCONV_HAS_P2P
+#include "distconv/tensor/halo_exchange_cuda_hybrid.hpp"
+#include "distconv/tensor/halo_exchange_cuda_p2p.hpp"
+#endif // DISTCONV_HAS_P2P
+#ifdef DISTCONV_HAS_NVSHMEM
+#include "distconv/tensor/halo_exchange_cuda_nvshmem.hpp"
+#endif // DISTCONV_HAS_NVSHMEM
+#include "distconv/util/util_mpi.hpp"
+
+#include <Al.hpp>
+
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace distconv
+{
+
+/** @brief Selection of the halo exchange method of each dimension.
+ *
+ *  Each candidate method exchanges the halo of a split dimension a
+ *  few times, and the one with the smallest time, taking the maximum
+ *  over the ranks, is used for that dimension. Selections are stored
+ *  in the algorithm cache of the backend, keyed by the dimension, the
+ *  halo width and size, and whether all peers are on the same node.
+ *  Collective over the processes of the tensor.
+ */
+template <typename DataType>
+class HaloExchangeTuner
+{
+public:
+    using HaloExchange = tensor::
+        HaloExchange<DataType, tensor::CUDAAllocator, Al::NCCLBackend>;
+    using HaloExchangeAuto =
+        tensor::HaloExchangeAuto<DataType, Al::NCCLBackend>;
+    using TensorType =
+        tensor::Tensor<DataType, tensor::LocaleMPI, tensor::CUDAAllocator>;
+    using CommType = typename HaloExchange::CommType;
+
+    explicit HaloExchangeTuner(BackendDNNLib& backend) : m_be(backend) {}
+
+    std::unique_ptr<HaloExchange> tune(TensorType& tensor)
+    {
+        std::unique_ptr<HaloExchangeAuto> xch(new HaloExchangeAuto(tensor));
+        MPI_Comm comm = tensor.get_locale().get_comm();
+        const int num_dims = tensor.get_num_dims();
+        std::vector<std::string> keys(num_dims);
+        std::vector<int> methods(num_dims, -1);
+        bool tuning_required = false;
+        for (int dim = 0; dim < num_dims; ++dim)
+        {
+            if (!is_exchange_required(tensor, dim))
+            {
+                continue;
+            }
+            keys[dim] = get_key(*xch, tensor, dim);
+            methods[dim] = lookup(keys[dim], comm);
+            tuning_required |= methods[dim] < 0;
+        }
+
+        // Implementations are constructed in the same order on all
+        // ranks as NVSHMEM allocates its buffers collectively.
+        std::map<HaloExchangeMethod, std::shared_ptr<HaloExchange>> impls;
+        if (tuning_required)
+        {
+            for (auto m : get_candidates())
+            {
+                impls[m] = make(m, tensor);
+            }
+            auto comms = get_comms(tensor);
+            for (int dim = 0; dim < num_dims; ++dim)
+            {
+                if (keys[dim].empty() || methods[dim] >= 0)
+                {
+                    continue;
+                }
+                HaloExchangeMethod best = HaloExchangeMethod::AL;
+                double best_time = std::numeric_limits<double>::max();
+                for (auto& x : impls)
+                {
+                    const double t = time_exchange(
+                        *x.second, dim, comms(dim, RHS), comms(dim, LHS), comm);
+                    util::MPIRootPrintStreamDebug()
+                        << "Halo exchange with " << x.first << ": " << t
+                        << " s for " << keys[dim];
+                    if (t < best_time)
+                    {
+                        best = x.first;
+                        best_time = t;
+                    }
+                }
+                methods[dim] = static_cast<int>(best);
+                m_be.get_algo_cache().insert(keys[dim], methods[dim], 0);
+            }
+        }
+
+        for (int dim = 0; dim < num_dims; ++dim)
+        {
+            if (methods[dim] < 0)
+            {
+                continue;
+            }
+            const auto m = static_cast<HaloExchangeMethod>(methods[dim]);
+            if (impls.count(m) == 0)
+            {
+                impls[m] = make(m, tensor);
+            }
+            xch->set_impl(dim, impls[m]);
+            util::MPIRootPrintStreamDebug()
+                << "Using " << m << " in halo exchange of dimension " << dim;
+        }
+        return xch;
+    }
+
+    static std::vector<HaloExchangeMethod> get_candidates()
+    {
+        return {
+            HaloExchangeMethod::MPI,
+            HaloExchangeMethod::AL,
+#ifdef DISTCONV_HAS_P2P
+            HaloExchangeMethod::P2P,
+            HaloExchangeMethod::HYBRID,
+            HaloExchangeMethod::P2P_FUSED_NOTIFY,
+#endif // DISTCONV_HAS_P2P
+#ifdef DISTCONV_HAS_NVSHMEM
+            // Graph variants replay whole multi-dimensional exchanges,
+            // so they are the same as their methods per dimension
+            HaloExchangeMethod::NVSHMEM,
+            HaloExchangeMethod::NVSHMEM_DIRECT,
+            HaloExchangeMethod::NVSHMEM_FUSED_NOTIFY,
+#endif // DISTCONV_HAS_NVSHMEM
+        };
+    }
+
+    /** @brief Implementation of method m for tensor */
+    std::shared_ptr<HaloExchange> make(HaloExchangeMethod m,
+                                       TensorType& tensor)
+    {
+        switch (m)
+        {
+        case HaloExchangeMethod::MPI:
+            return std::make_shared<
+                tensor::HaloExchangeMPI<DataType,
+                                        tensor::CUDAAllocator,
+                                        Al::NCCLBackend>>(tensor);
+        case HaloExchangeMethod::AL:
+            return std::make_shared<
+                tensor::HaloExchangeAL<DataType,
+                                       tensor::CUDAAllocator,
+                                       Al::NCCLBackend>>(tensor);
+#ifdef DISTCONV_HAS_P2P
+        case HaloExchangeMethod::P2P:
+            return std::make_shared<
+                tensor::HaloExchangeP2P<DataType,
+                                        tensor::CUDAAllocator,
+                                        Al::NCCLBackend>>(tensor,
+                                                          m_be.get_p2p());
+        case HaloExchangeMethod::HYBRID:
+            return std::make_shared<
+                tensor::HaloExchangeHybrid<DataType,
+                                           tensor::CUDAAllocator,
+                                           Al::NCCLBackend>>(tensor,
+                                                             m_be.get_p2p());
+        case HaloExchangeMethod::P2P_FUSED_NOTIFY:
+            return std::make_shared<tensor::HaloExchangeP2PFusedNotify<
+                DataType,
+                tensor::CUDAAllocator,
+                Al::NCCLBackend>>(tensor, m_be.get_p2p());
+#endif // DISTCONV_HAS_P2P
+#ifdef DISTCONV_HAS_NVSHMEM
+        case HaloExchangeMethod::NVSHMEM:
+            return std::make_shared<
+                tensor::HaloExchangeNVSHMEM<DataType,
+                                            tensor::CUDAAllocator,
+                                            Al::NCCLBackend>>(tensor);
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        case HaloExchangeMethod::NVSHMEM_GRAPH:
+            return std::make_shared<
+                tensor::HaloExchangeNVSHMEMGraph<DataType,
+                                                 tensor::CUDAAllocator,
+                                                 Al::NCCLBackend>>(tensor);
+#endif // DISTCONV_HAS_CUDA_GRAPH
+        case HaloExchangeMethod::NVSHMEM_DIRECT:
+            return std::make_shared<
+                tensor::HaloExchangeNVSHMEMDirect<DataType,
+                                                  tensor::CUDAAllocator,
+                                                  Al::NCCLBackend>>(tensor);
+        case HaloExchangeMethod::NVSHMEM_FUSED_NOTIFY:
+            return std::make_shared<
+                tensor::HaloExchangeNVSHMEMFusedNotify<DataType,
+                                                       tensor::CUDAAllocator,
+                                                       Al::NCCLBackend>>(
+                tensor);
+#endif // DISTCONV_HAS_NVSHMEM
+        default:
+            util::MPIPrintStreamError()
+                << "Invalid halo exchange method: " << m;
+            std::abort();
+        }
+    }
+
+    // Same communicators as the boundary communicators of the layers
+    BoundaryAttributesV<CommType> get_comms(const TensorType& tensor)
+    {
+        BoundaryAttributesV<CommType> comms;
+        for (int dim = 0; dim < tensor.get_num_dims(); ++dim)
+        {
+            if (!is_exchange_required(tensor, dim))
+            {
+                continue;
+            }
+            for (Side side : SIDES)
+            {
+                comms(dim, side) = m_be.get_internal_al_mpi_cuda_comm(
+                    dim * 2 + (side == LHS ? 0 : 1));
+            }
+            if (tensor.get_split_index()[dim] % 2)
+            {
+                std::swap(comms(dim, LHS), comms(dim, RHS));
+            }
+        }
+        return comms;
+    }
+
+    /** @brief Records m as the method of dim of tensor in the
+     *  algorithm cache, e.g., as measured by a benchmark, so that
+     *  tune selects it without timing. Collective over the processes
+     *  of tensor.
+     */
+    void set_selection(TensorType& tensor, int dim, HaloExchangeMethod m)
+    {
+        HaloExchangeAuto xch(tensor);
+        m_be.get_algo_cache().insert(
+            get_key(xch, tensor, dim), static_cast<int>(m), 0);
+    }
+
+private:
+    BackendDNNLib& m_be;
+    static constexpr int m_num_warmup = 2;
+    static constexpr int m_num_trials = 10;
+
+    static bool is_exchange_required(const TensorType& tensor, int dim)
+    {
+        const auto& dist = tensor.get_distribution();
+        return (dist.is_distributed(dim) || dist.is_periodic(dim))
+               && tensor.get_halo_width(dim) > 0;
+    }
+
+    // The key must be the same on all ranks.
+    static std::string
+    get_key(HaloExchangeAuto& xch, const TensorType& tensor, int dim)
+    {
+        MPI_Comm comm = tensor.get_locale().get_comm();
+        const int width = tensor.get_halo_width(dim);
+        auto shape = tensor.get_local_real_shape();
+        shape[dim] = width;
+        size_t count = shape.get_size();
+        DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE,
+                                         &count,
+                                         1,
+                                         util::get_mpi_data_type<size_t>(),
+                                         MPI_MAX,
+                                         comm));
+        int intra_node = xch.is_intra_node(dim);
+        DISTCONV_CHECK_MPI(MPI_Allreduce(
+            MPI_IN_PLACE, &intra_node, 1, MPI_INT, MPI_LAND, comm));
+        std::stringstream ss;
+        ss << "halo_xch dim=" << dim << " split="
+           << tensor.get_distribution().get_split_shape()[dim]
+           << " width=" << width << " count=" << count
+           << " type_size=" << sizeof(DataType)
+           << " intra_node=" << intra_node;
+        return ss.str();
+    }
+
+    // Returns a cached method only when all ranks have the same one.
+    int lookup(const std::string& key, MPI_Comm comm)
+    {
+        int method = -1;
+        if (!m_be.get_algo_cache().lookup(key, 0, method)
+            || !is_candidate(method))
+        {
+            method = -1;
+        }
+        int range[2] = {method, -method};
+        DISTCONV_CHECK_MPI(
+            MPI_Allreduce(MPI_IN_PLACE, range, 2, MPI_INT, MPI_MAX, comm));
+        return range[0] == -range[1] ? method : -1;
+    }
+
+    static bool is_candidate(int method)
+    {
+        for (auto m : get_candidates())
+        {
+            if (static_cast<int>(m) == method)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static double time_exchange(HaloExchange& xch,
+                                int dim,
+                                CommType& comm_rhs,
+                                CommType& comm_lhs,
+                                MPI_Comm comm)
+    {
+        for (int i = 0; i < m_num_warmup; ++i)
+        {
+            xch.exchange(dim, comm_rhs, comm_lhs, false, false, false);
+        }
+        h2::gpu::sync();
+        DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+        const double start = MPI_Wtime();
+        for (int i = 0; i < m_num_trials; ++i)
+        {
+            xch.exchange(dim, comm_rhs, comm_lhs, false, false, false);
+        }
+        h2::gpu::sync();
+        double t = (MPI_Wtime() - start) / m_num_trials;
+        DISTCONV_CHECK_MPI(
+            MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, comm));
+        return t;
+    }
+};
+
+} // namespace distconv
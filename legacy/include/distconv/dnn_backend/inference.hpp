@@ -0,0 +1,179 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/dnn_backend/graph_cache.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <cmath>
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace distconv
+{
+
+/** @brief Fold a batch normalization into the preceding convolution.
+ *
+ *  With the running statistics of inference, the normalization is an
+ *  affine map per output channel, so it is applied once to the filter
+ *  and the bias of the convolution at load time:
+ *
+ *    filter[k] *= scale[k] / sqrt(var[k] + epsilon)
+ *    bias[k] = (bias[k] - mean[k]) * scale[k] / sqrt(var[k] + epsilon)
+ *              + shift[k]
+ *
+ *  The bias must be allocated, zero-cleared if the convolution had
+ *  none. The parameters of the normalization must not be partitioned.
+ *  The tensors are updated through host copies, which blocks the host.
+ */
+template <typename DataType, typename Allocator>
+void fold_batchnorm(tensor::Tensor<DataType, LocaleMPI, Allocator>& filter,
+                    tensor::Tensor<DataType, LocaleMPI, Allocator>& bias,
+                    const tensor::Tensor<DataType, LocaleMPI, Allocator>& scale,
+                    const tensor::Tensor<DataType, LocaleMPI, Allocator>& shift,
+                    const tensor::Tensor<DataType, LocaleMPI, Allocator>& mean,
+                    const tensor::Tensor<DataType, LocaleMPI, Allocator>& var,
+                    DataType epsilon)
+{
+    // Output channels are the outermost dimension of filters
+    assert_always(filter.get_layout() == tensor::Layout::CHANNELS_FIRST);
+    int const num_channels = filter.get_shape()[-1];
+    auto copyout = [num_channels](const auto& t) {
+        assert_eq((int) t.get_local_size(), num_channels);
+        std::vector<DataType> v(num_channels);
+        t.get_data().copyout(v.data());
+        return v;
+    };
+    auto const s = copyout(scale);
+    auto const b = copyout(shift);
+    auto const m = copyout(mean);
+    auto const v = copyout(var);
+    auto b_conv = copyout(bias);
+    for (int k = 0; k < num_channels; ++k)
+    {
+        DataType const factor = s[k] / std::sqrt(v[k] + epsilon);
+        b_conv[k] = (b_conv[k] - m[k]) * factor + b[k];
+    }
+    bias.get_data().copyin(b_conv.data());
+
+    if (filter.get_local_size() == 0)
+        return;
+    index_t const num_local_channels = filter.get_local_shape()[-1];
+    index_t const channel_size =
+        filter.get_local_size() / num_local_channels;
+    std::vector<DataType> f(filter.get_local_size());
+    filter.get_data().copyout(f.data());
+    for (index_t k = 0; k < num_local_channels; ++k)
+    {
+        auto const gk = filter.get_global_index(filter.get_num_dims() - 1, k);
+        DataType const factor = s[gk] / std::sqrt(v[gk] + epsilon);
+        for (index_t i = 0; i < channel_size; ++i)
+        {
+            f[k * channel_size + i] *= factor;
+        }
+    }
+    filter.get_data().copyin(f.data());
+}
+
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+
+/** @brief Forward pass of a whole network replayed as one graph.
+ *
+ *  Meant for serving fixed shapes with the layers set up for inference
+ *  (see Convolution::setup_inference). The forward function issues the
+ *  passes of all layers to the default stream of the backend and
+ *  returns a status code. The first run of each local mini-batch size
+ *  is eager, since it may select algorithms and allocate buffers,
+ *  which cannot be captured; planning the sizes at setup moves that
+ *  work out of the first request. The second run is captured, and
+ *  later ones replay the graph. Graphs are dropped when the workspace
+ *  arena of the backend reallocates, since they hold its buffers.
+ *
+ *  The layers must not capture graphs of their own, and their halo
+ *  exchanges must be issued to streams without host synchronization,
+ *  e.g., with Aluminum or NVSHMEM. The tensors must stay in place.
+ */
+class InferenceGraph
+{
+public:
+    using Func = std::function<int(int)>;
+
+    InferenceGraph(BackendDNNLib& backend, Func forward)
+        : m_be(backend), m_forward(std::move(forward))
+    {
+        assert_always(!m_be.get_options().m_enable_graph_capture);
+    }
+
+    InferenceGraph(const InferenceGraph&) = delete;
+    InferenceGraph& operator=(const InferenceGraph&) = delete;
+
+    /** @brief Run the forward pass of num_samples samples per process.
+     *
+     *  Additional streams the layers fork work to must be joined back
+     *  to the default stream, as the layers of Distconv do.
+     */
+    int run(int num_samples)
+    {
+        auto const key = std::to_string(num_samples);
+        sync_with_workspace();
+        if (m_graphs.contains(key))
+        {
+            m_graphs.launch(key, m_be.get_stream());
+            return 0;
+        }
+        int ret;
+        if (m_warm.count(num_samples) == 0)
+        {
+            ret = m_forward(num_samples);
+            if (ret == 0)
+                m_warm.insert(num_samples);
+        }
+        else
+        {
+            ret = m_graphs.capture(key, m_be.get_stream(), {}, [&]() {
+                return m_forward(num_samples);
+            });
+        }
+        sync_with_workspace();
+        return ret;
+    }
+
+    /** @brief Drop the graphs, e.g., after the tensors are moved. */
+    void clear()
+    {
+        m_graphs.clear();
+        m_warm.clear();
+    }
+
+private:
+    void sync_with_workspace()
+    {
+        size_t const generation = m_be.get_workspace_arena().get_generation();
+        if (generation != m_ws_generation)
+        {
+            m_graphs.clear();
+            m_ws_generation = generation;
+        }
+    }
+
+    BackendDNNLib& m_be;
+    Func m_forward;
+    GraphCache m_graphs;
+    // Generation of the workspace arena the graphs were captured with
+    size_t m_ws_generation = 0;
+    // Sizes that have run once without capturing
+    std::unordered_set<int> m_warm;
+};
+
+#endif // DISTCONV_HAS_CUDA_GRAPH
+
+} // namespace distconv
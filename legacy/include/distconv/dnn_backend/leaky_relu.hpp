@@ -3,6 +3,8 @@
 #include "distconv/dnn_backend/backend.hpp"
 #include "distconv/runtime_gpu.hpp"
 
+#include <cstdint>
+
 namespace distconv
 {
 namespace leaky_relu
@@ -21,6 +23,76 @@ void backward(Tensor& input,
               Tensor& output,
               h2::gpu::DeviceStream stream);
 
+// Number of 32-bit words of the sign mask of t, which has a bit for
+// each element of the local buffer of t including halos
+template <typename Tensor>
+size_t get_mask_size(const Tensor& t)
+{
+    return util::ceil(t.get_local_real_size(), (size_t) 32);
+}
+
+// Same as forward, but also saves the signs of input to mask. output
+// may be input.
+template <typename Tensor>
+void forward_masked(const Tensor& input,
+                    typename Tensor::data_type negative_slope,
+                    Tensor& output,
+                    uint32_t* mask,
+                    h2::gpu::DeviceStream stream);
+
+// Same as backward, but with the signs of the input from mask
+template <typename Tensor>
+void backward_masked(const uint32_t* mask,
+                     const Tensor& d_output,
+                     typename Tensor::data_type negative_slope,
+                     Tensor& d_input,
+                     h2::gpu::DeviceStream stream);
+
+/** @brief Device memory for the sign mask of an activation. */
+class SignMask
+{
+public:
+    SignMask() = default;
+    SignMask(const SignMask&) = delete;
+    SignMask& operator=(const SignMask&) = delete;
+
+    ~SignMask()
+    {
+        if (m_mask)
+        {
+            internal::RuntimeGPU::get_device_memory_pool().release(m_mask);
+        }
+    }
+
+    uint32_t* get(size_t num_words, h2::gpu::DeviceStream stream)
+    {
+        if (m_num_words < num_words)
+        {
+            auto& mempool = internal::RuntimeGPU::get_device_memory_pool();
+            if (m_mask)
+            {
+                mempool.release(m_mask);
+            }
+            m_mask = static_cast<uint32_t*>(
+                mempool.get(num_words * sizeof(uint32_t), stream));
+            m_num_words = num_words;
+        }
+        m_valid = true;
+        return m_mask;
+    }
+
+    const uint32_t* get() const
+    {
+        assert_always(m_valid);
+        return m_mask;
+    }
+
+private:
+    uint32_t* m_mask = nullptr;
+    size_t m_num_words = 0;
+    bool m_valid = false;
+};
+
 } // namespace leaky_relu
 
 template <>
@@ -31,12 +103,18 @@ public:
 
     ~LeakyReLU() = default;
 
-    LeakyReLU operator=(const LeakyReLU& x)
+    LeakyReLU& operator=(const LeakyReLU& x)
     {
         assert_always(&m_be == &x.m_be);
+        m_save_mask = x.m_save_mask;
         return *this;
     }
 
+    /** @brief Save a 1-bit sign mask of the input in the forward pass,
+     *  so that the backward pass does not need the input.
+     */
+    void set_save_mask(bool save_mask) { m_save_mask = save_mask; }
+
     // input should be const, but transform::Transform, which is used
     // in the implementation, is not polymorphic with respect to
     // constness of tensor parameters. All of tensors need to
@@ -52,10 +130,28 @@ public:
         {
             return 0;
         }
+        if (m_save_mask)
+        {
+            auto stream = m_be.get_stream();
+            leaky_relu::forward_masked(
+                input,
+                negative_slope,
+                output,
+                m_mask.get(leaky_relu::get_mask_size(input), stream),
+                stream);
+            return 0;
+        }
         leaky_relu::forward(input, negative_slope, output, m_be.get_stream());
         return 0;
     }
 
+    /** @brief Overwrite x with its activation. */
+    template <typename Tensor>
+    int forward(Tensor& x, typename Tensor::data_type negative_slope)
+    {
+        return forward(x, negative_slope, x);
+    }
+
     template <typename Tensor>
     int backward(Tensor& input,
                  Tensor& d_output,
@@ -73,8 +169,33 @@ public:
         return 0;
     }
 
+    /** @brief Backward pass with the sign mask saved by the forward
+     *  pass.
+     */
+    template <typename Tensor>
+    int backward(const Tensor& d_output,
+                 typename Tensor::data_type negative_slope,
+                 Tensor& d_input)
+    {
+        util::MPIPrintStreamDebug()
+            << "Leaky Relu BP: " << d_output << ", " << d_input;
+        assert_always(m_save_mask);
+        if (d_input.get_local_size() == 0)
+        {
+            return 0;
+        }
+        leaky_relu::backward_masked(m_mask.get(),
+                                    d_output,
+                                    negative_slope,
+                                    d_input,
+                                    m_be.get_stream());
+        return 0;
+    }
+
 protected:
     BackendDNNLib& m_be;
+    bool m_save_mask = false;
+    leaky_relu::SignMask m_mask;
 };
 
 } // namespace distconv
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/util/launch_config.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+#if H2_HAS_CUDA
+#include <cub/block/block_reduce.cuh>
+#include <cub/warp/warp_reduce.cuh>
+#elif H2_HAS_ROCM
+#include <hipcub/block/block_reduce.hpp>
+#include <hipcub/warp/warp_reduce.hpp>
+#endif
+
+namespace distconv {
+namespace loss_reduce {
+
+#if H2_HAS_CUDA
+namespace cubns = cub;
+#elif H2_HAS_ROCM
+namespace cubns = hipcub;
+#endif
+
+using util::warp_size;
+constexpr int block_size = util::reduce_block_size;
+constexpr int thread_work_size = 8;
+// Samples up to this size are reduced by a single warp each
+constexpr index_t max_warp_sample_size = warp_size * 32;
+
+/*
+  - Each warp takes care of one sample
+  - y[sample] = scale * sum of element_loss(sample, offset)
+ */
+template <typename DataType, int BLOCK_SIZE, typename ElementLoss>
+__global__ void reduce_per_sample_warp(const int num_samples,
+                                       const index_t sample_size,
+                                       ElementLoss element_loss,
+                                       const DataType scale,
+                                       DataType * __restrict__ y) {
+  constexpr int warps_per_block = BLOCK_SIZE / warp_size;
+  const int warp = threadIdx.x / warp_size;
+  const int lane = threadIdx.x % warp_size;
+  const int sample_idx = blockIdx.x * warps_per_block + warp;
+
+  using WarpReduce = cubns::WarpReduce<DataType, warp_size>;
+  __shared__ typename WarpReduce::TempStorage temp_storage[warps_per_block];
+
+  // Whole warps return together
+  if (sample_idx >= num_samples) return;
+
+  auto psum = DataType(0.);
+  for (index_t offset = lane; offset < sample_size; offset += warp_size) {
+    psum += element_loss(sample_idx, offset);
+  }
+  psum = WarpReduce(temp_storage[warp]).Sum(psum);
+
+  if (lane == 0) {
+    y[sample_idx] = psum * scale;
+  }
+}
+
+/*
+  - gridDim.y == number of samples
+  - Each sample is taken care by gridDim.x blocks, which accumulate
+    into y with atomics unless there is only one
+ */
+template <typename DataType, int BLOCK_SIZE, typename ElementLoss>
+__global__ void reduce_per_sample_blocks(const index_t sample_size,
+                                         ElementLoss element_loss,
+                                         const DataType scale,
+                                         const int thread_work_size,
+                                         DataType * __restrict__ y) {
+  const int tid = threadIdx.x;
+  const int sample_idx = blockIdx.y;
+
+  index_t offset = tid + blockIdx.x * BLOCK_SIZE;
+  const int offset_stride = BLOCK_SIZE * gridDim.x;
+  const index_t offset_limit = min(
+      sample_size, offset + offset_stride * thread_work_size);
+
+  auto psum = DataType(0.);
+  for (; offset < offset_limit; offset += offset_stride) {
+    psum += element_loss(sample_idx, offset);
+  }
+
+  using BlockReduce = cubns::BlockReduce<DataType, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  psum = BlockReduce(temp_storage).Sum(psum) * scale;
+
+  if (tid == 0) {
+    if (gridDim.x == 1) {
+      y[sample_idx] = psum;
+    } else {
+      atomic_add(&y[sample_idx], psum);
+    }
+  }
+}
+
+/** @brief Set y[sample] to scale times the sum of
+ *  element_loss(sample, offset) over the local elements of each sample.
+ *
+ *  Small samples are reduced by a warp each with shuffles; larger ones
+ *  by blocks, which only need atomics and a zeroed y if a sample spans
+ *  several blocks.
+ */
+template <typename DataType, typename ElementLoss>
+void reduce_per_sample(int num_samples,
+                       index_t sample_size,
+                       ElementLoss element_loss,
+                       DataType scale,
+                       DataType* y,
+                       h2::gpu::DeviceStream stream)
+{
+    if (num_samples == 0)
+    {
+        return;
+    }
+
+    if (sample_size <= max_warp_sample_size)
+    {
+        constexpr int warps_per_block = block_size / warp_size;
+        reduce_per_sample_warp<DataType, block_size>
+            <<<util::ceil(num_samples, warps_per_block), block_size, 0, stream>>>(
+                num_samples, sample_size, element_loss, scale, y);
+        return;
+    }
+
+    auto num_blocks_per_sample =
+        util::ceil(sample_size, (index_t) block_size * thread_work_size);
+    if (num_blocks_per_sample > 1)
+    {
+        h2::gpu::mem_zero(y, num_samples, stream);
+    }
+    dim3 gdim(num_blocks_per_sample, num_samples);
+    reduce_per_sample_blocks<DataType, block_size>
+        <<<gdim, block_size, 0, stream>>>(
+            sample_size, element_loss, scale, thread_work_size, y);
+}
+
+} // namespace loss_reduce
+} // namespace distconv
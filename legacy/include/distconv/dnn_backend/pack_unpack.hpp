@@ -32,21 +32,54 @@ using DataType_t = miopenDataType_t;
 #define H2_DNN_BACKEND_NS miopen
 #endif
 
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
 namespace distconv
 {
 namespace H2_DNN_BACKEND_NS
 {
 
+using SharedTensorDescriptor =
+    std::shared_ptr<std::remove_pointer_t<TensorDescriptor_t>>;
+
+/** @brief Get the tensor descriptor of the data type, dimensions and
+ *         strides, given in the order of the backend API.
+ *
+ *  The descriptor is created on the first request of its key and
+ *  shared by all the following ones, so it must not be modified. The
+ *  cache holds it until clear_shared_tensor_descriptors.
+ */
+SharedTensorDescriptor
+get_shared_tensor_descriptor(DataType_t dt,
+                             std::vector<int> const& dims,
+                             std::vector<int> const& strides);
+
+/** @brief Drop the cached descriptors; those in use are destroyed
+ *         once released. */
+void clear_shared_tensor_descriptors();
+
 // This models a strided INPUT to a cuDNN operation. This object is
 // simple: on construction, we allocate a buffer and copy the strided
 // tensor into it. At destruction, we simply free the buffer (stack
 // unwinding is irrelevant).
+//
+// With H2_DISTCONV_PACKED_CACHE_SIZE set, the packed copy is kept as a
+// "shadow" of the tensor and reused by the following proxies of the
+// same tensor on the same stream, until it is invalidated (see
+// invalidate_packed_shadows).
 class PackedTensorReadProxy
 {
     TensorDescriptor_t m_unpacked_desc = 0;
     TensorDescriptor_t m_packed_desc = 0;
+    // Holds m_packed_desc if it differs from m_unpacked_desc.
+    SharedTensorDescriptor m_packed_desc_ref;
     void const* m_unpacked_data = nullptr;
     void* m_packed_data = nullptr;
+    // Holds m_packed_data if it is a cached shadow.
+    std::shared_ptr<void> m_shadow;
 
 public:
     /** @brief Construct a "descriptor-only" read proxy.
@@ -121,10 +154,16 @@ public:
 // code's alpha, beta values). It might be more work but we can avoid
 // it when b=0. (Also, cuDNN strongly encourages users to use beta=0
 // whenever possible.)
+//
+// A write proxy invalidates the packed shadows of the tensor. With
+// the cache enabled, its packed buffer becomes the new shadow after
+// it is copied out, so reading the output back needs no repacking.
 class PackedTensorWriteProxy
 {
     TensorDescriptor_t m_unpacked_desc = 0;
     TensorDescriptor_t m_packed_desc = 0;
+    // Holds m_packed_desc if it differs from m_unpacked_desc.
+    SharedTensorDescriptor m_packed_desc_ref;
     void* m_unpacked_data = nullptr;
     void* m_packed_data = nullptr;
 
@@ -169,6 +208,18 @@ public:
 
 };// class PackedTensorWriteProxy
 
+/** @brief Drop the packed shadows of the tensors overlapping
+ *         [data, data + bytes).
+ *
+ *  Must be called after such a tensor is modified other than through
+ *  a write proxy, or its stale shadow may be read. Has no effect if
+ *  the cache is disabled.
+ */
+void invalidate_packed_shadows(void const* data, size_t bytes);
+
+/** @brief Drop all the packed shadows. */
+void clear_packed_shadows();
+
 inline PackedTensorReadProxy read_proxy(TensorDescriptor_t desc)
 {
     return PackedTensorReadProxy{desc};
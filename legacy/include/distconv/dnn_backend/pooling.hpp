@@ -1,11 +1,15 @@
 #pragma once
 
 #include "distconv/dnn_backend/backend.hpp"
+#include "distconv/dnn_backend/halo_exchange_tuner.hpp"
 #include "distconv/distconv.hpp"
 #include "distconv/runtime_gpu.hpp"
 #include "distconv/tensor/halo_exchange_cuda.hpp"
 #include "distconv/tensor/halo_exchange_cuda_al.hpp"
+#include "distconv/tensor/halo_exchange_cuda_batched.hpp"
+#include "distconv/tensor/halo_exchange_cuda_graph.hpp"
 #include "distconv/tensor/halo_exchange_cuda_mpi.hpp"
+#include "distconv/tensor/occupancy.hpp"
 #include "distconv/util/util.hpp"
 #ifdef DISTCONV_HAS_P2P
 #include "distconv/tensor/halo_exchange_cuda_hybrid.hpp"
@@ -15,6 +19,8 @@
 #include "distconv/tensor/halo_exchange_cuda_nvshmem.hpp"
 #endif // DISTCONV_HAS_NVSHMEM
 
+#include <cstdint>
+
 namespace distconv
 {
 
@@ -84,7 +90,10 @@ class Pooling<BackendDNNLib, DataType>
     using LocaleMPI = tensor::LocaleMPI;
 
 public:
-    Pooling(BackendDNNLib& backend, int num_dims, HaloExchangeMethod method)
+    Pooling(BackendDNNLib& backend,
+            int num_dims,
+            HaloExchangeMethod method,
+            bool enable_overlap)
         : m_be(backend),
           m_num_dims(num_dims),
           m_num_spatial_dims(num_dims - 2),
@@ -93,11 +102,38 @@ public:
           m_d_input_d{backend::make_tensor_descriptor()},
           m_d_output_d{backend::make_tensor_descriptor()},
           m_pooling_d{backend::make_pooling_descriptor()},
-          m_halo_xch_method(method)
+          m_halo_xch_method(method),
+          m_overlap_halo_exchange_fwd(enable_overlap),
+          m_input_interior_d{backend::make_tensor_descriptor()},
+          m_output_interior_d{backend::make_tensor_descriptor()}
+    {
+        // The layout is known only at setup, so the descriptors are
+        // made for the spatial dimensions of either layout.
+        apply_to_sides(m_num_dims - 1, [this](int i, Side side) {
+            m_input_boundaries_d(i, side) = backend::make_tensor_descriptor();
+            m_output_boundaries_d(i, side) = backend::make_tensor_descriptor();
+        });
+    }
+
+    Pooling(BackendDNNLib& backend, int num_dims, HaloExchangeMethod method)
+        : Pooling(backend,
+                  num_dims,
+                  method,
+                  backend.get_options().m_overlap_halo_exchange)
     {}
 
     ~Pooling()
     {
+        if (m_argmax)
+        {
+            internal::RuntimeGPU::get_device_memory_pool().release(m_argmax);
+        }
+        apply_to_sides(m_num_dims - 1, [this](int i, Side side) {
+            backend::destroy_tensor_descriptor(m_output_boundaries_d(i, side));
+            backend::destroy_tensor_descriptor(m_input_boundaries_d(i, side));
+        });
+        backend::destroy_tensor_descriptor(m_output_interior_d);
+        backend::destroy_tensor_descriptor(m_input_interior_d);
         backend::destroy_pooling_descriptor(m_pooling_d);
         backend::destroy_tensor_descriptor(m_d_output_d);
         backend::destroy_tensor_descriptor(m_d_input_d);
@@ -135,6 +171,9 @@ public:
             assert_eq((unsigned int) m_num_spatial_dims, strides.size());
         }
 
+        m_layout = input.get_layout();
+        assert_always(output.get_layout() == m_layout);
+
         // TODO: asymmetric not supported
         assert_always(util::is_all_elements_equal(windows));
         assert_always(util::is_all_elements_equal(pads));
@@ -167,9 +206,10 @@ public:
         // done).
         for (int i = 0; i < m_num_spatial_dims; ++i)
         {
-            if (input.get_distribution().is_shared(i))
+            const int dim = input.get_spatial_dim(i);
+            if (input.get_distribution().is_shared(dim))
             {
-                assert_always(input.get_distribution().get_split_shape()[i]
+                assert_always(input.get_distribution().get_split_shape()[dim]
                               == 1);
             }
         }
@@ -207,6 +247,7 @@ public:
 
         m_mode =
             backend::get_pooling_mode(mode, m_be.get_options().m_deterministic);
+        m_is_max = mode == "MAX";
 
         // When a dimension is split, halo region works as padding
         for (auto i = pads.begin(); i != pads.end(); i++)
@@ -221,10 +262,21 @@ public:
         // pooling descriptor
         setup_pooling_descriptor(
             input, output, windows, pads, strides, m_pooling_d);
+        m_windows = windows;
+        m_pads = pads;
+        m_strides = strides;
 
         setup_halo_xch(input, d_input);
 
         setup_boundary_streams(input.get_split_index());
+
+        if (m_overlap_halo_exchange_fwd)
+        {
+            setup_overlap(input, output, windows, strides);
+        }
+#ifdef DISTCONV_HAS_NVSHMEM
+        setup_fused_halo(input);
+#endif // DISTCONV_HAS_NVSHMEM
         return;
     }
 
@@ -237,11 +289,32 @@ public:
                 Tensor& output,
                 bool const training = true)
     {
-        exchange_halo_input(input, m_halo_xch_input);
+        if (m_use_argmax && training)
+        {
+            exchange_halo_input(input, m_halo_xch_input, true);
+            if (output.get_local_size() > 0)
+            {
+                max_pool_argmax(
+                    alpha, input, beta, output, get_argmax_buffer(output));
+            }
+            return 0;
+        }
+
+#ifdef DISTCONV_HAS_NVSHMEM
+        if (m_fused_halo_dim >= 0 && output.get_local_size() > 0)
+        {
+            forward_fused_halo(alpha, input, beta, output, training);
+            return 0;
+        }
+#endif // DISTCONV_HAS_NVSHMEM
 
         // Note that even when the local output is empty, halo exchange
         // must be called as this local process may need to push its data
         // to adjacent processes
+        const bool overlap = output.get_local_size() > 0
+                             && is_overlap_fwd_enabled(beta, training);
+        exchange_halo_input(input, m_halo_xch_input, !overlap);
+
         if (output.get_local_size() == 0)
         {
             return 0;
@@ -249,6 +322,17 @@ public:
 
         set_num_samples(output.get_local_shape()[-1]);
 
+        if (overlap)
+        {
+            forward_overlap(alpha, input, beta, output, training);
+            return 0;
+        }
+
+        if (skip_forward(beta, output))
+        {
+            return 0;
+        }
+
         const void* input_ptr =
             input.get_const_base_ptr()
             - input.get_local_offset(IndexVector(m_halo_bwd_recv), true);
@@ -283,6 +367,16 @@ public:
                  typename Tensor::data_type beta,
                  Tensor& d_input)
     {
+        if (m_fused_halo_unpack_pending)
+        {
+            // The input halo is unpacked on the boundary streams after
+            // the fused forward pooling.
+            apply_to_spatial_sides([&](int i, Side side) {
+                util::wait_stream(m_boundary_streams(i, side),
+                                  m_be.get_stream());
+            });
+            m_fused_halo_unpack_pending = false;
+        }
         if (d_input.get_local_size() == 0)
         {
             return 0;
@@ -347,6 +441,67 @@ public:
         return 0;
     }
 
+    /** @brief Backward pass of max pooling with the indices recorded
+     *  by the forward pass, which does not need the input or output.
+     *
+     *  The gradients are scattered into d_input, including its halos,
+     *  which the reverse halo exchange then adds to the neighbors.
+     */
+    template <typename Tensor>
+    int backward(typename Tensor::data_type alpha,
+                 const Tensor& d_output,
+                 typename Tensor::data_type beta,
+                 Tensor& d_input)
+    {
+        assert_always(m_use_argmax);
+        assert_always(beta == 0);
+        if (d_input.get_local_size() == 0)
+        {
+            return 0;
+        }
+        d_input.zero(m_be.get_stream());
+        if (d_output.get_local_size() > 0)
+        {
+            max_pool_scatter(alpha, d_output, m_argmax, d_input);
+        }
+        exchange_halo_reverse(d_input, m_halo_xch_d_input);
+        return 0;
+    }
+
+    /** @brief Record the offset of the maximum within each window in
+     *  the training forward pass of max pooling, one byte per output
+     *  element, for the index-based backward pass.
+     */
+    void set_argmax_indices(bool use_argmax)
+    {
+        if (use_argmax)
+        {
+            assert_always(m_is_max);
+            int window_size = 1;
+            for (auto w : m_windows)
+                window_size *= w;
+            assert_always(window_size <= 256);
+        }
+        m_use_argmax = use_argmax;
+    }
+
+    // Precision the halos of this layer are packed with; see
+    // HaloExchange::set_comm_precision
+    void set_halo_comm_precision(CommPrecision precision)
+    {
+        m_halo_comm_precision = precision;
+        apply_halo_comm_precision();
+    }
+
+    // Occupancy of the input, kept by the caller and computed before
+    // each forward, with which the pooling of an empty tile is
+    // skipped; see tensor/occupancy.hpp. Null disables it.
+    void set_occupancy(tensor::Occupancy const* occupancy)
+    {
+        m_occupancy = occupancy;
+        apply_occupancy();
+    }
+
     void set_num_samples(int n)
     {
         if (n != backend::get_tensor_num_samples(m_input_d))
@@ -356,9 +511,31 @@ public:
             backend::set_tensor_num_samples(m_output_d, n);
             backend::set_tensor_num_samples(m_d_input_d, n);
             backend::set_tensor_num_samples(m_d_output_d, n);
+            if (m_overlap_halo_exchange_fwd)
+            {
+                if (m_interior_req)
+                {
+                    backend::set_tensor_num_samples(m_input_interior_d, n);
+                    backend::set_tensor_num_samples(m_output_interior_d, n);
+                }
+                apply_to_spatial_sides([&](int i, Side side) {
+                    if (m_boundary_req(i, side))
+                    {
+                        backend::set_tensor_num_samples(
+                            m_input_boundaries_d(i, side), n);
+                        backend::set_tensor_num_samples(
+                            m_output_boundaries_d(i, side), n);
+                    }
+                });
+            }
         }
     }
 
+    bool is_overlap_fwd_halo_exchange_enabled() const
+    {
+        return m_overlap_halo_exchange_fwd;
+    }
+
     // Wait for asynchronous tasks
     void wait() { m_be.wait(); }
 
@@ -366,6 +543,7 @@ private:
     BackendDNNLib& m_be;
     const int m_num_dims;
     const int m_num_spatial_dims;
+    tensor::Layout m_layout = tensor::Layout::CHANNELS_FIRST;
     IntVector m_halo_fwd_send;
     IntVector m_halo_bwd_send;
     IntVector m_halo_fwd_recv;
@@ -376,8 +554,21 @@ private:
     backend::TensorDescriptor_t m_d_output_d;
     backend::PoolingDescriptor_t m_pooling_d;
     backend::PoolingMode_t m_mode;
+    // Parameters of the spatial dimensions; pads of the partitioned
+    // dimensions are zero
+    int_vector m_windows;
+    int_vector m_pads;
+    int_vector m_strides;
+    bool m_is_max = false;
+    // Offsets of the maxima within the windows of the last forward
+    // pass, one byte per output element
+    bool m_use_argmax = false;
+    uint8_t* m_argmax = nullptr;
+    size_t m_argmax_size = 0;
 
     HaloExchangeMethod m_halo_xch_method;
+    CommPrecision m_halo_comm_precision = CommPrecision::FULL;
+    tensor::Occupancy const* m_occupancy = nullptr;
     using HaloExchange = tensor::
         HaloExchange<DataType, tensor::CUDAAllocator, Al::NCCLBackend>;
     using HaloExchangeMPI = tensor::HaloExchangeMPI<DataType,
@@ -386,6 +577,13 @@ private:
     using HaloExchangeAL = tensor::HaloExchangeAL<DataType,
                                                   tensor::CUDAAllocator,
                                                   Al::NCCLBackend>;
+    using HaloExchangeALBatched =
+        tensor::HaloExchangeALBatched<DataType,
+                                      tensor::CUDAAllocator,
+                                      Al::NCCLBackend>;
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+    using HaloExchangeALGraph = tensor::HaloExchangeGraph<HaloExchangeAL>;
+#endif // DISTCONV_HAS_CUDA_GRAPH
 #ifdef DISTCONV_HAS_P2P
     using HaloExchangeP2P = tensor::HaloExchangeP2P<DataType,
                                                     tensor::CUDAAllocator,
@@ -394,6 +592,10 @@ private:
         tensor::HaloExchangeHybrid<DataType,
                                    tensor::CUDAAllocator,
                                    Al::NCCLBackend>;
+    using HaloExchangeP2PFusedNotify =
+        tensor::HaloExchangeP2PFusedNotify<DataType,
+                                           tensor::CUDAAllocator,
+                                           Al::NCCLBackend>;
 #endif // DISTCONV_HAS_P2P
 #ifdef DISTCONV_HAS_NVSHMEM
     using HaloExchangeNVSHMEM =
@@ -417,9 +619,30 @@ private:
 #endif // DISTCONV_HAS_NVSHMEM
     std::unique_ptr<HaloExchange> m_halo_xch_input;
     std::unique_ptr<HaloExchange> m_halo_xch_d_input;
+    BoundaryAttributesV<h2::gpu::DeviceStream> m_boundary_streams;
     BoundaryAttributesV<std::shared_ptr<Al::NCCLBackend::comm_type>>
         m_boundary_comms;
 
+    // Interior and boundary regions for overlapping the forward halo
+    // exchange
+    bool m_overlap_halo_exchange_fwd;
+    backend::TensorDescriptor_t m_input_interior_d;
+    backend::TensorDescriptor_t m_output_interior_d;
+    bool m_interior_req = false;
+    BoundaryAttributesV<bool> m_boundary_req = false;
+    BoundaryAttributesV<backend::TensorDescriptor_t> m_input_boundaries_d;
+    BoundaryAttributesV<backend::TensorDescriptor_t> m_output_boundaries_d;
+    index_t m_input_interior_offset = 0;
+    index_t m_output_interior_offset = 0;
+    BoundaryAttributesV<index_t> m_input_boundary_offsets = 0;
+    BoundaryAttributesV<index_t> m_output_boundary_offsets = 0;
+    // Whether more than one spatial dimension is partitioned
+    bool m_multi_dim_halo = false;
+    // Partitioned dimension whose halo is read by the fused pooling
+    // kernel; negative when not fused
+    int m_fused_halo_dim = -1;
+    bool m_fused_halo_unpack_pending = false;
+
     template <typename Tensor>
     void setup_pooling_descriptor(const Tensor& input,
                                   const Tensor& output,
@@ -436,12 +659,52 @@ private:
                                           util::reverse(strides).data());
     }
 
-    void bp_accumulate_sum(
+    void max_pool_argmax(
+        DataType alpha,
+        tensor::Tensor<DataType, tensor::LocaleMPI, tensor::CUDAAllocator> const&
+            input,
+        DataType beta,
         tensor::Tensor<DataType, tensor::LocaleMPI, tensor::CUDAAllocator>&
-            tensor,
-        IndexVector const& dst,
-        IndexVector const& src,
-        tensor::Shape const& shape);
+            output,
+        uint8_t* argmax);
+
+    void max_pool_scatter(
+        DataType alpha,
+        tensor::Tensor<DataType, tensor::LocaleMPI, tensor::CUDAAllocator> const&
+            d_output,
+        uint8_t const* argmax,
+        tensor::Tensor<DataType, tensor::LocaleMPI, tensor::CUDAAllocator>&
+            d_input);
+
+    template <typename Tensor>
+    uint8_t* get_argmax_buffer(const Tensor& output)
+    {
+        const size_t size = output.get_local_size();
+        if (m_argmax_size < size)
+        {
+            auto& mempool = internal::RuntimeGPU::get_device_memory_pool();
+            if (m_argmax)
+            {
+                mempool.release(m_argmax);
+            }
+            m_argmax = static_cast<uint8_t*>(
+                mempool.get(size, m_be.get_stream()));
+            m_argmax_size = size;
+        }
+        return m_argmax;
+    }
+
+#ifdef DISTCONV_HAS_NVSHMEM
+    void pool_fused_halo(
+        DataType alpha,
+        tensor::Tensor<DataType, tensor::LocaleMPI, tensor::CUDAAllocator> const&
+            input,
+        DataType beta,
+        tensor::Tensor<DataType, tensor::LocaleMPI, tensor::CUDAAllocator>&
+            output,
+        tensor::HaloRecvDevice<DataType> const& halo_lhs,
+        tensor::HaloRecvDevice<DataType> const& halo_rhs);
+#endif // DISTCONV_HAS_NVSHMEM
 
     template <typename Allocator>
     void setup_halo_xch(tensor::Tensor<DataType, LocaleMPI, Allocator>& input,
@@ -459,6 +722,20 @@ private:
             m_halo_xch_input.reset(new HaloExchangeAL(input));
             m_halo_xch_d_input.reset(new HaloExchangeAL(d_input));
             break;
+        case HaloExchangeMethod::AL_BATCHED:
+            util::MPIRootPrintStreamDebug()
+                << "Using AL_BATCHED in halo exchange";
+            m_halo_xch_input.reset(new HaloExchangeALBatched(input));
+            m_halo_xch_d_input.reset(new HaloExchangeALBatched(d_input));
+            break;
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+        case HaloExchangeMethod::AL_GRAPH:
+            util::MPIRootPrintStreamDebug()
+                << "Using AL_GRAPH in halo exchange";
+            m_halo_xch_input.reset(new HaloExchangeALGraph(input));
+            m_halo_xch_d_input.reset(new HaloExchangeALGraph(d_input));
+            break;
+#endif // DISTCONV_HAS_CUDA_GRAPH
 #ifdef DISTCONV_HAS_P2P
         case HaloExchangeMethod::P2P:
             util::MPIRootPrintStreamDebug() << "Using P2P in halo exchange";
@@ -474,6 +751,14 @@ private:
             m_halo_xch_d_input.reset(
                 new HaloExchangeHybrid(d_input, m_be.get_p2p()));
             break;
+        case HaloExchangeMethod::P2P_FUSED_NOTIFY:
+            util::MPIRootPrintStreamDebug()
+                << "Using P2P with fused notification in halo exchange";
+            m_halo_xch_input.reset(
+                new HaloExchangeP2PFusedNotify(input, m_be.get_p2p()));
+            m_halo_xch_d_input.reset(
+                new HaloExchangeP2PFusedNotify(d_input, m_be.get_p2p()));
+            break;
 #endif // DISTCONV_HAS_P2P
 #ifdef DISTCONV_HAS_NVSHMEM
         case HaloExchangeMethod::NVSHMEM:
@@ -496,31 +781,84 @@ private:
                 new HaloExchangeNVSHMEMFusedNotify(d_input));
             break;
 #endif // DISTCONV_HAS_NVSHMEM
+        case HaloExchangeMethod::AUTO:
+        {
+            util::MPIRootPrintStreamDebug() << "Using AUTO in halo exchange";
+            HaloExchangeTuner<DataType> tuner(m_be);
+            m_halo_xch_input = tuner.tune(input);
+            m_halo_xch_d_input = tuner.tune(d_input);
+            break;
+        }
         default:
             util::MPIPrintStreamError()
                 << "Invalid halo exchange method: " << m_halo_xch_method;
             std::abort();
         }
+        apply_halo_comm_precision();
+        apply_occupancy();
+    }
+
+    void apply_halo_comm_precision()
+    {
+        for (auto* xch : {m_halo_xch_input.get(), m_halo_xch_d_input.get()})
+        {
+            if (xch != nullptr)
+                xch->set_comm_precision(m_halo_comm_precision);
+        }
+    }
+
+    void apply_occupancy()
+    {
+        if (m_halo_xch_input != nullptr)
+            m_halo_xch_input->set_occupancy(m_occupancy);
+    }
+
+    // Whether the pooling is skipped since its input, including the
+    // halos just received, is empty, which both max and average
+    // pooling map to zero. Clears the output instead if beta is zero.
+    template <typename Tensor>
+    bool skip_forward(typename Tensor::data_type beta, Tensor& output)
+    {
+        using data_type = typename Tensor::data_type;
+        if (m_occupancy == nullptr)
+            return false;
+        auto& stats = tensor::OccupancyStats::get_instance();
+        ++stats.num_ops;
+        if (!m_occupancy->is_empty()
+            || (beta != data_type(0) && beta != data_type(1))
+            || !m_halo_xch_input->received_zero_halos())
+            return false;
+        if (beta == data_type(0))
+            output.zero(m_be.get_stream());
+        ++stats.num_skipped_ops;
+        return true;
     }
 
     template <typename Allocator>
     void
     exchange_halo_input(tensor::Tensor<DataType, LocaleMPI, Allocator>& tensor,
-                        std::unique_ptr<HaloExchange>& xch)
+                        std::unique_ptr<HaloExchange>& xch,
+                        bool sync_back)
     {
         if (m_be.is_nvtx_enabled())
         {
             GPU_PROFILE_RANGE_PUSH("pooling/exchange_halo");
         }
         assert_always(xch != nullptr);
-        xch->exchange(
-            m_boundary_comms, m_be.get_stream(), false, true, false, false);
+        xch->exchange(m_boundary_comms,
+                      m_be.get_stream(),
+                      false,
+                      sync_back,
+                      false,
+                      false);
         if (m_be.is_nvtx_enabled())
         {
             GPU_PROFILE_RANGE_POP();
         }
     }
 
+    // Halo gradients are added to the neighbors' interiors while
+    // unpacking, so no separate accumulation pass follows.
     template <typename Allocator>
     void exchange_halo_reverse(
         tensor::Tensor<DataType, LocaleMPI, Allocator>& tensor,
@@ -550,15 +888,22 @@ private:
 
     void setup_boundary_streams(const IndexVector& split_idx)
     {
-        apply_to_spatial_sides(m_num_dims, [this](int i, Side side) {
-            int idx = get_boundary_stream_index(i, side);
-            m_boundary_comms(i, side) = m_be.get_internal_al_mpi_cuda_comm(idx);
-        });
         for (int i = 0; i < m_num_spatial_dims; ++i)
         {
-            if (split_idx[i] % 2)
+            const int dim = tensor::get_spatial_dim(m_layout, i);
+            for (Side side : SIDES)
             {
-                std::swap(m_boundary_comms(i, LHS), m_boundary_comms(i, RHS));
+                int idx = get_boundary_stream_index(dim, side);
+                m_boundary_streams(dim, side) = m_be.get_internal_stream_pr(idx);
+                m_boundary_comms(dim, side) =
+                    m_be.get_internal_al_mpi_cuda_comm(idx);
+            }
+            if (split_idx[dim] % 2)
+            {
+                std::swap(m_boundary_streams(dim, LHS),
+                          m_boundary_streams(dim, RHS));
+                std::swap(m_boundary_comms(dim, LHS),
+                          m_boundary_comms(dim, RHS));
             }
         }
     }
@@ -567,6 +912,335 @@ private:
     {
         return dim * 2 + (side == LHS ? 0 : 1);
     }
+
+    // Apply f to each side of the spatial tensor dimensions
+    template <typename F>
+    void apply_to_spatial_sides(F&& f) const
+    {
+        distconv::apply_to_spatial_sides(m_num_dims, [&](int i, Side side) {
+            f(tensor::get_spatial_dim(m_layout, i), side);
+        });
+    }
+
+    int get_input_halo_recv(int dim, Side side)
+    {
+        return side == LHS ? m_halo_bwd_recv[dim] : m_halo_fwd_recv[dim];
+    }
+
+    // Decomposes the output into the interior, which does not depend
+    // on the halo, and the boundaries, as done by Convolution
+    template <typename Tensor>
+    void setup_overlap(const Tensor& input,
+                       const Tensor& output,
+                       const int_vector& windows,
+                       const int_vector& strides)
+    {
+        int num_partitioned_dims = 0;
+        bool halo_exchange_required = false;
+        for (int i = 0; i < m_num_spatial_dims; ++i)
+        {
+            const int dim = tensor::get_spatial_dim(m_layout, i);
+            if (input.get_distribution().get_split_shape()[dim] == 1)
+            {
+                continue;
+            }
+            ++num_partitioned_dims;
+            const int stencil = windows[i] % 2 ? (windows[i] - 1) / 2 : 0;
+            halo_exchange_required |= stencil > 0;
+            // Unlikely to be profitable with small spatial domains
+            if (input.get_local_shape()[dim] < (index_t) windows[i] * 3)
+            {
+                util::MPIRootPrintStreamInfo()
+                    << "Overlapped halo exchange in forward pooling "
+                       "disabled as the spatial domain is small ("
+                    << input.get_local_shape();
+                m_overlap_halo_exchange_fwd = false;
+                return;
+            }
+        }
+        if (!halo_exchange_required)
+        {
+            util::MPIPrintStreamDebug() << "Halo exchange not required";
+            m_overlap_halo_exchange_fwd = false;
+            return;
+        }
+        m_multi_dim_halo = num_partitioned_dims > 1;
+
+        auto input_shape = input.get_local_shape();
+        auto output_shape = output.get_local_shape();
+        IndexVector input_interior_idx(m_num_dims, 0);
+        IndexVector output_interior_idx(m_num_dims, 0);
+        apply_to_spatial_sides([&](int dim, Side side) {
+            const int si = tensor::get_spatial_index(m_layout, dim);
+            const int window = windows[si];
+            const int st = strides[si];
+            const int h = get_input_halo_recv(dim, side);
+            m_boundary_req(dim, side) = false;
+            if (h == 0)
+            {
+                return;
+            }
+            int num_boundary_centers = util::ceil(h, st);
+            int interior_offset = num_boundary_centers * st - h;
+            int boundary_edge = ((h - 1) / st) * st;
+            int input_boundary_dim = window + boundary_edge;
+            if (side == LHS)
+            {
+                input_interior_idx[dim] = interior_offset;
+                output_interior_idx[dim] = num_boundary_centers;
+            }
+            int output_boundary_dim =
+                util::ceil(input_boundary_dim - (window - 1), st);
+            assert_always(interior_offset >= 0);
+            input_shape[dim] -= interior_offset;
+            output_shape[dim] -= num_boundary_centers;
+            if (output_boundary_dim == 0)
+            {
+                return;
+            }
+            m_boundary_req(dim, side) = true;
+            // Descriptors are in the channels-first order
+            const int desc_dim =
+                tensor::get_channels_first_dim(m_layout, m_num_dims, dim);
+            backend::copy_tensor_descriptor(m_input_boundaries_d(dim, side),
+                                            m_input_d);
+            backend::set_tensor_dimension(
+                m_input_boundaries_d(dim, side), desc_dim, input_boundary_dim);
+            backend::copy_tensor_descriptor(m_output_boundaries_d(dim, side),
+                                            m_output_d);
+            backend::set_tensor_dimension(m_output_boundaries_d(dim, side),
+                                          desc_dim,
+                                          output_boundary_dim);
+            if (side == LHS)
+            {
+                m_input_boundary_offsets(dim, side) =
+                    input.get_local_offset()
+                    - input.get_local_offset(m_halo_bwd_recv, true);
+                m_output_boundary_offsets(dim, side) =
+                    output.get_local_offset();
+            }
+            else
+            {
+                IndexVector input_boundary_idx =
+                    input.get_overlap() - m_halo_bwd_recv;
+                input_boundary_idx[dim] = input.get_local_shape()[dim] + h
+                                          - input_boundary_dim
+                                          + input.get_overlap()[dim];
+                m_input_boundary_offsets(dim, side) =
+                    input.get_local_offset(input_boundary_idx, true);
+                IndexVector output_boundary_idx(m_num_dims, 0);
+                output_boundary_idx[dim] =
+                    output.get_local_shape()[dim] - output_boundary_dim;
+                m_output_boundary_offsets(dim, side) =
+                    output.get_local_offset(output_boundary_idx, false);
+            }
+            util::MPIPrintStreamDebug()
+                << "pooling input boundary for dimension " << dim << ", "
+                << side << ": " << m_input_boundaries_d(dim, side);
+        });
+        m_interior_req = !input_shape.is_empty() && !output_shape.is_empty();
+        if (m_interior_req)
+        {
+            backend::setup_tensor_descriptor(
+                m_input_interior_d, input, input_shape);
+            m_input_interior_offset =
+                input.get_local_offset(input_interior_idx, false);
+            backend::setup_tensor_descriptor(
+                m_output_interior_d, output, output_shape);
+            m_output_interior_offset =
+                output.get_local_offset(output_interior_idx, false);
+            util::MPIPrintStreamDebug()
+                << "pooling input interior: " << m_input_interior_d;
+        }
+        util::MPIRootPrintStreamDebug()
+            << "Overlapping of halo exchanges in forward pooling enabled";
+    }
+
+    bool is_overlap_fwd_enabled(DataType beta, bool training) const
+    {
+        // Boundaries of different dimensions overlap at the corners,
+        // so they must not accumulate into the output.
+        if (!m_overlap_halo_exchange_fwd || beta != DataType(0))
+        {
+            return false;
+        }
+#if H2_HAS_ROCM
+        // MIOpen keeps the indices for backward in a single workspace
+        // of the pooling descriptor.
+        return !training;
+#else
+        return true;
+#endif
+    }
+
+    // The interior is pooled on the main stream while the halo is
+    // exchanged. Each boundary is pooled on the stream of its
+    // communicator once its halo arrives.
+    template <typename Tensor>
+    void forward_overlap(typename Tensor::data_type alpha,
+                         Tensor& input,
+                         typename Tensor::data_type beta,
+                         Tensor& output,
+                         bool const training)
+    {
+        auto const handle = m_be.get_handle();
+        if (m_interior_req)
+        {
+            pooling_forward_region(
+                handle,
+                alpha,
+                m_input_interior_d,
+                input.get_const_buffer() + m_input_interior_offset,
+                beta,
+                m_output_interior_d,
+                output.get_buffer() + m_output_interior_offset,
+                training);
+        }
+        apply_to_spatial_sides([&](int i, Side side) {
+            if (!m_boundary_req(i, side))
+            {
+                return;
+            }
+            h2::gpu::DeviceStream st_boundary = m_boundary_streams(i, side);
+            if (m_multi_dim_halo)
+            {
+                // Corner halos are complete only after the exchanges
+                // of all dimensions.
+                apply_to_spatial_sides([&](int j, Side side_j) {
+                    if (m_boundary_streams(j, side_j) != st_boundary)
+                    {
+                        util::wait_stream(m_boundary_streams(j, side_j),
+                                          st_boundary);
+                    }
+                });
+            }
+            backend::set_stream(handle, st_boundary);
+            pooling_forward_region(
+                handle,
+                alpha,
+                m_input_boundaries_d(i, side),
+                input.get_const_buffer() + m_input_boundary_offsets(i, side),
+                beta,
+                m_output_boundaries_d(i, side),
+                output.get_buffer() + m_output_boundary_offsets(i, side),
+                training);
+            util::wait_stream(st_boundary, m_be.get_stream());
+        });
+        backend::set_stream(handle, m_be.get_stream());
+    }
+
+#ifdef DISTCONV_HAS_NVSHMEM
+    // The halo of a single partitioned dimension can be read by the
+    // fused pooling kernel directly from the receive buffers of
+    // HaloExchangeNVSHMEMFusedNotify.
+    template <typename Tensor>
+    void setup_fused_halo(const Tensor& input)
+    {
+        m_fused_halo_dim = -1;
+        if (!m_be.get_options().m_fuse_halo_exchange
+            || m_halo_xch_method != HaloExchangeMethod::NVSHMEM_FUSED_NOTIFY)
+        {
+            return;
+        }
+        if (m_layout != tensor::Layout::CHANNELS_FIRST)
+        {
+            util::MPIRootPrintStreamInfo()
+                << "Fused halo exchange in pooling disabled as only the "
+                   "channels-first layout is supported";
+            return;
+        }
+        int dim = -1;
+        for (int i = 0; i < m_num_spatial_dims; ++i)
+        {
+            const int d = tensor::get_spatial_dim(m_layout, i);
+            if (input.get_halo_width(d) == 0)
+            {
+                continue;
+            }
+            if (dim >= 0)
+            {
+                // Corner halos are exchanged through the unpacked halo
+                // of the other dimensions.
+                util::MPIRootPrintStreamInfo()
+                    << "Fused halo exchange in pooling disabled as the "
+                       "tensor has halos in multiple dimensions";
+                return;
+            }
+            dim = d;
+        }
+        m_fused_halo_dim = dim;
+        if (m_fused_halo_dim >= 0)
+        {
+            util::MPIRootPrintStreamDebug()
+                << "Pooling fused with the halo exchange of dimension "
+                << m_fused_halo_dim;
+        }
+    }
+
+    // Only the packing kernels, which also put and notify, run before
+    // the pooling kernel. The pooling kernel waits on the device for
+    // the halos that its blocks read.
+    template <typename Tensor>
+    void forward_fused_halo(typename Tensor::data_type alpha,
+                            Tensor& input,
+                            typename Tensor::data_type beta,
+                            Tensor& output,
+                            bool const training)
+    {
+        auto xch =
+            dynamic_cast<HaloExchangeNVSHMEMFusedNotify*>(m_halo_xch_input.get());
+        assert_always(xch != nullptr);
+        if (m_be.is_nvtx_enabled())
+        {
+            GPU_PROFILE_RANGE_PUSH("pooling/exchange_halo");
+        }
+        xch->exchange(
+            m_boundary_comms, m_be.get_stream(), false, true, false, true);
+        if (m_be.is_nvtx_enabled())
+        {
+            GPU_PROFILE_RANGE_POP();
+        }
+        set_num_samples(output.get_local_shape()[-1]);
+        pool_fused_halo(alpha,
+                        input,
+                        beta,
+                        output,
+                        xch->get_halo_recv_for_device(m_fused_halo_dim, LHS),
+                        xch->get_halo_recv_for_device(m_fused_halo_dim, RHS));
+        if (training)
+        {
+            // Backward reads the halo from the tensor. Unpacking is
+            // ordered after the pooling kernel, which waited for the
+            // arrival of the halos.
+            xch->unpack(m_boundary_streams, m_be.get_stream(), false, false);
+            m_fused_halo_unpack_pending = true;
+        }
+    }
+#endif // DISTCONV_HAS_NVSHMEM
+
+    template <typename Handle>
+    void pooling_forward_region(Handle const& handle,
+                                DataType alpha,
+                                backend::TensorDescriptor_t const& input_d,
+                                void const* input_ptr,
+                                DataType beta,
+                                backend::TensorDescriptor_t const& output_d,
+                                void* output_ptr,
+                                bool const training)
+    {
+        dnn_lib::PackedTensorReadProxy input_prox(handle, input_d, input_ptr);
+        dnn_lib::PackedTensorWriteProxy output_prox(
+            handle, output_d, output_ptr, beta);
+        backend::pooling_forward(handle,
+                                 m_pooling_d,
+                                 alpha,
+                                 input_prox.desc(),
+                                 input_prox.ptr(),
+                                 beta,
+                                 output_prox.desc(),
+                                 output_prox.ptr(),
+                                 training);
+    }
 };
 
 } // namespace distconv
@@ -0,0 +1,433 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/dnn_backend/grouped_convolution.hpp"
+#include "distconv/dnn_backend/halo_exchange_tuner.hpp"
+#include "distconv/layers.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/halo_exchange_cuda.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
+#include "distconv/util/util.hpp"
+
+#include <h2/gpu/memory_utils.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace distconv
+{
+namespace quantized_conv
+{
+
+/** Largest magnitude of the symmetric INT8 range */
+constexpr int max_int8 = 127;
+
+/** @brief Fused epilogue turning the INT32 sums of output channel k
+ *  into INT8:
+ *
+ *    y = saturate(rint((sum + bias[k]) * scales[k]))
+ *
+ *  saturated to [-127, 127], or to [0, 127] with relu. Both arrays
+ *  are in device memory, with one element per output channel.
+ */
+struct Requantization
+{
+    const float* scales;
+    const std::int32_t* bias;
+    bool relu;
+    // Scale the INT8 outputs are multiplied by when stored as float
+    float output_scale;
+};
+
+/** @brief Geometry of a densely packed copy of g in the same order */
+inline grouped_conv::Geometry
+make_packed_geometry(grouped_conv::Geometry const& g, int num_dims)
+{
+    grouped_conv::Geometry packed = g;
+    index_t stride = 1;
+    for (int i = 0; i < num_dims; ++i)
+    {
+        packed.strides[i] = stride;
+        stride *= g.dims[i];
+    }
+    return packed;
+}
+
+/** @brief Quantize each filter, the outermost dimension of w, with a
+ *  scale of its own: q = rint(w / scales[k]).
+ *
+ *  The scale maps the largest magnitude of the filter to 127.
+ */
+inline void quantize_filters(std::vector<float> const& w,
+                             int num_filters,
+                             std::vector<std::int8_t>& q,
+                             std::vector<float>& scales)
+{
+    assert_always(num_filters > 0 && w.size() % num_filters == 0);
+    size_t const filter_size = w.size() / num_filters;
+    q.resize(w.size());
+    scales.resize(num_filters);
+    for (int k = 0; k < num_filters; ++k)
+    {
+        auto const begin = w.begin() + k * filter_size;
+        float max_abs = 0;
+        std::for_each(begin, begin + filter_size, [&](float v) {
+            max_abs = std::max(max_abs, std::abs(v));
+        });
+        // An all-zero filter quantizes to zeros with any scale
+        scales[k] = max_abs > 0 ? max_abs / max_int8 : 1.0f;
+        for (size_t i = 0; i < filter_size; ++i)
+        {
+            float const v = std::rint(begin[i] / scales[k]);
+            q[k * filter_size + i] = static_cast<std::int8_t>(
+                std::min<float>(std::max<float>(v, -max_int8), max_int8));
+        }
+    }
+}
+
+/** @brief Quantize the elements of x with geometry g into q, densely
+ *  packed: q = saturate(rint(x * inv_scale)).
+ */
+void quantize(grouped_conv::Geometry const& g,
+              int num_spatial_dims,
+              const float* x,
+              float inv_scale,
+              std::int8_t* q,
+              h2::gpu::DeviceStream stream);
+
+/** @brief y = requantize(conv(x, w)) with INT32 sums.
+ *
+ *  As grouped_conv::forward, but on INT8 operands with one group.
+ *  OutType is std::int8_t, or float to store the requantized values
+ *  multiplied by rq.output_scale.
+ */
+template <typename OutType>
+void forward(grouped_conv::Problem const& p,
+             const std::int8_t* x,
+             const std::int8_t* w,
+             Requantization const& rq,
+             OutType* y,
+             h2::gpu::DeviceStream stream);
+
+} // namespace quantized_conv
+
+/** @brief Spatially distributed INT8 convolution for inference.
+ *
+ *  The filters are quantized with a scale per output channel, and the
+ *  input with the single scale of the tensor. Each output channel is
+ *  computed with INT32 sums and requantized to INT8 in the epilogue of
+ *  the convolution kernel, with the bias and an optional ReLU, so the
+ *  INT32 sums never leave the registers. The outputs are stored as the
+ *  INT8 values multiplied by the output scale, which is what the
+ *  following layers of the float stack read.
+ *
+ *  The halos of the input are exchanged before it is quantized; with
+ *  set_halo_comm_precision(CommPrecision::FP8), they move one byte per
+ *  element, as INT8 payloads would.
+ *
+ *  The tensors must be in the CHANNELS_FIRST layout. The input must
+ *  have halos wide enough for the windows of the local outputs in the
+ *  partitioned spatial dimensions, which are exchanged with AUTO or a
+ *  method of HaloExchangeTuner::make. The samples must be partitioned
+ *  in the same way in both tensors.
+ */
+template <>
+class QuantizedConvolution<BackendDNNLib>
+{
+    using TensorType =
+        tensor::Tensor<float, tensor::LocaleMPI, tensor::CUDAAllocator>;
+    using HaloExchange =
+        tensor::HaloExchange<float, tensor::CUDAAllocator, Al::NCCLBackend>;
+
+public:
+    QuantizedConvolution(BackendDNNLib& backend,
+                         int num_dims,
+                         HaloExchangeMethod method)
+        : m_be(backend),
+          m_num_dims(num_dims),
+          m_num_spatial_dims(num_dims - 2),
+          m_halo_xch_method(method)
+    {}
+
+    QuantizedConvolution(const QuantizedConvolution&) = delete;
+    QuantizedConvolution& operator=(const QuantizedConvolution&) = delete;
+
+    /** @brief Quantize the filters and set up the convolution.
+     *
+     *  filter holds the float filters of the whole layer, each output
+     *  channel (K) outermost, then the input channels (C) and the
+     *  spatial dimensions, as in the filter tensors of Convolution.
+     *  bias holds one element per output channel, or is empty.
+     */
+    void setup(TensorType& input,
+               TensorType& output,
+               std::vector<float> const& filter,
+               int_vector const& filter_dims,
+               std::vector<float> const& bias,
+               int_vector const& pads,
+               int_vector const& strides,
+               int_vector const& dilations,
+               float input_scale,
+               float output_scale,
+               bool relu)
+    {
+        assert_eq(input.get_num_dims(), m_num_dims);
+        assert_eq((unsigned int) m_num_spatial_dims, filter_dims.size());
+        assert_always(input.get_layout() == tensor::Layout::CHANNELS_FIRST);
+        assert_always(output.get_layout() == tensor::Layout::CHANNELS_FIRST);
+        assert_always(input_scale > 0 && output_scale > 0);
+        int const num_channels = input.get_shape()[-2];
+        int const num_filters = output.get_shape()[-2];
+        assert_eq(input.get_local_shape()[-2], (index_t) num_channels);
+        assert_eq(output.get_local_shape()[-2], (index_t) num_filters);
+        assert_eq(input.get_local_shape()[-1], output.get_local_shape()[-1]);
+
+        setup_filter(filter, filter_dims, num_channels, num_filters, bias,
+                     input_scale, output_scale);
+        m_input_inv_scale = 1.0f / input_scale;
+        m_relu = relu;
+        m_output_scale = output_scale;
+
+        // Halos are exchanged only for the partitioned dimensions
+        bool halo_required = false;
+        for (int i = 0; i < m_num_spatial_dims; ++i)
+        {
+            auto const& dist = input.get_distribution();
+            if (dist.get_split_shape()[i] == 1 || input.get_overlap()[i] == 0)
+                continue;
+            // Halo exchanges with shared tensors are not supported
+            assert_always(!dist.is_shared(i));
+            halo_required = true;
+        }
+        m_halo_xch_input.reset();
+        if (halo_required)
+            setup_halo_xch(input);
+
+        if (output.get_local_size() > 0)
+            setup_problem(input, output, filter_dims, pads, strides,
+                          dilations);
+    }
+
+    /** @brief Precision the halos of the input are packed with; see
+     *  HaloExchange::set_comm_precision.
+     */
+    void set_halo_comm_precision(CommPrecision precision)
+    {
+        m_halo_comm_precision = precision;
+        if (m_halo_xch_input)
+            m_halo_xch_input->set_comm_precision(precision);
+    }
+
+    int forward(TensorType& input, TensorType& output)
+    {
+        DISTCONV_RANGE("quantized_conv/forward", Compute);
+        util::MPIPrintStreamDebug()
+            << "Quantized convolution: " << input << ", " << output;
+        // The local halos must be sent even if the local output is
+        // empty
+        if (m_halo_xch_input)
+        {
+            m_halo_xch_input->exchange(m_boundary_comms,
+                                       m_be.get_stream(),
+                                       false,
+                                       true,
+                                       false,
+                                       false);
+        }
+        if (output.get_local_size() == 0)
+            return 0;
+        auto const nd = m_num_dims;
+        index_t x_size = 1;
+        for (int i = 0; i < nd; ++i)
+            x_size *= m_fwd_p.x.dims[i];
+        // The quantized input lives in the workspace of the stream,
+        // as it is only read by the kernel that follows.
+        auto* x_q = static_cast<std::int8_t*>(
+            m_be.get_workspace_arena().get(x_size, m_be.get_stream()));
+        const float* x = input.get_const_base_ptr()
+                         - input.get_local_offset(IndexVector(m_halo_bwd),
+                                                  true);
+        quantized_conv::quantize(m_input_geometry,
+                                 m_num_spatial_dims,
+                                 x,
+                                 m_input_inv_scale,
+                                 x_q,
+                                 m_be.get_stream());
+        quantized_conv::Requantization const rq{
+            static_cast<const float*>(m_scales.get()),
+            static_cast<const std::int32_t*>(m_bias.get()),
+            m_relu,
+            m_output_scale};
+        quantized_conv::forward(m_fwd_p,
+                                x_q,
+                                static_cast<const std::int8_t*>(m_filter.get()),
+                                rq,
+                                output.get_base_ptr(),
+                                m_be.get_stream());
+        return 0;
+    }
+
+private:
+    BackendDNNLib& m_be;
+    const int m_num_dims;
+    const int m_num_spatial_dims;
+    HaloExchangeMethod m_halo_xch_method;
+    CommPrecision m_halo_comm_precision = CommPrecision::FULL;
+    std::shared_ptr<HaloExchange> m_halo_xch_input;
+    BoundaryAttributesV<typename HaloExchangeTuner<float>::CommType>
+        m_boundary_comms;
+    // Halos of the input read by the local windows, per dimension
+    IntVector m_halo_bwd;
+    IntVector m_halo_fwd;
+    // The float input with its halos, and the problem on its packed
+    // quantized copy
+    grouped_conv::Geometry m_input_geometry;
+    grouped_conv::Problem m_fwd_p;
+    float m_input_inv_scale = 1;
+    float m_output_scale = 1;
+    bool m_relu = false;
+    // INT8 filters, requantization scales and INT32 bias in device
+    // memory
+    tensor::Memory<tensor::CUDAAllocator> m_filter;
+    tensor::Memory<tensor::CUDAAllocator> m_scales;
+    tensor::Memory<tensor::CUDAAllocator> m_bias;
+
+    void setup_filter(std::vector<float> const& filter,
+                      int_vector const& filter_dims,
+                      int num_channels,
+                      int num_filters,
+                      std::vector<float> const& bias,
+                      float input_scale,
+                      float output_scale)
+    {
+        size_t filter_size = num_channels;
+        for (auto d : filter_dims)
+            filter_size *= d;
+        assert_eq(filter.size(), filter_size * num_filters);
+        assert_always(bias.empty() || (int) bias.size() == num_filters);
+
+        std::vector<std::int8_t> filter_q;
+        std::vector<float> filter_scales;
+        quantized_conv::quantize_filters(
+            filter, num_filters, filter_q, filter_scales);
+        // The sums are in units of input_scale * filter_scales[k]
+        std::vector<float> scales(num_filters);
+        std::vector<std::int32_t> bias_q(num_filters, 0);
+        for (int k = 0; k < num_filters; ++k)
+        {
+            float const sum_scale = input_scale * filter_scales[k];
+            scales[k] = sum_scale / output_scale;
+            if (!bias.empty())
+                bias_q[k] =
+                    static_cast<std::int32_t>(std::rint(bias[k] / sum_scale));
+        }
+
+        auto const stream = m_be.get_stream();
+        m_filter.allocate(filter_q.size() * sizeof(std::int8_t));
+        h2::gpu::mem_copy(static_cast<std::int8_t*>(m_filter.get()),
+                          filter_q.data(),
+                          filter_q.size(),
+                          stream);
+        m_scales.allocate(scales.size() * sizeof(float));
+        h2::gpu::mem_copy(static_cast<float*>(m_scales.get()),
+                          scales.data(),
+                          scales.size(),
+                          stream);
+        m_bias.allocate(bias_q.size() * sizeof(std::int32_t));
+        h2::gpu::mem_copy(static_cast<std::int32_t*>(m_bias.get()),
+                          bias_q.data(),
+                          bias_q.size(),
+                          stream);
+        // The host copies are released when this returns
+        h2::gpu::sync(stream);
+    }
+
+    void setup_problem(TensorType& input,
+                       TensorType& output,
+                       int_vector const& filter_dims,
+                       int_vector const& pads,
+                       int_vector const& strides,
+                       int_vector const& dilations)
+    {
+        int const nsd = m_num_spatial_dims;
+        assert_always(nsd <= grouped_conv::max_num_spatial_dims);
+        m_halo_bwd = IntVector(m_num_dims, 0);
+        m_halo_fwd = IntVector(m_num_dims, 0);
+        for (int i = 0; i < nsd; ++i)
+        {
+            // No halo is filled beyond the boundaries of the tensor,
+            // where the windows read zeros instead
+            index_t const begin = input.get_global_index(i, 0);
+            index_t const end = begin + input.get_local_shape()[i];
+            if (begin > 0)
+                m_halo_bwd[i] = input.get_overlap()[i];
+            if (end < input.get_shape()[i])
+                m_halo_fwd[i] = input.get_overlap()[i];
+        }
+        m_input_geometry =
+            grouped_conv::make_geometry(input, m_halo_fwd, m_halo_bwd);
+
+        const IntVector no_halo(m_num_dims, 0);
+        m_fwd_p.num_spatial_dims = nsd;
+        m_fwd_p.num_groups = 1;
+        m_fwd_p.x =
+            quantized_conv::make_packed_geometry(m_input_geometry, m_num_dims);
+        m_fwd_p.y = grouped_conv::make_geometry(output, no_halo, no_halo);
+        for (int i = 0; i < m_num_dims; ++i)
+        {
+            m_fwd_p.w.dims[i] =
+                i < nsd ? filter_dims[i]
+                        : (i == nsd ? input.get_shape()[-2]
+                                    : output.get_shape()[-2]);
+        }
+        m_fwd_p.w = quantized_conv::make_packed_geometry(m_fwd_p.w,
+                                                         m_num_dims);
+        for (int i = 0; i < nsd; ++i)
+        {
+            m_fwd_p.strides[i] = strides[i];
+            m_fwd_p.dilations[i] = dilations[i];
+            // The windows are placed in the coordinates of the local
+            // input with its halos, whose first element is at global
+            // index begin - halo
+            index_t const in_begin =
+                input.get_global_index(i, 0) - m_halo_bwd[i];
+            index_t const out_begin = output.get_global_index(i, 0);
+            m_fwd_p.pads[i] = pads[i] + in_begin - out_begin * strides[i];
+            // The windows must not read beyond the halos, except
+            // across the boundaries of the tensor
+            index_t const first = -m_fwd_p.pads[i];
+            index_t const last = (output.get_local_shape()[i] - 1) * strides[i]
+                                 - m_fwd_p.pads[i]
+                                 + (filter_dims[i] - 1) * dilations[i];
+            index_t const begin = input.get_global_index(i, 0);
+            index_t const end = begin + input.get_local_shape()[i];
+            assert_always(first >= 0 || begin == 0);
+            assert_always(last < m_fwd_p.x.dims[i]
+                          || end == input.get_shape()[i]);
+        }
+        assert_always(grouped_conv::is_supported(m_fwd_p));
+    }
+
+    void setup_halo_xch(TensorType& input)
+    {
+        HaloExchangeTuner<float> tuner(m_be);
+        if (m_halo_xch_method == HaloExchangeMethod::AUTO)
+            m_halo_xch_input = tuner.tune(input);
+        else
+            m_halo_xch_input = tuner.make(m_halo_xch_method, input);
+        m_boundary_comms = tuner.get_comms(input);
+        m_halo_xch_input->set_comm_precision(m_halo_comm_precision);
+    }
+};
+
+} // namespace distconv
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "distconv/dnn_backend/backend.hpp"
+#include "distconv/dnn_backend/leaky_relu.hpp"
 #include "distconv/runtime_gpu.hpp"
 
 namespace distconv
@@ -28,9 +29,10 @@ public:
         backend::destroy_activation_descriptor(m_activation_d);
     }
 
-    ReLU<BackendDNNLib> operator=(const ReLU<BackendDNNLib>& x)
+    ReLU<BackendDNNLib>& operator=(const ReLU<BackendDNNLib>& x)
     {
         assert_always(&m_be == &x.m_be);
+        m_save_mask = x.m_save_mask;
         backend::copy_tensor_descriptor(m_input_d, x.m_input_d);
         backend::copy_tensor_descriptor(m_output_d, x.m_output_d);
         backend::copy_tensor_descriptor(m_d_input_d, x.m_d_input_d);
@@ -39,6 +41,12 @@ public:
         return *this;
     }
 
+    /** @brief Save a 1-bit sign mask of the input in the forward pass
+     *  instead of using cuDNN, so that the backward pass needs neither
+     *  the input nor the output. The output may then be the input.
+     */
+    void set_save_mask(bool save_mask) { m_save_mask = save_mask; }
+
     template <typename Tensor, typename ConstTensor>
     void setup(const ConstTensor& input,
                const Tensor& output,
@@ -66,6 +74,19 @@ public:
         {
             return 0;
         }
+        if (m_save_mask)
+        {
+            // Zero slope of the leaky variant
+            assert_always(alpha == 1 && beta == 0);
+            auto stream = m_be.get_stream();
+            leaky_relu::forward_masked(
+                input,
+                typename Tensor::data_type(0),
+                output,
+                m_mask.get(leaky_relu::get_mask_size(input), stream),
+                stream);
+            return 0;
+        }
         set_num_samples(input.get_local_shape()[-1]);
         auto const& handle = m_be.get_handle();
         // Note: These proxies do not need to be "forced" since cuDNN
@@ -131,6 +152,31 @@ public:
         return 0;
     }
 
+    /** @brief Backward pass with the sign mask saved by the forward
+     *  pass.
+     */
+    template <typename Tensor>
+    int backward(typename Tensor::data_type alpha,
+                 const Tensor& d_output,
+                 typename Tensor::data_type beta,
+                 Tensor& d_input)
+    {
+        util::MPIPrintStreamDebug()
+            << "Relu BP: " << d_output << ", " << d_input;
+        assert_always(m_save_mask);
+        assert_always(alpha == 1 && beta == 0);
+        if (d_input.get_local_size() == 0)
+        {
+            return 0;
+        }
+        leaky_relu::backward_masked(m_mask.get(),
+                                    d_output,
+                                    typename Tensor::data_type(0),
+                                    d_input,
+                                    m_be.get_stream());
+        return 0;
+    }
+
     void set_num_samples(int n)
     {
         if (n != backend::get_tensor_num_samples(m_input_d))
@@ -149,6 +195,8 @@ protected:
     backend::TensorDescriptor_t m_output_d;
     backend::TensorDescriptor_t m_d_input_d;
     backend::TensorDescriptor_t m_d_output_d;
+    bool m_save_mask = false;
+    leaky_relu::SignMask m_mask;
 };
 
 } // namespace distconv
@@ -0,0 +1,239 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#ifdef DISTCONV_HAS_P2P
+
+#include "p2p/p2p.hpp"
+
+#include <Al.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace distconv
+{
+
+/** @brief Filter held once per node and shared by its processes.
+ *
+ *  Filters are replicated on every process, so each GPU holds a copy
+ *  of all the weights of a layer along with their optimizer state.
+ *  Here the first process of each node, the owner, allocates the
+ *  filter, and the other processes of the node map it through CUDA IPC
+ *  and read it in place. When a process of the node has no direct
+ *  peer-to-peer path to the owner, every process keeps a copy instead,
+ *  which is broadcast within the node only when the filter changes.
+ *
+ *  The filter gradients are reduced to the owners: within each node
+ *  first, then among the owners. Only the owners apply the optimizer,
+ *  through update(), so its state is held once per node as well.
+ *
+ *  Construction is collective over the communicator of the backend.
+ *  The communication is issued to the default stream of the backend.
+ */
+template <typename DataType>
+class SharedFilter
+{
+public:
+    using AlComm = Al::NCCLBackend::comm_type;
+
+    SharedFilter(BackendDNNLib& backend, size_t count)
+        : m_be(backend), m_count(count)
+    {
+        MPI_Comm const comm = m_be.get_comm();
+        int rank;
+        DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &rank));
+        DISTCONV_CHECK_MPI(MPI_Comm_split_type(
+            comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &m_node_comm));
+        int node_rank, node_size;
+        DISTCONV_CHECK_MPI(MPI_Comm_rank(m_node_comm, &node_rank));
+        DISTCONV_CHECK_MPI(MPI_Comm_size(m_node_comm, &node_size));
+        m_owner = node_rank == 0;
+        DISTCONV_CHECK_MPI(MPI_Comm_split(comm,
+                                          m_owner ? 0 : MPI_UNDEFINED,
+                                          rank,
+                                          &m_owner_comm));
+        auto const stream = m_be.get_stream();
+        m_node_al = std::make_unique<AlComm>(m_node_comm, stream);
+        if (m_owner_comm != MPI_COMM_NULL)
+        {
+            m_owner_al = std::make_unique<AlComm>(m_owner_comm, stream);
+        }
+
+        // Ranks of the processes of the node in the backend communicator
+        std::vector<int> node_ranks(node_size);
+        DISTCONV_CHECK_MPI(MPI_Allgather(
+            &rank, 1, MPI_INT, node_ranks.data(), 1, MPI_INT, m_node_comm));
+        std::vector<int> peers;
+        if (m_owner)
+            peers.assign(node_ranks.begin() + 1, node_ranks.end());
+        else
+            peers.push_back(node_ranks[0]);
+        auto& p2p = m_be.get_p2p();
+        if (node_size > 1)
+        {
+            p2p.get_connections(peers, m_conns);
+        }
+        int direct = 1;
+        for (const auto& conn : m_conns)
+        {
+            if (conn->get_path() != p2p::Connection::Path::DIRECT)
+                direct = 0;
+        }
+        DISTCONV_CHECK_MPI(MPI_Allreduce(
+            MPI_IN_PLACE, &direct, 1, MPI_INT, MPI_LAND, m_node_comm));
+        m_mapped = direct && node_size > 1;
+
+        if (m_owner || !m_mapped)
+        {
+            // IPC handles require memory allocated by cudaMalloc itself
+            DISTCONV_CHECK_CUDA(
+                cudaMalloc(&m_local, std::max(m_count, size_t(1))
+                                         * sizeof(DataType)));
+            m_ptr = m_local;
+        }
+        if (m_mapped)
+        {
+            std::vector<void*> local_addrs(m_conns.size(),
+                                           m_owner ? m_local : nullptr);
+            m_peer_addrs.resize(m_conns.size(), nullptr);
+            p2p.exchange_addrs(m_conns, local_addrs, m_peer_addrs);
+            if (!m_owner)
+            {
+                m_ptr = static_cast<DataType*>(m_peer_addrs[0]);
+                assert_always(m_ptr != nullptr);
+            }
+        }
+        util::MPIPrintStreamDebug()
+            << "SharedFilter of " << m_count << " elements, "
+            << (m_owner ? "owner" : "non-owner") << ", "
+            << (m_mapped ? "mapped" : "broadcast");
+    }
+
+    SharedFilter(const SharedFilter&) = delete;
+    SharedFilter& operator=(const SharedFilter&) = delete;
+
+    ~SharedFilter()
+    {
+        if (m_mapped && !m_owner)
+        {
+            m_be.get_p2p().close_addrs(
+                m_conns.data(), m_peer_addrs.data(), m_conns.size());
+        }
+        m_owner_al.reset();
+        m_node_al.reset();
+        if (m_local != nullptr)
+        {
+            DISTCONV_CHECK_CUDA(cudaFree(m_local));
+        }
+        if (m_owner_comm != MPI_COMM_NULL)
+        {
+            DISTCONV_CHECK_MPI(MPI_Comm_free(&m_owner_comm));
+        }
+        DISTCONV_CHECK_MPI(MPI_Comm_free(&m_node_comm));
+    }
+
+    /** @brief Whether this process applies the updates of its node. */
+    bool is_owner() const { return m_owner; }
+
+    /** @brief Whether the filter is read from the memory of the owner. */
+    bool is_mapped() const { return m_mapped; }
+
+    size_t get_count() const { return m_count; }
+
+    /** @brief Filter to read, which only the owner may write. */
+    const DataType* get() const { return m_ptr; }
+
+    /** @brief Point a non-partitioned filter tensor at the shared filter. */
+    template <typename Allocator>
+    void view(tensor::Tensor<DataType, LocaleMPI, Allocator>& filter) const
+    {
+        assert_eq(filter.get_local_size(), m_count);
+        tensor::View(filter, m_ptr);
+    }
+
+    /** @brief Modify the filter at the owner and publish the result.
+     *
+     *  update_func takes the filter and the stream to issue the update
+     *  to, e.g., an optimizer step with the reduced gradients. It is
+     *  called only at the owner, after the other processes of the node
+     *  have issued their reads, and they read the result once this
+     *  returns. Collective over the processes of the node.
+     */
+    template <typename Func>
+    void update(Func&& update_func)
+    {
+        DISTCONV_RANGE("shared_filter/update", Collective);
+        auto stream = m_be.get_stream();
+        if (m_mapped)
+            barrier(stream);
+        if (m_owner)
+            update_func(m_local, stream);
+        if (m_mapped)
+            barrier(stream);
+        else if (m_node_al->size() > 1)
+            Al::Bcast<Al::NCCLBackend, DataType>(
+                m_local, m_count, 0, *m_node_al);
+    }
+
+    /** @brief Sum the local filter gradients of all processes at the
+     *  owners.
+     *
+     *  The gradients of the other processes are left unspecified.
+     *  Pass reduce=false to the backward filter pass of the layer to
+     *  skip its own allreduce.
+     */
+    void reduce_gradients(DataType* d_filter)
+    {
+        DISTCONV_RANGE("shared_filter/reduce_gradients", Collective);
+        if (m_node_al->size() > 1)
+        {
+            Al::Reduce<Al::NCCLBackend, DataType>(
+                d_filter, m_count, Al::ReductionOperator::sum, 0, *m_node_al);
+        }
+        if (m_owner_al != nullptr && m_owner_al->size() > 1)
+        {
+            Al::Allreduce<Al::NCCLBackend, DataType>(
+                d_filter, m_count, Al::ReductionOperator::sum, *m_owner_al);
+        }
+    }
+
+private:
+    BackendDNNLib& m_be;
+    size_t m_count;
+    bool m_owner = false;
+    bool m_mapped = false;
+    MPI_Comm m_node_comm = MPI_COMM_NULL;
+    // Only set on the owners
+    MPI_Comm m_owner_comm = MPI_COMM_NULL;
+    std::unique_ptr<AlComm> m_node_al;
+    std::unique_ptr<AlComm> m_owner_al;
+    // Connections to the other processes of the node at the owner,
+    // and to the owner elsewhere
+    std::vector<p2p::P2P::connection_type> m_conns;
+    std::vector<void*> m_peer_addrs;
+    // Allocated at the owner, and everywhere unless mapped
+    DataType* m_local = nullptr;
+    DataType* m_ptr = nullptr;
+
+    // Orders the streams of the owner and of the other processes
+    void barrier(cudaStream_t stream)
+    {
+        std::vector<cudaStream_t> streams(m_conns.size(), stream);
+        m_be.get_p2p().barrier(m_conns, streams);
+    }
+};
+
+} // namespace distconv
+
+#endif // DISTCONV_HAS_P2P
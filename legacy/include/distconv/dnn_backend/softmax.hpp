@@ -2,6 +2,7 @@
 
 #include "distconv/dnn_backend/backend.hpp"
 #include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/al_collectives.hpp"
 
 #include <Al.hpp>
 
@@ -33,8 +34,8 @@ public:
         if (m_num_procs_per_sample > 1)
         {
             auto sample_loc = input.get_sub_locale_except_dim(-1);
-            m_sample_al.reset(new Al::NCCLBackend::comm_type(
-                sample_loc.get_comm(), m_be.get_stream()));
+            m_sample_al = tensor::get_al_collectives(
+                sample_loc.get_comm(), m_be.get_stream());
         }
     }
 
@@ -48,7 +49,7 @@ protected:
     BackendDNNLib& m_be;
     SoftmaxMode m_mode;
     int m_num_procs_per_sample;
-    std::unique_ptr<Al::NCCLBackend::comm_type> m_sample_al;
+    std::shared_ptr<tensor::AlCollectives> m_sample_al;
 
     template <typename DataType>
     void allreduce(DataType* sample_values, int num_samples, bool max_or_sum)
@@ -58,8 +59,24 @@ protected:
 
         auto op = max_or_sum ? Al::ReductionOperator::max
                              : Al::ReductionOperator::sum;
-        Al::Allreduce<Al::NCCLBackend, DataType>(
-            sample_values, num_samples, op, *m_sample_al.get());
+        m_sample_al->allreduce(sample_values, num_samples, op);
+    }
+
+    int get_sample_rank() const
+    {
+        return m_num_procs_per_sample < 2 ? 0 : m_sample_al->rank();
+    }
+
+    // Gathers count values from each process of a sample into
+    // values, ordered by rank. local_values must be at the position
+    // of this process.
+    template <typename DataType>
+    void allgather(const DataType* local_values, DataType* values, int count)
+    {
+        if (m_num_procs_per_sample < 2)
+            return;
+
+        m_sample_al->allgather(local_values, values, count);
     }
 };
 
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/al_collectives.hpp"
+
+#include <Al.hpp>
+
+#include <memory>
+
+namespace distconv
+{
+
+/** @brief Softmax followed by cross entropy, fused into one layer.
+ *
+ *  Computes the per-sample cross entropy of softmax(x_pred) and x_truth
+ *  without materializing the softmax output. The loss is computed with
+ *  log-sum-exp, and the gradient with respect to x_pred is computed
+ *  directly as dy * (softmax * sum(x_truth) - x_truth), i.e.,
+ *  dy * (softmax - onehot) for one-hot or label ground truth.
+ *
+ *  In CHANNEL mode, the softmax is taken over the channels of each
+ *  position, which must not be split. In INSTANCE mode, it is taken
+ *  over the whole sample. Either way, the processes of a sample need a
+ *  single collective per forward pass.
+ */
+template <>
+class SoftmaxCrossEntropy<BackendDNNLib>
+{
+public:
+    SoftmaxCrossEntropy(BackendDNNLib& backend,
+                        SoftmaxMode mode,
+                        const bool use_labels = false)
+        : m_be(backend), m_mode(mode), m_use_labels(use_labels)
+    {}
+
+    ~SoftmaxCrossEntropy()
+    {
+        if (m_sample_stats)
+        {
+            internal::RuntimeGPU::get_device_memory_pool().release(
+                m_sample_stats);
+        }
+    }
+
+    SoftmaxCrossEntropy(const SoftmaxCrossEntropy&) = delete;
+    SoftmaxCrossEntropy& operator=(const SoftmaxCrossEntropy&) = delete;
+
+    template <typename Tensor>
+    void setup(const Tensor& x_pred, const Tensor& x_truth, const Tensor& y)
+    {
+        // Both tensors must have the same process grid
+        assert_eq(x_pred.get_locale_shape(), x_truth.get_locale_shape());
+        if (m_use_labels)
+        {
+            // Must have the same number of samples
+            assert_eq(x_pred.get_shape()[-1], x_truth.get_shape()[-1]);
+            assert_eq(x_pred.get_local_shape()[-1],
+                      x_truth.get_local_shape()[-1]);
+            // Must have the same global and locale spatial shapes
+            for (int i = 0; i < x_pred.get_num_spatial_dims(); i++)
+            {
+                assert_eq(x_pred.get_shape()[i], x_truth.get_shape()[i]);
+                assert_eq(x_pred.get_local_shape()[i],
+                          x_truth.get_local_shape()[i]);
+            }
+            // Must have only one channel
+            assert_eq(x_truth.get_shape()[-2], 1);
+            assert_eq(x_truth.get_local_shape()[-2], 1);
+        }
+        else
+        {
+            // Must have the same global and locale shapes
+            assert_eq(x_pred.get_shape(), x_truth.get_shape());
+            assert_eq(x_pred.get_local_shape(), x_truth.get_local_shape());
+        }
+        if (m_mode == SoftmaxMode::CHANNEL)
+        {
+            // Channels must be local
+            assert_eq(x_pred.get_split_shape()[-2], 1);
+        }
+        // No halo for simplicity
+        assert_eq(x_pred.get_local_shape(), x_pred.get_local_real_shape());
+        assert_eq(x_truth.get_local_shape(), x_truth.get_local_real_shape());
+        // y is a 1-d vector of length as long as the number of samples
+        assert_eq(x_pred.get_local_shape()[-1], y.get_local_shape()[-1]);
+        assert_eq(y.get_local_shape()[-1], y.get_local_size());
+        // same process grid
+        assert_eq(x_pred.get_locale_shape(), y.get_locale_shape());
+        // no partitioning except for the sample dimension
+        assert_eq(y.get_split_shape().reduce_prod(), y.get_split_shape()[-1]);
+        assert_eq(y.get_locale_shape()[-1], y.get_split_shape()[-1]);
+
+        auto loc_shape = x_pred.get_locale_shape();
+        m_num_procs_per_sample = loc_shape.reduce_prod() / loc_shape[-1];
+        if (m_num_procs_per_sample > 1)
+        {
+            auto sample_loc = x_pred.get_sub_locale_except_dim(-1);
+            m_al = tensor::get_al_collectives(
+                sample_loc.get_comm(), m_be.get_stream());
+        }
+    }
+
+    /** @brief Compute the per-sample loss y. */
+    template <typename Tensor>
+    int forward(const Tensor& x_pred, const Tensor& x_truth, Tensor& y);
+
+    /** @brief Compute the gradient with respect to x_pred. Must follow
+     *  the forward pass of the same inputs.
+     */
+    template <typename Tensor>
+    int backward(const Tensor& x_pred,
+                 const Tensor& x_truth,
+                 Tensor& dy,
+                 Tensor& dx_pred);
+
+protected:
+    BackendDNNLib& m_be;
+    const SoftmaxMode m_mode;
+    const bool m_use_labels;
+    int m_num_procs_per_sample;
+    std::shared_ptr<tensor::AlCollectives> m_al;
+    // Log-sum-exp and target sum of each sample, kept from the forward
+    // pass in INSTANCE mode
+    void* m_sample_stats = nullptr;
+    size_t m_sample_stats_size = 0;
+
+    int get_sample_rank() const
+    {
+        return m_num_procs_per_sample < 2 ? 0 : m_al->rank();
+    }
+
+    void* get_sample_stats(size_t size, h2::gpu::DeviceStream stream)
+    {
+        if (m_sample_stats_size < size)
+        {
+            auto& mempool = internal::RuntimeGPU::get_device_memory_pool();
+            if (m_sample_stats)
+            {
+                mempool.release(m_sample_stats);
+            }
+            m_sample_stats = mempool.get(size, stream);
+            m_sample_stats_size = size;
+        }
+        return m_sample_stats;
+    }
+};
+
+} // namespace distconv
@@ -0,0 +1,197 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/dnn_backend/backend.hpp"
+#include "distconv/dnn_backend/halo_exchange_tuner.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/halo_exchange_cuda.hpp"
+#include "distconv/util/util.hpp"
+
+#include <memory>
+
+namespace distconv
+{
+
+/** @brief Nearest or linear upsampling of spatially distributed samples.
+ *
+ *  Each spatial dimension is enlarged by an integer scale factor. With
+ *  LINEAR, the outputs are interpolated from the two nearest inputs of
+ *  each spatial dimension, i.e., bilinear or trilinear interpolation,
+ *  with the input coordinate of an output index o at
+ *  (o + 0.5) / scale - 0.5, clamped to the input at the boundaries of
+ *  the whole tensor. The interpolation reads one input element beyond
+ *  each side of the local tile, which comes from a halo exchange of
+ *  width one; nearest upsampling needs no halo.
+ *
+ *  The backward pass of LINEAR adds the weighted gradients of each
+ *  output into d_input, including its halos, and the reverse halo
+ *  exchange adds the halos to the neighbors, as the index-based
+ *  backward pass of max pooling does. That of NEAREST gathers the
+ *  gradients of the outputs of each input and needs no communication.
+ *
+ *  The tensors must be in the CHANNELS_FIRST layout, and each local
+ *  output tile must be the upsampled local input tile, e.g., with the
+ *  same process grid. With LINEAR, the input and d_input must have a
+ *  halo of width one in the partitioned spatial dimensions, which are
+ *  exchanged with AUTO or a method of HaloExchangeTuner::make. The
+ *  output must not have halos.
+ */
+template <typename DataType>
+class Upsample<BackendDNNLib, DataType>
+{
+    using TensorType =
+        tensor::Tensor<DataType, tensor::LocaleMPI, tensor::CUDAAllocator>;
+    using HaloExchange = tensor::
+        HaloExchange<DataType, tensor::CUDAAllocator, Al::NCCLBackend>;
+
+public:
+    Upsample(BackendDNNLib& backend, int num_dims, HaloExchangeMethod method)
+        : m_be(backend),
+          m_num_dims(num_dims),
+          m_num_spatial_dims(num_dims - 2),
+          m_halo_xch_method(method)
+    {}
+
+    Upsample(const Upsample&) = delete;
+    Upsample& operator=(const Upsample&) = delete;
+
+    template <typename Tensor>
+    void setup(Tensor& input,
+               Tensor& output,
+               Tensor& d_input,
+               Tensor& d_output,
+               int_vector scale_factors,
+               UpsampleMode mode)
+    {
+        assert_eq((unsigned int) m_num_spatial_dims, scale_factors.size());
+        assert_eq(input.get_num_dims(), m_num_dims);
+        assert_always(input.get_layout() == tensor::Layout::CHANNELS_FIRST);
+        assert_always(output.get_layout() == tensor::Layout::CHANNELS_FIRST);
+        assert_eq(input.get_distribution(), d_input.get_distribution());
+        assert_eq(output.get_distribution(), d_output.get_distribution());
+
+        m_scale_factors = IntVector(m_num_dims, 1);
+        for (int i = 0; i < m_num_spatial_dims; ++i)
+        {
+            assert_always(scale_factors[i] > 0);
+            m_scale_factors[i] = scale_factors[i];
+        }
+        for (int i = 0; i < m_num_dims; ++i)
+        {
+            const int s = m_scale_factors[i];
+            assert_eq(output.get_shape()[i], input.get_shape()[i] * s);
+            assert_eq(output.get_local_shape()[i],
+                      input.get_local_shape()[i] * s);
+            assert_eq(output.get_overlap()[i], 0);
+        }
+        m_mode = mode;
+
+        // Halos are exchanged only for the partitioned dimensions, as
+        // the interpolation is clamped at the boundaries of the tensor
+        bool halo_required = false;
+        if (m_mode == UpsampleMode::LINEAR)
+        {
+            for (int i = 0; i < m_num_spatial_dims; ++i)
+            {
+                const auto& dist = input.get_distribution();
+                if (dist.get_split_shape()[i] == 1)
+                    continue;
+                // Halo exchanges with shared tensors are not supported
+                assert_always(!dist.is_shared(i));
+                assert_eq(input.get_overlap()[i], 1);
+                halo_required = true;
+            }
+        }
+        m_halo_xch_input.reset();
+        m_halo_xch_d_input.reset();
+        if (halo_required)
+        {
+            setup_halo_xch(input, d_input);
+        }
+    }
+
+    template <typename Tensor>
+    int forward(Tensor& input, Tensor& output)
+    {
+        DISTCONV_RANGE("upsample/forward", Compute);
+        util::MPIPrintStreamDebug()
+            << "Upsample: " << input << ", " << output;
+        // The local halos must be sent even if the local output is
+        // empty
+        if (m_halo_xch_input)
+        {
+            m_halo_xch_input->exchange(m_boundary_comms,
+                                       m_be.get_stream(),
+                                       false,
+                                       true,
+                                       false,
+                                       false);
+        }
+        if (output.get_local_size() == 0)
+            return 0;
+        upsample_forward(input, output);
+        return 0;
+    }
+
+    template <typename Tensor>
+    int backward(const Tensor& d_output, Tensor& d_input)
+    {
+        DISTCONV_RANGE("upsample/backward", Compute);
+        util::MPIPrintStreamDebug() << "Upsample BP";
+        if (d_input.get_local_size() == 0)
+            return 0;
+        upsample_backward(d_output, d_input);
+        if (m_halo_xch_d_input)
+        {
+            m_halo_xch_d_input->exchange(m_boundary_comms,
+                                         m_be.get_stream(),
+                                         true,
+                                         true,
+                                         true,
+                                         false,
+                                         tensor::HaloExchangeAccumOp::SUM);
+        }
+        return 0;
+    }
+
+private:
+    BackendDNNLib& m_be;
+    const int m_num_dims;
+    const int m_num_spatial_dims;
+    // Scale factors of all the dimensions, one for the channels and
+    // samples
+    IntVector m_scale_factors;
+    UpsampleMode m_mode = UpsampleMode::NEAREST;
+    HaloExchangeMethod m_halo_xch_method;
+    std::shared_ptr<HaloExchange> m_halo_xch_input;
+    std::shared_ptr<HaloExchange> m_halo_xch_d_input;
+    BoundaryAttributesV<typename HaloExchangeTuner<DataType>::CommType>
+        m_boundary_comms;
+
+    void setup_halo_xch(TensorType& input, TensorType& d_input)
+    {
+        HaloExchangeTuner<DataType> tuner(m_be);
+        if (m_halo_xch_method == HaloExchangeMethod::AUTO)
+        {
+            m_halo_xch_input = tuner.tune(input);
+            m_halo_xch_d_input = tuner.tune(d_input);
+        }
+        else
+        {
+            m_halo_xch_input = tuner.make(m_halo_xch_method, input);
+            m_halo_xch_d_input = tuner.make(m_halo_xch_method, d_input);
+        }
+        m_boundary_comms = tuner.get_comms(input);
+    }
+
+    void upsample_forward(TensorType const& input, TensorType& output);
+
+    void upsample_backward(TensorType const& d_output, TensorType& d_input);
+};
+
+} // namespace distconv
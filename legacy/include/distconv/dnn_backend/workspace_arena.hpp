@@ -0,0 +1,247 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/util/memory_accounting.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace distconv
+{
+
+/** @brief Workspace shared by all layers of a backend.
+ *
+ *  Each stream gets its own region, so concurrent convolutions on the
+ *  interior and boundary streams never share a buffer, while layers
+ *  running on the same stream reuse it in stream order. Regions grow
+ *  to the largest request seen so far. Once the sizes are stable
+ *  (e.g., after the first iteration), finalize() packs all regions
+ *  into a single allocation.
+ *
+ *  A workspace budget bounds the sum of all regions, since that is
+ *  what finalize() allocates. Algorithm searches ask get_limit() how
+ *  much a stream may use and reserve() what they picked, so that later
+ *  searches, on any stream, only see what is left.
+ */
+class WorkspaceArena
+{
+public:
+    WorkspaceArena() = default;
+    WorkspaceArena(const WorkspaceArena&) = delete;
+    WorkspaceArena& operator=(const WorkspaceArena&) = delete;
+
+    ~WorkspaceArena() { release(); }
+
+    /** @brief Get a workspace of at least size bytes for stream st.
+     *
+     *  The buffer is valid until the next call with the same stream.
+     */
+    void* get(size_t size, h2::gpu::DeviceStream st)
+    {
+        if (size == 0)
+        {
+            return nullptr;
+        }
+        auto& r = get_region(st);
+        if (r.size < size)
+        {
+            grow(r, size);
+        }
+        return r.ptr;
+    }
+
+    /** @brief Account for a workspace of size bytes on stream st
+     *  without allocating it yet.
+     */
+    void reserve(size_t size, h2::gpu::DeviceStream st)
+    {
+        auto& r = get_region(st);
+        r.reserved = std::max(r.reserved, size);
+    }
+
+    /** @brief Largest workspace stream st may use without the regions
+     *  exceeding budget in total.
+     *
+     *  The other regions count with their sizes or reservations,
+     *  whichever is larger.
+     */
+    size_t get_limit(size_t budget, h2::gpu::DeviceStream st) const
+    {
+        size_t others = 0;
+        for (const auto& r : m_regions)
+        {
+            if (r.stream != st)
+            {
+                others += align(std::max(r.size, r.reserved));
+            }
+        }
+        if (others >= budget)
+        {
+            return 0;
+        }
+        // Rounded down so that the aligned region still fits.
+        return (budget - others) / m_alignment * m_alignment;
+    }
+
+    /** @brief Pack all regions into one allocation of the current
+     *  high-water marks.
+     */
+    void finalize()
+    {
+        if (m_regions.empty())
+        {
+            return;
+        }
+        // Regions may be in use on any of the streams.
+        h2::gpu::sync();
+        for (auto& r : m_regions)
+        {
+            if (!m_block && r.ptr)
+            {
+                release_buffer(r.ptr);
+            }
+            r.ptr = nullptr;
+        }
+        if (m_block)
+        {
+            release_buffer(m_block);
+            m_block = nullptr;
+        }
+        size_t total = 0;
+        for (const auto& r : m_regions)
+        {
+            total += align(r.size);
+        }
+        m_block = static_cast<char*>(get_buffer(total, 0));
+        size_t offset = 0;
+        for (auto& r : m_regions)
+        {
+            r.ptr = m_block + offset;
+            offset += align(r.size);
+        }
+        m_total_size = total;
+        ++m_generation;
+        util::MPIPrintStreamDebug()
+            << "Workspace arena finalized: " << total << " bytes for "
+            << m_regions.size() << " streams";
+    }
+
+    bool is_finalized() const { return m_block != nullptr; }
+
+    /** @brief Total bytes currently held by the arena. */
+    size_t get_size() const { return m_total_size; }
+
+    /** @brief Changes whenever buffers returned by get may have been
+     *  released, e.g., so that captured graphs using them are dropped.
+     */
+    size_t get_generation() const { return m_generation; }
+
+private:
+    struct Region
+    {
+        h2::gpu::DeviceStream stream;
+        size_t size;
+        void* ptr;
+        // Largest size promised by reserve()
+        size_t reserved;
+    };
+
+    static constexpr size_t m_alignment = 256;
+
+    std::vector<Region> m_regions;
+    char* m_block = nullptr;
+    size_t m_total_size = 0;
+    size_t m_generation = 0;
+
+    static size_t align(size_t s)
+    {
+        return (s + m_alignment - 1) / m_alignment * m_alignment;
+    }
+
+    /** @brief Get a buffer from the pool, counted as workspace. */
+    static void* get_buffer(size_t size, h2::gpu::DeviceStream st)
+    {
+        void* p = internal::RuntimeGPU::get_device_memory_pool().get(size, st);
+        assert_always(p != nullptr);
+        util::memory_accounting::OwnerScope owner(
+            util::memory_accounting::Owner::WORKSPACE);
+        util::memory_accounting::record_allocation(p, size);
+        return p;
+    }
+
+    static void release_buffer(void* p)
+    {
+        util::memory_accounting::record_deallocation(p);
+        internal::RuntimeGPU::get_device_memory_pool().release(p);
+    }
+
+    Region& get_region(h2::gpu::DeviceStream st)
+    {
+        for (auto& r : m_regions)
+        {
+            if (r.stream == st)
+            {
+                return r;
+            }
+        }
+        m_regions.push_back(Region{st, 0, nullptr, 0});
+        return m_regions.back();
+    }
+
+    void grow(Region& r, size_t size)
+    {
+        if (is_finalized())
+        {
+            // A larger workspace is needed after finalization, e.g.,
+            // when the number of samples changes. Fall back to a
+            // separate buffer and pack again.
+            util::MPIPrintStreamDebug()
+                << "Workspace arena grows after finalization: " << r.size
+                << " -> " << size << " bytes";
+            r.size = size;
+            finalize();
+            return;
+        }
+        // The pool keeps the previous buffer alive until the work
+        // queued on its stream is done.
+        if (r.ptr)
+        {
+            release_buffer(r.ptr);
+            m_total_size -= r.size;
+        }
+        r.ptr = get_buffer(size, r.stream);
+        r.size = size;
+        m_total_size += size;
+        ++m_generation;
+    }
+
+    void release()
+    {
+        for (auto& r : m_regions)
+        {
+            if (!m_block && r.ptr)
+            {
+                release_buffer(r.ptr);
+            }
+        }
+        if (m_block)
+        {
+            release_buffer(m_block);
+        }
+        m_regions.clear();
+        m_block = nullptr;
+        m_total_size = 0;
+        ++m_generation;
+    }
+};
+
+} // namespace distconv
@@ -79,6 +79,13 @@ class Convolution {
   void set_num_samples(int);
 };
 
+template <typename Backend, typename DataType>
+class ChannelPaddedConvolution {
+ public:
+  ChannelPaddedConvolution(Backend &backend, int num_dims,
+                           HaloExchangeMethod method, int pad_multiple);
+};
+
 template <typename Backend, typename DataType>
 class Pooling {
  public:
@@ -123,6 +130,35 @@ class BatchNormalization {
   BatchNormalization(Backend &backend, int num_dims, DataType decay, DataType epsilon);
 };
 
+template <typename Backend, typename DataType>
+class GroupNormalization {
+ public:
+  GroupNormalization(Backend &backend, int num_dims, int num_groups, DataType epsilon);
+};
+
+enum class GlobalPoolingMode {AVERAGE, MAX};
+
+template <typename Backend, typename DataType>
+class GlobalPooling {
+ public:
+  GlobalPooling(Backend &backend, int num_dims, GlobalPoolingMode mode);
+};
+
+enum class UpsampleMode {NEAREST, LINEAR};
+
+template <typename Backend, typename DataType>
+class Upsample {
+ public:
+  Upsample(Backend &backend, int num_dims, HaloExchangeMethod method);
+};
+
+template <typename Backend>
+class QuantizedConvolution {
+ public:
+  QuantizedConvolution(Backend &backend, int num_dims,
+                       HaloExchangeMethod method);
+};
+
 enum class SoftmaxMode {INSTANCE, CHANNEL};
 
 template <typename Backend>
@@ -137,6 +173,12 @@ class CrossEntropy {
   CrossEntropy(Backend &backend);
 };
 
+template <typename Backend>
+class SoftmaxCrossEntropy {
+ public:
+  SoftmaxCrossEntropy(Backend &backend);
+};
+
 template <typename Backend>
 class MeanSquaredError {
  public:
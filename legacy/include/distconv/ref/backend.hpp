@@ -14,6 +14,54 @@ class Backend {
   }
 };
 
+template <typename Tensor>
+void apply3d(typename Tensor::data_type alpha,
+             const Tensor &x,
+             index_t x_n, index_t x_c,
+             const Tensor &filter,
+             index_t f_k, index_t f_c,
+             bool rotate,
+             typename Tensor::data_type beta,
+             Tensor &y,
+             index_t y_n, index_t y_k,
+             int_vector paddings, // W
+             int_vector strides, // W
+             bool expand_halo) {
+  using Array3 = tensor::Array<3>;
+  using DataType = typename Tensor::data_type;
+  auto shape = expand_halo ? x.get_local_real_shape() :
+      x.get_local_shape();
+  index_t w_len = shape[0];
+  auto f_shape = filter.get_local_shape();
+  index_t fw_len = f_shape[0];
+  const int padding_w = paddings[0];
+  index_t w_sweep_len = w_len + padding_w * 2 - fw_len + 1;
+  for (index_t w = 0; w < w_sweep_len; ++w) {
+    DataType acc = 0.0;
+    for (index_t j = 0; j < fw_len; ++j) {
+      Array3 x_idx = {w + j, x_c, x_n};
+      DataType xi;
+      // if idx is in the padded area, value of 0 is used
+      if (x_idx[0] < (index_t)padding_w
+          || x_idx[0] >= w_len + padding_w) {
+        xi = 0.0;
+      } else {
+        x_idx[0] -= padding_w;
+        xi = x.get(x_idx.get_vector(),
+                   expand_halo);
+      }
+      index_t f_w = rotate ? fw_len - j - 1 : j;
+      IndexVector f_idx({f_w, f_c, f_k});
+      DataType fi = filter.get(f_idx);
+      acc = acc + xi * fi;
+    }
+    // save acc to the output tensor
+    IndexVector y_idx({w, y_k, y_n});
+    acc = acc * alpha + y.get(y_idx) * beta;
+    y.set(y_idx, acc);
+  }
+}
+
 template <typename Tensor>
 void apply4d(typename Tensor::data_type alpha,
              const Tensor &x,
@@ -179,6 +227,11 @@ void apply(typename Tensor::data_type alpha,
            int_vector strides, // DWH
            bool expand_halo) {
   switch (x.get_num_dims()) {
+    case 3:
+      apply3d(alpha, x, x_n, x_c, filter, f_k, f_c,
+              rotate, beta, y, y_n, y_k, paddings, strides,
+              expand_halo);
+      break;
     case 4:
       apply4d(alpha, x, x_n, x_c, filter, f_k, f_c,
               rotate, beta, y, y_n, y_k, paddings, strides,
@@ -255,9 +308,9 @@ class Convolution<ref::Backend, DataType> {
       strides.push_back(0);
     }
     // Note halo exchange not implemented
-    for (index_t n = 0; n < input.get_local_shape()[3]; ++n) {
-      for (index_t k = 0; k < output.get_local_shape()[2]; ++k) {
-        for (index_t c = 0; c < input.get_local_shape()[2]; ++c) {
+    for (index_t n = 0; n < input.get_local_shape()[-1]; ++n) {
+      for (index_t k = 0; k < output.get_local_shape()[-2]; ++k) {
+        for (index_t c = 0; c < input.get_local_shape()[-2]; ++c) {
           ref::apply<Tensor>(alpha, input, n, c,
                              filter, k, c, false,
                              c == 0 ? beta : (typename Tensor::data_type)1.0,
@@ -308,9 +361,9 @@ class Convolution<ref::Backend, DataType> {
       strides.push_back(0);
     }
 
-    for (index_t n = 0; n < d_output.get_local_shape()[3]; ++n) {
-      for (index_t k = 0; k < d_output.get_local_shape()[2]; ++k) {
-        for (index_t c = 0; c < filter.get_local_shape()[2]; ++c) {
+    for (index_t n = 0; n < d_output.get_local_shape()[-1]; ++n) {
+      for (index_t k = 0; k < d_output.get_local_shape()[-2]; ++k) {
+        for (index_t c = 0; c < filter.get_local_shape()[-2]; ++c) {
           ref::apply<Tensor>(alpha, d_output, n, k,
                              filter, k, c, true,
                              k == 0 ? beta : (typename Tensor::data_type)1.0,
@@ -342,9 +395,9 @@ class Convolution<ref::Backend, DataType> {
       strides.push_back(0);
     }
 
-    for (index_t n = 0; n < input.get_local_shape()[3]; ++n) {
-      for (index_t k = 0; k < d_output.get_local_shape()[2]; ++k) {
-        for (index_t c = 0; c < input.get_local_shape()[2]; ++c) {
+    for (index_t n = 0; n < input.get_local_shape()[-1]; ++n) {
+      for (index_t k = 0; k < d_output.get_local_shape()[-2]; ++k) {
+        for (index_t c = 0; c < input.get_local_shape()[-2]; ++c) {
           ref::apply<Tensor>(alpha, input, n, c,
                              d_output, n, k, false,
                              n == 0 ? beta : (typename Tensor::data_type)(1.0),
@@ -4,6 +4,8 @@ namespace distconv {
 
 struct Config {
     bool profiling;
+    // Per-layer GPU timing; see util/instrumentation.hpp
+    bool instrumentation;
 };
 
 void initialize();
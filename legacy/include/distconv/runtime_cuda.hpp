@@ -3,9 +3,21 @@
 #include <cuda_runtime.h>
 #include "cub/util_allocator.cuh"
 
+#include "h2/gpu/memory_utils.hpp"
+#include "h2/gpu/pools.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
 namespace distconv {
 namespace internal {
 
+// Serves all the devices of the process: memory is allocated on the
+// current device and released to the device it was allocated on.
 class CUDADeviceMemoryPool {
  public:
   CUDADeviceMemoryPool();
@@ -13,22 +25,34 @@ class CUDADeviceMemoryPool {
   void *get(size_t size, cudaStream_t st);
   void release(void *p);
   size_t get_max_allocatable_size(size_t limit);
-  
+  // Returns cached memory not in use to the system
+  void release_unused();
+  // Includes the allocations outside of the pool when the default
+  // allocator of H2 is used
+  h2::gpu::DeviceAllocatorStats get_stats(int device) const;
+
  protected:
-  cub::CachingDeviceAllocator m_allocator;
+  // The default allocator of H2 when it uses stream-ordered pools,
+  // otherwise a CUB allocator owned by this pool
+  std::unique_ptr<h2::gpu::DeviceAllocator> m_owned_allocator;
+  h2::gpu::DeviceAllocator *m_allocator;
+  static constexpr unsigned int m_bin_growth = 4;
 };
 
 class RuntimeCUDA {
  public:
   static CUDADeviceMemoryPool &get_device_memory_pool();
-  static cudaEvent_t &get_event(int idx=0);
+  // Events of the current device and the calling thread, acquired
+  // from the pools of H2 on first use. Threads get their own events so
+  // that recording and waiting for them does not interleave.
+  static cudaEvent_t get_event(int idx=0);
   
  protected:
-  static RuntimeCUDA *m_instance;
   //PinnedMemoryPool m_pmp;
   CUDADeviceMemoryPool m_dmp;
-  static constexpr int m_num_events = 2;
-  cudaEvent_t m_events[m_num_events];
+  std::mutex m_events_mutex;
+  std::map<std::pair<int, std::thread::id>,
+           std::vector<h2::gpu::PooledEvent>> m_events;
   
   RuntimeCUDA();
   static RuntimeCUDA &get_instance();
@@ -18,12 +18,16 @@
 #include "runtime_cuda.hpp"
 
 #define GPU_DEVICE_RESET cudaDeviceReset
+#define GPU_ERROR_NOT_READY cudaErrorNotReady
+#define GPU_EVENT_QUERY cudaEventQuery
+#define GPU_EVENT_RECORD cudaEventRecord
 #define GPU_FREE cudaFree
 #define GPU_GET_LAST_ERROR cudaGetLastError
 #define GPU_MAKE_GPU_EXTENT make_cudaExtent
 #define GPU_MAKE_GPU_PITCHED_PTR make_cudaPitchedPtr
 #define GPU_MAKE_GPU_POS make_cudaPos
 #define GPU_MALLOC cudaMalloc
+#define GPU_STREAM_WAIT_EVENT cudaStreamWaitEvent
 
 // These aren't general-purpose; maybe best left in this weird
 // preprocessor (anti)pattern.
@@ -37,12 +41,16 @@
 #include "runtime_rocm.hpp"
 
 #define GPU_DEVICE_RESET hipDeviceReset
+#define GPU_ERROR_NOT_READY hipErrorNotReady
+#define GPU_EVENT_QUERY hipEventQuery
+#define GPU_EVENT_RECORD hipEventRecord
 #define GPU_FREE hipFree
 #define GPU_GET_LAST_ERROR hipGetLastError
 #define GPU_MAKE_GPU_EXTENT make_hipExtent
 #define GPU_MAKE_GPU_PITCHED_PTR make_hipPitchedPtr
 #define GPU_MAKE_GPU_POS make_hipPos
 #define GPU_MALLOC hipMalloc
+#define GPU_STREAM_WAIT_EVENT hipStreamWaitEvent
 
 // These aren't general-purpose; maybe best left in this weird
 // preprocessor (anti)pattern.
@@ -6,7 +6,10 @@
 ////////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include "h2/gpu/memory_utils.hpp"
+
 #include <array>
+#include <memory>
 
 #include <hip/hip_runtime.h>
 #include <hipcub/util_allocator.hpp>
@@ -16,6 +19,11 @@ namespace distconv
 namespace internal
 {
 
+/** @brief Pool serving all the devices of the process.
+ *
+ *  Memory is allocated on the current device and released to the
+ *  device it was allocated on.
+ */
 class HIPDeviceMemoryPool
 {
 public:
@@ -24,16 +32,31 @@ public:
     void* get(size_t size, hipStream_t st);
     void release(void* p);
     size_t get_max_allocatable_size(size_t limit);
+    /** @brief Return cached memory not in use to the system. */
+    void release_unused();
+    /** @brief Statistics of the allocator on the given device.
+     *
+     *  Includes the allocations outside of the pool when the default
+     *  allocator of H2 is used.
+     */
+    h2::gpu::DeviceAllocatorStats get_stats(int device) const;
 
 private:
-    hipcub::CachingDeviceAllocator m_allocator;
+    // The default allocator of H2 when it uses stream-ordered pools,
+    // otherwise a hipCUB allocator owned by this pool
+    std::unique_ptr<h2::gpu::DeviceAllocator> m_owned_allocator;
+    h2::gpu::DeviceAllocator* m_allocator;
+    static constexpr unsigned int m_bin_growth = 4;
 };
 
 class RuntimeHIP
 {
 public:
     static HIPDeviceMemoryPool& get_device_memory_pool();
-    static hipEvent_t& get_event(int idx = 0);
+    // Events of the current device and the calling thread, acquired
+    // from the pools of H2 on first use. Threads get their own events
+    // so that recording and waiting for them does not interleave.
+    static hipEvent_t get_event(int idx = 0);
 };
 
 } // namespace internal
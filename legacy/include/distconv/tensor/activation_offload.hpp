@@ -0,0 +1,273 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
+#include "distconv/tensor/runtime_gpu.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace distconv
+{
+namespace tensor
+{
+
+/** @brief Moves forward activations to pinned host memory and back.
+ *
+ *  Tensors are allocated by the manager in forward order. offload()
+ *  copies a tensor to pinned host memory on a copy stream as soon as
+ *  it is produced and frees its device memory after the copy, without
+ *  blocking the compute stream. In the backward pass, fetch() makes a
+ *  tensor available again and prefetches the tensors needed next, in
+ *  reverse forward order, as long as the device memory held by
+ *  prefetched tensors stays within the staging budget. release() ends
+ *  the use of a fetched tensor and frees its memory.
+ *
+ *  All device memory of the managed tensors is allocated and freed on
+ *  the copy stream, so that the stream-ordered pool never reuses it
+ *  before the copies are done.
+ */
+template <typename DataType>
+class ActivationOffload
+{
+public:
+    using TensorType = Tensor<DataType, LocaleMPI, CUDAAllocator>;
+
+    explicit ActivationOffload(size_t staging_budget)
+        : m_staging_budget(staging_budget),
+          m_copy_stream(h2::gpu::make_stream_nonblocking())
+    {}
+
+    ActivationOffload(const ActivationOffload&) = delete;
+    ActivationOffload& operator=(const ActivationOffload&) = delete;
+
+    ~ActivationOffload()
+    {
+        h2::gpu::sync(m_copy_stream);
+        for (auto& e : m_entries)
+        {
+            free_device(e);
+            free_host(e);
+            h2::gpu::destroy(e.event);
+        }
+        h2::gpu::destroy(m_copy_stream);
+    }
+
+    /** @brief Allocate t so that it can be offloaded; t can be written
+     *  on stream right away. Tensors released in an earlier iteration
+     *  keep their host memory.
+     */
+    void allocate(TensorType& t, h2::gpu::DeviceStream stream)
+    {
+        assert_always(t.is_null());
+        size_t idx = find_entry(t);
+        if (idx == m_entries.size())
+        {
+            Entry e;
+            e.tensor = &t;
+            e.size = t.get_local_real_size() * sizeof(DataType);
+            e.event = h2::gpu::make_event_notiming();
+            m_entries.push_back(e);
+        }
+        auto& e = m_entries[idx];
+        assert_always(e.state == State::RELEASED);
+        alloc_device(e);
+        e.state = State::ON_DEVICE;
+        wait(stream, m_copy_stream, e.event);
+    }
+
+    /** @brief Move t, produced on stream, to host memory. */
+    void offload(TensorType& t, h2::gpu::DeviceStream stream)
+    {
+        auto& e = get_entry(t);
+        assert_always(e.state == State::ON_DEVICE);
+        if (e.host_ptr == nullptr && e.size > 0)
+        {
+            e.host_ptr = internal::RuntimeGPU::get_pinned_memory_pool().get(
+                e.size);
+        }
+        wait(m_copy_stream, stream, e.event);
+        h2::gpu::mem_copy(e.host_ptr, e.dev_ptr, e.size, m_copy_stream);
+        free_device(e);
+        e.state = State::ON_HOST;
+        m_offloaded.push_back(find_entry(t));
+    }
+
+    /** @brief Make the offloaded t available to stream and prefetch
+     *  the tensors the backward pass needs after it.
+     */
+    void fetch(TensorType& t, h2::gpu::DeviceStream stream)
+    {
+        auto& e = get_entry(t);
+        if (e.state == State::ON_HOST)
+        {
+            prefetch(e);
+        }
+        assert_always(e.state == State::ON_DEVICE);
+        // Tensors offloaded after t will not be fetched anymore
+        auto it = std::find(
+            m_offloaded.begin(), m_offloaded.end(), find_entry(t));
+        if (it != m_offloaded.end())
+        {
+            m_offloaded.erase(it, m_offloaded.end());
+        }
+        DISTCONV_CHECK_GPU(GPU_STREAM_WAIT_EVENT(stream, e.event, 0));
+        prefetch_ahead();
+    }
+
+    /** @brief End the use of t by stream in the backward pass. */
+    void release(TensorType& t, h2::gpu::DeviceStream stream)
+    {
+        auto& e = get_entry(t);
+        assert_always(e.state == State::ON_DEVICE);
+        wait(m_copy_stream, stream, e.event);
+        if (e.staged)
+        {
+            m_staged_size -= e.size;
+            e.staged = false;
+        }
+        // The host copy is kept for the next iteration; later copies
+        // into it are ordered on the copy stream.
+        free_device(e);
+        e.state = State::RELEASED;
+        prefetch_ahead();
+    }
+
+    /** @brief Device bytes held by prefetched tensors not released
+     *  yet.
+     */
+    size_t get_staged_size() const { return m_staged_size; }
+
+private:
+    enum class State
+    {
+        ON_DEVICE,
+        ON_HOST,
+        RELEASED
+    };
+
+    struct Entry
+    {
+        TensorType* tensor = nullptr;
+        size_t size = 0;
+        State state = State::RELEASED;
+        void* dev_ptr = nullptr;
+        void* host_ptr = nullptr;
+        // Counted against the staging budget
+        bool staged = false;
+        h2::gpu::DeviceEvent event;
+    };
+
+    size_t m_staging_budget;
+    size_t m_staged_size = 0;
+    h2::gpu::DeviceStream m_copy_stream;
+    std::vector<Entry> m_entries;
+    // Indices of the offloaded entries not fetched yet, in forward
+    // order
+    std::vector<size_t> m_offloaded;
+
+    // Make follower wait for the work queued on master so far
+    static void wait(h2::gpu::DeviceStream follower,
+                     h2::gpu::DeviceStream master,
+                     h2::gpu::DeviceEvent event)
+    {
+        DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(event, master));
+        DISTCONV_CHECK_GPU(GPU_STREAM_WAIT_EVENT(follower, event, 0));
+    }
+
+    size_t find_entry(const TensorType& t) const
+    {
+        for (size_t i = 0; i < m_entries.size(); ++i)
+        {
+            if (m_entries[i].tensor == &t)
+            {
+                return i;
+            }
+        }
+        return m_entries.size();
+    }
+
+    Entry& get_entry(const TensorType& t)
+    {
+        const size_t idx = find_entry(t);
+        if (idx == m_entries.size())
+        {
+            util::MPIPrintStreamError()
+                << "Tensor not allocated by ActivationOffload: " << t;
+            throw std::exception();
+        }
+        return m_entries[idx];
+    }
+
+    void alloc_device(Entry& e)
+    {
+        if (e.size > 0)
+        {
+            e.dev_ptr =
+                distconv::internal::RuntimeGPU::get_device_memory_pool().get(
+                    e.size, m_copy_stream);
+        }
+        View(*e.tensor, static_cast<DataType*>(e.dev_ptr));
+    }
+
+    void free_device(Entry& e)
+    {
+        if (e.dev_ptr)
+        {
+            distconv::internal::RuntimeGPU::get_device_memory_pool().release(
+                e.dev_ptr);
+            e.dev_ptr = nullptr;
+        }
+        View(*e.tensor, static_cast<DataType*>(nullptr));
+    }
+
+    void free_host(Entry& e)
+    {
+        if (e.host_ptr)
+        {
+            internal::RuntimeGPU::get_pinned_memory_pool().release(e.host_ptr);
+            e.host_ptr = nullptr;
+        }
+    }
+
+    void prefetch(Entry& e)
+    {
+        alloc_device(e);
+        h2::gpu::mem_copy(e.dev_ptr, e.host_ptr, e.size, m_copy_stream);
+        DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(e.event, m_copy_stream));
+        e.state = State::ON_DEVICE;
+    }
+
+    void prefetch_ahead()
+    {
+        for (auto it = m_offloaded.rbegin(); it != m_offloaded.rend(); ++it)
+        {
+            auto& e = m_entries[*it];
+            if (e.state != State::ON_HOST)
+            {
+                continue;
+            }
+            if (m_staged_size + e.size > m_staging_budget)
+            {
+                break;
+            }
+            prefetch(e);
+            e.staged = true;
+            m_staged_size += e.size;
+        }
+    }
+};
+
+} // namespace tensor
+} // namespace distconv
@@ -0,0 +1,412 @@
+#pragma once
+
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/allreduce.hpp"
+#include "distconv/tensor/allreduce_al.hpp"
+#include "distconv/tensor/comm_cache.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <Al.hpp>
+#include <h2/gpu/memory_utils.hpp>
+#include <h2/gpu/runtime.hpp>
+
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+  Collectives whose Aluminum backend is chosen per call by the message
+  size. NCCL has a high fixed latency, so tiny collectives, e.g., the
+  per-sample reductions of softmax and the loss layers, are faster with
+  the MPI-CUDA or the host-transfer backends when Aluminum has them.
+
+  The largest message the faster of them is used for is calibrated
+  when the first collective is issued, by timing allreduces of a few
+  sizes with each backend. The thresholds depend on the number of
+  processes and on whether they span nodes, so they are kept per both
+  and reused for other communicators of the same kind. The
+  communicator of each backend is created the first time it is used.
+
+  DISTCONV_AL_COLLECTIVE_BACKEND=NCCL|MPI_CUDA|HOST_TRANSFER forces a
+  backend for all sizes without calibration.
+ */
+
+namespace distconv {
+namespace tensor {
+
+enum class AlCollectiveBackend { NCCL, MPI_CUDA, HOST_TRANSFER };
+
+inline std::ostream &operator<<(std::ostream &os, AlCollectiveBackend b) {
+  switch (b) {
+    case AlCollectiveBackend::NCCL: return os << "NCCL";
+    case AlCollectiveBackend::MPI_CUDA: return os << "MPI_CUDA";
+    case AlCollectiveBackend::HOST_TRANSFER: return os << "HOST_TRANSFER";
+  }
+  return os;
+}
+
+class AlCollectives {
+ public:
+  // Messages up to max_small_bytes use small_backend
+  struct Thresholds {
+    AlCollectiveBackend small_backend = AlCollectiveBackend::NCCL;
+    size_t max_small_bytes = 0;
+  };
+
+  AlCollectives(MPI_Comm comm, h2::gpu::DeviceStream stream):
+      m_comm(comm), m_stream(stream) {
+    DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &m_rank));
+    DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &m_size));
+    m_intranode = util::get_mpi_comm_local_size(comm) == m_size;
+  }
+  AlCollectives(const AlCollectives &) = delete;
+  AlCollectives &operator=(const AlCollectives &) = delete;
+
+  int rank() const { return m_rank; }
+  int size() const { return m_size; }
+  MPI_Comm get_comm() const { return m_comm; }
+  h2::gpu::DeviceStream get_stream() const { return m_stream; }
+  // Whether all the processes are on the same node
+  bool is_intranode() const { return m_intranode; }
+
+  /**
+     Sets the thresholds unless done yet, e.g., at startup so that
+     the first collective is not delayed. Collective.
+   */
+  void calibrate() {
+    if (m_calibrated) return;
+    m_thresholds = get_thresholds();
+    m_calibrated = true;
+    util::MPIPrintStreamDebug()
+        << "Aluminum collectives of " << m_size << " processes"
+        << (m_intranode ? " in a node" : " across nodes") << " use "
+        << m_thresholds.small_backend << " up to "
+        << m_thresholds.max_small_bytes << " bytes and NCCL otherwise";
+  }
+
+  /** Backend of a collective of count elements of type DataType. */
+  template <typename DataType>
+  AlCollectiveBackend select(size_t count) {
+    // The MPI backends reduce only the types MPI has
+    if (!is_mpi_type<DataType>()) return AlCollectiveBackend::NCCL;
+    calibrate();
+    return count * sizeof(DataType) <= m_thresholds.max_small_bytes ?
+        m_thresholds.small_backend : AlCollectiveBackend::NCCL;
+  }
+
+  template <typename DataType>
+  void allreduce(DataType *buf, size_t count, Al::ReductionOperator op) {
+    dispatch<DataType>(count, [&](auto tag, auto &comm) {
+      using Backend = typename decltype(tag)::type;
+      Al::Allreduce<Backend, DataType>(buf, count, op, comm);
+    });
+  }
+
+  template <typename DataType>
+  void allreduce(const DataType *send_buf, DataType *recv_buf, size_t count,
+                 Al::ReductionOperator op) {
+    dispatch<DataType>(count, [&](auto tag, auto &comm) {
+      using Backend = typename decltype(tag)::type;
+      Al::Allreduce<Backend, DataType>(send_buf, recv_buf, count, op, comm);
+    });
+  }
+
+  // count is the number of elements of each process
+  template <typename DataType>
+  void allgather(const DataType *send_buf, DataType *recv_buf,
+                 size_t count) {
+    dispatch<DataType>(count * m_size, [&](auto tag, auto &comm) {
+      using Backend = typename decltype(tag)::type;
+      Al::Allgather<Backend, DataType>(send_buf, recv_buf, count, comm);
+    });
+  }
+
+  template <typename DataType>
+  void bcast(DataType *buf, size_t count, int root) {
+    dispatch<DataType>(count, [&](auto tag, auto &comm) {
+      using Backend = typename decltype(tag)::type;
+      Al::Bcast<Backend, DataType>(buf, count, root, comm);
+    });
+  }
+
+ protected:
+  template <typename Backend>
+  struct Tag {
+    using type = Backend;
+  };
+
+  MPI_Comm m_comm;
+  h2::gpu::DeviceStream m_stream;
+  int m_rank = 0;
+  int m_size = 1;
+  bool m_intranode = true;
+  bool m_calibrated = false;
+  Thresholds m_thresholds;
+  std::shared_ptr<Al::NCCLBackend::comm_type> m_nccl_comm;
+#ifdef AL_HAS_MPI_CUDA
+  std::shared_ptr<Al::MPICUDABackend::comm_type> m_mpi_cuda_comm;
+#endif
+#ifdef AL_HAS_HOST_TRANSFER
+  std::shared_ptr<Al::HostTransferBackend::comm_type> m_ht_comm;
+#endif
+
+  static constexpr int m_num_warmup = 3;
+  static constexpr int m_num_trials = 10;
+  // Sizes of the calibration, from 8 B to 32 KiB
+  static constexpr size_t m_min_calibration_bytes = 8;
+  static constexpr size_t m_max_calibration_bytes = 32 * 1024;
+
+  template <typename DataType>
+  static constexpr bool is_mpi_type() {
+    return std::is_same<DataType, float>::value ||
+        std::is_same<DataType, double>::value ||
+        std::is_same<DataType, int>::value;
+  }
+
+  template <typename Backend>
+  std::shared_ptr<typename Backend::comm_type> &comm_slot();
+
+  template <typename Backend>
+  typename Backend::comm_type &get_backend_comm() {
+    auto &comm = comm_slot<Backend>();
+    if (comm == nullptr) {
+      comm = tensor::get_al_comm<Backend>(m_comm, m_stream);
+    }
+    return *comm;
+  }
+
+  // Calls f(Tag<Backend>(), comm) with the backend selected for count
+  // elements
+  template <typename DataType, typename F>
+  void dispatch(size_t count, F &&f) {
+    if constexpr (is_mpi_type<DataType>()) {
+      switch (select<DataType>(count)) {
+#ifdef AL_HAS_MPI_CUDA
+        case AlCollectiveBackend::MPI_CUDA:
+          f(Tag<Al::MPICUDABackend>(),
+            get_backend_comm<Al::MPICUDABackend>());
+          return;
+#endif
+#ifdef AL_HAS_HOST_TRANSFER
+        case AlCollectiveBackend::HOST_TRANSFER:
+          f(Tag<Al::HostTransferBackend>(),
+            get_backend_comm<Al::HostTransferBackend>());
+          return;
+#endif
+        default:
+          break;
+      }
+    }
+    f(Tag<Al::NCCLBackend>(), get_backend_comm<Al::NCCLBackend>());
+  }
+
+  // The backends other than NCCL Aluminum has
+  static std::vector<AlCollectiveBackend> get_small_candidates() {
+    std::vector<AlCollectiveBackend> candidates;
+#ifdef AL_HAS_MPI_CUDA
+    candidates.push_back(AlCollectiveBackend::MPI_CUDA);
+#endif
+#ifdef AL_HAS_HOST_TRANSFER
+    candidates.push_back(AlCollectiveBackend::HOST_TRANSFER);
+#endif
+    return candidates;
+  }
+
+  Thresholds get_thresholds() {
+    Thresholds th;
+    const char *env = std::getenv("DISTCONV_AL_COLLECTIVE_BACKEND");
+    if (env != nullptr) {
+      const std::string name(env);
+      if (name == "NCCL") {
+        return th;
+      }
+      for (auto b : get_small_candidates()) {
+        std::stringstream ss;
+        ss << b;
+        if (ss.str() == name) {
+          th.small_backend = b;
+          th.max_small_bytes = ~size_t(0);
+          return th;
+        }
+      }
+      util::MPIPrintStreamError()
+          << "Unavailable Aluminum backend: " << name;
+      std::abort();
+    }
+    if (get_small_candidates().empty()) {
+      return th;
+    }
+    // Thresholds calibrated for communicators of the same kind. All
+    // the processes must use those of the root as they may have been
+    // calibrated with different communicators.
+    static std::map<std::pair<int, bool>, Thresholds> cache;
+    const auto key = std::make_pair(m_size, m_intranode);
+    auto it = cache.find(key);
+    int cached = it != cache.end();
+    DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &cached, 1, MPI_INT,
+                                     MPI_MIN, m_comm));
+    if (cached) {
+      th = it->second;
+      DISTCONV_CHECK_MPI(MPI_Bcast(&th, sizeof(Thresholds), MPI_BYTE, 0,
+                                   m_comm));
+      return th;
+    }
+    th = measure_thresholds();
+    cache[key] = th;
+    return th;
+  }
+
+  // Uses the fastest of the candidates at the smallest size as long as
+  // it is faster than NCCL
+  Thresholds measure_thresholds() {
+    Thresholds th;
+    std::vector<size_t> sizes;
+    for (size_t s = m_min_calibration_bytes; s <= m_max_calibration_bytes;
+         s *= 8) {
+      sizes.push_back(s);
+    }
+    auto &pool = internal::RuntimeGPU::get_device_memory_pool();
+    float *buf = static_cast<float *>(
+        pool.get(m_max_calibration_bytes, m_stream));
+    h2::gpu::mem_zero(buf, m_max_calibration_bytes / sizeof(float),
+                      m_stream);
+    const double nccl_small = measure(AlCollectiveBackend::NCCL, buf,
+                                      sizes.front());
+    double best_small = nccl_small;
+    for (auto b : get_small_candidates()) {
+      const double t = measure(b, buf, sizes.front());
+      if (t < best_small) {
+        best_small = t;
+        th.small_backend = b;
+      }
+    }
+    if (th.small_backend != AlCollectiveBackend::NCCL) {
+      th.max_small_bytes = sizes.front();
+      for (size_t i = 1; i < sizes.size(); ++i) {
+        if (measure(th.small_backend, buf, sizes[i]) >=
+            measure(AlCollectiveBackend::NCCL, buf, sizes[i])) {
+          break;
+        }
+        th.max_small_bytes = sizes[i];
+      }
+    }
+    pool.release(buf);
+    util::MPIRootPrintStreamInfo()
+        << "Aluminum collectives of " << m_size << " processes"
+        << (m_intranode ? " in a node" : " across nodes") << ": "
+        << th.small_backend << " up to " << th.max_small_bytes
+        << " bytes, NCCL otherwise";
+    return th;
+  }
+
+  // Time of an allreduce of bytes with backend, maximized over the
+  // processes
+  double measure(AlCollectiveBackend backend, float *buf, size_t bytes) {
+    const size_t count = bytes / sizeof(float);
+    auto run = [&]() {
+      switch (backend) {
+#ifdef AL_HAS_MPI_CUDA
+        case AlCollectiveBackend::MPI_CUDA:
+          Al::Allreduce<Al::MPICUDABackend, float>(
+              buf, count, Al::ReductionOperator::sum,
+              get_backend_comm<Al::MPICUDABackend>());
+          break;
+#endif
+#ifdef AL_HAS_HOST_TRANSFER
+        case AlCollectiveBackend::HOST_TRANSFER:
+          Al::Allreduce<Al::HostTransferBackend, float>(
+              buf, count, Al::ReductionOperator::sum,
+              get_backend_comm<Al::HostTransferBackend>());
+          break;
+#endif
+        default:
+          Al::Allreduce<Al::NCCLBackend, float>(
+              buf, count, Al::ReductionOperator::sum,
+              get_backend_comm<Al::NCCLBackend>());
+          break;
+      }
+    };
+    for (int i = 0; i < m_num_warmup; ++i) {
+      run();
+    }
+    h2::gpu::sync(m_stream);
+    DISTCONV_CHECK_MPI(MPI_Barrier(m_comm));
+    const double start = MPI_Wtime();
+    for (int i = 0; i < m_num_trials; ++i) {
+      run();
+    }
+    h2::gpu::sync(m_stream);
+    double t = (MPI_Wtime() - start) / m_num_trials;
+    DISTCONV_CHECK_MPI(
+        MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, m_comm));
+    return t;
+  }
+};
+
+template <>
+inline std::shared_ptr<Al::NCCLBackend::comm_type> &
+AlCollectives::comm_slot<Al::NCCLBackend>() {
+  return m_nccl_comm;
+}
+
+#ifdef AL_HAS_MPI_CUDA
+template <>
+inline std::shared_ptr<Al::MPICUDABackend::comm_type> &
+AlCollectives::comm_slot<Al::MPICUDABackend>() {
+  return m_mpi_cuda_comm;
+}
+#endif
+
+#ifdef AL_HAS_HOST_TRANSFER
+template <>
+inline std::shared_ptr<Al::HostTransferBackend::comm_type> &
+AlCollectives::comm_slot<Al::HostTransferBackend>() {
+  return m_ht_comm;
+}
+#endif
+
+/**
+   The collectives over comm and stream, created the first time they
+   are requested and cached with comm like get_al_comm, so that the
+   layers over the same ranks share the calibration and the
+   communicators.
+ */
+inline std::shared_ptr<AlCollectives>
+get_al_collectives(MPI_Comm comm, h2::gpu::DeviceStream stream) {
+  return get_comm_object<AlCollectives>(comm, stream, [&]() {
+    return new AlCollectives(comm, stream);
+  });
+}
+
+/*
+  Sum of the processes of comm with the backend selected per count.
+ */
+template <typename DataType>
+class AllreduceAlAuto: public Allreduce<DataType> {
+ public:
+  AllreduceAlAuto(MPI_Comm comm, h2::gpu::DeviceStream stream):
+      Allreduce<DataType>(), m_coll(get_al_collectives(comm, stream)) {}
+  virtual ~AllreduceAlAuto() = default;
+
+  virtual void allreduce(const DataType *send_buf, DataType *recv_buf,
+                         size_t count) override {
+    m_coll->allreduce(send_buf, recv_buf, count,
+                      Al::ReductionOperator::sum);
+  }
+  virtual void allreduce(DataType *buf, size_t count) override {
+    m_coll->allreduce(buf, count, Al::ReductionOperator::sum);
+  }
+
+ protected:
+  std::shared_ptr<AlCollectives> m_coll;
+};
+
+} // namespace tensor
+} // namespace distconv
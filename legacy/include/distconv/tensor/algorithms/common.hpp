@@ -2,16 +2,30 @@
 
 #include "distconv/tensor/tensor.hpp"
 
+#include <cstdlib>
 #include <type_traits>
 
-// Placeholder
-
 namespace distconv {
 namespace tensor {
 namespace algorithms {
 
+inline bool &deterministic_reduction_flag() {
+  static bool deterministic = std::getenv("DISTCONV_DETERMINISTIC") != nullptr;
+  return deterministic;
+}
+
+// Whether reductions sum in a fixed order instead of with atomics, so
+// that their results are reproducible. Enabled by
+// DISTCONV_DETERMINISTIC and by DNN backends created with
+// Options::m_deterministic.
+inline bool use_deterministic_reduction() {
+  return deterministic_reduction_flag();
+}
 
-} // namespace algorithms_cuda
+inline void set_deterministic_reduction(bool deterministic) {
+  deterministic_reduction_flag() = deterministic;
+}
+
+} // namespace algorithms
 } // namespace tensor
 } // namespace distconv
-
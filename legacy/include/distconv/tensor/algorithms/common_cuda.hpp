@@ -1,8 +1,12 @@
 #pragma once
 
 #include "distconv/tensor/tensor.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include "h2/meta/TypeList.hpp"
 
 #include <type_traits>
+#include <utility>
 
 namespace distconv {
 namespace tensor {
@@ -12,6 +16,80 @@ namespace algorithms_cuda {
 constexpr int DEFAULT_BLOCK_SIZE = 256;
 constexpr int DEFAULT_MAX_THREAD_WORK_SIZE = 8;
 
+// Largest rank the kernels of the algorithms are instantiated
+// for. Tensors of higher rank work as long as enough of their
+// dimensions can be collapsed.
+constexpr int MAX_ND = 6;
+
+// The ranks in [FIRST, LAST] as a typelist of ValueAsType.
+template <int FIRST, int LAST>
+struct RankRangeT
+{
+    template <int... Ns>
+    static h2::meta::TL<h2::meta::ValueAsType<int, FIRST + Ns>...>
+        make(std::integer_sequence<int, Ns...>);
+    using type =
+        decltype(make(std::make_integer_sequence<int, LAST - FIRST + 1>()));
+};
+
+template <int FIRST, int LAST>
+using RankRange = typename RankRangeT<FIRST, LAST>::type;
+
+/** @brief Call f with the ValueAsType in a rank typelist that equals
+ *         nd.
+ *
+ *  Lets kernels templated on a rank be launched for a rank known only
+ *  at run time.
+ */
+template <typename F>
+void dispatch_rank(int nd, F&&, h2::meta::TL<>)
+{
+    util::MPIPrintStreamError()
+        << "Tensors with " << nd << " dimensions not supported.";
+    throw std::exception();
+}
+
+template <typename F, typename Rank, typename... Ranks>
+void dispatch_rank(int nd, F&& f, h2::meta::TL<Rank, Ranks...>)
+{
+    if (nd == Rank::value)
+        f(Rank{});
+    else
+        dispatch_rank(nd, std::forward<F>(f), h2::meta::TL<Ranks...>{});
+}
+
+/**
+   Collapse adjacent dimensions that are traversed contiguously, so
+   that shape and strides describe the same elements with as few
+   dimensions as possible. Dimensions of size 1 are dropped. At least
+   one dimension remains.
+ */
+inline void collapse_dims(const Shape &shape, const IndexVector &strides,
+                          Shape &collapsed_shape,
+                          IndexVector &collapsed_strides) {
+  collapsed_shape = Shape();
+  collapsed_strides = IndexVector();
+  for (int i = 0; i < shape.num_dims(); ++i) {
+    if (shape[i] == 1) {
+      continue;
+    }
+    if (collapsed_shape.num_dims() > 0 &&
+        strides[i] == collapsed_strides[-1] * collapsed_shape[-1]) {
+      collapsed_shape[-1] *= shape[i];
+    } else {
+      collapsed_shape.push_back(shape[i]);
+      collapsed_strides.push_back(strides[i]);
+    }
+  }
+  if (collapsed_shape.num_dims() == 0) {
+    collapsed_shape.push_back(1);
+    collapsed_strides.push_back(1);
+  }
+}
+
+// Dimensions 0 and 1 are traversed by the blocks of a grid; the
+// last one is indexed by blockIdx.z and the others in between by
+// blockIdx.y.
 template <int BLOCK_SIZE, int MAX_THREAD_WORK_SIZE>
 void get_grid_dims(const Shape &region, dim3 &grid_dims,
                    int &thread_work_size) {
@@ -24,9 +102,11 @@ void get_grid_dims(const Shape &region, dim3 &grid_dims,
     grid_dims.y = region[-1];
     ++inner_dim_exclude;
   } else if (nd > 3) {
-    grid_dims.y = region[-2];
+    for (int i = 2; i < nd - 1; ++i) {
+      grid_dims.y *= region[i];
+    }
     grid_dims.z = region[-1];
-    inner_dim_exclude += 2;
+    inner_dim_exclude += nd - 2;
   }
   for (int i = 0; i < nd - inner_dim_exclude; ++i) {
     inner_size *= region[i];
@@ -1,11 +1,15 @@
 #pragma once
 
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/algorithms/common.hpp"
 #include "distconv/tensor/algorithms/common_cuda.hpp"
 #include "distconv/tensor/memory_gpu.hpp"
 #include "distconv/tensor/tensor.hpp"
 #include "distconv/util/util_gpu.hpp"
+#include "distconv/util/overflow_gpu.hpp"
 #include "distconv/util/util_mpi.hpp"
 
+#include <algorithm>
 #include <type_traits>
 #if __has_include(<nvfunctional>)
 #define DISTCONV_HAS_NVFUNCTIONAL_HEADER
@@ -53,8 +57,31 @@ public:
 };
 #endif // ifndef DISTCONV_HAS_NVFUNCTIONAL_HEADER
 
+// Offset of the sub-tensor a block of reduce_kernel works on, for a
+// tensor of the given shape and strides. Dimensions of size 1 are
+// broadcast.
+template <int ND>
+__device__ static index_t get_reduce_block_offset(const Array<ND> &src_shape,
+                                                  const Array<ND> &shape,
+                                                  const Array<ND> &strides) {
+  index_t offset = 0;
+  int outer_idx = blockIdx.y;
+#pragma unroll
+  for (int i = 2; i < (ND == 3 ? 3 : ND - 1); ++i) {
+    int idx = outer_idx % src_shape[i];
+    outer_idx /= src_shape[i];
+    if (shape[i] != 1) {
+      offset += idx * strides[i];
+    }
+  }
+  if (ND > 3 && shape[ND - 1] != 1) {
+    offset += blockIdx.z * strides[ND - 1];
+  }
+  return offset;
+}
+
 // Generic implementation using atomicAdd
-// assumes ND == 3 or 4
+// assumes ND >= 3
 template <int ND, typename DataType,
           typename UnaryFunction, int BLOCK_SIZE>
 __global__ static void reduce_kernel(
@@ -65,20 +92,13 @@ __global__ static void reduce_kernel(
     Array<ND> dst_shape,
     Array<ND> dst_strides,
     UnaryFunction op,
-    int thread_work_size) {
+    int thread_work_size,
+    int *overflow) {
   const int tid = threadIdx.x;
   const int inner_size = src_shape[0] * src_shape[1];
   int inner_idx = tid + blockIdx.x * BLOCK_SIZE * thread_work_size;
-  src += blockIdx.y * src_strides[2];
-  if (dst_shape[2] != 1) {
-    dst += blockIdx.y * dst_strides[2];
-  }
-  if (ND == 4) {
-    src += blockIdx.z * src_strides[3];
-    if (dst_shape[3] != 1) {
-      dst += blockIdx.z * dst_strides[3];
-    }
-  }
+  src += get_reduce_block_offset(src_shape, src_shape, src_strides);
+  dst += get_reduce_block_offset(src_shape, dst_shape, dst_strides);
 
 #ifdef DISTCONV_HAS_NVFUNCTIONAL_HEADER
   nvstd::function<DataType(DataType&)> op_func = op;
@@ -100,6 +120,8 @@ __global__ static void reduce_kernel(
       if constexpr (op_func.valid())
           x = op_func(x);
 #endif
+      // The atomic sums are not checked, only their terms
+      util::overflow::check(overflow, x);
       int dst_idx0 = dst_shape[0] != 1 ? idx0 : 0;
       int dst_idx1 = dst_shape[1] != 1 ? idx1 : 0;
       int dst_offset = dst_idx0 + dst_idx1 * dst_strides[1];
@@ -110,6 +132,177 @@ __global__ static void reduce_kernel(
   }
 }
 
+// Deterministic alternative to reduce_kernel that does not use
+// atomics. Block (x, y) sums chunk x of the source elements reduced
+// into output element y in a fixed order. The sum is added to dst if
+// there is only one chunk, and stored to partials otherwise.
+template <int ND, typename DataType,
+          typename UnaryFunction, int BLOCK_SIZE>
+__global__ static void reduce_partial_kernel(
+    const DataType *src,
+    Array<ND> src_strides,
+    FastDivShape<ND> out_shape,
+    FastDivShape<ND> red_shape,
+    DataType *dst,
+    Array<ND> dst_strides,
+    DataType *partials,
+    uint32_t chunk_size,
+    UnaryFunction op,
+    int *overflow) {
+  __shared__ DataType sums[BLOCK_SIZE];
+  const int tid = threadIdx.x;
+  const uint32_t num_chunks = gridDim.x;
+  const uint32_t begin = blockIdx.x * chunk_size;
+  const uint32_t end = min(begin + chunk_size, red_shape.get_size());
+
+#ifdef DISTCONV_HAS_NVFUNCTIONAL_HEADER
+  nvstd::function<DataType(DataType&)> op_func = op;
+  auto const use_op = (op != nullptr);
+#else
+  UnaryFunctionWrapper<UnaryFunction> op_func(op);
+#endif
+
+  for (uint32_t out = blockIdx.y; out < out_shape.get_size();
+       out += gridDim.y) {
+    index_t src_base = 0;
+    index_t dst_offset = 0;
+    uint32_t rem = out;
+#pragma unroll
+    for (int i = 0; i < ND; ++i) {
+      const uint32_t idx = out_shape.divmod(i, rem);
+      src_base += idx * src_strides[i];
+      dst_offset += idx * dst_strides[i];
+    }
+    DataType sum = DataType(0);
+    for (uint32_t r = begin + tid; r < end; r += BLOCK_SIZE) {
+      index_t src_offset = src_base;
+      rem = r;
+#pragma unroll
+      for (int i = 0; i < ND; ++i) {
+        src_offset += red_shape.divmod(i, rem) * src_strides[i];
+      }
+      DataType x = src[src_offset];
+#ifdef DISTCONV_HAS_NVFUNCTIONAL_HEADER
+      if (use_op)
+          x = op_func(x);
+#else
+      if constexpr (op_func.valid())
+          x = op_func(x);
+#endif
+      sum += x;
+    }
+    sums[tid] = sum;
+    __syncthreads();
+#pragma unroll
+    for (int stride = BLOCK_SIZE / 2; stride > 0; stride /= 2) {
+      if (tid < stride) {
+        sums[tid] += sums[tid + stride];
+      }
+      __syncthreads();
+    }
+    if (tid == 0) {
+      if (num_chunks == 1) {
+        dst[dst_offset] += sums[0];
+        util::overflow::check(overflow, dst[dst_offset]);
+      } else {
+        partials[out * num_chunks + blockIdx.x] = sums[0];
+      }
+    }
+    __syncthreads();
+  }
+}
+
+// Adds the partial sums of reduce_partial_kernel, in chunk order, to
+// dst.
+template <int ND, typename DataType>
+__global__ static void reduce_partials_kernel(
+    const DataType *partials,
+    uint32_t num_chunks,
+    FastDivShape<ND> out_shape,
+    DataType *dst,
+    Array<ND> dst_strides,
+    int *overflow) {
+  for (uint32_t out = threadIdx.x + blockIdx.x * blockDim.x;
+       out < out_shape.get_size(); out += blockDim.x * gridDim.x) {
+    DataType sum = DataType(0);
+    for (uint32_t i = 0; i < num_chunks; ++i) {
+      sum += partials[out * num_chunks + i];
+    }
+    index_t dst_offset = 0;
+    uint32_t rem = out;
+#pragma unroll
+    for (int i = 0; i < ND; ++i) {
+      dst_offset += out_shape.divmod(i, rem) * dst_strides[i];
+    }
+    dst[dst_offset] += sum;
+    util::overflow::check(overflow, dst[dst_offset]);
+  }
+}
+
+/**
+   Reduce src into dst like reduce_kernel, but with the same result on
+   every run. Dimensions where dst has extent 1 are reduced, which can
+   be any subset of them. Long reductions are split into chunks summed
+   by separate blocks in a first pass and added up in a second one.
+ */
+template <int ND, int BLOCK_SIZE, typename DataType, typename UnaryFunction>
+void reduce_deterministic(const DataType *src,
+                          const Shape &src_shape,
+                          const Array<ND> &src_strides,
+                          DataType *dst,
+                          const Shape &dst_shape,
+                          const Array<ND> &dst_strides,
+                          const UnaryFunction &op,
+                          h2::gpu::DeviceStream stream) {
+  Shape out_shape(ND, 1);
+  Shape red_shape(ND, 1);
+  for (int i = 0; i < ND; ++i) {
+    if (dst_shape[i] == 1) {
+      red_shape[i] = src_shape[i];
+    } else {
+      out_shape[i] = src_shape[i];
+    }
+  }
+  const size_t out_size = out_shape.size();
+  const size_t red_size = red_shape.size();
+  // Enough chunks to occupy the device when there are few outputs,
+  // while keeping at least BLOCK_SIZE * MAX_THREAD_WORK_SIZE elements
+  // per chunk. Both depend only on the shapes, which keeps the order
+  // of summation fixed.
+  constexpr size_t target_num_blocks = 1 << 16;
+  const size_t num_chunks = std::max<size_t>(
+      1, std::min(util::ceil(red_size,
+                             (size_t) BLOCK_SIZE
+                                 * DEFAULT_MAX_THREAD_WORK_SIZE),
+                  target_num_blocks / out_size));
+  const uint32_t chunk_size = util::ceil(red_size, num_chunks);
+
+  auto &pool = internal::RuntimeGPU::get_device_memory_pool();
+  DataType *partials = nullptr;
+  if (num_chunks > 1) {
+    partials = static_cast<DataType*>(
+        pool.get(out_size * num_chunks * sizeof(DataType), stream));
+  }
+  int *overflow = util::overflow::get_flag();
+  dim3 grid_dims(num_chunks, std::min<size_t>(out_size, 65535));
+  reduce_partial_kernel<ND, DataType, UnaryFunction, BLOCK_SIZE>
+      <<<grid_dims, BLOCK_SIZE, 0, stream>>>(
+          src, src_strides, FastDivShape<ND>(out_shape),
+          FastDivShape<ND>(red_shape), dst, dst_strides, partials,
+          chunk_size, op, overflow);
+  if (num_chunks > 1) {
+    const int grid_dim = util::ceil(out_size, (size_t) BLOCK_SIZE);
+    reduce_partials_kernel<ND, DataType>
+        <<<grid_dim, BLOCK_SIZE, 0, stream>>>(
+            partials, num_chunks, FastDivShape<ND>(out_shape),
+            dst, dst_strides, overflow);
+    // The pool reuses the partials only after the work issued to
+    // stream so far, so the host does not wait for the kernels
+    util::sync_if_synchronous(stream);
+    pool.release(partials);
+  }
+}
+
 inline std::vector<int> find_reduce_dims(const Distribution &src_dist,
                                          const Distribution &dst_dist) {
   std::vector<int> reduction_dims;
@@ -158,7 +351,7 @@ struct ReduceSumFunctor {
             for (int i = 0; i < ND; ++i)
             {
                 // reduce to a single entry or no reduction at all
-                util::MPIPrintStreamDebug()
+                DISTCONV_LOG_DEBUG(Tensor)
                     << "dst_shape[" << i << "]: " << dst_shape[i]
                     << ", src_shape: " << src.get_local_shape()[i];
                 assert_always(dst_shape[i] == 1
@@ -167,17 +360,32 @@ struct ReduceSumFunctor {
             const auto src_strides = get_strides<ND>(
                 local_reduction_shape, src.get_overlap(), src.get_pitch());
             const auto dst_strides = dst.get_strides();
-            reduce_kernel<ND, DataType, UnaryFunction, block_size>
-                <<<grid_dims, block_dims, 0, stream>>>(
+            if (algorithms::use_deterministic_reduction())
+            {
+                reduce_deterministic<ND, block_size>(
                     src.get_const_base_ptr(),
-                    Array<ND>(local_reduction_shape),
+                    local_reduction_shape,
                     src_strides,
                     dst.get_base_ptr(),
                     dst_shape,
-                    dst_strides,
+                    Array<ND>(dst_strides),
                     op,
-                    thread_work_size);
-            h2::gpu::sync(stream);
+                    stream);
+            }
+            else
+            {
+                reduce_kernel<ND, DataType, UnaryFunction, block_size>
+                    <<<grid_dims, block_dims, 0, stream>>>(
+                        src.get_const_base_ptr(),
+                        Array<ND>(local_reduction_shape),
+                        src_strides,
+                        dst.get_base_ptr(),
+                        dst_shape,
+                        dst_strides,
+                        op,
+                        thread_work_size,
+                        util::overflow::get_flag());
+            }
         }
 
         // Finds the dimensions to reduce. Note that a dimension is not
@@ -185,14 +393,14 @@ struct ReduceSumFunctor {
         // != locale_shape.
         std::vector<int> reduction_dims =
             find_reduce_dims(src.get_distribution(), dst.get_distribution());
-        dst.allreduce(reduction_dims);
+        dst.allreduce(reduction_dims, stream);
 
         return 0;
     }
 };
 
 // Generic implementation using atomicAdd
-// assumes ND == 3 or 4
+// assumes ND >= 3
 template <int ND, typename DataType,
           typename UnaryFunction1, typename UnaryFunction2, int BLOCK_SIZE>
 __global__ static void reduce_kernel2(
@@ -207,26 +415,14 @@ __global__ static void reduce_kernel2(
     Array<ND> dst2_shape,
     Array<ND> dst2_strides,
     const UnaryFunction2 op2,
-    int thread_work_size) {
+    int thread_work_size,
+    int *overflow) {
   const int tid = threadIdx.x;
   const int inner_size = src_shape[0] * src_shape[1];
   int inner_idx = tid + blockIdx.x * BLOCK_SIZE * thread_work_size;
-  src += blockIdx.y * src_strides[2];
-  if (dst1_shape[2] != 1) {
-    dst1 += blockIdx.y * dst1_strides[2];
-  }
-  if (dst2_shape[2] != 1) {
-    dst2 += blockIdx.y * dst2_strides[2];
-  }
-  if (ND == 4) {
-    src += blockIdx.z * src_strides[3];
-    if (dst1_shape[3] != 1) {
-      dst1 += blockIdx.z * dst1_strides[3];
-    }
-    if (dst2_shape[3] != 1) {
-      dst2 += blockIdx.z * dst2_strides[3];
-    }
-  }
+  src += get_reduce_block_offset(src_shape, src_shape, src_strides);
+  dst1 += get_reduce_block_offset(src_shape, dst1_shape, dst1_strides);
+  dst2 += get_reduce_block_offset(src_shape, dst2_shape, dst2_strides);
 
 #ifdef DISTCONV_HAS_NVFUNCTIONAL_HEADER
   nvstd::function<DataType(DataType)> op1_func = op1;
@@ -257,6 +453,7 @@ __global__ static void reduce_kernel2(
       int dst1_idx0 = dst1_shape[0] != 1 ? idx0 : 0;
       int dst1_idx1 = dst1_shape[1] != 1 ? idx1 : 0;
       int dst1_offset = dst1_idx0 + dst1_idx1 * dst1_strides[1];
+      util::overflow::check(overflow, y1);
       atomicAdd(&dst1[dst1_offset], y1);
       DataType y2 = x;
 #ifdef DISTCONV_HAS_NVFUNCTIONAL_HEADER
@@ -271,6 +468,7 @@ __global__ static void reduce_kernel2(
       int dst2_idx0 = dst2_shape[0] != 1 ? idx0 : 0;
       int dst2_idx1 = dst2_shape[1] != 1 ? idx1 : 0;
       int dst2_offset = dst2_idx0 + dst2_idx1 * dst2_strides[1];
+      util::overflow::check(overflow, y2);
       atomicAdd(&dst2[dst2_offset], y2);
     }
     inner_idx += BLOCK_SIZE;
@@ -305,32 +503,58 @@ struct ReduceSumFunctor2 {
                 local_reduction_shape, src.get_overlap(), src.get_pitch());
             const auto dst1_strides = dst1.get_strides();
             const auto dst2_strides = dst2.get_strides();
-            reduce_kernel2<ND,
-                           typename Tensor::data_type,
-                           UnaryFunction1,
-                           UnaryFunction2,
-                           block_size><<<grid_dims, block_dims, 0, stream>>>(
-                src.get_base_ptr(),
-                Array<ND>(local_reduction_shape),
-                src_strides,
-                dst1.get_base_ptr(),
-                dst1_shape,
-                dst1_strides,
-                op1,
-                dst2.get_base_ptr(),
-                dst2_shape,
-                dst2_strides,
-                op2,
-                thread_work_size);
-            h2::gpu::sync(stream);
+            if (algorithms::use_deterministic_reduction())
+            {
+                // Reads src once per destination
+                reduce_deterministic<ND, block_size>(
+                    src.get_const_base_ptr(),
+                    local_reduction_shape,
+                    src_strides,
+                    dst1.get_base_ptr(),
+                    dst1_shape,
+                    Array<ND>(dst1_strides),
+                    op1,
+                    stream);
+                reduce_deterministic<ND, block_size>(
+                    src.get_const_base_ptr(),
+                    local_reduction_shape,
+                    src_strides,
+                    dst2.get_base_ptr(),
+                    dst2_shape,
+                    Array<ND>(dst2_strides),
+                    op2,
+                    stream);
+            }
+            else
+            {
+                reduce_kernel2<ND,
+                               typename Tensor::data_type,
+                               UnaryFunction1,
+                               UnaryFunction2,
+                               block_size>
+                    <<<grid_dims, block_dims, 0, stream>>>(
+                        src.get_base_ptr(),
+                        Array<ND>(local_reduction_shape),
+                        src_strides,
+                        dst1.get_base_ptr(),
+                        dst1_shape,
+                        dst1_strides,
+                        op1,
+                        dst2.get_base_ptr(),
+                        dst2_shape,
+                        dst2_strides,
+                        op2,
+                        thread_work_size,
+                        util::overflow::get_flag());
+            }
         }
 
         std::vector<int> reduction_dims =
             find_reduce_dims(src.get_distribution(), dst1.get_distribution());
-        dst1.allreduce(reduction_dims);
+        dst1.allreduce(reduction_dims, stream);
         reduction_dims =
             find_reduce_dims(src.get_distribution(), dst2.get_distribution());
-        dst2.allreduce(reduction_dims);
+        dst2.allreduce(reduction_dims, stream);
         return 0;
     }
 };
@@ -372,7 +596,7 @@ ReduceSum(Tensor<DataType, Locale, Allocator>& src,
           Tensor<DataType, Locale, Allocator>& dst,
           h2::gpu::DeviceStream stream = 0)
 {
-    assert_always(ND == 3 || ND == 4);
+    static_assert(ND >= 3, "Reductions need at least 3 dimensions");
     algorithms_cuda::reduction_sanity_check(src, dst);
     using TensorType = Tensor<DataType, Locale, Allocator>;
     return algorithms_cuda::ReduceSumFunctor<ND, TensorType, std::nullptr_t>()(
@@ -388,7 +612,7 @@ ReduceSum(Tensor<DataType, Locale, Allocator>& src,
           Tensor<DataType, Locale, Allocator>& dst,
           h2::gpu::DeviceStream stream = 0)
 {
-    assert_always(ND == 3 || ND == 4);
+    static_assert(ND >= 3, "Reductions need at least 3 dimensions");
     algorithms_cuda::reduction_sanity_check<ND, DataType, Locale, Allocator>(
         src, dst);
     using TensorType = Tensor<DataType, Locale, Allocator>;
@@ -404,7 +628,7 @@ ReduceSum(Tensor<DataType, Locale, Allocator>& src,
           Tensor<DataType, Locale, Allocator>& dst2,
           h2::gpu::DeviceStream stream = 0)
 {
-    assert_always(ND == 3 || ND == 4);
+    static_assert(ND >= 3, "Reductions need at least 3 dimensions");
     algorithms_cuda::reduction_sanity_check(src, dst1);
     algorithms_cuda::reduction_sanity_check(src, dst2);
     using TensorType = Tensor<DataType, Locale, Allocator>;
@@ -426,7 +650,7 @@ ReduceSum(Tensor<DataType, Locale, Allocator>& src,
           Tensor<DataType, Locale, Allocator>& dst2,
           h2::gpu::DeviceStream stream = 0)
 {
-    assert_always(ND == 3 || ND == 4);
+    static_assert(ND >= 3, "Reductions need at least 3 dimensions");
     algorithms_cuda::reduction_sanity_check(src, dst1);
     algorithms_cuda::reduction_sanity_check(src, dst2);
     using TensorType = Tensor<DataType, Locale, Allocator>;
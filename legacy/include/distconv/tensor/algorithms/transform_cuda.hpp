@@ -5,6 +5,7 @@
 #include "distconv/tensor/memory_gpu.hpp"
 #include "distconv/tensor/tensor.hpp"
 
+#include <cstdint>
 #include <type_traits>
 
 namespace distconv {
@@ -15,16 +16,15 @@ template <int ND, typename DataType, int BLOCK_SIZE,
           int INNER_DIM,
           typename TransformFunc>
 __global__ void transform_kernel(
-    Array<ND> shape,
+    FastDivShape<ND> shape,
     Array<ND> strides,
     DataType *data,
     TransformFunc op,
     int thread_work_size,
-    int num_inner_blocks) {
+    h2::FastDiv<uint32_t> num_inner_blocks) {
   const int tid = threadIdx.x;
-  int bid = blockIdx.x;
-  int inner_bid = bid % num_inner_blocks;
-  bid /= num_inner_blocks;
+  uint32_t bid, inner_bid;
+  num_inner_blocks.divmod(blockIdx.x, bid, inner_bid);
   int inner_idx = tid + inner_bid * BLOCK_SIZE * thread_work_size;
   int inner_size = 1;
 #pragma unroll
@@ -33,18 +33,15 @@ __global__ void transform_kernel(
   }
 #pragma unroll
   for (int i = INNER_DIM + 1; i < ND; ++i) {
-    data += strides[i] * (bid % shape[i]);
-    bid /= shape[i];
+    data += strides[i] * shape.divmod(i, bid);
   }
 
   for (int i = 0; i < thread_work_size; ++i) {
     int tensor_offset = 0;
-    int inner_idx_i = inner_idx;
+    uint32_t inner_idx_i = inner_idx;
 #pragma unroll
     for (int j = 0; j <= INNER_DIM; ++j) {
-      int idx_j = inner_idx_i % shape[j];
-      tensor_offset += strides[j] * idx_j;
-      inner_idx_i /= shape[j];
+      tensor_offset += strides[j] * shape.divmod(j, inner_idx_i);
     }
     if (inner_idx < inner_size) {
       op(data[tensor_offset]);
@@ -53,55 +50,18 @@ __global__ void transform_kernel(
   }
 }
 
-template <int BLOCK_SIZE,
-          int INNER_DIM,
-          typename DataType,
-          typename TransformFunc>
-void transform(Shape shape,
-               IndexVector strides,
-               DataType* data,
-               TransformFunc op,
-               int thread_work_size,
-               int num_inner_blocks,
-               const dim3& grid_dims,
-               const dim3& block_dims,
-               h2::gpu::DeviceStream stream)
-{
-    const int nd = shape.num_dims();
-
-#define CALL_KERNEL(ND)                                                 \
-  transform_kernel<ND, DataType, BLOCK_SIZE, INNER_DIM, TransformFunc>  \
-      <<<grid_dims, block_dims, 0, stream>>>(                           \
-          Array<ND>(shape), Array<ND>(strides),                         \
-          data, op, thread_work_size, num_inner_blocks)
-
-  switch (nd) {
-    case 3:
-      CALL_KERNEL(3);
-      break;
-    case 4:
-      CALL_KERNEL(4);
-      break;
-    case 5:
-      CALL_KERNEL(5);
-      break;
-    default:
-      throw std::exception();
-  }
-#undef CALL_KERNEL
-}
-
 template <int ND, typename DataType1, typename DataType2,
           int BLOCK_SIZE, int INNER_DIM,
           typename TransformFunc>
-__global__ void transform_kernel(Array<ND> shape, Array<ND> strides,
+__global__ void transform_kernel(FastDivShape<ND> shape,
+                                 Array<ND> strides,
                                  DataType1 *data1, DataType2 *data2,
                                  TransformFunc op,
-                                 int thread_work_size, int num_inner_blocks) {
+                                 int thread_work_size,
+                                 h2::FastDiv<uint32_t> num_inner_blocks) {
   const int tid = threadIdx.x;
-  int bid = blockIdx.x;
-  int inner_bid = bid % num_inner_blocks;
-  bid /= num_inner_blocks;
+  uint32_t bid, inner_bid;
+  num_inner_blocks.divmod(blockIdx.x, bid, inner_bid);
   int inner_idx = tid + inner_bid * BLOCK_SIZE * thread_work_size;
   int inner_size = 1;
 #pragma unroll
@@ -110,20 +70,17 @@ __global__ void transform_kernel(Array<ND> shape, Array<ND> strides,
   }
 #pragma unroll
   for (int i = INNER_DIM + 1; i < ND; ++i) {
-    index_t offset = strides[i] * (bid % shape[i]);
+    index_t offset = strides[i] * shape.divmod(i, bid);
     data1 += offset;
     data2 += offset;
-    bid /= shape[i];
   }
 
   for (int i = 0; i < thread_work_size; ++i) {
     int tensor_offset = 0;
-    int inner_idx_i = inner_idx;
+    uint32_t inner_idx_i = inner_idx;
 #pragma unroll
     for (int j = 0; j <= INNER_DIM; ++j) {
-      int idx_j = inner_idx_i % shape[j];
-      tensor_offset += strides[j] * idx_j;
-      inner_idx_i /= shape[j];
+      tensor_offset += strides[j] * shape.divmod(j, inner_idx_i);
     }
     if (inner_idx < inner_size) {
       op(data1[tensor_offset],
@@ -133,59 +90,18 @@ __global__ void transform_kernel(Array<ND> shape, Array<ND> strides,
   }
 }
 
-template <int BLOCK_SIZE,
-          int INNER_DIM,
-          typename DataType1,
-          typename DataType2,
-          typename TransformFunc>
-void transform(Shape shape,
-               IndexVector strides,
-               DataType1* data1,
-               DataType2* data2,
-               TransformFunc op,
-               int thread_work_size,
-               int num_inner_blocks,
-               const dim3& grid_dims,
-               const dim3& block_dims,
-               h2::gpu::DeviceStream stream)
-{
-    const int nd = shape.num_dims();
-
-#define CALL_KERNEL(ND)                                                 \
-  transform_kernel<ND, DataType1, DataType2, BLOCK_SIZE, INNER_DIM,     \
-                   TransformFunc>                                       \
-      <<<grid_dims, block_dims, 0, stream>>>(                           \
-          Array<ND>(shape), Array<ND>(strides),                         \
-          data1, data2,                                                 \
-          op, thread_work_size, num_inner_blocks)
-
-  switch (nd) {
-    case 3:
-      CALL_KERNEL(3);
-      break;
-    case 4:
-      CALL_KERNEL(4);
-      break;
-    case 5:
-      CALL_KERNEL(5);
-      break;
-    default:
-      throw std::exception();
-  }
-#undef CALL_KERNEL
-}
-
 template <int ND, typename DataType1, typename DataType2, typename DataType3,
           int BLOCK_SIZE, int INNER_DIM, typename TransformFunc>
-__global__ void transform_kernel(Array<ND> shape, Array<ND> strides,
+__global__ void transform_kernel(FastDivShape<ND> shape,
+                                 Array<ND> strides,
                                  DataType1 *data1, DataType2 *data2,
                                  DataType3 *data3,
                                  TransformFunc op,
-                                 int thread_work_size, int num_inner_blocks) {
+                                 int thread_work_size,
+                                 h2::FastDiv<uint32_t> num_inner_blocks) {
   const int tid = threadIdx.x;
-  int bid = blockIdx.x;
-  int inner_bid = bid % num_inner_blocks;
-  bid /= num_inner_blocks;
+  uint32_t bid, inner_bid;
+  num_inner_blocks.divmod(blockIdx.x, bid, inner_bid);
   int inner_idx = tid + inner_bid * BLOCK_SIZE * thread_work_size;
   int inner_size = 1;
 #pragma unroll
@@ -194,21 +110,18 @@ __global__ void transform_kernel(Array<ND> shape, Array<ND> strides,
   }
 #pragma unroll
   for (int i = INNER_DIM + 1; i < ND; ++i) {
-    index_t offset = strides[i] * (bid % shape[i]);
+    index_t offset = strides[i] * shape.divmod(i, bid);
     data1 += offset;
     data2 += offset;
     data3 += offset;
-    bid /= shape[i];
   }
 
   for (int i = 0; i < thread_work_size; ++i) {
     int tensor_offset = 0;
-    int inner_idx_i = inner_idx;
+    uint32_t inner_idx_i = inner_idx;
 #pragma unroll
     for (int j = 0; j <= INNER_DIM; ++j) {
-      int idx_j = inner_idx_i % shape[j];
-      tensor_offset += strides[j] * idx_j;
-      inner_idx_i /= shape[j];
+      tensor_offset += strides[j] * shape.divmod(j, inner_idx_i);
     }
     if (inner_idx < inner_size) {
       op(data1[tensor_offset],
@@ -219,62 +132,19 @@ __global__ void transform_kernel(Array<ND> shape, Array<ND> strides,
   }
 }
 
-template <int BLOCK_SIZE,
-          int INNER_DIM,
-          typename DataType1,
-          typename DataType2,
-          typename DataType3,
-          typename TransformFunc>
-void transform(Shape shape,
-               IndexVector strides,
-               DataType1* data1,
-               DataType2* data2,
-               DataType3* data3,
-               TransformFunc op,
-               int thread_work_size,
-               int num_inner_blocks,
-               const dim3& grid_dims,
-               const dim3& block_dims,
-               h2::gpu::DeviceStream stream)
-{
-    const int nd = shape.num_dims();
-
-#define CALL_KERNEL(ND)                                                 \
-  transform_kernel<ND, DataType1, DataType2, DataType3, BLOCK_SIZE,     \
-                   INNER_DIM, TransformFunc>                            \
-      <<<grid_dims, block_dims, 0, stream>>>(                           \
-          Array<ND>(shape), Array<ND>(strides),                         \
-          data1, data2, data3,                                          \
-          op, thread_work_size, num_inner_blocks)
-
-  switch (nd) {
-    case 3:
-      CALL_KERNEL(3);
-      break;
-    case 4:
-      CALL_KERNEL(4);
-      break;
-    case 5:
-      CALL_KERNEL(5);
-      break;
-    default:
-      throw std::exception();
-  }
-#undef CALL_KERNEL
-}
-
 template <int ND, typename DataType1, typename DataType2, typename DataType3,
           typename DataType4, int BLOCK_SIZE, int INNER_DIM,
           typename TransformFunc>
-__global__ void transform_kernel(Array<ND> shape, Array<ND> strides,
+__global__ void transform_kernel(FastDivShape<ND> shape,
+                                 Array<ND> strides,
                                  DataType1 *data1, DataType2 *data2,
                                  DataType3 *data3, DataType4 *data4,
                                  TransformFunc op,
-                                 int thread_work_size, int num_inner_blocks) {
+                                 int thread_work_size,
+                                 h2::FastDiv<uint32_t> num_inner_blocks) {
   const int tid = threadIdx.x;
-  int bid = blockIdx.x;
-  int inner_bid = bid % num_inner_blocks;
-  bid /= num_inner_blocks;
+  uint32_t bid, inner_bid;
+  num_inner_blocks.divmod(blockIdx.x, bid, inner_bid);
   int inner_idx = tid + inner_bid * BLOCK_SIZE * thread_work_size;
   int inner_size = 1;
 #pragma unroll
@@ -283,22 +153,19 @@ __global__ void transform_kernel(Array<ND> shape, Array<ND> strides,
   }
 #pragma unroll
   for (int i = INNER_DIM + 1; i < ND; ++i) {
-    index_t offset = strides[i] * (bid % shape[i]);
+    index_t offset = strides[i] * shape.divmod(i, bid);
     data1 += offset;
     data2 += offset;
     data3 += offset;
     data4 += offset;
-    bid /= shape[i];
   }
 
   for (int i = 0; i < thread_work_size; ++i) {
     int tensor_offset = 0;
-    int inner_idx_i = inner_idx;
+    uint32_t inner_idx_i = inner_idx;
 #pragma unroll
     for (int j = 0; j <= INNER_DIM; ++j) {
-      int idx_j = inner_idx_i % shape[j];
-      tensor_offset += strides[j] * idx_j;
-      inner_idx_i /= shape[j];
+      tensor_offset += strides[j] * shape.divmod(j, inner_idx_i);
     }
     if (inner_idx < inner_size) {
       op(data1[tensor_offset],
@@ -310,48 +177,63 @@ __global__ void transform_kernel(Array<ND> shape, Array<ND> strides,
   }
 }
 
-template <int BLOCK_SIZE,
-          int INNER_DIM,
-          typename DataType1,
-          typename DataType2,
-          typename DataType3,
-          typename DataType4,
-          typename TransformFunc>
-void transform(Shape shape,
-               IndexVector strides,
-               DataType1* data1,
-               DataType2* data2,
-               DataType3* data3,
-               DataType4* data4,
+// Launches op over the elements of tensors that share shape and
+// strides. Dimensions traversed contiguously are collapsed first, so
+// that kernels for a handful of ranks serve tensors of any rank.
+template <typename TransformFunc, typename... DataTypes>
+void transform(const Shape& shape,
+               const IndexVector& strides,
                TransformFunc op,
-               int thread_work_size,
-               int num_inner_blocks,
-               const dim3& grid_dims,
-               const dim3& block_dims,
-               h2::gpu::DeviceStream stream)
+               h2::gpu::DeviceStream stream,
+               DataTypes*... data)
 {
-    const int nd = shape.num_dims();
-#define CALL_KERNEL(ND)                                                 \
-  transform_kernel<ND, DataType1, DataType2, DataType3, DataType4,      \
-                   BLOCK_SIZE, INNER_DIM, TransformFunc>                \
-      <<<grid_dims, block_dims, 0, stream>>>(                           \
-          Array<ND>(shape), Array<ND>(strides),                         \
-          data1, data2, data3, data4,                                   \
-          op, thread_work_size, num_inner_blocks)
-  switch (nd) {
-    case 3:
-      CALL_KERNEL(3);
-      break;
-    case 4:
-      CALL_KERNEL(4);
-      break;
-    case 5:
-      CALL_KERNEL(5);
-      break;
-    default:
-      throw std::exception();
-  }
-#undef CALL_KERNEL
+    Shape collapsed_shape;
+    IndexVector collapsed_strides;
+    collapse_dims(shape, strides, collapsed_shape, collapsed_strides);
+
+    constexpr int block_size = DEFAULT_BLOCK_SIZE;
+    constexpr int max_thread_work_size = DEFAULT_MAX_THREAD_WORK_SIZE;
+    dim3 block_dims(block_size);
+    int thread_work_size;
+    dim3 grid_dims(0);
+    int inner_dim;
+    int num_inner_blocks;
+    get_grid_dims2<block_size, max_thread_work_size>(collapsed_shape,
+                                                     grid_dims,
+                                                     thread_work_size,
+                                                     inner_dim,
+                                                     num_inner_blocks);
+
+    DISTCONV_LOG_DEBUG(Tensor)
+        << "grid_dim: " << grid_dims.x << ", inner dim: " << inner_dim
+        << ", num_inner_blocks: " << num_inner_blocks
+        << ", collapsed shape: " << collapsed_shape
+        << ", collapsed strides: " << collapsed_strides;
+
+    dispatch_rank(
+        collapsed_shape.num_dims(),
+        [&](auto nd) {
+            constexpr int ND = decltype(nd)::value;
+            dispatch_rank(
+                inner_dim,
+                [&](auto inner) {
+                    constexpr int INNER_DIM = decltype(inner)::value;
+                    transform_kernel<ND,
+                                     DataTypes...,
+                                     block_size,
+                                     INNER_DIM,
+                                     TransformFunc>
+                        <<<grid_dims, block_dims, 0, stream>>>(
+                            FastDivShape<ND>(collapsed_shape),
+                            Array<ND>(collapsed_strides),
+                            data...,
+                            op,
+                            thread_work_size,
+                            h2::FastDiv<uint32_t>(num_inner_blocks));
+                },
+                RankRange<0, ND - 1>{});
+        },
+        RankRange<1, MAX_ND>{});
 }
 
 } // namespace algorithms_cuda
@@ -366,64 +248,11 @@ Transform(Tensor& tensor, TransformFunc op, h2::gpu::DeviceStream stream = 0)
     if (tensor.get_local_size() == 0)
         return 0;
 
-    constexpr int block_size = algo::DEFAULT_BLOCK_SIZE;
-    constexpr int max_thread_work_size = algo::DEFAULT_MAX_THREAD_WORK_SIZE;
-    dim3 block_dims(block_size);
-    int thread_work_size;
-    dim3 grid_dims(0);
-    int inner_dim;
-    int num_inner_blocks;
-    algo::get_grid_dims2<block_size, max_thread_work_size>(
-        tensor.get_local_shape(),
-        grid_dims,
-        thread_work_size,
-        inner_dim,
-        num_inner_blocks);
-
     const auto shape = tensor.get_local_shape();
     const auto strides =
         get_strides(shape, tensor.get_overlap(), tensor.get_pitch());
-
-    util::MPIPrintStreamDebug()
-        << "grid_dim: " << grid_dims.x << ", inner dim: " << inner_dim
-        << ", num_inner_blocks: " << num_inner_blocks;
-
-    if (tensor.get_num_dims() > 5)
-    {
-        // The below switch block assumes ND <= 5. Otherwise, inner_dim
-        // can be >= 5, and the default case would hit. Simply repeating
-        // the case block would work.
-        util::MPIPrintStreamError()
-            << "Tensors with 6 or larger number of dimensions not supported.";
-        throw std::exception();
-    }
-
-#define CALL_TRANFORM(INNER_DIM)                                        \
-  algo::transform<block_size, INNER_DIM>(                               \
-      shape, strides, tensor.get_base_ptr(), op,                        \
-      thread_work_size, num_inner_blocks, grid_dims, block_dims, stream)
-
-  switch (inner_dim) {
-    case 0:
-      CALL_TRANFORM(0);
-      break;
-    case 1:
-      CALL_TRANFORM(1);
-      break;
-    case 2:
-      CALL_TRANFORM(2);
-      break;
-    case 3:
-      CALL_TRANFORM(3);
-      break;
-    case 4:
-      CALL_TRANFORM(4);
-      break;
-    default:
-      throw std::exception();
-  }
-#undef CALL_TRANFORM
-  return 0;
+    algo::transform(shape, strides, op, stream, tensor.get_base_ptr());
+    return 0;
 }
 
 template <typename Tensor1, typename Tensor2, typename TransformFunc>
@@ -449,64 +278,16 @@ Transform(Tensor1& tensor1,
     if (tensor1.get_local_size() == 0)
         return 0;
 
-    constexpr int block_size = algo::DEFAULT_BLOCK_SIZE;
-    constexpr int max_thread_work_size = algo::DEFAULT_MAX_THREAD_WORK_SIZE;
-    dim3 block_dims(block_size);
-    int thread_work_size;
-    dim3 grid_dims(0);
-    int inner_dim;
-    int num_inner_blocks;
-    algo::get_grid_dims2<block_size, max_thread_work_size>(
-        tensor1.get_local_shape(),
-        grid_dims,
-        thread_work_size,
-        inner_dim,
-        num_inner_blocks);
-
     const auto shape = tensor1.get_local_shape();
     const auto strides =
         get_strides(shape, tensor1.get_overlap(), tensor1.get_pitch());
-
-    util::MPIPrintStreamDebug()
-        << "grid_dim: " << grid_dims.x << ", inner dim: " << inner_dim
-        << ", num_inner_blocks: " << num_inner_blocks << ", shape: " << shape
-        << ", strides: " << strides;
-
-    if (tensor1.get_num_dims() > 5)
-    {
-        // The below switch block assumes ND <= 5. Otherwise, inner_dim
-        // can be >= 5, and the default case would hit. Simply repeating
-        // the case block would work.
-        util::MPIPrintStreamError()
-            << "Tensors with 6 or larger number of dimensions not supported.";
-        throw std::exception();
-    }
-
-#define CALL_TRANFORM(INNER_DIM) \
-  algo::transform<block_size, INNER_DIM>( \
-      shape, strides, tensor1.get_base_ptr(), tensor2.get_base_ptr(),   \
-      op, thread_work_size, num_inner_blocks, grid_dims, block_dims, stream);
-  switch (inner_dim) {
-    case 0:
-      CALL_TRANFORM(0);
-      break;
-    case 1:
-      CALL_TRANFORM(1);
-      break;
-    case 2:
-      CALL_TRANFORM(2);
-      break;
-    case 3:
-      CALL_TRANFORM(3);
-      break;
-    case 4:
-      CALL_TRANFORM(4);
-      break;
-    default:
-      throw std::exception();
-  }
-#undef CALL_TRANFORM
-  return 0;
+    algo::transform(shape,
+                    strides,
+                    op,
+                    stream,
+                    tensor1.get_base_ptr(),
+                    tensor2.get_base_ptr());
+    return 0;
 }
 
 template <typename Tensor1,
@@ -538,64 +319,17 @@ Transform(Tensor1& tensor1,
     if (tensor1.get_local_size() == 0)
         return 0;
 
-    constexpr int block_size = algo::DEFAULT_BLOCK_SIZE;
-    constexpr int max_thread_work_size = algo::DEFAULT_MAX_THREAD_WORK_SIZE;
-    dim3 block_dims(block_size);
-    int thread_work_size;
-    dim3 grid_dims(0);
-    int inner_dim;
-    int num_inner_blocks;
-    algo::get_grid_dims2<block_size, max_thread_work_size>(
-        tensor1.get_local_shape(),
-        grid_dims,
-        thread_work_size,
-        inner_dim,
-        num_inner_blocks);
-
     const auto shape = tensor1.get_local_shape();
     const auto strides =
         get_strides(shape, tensor1.get_overlap(), tensor1.get_pitch());
-
-    util::MPIPrintStreamDebug()
-        << "grid_dim: " << grid_dims.x << ", inner dim: " << inner_dim
-        << ", num_inner_blocks: " << num_inner_blocks;
-
-    if (tensor1.get_num_dims() > 5)
-    {
-        // The below switch block assumes ND <= 5. Otherwise, inner_dim
-        // can be >= 5, and the default case would hit. Simply repeating
-        // the case block would work.
-        util::MPIPrintStreamError()
-            << "Tensors with 6 or larger number of dimensions not supported.";
-        throw std::exception();
-    }
-#define CALL_TRANFORM(INNER_DIM)                                        \
-  algo::transform<block_size, INNER_DIM>(                               \
-      shape, strides, tensor1.get_base_ptr(), tensor2.get_base_ptr(),   \
-      tensor3.get_base_ptr(), op, thread_work_size, num_inner_blocks,   \
-      grid_dims, block_dims, stream)
-
-  switch (inner_dim) {
-    case 0:
-      CALL_TRANFORM(0);
-      break;
-    case 1:
-      CALL_TRANFORM(1);
-      break;
-    case 2:
-      CALL_TRANFORM(2);
-      break;
-    case 3:
-      CALL_TRANFORM(3);
-      break;
-    case 4:
-      CALL_TRANFORM(4);
-      break;
-    default:
-      throw std::exception();
-  }
-#undef CALL_TRANFORM
-  return 0;
+    algo::transform(shape,
+                    strides,
+                    op,
+                    stream,
+                    tensor1.get_base_ptr(),
+                    tensor2.get_base_ptr(),
+                    tensor3.get_base_ptr());
+    return 0;
 }
 
 template <typename Tensor1,
@@ -632,64 +366,18 @@ Transform(Tensor1& tensor1,
     if (tensor1.get_local_size() == 0)
         return 0;
 
-    constexpr int block_size = algo::DEFAULT_BLOCK_SIZE;
-    constexpr int max_thread_work_size = algo::DEFAULT_MAX_THREAD_WORK_SIZE;
-    dim3 block_dims(block_size);
-    int thread_work_size;
-    dim3 grid_dims(0);
-    int inner_dim;
-    int num_inner_blocks;
-    algo::get_grid_dims2<block_size, max_thread_work_size>(
-        tensor1.get_local_shape(),
-        grid_dims,
-        thread_work_size,
-        inner_dim,
-        num_inner_blocks);
-
     const auto shape = tensor1.get_local_shape();
     const auto strides =
         get_strides(shape, tensor1.get_overlap(), tensor1.get_pitch());
-
-    util::MPIPrintStreamDebug()
-        << "grid_dim: " << grid_dims.x << ", inner dim: " << inner_dim
-        << ", num_inner_blocks: " << num_inner_blocks << "\n";
-
-    if (tensor1.get_num_dims() > 5)
-    {
-        // The below switch block assumes ND <= 5. Otherwise, inner_dim
-        // can be >= 5, and the default case would hit. Simply repeating
-        // the case block would work.
-        util::MPIPrintStreamError()
-            << "Tensors with 6 or larger number of dimensions not supported.";
-        throw std::exception();
-    }
-#define CALL_TRANFORM(INNER_DIM)                                        \
-  algo::transform<block_size, INNER_DIM>(                               \
-      shape, strides, tensor1.get_base_ptr(), tensor2.get_base_ptr(),   \
-      tensor3.get_base_ptr(), tensor4.get_base_ptr(),                   \
-      op, thread_work_size, num_inner_blocks, grid_dims, block_dims, stream);
-
-  switch (inner_dim) {
-    case 0:
-      CALL_TRANFORM(0);
-      break;
-    case 1:
-      CALL_TRANFORM(1);
-      break;
-    case 2:
-      CALL_TRANFORM(2);
-      break;
-    case 3:
-      CALL_TRANFORM(3);
-      break;
-    case 4:
-      CALL_TRANFORM(4);
-      break;
-    default:
-      throw std::exception();
-  }
-#undef CALL_TRANFORM
-  return 0;
+    algo::transform(shape,
+                    strides,
+                    op,
+                    stream,
+                    tensor1.get_base_ptr(),
+                    tensor2.get_base_ptr(),
+                    tensor3.get_base_ptr(),
+                    tensor4.get_base_ptr());
+    return 0;
 }
 
 } // namespace tensor
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "distconv/tensor/algorithms/transform_cuda.hpp"
+#include "distconv/tensor/algorithms/transform_reduce_sum_cuda.hpp"
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace distconv {
+namespace tensor {
+namespace algorithms_cuda {
+
+// The empty chain of a lazy transform.
+struct NopTransformFunctor
+{
+    template <typename... Args>
+    __device__ void operator()(Args&...)
+    {}
+};
+
+// Applies two element-wise functors in order to the same elements, so
+// that a chain of them is a single Transform op.
+template <typename First, typename Second>
+struct FusedTransformFunctor
+{
+    FusedTransformFunctor(First first, Second second)
+        : m_first(std::move(first)), m_second(std::move(second))
+    {}
+    template <typename... Args>
+    __device__ void operator()(Args&... args)
+    {
+        m_first(args...);
+        m_second(args...);
+    }
+    First m_first;
+    Second m_second;
+};
+
+// Presents an in-place functor as the unary function ReduceSum applies
+// to each source element before summing it.
+template <typename TransformFunc>
+struct InPlaceUnaryFunctor
+{
+    InPlaceUnaryFunctor(TransformFunc op) : m_op(std::move(op)) {}
+    template <typename DataType>
+    __device__ DataType operator()(DataType x) const
+    {
+        m_op(x);
+        return x;
+    }
+    mutable TransformFunc m_op;
+};
+
+} // namespace algorithms_cuda
+
+/** @brief A lazily evaluated chain of element-wise functors.
+ *
+ *  Each functor takes the elements of the tensors, in order, as
+ *  Transform does. then() appends a functor to the type of the chain
+ *  without touching memory; eval() runs the whole chain in a single
+ *  transform_kernel, and reduce_sum() runs it fused into ReduceSum.
+ *  The tensors are referenced, so they must outlive the expression.
+ */
+template <typename TransformFunc, typename... Tensors>
+class TransformExpr
+{
+public:
+    TransformExpr(std::tuple<Tensors&...> tensors, TransformFunc op)
+        : m_tensors(tensors), m_op(std::move(op))
+    {}
+
+    template <typename F>
+    TransformExpr<algorithms_cuda::FusedTransformFunctor<TransformFunc, F>,
+                  Tensors...>
+    then(F f) const
+    {
+        return {m_tensors,
+                algorithms_cuda::FusedTransformFunctor<TransformFunc, F>(m_op,
+                                                                         f)};
+    }
+
+    int eval(h2::gpu::DeviceStream stream = 0) const
+    {
+        return std::apply(
+            [&](Tensors&... tensors) {
+                return Transform(tensors..., m_op, stream);
+            },
+            m_tensors);
+    }
+
+    // Sums the transformed elements of the only tensor into dst,
+    // leaving the tensor itself unmodified.
+    template <int ND, typename DstTensor>
+    int reduce_sum(DstTensor& dst, h2::gpu::DeviceStream stream = 0) const
+    {
+        static_assert(sizeof...(Tensors) == 1,
+                      "Only single-tensor transforms can be reduced");
+        return TransformReduceSum<ND>(
+            std::get<0>(m_tensors),
+            dst,
+            algorithms_cuda::InPlaceUnaryFunctor<TransformFunc>(m_op),
+            stream);
+    }
+
+    template <int ND, typename DstTensor>
+    int reduce_sum(const Array<ND>& local_reduction_region,
+                   DstTensor& dst,
+                   h2::gpu::DeviceStream stream = 0) const
+    {
+        static_assert(sizeof...(Tensors) == 1,
+                      "Only single-tensor transforms can be reduced");
+        return TransformReduceSum<ND>(
+            std::get<0>(m_tensors),
+            local_reduction_region,
+            dst,
+            algorithms_cuda::InPlaceUnaryFunctor<TransformFunc>(m_op),
+            stream);
+    }
+
+private:
+    std::tuple<Tensors&...> m_tensors;
+    TransformFunc m_op;
+};
+
+/** @brief Start a lazy transform over up to four tensors of equal
+ *         shape and distribution.
+ *
+ *  For example, with the functors of CastScaleBias,
+ *  LazyTransform(dst, src).then(cast).then(scale_bias).eval(stream)
+ *  reads src and writes dst once.
+ */
+template <typename... Tensors>
+TransformExpr<algorithms_cuda::NopTransformFunctor, Tensors...>
+LazyTransform(Tensors&... tensors)
+{
+    static_assert(sizeof...(Tensors) >= 1 && sizeof...(Tensors) <= 4,
+                  "Transform supports one to four tensors");
+    return {std::tuple<Tensors&...>(tensors...),
+            algorithms_cuda::NopTransformFunctor()};
+}
+
+} // namespace tensor
+} // namespace distconv
@@ -3,3 +3,4 @@
 #include "distconv/tensor/algorithms/transform_cuda.hpp"
 #include "distconv/tensor/algorithms/reduce_sum_cuda.hpp"
 #include "distconv/tensor/algorithms/transform_reduce_sum_cuda.hpp"
+#include "distconv/tensor/algorithms/transform_expr_cuda.hpp"
@@ -16,6 +16,25 @@ class Allreduce {
   virtual void allreduce(DataType *buf, size_t count) {
     allreduce(buf, buf, count);
   }
+
+  // Number of elements of the sum of count elements that
+  // reduce_scatter leaves at this process
+  virtual size_t get_shard_count(size_t count) const {
+    return count;
+  }
+  // Offset of the shard of this process in the sum, which may be past
+  // count for the last shards when count is not divisible
+  virtual size_t get_shard_offset(size_t) const {
+    return 0;
+  }
+  // Sums count elements of sendbuf over the processes and stores only
+  // the shard of this process at recvbuf, which must hold
+  // get_shard_count(count) elements. Implementations without sharding
+  // store the whole sum.
+  virtual void reduce_scatter(const DataType *sendbuf, DataType *recvbuf,
+                              size_t count) {
+    allreduce(sendbuf, recvbuf, count);
+  }
 };
 
 } // namespace tensor
@@ -1,13 +1,32 @@
 #pragma once
 
+#include "distconv/runtime_gpu.hpp"
 #include "distconv/tensor/allreduce.hpp"
+#include "distconv/tensor/comm_cache.hpp"
+#include "distconv/util/util_mpi.hpp"
 
 #include <memory>
 #include <Al.hpp>
+#include <h2/gpu/memory_utils.hpp>
 
 namespace distconv {
 namespace tensor {
 
+/**
+   The communicator of AlBackend over comm and stream, created the
+   first time it is requested and cached with comm. Pair it with the
+   cached sub-locales of tensors to set up reductions over the same
+   ranks only once.
+ */
+template <typename AlBackend>
+std::shared_ptr<typename AlBackend::comm_type>
+get_al_comm(MPI_Comm comm, h2::gpu::DeviceStream stream) {
+  using AlComm = typename AlBackend::comm_type;
+  return get_comm_object<AlComm>(comm, stream, [&]() {
+    return new AlComm(comm, stream);
+  });
+}
+
 template <typename DataType, typename AlBackend>
 class AllreduceAl: public Allreduce<DataType> {
  public:
@@ -36,5 +55,192 @@ class AllreduceAl: public Allreduce<DataType> {
 template <typename DataType>
 using AllreduceAlNCCL = AllreduceAl<DataType, Al::NCCLBackend>;
 
+/*
+  Reduces within each node first, then allreduces among one leader
+  process per node, and broadcasts the result within each node. The
+  inter-node collective thus involves only the node leaders, which
+  helps when the count is small and the flat allreduce is bound by
+  latency.
+ */
+template <typename DataType, typename AlBackend>
+class AllreduceAlHierarchical: public Allreduce<DataType> {
+ public:
+  using AlComm = typename AlBackend::comm_type;
+  AllreduceAlHierarchical(MPI_Comm comm,
+                          h2::gpu::DeviceStream stream):
+      Allreduce<DataType>() {
+    DISTCONV_CHECK_MPI(MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0,
+                                           MPI_INFO_NULL, &m_node_mpi_comm));
+    int node_rank;
+    DISTCONV_CHECK_MPI(MPI_Comm_rank(m_node_mpi_comm, &node_rank));
+    DISTCONV_CHECK_MPI(MPI_Comm_split(
+        comm, node_rank == 0 ? 0 : MPI_UNDEFINED, 0, &m_leader_mpi_comm));
+    m_node_comm.reset(new AlComm(m_node_mpi_comm, stream));
+    if (m_leader_mpi_comm != MPI_COMM_NULL) {
+      m_leader_comm.reset(new AlComm(m_leader_mpi_comm, stream));
+    }
+  }
+
+  virtual ~AllreduceAlHierarchical() {
+    m_leader_comm.reset();
+    m_node_comm.reset();
+    if (m_leader_mpi_comm != MPI_COMM_NULL) {
+      DISTCONV_CHECK_MPI(MPI_Comm_free(&m_leader_mpi_comm));
+    }
+    DISTCONV_CHECK_MPI(MPI_Comm_free(&m_node_mpi_comm));
+  }
+
+  virtual void allreduce(const DataType *send_buf, DataType *recv_buf,
+                         size_t count) override {
+    Al::Reduce<AlBackend, DataType>(send_buf, recv_buf, count,
+                                    Al::ReductionOperator::sum, 0,
+                                    *m_node_comm);
+    reduce_and_bcast(recv_buf, count);
+  }
+  virtual void allreduce(DataType *buf, size_t count) override {
+    Al::Reduce<AlBackend, DataType>(buf, count, Al::ReductionOperator::sum,
+                                    0, *m_node_comm);
+    reduce_and_bcast(buf, count);
+  }
+
+ protected:
+  MPI_Comm m_node_mpi_comm = MPI_COMM_NULL;
+  MPI_Comm m_leader_mpi_comm = MPI_COMM_NULL;
+  std::unique_ptr<AlComm> m_node_comm;
+  // Only set on the node leaders
+  std::unique_ptr<AlComm> m_leader_comm;
+
+  // buf holds the sum within the node at the leader
+  void reduce_and_bcast(DataType *buf, size_t count) {
+    if (m_leader_comm != nullptr && m_leader_comm->size() > 1) {
+      Al::Allreduce<AlBackend, DataType>(buf, count,
+                                         Al::ReductionOperator::sum,
+                                         *m_leader_comm);
+    }
+    Al::Bcast<AlBackend, DataType>(buf, count, 0, *m_node_comm);
+  }
+};
+
+template <typename DataType>
+using AllreduceAlNCCLHierarchical =
+    AllreduceAlHierarchical<DataType, Al::NCCLBackend>;
+
+/*
+  Reduce-scatter over the processes of a hybrid data and spatial
+  decomposition, for sharding the weights and the optimizer state. The
+  sum is reduce-scattered among the processes sharing the samples,
+  i.e., the sub-locale of a tensor except the sample dimension, and
+  the resulting part among the processes at the same spatial position
+  of the other samples, i.e., the sub-locale of the sample dimension.
+  Each process thus receives 1/(S*D) of the sum for S processes per
+  sample and D sample partitions, and the inter-sample collective
+  moves only 1/S of the gradients.
+
+  The process with rank s in the spatial communicator and d in the
+  data-parallel one owns shard s*D+d. Each process at the same spatial
+  position must have the same rank s. The allreduce is a
+  reduce-scatter followed by allgathers in the reverse order. Counts
+  not divisible by S*D are padded through a staging buffer.
+ */
+template <typename DataType, typename AlBackend>
+class ReduceScatterAlHierarchical: public Allreduce<DataType> {
+ public:
+  using AlComm = typename AlBackend::comm_type;
+  ReduceScatterAlHierarchical(MPI_Comm spatial_comm, MPI_Comm data_comm,
+                              h2::gpu::DeviceStream stream):
+      Allreduce<DataType>(), m_stream(stream) {
+    m_spatial_comm = get_al_comm<AlBackend>(spatial_comm, stream);
+    m_data_comm = get_al_comm<AlBackend>(data_comm, stream);
+    m_spatial_size = m_spatial_comm->size();
+    m_data_size = m_data_comm->size();
+    m_shard_idx = m_spatial_comm->rank() * m_data_size +
+        m_data_comm->rank();
+    int spatial_rank = m_spatial_comm->rank();
+    int min_rank = 0;
+    int max_rank = 0;
+    DISTCONV_CHECK_MPI(MPI_Allreduce(&spatial_rank, &min_rank, 1, MPI_INT,
+                                     MPI_MIN, data_comm));
+    DISTCONV_CHECK_MPI(MPI_Allreduce(&spatial_rank, &max_rank, 1, MPI_INT,
+                                     MPI_MAX, data_comm));
+    assert_eq(min_rank, max_rank);
+  }
+  virtual ~ReduceScatterAlHierarchical() = default;
+
+  size_t get_shard_count(size_t count) const override {
+    const size_t num_shards = m_spatial_size * m_data_size;
+    return (count + num_shards - 1) / num_shards;
+  }
+  size_t get_shard_offset(size_t count) const override {
+    return m_shard_idx * get_shard_count(count);
+  }
+
+  void reduce_scatter(const DataType *sendbuf, DataType *recvbuf,
+                      size_t count) override {
+    if (count == 0) return;
+    auto &pool = internal::RuntimeGPU::get_device_memory_pool();
+    const size_t shard = get_shard_count(count);
+    const size_t padded_count = shard * m_spatial_size * m_data_size;
+    DataType *padded = nullptr;
+    if (padded_count != count) {
+      padded = static_cast<DataType*>(
+          pool.get(padded_count * sizeof(DataType), m_stream));
+      h2::gpu::mem_copy(padded, sendbuf, count, m_stream);
+      h2::gpu::mem_zero(padded + count, padded_count - count, m_stream);
+      sendbuf = padded;
+    }
+    // Part of the spatial group, reduced over its processes
+    DataType *part = static_cast<DataType*>(
+        pool.get(shard * m_data_size * sizeof(DataType), m_stream));
+    Al::Reduce_scatter<AlBackend, DataType>(
+        sendbuf, part, shard * m_data_size, Al::ReductionOperator::sum,
+        *m_spatial_comm);
+    Al::Reduce_scatter<AlBackend, DataType>(
+        part, recvbuf, shard, Al::ReductionOperator::sum, *m_data_comm);
+    pool.release(part);
+    if (padded != nullptr) {
+      pool.release(padded);
+    }
+  }
+
+  virtual void allreduce(const DataType *send_buf, DataType *recv_buf,
+                         size_t count) override {
+    if (count == 0) return;
+    auto &pool = internal::RuntimeGPU::get_device_memory_pool();
+    const size_t shard = get_shard_count(count);
+    const size_t padded_count = shard * m_spatial_size * m_data_size;
+    DataType *shard_buf = static_cast<DataType*>(
+        pool.get(shard * sizeof(DataType), m_stream));
+    reduce_scatter(send_buf, shard_buf, count);
+    DataType *part = static_cast<DataType*>(
+        pool.get(shard * m_data_size * sizeof(DataType), m_stream));
+    Al::Allgather<AlBackend, DataType>(shard_buf, part, shard,
+                                       *m_data_comm);
+    DataType *padded = padded_count != count ?
+        static_cast<DataType*>(
+            pool.get(padded_count * sizeof(DataType), m_stream)) :
+        recv_buf;
+    Al::Allgather<AlBackend, DataType>(part, padded, shard * m_data_size,
+                                       *m_spatial_comm);
+    if (padded != recv_buf) {
+      h2::gpu::mem_copy(recv_buf, padded, count, m_stream);
+      pool.release(padded);
+    }
+    pool.release(part);
+    pool.release(shard_buf);
+  }
+
+ protected:
+  h2::gpu::DeviceStream m_stream;
+  std::shared_ptr<AlComm> m_spatial_comm;
+  std::shared_ptr<AlComm> m_data_comm;
+  int m_spatial_size;
+  int m_data_size;
+  int m_shard_idx;
+};
+
+template <typename DataType>
+using ReduceScatterAlNCCLHierarchical =
+    ReduceScatterAlHierarchical<DataType, Al::NCCLBackend>;
+
 } // namespace tensor
 } // namespace distconv
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/allreduce.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
+
+#include <vector>
+
+namespace distconv {
+namespace tensor {
+
+/*
+  Coalesces the allreduces of many small buffers into one. The buffers
+  added until flush are packed into a staging buffer with a single
+  kernel, reduced with one allreduce of the underlying implementation,
+  and scattered back with another kernel. All of them run on stream,
+  so flush does not block the host unless the underlying allreduce
+  does, e.g., AllreduceMPICUDA. The buffers must not be modified on
+  other streams until the stream reaches the end of flush.
+ */
+template <typename DataType>
+class AllreduceFused {
+ public:
+  struct Entry {
+    const DataType *send_buf;
+    DataType *recv_buf;
+    size_t offset;
+    size_t count;
+  };
+
+  AllreduceFused(Allreduce<DataType> &ar, h2::gpu::DeviceStream stream):
+      m_ar(ar), m_stream(stream), m_count(0) {}
+
+  AllreduceFused(const AllreduceFused &) = delete;
+  AllreduceFused &operator=(const AllreduceFused &) = delete;
+
+  void add(const DataType *send_buf, DataType *recv_buf, size_t count) {
+    if (count == 0) return;
+    m_entries.push_back({send_buf, recv_buf, m_count, count});
+    m_count += count;
+  }
+
+  void add(DataType *buf, size_t count) {
+    add(buf, buf, count);
+  }
+
+  size_t get_num_entries() const {
+    return m_entries.size();
+  }
+
+  // Reduces the buffers added since the last flush
+  void flush();
+
+ protected:
+  Allreduce<DataType> &m_ar;
+  h2::gpu::DeviceStream m_stream;
+  std::vector<Entry> m_entries;
+  size_t m_count;
+  Memory<CUDAAllocator> m_buf;
+  Memory<CUDAAllocator> m_entries_d;
+
+  void pack();
+  void unpack();
+};
+
+} // namespace tensor
+} // namespace distconv
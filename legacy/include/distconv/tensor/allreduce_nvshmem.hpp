@@ -5,12 +5,16 @@
 #ifdef DISTCONV_HAS_NVSHMEM
 
 #include "distconv/tensor/allreduce.hpp"
-#include "distconv/tensor/memory_cuda.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
 #include "distconv/util/util_mpi.hpp"
-#include "distconv/util/util_cuda.hpp"
+#include "distconv/util/util_gpu.hpp"
 #include "distconv/util/nvshmem.hpp"
 
 #include <cmath>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
 
 namespace distconv {
 namespace tensor {
@@ -29,7 +33,7 @@ struct AllreduceNVSHMEMDevice {
   int m_num_steps;
   DataType *m_buf;
   util::nvshmem::SyncArrayDevice m_sync;
-#ifdef __CUDACC__
+#if defined(__CUDACC__) || __HIP__
   // Assume that the root thread has the partial sum. Those held by
   // other threads are not used. Only the root thread has the valid
   // output value.
@@ -64,21 +68,56 @@ struct AllreduceNVSHMEMDevice {
     // TODO: intra-grid scatter
     return final_sum;
   }
-#endif // __CUDACC__
+#endif // __CUDACC__ || __HIP__
 };
 
+/*
+  AUTO selects an algorithm for each power-of-two bucket of counts. The
+  selection is read from the file set by
+  DISTCONV_ALLREDUCE_NVSHMEM_AUTO_TABLE, where each line has the largest
+  count of a bucket and the algorithm name, e.g., "1024
+  RECURSIVE_DOUBLING". Otherwise, the candidates are timed at the first
+  allreduce of a bucket, which is collective over all the PEs.
+ */
 template <typename DataType>
 class AllreduceNVSHMEM: public Allreduce<DataType> {
  public:
   enum Algo {NAIVE, NATIVE, RECURSIVE_DOUBLING_HOST, RECURSIVE_DOUBLING,
-             RECURSIVE_DOUBLING_BUFFERED, RECURSIVE_DOUBLING_BLOCK};
+             RECURSIVE_DOUBLING_BUFFERED, RECURSIVE_DOUBLING_BLOCK, RING,
+             AUTO};
   AllreduceNVSHMEM(cudaStream_t stream, Algo algo=NAIVE):
       m_stream(stream), m_algo(algo), m_pid(nvshmem_my_pe()), m_np(nvshmem_n_pes()),
       m_sync(0) {
+    if (m_algo == AUTO) {
+      load_auto_table();
+    }
   }
 
   virtual ~AllreduceNVSHMEM() = default;
 
+  /**
+     Allocates the buffers for allreduces of up to count elements
+     with any algorithm at setup, so that the symmetric heap does not
+     need to grow, synchronizing all PEs, in the middle of training.
+   */
+  void reserve(size_t count) {
+    const size_t num_steps = std::ceil(std::log2((float)m_np));
+    const size_t buf_count = std::max(
+        count * (num_steps + 1), (size_t)NVSHMEMI_REDUCE_MIN_WRKDATA_SIZE);
+    if (m_buf.get_size() < buf_count * sizeof(DataType)) {
+      auto &heap = util::nvshmem::SymmetricHeap::get_instance();
+      heap.reserve(buf_count * sizeof(DataType));
+      if (m_native_sync.is_null()) {
+        heap.reserve(NVSHMEMI_REDUCE_SYNC_SIZE * sizeof(long));
+      }
+      // The current buffer is reclaimed at the next growth
+      m_buf = Memory<NVSHMEMAllocator>();
+      heap.grow();
+    }
+    ensure_native_sync();
+    ensure_buffer(buf_count);
+  }
+
   using Allreduce<DataType>::allreduce;
 
   virtual void allreduce(const DataType *send_buf, DataType *recv_buf,
@@ -87,31 +126,42 @@ class AllreduceNVSHMEM: public Allreduce<DataType> {
       copy(send_buf, recv_buf, count);
       return;
     }
-    switch (m_algo) {
-      case NAIVE:
-        allreduce_naive(send_buf, recv_buf, count);
-        break;
-      case NATIVE:
-        allreduce_native(send_buf, recv_buf, count);
-        break;
-      case RECURSIVE_DOUBLING_HOST:
-        recursive_doubling_host(send_buf, recv_buf, count);
-        break;
-      case RECURSIVE_DOUBLING:
-        recursive_doubling(send_buf, recv_buf, count);
-        break;
-      case RECURSIVE_DOUBLING_BUFFERED:
-        recursive_doubling_buffered(send_buf, recv_buf, count);
-        break;
-      case RECURSIVE_DOUBLING_BLOCK:
-        recursive_doubling_block(send_buf, recv_buf, count);
-        break;
+    if (m_algo == AUTO) {
+      run_algo(select_algo(count), send_buf, recv_buf, count);
+    } else {
+      run_algo(m_algo, send_buf, recv_buf, count);
+    }
+  }
+
+  static std::string get_algo_name(Algo algo) {
+    switch (algo) {
+      case NAIVE: return "NAIVE";
+      case NATIVE: return "NATIVE";
+      case RECURSIVE_DOUBLING_HOST: return "RECURSIVE_DOUBLING_HOST";
+      case RECURSIVE_DOUBLING: return "RECURSIVE_DOUBLING";
+      case RECURSIVE_DOUBLING_BUFFERED: return "RECURSIVE_DOUBLING_BUFFERED";
+      case RECURSIVE_DOUBLING_BLOCK: return "RECURSIVE_DOUBLING_BLOCK";
+      case RING: return "RING";
+      case AUTO: return "AUTO";
       default:
         util::MPIRootPrintStreamError() << "Unknown allreduce algorithm";
         std::abort();
     }
   }
 
+  static Algo get_algo(const std::string &name) {
+    for (auto algo: {NAIVE, NATIVE, RECURSIVE_DOUBLING_HOST,
+                     RECURSIVE_DOUBLING, RECURSIVE_DOUBLING_BUFFERED,
+                     RECURSIVE_DOUBLING_BLOCK, RING, AUTO}) {
+      if (get_algo_name(algo) == name) {
+        return algo;
+      }
+    }
+    util::MPIRootPrintStreamError() << "Unknown allreduce algorithm: "
+                                    << name;
+    std::abort();
+  }
+
   // Setup data buffers and sync buffers
   void recursive_doubling_block_setup(size_t count, size_t num_blocks_per_entry) {
     auto log_np = std::log2((float)m_np);
@@ -137,6 +187,125 @@ class AllreduceNVSHMEM: public Allreduce<DataType> {
   util::nvshmem::SyncArray m_sync;
   Memory<NVSHMEMAllocator> m_native_sync;
 
+  // Selected algorithms keyed by the largest count of each bucket
+  std::map<size_t, Algo> m_auto_algos;
+  static constexpr int m_auto_num_warmup = 2;
+  static constexpr int m_auto_num_trials = 5;
+
+  void run_algo(Algo algo, const DataType *send_buf, DataType *recv_buf,
+                size_t count) {
+    switch (algo) {
+      case NAIVE:
+        allreduce_naive(send_buf, recv_buf, count);
+        break;
+      case NATIVE:
+        allreduce_native(send_buf, recv_buf, count);
+        break;
+      case RECURSIVE_DOUBLING_HOST:
+        recursive_doubling_host(send_buf, recv_buf, count);
+        break;
+      case RECURSIVE_DOUBLING:
+        recursive_doubling(send_buf, recv_buf, count);
+        break;
+      case RECURSIVE_DOUBLING_BUFFERED:
+        recursive_doubling_buffered(send_buf, recv_buf, count);
+        break;
+      case RECURSIVE_DOUBLING_BLOCK:
+        recursive_doubling_block(send_buf, recv_buf, count);
+        break;
+      case RING:
+        ring(send_buf, recv_buf, count);
+        break;
+      default:
+        util::MPIRootPrintStreamError() << "Unknown allreduce algorithm";
+        std::abort();
+    }
+  }
+
+  static size_t get_bucket(size_t count) {
+    size_t bucket = 1;
+    while (bucket < count) bucket *= 2;
+    return bucket;
+  }
+
+  void load_auto_table() {
+    auto path = std::getenv("DISTCONV_ALLREDUCE_NVSHMEM_AUTO_TABLE");
+    if (path == nullptr) return;
+    std::ifstream ifs(path);
+    if (!ifs) {
+      util::MPIRootPrintStreamError()
+          << "Failed to open allreduce table: " << path;
+      std::abort();
+    }
+    size_t count;
+    std::string name;
+    while (ifs >> count >> name) {
+      m_auto_algos[get_bucket(count)] = get_algo(name);
+    }
+  }
+
+  Algo select_algo(size_t count) {
+    const size_t bucket = get_bucket(count);
+    auto it = m_auto_algos.find(bucket);
+    if (it != m_auto_algos.end()) {
+      return it->second;
+    }
+    const Algo algo = tune(bucket);
+    m_auto_algos[bucket] = algo;
+    util::MPIRootPrintStreamInfo()
+        << "Allreduce of count up to " << bucket << " with "
+        << get_algo_name(algo);
+    return algo;
+  }
+
+  // NATIVE is not a candidate as it requires symmetric user buffers.
+  std::vector<Algo> get_auto_candidates() const {
+    std::vector<Algo> candidates;
+    if ((m_np & (m_np - 1)) == 0) {
+      candidates.push_back(RECURSIVE_DOUBLING);
+    }
+    candidates.push_back(RING);
+    return candidates;
+  }
+
+  // Times the candidates with count elements. The times are maximized
+  // over MPI_COMM_WORLD, with which NVSHMEM is initialized, so that
+  // all the PEs select the same algorithm.
+  Algo tune(size_t count) {
+    const auto candidates = get_auto_candidates();
+    if (candidates.size() == 1) {
+      return candidates[0];
+    }
+    Memory<CUDAAllocator> send, recv;
+    send.allocate(count * sizeof(DataType));
+    recv.allocate(count * sizeof(DataType));
+    send.memset(0);
+    auto send_buf = static_cast<const DataType*>(send.get());
+    auto recv_buf = static_cast<DataType*>(recv.get());
+    std::vector<double> times;
+    for (auto algo: candidates) {
+      for (int i = 0; i < m_auto_num_warmup; ++i) {
+        run_algo(algo, send_buf, recv_buf, count);
+      }
+      DISTCONV_CHECK_CUDA(cudaStreamSynchronize(m_stream));
+      util::nvshmem::barrier();
+      const double start = MPI_Wtime();
+      for (int i = 0; i < m_auto_num_trials; ++i) {
+        run_algo(algo, send_buf, recv_buf, count);
+      }
+      DISTCONV_CHECK_CUDA(cudaStreamSynchronize(m_stream));
+      times.push_back((MPI_Wtime() - start) / m_auto_num_trials);
+    }
+    DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, times.data(),
+                                     (int)times.size(), MPI_DOUBLE, MPI_MAX,
+                                     MPI_COMM_WORLD));
+    size_t best = 0;
+    for (size_t i = 1; i < times.size(); ++i) {
+      if (times[i] < times[best]) best = i;
+    }
+    return candidates[best];
+  }
+
   void ensure_buffer(size_t count) {
     size_t cur_size = m_buf.get_size() / sizeof(DataType);
     if (cur_size >= count) {
@@ -252,6 +421,55 @@ class AllreduceNVSHMEM: public Allreduce<DataType> {
     }
   }
 
+  // Ring reduce-scatter followed by ring allgather. Each PE sends
+  // 2(np-1) chunks of count/np elements to the next PE, so the volume
+  // does not grow with the number of PEs, which is better for large
+  // counts than recursive doubling. Each step has its own receive
+  // buffer, and the next PE notifies when it is ready to receive.
+  void ring(const DataType *send_buf, DataType *recv_buf, size_t count) {
+    const int num_steps = m_np - 1;
+    const size_t chunk = (count + m_np - 1) / m_np;
+    ensure_buffer(chunk * num_steps * 2);
+    copy(send_buf, recv_buf, count);
+    m_sync.ensure_size(num_steps * 2 + 1);
+
+    const int next_pid = (m_pid + 1) % m_np;
+    const int prev_pid = (m_pid + m_np - 1) % m_np;
+    auto buf = static_cast<DataType*>(m_buf.get());
+    auto chunk_offset = [&](int idx) {
+      return std::min(chunk * idx, count);
+    };
+    auto chunk_count = [&](int idx) {
+      return chunk_offset(idx + 1) - chunk_offset(idx);
+    };
+
+    m_sync.sync(prev_pid, true, true, util::nvshmem::SyncType::NONE,
+                0, m_stream);
+    for (int i = 0; i < num_steps * 2; ++i) {
+      // Reduce-scatter, and then allgather the reduced chunks
+      const bool rs = i < num_steps;
+      const int step = rs ? i : i - num_steps;
+      const int send_idx = (m_pid - step + (rs ? 0 : 1) + m_np * 2) % m_np;
+      const int recv_idx = (m_pid - step - (rs ? 1 : 0) + m_np * 2) % m_np;
+      auto slot = buf + chunk * i;
+      const size_t send_count = chunk_count(send_idx);
+      if (send_count > 0) {
+        nvshmemx_putmem_on_stream(slot, recv_buf + chunk_offset(send_idx),
+                                  send_count * sizeof(DataType),
+                                  next_pid, m_stream);
+      }
+      m_sync.sync(next_pid, true, true, util::nvshmem::SyncType::FENCE,
+                  i + 1, m_stream);
+      const size_t recv_count = chunk_count(recv_idx);
+      if (recv_count == 0) continue;
+      if (rs) {
+        reduce(slot, recv_buf + chunk_offset(recv_idx), recv_count);
+      } else {
+        copy(slot, recv_buf + chunk_offset(recv_idx), recv_count);
+      }
+    }
+  }
+
   void set_blocking_params(size_t count, size_t &work_per_block, int &block_size,
                            int &grid_size) {
     // default work size
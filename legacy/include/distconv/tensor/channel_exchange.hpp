@@ -2,12 +2,18 @@
 
 #include "distconv/base.hpp"
 #include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/allreduce_al.hpp"
 #include "distconv/tensor/memory_gpu.hpp"
 #include "distconv/tensor/tensor_mpi.hpp"
 #include "distconv/util/util_gpu.hpp"
 
 #include <Al.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
 namespace distconv {
 namespace tensor {
 
@@ -19,6 +25,7 @@ class ChannelExchange {
   ChannelExchange() {
   }
 
+  // Streams and events are not shared with the copy
   ChannelExchange(const ChannelExchange<DataType> &x) {
   }
 
@@ -26,19 +33,29 @@ class ChannelExchange {
     return *this;
   }
 
-  virtual ~ChannelExchange() {}
+  virtual ~ChannelExchange() {
+    if (m_side_stream) {
+      h2::gpu::destroy(m_side_stream);
+      h2::gpu::destroy(m_main_event);
+      h2::gpu::destroy(m_side_event);
+    }
+  }
 
   /**
    * Reduce-scatter src by channels into dst.
    *
    * This does the equivalent of running a reduce-scatter on each sample in
-   * src.
+   * src. When DISTCONV_CHANNEL_EXCHANGE_CHUNK_SIZE is set, samples are
+   * packed and reduce-scattered in chunks of that many samples, and
+   * the packing of a chunk on a side stream overlaps with the
+   * reduce-scatter of the previous one.
    */
   virtual void reduce_scatter(TensorType& src,
                               TensorType& dst,
                               Al::NCCLBackend::comm_type& comm,
                               h2::gpu::DeviceStream stream)
   {
+      DISTCONV_RANGE("channel_exchange/reduce_scatter", Collective);
       // If there is only one sample, we can do this directly.
       if (src.get_local_shape()[-1] == 1)
       {
@@ -54,21 +71,58 @@ class ChannelExchange {
       DataType* src_buf =
           (DataType*) distconv::internal::RuntimeGPU::get_device_memory_pool()
               .get(src.get_local_size() * sizeof(DataType), stream);
-      // Pack src such that we can reduce-scatter directly into dst.
-      pack_for_rs(src, dst, src_buf, comm.size(), stream);
-      Al::Reduce_scatter<Al::NCCLBackend, DataType>(src_buf,
-                                                    dst.get_base_ptr(),
-                                                    dst.get_local_size(),
-                                                    Al::ReductionOperator::sum,
-                                                    comm);
+      const index_t num_samples = src.get_local_shape()[-1];
+      const index_t chunk_size = get_chunk_size(num_samples);
+      if (chunk_size == num_samples)
+      {
+          // Pack src such that we can reduce-scatter directly into dst.
+          pack_for_rs(src, dst, src_buf, comm.size(), stream);
+          Al::Reduce_scatter<Al::NCCLBackend, DataType>(
+              src_buf,
+              dst.get_base_ptr(),
+              dst.get_local_size(),
+              Al::ReductionOperator::sum,
+              comm);
+      }
+      else
+      {
+          ensure_side_stream();
+          // src is produced on stream
+          DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(m_main_event, stream));
+          DISTCONV_CHECK_GPU(
+              GPU_STREAM_WAIT_EVENT(m_side_stream, m_main_event, 0));
+          for (index_t s = 0; s < num_samples; s += chunk_size)
+          {
+              const index_t n = std::min(chunk_size, num_samples - s);
+              DataType* chunk_buf = src_buf + s * get_sample_size(src);
+              pack_for_rs(src, dst, chunk_buf, comm.size(), s, n,
+                          m_side_stream);
+              DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(m_side_event,
+                                                  m_side_stream));
+              DISTCONV_CHECK_GPU(
+                  GPU_STREAM_WAIT_EVENT(stream, m_side_event, 0));
+              Al::Reduce_scatter<Al::NCCLBackend, DataType>(
+                  chunk_buf,
+                  dst.get_base_ptr() + s * get_sample_size(dst),
+                  n * get_sample_size(dst),
+                  Al::ReductionOperator::sum,
+                  comm);
+          }
+      }
       distconv::internal::RuntimeGPU::get_device_memory_pool().release(src_buf);
   }
 
+  /**
+   * Allgather src by channels into dst. The received chunks are
+   * unpacked on a side stream while the next chunk is gathered, as in
+   * reduce_scatter.
+   */
   virtual void allgather(TensorType& src,
                          TensorType& dst,
                          Al::NCCLBackend::comm_type& comm,
                          h2::gpu::DeviceStream stream)
   {
+      DISTCONV_RANGE("channel_exchange/allgather", Collective);
       // If there is only one sample, we can do this directly.
       if (src.get_local_shape()[-1] == 1)
       {
@@ -82,10 +136,37 @@ class ChannelExchange {
       DataType* dst_buf =
           (DataType*) distconv::internal::RuntimeGPU::get_device_memory_pool()
               .get(dst.get_local_size() * sizeof(DataType), stream);
-      Al::Allgather<Al::NCCLBackend, DataType>(
-          src.get_base_ptr(), dst_buf, src.get_local_size(), comm);
-      // Unpack dst, which is interleaved.
-      unpack_from_ag(src, dst, dst_buf, comm.size(), stream);
+      const index_t num_samples = src.get_local_shape()[-1];
+      const index_t chunk_size = get_chunk_size(num_samples);
+      if (chunk_size == num_samples)
+      {
+          Al::Allgather<Al::NCCLBackend, DataType>(
+              src.get_base_ptr(), dst_buf, src.get_local_size(), comm);
+          // Unpack dst, which is interleaved.
+          unpack_from_ag(src, dst, dst_buf, comm.size(), stream);
+      }
+      else
+      {
+          ensure_side_stream();
+          for (index_t s = 0; s < num_samples; s += chunk_size)
+          {
+              const index_t n = std::min(chunk_size, num_samples - s);
+              DataType* chunk_buf = dst_buf + s * get_sample_size(dst);
+              Al::Allgather<Al::NCCLBackend, DataType>(
+                  src.get_base_ptr() + s * get_sample_size(src),
+                  chunk_buf,
+                  n * get_sample_size(src),
+                  comm);
+              DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(m_main_event, stream));
+              DISTCONV_CHECK_GPU(
+                  GPU_STREAM_WAIT_EVENT(m_side_stream, m_main_event, 0));
+              unpack_from_ag(src, dst, chunk_buf, comm.size(), s, n,
+                             m_side_stream);
+          }
+          // dst is consumed on stream
+          DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(m_side_event, m_side_stream));
+          DISTCONV_CHECK_GPU(GPU_STREAM_WAIT_EVENT(stream, m_side_event, 0));
+      }
       distconv::internal::RuntimeGPU::get_device_memory_pool().release(dst_buf);
   }
 
@@ -103,17 +184,109 @@ class ChannelExchange {
     return t.get_local_offset(idx);
   }
 
+  // Number of samples exchanged at once
+  index_t get_chunk_size(index_t num_samples) const {
+    const char *env = std::getenv("DISTCONV_CHANNEL_EXCHANGE_CHUNK_SIZE");
+    const index_t chunk_size = env ? std::max(std::atoi(env), 0) : 0;
+    return chunk_size == 0 ? num_samples : std::min(chunk_size, num_samples);
+  }
+
+  void ensure_side_stream() {
+    if (m_side_stream == nullptr) {
+      m_side_stream = h2::gpu::make_stream_nonblocking();
+      m_main_event = h2::gpu::make_event_notiming();
+      m_side_event = h2::gpu::make_event_notiming();
+    }
+  }
+
+  void pack_for_rs(TensorType& src,
+                   TensorType& dst,
+                   DataType* dst_buf,
+                   size_t comm_size,
+                   h2::gpu::DeviceStream stream) {
+    pack_for_rs(src, dst, dst_buf, comm_size, 0, src.get_local_shape()[-1],
+                stream);
+  }
+
+  // Packs num_samples samples of src from sample_offset
   void pack_for_rs(TensorType& src,
                    TensorType& dst,
                    DataType* dst_buf,
                    size_t comm_size,
+                   index_t sample_offset,
+                   index_t num_samples,
                    h2::gpu::DeviceStream stream);
 
   void unpack_from_ag(TensorType& src,
                       TensorType& dst,
                       DataType* packed_buf,
                       size_t comm_size,
+                      h2::gpu::DeviceStream stream) {
+    unpack_from_ag(src, dst, packed_buf, comm_size, 0,
+                   src.get_local_shape()[-1], stream);
+  }
+
+  // Unpacks num_samples samples into dst from sample_offset
+  void unpack_from_ag(TensorType& src,
+                      TensorType& dst,
+                      DataType* packed_buf,
+                      size_t comm_size,
+                      index_t sample_offset,
+                      index_t num_samples,
                       h2::gpu::DeviceStream stream);
+
+  h2::gpu::DeviceStream m_side_stream = nullptr;
+  h2::gpu::DeviceEvent m_main_event = nullptr;
+  h2::gpu::DeviceEvent m_side_event = nullptr;
+};
+
+/**
+   Redistributes tensors between a spatial decomposition, with all the
+   channels of the local spatial box, and a channel decomposition, with
+   the whole spatial domain of the local channels, e.g., between
+   spatial-parallel and channel/filter-parallel stages.
+
+   Each process exchanges a slab of its local samples with every other
+   process of comm in a single all-to-all. The spatial side is packed
+   in the format of ChannelExchange::reduce_scatter and unpacked from
+   that of ChannelExchange::allgather, i.e., by channel blocks of the
+   destinations, so only the channel side places the spatial boxes of
+   the peers with its own kernel.
+
+   Both tensors must be over the processes of comm with the same local
+   samples, the channel blocks in the order of the ranks of comm, and
+   equal spatial boxes, without halos.
+ */
+template <typename DataType>
+class ChannelSpatialShuffler: public ChannelExchange<DataType> {
+ public:
+  using TensorType = typename ChannelExchange<DataType>::TensorType;
+
+  ChannelSpatialShuffler(const TensorType &spatial,
+                         const TensorType &channel,
+                         MPI_Comm comm,
+                         h2::gpu::DeviceStream stream);
+
+  virtual ~ChannelSpatialShuffler() = default;
+
+  void spatial_to_channel(TensorType &spatial,
+                          TensorType &channel,
+                          h2::gpu::DeviceStream stream);
+
+  void channel_to_spatial(TensorType &channel,
+                          TensorType &spatial,
+                          h2::gpu::DeviceStream stream);
+
+ protected:
+  std::shared_ptr<Al::NCCLBackend::comm_type> m_comm;
+  // Spatial box of each rank of comm, padded to 3 dimensions
+  index_t m_box_shape[3] = {1, 1, 1};
+  index_t m_full_shape[3] = {1, 1, 1};
+  // Offsets of the boxes in the spatial domain, 3 per rank
+  Memory<CUDAAllocator> m_box_offsets;
+
+  // Elements exchanged with each process
+  size_t get_block_size(const TensorType &channel) const;
 };
 
 }  // namespace tensor
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "distconv/util/util_mpi.hpp"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "mpi.h"
+
+/*
+  Process-wide caches of communicators split from others and of the
+  objects built over them, e.g. Aluminum communicators. Entries are
+  kept as MPI attributes of the communicator they derive from, so they
+  are released when it is freed, and a freed communicator whose handle
+  is reused never hits stale entries.
+ */
+
+namespace distconv {
+namespace tensor {
+
+namespace internal {
+
+// The cached values of type T of communicators, as an attribute
+// holding a map from Key.
+template <typename Key, typename T>
+class CommAttribute {
+ public:
+  using Map = std::map<Key, std::shared_ptr<T>>;
+
+  static Map &get(MPI_Comm comm) {
+    void *attr = nullptr;
+    int found = 0;
+    DISTCONV_CHECK_MPI(MPI_Comm_get_attr(comm, keyval(), &attr, &found));
+    if (!found) {
+      attr = new Map();
+      DISTCONV_CHECK_MPI(MPI_Comm_set_attr(comm, keyval(), attr));
+    }
+    return *static_cast<Map*>(attr);
+  }
+
+ private:
+  static int keyval() {
+    static const int kv = [] {
+      int k;
+      DISTCONV_CHECK_MPI(MPI_Comm_create_keyval(
+          MPI_COMM_NULL_COPY_FN, delete_attr, &k, nullptr));
+      return k;
+    }();
+    return kv;
+  }
+
+  static int delete_attr(MPI_Comm, int, void *attr, void*) {
+    delete static_cast<Map*>(attr);
+    return MPI_SUCCESS;
+  }
+};
+
+inline void free_cached_comm(MPI_Comm *comm) {
+  int finalized = 0;
+  MPI_Finalized(&finalized);
+  if (!finalized && *comm != MPI_COMM_NULL) {
+    MPI_Comm_free(comm);
+  }
+  delete comm;
+}
+
+} // namespace internal
+
+/**
+   The communicator of the ranks of comm with the same color, ordered
+   by rank_key, as MPI_Comm_split creates it. It is split only the
+   first time a key is seen, so every rank of comm must pass the same
+   key for the same grouping, e.g. the shape of the process grid and
+   the dimensions it is reduced over. The communicator stays valid as
+   long as the returned pointer or comm is.
+ */
+inline std::shared_ptr<MPI_Comm> get_split_comm(MPI_Comm comm,
+                                                const std::vector<int> &key,
+                                                int color, int rank_key) {
+  auto &cache = internal::CommAttribute<std::vector<int>, MPI_Comm>::get(
+      comm);
+  auto it = cache.find(key);
+  if (it == cache.end()) {
+    std::shared_ptr<MPI_Comm> sub_comm(new MPI_Comm(MPI_COMM_NULL),
+                                       internal::free_cached_comm);
+    DISTCONV_CHECK_MPI(MPI_Comm_split(comm, color, rank_key,
+                                      sub_comm.get()));
+    it = cache.emplace(key, sub_comm).first;
+  }
+  return it->second;
+}
+
+/**
+   An object of type T over comm, e.g. an Aluminum communicator,
+   created by make() the first time it is requested for comm and key
+   and shared afterwards. It lives as long as comm.
+ */
+template <typename T, typename Key, typename F>
+std::shared_ptr<T> get_comm_object(MPI_Comm comm, const Key &key, F make) {
+  auto &cache = internal::CommAttribute<Key, T>::get(comm);
+  auto it = cache.find(key);
+  if (it == cache.end()) {
+    it = cache.emplace(key, std::shared_ptr<T>(make())).first;
+  }
+  return it->second;
+}
+
+} // namespace tensor
+} // namespace distconv
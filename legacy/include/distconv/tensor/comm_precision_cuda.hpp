@@ -0,0 +1,106 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+#if H2_HAS_CUDA
+#include <cuda_fp16.h>
+#endif // H2_HAS_CUDA
+
+namespace distconv {
+namespace tensor {
+
+// Converts elements to and from the type they are packed as for
+// communication. The full-precision wire type is the element type
+// itself.
+template <typename WireType>
+struct WireCast {
+  template <typename DataType>
+  __device__ static WireType to_wire(DataType x) {
+    return x;
+  }
+  template <typename DataType>
+  __device__ static DataType from_wire(WireType x) {
+    return x;
+  }
+};
+
+#if H2_HAS_CUDA
+// Rounded through FP32, which also covers FP64 tensors
+template <>
+struct WireCast<half> {
+  template <typename DataType>
+  __device__ static half to_wire(DataType x) {
+    return __float2half(static_cast<float>(x));
+  }
+  template <typename DataType>
+  __device__ static DataType from_wire(half x) {
+    return static_cast<DataType>(__half2float(x));
+  }
+};
+
+#ifdef DISTCONV_HAS_BFLOAT16
+template <>
+struct WireCast<__nv_bfloat16> {
+  template <typename DataType>
+  __device__ static __nv_bfloat16 to_wire(DataType x) {
+    return __float2bfloat16(static_cast<float>(x));
+  }
+  template <typename DataType>
+  __device__ static DataType from_wire(__nv_bfloat16 x) {
+    return static_cast<DataType>(__bfloat162float(x));
+  }
+};
+#endif // DISTCONV_HAS_BFLOAT16
+
+#ifdef DISTCONV_HAS_FP8
+// E4M3, which keeps more mantissa than E5M2 for activations. Values
+// beyond its range saturate to the largest finite ones.
+template <>
+struct WireCast<__nv_fp8_e4m3> {
+  template <typename DataType>
+  __device__ static __nv_fp8_e4m3 to_wire(DataType x) {
+    return __nv_fp8_e4m3(static_cast<float>(x));
+  }
+  template <typename DataType>
+  __device__ static DataType from_wire(__nv_fp8_e4m3 x) {
+    return static_cast<DataType>(static_cast<float>(x));
+  }
+};
+#endif // DISTCONV_HAS_FP8
+#endif // H2_HAS_CUDA
+
+// Calls f with a null pointer of the wire type of precision p. Exits
+// with an error if p is not available in this build.
+template <typename DataType, typename F>
+void dispatch_wire_type(CommPrecision p, F &&f) {
+  if (p == CommPrecision::FULL) {
+    f(static_cast<DataType*>(nullptr));
+    return;
+  }
+  assert_always(is_comm_precision_supported<DataType>(p));
+#if H2_HAS_CUDA
+  if (p == CommPrecision::FP16) {
+    f(static_cast<half*>(nullptr));
+    return;
+  }
+#ifdef DISTCONV_HAS_BFLOAT16
+  if (p == CommPrecision::BF16) {
+    f(static_cast<__nv_bfloat16*>(nullptr));
+    return;
+  }
+#endif // DISTCONV_HAS_BFLOAT16
+#ifdef DISTCONV_HAS_FP8
+  if (p == CommPrecision::FP8) {
+    f(static_cast<__nv_fp8_e4m3*>(nullptr));
+    return;
+  }
+#endif // DISTCONV_HAS_FP8
+#endif // H2_HAS_CUDA
+  util::MPIPrintStreamError()
+      << "Communication precision not available: " << p;
+  throw std::exception();
+}
+
+} // namespace tensor
+} // namespace distconv
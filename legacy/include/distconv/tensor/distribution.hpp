@@ -7,6 +7,7 @@
 
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 namespace distconv {
 namespace tensor {
@@ -18,6 +19,11 @@ class Distribution {
   IntVector m_overlap;
   // Block size when cyclic distribution is used
   Shape m_block_size;
+  // Explicit sizes of the splits of each dimension. Empty for
+  // dimensions that are partitioned evenly.
+  std::vector<std::vector<index_t>> m_partitions;
+  // Whether the halos of each dimension wrap around the edges
+  std::vector<bool> m_periodic;
 
  public:
   Distribution(const Shape &locale_shape,
@@ -27,7 +33,8 @@ class Distribution {
       m_locale_shape(locale_shape),
       m_split_shape(split_shape),
       m_overlap(overlap),
-      m_block_size(block_size) {
+      m_block_size(block_size),
+      m_periodic(locale_shape.num_dims(), false) {
     sanity_check_shapes();
     fixup_overlap();
   }
@@ -99,7 +106,9 @@ class Distribution {
     return m_locale_shape == d.m_locale_shape &&
         m_split_shape == d.m_split_shape &&
         m_block_size == d.m_block_size &&
-        m_overlap == d.m_overlap;
+        m_overlap == d.m_overlap &&
+        m_partitions == d.m_partitions &&
+        m_periodic == d.m_periodic;
   }
 
   bool operator!=(const Distribution &d) const {
@@ -131,9 +140,49 @@ class Distribution {
 
   void set_split_shape(const Shape &split_shape) {
     m_split_shape = split_shape;
+    clear_partitions();
     sanity_check_shapes();
   }
 
+  bool has_partition(int dim) const {
+    dim = dim < 0 ? num_dims() + dim : dim;
+    return dim < (int)m_partitions.size() && !m_partitions[dim].empty();
+  }
+
+  // Sizes of the splits of dimension dim in the split order
+  const std::vector<index_t> &get_partition(int dim) const {
+    assert_always(has_partition(dim));
+    return m_partitions[dim < 0 ? num_dims() + dim : dim];
+  }
+
+  // Partitions dimension dim by the given split sizes instead of
+  // evenly. The sizes must add up to the size of the dimension of
+  // each tensor with this distribution.
+  void set_partition(int dim, const std::vector<index_t> &sizes) {
+    dim = dim < 0 ? num_dims() + dim : dim;
+    assert_eq((index_t)sizes.size(), m_split_shape[dim]);
+    m_partitions.resize(num_dims());
+    m_partitions[dim] = sizes;
+  }
+
+  void clear_partition(int dim) {
+    dim = dim < 0 ? num_dims() + dim : dim;
+    if (dim < (int)m_partitions.size()) {
+      m_partitions[dim].clear();
+    }
+  }
+
+  void clear_partitions() {
+    m_partitions.clear();
+  }
+
+  bool is_evenly_partitioned() const {
+    for (int i = 0; i < num_dims(); ++i) {
+      if (has_partition(i)) return false;
+    }
+    return true;
+  }
+
   void sanity_check_shapes() const {
     auto nd = num_dims();
     assert_eq(m_split_shape.num_dims(), nd);
@@ -192,6 +241,21 @@ class Distribution {
     m_overlap = d.m_overlap;
   }
 
+  bool is_periodic(int dim) const {
+    return m_periodic[dim];
+  }
+
+  /*
+    Makes the halos of dim wrap around: the processes at either edge
+    exchange halos with the process at the other edge, and a process
+    alone in dim with itself, so periodic boundaries need no padding
+    copies. Periodic dimensions keep their overlap even when not
+    split, so set the overlap after this.
+   */
+  void set_periodic(int dim, bool periodic=true) {
+    m_periodic[dim] = periodic;
+  }
+
   bool is_distributed(int dim) const {
     return get_split_shape()[dim] > 1;
   }
@@ -245,10 +309,10 @@ class Distribution {
     return num_partitioned_dims > 1;
   }
 
-  // disables overlap if the dimension is not distributed
+  // disables overlap if the dimension is not distributed nor periodic
   void fixup_overlap() {
     for (int i = 0; i < num_dims(); ++i) {
-      if (!is_distributed(i)) {
+      if (!is_distributed(i) && !is_periodic(i)) {
         set_overlap(i, 0);
       }
     }
@@ -263,6 +327,13 @@ class Distribution {
       }
       ss << m_split_shape[i] << "/" << m_locale_shape[i]
          << ":" << m_overlap[i];
+      if (is_periodic(i)) {
+        ss << "p";
+      }
+      if (has_partition(i)) {
+        util::print_vector(ss, m_partitions[i].begin(),
+                           m_partitions[i].end());
+      }
     }
     ss << ")";
     return os << ss.str();
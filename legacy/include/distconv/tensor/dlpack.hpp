@@ -0,0 +1,178 @@
+#pragma once
+
+#include "distconv_config.hpp"
+
+#ifndef DISTCONV_HAS_DLPACK
+#error "DLPack was not found when DiHydrogen was configured"
+#endif
+
+#include "distconv/tensor/memory_gpu.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "h2/gpu/runtime.hpp"
+
+#include <dlpack/dlpack.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+  Zero-copy exchange of the local tensors of LocaleMPI tensors with
+  other frameworks, e.g., PyTorch or CuPy, through DLPack.
+
+  DLPack shapes and strides are outermost first, i.e., in the reverse
+  order of distconv. The data are ordered between the streams of the
+  producer and the consumer with an event, without synchronizing the
+  device.
+ */
+
+namespace distconv {
+namespace tensor {
+
+namespace dlpack_internal {
+
+template <typename DataType>
+struct DLPackType;
+
+template <>
+struct DLPackType<float> {
+  static constexpr DLDataType value = {kDLFloat, 32, 1};
+};
+
+template <>
+struct DLPackType<double> {
+  static constexpr DLDataType value = {kDLFloat, 64, 1};
+};
+
+template <>
+struct DLPackType<std::int32_t> {
+  static constexpr DLDataType value = {kDLInt, 32, 1};
+};
+
+template <>
+struct DLPackType<std::int64_t> {
+  static constexpr DLDataType value = {kDLInt, 64, 1};
+};
+
+inline DLDevice get_current_device() {
+#if H2_HAS_CUDA
+  return DLDevice{kDLCUDA, h2::gpu::current_gpu()};
+#elif H2_HAS_ROCM
+  return DLDevice{kDLROCM, h2::gpu::current_gpu()};
+#endif
+}
+
+// Holds the shape and strides of an exported tensor
+struct ExportContext {
+  std::vector<std::int64_t> shape;
+  std::vector<std::int64_t> strides;
+  DLManagedTensor managed;
+};
+
+} // namespace dlpack_internal
+
+/**
+   Export the local tensor of this process as a DLPack tensor without
+   a copy. The consumer must call its deleter, which releases only the
+   DLPack structures; the tensor must outlive the export.
+
+   With include_halo, the exported tensor covers the halos too, and
+   otherwise it starts at the first element past them. Either way,
+   the strides are those of the local buffer, including the halos and
+   the pitch.
+
+   The work issued on stream until the export is ordered before the
+   work issued on consumer_stream afterwards.
+ */
+template <typename DataType>
+DLManagedTensor *ExportDLPack(Tensor<DataType, LocaleMPI, CUDAAllocator> &t,
+                              bool include_halo,
+                              h2::gpu::DeviceStream stream,
+                              h2::gpu::DeviceStream consumer_stream) {
+  assert_always(!t.is_null());
+  const int nd = t.get_num_dims();
+  const auto shape =
+      include_halo ? t.get_local_real_shape() : t.get_local_shape();
+  const auto strides = t.get_strides();
+  auto ctx = new dlpack_internal::ExportContext;
+  for (int i = nd - 1; i >= 0; --i) {
+    ctx->shape.push_back(shape[i]);
+    ctx->strides.push_back(strides[i]);
+  }
+  DLTensor &dl = ctx->managed.dl_tensor;
+  dl.data = t.get_buffer(!include_halo);
+  dl.device = dlpack_internal::get_current_device();
+  dl.ndim = nd;
+  dl.dtype = dlpack_internal::DLPackType<DataType>::value;
+  dl.shape = ctx->shape.data();
+  dl.strides = ctx->strides.data();
+  dl.byte_offset = 0;
+  ctx->managed.manager_ctx = ctx;
+  ctx->managed.deleter = [](DLManagedTensor *self) {
+    delete static_cast<dlpack_internal::ExportContext *>(self->manager_ctx);
+  };
+  util::wait_stream(stream, consumer_stream);
+  return &ctx->managed;
+}
+
+/**
+   Make the local tensor of t a view of an external DLPack tensor,
+   whose deleter is called once the returned owner is released. t
+   must be kept from using its data past then.
+
+   The external tensor must be on the current device, be of the type
+   of t, and have the local shape of t, or its local real shape if t
+   has halos. It may be pitched in the innermost dimension, and the
+   other dimensions must be contiguous.
+
+   The work issued on producer_stream until the import is ordered
+   before the work issued on stream afterwards.
+
+   @return null, leaving t and src untouched, if src cannot be
+   viewed, in which case it has to be copied.
+ */
+template <typename DataType>
+std::shared_ptr<DLManagedTensor>
+ImportDLPack(Tensor<DataType, LocaleMPI, CUDAAllocator> &t,
+             DLManagedTensor *src,
+             h2::gpu::DeviceStream producer_stream,
+             h2::gpu::DeviceStream stream) {
+  const DLTensor &dl = src->dl_tensor;
+  const int nd = t.get_num_dims();
+  const auto device = dlpack_internal::get_current_device();
+  const auto dtype = dlpack_internal::DLPackType<DataType>::value;
+  if (dl.device.device_type != device.device_type ||
+      dl.device.device_id != device.device_id ||
+      dl.dtype.code != dtype.code || dl.dtype.bits != dtype.bits ||
+      dl.dtype.lanes != dtype.lanes || dl.ndim != nd) {
+    return nullptr;
+  }
+  const auto shape = t.get_local_real_shape();
+  index_t pitch = shape[0];
+  index_t expected_stride = 1;
+  for (int i = 0; i < nd; ++i) {
+    const int dl_dim = nd - 1 - i;
+    if (dl.shape[dl_dim] != (std::int64_t)shape[i]) return nullptr;
+    // Null strides mean a compact row-major tensor
+    const index_t stride = dl.strides ? dl.strides[dl_dim] : expected_stride;
+    if (i == 1 && stride >= expected_stride) {
+      pitch = stride;
+      expected_stride = stride;
+    } else if (stride != expected_stride && shape[i] > 1) {
+      return nullptr;
+    }
+    expected_stride *= shape[i];
+  }
+  if (dl.byte_offset % sizeof(DataType)) return nullptr;
+  t.set_view(static_cast<DataType *>(dl.data) +
+                 dl.byte_offset / sizeof(DataType),
+             pitch);
+  util::wait_stream(producer_stream, stream);
+  return std::shared_ptr<DLManagedTensor>(src, [](DLManagedTensor *p) {
+    if (p->deleter) p->deleter(p);
+  });
+}
+
+} // namespace tensor
+} // namespace distconv
@@ -0,0 +1,96 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util.hpp"
+
+#include <h2/tensor/dist_tensor.hpp>
+
+namespace distconv
+{
+namespace tensor
+{
+
+/** @brief Distribution of t as an h2 layout.
+ *
+ *  h2 tensors are block-distributed over a process grid, so t must
+ *  not be split over several processes per partition, and its
+ *  partitions must be those of the block distribution of h2.
+ */
+template <int N, typename DataType, typename Allocator>
+h2::DistLayout<N>
+get_h2_layout(const Tensor<DataType, LocaleMPI, Allocator>& t)
+{
+    assert_always(t.get_num_dims() == N);
+    assert_always(t.get_split_shape() == t.get_locale_shape());
+    h2::DimTuple<N> shape;
+    h2::DimTuple<N> halo;
+    typename h2::ProcGrid<N>::Coord grid;
+    for (int d = 0; d < N; ++d)
+    {
+        shape[d] = t.get_shape()[d];
+        halo[d] = t.get_halo_width(d);
+        grid[d] = t.get_locale_shape()[d];
+    }
+    h2::DistLayout<N> const layout(shape, h2::ProcGrid<N>(grid), halo);
+    for (int d = 0; d < N; ++d)
+    {
+        for (int i = 0; i < grid[d]; ++i)
+        {
+            typename h2::ProcGrid<N>::Coord c = {};
+            c[d] = i;
+            assert_always(layout.local_box(layout.grid().rank(c)).offset[d]
+                          == (h2::DimType) t.get_dimension_rank_offset(d, i));
+        }
+    }
+    return layout;
+}
+
+/** @brief Zero-copy h2 view of the local partition of t.
+ *
+ *  Work on the view is enqueued on stream. t keeps owning the memory,
+ *  including its pitch, and must outlive the view.
+ */
+template <int N, typename DataType, typename Allocator>
+h2::DistTensor<DataType, N>
+make_h2_view(Tensor<DataType, LocaleMPI, Allocator>& t,
+             h2::gpu::DeviceStream stream)
+{
+    auto const dist = get_h2_layout<N>(t);
+    h2::LocalLayout<N> local;
+    auto const strides = t.get_strides();
+    for (int d = 0; d < N; ++d)
+    {
+        local.shape[d] = t.get_local_shape()[d];
+        local.halo[d] = t.get_halo_width(d);
+        local.strides[d] = strides[d];
+    }
+    return h2::DistTensor<DataType, N>::view(
+        dist, t.get_locale().get_rank(), local, t.get_buffer(), stream);
+}
+
+/** @brief Make t a view of the memory of h2 tensor x.
+ *
+ *  t must be an unallocated tensor distributed as x is; x keeps owning
+ *  the memory and must outlive t.
+ */
+template <int N, typename DataType, typename Allocator>
+void view_h2_tensor(Tensor<DataType, LocaleMPI, Allocator>& t,
+                    h2::DistTensor<DataType, N>& x)
+{
+    assert_always(get_h2_layout<N>(t) == x.dist());
+    assert_always(t.get_locale().get_rank() == x.proc_rank());
+    // Legacy views are not pitched.
+    auto const packed =
+        h2::LocalLayout<N>::packed(x.local().shape, x.local().halo);
+    assert_always(x.local().strides == packed.strides);
+    View(t, x.buffer());
+}
+
+} // namespace tensor
+} // namespace distconv
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+#include "distconv_config.hpp"
+
+#ifdef DISTCONV_HAS_P2P
+#include "p2p/p2p.hpp"
+#endif // DISTCONV_HAS_P2P
+
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+namespace distconv {
+namespace tensor {
+
+/*
+  Halo buffers shared by the halo exchangers of a process. Tensors
+  with the same shape and distribution, e.g., those of consecutive
+  layers, exchange halos of the same size with the same peers. Their
+  exchangers therefore use the same send and receive buffers. With
+  P2P, they also use the same mapping of the receive buffer of the
+  peer. Entries are keyed by the communicator, peer, dimension, side
+  and byte size of the halo, and the device and thread of the
+  exchanger, and are released once no exchanger uses them. Layers run
+  concurrently from different threads, or exchanging over different
+  communicators, thus never share buffers.
+
+  Exchanges sharing buffers must not be interleaved, e.g., by
+  exchanging with one exchanger while the halo received by another is
+  not unpacked yet. Layers exchange their halos one at a time on the
+  boundary streams of the backend, which keeps them ordered. Sharing
+  is disabled by setting DISTCONV_DISABLE_HALO_BUFFER_SHARING.
+ */
+class HaloBufferRegistry {
+ public:
+  struct Key {
+    // Communicator of the tensor, in which peer is a rank
+    MPI_Comm comm;
+    int peer;
+    int dim;
+    Side side;
+    size_t size;
+    // Set by get to the current device and thread
+    int device = -1;
+    std::thread::id thread;
+    bool operator<(const Key &k) const {
+      return std::tie(comm, peer, dim, side, size, device, thread) <
+          std::tie(k.comm, k.peer, k.dim, k.side, k.size, k.device,
+                   k.thread);
+    }
+  };
+
+  struct Entry {
+    Memory<CUDAAllocator> send;
+    Memory<CUDAAllocator> recv;
+#ifdef DISTCONV_HAS_P2P
+    // Set once the receive buffer of the peer is mapped with p2p
+    p2p::P2P *p2p = nullptr;
+    p2p::P2P::connection_type conn;
+    void *peer_addr = nullptr;
+
+    ~Entry() {
+      // The peer closes its entry of this process at the same point
+      // as both are used by the corresponding exchangers.
+      if (p2p != nullptr) {
+        p2p->close_addrs(&conn, &peer_addr, 1);
+      }
+    }
+#endif // DISTCONV_HAS_P2P
+  };
+
+  static HaloBufferRegistry &get_instance() {
+    static HaloBufferRegistry registry;
+    return registry;
+  }
+
+  bool is_enabled() const {
+    return m_enabled;
+  }
+
+  // Buffers of key. They are allocated and zero-cleared on the default
+  // stream when no exchanger uses them.
+  std::shared_ptr<Entry> get(Key key) {
+    key.device = h2::gpu::current_gpu();
+    key.thread = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto entry = m_entries[key].lock();
+    if (entry == nullptr) {
+      entry = std::make_shared<Entry>();
+      for (auto buf: {&entry->send, &entry->recv}) {
+        buf->allocate(key.size);
+        buf->memset(0, 0);
+      }
+      m_entries[key] = entry;
+      DISTCONV_LOG_DEBUG(HaloExchange)
+          << "Halo buffers allocated for rank " << key.peer
+          << ", dimension " << key.dim << ", " << key.side
+          << ": " << key.size << " bytes";
+    }
+    return entry;
+  }
+
+ private:
+  bool m_enabled;
+  std::mutex m_mutex;
+  std::map<Key, std::weak_ptr<Entry>> m_entries;
+
+  HaloBufferRegistry():
+      m_enabled(std::getenv("DISTCONV_DISABLE_HALO_BUFFER_SHARING")
+                == nullptr) {}
+};
+
+} // namespace tensor
+} // namespace distconv
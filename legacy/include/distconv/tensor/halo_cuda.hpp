@@ -2,8 +2,12 @@
 
 #include "distconv/base.hpp"
 #include "distconv/runtime_gpu.hpp"
+#include "distconv/util/launch_config.hpp"
 #include <distconv_config.hpp>
 
+#include <cstdint>
+#include <vector>
+
 #if H2_HAS_CUDA
 #include <cooperative_groups.h>
 #define GPU_LAST_ERROR cudaGetLastError
@@ -28,15 +32,38 @@ enum class HaloTraversalOpGroup
     BLOCK
 };
 
+// Maximum number of regions traversed by a single fused launch, enough
+// for all the neighbors of a 3D decomposition
+constexpr int max_num_fused_regions = 26;
+
 namespace internal
 {
 
-template <int ND, typename DataType, typename OpType>
+// Regions handled by one fused launch. Each region is assigned a
+// contiguous range of blocks, starting at block_offsets.
+template <int ND, typename BufType>
+struct RegionTable
+{
+    // Kept small to fit in the kernel parameters.
+    Array<ND, int> offsets[max_num_fused_regions];
+    FastDivShape<ND> shapes[max_num_fused_regions];
+    BufType* bufs[max_num_fused_regions];
+    size_t num_points[max_num_fused_regions];
+    int block_offsets[max_num_fused_regions + 1];
+    int num_regions;
+};
+
+// HW is the halo width when known at compile time, or 0 to read it
+// from halo_width. A constant width lets the index along dim be
+// computed with constant divisions.
+template <int ND, typename DataType, typename OpType, int HW>
 __global__
     typename std::enable_if<OpType::group == HaloTraversalOpGroup::THREAD,
                             void>::type
     traverse_halo_generic_kernel(DataType* tensor,
                                  Array<ND> shape,
+                                 FastDivShape<ND> halo_shape,
+                                 int pitch,
                                  int dim,
                                  Side side,
                                  bool inner,
@@ -46,18 +73,29 @@ __global__
 {
     const size_t num_threads = blockDim.x * gridDim.x;
     const bool fwd_halo = side == Side::RHS;
+    if (HW > 0)
+        halo_width = HW;
     for (size_t packed_offset = threadIdx.x + blockIdx.x * blockDim.x;
          packed_offset < num_halo_points;
          packed_offset += num_threads)
     {
         size_t tensor_offset = 0;
         size_t dim_offset = 1;
-        size_t offset = packed_offset;
+        uint32_t offset = packed_offset;
 #pragma unroll
         for (int i = 0; i < ND; ++i)
         {
-            int i_dim = i == dim ? halo_width : shape[i];
-            int idx = offset % i_dim;
+            int idx;
+            if (HW > 0 && i == dim)
+            {
+                constexpr uint32_t width = HW > 0 ? HW : 1;
+                idx = offset % width;
+                offset /= width;
+            }
+            else
+            {
+                idx = halo_shape.divmod(i, offset);
+            }
             if (i == dim)
             {
                 if (fwd_halo)
@@ -80,18 +118,19 @@ __global__
                 }
             }
             tensor_offset += idx * dim_offset;
-            offset /= i_dim;
-            dim_offset *= shape[i];
+            dim_offset *= i == 0 ? pitch : shape[i];
         }
         op(tensor[tensor_offset], packed_offset);
     }
 }
 
-template <int ND, typename DataType, typename OpType>
+template <int ND, typename DataType, typename OpType, int HW>
 __global__ typename std::enable_if<OpType::group == HaloTraversalOpGroup::BLOCK,
                                    void>::type
 traverse_halo_generic_kernel(DataType* tensor,
                              Array<ND> shape,
+                             FastDivShape<ND> halo_shape,
+                             int pitch,
                              int dim,
                              Side side,
                              bool inner,
@@ -105,6 +144,7 @@ traverse_halo_generic_kernel(DataType* tensor,
 template <typename DataType, typename OpType>
 void traverse_halo_generic(DataType* tensor,
                            const Shape& shape,
+                           int pitch,
                            int dim,
                            Side side,
                            bool inner,
@@ -116,19 +156,102 @@ void traverse_halo_generic(DataType* tensor,
                            const dim3& block_dims,
                            h2::gpu::DeviceStream s)
 {
-#define CALL_KERNEL(ND)                                                        \
-    traverse_halo_generic_kernel<ND, DataType, OpType>                         \
+    // The shape traversed, with halo_width along dim
+    Shape halo_shape = shape;
+    halo_shape[dim] = halo_width;
+#define CALL_KERNEL(ND, HW)                                                    \
+    traverse_halo_generic_kernel<ND, DataType, OpType, HW>                     \
         <<<grid_dims, block_dims, 0, s>>>(tensor,                              \
                                           Array<ND>(shape),                    \
+                                          FastDivShape<ND>(halo_shape),        \
+                                          pitch,                               \
                                           dim,                                 \
                                           side,                                \
                                           inner,                               \
                                           halo_width,                          \
                                           num_halo_points,                     \
                                           op)
+// Halos of 3 to 7-wide filters of 3D to 5D tensors are traversed
+// with the width known at compile time; others with the width read
+// at run time.
+#define CALL_KERNEL_WIDTH(ND)                                                  \
+    switch (halo_width)                                                        \
+    {                                                                          \
+    case 1: CALL_KERNEL(ND, 1); break;                                         \
+    case 2: CALL_KERNEL(ND, 2); break;                                         \
+    case 3: CALL_KERNEL(ND, 3); break;                                         \
+    default: CALL_KERNEL(ND, 0); break;                                        \
+    }
 
     switch (nd)
     {
+    case 1: CALL_KERNEL(1, 0); break;
+    case 2: CALL_KERNEL(2, 0); break;
+    case 3: CALL_KERNEL_WIDTH(3); break;
+    case 4: CALL_KERNEL_WIDTH(4); break;
+    case 5: CALL_KERNEL_WIDTH(5); break;
+    case 6: CALL_KERNEL(6, 0); break;
+    default: throw std::exception();
+    }
+#undef CALL_KERNEL_WIDTH
+#undef CALL_KERNEL
+}
+
+// Traverse a box of the tensor starting at offset. The shape is the
+// pitched one, as it only gives the strides.
+template <int ND, typename DataType, typename OpType>
+__global__ void traverse_region_kernel(DataType* tensor,
+                                       Array<ND> shape,
+                                       Array<ND> offset,
+                                       FastDivShape<ND> region_shape,
+                                       size_t num_points,
+                                       OpType op)
+{
+    const size_t num_threads = blockDim.x * gridDim.x;
+    for (size_t packed_offset = threadIdx.x + blockIdx.x * blockDim.x;
+         packed_offset < num_points;
+         packed_offset += num_threads)
+    {
+        size_t tensor_offset = 0;
+        size_t dim_offset = 1;
+        uint32_t idx = packed_offset;
+#pragma unroll
+        for (int i = 0; i < ND; ++i)
+        {
+            tensor_offset +=
+                (region_shape.divmod(i, idx) + offset[i]) * dim_offset;
+            dim_offset *= shape[i];
+        }
+        op(tensor[tensor_offset], packed_offset);
+    }
+}
+
+template <typename DataType, typename OpType>
+void traverse_region(DataType* tensor,
+                     const Shape& shape,
+                     const IndexVector& offset,
+                     const Shape& region_shape,
+                     OpType op,
+                     h2::gpu::DeviceStream s)
+{
+    const size_t num_points = region_shape.get_size();
+    if (num_points == 0)
+    {
+        return;
+    }
+    const int block_size = util::block_size;
+    const int grid_size = (num_points + block_size - 1) / block_size;
+#define CALL_KERNEL(ND)                                                        \
+    traverse_region_kernel<ND, DataType, OpType>                               \
+        <<<grid_size, block_size, 0, s>>>(tensor,                              \
+                                          Array<ND>(shape),                    \
+                                          Array<ND>(offset),                   \
+                                          FastDivShape<ND>(region_shape),      \
+                                          num_points,                          \
+                                          op)
+
+    switch (shape.num_dims())
+    {
     case 1: CALL_KERNEL(1); break;
     case 2: CALL_KERNEL(2); break;
     case 3: CALL_KERNEL(3); break;
@@ -140,6 +263,84 @@ void traverse_halo_generic(DataType* tensor,
 #undef CALL_KERNEL
 }
 
+// OpType is constructed with the buffer of each region.
+template <int ND, typename DataType, typename BufType, typename OpType>
+__global__ void traverse_regions_kernel(DataType* tensor,
+                                        Array<ND> shape,
+                                        RegionTable<ND, BufType> table)
+{
+    int r = 0;
+    while ((int) blockIdx.x >= table.block_offsets[r + 1])
+    {
+        ++r;
+    }
+    const size_t packed_offset =
+        (blockIdx.x - table.block_offsets[r]) * blockDim.x + threadIdx.x;
+    if (packed_offset >= table.num_points[r])
+    {
+        return;
+    }
+    size_t tensor_offset = 0;
+    size_t dim_offset = 1;
+    uint32_t idx = packed_offset;
+#pragma unroll
+    for (int i = 0; i < ND; ++i)
+    {
+        tensor_offset +=
+            (table.shapes[r].divmod(i, idx) + table.offsets[r][i]) * dim_offset;
+        dim_offset *= shape[i];
+    }
+    OpType op(table.bufs[r]);
+    op(tensor[tensor_offset], packed_offset);
+}
+
+template <int ND, typename DataType, typename BufType, typename OpType>
+void traverse_regions(DataType* tensor,
+                      const Shape& shape,
+                      const std::vector<IndexVector>& offsets,
+                      const std::vector<Shape>& region_shapes,
+                      const std::vector<BufType*>& bufs,
+                      h2::gpu::DeviceStream s)
+{
+    static_assert(sizeof(RegionTable<ND, BufType>) + sizeof(Array<ND>)
+                          + sizeof(DataType*)
+                      <= 4096,
+                  "Region table exceeds the kernel parameter limit");
+    const int block_size = util::block_size;
+    for (size_t begin = 0; begin < offsets.size();
+         begin += max_num_fused_regions)
+    {
+        RegionTable<ND, BufType> table;
+        table.num_regions = 0;
+        table.block_offsets[0] = 0;
+        for (size_t i = begin;
+             i < offsets.size() && i < begin + max_num_fused_regions;
+             ++i)
+        {
+            const size_t num_points = region_shapes[i].get_size();
+            if (num_points == 0)
+            {
+                continue;
+            }
+            const int r = table.num_regions++;
+            table.offsets[r] = Array<ND, int>(offsets[i]);
+            table.shapes[r] = FastDivShape<ND>(region_shapes[i]);
+            table.bufs[r] = bufs[i];
+            table.num_points[r] = num_points;
+            table.block_offsets[r + 1] =
+                table.block_offsets[r]
+                + (num_points + block_size - 1) / block_size;
+        }
+        if (table.num_regions == 0)
+        {
+            continue;
+        }
+        const int grid_size = table.block_offsets[table.num_regions];
+        traverse_regions_kernel<ND, DataType, BufType, OpType>
+            <<<grid_size, block_size, 0, s>>>(tensor, Array<ND>(shape), table);
+    }
+}
+
 // ND: 4, 5
 // Traverse halo at dimension 0
 template <typename DataType, typename OpType>
@@ -186,6 +387,7 @@ __device__ static
 template <int ND, typename DataType, typename OpType, bool inner, Side side>
 __device__ static void traverse_halo_opt_dim0(DataType* tensor,
                                               Array<ND> shape,
+                                              int pitch,
                                               int halo_width,
                                               OpType op)
 {
@@ -238,11 +440,11 @@ __device__ static void traverse_halo_opt_dim0(DataType* tensor,
             size_t packed_offset =
                 offset_common * halo_width + packed_halo_idx - threadIdx.x;
             size_t tensor_offset =
-                offset_common * shape[0] + halo_idx - threadIdx.x;
+                offset_common * pitch + halo_idx - threadIdx.x;
             traverse_halo_opt_dim0_apply(tensor,
                                          tensor_offset,
                                          packed_offset,
-                                         shape[0],
+                                         pitch,
                                          shape[1],
                                          halo_width,
                                          op);
@@ -298,13 +500,14 @@ __device__ static
                                     size_t tensor_offset_common,
                                     size_t packed_offset_common,
                                     int x_len,
+                                    int pitch,
                                     int y_len,
                                     int z_len,
                                     int halo_tensor_base,
                                     OpType op)
 {
     packed_offset_common += x_len * threadIdx.y;
-    tensor_offset_common += x_len * y_len * threadIdx.y;
+    tensor_offset_common += pitch * y_len * threadIdx.y;
     for (int y = threadIdx.y; y < z_len; y += blockDim.y)
     {
         int const z_block_len =
@@ -316,14 +519,14 @@ __device__ static
             size_t packed_offset =
                 packed_offset_common + x_len * z_block_len * hw;
             int halo_idx = hw + halo_tensor_base;
-            size_t tensor_offset = tensor_offset_common + x_len * halo_idx;
+            size_t tensor_offset = tensor_offset_common + pitch * halo_idx;
             for (int x = threadIdx.x; x < x_len; x += blockDim.x)
             {
                 op(tensor[tensor_offset + x], packed_offset + x);
             }
         }
         packed_offset_common += halo_width * x_len * blockDim.y;
-        tensor_offset_common += x_len * y_len * blockDim.y;
+        tensor_offset_common += pitch * y_len * blockDim.y;
     }
 }
 
@@ -335,6 +538,7 @@ __device__ static
                                     size_t tensor_offset_common,
                                     size_t packed_offset_common,
                                     int x_len,
+                                    int pitch,
                                     int y_len,
                                     int z_len,
                                     int halo_tensor_base,
@@ -354,8 +558,8 @@ __device__ static
                                    + x_len * z_block_len * hw
                                    + z * x_len * halo_width;
             int halo_idx = hw + halo_tensor_base;
-            size_t tensor_offset = tensor_offset_common + x_len * halo_idx
-                                   + z_thread * x_len * y_len;
+            size_t tensor_offset = tensor_offset_common + pitch * halo_idx
+                                   + z_thread * pitch * y_len;
             for (int x = 0; x < x_len; x += blockDim.x)
             {
                 // avoid reading beyond array boundary
@@ -377,6 +581,7 @@ template <int ND,
           int halo_width>
 __device__ static void traverse_halo_opt_dim1(DataType* __restrict__ tensor,
                                               const Array<ND>& shape,
+                                              int pitch,
                                               OpType op)
 {
     constexpr int dim = 1;
@@ -410,7 +615,9 @@ __device__ static void traverse_halo_opt_dim1(DataType* __restrict__ tensor,
     for (int ch_idx = blockIdx.x; ch_idx < shape[-2]; ch_idx += gridDim.x)
     {
         const size_t packed_offset_common = offset_common * halo_width;
-        const size_t tensor_offset_common = offset_common * shape[1];
+        // offset_common counts rows of shape[0] points
+        const size_t tensor_offset_common =
+            offset_common / shape[0] * pitch * shape[1];
         if (ND == 5)
         {
             traverse_halo_opt_dim1_5d_apply<DataType, OpType, halo_width>(
@@ -418,6 +625,7 @@ __device__ static void traverse_halo_opt_dim1(DataType* __restrict__ tensor,
                 tensor_offset_common,
                 packed_offset_common,
                 shape[0],
+                pitch,
                 shape[1],
                 shape[2],
                 halo_tensor_base,
@@ -430,8 +638,7 @@ __device__ static void traverse_halo_opt_dim1(DataType* __restrict__ tensor,
             {
                 int halo_idx = hw + halo_tensor_base;
                 size_t packed_offset = packed_offset_common + shape[0] * hw;
-                size_t tensor_offset =
-                    tensor_offset_common + shape[0] * halo_idx;
+                size_t tensor_offset = tensor_offset_common + pitch * halo_idx;
                 traverse_halo_opt_dim1_apply(
                     tensor, tensor_offset, packed_offset, shape[0], op);
             }
@@ -450,13 +657,14 @@ __device__ static
                                  size_t tensor_offset_common,
                                  size_t packed_offset_common,
                                  int x_len,
+                                 int pitch,
                                  int y_len,
                                  OpType op)
 {
     for (int y = threadIdx.y; y < y_len; y += blockDim.y)
     {
         size_t packed_offset = packed_offset_common + x_len * y;
-        size_t tensor_offset = tensor_offset_common + x_len * y;
+        size_t tensor_offset = tensor_offset_common + pitch * y;
         for (int x = threadIdx.x; x < x_len; x += blockDim.x)
         {
             op(tensor[tensor_offset + x], packed_offset + x);
@@ -472,6 +680,7 @@ __device__ static
                                  size_t tensor_offset_common,
                                  size_t packed_offset_common,
                                  int x_len,
+                                 int pitch,
                                  int y_len,
                                  OpType op)
 {
@@ -482,7 +691,7 @@ __device__ static
         {
             // avoid reading beyond array boundary
             auto tensor_idx = min(x + threadIdx.x, x_len - 1)
-                              + min(y + threadIdx.y, y_len - 1) * x_len;
+                              + min(y + threadIdx.y, y_len - 1) * pitch;
             op(tensor[tensor_offset_common + tensor_idx],
                packed_offset_common + x + y * x_len,
                tid,
@@ -501,6 +710,7 @@ template <int ND,
           int halo_width>
 __device__ static void traverse_halo_opt_dim2(DataType* __restrict__ tensor,
                                               const Array<ND>& shape,
+                                              int pitch,
                                               OpType op)
 {
     constexpr int dim = 2;
@@ -531,8 +741,10 @@ __device__ static void traverse_halo_opt_dim2(DataType* __restrict__ tensor,
     for (int ch_idx = blockIdx.x; ch_idx < shape[-2]; ch_idx += gridDim.x)
     {
         size_t packed_offset_common = offset_common * halo_width;
-        size_t tensor_offset_common = offset_common * shape[2];
-        tensor_offset_common += shape[0] * shape[1] * halo_idx;
+        // offset_common counts rows of shape[0] points
+        size_t tensor_offset_common =
+            offset_common / shape[0] * pitch * shape[2];
+        tensor_offset_common += pitch * shape[1] * halo_idx;
 #pragma unroll
         for (int hw = 0; hw < halo_width; ++hw)
         {
@@ -540,10 +752,11 @@ __device__ static void traverse_halo_opt_dim2(DataType* __restrict__ tensor,
                                          tensor_offset_common,
                                          packed_offset_common,
                                          shape[0],
+                                         pitch,
                                          shape[1],
                                          op);
             packed_offset_common += shape[0] * shape[1];
-            tensor_offset_common += shape[0] * shape[1];
+            tensor_offset_common += pitch * shape[1];
         }
         offset_common += ch_offset;
     }
@@ -613,24 +826,26 @@ template <int ND,
           Side side,
           int dim,
           int halo_width>
-__global__ static void
-traverse_halo_opt(DataType* __restrict__ tensor, Array<ND> shape, OpType op)
+__global__ static void traverse_halo_opt(DataType* __restrict__ tensor,
+                                         Array<ND> shape,
+                                         int pitch,
+                                         OpType op)
 {
     traverse_halo_pre(op);
     if (dim == 0)
     {
         traverse_halo_opt_dim0<ND, DataType, OpType, inner, side>(
-            tensor, shape, halo_width, op);
+            tensor, shape, pitch, halo_width, op);
     }
     else if (dim == 1)
     {
         traverse_halo_opt_dim1<ND, DataType, OpType, inner, side, halo_width>(
-            tensor, shape, op);
+            tensor, shape, pitch, op);
     }
     else if (dim == 2)
     {
         traverse_halo_opt_dim2<ND, DataType, OpType, inner, side, halo_width>(
-            tensor, shape, op);
+            tensor, shape, pitch, op);
     }
     traverse_halo_post(op);
 }
@@ -644,6 +859,7 @@ template <int ND,
           int dim>
 inline void traverse_halo_opt(DataType* tensor,
                               Array<ND> shape,
+                              int pitch,
                               int halo_width,
                               OpType op,
                               h2::gpu::DeviceStream s,
@@ -653,7 +869,7 @@ inline void traverse_halo_opt(DataType* tensor,
 #define CALL(HW)                                                               \
     if ((OpType::has_post_grid || OpType::has_pre_grid) && num_blocks > 1)     \
     {                                                                          \
-        void* args[3] = {&tensor, &shape, &op};                                \
+        void* args[4] = {&tensor, &shape, &pitch, &op};                                \
         DISTCONV_CHECK_GPU(                                                    \
             GPU_LAUNCH_COOP_KERNEL((const void*) (traverse_halo_opt<ND,        \
                                                                     DataType,  \
@@ -671,7 +887,7 @@ inline void traverse_halo_opt(DataType* tensor,
     else                                                                       \
     {                                                                          \
         traverse_halo_opt<ND, DataType, OpType, inner, side, dim, HW>          \
-            <<<gsize, bsize, 0, s>>>(tensor, shape, op);                       \
+            <<<gsize, bsize, 0, s>>>(tensor, shape, pitch, op);                \
         auto err = GPU_LAST_ERROR();                                           \
         if (err != GPU_SUCCESS)                                                \
         {                                                                      \
@@ -738,37 +954,43 @@ template <int ND,
           int dim>
 inline void traverse_halo_opt(DataType* tensor,
                               Array<ND> shape,
+                              int pitch,
                               int halo_width,
                               OpType op,
                               h2::gpu::DeviceStream s)
 {
+    // Rows of a pitched tensor start at the pitch, which must be a
+    // multiple of the vector width as well. Pitches aligned to 128
+    // bytes always are.
     int vector_width = 1;
     if (dim >= 1)
     {
-        if (shape[0] % 4 == 0)
+        if (shape[0] % 4 == 0 && pitch % 4 == 0)
         {
             // vector2 seems better than vector4.
             vector_width = 2;
         }
-        else if (shape[0] % 2 == 0)
+        else if (shape[0] % 2 == 0 && pitch % 2 == 0)
         {
             vector_width = 2;
         }
         shape[0] /= vector_width;
+        pitch /= vector_width;
     }
     else if (dim == 0)
     {
-        if (halo_width % 4 == 0 && shape[0] % 4 == 0)
+        if (halo_width % 4 == 0 && shape[0] % 4 == 0 && pitch % 4 == 0)
         {
             // vector2 seems better than vector4.
             vector_width = 2;
         }
-        else if (halo_width % 2 == 0 && shape[0] % 2 == 0)
+        else if (halo_width % 2 == 0 && shape[0] % 2 == 0 && pitch % 2 == 0)
         {
             vector_width = 2;
         }
         halo_width /= vector_width;
         shape[0] /= vector_width;
+        pitch /= vector_width;
     }
     else
     {
@@ -808,12 +1030,12 @@ inline void traverse_halo_opt(DataType* tensor,
     {
         using VecType = typename util::GetVectorType<DataType, 2>::type;
         traverse_halo_opt<ND, VecType, OpType, inner, side, dim>(
-            (VecType*) tensor, shape, halo_width, op, s, gsize, bsize);
+            (VecType*) tensor, shape, pitch, halo_width, op, s, gsize, bsize);
     }
     else
     {
         traverse_halo_opt<ND, DataType, OpType, inner, side, dim>(
-            tensor, shape, halo_width, op, s, gsize, bsize);
+            tensor, shape, pitch, halo_width, op, s, gsize, bsize);
     }
 }
 
@@ -822,6 +1044,7 @@ inline void traverse_halo_opt(DataType* tensor,
 template <int ND, typename DataType, typename OpType, bool inner, Side side>
 inline void traverse_halo_opt(DataType* tensor,
                               Array<ND> shape,
+                              int pitch,
                               int dim,
                               int halo_width,
                               OpType op,
@@ -830,18 +1053,18 @@ inline void traverse_halo_opt(DataType* tensor,
     if (dim == 0)
     {
         traverse_halo_opt<ND, DataType, OpType, inner, side, 0>(
-            tensor, shape, halo_width, op, s);
+            tensor, shape, pitch, halo_width, op, s);
     }
     else if (dim == 1)
     {
         traverse_halo_opt<ND, DataType, OpType, inner, side, 1>(
-            tensor, shape, halo_width, op, s);
+            tensor, shape, pitch, halo_width, op, s);
     }
     else
     {
         assert_eq(dim, 2);
         traverse_halo_opt<ND, DataType, OpType, inner, side, 2>(
-            tensor, shape, halo_width, op, s);
+            tensor, shape, pitch, halo_width, op, s);
     }
 }
 
@@ -850,6 +1073,7 @@ inline void traverse_halo_opt(DataType* tensor,
 template <int ND, typename DataType, typename OpType, bool inner>
 inline void traverse_halo_opt(DataType* tensor,
                               Array<ND> shape,
+                              int pitch,
                               int dim,
                               Side side,
                               int halo_width,
@@ -859,12 +1083,12 @@ inline void traverse_halo_opt(DataType* tensor,
     if (side == Side::RHS)
     {
         traverse_halo_opt<ND, DataType, OpType, inner, Side::RHS>(
-            tensor, shape, dim, halo_width, op, s);
+            tensor, shape, pitch, dim, halo_width, op, s);
     }
     else
     {
         traverse_halo_opt<ND, DataType, OpType, inner, Side::LHS>(
-            tensor, shape, dim, halo_width, op, s);
+            tensor, shape, pitch, dim, halo_width, op, s);
     }
 }
 
@@ -873,6 +1097,7 @@ inline void traverse_halo_opt(DataType* tensor,
 template <int ND, typename DataType, typename OpType>
 inline void traverse_halo_opt(DataType* tensor,
                               Array<ND> shape,
+                              int pitch,
                               int dim,
                               Side side,
                               int halo_width,
@@ -883,12 +1108,12 @@ inline void traverse_halo_opt(DataType* tensor,
     if (inner)
     {
         traverse_halo_opt<ND, DataType, OpType, true>(
-            tensor, shape, dim, side, halo_width, op, s);
+            tensor, shape, pitch, dim, side, halo_width, op, s);
     }
     else
     {
         traverse_halo_opt<ND, DataType, OpType, false>(
-            tensor, shape, dim, side, halo_width, op, s);
+            tensor, shape, pitch, dim, side, halo_width, op, s);
     }
 }
 
@@ -919,11 +1144,14 @@ void TraverseHalo(Tensor& tensor,
         // No halo region attached
         return;
     }
+    // Points between rows of a pitched tensor are not traversed
+    const int pitch = static_cast<int>(tensor.get_pitch());
     if (num_dims == 4 && (dim == 0 || dim == 1))
     {
         internal::traverse_halo_opt<4, ConstDataType, OpType>(
             static_cast<ConstDataType*>(tensor.get_buffer()),
             tensor.get_local_real_shape(),
+            pitch,
             dim,
             side,
             halo_width,
@@ -936,6 +1164,7 @@ void TraverseHalo(Tensor& tensor,
         internal::traverse_halo_opt<5, ConstDataType, OpType>(
             static_cast<ConstDataType*>(tensor.get_buffer()),
             tensor.get_local_real_shape(),
+            pitch,
             dim,
             side,
             halo_width,
@@ -955,6 +1184,7 @@ void TraverseHalo(Tensor& tensor,
         internal::traverse_halo_generic<ConstDataType, OpType>(
             static_cast<ConstDataType*>(tensor.get_buffer()),
             tensor.get_local_real_shape(),
+            pitch,
             dim,
             side,
             inner,
@@ -1007,6 +1237,65 @@ void TraverseHalo(
     TraverseHalo(tensor, dim, Side::LHS, inner, op, s);
 }
 
+// Traverse the box of the local real tensor with the given offset and
+// shape, e.g., faces, edges and corners of the halo
+template <typename Tensor, typename OpType>
+void TraverseRegion(Tensor& tensor,
+                    const IndexVector& offset,
+                    const Shape& region_shape,
+                    OpType op,
+                    h2::gpu::DeviceStream s)
+{
+    using ConstDataType = std::conditional_t<OpType::modifies_tensor,
+                                             typename Tensor::data_type,
+                                             typename Tensor::const_data_type>;
+    // Block-based operation not supported
+    assert_always(OpType::group == HaloTraversalOpGroup::THREAD);
+    internal::traverse_region<ConstDataType, OpType>(
+        static_cast<ConstDataType*>(tensor.get_buffer()),
+        tensor.get_local_pitched_shape(),
+        offset,
+        region_shape,
+        op,
+        s);
+}
+
+// Traverse multiple boxes in a single launch. Unlike TraverseRegion,
+// OpType is constructed on the device from the buffer of each box.
+// Boxes must not overlap if OpType modifies the tensor.
+template <typename Tensor, typename OpType>
+void TraverseRegions(Tensor& tensor,
+                     const std::vector<IndexVector>& offsets,
+                     const std::vector<Shape>& region_shapes,
+                     const std::vector<typename Tensor::data_type*>& bufs,
+                     h2::gpu::DeviceStream s)
+{
+    using ConstDataType = std::conditional_t<OpType::modifies_tensor,
+                                             typename Tensor::data_type,
+                                             typename Tensor::const_data_type>;
+    using BufType = typename Tensor::data_type;
+    assert_always(OpType::group == HaloTraversalOpGroup::THREAD);
+    assert_eq(offsets.size(), region_shapes.size());
+    assert_eq(offsets.size(), bufs.size());
+    auto tensor_ptr = static_cast<ConstDataType*>(tensor.get_buffer());
+    const auto shape = tensor.get_local_pitched_shape();
+#define CALL_TRAVERSE(ND)                                                      \
+    internal::traverse_regions<ND, ConstDataType, BufType, OpType>(            \
+        tensor_ptr, shape, offsets, region_shapes, bufs, s)
+
+    switch (tensor.get_num_dims())
+    {
+    case 1: CALL_TRAVERSE(1); break;
+    case 2: CALL_TRAVERSE(2); break;
+    case 3: CALL_TRAVERSE(3); break;
+    case 4: CALL_TRAVERSE(4); break;
+    case 5: CALL_TRAVERSE(5); break;
+    case 6: CALL_TRAVERSE(6); break;
+    default: throw std::exception();
+    }
+#undef CALL_TRAVERSE
+}
+
 } // namespace tensor
 } // namespace distconv
 
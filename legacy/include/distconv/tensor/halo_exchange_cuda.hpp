@@ -2,9 +2,13 @@
 
 #include "distconv/base.hpp"
 #include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/halo_buffer_registry.hpp"
 #include "distconv/tensor/halo_exchange.hpp"
 #include "distconv/tensor/memory_gpu.hpp"
+#include "distconv/tensor/occupancy.hpp"
 #include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/instrumentation.hpp"
+#include "distconv/util/memory_accounting.hpp"
 #include "distconv/util/util_gpu.hpp"
 #include "distconv/util/util_mpi.hpp"
 
@@ -15,13 +19,21 @@
 namespace distconv {
 namespace tensor {
 
+template <typename DataType, typename AlBackend>
+class HaloExchangeAuto;
+
 template <typename DataType, typename AlBackend>
 class HaloExchange<DataType, CUDAAllocator, AlBackend> {
+  // Calls unpack of the per-dimension implementations
+  friend class HaloExchangeAuto<DataType, AlBackend>;
  public:
   using TensorType = Tensor<DataType, LocaleMPI, CUDAAllocator>;
   using CommType = std::shared_ptr<typename AlBackend::comm_type>;
 
-  HaloExchange(TensorType &tensor): m_tensor(tensor), m_peers(-1) {
+  HaloExchange(TensorType &tensor):
+      m_tensor(tensor), m_peers(-1),
+      m_row_steps(tensor.get_num_dims(), 1),
+      m_row_phases(tensor.get_num_dims(), 0) {
     bool exchange_req = false;
     for (int i = 0; i < tensor.get_num_dims(); ++i) {
       exchange_req |= is_exchange_required(i);
@@ -36,18 +48,143 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
   HaloExchange(const HaloExchange<DataType, CUDAAllocator, AlBackend> &x):
       HaloExchange(x.m_tensor) {
     m_peers = x.m_peers;
+    m_comm_precision = x.m_comm_precision;
+    m_accum_scale = x.m_accum_scale;
+    m_row_steps = x.m_row_steps;
+    m_row_phases = x.m_row_phases;
+    m_clear_boundary_halos = x.m_clear_boundary_halos;
+    m_occupancy = x.m_occupancy;
   }
 
   HaloExchange &operator=(const HaloExchange &x) {
     m_tensor = x.m_tensor;
     m_peers = x.m_peers;
+    m_comm_precision = x.m_comm_precision;
+    m_accum_scale = x.m_accum_scale;
+    m_row_steps = x.m_row_steps;
+    m_row_phases = x.m_row_phases;
+    m_clear_boundary_halos = x.m_clear_boundary_halos;
+    m_occupancy = x.m_occupancy;
     m_halo_send.clear();
     m_halo_recv.clear();
+    m_halo_bufs.clear();
+    m_halo_buffers_ready.reset();
     return *this;
   }
 
   virtual ~HaloExchange() {}
 
+  /*
+    Sets the precision halos are packed with. Reduced precisions round
+    the exchanged halos, so they are meant for layers whose halo
+    exchange is communication bound and tolerant to the rounding. All
+    processes of the tensor must use the same precision.
+   */
+  virtual void set_comm_precision(CommPrecision precision) {
+    if (!is_comm_precision_supported<DataType>(precision) ||
+        (precision != CommPrecision::FULL && !supports_comm_precision())) {
+      util::MPIPrintStreamError()
+          << "Halo exchange does not support precision " << precision;
+      throw std::exception();
+    }
+    m_comm_precision = precision;
+  }
+
+  CommPrecision get_comm_precision() const {
+    return m_comm_precision;
+  }
+
+  /*
+    Sets the weight of the halos summed into the tensor when unpacking
+    with HaloExchangeAccumOp::SUM, e.g., to average the neighbor
+    contributions of a reverse exchange without a separate pass over
+    the tensor. The local elements are not scaled.
+   */
+  virtual void set_accum_scale(DataType scale) {
+    if (scale != DataType(1) && !supports_accum_scale()) {
+      util::MPIPrintStreamError()
+          << "Halo exchange does not support scaling summed halos";
+      throw std::exception();
+    }
+    m_accum_scale = scale;
+  }
+
+  DataType get_accum_scale() const {
+    return m_accum_scale;
+  }
+
+  /*
+    Packs only the halo rows of a dimension whose global index is
+    congruent to phase modulo step, e.g., the rows read by a strided
+    and dilated convolution, and leaves the other received rows as
+    they are. It applies to the implementations that pack the halos
+    themselves and with the full precision; the others exchange the
+    whole halos, which gives the same rows. All processes of the
+    tensor must use the same subset.
+   */
+  virtual void set_row_subset(int dim, int step, int phase) {
+    if (step < 1 ||
+        (step > 1 && m_tensor.get_distribution().is_periodic(dim))) {
+      util::MPIPrintStreamError()
+          << "Invalid halo row subset of dimension " << dim
+          << ": step " << step;
+      throw std::exception();
+    }
+    m_row_steps[dim] = step;
+    m_row_phases[dim] = ((phase % step) + step) % step;
+  }
+
+  // Step of the packed halo rows of a dimension, which is one when
+  // the whole halos are packed
+  int get_row_step(int dim) const {
+    if (!supports_row_subset() || m_comm_precision != CommPrecision::FULL) {
+      return 1;
+    }
+    return m_row_steps[dim];
+  }
+
+  int get_row_phase(int dim) const {
+    return m_row_phases[dim];
+  }
+
+  /*
+    Zeroes the halos of the sides without a peer, i.e., at the outer
+    boundary of the exchanged dimensions, when unpacking forward
+    exchanges. This replaces clearing the halos of the tensor
+    separately when they serve as zero padding.
+   */
+  void set_clear_boundary_halos(bool clear) {
+    m_clear_boundary_halos = clear;
+  }
+
+  bool get_clear_boundary_halos() const {
+    return m_clear_boundary_halos;
+  }
+
+  /*
+    Sets the occupancy of the tensor, kept by the caller and computed
+    before each exchange, with which implementations may signal halos
+    that are all zeros instead of sending them in forward exchanges.
+    Null disables it.
+   */
+  void set_occupancy(const Occupancy *occupancy) {
+    m_occupancy = occupancy;
+  }
+
+  const Occupancy *get_occupancy() const {
+    return m_occupancy;
+  }
+
+  /*
+    Whether all the halos received by the last exchange were signaled
+    as zeros, in which case the tensor including its halos is zero if
+    its occupancy is empty. False if the implementation does not
+    signal zero halos.
+   */
+  virtual bool received_zero_halos() {
+    return false;
+  }
+
   /*
     rendezvous: synchronize before exchanging halos. Implicitly done
     with MPI. Explicit barrier is used with the P2P-based
@@ -65,6 +202,7 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
                         bool skip_unpack,
                         HaloExchangeAccumOp op = HaloExchangeAccumOp::ID)
   {
+      DISTCONV_RANGE("halo_exchange", HaloExchange);
       h2::gpu::DeviceStream prev_streams[2] = {stream_main, stream_main};
       for (int i = 0; i < m_tensor.get_num_dims(); ++i)
       {
@@ -94,6 +232,14 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
                        is_reverse,
                        skip_unpack,
                        op);
+              if (!skip_unpack && !is_reverse)
+              {
+                  clear_boundary_halos(i,
+                                       widths_rhs_recv[i],
+                                       widths_lhs_recv[i],
+                                       comms(i, RHS)->get_stream(),
+                                       comms(i, LHS)->get_stream());
+              }
           }
       }
       if (sync_back)
@@ -103,6 +249,10 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
               util::wait_stream(prev_streams[side], stream_main);
           }
       }
+      for (Side side : SIDES)
+      {
+          util::sync_if_synchronous(prev_streams[side]);
+      }
   }
   virtual void exchange(BoundaryAttributesV<CommType>& comms,
                         h2::gpu::DeviceStream stream_main,
@@ -145,13 +295,13 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
              skip_unpack, op);
   }
 
-  void unpack(const IntVector& widths_rhs_recv,
-              const IntVector& widths_lhs_recv,
-              BoundaryAttributesV<h2::gpu::DeviceStream>& streams,
-              h2::gpu::DeviceStream stream_main,
-              bool sync_back,
-              bool is_reverse,
-              HaloExchangeAccumOp op = HaloExchangeAccumOp::ID)
+  virtual void unpack(const IntVector& widths_rhs_recv,
+                      const IntVector& widths_lhs_recv,
+                      BoundaryAttributesV<h2::gpu::DeviceStream>& streams,
+                      h2::gpu::DeviceStream stream_main,
+                      bool sync_back,
+                      bool is_reverse,
+                      HaloExchangeAccumOp op = HaloExchangeAccumOp::ID)
   {
       h2::gpu::DeviceStream prev_streams[2] = {stream_main, stream_main};
       for (int i = 0; i < m_tensor.get_num_dims(); ++i)
@@ -176,6 +326,14 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
                  streams(i, LHS),
                  is_reverse,
                  op);
+          if (!is_reverse)
+          {
+              clear_boundary_halos(i,
+                                   widths_rhs_recv[i],
+                                   widths_lhs_recv[i],
+                                   streams(i, RHS),
+                                   streams(i, LHS));
+          }
       }
       if (sync_back)
       {
@@ -258,7 +416,18 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
   TensorType &m_tensor;
   BoundaryAttributesV<Memory<CUDAAllocator>> m_halo_send;
   BoundaryAttributesV<Memory<CUDAAllocator>> m_halo_recv;
+  // Entries of the halo buffers when shared with other exchangers
+  BoundaryAttributesV<std::shared_ptr<HaloBufferRegistry::Entry>> m_halo_bufs;
   BoundaryAttributesV<int> m_peers;
+  CommPrecision m_comm_precision = CommPrecision::FULL;
+  DataType m_accum_scale = DataType(1);
+  bool m_clear_boundary_halos = false;
+  const Occupancy *m_occupancy = nullptr;
+  // Halo rows packed per dimension; see set_row_subset
+  IntVector m_row_steps;
+  IntVector m_row_phases;
+  // Recorded after the last clearing of halo buffers
+  h2::gpu::PooledEvent m_halo_buffers_ready;
 
   int &get_peer(int dim, Side side) {
     return m_peers(dim, side);
@@ -274,6 +443,37 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
     return get_halo_size(dim, m_tensor.get_distribution().get_overlap(dim));
   }
 
+  // Rows of a halo of the given width that are packed. The rows of
+  // the subset are at most this many, and the rest of the packed halo
+  // is not read.
+  int get_packed_width(int dim, int width) const {
+    return util::ceil(width, get_row_step(dim));
+  }
+
+  // Bytes of a halo packed with the communication precision
+  size_t get_halo_bytes(int dim, int width) const {
+    return get_halo_size(dim, get_packed_width(dim, width))
+        * get_comm_element_size<DataType>(m_comm_precision);
+  }
+
+  // Whether halos are packed only by pack_dim and unpacked only by
+  // unpack_dim, which convert them to the communication precision
+  virtual bool supports_comm_precision() const {
+    return true;
+  }
+
+  // Whether halos summed when unpacking are weighted by the
+  // accumulation scale
+  virtual bool supports_accum_scale() const {
+    return true;
+  }
+
+  // Whether only the halo rows of set_row_subset are packed, which
+  // requires packing by pack_dim and unpacking by unpack_dim
+  virtual bool supports_row_subset() const {
+    return supports_comm_precision();
+  }
+
   virtual void *get_send_buffer(int dim, Side side) {
     return m_halo_send(dim, side).get();
   }
@@ -282,32 +482,65 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
     return m_halo_recv(dim, side).get();
   }
 
+  // The buffers hold full-precision halos, so they are large enough
+  // for any communication precision.
   virtual void ensure_halo_buffers(int dim) {
     size_t s = get_halo_size(dim) * sizeof(DataType);
     assert_always(s > 0);
+    util::memory_accounting::OwnerScope owner(
+        util::memory_accounting::Owner::HALO);
+    auto &registry = HaloBufferRegistry::get_instance();
+    bool cleared = false;
     for (auto side: SIDES) {
       if (get_peer(dim, side) == MPI_PROC_NULL) continue;
+      if (registry.is_enabled() && m_halo_send(dim, side).is_null()) {
+        auto &entry = m_halo_bufs(dim, side);
+        entry = registry.get({m_tensor.get_locale().get_comm(),
+                              get_peer(dim, side), dim, side, s});
+        m_halo_send(dim, side) = entry->send;
+        m_halo_recv(dim, side) = entry->recv;
+        // The registry may have just cleared them
+        cleared = true;
+        continue;
+      }
       if (m_halo_send(dim, side).is_null()) {
         m_halo_send(dim, side).allocate(s);
         m_halo_send(dim, side).memset(0, 0);
-        // ensure memset is completed
-        h2::gpu::sync(static_cast<h2::gpu::DeviceStream>(0));
+        cleared = true;
       }
       if (m_halo_recv(dim, side).is_null()) {
         m_halo_recv(dim, side).allocate(s);
         m_halo_recv(dim, side).memset(0, 0);
-        // ensure memset is completed
-        h2::gpu::sync(static_cast<h2::gpu::DeviceStream>(0));
+        cleared = true;
       }
     }
+    if (cleared) {
+      // The buffers are cleared on the default stream, which the
+      // exchanges wait for in wait_halo_buffers
+      const auto default_stream = static_cast<h2::gpu::DeviceStream>(0);
+      if (util::is_synchronous()) {
+        h2::gpu::sync(default_stream);
+      } else {
+        m_halo_buffers_ready = util::record_pooled_event(default_stream);
+      }
+    }
+  }
+
+  // Makes the streams of the exchange wait for the clearing of the
+  // halo buffers without blocking the host
+  void wait_halo_buffers(CommType &comm_rhs, CommType &comm_lhs) {
+    if (!m_halo_buffers_ready) return;
+    for (auto stream: {comm_rhs->get_stream(), comm_lhs->get_stream()}) {
+      DISTCONV_CHECK_GPU(GPU_STREAM_WAIT_EVENT(stream, m_halo_buffers_ready,
+                                               0));
+    }
   }
 
   virtual bool is_exchange_required(int dim,
                                     int width_rhs_send, int width_rhs_recv,
                                     int width_lhs_send, int width_lhs_recv) {
     const auto &dist = m_tensor.get_distribution();
-    return dist.is_distributed(dim) &&
-        dist.get_split_shape()[dim] > 1 &&
+    return (dist.is_distributed(dim) || dist.is_periodic(dim)) &&
         (width_rhs_send > 0 || width_rhs_recv > 0 ||
          width_lhs_send > 0 || width_lhs_recv > 0) &&
         (m_tensor.get_local_size() > 0);
@@ -341,7 +574,13 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
 
     // processes located at either edge
     if (peer_dim_idx < 0 || peer_dim_idx >= (int)locale_shape[dim]) {
-      return MPI_PROC_NULL;
+      if (!dist.is_periodic(dim)) {
+        return MPI_PROC_NULL;
+      }
+      // Wraps around to the other edge, which is this process itself
+      // when it is alone in dim
+      const int n = locale_shape[dim];
+      peer_dim_idx = (peer_dim_idx + n) % n;
     }
 
     auto proc_idx = m_tensor.get_proc_index();
@@ -362,6 +601,42 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
       });
   }
 
+  // Whether both sides of dim exchange with the same process, which
+  // happens with periodic dimensions of one or two processes. The
+  // halo sent to a side then arrives at the other side of the peer,
+  // so the sides cannot be told apart by the peer alone.
+  bool has_same_peers(int dim) {
+    return get_peer(dim, RHS) != MPI_PROC_NULL
+        && get_peer(dim, RHS) == get_peer(dim, LHS);
+  }
+
+  // The boundary communicators of the layers alternate between the
+  // processes along a dimension, so that each pair of neighbors
+  // shares one. The edges of a periodic dimension are thus paired
+  // only when the dimension has an even number of processes, or one.
+  // Used by implementations exchanging with the boundary
+  // communicators or pairing the sides likewise.
+  void check_periodic_pairing(int dim) {
+    const auto &dist = m_tensor.get_distribution();
+    const int n = dist.get_locale_shape()[dim];
+    if (dist.is_periodic(dim) && n > 1 && n % 2) {
+      util::MPIPrintStreamError()
+          << "Halo exchange requires an even number of processes "
+          << "in periodic dimension " << dim << ": " << dist;
+      throw std::exception();
+    }
+  }
+
+  // Used by implementations that identify the sides by their peers
+  void check_distinct_peers(int dim) {
+    if (has_same_peers(dim)) {
+      util::MPIPrintStreamError()
+          << "Halo exchange does not support the same peer on both sides"
+          << " of dimension " << dim << ": " << m_tensor.get_distribution();
+      throw std::exception();
+    }
+  }
+
   void pack_dim(int dim,
                 Side side,
                 int width,
@@ -369,6 +644,8 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
                 void* buf,
                 bool is_reverse)
   {
+      util::instrumentation::ScopedTimer timer(
+          util::instrumentation::Phase::HALO_PACK, stream);
       pack_or_unpack(dim, side, width, stream, buf, true, is_reverse);
   }
 
@@ -380,6 +657,8 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
                   bool is_reverse,
                   HaloExchangeAccumOp op = HaloExchangeAccumOp::ID)
   {
+      util::instrumentation::ScopedTimer timer(
+          util::instrumentation::Phase::HALO_UNPACK, stream);
       pack_or_unpack(dim, side, width, stream, buf, false, is_reverse, op);
   }
 
@@ -392,6 +671,79 @@ class HaloExchange<DataType, CUDAAllocator, AlBackend> {
                       bool is_reverse,
                       HaloExchangeAccumOp op = HaloExchangeAccumOp::ID);
 
+  void clear_boundary_halo(int dim,
+                           Side side,
+                           int width,
+                           h2::gpu::DeviceStream stream);
+
+  // Issued to the streams the sides are unpacked with, so later
+  // dimensions exchange the cleared halos
+  void clear_boundary_halos(int dim,
+                            int width_rhs_recv,
+                            int width_lhs_recv,
+                            h2::gpu::DeviceStream stream_rhs,
+                            h2::gpu::DeviceStream stream_lhs)
+  {
+      if (!m_clear_boundary_halos)
+          return;
+      for (auto side : SIDES)
+      {
+          if (get_peer(dim, side) != MPI_PROC_NULL)
+              continue;
+          util::instrumentation::ScopedTimer timer(
+              util::instrumentation::Phase::HALO_UNPACK,
+              side == Side::RHS ? stream_rhs : stream_lhs);
+          clear_boundary_halo(dim,
+                              side,
+                              side == Side::RHS ? width_rhs_recv
+                                                : width_lhs_recv,
+                              side == Side::RHS ? stream_rhs : stream_lhs);
+      }
+  }
+
+  // Exchanges packed halos with Aluminum. Reduced-precision halos are
+  // exchanged as bytes.
+  void send_recv_halo(int dim,
+                      int width_send,
+                      int width_recv,
+                      void* send_buf,
+                      void* recv_buf,
+                      int peer,
+                      typename AlBackend::comm_type& comm)
+  {
+      // Attributed to the peer, which delays it when late
+      util::instrumentation::ScopedTimer timer(
+          util::instrumentation::Phase::HALO_TRANSFER, peer,
+          comm.get_stream());
+      if (m_comm_precision == CommPrecision::FULL)
+      {
+          Al::SendRecv<AlBackend, DataType>(static_cast<DataType*>(send_buf),
+                                            get_halo_size(
+                                                dim,
+                                                get_packed_width(dim,
+                                                                 width_send)),
+                                            peer,
+                                            static_cast<DataType*>(recv_buf),
+                                            get_halo_size(
+                                                dim,
+                                                get_packed_width(dim,
+                                                                 width_recv)),
+                                            peer,
+                                            comm);
+      }
+      else
+      {
+          Al::SendRecv<AlBackend, unsigned char>(
+              static_cast<unsigned char*>(send_buf),
+              get_halo_bytes(dim, width_send),
+              peer,
+              static_cast<unsigned char*>(recv_buf),
+              get_halo_bytes(dim, width_recv),
+              peer,
+              comm);
+      }
+  }
+
   virtual bool unpack(int dim,
                       int width_rhs_recv,
                       int width_lhs_recv,
@@ -38,28 +38,35 @@ class HaloExchangeAL:
       return;
     }
 
+    this->check_periodic_pairing(dim);
     this->ensure_halo_buffers(dim);
+    this->wait_halo_buffers(comm_rhs, comm_lhs);
 
+    // A process alone in a periodic dimension receives the halo sent
+    // to a side at the other side
+    const bool is_self = this->get_peer(dim, RHS)
+        == this->m_tensor.get_locale().get_rank();
     for (auto side: SIDES) {
       if (this->get_peer(dim, side) == MPI_PROC_NULL) continue;
       CommType &comm = side == Side::RHS ? comm_rhs : comm_lhs;
       const h2::gpu::DeviceStream stream = comm->get_stream();
+      const Side recv_side = is_self ? ~side : side;
       const int width_send = side == Side::RHS ? width_rhs_send : width_lhs_send;
-      const int width_recv = side == Side::RHS ? width_rhs_recv : width_lhs_recv;
+      const int width_recv = recv_side == Side::RHS
+          ? width_rhs_recv : width_lhs_recv;
       auto send_buf = this->get_send_buffer(dim, side);
-      auto recv_buf = this->get_recv_buffer(dim, side);
-      size_t send_count = this->get_halo_size(dim, width_send);
-      size_t recv_count = this->get_halo_size(dim, width_recv);
+      auto recv_buf = this->get_recv_buffer(dim, recv_side);
       if (width_send > 0) {
         // pack the local halo
         this->pack_dim(dim, side, width_send, stream, send_buf, is_reverse);
       }
-      Al::SendRecv<AlBackend, DataType>(
-          static_cast<DataType*>(send_buf), send_count,
-          this->get_peer(dim, side),
-          static_cast<DataType*>(recv_buf), recv_count,
-          this->get_peer(dim, side),
-          *comm);
+      this->send_recv_halo(dim, width_send, width_recv, send_buf, recv_buf,
+                           this->get_peer(dim, side), *comm);
+    }
+    if (is_self) {
+      // Each side is received on the stream of the other
+      util::wait_stream(comm_rhs->get_stream(), comm_lhs->get_stream());
+      util::wait_stream(comm_lhs->get_stream(), comm_rhs->get_stream());
     }
     if (!skip_unpack) {
       this->unpack(dim, width_rhs_recv, width_lhs_recv,
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "distconv/tensor/halo_exchange_cuda.hpp"
+
+#include <Al.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace distconv {
+namespace tensor {
+
+/*
+  Dispatches the exchange of each dimension to a separate
+  implementation, e.g., P2P for dimensions split within a node and AL
+  for those split across nodes. Dimensions without an implementation
+  set are not exchanged.
+ */
+template <typename DataType, typename AlBackend>
+class HaloExchangeAuto:
+      public HaloExchange<DataType, CUDAAllocator, AlBackend> {
+  using Base = HaloExchange<DataType, CUDAAllocator, AlBackend>;
+  using TensorType = typename Base::TensorType;
+  using CommType = typename Base::CommType;
+ public:
+  HaloExchangeAuto(TensorType &tensor):
+      Base(tensor), m_impls(tensor.get_num_dims()) {}
+
+  HaloExchangeAuto(const HaloExchangeAuto &x) = delete;
+  HaloExchangeAuto &operator=(const HaloExchangeAuto &x) = delete;
+
+  virtual ~HaloExchangeAuto() {}
+
+  // An implementation can be shared by several dimensions
+  void set_impl(int dim, std::shared_ptr<Base> impl) {
+    m_impls.at(dim) = std::move(impl);
+    apply_comm_precision(m_impls.at(dim).get());
+    if (m_impls.at(dim) != nullptr) {
+      m_impls.at(dim)->set_accum_scale(this->m_accum_scale);
+      apply_row_subsets(m_impls.at(dim).get());
+    }
+  }
+
+  // Implementations that cannot pack with reduced precision keep
+  // exchanging their dimensions in full precision.
+  void set_comm_precision(CommPrecision precision) override {
+    if (!is_comm_precision_supported<DataType>(precision)) {
+      util::MPIPrintStreamError()
+          << "Halo exchange does not support precision " << precision;
+      throw std::exception();
+    }
+    this->m_comm_precision = precision;
+    for (auto &impl: m_impls) {
+      apply_comm_precision(impl.get());
+    }
+  }
+
+  // Unlike the precision, the scale changes the result, so all the
+  // implementations must support it
+  void set_accum_scale(DataType scale) override {
+    for (auto &impl: m_impls) {
+      if (impl != nullptr) {
+        impl->set_accum_scale(scale);
+      }
+    }
+    this->m_accum_scale = scale;
+  }
+
+  // Implementations without row subsets exchange the whole halos
+  void set_row_subset(int dim, int step, int phase) override {
+    Base::set_row_subset(dim, step, phase);
+    for (auto &impl: m_impls) {
+      if (impl != nullptr) {
+        impl->set_row_subset(dim, step, phase);
+      }
+    }
+  }
+
+  Base *get_impl(int dim) {
+    return m_impls.at(dim).get();
+  }
+
+  // Whether the peers of dim are on the same node as this process
+  bool is_intra_node(int dim) {
+    MPI_Comm comm = this->m_tensor.get_locale().get_comm();
+    MPI_Comm node_comm;
+    DISTCONV_CHECK_MPI(MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0,
+                                           MPI_INFO_NULL, &node_comm));
+    MPI_Group group, node_group;
+    DISTCONV_CHECK_MPI(MPI_Comm_group(comm, &group));
+    DISTCONV_CHECK_MPI(MPI_Comm_group(node_comm, &node_group));
+    bool intra = true;
+    for (auto side: SIDES) {
+      int peer = this->get_peer(dim, side);
+      if (peer == MPI_PROC_NULL) continue;
+      int node_peer;
+      DISTCONV_CHECK_MPI(MPI_Group_translate_ranks(group, 1, &peer,
+                                                   node_group, &node_peer));
+      intra &= node_peer != MPI_UNDEFINED;
+    }
+    DISTCONV_CHECK_MPI(MPI_Group_free(&node_group));
+    DISTCONV_CHECK_MPI(MPI_Group_free(&group));
+    DISTCONV_CHECK_MPI(MPI_Comm_free(&node_comm));
+    return intra;
+  }
+
+  using Base::exchange;
+  using Base::unpack;
+
+  void exchange(int dim,
+                int width_rhs_send, int width_rhs_recv,
+                int width_lhs_send, int width_lhs_recv,
+                CommType &comm_rhs,
+                CommType &comm_lhs,
+                bool rendezvous,
+                bool is_reverse,
+                bool skip_unpack,
+                HaloExchangeAccumOp op=HaloExchangeAccumOp::ID) override {
+    if (m_impls[dim] == nullptr) return;
+    m_impls[dim]->exchange(dim, width_rhs_send, width_rhs_recv,
+                           width_lhs_send, width_lhs_recv,
+                           comm_rhs, comm_lhs, rendezvous, is_reverse,
+                           skip_unpack, op);
+  }
+
+ protected:
+  std::vector<std::shared_ptr<Base>> m_impls;
+
+  void apply_comm_precision(Base *impl) {
+    if (impl != nullptr && impl->supports_comm_precision()) {
+      impl->set_comm_precision(this->m_comm_precision);
+    }
+  }
+
+  void apply_row_subsets(Base *impl) {
+    for (int i = 0; i < this->m_tensor.get_num_dims(); ++i) {
+      impl->set_row_subset(i, this->m_row_steps[i], this->m_row_phases[i]);
+    }
+  }
+
+  bool unpack(int dim,
+              int width_rhs_recv,
+              int width_lhs_recv,
+              h2::gpu::DeviceStream stream_rhs,
+              h2::gpu::DeviceStream stream_lhs,
+              bool is_reverse,
+              HaloExchangeAccumOp op=HaloExchangeAccumOp::ID) override {
+    if (m_impls[dim] == nullptr) return false;
+    // The received halos are in the buffers of the implementation.
+    return m_impls[dim]->unpack(dim, width_rhs_recv, width_lhs_recv,
+                                stream_rhs, stream_lhs, is_reverse, op);
+  }
+};
+
+} // namespace tensor
+} // namespace distconv
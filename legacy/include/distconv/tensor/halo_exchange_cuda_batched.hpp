@@ -0,0 +1,345 @@
+#pragma once
+
+#include "distconv/tensor/halo_exchange_cuda.hpp"
+
+#include <Al.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+namespace distconv {
+namespace tensor {
+
+/*
+  Exchanges the halos of all partitioned dimensions in a single
+  epoch. Faces, edges and corners are packed at once and sent directly
+  to each of the up to 3^N-1 neighbors with one Aluminum MultiSendRecv,
+  which runs as a single NCCL group. Corner halos thus do not depend on
+  the exchange of other dimensions. All the transfers run on the stream
+  of one of the boundary communicators.
+ */
+template <typename DataType, typename Allocator, typename AlBackend>
+class HaloExchangeALBatched:
+      public HaloExchange<DataType, Allocator, AlBackend> {
+  using Base = HaloExchange<DataType, Allocator, AlBackend>;
+  using TensorType = typename Base::TensorType;
+  using CommType = typename Base::CommType;
+ public:
+  HaloExchangeALBatched(TensorType &tensor): Base(tensor) {}
+  HaloExchangeALBatched(const HaloExchangeALBatched &x): Base(x) {}
+
+  virtual ~HaloExchangeALBatched() {}
+
+  using Base::exchange;
+  using Base::unpack;
+
+  void exchange(const IntVector& widths_rhs_send,
+                const IntVector& widths_rhs_recv,
+                const IntVector& widths_lhs_send,
+                const IntVector& widths_lhs_recv,
+                BoundaryAttributesV<CommType>& comms,
+                h2::gpu::DeviceStream stream_main,
+                bool rendezvous,
+                bool sync_back,
+                bool is_reverse,
+                bool skip_unpack,
+                HaloExchangeAccumOp op=HaloExchangeAccumOp::ID) override {
+    std::vector<int> dims;
+    for (int i = 0; i < this->m_tensor.get_num_dims(); ++i) {
+      if (this->is_exchange_required(i, widths_rhs_send[i],
+                                     widths_rhs_recv[i],
+                                     widths_lhs_send[i],
+                                     widths_lhs_recv[i])) {
+        dims.push_back(i);
+      }
+    }
+    if (dims.empty()) return;
+    CommType &comm = comms(dims[0], RHS);
+    util::wait_stream(stream_main, comm->get_stream());
+    exchange_neighbors(dims, true, widths_rhs_send, widths_rhs_recv,
+                       widths_lhs_send, widths_lhs_recv, comm,
+                       is_reverse, skip_unpack, op);
+    if (!skip_unpack && !is_reverse) {
+      for (int d: dims) {
+        this->clear_boundary_halos(d, widths_rhs_recv[d], widths_lhs_recv[d],
+                                   m_stream, m_stream);
+      }
+    }
+    // Boundary computations wait for the streams of their own
+    // communicators.
+    for (int d: dims) {
+      for (auto side: SIDES) {
+        util::wait_stream(comm->get_stream(), comms(d, side)->get_stream());
+      }
+    }
+    if (sync_back) {
+      util::wait_stream(comm->get_stream(), stream_main);
+    }
+  }
+
+  // Exchanges the faces of dim only, as HaloExchangeAL does
+  void exchange(int dim,
+                int width_rhs_send, int width_rhs_recv,
+                int width_lhs_send, int width_lhs_recv,
+                CommType &comm_rhs,
+                CommType &comm_lhs,
+                bool rendezvous,
+                bool is_reverse,
+                bool skip_unpack,
+                HaloExchangeAccumOp op=HaloExchangeAccumOp::ID) override {
+    if (!this->is_exchange_required(dim, width_rhs_send, width_rhs_recv,
+                                    width_lhs_send, width_lhs_recv)) {
+      return;
+    }
+    const int nd = this->m_tensor.get_num_dims();
+    IntVector rhs_send(nd, 0), rhs_recv(nd, 0), lhs_send(nd, 0),
+        lhs_recv(nd, 0);
+    rhs_send[dim] = width_rhs_send;
+    rhs_recv[dim] = width_rhs_recv;
+    lhs_send[dim] = width_lhs_send;
+    lhs_recv[dim] = width_lhs_recv;
+    util::wait_stream(comm_lhs->get_stream(), comm_rhs->get_stream());
+    exchange_neighbors({dim}, false, rhs_send, rhs_recv, lhs_send, lhs_recv,
+                       comm_rhs, is_reverse, skip_unpack, op);
+    util::wait_stream(comm_rhs->get_stream(), comm_lhs->get_stream());
+  }
+
+  void unpack(const IntVector& widths_rhs_recv,
+              const IntVector& widths_lhs_recv,
+              BoundaryAttributesV<h2::gpu::DeviceStream>& streams,
+              h2::gpu::DeviceStream stream_main,
+              bool sync_back,
+              bool is_reverse,
+              HaloExchangeAccumOp op=HaloExchangeAccumOp::ID) override {
+    if (m_pending.empty()) return;
+    util::wait_stream(stream_main, m_stream);
+    const bool is_pending_reverse = m_pending_reverse;
+    unpack_pending(op);
+    if (!is_pending_reverse) {
+      for (int i = 0; i < this->m_tensor.get_num_dims(); ++i) {
+        if (this->is_exchange_required(i, 0, widths_rhs_recv[i],
+                                       0, widths_lhs_recv[i])) {
+          this->clear_boundary_halos(i, widths_rhs_recv[i],
+                                     widths_lhs_recv[i], m_stream, m_stream);
+        }
+      }
+    }
+    if (sync_back) {
+      util::wait_stream(m_stream, stream_main);
+    }
+  }
+
+ protected:
+  // Packs and unpacks regions with full precision
+  bool supports_comm_precision() const override {
+    return false;
+  }
+
+  struct Region {
+    IndexVector offset;
+    Shape shape;
+  };
+  struct Neighbor {
+    int peer;
+    Region send;
+    Region recv;
+    Memory<Allocator> send_buf;
+    Memory<Allocator> recv_buf;
+  };
+  // Neighbors keyed by the offset of their process index encoded in
+  // base 3
+  std::unordered_map<int, Neighbor> m_neighbors;
+  // Neighbors whose received halo is not unpacked yet
+  std::vector<int> m_pending;
+  bool m_pending_reverse = false;
+  h2::gpu::DeviceStream m_stream;
+
+  void pack_or_unpack_region(const Region &region,
+                             h2::gpu::DeviceStream stream,
+                             void* buf,
+                             bool is_pack,
+                             HaloExchangeAccumOp op);
+
+  // Packs or unpacks all the regions with a single kernel launch
+  void pack_or_unpack_regions(const std::vector<const Region*> &regions,
+                              const std::vector<void*> &bufs,
+                              h2::gpu::DeviceStream stream,
+                              bool is_pack,
+                              HaloExchangeAccumOp op);
+
+  // Region of dim for the neighbor at offset o (-1, 0 or 1). Dimensions
+  // not exchanged are covered entirely. When all dimensions are
+  // exchanged at once, the halos of the others are left to the edge
+  // and corner neighbors.
+  void get_region_dim(int dim, int o, bool inner, int width,
+                      bool exchanged, bool batched,
+                      index_t &offset, index_t &len) const {
+    const index_t size = this->m_tensor.get_local_real_shape()[dim];
+    if (o > 0) {
+      offset = inner ? size - width * 2 : size - width;
+      len = width;
+    } else if (o < 0) {
+      offset = inner ? width : 0;
+      len = width;
+    } else if (exchanged && batched) {
+      const int halo = this->m_tensor.get_halo_width(dim);
+      offset = halo;
+      len = size - halo * 2;
+    } else {
+      offset = 0;
+      len = size;
+    }
+  }
+
+  int find_neighbor_rank(const IntVector &o) const {
+    const auto &dist = this->m_tensor.get_distribution();
+    const auto &locale_shape = dist.get_locale_shape();
+    auto proc_idx = this->m_tensor.get_proc_index();
+    for (int i = 0; i < o.length(); ++i) {
+      if (o[i] == 0) continue;
+      const int n = locale_shape[i];
+      int idx = proc_idx[i] + o[i];
+      if (idx < 0 || idx >= n) {
+        if (!dist.is_periodic(i)) {
+          return MPI_PROC_NULL;
+        }
+        // Neighbors are told apart by their ranks only, so they must
+        // be distinct after wrapping around
+        if (n < 3) {
+          util::MPIPrintStreamError()
+              << "Batched halo exchange requires at least three processes"
+              << " in periodic dimension " << i << ": " << dist;
+          throw std::exception();
+        }
+        idx = (idx + n) % n;
+      }
+      // Empty peer tensor
+      if (this->m_tensor.get_dimension_rank_offset(i, idx)
+          == this->m_tensor.get_shape()[i]) {
+        return MPI_PROC_NULL;
+      }
+      proc_idx[i] = idx;
+    }
+    return get_offset(proc_idx, locale_shape);
+  }
+
+  void exchange_neighbors(const std::vector<int> &dims,
+                          bool batched,
+                          const IntVector& widths_rhs_send,
+                          const IntVector& widths_rhs_recv,
+                          const IntVector& widths_lhs_send,
+                          const IntVector& widths_lhs_recv,
+                          CommType &comm,
+                          bool is_reverse,
+                          bool skip_unpack,
+                          HaloExchangeAccumOp op) {
+    const int nd = this->m_tensor.get_num_dims();
+    std::vector<bool> exchanged(nd, false);
+    for (int d: dims) exchanged[d] = true;
+    m_stream = comm->get_stream();
+    std::vector<const DataType*> send_bufs;
+    std::vector<size_t> send_counts;
+    std::vector<int> dests;
+    std::vector<DataType*> recv_bufs;
+    std::vector<size_t> recv_counts;
+    std::vector<int> srcs;
+    std::vector<const Region*> send_regions;
+    std::vector<void*> send_region_bufs;
+    int num_offsets = 1;
+    for (size_t i = 0; i < dims.size(); ++i) num_offsets *= 3;
+    for (int k = 0; k < num_offsets; ++k) {
+      IntVector o(nd, 0);
+      bool is_self = true;
+      for (size_t i = 0, x = k; i < dims.size(); ++i, x /= 3) {
+        o[dims[i]] = (int)(x % 3) - 1;
+        is_self &= o[dims[i]] == 0;
+      }
+      if (is_self) continue;
+      const int peer = find_neighbor_rank(o);
+      if (peer == MPI_PROC_NULL) continue;
+      int key = 0;
+      for (int i = nd - 1; i >= 0; --i) key = key * 3 + o[i] + 1;
+      auto &n = m_neighbors[key];
+      n.peer = peer;
+      n.send.offset = IndexVector(nd, 0);
+      n.send.shape = Shape(nd, 0);
+      n.recv.offset = IndexVector(nd, 0);
+      n.recv.shape = Shape(nd, 0);
+      for (int i = 0; i < nd; ++i) {
+        const int width_send = o[i] > 0 ? widths_rhs_send[i] :
+            o[i] < 0 ? widths_lhs_send[i] : 0;
+        const int width_recv = o[i] > 0 ? widths_rhs_recv[i] :
+            o[i] < 0 ? widths_lhs_recv[i] : 0;
+        // The inner halo is sent, or the outer one when reversed.
+        get_region_dim(i, o[i], !is_reverse, width_send, exchanged[i],
+                       batched, n.send.offset[i], n.send.shape[i]);
+        get_region_dim(i, o[i], is_reverse, width_recv, exchanged[i],
+                       batched, n.recv.offset[i], n.recv.shape[i]);
+      }
+      const size_t send_count = n.send.shape.get_size();
+      const size_t recv_count = n.recv.shape.get_size();
+      if (send_count == 0 && recv_count == 0) continue;
+      ensure_buffer(n.send_buf, send_count);
+      ensure_buffer(n.recv_buf, recv_count);
+      if (send_count > 0) {
+        send_regions.push_back(&n.send);
+        send_region_bufs.push_back(n.send_buf.get());
+      }
+      send_bufs.push_back(static_cast<const DataType*>(n.send_buf.get()));
+      send_counts.push_back(send_count);
+      dests.push_back(peer);
+      recv_bufs.push_back(static_cast<DataType*>(n.recv_buf.get()));
+      recv_counts.push_back(recv_count);
+      srcs.push_back(peer);
+      m_pending.push_back(key);
+    }
+    // The send regions may overlap, but only the buffers are written.
+    pack_or_unpack_regions(send_regions, send_region_bufs, m_stream, true,
+                           HaloExchangeAccumOp::ID);
+    m_pending_reverse = is_reverse;
+    Al::MultiSendRecv<AlBackend, DataType>(send_bufs, send_counts, dests,
+                                           recv_bufs, recv_counts, srcs,
+                                           *comm);
+    if (!skip_unpack) {
+      unpack_pending(op);
+    }
+  }
+
+  // The outer regions are disjoint, so they are unpacked in a single
+  // launch. The inner regions of faces, edges and corners overlap when
+  // accumulating in reverse, so they are unpacked one by one. Scaled
+  // sums are also unpacked one by one as the single launch constructs
+  // the functors from the buffers only.
+  void unpack_pending(HaloExchangeAccumOp op) {
+    const bool scaled = op == HaloExchangeAccumOp::SUM
+        && this->m_accum_scale != DataType(1);
+    std::vector<const Region*> regions;
+    std::vector<void*> bufs;
+    for (int key: m_pending) {
+      auto &n = m_neighbors.at(key);
+      if (n.recv.shape.get_size() == 0) continue;
+      if (m_pending_reverse || scaled) {
+        pack_or_unpack_region(n.recv, m_stream, n.recv_buf.get(), false, op);
+      } else {
+        regions.push_back(&n.recv);
+        bufs.push_back(n.recv_buf.get());
+      }
+    }
+    if (!regions.empty()) {
+      pack_or_unpack_regions(regions, bufs, m_stream, false, op);
+    }
+    m_pending.clear();
+  }
+
+  static void ensure_buffer(Memory<Allocator> &buf, size_t count) {
+    const size_t s = count * sizeof(DataType);
+    if (s > 0 && buf.get_size() < s) {
+      util::memory_accounting::OwnerScope owner(
+          util::memory_accounting::Owner::HALO);
+      buf.allocate(s);
+    }
+  }
+};
+
+} // namespace tensor
+} // namespace distconv
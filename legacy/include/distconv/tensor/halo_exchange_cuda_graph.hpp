@@ -0,0 +1,208 @@
+#pragma once
+
+#include "distconv_config.hpp"
+
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+
+#include "distconv/tensor/halo_exchange_cuda.hpp"
+#include "distconv/util/util_cuda.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <cuda_runtime.h>
+
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace distconv {
+namespace tensor {
+
+/*
+  Halo exchange of any capturable method, i.e., one that only issues
+  work to the streams of the tensor and its boundary communicators,
+  e.g., Aluminum with NCCL or NVSHMEM, replayed as a single CUDA graph
+  over all dimensions.
+
+  The first exchange of a given set of widths and options runs as the
+  method does, which lets it allocate its buffers and set up its
+  connections. The next one is captured, and later ones launch the
+  graph. When the tensor, the halo buffers or the communicator streams
+  change, the exchange is captured again and the executable graph is
+  updated in place when possible. Exchanges issued while the stream is
+  already being captured, e.g. as part of a layer graph, are left to
+  the method.
+ */
+template <typename Base>
+class HaloExchangeGraph: public Base {
+ public:
+  using TensorType = typename Base::TensorType;
+  using CommType = typename Base::CommType;
+
+  template <typename... Args>
+  HaloExchangeGraph(TensorType &tensor, Args&&... args):
+      Base(tensor, std::forward<Args>(args)...) {}
+
+  HaloExchangeGraph(const HaloExchangeGraph &x): Base(x) {}
+
+  HaloExchangeGraph &operator=(const HaloExchangeGraph &x) {
+    clear_graphs();
+    Base::operator=(x);
+    return *this;
+  }
+
+  virtual ~HaloExchangeGraph() {
+    clear_graphs();
+  }
+
+  using Base::exchange;
+
+  void exchange(const IntVector &widths_rhs_send,
+                const IntVector &widths_rhs_recv,
+                const IntVector &widths_lhs_send,
+                const IntVector &widths_lhs_recv,
+                BoundaryAttributesV<CommType> &comms,
+                h2::gpu::DeviceStream stream_main,
+                bool rendezvous,
+                bool sync_back,
+                bool is_reverse,
+                bool skip_unpack,
+                HaloExchangeAccumOp op=HaloExchangeAccumOp::ID) override {
+    // The graph is launched on the stream of the first boundary
+    // communicator exchanging a halo
+    int first_dim = -1;
+    for (int i = 0; i < this->m_tensor.get_num_dims() && first_dim < 0; ++i) {
+      if (this->is_exchange_required(i,
+                                     widths_rhs_send[i], widths_rhs_recv[i],
+                                     widths_lhs_send[i], widths_lhs_recv[i])) {
+        first_dim = i;
+      }
+    }
+    cudaStreamCaptureStatus capture_status;
+    DISTCONV_CHECK_CUDA(cudaStreamIsCapturing(stream_main, &capture_status));
+    if (first_dim < 0 || capture_status != cudaStreamCaptureStatusNone) {
+      Base::exchange(widths_rhs_send, widths_rhs_recv,
+                     widths_lhs_send, widths_lhs_recv, comms, stream_main,
+                     rendezvous, sync_back, is_reverse, skip_unpack, op);
+      return;
+    }
+    std::vector<int> key;
+    for (const auto *w: {&widths_rhs_send, &widths_rhs_recv,
+                         &widths_lhs_send, &widths_lhs_recv}) {
+      key.insert(key.end(), w->begin(), w->end());
+    }
+    key.insert(key.end(), {rendezvous, is_reverse, skip_unpack,
+                           static_cast<int>(op),
+                           static_cast<int>(this->get_comm_precision()),
+                           this->get_clear_boundary_halos()});
+    // The scale is captured as a kernel argument
+    const double accum_scale = this->get_accum_scale();
+    int accum_scale_bits[sizeof(double) / sizeof(int)];
+    std::memcpy(accum_scale_bits, &accum_scale, sizeof(double));
+    key.insert(key.end(), std::begin(accum_scale_bits),
+               std::end(accum_scale_bits));
+    h2::gpu::DeviceStream stream = comms(first_dim, RHS)->get_stream();
+    auto run = [&]() {
+      Base::exchange(widths_rhs_send, widths_rhs_recv,
+                     widths_lhs_send, widths_lhs_recv, comms, stream,
+                     rendezvous, true, is_reverse, skip_unpack, op);
+    };
+    util::wait_stream(stream_main, stream);
+    auto it = m_graphs.find(key);
+    if (it == m_graphs.end()) {
+      run();
+      m_graphs.emplace(key, Entry());
+    } else {
+      auto &e = it->second;
+      const auto signature = get_signature(comms);
+      if (e.exec == nullptr || e.signature != signature) {
+        capture(e, stream, run);
+        e.signature = signature;
+      }
+      DISTCONV_CHECK_CUDA(cudaGraphLaunch(e.exec, stream));
+    }
+    // Make the streams the method would leave the exchange on wait
+    // for it
+    if (sync_back) {
+      util::wait_stream(stream, stream_main);
+    } else {
+      apply_to_sides(this->m_tensor.get_num_dims(), [&](int dim, Side side) {
+          if (comms(dim, side) && comms(dim, side)->get_stream() != stream) {
+            util::wait_stream(stream, comms(dim, side)->get_stream());
+          }
+        });
+    }
+  }
+
+  void clear_graphs() {
+    for (auto &kv: m_graphs) {
+      if (kv.second.exec != nullptr) {
+        DISTCONV_CHECK_CUDA(cudaGraphExecDestroy(kv.second.exec));
+      }
+    }
+    m_graphs.clear();
+  }
+
+ protected:
+  struct Entry {
+    cudaGraphExec_t exec = nullptr;
+    // Pointers and streams the graph was captured with
+    std::vector<const void*> signature;
+  };
+
+  std::map<std::vector<int>, Entry> m_graphs;
+
+  std::vector<const void*> get_signature(BoundaryAttributesV<CommType> &comms) {
+    std::vector<const void*> signature = {this->m_tensor.get_buffer()};
+    apply_to_sides(this->m_tensor.get_num_dims(), [&](int dim, Side side) {
+        signature.push_back(this->get_send_buffer(dim, side));
+        signature.push_back(this->get_recv_buffer(dim, side));
+        signature.push_back(comms(dim, side) ? comms(dim, side)->get_stream()
+                            : nullptr);
+      });
+    return signature;
+  }
+
+  template <typename F>
+  void capture(Entry &e, h2::gpu::DeviceStream stream, F &&run) {
+    cudaGraph_t graph;
+    DISTCONV_CHECK_CUDA(cudaStreamBeginCapture(
+        stream, cudaStreamCaptureModeThreadLocal));
+    run();
+    DISTCONV_CHECK_CUDA(cudaStreamEndCapture(stream, &graph));
+    if (e.exec != nullptr && !update(e.exec, graph)) {
+      DISTCONV_CHECK_CUDA(cudaGraphExecDestroy(e.exec));
+      e.exec = nullptr;
+    }
+    if (e.exec == nullptr) {
+      DISTCONV_CHECK_CUDA(cudaGraphInstantiate(&e.exec, graph, nullptr,
+                                               nullptr, 0));
+      util::MPIPrintStreamDebug() << "Captured halo exchange graph";
+    }
+    DISTCONV_CHECK_CUDA(cudaGraphDestroy(graph));
+  }
+
+  // Updates exec to graph if only the parameters of its nodes differ
+  static bool update(cudaGraphExec_t exec, cudaGraph_t graph) {
+#if CUDART_VERSION >= 12000
+    cudaGraphExecUpdateResultInfo info;
+    const bool ok = cudaGraphExecUpdate(exec, graph, &info) == cudaSuccess;
+#else
+    cudaGraphNode_t error_node;
+    cudaGraphExecUpdateResult result;
+    const bool ok = cudaGraphExecUpdate(exec, graph, &error_node, &result)
+        == cudaSuccess;
+#endif
+    if (!ok) {
+      // Clear the error of the failed update
+      cudaGetLastError();
+    }
+    return ok;
+  }
+};
+
+} // namespace tensor
+} // namespace distconv
+
+#endif // DISTCONV_HAS_CUDA_GRAPH
@@ -47,49 +47,87 @@ class HaloExchangeHybrid:
     if (!this->is_exchange_required(
             dim, width_rhs_send, width_rhs_recv,
             width_lhs_send, width_lhs_recv)) {
-      util::MPIPrintStreamDebug()
+      DISTCONV_LOG_DEBUG(HaloExchange)
           << "exchange not required for dimension " << dim;
       return;
     }
+    this->check_distinct_peers(dim);
+    this->check_periodic_pairing(dim);
     this->ensure_halo_buffers(dim);
+    this->wait_halo_buffers(comm_rhs, comm_lhs);
     ensure_connection(dim);
     BoundaryAttributes<cudaStream_t> streams(
         comm_lhs->get_stream(), comm_rhs->get_stream());
-    if (rendezvous) m_p2p.barrier(get_conns(dim), streams.data(), 2);
+    // Sides without P2P are exchanged with send/recv of the boundary
+    // communicators first, so that their transfers proceed while the
+    // puts and their barrier are issued. Their unpacking is ordered
+    // by the boundary streams, so it does not wait for the barrier.
     for (auto side: SIDES) {
-      if (this->get_peer(dim, side) == MPI_PROC_NULL) continue;
+      if (this->get_peer(dim, side) == MPI_PROC_NULL ||
+          is_p2p_enabled(dim, side)) continue;
       CommType &comm = side == Side::RHS ? comm_rhs : comm_lhs;
       const cudaStream_t stream = comm->get_stream();
       const int width_send = side == Side::RHS ? width_rhs_send : width_lhs_send;
       const int width_recv = side == Side::RHS ? width_rhs_recv : width_lhs_recv;
       auto send_buf = this->get_send_buffer(dim, side);
       auto recv_buf = this->get_recv_buffer(dim, side);
-      size_t send_count = this->get_halo_size(dim, width_send);
-      size_t recv_count = this->get_halo_size(dim, width_recv);
-      // pack the local halo
-      util::MPIPrintStreamDebug()
+      DISTCONV_LOG_DEBUG(HaloExchange)
           << "Packing halo for dimension " << dim << ", " << side;
       this->pack_dim(dim, side, width_send, stream,
                      send_buf, is_reverse);
-      // Use put if possible
-      if (is_p2p_enabled(dim, side)) {
-        get_conn(dim, side)->put(send_buf, get_halo_peer(dim, side),
-                                 send_count * sizeof(DataType), stream);
-      } else {
-        // Use Al send/recv
-        Al::SendRecv<AlBackend, DataType>(
-            static_cast<DataType*>(send_buf), send_count,
-            this->get_peer(dim, side),
-            static_cast<DataType*>(recv_buf), recv_count,
-            this->get_peer(dim, side),
-            *comm);
+      this->send_recv_halo(dim, width_send, width_recv, send_buf, recv_buf,
+                           this->get_peer(dim, side), *comm);
+      if (!skip_unpack) {
+        unpack_side(dim, side, width_rhs_recv, width_lhs_recv,
+                    comm_rhs, comm_lhs, is_reverse, op);
       }
     }
+    if (rendezvous) m_p2p.barrier(get_conns(dim), streams.data(), 2);
+    for (auto side: SIDES) {
+      if (this->get_peer(dim, side) == MPI_PROC_NULL ||
+          !is_p2p_enabled(dim, side)) continue;
+      const cudaStream_t stream = side == Side::RHS
+          ? comm_rhs->get_stream() : comm_lhs->get_stream();
+      const int width_send = side == Side::RHS ? width_rhs_send : width_lhs_send;
+      auto send_buf = this->get_send_buffer(dim, side);
+      size_t halo_bytes = this->get_halo_bytes(dim, width_send);
+      DISTCONV_LOG_DEBUG(HaloExchange)
+          << "Packing halo for dimension " << dim << ", " << side;
+      this->pack_dim(dim, side, width_send, stream,
+                     send_buf, is_reverse);
+      get_conn(dim, side)->put(send_buf, get_halo_peer(dim, side),
+                               halo_bytes, stream);
+    }
     // make sure the remote device waits for the completion of the put
-    m_p2p.barrier(get_conns(dim), streams.data(), 2);
-    if (!skip_unpack) {
-      this->unpack(dim, width_rhs_recv, width_lhs_recv,
-                   comm_rhs->get_stream(), comm_lhs->get_stream(), is_reverse, op);
+    p2p::Request requests[4];
+    m_p2p.barrier_nb(get_conns(dim), streams.data(), 2, requests);
+    if (skip_unpack) {
+      m_p2p.wait_all(requests, 4);
+      return;
+    }
+    // Unpack each P2P side once its barrier completes
+    int num_pending[2] = {0, 0};
+    for (int i = 0; i < 4; ++i) {
+      if (!requests[i].is_null()) ++num_pending[i / 2];
+    }
+    bool done[2] = {false, false};
+    int num_done = 0;
+    while (num_done < 2) {
+      int indices[4];
+      int num_completed = m_p2p.test_some(requests, 4, indices);
+      for (int i = 0; i < num_completed; ++i) {
+        --num_pending[indices[i] / 2];
+      }
+      for (int i = 0; i < 2; ++i) {
+        if (done[i] || num_pending[i] > 0) continue;
+        const Side side = SIDES[i];
+        if (is_p2p_enabled(dim, side)) {
+          unpack_side(dim, side, width_rhs_recv, width_lhs_recv,
+                      comm_rhs, comm_lhs, is_reverse, op);
+        }
+        done[i] = true;
+        ++num_done;
+      }
     }
     return;
   }
@@ -121,19 +159,38 @@ class HaloExchangeHybrid:
     return m_p2p_enabled(dim, side);
   }
 
+  void unpack_side(int dim, Side side,
+                   int width_rhs_recv, int width_lhs_recv,
+                   CommType &comm_rhs, CommType &comm_lhs,
+                   bool is_reverse, HaloExchangeAccumOp op) {
+    this->unpack(dim,
+                 side == Side::RHS ? width_rhs_recv : 0,
+                 side == Side::LHS ? width_lhs_recv : 0,
+                 comm_rhs->get_stream(), comm_lhs->get_stream(),
+                 is_reverse, op);
+  }
+
   void ensure_connection(int dim) {
     if (!m_p2p_conn_established.at(dim)) {
       // Connection not created yet
       m_p2p.get_connections(this->m_peers(dim), get_conns(dim), 2);
-      // exchange addresses
+      // exchange addresses not mapped by other exchangers yet
+      p2p::P2P::connection_type conns[2];
       void *self_addrs[2] = {nullptr, nullptr};
+      void *peer_addrs[2] = {nullptr, nullptr};
+      Side sides[2];
+      int num_conns = 0;
       for (auto side: SIDES) {
         if (get_conn(dim, side)) {
-          self_addrs[side] = this->get_recv_buffer(dim, side);
           is_p2p_enabled(dim, side) = true;
+          if (is_mapping_shared(dim, side)) {
+            get_halo_peer(dim, side) = this->m_halo_bufs(dim, side)->peer_addr;
+            continue;
+          }
+          self_addrs[num_conns] = this->get_recv_buffer(dim, side);
         } else {
           // Set the conn as NULL so that operations are ignored
-          util::MPIPrintStreamDebug()
+          DISTCONV_LOG_DEBUG(HaloExchange)
               << "P2P not possible from rank "
               << this->m_tensor.get_locale().get_rank()
               << " to rank " << this->get_peer(dim, side);
@@ -141,25 +198,55 @@ class HaloExchangeHybrid:
           m_p2p.get_connections(&null_proc, &get_conn(dim, side), 1);
           is_p2p_enabled(dim, side) = false;
         }
+        conns[num_conns] = get_conn(dim, side);
+        sides[num_conns] = side;
+        ++num_conns;
       }
-      util::MPIPrintStreamDebug()
+      DISTCONV_LOG_DEBUG(HaloExchange)
           << "Exchanging local addreess for dimension " << dim
           << ": " << self_addrs[0] << ", " << self_addrs[1];
-      m_p2p.exchange_addrs(get_conns(dim), self_addrs, get_halo_peers(dim), 2);
+      m_p2p.exchange_addrs(conns, self_addrs, peer_addrs, num_conns);
+      for (int i = 0; i < num_conns; ++i) {
+        get_halo_peer(dim, sides[i]) = peer_addrs[i];
+        auto &entry = this->m_halo_bufs(dim, sides[i]);
+        if (is_p2p_enabled(dim, sides[i]) && entry && entry->p2p == nullptr) {
+          // The mapping is closed by the entry
+          entry->p2p = &m_p2p;
+          entry->conn = conns[i];
+          entry->peer_addr = peer_addrs[i];
+        }
+      }
       m_p2p_conn_established.at(dim) = true;
     }
   }
 
+  // Whether the peer address of dim and side is mapped by a shared
+  // halo buffer entry, which also closes it
+  bool is_mapping_shared(int dim, Side side) {
+    auto &entry = this->m_halo_bufs(dim, side);
+    return entry && entry->p2p == &m_p2p;
+  }
+
   void close_addrs() {
     for (int i = 0; i < this->m_tensor.get_num_dims(); ++i) {
       // close_addrs needs to be called even if no connection exists
       // for this rank as other ranks may have. close_addrs calls
       // MPI_Barrier, so all ranks need to join.
-      int num_conns = m_p2p_conn_established.at(i) ? 2 : 0;
+      p2p::P2P::connection_type conns[2];
+      void *peer_addrs[2];
+      int num_conns = 0;
+      if (m_p2p_conn_established.at(i)) {
+        for (auto side: SIDES) {
+          if (is_mapping_shared(i, side)) continue;
+          conns[num_conns] = get_conn(i, side);
+          peer_addrs[num_conns] = get_halo_peer(i, side);
+          ++num_conns;
+        }
+      }
       // Connection may be used in different places, but the memory
       // registered for the connection in this class must be freed
       // here.
-      m_p2p.close_addrs(get_conns(i), get_halo_peers(i), num_conns);
+      m_p2p.close_addrs(conns, peer_addrs, num_conns);
     }
   }
 };
@@ -2,6 +2,12 @@
 
 #include "distconv/tensor/halo_exchange_cuda.hpp"
 
+#include "h2/gpu/memory_utils.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
 namespace distconv {
 namespace tensor {
 
@@ -14,14 +20,46 @@ class HaloExchangeMPI:
     DataType, Allocator, AlBackend>::CommType;
  public:
   HaloExchangeMPI(TensorType &tensor):
-      HaloExchange<DataType, Allocator, AlBackend>(tensor) {}
+      HaloExchange<DataType, Allocator, AlBackend>(tensor),
+      m_persistent(std::getenv("DISTCONV_PERSISTENT_MPI") != nullptr) {}
   HaloExchangeMPI(const HaloExchangeMPI &x):
-      HaloExchange<DataType, Allocator, AlBackend>(x) {}
+      HaloExchange<DataType, Allocator, AlBackend>(x),
+      m_persistent(x.m_persistent) {}
 
-  virtual ~HaloExchangeMPI() {}
+  virtual ~HaloExchangeMPI() {
+    free_persistent_requests();
+  }
 
   using HaloExchange<DataType, Allocator, AlBackend>::exchange;
 
+  /**
+     Starts the sends and receives of each dimension and side with
+     persistent requests, created once the halo buffers of the
+     dimension are ensured and recreated only if the buffer, the size
+     or the peer changes, instead of posting them at every
+     exchange. Defaults to whether DISTCONV_PERSISTENT_MPI is set.
+   */
+  void set_persistent(bool b) {
+    if (!b) free_persistent_requests();
+    m_persistent = b;
+  }
+  bool get_persistent() const { return m_persistent; }
+
+  /*
+    With an occupancy set, halos that are all zeros are signaled with
+    an empty message in forward exchanges, and the receiver clears its
+    halo instead of receiving it.
+   */
+  bool received_zero_halos() override {
+    for (int i = 0; i < this->m_tensor.get_num_dims(); ++i) {
+      if (this->is_exchange_required(i)
+          && (i >= (int) m_zero_halos.size() || !m_zero_halos[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   void exchange(int dim,
                 int width_rhs_send, int width_rhs_recv,
                 int width_lhs_send, int width_lhs_recv,
@@ -31,8 +69,6 @@ class HaloExchangeMPI:
                 bool is_reverse,
                 bool skip_unpack,
                 HaloExchangeAccumOp op=HaloExchangeAccumOp::ID) override {
-    const int tag = 0;
-
     if (!this->is_exchange_required(dim, width_rhs_send, width_rhs_recv,
                                     width_lhs_send, width_lhs_recv)) {
       return;
@@ -41,9 +77,13 @@ class HaloExchangeMPI:
     MPI_Comm comm = this->m_tensor.get_locale().get_comm();
     MPI_Request send_req[2];
     MPI_Request recv_req[2];
+    MPI_Status recv_status[2];
+    Side recv_sides[2];
     int num_send_requests = 0;
     int num_recv_requests = 0;
+    begin_zero_halos(dim);
     this->ensure_halo_buffers(dim);
+    this->wait_halo_buffers(comm_rhs, comm_lhs);
 
     for (auto side: SIDES) {
       if (this->get_peer(dim, side) == MPI_PROC_NULL) continue;
@@ -56,34 +96,74 @@ class HaloExchangeMPI:
       auto send_buf = this->get_send_buffer(dim, side);
       auto recv_buf = this->get_recv_buffer(dim, side);
       if (width_recv > 0) {
-        size_t halo_bytes = this->get_halo_size(dim, width_recv)
-            * sizeof(DataType);
-        DISTCONV_CHECK_MPI(MPI_Irecv(
-            recv_buf, halo_bytes, MPI_BYTE,
-            this->get_peer(dim, side), tag, comm, &recv_req[num_recv_requests]));
+        size_t halo_bytes = this->get_halo_bytes(dim, width_recv);
+        if (m_persistent) {
+          auto &req = get_persistent_request(dim, side, false, recv_buf,
+                                             halo_bytes, comm);
+          DISTCONV_CHECK_MPI(MPI_Start(&req));
+          recv_req[num_recv_requests] = req;
+        } else {
+          DISTCONV_CHECK_MPI(MPI_Irecv(
+              recv_buf, halo_bytes, MPI_BYTE,
+              this->get_peer(dim, side), get_tag(side), comm,
+              &recv_req[num_recv_requests]));
+        }
+        recv_sides[num_recv_requests] = side;
         ++num_recv_requests;
       }
-      util::MPIPrintStreamDebug()
+      DISTCONV_LOG_DEBUG(HaloExchange)
           << "Packing halo for dimension " << dim << ", " << side;
-      if (width_send > 0) {
+      if (width_send > 0 && is_zero_halo(dim, side, width_send, is_reverse)) {
+        DISTCONV_CHECK_MPI(MPI_Isend(
+            send_buf, 0, MPI_BYTE, this->get_peer(dim, side),
+            get_tag(~side), comm, &send_req[num_send_requests]));
+        ++num_send_requests;
+      } else if (width_send > 0) {
         // pack the local halo
         this->pack_dim(dim, side, width_send, stream, send_buf, is_reverse);
-        util::MPIPrintStreamDebug() << "Sending packed halo";
+        DISTCONV_LOG_DEBUG(HaloExchange) << "Sending packed halo";
         // send
         h2::gpu::sync(stream);
-        size_t halo_bytes = this->get_halo_size(dim, width_send)
-            * sizeof(DataType);
-        DISTCONV_CHECK_MPI(MPI_Isend(
-            send_buf, halo_bytes, MPI_BYTE,
-            this->get_peer(dim, side), tag, comm, &send_req[num_send_requests]));
+        size_t halo_bytes = this->get_halo_bytes(dim, width_send);
+        if (m_persistent) {
+          auto &req = get_persistent_request(dim, side, true, send_buf,
+                                             halo_bytes, comm);
+          DISTCONV_CHECK_MPI(MPI_Start(&req));
+          send_req[num_send_requests] = req;
+        } else {
+          DISTCONV_CHECK_MPI(MPI_Isend(
+              send_buf, halo_bytes, MPI_BYTE,
+              this->get_peer(dim, side), get_tag(~side), comm,
+              &send_req[num_send_requests]));
+        }
         ++num_send_requests;
       }
     }
 
+    // Copies of the persistent requests are only waited for, which
+    // leaves the requests themselves inactive for the next start
     if (num_recv_requests > 0) {
       DISTCONV_CHECK_MPI(MPI_Waitall(
-          num_recv_requests, recv_req, MPI_STATUS_IGNORE));
+          num_recv_requests, recv_req, recv_status));
+    }
+    bool zero_halos = true;
+    for (int i = 0; i < num_recv_requests; ++i) {
+      int count;
+      DISTCONV_CHECK_MPI(MPI_Get_count(&recv_status[i], MPI_BYTE, &count));
+      if (count > 0) {
+        zero_halos = false;
+        continue;
+      }
+      // Unpacked as usual from the cleared buffer
+      const Side side = recv_sides[i];
+      const int width_recv = side == Side::RHS
+          ? width_rhs_recv : width_lhs_recv;
+      h2::gpu::mem_zero(
+          static_cast<unsigned char*>(this->get_recv_buffer(dim, side)),
+          this->get_halo_bytes(dim, width_recv),
+          side == Side::RHS ? comm_rhs->get_stream() : comm_lhs->get_stream());
     }
+    m_zero_halos[dim] = zero_halos;
 
     if (!skip_unpack) {
       this->unpack(dim, width_rhs_recv, width_lhs_recv,
@@ -98,6 +178,102 @@ class HaloExchangeMPI:
 
     return;
   }
+
+ protected:
+  // Tagged with the side the halo is received at, so that the halos
+  // of a periodic dimension with the same peer on both sides, or
+  // with itself, are not mixed up
+  static int get_tag(Side side) {
+    return static_cast<int>(side);
+  }
+
+  // Whether the halos received in the last exchange of each
+  // dimension were all zeros
+  std::vector<bool> m_zero_halos;
+
+  void begin_zero_halos(int dim) {
+    m_zero_halos.resize(this->m_tensor.get_num_dims(), false);
+    m_zero_halos[dim] = false;
+    // A new exchange starts from the first exchanged dimension
+    for (int i = 0; i < dim; ++i) {
+      if (this->is_exchange_required(i)) return;
+    }
+    std::fill(m_zero_halos.begin(), m_zero_halos.end(), false);
+  }
+
+  // Whether the halo sent at side of dim is zero: its local part is
+  // empty, and so are the halos of the dimensions exchanged before,
+  // which it includes at its corners
+  bool is_zero_halo(int dim, Side side, int width, bool is_reverse) {
+    const Occupancy *occupancy = this->m_occupancy;
+    if (occupancy == nullptr || is_reverse || !occupancy->is_valid()) {
+      return false;
+    }
+    const auto local_shape = this->m_tensor.get_local_shape();
+    if (occupancy->get_local_shape() != local_shape) return false;
+    auto &stats = OccupancyStats::get_instance();
+    const size_t bytes = this->get_halo_bytes(dim, width);
+    stats.halo_bytes += bytes;
+    for (int i = 0; i < dim; ++i) {
+      if (this->is_exchange_required(i) && !m_zero_halos[i]) return false;
+    }
+    IndexVector offset(local_shape.num_dims(), 0);
+    Shape shape = local_shape;
+    shape[dim] = width;
+    if (side == Side::RHS) offset[dim] = local_shape[dim] - width;
+    if (!occupancy->is_empty(offset, shape)) return false;
+    stats.skipped_halo_bytes += bytes;
+    return true;
+  }
+
+  struct PersistentRequest {
+    MPI_Request request = MPI_REQUEST_NULL;
+    void *buf = nullptr;
+    size_t bytes = 0;
+    int peer = MPI_PROC_NULL;
+  };
+
+  bool m_persistent = false;
+  // Receive and send of each dimension and side
+  std::vector<PersistentRequest> m_persistent_requests;
+
+  MPI_Request &get_persistent_request(int dim, Side side, bool is_send,
+                                      void *buf, size_t bytes,
+                                      MPI_Comm comm) {
+    const size_t idx = (dim * 2 + static_cast<int>(side)) * 2 + is_send;
+    if (idx >= m_persistent_requests.size()) {
+      m_persistent_requests.resize(idx + 1);
+    }
+    auto &pr = m_persistent_requests[idx];
+    const int peer = this->get_peer(dim, side);
+    if (pr.request != MPI_REQUEST_NULL
+        && pr.buf == buf && pr.bytes == bytes && pr.peer == peer) {
+      return pr.request;
+    }
+    if (pr.request != MPI_REQUEST_NULL) {
+      DISTCONV_CHECK_MPI(MPI_Request_free(&pr.request));
+    }
+    if (is_send) {
+      DISTCONV_CHECK_MPI(MPI_Send_init(buf, bytes, MPI_BYTE, peer,
+                                       get_tag(~side), comm, &pr.request));
+    } else {
+      DISTCONV_CHECK_MPI(MPI_Recv_init(buf, bytes, MPI_BYTE, peer,
+                                       get_tag(side), comm, &pr.request));
+    }
+    pr.buf = buf;
+    pr.bytes = bytes;
+    pr.peer = peer;
+    return pr.request;
+  }
+
+  void free_persistent_requests() {
+    for (auto &pr: m_persistent_requests) {
+      if (pr.request != MPI_REQUEST_NULL) {
+        DISTCONV_CHECK_MPI(MPI_Request_free(&pr.request));
+      }
+    }
+    m_persistent_requests.clear();
+  }
 };
 
 } // namespace tensor
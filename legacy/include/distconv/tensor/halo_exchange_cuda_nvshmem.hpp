@@ -5,6 +5,7 @@
 #ifdef DISTCONV_HAS_NVSHMEM
 
 #include "distconv/tensor/halo_exchange_cuda.hpp"
+#include "distconv/tensor/halo_exchange_cuda_graph.hpp"
 #include "distconv/util/nvshmem.hpp"
 
 namespace distconv {
@@ -22,7 +23,20 @@ class HaloExchangeNVSHMEM:
   HaloExchangeNVSHMEM(TensorType &tensor):
       HaloExchange<DataType, Allocator, AlBackend>(tensor) {
     // Preallocates all NVSHMEM buffers as doing that middle of shmem
-    // operations seems to cause deadlock
+    // operations seems to cause deadlock. The symmetric heap grows
+    // once for all of them.
+    auto &heap = util::nvshmem::SymmetricHeap::get_instance();
+    for (int i = 0; i < this->m_tensor.get_num_dims(); ++i) {
+      const size_t s = this->get_halo_size(i) * sizeof(DataType);
+      for (int k = 0; k < 2; ++k) {
+        if (s > 0) {
+          heap.reserve(s);
+          heap.reserve(s);
+        }
+        heap.reserve(sizeof(util::nvshmem::PairwiseSync::CounterType));
+      }
+    }
+    heap.grow();
     for (int i = 0; i < this->m_tensor.get_num_dims(); ++i) {
       ensure_halo_buffers(i);
       for (auto side: SIDES) {
@@ -51,6 +65,8 @@ class HaloExchangeNVSHMEM:
                                     width_lhs_send, width_lhs_recv)) {
       return;
     }
+    this->check_distinct_peers(dim);
+    this->check_periodic_pairing(dim);
     for (auto side: SIDES) {
       const int width_send = side == Side::RHS ? width_rhs_send : width_lhs_send;
       const int width_recv = side == Side::RHS ? width_rhs_recv : width_lhs_recv;
@@ -81,11 +97,13 @@ class HaloExchangeNVSHMEM:
     // the receive buffer is a different variable.
     size_t s = this->get_halo_size(dim) * sizeof(DataType);
     if (s == 0) return;
+    util::memory_accounting::OwnerScope owner(
+        util::memory_accounting::Owner::HALO);
     for (auto side: SIDES) {
       // SHMEM buffer needs to be symmetric, so the recv buffer must
       // be created by all processes
       if (this->m_halo_send_shmem(dim, side).is_null()) {
-        util::MPIPrintStreamDebug() << "SHMEM size: " << s;
+        DISTCONV_LOG_DEBUG(HaloExchange) << "SHMEM size: " << s;
         m_halo_send_shmem(dim, side).allocate(s);
         m_halo_send_shmem(dim, side).memset(0);
         m_halo_recv_shmem(dim, side).allocate(s);
@@ -120,11 +138,11 @@ class HaloExchangeNVSHMEM:
     if (width_send > 0) {
       auto send_buf = this->get_send_buffer(dim, side);
       auto peer_recv_buf = this->get_recv_buffer(dim, ~side);
-      size_t send_count = this->get_halo_size(dim, width_send);
+      size_t halo_bytes = this->get_halo_bytes(dim, width_send);
       // pack the local halo
       this->pack_dim(dim, side, width_send, stream, send_buf, is_reverse);
       nvshmemx_putmem_on_stream((void*)peer_recv_buf, send_buf,
-                                send_count * sizeof(DataType),
+                                halo_bytes,
                                 this->get_peer(dim, side),
                                 stream);
     }
@@ -187,11 +205,28 @@ class HaloExchangeNVSHMEMDirect:
   }
 
  protected:
+  // Packs or unpacks halos with its own kernels
+  bool supports_comm_precision() const override {
+    return false;
+  }
+
   virtual void pack_and_put(int dim, Side side, int width,
                             cudaStream_t stream, void *buf,
                             bool is_reverse, void *dst, int peer);
 };
 
+/*
+  Received halo of one side for kernels that consume it without
+  unpacking. The kernel waits for the notification of the peer and
+  reads the packed halo from the receive buffer.
+ */
+template <typename DataType>
+struct HaloRecvDevice {
+  // Null when no halo is received
+  const DataType *m_buf = nullptr;
+  util::nvshmem::PairwiseSyncDevice m_sync{nullptr, nullptr};
+};
+
 template <typename DataType, typename Allocator, typename AlBackend>
 class HaloExchangeNVSHMEMFusedNotify:
       public HaloExchangeNVSHMEM<DataType, Allocator, AlBackend> {
@@ -230,13 +265,37 @@ class HaloExchangeNVSHMEMFusedNotify:
     }
 
     if (!skip_unpack && width_recv > 0) {
+      // Mostly waits for the notification of the peer
+      util::instrumentation::ScopedTimer timer(
+          util::instrumentation::Phase::HALO_TRANSFER,
+          this->get_peer(dim, side), stream);
       auto recv_buf = this->get_recv_buffer(dim, side);
       this->wait_and_unpack(dim, side, width_recv, stream, recv_buf,
                             is_reverse, op);
     }
   }
 
+  // Only valid for halos exchanged with skip_unpack and not yet
+  // unpacked
+  HaloRecvDevice<DataType> get_halo_recv_for_device(int dim, Side side) {
+    HaloRecvDevice<DataType> h;
+    if (this->get_peer(dim, side) != MPI_PROC_NULL) {
+      h.m_buf = static_cast<const DataType*>(this->get_recv_buffer(dim, side));
+      h.m_sync = this->m_sync(dim, side).get_for_device();
+    }
+    return h;
+  }
+
  protected:
+  // Packs or unpacks halos with its own kernels
+  bool supports_comm_precision() const override {
+    return false;
+  }
+
+  bool supports_accum_scale() const override {
+    return false;
+  }
+
   virtual void pack_put_notify(int dim, Side side, int width,
                                cudaStream_t stream, void *buf,
                                bool is_reverse, void *dst, int peer);
@@ -249,55 +308,21 @@ class HaloExchangeNVSHMEMFusedNotify:
 #ifdef DISTCONV_HAS_CUDA_GRAPH
 template <typename DataType, typename Allocator, typename AlBackend>
 class HaloExchangeNVSHMEMGraph:
-      public HaloExchangeNVSHMEM<DataType, Allocator, AlBackend> {
+      public HaloExchangeGraph<
+        HaloExchangeNVSHMEM<DataType, Allocator, AlBackend>> {
  public:
   using TensorType =
       typename HaloExchangeNVSHMEM<DataType, Allocator, AlBackend>::TensorType;
   HaloExchangeNVSHMEMGraph(TensorType &tensor):
-      HaloExchangeNVSHMEM<DataType, Allocator, AlBackend>(tensor),
-      m_graph_ready(false) {}
-  virtual ~HaloExchangeNVSHMEMGraph() {
-    destroy_graph();
-  }
-
-  using HaloExchangeNVSHMEM<DataType, Allocator, AlBackend>::exchange;
+      HaloExchangeGraph<HaloExchangeNVSHMEM<DataType, Allocator, AlBackend>>(
+          tensor) {}
+  virtual ~HaloExchangeNVSHMEMGraph() = default;
 
  protected:
-  BoundaryAttributesV<bool> m_graph_ready;
-  BoundaryAttributesV<cudaGraph_t> m_graphs;
-  BoundaryAttributesV<cudaGraphExec_t> m_execs;
-
-  void destroy_graph() {
-    apply_to_sides(this->m_tensor.get_num_dims(), [&](int dim, Side side) {
-        if (m_graph_ready(dim, side)) {
-          DISTCONV_CHECK_CUDA(cudaGraphExecDestroy(m_execs(dim, side)));
-          DISTCONV_CHECK_CUDA(cudaGraphDestroy(m_graphs(dim, side)));
-          m_graph_ready(dim, side) = false;
-        }
-      });
+  // Packs or unpacks halos with its own kernels
+  bool supports_comm_precision() const override {
+    return false;
   }
-
-  virtual void exchange(int dim, Side side,
-                        int width_send, int width_recv,
-                        cudaStream_t stream,
-                        bool rendezvous,
-                        bool is_reverse,
-                        bool skip_unpack,
-                        HaloExchangeAccumOp op) override {
-    if (!m_graph_ready(dim, side)) {
-      DISTCONV_CHECK_CUDA(cudaStreamBeginCapture(stream, cudaStreamCaptureModeGlobal));
-      HaloExchangeNVSHMEM<DataType, Allocator, AlBackend>::exchange(
-          dim, side, width_send, width_recv,
-          stream, rendezvous, is_reverse,
-          skip_unpack, op);
-      DISTCONV_CHECK_CUDA(cudaStreamEndCapture(stream, &m_graphs(dim, side)));
-      DISTCONV_CHECK_CUDA(cudaGraphInstantiate(
-          &m_execs(dim, side), m_graphs(dim, side), nullptr, nullptr, 0));
-      m_graph_ready(dim, side) = true;
-    }
-    DISTCONV_CHECK_CUDA(cudaGraphLaunch(m_execs(dim, side), stream));
-  }
-
 };
 #endif // DISTCONV_CUDA_VERSION_MAJOR
 
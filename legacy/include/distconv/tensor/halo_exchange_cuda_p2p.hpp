@@ -3,6 +3,15 @@
 #include "distconv/tensor/halo_exchange_cuda.hpp"
 
 #include "p2p/p2p.hpp"
+#include "p2p/connection_ipc.hpp"
+#include "p2p/device_sync.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace distconv {
 namespace tensor {
@@ -30,10 +39,27 @@ class HaloExchangeP2P:
 
   virtual ~HaloExchangeP2P() {
     close_addrs();
+    close_zero_pack();
   }
 
   using HaloExchange<DataType, Allocator, AlBackend>::exchange;
 
+  /**
+     Copies the halos of peers connected with direct IPC from the
+     tensor to the halos of the peer tensor with strided 3D copies,
+     without packing and unpacking them. Only plain exchanges are
+     copied; accumulating, reversed, reduced-precision and deferred
+     unpacking exchanges still pack. The peer tensor is written while
+     the peer may not have reached the exchange, so the pair always
+     rendezvouses first.
+
+     Must be set alike at all the processes. The tensor buffer is
+     mapped at the first exchange of each dimension and must not
+     change afterwards.
+   */
+  void set_zero_pack(bool b) { m_zero_pack = b; }
+  bool get_zero_pack() const { return m_zero_pack; }
+
   void exchange(int dim,
                 int width_rhs_send, int width_rhs_recv,
                 int width_lhs_send, int width_lhs_recv,
@@ -45,52 +71,135 @@ class HaloExchangeP2P:
     if (!this->is_exchange_required(
             dim, width_rhs_send, width_rhs_recv,
             width_lhs_send, width_lhs_recv)) {
-      util::MPIPrintStreamDebug()
+      DISTCONV_LOG_DEBUG(HaloExchange)
           << "exchange not required for dimension " << dim;
       return;
     }
     this->ensure_halo_buffers(dim);
+    this->wait_halo_buffers(comm_rhs, comm_lhs);
     ensure_connection(dim);
+    if (m_zero_pack) ensure_zero_pack(dim);
     BoundaryAttributes<cudaStream_t> streams(
         comm_lhs->get_stream(), comm_rhs->get_stream());
-    if (rendezvous) m_p2p.barrier(get_conns(dim), streams.data(), 2);
+    BoundaryAttributes<bool> zero_packed(false, false);
     for (auto side: SIDES) {
+      zero_packed(side) = is_zero_packed(dim, side, is_reverse,
+                                         skip_unpack, op);
+    }
+    if (rendezvous) {
+      m_p2p.barrier(get_conns(dim), streams.data(), 2);
+    } else if (zero_packed(LHS) || zero_packed(RHS)) {
+      // The peers decide alike, so only their sides rendezvous
+      p2p::P2P::connection_type conns[2];
+      cudaStream_t conn_streams[2];
+      int num_conns = 0;
+      for (auto side: SIDES) {
+        if (!zero_packed(side)) continue;
+        conns[num_conns] = get_conn(dim, side);
+        conn_streams[num_conns] = streams(side);
+        ++num_conns;
+      }
+      m_p2p.barrier(conns, conn_streams, num_conns);
+    }
+    for (auto side: get_put_order(dim)) {
       if (this->get_peer(dim, side) == MPI_PROC_NULL) continue;
       const cudaStream_t stream = side == Side::RHS
           ? comm_rhs->get_stream() : comm_lhs->get_stream();
       const int width_send = side == Side::RHS
           ? width_rhs_send : width_lhs_send;
+      if (zero_packed(side)) {
+        if (width_send > 0) put_zero_pack(dim, side, width_send, stream);
+        continue;
+      }
       auto send_buf = this->get_send_buffer(dim, side);
       if (width_send > 0) {
-        util::MPIPrintStreamDebug()
+        DISTCONV_LOG_DEBUG(HaloExchange)
             << "Packing halo for dimension " << dim << ", " << side;
         // pack the local halo
         this->pack_dim(dim, side, width_send, stream,
                        send_buf, is_reverse);
-        util::MPIPrintStreamDebug() << "Put packed halo";
+        DISTCONV_LOG_DEBUG(HaloExchange) << "Put packed halo";
         // put
-        size_t halo_bytes = this->get_halo_size(dim, width_send)
-            * sizeof(DataType);
+        size_t halo_bytes = this->get_halo_bytes(dim, width_send);
         get_conn(dim, side)->put(send_buf, get_halo_peer(dim, side),
                                  halo_bytes, stream);
       } else {
-        util::MPIPrintStreamDebug()
+        DISTCONV_LOG_DEBUG(HaloExchange)
             << "nothing to send for dimension " << dim << ", " << side;
       }
     }
+    // Zero-packed sides are in place once the puts complete
+    if (zero_packed(RHS)) width_rhs_recv = 0;
+    if (zero_packed(LHS)) width_lhs_recv = 0;
     // make sure the remote device waits for the completion of the put
-    m_p2p.barrier(get_conns(dim), streams.data(), 2);
-    if (!skip_unpack) {
-      this->unpack(dim, width_rhs_recv, width_lhs_recv,
-                   comm_rhs->get_stream(), comm_lhs->get_stream(), is_reverse, op);
+    p2p::Request requests[4];
+    m_p2p.barrier_nb(get_conns(dim), streams.data(), 2, requests);
+    if (skip_unpack || this->has_same_peers(dim)) {
+      m_p2p.wait_all(requests, 4);
+      if (this->has_same_peers(dim)) {
+        // Each side is put by the peer along with its other side
+        wait_each_other(streams);
+      }
+      if (!skip_unpack) {
+        this->unpack(dim, width_rhs_recv, width_lhs_recv,
+                     comm_rhs->get_stream(), comm_lhs->get_stream(),
+                     is_reverse, op);
+      }
+      return;
+    }
+    // Unpack each side once its barrier completes, while the other
+    // is still in flight
+    int num_pending[2] = {0, 0};
+    for (int i = 0; i < 4; ++i) {
+      if (!requests[i].is_null()) ++num_pending[i / 2];
+    }
+    bool unpacked[2] = {false, false};
+    int num_unpacked = 0;
+    while (num_unpacked < 2) {
+      int indices[4];
+      int num_completed = m_p2p.test_some(requests, 4, indices);
+      for (int i = 0; i < num_completed; ++i) {
+        --num_pending[indices[i] / 2];
+      }
+      for (int i = 0; i < 2; ++i) {
+        if (unpacked[i] || num_pending[i] > 0) continue;
+        // The connections are ordered as SIDES
+        const Side side = SIDES[i];
+        this->unpack(dim,
+                     side == Side::RHS ? width_rhs_recv : 0,
+                     side == Side::LHS ? width_lhs_recv : 0,
+                     comm_rhs->get_stream(), comm_lhs->get_stream(),
+                     is_reverse, op);
+        unpacked[i] = true;
+        ++num_unpacked;
+      }
     }
     return;
   }
 
  protected:
+  // Tensor of a peer written by the zero-pack copies
+  struct ZeroPackPeer {
+    // Peer tensor buffer as mapped here, null if the side packs
+    char *buf = nullptr;
+    // Elements between rows
+    size_t pitch = 0;
+    // Rows between slices of the exchanged dimension, i.e., the
+    // extents of dimensions 1 to it
+    size_t rows = 0;
+    // Extent of the exchanged dimension
+    size_t extent = 0;
+  };
+
   p2p::P2P &m_p2p;
   BoundaryAttributesV<p2p::P2P::connection_type> m_conns;
   BoundaryAttributesV<void*> m_halo_peer;
+  bool m_zero_pack = false;
+  // Tensor buffer mapped for each dimension, null until set up
+  std::vector<const void*> m_zero_pack_bufs;
+  BoundaryAttributesV<ZeroPackPeer> m_zero_pack_peers;
+  // Mappings of the peer allocations, closed at destruction
+  BoundaryAttributesV<void*> m_zero_pack_mapped;
 
   p2p::P2P::connection_type &get_conn(int dim, Side side) {
     return m_conns(dim, side);
@@ -112,16 +221,203 @@ class HaloExchangeP2P:
     if (!get_conn(dim, RHS)) {
       // Connection not created yet
       m_p2p.get_connections(this->m_peers(dim), get_conns(dim), 2);
-      // exchange addresses
-      void *self_addrs[2];
+      // exchange addresses not mapped by other exchangers yet
+      p2p::P2P::connection_type conns[2];
+      void *self_addrs[2] = {nullptr, nullptr};
+      void *peer_addrs[2] = {nullptr, nullptr};
+      Side sides[2];
+      int num_conns = 0;
       for (auto side: SIDES) {
-        self_addrs[side] = this->get_recv_buffer(dim, side);
+        if (is_mapping_shared(dim, side)) {
+          get_halo_peer(dim, side) = this->m_halo_bufs(dim, side)->peer_addr;
+          continue;
+        }
+        conns[num_conns] = get_conn(dim, side);
+        // With the same peer on both sides, the address given for a
+        // side is mapped to the same side of the peer, which puts to
+        // the other side here
+        self_addrs[num_conns] = this->get_recv_buffer(
+            dim, this->has_same_peers(dim) ? ~side : side);
+        sides[num_conns] = side;
+        ++num_conns;
       }
-      util::MPIPrintStreamDebug()
+      DISTCONV_LOG_DEBUG(HaloExchange)
           << "Exchanging local addreess for dimension " << dim
           << ": " << self_addrs[0] << ", " << self_addrs[1] << "\n";
-      m_p2p.exchange_addrs(get_conns(dim), self_addrs, get_halo_peers(dim), 2);
+      m_p2p.exchange_addrs(conns, self_addrs, peer_addrs, num_conns);
+      for (int i = 0; i < num_conns; ++i) {
+        get_halo_peer(dim, sides[i]) = peer_addrs[i];
+        auto &entry = this->m_halo_bufs(dim, sides[i]);
+        if (entry && entry->p2p == nullptr) {
+          // The mapping is closed by the entry
+          entry->p2p = &m_p2p;
+          entry->conn = conns[i];
+          entry->peer_addr = peer_addrs[i];
+        }
+      }
+    }
+  }
+
+  // Whether this process can store directly to the peer of dim and
+  // side
+  bool is_direct(int dim, Side side) {
+    auto &conn = get_conn(dim, side);
+    return std::dynamic_pointer_cast<p2p::ConnectionIPC>(conn) != nullptr
+        && conn->get_path() == p2p::Connection::Path::DIRECT;
+  }
+
+  static size_t get_zero_pack_rows(const Shape &shape, int dim) {
+    size_t rows = 1;
+    for (int i = 1; i <= dim; ++i) {
+      rows *= shape[i];
+    }
+    return rows;
+  }
+
+  // Both processes of a pair expose their tensor only if they can
+  // copy to each other, so they decide alike
+  bool is_zero_packed(int dim, Side side, bool is_reverse, bool skip_unpack,
+                      HaloExchangeAccumOp op) {
+    if (!m_zero_pack || op != HaloExchangeAccumOp::ID || is_reverse
+        || skip_unpack || this->m_comm_precision != CommPrecision::FULL
+        || m_zero_pack_peers(dim, side).buf == nullptr) {
+      return false;
+    }
+    if (this->m_tensor.get_const_buffer() != m_zero_pack_bufs[dim]) {
+      util::MPIPrintStreamError()
+          << "Tensor buffer changed after zero-pack halo exchange of "
+          << "dimension " << dim << " was set up";
+      throw std::exception();
+    }
+    return true;
+  }
+
+  // Maps the tensors of the peers of dim and exchanges their layouts
+  void ensure_zero_pack(int dim) {
+    if (m_zero_pack_bufs.empty()) {
+      m_zero_pack_bufs.resize(this->m_tensor.get_num_dims(), nullptr);
+    }
+    if (m_zero_pack_bufs[dim] != nullptr) return;
+    const void *buf = this->m_tensor.get_const_buffer();
+    m_zero_pack_bufs[dim] = buf;
+    const auto shape = this->m_tensor.get_local_real_shape();
+    void *base = nullptr;
+    const bool mappable = p2p::ConnectionIPC::get_ipc_base(buf, &base);
+    // Offset of the buffer in its allocation and layout
+    size_t self_layout[4] = {
+      static_cast<size_t>(static_cast<const char*>(buf)
+                          - static_cast<const char*>(base)),
+      static_cast<size_t>(this->m_tensor.get_pitch()),
+      get_zero_pack_rows(shape, dim),
+      static_cast<size_t>(shape[dim])};
+    BoundaryAttributes<std::array<size_t, 4>> peer_layouts;
+    void *self_bases[2] = {nullptr, nullptr};
+    MPI_Request requests[4];
+    int num_requests = 0;
+    MPI_Comm comm = this->m_tensor.get_locale().get_comm();
+    for (auto side: SIDES) {
+      const int peer = this->get_peer(dim, side);
+      if (peer == MPI_PROC_NULL || this->has_same_peers(dim)) continue;
+      if (mappable && is_direct(dim, side)) {
+        self_bases[side] = base;
+      }
+      DISTCONV_CHECK_MPI(MPI_Isend(self_layout, 4, MPI_UNSIGNED_LONG, peer,
+                                   0, comm, &requests[num_requests++]));
+      DISTCONV_CHECK_MPI(MPI_Irecv(peer_layouts(side).data(), 4,
+                                   MPI_UNSIGNED_LONG, peer, 0, comm,
+                                   &requests[num_requests++]));
+    }
+    DISTCONV_CHECK_MPI(MPI_Waitall(num_requests, requests,
+                                   MPI_STATUSES_IGNORE));
+    m_p2p.exchange_addrs(get_conns(dim), self_bases,
+                         m_zero_pack_mapped(dim), 2);
+    for (auto side: SIDES) {
+      auto &peer = m_zero_pack_peers(dim, side);
+      if (self_bases[side] == nullptr
+          || m_zero_pack_mapped(dim, side) == nullptr) {
+        continue;
+      }
+      const auto &layout = peer_layouts(side);
+      peer.buf = static_cast<char*>(m_zero_pack_mapped(dim, side))
+          + layout[0];
+      peer.pitch = layout[1];
+      peer.rows = layout[2];
+      peer.extent = layout[3];
+      DISTCONV_LOG_DEBUG(HaloExchange)
+          << "Zero-pack halo exchange for dimension " << dim << ", "
+          << side;
+    }
+  }
+
+  // Copies the inner halo of side to the outer halo of the other
+  // side of the peer, as unpacking a packed halo would
+  void put_zero_pack(int dim, Side side, int width, cudaStream_t stream) {
+    const auto &peer = m_zero_pack_peers(dim, side);
+    const auto shape = this->m_tensor.get_local_real_shape();
+    const size_t pitch = this->m_tensor.get_pitch();
+    const size_t rows = get_zero_pack_rows(shape, dim);
+    const size_t src_idx = side == Side::RHS
+        ? shape[dim] - width * 2 : width;
+    const size_t dst_idx = side == Side::RHS ? 0 : peer.extent - width;
+    const auto *src = static_cast<const DataType*>(
+        this->m_tensor.get_const_buffer());
+    auto *dst = reinterpret_cast<DataType*>(peer.buf);
+    size_t row_width, height, depth;
+    if (dim == 0) {
+      row_width = width;
+      height = shape.get_size() / shape[0];
+      depth = 1;
+      src += src_idx;
+      dst += dst_idx;
+    } else {
+      // Rows below the exchanged dimension are copied whole
+      row_width = shape[0];
+      height = rows / shape[dim] * width;
+      depth = shape.get_size() / shape[0] / rows;
+      src += src_idx * (rows / shape[dim]) * pitch;
+      dst += dst_idx * (peer.rows / peer.extent) * peer.pitch;
+    }
+    DISTCONV_LOG_DEBUG(HaloExchange)
+        << "Zero-pack put for dimension " << dim << ", " << side;
+    std::static_pointer_cast<p2p::ConnectionIPC>(get_conn(dim, side))
+        ->put_3d(src, pitch * sizeof(DataType), dim == 0 ? height : rows,
+                 dst, peer.pitch * sizeof(DataType),
+                 dim == 0 ? height : peer.rows,
+                 row_width * sizeof(DataType), height, depth, stream);
+  }
+
+  void close_zero_pack() {
+    for (int i = 0; i < (int)m_zero_pack_bufs.size(); ++i) {
+      if (m_zero_pack_bufs[i] == nullptr) continue;
+      m_p2p.close_addrs(get_conns(i), m_zero_pack_mapped(i), 2);
+    }
+  }
+
+  // Makes the streams of both sides wait for each other
+  static void wait_each_other(BoundaryAttributes<cudaStream_t> &streams) {
+    util::wait_stream(streams(RHS), streams(LHS));
+    util::wait_stream(streams(LHS), streams(RHS));
+  }
+
+  // Puts through slower paths are issued first as they take longer
+  // to complete
+  std::array<Side, 2> get_put_order(int dim) {
+    std::array<Side, 2> order = {SIDES[0], SIDES[1]};
+    auto path = [&](Side side) {
+      auto &conn = get_conn(dim, side);
+      return conn ? static_cast<int>(conn->get_path()) : 0;
+    };
+    if (path(order[1]) > path(order[0])) {
+      std::swap(order[0], order[1]);
     }
+    return order;
+  }
+
+  // Whether the peer address of dim and side is mapped by a shared
+  // halo buffer entry, which also closes it
+  bool is_mapping_shared(int dim, Side side) {
+    auto &entry = this->m_halo_bufs(dim, side);
+    return entry && entry->p2p == &m_p2p;
   }
 
   void close_addrs() {
@@ -130,11 +426,208 @@ class HaloExchangeP2P:
       // registered for the connection in this class must be freed
       // here. Note that when RHS connection exists, LHS should also
       // exist.
-      if (get_conn(i, RHS)) {
-        m_p2p.close_addrs(get_conns(i), get_halo_peers(i), 2);
+      if (!get_conn(i, RHS)) continue;
+      p2p::P2P::connection_type conns[2];
+      void *peer_addrs[2];
+      int num_conns = 0;
+      for (auto side: SIDES) {
+        if (is_mapping_shared(i, side)) continue;
+        conns[num_conns] = get_conn(i, side);
+        peer_addrs[num_conns] = get_halo_peer(i, side);
+        ++num_conns;
+      }
+      m_p2p.close_addrs(conns, peer_addrs, num_conns);
+    }
+  }
+};
+
+// Fuses packing, putting and notifying into a single kernel per side
+// when the peer is reachable with direct IPC stores. The pack kernel
+// writes the halo to the mapped recv buffer of the peer and then sets
+// a flag of the peer, which the unpack kernel of the peer waits for,
+// so no host synchronization is needed. Other sides fall back to the
+// put and barrier of HaloExchangeP2P. Uses only plain stores and
+// system fences, so it does not require NVSHMEM.
+template <typename DataType, typename Allocator, typename AlBackend>
+class HaloExchangeP2PFusedNotify:
+      public HaloExchangeP2P<DataType, Allocator, AlBackend> {
+  using TensorType = typename HaloExchangeP2P<
+    DataType, Allocator, AlBackend>::TensorType;
+  using CommType = typename HaloExchangeP2P<
+    DataType, Allocator, AlBackend>::CommType;
+
+ public:
+  HaloExchangeP2PFusedNotify(TensorType &tensor,
+                             p2p::P2P &p2p)
+      : HaloExchangeP2P<DataType, Allocator, AlBackend>(tensor, p2p) {}
+
+  HaloExchangeP2PFusedNotify(const HaloExchangeP2PFusedNotify &x)
+      : HaloExchangeP2P<DataType, Allocator, AlBackend>(x) {}
+
+  HaloExchangeP2PFusedNotify &operator=(
+      const HaloExchangeP2PFusedNotify &x) = delete;
+
+  virtual ~HaloExchangeP2PFusedNotify() {
+    close_flags();
+  }
+
+  using HaloExchangeP2P<DataType, Allocator, AlBackend>::exchange;
+
+  void exchange(int dim,
+                int width_rhs_send, int width_rhs_recv,
+                int width_lhs_send, int width_lhs_recv,
+                CommType &comm_rhs,
+                CommType &comm_lhs,
+                bool rendezvous, bool is_reverse,
+                bool skip_unpack,
+                HaloExchangeAccumOp op=HaloExchangeAccumOp::ID) override {
+    // The flags are only waited for by the unpack kernels
+    if (skip_unpack) {
+      HaloExchangeP2P<DataType, Allocator, AlBackend>::exchange(
+          dim, width_rhs_send, width_rhs_recv, width_lhs_send, width_lhs_recv,
+          comm_rhs, comm_lhs, rendezvous, is_reverse, skip_unpack, op);
+      return;
+    }
+    if (!this->is_exchange_required(
+            dim, width_rhs_send, width_rhs_recv,
+            width_lhs_send, width_lhs_recv)) {
+      DISTCONV_LOG_DEBUG(HaloExchange)
+          << "exchange not required for dimension " << dim;
+      return;
+    }
+    this->ensure_halo_buffers(dim);
+    this->wait_halo_buffers(comm_rhs, comm_lhs);
+    this->ensure_connection(dim);
+    ensure_sync(dim);
+    BoundaryAttributes<cudaStream_t> streams(
+        comm_lhs->get_stream(), comm_rhs->get_stream());
+    if (rendezvous) this->m_p2p.barrier(this->get_conns(dim), streams.data(), 2);
+    p2p::P2P::connection_type barrier_conns[2];
+    cudaStream_t barrier_streams[2];
+    int barrier_peers[2];
+    int num_barrier_conns = 0;
+    for (auto side: this->get_put_order(dim)) {
+      if (this->get_peer(dim, side) == MPI_PROC_NULL) continue;
+      const cudaStream_t stream = streams(side);
+      const int width_send = side == Side::RHS
+          ? width_rhs_send : width_lhs_send;
+      if (is_fused(dim, side)) {
+        if (width_send > 0) {
+          pack_put_notify(dim, side, width_send, stream,
+                          this->get_halo_peer(dim, side), is_reverse);
+        } else {
+          // Keeps the counters of both sides matched
+          get_sync(dim, side)->inc_counter(stream);
+        }
+        continue;
+      }
+      if (width_send > 0) {
+        auto send_buf = this->get_send_buffer(dim, side);
+        this->pack_dim(dim, side, width_send, stream,
+                       send_buf, is_reverse);
+        size_t halo_bytes = this->get_halo_bytes(dim, width_send);
+        this->get_conn(dim, side)->put(
+            send_buf, this->get_halo_peer(dim, side), halo_bytes, stream);
+      }
+      barrier_conns[num_barrier_conns] = this->get_conn(dim, side);
+      barrier_streams[num_barrier_conns] = stream;
+      barrier_peers[num_barrier_conns] = this->get_peer(dim, side);
+      ++num_barrier_conns;
+    }
+    if (num_barrier_conns > 0) {
+      // Time waited on each peer
+      std::uint64_t timer_ids[2] = {0, 0};
+      const bool timed = util::instrumentation::is_enabled();
+      for (int i = 0; timed && i < num_barrier_conns; ++i) {
+        timer_ids[i] = util::instrumentation::begin(
+            std::string(), util::instrumentation::Phase::HALO_TRANSFER,
+            barrier_streams[i], barrier_peers[i]);
+      }
+      this->m_p2p.barrier(barrier_conns, barrier_streams, num_barrier_conns);
+      for (int i = 0; timed && i < num_barrier_conns; ++i) {
+        util::instrumentation::end(timer_ids[i], barrier_streams[i]);
+      }
+      if (this->has_same_peers(dim)) {
+        this->wait_each_other(streams);
+      }
+    }
+    for (auto side: SIDES) {
+      if (this->get_peer(dim, side) == MPI_PROC_NULL) continue;
+      const int width_recv = side == Side::RHS
+          ? width_rhs_recv : width_lhs_recv;
+      if (width_recv == 0) continue;
+      if (is_fused(dim, side)) {
+        // Mostly waits for the flag of the peer
+        util::instrumentation::ScopedTimer timer(
+            util::instrumentation::Phase::HALO_TRANSFER,
+            this->get_peer(dim, side), streams(side));
+        wait_and_unpack(dim, side, width_recv, streams(side),
+                        this->get_recv_buffer(dim, side), is_reverse, op);
+      } else {
+        this->unpack_dim(dim, side, width_recv, streams(side),
+                         this->get_recv_buffer(dim, side), is_reverse, op);
+      }
+    }
+  }
+
+ protected:
+  BoundaryAttributesV<std::shared_ptr<p2p::DeviceSync>> m_sync;
+  BoundaryAttributesV<void*> m_peer_flag;
+
+  std::shared_ptr<p2p::DeviceSync> &get_sync(int dim, Side side) {
+    return m_sync(dim, side);
+  }
+
+  bool is_fused(int dim, Side side) {
+    // The fused kernels pack and unpack full-precision halos without
+    // scaling them
+    auto &sync = get_sync(dim, side);
+    return sync && sync->is_connected()
+        && this->m_comm_precision == CommPrecision::FULL
+        && this->m_accum_scale == DataType(1);
+  }
+
+  // Exchanges the flags with the peers. A side not capable of direct
+  // stores sends no flag, so that both processes of a pair fall back
+  // to the host barrier, as do sides with the same peer, whose flags
+  // could not be told apart.
+  void ensure_sync(int dim) {
+    if (get_sync(dim, RHS)) return;
+    void *self_flags[2] = {nullptr, nullptr};
+    for (auto side: SIDES) {
+      get_sync(dim, side) = std::make_shared<p2p::DeviceSync>();
+      if (this->get_peer(dim, side) != MPI_PROC_NULL
+          && !this->has_same_peers(dim)
+          && this->is_direct(dim, side)) {
+        self_flags[side] = get_sync(dim, side)->get_flag();
       }
     }
+    this->m_p2p.exchange_addrs(this->get_conns(dim), self_flags,
+                               m_peer_flag(dim), 2);
+    for (auto side: SIDES) {
+      if (self_flags[side] != nullptr && m_peer_flag(dim, side) != nullptr) {
+        get_sync(dim, side)->set_peer_flag(m_peer_flag(dim, side));
+      }
+      DISTCONV_LOG_DEBUG(HaloExchange)
+          << "Fused notification for dimension " << dim << ", " << side
+          << ": " << is_fused(dim, side);
+    }
   }
+
+  void close_flags() {
+    for (int i = 0; i < this->m_tensor.get_num_dims(); ++i) {
+      if (!get_sync(i, RHS)) continue;
+      this->m_p2p.close_addrs(this->get_conns(i), m_peer_flag(i), 2);
+    }
+  }
+
+  virtual void pack_put_notify(int dim, Side side, int width,
+                               cudaStream_t stream, void *dst,
+                               bool is_reverse);
+
+  virtual void wait_and_unpack(int dim, Side side, int width,
+                               cudaStream_t stream, void *buf,
+                               bool is_reverse, HaloExchangeAccumOp op);
 };
 
 } // namespace tensor
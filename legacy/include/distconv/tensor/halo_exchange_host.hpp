@@ -0,0 +1,261 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/tensor/halo_exchange.hpp"
+#include "distconv/tensor/memory.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace distconv {
+namespace tensor {
+
+/*
+  Halo exchange of host tensors over MPI.
+
+  The dimensions are exchanged one after another, each with the halos
+  of the preceding ones, so that edges and corners are filled as
+  well. The reverse exchange sends the halos back to the processes
+  owning them, which accumulate them into their boundaries, with the
+  dimensions in the reverse order so that corners reach the diagonal
+  neighbors. Halos may be wider than the local tensors of the
+  neighbors, in which case they span several processes.
+ */
+template <typename DataType>
+class HaloExchangeHost {
+ public:
+  using TensorType = Tensor<DataType, LocaleMPI, BaseAllocator>;
+
+  HaloExchangeHost(TensorType &tensor):
+      m_tensor(tensor) {
+    bool exchange_req = false;
+    for (int i = 0; i < tensor.get_num_dims(); ++i) {
+      exchange_req |= is_exchange_required(i, tensor.get_halo_width(i));
+    }
+    if (exchange_req) {
+      // Does not work for shared tensors yet
+      assert_always(!tensor.get_distribution().is_shared());
+      // Halos are packed assuming rows are not padded
+      assert_eq(tensor.get_pitch(), tensor.get_local_real_shape()[0]);
+      // Halos are not wrapped around
+      for (int i = 0; i < tensor.get_num_dims(); ++i) {
+        assert_always(!tensor.get_distribution().is_periodic(i));
+      }
+    }
+  }
+
+  virtual ~HaloExchangeHost() = default;
+
+  const TensorType &get_tensor() const {
+    return m_tensor;
+  }
+
+  // Fills the halos of widths from the boundaries of the neighbors
+  void exchange(const IntVector &widths) {
+    for (int i = 0; i < m_tensor.get_num_dims(); ++i) {
+      if (is_exchange_required(i, widths[i])) {
+        exchange(i, widths[i], false, HaloExchangeAccumOp::ID);
+      }
+    }
+  }
+
+  void exchange() {
+    exchange(m_tensor.get_halo_width());
+  }
+
+  // Accumulates the halos of widths into the boundaries of the
+  // neighbors
+  void exchange_reverse(const IntVector &widths,
+                        HaloExchangeAccumOp op=HaloExchangeAccumOp::SUM) {
+    for (int i = m_tensor.get_num_dims() - 1; i >= 0; --i) {
+      if (is_exchange_required(i, widths[i])) {
+        exchange(i, widths[i], true, op);
+      }
+    }
+  }
+
+  void exchange_reverse(HaloExchangeAccumOp op=HaloExchangeAccumOp::SUM) {
+    exchange_reverse(m_tensor.get_halo_width(), op);
+  }
+
+ protected:
+  TensorType &m_tensor;
+  std::vector<std::vector<DataType>> m_halo_send;
+  std::vector<std::vector<DataType>> m_halo_recv;
+
+  bool is_exchange_required(int dim, int width) const {
+    const auto &dist = m_tensor.get_distribution();
+    return dist.is_distributed(dim) &&
+        dist.get_split_shape()[dim] > 1 &&
+        width > 0 && m_tensor.get_local_size() > 0;
+  }
+
+  // The real tensor is traversed as outer x shape[dim] x inner
+  // elements, so that a slab along dim is one contiguous chunk per
+  // outer index.
+  void get_slab_shape(int dim, index_t &inner, index_t &outer) const {
+    const auto shape = m_tensor.get_local_real_shape();
+    inner = 1;
+    outer = 1;
+    for (int i = 0; i < m_tensor.get_num_dims(); ++i) {
+      if (i < dim) inner *= shape[i];
+      if (i > dim) outer *= shape[i];
+    }
+  }
+
+  // Copies the slab of width starting at offset along dim to buf
+  void pack(int dim, index_t offset, int width, DataType *buf) const {
+    index_t inner, outer;
+    get_slab_shape(dim, inner, outer);
+    const index_t chunk = inner * width;
+    const index_t stride = inner * m_tensor.get_local_real_shape()[dim];
+    const DataType *src = m_tensor.get_const_buffer() + offset * inner;
+#pragma omp parallel for schedule(static) if (outer > 1)
+    for (index_t i = 0; i < outer; ++i) {
+      std::memcpy(buf + i * chunk, src + i * stride,
+                  chunk * sizeof(DataType));
+    }
+  }
+
+  // Combines buf with the slab of width starting at offset along dim
+  void unpack(int dim, index_t offset, int width, const DataType *buf,
+              HaloExchangeAccumOp op) {
+    index_t inner, outer;
+    get_slab_shape(dim, inner, outer);
+    const index_t chunk = inner * width;
+    const index_t stride = inner * m_tensor.get_local_real_shape()[dim];
+    DataType *dst = m_tensor.get_buffer() + offset * inner;
+#pragma omp parallel for schedule(static) if (outer > 1)
+    for (index_t i = 0; i < outer; ++i) {
+      DataType *d = dst + i * stride;
+      const DataType *s = buf + i * chunk;
+      switch (op) {
+        case HaloExchangeAccumOp::ID:
+          std::memcpy(d, s, chunk * sizeof(DataType));
+          break;
+        case HaloExchangeAccumOp::SUM:
+#pragma omp simd
+          for (index_t j = 0; j < chunk; ++j) d[j] += s[j];
+          break;
+        case HaloExchangeAccumOp::MAX:
+          for (index_t j = 0; j < chunk; ++j) d[j] = std::max(d[j], s[j]);
+          break;
+        case HaloExchangeAccumOp::MIN:
+          for (index_t j = 0; j < chunk; ++j) d[j] = std::min(d[j], s[j]);
+          break;
+      }
+    }
+  }
+
+  // Range [begin, end) of the global indices along dim owned by
+  // the process at index p of dim
+  void get_dimension_range(int dim, int p, long &begin, long &end) const {
+    const auto &locale_shape = m_tensor.get_distribution().get_locale_shape();
+    begin = m_tensor.get_dimension_rank_offset(dim, p);
+    end = p + 1 < (int)locale_shape[dim] ?
+        m_tensor.get_dimension_rank_offset(dim, p + 1) :
+        m_tensor.get_shape()[dim];
+  }
+
+  /*
+    Exchanges with every process along dim whose range overlaps the
+    halos, so halos wider than the local tensors of the neighbors are
+    filled from the processes further away. Each peer owns one
+    contiguous segment of either halo, which is sent as one message.
+   */
+  void exchange(int dim, int width, bool is_reverse,
+                HaloExchangeAccumOp op) {
+    const index_t halo = m_tensor.get_halo_width(dim);
+    assert_always(width <= (int)halo);
+    const auto &locale_shape = m_tensor.get_distribution().get_locale_shape();
+    auto proc_idx = m_tensor.get_proc_index();
+    const int my_idx = proc_idx[dim];
+    // Global indices are signed as the halos may extend beyond the
+    // global tensor
+    long begin, end;
+    get_dimension_range(dim, my_idx, begin, end);
+    // Global index to the offset along dim in the real tensor
+    const auto to_local = [&](long idx) {
+      return (index_t)(idx + (long)halo - begin);
+    };
+    MPI_Comm comm = m_tensor.get_locale().get_comm();
+    const auto mpi_type = util::get_mpi_data_type<DataType>();
+
+    struct Segment {
+      int peer;
+      index_t offset;
+      int width;
+    };
+    // Halo segments owned by the peers, and boundary segments that
+    // are halos of the peers
+    std::vector<Segment> halos;
+    std::vector<Segment> boundaries;
+    for (int p = 0; p < (int)locale_shape[dim]; ++p) {
+      if (p == my_idx) continue;
+      long peer_begin, peer_end;
+      get_dimension_range(dim, p, peer_begin, peer_end);
+      if (peer_begin == peer_end) continue;
+      proc_idx[dim] = p;
+      const int peer = get_offset(proc_idx, locale_shape);
+      long hb, he, bb, be;
+      if (p < my_idx) {
+        hb = std::max(begin - width, peer_begin);
+        he = std::min(begin, peer_end);
+        bb = begin;
+        be = std::min(end, peer_end + width);
+      } else {
+        hb = std::max(end, peer_begin);
+        he = std::min(end + width, peer_end);
+        bb = std::max(begin, peer_begin - width);
+        be = end;
+      }
+      if (hb < he) {
+        halos.push_back({peer, to_local(hb), (int)(he - hb)});
+      }
+      if (bb < be) {
+        boundaries.push_back({peer, to_local(bb), (int)(be - bb)});
+      }
+    }
+
+    // The halos are received in the forward exchange and sent in the
+    // reverse one
+    const auto &recv_segments = is_reverse ? boundaries : halos;
+    const auto &send_segments = is_reverse ? halos : boundaries;
+    index_t inner, outer;
+    get_slab_shape(dim, inner, outer);
+    const index_t slice = inner * outer;
+    m_halo_recv.resize(recv_segments.size());
+    m_halo_send.resize(send_segments.size());
+    std::vector<MPI_Request> requests;
+    requests.reserve(recv_segments.size() + send_segments.size());
+    for (size_t i = 0; i < recv_segments.size(); ++i) {
+      const auto &s = recv_segments[i];
+      m_halo_recv[i].resize(slice * s.width);
+      requests.push_back(MPI_REQUEST_NULL);
+      DISTCONV_CHECK_MPI(MPI_Irecv(m_halo_recv[i].data(), slice * s.width,
+                                   mpi_type, s.peer, dim, comm,
+                                   &requests.back()));
+    }
+    for (size_t i = 0; i < send_segments.size(); ++i) {
+      const auto &s = send_segments[i];
+      m_halo_send[i].resize(slice * s.width);
+      pack(dim, s.offset, s.width, m_halo_send[i].data());
+      requests.push_back(MPI_REQUEST_NULL);
+      DISTCONV_CHECK_MPI(MPI_Isend(m_halo_send[i].data(), slice * s.width,
+                                   mpi_type, s.peer, dim, comm,
+                                   &requests.back()));
+    }
+    DISTCONV_CHECK_MPI(MPI_Waitall(requests.size(), requests.data(),
+                                   MPI_STATUSES_IGNORE));
+    for (size_t i = 0; i < recv_segments.size(); ++i) {
+      const auto &s = recv_segments[i];
+      unpack(dim, s.offset, s.width, m_halo_recv[i].data(), op);
+    }
+  }
+};
+
+} // namespace tensor
+} // namespace distconv
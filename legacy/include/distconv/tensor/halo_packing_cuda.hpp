@@ -1,13 +1,24 @@
 #pragma once
 
 #include "distconv/base.hpp"
+#include "distconv/tensor/comm_precision_cuda.hpp"
 #include "distconv/tensor/halo_exchange_cuda.hpp"
 #include "distconv/tensor/halo_cuda.hpp"
 
 #ifdef DISTCONV_HAS_NVSHMEM
 #include "distconv/util/nvshmem.hpp"
+#include "distconv/util/overflow_gpu.hpp"
 #endif // DISTCONV_HAS_NVSHMEM
 
+#ifdef DISTCONV_HAS_P2P
+#include "p2p/device_sync.hpp"
+#endif // DISTCONV_HAS_P2P
+
+#if H2_HAS_CUDA
+#include "distconv/tensor/halo_packing_jit_cuda.hpp"
+#include "distconv/tensor/halo_packing_tma_cuda.hpp"
+#endif // H2_HAS_CUDA
+
 #define HALO_EXCHANGE_ACCUME_OP_SWITCH(x)                       \
   switch(x) {                                                   \
     CASE_BLOCK(HaloExchangeAccumOp::ID);                        \
@@ -33,12 +44,19 @@ struct HaloExchangeAccumCUDAFunctor<DataType,
   }
 };
 
+// The scaled sums weight the received halo, e.g., to average the
+// contributions of the neighbors without a separate pass over the
+// tensor.
 template <typename DataType>
 struct HaloExchangeAccumCUDAFunctor<DataType,
                                     HaloExchangeAccumOp::SUM> {
   __device__ void operator()(DataType &x, const DataType y) {
     x += y;
   }
+  template <typename S>
+  __device__ void operator()(DataType &x, const DataType y, const S s) {
+    x += y * s;
+  }
 };
 
 template <typename DataType>
@@ -67,7 +85,15 @@ struct PackFunctor {
   static constexpr bool modifies_tensor = true;
 
   DataType *m_buf;
-  PackFunctor(DataType *buf): m_buf(buf) {}
+  // Weight of the unpacked halo when summed
+  DataType m_scale;
+  // Set if a sum is not finite; see util/overflow_gpu.hpp
+  int *m_overflow;
+  // Also constructed on the device by TraverseRegions
+  __host__ __device__ PackFunctor(DataType *buf,
+                                  DataType scale=DataType(1),
+                                  int *overflow=nullptr):
+      m_buf(buf), m_scale(scale), m_overflow(overflow) {}
   template <typename T> __device__
   typename std::enable_if<std::is_same<T, DataType>::value ||
                           std::is_same<T, Vec2>::value ||
@@ -75,6 +101,10 @@ struct PackFunctor {
   operator()(T &x, size_t offset) {
     if (pack) {
       ((T*)m_buf)[offset] = x;
+    } else if constexpr (op == HaloExchangeAccumOp::SUM) {
+      HaloExchangeAccumCUDAFunctor<T, op>()(
+          x, ((T*)m_buf)[offset], m_scale);
+      util::overflow::check<DataType>(m_overflow, x);
     } else {
       HaloExchangeAccumCUDAFunctor<T, op>()(
           x, ((T*)m_buf)[offset]);
@@ -82,6 +112,52 @@ struct PackFunctor {
   }
 };
 
+// Packs halos as WireType, converting each element, and accumulates
+// unpacked elements in DataType. Vectors of elements are packed as
+// consecutive wire elements.
+template <typename DataType, typename WireType, bool pack,
+          HaloExchangeAccumOp op>
+struct WirePackFunctor {
+  using Vec2 = typename util::GetVectorType<DataType, 2>::type;
+  using Vec4 = typename util::GetVectorType<DataType, 4>::type;
+  static constexpr HaloTraversalOpGroup group = HaloTraversalOpGroup::THREAD;
+  static constexpr bool has_pre_grid = false;
+  static constexpr bool has_post_grid = false;
+  static constexpr bool modifies_tensor = true;
+
+  WireType *m_buf;
+  DataType m_scale;
+  int *m_overflow;
+  __host__ __device__ WirePackFunctor(void *buf,
+                                      DataType scale=DataType(1),
+                                      int *overflow=nullptr):
+      m_buf(static_cast<WireType*>(buf)), m_scale(scale),
+      m_overflow(overflow) {}
+  template <typename T> __device__
+  typename std::enable_if<std::is_same<T, DataType>::value ||
+                          std::is_same<T, Vec2>::value ||
+                          std::is_same<T, Vec4>::value, void>::type
+  operator()(T &x, size_t offset) {
+    constexpr int width = sizeof(T) / sizeof(DataType);
+    DataType *xs = reinterpret_cast<DataType*>(&x);
+    WireType *ws = m_buf + offset * width;
+#pragma unroll
+    for (int i = 0; i < width; ++i) {
+      if (pack) {
+        ws[i] = WireCast<WireType>::to_wire(xs[i]);
+      } else if constexpr (op == HaloExchangeAccumOp::SUM) {
+        HaloExchangeAccumCUDAFunctor<DataType, op>()(
+            xs[i], WireCast<WireType>::template from_wire<DataType>(ws[i]),
+            m_scale);
+        util::overflow::check(m_overflow, xs[i]);
+      } else {
+        HaloExchangeAccumCUDAFunctor<DataType, op>()(
+            xs[i], WireCast<WireType>::template from_wire<DataType>(ws[i]));
+      }
+    }
+  }
+};
+
 template <typename DataType, bool is_pack, typename PackFunctor>
 void pack_or_unpack(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
                     int dim,
@@ -89,7 +165,8 @@ void pack_or_unpack(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
                     int width,
                     h2::gpu::DeviceStream stream,
                     void* buf,
-                    bool is_reverse)
+                    bool is_reverse,
+                    DataType scale = DataType(1))
 {
     using TensorType = Tensor<DataType, LocaleMPI, CUDAAllocator>;
     TraverseHalo<TensorType, PackFunctor>(
@@ -98,7 +175,8 @@ void pack_or_unpack(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
         side,
         width,
         (is_pack && !is_reverse) || (!is_pack && is_reverse),
-        PackFunctor(static_cast<DataType*>(buf)),
+        PackFunctor(static_cast<DataType*>(buf), scale,
+                    util::overflow::get_flag()),
         stream);
 }
 
@@ -113,13 +191,15 @@ void pack_or_unpack(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
                     h2::gpu::DeviceStream stream,
                     void* buf,
                     bool is_reverse,
-                    HaloExchangeAccumOp op)
+                    HaloExchangeAccumOp op,
+                    DataType scale = DataType(1))
 {
 #define CASE_BLOCK(OP)                                                  \
   case OP:                                                              \
     pack_or_unpack<DataType, is_pack,                                   \
                    PackFunctor<DataType, is_pack, OP>>(                 \
-                       tensor, dim, side, width, stream, buf, is_reverse); \
+                       tensor, dim, side, width, stream, buf, is_reverse, \
+                       scale);                                          \
     break;
 
   HALO_EXCHANGE_ACCUME_OP_SWITCH(op);
@@ -134,10 +214,11 @@ void pack_or_unpack(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
                     h2::gpu::DeviceStream stream,
                     void* buf,
                     bool is_reverse,
-                    HaloExchangeAccumOp op)
+                    HaloExchangeAccumOp op,
+                    DataType scale = DataType(1))
 {
     pack_or_unpack<DataType, is_pack, PackFunctor>(
-        tensor, dim, side, width, stream, buf, is_reverse, op);
+        tensor, dim, side, width, stream, buf, is_reverse, op, scale);
 }
 
 template <typename DataType>
@@ -149,10 +230,26 @@ void pack_or_unpack(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
                     void* buf,
                     bool is_pack,
                     bool is_reverse,
-                    HaloExchangeAccumOp op)
+                    HaloExchangeAccumOp op,
+                    DataType scale = DataType(1))
 {
     if (width == 0)
         return;
+#if H2_HAS_CUDA
+    // Plain copies go through the TMA where available
+    if ((is_pack || op == HaloExchangeAccumOp::ID)
+        && copy_halo_tma(
+            tensor, dim, side, width, stream, buf, is_pack, is_reverse))
+    {
+        return;
+    }
+    if (pack_or_unpack_jit(
+            tensor, dim, side, width, stream, buf, is_pack, is_reverse, op,
+            scale))
+    {
+        return;
+    }
+#endif // H2_HAS_CUDA
     if (is_pack)
     {
         pack_or_unpack<DataType, true>(
@@ -161,11 +258,380 @@ void pack_or_unpack(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
     else
     {
         pack_or_unpack<DataType, false>(
-            tensor, dim, side, width, stream, buf, is_reverse, op);
+            tensor, dim, side, width, stream, buf, is_reverse, op, scale);
     }
     return;
 }
 
+// Packs or unpacks the halo with the elements converted to the wire
+// type of precision. Halos summed when unpacked are weighted by scale.
+template <typename DataType>
+void pack_or_unpack(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                    int dim,
+                    Side side,
+                    int width,
+                    h2::gpu::DeviceStream stream,
+                    void* buf,
+                    bool is_pack,
+                    bool is_reverse,
+                    HaloExchangeAccumOp op,
+                    CommPrecision precision,
+                    DataType scale = DataType(1))
+{
+    if (precision == CommPrecision::FULL)
+    {
+        pack_or_unpack<DataType>(tensor, dim, side, width, stream, buf,
+                                 is_pack, is_reverse, op, scale);
+        return;
+    }
+    if (width == 0)
+        return;
+    dispatch_wire_type<DataType>(precision, [&](auto* wire_ptr) {
+        using WireType = std::remove_pointer_t<decltype(wire_ptr)>;
+#define CASE_BLOCK(OP)                                                  \
+  case OP:                                                              \
+    if (is_pack) {                                                      \
+      pack_or_unpack<DataType, true,                                    \
+                     WirePackFunctor<DataType, WireType, true, OP>>(    \
+                         tensor, dim, side, width, stream, buf,         \
+                         is_reverse);                                   \
+    } else {                                                            \
+      pack_or_unpack<DataType, false,                                   \
+                     WirePackFunctor<DataType, WireType, false, OP>>(   \
+                         tensor, dim, side, width, stream, buf,         \
+                         is_reverse, scale);                            \
+    }                                                                   \
+    break;
+
+        HALO_EXCHANGE_ACCUME_OP_SWITCH(op);
+#undef CASE_BLOCK
+    });
+}
+
+template <typename DataType, bool is_pack, HaloExchangeAccumOp op>
+void pack_or_unpack_region(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                           const IndexVector& offset,
+                           const Shape& shape,
+                           h2::gpu::DeviceStream stream,
+                           void* buf,
+                           DataType scale = DataType(1))
+{
+    TraverseRegion(tensor,
+                   offset,
+                   shape,
+                   PackFunctor<DataType, is_pack, op>(
+                       static_cast<DataType*>(buf), scale,
+                       util::overflow::get_flag()),
+                   stream);
+}
+
+template <typename DataType>
+void pack_or_unpack_region(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                           const IndexVector& offset,
+                           const Shape& shape,
+                           h2::gpu::DeviceStream stream,
+                           void* buf,
+                           bool is_pack,
+                           HaloExchangeAccumOp op,
+                           DataType scale = DataType(1))
+{
+    if (is_pack)
+    {
+        pack_or_unpack_region<DataType, true, HaloExchangeAccumOp::ID>(
+            tensor, offset, shape, stream, buf);
+        return;
+    }
+#define CASE_BLOCK(OP)                                                  \
+  case OP:                                                              \
+    pack_or_unpack_region<DataType, false, OP>(                         \
+        tensor, offset, shape, stream, buf, scale);                     \
+    break;
+
+  HALO_EXCHANGE_ACCUME_OP_SWITCH(op);
+#undef CASE_BLOCK
+}
+
+template <typename DataType, bool is_pack, HaloExchangeAccumOp op>
+void pack_or_unpack_regions(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                            const std::vector<IndexVector>& offsets,
+                            const std::vector<Shape>& shapes,
+                            const std::vector<DataType*>& bufs,
+                            h2::gpu::DeviceStream stream)
+{
+    TraverseRegions<Tensor<DataType, LocaleMPI, CUDAAllocator>,
+                    PackFunctor<DataType, is_pack, op>>(
+        tensor, offsets, shapes, bufs, stream);
+}
+
+// Packs or unpacks all the regions with a single kernel launch
+template <typename DataType>
+void pack_or_unpack_regions(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                            const std::vector<IndexVector>& offsets,
+                            const std::vector<Shape>& shapes,
+                            const std::vector<DataType*>& bufs,
+                            h2::gpu::DeviceStream stream,
+                            bool is_pack,
+                            HaloExchangeAccumOp op)
+{
+    if (is_pack)
+    {
+        pack_or_unpack_regions<DataType, true, HaloExchangeAccumOp::ID>(
+            tensor, offsets, shapes, bufs, stream);
+        return;
+    }
+    // The functors constructed on the device do not get the overflow
+    // flag, so checked sums are unpacked region by region
+    if (op == HaloExchangeAccumOp::SUM && util::overflow::is_enabled())
+    {
+        for (size_t i = 0; i < offsets.size(); ++i)
+        {
+            pack_or_unpack_region<DataType, false, HaloExchangeAccumOp::SUM>(
+                tensor, offsets[i], shapes[i], stream, bufs[i]);
+        }
+        return;
+    }
+#define CASE_BLOCK(OP)                                                  \
+  case OP:                                                              \
+    pack_or_unpack_regions<DataType, false, OP>(                        \
+        tensor, offsets, shapes, bufs, stream);                         \
+    break;
+
+  HALO_EXCHANGE_ACCUME_OP_SWITCH(op);
+#undef CASE_BLOCK
+}
+
+// Packs or unpacks the rows of a halo whose global index in dim is
+// congruent to phase modulo step, each row in the next slot of buf.
+// The rows are those of TraverseHalo, and the sender and receiver of
+// a halo enumerate the same global rows in order.
+template <typename DataType>
+void pack_or_unpack_rows(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                         int dim,
+                         Side side,
+                         int width,
+                         int step,
+                         int phase,
+                         h2::gpu::DeviceStream stream,
+                         void* buf,
+                         bool is_pack,
+                         bool is_reverse,
+                         HaloExchangeAccumOp op,
+                         DataType scale = DataType(1))
+{
+    if (width == 0)
+        return;
+    const bool inner = (is_pack && !is_reverse) || (!is_pack && is_reverse);
+    auto row_shape = tensor.get_local_real_shape();
+    const index_t real_dim = row_shape[dim];
+    index_t begin = 0;
+    if (side == Side::RHS)
+        begin = real_dim - width * (inner ? 2 : 1);
+    else if (inner)
+        begin = width;
+    row_shape[dim] = 1;
+    const size_t row_size = row_shape.get_size();
+    // Local real row 0 is the first row of the LHS halo
+    const index_t global_begin = tensor.get_global_index(dim, 0)
+                                 - tensor.get_halo_width(dim) + begin;
+    std::vector<IndexVector> offsets;
+    std::vector<Shape> shapes;
+    std::vector<DataType*> bufs;
+    for (int r = 0; r < width; ++r)
+    {
+        const index_t g = global_begin + r;
+        if (((g - phase) % step + step) % step != 0)
+            continue;
+        IndexVector offset(tensor.get_num_dims(), 0);
+        offset[dim] = begin + r;
+        offsets.push_back(offset);
+        shapes.push_back(row_shape);
+        bufs.push_back(static_cast<DataType*>(buf) + bufs.size() * row_size);
+    }
+    if (offsets.empty())
+        return;
+    if (scale == DataType(1))
+    {
+        pack_or_unpack_regions<DataType>(
+            tensor, offsets, shapes, bufs, stream, is_pack, op);
+        return;
+    }
+    for (size_t i = 0; i < offsets.size(); ++i)
+    {
+        pack_or_unpack_region<DataType>(
+            tensor, offsets[i], shapes[i], stream, bufs[i], is_pack, op, scale);
+    }
+}
+
+// Zeroes the halo of a side without a peer
+template <typename DataType>
+struct ClearBoundaryHaloFunctor {
+  using Vec2 = typename util::GetVectorType<DataType, 2>::type;
+  using Vec4 = typename util::GetVectorType<DataType, 4>::type;
+  static constexpr HaloTraversalOpGroup group = HaloTraversalOpGroup::THREAD;
+  static constexpr bool has_pre_grid = false;
+  static constexpr bool has_post_grid = false;
+  static constexpr bool modifies_tensor = true;
+
+  template <typename T> __device__
+  typename std::enable_if<std::is_same<T, DataType>::value ||
+                          std::is_same<T, Vec2>::value ||
+                          std::is_same<T, Vec4>::value, void>::type
+  operator()(T &x, size_t offset) {
+    constexpr int width = sizeof(T) / sizeof(DataType);
+    DataType *xs = reinterpret_cast<DataType*>(&x);
+#pragma unroll
+    for (int i = 0; i < width; ++i) {
+      xs[i] = DataType(0);
+    }
+  }
+};
+
+template <typename DataType>
+void clear_boundary_halo(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                         int dim,
+                         Side side,
+                         int width,
+                         h2::gpu::DeviceStream stream)
+{
+    if (width == 0)
+        return;
+    using TensorType = Tensor<DataType, LocaleMPI, CUDAAllocator>;
+    TraverseHalo<TensorType, ClearBoundaryHaloFunctor<DataType>>(
+        tensor,
+        dim,
+        side,
+        width,
+        false,
+        ClearBoundaryHaloFunctor<DataType>(),
+        stream);
+}
+
+#ifdef DISTCONV_HAS_P2P
+
+// Packs the halo directly to the recv buffer of the peer mapped with
+// ConnectionIPC and notifies the peer once all blocks are done
+template <typename DataType>
+struct PackPutNotifyIPCFunctor {
+  using Vec2 = typename util::GetVectorType<DataType, 2>::type;
+  using Vec4 = typename util::GetVectorType<DataType, 4>::type;
+  static constexpr HaloTraversalOpGroup group = HaloTraversalOpGroup::THREAD;
+  static constexpr bool has_pre_grid = false;
+  static constexpr bool has_post_grid = true;
+  static constexpr bool modifies_tensor = false;
+
+  DataType *m_dst;
+  p2p::DeviceSyncDevice m_sync;
+  PackPutNotifyIPCFunctor(DataType *dst, p2p::DeviceSync &sync):
+      m_dst(dst), m_sync(sync.get_for_device()) {}
+
+  template <typename T> __device__
+  typename std::enable_if<std::is_same<T, DataType>::value ||
+                          std::is_same<T, Vec2>::value ||
+                          std::is_same<T, Vec4>::value, void>::type
+  operator()(const T &x, size_t offset) {
+    ((T*)(m_dst))[offset] = x;
+  }
+
+  __device__ void post() {
+    m_sync.inc_counter();
+    m_sync.notify();
+  }
+};
+
+template <typename DataType>
+void pack_put_notify_ipc(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                         int dim,
+                         Side side,
+                         int width,
+                         h2::gpu::DeviceStream stream,
+                         void* dst,
+                         bool is_reverse,
+                         p2p::DeviceSync& sync)
+{
+    using TensorType = Tensor<DataType, LocaleMPI, CUDAAllocator>;
+    TraverseHalo<TensorType, PackPutNotifyIPCFunctor<DataType>>(
+        tensor,
+        dim,
+        side,
+        width,
+        !is_reverse,
+        PackPutNotifyIPCFunctor<DataType>(static_cast<DataType*>(dst), sync),
+        stream);
+}
+
+template <typename DataType, HaloExchangeAccumOp op>
+struct WaitAndUnpackIPCFunctor {
+  using Vec2 = typename util::GetVectorType<DataType, 2>::type;
+  using Vec4 = typename util::GetVectorType<DataType, 4>::type;
+  static constexpr HaloTraversalOpGroup group = HaloTraversalOpGroup::THREAD;
+  static constexpr bool has_pre_grid = true;
+  static constexpr bool has_post_grid = false;
+  static constexpr bool modifies_tensor = true;
+
+  DataType *m_buf;
+  p2p::DeviceSyncDevice m_sync;
+  WaitAndUnpackIPCFunctor(DataType *buf, p2p::DeviceSync &sync):
+      m_buf(buf), m_sync(sync.get_for_device()) {}
+
+  template <typename T> __device__
+  typename std::enable_if<std::is_same<T, DataType>::value ||
+                          std::is_same<T, Vec2>::value ||
+                          std::is_same<T, Vec4>::value, void>::type
+  operator()(T &x, size_t offset) {
+    HaloExchangeAccumCUDAFunctor<T, op>()(
+        x, ((T*)(m_buf))[offset]);
+  }
+
+  __device__ void pre() {
+    m_sync.wait();
+  }
+};
+
+template <typename DataType, HaloExchangeAccumOp Op>
+void wait_and_unpack_ipc(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                         int dim,
+                         Side side,
+                         int width,
+                         h2::gpu::DeviceStream stream,
+                         void* buf,
+                         bool is_reverse,
+                         p2p::DeviceSync& sync)
+{
+    using TensorType = Tensor<DataType, LocaleMPI, CUDAAllocator>;
+    TraverseHalo<TensorType, WaitAndUnpackIPCFunctor<DataType, Op>>(
+        tensor,
+        dim,
+        side,
+        width,
+        is_reverse,
+        WaitAndUnpackIPCFunctor<DataType, Op>(static_cast<DataType*>(buf),
+                                              sync),
+        stream);
+}
+
+template <typename DataType>
+void wait_and_unpack_ipc(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                         int dim,
+                         Side side,
+                         int width,
+                         h2::gpu::DeviceStream stream,
+                         void* buf,
+                         bool is_reverse,
+                         HaloExchangeAccumOp op,
+                         p2p::DeviceSync& sync)
+{
+#define CASE_BLOCK(OP)                                                  \
+  case OP:                                                              \
+    wait_and_unpack_ipc<DataType, OP>(                                  \
+        tensor, dim, side, width, stream, buf, is_reverse, sync);       \
+    break;
+
+  HALO_EXCHANGE_ACCUME_OP_SWITCH(op);
+#undef CASE_BLOCK
+}
+
+#endif // DISTCONV_HAS_P2P
+
 #ifdef DISTCONV_HAS_NVSHMEM
 
 template <typename DataType>
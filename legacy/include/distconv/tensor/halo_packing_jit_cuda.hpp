@@ -0,0 +1,132 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/tensor/halo_exchange.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/jit_cuda.hpp"
+#include "distconv/util/overflow_gpu.hpp"
+#include "distconv/util/util.hpp"
+
+#include <cuda_runtime.h>
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+/*
+  Halo packing and unpacking kernels specialized for the geometry of
+  a halo and compiled at run time; see util/jit_cuda.hpp.
+
+  The shape of the halo, the strides of the tensor and the offset of
+  the halo are compile-time constants of the generated kernel, so the
+  index computations of the traversal reduce to multiplications by
+  constants. Packing and unpacking with ID and SUM are generated;
+  other operations and element types use the traversal kernels.
+ */
+
+namespace distconv {
+namespace tensor {
+namespace halo_exchange_cuda {
+namespace jit {
+
+template <typename DataType>
+const char *get_type_name() {
+  if constexpr (std::is_same_v<DataType, float>) {
+    return "float";
+  } else if constexpr (std::is_same_v<DataType, double>) {
+    return "double";
+  } else {
+    return nullptr;
+  }
+}
+
+// Source of the kernel of the halo of width at side of dim, traversed
+// as pack_or_unpack does, with the packed elements in the same order
+template <typename DataType>
+std::string generate(const Shape &shape, size_t pitch, int dim, Side side,
+                     int width, bool is_pack, bool inner,
+                     HaloExchangeAccumOp op) {
+  const int nd = shape.num_dims();
+  size_t origin;
+  if (side == Side::RHS) {
+    origin = shape[dim] - width * (inner ? 2 : 1);
+  } else {
+    origin = inner ? width : 0;
+  }
+  size_t stride = 1;
+  size_t num_elms = 1;
+  std::ostringstream index;
+  for (int i = 0; i < nd; ++i) {
+    const size_t extent = i == dim ? width : shape[i];
+    if (i == dim) origin *= stride;
+    if (i + 1 < nd) {
+      index << "  off += (r % " << extent << "ul) * " << stride << "ul;\n"
+            << "  r /= " << extent << "ul;\n";
+    } else {
+      index << "  off += r * " << stride << "ul;\n";
+    }
+    num_elms *= extent;
+    stride *= i == 0 ? pitch : shape[i];
+  }
+  std::ostringstream src;
+  src << "using T = " << get_type_name<DataType>() << ";\n"
+      << "extern \"C\" __global__ void halo_kernel(T *tensor, T *buf, "
+      << "T scale, int *overflow) {\n"
+      << "for (unsigned long i = blockIdx.x * blockDim.x + threadIdx.x;\n"
+      << "     i < " << num_elms << "ul;\n"
+      << "     i += (unsigned long)gridDim.x * blockDim.x) {\n"
+      << "  unsigned long r = i;\n"
+      << "  unsigned long off = " << origin << "ul;\n"
+      << index.str();
+  if (is_pack) {
+    src << "  buf[i] = tensor[off];\n";
+  } else if (op == HaloExchangeAccumOp::SUM) {
+    src << "  tensor[off] += scale * buf[i];\n"
+        << "  if (overflow && !isfinite(tensor[off])) *overflow = 1;\n";
+  } else {
+    src << "  tensor[off] = buf[i];\n";
+  }
+  src << "}\n}\n";
+  return src.str();
+}
+
+} // namespace jit
+
+// Packs or unpacks the halo with a kernel compiled for its geometry.
+// Returns false without issuing anything if the kernel is not
+// available, in which case the caller uses the traversal kernels.
+template <typename DataType>
+bool pack_or_unpack_jit(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                        int dim, Side side, int width, cudaStream_t stream,
+                        void *buf, bool is_pack, bool is_reverse,
+                        HaloExchangeAccumOp op, DataType scale) {
+  if (!util::jit::is_enabled() || jit::get_type_name<DataType>() == nullptr
+      || (!is_pack && op != HaloExchangeAccumOp::ID
+          && op != HaloExchangeAccumOp::SUM)) {
+    return false;
+  }
+  const auto shape = tensor.get_local_real_shape();
+  const auto source = jit::generate<DataType>(
+      shape, tensor.get_pitch(), dim, side, width, is_pack,
+      is_pack != is_reverse, op);
+  CUfunction kernel = util::jit::get_kernel(source, "halo_kernel");
+  if (kernel == nullptr) return false;
+  auto halo_shape = shape;
+  halo_shape[dim] = width;
+  constexpr size_t block = 256;
+  const size_t grid = std::min<size_t>(
+      util::ceil<size_t>(halo_shape.get_size(), block),
+      std::numeric_limits<int>::max());
+  DataType *tensor_ptr = tensor.get_buffer();
+  DataType *buf_ptr = static_cast<DataType*>(buf);
+  int *overflow = util::overflow::get_flag();
+  void *args[] = {&tensor_ptr, &buf_ptr, &scale, &overflow};
+  util::jit::launch(kernel, grid, block, stream, args);
+  return true;
+}
+
+} // namespace halo_exchange_cuda
+} // namespace tensor
+} // namespace distconv
@@ -0,0 +1,291 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_cuda.hpp"
+
+#include <cuda.h>
+#include <cuda_runtime.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <type_traits>
+
+/*
+  Packing and unpacking of halos with the Tensor Memory Accelerator of
+  sm_90 devices.
+
+  The halo of a side is a box of the tensor, and the packed buffer a
+  dense tensor of the shape of the box, so both are described as TMA
+  tensor maps. Each block moves one tile of the box: a single thread
+  loads it into shared memory with a bulk tensor copy and stores it to
+  the other map with another, without per-element loads. Tiles
+  crossing the end of the box are filled and clipped by the TMA.
+
+  Only copies are supported, i.e., packing and unpacking without
+  accumulation, and only when the TMA can address both maps: strides
+  of multiples of 16 bytes, which excludes the halos of the innermost
+  dimension unless they are 16 bytes wide, and 16-byte aligned
+  buffers. Other cases, devices before sm_90 and builds without CUDA
+  12 fall back to the traversal kernels. Setting
+  DISTCONV_DISABLE_HALO_TMA disables the path.
+ */
+
+namespace distconv {
+namespace tensor {
+namespace halo_exchange_cuda {
+
+#if CUDART_VERSION >= 12000
+
+namespace tma {
+
+constexpr int max_dims = 5;
+// Bytes of the tile of a block
+constexpr size_t max_tile_bytes = 16 * 1024;
+
+struct Coords {
+  int v[max_dims];
+};
+
+template <typename DataType>
+bool get_data_type(CUtensorMapDataType &t) {
+  if constexpr (std::is_same_v<DataType, float>) {
+    t = CU_TENSOR_MAP_DATA_TYPE_FLOAT32;
+  } else if constexpr (std::is_same_v<DataType, double>) {
+    t = CU_TENSOR_MAP_DATA_TYPE_FLOAT64;
+  } else if constexpr (std::is_same_v<DataType, int>) {
+    t = CU_TENSOR_MAP_DATA_TYPE_INT32;
+  } else if constexpr (std::is_same_v<DataType, long>) {
+    t = CU_TENSOR_MAP_DATA_TYPE_INT64;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+#if defined(__CUDA_ARCH__) && __CUDA_ARCH__ >= 900
+
+template <int ND>
+__device__ __forceinline__ void load_tile(void *smem, const CUtensorMap *map,
+                                          const int *c, uint64_t *bar) {
+  const auto dst = static_cast<uint32_t>(__cvta_generic_to_shared(smem));
+  const auto mbar = static_cast<uint32_t>(__cvta_generic_to_shared(bar));
+  if constexpr (ND == 4) {
+    asm volatile(
+        "cp.async.bulk.tensor.4d.shared::cluster.global.tile"
+        ".mbarrier::complete_tx::bytes [%0], [%1, {%3, %4, %5, %6}], [%2];"
+        :: "r"(dst), "l"(map), "r"(mbar),
+           "r"(c[0]), "r"(c[1]), "r"(c[2]), "r"(c[3])
+        : "memory");
+  } else {
+    asm volatile(
+        "cp.async.bulk.tensor.5d.shared::cluster.global.tile"
+        ".mbarrier::complete_tx::bytes [%0], [%1, {%3, %4, %5, %6, %7}], [%2];"
+        :: "r"(dst), "l"(map), "r"(mbar),
+           "r"(c[0]), "r"(c[1]), "r"(c[2]), "r"(c[3]), "r"(c[4])
+        : "memory");
+  }
+}
+
+template <int ND>
+__device__ __forceinline__ void store_tile(const CUtensorMap *map,
+                                           const int *c, const void *smem) {
+  const auto src = static_cast<uint32_t>(__cvta_generic_to_shared(smem));
+  if constexpr (ND == 4) {
+    asm volatile(
+        "cp.async.bulk.tensor.4d.global.shared::cta.tile.bulk_group"
+        " [%0, {%2, %3, %4, %5}], [%1];"
+        :: "l"(map), "r"(src),
+           "r"(c[0]), "r"(c[1]), "r"(c[2]), "r"(c[3])
+        : "memory");
+  } else {
+    asm volatile(
+        "cp.async.bulk.tensor.5d.global.shared::cta.tile.bulk_group"
+        " [%0, {%2, %3, %4, %5, %6}], [%1];"
+        :: "l"(map), "r"(src),
+           "r"(c[0]), "r"(c[1]), "r"(c[2]), "r"(c[3]), "r"(c[4])
+        : "memory");
+  }
+}
+
+#endif // defined(__CUDA_ARCH__) && __CUDA_ARCH__ >= 900
+
+// Copies the tile of the block from src at src_origin to dst at
+// dst_origin. Launched with a single thread per block.
+template <int ND>
+__global__ void copy_box_kernel(const __grid_constant__ CUtensorMap src,
+                                const __grid_constant__ CUtensorMap dst,
+                                Coords src_origin, Coords dst_origin,
+                                Coords tile, Coords num_tiles,
+                                uint32_t tile_bytes) {
+#if defined(__CUDA_ARCH__) && __CUDA_ARCH__ >= 900
+  extern __shared__ __align__(128) unsigned char smem[];
+  __shared__ __align__(8) uint64_t bar;
+  int src_c[ND], dst_c[ND];
+  unsigned idx = blockIdx.x;
+#pragma unroll
+  for (int i = 0; i < ND; ++i) {
+    const int offset = (idx % num_tiles.v[i]) * tile.v[i];
+    idx /= num_tiles.v[i];
+    src_c[i] = src_origin.v[i] + offset;
+    dst_c[i] = dst_origin.v[i] + offset;
+  }
+  const auto mbar = static_cast<uint32_t>(__cvta_generic_to_shared(&bar));
+  asm volatile("mbarrier.init.shared::cta.b64 [%0], 1;" :: "r"(mbar));
+  asm volatile("fence.proxy.async.shared::cta;" ::: "memory");
+  asm volatile(
+      "mbarrier.arrive.expect_tx.shared::cta.b64 _, [%0], %1;"
+      :: "r"(mbar), "r"(tile_bytes) : "memory");
+  load_tile<ND>(smem, &src, src_c, &bar);
+  asm volatile(
+      "{\n"
+      ".reg .pred done;\n"
+      "wait:\n"
+      "mbarrier.try_wait.parity.shared::cta.b64 done, [%0], 0;\n"
+      "@!done bra wait;\n"
+      "}"
+      :: "r"(mbar) : "memory");
+  store_tile<ND>(&dst, dst_c, smem);
+  asm volatile("cp.async.bulk.commit_group;" ::: "memory");
+  // The shared memory must stay valid until the store has read it
+  asm volatile("cp.async.bulk.wait_group.read 0;" ::: "memory");
+#endif // defined(__CUDA_ARCH__) && __CUDA_ARCH__ >= 900
+}
+
+// Whether the device runs the sm_90 kernels, checked once per process
+// as each uses a single device
+inline bool is_available() {
+  static const bool available = [] {
+    if (std::getenv("DISTCONV_DISABLE_HALO_TMA")) return false;
+    int dev, major;
+    DISTCONV_CHECK_CUDA(cudaGetDevice(&dev));
+    DISTCONV_CHECK_CUDA(cudaDeviceGetAttribute(
+        &major, cudaDevAttrComputeCapabilityMajor, dev));
+    if (major < 9) return false;
+    // The kernel is empty unless built for sm_90 or later
+    cudaFuncAttributes attr;
+    DISTCONV_CHECK_CUDA(cudaFuncGetAttributes(&attr, copy_box_kernel<4>));
+    return attr.binaryVersion >= 90;
+  }();
+  return available;
+}
+
+// Encodes a map of the dense or pitched tensor of the given shape
+// with the given tile. False if the TMA cannot address it.
+template <typename DataType>
+bool encode(CUtensorMap &map, const void *buf, int nd, const Shape &shape,
+            size_t pitch, const Coords &tile) {
+  CUtensorMapDataType data_type;
+  if (!get_data_type<DataType>(data_type)) return false;
+  if (reinterpret_cast<uintptr_t>(buf) % 16 != 0) return false;
+  cuuint64_t dims[max_dims];
+  cuuint64_t strides[max_dims - 1];
+  cuuint32_t box[max_dims];
+  cuuint32_t elm_strides[max_dims];
+  size_t stride = pitch * sizeof(DataType);
+  for (int i = 0; i < nd; ++i) {
+    dims[i] = shape[i];
+    box[i] = tile.v[i];
+    elm_strides[i] = 1;
+    if (i == 0) continue;
+    if (stride % 16 != 0) return false;
+    strides[i - 1] = stride;
+    stride *= shape[i];
+  }
+  return cuTensorMapEncodeTiled(
+      &map, data_type, nd, const_cast<void*>(buf), dims, strides, box,
+      elm_strides, CU_TENSOR_MAP_INTERLEAVE_NONE,
+      CU_TENSOR_MAP_SWIZZLE_NONE, CU_TENSOR_MAP_L2_PROMOTION_L2_128B,
+      CU_TENSOR_MAP_FLOAT_OOB_FILL_NONE) == CUDA_SUCCESS;
+}
+
+} // namespace tma
+
+// Packs the halo of side to buf, or unpacks buf to it without
+// accumulation, with TMA bulk copies. Returns false without issuing
+// anything if the TMA cannot be used, in which case the caller falls
+// back to the traversal kernels.
+template <typename DataType>
+bool copy_halo_tma(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                   int dim, Side side, int width, cudaStream_t stream,
+                   void *buf, bool is_pack, bool is_reverse) {
+  const int nd = tensor.get_num_dims();
+  if ((nd != 4 && nd != 5) || !tma::is_available()) return false;
+  const auto shape = tensor.get_local_real_shape();
+  auto box_shape = shape;
+  box_shape[dim] = width;
+  // The tile is a row, rounded up to 16 bytes, and as many rows of
+  // the next dimension as fit
+  constexpr int align = 16 / sizeof(DataType) > 0 ? 16 / sizeof(DataType) : 1;
+  tma::Coords tile, num_tiles;
+  for (int i = 0; i < nd; ++i) {
+    tile.v[i] = 1;
+  }
+  tile.v[0] = std::min<int>(util::ceil<int>(box_shape[0], align) * align,
+                            256 / align * align);
+  tile.v[1] = std::min<size_t>(
+      {static_cast<size_t>(box_shape[1]), size_t(256),
+       tma::max_tile_bytes / (tile.v[0] * sizeof(DataType))});
+  // Tiles past the end of the halo would be clipped only at the end
+  // of the tensor, so they must not reach the interior
+  if (box_shape[dim] % tile.v[dim] != 0) return false;
+  size_t grid = 1;
+  for (int i = 0; i < nd; ++i) {
+    num_tiles.v[i] = util::ceil<int>(box_shape[i], tile.v[i]);
+    grid *= num_tiles.v[i];
+  }
+  if (grid > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    return false;
+  }
+  CUtensorMap tensor_map, buf_map;
+  if (!tma::encode<DataType>(tensor_map, tensor.get_const_buffer(), nd, shape,
+                             tensor.get_pitch(), tile)
+      || !tma::encode<DataType>(buf_map, buf, nd, box_shape, box_shape[0],
+                                tile)) {
+    return false;
+  }
+  // Same traversed region as pack_or_unpack
+  const bool inner = is_pack != is_reverse;
+  tma::Coords halo_origin = {}, buf_origin = {};
+  if (side == Side::RHS) {
+    halo_origin.v[dim] = shape[dim] - width * (inner ? 2 : 1);
+  } else {
+    halo_origin.v[dim] = inner ? width : 0;
+  }
+  const uint32_t tile_bytes = [&]() {
+    uint32_t b = sizeof(DataType);
+    for (int i = 0; i < nd; ++i) b *= tile.v[i];
+    return b;
+  }();
+  const auto &src = is_pack ? tensor_map : buf_map;
+  const auto &dst = is_pack ? buf_map : tensor_map;
+  const auto &src_origin = is_pack ? halo_origin : buf_origin;
+  const auto &dst_origin = is_pack ? buf_origin : halo_origin;
+  if (nd == 4) {
+    tma::copy_box_kernel<4><<<grid, 1, tile_bytes, stream>>>(
+        src, dst, src_origin, dst_origin, tile, num_tiles, tile_bytes);
+  } else {
+    tma::copy_box_kernel<5><<<grid, 1, tile_bytes, stream>>>(
+        src, dst, src_origin, dst_origin, tile, num_tiles, tile_bytes);
+  }
+  DISTCONV_CHECK_CUDA(cudaGetLastError());
+  return true;
+}
+
+#else // CUDART_VERSION >= 12000
+
+template <typename DataType>
+bool copy_halo_tma(Tensor<DataType, LocaleMPI, CUDAAllocator>& tensor,
+                   int dim, Side side, int width, cudaStream_t stream,
+                   void *buf, bool is_pack, bool is_reverse) {
+  return false;
+}
+
+#endif // CUDART_VERSION >= 12000
+
+} // namespace halo_exchange_cuda
+} // namespace tensor
+} // namespace distconv
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
+#include "distconv/tensor/runtime_gpu.hpp"
+#include "distconv/tensor/shuffle_mpi_cuda.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace distconv
+{
+namespace tensor
+{
+
+/** @brief Stages the inputs of the next mini-batches while the current
+ *  one is in use.
+ *
+ *  A producer fills the local samples of a step, laid out as the
+ *  unpitched local buffer of the sample-distributed tensor given to
+ *  the constructor, into a pinned host buffer. Producers run in the
+ *  background, up to depth steps ahead. One step ahead of its use, the
+ *  samples are copied to the device on a dedicated stream and shuffled
+ *  into the distribution of the output tensor on another, so that both
+ *  overlap the step in progress. next() hands the samples of a step to
+ *  a stream only through an event, without blocking the host on the
+ *  device.
+ *
+ *  Every rank must call next() in the same order, as the shuffles are
+ *  collective. The buffers are kept in rotation: those of a step are
+ *  refilled for the step depth ahead once the work queued on the
+ *  stream before the next call of next() is done.
+ */
+template <typename DataType>
+class InputPrefetcher
+{
+public:
+    using TensorType = Tensor<DataType, LocaleMPI, CUDAAllocator>;
+    /** @brief Fills the local samples of a step into a host buffer. */
+    using Producer = std::function<void(index_t step, DataType* buf)>;
+
+    /** @brief Prefetch into tensors of the distribution of tensor the
+     *  samples produced for sample_tensor, keeping depth steps in
+     *  rotation.
+     */
+    InputPrefetcher(const TensorType& sample_tensor,
+                    const TensorType& tensor,
+                    int depth,
+                    Producer producer)
+        : m_producer(std::move(producer)),
+          m_sample_size(sample_tensor.get_local_real_size()
+                        * sizeof(DataType)),
+          m_size(tensor.get_local_real_size() * sizeof(DataType)),
+          m_device(h2::gpu::current_gpu()),
+          m_slots(depth)
+    {
+        assert_always(depth >= 2);
+        assert_always(sample_tensor.get_shape() == tensor.get_shape());
+        if (sample_tensor.get_distribution() != tensor.get_distribution())
+        {
+            m_shuffler = std::make_unique<TensorMPICUDAShuffler<DataType>>(
+                sample_tensor, tensor);
+        }
+        m_copy_stream = h2::gpu::make_stream_nonblocking();
+        m_shuffle_stream = h2::gpu::make_stream_nonblocking();
+        auto& pinned_pool = internal::RuntimeGPU::get_pinned_memory_pool();
+        auto& device_pool = internal::RuntimeGPU::get_device_memory_pool();
+        for (auto& s : m_slots)
+        {
+            s.host_buf = static_cast<DataType*>(
+                pinned_pool.get(m_sample_size));
+            s.buf = static_cast<DataType*>(
+                device_pool.get(m_size, m_shuffle_stream));
+            if (m_shuffler)
+            {
+                s.sample_buf = static_cast<DataType*>(
+                    device_pool.get(m_sample_size, m_copy_stream));
+            }
+            s.copied = h2::gpu::make_event_notiming();
+            s.ready = h2::gpu::make_event_notiming();
+            s.consumed = h2::gpu::make_event_notiming();
+        }
+    }
+
+    InputPrefetcher(const InputPrefetcher&) = delete;
+    InputPrefetcher& operator=(const InputPrefetcher&) = delete;
+
+    ~InputPrefetcher()
+    {
+        for (auto& s : m_slots)
+        {
+            if (s.produced.valid())
+            {
+                s.produced.wait();
+            }
+            s.request.wait();
+        }
+        h2::gpu::sync(m_copy_stream);
+        h2::gpu::sync(m_shuffle_stream);
+        auto& pinned_pool = internal::RuntimeGPU::get_pinned_memory_pool();
+        auto& device_pool = internal::RuntimeGPU::get_device_memory_pool();
+        for (auto& s : m_slots)
+        {
+            h2::gpu::sync(s.consumed);
+            h2::gpu::destroy(s.copied);
+            h2::gpu::destroy(s.ready);
+            h2::gpu::destroy(s.consumed);
+            pinned_pool.release(s.host_buf);
+            device_pool.release(s.buf);
+            if (s.sample_buf != nullptr)
+            {
+                device_pool.release(s.sample_buf);
+            }
+        }
+        h2::gpu::destroy(m_copy_stream);
+        h2::gpu::destroy(m_shuffle_stream);
+    }
+
+    int get_depth() const { return static_cast<int>(m_slots.size()); }
+
+    /** @brief Start producing the steps from first_step on. */
+    void start(index_t first_step)
+    {
+        assert_always(!m_started);
+        m_started = true;
+        m_step = first_step;
+        for (int k = 0; k < get_depth(); ++k)
+        {
+            produce(first_step + k);
+        }
+        transfer(first_step);
+    }
+
+    /** @brief Make t a view of the samples of the next step, ready for
+     *  the work queued on stream from now on.
+     *
+     *  The view stays valid until the work queued on stream before the
+     *  next call is done.
+     */
+    void next(TensorType& t, h2::gpu::DeviceStream stream)
+    {
+        assert_always(m_started);
+        assert_always(t.get_local_real_size() * sizeof(DataType) == m_size);
+        if (m_has_prev)
+        {
+            DISTCONV_CHECK_GPU(
+                GPU_EVENT_RECORD(get_slot(m_step - 1).consumed, stream));
+        }
+        auto& s = get_slot(m_step);
+        s.request.wait();
+        s.request = ShuffleRequest();
+        DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(s.ready, m_shuffle_stream));
+        DISTCONV_CHECK_GPU(GPU_STREAM_WAIT_EVENT(stream, s.ready, 0));
+        View(t, s.buf);
+        m_has_prev = true;
+        // The host buffer is reused once its copy is done
+        produce(m_step + get_depth());
+        ++m_step;
+        transfer(m_step);
+    }
+
+private:
+    using ShuffleRequest = typename TensorMPICUDAShuffler<DataType>::Request;
+
+    struct Slot
+    {
+        DataType* host_buf = nullptr;
+        DataType* sample_buf = nullptr;
+        DataType* buf = nullptr;
+        h2::gpu::DeviceEvent copied;
+        h2::gpu::DeviceEvent ready;
+        h2::gpu::DeviceEvent consumed;
+        std::future<void> produced;
+        ShuffleRequest request;
+    };
+
+    Slot& get_slot(index_t step) { return m_slots[step % m_slots.size()]; }
+
+    void produce(index_t step)
+    {
+        auto& s = get_slot(step);
+        s.produced = std::async(std::launch::async, [this, &s, step]() {
+            h2::gpu::set_gpu(m_device);
+            h2::gpu::sync(s.copied);
+            m_producer(step, s.host_buf);
+        });
+    }
+
+    // Copies and shuffles the samples of step in the background. It is
+    // collective and thus issued at the same point by every rank.
+    void transfer(index_t step)
+    {
+        auto& s = get_slot(step);
+        s.produced.get();
+        // The previous use of the device buffers must be done
+        DISTCONV_CHECK_GPU(GPU_STREAM_WAIT_EVENT(m_copy_stream, s.consumed, 0));
+        DataType* dst = m_shuffler ? s.sample_buf : s.buf;
+        h2::gpu::mem_copy(dst, s.host_buf, m_sample_size, m_copy_stream);
+        DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(s.copied, m_copy_stream));
+        DISTCONV_CHECK_GPU(GPU_STREAM_WAIT_EVENT(m_shuffle_stream, s.copied, 0));
+        if (m_shuffler)
+        {
+            s.request = m_shuffler->shuffle_forward_async(
+                s.sample_buf, s.buf, m_shuffle_stream);
+        }
+    }
+
+    Producer m_producer;
+    size_t m_sample_size;
+    size_t m_size;
+    int m_device;
+    std::vector<Slot> m_slots;
+    std::unique_ptr<TensorMPICUDAShuffler<DataType>> m_shuffler;
+    h2::gpu::DeviceStream m_copy_stream;
+    h2::gpu::DeviceStream m_shuffle_stream;
+    index_t m_step = 0;
+    bool m_started = false;
+    bool m_has_prev = false;
+};
+
+} // namespace tensor
+} // namespace distconv
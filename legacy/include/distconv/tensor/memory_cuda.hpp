@@ -5,13 +5,20 @@
 #include "distconv/tensor/stream.hpp"
 #include "distconv/tensor/stream_cuda.hpp"
 #include "distconv/util/util.hpp"
+#include "distconv/util/memory_accounting.hpp"
 #include "distconv/util/util_cuda.hpp"
+#include "h2/gpu/memory_resource.hpp"
+#include "h2/gpu/memory_utils.hpp"
+#include "h2/gpu/runtime.hpp"
 #ifdef DISTCONV_HAS_NVSHMEM
 #include "distconv/util/nvshmem.hpp"
 #endif
 
 #include <cuda_runtime.h>
 
+#include <cstdlib>
+#include <cstring>
+
 #define TENSOR_CHECK_CUDA(cuda_call)                                    \
   do {                                                                  \
     const cudaError_t cuda_status = cuda_call;                          \
@@ -27,15 +34,56 @@
 namespace distconv {
 namespace tensor {
 
+// Rows of tensors allocated by CUDAAllocator are padded to a multiple
+// of this many bytes if DISTCONV_PITCHED_TENSORS is set, so that
+// vectorized kernels always find their rows aligned. Returns 0 if
+// tensors are packed.
+inline size_t get_tensor_pitch_alignment() {
+  static const size_t alignment = [] {
+    const char *env = std::getenv("DISTCONV_PITCHED_TENSORS");
+    return (env && std::strlen(env) && env[0] != '0') ? 128 : 0;
+  }();
+  return alignment;
+}
+
+// Whether tensors are allocated from the device memory resource of
+// H2. The CUB allocator rounds allocations up to its bins and caches
+// them, which costs more memory than tensors of exact sizes, so
+// tensors are only pooled with the allocators that do not.
+inline bool allocate_tensors_from_resource() {
+  static const bool b = h2::gpu::default_device_allocator().backend()
+      != h2::gpu::DeviceAllocator::Backend::CUB;
+  return b;
+}
+
+// Allocates from the device memory resource of H2 with the async or
+// reserved allocators, so tensors share their pools with the rest of
+// the library, and with cudaMalloc otherwise.
 struct CUDAAllocator {
   static void allocate(void *&p, size_t &pitch,
                        size_t size, size_t ldim)  {
-    DISTCONV_CUDA_MALLOC(&p, size);
-    pitch = ldim;
+    const size_t alignment = get_tensor_pitch_alignment();
+    pitch = (alignment && ldim) ? util::ceil(ldim, alignment) * alignment
+        : ldim;
+    const size_t real_size = ldim ? size / ldim * pitch : size;
+    if (allocate_tensors_from_resource()) {
+      p = h2::gpu::device_memory_resource().allocate(real_size, 0);
+    } else {
+      DISTCONV_CUDA_MALLOC(&p, real_size);
+    }
+    util::memory_accounting::record_allocation(p, real_size);
   }
+  // Users may free tensors still in use by other streams, which
+  // cudaFree waits for
   static void deallocate(void *p)  {
     assert_always(p != nullptr);
-    TENSOR_CHECK_CUDA(cudaFree(p));
+    util::memory_accounting::record_deallocation(p);
+    if (allocate_tensors_from_resource()) {
+      h2::gpu::sync();
+      h2::gpu::device_memory_resource().deallocate(p);
+    } else {
+      TENSOR_CHECK_CUDA(cudaFree(p));
+    }
   }
   static void copy(void *dst, const void *src,
                    size_t size, cudaStream_t stream=0) {
@@ -43,24 +91,44 @@ struct CUDAAllocator {
                                         cudaMemcpyDeviceToDevice,
                                         stream));
   }
+  // The padding of pitched rows is left untouched
   static void memset(void *p, size_t pitch, int v,
-                     size_t size, size_t,
+                     size_t size, size_t ldim,
                      cudaStream_t stream=0) {
-    TENSOR_CHECK_CUDA(cudaMemsetAsync(p, v, size, stream));
+    if (pitch == ldim) {
+      TENSOR_CHECK_CUDA(cudaMemsetAsync(p, v, size, stream));
+    } else {
+      TENSOR_CHECK_CUDA(cudaMemset2DAsync(p, pitch, v, ldim, size / ldim,
+                                          stream));
+    }
   }
   static void copyin(void *dst, const void *src,
-                     size_t size, size_t, size_t,
+                     size_t size, size_t pitch, size_t ldim,
                      cudaStream_t stream=0) {
-    TENSOR_CHECK_CUDA(cudaMemcpyAsync(dst, src, size,
-                                      cudaMemcpyHostToDevice,
-                                      stream));
+    if (pitch == ldim) {
+      TENSOR_CHECK_CUDA(cudaMemcpyAsync(dst, src, size,
+                                        cudaMemcpyHostToDevice,
+                                        stream));
+    } else {
+      TENSOR_CHECK_CUDA(cudaMemcpy2DAsync(dst, pitch, src, ldim,
+                                          ldim, size / ldim,
+                                          cudaMemcpyHostToDevice,
+                                          stream));
+    }
   }
   static void copyout(void *dst, const void *src,
-                      size_t size, size_t, size_t,
+                      size_t size, size_t pitch, size_t ldim,
                       cudaStream_t stream=0) {
-    TENSOR_CHECK_CUDA(cudaMemcpyAsync(dst, src, size,
-                                      cudaMemcpyDeviceToHost,
-                                      stream));
+    if (pitch == ldim) {
+      TENSOR_CHECK_CUDA(cudaMemcpyAsync(dst, src, size,
+                                        cudaMemcpyDeviceToHost,
+                                        stream));
+    } else {
+      TENSOR_CHECK_CUDA(cudaMemcpy2DAsync(dst, ldim, src, pitch,
+                                          ldim, size / ldim,
+                                          cudaMemcpyDeviceToHost,
+                                          stream));
+    }
     TENSOR_CHECK_CUDA(cudaStreamSynchronize(stream));
   }
 };
@@ -187,24 +255,19 @@ struct Stream<CUDAHostPooledAllocator> {
 };
 
 #ifdef DISTCONV_HAS_NVSHMEM
+// Carves symmetric buffers out of the symmetric heap, which only
+// synchronizes the PEs when it needs to grow
 struct NVSHMEMAllocator: CUDAAllocator {
   static void allocate(void *&p, size_t &pitch,
                        size_t size, size_t ldim)  {
-    //nvshmem_barrier_all();
-    p = nvshmem_malloc(size);
-    nvshmem_barrier_all();
-    if (p == nullptr) {
-      util::PrintStreamError() << "NVSHMEM allocation of " << size << " bytes ("
-                               << size / 1024.0 / 1024.0 / 1024.0 << " GiB) failed. ";
-      TENSOR_CHECK_CUDA(cudaGetLastError());
-    }
+    p = util::nvshmem::SymmetricHeap::get_instance().allocate(size);
     pitch = ldim;
+    util::memory_accounting::record_allocation(p, size, true);
   }
   static void deallocate(void *p)  {
     assert_always(p != nullptr);
-    nvshmem_barrier_all();
-    nvshmem_free(p);
-    nvshmem_barrier_all();
+    util::memory_accounting::record_deallocation(p);
+    util::nvshmem::SymmetricHeap::get_instance().deallocate(p);
   }
 };
 
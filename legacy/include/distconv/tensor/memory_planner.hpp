@@ -0,0 +1,196 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <numeric>
+#include <vector>
+
+namespace distconv
+{
+namespace tensor
+{
+
+/** @brief Places tensors with disjoint lifetimes at the same memory.
+ *
+ *  Tensors are added, instead of being allocated, with the first and
+ *  last steps of a layer sequence they are used in; forward_step() and
+ *  backward_step() number the steps of a training iteration. plan()
+ *  then assigns each tensor an offset such that tensors whose
+ *  lifetimes overlap never overlap in memory, allocates a single arena
+ *  of the resulting peak size, and makes every tensor a view of its
+ *  part of the arena. The planner owns the arena, so it must outlive
+ *  the use of the tensors.
+ */
+class MemoryPlanner
+{
+public:
+    MemoryPlanner() = default;
+    MemoryPlanner(const MemoryPlanner&) = delete;
+    MemoryPlanner& operator=(const MemoryPlanner&) = delete;
+
+    ~MemoryPlanner() { release(); }
+
+    // Step of the forward pass of layer in a sequence of num_layers
+    static int forward_step(int layer, int /*num_layers*/) { return layer; }
+
+    // Step of the backward pass of layer, which runs in reverse order
+    // after all forward steps
+    static int backward_step(int layer, int num_layers)
+    {
+        return 2 * num_layers - 1 - layer;
+    }
+
+    /** @brief Add an unallocated tensor used from first_step to
+     *  last_step, inclusive.
+     */
+    template <typename DataType, typename Allocator>
+    void add(Tensor<DataType, LocaleMPI, Allocator>& t,
+             int first_step,
+             int last_step)
+    {
+        assert_always(t.is_null());
+        assert_always(first_step <= last_step);
+        const size_t size = t.get_local_real_size() * sizeof(DataType);
+        m_entries.push_back(Entry{size,
+                                  first_step,
+                                  last_step,
+                                  0,
+                                  [&t](void* ptr) {
+                                      View(t, static_cast<DataType*>(ptr));
+                                  }});
+    }
+
+    /** @brief Assign offsets, allocate the arena and make the added
+     *  tensors views of it.
+     */
+    void plan()
+    {
+        release();
+        m_size = assign_offsets(m_entries);
+        if (m_size > 0)
+        {
+            m_block = static_cast<char*>(
+                internal::RuntimeGPU::get_device_memory_pool().get(m_size,
+                                                                   0));
+            assert_always(m_block != nullptr);
+        }
+        for (auto& e : m_entries)
+        {
+            e.set_view(e.size > 0 ? m_block + e.offset : nullptr);
+        }
+        util::MPIPrintStreamDebug()
+            << "Memory planner: " << m_entries.size() << " tensors in "
+            << m_size << " bytes instead of " << get_unplanned_size();
+    }
+
+    /** @brief Bytes of the arena; zero before plan(). */
+    size_t get_size() const { return m_size; }
+
+    /** @brief Bytes the added tensors take when allocated separately. */
+    size_t get_unplanned_size() const
+    {
+        size_t size = 0;
+        for (const auto& e : m_entries)
+        {
+            size += align(e.size);
+        }
+        return size;
+    }
+
+private:
+    struct Entry
+    {
+        size_t size;
+        int first_step;
+        int last_step;
+        size_t offset;
+        std::function<void(void*)> set_view;
+    };
+
+    static constexpr size_t m_alignment = 256;
+
+    std::vector<Entry> m_entries;
+    char* m_block = nullptr;
+    size_t m_size = 0;
+
+    static size_t align(size_t s)
+    {
+        return (s + m_alignment - 1) / m_alignment * m_alignment;
+    }
+
+    static bool live_together(const Entry& x, const Entry& y)
+    {
+        return x.first_step <= y.last_step && y.first_step <= x.last_step;
+    }
+
+    /** Greedily place the largest tensors first, each at the lowest
+     *  offset that does not overlap a placed tensor live at the same
+     *  time. Returns the peak size.
+     */
+    static size_t assign_offsets(std::vector<Entry>& entries)
+    {
+        std::vector<size_t> order(entries.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+            return entries[i].size > entries[j].size;
+        });
+        std::vector<size_t> placed;
+        size_t peak = 0;
+        for (auto i : order)
+        {
+            auto& e = entries[i];
+            // Placed tensors in conflict, sorted by offset
+            std::vector<const Entry*> conflicts;
+            for (auto j : placed)
+            {
+                if (live_together(e, entries[j]))
+                {
+                    conflicts.push_back(&entries[j]);
+                }
+            }
+            std::sort(conflicts.begin(),
+                      conflicts.end(),
+                      [](const Entry* x, const Entry* y) {
+                          return x->offset < y->offset;
+                      });
+            size_t offset = 0;
+            for (const auto* c : conflicts)
+            {
+                if (offset + align(e.size) <= c->offset)
+                {
+                    break;
+                }
+                offset = std::max(offset, c->offset + align(c->size));
+            }
+            e.offset = offset;
+            peak = std::max(peak, offset + align(e.size));
+            placed.push_back(i);
+        }
+        return peak;
+    }
+
+    void release()
+    {
+        if (m_block)
+        {
+            internal::RuntimeGPU::get_device_memory_pool().release(m_block);
+        }
+        m_block = nullptr;
+        m_size = 0;
+    }
+};
+
+} // namespace tensor
+} // namespace distconv
@@ -10,14 +10,21 @@
 #include "distconv/tensor/runtime_rocm.hpp"
 #include "distconv/tensor/stream.hpp"
 #include "distconv/tensor/stream_rocm.hpp"
+#include "distconv/util/memory_accounting.hpp"
 #include "distconv/util/util.hpp"
 #include "distconv/util/util_rocm.hpp"
+#include "h2/gpu/memory_resource.hpp"
+#include "h2/gpu/memory_utils.hpp"
+#include "h2/gpu/runtime.hpp"
 #ifdef DISTCONV_HAS_NVSHMEM
 #include "distconv/util/nvshmem.hpp"
 #endif
 
 #include <hip/hip_runtime.h>
 
+#include <cstdlib>
+#include <cstring>
+
 #define TENSOR_CHECK_HIP(hip_call) DISTCONV_CHECK_HIP(hip_call)
 
 namespace distconv
@@ -25,52 +32,111 @@ namespace distconv
 namespace tensor
 {
 
+// Rows of tensors allocated by CUDAAllocator are padded to a multiple
+// of this many bytes if DISTCONV_PITCHED_TENSORS is set, so that
+// vectorized kernels always find their rows aligned. Returns 0 if
+// tensors are packed.
+inline size_t get_tensor_pitch_alignment()
+{
+    static size_t const alignment = [] {
+        char const* env = std::getenv("DISTCONV_PITCHED_TENSORS");
+        return (env && std::strlen(env) && env[0] != '0') ? 128 : 0;
+    }();
+    return alignment;
+}
+
+// Whether tensors are allocated from the device memory resource of
+// H2. The CUB allocator rounds allocations up to its bins and caches
+// them, which costs more memory than tensors of exact sizes, so
+// tensors are only pooled with the allocators that do not.
+inline bool allocate_tensors_from_resource()
+{
+    static bool const b = h2::gpu::default_device_allocator().backend()
+                          != h2::gpu::DeviceAllocator::Backend::CUB;
+    return b;
+}
+
 // I'm not changing any of the struct names at this time. These are
 // being rewritten anyway, but this saves me having to add a bunch of
 // typedefs all over.
+//
+// Allocates from the device memory resource of H2 with the async or
+// reserved allocators, so tensors share their pools with the rest of
+// the library, and with hipMalloc otherwise.
 struct CUDAAllocator
 {
     static void allocate(void*& p, size_t& pitch, size_t size, size_t ldim)
     {
-        DISTCONV_HIP_MALLOC(&p, size);
-        pitch = ldim;
+        size_t const alignment = get_tensor_pitch_alignment();
+        pitch = (alignment && ldim) ? util::ceil(ldim, alignment) * alignment
+                                    : ldim;
+        size_t const real_size = ldim ? size / ldim * pitch : size;
+        if (allocate_tensors_from_resource())
+            p = h2::gpu::device_memory_resource().allocate(real_size, 0);
+        else
+            DISTCONV_HIP_MALLOC(&p, real_size);
+        util::memory_accounting::record_allocation(p, real_size);
     }
+    // Users may free tensors still in use by other streams, which
+    // hipFree waits for.
     static void deallocate(void* p)
     {
         assert_always(p != nullptr);
-        TENSOR_CHECK_HIP(hipFree(p));
+        util::memory_accounting::record_deallocation(p);
+        if (allocate_tensors_from_resource())
+        {
+            h2::gpu::sync();
+            h2::gpu::device_memory_resource().deallocate(p);
+        }
+        else
+        {
+            TENSOR_CHECK_HIP(hipFree(p));
+        }
     }
     static void
     copy(void* dst, const void* src, size_t size, hipStream_t stream = 0)
     {
         h2::gpu::mem_copy(dst, src, size, stream);
     }
+    // The padding of pitched rows is left untouched.
     static void memset(void* p,
                        size_t pitch,
                        int v,
                        size_t size,
-                       size_t,
+                       size_t ldim,
                        hipStream_t stream = 0)
     {
-        TENSOR_CHECK_HIP(hipMemsetAsync(p, v, size, stream));
+        if (pitch == ldim)
+            TENSOR_CHECK_HIP(hipMemsetAsync(p, v, size, stream));
+        else
+            TENSOR_CHECK_HIP(
+                hipMemset2DAsync(p, pitch, v, ldim, size / ldim, stream));
     }
     static void copyin(void* dst,
                        const void* src,
                        size_t size,
-                       size_t,
-                       size_t,
+                       size_t pitch,
+                       size_t ldim,
                        hipStream_t stream = 0)
     {
-        h2::gpu::mem_copy(dst, src, size, stream);
+        if (pitch == ldim)
+            h2::gpu::mem_copy(dst, src, size, stream);
+        else
+            h2::gpu::mem_copy_2d(
+                dst, pitch, src, ldim, ldim, size / ldim, stream);
     }
     static void copyout(void* dst,
                         const void* src,
                         size_t size,
-                        size_t,
-                        size_t,
+                        size_t pitch,
+                        size_t ldim,
                         hipStream_t stream = 0)
     {
-        h2::gpu::mem_copy(dst, src, size, stream);
+        if (pitch == ldim)
+            h2::gpu::mem_copy(dst, src, size, stream);
+        else
+            h2::gpu::mem_copy_2d(
+                dst, ldim, src, pitch, ldim, size / ldim, stream);
         h2::gpu::sync(stream);
     }
 };
@@ -211,32 +277,21 @@ struct Stream<CUDAHostPooledAllocator>
     static constexpr type default_value = 0;
 };
 
-// This won't ever be enabled in ROCm-land. However, one of these
-// years we might get HIP-SHMEM up and running. So I'll leave it in
-// case it's ever useful.
+// Backed by rocSHMEM
 #ifdef DISTCONV_HAS_NVSHMEM
 struct NVSHMEMAllocator : HIPAllocator
 {
     static void allocate(void*& p, size_t& pitch, size_t size, size_t ldim)
     {
-        // nvshmem_barrier_all();
-        p = nvshmem_malloc(size);
-        nvshmem_barrier_all();
-        if (p == nullptr)
-        {
-            util::PrintStreamError()
-                << "NVSHMEM allocation of " << size << " bytes ("
-                << size / 1024.0 / 1024.0 / 1024.0 << " GiB) failed. ";
-            TENSOR_CHECK_HIP(hipGetLastError());
-        }
+        p = util::nvshmem::SymmetricHeap::get_instance().allocate(size);
         pitch = ldim;
+        util::memory_accounting::record_allocation(p, size, true);
     }
     static void deallocate(void* p)
     {
         assert_always(p != nullptr);
-        nvshmem_barrier_all();
-        nvshmem_free(p);
-        nvshmem_barrier_all();
+        util::memory_accounting::record_deallocation(p);
+        util::nvshmem::SymmetricHeap::get_instance().deallocate(p);
     }
 };
 
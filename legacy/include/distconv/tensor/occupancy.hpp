@@ -0,0 +1,182 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/tensor/tensor_base.hpp"
+#include "distconv/util/util.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+/*
+  Occupancy of the local tile of a tensor, for skipping work over the
+  empty parts of mostly-zero data such as volumes with a large
+  background.
+
+  The tile is divided into blocks of a fixed spatial shape, each
+  spanning all the channels of a sample, and a bitmap records the
+  blocks with a nonzero element. It is computed in a single pass by
+  compute_occupancy (occupancy_cuda.hpp) before the tensor is used.
+  Given the occupancy of their input, halo exchanges send a flag
+  instead of halos that are all zeros, and convolutions and poolings
+  skip tiles that are empty including their halos. Blocks are the
+  unit of the bitmap only: the libraries run on whole tiles, so the
+  work of a process is skipped when all its blocks are empty.
+
+  The blocks examined, the operations skipped and the halo bytes not
+  sent are counted in OccupancyStats.
+ */
+
+namespace distconv {
+namespace tensor {
+
+struct OccupancyStats {
+  size_t num_blocks = 0;
+  size_t num_empty_blocks = 0;
+  size_t num_ops = 0;
+  size_t num_skipped_ops = 0;
+  size_t halo_bytes = 0;
+  size_t skipped_halo_bytes = 0;
+
+  static double get_fraction(size_t part, size_t total) {
+    return total == 0 ? 0.0 : static_cast<double>(part) / total;
+  }
+  double get_empty_fraction() const {
+    return get_fraction(num_empty_blocks, num_blocks);
+  }
+  double get_skipped_op_fraction() const {
+    return get_fraction(num_skipped_ops, num_ops);
+  }
+  double get_skipped_halo_fraction() const {
+    return get_fraction(skipped_halo_bytes, halo_bytes);
+  }
+
+  void clear() { *this = OccupancyStats(); }
+
+  /** Counts the process-wide operations and halos. */
+  static OccupancyStats &get_instance() {
+    static OccupancyStats stats;
+    return stats;
+  }
+};
+
+inline std::ostream &operator<<(std::ostream &os,
+                                const OccupancyStats &stats) {
+  return os << "empty blocks: " << stats.num_empty_blocks << "/"
+            << stats.num_blocks << " (" << stats.get_empty_fraction()
+            << "), skipped operations: " << stats.num_skipped_ops << "/"
+            << stats.num_ops << " (" << stats.get_skipped_op_fraction()
+            << "), skipped halo bytes: " << stats.skipped_halo_bytes << "/"
+            << stats.halo_bytes << " ("
+            << stats.get_skipped_halo_fraction() << ")";
+}
+
+class Occupancy {
+ public:
+  /**
+     block_shape holds the extents of the blocks in the spatial
+     dimensions, from the innermost.
+   */
+  explicit Occupancy(const IntVector &block_shape):
+      m_block_shape(block_shape) {
+    assert_always(std::all_of(m_block_shape.begin(), m_block_shape.end(),
+                              [](int b) { return b > 0; }));
+  }
+
+  const IntVector &get_block_shape() const { return m_block_shape; }
+
+  /** Shape of the tile of the bitmap. */
+  const Shape &get_local_shape() const { return m_local_shape; }
+
+  /**
+     Shape of the bitmap of a tile of local_shape: the blocks of each
+     spatial dimension, then the samples.
+   */
+  Shape get_grid_shape(const Shape &local_shape) const {
+    const int num_spatial_dims = local_shape.num_dims() - 2;
+    assert_eq(num_spatial_dims, m_block_shape.length());
+    Shape grid(num_spatial_dims + 1, 1);
+    for (int i = 0; i < num_spatial_dims; ++i) {
+      grid[i] = util::ceil<index_t>(local_shape[i], m_block_shape[i]);
+    }
+    grid[num_spatial_dims] = local_shape[-1];
+    return grid;
+  }
+
+  /**
+     Sets the bitmap of a tile of local_shape, with a nonzero entry per
+     occupied block in the order of get_grid_shape.
+   */
+  void set(const Shape &local_shape, std::vector<unsigned char> bitmap) {
+    m_local_shape = local_shape;
+    m_grid_shape = get_grid_shape(local_shape);
+    assert_eq(bitmap.size(), m_grid_shape.size());
+    m_bitmap = std::move(bitmap);
+    m_num_empty = std::count(m_bitmap.begin(), m_bitmap.end(), 0);
+    auto &stats = OccupancyStats::get_instance();
+    stats.num_blocks += m_bitmap.size();
+    stats.num_empty_blocks += m_num_empty;
+  }
+
+  /** Whether a bitmap is set. */
+  bool is_valid() const { return !m_bitmap.empty(); }
+
+  size_t get_num_blocks() const { return m_bitmap.size(); }
+  size_t get_num_empty_blocks() const { return m_num_empty; }
+
+  /** Whether the whole tile is zero. */
+  bool is_empty() const {
+    return is_valid() && m_num_empty == m_bitmap.size();
+  }
+
+  /**
+     Whether the region of shape at offset, in the local coordinates of
+     the tile, is zero. The channel dimension is ignored.
+   */
+  bool is_empty(const IndexVector &offset, const Shape &shape) const {
+    if (!is_valid()) return false;
+    if (is_empty()) return true;
+    const int nd = m_local_shape.num_dims();
+    // Bounds of the blocks overlapping the region
+    std::vector<index_t> first(nd - 1), last(nd - 1);
+    for (int i = 0; i < nd - 2; ++i) {
+      if (shape[i] == 0) return true;
+      first[i] = offset[i] / m_block_shape[i];
+      last[i] = (offset[i] + shape[i] - 1) / m_block_shape[i];
+    }
+    if (shape[-1] == 0) return true;
+    first[nd - 2] = offset[-1];
+    last[nd - 2] = offset[-1] + shape[-1] - 1;
+    std::vector<index_t> idx(first);
+    while (true) {
+      index_t pos = 0;
+      index_t stride = 1;
+      for (int i = 0; i < nd - 1; ++i) {
+        pos += idx[i] * stride;
+        stride *= m_grid_shape[i];
+      }
+      if (m_bitmap[pos]) return false;
+      int i = 0;
+      for (; i < nd - 1; ++i) {
+        if (idx[i] < last[i]) {
+          ++idx[i];
+          break;
+        }
+        idx[i] = first[i];
+      }
+      if (i == nd - 1) return true;
+    }
+  }
+
+ private:
+  IntVector m_block_shape;
+  Shape m_local_shape;
+  Shape m_grid_shape;
+  std::vector<unsigned char> m_bitmap;
+  size_t m_num_empty = 0;
+};
+
+} // namespace tensor
+} // namespace distconv
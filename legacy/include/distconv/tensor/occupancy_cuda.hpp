@@ -0,0 +1,111 @@
+#pragma once
+
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
+#include "distconv/tensor/occupancy.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+#include "h2/gpu/memory_utils.hpp"
+#include "h2/gpu/runtime.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace distconv {
+namespace tensor {
+namespace occupancy_cuda {
+
+// Marks the blocks holding a nonzero element of the local tile. All
+// the writes to an entry store the same value, so no atomics are
+// needed.
+template <int ND, typename DataType>
+__global__ void occupancy_kernel(const DataType *buf,
+                                 Array<ND> shape,
+                                 Array<ND> strides,
+                                 Array<ND> block_shape,
+                                 Array<ND> grid_strides,
+                                 size_t size,
+                                 unsigned char *bitmap) {
+  for (size_t i = threadIdx.x + blockIdx.x * (size_t) blockDim.x; i < size;
+       i += (size_t) blockDim.x * gridDim.x) {
+    size_t rem = i;
+    index_t offset = 0;
+    index_t pos = 0;
+#pragma unroll
+    for (int d = 0; d < ND; ++d) {
+      const index_t idx = rem % shape[d];
+      rem /= shape[d];
+      offset += idx * strides[d];
+      // The channel dimension is not blocked
+      if (d != ND - 2) pos += idx / block_shape[d] * grid_strides[d];
+    }
+    if (buf[offset] != DataType(0)) bitmap[pos] = 1;
+  }
+}
+
+} // namespace occupancy_cuda
+
+/**
+   Computes the occupancy of the local tile of tensor, excluding its
+   halos, on stream. Waits for the bitmap.
+ */
+template <typename DataType>
+void compute_occupancy(const Tensor<DataType, LocaleMPI, CUDAAllocator> &tensor,
+                       Occupancy &occupancy,
+                       h2::gpu::DeviceStream stream) {
+  const auto local_shape = tensor.get_local_shape();
+  const auto grid_shape = occupancy.get_grid_shape(local_shape);
+  const int nd = tensor.get_num_dims();
+  std::vector<unsigned char> bitmap(grid_shape.size(), 0);
+  if (bitmap.empty()) {
+    occupancy.set(local_shape, std::move(bitmap));
+    return;
+  }
+  // Blocks of the spatial dimensions, one of the channels and the
+  // samples
+  IndexVector block(nd, 1);
+  IndexVector grid_strides(nd, 0);
+  index_t stride = 1;
+  for (int i = 0; i < nd; ++i) {
+    if (i == nd - 2) continue;
+    const int g = i == nd - 1 ? nd - 2 : i;
+    if (i < nd - 2) block[i] = occupancy.get_block_shape()[i];
+    grid_strides[i] = stride;
+    stride *= grid_shape[g];
+  }
+
+  auto &pool = internal::RuntimeGPU::get_device_memory_pool();
+  auto *dev_bitmap = static_cast<unsigned char*>(
+      pool.get(bitmap.size(), stream));
+  h2::gpu::mem_zero(dev_bitmap, bitmap.size(), stream);
+  const size_t size = local_shape.size();
+  constexpr int block_size = 256;
+  const int grid_size = std::min<size_t>(
+      util::ceil(size, (size_t) block_size), 65535);
+#define CALL_KERNEL(ND)                                                 \
+  occupancy_cuda::occupancy_kernel<ND, DataType>                        \
+      <<<grid_size, block_size, 0, stream>>>(                           \
+          tensor.get_const_base_ptr(), Array<ND>(local_shape),          \
+          Array<ND>(tensor.get_strides()), Array<ND>(block),            \
+          Array<ND>(grid_strides), size, dev_bitmap)
+  switch (nd) {
+    case 3: CALL_KERNEL(3); break;
+    case 4: CALL_KERNEL(4); break;
+    case 5: CALL_KERNEL(5); break;
+    case 6: CALL_KERNEL(6); break;
+    default:
+      util::MPIPrintStreamError()
+          << "Occupancy of " << nd << "-dimensional tensors not supported";
+      throw std::exception();
+  }
+#undef CALL_KERNEL
+  h2::gpu::mem_copy(bitmap.data(), dev_bitmap, bitmap.size(), stream);
+  h2::gpu::sync(stream);
+  pool.release(dev_bitmap);
+  occupancy.set(local_shape, std::move(bitmap));
+}
+
+} // namespace tensor
+} // namespace distconv
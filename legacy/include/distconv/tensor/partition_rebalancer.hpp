@@ -0,0 +1,176 @@
+#pragma once
+
+#include "distconv/base.hpp"
+#include "distconv/tensor/distribution.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+namespace distconv {
+namespace tensor {
+
+/**
+   Moves the partition boundaries of a spatial dimension so that each
+   split takes about the same time.
+
+   The time of a split is that of its slowest rank. Each split is given
+   a share of the dimension proportional to its measured throughput,
+   i.e., its current size over its time, so ranks on slower devices or
+   with costlier tiles get fewer elements. The boundaries move only
+   part of the way to the estimate each time to damp measurement
+   noise, and not at all when the splits are already within the
+   tolerance of each other.
+
+   The new partition takes effect on the tensors created with the
+   updated distribution, so rebalance between epochs and recreate the
+   tensors and layers afterwards.
+ */
+class PartitionRebalancer {
+ public:
+  /**
+     @param dim a tensor dimension
+     @param min_size the minimum size of a split, which must be at
+     least the halo width of the tensors of the distribution
+     @param damping the fraction of the way to the estimated balanced
+     partition moved each time
+     @param tolerance the relative imbalance of the split times below
+     which the partition is kept as is
+   */
+  PartitionRebalancer(int dim, index_t min_size,
+                      double damping=0.5, double tolerance=0.05):
+      m_dim(dim), m_min_size(std::max(min_size, index_t(1))),
+      m_damping(damping), m_tolerance(tolerance) {
+    assert_always(damping > 0 && damping <= 1);
+  }
+
+  /**
+     Updates the partition of dist with the time the local rank took
+     for the layers of tensor. Collective over the locale of tensor.
+
+     @return true if the partition is changed.
+   */
+  template <typename DataType, typename Allocator>
+  bool rebalance(const Tensor<DataType, LocaleMPI, Allocator> &tensor,
+                 double local_time, Distribution &dist) const {
+    const int dim = m_dim < 0 ? tensor.get_num_dims() + m_dim : m_dim;
+    const auto &tensor_dist = tensor.get_distribution();
+    if (!tensor_dist.is_distributed(dim)) return false;
+    const int num_splits = tensor_dist.get_split_shape()[dim];
+    const index_t ranks_per_split = tensor_dist.get_num_ranks_per_split(dim);
+
+    // Time of each split: the maximum over its ranks
+    std::vector<double> times(num_splits, 0.0);
+    times[tensor.get_split_index()[dim]] = local_time;
+    DISTCONV_CHECK_MPI(MPI_Allreduce(
+        MPI_IN_PLACE, times.data(), num_splits, MPI_DOUBLE, MPI_MAX,
+        tensor.get_locale().get_comm()));
+
+    std::vector<index_t> sizes(num_splits);
+    for (int i = 0; i < num_splits; ++i) {
+      sizes[i] = tensor.get_remote_dimension(dim, i * ranks_per_split);
+    }
+
+    const double max_time = *std::max_element(times.begin(), times.end());
+    const double mean_time =
+        std::accumulate(times.begin(), times.end(), 0.0) / num_splits;
+    if (mean_time <= 0 || max_time <= mean_time * (1 + m_tolerance)) {
+      return false;
+    }
+
+    const auto new_sizes = get_balanced_sizes(sizes, times);
+    util::MPIRootPrintStreamInfo()
+        << "Rebalancing dimension " << dim << " from "
+        << util::tostring(sizes.begin(), sizes.end()) << " to "
+        << util::tostring(new_sizes.begin(), new_sizes.end())
+        << ", split times: "
+        << util::tostring(times.begin(), times.end());
+    if (new_sizes == sizes) return false;
+    dist.set_partition(dim, new_sizes);
+    return true;
+  }
+
+  /**
+     Sizes proportional to the throughput of each split, moved by
+     the damping factor from sizes and rounded so that they add up to
+     the same total. Splits with no measured time keep their sizes.
+   */
+  std::vector<index_t> get_balanced_sizes(
+      const std::vector<index_t> &sizes,
+      const std::vector<double> &times) const {
+    const int n = sizes.size();
+    const index_t total = std::accumulate(sizes.begin(), sizes.end(),
+                                          index_t(0));
+    assert_always(total >= m_min_size * n);
+    std::vector<double> rates(n);
+    for (int i = 0; i < n; ++i) {
+      rates[i] = times[i] > 0 ? sizes[i] / times[i] : 0;
+    }
+    const double total_rate = std::accumulate(rates.begin(), rates.end(), 0.0);
+    std::vector<double> target(n);
+    for (int i = 0; i < n; ++i) {
+      const double balanced = times[i] > 0 && total_rate > 0 ?
+          total * rates[i] / total_rate : sizes[i];
+      target[i] = sizes[i] + m_damping * (balanced - sizes[i]);
+    }
+
+    // Raise the splits below the minimum and take the difference from
+    // the others in proportion to their sizes until none is below it
+    std::vector<bool> fixed(n, false);
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      double free_total = 0;
+      double free_target = 0;
+      for (int i = 0; i < n; ++i) {
+        if (fixed[i]) {
+          target[i] = m_min_size;
+        } else {
+          free_target += target[i];
+        }
+        free_total += fixed[i] ? 0 : 1;
+      }
+      const double remaining = total - m_min_size * (n - free_total);
+      for (int i = 0; i < n; ++i) {
+        if (fixed[i]) continue;
+        target[i] *= remaining / free_target;
+        if (target[i] < m_min_size) {
+          fixed[i] = true;
+          changed = true;
+        }
+      }
+    }
+
+    // Round down and give the remainder to the largest fractions
+    std::vector<index_t> new_sizes(n);
+    std::vector<int> order(n);
+    index_t assigned = 0;
+    for (int i = 0; i < n; ++i) {
+      new_sizes[i] = std::max(static_cast<index_t>(std::floor(target[i])),
+                              m_min_size);
+      assigned += new_sizes[i];
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+      return target[a] - std::floor(target[a]) >
+          target[b] - std::floor(target[b]);
+    });
+    for (int i = 0; assigned < total; i = (i + 1) % n) {
+      ++new_sizes[order[i]];
+      ++assigned;
+    }
+    return new_sizes;
+  }
+
+ private:
+  int m_dim;
+  index_t m_min_size;
+  double m_damping;
+  double m_tolerance;
+};
+
+} // namespace tensor
+} // namespace distconv
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "distconv/tensor/distribution.hpp"
+#include "distconv/tensor/shuffle_mpi_cuda.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace distconv {
+namespace tensor {
+
+/**
+   Moves live tensors to a new process grid without restarting.
+
+   Tensors are registered with the distribution to move them to, e.g.,
+   one with a different split shape, or the partition computed by
+   PartitionRebalancer. run() allocates the new tensors, starts the
+   shuffles of all of them before waiting for any, so that the
+   transfers of the whole model overlap as one exchange, and then
+   replaces the registered tensors with the new ones. Replicated
+   tensors such as filters move in the same way. The interiors are
+   moved; halos are zero until exchanged again.
+
+   Layers hold halo exchangers, connections and algorithms chosen for
+   the old shapes, so they must be set up again with the new tensors.
+   The rebuild functions run after the tensors are moved, in
+   registration order, e.g., to call setup of each layer. The
+   algorithms are then found in the cache of the backend, which
+   persists across setups, and only new local shapes are searched.
+
+   The new distributions must be over the locales of the tensors,
+   since the shuffles are planned within one communicator. A resized
+   job thus re-decomposes on a communicator spanning the processes of
+   both grids.
+ */
+template <typename DataType>
+class Redecomposition {
+ public:
+  using TensorType = Tensor<DataType, LocaleMPI, CUDAAllocator>;
+  using ShufflerType = TensorMPICUDAShuffler<DataType>;
+  using RebuildFunc = std::function<void()>;
+
+  Redecomposition() = default;
+  Redecomposition(const Redecomposition &) = delete;
+  Redecomposition &operator=(const Redecomposition &) = delete;
+
+  // Moves tensor to dist at the next run. Tensors sharing memory must
+  // be registered only once. The tensor must stay alive until then.
+  void add(TensorType &tensor, const Distribution &dist) {
+    assert_eq(tensor.get_num_dims(), dist.num_dims());
+    m_entries.push_back(Entry{&tensor, dist});
+  }
+
+  // Called after the tensors are moved at each run
+  void add_rebuild(RebuildFunc f) {
+    m_rebuilds.push_back(std::move(f));
+  }
+
+  int get_num_tensors() const {
+    return m_entries.size();
+  }
+
+  // Moves the registered tensors, which are then unregistered, and
+  // rebuilds. Collective over the locales of the tensors, which must
+  // be registered in the same order on all processes.
+  void run(h2::gpu::DeviceStream stream) {
+    std::vector<TensorType> new_tensors;
+    new_tensors.reserve(m_entries.size());
+    std::vector<std::unique_ptr<ShufflerType>> shufflers;
+    std::vector<typename ShufflerType::Request> requests;
+    for (auto &e: m_entries) {
+      const auto &src = *e.tensor;
+      new_tensors.emplace_back(src.get_shape(), src.get_locale(), e.dist);
+      auto &dst = new_tensors.back();
+      dst.set_layout(src.get_layout());
+      assert0(dst.allocate());
+      dst.zero(stream);
+      util::MPIPrintStreamDebug() << "Redecomposing " << src << " to " << dst;
+      shufflers.emplace_back(new ShufflerType(src, dst));
+      requests.push_back(shufflers.back()->shuffle_forward_async(
+          src.get_const_base_ptr(), dst.get_base_ptr(), stream));
+    }
+    for (auto &r: requests) {
+      r.wait();
+    }
+    // The old memory may be released only after the shuffles
+    h2::gpu::sync(stream);
+    shufflers.clear();
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+      *m_entries[i].tensor = new_tensors[i];
+    }
+    m_entries.clear();
+    for (auto &f: m_rebuilds) {
+      f();
+    }
+  }
+
+ protected:
+  struct Entry {
+    TensorType *tensor;
+    Distribution dist;
+  };
+  std::vector<Entry> m_entries;
+  std::vector<RebuildFunc> m_rebuilds;
+};
+
+} // namespace tensor
+} // namespace distconv
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "distconv/tensor/tensor_base.hpp"
+
+#include <cstdint>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+
+/*
+  Traversal of a region of a strided tensor for the kernels that
+  visit its elements independently, e.g. to copy, pack or transform
+  them. A region is set up on the host, decomposes the linear offsets
+  of its elements into indices with FastDiv, and may be traversed by
+  vectors of consecutive elements along the first dimension.
+ */
+
+namespace distconv {
+namespace tensor {
+
+// VW consecutive elements, accessed with a single load or store of up
+// to 16 bytes
+template <typename DataType, int VW>
+struct alignas(sizeof(DataType) * VW) ElementVector {
+  DataType v[VW];
+};
+
+// The widest vector of DataType that is accessed at once
+template <typename DataType>
+constexpr int max_vector_width() {
+  return sizeof(DataType) < 16 ? 16 / sizeof(DataType) : 1;
+}
+
+/**
+   A region of a tensor visited by vectors of VW elements in the order
+   of their linear offset in the region, the first dimension fastest.
+   The extent of the region along the first dimension must be a
+   multiple of VW, and its elements must be contiguous along it.
+
+   IType bounds the number of vectors; use uint64_t when it may exceed
+   32 bits.
+ */
+template <int ND, int VW=1, typename IType=uint32_t>
+class RegionTraversal {
+ public:
+  static constexpr int num_dims = ND;
+  static constexpr int vector_width = VW;
+  using index_type = IType;
+
+  RegionTraversal() = default;
+  /**
+     shape is the shape of the region and strides are those of the
+     tensor, both in elements.
+   */
+  template <typename ShapeType, typename StridesType>
+  RegionTraversal(const ShapeType &shape, const StridesType &strides):
+      m_shape(vector_shape(shape)), m_strides(strides) {
+    assert_always(shape[0] % VW == 0);
+    assert_always(VW == 1 || strides[0] == 1);
+  }
+
+  // The number of vectors
+  TENSOR_FUNC_DECL IType get_size() const {
+    return m_shape.get_size();
+  }
+
+  // Index in the region of the first element of the i-th vector
+  TENSOR_FUNC_DECL Array<ND> get_index(IType i) const {
+    Array<ND> idx;
+#pragma unroll
+    for (int d = 0; d < ND; ++d) {
+      idx[d] = m_shape.divmod(d, i);
+    }
+    idx[0] *= VW;
+    return idx;
+  }
+
+  // Offset in the tensor of the element at idx
+  TENSOR_FUNC_DECL size_t get_offset(const Array<ND> &idx) const {
+    size_t offset = 0;
+#pragma unroll
+    for (int d = 0; d < ND; ++d) {
+      offset += idx[d] * m_strides[d];
+    }
+    return offset;
+  }
+
+  // Offset in the tensor of the first element of the i-th vector
+  TENSOR_FUNC_DECL size_t get_offset(IType i) const {
+    return get_offset(get_index(i));
+  }
+
+  TENSOR_FUNC_DECL const Array<ND> &get_strides() const {
+    return m_strides;
+  }
+
+ private:
+  template <typename ShapeType>
+  static Array<ND> vector_shape(const ShapeType &shape) {
+    Array<ND> s;
+    for (int d = 0; d < ND; ++d) {
+      s[d] = shape[d];
+    }
+    s[0] /= VW;
+    return s;
+  }
+
+  FastDivShape<ND, IType> m_shape;
+  Array<ND> m_strides;
+};
+
+/**
+   The widest vector of DataType, up to max_vector_width, by which a
+   region of shape and strides can be traversed, given the pointers to
+   the first element of the region in every tensor accessed by vector.
+ */
+template <typename DataType>
+int get_region_vector_width(const Shape &shape, const IndexVector &strides,
+                            std::initializer_list<const void*> ptrs) {
+  if (strides[0] != 1) return 1;
+  for (int vw = max_vector_width<DataType>(); vw > 1; vw /= 2) {
+    bool ok = shape[0] % vw == 0;
+    for (int d = 1; d < shape.num_dims() && ok; ++d) {
+      ok = strides[d] % vw == 0;
+    }
+    for (const void *p: ptrs) {
+      ok = ok && reinterpret_cast<uintptr_t>(p) % (sizeof(DataType) * vw) == 0;
+    }
+    if (ok) return vw;
+  }
+  return 1;
+}
+
+/**
+   Calls f(std::integral_constant<int, VW>()) with vw, a power of two
+   no larger than MAX_VW, as VW.
+ */
+template <int MAX_VW, typename F>
+void dispatch_vector_width(int vw, F &&f) {
+  if constexpr (MAX_VW > 1) {
+    if (vw >= MAX_VW) {
+      f(std::integral_constant<int, MAX_VW>());
+      return;
+    }
+    dispatch_vector_width<MAX_VW / 2>(vw, std::forward<F>(f));
+  } else {
+    f(std::integral_constant<int, 1>());
+  }
+}
+
+#if defined(__CUDACC__) || __HIP__
+/**
+   Calls f(i) for each vector i of a region, spread over the threads of
+   the grid. Each thread takes TILE vectors at a time, spaced by the
+   block size so that the threads of a warp access consecutive vectors.
+ */
+template <int TILE=1, typename Traversal, typename F>
+__device__ __forceinline__ void for_each_in_region(const Traversal &region,
+                                                   F &&f) {
+  using IType = typename Traversal::index_type;
+  const IType size = region.get_size();
+  const IType step = (IType)blockDim.x * gridDim.x * TILE;
+  for (IType base = (IType)blockIdx.x * blockDim.x * TILE + threadIdx.x;
+       base < size; base += step) {
+#pragma unroll
+    for (int t = 0; t < TILE; ++t) {
+      const IType i = base + (IType)t * blockDim.x;
+      if (i < size) {
+        f(i);
+      }
+    }
+  }
+}
+#endif
+
+} // namespace tensor
+} // namespace distconv
@@ -1,24 +1,76 @@
 #pragma once
 
-#include <tuple>
+#include "distconv/util/free_list.hpp"
+
+#include <atomic>
+#include <cstdint>
 #include <list>
+#include <mutex>
+#include <tuple>
+#include <vector>
 
 namespace distconv {
 namespace tensor {
 namespace internal {
 
 // REFACTORING: Move this class to distconv::RuntimeCUDA
+/*
+  Pool of pinned host memory, also used by p2p. Chunks are binned into
+  size classes, four per power of two, and freed chunks of each class
+  are kept in a lock-free free list. get and release do not block
+  unless a new chunk needs to be allocated. Each chunk has a header
+  recording its class, so release does not search the chunks.
+ */
 class PinnedMemoryPool {
  public:
+  struct Stats {
+    // Number of get calls and of those served by a freed chunk
+    size_t num_gets = 0;
+    size_t num_hits = 0;
+    size_t num_chunks = 0;
+    size_t num_in_use = 0;
+    size_t allocated_bytes = 0;
+    // Bin sizes of the chunks in use and their maximum
+    size_t bytes_in_use = 0;
+    size_t peak_bytes_in_use = 0;
+  };
+
   PinnedMemoryPool();
   ~PinnedMemoryPool();
   void *get(size_t size);
   void release(void *p);
+  Stats get_stats() const;
 
  protected:
-  using chunk_t = std::tuple<void*, size_t, bool>;
-  std::list<chunk_t> m_chunks;
-
+  using free_list_t = util::FreeList<void*>;
+  struct Header {
+    uint32_t magic;
+    uint32_t bin;
+  };
+  // Keeps the alignment of cudaMallocHost
+  static constexpr size_t m_header_size = 256;
+  static constexpr uint32_t m_magic = 0x504d504c;
+  static constexpr int m_min_bin_shift = 8;
+  static constexpr int m_num_bins = 4 * (48 - m_min_bin_shift) + 1;
+  static constexpr uint32_t m_bin_capacity = 1024;
+
+  // Created at the first use
+  std::atomic<free_list_t*> m_bins[m_num_bins];
+  std::atomic<size_t> m_num_gets;
+  std::atomic<size_t> m_num_hits;
+  std::atomic<size_t> m_num_in_use;
+  std::atomic<size_t> m_bytes_in_use;
+  std::atomic<size_t> m_peak_bytes_in_use;
+  // Slow path
+  mutable std::mutex m_mutex;
+  std::vector<void*> m_chunks;
+  size_t m_allocated_bytes;
+
+  static int find_bin(size_t size);
+  static size_t get_bin_size(int bin);
+  free_list_t &get_bin(int bin);
+  void *allocate_chunk(int bin);
+  void deallocate_chunk(void *chunk);
   void deallocate_all_chunks();
 };
 
@@ -8,6 +8,9 @@
 #include <algorithm>
 #include <cstring>
 
+#define CALC_OFFSET3(i0, i1, i2, strides)                               \
+  ((i0) * strides[0] + (i1) * strides[1] + (i2) * strides[2])
+
 #define CALC_OFFSET4(i0, i1, i2, i3, strides)                           \
   ((i0) * strides[0] + (i1) * strides[1] + (i2) * strides[2] +          \
    (i3) * strides[3])
@@ -43,6 +46,8 @@ class TensorMPIShuffleHelper {
       m_src_buf(src_buf), m_dst_buf(dst_buf),
       m_src_buf_passed(src_buf != nullptr),
       m_dst_buf_passed(dst_buf != nullptr) {
+    // Shuffling does not transpose
+    assert_always(src_tensor.get_layout() == dst_tensor.get_layout());
     setup_rank_limits(src_tensor, dst_tensor, m_rank_limits_fwd);
     setup_rank_limits(dst_tensor, src_tensor, m_rank_limits_bwd);
     setup_displs(src_tensor, dst_tensor);
@@ -50,7 +55,7 @@ class TensorMPIShuffleHelper {
     int num_ranks = m_loc.get_size();
     for (int pid = 0; pid < num_ranks; ++pid) {
       if (m_send_counts[pid] != 0 || m_recv_counts[pid] != 0) {
-        util::MPIPrintStreamDebug()
+        DISTCONV_LOG_DEBUG(Shuffle)
             << "Send/recv counts for "
             << pid << ": " << m_send_counts[pid] << ", "
             << m_recv_counts[pid];
@@ -201,7 +206,7 @@ class TensorMPIShuffleHelper {
     bool src_split_root = src_tensor.is_split_root();
     bool dst_split_root = dst_tensor.is_split_root();
 
-    util::MPIPrintStreamDebug()
+    DISTCONV_LOG_DEBUG(Shuffle)
         << "src_local_region: " << src_local_region
         << ", dst_local_region: " << dst_local_region
         << ", src_split_root: " << src_split_root
@@ -221,13 +226,13 @@ class TensorMPIShuffleHelper {
         auto &&send_intersection =
             src_local_region.intersect(dst_remote_region);
         m_send_counts[pid] = send_intersection.get_size();
-        util::MPIPrintStreamDebug()
+        DISTCONV_LOG_DEBUG(Shuffle)
             << "send_intersection for " << pid << ": "
             << send_intersection
             << ", dst_remote_region: " << dst_remote_region;
       } else {
         // do not send anything if the destination is not a split root
-        util::MPIPrintStreamDebug() << "destination "
+        DISTCONV_LOG_DEBUG(Shuffle) << "destination "
                                     << pid << " is not a split root";
         m_send_counts[pid] = 0;
       }
@@ -245,12 +250,12 @@ class TensorMPIShuffleHelper {
       } else {
         // similarly, if the remote source is not a split root, do not
         // receive anything from it
-        util::MPIPrintStreamDebug() << "source is not a split root";
+        DISTCONV_LOG_DEBUG(Shuffle) << "source is not a split root";
         m_recv_counts[pid] = 0;
       }
       cur_recv_displs += m_recv_counts[pid];
 
-      util::MPIPrintStreamDebug()
+      DISTCONV_LOG_DEBUG(Shuffle)
           << "send displs for rank " << pid << ": " << m_send_displs[pid]
           << ", recv displs: " << m_recv_displs[pid]
           << ", send count: " << m_send_counts[pid]
@@ -442,8 +447,8 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
                             const TensorType &dst) {
     const int nd = src.get_num_dims();
 
-    // Only 4D and 5D tensors
-    if (nd != 4 && nd != 5) return false;
+    // Only 3D to 5D tensors
+    if (nd < 3 || nd > 5) return false;
 
     // The source tensor must not have splitting other than the sample
     // dimension.
@@ -504,15 +509,21 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
 
     int nd = m_helper.get_num_dims();
 
-    util::profile_push("pack");
+    util::profile_push("pack", h2::gpu::RangeCategory::Shuffle);
 
     if (!getenv("SKIP_PACK")) {
       if (m_helper.is_src_split_root(is_forward)) {
         if (get_sample_to_spatial(is_forward) &&
-            (nd == 4 || nd == 5)) {
-          util::MPIPrintStreamDebug() << "Sample-to-spatial packing";
-          util::profile_push("pack-opt");
-          if (nd == 4) {
+            (nd >= 3 && nd <= 5)) {
+          DISTCONV_LOG_DEBUG(Shuffle) << "Sample-to-spatial packing";
+          util::profile_push("pack-opt", h2::gpu::RangeCategory::Shuffle);
+          if (nd == 3) {
+            pack_sample_to_spatial3(
+                src, m_helper.get_src_local_shape(is_forward),
+                m_helper.get_dst_local_shape(is_forward),
+                m_helper.get_dst_locale_shape(is_forward),
+                send_buf.get());
+          } else if (nd == 4) {
             pack_sample_to_spatial4(
                 src, m_helper.get_src_local_shape(is_forward),
                 m_helper.get_dst_local_shape(is_forward),
@@ -527,7 +538,7 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
           }
           util::profile_pop();
         } else {
-            util::profile_push("pack-default");
+            util::profile_push("pack-default", h2::gpu::RangeCategory::Shuffle);
             util::MPIRootPrintStreamWarning()
                 << "Packing does not use the optimized implementation";
             pack(src,
@@ -544,20 +555,29 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
 
     util::profile_pop(); // pack
 
-    util::profile_push("transfer");
+    util::profile_push("transfer", h2::gpu::RangeCategory::Shuffle);
     if (!getenv("SKIP_TRANSFER")) {
       transfer(send_buf, recv_buf, is_forward);
     }
     util::profile_pop();
 
-    util::profile_push("unpack");
+    util::profile_push("unpack", h2::gpu::RangeCategory::Shuffle);
     // unpack
     if (!getenv("SKIP_UNPACK")) {
       if (m_helper.is_dst_split_root(is_forward)) {
         if (get_sample_to_spatial(is_forward)) {
-            util::profile_push("unpack-opt");
-            util::MPIPrintStreamDebug() << "Sample-to-spatial unpacking";
-            if (nd == 4)
+            util::profile_push("unpack-opt", h2::gpu::RangeCategory::Shuffle);
+            DISTCONV_LOG_DEBUG(Shuffle) << "Sample-to-spatial unpacking";
+            if (nd == 3)
+            {
+                unpack_sample_to_spatial_halo3(
+                    dst,
+                    m_helper.get_dst_local_shape(is_forward),
+                    m_helper.get_dst_strides(is_forward),
+                    recv_buf.get(),
+                    m_helper.get_dst_overlap(is_forward));
+            }
+            else if (nd == 4)
             {
                 unpack_sample_to_spatial_halo4(
                     dst,
@@ -577,7 +597,8 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
             }
             util::profile_pop();
         } else {
-            util::profile_push("unpack-default");
+            util::profile_push("unpack-default",
+                               h2::gpu::RangeCategory::Shuffle);
             unpack(dst,
                    m_helper.get_dst_local_shape(is_forward),
                    m_helper.get_dst_strides(is_forward),
@@ -604,7 +625,7 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
                   m_helper.get_recv_displs(is_forward),
                   util::get_mpi_data_type<DataType>(),
                   m_helper.m_loc.get_comm());
-    util::MPIPrintStreamDebug() << "Transfer done";
+    DISTCONV_LOG_DEBUG(Shuffle) << "Transfer done";
   }
 
 #if 0
@@ -621,7 +642,7 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
                 0,
                 m_helper.m_loc.get_comm());
                 //m_dst_spatial_locale.get_comm());
-    util::MPIPrintStreamDebug() << "Transfer done";
+    DISTCONV_LOG_DEBUG(Shuffle) << "Transfer done";
   }
 #endif
 
@@ -683,6 +704,23 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
     }
   }
 
+  // Number of elements from idx along the innermost dimension that
+  // belong to the same remote rank. They are contiguous in both the
+  // local tensor and the packed buffer of the rank.
+  static index_t get_run_length(index_t idx, index_t len,
+                                const int * __restrict__ rank_limits) {
+#ifdef DISTCONV_OPTIMIZE_FIND_DESTINATION
+    if (rank_limits[0] == -1) {
+      const index_t global_idx = idx + rank_limits[1];
+      const index_t remote_len = rank_limits[2];
+      return std::min(remote_len - global_idx % remote_len, len - idx);
+    }
+#endif
+    int j = 0;
+    while (static_cast<int>(idx) >= rank_limits[j]) ++j;
+    return std::min(static_cast<index_t>(rank_limits[j]), len) - idx;
+  }
+
   // NOTE: packed tensor is assumed
   void pack(const DataType *src, const Shape &src_local_shape,
             const IndexVector &src_strides, const Shape &dst_locale_shape,
@@ -690,19 +728,83 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
             const int *displs) {
     if (src_local_shape.size() == 0) return;
 
-    const size_t size = src_local_shape.size();
-    const size_t gid = 0;
-    const size_t num_threads = 1;
+    const index_t row_len = src_local_shape[0];
+    const size_t num_rows = src_local_shape.size() / row_len;
+
+#pragma omp parallel for
+    for (size_t row = 0; row < num_rows; ++row) {
+      auto idx = src_local_shape.get_index(row * row_len);
+      while (idx[0] < row_len) {
+        int rank;
+        size_t packed_buf_offset;
+        find_destination(idx, src_local_shape, dst_locale_shape,
+                         rank_limits, rank, packed_buf_offset);
+        const index_t len = get_run_length(idx[0], row_len, rank_limits);
+        std::memcpy(&buf[displs[rank] + packed_buf_offset],
+                    &src[row * row_len + idx[0]],
+                    sizeof(DataType) * len);
+        idx[0] += len;
+      }
+    }
+  }
+
+  void pack_sample_to_spatial3(
+      const DataType *src, const Shape &src_local_shape,
+      const Shape &dst_local_shape,
+      const Shape &dst_locale_shape,
+      DataType *buf) {
+    constexpr int ND = 3;
+    if (src_local_shape.size() == 0) return;
 
-    for (size_t offset = gid; offset < size; offset += num_threads) {
-      DataType v = src[offset];
-      const auto idx = src_local_shape.get_index(offset);
-      int rank;
-      size_t packed_buf_offset;
-      find_destination(idx, src_local_shape, dst_locale_shape,
-                       rank_limits, rank, packed_buf_offset);
-      buf[displs[rank] + packed_buf_offset] = v;
+    auto dst_local_size = dst_local_shape.size();
+    auto dst_offset = 0;
+    auto num_dst_ranks = dst_locale_shape.size() / dst_locale_shape[-1];
+    index_t *dst_offsets = new index_t[num_dst_ranks];
+    int dst_offsets_idx = 0;
+    for (int p1 = 0; p1 < (int)dst_locale_shape[1]; ++p1) {
+      for (int p0 = 0; p0 < (int)dst_locale_shape[0]; ++p0) {
+        dst_offsets[dst_offsets_idx++] = dst_offset;
+        dst_offset += dst_local_size;
+      }
     }
+
+    Array<ND> src_local_strides;
+    Array<ND> dst_local_strides;
+    Array<ND> dst_locale_strides;
+    index_t src_stride = 1;
+    index_t dst_stride = 1;
+    int dst_locale_stride = 1;
+    for (int i = 0; i < ND; ++i) {
+      src_local_strides[i] = src_stride;
+      dst_local_strides[i] = dst_stride;
+      dst_locale_strides[i] = dst_locale_stride;
+      src_stride *= src_local_shape[i];
+      dst_stride *= dst_local_shape[i];
+      dst_locale_stride *= dst_locale_shape[i];
+    }
+
+    const int linear_len = dst_local_shape[0];
+    constexpr int p2 = 0;
+#pragma omp parallel for collapse(3)
+    for (int i2 = 0; i2 < (int)dst_local_shape[2]; ++i2) {
+      for (int p1 = 0; p1 < (int)dst_locale_shape[1]; ++p1) {
+        for (int i1 = 0; i1 < (int)dst_local_shape[1]; ++i1) {
+          index_t src_offset =
+              CALC_OFFSET3(
+                  0, i1 + dst_local_shape[1] * p1,
+                  i2 + dst_local_shape[2] * p2, src_local_strides);
+          index_t dst_offset_i1 = CALC_OFFSET3(0, i1, i2, dst_local_strides);
+          for (int p0 = 0; p0 < (int)dst_locale_shape[0]; ++p0) {
+            int dst_rank_idx = CALC_OFFSET3(p0, p1, p2, dst_locale_strides);
+            std::memcpy(&buf[dst_offsets[dst_rank_idx]+dst_offset_i1],
+                        &src[src_offset],
+                        sizeof(DataType) * linear_len);
+            src_offset += linear_len;
+          }
+        }
+      }
+    }
+    delete[] dst_offsets;
   }
 
   void pack_sample_to_spatial4(
@@ -857,17 +959,23 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
               const int *displs) {
     if (dst_local_shape.size() == 0) return;
 
-    const size_t size = dst_local_shape.size();
-    const size_t gid = 0;
-    const size_t num_threads = 1;
-
-    for (size_t offset = gid; offset < size; offset += num_threads) {
-      const auto idx = dst_local_shape.get_index(offset);
-      int rank;
-      size_t packed_buf_offset;
-      find_destination(idx, dst_local_shape, src_locale_shape,
-                       rank_limits, rank, packed_buf_offset);
-      dst[offset] = buf[displs[rank] + packed_buf_offset];
+    const index_t row_len = dst_local_shape[0];
+    const size_t num_rows = dst_local_shape.size() / row_len;
+
+#pragma omp parallel for
+    for (size_t row = 0; row < num_rows; ++row) {
+      auto idx = dst_local_shape.get_index(row * row_len);
+      while (idx[0] < row_len) {
+        int rank;
+        size_t packed_buf_offset;
+        find_destination(idx, dst_local_shape, src_locale_shape,
+                         rank_limits, rank, packed_buf_offset);
+        const index_t len = get_run_length(idx[0], row_len, rank_limits);
+        std::memcpy(&dst[row * row_len + idx[0]],
+                    &buf[displs[rank] + packed_buf_offset],
+                    sizeof(DataType) * len);
+        idx[0] += len;
+      }
     }
   }
 
@@ -878,6 +986,37 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
     std::memcpy(dst, buf, dst_local_shape.size() * sizeof(DataType));
   }
 
+  void unpack_sample_to_spatial_halo3(DataType *dst,
+                                      const Shape &dst_local_shape,
+                                      const IndexVector &dst_strides,
+                                      const DataType *buf,
+                                      const IntVector &dst_overlap) {
+    constexpr int ND = 3;
+    if (dst_local_shape.size() == 0) return;
+
+    // packed strides
+    Array<ND> buf_strides;
+    index_t buf_stride = 1;
+    for (int i = 0; i < ND; ++i) {
+      buf_strides[i] = buf_stride;
+      buf_stride *= dst_local_shape[i];
+    }
+
+    const int linear_len = dst_local_shape[0];
+#pragma omp parallel for collapse(2)
+    for (int i2 = 0; i2 < (int)dst_local_shape[2]; ++i2) {
+      for (int i1 = 0; i1 < (int)dst_local_shape[1]; ++i1) {
+        constexpr int i0 = 0;
+        index_t dst_offset =
+            CALC_OFFSET3(i0, i1, i2, dst_strides);
+        index_t buf_offset =
+            CALC_OFFSET3(i0, i1, i2, buf_strides);
+        std::memcpy(&dst[dst_offset], &buf[buf_offset],
+                    sizeof(DataType) * linear_len);
+      }
+    }
+  }
+
   void unpack_sample_to_spatial_halo4(DataType *dst,
                                       const Shape &dst_local_shape,
                                       const IndexVector &dst_strides,
@@ -950,5 +1089,6 @@ class TensorMPIShuffler<DataType, BaseAllocator> {
 } // namespace tensor
 } // namespace distconv
 
+#undef CALC_OFFSET3
 #undef CALC_OFFSET4
 #undef CALC_OFFSET5
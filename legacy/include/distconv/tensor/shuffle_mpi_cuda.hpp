@@ -3,11 +3,19 @@
 #include "distconv/runtime_gpu.hpp"
 #include "distconv/tensor/memory_gpu.hpp"
 #include "distconv/tensor/runtime_gpu.hpp"
+#include "distconv/tensor/shuffle_plan.hpp"
 #include "distconv/tensor/tensor.hpp"
 #include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/memory_accounting.hpp"
 #include "distconv/util/util_gpu.hpp"
 #include "distconv/util/util_mpi.hpp"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
 namespace distconv {
 namespace tensor {
 
@@ -32,46 +40,143 @@ class TensorMPICUDAShuffler {
       m_loc(src_tensor.get_locale()),
       m_src_split_root(src_tensor.is_split_root()),
       m_dst_split_root(dst_tensor.is_split_root()),
-      m_rank_limits_fwd(nullptr),
-      m_rank_limits_bwd(nullptr),
-      m_send_counts(nullptr), m_recv_counts(nullptr),
-      m_send_displs_h(nullptr), m_recv_displs_h(nullptr),
-      m_send_displs_d(nullptr), m_recv_displs_d(nullptr),
+      m_num_samples(src_tensor.get_shape()[-1]),
+      m_src_sample_offset(src_tensor.get_global_index()[-1]),
+      m_dst_sample_offset(dst_tensor.get_global_index()[-1]),
+      m_chunk_size(get_default_chunk_size()),
+      m_persistent(std::getenv("DISTCONV_PERSISTENT_MPI") != nullptr),
       m_src_buf(src_buf), m_dst_buf(dst_buf),
       m_src_buf_passed(src_buf != nullptr), m_dst_buf_passed(dst_buf != nullptr) {
-    setup_rank_limits(src_tensor, dst_tensor, m_rank_limits_fwd);
-    setup_rank_limits(dst_tensor, src_tensor, m_rank_limits_bwd);
-    setup_displs(src_tensor, dst_tensor);
-
-    int num_ranks = m_loc.get_size();
-    for (int pid = 0; pid < num_ranks; ++pid) {
-      if (m_send_counts[pid] != 0 || m_recv_counts[pid] != 0) {
-        util::MPIPrintStreamDebug()
-            << "Send/recv counts for "
-            << pid << ": " << m_send_counts[pid] << ", "
-            << m_recv_counts[pid];
-        m_peers.push_back(pid);
+    // Shuffling does not transpose
+    assert_always(src_tensor.get_layout() == dst_tensor.get_layout());
+    auto &cache = ShufflePlanCache::get_instance();
+    const auto key = ShufflePlanCache::get_key(src_tensor, dst_tensor);
+    m_plan = cache.find(key);
+    if (m_plan == nullptr) {
+      auto plan = std::make_shared<ShufflePlan>();
+      setup_rank_limits(src_tensor, dst_tensor, plan->m_rank_limits_fwd,
+                        plan->m_rank_limits_fwd_h);
+      setup_rank_limits(dst_tensor, src_tensor, plan->m_rank_limits_bwd,
+                        plan->m_rank_limits_bwd_h);
+      setup_displs(src_tensor, dst_tensor, *plan);
+      int num_ranks = m_loc.get_size();
+      for (int pid = 0; pid < num_ranks; ++pid) {
+        if (plan->m_send_counts[pid] != 0 || plan->m_recv_counts[pid] != 0) {
+          DISTCONV_LOG_DEBUG(Shuffle)
+              << "Send/recv counts for "
+              << pid << ": " << plan->m_send_counts[pid] << ", "
+              << plan->m_recv_counts[pid];
+          plan->m_peers.push_back(pid);
+        }
       }
+      m_plan = plan;
+      cache.insert(key, m_plan);
+    } else {
+      DISTCONV_LOG_DEBUG(Shuffle) << "Reusing shuffle plan of " << key;
+    }
+    m_peers = m_plan->m_peers;
+    m_sample_slabs = is_sample_slab_shuffle(src_tensor) &&
+        is_sample_slab_shuffle(dst_tensor);
+    if (m_dst_overlap.reduce_sum() != 0) {
+      setup_halo_plan(src_tensor, dst_tensor);
     }
   }
 
   virtual ~TensorMPICUDAShuffler() {
-    if (m_rank_limits_fwd)
-        DISTCONV_CHECK_GPU(GPU_FREE(m_rank_limits_fwd));
-    if (m_rank_limits_bwd)
-        DISTCONV_CHECK_GPU(GPU_FREE(m_rank_limits_bwd));
-    if (m_send_counts)
-      delete[] m_send_counts;
-    if (m_recv_counts)
-      delete[] m_recv_counts;
-    if (m_send_displs_h)
-      delete[] m_send_displs_h;
-    if (m_recv_displs_h)
-      delete[] m_recv_displs_h;
-    if (m_send_displs_d)
-        DISTCONV_CHECK_GPU(GPU_FREE(m_send_displs_d));
-    if (m_recv_displs_d)
-        DISTCONV_CHECK_GPU(GPU_FREE(m_recv_displs_d));
+    for (auto &a: m_async) {
+      if (a.pending) {
+        progress(&a == &m_async[0], true);
+      }
+      if (a.packed) {
+        h2::gpu::destroy(a.packed);
+      }
+    }
+    for (auto &p: m_pipelines) {
+      if (p.chunk_arrays_d) {
+        DISTCONV_CHECK_GPU(GPU_FREE(p.chunk_arrays_d));
+      }
+    }
+    free_persistent_requests();
+    if (m_pack_stream) {
+      h2::gpu::destroy(m_pack_stream);
+      h2::gpu::destroy(m_unpack_stream);
+      for (int i = 0; i < 2; ++i) {
+        h2::gpu::destroy(m_packed[i]);
+        h2::gpu::destroy(m_transferred[i]);
+        h2::gpu::destroy(m_unpacked[i]);
+      }
+    }
+  }
+
+  // Splits shuffles into chunks of num_samples samples, which are
+  // packed, transferred and unpacked in a pipeline with two staging
+  // buffers per direction. 0 shuffles the whole tensors at once. Must
+  // be the same on all processes. Defaults to
+  // DISTCONV_SHUFFLE_CHUNK_SIZE.
+  void set_chunk_size(index_t num_samples) {
+    m_chunk_size = num_samples;
+  }
+
+  index_t get_chunk_size() const {
+    return m_chunk_size;
+  }
+
+  // Transfers with MPI through persistent sends and receives to the
+  // peers of each set of buffers and counts, started together,
+  // instead of an alltoallv. The requests of the most recently used
+  // sets are kept, so steady-state shuffles, whose buffers come back
+  // from the memory pools, do not match or set up anything. Only
+  // blocking transfers are persistent. Must be the same on all
+  // processes. Defaults to whether DISTCONV_PERSISTENT_MPI is set.
+  void set_persistent(bool b) {
+    if (!b) free_persistent_requests();
+    m_persistent = b;
+  }
+
+  bool get_persistent() const {
+    return m_persistent;
+  }
+
+  // Packs the shuffled elements with a reduced precision, which
+  // rounds them. Reduced-precision shuffles are neither chunked nor
+  // asynchronous, and are transferred with MPI by all but the
+  // Aluminum shuffler. Must be the same on all processes.
+  void set_comm_precision(CommPrecision precision) {
+    if (precision != CommPrecision::FULL && m_fill_dst_halo) {
+      util::MPIPrintStreamError()
+          << "Halos are not filled by reduced-precision shuffles";
+      throw std::exception();
+    }
+    if (!is_comm_precision_supported<DataType>(precision)) {
+      util::MPIPrintStreamError()
+          << "Shuffle does not support precision " << precision;
+      throw std::exception();
+    }
+    m_comm_precision = precision;
+  }
+
+  CommPrecision get_comm_precision() const {
+    return m_comm_precision;
+  }
+
+  // Delivers the halos of the dst tensor along with its interior in
+  // forward shuffles, taking them from the src processes owning the
+  // elements, so that dst needs no halo exchange before it is read,
+  // e.g., by the first convolution after the shuffle. Halos outside
+  // the global tensor are not written. Such shuffles are neither
+  // chunked nor asynchronous, and are transferred with MPI. Must be
+  // the same on all processes.
+  void set_fill_dst_halo(bool fill) {
+    if (fill && m_comm_precision != CommPrecision::FULL) {
+      util::MPIPrintStreamError()
+          << "Halos are not filled by reduced-precision shuffles";
+      throw std::exception();
+    }
+    m_fill_dst_halo = fill;
+  }
+
+  bool is_dst_halo_filled() const {
+    return m_fill_dst_halo;
   }
 
   void shuffle_forward(const DataType* src,
@@ -81,6 +186,48 @@ class TensorMPICUDAShuffler {
                         DataType* dst,
                         h2::gpu::DeviceStream stream = 0);
 
+  /*
+    Completion of a shuffle started by shuffle_forward_async or
+    shuffle_backward_async. Once completed, the result is available in
+    the order of the stream of the shuffle, as with the blocking
+    shuffles. The shuffler and the tensors must stay alive until then.
+   */
+  class Request {
+   public:
+    Request() = default;
+
+    // Advances the shuffle without blocking and returns whether it is
+    // completed
+    bool test() {
+      return m_shuffler == nullptr || m_shuffler->progress(m_is_forward, false);
+    }
+
+    void wait() {
+      if (m_shuffler != nullptr) {
+        m_shuffler->progress(m_is_forward, true);
+      }
+    }
+
+   private:
+    friend class TensorMPICUDAShuffler;
+    TensorMPICUDAShuffler *m_shuffler = nullptr;
+    bool m_is_forward = true;
+
+    Request(TensorMPICUDAShuffler *shuffler, bool is_forward):
+        m_shuffler(shuffler), m_is_forward(is_forward) {}
+  };
+
+  // Shuffles without synchronizing the host. Transfers not ordered by
+  // the stream, i.e., those with MPI, are started once packing is
+  // done and progressed by the request. Starting another shuffle of
+  // the same direction completes the previous one.
+  Request shuffle_forward_async(const DataType* src,
+                                DataType* dst,
+                                h2::gpu::DeviceStream stream = 0);
+  Request shuffle_backward_async(const DataType* src,
+                                 DataType* dst,
+                                 h2::gpu::DeviceStream stream = 0);
+
   static size_t get_buf_size(const TensorType &tensor) {
     return get_buf_size(tensor.get_local_shape());
   }
@@ -101,19 +248,108 @@ class TensorMPICUDAShuffler {
   const LocaleMPI &m_loc;
   const bool m_src_split_root;
   const bool m_dst_split_root;
+  const index_t m_num_samples;
+  const index_t m_src_sample_offset;
+  const index_t m_dst_sample_offset;
+
+  // Possibly shared with other shufflers
+  std::shared_ptr<const ShufflePlan> m_plan;
+  // Whether the data exchanged with each peer is a contiguous slab of
+  // the local tensors, so they are transferred without packing
+  bool m_sample_slabs;
+
+  // Samples of each chunk when pipelined
+  index_t m_chunk_size;
+
+  bool m_persistent;
+  // Set of persistent requests of an alltoallv
+  struct PersistentAlltoallv {
+    const void *send_buf;
+    void *recv_buf;
+    MPI_Datatype type;
+    // Send counts and displacements, and recv counts and
+    // displacements, of all ranks
+    std::vector<int> layout;
+    std::vector<MPI_Request> requests;
+  };
+  static constexpr size_t max_persistent_alltoallvs = 4;
+  // Most recently used first
+  std::vector<PersistentAlltoallv> m_persistent_alltoallvs;
+  // Duplicate of the communicator of the locale, so that the
+  // point-to-point messages match no others
+  MPI_Comm m_persistent_comm = MPI_COMM_NULL;
+  CommPrecision m_comm_precision = CommPrecision::FULL;
+  struct Chunk {
+    // Local sample ranges of the src and dst tensors
+    index_t src_begin;
+    index_t src_end;
+    index_t dst_begin;
+    index_t dst_end;
+    std::vector<int> send_counts;
+    std::vector<int> send_displs;
+    std::vector<int> recv_counts;
+    std::vector<int> recv_displs;
+    size_t send_size;
+    size_t recv_size;
+    // Offset of the rank limits and displacements of the chunk in
+    // chunk_arrays_d
+    size_t arrays_offset;
+  };
+  struct Pipeline {
+    index_t chunk_size = 0;
+    std::vector<Chunk> chunks;
+    // Rank limits fwd, bwd, send and recv displacements of all chunks
+    int *chunk_arrays_d = nullptr;
+    // Largest send and recv sizes of a chunk
+    size_t max_send_size = 0;
+    size_t max_recv_size = 0;
+  };
+  // Pipelines of the forward and backward shuffles
+  Pipeline m_pipelines[2];
+  h2::gpu::DeviceStream m_pack_stream = nullptr;
+  h2::gpu::DeviceStream m_unpack_stream = nullptr;
+  h2::gpu::DeviceEvent m_packed[2];
+  h2::gpu::DeviceEvent m_transferred[2];
+  h2::gpu::DeviceEvent m_unpacked[2];
+
+  // Shuffles started by shuffle_async whose transfer is not done
+  struct AsyncShuffle {
+    bool pending = false;
+    bool transferring = false;
+    bool sample_slabs = false;
+    const DataType *send_buf = nullptr;
+    DataType *recv_buf = nullptr;
+    // Host staging buffers unless MPI is CUDA-aware
+    DataType *send_buf_h = nullptr;
+    DataType *recv_buf_h = nullptr;
+    size_t send_size = 0;
+    size_t recv_size = 0;
+    DataType *dst = nullptr;
+    h2::gpu::DeviceStream stream = nullptr;
+    h2::gpu::DeviceEvent packed = nullptr;
+    MPI_Request request = MPI_REQUEST_NULL;
+  };
+  // Forward and backward
+  AsyncShuffle m_async[2];
 
-  // Offsets in src tensor for each dst locale. Used in
-  // packing. Linearized to a 1D array.
-  int *m_rank_limits_fwd;
-  // Offsets in dst tensor for each src locale. Used in
-  // packing. Linearized to a 1D array.
-  int *m_rank_limits_bwd;
-  int *m_send_counts;
-  int *m_recv_counts;
-  int *m_send_displs_h;
-  int *m_recv_displs_h;
-  int *m_send_displs_d;
-  int *m_recv_displs_d;
+  // Boxes exchanged with each peer by the forward shuffles filling the
+  // dst halos, which overlap among the peers unlike the partitions of
+  // the plan. The offsets are in the real local tensors.
+  struct HaloPlan {
+    std::vector<int> send_counts;
+    std::vector<int> send_displs;
+    std::vector<int> recv_counts;
+    std::vector<int> recv_displs;
+    std::vector<IndexVector> send_offsets;
+    std::vector<Shape> send_shapes;
+    std::vector<size_t> send_box_displs;
+    std::vector<IndexVector> recv_offsets;
+    std::vector<Shape> recv_shapes;
+    std::vector<size_t> recv_box_displs;
+  };
+  bool m_fill_dst_halo = false;
+  // Only set up when dst has halos
+  HaloPlan m_halo_plan;
 
   DataType *m_src_buf;
   DataType *m_dst_buf;
@@ -126,10 +362,39 @@ class TensorMPICUDAShuffler {
     return m_peers.size();
   }
 
+  // Only the sample dimension is partitioned and the local tensor is
+  // packed. The data of each peer is then a slab of samples, and the
+  // slabs are in the rank order as the send and recv displacements.
+  static bool is_sample_slab_shuffle(const TensorType &tensor) {
+    const auto &dist = tensor.get_distribution();
+    const int num_dims = tensor.get_num_dims();
+    if (dist.get_locale_shape() != dist.get_split_shape() ||
+        tensor.get_overlap().reduce_sum() != 0) {
+      return false;
+    }
+    const auto local_shape = tensor.get_local_shape();
+    const auto strides = tensor.get_strides();
+    index_t stride = 1;
+    for (int i = 0; i < num_dims; ++i) {
+      if ((i < num_dims - 1 && dist.get_locale_shape()[i] != 1) ||
+          strides[i] != stride) {
+        return false;
+      }
+      stride *= local_shape[i];
+    }
+    return true;
+  }
+
+  static index_t get_default_chunk_size() {
+    const char *env = std::getenv("DISTCONV_SHUFFLE_CHUNK_SIZE");
+    return env ? std::max(std::atoi(env), 0) : 0;
+  }
+
   void setup_rank_limits(const TensorType &src_tensor,
                          const TensorType &dst_tensor,
-                         int *&rank_limits) {
-    std::vector<int> host_buf;
+                         int *&rank_limits,
+                         std::vector<int> &host_buf) {
+    host_buf.clear();
     const int num_dims = src_tensor.get_num_dims();
     for (int i = 0; i < num_dims; ++i) {
       int dst_locale_dim = dst_tensor.get_locale_shape()[i];
@@ -205,15 +470,20 @@ class TensorMPICUDAShuffler {
   }
 
   void setup_displs(const TensorType &src_tensor,
-                    const TensorType &dst_tensor) {
+                    const TensorType &dst_tensor,
+                    ShufflePlan &plan) {
     int num_ranks = m_loc.get_size();
 
-    m_send_counts = new int[num_ranks];
-    m_recv_counts = new int[num_ranks];
-    m_send_displs_h = new int[num_ranks];
-    m_recv_displs_h = new int[num_ranks];
-    DISTCONV_GPU_MALLOC(&m_send_displs_d, sizeof(int) * num_ranks);
-    DISTCONV_GPU_MALLOC(&m_recv_displs_d, sizeof(int) * num_ranks);
+    auto &send_counts = plan.m_send_counts;
+    auto &recv_counts = plan.m_recv_counts;
+    auto &send_displs = plan.m_send_displs_h;
+    auto &recv_displs = plan.m_recv_displs_h;
+    send_counts.resize(num_ranks);
+    recv_counts.resize(num_ranks);
+    send_displs.resize(num_ranks);
+    recv_displs.resize(num_ranks);
+    DISTCONV_GPU_MALLOC(&plan.m_send_displs_d, sizeof(int) * num_ranks);
+    DISTCONV_GPU_MALLOC(&plan.m_recv_displs_d, sizeof(int) * num_ranks);
 
     const Region src_local_region(src_tensor.get_global_index(),
                                   m_src_local_shape);
@@ -227,7 +497,7 @@ class TensorMPICUDAShuffler {
     bool src_split_root = src_tensor.is_split_root();
     bool dst_split_root = dst_tensor.is_split_root();
 
-    util::MPIPrintStreamDebug()
+    DISTCONV_LOG_DEBUG(Shuffle)
         << "src_local_region: " << src_local_region
         << ", dst_local_region: " << dst_local_region
         << ", src_split_root: " << src_split_root
@@ -235,8 +505,8 @@ class TensorMPICUDAShuffler {
 
     // transfers only between split root ranks
     for (int pid = 0; pid < num_ranks; ++pid) {
-      m_send_displs_h[pid] = cur_send_displs;
-      m_recv_displs_h[pid] = cur_recv_displs;
+      send_displs[pid] = cur_send_displs;
+      recv_displs[pid] = cur_recv_displs;
       // send_counts & send_displs
       const auto &dst_pid_idx = loc_shape_dst.get_index(pid);
       if (src_split_root &&
@@ -246,18 +516,18 @@ class TensorMPICUDAShuffler {
             dst_tensor.get_remote_shape(dst_pid_idx));
         auto &&send_intersection =
             src_local_region.intersect(dst_remote_region);
-        m_send_counts[pid] = send_intersection.get_size();
-        util::MPIPrintStreamDebug()
+        send_counts[pid] = send_intersection.get_size();
+        DISTCONV_LOG_DEBUG(Shuffle)
             << "send_intersection for " << pid << ": "
             << send_intersection
             << ", dst_remote_region: " << dst_remote_region;
       } else {
         // do not send anything if the destination is not a split root
-        util::MPIPrintStreamDebug() << "destination "
+        DISTCONV_LOG_DEBUG(Shuffle) << "destination "
                                     << pid << " is not a split root";
-        m_send_counts[pid] = 0;
+        send_counts[pid] = 0;
       }
-      cur_send_displs += m_send_counts[pid];
+      cur_send_displs += send_counts[pid];
       // recv_counts & recv_displs
       const auto src_pid_idx = loc_shape_src.get_index(pid);
       if (dst_split_root &&
@@ -267,30 +537,162 @@ class TensorMPICUDAShuffler {
             src_tensor.get_remote_shape(src_pid_idx));
         auto &&recv_intersection =
             dst_local_region.intersect(src_remote_region);
-        m_recv_counts[pid] = recv_intersection.get_size();
+        recv_counts[pid] = recv_intersection.get_size();
       } else {
         // similarly, if the remote source is not a split root, do not
         // receive anything from it
-        util::MPIPrintStreamDebug() << "source is not a split root";
-        m_recv_counts[pid] = 0;
+        DISTCONV_LOG_DEBUG(Shuffle) << "source is not a split root";
+        recv_counts[pid] = 0;
       }
-      cur_recv_displs += m_recv_counts[pid];
+      cur_recv_displs += recv_counts[pid];
+
+      DISTCONV_LOG_DEBUG(Shuffle)
+          << "send displs for rank " << pid << ": " << send_displs[pid]
+          << ", recv displs: " << recv_displs[pid]
+          << ", send count: " << send_counts[pid]
+          << ", recv count: " << recv_counts[pid];
+    }
+    h2::gpu::mem_copy(plan.m_send_displs_d, send_displs.data(), num_ranks);
+    h2::gpu::mem_copy(plan.m_recv_displs_d, recv_displs.data(), num_ranks);
+  }
+
+  // The region of dst_tensor at the process at rank_idx including
+  // its halos within the global tensor
+  static Region get_halo_region(const TensorType &dst_tensor,
+                                const IndexVector &rank_idx) {
+    const int num_dims = dst_tensor.get_num_dims();
+    const auto &overlap = dst_tensor.get_overlap();
+    IndexVector offset = dst_tensor.get_remote_index(rank_idx);
+    Shape shape = dst_tensor.get_remote_shape(rank_idx);
+    for (int i = 0; i < num_dims; ++i) {
+      if (shape[i] == 0) continue;
+      const index_t begin = offset[i] > (index_t) overlap[i] ?
+          offset[i] - overlap[i] : 0;
+      const index_t end = std::min(offset[i] + shape[i] + overlap[i],
+                                   dst_tensor.get_shape()[i]);
+      offset[i] = begin;
+      shape[i] = end - begin;
+    }
+    return Region(offset, shape);
+  }
 
-      util::MPIPrintStreamDebug()
-          << "send displs for rank " << pid << ": " << m_send_displs_h[pid]
-          << ", recv displs: " << m_recv_displs_h[pid]
-          << ", send count: " << m_send_counts[pid]
-          << ", recv count: " << m_recv_counts[pid];
+  void setup_halo_plan(const TensorType &src_tensor,
+                       const TensorType &dst_tensor) {
+    const int num_ranks = m_loc.get_size();
+    const int num_dims = src_tensor.get_num_dims();
+    auto &plan = m_halo_plan;
+    plan.send_counts.assign(num_ranks, 0);
+    plan.send_displs.assign(num_ranks, 0);
+    plan.recv_counts.assign(num_ranks, 0);
+    plan.recv_displs.assign(num_ranks, 0);
+    const Region src_local_region(src_tensor.get_global_index(),
+                                  m_src_local_shape);
+    const auto dst_local_idx = m_dst_locale_shape.get_index(
+        m_loc.get_rank());
+    const Region dst_local_region = get_halo_region(dst_tensor,
+                                                    dst_local_idx);
+    // Offsets of the interiors in the real local tensors
+    IndexVector src_base(num_dims), dst_base(num_dims);
+    for (int i = 0; i < num_dims; ++i) {
+      src_base[i] = src_tensor.get_global_index()[i] - m_src_overlap[i];
+      dst_base[i] = dst_tensor.get_global_index()[i] - m_dst_overlap[i];
+    }
+    int send_displs = 0;
+    int recv_displs = 0;
+    for (int pid = 0; pid < num_ranks; ++pid) {
+      plan.send_displs[pid] = send_displs;
+      plan.recv_displs[pid] = recv_displs;
+      const auto dst_pid_idx = m_dst_locale_shape.get_index(pid);
+      if (m_src_split_root &&
+          dst_tensor.get_distribution().is_split_root(dst_pid_idx)) {
+        const auto box = src_local_region.intersect(
+            get_halo_region(dst_tensor, dst_pid_idx));
+        if (!box.is_empty()) {
+          plan.send_offsets.push_back(box.get_offset() - src_base);
+          plan.send_shapes.push_back(box.get_extent());
+          plan.send_box_displs.push_back(send_displs);
+          plan.send_counts[pid] = box.get_size();
+        }
+      }
+      send_displs += plan.send_counts[pid];
+      const auto src_pid_idx = m_src_locale_shape.get_index(pid);
+      if (m_dst_split_root &&
+          src_tensor.get_distribution().is_split_root(src_pid_idx)) {
+        const Region src_remote_region(
+            src_tensor.get_remote_index(src_pid_idx),
+            src_tensor.get_remote_shape(src_pid_idx));
+        const auto box = dst_local_region.intersect(src_remote_region);
+        if (!box.is_empty()) {
+          plan.recv_offsets.push_back(box.get_offset() - dst_base);
+          plan.recv_shapes.push_back(box.get_extent());
+          plan.recv_box_displs.push_back(recv_displs);
+          plan.recv_counts[pid] = box.get_size();
+        }
+      }
+      recv_displs += plan.recv_counts[pid];
     }
-    h2::gpu::mem_copy(m_send_displs_d, m_send_displs_h, num_ranks);
-    h2::gpu::mem_copy(m_recv_displs_d, m_recv_displs_h, num_ranks);
+    DISTCONV_LOG_DEBUG(Shuffle)
+        << "Halo-filling shuffle: " << plan.send_offsets.size()
+        << " send boxes, " << plan.recv_offsets.size() << " recv boxes";
   }
 
+  // Forward shuffle filling the dst halos
+  void shuffle_halo(const DataType* src,
+                    DataType* dst,
+                    h2::gpu::DeviceStream stream);
+
   void shuffle(const DataType* src,
                DataType* dst,
                h2::gpu::DeviceStream stream,
                bool is_forward);
 
+  void shuffle_chunked(const DataType* src,
+                       DataType* dst,
+                       h2::gpu::DeviceStream stream,
+                       bool is_forward);
+
+  Pipeline &get_pipeline(bool is_forward);
+
+  // Packs src into send_buf, or directly into the peer buffers when
+  // overridden by transfers that need no staging send buffer
+  virtual void pack_tensor(const DataType* src,
+                           DataType* send_buf,
+                           h2::gpu::DeviceStream stream,
+                           bool is_forward);
+
+  void unpack_tensor(const DataType* recv_buf,
+                     DataType* dst,
+                     h2::gpu::DeviceStream stream,
+                     bool is_forward);
+
+  // Shuffles with the elements packed as WireType
+  template <typename WireType>
+  void shuffle_wire(const DataType* src,
+                    DataType* dst,
+                    h2::gpu::DeviceStream stream,
+                    bool is_forward);
+
+  Request shuffle_async(const DataType* src,
+                        DataType* dst,
+                        h2::gpu::DeviceStream stream,
+                        bool is_forward);
+
+  // Advances the pending async shuffle of the direction. Returns
+  // whether it is completed.
+  bool progress(bool is_forward, bool blocking);
+
+  // Whether transfer enqueues its communication on the stream without
+  // synchronizing the host. Async shuffles are then just enqueued.
+  virtual bool is_transfer_stream_ordered() const {
+    return false;
+  }
+
+  // Whether transfer and transfer_chunk can exchange any buffers
+  // rather than only those of get_src_buf and get_dst_buf
+  virtual bool is_transfer_buffer_independent() const {
+    return true;
+  }
+
   virtual DataType* get_src_buf(bool is_forward, h2::gpu::DeviceStream s)
   {
       if (is_forward && m_src_buf_passed)
@@ -311,6 +713,7 @@ class TensorMPICUDAShuffler {
                   : static_cast<DataType*>(
                       distconv::internal::RuntimeGPU::get_device_memory_pool()
                           .get(buffer_size, s));
+          record_buf(buf, buffer_size);
           return buf;
       }
   }
@@ -335,6 +738,7 @@ class TensorMPICUDAShuffler {
                   : static_cast<DataType*>(
                       distconv::internal::RuntimeGPU::get_device_memory_pool()
                           .get(buffer_size, s));
+          record_buf(buf, buffer_size);
           return buf;
       }
   }
@@ -346,29 +750,117 @@ class TensorMPICUDAShuffler {
                         bool is_forward,
                         h2::gpu::DeviceStream stream)
   {
+    alltoallv(send_buf, send_buffer_size, get_send_counts(is_forward),
+              get_send_displs_h(is_forward), recv_buf, recv_buffer_size,
+              get_recv_counts(is_forward), get_recv_displs_h(is_forward),
+              stream);
+  }
+
+  // Transfers the packed buffers of a reduced-precision shuffle,
+  // whose elements are element_size bytes each
+  virtual void transfer_wire(const void* send_buf,
+                             void* recv_buf,
+                             size_t element_size,
+                             bool is_forward,
+                             h2::gpu::DeviceStream stream)
+  {
+    const int num_ranks = m_loc.get_size();
+    const int* send_counts = get_send_counts(is_forward);
+    const int* send_displs = get_send_displs_h(is_forward);
+    const int* recv_counts = get_recv_counts(is_forward);
+    const int* recv_displs = get_recv_displs_h(is_forward);
+    const size_t send_buffer_size =
+        (send_displs[num_ranks - 1] + send_counts[num_ranks - 1])
+        * element_size;
+    const size_t recv_buffer_size =
+        (recv_displs[num_ranks - 1] + recv_counts[num_ranks - 1])
+        * element_size;
+    // The wire types are 8 or 16 bits wide
+    if (element_size == sizeof(uint8_t)) {
+      alltoallv(static_cast<const uint8_t*>(send_buf), send_buffer_size,
+                send_counts, send_displs,
+                static_cast<uint8_t*>(recv_buf), recv_buffer_size,
+                recv_counts, recv_displs, MPI_UINT8_T, stream);
+      return;
+    }
+    assert_eq(element_size, sizeof(uint16_t));
+    alltoallv(static_cast<const uint16_t*>(send_buf), send_buffer_size,
+              send_counts, send_displs,
+              static_cast<uint16_t*>(recv_buf), recv_buffer_size,
+              recv_counts, recv_displs, MPI_UINT16_T, stream);
+  }
+
+  // Transfers a chunk of a pipelined shuffle. The counts and
+  // displacements are those of the chunk.
+  virtual void transfer_chunk(const DataType* send_buf,
+                              const int* send_counts,
+                              const int* send_displs,
+                              DataType* recv_buf,
+                              const int* recv_counts,
+                              const int* recv_displs,
+                              h2::gpu::DeviceStream stream)
+  {
+    // The chunk may have been packed on another stream
+    h2::gpu::sync(stream);
+    const int num_ranks = m_loc.get_size();
+    const size_t send_buffer_size =
+        (send_displs[num_ranks - 1] + send_counts[num_ranks - 1])
+        * sizeof(DataType);
+    const size_t recv_buffer_size =
+        (recv_displs[num_ranks - 1] + recv_counts[num_ranks - 1])
+        * sizeof(DataType);
+    alltoallv(send_buf, send_buffer_size, send_counts, send_displs,
+              recv_buf, recv_buffer_size, recv_counts, recv_displs, stream);
+  }
+
+  void alltoallv(const DataType* send_buf,
+                 size_t send_buffer_size,
+                 const int* send_counts,
+                 const int* send_displs,
+                 DataType* recv_buf,
+                 size_t recv_buffer_size,
+                 const int* recv_counts,
+                 const int* recv_displs,
+                 h2::gpu::DeviceStream stream)
+  {
+    alltoallv(send_buf, send_buffer_size, send_counts, send_displs,
+              recv_buf, recv_buffer_size, recv_counts, recv_displs,
+              util::get_mpi_data_type<DataType>(), stream);
+  }
+
+  template <typename BufType>
+  void alltoallv(const BufType* send_buf,
+                 size_t send_buffer_size,
+                 const int* send_counts,
+                 const int* send_displs,
+                 BufType* recv_buf,
+                 size_t recv_buffer_size,
+                 const int* recv_counts,
+                 const int* recv_displs,
+                 MPI_Datatype type,
+                 h2::gpu::DeviceStream stream)
+  {
 #ifdef DISTCONV_SHFL_USE_CUDA_AWARE
       DISTCONV_CHECK_GPU(cudaStreamSynchronize(stream));
-      MPI_Alltoallv(send_buf,
-                    get_send_counts(is_forward),
-                    get_send_displs_h(is_forward),
-                    util::get_mpi_data_type<DataType>(),
+      alltoallv_mpi(send_buf,
+                    send_counts,
+                    send_displs,
                     recv_buf,
-                    get_recv_counts(is_forward),
-                    get_recv_displs_h(is_forward),
-                    util::get_mpi_data_type<DataType>(),
-                    m_loc.get_comm());
+                    recv_counts,
+                    recv_displs,
+                    type);
 #else
     // manually copying back to host
-    DataType* send_buf_h =
+    BufType* send_buf_h =
         send_buffer_size == 0
             ? nullptr
-            : static_cast<DataType*>(
+            : static_cast<BufType*>(
                 tensor::internal::RuntimeGPU::get_pinned_memory_pool().get(
                     send_buffer_size));
-    DataType* recv_buf_h =
+    BufType* recv_buf_h =
         recv_buffer_size == 0
             ? nullptr
-            : static_cast<DataType*>(
+            : static_cast<BufType*>(
                 internal::RuntimeGPU::get_pinned_memory_pool().get(
                     recv_buffer_size));
 
@@ -377,13 +869,11 @@ class TensorMPICUDAShuffler {
             (void*) send_buf_h, (void*) send_buf, send_buffer_size);
     }
 
-    MPI_Alltoallv(send_buf_h, get_send_counts(is_forward),
-                  get_send_displs_h(is_forward),
-                  util::get_mpi_data_type<DataType>(),
-                  recv_buf_h, get_recv_counts(is_forward),
-                  get_recv_displs_h(is_forward),
-                  util::get_mpi_data_type<DataType>(),
-                  m_loc.get_comm());
+    alltoallv_mpi(send_buf_h, send_counts,
+                  send_displs,
+                  recv_buf_h, recv_counts,
+                  recv_displs,
+                  type);
 
     if (recv_buffer_size > 0) {
         h2::gpu::mem_copy(
@@ -399,11 +889,102 @@ class TensorMPICUDAShuffler {
             recv_buf_h);
     }
 #endif
-    util::MPIPrintStreamDebug() << "Transfer done\n";
+    DISTCONV_LOG_DEBUG(Shuffle) << "Transfer done\n";
+  }
+
+  void alltoallv_mpi(const void *send_buf,
+                     const int *send_counts,
+                     const int *send_displs,
+                     void *recv_buf,
+                     const int *recv_counts,
+                     const int *recv_displs,
+                     MPI_Datatype type) {
+    if (!m_persistent) {
+      DISTCONV_CHECK_MPI(MPI_Alltoallv(send_buf, send_counts, send_displs,
+                                       type, recv_buf, recv_counts,
+                                       recv_displs, type, m_loc.get_comm()));
+      return;
+    }
+    const int num_ranks = m_loc.get_size();
+    std::vector<int> layout;
+    layout.reserve(num_ranks * 4);
+    for (const int *a: {send_counts, send_displs, recv_counts, recv_displs}) {
+      layout.insert(layout.end(), a, a + num_ranks);
+    }
+    auto it = std::find_if(
+        m_persistent_alltoallvs.begin(), m_persistent_alltoallvs.end(),
+        [&](const PersistentAlltoallv &p) {
+          return p.send_buf == send_buf && p.recv_buf == recv_buf
+              && p.type == type && p.layout == layout;
+        });
+    if (it == m_persistent_alltoallvs.end()) {
+      if (m_persistent_comm == MPI_COMM_NULL) {
+        // Collective, as are the transfers
+        DISTCONV_CHECK_MPI(MPI_Comm_dup(m_loc.get_comm(),
+                                        &m_persistent_comm));
+      }
+      if (m_persistent_alltoallvs.size() == max_persistent_alltoallvs) {
+        free_requests(m_persistent_alltoallvs.back());
+        m_persistent_alltoallvs.pop_back();
+      }
+      MPI_Aint lb, extent;
+      DISTCONV_CHECK_MPI(MPI_Type_get_extent(type, &lb, &extent));
+      PersistentAlltoallv p{send_buf, recv_buf, type, std::move(layout), {}};
+      for (int pid = 0; pid < num_ranks; ++pid) {
+        if (recv_counts[pid] == 0) continue;
+        p.requests.emplace_back();
+        DISTCONV_CHECK_MPI(MPI_Recv_init(
+            static_cast<char*>(recv_buf) + recv_displs[pid] * extent,
+            recv_counts[pid], type, pid, 0, m_persistent_comm,
+            &p.requests.back()));
+      }
+      for (int pid = 0; pid < num_ranks; ++pid) {
+        if (send_counts[pid] == 0) continue;
+        p.requests.emplace_back();
+        DISTCONV_CHECK_MPI(MPI_Send_init(
+            static_cast<const char*>(send_buf) + send_displs[pid] * extent,
+            send_counts[pid], type, pid, 0, m_persistent_comm,
+            &p.requests.back()));
+      }
+      m_persistent_alltoallvs.insert(m_persistent_alltoallvs.begin(),
+                                     std::move(p));
+    } else if (it != m_persistent_alltoallvs.begin()) {
+      std::rotate(m_persistent_alltoallvs.begin(), it, it + 1);
+    }
+    auto &requests = m_persistent_alltoallvs.front().requests;
+    if (requests.empty()) return;
+    DISTCONV_CHECK_MPI(MPI_Startall(requests.size(), requests.data()));
+    DISTCONV_CHECK_MPI(MPI_Waitall(requests.size(), requests.data(),
+                                   MPI_STATUSES_IGNORE));
+  }
+
+  static void free_requests(PersistentAlltoallv &p) {
+    for (auto &r: p.requests) {
+      DISTCONV_CHECK_MPI(MPI_Request_free(&r));
+    }
+    p.requests.clear();
+  }
+
+  void free_persistent_requests() {
+    for (auto &p: m_persistent_alltoallvs) {
+      free_requests(p);
+    }
+    m_persistent_alltoallvs.clear();
+    if (m_persistent_comm != MPI_COMM_NULL) {
+      DISTCONV_CHECK_MPI(MPI_Comm_free(&m_persistent_comm));
+    }
+  }
+
+  // Counts a buffer taken from the memory pool for the shuffle
+  static void record_buf(const DataType *buf, size_t size) {
+    util::memory_accounting::OwnerScope owner(
+        util::memory_accounting::Owner::SHUFFLE);
+    util::memory_accounting::record_allocation(buf, size);
   }
 
   virtual void release_buf(DataType *buf) {
     if (buf != nullptr && buf != m_src_buf && buf != m_dst_buf) {
+        util::memory_accounting::record_deallocation(buf);
         distconv::internal::RuntimeGPU::get_device_memory_pool().release(buf);
     }
   }
@@ -480,31 +1061,43 @@ class TensorMPICUDAShuffler {
   }
 
   const int *get_rank_limits_fwd(bool is_forward) const {
-    return is_forward ? m_rank_limits_fwd : m_rank_limits_bwd;
+    return is_forward ? m_plan->m_rank_limits_fwd : m_plan->m_rank_limits_bwd;
   }
   const int *get_rank_limits_bwd(bool is_forward) const {
-    return is_forward ? m_rank_limits_bwd : m_rank_limits_fwd;
+    return is_forward ? m_plan->m_rank_limits_bwd : m_plan->m_rank_limits_fwd;
+  }
+  const int *get_rank_limits_fwd_h(bool is_forward) const {
+    return is_forward ? m_plan->m_rank_limits_fwd_h.data() :
+        m_plan->m_rank_limits_bwd_h.data();
+  }
+  const int *get_rank_limits_bwd_h(bool is_forward) const {
+    return is_forward ? m_plan->m_rank_limits_bwd_h.data() :
+        m_plan->m_rank_limits_fwd_h.data();
   }
 
   const int *get_send_counts(bool is_forward) const {
-    return is_forward ? m_send_counts : m_recv_counts;
+    return is_forward ? m_plan->m_send_counts.data() :
+        m_plan->m_recv_counts.data();
   }
   const int *get_recv_counts(bool is_forward) const {
-    return is_forward ? m_recv_counts : m_send_counts;
+    return is_forward ? m_plan->m_recv_counts.data() :
+        m_plan->m_send_counts.data();
   }
 
   const int *get_send_displs_h(bool is_forward) const {
-    return is_forward ? m_send_displs_h : m_recv_displs_h;
+    return is_forward ? m_plan->m_send_displs_h.data() :
+        m_plan->m_recv_displs_h.data();
   }
   const int *get_recv_displs_h(bool is_forward) const {
-    return is_forward ? m_recv_displs_h : m_send_displs_h;
+    return is_forward ? m_plan->m_recv_displs_h.data() :
+        m_plan->m_send_displs_h.data();
   }
 
   const int *get_send_displs_d(bool is_forward) const {
-    return is_forward ? m_send_displs_d : m_recv_displs_d;
+    return is_forward ? m_plan->m_send_displs_d : m_plan->m_recv_displs_d;
   }
   const int *get_recv_displs_d(bool is_forward) const {
-    return is_forward ? m_recv_displs_d : m_send_displs_d;
+    return is_forward ? m_plan->m_recv_displs_d : m_plan->m_send_displs_d;
   }
 };
 
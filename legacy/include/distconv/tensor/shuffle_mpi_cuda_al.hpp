@@ -28,26 +28,87 @@ class TensorMPICUDAShufflerAL:
  protected:
   Al::NCCLBackend::comm_type &m_al_comm;
 
+  bool is_transfer_stream_ordered() const override {
+    return true;
+  }
+
   void transfer(const DataType* send_buf,
                 size_t send_buffer_size,
                 DataType* recv_buf,
                 size_t recv_buffer_size,
                 bool is_forward,
                 h2::gpu::DeviceStream stream) override
+  {
+      transfer_chunk(send_buf,
+                     this->get_send_counts(is_forward),
+                     this->get_send_displs_h(is_forward),
+                     recv_buf,
+                     this->get_recv_counts(is_forward),
+                     this->get_recv_displs_h(is_forward),
+                     stream);
+  }
+
+  void transfer_chunk(const DataType* send_buf,
+                      const int* send_counts,
+                      const int* send_displs,
+                      DataType* recv_buf,
+                      const int* recv_counts,
+                      const int* recv_displs,
+                      h2::gpu::DeviceStream stream) override
   {
       // Assumes stream is the same as m_al_comm.get_stream()
       std::vector<Al::NCCLBackend::req_type> requests;
       for (int i = 0; i < this->get_num_peers(); ++i)
       {
+          auto peer = this->m_peers[i];
+          // Peers may have nothing to exchange in a chunk
+          if (send_counts[peer] == 0 && recv_counts[peer] == 0)
+          {
+              continue;
+          }
           requests.push_back(Al::NCCLBackend::null_req);
           auto& req = requests.back();
-          auto peer = this->m_peers[i];
           Al::NonblockingSendRecv<Al::NCCLBackend, DataType>(
-              send_buf + this->get_send_displs_h(is_forward)[peer],
-              this->get_send_counts(is_forward)[peer],
+              send_buf + send_displs[peer],
+              send_counts[peer],
+              peer,
+              recv_buf + recv_displs[peer],
+              recv_counts[peer],
+              peer,
+              m_al_comm,
+              req);
+      }
+      for (auto& req : requests)
+      {
+          Al::Wait<Al::NCCLBackend>(req);
+      }
+  }
+
+  // Exchanges the reduced-precision payloads as bytes
+  void transfer_wire(const void* send_buf,
+                     void* recv_buf,
+                     size_t element_size,
+                     bool is_forward,
+                     h2::gpu::DeviceStream stream) override
+  {
+      const int* send_counts = this->get_send_counts(is_forward);
+      const int* send_displs = this->get_send_displs_h(is_forward);
+      const int* recv_counts = this->get_recv_counts(is_forward);
+      const int* recv_displs = this->get_recv_displs_h(is_forward);
+      const auto* send_bytes = static_cast<const unsigned char*>(send_buf);
+      auto* recv_bytes = static_cast<unsigned char*>(recv_buf);
+      std::vector<Al::NCCLBackend::req_type> requests;
+      for (int i = 0; i < this->get_num_peers(); ++i)
+      {
+          auto peer = this->m_peers[i];
+          requests.push_back(Al::NCCLBackend::null_req);
+          auto& req = requests.back();
+          Al::NonblockingSendRecv<Al::NCCLBackend, unsigned char>(
+              send_bytes + send_displs[peer] * element_size,
+              send_counts[peer] * element_size,
               peer,
-              recv_buf + this->get_recv_displs_h(is_forward)[peer],
-              this->get_recv_counts(is_forward)[peer],
+              recv_bytes + recv_displs[peer] * element_size,
+              recv_counts[peer] * element_size,
               peer,
               m_al_comm,
               req);
@@ -31,9 +31,11 @@ class TensorMPICUDAShufflerHybrid:
     m_p2p.close_addrs(m_conns, get_peer_addrs(false), this->get_num_peers());
     delete[] m_conns;
     if (this->m_src_buf_passed) {
+      util::memory_accounting::record_deallocation(this->m_src_buf);
       DISTCONV_CHECK_CUDA(cudaFree(this->m_src_buf));
     }
     if (this->m_dst_buf_passed) {
+      util::memory_accounting::record_deallocation(this->m_dst_buf);
       DISTCONV_CHECK_CUDA(cudaFree(this->m_dst_buf));
     }
     for (int i = 0; i < 2; ++i) {
@@ -55,6 +57,15 @@ class TensorMPICUDAShufflerHybrid:
   cudaStream_t *m_streams;
   std::vector<bool> m_p2p_enabled;
 
+  // Peers write directly to the buffers exposed at setup.
+  bool is_transfer_buffer_independent() const override {
+    return false;
+  }
+
+  bool is_transfer_stream_ordered() const override {
+    return true;
+  }
+
   void **&get_peer_addrs(bool is_forward) {
     return m_peer_addrs[is_forward ? 0 : 1];
   }
@@ -104,7 +115,7 @@ class TensorMPICUDAShufflerHybrid:
   }
 
   void setup() {
-    util::MPIPrintStreamDebug() <<
+    DISTCONV_LOG_DEBUG(Shuffle) <<
         "Setting up P2P connections for shuffling\n";
     int num_peers = this->get_num_peers();
     m_conns = new p2p::P2P::connection_type[num_peers];
@@ -114,7 +125,7 @@ class TensorMPICUDAShufflerHybrid:
     for (int i = 0; i < num_peers; ++i) {
       if (!m_conns[i]) {
         // Set the conn as NULL so that operations are ignored
-        util::MPIPrintStreamDebug()
+        DISTCONV_LOG_DEBUG(Shuffle)
             << "Shuffling with P2P not possible from rank " << this->m_loc.get_rank()
             << " to rank " << this->m_peers[i];
         int null_proc = MPI_PROC_NULL;
@@ -129,11 +140,13 @@ class TensorMPICUDAShufflerHybrid:
       auto buffer_size = TensorMPICUDAShuffler<DataType>::get_buf_size(
           this->m_src_local_shape);
       DISTCONV_CUDA_MALLOC(&this->m_src_buf, buffer_size);
+      this->record_buf(this->m_src_buf, buffer_size);
     }
     if (!this->m_dst_buf_passed) {
       auto buffer_size = TensorMPICUDAShuffler<DataType>::get_buf_size(
           this->m_dst_local_shape);
       DISTCONV_CUDA_MALLOC(&this->m_dst_buf, buffer_size);
+      this->record_buf(this->m_dst_buf, buffer_size);
     }
 
     // setup peer addresses
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "distconv_config.hpp"
+
+#ifdef DISTCONV_HAS_NVSHMEM
+
+#include "distconv/tensor/memory_gpu.hpp"
+#include "distconv/tensor/shuffle_mpi_cuda.hpp"
+#include "distconv/util/nvshmem.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace distconv {
+namespace tensor {
+
+/**
+   Shuffler writing the elements directly to the destination PEs.
+
+   The pack kernel computes the destination of each element as the
+   other shufflers do, but stores it into the receive buffer of the
+   destination PE, which is allocated in the NVSHMEM symmetric heap:
+   through plain stores for peers whose memory is mapped, e.g., over
+   NVLink, and through NVSHMEM puts otherwise. There is no staging
+   send buffer, and the whole shuffle is issued to the stream without
+   host-driven alltoallv. Senders signal the completion of their
+   writes, and receivers signal when their buffer may be overwritten
+   by the next shuffle, both through counters on the symmetric heap.
+
+   The locale of the tensors must span all the PEs, with the ranks
+   matching the PE numbers. Construction is collective over all the
+   PEs as it allocates from the symmetric heap. Only the element types
+   with NVSHMEM puts are supported: float, double, int and long.
+ */
+template <typename DataType>
+class TensorMPICUDAShufflerNVSHMEM:
+      public TensorMPICUDAShuffler<DataType> {
+  using TensorType = typename TensorMPICUDAShuffler<DataType>::TensorType;
+ public:
+  TensorMPICUDAShufflerNVSHMEM(const TensorType &src_tensor,
+                               const TensorType &dst_tensor):
+      TensorMPICUDAShuffler<DataType>(src_tensor, dst_tensor),
+      m_pid(nvshmem_my_pe()), m_np(nvshmem_n_pes()),
+      m_sync(0) {
+    assert_eq(this->m_loc.get_size(), m_np);
+    assert_eq(this->m_loc.get_rank(), m_pid);
+    setup_nvshmem();
+  }
+
+  virtual ~TensorMPICUDAShufflerNVSHMEM() {
+    for (int i = 0; i < 2; ++i) {
+      DISTCONV_CHECK_CUDA(cudaFree(m_put_displs_d[i]));
+      DISTCONV_CHECK_CUDA(cudaFree(m_peer_ptrs_d[i]));
+      DISTCONV_CHECK_CUDA(cudaFree(m_send_peers_d[i]));
+      DISTCONV_CHECK_CUDA(cudaFree(m_recv_peers_d[i]));
+    }
+  }
+
+ protected:
+  int m_pid;
+  int m_np;
+  // Receive buffers of the forward and backward shuffles
+  Memory<NVSHMEMAllocator> m_recv_shmem[2];
+  // Offsets in the receive buffer of each PE of the elements sent
+  // from this PE
+  int *m_put_displs_d[2] = {nullptr, nullptr};
+  // Receive buffers of the PEs mapped to this process, or null for
+  // those written with NVSHMEM puts
+  DataType **m_peer_ptrs_d[2] = {nullptr, nullptr};
+  // Other PEs sent to and received from
+  int *m_send_peers_d[2] = {nullptr, nullptr};
+  int *m_recv_peers_d[2] = {nullptr, nullptr};
+  int m_num_send_peers[2] = {0, 0};
+  int m_num_recv_peers[2] = {0, 0};
+  // Counters of the ready and done signals of each direction, indexed
+  // by the signaling PE
+  util::nvshmem::SyncArray m_sync;
+
+  enum Signal {READY = 0, DONE = 1};
+
+  // Buffers are written by the peers
+  bool is_transfer_buffer_independent() const override {
+    return false;
+  }
+
+  bool is_transfer_stream_ordered() const override {
+    return true;
+  }
+
+  static int get_dir(bool is_forward) {
+    return is_forward ? 0 : 1;
+  }
+
+  void setup_nvshmem() {
+    DISTCONV_LOG_DEBUG(Shuffle) << "Setting up NVSHMEM shuffling\n";
+    // Symmetric allocations must be of the same size at all PEs
+    size_t sizes[2] = {
+      TensorMPICUDAShuffler<DataType>::get_buf_size(this->m_dst_local_shape),
+      TensorMPICUDAShuffler<DataType>::get_buf_size(this->m_src_local_shape)};
+    DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, sizes, 2,
+                                     MPI_UNSIGNED_LONG, MPI_MAX,
+                                     this->m_loc.get_comm()));
+    auto &heap = util::nvshmem::SymmetricHeap::get_instance();
+    for (int i = 0; i < 2; ++i) {
+      sizes[i] = std::max(sizes[i], sizeof(DataType));
+      heap.reserve(sizes[i]);
+    }
+    heap.reserve(4 * m_np * sizeof(util::nvshmem::SyncArray::CounterType));
+    heap.grow();
+    util::memory_accounting::OwnerScope owner(
+        util::memory_accounting::Owner::SHUFFLE);
+    for (int i = 0; i < 2; ++i) {
+      m_recv_shmem[i].allocate(sizes[i]);
+    }
+    m_sync.ensure_size(4 * m_np);
+    setup_peers(true);
+    setup_peers(false);
+  }
+
+  void setup_peers(bool is_forward) {
+    const int dir = get_dir(is_forward);
+    // The offset of the elements from this PE at PE j is its j-th
+    // receive displacement
+    std::vector<int> put_displs(m_np);
+    DISTCONV_CHECK_MPI(MPI_Alltoall(
+        this->get_recv_displs_h(is_forward), 1, MPI_INT,
+        put_displs.data(), 1, MPI_INT, this->m_loc.get_comm()));
+    std::vector<DataType*> peer_ptrs(m_np);
+    for (int pid = 0; pid < m_np; ++pid) {
+      peer_ptrs[pid] = static_cast<DataType*>(
+          nvshmem_ptr(m_recv_shmem[dir].get(), pid));
+    }
+    std::vector<int> send_peers, recv_peers;
+    for (int pid = 0; pid < m_np; ++pid) {
+      if (pid == m_pid) continue;
+      if (this->get_send_counts(is_forward)[pid] != 0) {
+        send_peers.push_back(pid);
+      }
+      if (this->get_recv_counts(is_forward)[pid] != 0) {
+        recv_peers.push_back(pid);
+      }
+    }
+    m_num_send_peers[dir] = send_peers.size();
+    m_num_recv_peers[dir] = recv_peers.size();
+    copy_to_device(m_put_displs_d[dir], put_displs);
+    copy_to_device(m_peer_ptrs_d[dir], peer_ptrs);
+    copy_to_device(m_send_peers_d[dir], send_peers);
+    copy_to_device(m_recv_peers_d[dir], recv_peers);
+  }
+
+  template <typename T>
+  static void copy_to_device(T *&dst, const std::vector<T> &src) {
+    DISTCONV_CUDA_MALLOC(&dst, sizeof(T) * std::max(src.size(), size_t(1)));
+    if (!src.empty()) {
+      DISTCONV_CHECK_CUDA(cudaMemcpy(dst, src.data(), sizeof(T) * src.size(),
+                                     cudaMemcpyHostToDevice));
+    }
+  }
+
+  // No staging buffer is used
+  DataType *get_src_buf(bool is_forward, cudaStream_t=0) override {
+    return nullptr;
+  }
+
+  DataType *get_dst_buf(bool is_forward, cudaStream_t=0) override {
+    return static_cast<DataType*>(m_recv_shmem[get_dir(is_forward)].get());
+  }
+
+  void release_buf(DataType *buf) override {
+    // Buffers are reused without releasing
+    return;
+  }
+
+  // Notifies the PEs signaled by this PE and waits for the signals of
+  // the others. The receivers signal READY and the senders DONE.
+  void signal(Signal sig, bool is_forward, cudaStream_t stream);
+
+  // Waits until the receivers are ready, and writes the elements to
+  // them. send_buf is not used.
+  void pack_tensor(const DataType *src,
+                   DataType *send_buf,
+                   cudaStream_t stream,
+                   bool is_forward) override;
+
+  // Completes the writes of this PE and waits for those of the others
+  void transfer(const DataType *send_buf,
+                size_t send_buffer_size,
+                DataType *recv_buf,
+                size_t recv_buffer_size,
+                bool is_forward, cudaStream_t stream) override {
+    nvshmemx_quiet_on_stream(stream);
+    signal(DONE, is_forward, stream);
+  }
+};
+
+} // namespace tensor
+} // namespace distconv
+
+#endif // DISTCONV_HAS_NVSHMEM
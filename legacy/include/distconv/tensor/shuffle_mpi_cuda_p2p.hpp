@@ -28,9 +28,11 @@ class TensorMPICUDAShufflerP2P:
     m_p2p.close_addrs(m_conns, get_peer_addrs(false), this->get_num_peers());
     delete[] m_conns;
     if (this->m_src_buf_passed) {
+      util::memory_accounting::record_deallocation(this->m_src_buf);
       DISTCONV_CHECK_CUDA(cudaFree(this->m_src_buf));
     }
     if (this->m_dst_buf_passed) {
+      util::memory_accounting::record_deallocation(this->m_dst_buf);
       DISTCONV_CHECK_CUDA(cudaFree(this->m_dst_buf));
     }
     for (int i = 0; i < 2; ++i) {
@@ -52,6 +54,15 @@ class TensorMPICUDAShufflerP2P:
   cudaStream_t *m_streams;
   cudaEvent_t m_ev;
 
+  // Peers write directly to the buffers exposed at setup.
+  bool is_transfer_buffer_independent() const override {
+    return false;
+  }
+
+  bool is_transfer_stream_ordered() const override {
+    return true;
+  }
+
   void **&get_peer_addrs(bool is_forward) {
     return m_peer_addrs[is_forward ? 0 : 1];
   }
@@ -101,7 +112,7 @@ class TensorMPICUDAShufflerP2P:
   }
 
   void setup_p2p_connections() {
-    util::MPIPrintStreamDebug() <<
+    DISTCONV_LOG_DEBUG(Shuffle) <<
         "Setting up P2P connections for shuffling\n";
     int num_peers = this->get_num_peers();
     m_conns = new p2p::P2P::connection_type[num_peers];
@@ -111,11 +122,13 @@ class TensorMPICUDAShufflerP2P:
       auto buffer_size = TensorMPICUDAShuffler<DataType>::get_buf_size(
           this->m_src_local_shape);
       DISTCONV_CUDA_MALLOC(&this->m_src_buf, buffer_size);
+      this->record_buf(this->m_src_buf, buffer_size);
     }
     if (!this->m_dst_buf_passed) {
       auto buffer_size = TensorMPICUDAShuffler<DataType>::get_buf_size(
           this->m_dst_local_shape);
       DISTCONV_CUDA_MALLOC(&this->m_dst_buf, buffer_size);
+      this->record_buf(this->m_dst_buf, buffer_size);
     }
 
     // setup peer addresses
@@ -191,7 +204,7 @@ class TensorMPICUDAShufflerP2P:
       int i = ((my_rank % 4) + 2) % 4;
       auto &conn = m_conns[i];
       if (this->get_send_counts(is_forward)[this->m_peers[i]] != 0) {
-        util::MPIPrintStreamDebug() <<
+        DISTCONV_LOG_DEBUG(Shuffle) <<
             "Putting to " << conn->get_peer() << "\n";
         conn->put(send_buf +
                   this->get_send_displs_h(is_forward)[conn->get_peer()],
@@ -208,7 +221,7 @@ class TensorMPICUDAShufflerP2P:
       i = (i - (i % 2) + 2 + ((i % 2) ^ 1)) % 4;
       auto &conn = m_conns[i];
       if (this->get_send_counts(is_forward)[this->m_peers[i]] != 0) {
-        util::MPIPrintStreamDebug() <<
+        DISTCONV_LOG_DEBUG(Shuffle) <<
             "Putting to " << conn->get_peer() << "\n";
         conn->put(send_buf
                   + this->get_send_displs_h(is_forward)[conn->get_peer()],
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/tensor.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace distconv {
+namespace tensor {
+
+/*
+  Rank limits, counts and displacements of shuffling between two
+  tensors. They only depend on the shapes and distributions of the
+  tensors, so shufflers of the same pair of tensors, including those of
+  different data types and transfer methods, use the same plan.
+ */
+struct ShufflePlan {
+  // Offsets in src tensor for each dst locale. Used in
+  // packing. Linearized to a 1D array.
+  int *m_rank_limits_fwd = nullptr;
+  // Offsets in dst tensor for each src locale. Used in
+  // packing. Linearized to a 1D array.
+  int *m_rank_limits_bwd = nullptr;
+  // Host copies of the rank limits
+  std::vector<int> m_rank_limits_fwd_h;
+  std::vector<int> m_rank_limits_bwd_h;
+  std::vector<int> m_send_counts;
+  std::vector<int> m_recv_counts;
+  std::vector<int> m_send_displs_h;
+  std::vector<int> m_recv_displs_h;
+  int *m_send_displs_d = nullptr;
+  int *m_recv_displs_d = nullptr;
+  // Ranks with non-zero send or recv counts
+  std::vector<int> m_peers;
+
+  ShufflePlan() = default;
+  ShufflePlan(const ShufflePlan &) = delete;
+  ShufflePlan &operator=(const ShufflePlan &) = delete;
+
+  ~ShufflePlan() {
+    for (auto p: {m_rank_limits_fwd, m_rank_limits_bwd,
+                  m_send_displs_d, m_recv_displs_d}) {
+      if (p) {
+        DISTCONV_CHECK_GPU(GPU_FREE(p));
+      }
+    }
+  }
+};
+
+/*
+  Plans of the shuffles set up recently by this process. The least
+  recently used one is evicted when the cache is full. Shufflers keep
+  their plans alive after eviction. The capacity is set by
+  DISTCONV_SHUFFLE_PLAN_CACHE_SIZE, and 0 disables caching.
+ */
+class ShufflePlanCache {
+ public:
+  using PlanPtr = std::shared_ptr<const ShufflePlan>;
+
+  // Never destroyed, as the plans must not be freed after the GPU
+  // runtime is shut down. Call clear() to free them earlier.
+  static ShufflePlanCache &get_instance() {
+    static ShufflePlanCache *cache = new ShufflePlanCache();
+    return *cache;
+  }
+
+  // Identifies the plan of shuffling from src_tensor to dst_tensor
+  // on this process
+  template <typename TensorType>
+  static std::string get_key(const TensorType &src_tensor,
+                             const TensorType &dst_tensor) {
+    std::stringstream ss;
+    ss << "rank=" << src_tensor.get_locale().get_rank()
+       << " size=" << src_tensor.get_locale().get_size();
+    for (const auto *t: {&src_tensor, &dst_tensor}) {
+      const auto &dist = t->get_distribution();
+      ss << " | shape=" << t->get_shape()
+         << " local_shape=" << t->get_local_shape()
+         << " requested_local_shape=" << t->get_requested_local_shape()
+         << " requested_local_block=" << t->get_requested_local_block()
+         << " locale_shape=" << dist.get_locale_shape()
+         << " split_shape=" << dist.get_split_shape()
+         << " overlap=" << dist.get_overlap()
+         << " block_size=" << dist.get_block_size();
+    }
+    return ss.str();
+  }
+
+  PlanPtr find(const std::string &key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+      return nullptr;
+    }
+    // Move to the front as the most recently used
+    m_plans.splice(m_plans.begin(), m_plans, it->second);
+    return it->second->second;
+  }
+
+  void insert(const std::string &key, PlanPtr plan) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_capacity == 0 || m_index.count(key)) {
+      return;
+    }
+    if (m_plans.size() == m_capacity) {
+      m_index.erase(m_plans.back().first);
+      m_plans.pop_back();
+    }
+    m_plans.emplace_front(key, std::move(plan));
+    m_index[key] = m_plans.begin();
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_index.clear();
+    m_plans.clear();
+  }
+
+ private:
+  size_t m_capacity;
+  // Shufflers may be set up by concurrent threads
+  std::mutex m_mutex;
+  // Most recently used first
+  std::list<std::pair<std::string, PlanPtr>> m_plans;
+  std::unordered_map<std::string, decltype(m_plans)::iterator> m_index;
+
+  ShufflePlanCache(): m_capacity(64) {
+    if (const char *env = std::getenv("DISTCONV_SHUFFLE_PLAN_CACHE_SIZE")) {
+      m_capacity = std::max(std::atoi(env), 0);
+      util::MPIRootPrintStreamInfo()
+          << "Shuffle plan cache size: " << m_capacity;
+    }
+  }
+};
+
+} // namespace tensor
+} // namespace distconv
@@ -9,6 +9,7 @@
 #include <iostream>
 #include <exception>
 
+#include "distconv/tensor/allreduce.hpp"
 #include "distconv/tensor/tensor_base.hpp"
 #include "distconv/tensor/memory.hpp"
 #include "distconv/tensor/distribution.hpp"
@@ -88,8 +89,10 @@ class Tensor: public AbstractTensor {
     m_locale = t.m_locale;
     m_dist = t.m_dist;
     m_is_view = t.m_is_view;
+    m_layout = t.m_layout;
     m_data = t.m_data;
     m_impl = TensorImplType(this, t.m_impl);
+    increment_halo_version();
     check_shape_validity();
     return *this;
   }
@@ -99,8 +102,8 @@ class Tensor: public AbstractTensor {
       m_shape(t.m_shape), m_requested_local_shape(t.m_requested_local_shape),
       m_requested_local_block(t.m_requested_local_block),
       m_locale(t.m_locale), m_dist(t.m_dist),
-      m_is_view(t.m_is_view), m_data(t.m_data),
-      m_impl(this, t.m_impl) {
+      m_is_view(t.m_is_view), m_layout(t.m_layout), m_data(t.m_data),
+      m_impl(this, t.m_impl), m_halo_version(t.m_halo_version) {
     check_shape_validity();
   }
 
@@ -396,6 +399,24 @@ class Tensor: public AbstractTensor {
     return m_is_view;
   }
 
+  Layout get_layout() const {
+    return m_layout;
+  }
+
+  // Only changes the interpretation of the dimensions; the shape must
+  // already be in the order of the layout.
+  void set_layout(Layout layout) {
+    m_layout = layout;
+  }
+
+  int get_channel_dim() const {
+    return tensor::get_channel_dim(m_layout, get_num_dims());
+  }
+
+  int get_spatial_dim(int i) const {
+    return tensor::get_spatial_dim(m_layout, i);
+  }
+
   size_t get_size() const {
     return m_shape.size();
   }
@@ -414,10 +435,12 @@ class Tensor: public AbstractTensor {
           "Empty locale shape: " << m_dist.get_locale_shape();
       return -1;
     }
+    increment_halo_version();
     return m_impl.allocate();
   }
 
   int nullify() {
+    increment_halo_version();
     m_impl.nullify();
     return 0;
   }
@@ -510,9 +533,28 @@ class Tensor: public AbstractTensor {
   void clear_halo(int dim,
                   typename Stream<Allocator>::type stream=
                   Stream<Allocator>::default_value) {
+    increment_halo_version();
     m_impl.clear_halo(dim, stream);
   }
 
+  /*
+    Version of the halo, which changes whenever the halo may no longer
+    hold the data exchanged into it, so that layers can tell whether
+    a halo they exchanged is still valid. Exchanges keep it as they
+    fill the halo with the data of the neighbors. It is changed by
+    allocation, views, and clear_halo, and must be changed with
+    increment_halo_version by whoever overwrites the tensor otherwise,
+    e.g., by reusing its buffer for another tensor. The processes
+    exchanging halos with each other must change it alike.
+  */
+  std::uint64_t get_halo_version() const {
+    return m_halo_version;
+  }
+
+  void increment_halo_version() {
+    ++m_halo_version;
+  }
+
   std::ostream &print(std::ostream &os) const {
     std::stringstream ss;
     ss << "(";
@@ -524,6 +566,7 @@ class Tensor: public AbstractTensor {
     PrintLocale(ss, m_locale);
     ss << ", dist: " << m_dist
        << ", is_view?: " << m_is_view
+       << ", layout: " << m_layout
        << ", data: " << m_data
        << ")";
     os << ss.str();
@@ -566,9 +609,13 @@ class Tensor: public AbstractTensor {
   //! Indicates whether this is a view
   bool m_is_view = false;
 
+  Layout m_layout = Layout::CHANNELS_FIRST;
+
   Memory<Allocator> m_data;
   TensorImplType m_impl;
 
+  std::uint64_t m_halo_version = 0;
+
   void check_shape_validity() const {
     auto shape_nd = m_shape.num_dims();
     auto dist_nd = m_dist.num_dims();
@@ -604,6 +651,7 @@ class Tensor: public AbstractTensor {
   void set_view(const Memory<Allocator> &parent_mem) {
     m_data.alias(parent_mem);
     m_is_view = true;
+    increment_halo_version();
   }
 
   void set_view(void *raw_ptr) {
@@ -612,6 +660,7 @@ class Tensor: public AbstractTensor {
                  sizeof(DataType) * get_local_real_shape()[0],
                  sizeof(DataType) * get_local_real_shape()[0]);
     m_is_view = true;
+    increment_halo_version();
   }
 
   void set_view(const void *raw_ptr) {
@@ -620,6 +669,16 @@ class Tensor: public AbstractTensor {
                  sizeof(DataType) * get_local_real_shape()[0],
                  sizeof(DataType) * get_local_real_shape()[0]);
     m_is_view = true;
+    increment_halo_version();
+  }
+
+  // Aliases pitched memory whose rows are pitch elements apart
+  void set_view(void *raw_ptr, size_t pitch) {
+    m_data.alias(raw_ptr, sizeof(DataType) * get_local_real_size(),
+                 sizeof(DataType) * get_local_real_shape()[0],
+                 sizeof(DataType) * pitch);
+    m_is_view = true;
+    increment_halo_version();
   }
 
   void copyin(const void *m) {
@@ -637,19 +696,49 @@ class Tensor: public AbstractTensor {
   /*
     Allreduces shared regions.
 
-    Shared regions are splits that have multiple locales.
+    Shared regions are splits that have multiple locales. Only the
+    local elements outside of the halo are reduced. This version
+    blocks on MPI; the one taking a stream orders the reduction of
+    device tensors on it instead.
   */
   void allreduce_shared_regions() {
     this->m_impl.allreduce_shared_regions();
     return;
   }
 
+  void allreduce_shared_regions(typename Stream<Allocator>::type stream) {
+    this->m_impl.allreduce_shared_regions(stream);
+  }
+
   /*
     Allreduces along dims.
   */
   void allreduce(const std::vector<int> &dims) {
     this->m_impl.allreduce(dims);
   }
+
+  void allreduce(const std::vector<int> &dims,
+                 typename Stream<Allocator>::type stream) {
+    this->m_impl.allreduce(dims, stream);
+  }
+
+  /*
+    Allreduces the local elements outside of the halo with ar, which
+    must be set up over get_shared_region_locale() or
+    get_reduction_locale(dims), e.g. to use NVSHMEM.
+  */
+  void allreduce(Allreduce<DataType> &ar,
+                 typename Stream<Allocator>::type stream) {
+    this->m_impl.allreduce(ar, stream);
+  }
+
+  auto get_shared_region_locale() const {
+    return this->m_impl.get_shared_region_locale();
+  }
+
+  auto get_reduction_locale(const std::vector<int> &dims) const {
+    return this->m_impl.get_reduction_locale(dims);
+  }
 };
 
 template <typename DataType, typename Locale, typename Allocator>
@@ -3,6 +3,10 @@
 #include "distconv/util/util.hpp"
 #include "distconv/base.hpp"
 #include "distconv/vector.hpp"
+#include "h2/utils/IntegerMath.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <initializer_list>
 #include <assert.h>
 #include <vector>
@@ -11,6 +15,10 @@
 #include <iterator>
 #include <numeric>
 
+#if H2_HAS_OPENMP
+#include <omp.h>
+#endif
+
 #if defined(__CUDACC__) || __HIP__
 #define TENSOR_FUNC_DECL __host__ __device__
 #else
@@ -238,6 +246,54 @@ inline std::ostream &operator<<(std::ostream &os, const Array<ND, DataType> &s)
   return os << ss.str();
 }
 
+/**
+   A shape whose extents carry precomputed divisors, so that kernels
+   decompose linear offsets into indices with multiplies and shifts
+   instead of integer divisions. Built on the host.
+
+   IType bounds the offsets that can be decomposed; use uint64_t when
+   they may exceed 32 bits.
+ */
+template <int ND, typename IType=uint32_t>
+struct FastDivShape {
+ public:
+  static constexpr int num_dims = ND;
+  using FastDiv = h2::FastDiv<IType>;
+
+  FastDivShape() = default;
+  template <typename ShapeType>
+  explicit FastDivShape(const ShapeType &shape): size(1) {
+    // Nothing is decomposed over an empty shape, but FastDiv needs a
+    // positive divisor.
+    for (int i = 0; i < ND; ++i) {
+      dims[i] = FastDiv(shape[i] > 0 ? static_cast<IType>(shape[i]) : 1);
+      size *= static_cast<IType>(shape[i]);
+    }
+  }
+
+  // Extents of empty dimensions read as 1.
+  TENSOR_FUNC_DECL IType operator[](int i) const {
+    return dims[i];
+  }
+
+  TENSOR_FUNC_DECL IType get_size() const {
+    return size;
+  }
+
+  // Splits offset into its index along dimension i, returned, and the
+  // offset over the outer dimensions, stored back to offset.
+  TENSOR_FUNC_DECL IType divmod(int i, IType &offset) const {
+    IType q, r;
+    dims[i].divmod(offset, q, r);
+    offset = q;
+    return r;
+  }
+
+ private:
+  FastDiv dims[ND];
+  IType size = 0;
+};
+
 template <int ND, typename DataType>
 inline Array<ND, DataType> MakeArray(const std::vector<DataType> &v) {
   assert_always(ND == v.size());
@@ -606,5 +662,160 @@ inline IndexVector get_strides(const Shape &logical_shape,
   return strides;
 }
 
+/**
+   Copies a region of shape between host buffers with the given
+   strides, in elements. The leading dimensions that are packed in
+   both buffers form runs copied with memcpy, and large regions are
+   split over OpenMP threads along the other dimensions.
+ */
+template <typename DataType>
+void copy_region_host(DataType *dst, const IndexVector &dst_strides,
+                      const DataType *src, const IndexVector &src_strides,
+                      const Shape &shape) {
+  if (shape.is_empty()) return;
+  const int nd = shape.num_dims();
+  int inner = 0;
+  index_t run = 1;
+  while (inner < nd && dst_strides[inner] == run &&
+         src_strides[inner] == run) {
+    run *= shape[inner];
+    ++inner;
+  }
+  Shape outer(shape);
+  for (int i = 0; i < inner; ++i) {
+    outer[i] = 1;
+  }
+  const index_t num_runs = outer.size();
+  const size_t run_bytes = run * sizeof(DataType);
+  // Threads only pay off with enough to copy each
+  constexpr size_t min_bytes_per_chunk = 1 << 20;
+  index_t num_chunks = 1;
+#if H2_HAS_OPENMP
+  num_chunks = std::min<index_t>(
+      std::min<index_t>(omp_get_max_threads(), num_runs),
+      num_runs * run_bytes / min_bytes_per_chunk);
+  num_chunks = std::max<index_t>(num_chunks, 1);
+#pragma omp parallel for schedule(static) if (num_chunks > 1)
+#endif
+  for (index_t c = 0; c < num_chunks; ++c) {
+    const index_t begin = num_runs * c / num_chunks;
+    const index_t end = num_runs * (c + 1) / num_chunks;
+    IndexVector idx = outer.get_index(begin);
+    index_t dst_offset = 0;
+    index_t src_offset = 0;
+    for (int i = inner; i < nd; ++i) {
+      dst_offset += idx[i] * dst_strides[i];
+      src_offset += idx[i] * src_strides[i];
+    }
+    for (index_t r = begin; r < end; ++r) {
+      std::memcpy(dst + dst_offset, src + src_offset, run_bytes);
+      for (int i = inner; i < nd; ++i) {
+        dst_offset += dst_strides[i];
+        src_offset += src_strides[i];
+        if (++idx[i] < shape[i]) break;
+        dst_offset -= shape[i] * dst_strides[i];
+        src_offset -= shape[i] * src_strides[i];
+        idx[i] = 0;
+      }
+    }
+  }
+}
+
+/**
+   Position of the channel dimension of activation tensors.
+
+   Tensor dimensions are ordered from the innermost one. A
+   CHANNELS_FIRST tensor has the shape of (W, H, C, N), i.e., it is
+   stored in NCHW order. A CHANNELS_LAST tensor has the shape of (C,
+   W, H, N) and is stored in NHWC order, which the tensor-core kernels
+   of cuDNN use without transposing. As the dimensions still describe
+   the memory order, halo exchanges and shuffles work on either
+   layout unchanged.
+ */
+enum class Layout {CHANNELS_FIRST, CHANNELS_LAST};
+
+inline std::ostream &operator<<(std::ostream &os, Layout layout) {
+  return os << (layout == Layout::CHANNELS_FIRST ?
+                "CHANNELS_FIRST" : "CHANNELS_LAST");
+}
+
+TENSOR_FUNC_DECL
+inline int get_channel_dim(Layout layout, int num_dims) {
+  return layout == Layout::CHANNELS_FIRST ? num_dims - 2 : 0;
+}
+
+// Tensor dimension of the i-th spatial dimension
+TENSOR_FUNC_DECL
+inline int get_spatial_dim(Layout layout, int i) {
+  return layout == Layout::CHANNELS_FIRST ? i : i + 1;
+}
+
+// Inverse of get_spatial_dim
+TENSOR_FUNC_DECL
+inline int get_spatial_index(Layout layout, int dim) {
+  return layout == Layout::CHANNELS_FIRST ? dim : dim - 1;
+}
+
+// Dimension of the CHANNELS_FIRST tensor corresponding to dim
+TENSOR_FUNC_DECL
+inline int get_channels_first_dim(Layout layout, int num_dims, int dim) {
+  if (layout == Layout::CHANNELS_FIRST || dim == num_dims - 1) {
+    return dim;
+  }
+  return dim == 0 ? num_dims - 2 : dim - 1;
+}
+
+// Permute a per-dimension vector, e.g., a shape or strides, into the
+// order of CHANNELS_FIRST tensors
+template <typename VectorType>
+inline VectorType to_channels_first(Layout layout, const VectorType &v,
+                                    int num_dims) {
+  VectorType x(v);
+  for (int i = 0; i < num_dims; ++i) {
+    x[get_channels_first_dim(layout, num_dims, i)] = v[i];
+  }
+  return x;
+}
+
+// The DNN libraries convolve and pool no fewer than two spatial
+// dimensions, so tensors with one are described as 2D ones with a
+// unit dimension next to the spatial one. v is a channels-first
+// vector, e.g., a shape, and x is the value of the unit dimension.
+template <typename VectorType, typename T>
+inline VectorType insert_unit_spatial_dim(const VectorType &v, T x) {
+  VectorType r;
+  bool first = true;
+  for (const auto &e: v) {
+    r.push_back(e);
+    if (first) {
+      r.push_back(x);
+      first = false;
+    }
+  }
+  return r;
+}
+
+// Stride of the dimension inserted by insert_unit_spatial_dim into
+// channels-first strides: that of the next dimension in memory, so
+// packed tensors remain packed. extent is that of the spatial
+// dimension.
+template <typename VectorType>
+inline index_t get_unit_spatial_stride(const VectorType &strides,
+                                       index_t extent) {
+  index_t spatial_stride = 0;
+  index_t next_stride = 0;
+  bool first = true;
+  for (const auto &e: strides) {
+    const index_t s = e;
+    if (first) {
+      spatial_stride = s;
+      first = false;
+    } else if (s > spatial_stride && (next_stride == 0 || s < next_stride)) {
+      next_stride = s;
+    }
+  }
+  return next_stride == 0 ? spatial_stride * extent : next_stride;
+}
+
 } // namespace tensor
 } // namespace distconv
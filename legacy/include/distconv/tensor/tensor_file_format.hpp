@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <type_traits>
+#include <vector>
+
+/*
+  The self-describing binary format of the tensor files written by
+  WriteFile. A file starts with a TensorFileHeader, followed by the
+  global shape and the chunk index, i.e., the global offset and shape
+  of the part written by each rank, as int64 values. The elements start
+  at data_offset, aligned to TENSOR_FILE_ALIGNMENT, in the order of
+  their global offset with the first dimension fastest, so that a file
+  can be read into any distribution of a tensor of the same shape.
+ */
+
+namespace distconv {
+namespace tensor {
+
+enum class TensorFileDataType: uint32_t {
+  OTHER = 0, FLOAT32, FLOAT64, INT32, INT64, UINT16
+};
+
+template <typename DataType>
+constexpr TensorFileDataType get_tensor_file_data_type() {
+  if (std::is_same<DataType, float>::value) {
+    return TensorFileDataType::FLOAT32;
+  } else if (std::is_same<DataType, double>::value) {
+    return TensorFileDataType::FLOAT64;
+  } else if (std::is_integral<DataType>::value &&
+             std::is_signed<DataType>::value && sizeof(DataType) == 4) {
+    return TensorFileDataType::INT32;
+  } else if (std::is_integral<DataType>::value &&
+             std::is_signed<DataType>::value && sizeof(DataType) == 8) {
+    return TensorFileDataType::INT64;
+  } else if (std::is_integral<DataType>::value &&
+             !std::is_signed<DataType>::value && sizeof(DataType) == 2) {
+    return TensorFileDataType::UINT16;
+  }
+  return TensorFileDataType::OTHER;
+}
+
+constexpr char TENSOR_FILE_MAGIC[8] = {'D', 'C', 'T', 'E', 'N', 'S', 'O', 'R'};
+constexpr uint32_t TENSOR_FILE_VERSION = 1;
+// Aligns the elements to file system blocks
+constexpr uint64_t TENSOR_FILE_ALIGNMENT = 4096;
+
+struct TensorFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t data_type;
+  uint32_t element_size;
+  uint32_t num_dims;
+  uint64_t num_chunks;
+  uint64_t data_offset;
+};
+
+static_assert(sizeof(TensorFileHeader) == 40,
+              "TensorFileHeader must not be padded");
+
+inline uint64_t get_tensor_file_data_offset(int num_dims,
+                                            uint64_t num_chunks) {
+  const uint64_t size = sizeof(TensorFileHeader) +
+      sizeof(int64_t) * num_dims * (1 + 2 * num_chunks);
+  return (size + TENSOR_FILE_ALIGNMENT - 1) / TENSOR_FILE_ALIGNMENT *
+      TENSOR_FILE_ALIGNMENT;
+}
+
+/**
+   Everything in a tensor file before its elements. chunks holds the
+   global offset and then the shape of each chunk.
+ */
+template <typename DataType>
+std::vector<char> make_tensor_file_header(
+    const std::vector<int64_t> &shape, const std::vector<int64_t> &chunks) {
+  const int nd = shape.size();
+  TensorFileHeader h;
+  std::memcpy(h.magic, TENSOR_FILE_MAGIC, sizeof(h.magic));
+  h.version = TENSOR_FILE_VERSION;
+  h.data_type = static_cast<uint32_t>(get_tensor_file_data_type<DataType>());
+  h.element_size = sizeof(DataType);
+  h.num_dims = nd;
+  h.num_chunks = nd == 0 ? 0 : chunks.size() / (2 * nd);
+  h.data_offset = get_tensor_file_data_offset(nd, h.num_chunks);
+  std::vector<char> buf(h.data_offset, 0);
+  char *p = buf.data();
+  std::memcpy(p, &h, sizeof(h));
+  p += sizeof(h);
+  std::memcpy(p, shape.data(), sizeof(int64_t) * shape.size());
+  p += sizeof(int64_t) * shape.size();
+  std::memcpy(p, chunks.data(), sizeof(int64_t) * chunks.size());
+  return buf;
+}
+
+/**
+   Reads the header and the global shape of a tensor file from is,
+   leaving it at the chunk index. Returns false if is does not start
+   with a tensor file header.
+ */
+inline bool read_tensor_file_header(std::istream &is, TensorFileHeader &h,
+                                    std::vector<int64_t> &shape) {
+  if (!is.read(reinterpret_cast<char*>(&h), sizeof(h)) ||
+      std::memcmp(h.magic, TENSOR_FILE_MAGIC, sizeof(h.magic)) != 0) {
+    return false;
+  }
+  shape.resize(h.num_dims);
+  return static_cast<bool>(is.read(reinterpret_cast<char*>(shape.data()),
+                                   sizeof(int64_t) * h.num_dims));
+}
+
+} // namespace tensor
+} // namespace distconv
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/memory_gpu.hpp"
+#include "distconv/tensor/runtime_gpu.hpp"
+#include "distconv/tensor/tensor_file_reader.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+#include "h2/utils/HelperThreads.hpp"
+
+#include <future>
+#include <string>
+
+namespace distconv
+{
+namespace tensor
+{
+
+/** @brief Loads the local regions of device tensors from a tensor
+ *  file, reading the next samples while the current ones are in use.
+ *
+ *  prefetch() reads the local region and halo of a tensor in the
+ *  background, through the mapped file of TensorFileReader, into one
+ *  of two pinned staging buffers. load() waits for that read and
+ *  copies the buffer to the tensor asynchronously on a stream, so the
+ *  read of the next mini-batch, started right after, overlaps both
+ *  the copy and the step using the current one. A staging buffer is
+ *  refilled only once its previous copy is done.
+ *
+ *  All tensors loaded must have the distribution and local shape of
+ *  the tensor given to the constructor.
+ */
+template <typename DataType>
+class TensorFileLoader
+{
+public:
+    using TensorType = Tensor<DataType, LocaleMPI, CUDAAllocator>;
+
+    TensorFileLoader(const std::string& path, const TensorType& t)
+        : m_reader(path),
+          m_buf_size(t.get_local_real_size() * sizeof(DataType))
+    {
+        for (int k = 0; k < 2; ++k)
+        {
+            m_bufs[k] = static_cast<DataType*>(
+                internal::RuntimeGPU::get_pinned_memory_pool().get(
+                    m_buf_size));
+            m_events[k] = h2::gpu::make_event_notiming();
+        }
+    }
+
+    TensorFileLoader(const TensorFileLoader&) = delete;
+    TensorFileLoader& operator=(const TensorFileLoader&) = delete;
+
+    ~TensorFileLoader()
+    {
+        if (m_pending.valid())
+        {
+            m_pending.wait();
+        }
+        for (int k = 0; k < 2; ++k)
+        {
+            h2::gpu::sync(m_events[k]);
+            h2::gpu::destroy(m_events[k]);
+            internal::RuntimeGPU::get_pinned_memory_pool().release(m_bufs[k]);
+        }
+    }
+
+    const TensorFileReader& get_reader() const { return m_reader; }
+
+    /** @brief Start reading the samples of t from first_sample on;
+     *  t must be kept until load().
+     */
+    void prefetch(const TensorType& t, index_t first_sample)
+    {
+        assert_always(!m_pending.valid());
+        assert_always(t.get_local_real_size() * sizeof(DataType)
+                      == m_buf_size);
+        const int k = m_next;
+        m_next ^= 1;
+        // The last copy out of the buffer must be done
+        h2::gpu::sync(m_events[k]);
+        m_pending_buf = k;
+        m_pending = std::async(
+            std::launch::async, [this, &t, first_sample, k]() {
+                h2::register_helper_thread();
+                m_reader.read(t, first_sample, m_bufs[k]);
+            });
+    }
+
+    /** @brief Copy the prefetched samples into t on stream. */
+    void load(TensorType& t, h2::gpu::DeviceStream stream)
+    {
+        assert_always(m_pending.valid());
+        m_pending.get();
+        const int k = m_pending_buf;
+        auto& data = t.get_data();
+        CUDAAllocator::copyin(data.get(),
+                              m_bufs[k],
+                              data.get_size(),
+                              data.get_pitch(),
+                              data.get_ldim(),
+                              stream);
+        DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(m_events[k], stream));
+    }
+
+private:
+    TensorFileReader m_reader;
+    size_t m_buf_size;
+    DataType* m_bufs[2];
+    h2::gpu::DeviceEvent m_events[2];
+    int m_next = 0;
+    int m_pending_buf = 0;
+    std::future<void> m_pending;
+};
+
+} // namespace tensor
+} // namespace distconv
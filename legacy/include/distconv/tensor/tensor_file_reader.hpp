@@ -0,0 +1,179 @@
+#pragma once
+
+#include "distconv/tensor/tensor_base.hpp"
+#include "distconv/tensor/tensor_file_format.hpp"
+#include "distconv/util/util.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace distconv {
+namespace tensor {
+
+/**
+   Reads the local regions of distributed tensors, halo included, from
+   a tensor file mapped into memory. Each rank thus reads only what it
+   holds instead of a root reading whole samples and shuffling them
+   out. The last dimension of the file is the sample dimension of a
+   dataset; the tensors read have the shape of the file but for their
+   number of samples, e.g. a mini-batch.
+ */
+class TensorFileReader {
+ public:
+  explicit TensorFileReader(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+      util::PrintStreamError() << "Failed to open " << path;
+      if (fd >= 0) ::close(fd);
+      throw std::exception();
+    }
+    m_size = st.st_size;
+    m_ptr = m_size == 0 ? MAP_FAILED
+        : ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m_ptr == MAP_FAILED || m_size < sizeof(m_header) ||
+        std::memcmp(m_ptr, TENSOR_FILE_MAGIC, sizeof(TENSOR_FILE_MAGIC))) {
+      util::PrintStreamError() << path << " is not a tensor file";
+      unmap();
+      throw std::exception();
+    }
+    std::memcpy(&m_header, m_ptr, sizeof(m_header));
+    m_shape.resize(m_header.num_dims);
+    std::memcpy(m_shape.data(), get_bytes() + sizeof(m_header),
+                sizeof(int64_t) * m_header.num_dims);
+    // Regions are read piecewise in no particular order
+    ::madvise(m_ptr, m_size, MADV_RANDOM);
+  }
+
+  TensorFileReader(const TensorFileReader&) = delete;
+  TensorFileReader& operator=(const TensorFileReader&) = delete;
+
+  ~TensorFileReader() {
+    unmap();
+  }
+
+  const std::vector<int64_t> &get_shape() const {
+    return m_shape;
+  }
+
+  index_t get_num_samples() const {
+    return m_shape.empty() ? 0 : m_shape.back();
+  }
+
+  /**
+     Reads the local region of t and its halo for the samples from
+     first_sample on into buf, laid out as the unpitched local buffer
+     of t. The halo outside of the tensor is zeroed.
+   */
+  template <typename TensorType>
+  void read(const TensorType &t, index_t first_sample,
+            typename TensorType::data_type *buf) const {
+    using DataType = typename TensorType::data_type;
+    check<DataType>(t, first_sample);
+    const int nd = t.get_num_dims();
+    const auto local_shape = t.get_local_shape();
+    const auto real_shape = t.get_local_real_shape();
+    const auto global_index = t.get_global_index();
+    const IntVector &halo = t.get_halo_width();
+    const auto buf_strides = get_strides(
+        local_shape, halo, real_shape[0]);
+    Shape file_shape(nd);
+    for (int i = 0; i < nd; ++i) {
+      file_shape[i] = m_shape[i];
+    }
+    const auto file_strides = get_strides(
+        file_shape, IntVector(nd, 0), file_shape[0]);
+    Shape region_shape(nd);
+    index_t buf_offset = 0;
+    index_t file_offset = first_sample * file_strides[nd - 1];
+    bool clipped = false;
+    for (int i = 0; i < nd; ++i) {
+      // Signed, as the halo may start before the tensor
+      const int64_t lo = static_cast<int64_t>(global_index[i]) - halo[i];
+      const int64_t hi = lo + real_shape[i];
+      const int64_t begin = std::max<int64_t>(lo, 0);
+      const int64_t end = std::min<int64_t>(hi, t.get_shape()[i]);
+      clipped = clipped || begin != lo || end != hi;
+      region_shape[i] = std::max<int64_t>(end - begin, 0);
+      buf_offset += (begin - lo) * buf_strides[i];
+      file_offset += begin * file_strides[i];
+    }
+    if (clipped) {
+      std::memset(buf, 0, t.get_local_real_size() * sizeof(DataType));
+    }
+    copy_region_host(buf + buf_offset, buf_strides,
+                     reinterpret_cast<const DataType*>(
+                         get_bytes() + m_header.data_offset) + file_offset,
+                     file_strides, region_shape);
+  }
+
+  /**
+     Reads the local region of t and its halo for the samples from
+     first_sample on.
+   */
+  template <typename TensorType>
+  void read(TensorType &t, index_t first_sample) const {
+    std::vector<typename TensorType::data_type> buf(t.get_local_real_size());
+    read(t, first_sample, buf.data());
+    t.get_data().copyin(buf.data());
+  }
+
+ private:
+  const char *get_bytes() const {
+    return static_cast<const char*>(m_ptr);
+  }
+
+  void unmap() {
+    if (m_ptr != MAP_FAILED) {
+      ::munmap(m_ptr, m_size);
+      m_ptr = MAP_FAILED;
+    }
+  }
+
+  template <typename DataType, typename TensorType>
+  void check(const TensorType &t, index_t first_sample) const {
+    const int nd = t.get_num_dims();
+    bool ok = m_header.element_size == sizeof(DataType) &&
+        m_header.data_type == static_cast<uint32_t>(
+            get_tensor_file_data_type<DataType>()) &&
+        m_header.num_dims == static_cast<uint32_t>(nd) &&
+        first_sample + t.get_shape()[nd - 1] <= get_num_samples();
+    for (int i = 0; ok && i < nd - 1; ++i) {
+      ok = t.get_shape()[i] == m_shape[i];
+    }
+    if (!ok || m_header.data_offset + get_num_elements() * sizeof(DataType)
+        > m_size) {
+      util::PrintStreamError()
+          << "Samples " << first_sample << " to "
+          << first_sample + t.get_shape()[nd - 1]
+          << " of the tensor file do not match " << t;
+      throw std::exception();
+    }
+  }
+
+  uint64_t get_num_elements() const {
+    uint64_t n = 1;
+    for (auto s: m_shape) {
+      n *= s;
+    }
+    return n;
+  }
+
+  void *m_ptr = MAP_FAILED;
+  size_t m_size = 0;
+  TensorFileHeader m_header;
+  std::vector<int64_t> m_shape;
+};
+
+} // namespace tensor
+} // namespace distconv
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <limits>
+#include <string>
 #include <type_traits>
 #include <vector>
 #include <cstring>
 
+#include "distconv/tensor/comm_cache.hpp"
 #include "distconv/tensor/tensor.hpp"
+#include "distconv/tensor/tensor_file_format.hpp"
 #include "distconv/tensor/tensor_process.hpp"
 #include "distconv/util/util.hpp"
 #include "distconv/util/util_mpi.hpp"
@@ -36,6 +41,13 @@ class LocaleMPI {
     MPI_Comm_size(comm, &m_num_procs);
   }
 
+  // Shares a communicator owned by comm, e.g. one of get_split_comm
+  explicit LocaleMPI(std::shared_ptr<MPI_Comm> comm):
+      m_comm(std::move(comm)) {
+    MPI_Comm_rank(*m_comm, &m_rank);
+    MPI_Comm_size(*m_comm, &m_num_procs);
+  }
+
   int get_rank() const {
     return m_rank;
   }
@@ -168,6 +180,7 @@ class TensorImpl<Tensor<DataType, LocaleMPI, Allocator>> {
   void set_outermost_dimension(index_t global_dim) {
     index_t old_dim = m_tensor->get_shape()[-1];
     if (old_dim == global_dim) return;
+    assert_always(!m_tensor->get_distribution().has_partition(-1));
     util::MPIPrintStreamDebug() << "Changing the outermost dimension from "
                                 << old_dim << " to " << global_dim;
     m_tensor->m_shape[-1] = global_dim;
@@ -175,7 +188,8 @@ class TensorImpl<Tensor<DataType, LocaleMPI, Allocator>> {
     init_local_tensor();
 
     // m_offset and m_offset_all needs to be updated. The partitioning
-    // is assumed to be done without using requested sizes.
+    // is assumed to be done without using requested sizes or explicit
+    // partitions.
     int num_procs = m_tensor->get_distribution().get_locale_shape()[-1];
     int num_splits = m_tensor->get_distribution().get_split_shape()[-1];
     index_t num_procs_per_split =
@@ -277,8 +291,6 @@ class TensorImpl<Tensor<DataType, LocaleMPI, Allocator>> {
   }
 
   LocaleMPI get_sub_locale(int dim) const {
-    MPI_Comm comm = m_tensor->get_locale().get_comm();
-    MPI_Comm sub_comm;
     const auto &dist = m_tensor->get_distribution();
     auto proc_idx = m_proc_idx;
     proc_idx[dim] = 0;
@@ -288,15 +300,11 @@ class TensorImpl<Tensor<DataType, LocaleMPI, Allocator>> {
                                 << ", rank: " << m_tensor->get_locale().get_rank()
                                 << ", locale shape: " << dist.get_locale_shape()
                                 << ", tensor shape: " << m_tensor->get_shape();
-    DISTCONV_CHECK_MPI(MPI_Comm_split(comm, sub_comm_key,
-                                      m_tensor->get_locale().get_rank(),
-                                      &sub_comm));
-    return LocaleMPI(sub_comm, true);
+    dim = dim < 0 ? proc_idx.length() + dim : dim;
+    return split_locale({SUB_LOCALE, dim}, sub_comm_key);
   }
 
   LocaleMPI get_sub_locale_except_dim(int dim) const {
-    MPI_Comm comm = m_tensor->get_locale().get_comm();
-    MPI_Comm sub_comm;
     const auto &dist = m_tensor->get_distribution();
     auto proc_idx = m_proc_idx;
     dim = dim < 0 ? proc_idx.length() + dim : dim;
@@ -310,15 +318,10 @@ class TensorImpl<Tensor<DataType, LocaleMPI, Allocator>> {
                                 << ", rank: " << m_tensor->get_locale().get_rank()
                                 << ", locale shape: " << dist.get_locale_shape()
                                 << ", tensor shape: " << m_tensor->get_shape();
-    DISTCONV_CHECK_MPI(MPI_Comm_split(comm, sub_comm_key,
-                                      m_tensor->get_locale().get_rank(),
-                                      &sub_comm));
-    return LocaleMPI(sub_comm, true);
+    return split_locale({SUB_LOCALE_EXCEPT_DIM, dim}, sub_comm_key);
   }
 
   LocaleMPI get_spatial_locale() const {
-    MPI_Comm comm = m_tensor->get_locale().get_comm();
-    MPI_Comm sub_comm;
     const auto &dist = m_tensor->get_distribution();
     auto proc_idx = m_proc_idx;
     for (int i = 0; i < get_num_spatial_dims(); ++i) {
@@ -326,69 +329,83 @@ class TensorImpl<Tensor<DataType, LocaleMPI, Allocator>> {
     }
     int sub_comm_key = get_offset(proc_idx, dist.get_locale_shape());
     util::MPIPrintStreamDebug() << "sub comm key: " << sub_comm_key;
-    DISTCONV_CHECK_MPI(MPI_Comm_split(comm, sub_comm_key,
-                                      m_tensor->get_locale().get_rank(),
-                                      &sub_comm));
-    return LocaleMPI(sub_comm, true);
+    return split_locale({SPATIAL_LOCALE}, sub_comm_key);
   }
 
   LocaleMPI get_split_sub_locale() const {
-    MPI_Comm comm = m_tensor->get_locale().get_comm();
-    MPI_Comm sub_comm;
     const auto &dist = m_tensor->get_distribution();
     auto split_idx = m_split_idx;
     int sub_comm_key = get_offset(split_idx, dist.get_split_shape());
-    DISTCONV_CHECK_MPI(MPI_Comm_split(comm, sub_comm_key,
-                                      m_tensor->get_locale().get_rank(),
-                                      &sub_comm));
-    return LocaleMPI(sub_comm, true);
+    return split_locale({SPLIT_SUB_LOCALE, -1}, sub_comm_key);
   }
 
   LocaleMPI get_split_sub_locale(int dim) const {
-    MPI_Comm comm = m_tensor->get_locale().get_comm();
-    MPI_Comm sub_comm;
     const auto &dist = m_tensor->get_distribution();
     auto split_idx = m_split_idx;
     split_idx[dim] = 0;
     int sub_comm_key = get_offset(split_idx, dist.get_split_shape());
     util::MPIPrintStreamDebug() << "subcomm key: " << sub_comm_key << std::endl;
-    DISTCONV_CHECK_MPI(MPI_Comm_split(comm, sub_comm_key,
-                                      m_tensor->get_locale().get_rank(),
-                                      &sub_comm));
-    return LocaleMPI(sub_comm, true);
+    dim = dim < 0 ? split_idx.length() + dim : dim;
+    return split_locale({SPLIT_SUB_LOCALE, dim}, sub_comm_key);
   }
 
   index_t get_dimension_rank_offset(int dim, int rank) const {
     return m_offset_all[dim][rank];
   }
 
-  void allreduce_shared_regions() {
-    auto subloc = m_tensor->get_split_sub_locale();
-    DISTCONV_CHECK_MPI(
-        MPI_Allreduce(MPI_IN_PLACE, m_tensor->get_buffer(),
-                      m_tensor->get_local_pitched_size(),
-                      util::get_mpi_data_type<DataType>(),
-                      MPI_SUM, subloc.get_comm()));
+  // The ranks that share the regions of this rank, which
+  // allreduce_shared_regions reduces over
+  LocaleMPI get_shared_region_locale() const {
+    return m_tensor->get_split_sub_locale();
   }
 
-  void allreduce(const std::vector<int> &dims) {
-    MPI_Comm comm = m_tensor->get_locale().get_comm();
+  // The ranks that differ from this rank only along dims, which
+  // allreduce(dims) reduces over
+  LocaleMPI get_reduction_locale(const std::vector<int> &dims) const {
     const auto &dist = m_tensor->get_distribution();
     auto sub_comm_idx = get_proc_index();
+    std::vector<int> key = {ALLREDUCE};
     for (auto d: dims) {
       sub_comm_idx[d] = 0;
+      key.push_back(d);
     }
     int sub_comm_key = get_offset(sub_comm_idx, dist.get_locale_shape());
-    MPI_Comm sub_comm;
-    DISTCONV_CHECK_MPI(MPI_Comm_split(comm, sub_comm_key,
-                                      m_tensor->get_locale().get_rank(),
-                                      &sub_comm));
-    DISTCONV_CHECK_MPI(
-        MPI_Allreduce(MPI_IN_PLACE, m_tensor->get_buffer(),
-                      m_tensor->get_local_pitched_size(),
-                      util::get_mpi_data_type<DataType>(),
-                      MPI_SUM, sub_comm));
-    MPI_Comm_free(&sub_comm);
+    return split_locale(std::move(key), sub_comm_key);
+  }
+
+  void allreduce_shared_regions() {
+    allreduce_mpi(get_shared_region_locale());
+  }
+
+  void allreduce(const std::vector<int> &dims) {
+    allreduce_mpi(get_reduction_locale(dims));
+  }
+
+  void allreduce_shared_regions(typename Stream<Allocator>::type stream) {
+    HelperType(*this).allreduce(get_shared_region_locale(), stream);
+  }
+
+  void allreduce(const std::vector<int> &dims,
+                 typename Stream<Allocator>::type stream) {
+    HelperType(*this).allreduce(get_reduction_locale(dims), stream);
+  }
+
+  void allreduce(Allreduce<DataType> &ar,
+                 typename Stream<Allocator>::type stream) {
+    HelperType(*this).allreduce(ar, stream);
+  }
+
+  // Whether the local elements outside of the halo are contiguous in
+  // the buffer
+  bool is_local_interior_contiguous() const {
+    const auto shape = m_tensor->get_local_shape();
+    const auto strides = m_tensor->get_strides();
+    index_t run = 1;
+    for (int i = 0; i < shape.num_dims(); ++i) {
+      if (shape[i] > 1 && strides[i] != run) return false;
+      run *= shape[i];
+    }
+    return true;
   }
 
   void scale(DataType v, typename Stream<Allocator>::type stream) {
@@ -413,6 +430,65 @@ class TensorImpl<Tensor<DataType, LocaleMPI, Allocator>> {
 
  protected:
 
+  // What the groups of ranks of a sub-locale share, as the first
+  // element of the keys of get_split_comm
+  enum SubLocaleKind {
+    SUB_LOCALE, SUB_LOCALE_EXCEPT_DIM, SPATIAL_LOCALE, SPLIT_SUB_LOCALE,
+    ALLREDUCE
+  };
+
+  // Allreduces the local elements outside of the halo with MPI. Host
+  // buffers with a halo are reduced through a packed copy; for device
+  // buffers, which MPI accesses directly, the span from the first to
+  // the last interior element is reduced instead.
+  void allreduce_mpi(const LocaleMPI &loc) {
+    const index_t size = m_tensor->get_local_size();
+    if (loc.get_size() == 1) return;
+    DataType *base = m_tensor->get_base_ptr();
+    const auto type = util::get_mpi_data_type<DataType>();
+    if (is_local_interior_contiguous()) {
+      DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, base, size, type,
+                                       MPI_SUM, loc.get_comm()));
+      return;
+    }
+    const auto shape = m_tensor->get_local_shape();
+    const IndexVector strides(m_tensor->get_strides());
+    if (std::is_same<Allocator, BaseAllocator>::value) {
+      const auto packed_strides = get_strides(
+          shape, IntVector(shape.num_dims(), 0), shape[0]);
+      std::vector<DataType> buf(size);
+      copy_region_host(buf.data(), packed_strides, base, strides, shape);
+      DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, buf.data(), size, type,
+                                       MPI_SUM, loc.get_comm()));
+      copy_region_host(base, strides, buf.data(), packed_strides, shape);
+      return;
+    }
+    index_t span = 1;
+    for (int i = 0; i < shape.num_dims(); ++i) {
+      span += (shape[i] - 1) * strides[i];
+    }
+    DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, base, span, type,
+                                     MPI_SUM, loc.get_comm()));
+  }
+
+  // The locale of the ranks with the same color, split only once for
+  // the locale of the tensor, its process grid and the given key.
+  LocaleMPI split_locale(std::vector<int> key, int color) const {
+    const auto &dist = m_tensor->get_distribution();
+    const int nd = dist.num_dims();
+    key.push_back(nd);
+    for (int i = 0; i < nd; ++i) {
+      key.push_back(dist.get_locale_shape()[i]);
+      key.push_back(dist.get_split_shape()[i]);
+    }
+    if (key[0] == SPATIAL_LOCALE) {
+      key.push_back(get_num_spatial_dims());
+    }
+    return LocaleMPI(get_split_comm(m_tensor->get_locale().get_comm(), key,
+                                    color,
+                                    m_tensor->get_locale().get_rank()));
+  }
+
   int get_num_dims() const {
     return m_tensor->get_num_dims();
   }
@@ -455,6 +531,28 @@ class TensorImpl<Tensor<DataType, LocaleMPI, Allocator>> {
         real_size_extra = dist.get_overlap(i) * 2;
         util::MPIPrintStreamDebug()
             << "shape requested: " << proc_chunk_size;
+      } else if (dist.is_distributed(i) && dist.has_partition(i)) {
+        const auto &partition = dist.get_partition(i);
+        index_t total = 0;
+        for (const auto size: partition) {
+          // Each split must hold the halo its neighbors need
+          if (size < (index_t)dist.get_overlap(i)) {
+            util::MPIPrintStreamError()
+                << "Partition of dimension " << i
+                << " smaller than its overlap: " << dist;
+            std::abort();
+          }
+          total += size;
+        }
+        if (total != tensor_shape[i]) {
+          util::MPIPrintStreamError()
+              << "Partition of dimension " << i
+              << " does not match the tensor shape. Tensor: "
+              << tensor_shape << ", distribution: " << dist;
+          std::abort();
+        }
+        proc_chunk_size = partition[m_split_idx[i]];
+        real_size_extra = dist.get_overlap(i) * 2;
       } else if (dist.is_distributed(i)) {
         // Make sure each sub tensor has a size that is divisible by
         // bsize. The remainder is taken care by the last process.
@@ -492,7 +590,12 @@ class TensorImpl<Tensor<DataType, LocaleMPI, Allocator>> {
         util::MPIPrintStreamDebug()
             << "no partitioning on dimension " << i;
         proc_chunk_size = tensor_shape[i];
-        dist.set_overlap(i, 0);
+        if (dist.is_periodic(i)) {
+          // Halos wrapped around from the other edge
+          real_size_extra = dist.get_overlap(i) * 2;
+        } else {
+          dist.set_overlap(i, 0);
+        }
       }
       m_local_shape[i] = proc_chunk_size;
       m_local_real_shape[i] = proc_chunk_size + real_size_extra;
@@ -595,6 +698,7 @@ struct ViewFunctor<Tensor<DataType, LocaleProcess, Allocator>,
     t_proc.set_distribution(dist);
     assert_eq(t_mpi.get_local_real_shape(), t_proc.get_local_real_shape());
     t_proc.set_view(t_mpi.m_data);
+    t_proc.set_layout(t_mpi.get_layout());
     return 0;
   }
 };
@@ -610,6 +714,7 @@ struct ViewFunctor<Tensor<DataType, LocaleMPI, Allocator>,
     t_viewer.m_requested_local_block = t_original.get_requested_local_block();
     t_viewer.m_requested_local_shape = t_original.get_requested_local_shape();
     t_viewer.set_shape(t_original.get_shape());
+    t_viewer.set_layout(t_original.get_layout());
     util::MPIPrintStreamDebug()
         << "View created. original: " << t_original
         << ", viewer: " << t_viewer;
@@ -649,140 +754,218 @@ inline int View(
                                    t_viewer, t_original);
 }
 
-namespace internal {
-
-template <typename DataType, typename AllocatorProc, typename AllocatorMPI>
-struct CopyFunctor<Tensor<DataType, LocaleProcess, AllocatorProc>,
-                   Tensor<DataType, LocaleMPI, AllocatorMPI>> {
-  using TensorProcType = Tensor<DataType, LocaleProcess, AllocatorProc>;
-  using TensorMPIType = Tensor<DataType, LocaleMPI, AllocatorMPI>;
-
-  DataType *m_buf = nullptr;
-  size_t m_size = 0;
-
-  void ensure_buffer(size_t size) {
-    if (m_size < size) {
-      if (m_buf) {
-        free(m_buf);
-      }
-      m_buf = (DataType*)malloc(size);
-      m_size = size;
+/**
+   Make t_view a view of the slice of t_parent that starts at offset
+   along dimension dim and has the local extent of t_view. Producers
+   writing t_view then write t_parent in place, which makes
+   concatenating their outputs free.
+
+   Only slices that a pitch can describe are supported: dim is the
+   innermost dimension, e.g., the channels of a channels-last tensor,
+   or all dimensions outer to dim have local extent 1. Neither tensor
+   may have a halo along dim or partition it, and the other
+   dimensions, including halos, must match.
+
+   @return non-zero, leaving t_view untouched, if the slice cannot be
+   viewed.
+ */
+template <typename DataType, typename Allocator>
+inline int ViewSlice(Tensor<DataType, LocaleMPI, Allocator> &t_view,
+                     Tensor<DataType, LocaleMPI, Allocator> &t_parent,
+                     int dim, index_t offset) {
+  const int nd = t_parent.get_num_dims();
+  assert_always(t_view.get_num_dims() == nd);
+  assert_always(offset + t_view.get_local_shape()[dim] <=
+                t_parent.get_local_shape()[dim]);
+  if (t_parent.is_null() || t_view.get_layout() != t_parent.get_layout() ||
+      t_parent.get_overlap()[dim] != 0 || t_view.get_overlap()[dim] != 0 ||
+      t_parent.get_distribution().get_locale_shape()[dim] != 1) {
+    return 1;
+  }
+  const auto parent_real_shape = t_parent.get_local_real_shape();
+  const auto view_real_shape = t_view.get_local_real_shape();
+  for (int i = 0; i < nd; ++i) {
+    if (i != dim && view_real_shape[i] != parent_real_shape[i]) {
+      return 1;
+    }
+    if (i > dim && dim > 0 && parent_real_shape[i] != 1) {
+      return 1;
     }
   }
+  // The real buffer of the view starts at offset along dim
+  auto idx = IndexVector(nd, 0);
+  idx[dim] = offset;
+  auto ptr = t_parent.get_buffer() + t_parent.get_local_offset(idx, true);
+  t_view.set_view(ptr, t_parent.get_pitch());
+  return 0;
+}
 
-  ~CopyFunctor() {
-    if (m_buf) {
-      free(m_buf);
-    }
+/**
+   Whether the local tensor is the local matrix of a column-major
+   distributed matrix with a column per sample, e.g., that of a
+   Hydrogen DistMatrix with a sample-parallel distribution. Each row
+   holds an element of a sample in the memory order of the tensor,
+   e.g., CHW with the channels-first layout.
+
+   Only the sample dimension, the outermost one, may be partitioned,
+   and no dimension may have halos. The local samples are in the
+   local order, which differs from the global one of a cyclic
+   distribution of the matrix; this does not matter to layers
+   processing the samples independently.
+ */
+template <typename DataType, typename Allocator>
+inline bool IsMatrixCompatible(
+    const Tensor<DataType, LocaleMPI, Allocator> &t) {
+  const int nd = t.get_num_dims();
+  const auto &dist = t.get_distribution();
+  for (int i = 0; i < nd; ++i) {
+    if (t.get_overlap()[i] != 0) return false;
+    if (i < nd - 1 && dist.get_locale_shape()[i] != 1) return false;
   }
+  return true;
+}
 
-  void copy_into_local_buffer(DataType *dest, const DataType *src,
-                              const Shape &local_shape,
-                              const IndexVector &global_offset,
-                              const Shape &global_shape,
-                              const IndexVector &overlap,
-                              size_t pitch) {
-    auto local_real_shape = local_shape + overlap * 2;
-    // copy the MPI local buffer to the destination tensor
-    for (auto it = local_shape.index_begin();
-         it != local_shape.index_end();) {
-      auto src_offset = get_offset(
-          *it + overlap, local_real_shape, pitch);
-      auto dest_offset = get_offset(global_offset + *it,
-                                       global_shape);
-      memcpy(dest + dest_offset,
-             src + src_offset, local_shape[0] * sizeof(DataType));
-      // Skip the rest of the points at dimension 0
-      for (index_t i = 0; i < local_shape[0]; ++i) {
-        ++it;
-      }
-    }
+/**
+   Make t a view of the local matrix of a distributed matrix, which
+   is width columns of ldim elements at buffer, without a copy. Layers
+   then read and write the matrix in place, and when a layer needs
+   another distribution, the shuffler runs straight from or to t.
+
+   The matrix columns must hold the local samples of t contiguously,
+   so ldim must be the local sample size unless there is at most one
+   local sample.
+
+   @return non-zero, leaving t untouched, if the matrix cannot be
+   viewed, in which case it has to be copied.
+ */
+template <typename DataType, typename Allocator>
+inline int ViewMatrix(Tensor<DataType, LocaleMPI, Allocator> &t,
+                      DataType *buffer, index_t width, index_t ldim) {
+  const auto local_shape = t.get_local_shape();
+  const index_t num_samples = local_shape[-1];
+  const index_t sample_size =
+      num_samples == 0 ? 0 : local_shape.get_size() / num_samples;
+  if (!IsMatrixCompatible(t) || num_samples != width ||
+      (width > 1 && ldim != sample_size)) {
+    return 1;
   }
+  t.set_view(buffer);
+  return 0;
+}
 
-  template <typename TensorMPIType>
-  void send_local_buffer(const TensorMPIType &t_mpi, int root,
-                         int tag) {
-    const int nd = t_mpi.get_num_dims();
-    // Send offset and shape
-    IndexVector offset = t_mpi.get_global_index();
-    //util::PrintStreamDebug() << "Sending offset to " << root;
-    MPI_Send(offset.data(), sizeof(IndexVector::data_type) * nd, MPI_BYTE,
-             root, tag, t_mpi.m_locale.get_comm());
-    Shape shape = t_mpi.get_local_shape();
-    MPI_Send(shape.data(), sizeof(Shape::data_type) * nd, MPI_BYTE, root,
-             tag, t_mpi.m_locale.get_comm());
-    if (shape.get_size() == 0) {
-      util::MPIPrintStreamDebug() << "Empty tensor. Not sending";
-      return;
-    }
-    // Send the buffer
-    const DataType *send_buffer = t_mpi.get_const_buffer();
-    size_t buffer_size = t_mpi.m_data.get_real_size();
-
-    MPI_Send(&buffer_size, sizeof(size_t), MPI_BYTE, root,
-             tag, t_mpi.m_locale.get_comm());
-    assert_always(send_buffer);
-    // MVAPICH2-2.3rc1 seems to be hanging up here.
-#if 0
-    MPI_Send(send_buffer, buffer_size, MPI_BYTE, root,
-             tag, t_mpi.m_locale.get_comm());
-#else
-    DataType *host_buf = (DataType*)malloc(buffer_size);
-    assert_always(host_buf);
-    t_mpi.m_data.copyout(host_buf);
-    MPI_Send(host_buf, buffer_size, MPI_BYTE, root,
-             tag, t_mpi.m_locale.get_comm());
-    free(host_buf);
-#endif
-    size_t pitch = t_mpi.get_pitch();
-    MPI_Send(&pitch, sizeof(size_t), MPI_BYTE, root,
-             tag, t_mpi.m_locale.get_comm());
+/**
+   Get the local matrix t can be viewed as, e.g., to attach it to a
+   Hydrogen matrix with El::Matrix::Attach(height, width, buffer,
+   ldim). It is the reverse of ViewMatrix.
+
+   @return non-zero if t is not laid out as such a matrix.
+ */
+template <typename DataType, typename Allocator>
+inline int GetMatrixView(Tensor<DataType, LocaleMPI, Allocator> &t,
+                         DataType *&buffer, index_t &height,
+                         index_t &width, index_t &ldim) {
+  const auto local_shape = t.get_local_shape();
+  if (t.is_null() || !IsMatrixCompatible(t) ||
+      t.get_pitch() != (size_t)local_shape[0]) {
+    return 1;
   }
+  width = local_shape[-1];
+  height = width == 0 ? 0 : local_shape.get_size() / width;
+  ldim = std::max(height, (index_t)1);
+  buffer = t.get_base_ptr();
+  return 0;
+}
 
-  template <typename TensorProcType, typename TensorMPIType>
-  void recv_local_buffer(TensorProcType &t_proc,
-                         const TensorMPIType &t_mpi, int src,
-                         int tag) {
-    const int nd = t_proc.get_num_dims();
-    int my_rank = t_mpi.m_locale.get_rank();
-    const DataType *src_buf = nullptr;
-    IndexVector global_offset(nd);
-    Shape shape(nd);
-    size_t pitch;
-    if (src == my_rank) {
-      util::MPIPrintStreamDebug()
-          << "Buffer size: " << t_mpi.m_data.get_real_size()
-          << ", local real size: " << t_mpi.get_local_real_size();
-      ensure_buffer(t_mpi.m_data.get_real_size());
-      t_mpi.m_data.copyout(m_buf);
-      global_offset = t_mpi.get_global_index();
-      shape = t_mpi.get_local_shape();
-      pitch = t_mpi.get_pitch();
-    } else {
-      MPI_Recv(global_offset.data(), sizeof(IndexVector::data_type) * nd,
-               MPI_BYTE, src, tag, t_mpi.m_locale.get_comm(),
-               MPI_STATUS_IGNORE);
-      MPI_Recv(shape.data(), sizeof(Shape::data_type) * nd, MPI_BYTE, src,
-               tag, t_mpi.m_locale.get_comm(), MPI_STATUS_IGNORE);
-      if (shape.get_size() == 0) {
-        util::MPIPrintStreamDebug() << "Empty tensor. Not receiving";
-        return;
+namespace internal {
+
+// An MPI datatype of a region of shape at offset in an array of
+// array_shape, the first dimension fastest
+inline MPI_Datatype make_region_type(const Shape &array_shape,
+                                     const Shape &shape,
+                                     const IndexVector &offset,
+                                     MPI_Datatype element_type) {
+  const int nd = array_shape.num_dims();
+  std::vector<int> sizes(nd), subsizes(nd), starts(nd);
+  for (int i = 0; i < nd; ++i) {
+    assert_always(array_shape[i] <= std::numeric_limits<int>::max());
+    sizes[i] = array_shape[i];
+    subsizes[i] = shape[i];
+    starts[i] = offset[i];
+  }
+  MPI_Datatype type;
+  DISTCONV_CHECK_MPI(MPI_Type_create_subarray(
+      nd, sizes.data(), subsizes.data(), starts.data(), MPI_ORDER_FORTRAN,
+      element_type, &type));
+  DISTCONV_CHECK_MPI(MPI_Type_commit(&type));
+  return type;
+}
+
+/**
+   The parts of a tensor held by each rank, and whether each rank is
+   the lowest one holding its part, so that replicated parts are
+   transferred only once.
+ */
+struct LocalParts {
+  std::vector<IndexVector> offsets;
+  std::vector<Shape> shapes;
+  std::vector<bool> owners;
+
+  template <typename TensorType>
+  explicit LocalParts(const TensorType &t) {
+    const int nd = t.get_num_dims();
+    const int np = t.get_locale().get_size();
+    std::vector<index_t> local(nd * 2);
+    std::vector<index_t> all(nd * 2 * np);
+    const auto offset = t.get_global_index();
+    const auto shape = t.get_local_shape();
+    for (int i = 0; i < nd; ++i) {
+      local[i] = offset[i];
+      local[nd + i] = shape[i];
+    }
+    DISTCONV_CHECK_MPI(MPI_Allgather(
+        local.data(), nd * 2 * sizeof(index_t), MPI_BYTE,
+        all.data(), nd * 2 * sizeof(index_t), MPI_BYTE,
+        t.get_locale().get_comm()));
+    for (int r = 0; r < np; ++r) {
+      const index_t *p = all.data() + r * nd * 2;
+      offsets.emplace_back(IndexVector(p, p + nd));
+      shapes.emplace_back(Shape(IndexVector(p + nd, p + nd * 2)));
+      bool owner = !shapes.back().is_empty();
+      for (int q = 0; q < r && owner; ++q) {
+        owner = !owners[q] || offsets[q] != offsets[r];
       }
-      size_t buffer_size;
-      MPI_Recv(&buffer_size, sizeof(size_t), MPI_BYTE, src,
-               tag, t_mpi.m_locale.get_comm(), MPI_STATUS_IGNORE);
-      // Receiving the source local tensor
-      ensure_buffer(buffer_size);
-      MPI_Recv(m_buf, buffer_size, MPI_BYTE, src,
-               tag, t_mpi.m_locale.get_comm(), MPI_STATUS_IGNORE);
-      MPI_Recv(&pitch, sizeof(size_t), MPI_BYTE, src,
-               tag, t_mpi.m_locale.get_comm(), MPI_STATUS_IGNORE);
+      owners.push_back(owner);
     }
-    src_buf = m_buf;
-    const auto &overlap = t_mpi.get_halo_width();
-    copy_into_local_buffer(t_proc.get_buffer(), src_buf, shape,
-                           global_offset, t_mpi.get_shape(), overlap, pitch);
   }
+};
+
+// The local region of a tensor without its halo, in the host copy of
+// its local buffer. The copy is not pitched.
+template <typename TensorType>
+MPI_Datatype make_local_region_type(const TensorType &t,
+                                    MPI_Datatype element_type) {
+  return make_region_type(t.get_local_real_shape(), t.get_local_shape(),
+                          t.get_halo_width(), element_type);
+}
+
+template <typename DataType>
+MPI_Datatype make_element_type() {
+  MPI_Datatype type;
+  DISTCONV_CHECK_MPI(MPI_Type_contiguous(sizeof(DataType), MPI_BYTE, &type));
+  DISTCONV_CHECK_MPI(MPI_Type_commit(&type));
+  return type;
+}
+
+/**
+   Gathers a distributed tensor into a tensor at the root in a single
+   MPI_Alltoallw, whose datatypes select the local region of each rank
+   without its halo and place it into the global tensor directly.
+ */
+template <typename DataType, typename AllocatorProc, typename AllocatorMPI>
+struct CopyFunctor<Tensor<DataType, LocaleProcess, AllocatorProc>,
+                   Tensor<DataType, LocaleMPI, AllocatorMPI>> {
+  using TensorProcType = Tensor<DataType, LocaleProcess, AllocatorProc>;
+  using TensorMPIType = Tensor<DataType, LocaleMPI, AllocatorMPI>;
 
   int operator()(TensorProcType &t_proc, const TensorMPIType &t_mpi,
                  int root) {
@@ -806,15 +989,42 @@ struct CopyFunctor<Tensor<DataType, LocaleProcess, AllocatorProc>,
       assert0(t_proc.allocate());
     }
 
-    // Copy each local tensor to the root sequentially
-    int tag = 0;
+    const LocalParts parts(t_mpi);
+    const MPI_Datatype element_type = make_element_type<DataType>();
+    std::vector<int> send_counts(num_ranks, 0), recv_counts(num_ranks, 0);
+    std::vector<int> displs(num_ranks, 0);
+    std::vector<MPI_Datatype> send_types(num_ranks, element_type);
+    std::vector<MPI_Datatype> recv_types(num_ranks, element_type);
+    std::vector<char> host_buf;
+    if (parts.owners[my_rank]) {
+      host_buf.resize(t_mpi.m_data.get_size());
+      t_mpi.m_data.copyout(host_buf.data());
+      send_counts[root] = 1;
+      send_types[root] = make_local_region_type(t_mpi, element_type);
+    }
     if (my_rank == root) {
-      for (int src = 0; src < num_ranks; ++src) {
-        recv_local_buffer(t_proc, t_mpi, src, tag);
+      for (int r = 0; r < num_ranks; ++r) {
+        if (!parts.owners[r]) continue;
+        recv_counts[r] = 1;
+        recv_types[r] = make_region_type(t_mpi.get_shape(), parts.shapes[r],
+                                         parts.offsets[r], element_type);
       }
-    } else {
-      send_local_buffer(t_mpi, root, tag);
     }
+    DISTCONV_CHECK_MPI(MPI_Alltoallw(
+        host_buf.data(), send_counts.data(), displs.data(),
+        send_types.data(),
+        my_rank == root ? t_proc.get_buffer() : nullptr,
+        recv_counts.data(), displs.data(), recv_types.data(),
+        t_mpi.m_locale.get_comm()));
+    for (int r = 0; r < num_ranks; ++r) {
+      for (auto *type: {&send_types[r], &recv_types[r]}) {
+        if (*type != element_type) {
+          DISTCONV_CHECK_MPI(MPI_Type_free(type));
+        }
+      }
+    }
+    MPI_Datatype t = element_type;
+    DISTCONV_CHECK_MPI(MPI_Type_free(&t));
     return 0;
   }
 };
@@ -1067,6 +1277,247 @@ struct CopyLocalFunctor3D {
   }
 };
 
+// The elements of tensor files are staged through host buffers of
+// about this size, so that copying a chunk between the device and the
+// host overlaps the file access of the previous one.
+constexpr size_t file_io_chunk_bytes = 64 << 20;
+
+// The slices along the outermost dimension [begin, end) of the local
+// buffer of a tensor, copied between it and a host buffer, where they
+// are unpitched.
+template <typename TensorType>
+class LocalSlices {
+ public:
+  explicit LocalSlices(TensorType &t): m_t(t) {
+    const int nd = t.get_num_dims();
+    const auto real_shape = t.get_local_real_shape();
+    m_slice_rows = 1;
+    for (int i = 1; i < nd - 1; ++i) {
+      m_slice_rows *= real_shape[i];
+    }
+    // A 1D buffer is a single row, copied at once
+    m_num_slices = nd == 1 ? 1 : t.get_local_shape()[nd - 1];
+    m_halo = nd == 1 ? 0 : t.get_halo_width()[nd - 1];
+  }
+
+  index_t get_num_slices() const { return m_num_slices; }
+
+  size_t get_host_bytes(index_t begin, index_t end) const {
+    const auto &data = m_t.get_data();
+    if (m_t.get_num_dims() == 1) return data.get_size();
+    return (end - begin) * m_slice_rows * data.get_ldim();
+  }
+
+  void copyout(void *dst, index_t begin, index_t end) const {
+    const auto &data = m_t.get_data();
+    TensorType::allocator_type::copyout(
+        dst, get_ptr(begin), get_host_bytes(begin, end), data.get_pitch(),
+        data.get_ldim());
+  }
+
+  void copyin(const void *src, index_t begin, index_t end) {
+    const auto &data = m_t.get_data();
+    TensorType::allocator_type::copyin(
+        const_cast<char*>(get_ptr(begin)), src, get_host_bytes(begin, end),
+        data.get_pitch(), data.get_ldim());
+  }
+
+  // The interior of the slices in their host copy
+  MPI_Datatype make_type(index_t begin, index_t end,
+                         MPI_Datatype element_type) const {
+    const int nd = m_t.get_num_dims();
+    if (nd == 1) {
+      return make_local_region_type(m_t, element_type);
+    }
+    auto real_shape = m_t.get_local_real_shape();
+    auto shape = m_t.get_local_shape();
+    IndexVector offset(m_t.get_halo_width());
+    real_shape[nd - 1] = end - begin;
+    shape[nd - 1] = end - begin;
+    offset[nd - 1] = 0;
+    return make_region_type(real_shape, shape, offset, element_type);
+  }
+
+ private:
+  const char *get_ptr(index_t begin) const {
+    const auto &data = m_t.get_data();
+    return static_cast<const char*>(data.get()) +
+        (m_halo + begin) * m_slice_rows * data.get_pitch();
+  }
+
+  TensorType &m_t;
+  index_t m_slice_rows;
+  index_t m_num_slices;
+  index_t m_halo;
+};
+
+// Writes the header of a tensor file at rank 0, or reads and checks it
+// at every rank. Returns the offset of the elements, or -1 if the file
+// does not hold a tensor of the type and shape of t_mpi.
+template <bool IS_READ, typename TensorType>
+int64_t ReadOrWriteFileHeader(TensorType &t_mpi, MPI_File file) {
+  using DataType = typename TensorType::data_type;
+  MPI_Comm comm = t_mpi.get_locale().get_comm();
+  const int rank = t_mpi.get_locale().get_rank();
+  const int nd = t_mpi.get_num_dims();
+  std::vector<int64_t> shape(t_mpi.get_shape().begin(),
+                             t_mpi.get_shape().end());
+  if constexpr (!IS_READ) {
+    const LocalParts parts(t_mpi);
+    std::vector<int64_t> chunks;
+    for (size_t r = 0; r < parts.owners.size(); ++r) {
+      if (!parts.owners[r]) continue;
+      chunks.insert(chunks.end(), parts.offsets[r].begin(),
+                    parts.offsets[r].end());
+      chunks.insert(chunks.end(), parts.shapes[r].begin(),
+                    parts.shapes[r].end());
+    }
+    const auto header = make_tensor_file_header<DataType>(shape, chunks);
+    if (rank == 0) {
+      DISTCONV_CHECK_MPI(MPI_File_write_at(file, 0, header.data(),
+                                           header.size(), MPI_BYTE,
+                                           MPI_STATUS_IGNORE));
+    }
+    return header.size();
+  } else {
+    TensorFileHeader h;
+    std::vector<int64_t> file_shape(nd, -1);
+    if (rank == 0) {
+      DISTCONV_CHECK_MPI(MPI_File_read_at(file, 0, &h, sizeof(h), MPI_BYTE,
+                                          MPI_STATUS_IGNORE));
+      if (h.num_dims == (uint32_t)nd) {
+        DISTCONV_CHECK_MPI(MPI_File_read_at(
+            file, sizeof(h), file_shape.data(), sizeof(int64_t) * nd,
+            MPI_BYTE, MPI_STATUS_IGNORE));
+      }
+    }
+    DISTCONV_CHECK_MPI(MPI_Bcast(&h, sizeof(h), MPI_BYTE, 0, comm));
+    DISTCONV_CHECK_MPI(MPI_Bcast(file_shape.data(), sizeof(int64_t) * nd,
+                                 MPI_BYTE, 0, comm));
+    if (std::memcmp(h.magic, TENSOR_FILE_MAGIC, sizeof(h.magic)) != 0 ||
+        h.data_type != static_cast<uint32_t>(
+            get_tensor_file_data_type<DataType>()) ||
+        h.element_size != sizeof(DataType) || file_shape != shape) {
+      return -1;
+    }
+    return h.data_offset;
+  }
+}
+
+template <bool IS_READ, typename TensorType>
+int ReadOrWriteFile(TensorType &t_mpi, const std::string &file_path) {
+  using DataType = typename TensorType::data_type;
+  MPI_Comm comm = t_mpi.get_locale().get_comm();
+  const int nd = t_mpi.get_num_dims();
+  // Replicated parts are written once but read by every rank
+  const bool active = IS_READ ? !t_mpi.get_local_shape().is_empty()
+      : LocalParts(t_mpi).owners[t_mpi.get_locale().get_rank()];
+  MPI_File file;
+  if (MPI_File_open(comm, file_path.c_str(),
+                    IS_READ ? MPI_MODE_RDONLY
+                    : MPI_MODE_WRONLY | MPI_MODE_CREATE,
+                    MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+    util::MPIPrintStreamError() << "Failed to open " << file_path;
+    return 1;
+  }
+  const int64_t data_offset = ReadOrWriteFileHeader<IS_READ>(t_mpi, file);
+  if (data_offset < 0) {
+    util::MPIPrintStreamError() << file_path << " does not hold a tensor "
+                                << "of type and shape of " << t_mpi;
+    DISTCONV_CHECK_MPI(MPI_File_close(&file));
+    return 1;
+  }
+  if (!IS_READ) {
+    DISTCONV_CHECK_MPI(MPI_File_set_size(
+        file, data_offset + t_mpi.get_size() * sizeof(DataType)));
+  }
+  const MPI_Datatype element_type = make_element_type<DataType>();
+  MPI_Datatype file_type = element_type;
+  if (active) {
+    file_type = make_region_type(t_mpi.get_shape(), t_mpi.get_local_shape(),
+                                 t_mpi.get_global_index(), element_type);
+  }
+  DISTCONV_CHECK_MPI(MPI_File_set_view(file, data_offset, element_type,
+                                       file_type, "native", MPI_INFO_NULL));
+
+  // The local part is accessed as chunks of slices along the outermost
+  // dimension, contiguous in both the view and the host copy.
+  // Collective accesses must match, so every rank takes part in as
+  // many as the rank with the most chunks.
+  LocalSlices<TensorType> slices(t_mpi);
+  const index_t num_slices = active ? slices.get_num_slices() : 0;
+  const index_t slices_per_chunk = std::max<index_t>(
+      1, file_io_chunk_bytes / std::max<size_t>(
+          slices.get_host_bytes(0, 1), 1));
+  const index_t view_slice_size = nd == 1 ? 0
+      : t_mpi.get_local_size() / std::max<index_t>(num_slices, 1);
+  int num_chunks = util::ceil(num_slices, slices_per_chunk);
+  DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &num_chunks, 1, MPI_INT,
+                                   MPI_MAX, comm));
+  auto get_begin = [&](int c) {
+    return std::min<index_t>(c * slices_per_chunk, num_slices);
+  };
+  auto get_end = [&](int c) {
+    return std::min<index_t>((c + 1) * slices_per_chunk, num_slices);
+  };
+  // Double buffering
+  std::vector<char> host_bufs[2];
+  MPI_Request reqs[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  MPI_Datatype mem_types[2] = {element_type, element_type};
+  auto wait = [&](int k) {
+    DISTCONV_CHECK_MPI(MPI_Wait(&reqs[k], MPI_STATUS_IGNORE));
+    if (mem_types[k] != element_type) {
+      DISTCONV_CHECK_MPI(MPI_Type_free(&mem_types[k]));
+      mem_types[k] = element_type;
+    }
+  };
+  // Copies out chunk c, which keeps the halo of the local buffer as it
+  // is when reading, and starts accessing it in the file
+  auto start = [&](int c) {
+    const int k = c % 2;
+    const index_t begin = get_begin(c), end = get_end(c);
+    int count = 0;
+    if (begin < end) {
+      host_bufs[k].resize(slices.get_host_bytes(begin, end));
+      slices.copyout(host_bufs[k].data(), begin, end);
+      mem_types[k] = slices.make_type(begin, end, element_type);
+      count = 1;
+    }
+    const MPI_Offset offset = begin * view_slice_size;
+    if constexpr (IS_READ) {
+      DISTCONV_CHECK_MPI(MPI_File_iread_at_all(
+          file, offset, host_bufs[k].data(), count, mem_types[k], &reqs[k]));
+    } else {
+      DISTCONV_CHECK_MPI(MPI_File_iwrite_at_all(
+          file, offset, host_bufs[k].data(), count, mem_types[k], &reqs[k]));
+    }
+  };
+  if constexpr (IS_READ) {
+    if (num_chunks > 0) start(0);
+    for (int c = 0; c < num_chunks; ++c) {
+      if (c + 1 < num_chunks) start(c + 1);
+      wait(c % 2);
+      if (get_begin(c) < get_end(c)) {
+        slices.copyin(host_bufs[c % 2].data(), get_begin(c), get_end(c));
+      }
+    }
+  } else {
+    for (int c = 0; c < num_chunks; ++c) {
+      wait(c % 2);
+      start(c);
+    }
+    wait(0);
+    wait(1);
+  }
+  DISTCONV_CHECK_MPI(MPI_File_close(&file));
+  if (file_type != element_type) {
+    DISTCONV_CHECK_MPI(MPI_Type_free(&file_type));
+  }
+  MPI_Datatype t = element_type;
+  DISTCONV_CHECK_MPI(MPI_Type_free(&t));
+  return 0;
+}
+
 } // namespace internal
 
 template <typename DataType, typename AllocatorProc,
@@ -1080,6 +1531,32 @@ inline int Copy(Tensor<DataType, LocaleProcess, AllocatorProc> &t_proc,
         t_proc, t_mpi, root);
 }
 
+/**
+   Writes a distributed tensor to a tensor file (see
+   tensor_file_format.hpp), each rank writing its own part through
+   MPI-IO rather than gathering the tensor to a root. Device buffers
+   are staged to the host in chunks, each copied while the previous one
+   is written. Returns non-zero if the file cannot be opened.
+ */
+template <typename DataType, typename Allocator>
+int WriteFile(const Tensor<DataType, LocaleMPI, Allocator> &t_mpi,
+              const std::string &file_path) {
+  return internal::ReadOrWriteFile<false>(t_mpi, file_path);
+}
+
+/**
+   Reads the parts of a distributed tensor from a tensor file through
+   MPI-IO. The tensor may be distributed differently from the one
+   written, as long as its type and shape are the same. Halos are not
+   read. Returns non-zero if the file cannot be opened or does not
+   match the tensor.
+ */
+template <typename DataType, typename Allocator>
+int ReadFile(Tensor<DataType, LocaleMPI, Allocator> &t_mpi,
+             const std::string &file_path) {
+  return internal::ReadOrWriteFile<true>(t_mpi, file_path);
+}
+
 template <typename DataType, typename AllocSrc, typename AllocDest,
           typename StreamType=DefaultStream>
 inline int Copy(Tensor<DataType, LocaleMPI, AllocDest> &t_dest,
@@ -1096,6 +1573,12 @@ inline int Copy(Tensor<DataType, LocaleMPI, AllocDest> &t_dest,
     return 1;
   }
 
+  if (t_dest.get_layout() != t_src.get_layout()) {
+    util::MPIPrintStreamError()
+        << "Can't copy between tensors with different layouts";
+    return 1;
+  }
+
   if (t_dest.is_null() && !t_dest.get_local_shape().is_empty()) {
     util::MPIPrintStreamDebug()
         << "Dest tensor is null. Allocating tensor";
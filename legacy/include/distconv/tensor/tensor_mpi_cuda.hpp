@@ -9,6 +9,8 @@
 #include "distconv/util/util_mpi.hpp"
 #include <distconv_config.hpp>
 
+#include <vector>
+
 #if H2_HAS_CUDA
 #define GPU_MEMCPY_3D_PARAMS cudaMemcpy3DParms
 #elif H2_HAS_ROCM
@@ -154,6 +156,12 @@ class TensorImplHelper<DataType, CUDAAllocator> {
   TensorImplHelper(TensorImplType &impl): m_impl(impl) {}
   void clear_halo(int dim, h2::gpu::DeviceStream s);
   void scale(DataType v, h2::gpu::DeviceStream s);
+  // Allreduces the local elements outside of the halo over loc with
+  // its cached NCCL communicator, ordered on s
+  void allreduce(const LocaleMPI &loc, h2::gpu::DeviceStream s);
+  // Same with the backend ar, packing the elements when the halo
+  // separates them
+  void allreduce(Allreduce<DataType> &ar, h2::gpu::DeviceStream s);
 
   protected:
   TensorImplType &m_impl;
@@ -191,5 +199,48 @@ int Slice(Tensor<DataType, LocaleMPI, CUDAAllocator>& t_dest1,
           const Tensor<DataType, LocaleMPI, CUDAAllocator>& t_src,
           h2::gpu::DeviceStream s);
 
+/** Concatenate any number of tensors along the one dimension where
+ *  their shapes differ from t_dest, in a single kernel launch for up
+ *  to 16 sources. The dimension must not be partitioned, but the
+ *  others may be, with halos, as long as the sources share t_dest's
+ *  partitioning; halos are skipped.
+ *
+ *  When the local data of every source is made of long runs that are
+ *  contiguous in both the source and t_dest, e.g. along the outermost
+ *  dimension or any dimension without halos below it, each source is
+ *  copied instead with a single strided copy.
+ */
+template <typename DataType>
+int Concatenate(
+    Tensor<DataType, LocaleMPI, CUDAAllocator>& t_dest,
+    const std::vector<const Tensor<DataType, LocaleMPI, CUDAAllocator>*>&
+        t_srcs,
+    h2::gpu::DeviceStream s);
+
+// The inverse of the N-ary Concatenate.
+template <typename DataType>
+int Slice(const std::vector<Tensor<DataType, LocaleMPI, CUDAAllocator>*>&
+              t_dests,
+          const Tensor<DataType, LocaleMPI, CUDAAllocator>& t_src,
+          h2::gpu::DeviceStream s);
+
+/** Whether Concatenate and Slice may use strided copies instead of
+ *  their kernel. Enabled unless DISTCONV_CONCAT_KERNEL is set.
+ */
+void set_concat_copies_enabled(bool enabled);
+bool get_concat_copies_enabled();
+
+/** Make the unallocated t_srcs views of consecutive slices of t_dest
+ *  with ViewSlice, so that writing them concatenates them without any
+ *  copy. For example, the outputs of convolutions feeding a channel
+ *  concatenation of a channels-last tensor can be views. Returns
+ *  non-zero, leaving t_srcs untouched, when the local layout of t_dest
+ *  cannot be split that way, in which case Concatenate must be used.
+ */
+template <typename DataType>
+int ViewConcatenation(
+    Tensor<DataType, LocaleMPI, CUDAAllocator>& t_dest,
+    const std::vector<Tensor<DataType, LocaleMPI, CUDAAllocator>*>& t_srcs);
+
 } // namespace tensor
 } // namespace distconv
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "distconv_config.hpp"
+
+/*
+  The P2P and SHMEM communication paths are written against the CUDA
+  runtime. On ROCm, this header maps the names they use to their HIP
+  equivalents, so that their sources build as HIP unchanged. Include
+  it instead of the CUDA headers; with CUDA it includes just those.
+ */
+
+#if H2_HAS_CUDA
+
+#include <cuda.h>
+#include <cuda_runtime.h>
+
+#elif H2_HAS_ROCM
+
+#include "distconv/util/util_rocm.hpp"
+
+#include <hip/hip_runtime.h>
+
+// Types
+#define cudaDeviceProp hipDeviceProp_t
+#define cudaError_t hipError_t
+#define cudaEvent_t hipEvent_t
+#define cudaIpcEventHandle_t hipIpcEventHandle_t
+#define cudaIpcMemHandle_t hipIpcMemHandle_t
+#define cudaStream_t hipStream_t
+#define cuuint32_t uint32_t
+
+// Constants
+#define cudaComputeModeDefault hipComputeModeDefault
+#define cudaDevP2PAttrAccessSupported hipDevP2PAttrAccessSupported
+#define cudaDevP2PAttrPerformanceRank hipDevP2PAttrPerformanceRank
+#define cudaErrorNotReady hipErrorNotReady
+#define cudaErrorPeerAccessAlreadyEnabled hipErrorPeerAccessAlreadyEnabled
+#define cudaEventDisableTiming hipEventDisableTiming
+#define cudaEventInterprocess hipEventInterprocess
+#define cudaHostAllocMapped hipHostMallocMapped
+#define cudaHostAllocWriteCombined hipHostMallocWriteCombined
+#define cudaIpcMemLazyEnablePeerAccess hipIpcMemLazyEnablePeerAccess
+#define cudaMemcpyDeviceToDevice hipMemcpyDeviceToDevice
+#define cudaMemcpyDeviceToHost hipMemcpyDeviceToHost
+#define cudaMemcpyHostToDevice hipMemcpyHostToDevice
+#define cudaStreamNonBlocking hipStreamNonBlocking
+#define cudaSuccess hipSuccess
+
+// Functions
+#define cudaDeviceCanAccessPeer hipDeviceCanAccessPeer
+#define cudaDeviceEnablePeerAccess hipDeviceEnablePeerAccess
+#define cudaDeviceGetP2PAttribute hipDeviceGetP2PAttribute
+#define cudaDeviceGetStreamPriorityRange hipDeviceGetStreamPriorityRange
+#define cudaDeviceReset hipDeviceReset
+#define cudaDeviceSynchronize hipDeviceSynchronize
+#define cudaEventCreateWithFlags hipEventCreateWithFlags
+#define cudaEventDestroy hipEventDestroy
+#define cudaEventQuery hipEventQuery
+#define cudaEventRecord hipEventRecord
+#define cudaEventSynchronize hipEventSynchronize
+#define cudaFree hipFree
+#define cudaFreeHost hipHostFree
+#define cudaGetDevice hipGetDevice
+#define cudaGetDeviceCount hipGetDeviceCount
+#define cudaGetDeviceProperties hipGetDeviceProperties
+#define cudaGetErrorString hipGetErrorString
+#define cudaGetLastError hipGetLastError
+#define cudaHostAlloc hipHostMalloc
+#define cudaIpcCloseMemHandle hipIpcCloseMemHandle
+#define cudaIpcGetEventHandle hipIpcGetEventHandle
+#define cudaIpcGetMemHandle hipIpcGetMemHandle
+#define cudaIpcOpenEventHandle hipIpcOpenEventHandle
+#define cudaIpcOpenMemHandle hipIpcOpenMemHandle
+#define cudaMalloc hipMalloc
+#define cudaMemGetInfo hipMemGetInfo
+#define cudaMemcpy hipMemcpy
+#define cudaMemcpyAsync hipMemcpyAsync
+#define cudaMemcpyPeerAsync hipMemcpyPeerAsync
+#define cudaMemset hipMemset
+#define cudaSetDevice hipSetDevice
+#define cudaStreamCreate hipStreamCreate
+#define cudaStreamCreateWithPriority hipStreamCreateWithPriority
+#define cudaStreamDestroy hipStreamDestroy
+#define cudaStreamSynchronize hipStreamSynchronize
+#define cudaStreamWaitEvent hipStreamWaitEvent
+
+// Error checking of distconv
+#define DISTCONV_CHECK_CUDA(...) DISTCONV_CHECK_HIP(__VA_ARGS__)
+#define DISTCONV_CUDA_MALLOC(...) DISTCONV_HIP_MALLOC(__VA_ARGS__)
+
+#endif
@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+namespace distconv {
+namespace util {
+
+/*
+  Bounded lock-free free list of trivially copyable values, safe for
+  any number of concurrent producers and consumers.
+
+  Values are kept in a fixed array of slots. Slots holding values and
+  unused slots form two Treiber stacks linked by slot indices. Each
+  stack head packs the index of its top slot with a counter that is
+  incremented by every update, so that a stale head does not pass the
+  compare-and-swap when a slot is popped and pushed back in between
+  (the ABA problem).
+ */
+template <typename T>
+class FreeList {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "FreeList requires trivially copyable values");
+
+ public:
+  explicit FreeList(uint32_t capacity):
+      m_capacity(capacity), m_slots(new Slot[capacity]),
+      m_full(pack(0, NIL)), m_empty(pack(0, capacity > 0 ? 0 : NIL)),
+      m_size(0) {
+    for (uint32_t i = 0; i < capacity; ++i) {
+      m_slots[i].next.store(i + 1 < capacity ? i + 1 : NIL,
+                            std::memory_order_relaxed);
+    }
+  }
+
+  FreeList(const FreeList &) = delete;
+  FreeList &operator=(const FreeList &) = delete;
+
+  // Returns false if the list is full
+  bool push(const T &v) {
+    uint32_t idx;
+    if (!pop_slot(m_empty, idx)) return false;
+    m_slots[idx].value = v;
+    push_slot(m_full, idx);
+    m_size.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Returns false if the list is empty
+  bool pop(T &v) {
+    uint32_t idx;
+    if (!pop_slot(m_full, idx)) return false;
+    v = m_slots[idx].value;
+    push_slot(m_empty, idx);
+    m_size.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Not exact while other threads update the list
+  size_t size() const {
+    return m_size.load(std::memory_order_relaxed);
+  }
+
+  uint32_t capacity() const {
+    return m_capacity;
+  }
+
+ private:
+  static constexpr uint32_t NIL = ~0u;
+
+  struct Slot {
+    T value;
+    std::atomic<uint32_t> next;
+  };
+
+  const uint32_t m_capacity;
+  std::unique_ptr<Slot[]> m_slots;
+  std::atomic<uint64_t> m_full;
+  std::atomic<uint64_t> m_empty;
+  std::atomic<size_t> m_size;
+
+  static uint64_t pack(uint64_t tag, uint32_t idx) {
+    return (tag << 32) | idx;
+  }
+
+  static uint64_t next_tag(uint64_t head) {
+    return (head >> 32) + 1;
+  }
+
+  bool pop_slot(std::atomic<uint64_t> &head, uint32_t &idx) {
+    uint64_t h = head.load(std::memory_order_acquire);
+    while (true) {
+      idx = static_cast<uint32_t>(h);
+      if (idx == NIL) return false;
+      // May be stale if the slot is popped by another thread, in
+      // which case the tag of the head has changed.
+      const uint32_t next = m_slots[idx].next.load(
+          std::memory_order_relaxed);
+      if (head.compare_exchange_weak(h, pack(next_tag(h), next),
+                                     std::memory_order_acq_rel,
+                                     std::memory_order_acquire)) {
+        return true;
+      }
+    }
+  }
+
+  void push_slot(std::atomic<uint64_t> &head, uint32_t idx) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    do {
+      m_slots[idx].next.store(static_cast<uint32_t>(h),
+                              std::memory_order_relaxed);
+    } while (!head.compare_exchange_weak(h, pack(next_tag(h), idx),
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed));
+  }
+};
+
+} // namespace util
+} // namespace distconv
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "h2/gpu/ranges.hpp"
+#include "h2/gpu/runtime.hpp"
+
+#include <mpi.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+  Per-layer timing of the GPU work of distconv.
+
+  Layer operations, halo exchange, shuffle and allreduce phases record
+  a pair of pooled GPU events around the work they enqueue. The events
+  are resolved lazily into records kept in a fixed-size ring buffer of
+  the process, so timing does not synchronize the streams. Records are
+  attributed to the layer of the innermost enclosing layer operation,
+  which allows to break down communication by layer.
+
+  Instrumentation is off by default, and is turned on by setting the
+  DISTCONV_INSTRUMENTATION environment variable or with set_enabled.
+  Timers started while it is off cost only a check of the flag.
+
+  Independently, timers mark their phases as h2::gpu ranges while
+  those are enabled, so profiler timelines show the same breakdown.
+
+  Communication that waits on a single peer, such as a halo exchange
+  with a neighbor, is timed with the rank of the peer. A slow GPU then
+  shows up as long waits of all its neighbors on it, which
+  get_straggler_report gathers over the ranks of a communicator.
+ */
+
+namespace distconv {
+namespace util {
+namespace instrumentation {
+
+enum class Phase {
+  FORWARD,
+  BACKWARD_DATA,
+  BACKWARD_FILTER,
+  BACKWARD_BIAS,
+  HALO_PACK,
+  HALO_TRANSFER,
+  HALO_UNPACK,
+  SHUFFLE_PACK,
+  SHUFFLE_TRANSFER,
+  SHUFFLE_UNPACK,
+  ALLREDUCE,
+};
+
+constexpr int num_phases = static_cast<int>(Phase::ALLREDUCE) + 1;
+
+const char *to_string(Phase phase);
+
+struct Record {
+  std::string layer;
+  Phase phase;
+  // Milliseconds since the first recorded event of the process
+  double start;
+  double duration;
+  // Rank waited on in the communicator of the exchange, or -1
+  int peer = -1;
+};
+
+struct Stats {
+  std::size_t count = 0;
+  double total = 0;
+  double mean = 0;
+  double min = 0;
+  double max = 0;
+  double p50 = 0;
+  double p90 = 0;
+  double p99 = 0;
+};
+
+bool is_enabled();
+void set_enabled(bool enabled);
+
+/** Number of records kept; the oldest ones are overwritten first. */
+std::size_t get_capacity();
+void set_capacity(std::size_t capacity);
+
+/**
+   Starts timing phase of layer on stream and returns the id to pass
+   to end. An empty layer is replaced with the current layer. Nothing
+   is timed while stream is captured into a graph. peer is the rank
+   the work waits on, if any.
+ */
+std::uint64_t begin(const std::string &layer, Phase phase,
+                    h2::gpu::DeviceStream stream, int peer=-1);
+void end(std::uint64_t id, h2::gpu::DeviceStream stream);
+
+/** Name of the innermost layer operation being timed, if any. */
+const std::string &get_current_layer();
+
+/**
+   Moves the completed timings into the ring buffer. If wait is true,
+   waits for all of the timings that are ended.
+ */
+void collect(bool wait=false);
+
+/** Records in the buffer from the oldest. Collects completed timings. */
+std::vector<Record> get_records();
+/** Names of the layers with records in the buffer. */
+std::vector<std::string> get_layers();
+/** Statistics of the records of phase of layer, in milliseconds. */
+Stats get_stats(const std::string &layer, Phase phase);
+/** Statistics of the records of phase over all layers. */
+Stats get_stats(Phase phase);
+
+/** Statistics of the records with a peer, by peer. */
+std::map<int, Stats> get_peer_stats();
+
+struct PeerWait {
+  int rank;
+  int peer;
+  // Milliseconds rank waited on peer
+  double total;
+};
+
+struct StragglerReport {
+  /**
+     Slowness score of each rank: the mean time its neighbors waited on
+     it over the median of those of all the ranks waited on. Ranks much
+     above 1 delay their neighbors; 0 if no rank waited on it.
+   */
+  std::vector<double> scores;
+  /**
+     Milliseconds each rank spent in allreduces. A rank arriving late
+     spends the least, as the others wait for it inside the collective.
+   */
+  std::vector<double> collective_time;
+  /** Pairs with the longest waits, from the longest. */
+  std::vector<PeerWait> worst_pairs;
+};
+
+/**
+   Gathers the waits on each peer of the ranks of comm, which must be
+   the communicator the peers are ranks of. Only the records that
+   started within the last window milliseconds of each process are
+   counted, or all of them if window is 0. Collective over comm;
+   waits for the pending timings.
+ */
+StragglerReport get_straggler_report(MPI_Comm comm, double window=0,
+                                     std::size_t num_pairs=8);
+
+/** Drops all records and the pending timings. */
+void clear();
+
+/**
+   Writes the statistics of each layer and phase as JSON, waiting for
+   the pending timings.
+ */
+void write_json(std::ostream &os);
+/**
+   Writes the records in the Chrome trace event format, waiting for the
+   pending timings. Each rank is a process and each phase a thread.
+ */
+void write_chrome_trace(std::ostream &os);
+/** Writes report as JSON. */
+void write_json(std::ostream &os, const StragglerReport &report);
+
+/**
+   Opens a range of phase in the distconv domain, named after layer if
+   not empty. Closed with pop_range.
+ */
+void push_range(const std::string &layer, Phase phase);
+void pop_range();
+
+/** Times the work enqueued on stream during its lifetime. */
+class ScopedTimer {
+ public:
+  ScopedTimer(const std::string &layer, Phase phase,
+              h2::gpu::DeviceStream stream):
+      m_enabled(is_enabled()), m_range(h2::gpu::ranges_enabled()),
+      m_stream(stream) {
+    if (m_range) push_range(layer, phase);
+    if (m_enabled) m_id = begin(layer, phase, stream);
+  }
+  ScopedTimer(Phase phase, h2::gpu::DeviceStream stream):
+      ScopedTimer(std::string(), phase, stream) {}
+  // Times work that waits on peer
+  ScopedTimer(Phase phase, int peer, h2::gpu::DeviceStream stream):
+      m_enabled(is_enabled()), m_range(h2::gpu::ranges_enabled()),
+      m_stream(stream) {
+    if (m_range) push_range(std::string(), phase);
+    if (m_enabled) m_id = begin(std::string(), phase, stream, peer);
+  }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+  ~ScopedTimer() {
+    if (m_enabled) end(m_id, m_stream);
+    if (m_range) pop_range();
+  }
+
+ private:
+  bool m_enabled;
+  bool m_range;
+  h2::gpu::DeviceStream m_stream;
+  std::uint64_t m_id = 0;
+};
+
+} // namespace instrumentation
+} // namespace util
+} // namespace distconv
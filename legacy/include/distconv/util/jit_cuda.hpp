@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cuda.h>
+#include <cuda_runtime.h>
+
+#include <string>
+
+/*
+  Kernels compiled at run time with NVRTC.
+
+  Kernels specialized for a fixed geometry, e.g., with all the shapes
+  and strides of a halo as constants, are generated as source once a
+  layer is set up and compiled for the current device. The binaries
+  are cached in memory and on disk, keyed by a hash of the source and
+  the device architecture, so later runs and the other processes of a
+  node load them instead of compiling again.
+
+  The path is optional: it is used only if DISTCONV_JIT_KERNELS is
+  set, and the callers fall back to their generic kernels when a
+  kernel is not available. The disk cache is in DISTCONV_JIT_CACHE_DIR,
+  by default distconv_jit in the temporary directory.
+ */
+
+namespace distconv {
+namespace util {
+namespace jit {
+
+/** Whether the runtime-compiled kernels are enabled. */
+bool is_enabled();
+
+/** Directory of the compiled binaries. */
+std::string get_cache_dir();
+
+/**
+   Function name, declared extern "C", of source compiled for the
+   current device. Null if it cannot be compiled, which is reported
+   once per source.
+ */
+CUfunction get_kernel(const std::string &source, const std::string &name);
+
+void launch(CUfunction kernel, unsigned grid, unsigned block,
+            cudaStream_t stream, void **args);
+
+} // namespace jit
+} // namespace util
+} // namespace distconv
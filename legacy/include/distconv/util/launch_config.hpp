@@ -0,0 +1,125 @@
+#pragma once
+
+#include "distconv/util/util_gpu.hpp"
+#include "distconv_config.hpp"
+
+namespace distconv
+{
+namespace util
+{
+
+/** @brief Launch configuration and warp-level primitives of the
+ *  kernels of distconv.
+ *
+ *  NVIDIA GPUs run warps of 32 threads. ROCm builds target CDNA2
+ *  (MI200) and CDNA3 (MI300) GPUs, whose wavefronts are 64 threads wide
+ *  and whose compute units have four SIMDs each. Kernels written for
+ *  warps of 32 would leave half of each wavefront idle in their
+ *  shuffles and size their shared memory for twice as many warps as
+ *  there are.
+ */
+#if H2_HAS_CUDA
+constexpr int warp_size = 32;
+/** @brief Block size of element-wise and grid-stride kernels. */
+constexpr int block_size = 256;
+/** @brief Block size of kernels reducing partial sums in a block. */
+constexpr int reduce_block_size = 256;
+#elif H2_HAS_ROCM
+constexpr int warp_size = 64;
+// Four wavefronts, one per SIMD of a CU
+constexpr int block_size = 256;
+// Reductions are mostly waiting on memory. Two wavefronts per SIMD
+// leave one to switch to, which a block of four does not.
+constexpr int reduce_block_size = 512;
+#endif
+/** @brief Block size of kernels reducing a whole channel in one block. */
+constexpr int max_reduce_block_size = 1024;
+
+static_assert(block_size % warp_size == 0
+                  && reduce_block_size % warp_size == 0
+                  && max_reduce_block_size % warp_size == 0,
+              "Block sizes must be multiples of the warp size");
+
+#if defined(__CUDACC__) || __HIP__
+
+#define DISTCONV_DEFINE_SHFL_DOWN(T)                                           \
+    __device__ __forceinline__ T shfl_down(T v, int delta)                     \
+    {                                                                          \
+        DISTCONV_SHFL_DOWN_CALL(v, delta);                                     \
+    }
+#define DISTCONV_DEFINE_SHFL_DOWN2(V)                                          \
+    __device__ __forceinline__ V shfl_down(V v, int delta)                     \
+    {                                                                          \
+        V w;                                                                   \
+        w.x = shfl_down(v.x, delta);                                           \
+        w.y = shfl_down(v.y, delta);                                           \
+        return w;                                                              \
+    }
+#if H2_HAS_CUDA
+#define DISTCONV_SHFL_DOWN_CALL(v, delta)                                      \
+    return __shfl_down_sync(0xffffffffu, v, delta)
+#elif H2_HAS_ROCM
+#define DISTCONV_SHFL_DOWN_CALL(v, delta) return __shfl_down(v, delta)
+#endif
+
+/** @brief The value of the lane delta lanes above in the warp. */
+DISTCONV_DEFINE_SHFL_DOWN(float)
+DISTCONV_DEFINE_SHFL_DOWN(double)
+DISTCONV_DEFINE_SHFL_DOWN(int)
+DISTCONV_DEFINE_SHFL_DOWN(long)
+DISTCONV_DEFINE_SHFL_DOWN2(float2)
+DISTCONV_DEFINE_SHFL_DOWN2(double2)
+
+#undef DISTCONV_SHFL_DOWN_CALL
+#undef DISTCONV_DEFINE_SHFL_DOWN2
+#undef DISTCONV_DEFINE_SHFL_DOWN
+
+/** @brief Sum of v over the warp, valid in its first lane. */
+template <typename T>
+__device__ __forceinline__ T warp_reduce_sum(T v)
+{
+#pragma unroll
+    for (int delta = warp_size / 2; delta > 0; delta /= 2)
+    {
+        v += shfl_down(v, delta);
+    }
+    return v;
+}
+
+/** @brief Sum of v over a block of BLOCK_SIZE threads, valid in its
+ *  first thread.
+ *
+ *  Warps reduce with shuffles, and only their sums go through shared
+ *  memory. All threads of the block must call it.
+ */
+template <int BLOCK_SIZE, typename T>
+__device__ __forceinline__ T block_reduce_sum(T v)
+{
+    static_assert(BLOCK_SIZE % warp_size == 0,
+                  "The block size must be a multiple of the warp size");
+    constexpr int num_warps = BLOCK_SIZE / warp_size;
+    __shared__ T warp_sums[num_warps];
+    const int lane = threadIdx.x % warp_size;
+    const int warp = threadIdx.x / warp_size;
+    v = warp_reduce_sum(v);
+    if (num_warps == 1)
+    {
+        return v;
+    }
+    if (lane == 0)
+    {
+        warp_sums[warp] = v;
+    }
+    __syncthreads();
+    if (warp == 0)
+    {
+        v = lane < num_warps ? warp_sums[lane] : T{};
+        v = warp_reduce_sum(v);
+    }
+    return v;
+}
+
+#endif // defined(__CUDACC__) || __HIP__
+
+} // namespace util
+} // namespace distconv
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "distconv_config.hpp"
+#include "h2/utils/Logger.hpp"
+
+/*
+  Loggers of distconv, one per subsystem, named hierarchically under
+  "distconv" so that levels can be set per subsystem:
+
+    DISTCONV_LOG_LEVEL="info,distconv.shuffle=debug"
+    DISTCONV_LOG_MASK="distconv.halo=debug|error"
+    DISTCONV_LOG_ASYNC="on,queue=65536"
+
+  The level defaults to debug in DISTCONV_DEBUG builds and to info
+  otherwise. DISTCONV_PRINT_{DEBUG,INFO,WARNING,ERROR}=0 still turn
+  their levels off.
+ */
+
+namespace distconv {
+namespace util {
+
+enum class LogSubsystem {
+  Core,
+  Tensor,
+  Shuffle,
+  HaloExchange,
+  DNN,
+};
+
+/** Returns the logger of a subsystem, setting up all on first use. */
+h2::Logger &get_logger(LogSubsystem subsystem=LogSubsystem::Core);
+
+} // namespace util
+} // namespace distconv
+
+/*
+  Stream a message to the logger of a subsystem. Nothing after the
+  macro is evaluated when the level is disabled, which only costs a
+  relaxed load. Debug messages are compiled out without DISTCONV_DEBUG.
+
+    DISTCONV_LOG_DEBUG(Shuffle) << "Reusing shuffle plan of " << key;
+ */
+#define DISTCONV_LOG(subsystem, level)                                  \
+  H2_LOG_STREAM(::distconv::util::get_logger(                           \
+      ::distconv::util::LogSubsystem::subsystem), level)
+
+#ifdef DISTCONV_DEBUG
+#define DISTCONV_LOG_DEBUG(subsystem) DISTCONV_LOG(subsystem, DEBUG)
+#else
+#define DISTCONV_LOG_DEBUG(subsystem)                                   \
+  true ? (void)0 : ::h2_internal::LogStreamVoidify() & std::cerr
+#endif
+#define DISTCONV_LOG_INFO(subsystem) DISTCONV_LOG(subsystem, INFO)
+#define DISTCONV_LOG_WARNING(subsystem) DISTCONV_LOG(subsystem, WARN)
+#define DISTCONV_LOG_ERROR(subsystem) DISTCONV_LOG(subsystem, ERROR)
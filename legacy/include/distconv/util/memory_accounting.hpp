@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+  Accounting of the device memory of distconv by owner, to compare
+  the memory cost of decompositions.
+
+  The tensor allocators, CUDAAllocator and NVSHMEMAllocator, record
+  each buffer with the owner of the innermost OwnerScope of the
+  calling thread, which is the layer by default. Halo exchanges,
+  shufflers and the workspaces of the backends open scopes around
+  their allocations, and shufflers also record the buffers they take
+  from the memory pool. Buffers of the NVSHMEM symmetric heap are
+  counted separately as well.
+
+  Phases, opened with PhaseScope and possibly nested, record the peak
+  usage while they are open and the steady-state usage left when they
+  close.
+
+  Accounting is off by default, and is turned on by setting the
+  DISTCONV_MEMORY_ACCOUNTING environment variable or with
+  set_enabled. Buffers allocated while it is off are not counted.
+ */
+
+namespace distconv {
+namespace util {
+namespace memory_accounting {
+
+enum class Owner {
+  LAYER,
+  HALO,
+  SHUFFLE,
+  WORKSPACE,
+};
+
+constexpr int num_owners = static_cast<int>(Owner::WORKSPACE) + 1;
+
+inline const char *to_string(Owner owner) {
+  switch (owner) {
+    case Owner::LAYER: return "layer";
+    case Owner::HALO: return "halo";
+    case Owner::SHUFFLE: return "shuffle";
+    case Owner::WORKSPACE: return "workspace";
+  }
+  return "unknown";
+}
+
+/** Bytes allocated per owner, in total and in the symmetric heap. */
+struct Usage {
+  std::array<size_t, num_owners> owners{};
+  size_t total = 0;
+  size_t symmetric = 0;
+
+  size_t get(Owner owner) const {
+    return owners[static_cast<int>(owner)];
+  }
+
+  /** Keeps the maximum of each count. */
+  void update_peak(const Usage &usage) {
+    for (int i = 0; i < num_owners; ++i) {
+      owners[i] = std::max(owners[i], usage.owners[i]);
+    }
+    total = std::max(total, usage.total);
+    symmetric = std::max(symmetric, usage.symmetric);
+  }
+};
+
+struct PhaseRecord {
+  std::string name;
+  Usage peak;
+  // Usage when the phase ended
+  Usage steady;
+};
+
+namespace internal {
+
+struct Allocation {
+  Owner owner;
+  size_t size;
+  bool symmetric;
+};
+
+struct State {
+  bool enabled = false;
+  std::mutex mutex;
+  std::unordered_map<const void*, Allocation> allocations;
+  Usage current;
+  // Open phases from the outermost
+  std::vector<PhaseRecord> open_phases;
+  std::vector<PhaseRecord> phases;
+  State() {
+    const char *env = std::getenv("DISTCONV_MEMORY_ACCOUNTING");
+    enabled = env && env[0] != '\0' && env[0] != '0';
+  }
+};
+
+inline State &get_state() {
+  static State state;
+  return state;
+}
+
+inline Owner &get_thread_owner() {
+  thread_local Owner owner = Owner::LAYER;
+  return owner;
+}
+
+inline void add(Usage &usage, const Allocation &a, bool release) {
+  auto update = [&](size_t &count) {
+    count = release ? count - std::min(count, a.size) : count + a.size;
+  };
+  update(usage.owners[static_cast<int>(a.owner)]);
+  update(usage.total);
+  if (a.symmetric) update(usage.symmetric);
+}
+
+} // namespace internal
+
+inline bool is_enabled() {
+  return internal::get_state().enabled;
+}
+
+inline void set_enabled(bool enabled) {
+  internal::get_state().enabled = enabled;
+}
+
+/** Owner of the buffers allocated by the calling thread. */
+inline Owner get_owner() {
+  return internal::get_thread_owner();
+}
+
+/** Sets the owner of the buffers the calling thread allocates. */
+class OwnerScope {
+ public:
+  explicit OwnerScope(Owner owner): m_prev(get_owner()) {
+    internal::get_thread_owner() = owner;
+  }
+  ~OwnerScope() { internal::get_thread_owner() = m_prev; }
+  OwnerScope(const OwnerScope &) = delete;
+  OwnerScope &operator=(const OwnerScope &) = delete;
+ private:
+  Owner m_prev;
+};
+
+/**
+   Counts a buffer of size bytes at p for the current owner; symmetric
+   tells if it is in the symmetric heap.
+ */
+inline void record_allocation(const void *p, size_t size,
+                              bool symmetric=false) {
+  auto &state = internal::get_state();
+  if (!state.enabled || p == nullptr) return;
+  const internal::Allocation a{get_owner(), size, symmetric};
+  std::lock_guard<std::mutex> lock(state.mutex);
+  auto it = state.allocations.find(p);
+  if (it != state.allocations.end()) {
+    // Reused without being recorded as freed
+    internal::add(state.current, it->second, true);
+    it->second = a;
+  } else {
+    state.allocations.emplace(p, a);
+  }
+  internal::add(state.current, a, false);
+  for (auto &phase: state.open_phases) {
+    phase.peak.update_peak(state.current);
+  }
+}
+
+/** Stops counting the buffer at p if it was recorded. */
+inline void record_deallocation(const void *p) {
+  auto &state = internal::get_state();
+  if (p == nullptr) return;
+  std::lock_guard<std::mutex> lock(state.mutex);
+  auto it = state.allocations.find(p);
+  if (it == state.allocations.end()) return;
+  internal::add(state.current, it->second, true);
+  state.allocations.erase(it);
+}
+
+inline Usage get_usage() {
+  auto &state = internal::get_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.current;
+}
+
+inline void begin_phase(const std::string &name) {
+  auto &state = internal::get_state();
+  if (!state.enabled) return;
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.open_phases.push_back({name, state.current, Usage()});
+}
+
+/** Ends the innermost phase and records it. */
+inline void end_phase() {
+  auto &state = internal::get_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.open_phases.empty()) return;
+  auto phase = std::move(state.open_phases.back());
+  state.open_phases.pop_back();
+  phase.steady = state.current;
+  state.phases.push_back(std::move(phase));
+}
+
+/** Phase open for the lifetime of the scope. */
+class PhaseScope {
+ public:
+  explicit PhaseScope(const std::string &name): m_enabled(is_enabled()) {
+    if (m_enabled) begin_phase(name);
+  }
+  ~PhaseScope() {
+    if (m_enabled) end_phase();
+  }
+  PhaseScope(const PhaseScope &) = delete;
+  PhaseScope &operator=(const PhaseScope &) = delete;
+ private:
+  bool m_enabled;
+};
+
+/** Phases ended so far, in the order they ended. */
+inline std::vector<PhaseRecord> get_phases() {
+  auto &state = internal::get_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.phases;
+}
+
+/** Discards the phases ended so far; buffers stay counted. */
+inline void clear_phases() {
+  auto &state = internal::get_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.phases.clear();
+}
+
+/** Prints the peak and steady-state usage of phases in MiB. */
+inline std::ostream &print(std::ostream &os,
+                           const std::vector<PhaseRecord> &phases) {
+  auto mib = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+  auto print_usage = [&](const Usage &usage) {
+    os << mib(usage.total) << " MiB (";
+    for (int i = 0; i < num_owners; ++i) {
+      os << to_string(static_cast<Owner>(i)) << ": "
+         << mib(usage.owners[i]) << ", ";
+    }
+    os << "symmetric: " << mib(usage.symmetric) << ")";
+  };
+  for (const auto &phase: phases) {
+    os << phase.name << " memory peak: ";
+    print_usage(phase.peak);
+    os << ", steady: ";
+    print_usage(phase.steady);
+    os << "\n";
+  }
+  return os;
+}
+
+} // namespace memory_accounting
+} // namespace util
+} // namespace distconv
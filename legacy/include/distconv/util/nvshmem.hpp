@@ -1,11 +1,16 @@
 #pragma once
 
 #include "distconv_config.hpp"
+#include "distconv/util/cuda_to_hip.hpp"
 #include "distconv/util/util_mpi.hpp"
 
+#include <map>
 #include <memory>
+#include <vector>
 
-#ifdef DISTCONV_HAS_NVSHMEM
+#if defined(DISTCONV_HAS_ROCSHMEM)
+#include "distconv/util/rocshmem.hpp"
+#elif defined(DISTCONV_HAS_NVSHMEM)
 #ifndef NVSHMEM_TARGET
 #define NVSHMEM_TARGET
 #endif
@@ -38,6 +43,59 @@ void launch_barrier(cudaStream_t s);
 
 enum class SyncType {NONE, FENCE, QUIET};
 
+/*
+  The symmetric heap of distconv. Symmetric buffers are carved from a
+  few large segments obtained with nvshmem_malloc, which is collective,
+  instead of each being allocated by itself. Every PE carves the same
+  sequence of allocations the same way, so the buffers stay symmetric
+  as long as they are allocated and deallocated in the same order by
+  all PEs, as nvshmem_malloc requires anyway.
+
+  Requirements are reserved at setup and obtained at once by grow(),
+  the only point where the heap synchronizes the PEs; allocate() grows
+  the heap by itself only when the reservations fall short. Freed
+  buffers are reused only after the next grow(), when no peer can
+  still access them.
+ */
+class SymmetricHeap {
+ public:
+  static constexpr size_t alignment = 256;
+
+  static SymmetricHeap &get_instance();
+
+  // Requirement of a buffer of size bytes to be allocated later
+  void reserve(size_t size);
+  // Collectively make room for the reservations and reclaim the
+  // freed buffers
+  void grow();
+  void *allocate(size_t size);
+  void deallocate(void *p);
+  // Collectively free all segments; buffers must not be used anymore
+  void release();
+
+  size_t get_capacity() const;
+  size_t get_allocated_size() const;
+
+ private:
+  struct Segment {
+    char *base;
+    size_t size;
+    // Free blocks by offset
+    std::map<size_t, size_t> free_blocks;
+  };
+
+  SymmetricHeap() = default;
+  static bool fit(std::vector<Segment> &segments, size_t size,
+                  void **p=nullptr);
+  static void insert_free_block(Segment &segment, size_t offset, size_t size);
+
+  std::vector<Segment> m_segments;
+  std::vector<size_t> m_reservations;
+  // Allocated and freed-but-not-reclaimed buffers with their size
+  std::map<void*, size_t> m_allocated;
+  std::vector<void*> m_freed;
+};
+
 struct PairwiseSyncDevice {
   using CounterType = long;
 
@@ -47,7 +105,7 @@ struct PairwiseSyncDevice {
 
   ~PairwiseSyncDevice() = default;
 
-#ifdef __CUDACC__
+#if defined(__CUDACC__) || __HIP__
   __device__ __forceinline__ void notify(int peer, SyncType sync_type) {
     if (sync_type == SyncType::FENCE) {
       nvshmem_fence();
@@ -110,7 +168,7 @@ struct SyncArrayDevice {
 
   ~SyncArrayDevice() = default;
 
-#ifdef __CUDACC__
+#if defined(__CUDACC__) || __HIP__
   __device__ __forceinline__ void notify(int peer, SyncType sync_type, int idx) {
     if (sync_type == SyncType::FENCE) {
       nvshmem_fence();
@@ -172,7 +230,7 @@ struct SyncArray {
   size_t m_size;
 };
 
-#ifdef __NVCC__
+#if defined(__NVCC__) || __HIP__
 #define DEFINE_PUT(TYPE)                                                \
   inline __device__ void put(TYPE *dest, const TYPE *source,            \
                              size_t nelems, int pe) {                   \
@@ -216,7 +274,7 @@ DEFINE_PUT(int)
 DEFINE_PUT(long)
 #undef DEFINE_PUT
 
-#endif // __NVCC__
+#endif // __NVCC__ || __HIP__
 
 // Set the team to all possible PEs. May affect correctness but builds succesfully
 #define DEFINE_SUM_TO_ALL(TYPE)                                         \
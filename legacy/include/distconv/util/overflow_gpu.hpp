@@ -0,0 +1,130 @@
+#pragma once
+
+#include "distconv/util/util_gpu.hpp"
+
+#include "h2/gpu/memory_utils.hpp"
+#include "h2/gpu/runtime.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <type_traits>
+
+/*
+  Device-side flag of non-finite gradients for dynamic loss scaling.
+
+  Checking every gradient for Inf and NaN in a separate pass reads all
+  of them once more each step. Instead, the kernels that already go
+  over the gradients set this flag as they write them: the reductions
+  of ReduceSum, the reduction of AllreduceNVSHMEM, the accumulation of
+  halos unpacked with SUM and the batch normalization backprop2. The
+  allreduces of other libraries are not checked, so a sum that only
+  overflows across processes is not detected, but an Inf or NaN of any
+  process is.
+
+  The checks are made only if enabled, with DISTCONV_OVERFLOW_CHECK or
+  set_enabled, before the kernels are issued. The flag is cleared by
+  reset and read by get, e.g., at the beginning and end of each step,
+  and is shared by all the streams, so the work of the step must be
+  ordered before get on its stream.
+ */
+
+namespace distconv {
+namespace util {
+namespace overflow {
+
+namespace internal {
+
+struct State {
+  bool enabled = false;
+  int *flag = nullptr;
+  State() {
+    const char *env = std::getenv("DISTCONV_OVERFLOW_CHECK");
+    enabled = env && env[0] != '\0' && env[0] != '0';
+  }
+};
+
+inline State &get_state() {
+  static State state;
+  return state;
+}
+
+} // namespace internal
+
+inline bool is_enabled() {
+  return internal::get_state().enabled;
+}
+
+inline void set_enabled(bool enabled) {
+  internal::get_state().enabled = enabled;
+}
+
+/** Device flag set by the checks; null if they are disabled. */
+inline int *get_flag() {
+  auto &state = internal::get_state();
+  if (!state.enabled) return nullptr;
+  if (state.flag == nullptr) {
+    // Kept for the rest of the run
+    DISTCONV_GPU_MALLOC(&state.flag, sizeof(int));
+    h2::gpu::mem_zero(state.flag, 1);
+  }
+  return state.flag;
+}
+
+/** Clears the flag after the work issued to stream so far. */
+inline void reset(h2::gpu::DeviceStream stream) {
+  if (int *flag = get_flag()) {
+    h2::gpu::mem_zero(flag, 1, stream);
+  }
+}
+
+/**
+   Whether a non-finite value was found since the last reset, after
+   the work issued to stream so far. Waits for stream.
+ */
+inline bool get(h2::gpu::DeviceStream stream) {
+  int *flag = get_flag();
+  if (flag == nullptr) return false;
+  int found = 0;
+  h2::gpu::mem_copy(&found, flag, 1, stream);
+  h2::gpu::sync(stream);
+  return found != 0;
+}
+
+#if defined(__CUDACC__) || defined(__HIPCC__)
+template <typename T>
+__device__ __forceinline__ bool is_finite(const T x) {
+  if constexpr (std::is_integral<T>::value) {
+    return true;
+  } else if constexpr (std::is_floating_point<T>::value) {
+    return isfinite(x);
+  } else {
+    // Reduced-precision types
+    return isfinite(static_cast<float>(x));
+  }
+}
+
+/**
+   Sets flag if x, made of elements of ElemT, e.g., a vector of them,
+   is not finite. Does nothing if flag is null.
+ */
+template <typename ElemT, typename T>
+__device__ __forceinline__ void check(int *flag, const T &x) {
+  if (flag == nullptr) return;
+  const ElemT *xs = reinterpret_cast<const ElemT*>(&x);
+  bool finite = true;
+#pragma unroll
+  for (int i = 0; i < static_cast<int>(sizeof(T) / sizeof(ElemT)); ++i) {
+    finite &= is_finite(xs[i]);
+  }
+  if (!finite) *flag = 1;
+}
+
+template <typename T>
+__device__ __forceinline__ void check(int *flag, const T &x) {
+  check<T, T>(flag, x);
+}
+#endif // defined(__CUDACC__) || defined(__HIPCC__)
+
+} // namespace overflow
+} // namespace util
+} // namespace distconv
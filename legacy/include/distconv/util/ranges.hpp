@@ -0,0 +1,41 @@
+#pragma once
+
+#include "distconv/runtime.hpp"
+#include "h2/gpu/ranges.hpp"
+
+/*
+  Ranges of distconv on the timelines of Nsight Systems and rocprof,
+  in the "distconv" domain of the h2::gpu range API. They are turned
+  on with DISTCONV_NVTX, DISTCONV_PROFILING or H2_GPU_RANGES, or by
+  enabling the NVTX marking of a backend.
+ */
+
+namespace distconv {
+namespace util {
+
+inline const h2::gpu::RangeDomain &get_range_domain() {
+  static const h2::gpu::RangeDomain domain("distconv");
+  return domain;
+}
+
+inline void profile_push(const char *name,
+                         h2::gpu::RangeCategory category=
+                         h2::gpu::RangeCategory::Compute) {
+  if (get_config().profiling) {
+    h2::gpu::range_push(get_range_domain(), name, category);
+  }
+}
+
+inline void profile_pop() {
+  if (get_config().profiling) {
+    h2::gpu::range_pop(get_range_domain());
+  }
+}
+
+} // namespace util
+} // namespace distconv
+
+/** Marks the rest of the scope as a range of the given category. */
+#define DISTCONV_RANGE(name, category)                          \
+  H2_GPU_RANGE(::distconv::util::get_range_domain(), name,      \
+               ::h2::gpu::RangeCategory::category)
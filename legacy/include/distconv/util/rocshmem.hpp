@@ -0,0 +1,79 @@
+#pragma once
+
+#include "distconv_config.hpp"
+
+#ifdef DISTCONV_HAS_ROCSHMEM
+
+#include <hip/hip_runtime.h>
+#include <rocshmem/rocshmem.hpp>
+
+/*
+  rocSHMEM backend of the SHMEM paths of distconv, i.e., the NVSHMEM
+  halo exchanges and allreduces. The subset of NVSHMEM they use is
+  mapped to rocSHMEM here, so that they build unchanged with ROCm. The
+  operations NVSHMEM enqueues to a stream, which rocSHMEM does not
+  have, are single-workgroup kernels running its device API.
+ */
+
+// Host
+#define nvshmem_barrier_all ::rocshmem::rocshmem_barrier_all
+#define nvshmem_finalize ::rocshmem::rocshmem_finalize
+#define nvshmem_free ::rocshmem::rocshmem_free
+#define nvshmem_malloc ::rocshmem::rocshmem_malloc
+#define nvshmem_my_pe ::rocshmem::rocshmem_my_pe
+#define nvshmem_n_pes ::rocshmem::rocshmem_n_pes
+#define nvshmemx_barrier_all_on_stream                                  \
+  distconv::util::nvshmem::barrier_all_on_stream
+#define nvshmemx_putmem_on_stream distconv::util::nvshmem::putmem_on_stream
+
+// Device
+#define NVSHMEM_CMP_GE ::rocshmem::ROCSHMEM_CMP_GE
+#define nvshmem_fence ::rocshmem::rocshmem_fence
+#define nvshmem_quiet ::rocshmem::rocshmem_quiet
+#define nvshmem_long_p ::rocshmem::rocshmem_long_p
+#define nvshmem_long_put_nbi ::rocshmem::rocshmem_long_put_nbi
+#define nvshmem_long_wait_until ::rocshmem::rocshmem_long_wait_until
+
+// Typed puts; the block-wide variants are the workgroup ones
+#define nvshmem_float_put ::rocshmem::rocshmem_float_put
+#define nvshmem_float_put_nbi ::rocshmem::rocshmem_float_put_nbi
+#define nvshmemx_float_put_block ::rocshmem::rocshmem_float_put_wg
+#define nvshmemx_float_put_nbi_block ::rocshmem::rocshmem_float_put_nbi_wg
+#define nvshmem_double_put ::rocshmem::rocshmem_double_put
+#define nvshmem_double_put_nbi ::rocshmem::rocshmem_double_put_nbi
+#define nvshmemx_double_put_block ::rocshmem::rocshmem_double_put_wg
+#define nvshmemx_double_put_nbi_block ::rocshmem::rocshmem_double_put_nbi_wg
+#define nvshmem_int_put ::rocshmem::rocshmem_int_put
+#define nvshmem_int_put_nbi ::rocshmem::rocshmem_int_put_nbi
+#define nvshmemx_int_put_block ::rocshmem::rocshmem_int_put_wg
+#define nvshmemx_int_put_nbi_block ::rocshmem::rocshmem_int_put_nbi_wg
+#define nvshmem_long_put ::rocshmem::rocshmem_long_put
+#define nvshmemx_long_put_block ::rocshmem::rocshmem_long_put_wg
+#define nvshmemx_long_put_nbi_block ::rocshmem::rocshmem_long_put_nbi_wg
+
+// Reductions over all PEs; the team argument is always the world
+#define nvshmemx_float_sum_reduce_on_stream(team, ...)                  \
+  distconv::util::nvshmem::sum_reduce_on_stream(__VA_ARGS__)
+#define nvshmemx_double_sum_reduce_on_stream(team, ...)                 \
+  distconv::util::nvshmem::sum_reduce_on_stream(__VA_ARGS__)
+#define nvshmemx_int_sum_reduce_on_stream(team, ...)                    \
+  distconv::util::nvshmem::sum_reduce_on_stream(__VA_ARGS__)
+#define nvshmemx_long_sum_reduce_on_stream(team, ...)                   \
+  distconv::util::nvshmem::sum_reduce_on_stream(__VA_ARGS__)
+
+namespace distconv {
+namespace util {
+namespace nvshmem {
+
+void barrier_all_on_stream(hipStream_t s);
+void putmem_on_stream(void *dest, const void *source, size_t nelems,
+                      int pe, hipStream_t s);
+template <typename DataType>
+void sum_reduce_on_stream(DataType *dest, const DataType *source,
+                          size_t nreduce, hipStream_t s);
+
+} // namespace nvshmem
+} // namespace util
+} // namespace distconv
+
+#endif // DISTCONV_HAS_ROCSHMEM
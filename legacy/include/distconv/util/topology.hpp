@@ -0,0 +1,118 @@
+#pragma once
+
+#include <mpi.h>
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+  Map of the latency and bandwidth between the processes of a
+  communicator.
+
+  The links are measured with Aluminum NCCL send/recvs, the path halo
+  exchanges take, so intra-node links go over NVLink or PCIe and
+  inter-node ones over the network. Rank r exchanges with r + d and
+  r - d at once for each shift d from 1, with all the processes busy
+  as in a halo exchange, until the time budget runs out. Neighbors in
+  rank order are thus always measured, and links not reached within
+  the budget are estimated by the mean of the measured links of the
+  same kind, intra- or inter-node.
+
+  Profiling takes a few seconds, so the map is cached on disk per
+  allocation and reloaded as long as the processes are placed on the
+  same nodes.
+ */
+
+namespace distconv {
+namespace util {
+
+class TopologyMap {
+ public:
+  struct Link {
+    // Seconds per message
+    double latency = 0;
+    // Bytes per second
+    double bandwidth = 0;
+    // Otherwise estimated from the links of the same kind
+    bool measured = false;
+  };
+
+  struct Options {
+    // Seconds
+    double budget = 10;
+    std::size_t small_bytes = 8;
+    std::size_t large_bytes = 1 << 24;
+    int num_trials = 5;
+  };
+
+  TopologyMap() = default;
+
+  /** Measures the links among the processes of comm. Collective. */
+  static TopologyMap profile(MPI_Comm comm, const Options &opts);
+  static TopologyMap profile(MPI_Comm comm) {
+    return profile(comm, Options());
+  }
+
+  /**
+     Loads the map of comm from path if it was profiled with the same
+     placement of the processes, and otherwise profiles it and saves
+     it to path. Collective.
+   */
+  static TopologyMap load_or_profile(MPI_Comm comm,
+                                     const std::string &path,
+                                     const Options &opts);
+  static TopologyMap load_or_profile(MPI_Comm comm,
+                                     const std::string &path) {
+    return load_or_profile(comm, path, Options());
+  }
+  static TopologyMap load_or_profile(MPI_Comm comm) {
+    return load_or_profile(comm, get_default_cache_path());
+  }
+
+  /**
+     DISTCONV_TOPOLOGY_CACHE if set, otherwise a file in the working
+     directory named after the job ID of the batch system.
+   */
+  static std::string get_default_cache_path();
+
+  int get_size() const { return m_nodes.size(); }
+  /** Node of rank, identified by its lowest rank. */
+  int get_node(int rank) const { return m_nodes[rank]; }
+  bool is_intra_node(int src, int dst) const {
+    return m_nodes[src] == m_nodes[dst];
+  }
+  const Link &get_link(int src, int dst) const {
+    return m_links[src * get_size() + dst];
+  }
+  /** Number of shifts measured within the budget. */
+  int get_num_measured_shifts() const { return m_num_shifts; }
+
+  /** Seconds to send bytes from src to dst. */
+  double estimate_time(int src, int dst, std::size_t bytes) const;
+  /**
+     Seconds of a step of a ring over ranks where each process sends
+     bytes to the next one, bound by the slowest link.
+   */
+  double estimate_ring_step_time(const std::vector<int> &ranks,
+                                 std::size_t bytes) const;
+
+  void save(std::ostream &os) const;
+  /** Returns false if is holds no valid map. */
+  bool load(std::istream &is);
+
+ private:
+  std::vector<int> m_nodes;
+  // Indexed by src * size + dst
+  std::vector<Link> m_links;
+  int m_num_shifts = 0;
+
+  static std::vector<int> get_nodes(MPI_Comm comm);
+  void estimate_unmeasured();
+  void bcast(MPI_Comm comm);
+};
+
+} // namespace util
+} // namespace distconv
@@ -13,6 +13,7 @@
 #include <memory>
 
 #include "distconv_config.hpp"
+#include "distconv/util/logging.hpp"
 
 // Preprocessors can be confused if an expression contains curly
 // braces and considers an expression is separated at the braces. A
@@ -123,8 +124,17 @@ class PrintStream<true> {
       m_enable(enable), m_os(os) {
     ss << prefix;
   }
+  // Logs the message to logger instead of writing it to a stream.
+  PrintStream(h2::Logger &logger, h2::Logger::LogLevelType level):
+      m_enable(logger.should_log(level)), m_os(std::cerr),
+      m_logger(&logger), m_level(level) {}
   ~PrintStream() {
     if (m_enable) {
+      if (m_logger) {
+        h2::LogStream(*m_logger, m_level).stream()
+            << m_prefix.str() << ss.str();
+        return;
+      }
       if (!m_printed_newline) ss << std::endl;
       std::string msg = m_prefix.str() + ss.str();
       m_os << msg;
@@ -134,23 +144,29 @@ class PrintStream<true> {
     return ss;
   }
   PrintStream<true> &operator<<(const char *x) {
-    ss << x;
-    m_printed_newline = x[std::strlen(x)-1] == '\n';
+    if (m_enable) {
+      ss << x;
+      m_printed_newline = x[std::strlen(x)-1] == '\n';
+    }
     return *this;
   }
   PrintStream<true> &operator<<(const std::string &x) {
-    ss << x;
-    m_printed_newline = x.back() == '\n';
+    if (m_enable) {
+      ss << x;
+      m_printed_newline = x.back() == '\n';
+    }
     return *this;
   }
   template <typename X>
   PrintStream<true> &operator<<(const X &x) {
-    ss << x;
+    if (m_enable) ss << x;
     return *this;
   }
   PrintStream<true> &operator<<(std::ostream&(*endl)(std::ostream&)) {
-    ss << endl;
-    m_printed_newline = true;
+    if (m_enable) {
+      ss << endl;
+      m_printed_newline = true;
+    }
     return *this;
   }
 
@@ -160,22 +176,17 @@ class PrintStream<true> {
   std::stringstream ss;
   std::stringstream m_prefix;
   bool m_printed_newline = false;
+  h2::Logger *m_logger = nullptr;
+  h2::Logger::LogLevelType m_level = h2::Logger::OFF;
 };
 
+// The print streams log to the distconv logger. Prefer the
+// DISTCONV_LOG_* macros on hot paths as they evaluate nothing when
+// the level is disabled.
 #ifdef DISTCONV_DEBUG
 class PrintStreamDebug: public PrintStream<true> {
  public:
-  PrintStreamDebug(const std::string &prefix="[DEBUG] "):
-      PrintStream(true, std::cerr, prefix) {
-    // Disable if DISTCONV_PRINT_DEBUG=0
-    char *env = std::getenv("DISTCONV_PRINT_DEBUG");
-    if (env) {
-      int var = std::atoi(env);
-      if (var == 0) {
-        m_enable = false;
-      }
-    }
-  }
+  PrintStreamDebug(): PrintStream(get_logger(), h2::Logger::DEBUG) {}
 };
 #else
 using PrintStreamDebug = PrintStream<false>;
@@ -183,44 +194,17 @@ using PrintStreamDebug = PrintStream<false>;
 
 class PrintStreamError: public PrintStream<true> {
  public:
-  PrintStreamError(): PrintStream(true, std::cerr, "[ERROR] ") {
-    // Disable if DISTCONV_PRINT_DEBUG=0
-    char *env = std::getenv("DISTCONV_PRINT_ERROR");
-    if (env) {
-      int var = std::atoi(env);
-      if (var == 0) {
-        m_enable = false;
-      }
-    }
-  }
+  PrintStreamError(): PrintStream(get_logger(), h2::Logger::ERROR) {}
 };
 
 class PrintStreamInfo: public PrintStream<true> {
  public:
-  PrintStreamInfo(): PrintStream(true, std::cerr, "[INFO] ") {
-    // Disable if DISTCONV_PRINT_DEBUG=0
-    char *env = std::getenv("DISTCONV_PRINT_INFO");
-    if (env) {
-      int var = std::atoi(env);
-      if (var == 0) {
-        m_enable = false;
-      }
-    }
-  }
+  PrintStreamInfo(): PrintStream(get_logger(), h2::Logger::INFO) {}
 };
 
 class PrintStreamWarning: public PrintStream<true> {
  public:
-  PrintStreamWarning(): PrintStream(true, std::cerr, "[WARNING] ") {
-    // Disable if DISTCONV_PRINT_WARNING=0
-    char *env = std::getenv("DISTCONV_PRINT_WARNING");
-    if (env) {
-      int var = std::atoi(env);
-      if (var == 0) {
-        m_enable = false;
-      }
-    }
-  }
+  PrintStreamWarning(): PrintStream(get_logger(), h2::Logger::WARN) {}
 };
 
 // Copied from https://stackoverflow.com/a/236803
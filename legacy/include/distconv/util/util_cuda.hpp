@@ -4,10 +4,20 @@
 #include "distconv/util/util_mpi.hpp"
 #include "distconv/runtime.hpp"
 #include "distconv/runtime_cuda.hpp"
+#include "distconv/util/ranges.hpp"
+#include "h2/gpu/pools.hpp"
 
 #include <cstdlib>
 #include <cassert>
 #include <cuda_runtime.h>
+#if CUDART_VERSION >= 11000
+#include <cuda_bf16.h>
+#define DISTCONV_HAS_BFLOAT16
+#endif
+#if CUDART_VERSION >= 11080
+#include <cuda_fp8.h>
+#define DISTCONV_HAS_FP8
+#endif
 #include <vector>
 #include <iostream>
 #include <cfloat>
@@ -106,6 +116,18 @@ void wait_stream(cudaStream_t master, cudaStream_t follower);
 void wait_stream(cudaStream_t master, cudaStream_t *followers, int num_followers);
 void sync_stream(cudaStream_t s1, cudaStream_t s2);
 
+// Pooled event recorded on s, for streams to wait for the work issued
+// to s so far without blocking the host
+h2::gpu::PooledEvent record_pooled_event(cudaStream_t s);
+
+// Whether DISTCONV_SYNCHRONOUS is set. Distconv then blocks the host
+// where it otherwise orders streams with events, which helps locating
+// missing dependencies.
+bool is_synchronous();
+// Blocks the host until the work issued to s is done if
+// is_synchronous()
+void sync_if_synchronous(cudaStream_t s);
+
 cudaStream_t create_priority_stream();
 
 struct Clock {
@@ -139,22 +161,6 @@ struct Clock {
   }
 };
 
-inline void profile_push(const char* name)
-{
-    if (get_config().profiling)
-    {
-        nvtxRangePushA(name);
-    }
-}
-
-inline void profile_pop()
-{
-    if (get_config().profiling)
-    {
-        nvtxRangePop();
-    }
-}
-
 #define LIST_OF_ELEMENT_TYPES                   \
   ELEMENT_TYPE_OP(int)                          \
   ELEMENT_TYPE_OP(long)                         \
@@ -9,6 +9,11 @@
 #include "distconv/util/util.hpp"
 #include "distconv/util/util_cuda.hpp"
 
+// BF16 tensors are supported since cuDNN v8.1
+#if defined(DISTCONV_HAS_BFLOAT16) && CUDNN_VERSION >= 8100
+#define DISTCONV_HAS_CUDNN_BFLOAT16
+#endif
+
 #define DISTCONV_CHECK_CUDNN(cudnn_call)                                \
   do {                                                                  \
     const cudnnStatus_t cudnn_status = cudnn_call;                      \
@@ -32,6 +37,9 @@ inline std::ostream &operator<<(std::ostream &os, cudnnDataType_t &dt) {
     case CUDNN_DATA_FLOAT: s = "float"; break;
     case CUDNN_DATA_DOUBLE: s = "double"; break;
     case CUDNN_DATA_HALF: s = "half"; break;
+#ifdef DISTCONV_HAS_CUDNN_BFLOAT16
+    case CUDNN_DATA_BFLOAT16: s = "bfloat16"; break;
+#endif // DISTCONV_HAS_CUDNN_BFLOAT16
     default: s = "UNKNOWN"; break;
   }
   return os << s;
@@ -353,12 +361,46 @@ inline cudnnDataType_t get_cudnn_type<const half>() {
   return CUDNN_DATA_HALF;
 }
 
+#ifdef DISTCONV_HAS_CUDNN_BFLOAT16
+template <>
+inline cudnnDataType_t get_cudnn_type<__nv_bfloat16>() {
+  return CUDNN_DATA_BFLOAT16;
+}
+
+template <>
+inline cudnnDataType_t get_cudnn_type<const __nv_bfloat16>() {
+  return CUDNN_DATA_BFLOAT16;
+}
+#endif // DISTCONV_HAS_CUDNN_BFLOAT16
+
+// Type of the arithmetic done by convolutions. FP16 and BF16 data is
+// accumulated in FP32, which is also what the tensor-core kernels do.
+template <typename T>
+inline cudnnDataType_t get_cudnn_compute_type() {
+  const cudnnDataType_t dt = get_cudnn_type<T>();
+  switch (dt) {
+    case CUDNN_DATA_HALF:
+#ifdef DISTCONV_HAS_CUDNN_BFLOAT16
+    case CUDNN_DATA_BFLOAT16:
+#endif // DISTCONV_HAS_CUDNN_BFLOAT16
+      return CUDNN_DATA_FLOAT;
+    default:
+      return dt;
+  }
+}
+
 template <typename T>
 inline cudnnDataType_t get_dnnlib_type()
 {
     return get_cudnn_type<T>();
 }
 
+template <typename T>
+inline cudnnDataType_t get_dnnlib_compute_type()
+{
+    return get_cudnn_compute_type<T>();
+}
+
 inline std::string get_cudnn_version_number_string() {
   int version[3];
   cudnnGetProperty(MAJOR_VERSION, &version[0]);
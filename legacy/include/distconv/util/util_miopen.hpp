@@ -336,6 +336,14 @@ inline constexpr miopenDataType_t get_dnnlib_type()
     return get_miopen_type<T>();
 }
 
+// MIOpen convolution descriptors do not take a compute type; the
+// accumulation precision is chosen by the library.
+template <typename T>
+inline constexpr miopenDataType_t get_dnnlib_compute_type()
+{
+    return get_miopen_type<T>();
+}
+
 inline std::string get_miopen_version_number_string()
 {
     size_t version[3];
@@ -88,81 +88,34 @@ inline int get_mpi_comm_local_size(MPI_Comm comm) {
   return local_comm_size;
 }
 
-#ifdef DISTCONV_DEBUG
-class MPIPrintStreamDebug: public PrintStreamDebug {
- public:
-  MPIPrintStreamDebug(): PrintStreamDebug() {
-    MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
-    m_prefix << "[" << m_rank << "] ";
-  }
- protected:
-  int m_rank;
-};
-#else
-using MPIPrintStreamDebug = PrintStream<false>;
-#endif
-
-class MPIPrintStreamError: public PrintStreamError {
- public:
-  MPIPrintStreamError(): PrintStreamError() {
-    MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
-    m_prefix << "[" << m_rank << "] ";
-  }
- protected:
-  int m_rank;
-};
-
-class MPIPrintStreamInfo: public PrintStreamInfo {
- public:
-  MPIPrintStreamInfo(): PrintStreamInfo() {
-    MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
-    m_prefix << "[" << m_rank << "] ";
-  }
- protected:
-  int m_rank;
-};
-
-class MPIPrintStreamWarning: public PrintStreamWarning {
+// The rank is part of the pattern of the distconv logger, so the MPI
+// print streams only differ in the root variants.
+using MPIPrintStreamDebug = PrintStreamDebug;
+using MPIPrintStreamError = PrintStreamError;
+using MPIPrintStreamInfo = PrintStreamInfo;
+using MPIPrintStreamWarning = PrintStreamWarning;
+
+// Only enabled on the rank 0 of MPI_COMM_WORLD.
+template <typename Base>
+class MPIRootPrintStream: public Base {
  public:
-  MPIPrintStreamWarning(): PrintStreamWarning() {
-    MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
-    m_prefix << "[" << m_rank << "] ";
+  MPIRootPrintStream() {
+    if (this->m_enable) {
+      int rank;
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+      this->m_enable = rank == 0;
+    }
   }
- protected:
-  int m_rank;
 };
 
 #ifdef DISTCONV_DEBUG
-class MPIRootPrintStreamDebug: public MPIPrintStreamDebug {
- public:
-  MPIRootPrintStreamDebug(): MPIPrintStreamDebug() {
-    m_enable = m_rank == 0;
-  }
-};
+using MPIRootPrintStreamDebug = MPIRootPrintStream<PrintStreamDebug>;
 #else
 using MPIRootPrintStreamDebug = PrintStream<false>;
 #endif
-
-class MPIRootPrintStreamError: public MPIPrintStreamError {
- public:
-  MPIRootPrintStreamError(): MPIPrintStreamError() {
-    m_enable = m_rank == 0;
-  }
-};
-
-class MPIRootPrintStreamInfo: public MPIPrintStreamInfo {
- public:
-  MPIRootPrintStreamInfo(): MPIPrintStreamInfo() {
-    m_enable = m_rank == 0;
-  }
-};
-
-class MPIRootPrintStreamWarning: public MPIPrintStreamWarning {
- public:
-  MPIRootPrintStreamWarning(): MPIPrintStreamWarning() {
-    m_enable = m_rank == 0;
-  }
-};
+using MPIRootPrintStreamError = MPIRootPrintStream<PrintStreamError>;
+using MPIRootPrintStreamInfo = MPIRootPrintStream<PrintStreamInfo>;
+using MPIRootPrintStreamWarning = MPIRootPrintStream<PrintStreamWarning>;
 
 } // namespace util
 } // namespace distconv
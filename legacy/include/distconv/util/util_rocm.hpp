@@ -6,10 +6,12 @@
 ////////////////////////////////////////////////////////////////////////////////
 #pragma once
 
+#include "h2/gpu/pools.hpp"
 #include "h2/gpu/runtime.hpp"
 
 #include "distconv/runtime.hpp"
 #include "distconv/runtime_rocm.hpp"
+#include "distconv/util/ranges.hpp"
 #include "distconv/util/util_mpi.hpp"
 #include "distconv_config.hpp"
 
@@ -105,6 +107,18 @@ void wait_stream(hipStream_t master, hipStream_t follower);
 void wait_stream(hipStream_t master, hipStream_t* followers, int num_followers);
 void sync_stream(hipStream_t s1, hipStream_t s2);
 
+// Pooled event recorded on s, for streams to wait for the work issued
+// to s so far without blocking the host
+h2::gpu::PooledEvent record_pooled_event(hipStream_t s);
+
+// Whether DISTCONV_SYNCHRONOUS is set. Distconv then blocks the host
+// where it otherwise orders streams with events, which helps locating
+// missing dependencies.
+bool is_synchronous();
+// Blocks the host until the work issued to s is done if
+// is_synchronous()
+void sync_if_synchronous(hipStream_t s);
+
 hipStream_t create_priority_stream();
 
 struct Clock
@@ -137,22 +151,6 @@ struct Clock
     }
 };
 
-inline void profile_push(const char* name)
-{
-    if (get_config().profiling)
-    {
-        roctxRangePushA(name);
-    }
-}
-
-inline void profile_pop()
-{
-    if (get_config().profiling)
-    {
-        roctxRangePop();
-    }
-}
-
 #define LIST_OF_ELEMENT_TYPES                                                  \
     ELEMENT_TYPE_OP(int)                                                       \
     ELEMENT_TYPE_OP(long)                                                      \
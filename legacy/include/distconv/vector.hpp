@@ -3,40 +3,100 @@
 #include "distconv/base.hpp"
 #include "distconv/util/util.hpp"
 
+#include <algorithm>
 #include <vector>
 #include <initializer_list>
 #include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
 
 namespace distconv {
 
+/**
+   Vector of a small number of elements, mostly the dimensions of a
+   tensor.
+
+   Elements are stored inline up to inline_capacity, which is above
+   the rank of any tensor, and on the heap beyond it. Shapes, indices
+   and strides, including the temporaries returned by the tensor
+   accessors, thus do not allocate.
+ */
 template <typename DataType>
 class Vector {
+ public:
+  static constexpr int inline_capacity = 8;
+
  private:
-  using container_type = std::vector<DataType>;
-  container_type m_data;
+  DataType m_inline[inline_capacity] = {};
+  // Holds all the elements once there are more than
+  // inline_capacity. Not a std::vector, which has no storage to
+  // point to for bool.
+  std::unique_ptr<DataType[]> m_heap;
+  int m_heap_capacity = 0;
+  int m_length = 0;
+
+  bool is_inline() const {
+    return m_length <= inline_capacity;
+  }
+
+  // Moves the elements to a heap array of capacity
+  void grow(int capacity) {
+    std::unique_ptr<DataType[]> heap(new DataType[capacity]);
+    std::copy_n(data(), m_length, heap.get());
+    m_heap = std::move(heap);
+    m_heap_capacity = capacity;
+  }
+
+  void copy_from(const Vector &v) {
+    if (!v.is_inline() && v.m_length > m_heap_capacity) {
+      m_heap.reset(new DataType[v.m_length]);
+      m_heap_capacity = v.m_length;
+    }
+    m_length = v.m_length;
+    std::copy_n(v.data(), m_length, data());
+  }
+
+  void assign(int dim, const DataType &x) {
+    if (dim > inline_capacity) {
+      if (dim > m_heap_capacity) {
+        m_heap.reset(new DataType[dim]);
+        m_heap_capacity = dim;
+      }
+      std::fill_n(m_heap.get(), dim, x);
+    } else {
+      std::fill_n(m_inline, dim, x);
+    }
+    m_length = dim;
+  }
 
  public:
   using data_type = DataType;
   using value_type = data_type; // for compatibility with std::vector
-  using iterator = typename container_type::iterator;
-  using const_iterator = typename container_type::const_iterator;
-  using reverse_iterator = typename container_type::reverse_iterator;
-  using const_reverse_iterator = typename container_type::const_reverse_iterator;
-  using reference = typename container_type::reference;
-  using const_reference = typename container_type::const_reference;
+  using iterator = DataType *;
+  using const_iterator = const DataType *;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using reference = DataType &;
+  using const_reference = const DataType &;
 
   /**
      Constructs an empty vector.
    */
   explicit Vector() = default;
 
+  Vector(const Vector &v) {
+    copy_from(v);
+  }
+
   /**
      Constructs a vector of a given dimension.
 
      @param dim The vector dimension.
    */
-  explicit Vector(int dim):
-      m_data(dim) {}
+  explicit Vector(int dim) {
+    assign(dim, DataType());
+  }
 
   /**
      Constructs a vector of a given dimension with all elements
@@ -45,8 +105,9 @@ class Vector {
      @param dim The vector dimension.
      @param x The initial value of all elements.
    */
-  explicit Vector(int dim, const DataType &x):
-      m_data(dim, x) {}
+  explicit Vector(int dim, const DataType &x) {
+    assign(dim, x);
+  }
 
   /**
      Constructs a vector by copying another vector of possibly
@@ -59,7 +120,7 @@ class Vector {
   template <typename T>
   Vector(const Vector<T> &v) {
     for (const auto &x: v) {
-      m_data.push_back(x);
+      push_back(x);
     }
   }
 
@@ -73,7 +134,7 @@ class Vector {
   template <typename T>
   explicit Vector(const std::vector<T> &v) {
     for (const auto &x: v) {
-      m_data.push_back(x);
+      push_back(x);
     }
   }
 
@@ -87,7 +148,7 @@ class Vector {
   template <typename T>
   explicit Vector(std::initializer_list<T> l) {
     for (const auto &x: l) {
-      m_data.push_back(x);
+      push_back(x);
     }
   }
 
@@ -97,9 +158,13 @@ class Vector {
      @param first An iterator to the beginning of a range.
      @param last An iterator to the end of a range.
    */
-  template <typename InputIt>
-  explicit Vector(InputIt first, InputIt last):
-      m_data(first, last) {}
+  template <typename InputIt,
+            typename = std::enable_if_t<!std::is_integral_v<InputIt>>>
+  explicit Vector(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+      push_back(*first);
+    }
+  }
 
   virtual ~Vector() = default;
 
@@ -116,7 +181,7 @@ class Vector {
     assert_always(idx >= 0);
     assert_always(length() > 0);
     assert_always(idx < length());
-    return m_data.at(idx);
+    return data()[idx];
   }
 
   /**
@@ -132,7 +197,7 @@ class Vector {
     assert_always(idx >= 0);
     assert_always(length() > 0);
     assert_always(idx < length());
-    return m_data.at(idx);
+    return data()[idx];
   }
 
   /**
@@ -142,7 +207,9 @@ class Vector {
      @return *this.
    */
   Vector operator=(const Vector &v) {
-    m_data = v.m_data;
+    if (this != &v) {
+      copy_from(v);
+    }
     return *this;
   }
 
@@ -153,7 +220,7 @@ class Vector {
      @return *this.
    */
   Vector operator=(const DataType &x) {
-    for (auto &i: m_data) {
+    for (auto &i: *this) {
       i = x;
     }
     return *this;
@@ -165,7 +232,17 @@ class Vector {
      @param x Value to append.
    */
   void push_back(const DataType &x) {
-    m_data.push_back(x);
+    if (m_length < inline_capacity) {
+      m_inline[m_length] = x;
+    } else {
+      // x may be one of the elements moved by grow
+      const DataType y = x;
+      if (m_length == inline_capacity || m_length == m_heap_capacity) {
+        grow(std::max(m_length * 2, m_heap_capacity));
+      }
+      m_heap[m_length] = y;
+    }
+    ++m_length;
   }
 
   /**
@@ -179,7 +256,7 @@ class Vector {
      @return The dimension of the vector.
    */
   int length() const {
-    return m_data.size();
+    return m_length;
   }
 
   /**
@@ -204,14 +281,14 @@ class Vector {
      @return A pointer to the underlying element storage.
    */
   DataType *data() {
-    return m_data.data();
+    return is_inline() ? m_inline : m_heap.get();
   }
 
   /**
      @return A pointer to the underlying element storage.
    */
   const DataType *data() const {
-    return m_data.data();
+    return is_inline() ? m_inline : m_heap.get();
   }
 
   template <typename T>
@@ -526,91 +603,91 @@ class Vector {
      @return An iterator to the first element.
    */
   iterator begin() {
-    return m_data.begin();
+    return data();
   }
 
   /**
      @return An iterator to the end of the vector.
    */
   iterator end() {
-    return m_data.end();
+    return data() + m_length;
   }
 
   /**
      @return A const iterator to the first element.
    */
   const_iterator begin() const {
-    return m_data.begin();
+    return data();
   }
 
   /**
      @return A const iterator to the end of the vector.
    */
   const_iterator end() const {
-    return m_data.end();
+    return data() + m_length;
   }
 
   /**
      @return A reverse iterator to the first element.
    */
   reverse_iterator rbegin() {
-    return m_data.rbegin();
+    return reverse_iterator(end());
   }
 
   /**
      @return A reverse iterator to the end of the vector.
    */
   reverse_iterator rend() {
-    return m_data.rend();
+    return reverse_iterator(begin());
   }
 
   /**
      @return A reverse const iterator to the first element.
    */
   const_reverse_iterator rbegin() const {
-    return m_data.rbegin();
+    return const_reverse_iterator(end());
   }
 
   /**
      @return A reverse const iterator to the end of the vector.
    */
   const_reverse_iterator rend() const {
-    return m_data.rend();
+    return const_reverse_iterator(begin());
   }
 
   /**
      @return A reference to the first element.
    */
   reference front() {
-    return m_data.front();
+    return *begin();
   }
 
   /**
      @return A const reference to the first element.
   */
   const_reference front() const {
-    return m_data.front();
+    return *begin();
   }
 
   /**
      @return A reference to the last element.
   */
   reference back() {
-    return m_data.back();
+    return *(end() - 1);
   }
 
   /**
      @return A const reference to the last element.
   */
   const_reference back() const {
-    return m_data.back();
+    return *(end() - 1);
   }
 
   /**
      @return A string representation of the vector contents.
    */
   std::string tostring() const {
-    return util::join_array(m_data, ", ");
+    return util::join_array(*this, ", ");
   }
 };
 
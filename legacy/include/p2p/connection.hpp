@@ -3,15 +3,20 @@
 #include "p2p/mpi.hpp"
 #include "p2p/request.hpp"
 #include "p2p/util_cuda.hpp"
+#include "distconv/util/cuda_to_hip.hpp"
 
 #include <map>
-#include <cuda_runtime.h>
 
 namespace p2p {
 
 class Connection {
   friend class Request;
  public:
+  // Route of the transfers to the peer. DIRECT is peer-to-peer
+  // between the devices, RELAY goes through an intermediate device,
+  // and STAGED goes through host memory.
+  enum class Path {DIRECT, RELAY, STAGED};
+
   Connection(int peer, const internal::MPI &mpi,
              util::EventPool &ev_pool);
   virtual ~Connection() = default;
@@ -45,6 +50,7 @@ class Connection {
 
   int get_dev() const;
   int get_peer() const;
+  virtual Path get_path() const { return Path::DIRECT; }
 
   void *find_mapped_peer_memory(const void *peer);
 
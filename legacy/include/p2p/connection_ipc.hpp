@@ -7,10 +7,14 @@
 
 namespace p2p {
 
+// Connection to a process on the same node through CUDA IPC. A peer in
+// the same process, e.g., a thread driving another device, is
+// connected directly: its memory and events are used as they are,
+// without IPC handles, and data is copied between the devices.
 class ConnectionIPC: public Connection {
  public:
   ConnectionIPC(int peer, int dev, const internal::MPI &mpi,
-                util::EventPool &ev_pool);
+                util::EventPool &ev_pool, bool same_process = false);
   ~ConnectionIPC() override;
 
   static bool is_ipc_capable(int peer, internal::MPI &mpi,
@@ -34,6 +38,18 @@ class ConnectionIPC: public Connection {
 
   int put(const void *src, void *dst, size_t size,
           cudaStream_t stream) override;
+  // Puts depth slices of height rows of width bytes. The pitches are
+  // the bytes between rows and the heights the rows between slices.
+  // Only on the DIRECT path.
+  int put_3d(const void *src, size_t src_pitch, size_t src_height,
+             void *dst, size_t dst_pitch, size_t dst_height,
+             size_t width, size_t height, size_t depth,
+             cudaStream_t stream);
+
+  // Start of the allocation holding ptr, which is registered to map
+  // ptr at the peer. False if the memory cannot be mapped, e.g., if
+  // it is from a stream-ordered pool.
+  static bool get_ipc_base(const void *ptr, void **base);
 
   int transfer(void *local_buf, void *peer_buf, size_t size,
                cudaStream_t stream, bool is_src) override;
@@ -43,17 +59,38 @@ class ConnectionIPC: public Connection {
   
   int disconnect() override;
   int close_remote_resources() override;
-  
+
+  Path get_path() const override { return m_path; }
+  bool is_same_process() const { return m_same_process; }
+  // The intermediate device of the RELAY path
+  int get_relay_dev() const { return m_dev_relay; }
+
  private:
   int m_dev_peer;
+  bool m_same_process;
   cudaEvent_t m_ev;
   cudaIpcEventHandle_t m_peer_ev_handle;
   cudaEvent_t m_ev_peer;
   bool m_peer_event_opened;
   bool m_peer_enabled;
   std::set<void *> m_opened_local_mem;
+  // Number of registrations of each mapped peer memory. A mapping is
+  // reused by registrations of the same peer address, e.g., by
+  // multiple layers, and closed with the last deregistration.
+  std::map<void *, int> m_mapped_mem_refs;
   
+  Path m_path;
+  int m_dev_relay;
+  // Staging buffer on the relay device, shared by all puts
+  void *m_relay_buf;
+  size_t m_relay_size;
+  cudaEvent_t m_relay_ev;
+
   void enable_peer_access_if_possible();
+  void select_path();
+  void ensure_relay_buffer(size_t size);
+  int put_relay(const void *src, void *dst, size_t size,
+                cudaStream_t stream);
   int register_peer_memory(const void *peer,
                            cudaIpcMemHandle_t peer_handle);
 
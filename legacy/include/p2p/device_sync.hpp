@@ -0,0 +1,77 @@
+#pragma once
+
+#include "distconv/util/cuda_to_hip.hpp"
+
+namespace p2p {
+
+// Pairwise synchronization of kernels running on two devices with
+// peer access through IPC-mapped memory. Each side counts its
+// notifications and stores the count to the flag of the peer, whose
+// kernels wait until their own count is reached. Used by kernels that
+// put data directly to the mapped buffers of the peer.
+struct DeviceSyncDevice {
+  using CounterType = unsigned long long;
+
+  DeviceSyncDevice(CounterType *counter,
+                   volatile CounterType *flag,
+                   volatile CounterType *peer_flag):
+      m_counter(counter), m_flag(flag), m_peer_flag(peer_flag) {}
+
+#if defined(__CUDACC__) || __HIP__
+  __device__ __forceinline__ void inc_counter() {
+    ++(*m_counter);
+  }
+
+  // Makes the stores of the calling thread visible to the peer before
+  // the flag is updated
+  __device__ __forceinline__ void notify() {
+    __threadfence_system();
+    *m_peer_flag = *m_counter;
+  }
+
+  __device__ __forceinline__ void wait() {
+    const auto counter = *m_counter;
+    while (*m_flag < counter);
+    __threadfence_system();
+  }
+#endif // __CUDACC__ || __HIP__
+
+  CounterType *m_counter;
+  // Written by the peer
+  volatile CounterType *m_flag;
+  // Flag of the peer mapped to this process
+  volatile CounterType *m_peer_flag;
+};
+
+class DeviceSync {
+ public:
+  using CounterType = DeviceSyncDevice::CounterType;
+
+  DeviceSync();
+  ~DeviceSync();
+  DeviceSync(const DeviceSync &) = delete;
+  DeviceSync &operator=(const DeviceSync &) = delete;
+
+  // The flag is allocated separately so that it can be mapped by the
+  // peer with ConnectionIPC
+  void *get_flag() {
+    return m_flag;
+  }
+  void set_peer_flag(void *peer_flag) {
+    m_peer_flag = static_cast<CounterType*>(peer_flag);
+  }
+  bool is_connected() const {
+    return m_peer_flag != nullptr;
+  }
+  // Counts a notification without storing to the peer flag, which
+  // keeps the counters of both sides matched when nothing is put.
+  void inc_counter(cudaStream_t stream);
+  DeviceSyncDevice get_for_device();
+
+ private:
+  CounterType *m_counter;
+  CounterType *m_flag;
+  CounterType *m_peer_flag;
+};
+
+} // namespace p2p
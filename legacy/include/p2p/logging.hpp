@@ -7,6 +7,12 @@
 
 #include <mpi.h>
 
+// Print streams of p2p. p2p is built into the distconv library and
+// uses the H2 runtime and helper threads, but its messages do not go
+// through the distconv loggers (distconv/util/logging.hpp): the debug
+// ones are compiled in only with P2P_DEBUG, independently of
+// DISTCONV_DEBUG.
+
 namespace p2p {
 namespace logging {
 
@@ -11,6 +11,7 @@ class MPI {
  public:
   MPI(MPI_Comm comm);
   int get_rank() const;
+  int get_size() const;
   int send(const void *buf, size_t size, int dst);
   int isend(const void *buf, size_t size, int dst,
             MPI_Request *req);
@@ -25,7 +26,12 @@ class MPI {
   int iwait_notification(int peer, MPI_Request *req);
   int barrier(int peer);
   int barrier();
+  // Gathers size bytes of send_buf from all processes
+  int allgather(const void *send_buf, size_t size, void *recv_buf);
   int wait_requests(MPI_Request *requests, int num_requests);
+  // Sets completed to whether all the requests are complete
+  int test_requests(MPI_Request *requests, int num_requests,
+                    bool &completed);
 
  private:
   MPI_Comm get_comm();
@@ -1,7 +1,15 @@
 #pragma once
 
+#include "distconv_config.hpp"
 #include "p2p/config.hpp"
+
+#if H2_HAS_ROCM
+#include <roctracer/roctx.h>
+#define nvtxRangePushA roctxRangePushA
+#define nvtxRangePop roctxRangePop
+#else
 #include "nvToolsExt.h"
+#endif
 
 namespace p2p {
 namespace internal {
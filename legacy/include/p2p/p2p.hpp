@@ -6,12 +6,12 @@
 #include "p2p/mpi.hpp"
 #include "p2p/connection.hpp"
 #include "p2p/util_cuda.hpp"
+#include "distconv/util/cuda_to_hip.hpp"
 
 #include <map>
 #include <vector>
 #include <string>
 #include <memory>
-#include <cuda_runtime.h>
 
 namespace p2p {
 
@@ -19,6 +19,7 @@ class P2P {
  public:
   using connection_type = std::shared_ptr<Connection>;
   
+  // Collective over the processes of mpi
   P2P(const internal::MPI &mpi);
   virtual ~P2P();
   
@@ -30,6 +31,17 @@ class P2P {
                       int num_peers);
   int get_connections(const std::vector<int> &peers,
                       std::vector<connection_type> &conns);
+  /**
+   * Create connections without waiting for their setup.
+   * @param requests Setup requests of the new connections are
+   * appended. The connections can be used once they are processed
+   * with Request::process, which can be done at once for
+   * connections created with multiple calls.
+   */
+  int get_connections_nb(const int *peers,
+                         connection_type *conns,
+                         int num_peers,
+                         std::vector<Request> &requests);
   int disconnect_all();
   int disconnect(connection_type *conns, int num_conns);
 
@@ -38,6 +50,19 @@ class P2P {
   int barrier(std::shared_ptr<Connection> *connections,
               cudaStream_t *streams,
               int num_conns);
+  /**
+   * Start a barrier without waiting for it.
+   * @param requests The notify and wait requests of connection i are
+   * stored at 2*i and 2*i+1, respectively.
+   */
+  int barrier_nb(std::shared_ptr<Connection> *connections,
+                 cudaStream_t *streams,
+                 int num_conns,
+                 Request *requests);
+
+  int test_some(Request *requests, int num_requests, int *indices);
+  int wait_any(Request *requests, int num_requests);
+  int wait_all(Request *requests, int num_requests);
 
   int exchange_addrs(std::vector<connection_type> &connections,
                      const std::vector<void*> &local_addrs,
@@ -86,18 +111,18 @@ class P2P {
   char m_proc_name[MPI_MAX_PROCESSOR_NAME];
   util::EventPool m_event_pool;
   
-  std::shared_ptr<Connection> connect(int peer, char *peer_name,
-                                      int peer_dev);
-  int init_driver_api();
+  // Host names and devices of all processes, gathered at
+  // construction
+  std::vector<std::string> m_host_names;
+  std::vector<int> m_devices;
+  // Whether each rank runs in this process, e.g., as a thread driving
+  // another device
+  std::vector<bool> m_same_process;
 
-  int get_peer_host_names(const int *peers,
-                          int num_peers,
-                          std::vector<char*> &names);
-  int get_peer_devices(const int *peers,
-                       int num_peers,
-                       std::vector<int> &peer_devices);
-  
-    
+  std::shared_ptr<Connection> connect(int peer, const char *peer_name,
+                                      int peer_dev, bool same_process);
+  int init_driver_api();
+  int gather_peer_info();
 };
 
 } // namespace p2p
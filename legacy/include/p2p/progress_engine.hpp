@@ -0,0 +1,100 @@
+#pragma once
+
+#include "distconv/util/cuda_to_hip.hpp"
+
+#include "mpi.h"
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace p2p {
+namespace internal {
+
+// Progresses the MPI transfers of all ConnectionMPI objects of the
+// process with a single thread. The thread polls the outstanding
+// requests with MPI_Testsome and sleeps while there is no task.
+//
+// Environment variables:
+// - P2P_PROGRESS_CORE: Core to pin the thread to. By default, the
+//   thread runs on the helper cores of H2 (see
+//   h2/utils/HelperThreads.hpp).
+// - P2P_PROGRESS_POLICY: "poll" yields between polls, and "backoff"
+//   (default) sleeps exponentially longer, up to
+//   P2P_PROGRESS_MAX_BACKOFF_US microseconds (default: 64), while no
+//   request makes progress.
+class ProgressEngine {
+ public:
+  struct Task {
+    // The requests are posted once this event completes. Ignored if
+    // null.
+    cudaEvent_t ready_event = nullptr;
+    // Posts the MPI requests and returns their number, at most 2
+    std::function<int(MPI_Request*)> post;
+    // Called once the requests complete
+    std::function<void()> transferred;
+    // Called once this event completes after transferred
+    cudaEvent_t done_event = nullptr;
+    std::function<void()> done;
+  };
+
+  static ProgressEngine &get_instance();
+
+  // The thread runs while any key is attached.
+  void attach(const void *key, int dev);
+  // Blocks until all the tasks of key are done.
+  void detach(const void *key);
+
+  // Tasks of the same key are posted and complete in the order of
+  // submission.
+  void submit(const void *key, Task task);
+
+ private:
+  enum class Policy {POLL, BACKOFF};
+  enum class State {WAITING, POSTED};
+  struct Entry {
+    const void *key;
+    Task task;
+    State state = State::WAITING;
+    MPI_Request reqs[2];
+    int num_pending = 0;
+  };
+
+  int m_core;
+  Policy m_policy;
+  int m_max_backoff_us;
+
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  std::condition_variable m_drained_cv;
+  std::thread m_thread;
+  std::map<const void*, int> m_keys;
+  std::vector<std::pair<const void*, Task>> m_incoming;
+  size_t m_num_tasks = 0;
+  bool m_running = false;
+  int m_dev = 0;
+
+  // Only accessed by the thread
+  std::map<const void*, std::list<Entry>> m_queues;
+  std::vector<MPI_Request> m_reqs;
+  std::vector<Entry*> m_req_entries;
+  std::list<std::pair<const void*, Task>> m_draining;
+
+  ProgressEngine();
+  void run();
+  // Returns true if any task made progress
+  bool progress();
+  bool post(std::list<Entry> &queue);
+  bool test();
+  bool complete(std::list<Entry> &queue);
+  bool drain();
+  void pin_thread();
+};
+
+} // namespace internal
+} // namespace p2p
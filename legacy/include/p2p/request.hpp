@@ -2,11 +2,7 @@
 
 #include "p2p/mpi.hpp"
 
-#if H2_HAS_ROCM
-#include <hip/hip_runtime.h>
-#else
-#include <cuda_runtime.h>
-#endif
+#include "distconv/util/cuda_to_hip.hpp"
 
 namespace p2p {
 
@@ -67,6 +63,10 @@ public:
     const MPI_Request* get_mpi_requests() const;
     MPI_Request* get_mpi_requests();
     int wait_mpi();
+    // Whether the MPI requests are complete. Does not block.
+    bool test_mpi(internal::MPI& mpi);
+    // Null requests are complete and have nothing to process
+    bool is_null() const;
     bool run_post_process(Request* req = nullptr);
     int process();
     int add_mpi_request(MPI_Request req);
@@ -81,7 +81,30 @@ public:
     static void
     process(const Request* requests, int num_requests, internal::MPI& mpi);
 
+    // The following combinators progress requests in place, including
+    // the post processing of each. Completed requests are replaced
+    // with null requests, which are ignored.
+
+    /** Progress all requests without blocking.
+     *  @param indices Indices of the requests completed by this call.
+     *  @return Number of the requests completed by this call.
+     */
+    static int test_some(Request* requests,
+                         int num_requests,
+                         int* indices,
+                         internal::MPI& mpi);
+    /** Wait until any request completes.
+     *  @return Index of the completed request, or -1 if all are null.
+     */
+    static int
+    wait_any(Request* requests, int num_requests, internal::MPI& mpi);
+    static void
+    wait_all(Request* requests, int num_requests, internal::MPI& mpi);
+
 private:
+    // Returns true if req completes
+    static bool progress(Request& req, internal::MPI& mpi);
+
     Kind m_kind;
     Connection* m_conn;
     MPI_Request m_requests[MAX_MPI_REQUESTS];
@@ -1,15 +1,18 @@
 #pragma once
 
 #include "distconv_config.hpp"
+#include "distconv/tensor/runtime_gpu.hpp"
+#include "distconv/util/cuda_to_hip.hpp"
+#include "distconv/util/free_list.hpp"
 
 #include <iostream>
 #include <list>
 #include <vector>
 #include <map>
 #include <mutex>
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
-#include <cuda.h>
-#include <cuda_runtime_api.h>
 
 
 #define P2P_CHECK_CUDA_ALWAYS(cuda_call)                                \
@@ -29,6 +32,10 @@
 #define P2P_CHECK_CUDA(cuda_call) cuda_call
 #endif
 
+#if H2_HAS_ROCM
+// Stream memory operations are part of the runtime API of HIP
+#define P2P_CHECK_CUDA_DRV_ALWAYS(cuda_call) P2P_CHECK_CUDA_ALWAYS(cuda_call)
+#else
 #define P2P_CHECK_CUDA_DRV_ALWAYS(cuda_call)                            \
   do {                                                                  \
     const CUresult cuda_status = cuda_call;                             \
@@ -42,6 +49,7 @@
       abort();                                                          \
     }                                                                   \
   } while (0)
+#endif
 
 #ifdef P2P_DEBUG
 #define P2P_CHECK_CUDA_DRV(cuda_call) P2P_CHECK_CUDA_DRV_ALWAYS(cuda_call)
@@ -53,6 +61,16 @@ namespace p2p {
 namespace util {
 
 inline bool is_stream_mem_enabled() {
+#if H2_HAS_ROCM
+  int dev;
+  P2P_CHECK_CUDA_ALWAYS(hipGetDevice(&dev));
+  int attr;
+  P2P_CHECK_CUDA_ALWAYS(
+      hipDeviceGetAttribute(&attr,
+                            hipDeviceAttributeCanUseStreamWaitValue,
+                            dev));
+  return attr;
+#else
   CUdevice dev;
   P2P_CHECK_CUDA_DRV_ALWAYS(cuCtxGetDevice(&dev));
   int attr;
@@ -61,29 +79,15 @@ inline bool is_stream_mem_enabled() {
                            CU_DEVICE_ATTRIBUTE_CAN_USE_STREAM_MEM_OPS,
                            dev));
   return attr;
+#endif
 }
 
-class PinnedMemoryPool {
- public:
-  PinnedMemoryPool();
-  ~PinnedMemoryPool();
-
-  void *get(size_t size);
-  void release(void *p);
-
- private:
-  int m_bin_growth;
-  int m_min_bin;
-  int m_max_bin;
-  std::vector<std::list<void*>> m_bins;
-  std::map<void *, size_t> m_mem_map;
-  std::mutex m_mutex;
-  void setup_bins();
-  int find_bin(size_t size);
-  void *get_from_bin(int bin_idx);
-  void deallocate_all_chunks();
-};
+// Shared with distconv
+using PinnedMemoryPool = distconv::tensor::internal::PinnedMemoryPool;
 
+// Pool of events with a lock-free free list. Events are created when
+// the pool is empty, expansion at a time, and destroyed when
+// released to a full pool.
 class EventPool {
  public:
   EventPool(int num_events=10, int expansion=10);
@@ -92,18 +96,27 @@ class EventPool {
   cudaEvent_t get();
   void release(cudaEvent_t e);
   void expand();
-  
+
+  // Number of get calls and of events created
+  size_t get_num_gets() const { return m_num_gets.load(); }
+  size_t get_num_created() const { return m_num_created.load(); }
+
  private:
+  static constexpr uint32_t m_capacity = 4096;
   int m_expansion;
-  std::list<cudaEvent_t> m_events;
-  std::mutex m_mutex;  
+  distconv::util::FreeList<cudaEvent_t> m_events;
+  std::atomic<size_t> m_num_gets;
+  std::atomic<size_t> m_num_created;
 
-  static void expand_list(std::list<cudaEvent_t> &list,
-                          int num_events);
+  cudaEvent_t create_event();
 };
 
 size_t get_total_memory();
 size_t get_available_memory();
 
+// Returns true if MPI can directly access device memory. Can be
+// overridden with P2P_MPI_CUDA_AWARE=0/1.
+bool is_mpi_cuda_aware();
+
 } // namespace util
 } // namespace p2p
@@ -0,0 +1,617 @@
+#include "distconv/decomposition_planner.hpp"
+
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace distconv {
+
+namespace {
+
+constexpr int sample_dim = -1;
+constexpr int channel_dim = -2;
+
+// Coordinates of the process of rank in a grid of locale_shape, with
+// the first dimension the fastest as in LocaleMPI
+IndexVector get_coord(int rank, const tensor::Shape &locale_shape) {
+  const int nd = locale_shape.num_dims();
+  IndexVector idx(nd, 0);
+  for (int i = 0; i < nd; ++i) {
+    idx[i] = rank % locale_shape[i];
+    rank /= locale_shape[i];
+  }
+  return idx;
+}
+
+int get_rank(const IndexVector &idx, const tensor::Shape &locale_shape) {
+  return tensor::get_offset(idx, locale_shape);
+}
+
+// Range of the block i of n elements split over p
+index_t get_block_begin(index_t n, index_t p, index_t i) {
+  return n * i / p;
+}
+
+// Largest block of n elements split over p
+index_t get_max_block(index_t n, index_t p) {
+  return util::ceil(n, p);
+}
+
+double get_flops(const DecompositionPlanner::Layer &layer) {
+  double out_elms = 1;
+  for (auto x: layer.output_shape) out_elms *= x;
+  double in_elms = 1;
+  for (auto x: layer.input_shape) in_elms *= x;
+  double kernel_size = 1;
+  for (auto x: layer.kernel) kernel_size *= x;
+  const int nd = layer.input_shape.size();
+  switch (layer.kind) {
+    case DecompositionPlanner::LayerKind::CONVOLUTION:
+      // Forward, backward data and backward filter do the same work
+      return 3 * 2 * out_elms * layer.input_shape[nd - 2] * kernel_size;
+    case DecompositionPlanner::LayerKind::POOLING:
+      return 2 * out_elms * kernel_size;
+    default:
+      return 2 * in_elms;
+  }
+}
+
+} // namespace
+
+void ComputeProfile::add_sample(double flops, double seconds) {
+  m_samples.emplace_back(flops, seconds);
+}
+
+bool ComputeProfile::load_benchmark_metrics(const std::string &path) {
+  std::ifstream ifs(path);
+  std::string line;
+  if (!ifs || !std::getline(ifs, line)) return false;
+  auto split = [](const std::string &s) {
+    std::vector<std::string> items;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) items.push_back(item);
+    return items;
+  };
+  const auto header = split(line);
+  auto find = [&](const std::string &name) {
+    auto it = std::find(header.begin(), header.end(), name);
+    return it == header.end() ? -1 : (int)(it - header.begin());
+  };
+  const int flops_col = find("flops");
+  const int np_col = find("num_ranks");
+  const int time_cols[] = {find("fwd_time_ms"), find("bwd_data_time_ms"),
+                           find("bwd_filter_time_ms")};
+  if (flops_col < 0 || np_col < 0 || time_cols[0] < 0) return false;
+  bool found = false;
+  while (std::getline(ifs, line)) {
+    const auto row = split(line);
+    if (row.size() != header.size()) continue;
+    const double np = std::stod(row[np_col]);
+    // The flops are those of one pass over all the processes
+    double flops = std::stod(row[flops_col]) / np;
+    double ms = 0;
+    for (int col: time_cols) {
+      if (col < 0) continue;
+      ms += std::stod(row[col]);
+    }
+    const int num_passes = std::count_if(
+        std::begin(time_cols), std::end(time_cols),
+        [](int col) { return col >= 0; });
+    add_sample(flops * num_passes, ms * 1e-3);
+    found = true;
+  }
+  return found;
+}
+
+double ComputeProfile::estimate(double flops) const {
+  if (m_samples.empty()) return 0;
+  // Least squares of a + b * flops, through the origin if the samples
+  // do not determine a non-negative intercept
+  const double n = m_samples.size();
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (const auto &s: m_samples) {
+    sx += s.first;
+    sy += s.second;
+    sxx += s.first * s.first;
+    sxy += s.first * s.second;
+  }
+  const double det = n * sxx - sx * sx;
+  if (det > 0) {
+    const double b = (n * sxy - sx * sy) / det;
+    const double a = (sy - b * sx) / n;
+    if (a >= 0 && b >= 0) return a + b * flops;
+  }
+  return sxx > 0 ? sxy / sxx * flops : sy / n;
+}
+
+struct DecompositionPlanner::Candidate {
+  LayerPlan plan;
+  double time = 0;
+};
+
+DecompositionPlanner::DecompositionPlanner(int num_procs,
+                                           const util::TopologyMap &topology,
+                                           const Options &opts):
+    m_num_procs(num_procs), m_topology(topology), m_opts(opts) {
+  assert_always(topology.get_size() == 0
+                || topology.get_size() == num_procs);
+}
+
+int DecompositionPlanner::add_layer(const Layer &layer) {
+  const int nd = layer.input_shape.size();
+  assert_always(nd > 2);
+  assert_eq((int)layer.output_shape.size(), nd);
+  if (!m_layers.empty()) {
+    assert_always(m_layers.back().output_shape == layer.input_shape);
+  }
+  Layer l = layer;
+  const int nsd = nd - 2;
+  if (l.kernel.empty()) l.kernel = int_vector(nsd, 1);
+  if (l.strides.empty()) l.strides = int_vector(nsd, 1);
+  if (l.dilations.empty()) l.dilations = int_vector(nsd, 1);
+  assert_eq((int)l.kernel.size(), nsd);
+  m_layers.push_back(l);
+  return m_layers.size() - 1;
+}
+
+double DecompositionPlanner::get_link_time(int src, int dst,
+                                           std::size_t bytes) const {
+  if (src == dst) return 0;
+  if (m_topology.get_size() > 0) {
+    return m_topology.estimate_time(src, dst, bytes);
+  }
+  return m_opts.latency + bytes / m_opts.bandwidth;
+}
+
+double DecompositionPlanner::get_ring_step_time(
+    const std::vector<int> &ranks, std::size_t bytes) const {
+  if (m_topology.get_size() > 0) {
+    return m_topology.estimate_ring_step_time(ranks, bytes);
+  }
+  return ranks.size() > 1 ? m_opts.latency + bytes / m_opts.bandwidth : 0;
+}
+
+IntVector DecompositionPlanner::get_overlap(
+    const Layer &layer, const tensor::Shape &locale_shape) const {
+  const int nd = layer.input_shape.size();
+  IntVector overlap(nd, 0);
+  if (layer.kind == LayerKind::ELEMENTWISE) return overlap;
+  // As create_input_tensor
+  for (int i = 0; i < nd - 2; ++i) {
+    if (locale_shape[i] == 1) continue;
+    const int df = (layer.kernel[i] - 1) * layer.dilations[i] + 1;
+    if (df % 2) overlap[i] = (df - 1) / 2;
+  }
+  return overlap;
+}
+
+std::vector<DecompositionPlanner::Candidate>
+DecompositionPlanner::get_candidates(int layer_idx) const {
+  const auto &layer = m_layers[layer_idx];
+  const int nd = layer.input_shape.size();
+  const auto &in = layer.input_shape;
+  const auto &out = layer.output_shape;
+  // Dimensions that can be split and the largest splits
+  std::vector<int> dims;
+  std::vector<int> limits;
+  for (int i = 0; i < nd - 2; ++i) {
+    // Each process needs at least the halo width of each side
+    const int df = (layer.kernel[i] - 1) * layer.dilations[i] + 1;
+    const int width = layer.kind == LayerKind::ELEMENTWISE ? 1
+        : std::max((df - 1) / 2, 1);
+    dims.push_back(i);
+    // Even filters are only partitioned when strided by their size
+    if (layer.kind != LayerKind::ELEMENTWISE && df % 2 == 0
+        && df != layer.strides[i]) {
+      limits.push_back(1);
+    } else {
+      limits.push_back(std::min(in[i] / width, out[i]));
+    }
+  }
+  dims.push_back(nd + channel_dim);
+  limits.push_back(std::min(in[nd + channel_dim], out[nd + channel_dim]));
+  dims.push_back(nd + sample_dim);
+  limits.push_back(in[nd + sample_dim]);
+
+  std::vector<Candidate> candidates;
+  tensor::Shape locale_shape(nd, 1);
+  // Factorizations of the processes over dims
+  std::function<void(std::size_t, int)> enumerate =
+      [&](std::size_t di, int np) {
+        const int d = dims[di];
+        for (int p = 1; p <= np; ++p) {
+          if (np % p || p > limits[di]) continue;
+          if (di + 1 == dims.size() && p != np) continue;
+          if (p > 1 && (in[d] % p || out[d] % p)) continue;
+          locale_shape[d] = p;
+          if (di + 1 < dims.size()) {
+            enumerate(di + 1, np / p);
+            continue;
+          }
+          Candidate c;
+          c.plan.locale_shape = locale_shape;
+          estimate(layer_idx, c);
+          candidates.push_back(std::move(c));
+        }
+        locale_shape[d] = 1;
+      };
+  enumerate(0, m_num_procs);
+  if (candidates.empty()) {
+    util::MPIPrintStreamError()
+        << "No decomposition of layer " << layer.name << " over "
+        << m_num_procs << " processes";
+    throw std::exception();
+  }
+
+  // Shortlist the fastest ones, and with a memory cap, those using the
+  // least memory
+  const std::size_t num_kept = m_opts.max_candidates;
+  if (candidates.size() <= num_kept) return candidates;
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate &a, const Candidate &b) {
+              return a.time < b.time;
+            });
+  if (m_opts.memory_cap == 0) {
+    candidates.resize(num_kept);
+    return candidates;
+  }
+  const std::size_t num_fastest = num_kept - num_kept / 2;
+  std::sort(candidates.begin() + num_fastest, candidates.end(),
+            [](const Candidate &a, const Candidate &b) {
+              return a.plan.memory < b.plan.memory;
+            });
+  candidates.resize(num_kept);
+  return candidates;
+}
+
+void DecompositionPlanner::estimate(int layer_idx, Candidate &c) const {
+  const auto &layer = m_layers[layer_idx];
+  auto &plan = c.plan;
+  const auto &locale_shape = plan.locale_shape;
+  const int nd = locale_shape.num_dims();
+  const auto overlap = get_overlap(layer, locale_shape);
+  const std::size_t ts = m_opts.type_size;
+
+  tensor::Shape local_in(nd, 0), local_out(nd, 0);
+  double fraction = 1;
+  std::size_t in_elms = 1, in_halo_elms = 1, out_elms = 1;
+  for (int i = 0; i < nd; ++i) {
+    local_in[i] = get_max_block(layer.input_shape[i], locale_shape[i]);
+    local_out[i] = get_max_block(layer.output_shape[i], locale_shape[i]);
+    fraction *= (double)local_out[i] / layer.output_shape[i];
+    in_elms *= local_in[i];
+    in_halo_elms *= local_in[i] + overlap[i] * 2;
+    out_elms *= local_out[i];
+  }
+
+  const auto &profile = layer.profile.empty() ? m_default_profile
+      : layer.profile;
+  plan.compute_time = profile.estimate(get_flops(layer) * fraction);
+
+  // Halo exchanges of the input in forward and of the output gradients
+  // in backward, bound by the process sending the most
+  double halo_time = 0;
+  for (int rank = 0; rank < m_num_procs; ++rank) {
+    const auto idx = get_coord(rank, locale_shape);
+    double t = 0;
+    for (int d = 0; d < nd; ++d) {
+      if (overlap[d] == 0) continue;
+      const std::size_t bytes =
+          in_elms / local_in[d] * overlap[d] * ts;
+      for (int dir: {-1, 1}) {
+        const int n = (int)idx[d] + dir;
+        if (n < 0 || n >= (int)locale_shape[d]) continue;
+        auto peer_idx = idx;
+        peer_idx[d] = n;
+        t += get_link_time(rank, get_rank(peer_idx, locale_shape), bytes);
+      }
+    }
+    halo_time = std::max(halo_time, t);
+  }
+  plan.halo_time = halo_time * 2;
+
+  // Processes of the rings of dim, i.e., those differing only in their
+  // index of dim, and those of the other dimensions
+  auto get_groups = [&](bool along, int dim) {
+    // Processes before dim in the rank order
+    int inner = 1;
+    for (int i = 0; i < dim; ++i) inner *= locale_shape[i];
+    const int n = locale_shape[dim];
+    std::vector<std::vector<int>> groups(along ? m_num_procs / n : n);
+    for (int rank = 0; rank < m_num_procs; ++rank) {
+      const int idx = rank / inner % n;
+      const int id = along ? rank % inner + rank / (inner * n) * inner
+          : idx;
+      groups[id].push_back(rank);
+    }
+    return groups;
+  };
+  auto get_ring_time = [&](const std::vector<std::vector<int>> &groups,
+                           std::size_t bytes) {
+    double t = 0;
+    for (const auto &g: groups) {
+      t = std::max(t, get_ring_step_time(g, bytes));
+    }
+    return t;
+  };
+
+  const int cd = nd + channel_dim;
+  const int num_chan_procs = locale_shape[cd];
+  std::size_t temp_elms = 0;
+  std::size_t weight_elms = 0;
+  plan.chanfilt_algo = ChannelParallelismAlgorithm::NONE;
+  plan.chanfilt_time = 0;
+  plan.allreduce_time = 0;
+  if (layer.kind == LayerKind::CONVOLUTION) {
+    std::size_t kernel_size = 1;
+    for (auto x: layer.kernel) kernel_size *= x;
+    weight_elms = kernel_size * layer.input_shape[cd]
+        * layer.output_shape[cd] / num_chan_procs;
+    if (num_chan_procs > 1) {
+      // As ChanfiltTuner, the algorithm communicating the smaller
+      // tensor: X reduce-scatters the output of all filters and
+      // allgathers its gradients, and Y allgathers the input and
+      // reduce-scatters its gradients
+      const bool x = out_elms <= in_elms;
+      plan.chanfilt_algo = x ? ChannelParallelismAlgorithm::X
+          : ChannelParallelismAlgorithm::Y;
+      const std::size_t elms = x ? out_elms : in_elms;
+      temp_elms = elms * num_chan_procs;
+      plan.chanfilt_time = 2 * (num_chan_procs - 1)
+          * get_ring_time(get_groups(true, cd), elms * ts);
+    }
+    // Ring allreduce of the filter gradients over the processes with
+    // the same filters
+    const int num_reduce_procs = m_num_procs / num_chan_procs;
+    if (num_reduce_procs > 1) {
+      plan.allreduce_time = 2 * (num_reduce_procs - 1)
+          * get_ring_time(get_groups(false, cd),
+                          util::ceil(weight_elms * ts,
+                                     (std::size_t)num_reduce_procs));
+    }
+  }
+
+  // Activations and their gradients are retained for backward
+  std::size_t mem = 2 * in_halo_elms + 2 * weight_elms + temp_elms;
+  if (layer_idx + 1 == (int)m_layers.size()) {
+    mem += 2 * out_elms;
+  }
+  plan.memory = mem * ts;
+  c.time = plan.compute_time + plan.halo_time + plan.chanfilt_time
+      + plan.allreduce_time;
+}
+
+double DecompositionPlanner::estimate_shuffle(
+    const tensor::Shape &shape, const tensor::Shape &src_locale_shape,
+    const tensor::Shape &dst_locale_shape) const {
+  const int nd = shape.num_dims();
+  // Parts of the block of a source process in each dimension sent to
+  // each destination index, as the offset of that index in the rank
+  // order and the number of elements
+  std::vector<std::vector<std::pair<int, index_t>>> parts(nd);
+  std::vector<std::size_t> pos(nd);
+  double max_time = 0;
+  for (int rank = 0; rank < m_num_procs; ++rank) {
+    const auto idx = get_coord(rank, src_locale_shape);
+    int stride = 1;
+    for (int i = 0; i < nd; ++i) {
+      const index_t n = shape[i];
+      const index_t sp = src_locale_shape[i];
+      const index_t dp = dst_locale_shape[i];
+      const index_t begin = get_block_begin(n, sp, idx[i]);
+      const index_t end = get_block_begin(n, sp, idx[i] + 1);
+      parts[i].clear();
+      for (index_t j = begin * dp / n; j < dp; ++j) {
+        const index_t b = std::max(begin, get_block_begin(n, dp, j));
+        const index_t e = std::min(end, get_block_begin(n, dp, j + 1));
+        if (b >= end) break;
+        if (e > b) parts[i].emplace_back(j * stride, e - b);
+      }
+      stride *= dp;
+    }
+    double t = 0;
+    std::fill(pos.begin(), pos.end(), 0);
+    while (true) {
+      std::size_t elms = 1;
+      int dst = 0;
+      for (int i = 0; i < nd; ++i) {
+        dst += parts[i][pos[i]].first;
+        elms *= parts[i][pos[i]].second;
+      }
+      t += get_link_time(rank, dst, elms * m_opts.type_size);
+      int i = 0;
+      for (; i < nd; ++i) {
+        if (++pos[i] < parts[i].size()) break;
+        pos[i] = 0;
+      }
+      if (i == nd) break;
+    }
+    max_time = std::max(max_time, t);
+  }
+  // Activations in forward and their gradients in backward
+  return max_time * 2;
+}
+
+DecompositionPlanner::Plan DecompositionPlanner::plan() const {
+  const int nl = m_layers.size();
+  Plan plan;
+  if (nl == 0) return plan;
+
+  std::vector<std::vector<Candidate>> candidates(nl);
+  for (int l = 0; l < nl; ++l) {
+    candidates[l] = get_candidates(l);
+  }
+  // Shuffle time and the memory of the source tensor kept alongside
+  // the shuffled one, by layer, candidate and candidate of the
+  // previous layer
+  std::vector<std::vector<std::vector<double>>> shuffle_time(nl);
+  std::vector<std::vector<std::vector<std::size_t>>> shuffle_mem(nl);
+  for (int l = 1; l < nl; ++l) {
+    const auto &prev = candidates[l - 1];
+    const auto &cur = candidates[l];
+    const tensor::Shape shape(m_layers[l].input_shape);
+    shuffle_time[l].assign(cur.size(), std::vector<double>(prev.size(), 0));
+    shuffle_mem[l].assign(cur.size(),
+                          std::vector<std::size_t>(prev.size(), 0));
+    for (std::size_t j = 0; j < cur.size(); ++j) {
+      for (std::size_t i = 0; i < prev.size(); ++i) {
+        const auto &src = prev[i].plan.locale_shape;
+        const auto &dst = cur[j].plan.locale_shape;
+        if (src == dst) continue;
+        shuffle_time[l][j][i] = estimate_shuffle(shape, src, dst);
+        std::size_t elms = 1;
+        for (int d = 0; d < shape.num_dims(); ++d) {
+          elms *= get_max_block(shape[d], src[d]);
+        }
+        shuffle_mem[l][j][i] = 2 * elms * m_opts.type_size;
+      }
+    }
+  }
+
+  // Viterbi over the layers minimizing time + penalty * memory
+  auto solve = [&](double penalty, std::vector<int> &choice,
+                   double &time, std::size_t &mem) {
+    std::vector<std::vector<double>> cost(nl);
+    std::vector<std::vector<int>> from(nl);
+    for (int l = 0; l < nl; ++l) {
+      const auto &cur = candidates[l];
+      cost[l].assign(cur.size(), std::numeric_limits<double>::max());
+      from[l].assign(cur.size(), -1);
+      for (std::size_t j = 0; j < cur.size(); ++j) {
+        const double own = cur[j].time + penalty * cur[j].plan.memory;
+        if (l == 0) {
+          cost[l][j] = own;
+          continue;
+        }
+        for (std::size_t i = 0; i < candidates[l - 1].size(); ++i) {
+          const double c = cost[l - 1][i] + own + shuffle_time[l][j][i]
+              + penalty * shuffle_mem[l][j][i];
+          if (c < cost[l][j]) {
+            cost[l][j] = c;
+            from[l][j] = i;
+          }
+        }
+      }
+    }
+    choice.assign(nl, 0);
+    choice[nl - 1] = std::min_element(cost[nl - 1].begin(),
+                                      cost[nl - 1].end())
+        - cost[nl - 1].begin();
+    for (int l = nl - 1; l > 0; --l) {
+      choice[l - 1] = from[l][choice[l]];
+    }
+    time = 0;
+    mem = 0;
+    for (int l = 0; l < nl; ++l) {
+      time += candidates[l][choice[l]].time;
+      mem += candidates[l][choice[l]].plan.memory;
+      if (l > 0) {
+        time += shuffle_time[l][choice[l]][choice[l - 1]];
+        mem += shuffle_mem[l][choice[l]][choice[l - 1]];
+      }
+    }
+  };
+
+  std::vector<int> choice;
+  double time;
+  std::size_t mem;
+  solve(0, choice, time, mem);
+  const std::size_t cap = m_opts.memory_cap;
+  if (cap > 0 && mem > cap) {
+    // Find a penalty, in seconds per byte, that fits the cap, and then
+    // the smallest such one by bisection
+    double lo = 0, hi = 1e-15;
+    for (; hi < 1; hi *= 2) {
+      solve(hi, choice, time, mem);
+      if (mem <= cap) break;
+      lo = hi;
+    }
+    if (mem > cap) {
+      util::MPIPrintStreamError()
+          << "No decomposition fits in " << cap << " bytes per process; "
+          << "the smallest needs " << mem << " bytes";
+      throw std::exception();
+    }
+    for (int i = 0; i < 50; ++i) {
+      const double mid = (lo + hi) / 2;
+      std::vector<int> c;
+      double t;
+      std::size_t m;
+      solve(mid, c, t, m);
+      if (m <= cap) {
+        hi = mid;
+        choice = c;
+        time = t;
+        mem = m;
+      } else {
+        lo = mid;
+      }
+    }
+  }
+
+  plan.step_time = time;
+  plan.memory = mem;
+  for (int l = 0; l < nl; ++l) {
+    auto lp = candidates[l][choice[l]].plan;
+    lp.shuffle_input = l > 0 && lp.locale_shape
+        != candidates[l - 1][choice[l - 1]].plan.locale_shape;
+    if (lp.shuffle_input) {
+      lp.shuffle_time = shuffle_time[l][choice[l]][choice[l - 1]];
+      lp.memory += shuffle_mem[l][choice[l]][choice[l - 1]];
+    }
+    lp.input_dist = tensor::Distribution::make_overlapped_distribution(
+        lp.locale_shape, get_overlap(m_layers[l], lp.locale_shape));
+    plan.layers.push_back(lp);
+  }
+  // Outputs carry the halos of the next layer unless they are shuffled
+  for (int l = 0; l < nl; ++l) {
+    auto &lp = plan.layers[l];
+    const int nd = lp.locale_shape.num_dims();
+    IntVector overlap(nd, 0);
+    if (l + 1 < nl && !plan.layers[l + 1].shuffle_input) {
+      overlap = plan.layers[l + 1].input_dist.get_overlap();
+    }
+    lp.output_dist = tensor::Distribution::make_overlapped_distribution(
+        lp.locale_shape, overlap);
+  }
+  return plan;
+}
+
+std::ostream &DecompositionPlanner::print(std::ostream &os,
+                                          const Plan &plan) const {
+  const auto flags = os.flags();
+  os << std::fixed << std::setprecision(3);
+  for (std::size_t l = 0; l < plan.layers.size(); ++l) {
+    const auto &lp = plan.layers[l];
+    os << m_layers[l].name << ": locale shape " << lp.locale_shape;
+    if (lp.chanfilt_algo != ChannelParallelismAlgorithm::NONE) {
+      os << ", chanfilt " << lp.chanfilt_algo;
+    }
+    if (lp.shuffle_input) {
+      os << ", shuffled input (" << lp.shuffle_time * 1e3 << " ms)";
+    }
+    os << ", compute " << lp.compute_time * 1e3 << " ms"
+       << ", halo " << lp.halo_time * 1e3 << " ms";
+    if (lp.chanfilt_time > 0) {
+      os << ", chanfilt " << lp.chanfilt_time * 1e3 << " ms";
+    }
+    if (lp.allreduce_time > 0) {
+      os << ", allreduce " << lp.allreduce_time * 1e3 << " ms";
+    }
+    os << ", memory " << lp.memory / (1024.0 * 1024.0) << " MiB\n";
+  }
+  os << "Predicted step time " << plan.step_time * 1e3 << " ms, memory "
+     << plan.memory / (1024.0 * 1024.0) << " MiB per process\n";
+  os.flags(flags);
+  return os;
+}
+
+} // namespace distconv
@@ -0,0 +1,280 @@
+#include "distconv/dnn_backend/algo_cache.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace distconv
+{
+
+bool ConvAlgoCache::lookup(const std::string& key,
+                           size_t ws_limit,
+                           int& algo) const
+{
+    Entry e;
+    if (!lookup_entry(key, ws_limit, e))
+    {
+        return false;
+    }
+    algo = e.algo;
+    return true;
+}
+
+bool ConvAlgoCache::lookup_entry(const std::string& key,
+                                 size_t ws_limit,
+                                 Entry& entry) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+    {
+        return false;
+    }
+    if (it->second.ws_size > ws_limit)
+    {
+        util::MPIPrintStreamDebug()
+            << "Cached algorithm " << it->second.algo << " requires "
+            << it->second.ws_size << " bytes of workspace, exceeding "
+            << ws_limit << " bytes; ignoring the cached entry for " << key;
+        return false;
+    }
+    entry = it->second;
+    return true;
+}
+
+void ConvAlgoCache::insert(const std::string& key, int algo, size_t ws_size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries[key] = Entry{algo, ws_size};
+    m_dirty = true;
+}
+
+int ConvAlgoCache::get_or_tune(const std::string& key,
+                               size_t ws_limit,
+                               TuneFunc tune)
+{
+    int algo;
+    if (lookup(key, ws_limit, algo))
+    {
+        util::MPIPrintStreamDebug()
+            << "Using cached algorithm " << algo << " for " << key;
+        return algo;
+    }
+    const auto e = tune(ws_limit);
+    insert(key, e.algo, e.ws_size);
+    return e.algo;
+}
+
+int ConvAlgoCache::get_or_tune_collectively(const std::string& key,
+                                            size_t ws_limit,
+                                            MPI_Comm comm,
+                                            TuneFunc tune)
+{
+    MPI_Comm group_comm = split_comm_by_key(key, comm);
+    int group_rank, group_size;
+    DISTCONV_CHECK_MPI(MPI_Comm_rank(group_comm, &group_rank));
+    DISTCONV_CHECK_MPI(MPI_Comm_size(group_comm, &group_size));
+    // The selected algorithm must fit into the workspace of every
+    // member.
+    DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE,
+                                     &ws_limit,
+                                     1,
+                                     util::get_mpi_data_type<size_t>(),
+                                     MPI_MIN,
+                                     group_comm));
+    // Packs the algorithm and its workspace size for broadcasting
+    size_t buf[2];
+    if (group_rank == 0)
+    {
+        Entry e;
+        if (lookup_entry(key, ws_limit, e))
+        {
+            buf[0] = static_cast<size_t>(e.algo);
+            buf[1] = e.ws_size;
+        }
+        else
+        {
+            const auto e = tune(ws_limit);
+            buf[0] = static_cast<size_t>(e.algo);
+            buf[1] = e.ws_size;
+        }
+    }
+    DISTCONV_CHECK_MPI(MPI_Bcast(
+        buf, 2, util::get_mpi_data_type<size_t>(), 0, group_comm));
+    DISTCONV_CHECK_MPI(MPI_Comm_free(&group_comm));
+    const int algo = static_cast<int>(buf[0]);
+    int cached_algo;
+    if (!lookup(key, ws_limit, cached_algo) || cached_algo != algo)
+    {
+        insert(key, algo, buf[1]);
+    }
+    util::MPIPrintStreamDebug()
+        << "Algorithm " << algo << " selected by a group of " << group_size
+        << " ranks for " << key;
+    return algo;
+}
+
+MPI_Comm ConvAlgoCache::split_comm_by_key(const std::string& key,
+                                          MPI_Comm comm)
+{
+    int rank, size;
+    DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &rank));
+    DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &size));
+    int len = static_cast<int>(key.size());
+    std::vector<int> lens(size);
+    DISTCONV_CHECK_MPI(
+        MPI_Allgather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, comm));
+    std::vector<int> displs(size, 0);
+    int total_len = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        displs[i] = total_len;
+        total_len += lens[i];
+    }
+    std::string all(total_len, '\0');
+    DISTCONV_CHECK_MPI(MPI_Allgatherv(key.data(),
+                                      len,
+                                      MPI_CHAR,
+                                      &all[0],
+                                      lens.data(),
+                                      displs.data(),
+                                      MPI_CHAR,
+                                      comm));
+    // The color of a group is the lowest rank with the same key, so
+    // the keys are compared exactly rather than by hash.
+    int color = rank;
+    for (int i = 0; i < rank; ++i)
+    {
+        if (all.compare(displs[i], lens[i], key) == 0)
+        {
+            color = i;
+            break;
+        }
+    }
+    MPI_Comm group_comm;
+    DISTCONV_CHECK_MPI(MPI_Comm_split(comm, color, rank, &group_comm));
+    return group_comm;
+}
+
+std::string ConvAlgoCache::serialize() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::stringstream ss;
+    for (const auto& e : m_entries)
+    {
+        ss << e.second.algo << " " << e.second.ws_size << " " << e.first
+           << "\n";
+    }
+    return ss.str();
+}
+
+void ConvAlgoCache::deserialize(const std::string& str)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::istringstream is(str);
+    std::string line;
+    while (std::getline(is, line))
+    {
+        std::istringstream ls(line);
+        Entry e;
+        if (!(ls >> e.algo >> e.ws_size))
+        {
+            continue;
+        }
+        std::string key;
+        ls.get();
+        std::getline(ls, key);
+        if (key.empty())
+        {
+            continue;
+        }
+        // Keep the existing entry when the same key shows up twice.
+        m_entries.emplace(key, e);
+    }
+}
+
+void ConvAlgoCache::load(const std::string& path, MPI_Comm comm)
+{
+    int rank;
+    DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &rank));
+    std::string buf;
+    if (rank == 0)
+    {
+        std::ifstream ifs(path);
+        if (ifs)
+        {
+            std::stringstream ss;
+            ss << ifs.rdbuf();
+            buf = ss.str();
+        }
+        else
+        {
+            util::MPIPrintStreamInfo()
+                << "Convolution algorithm cache not found at " << path;
+        }
+    }
+    int len = static_cast<int>(buf.size());
+    DISTCONV_CHECK_MPI(MPI_Bcast(&len, 1, MPI_INT, 0, comm));
+    buf.resize(len);
+    DISTCONV_CHECK_MPI(MPI_Bcast(&buf[0], len, MPI_CHAR, 0, comm));
+    deserialize(buf);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dirty = false;
+    util::MPIRootPrintStreamInfo()
+        << "Loaded " << m_entries.size()
+        << " convolution algorithm cache entries from " << path;
+}
+
+void ConvAlgoCache::save(const std::string& path, MPI_Comm comm)
+{
+    int rank, size;
+    DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &rank));
+    DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &size));
+    const std::string buf = serialize();
+    int len = static_cast<int>(buf.size());
+    std::vector<int> lens(size);
+    DISTCONV_CHECK_MPI(
+        MPI_Gather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, 0, comm));
+    std::vector<int> displs(size, 0);
+    int total_len = 0;
+    if (rank == 0)
+    {
+        for (int i = 0; i < size; ++i)
+        {
+            displs[i] = total_len;
+            total_len += lens[i];
+        }
+    }
+    std::string all(total_len, '\0');
+    DISTCONV_CHECK_MPI(MPI_Gatherv(buf.data(),
+                                   len,
+                                   MPI_CHAR,
+                                   &all[0],
+                                   lens.data(),
+                                   displs.data(),
+                                   MPI_CHAR,
+                                   0,
+                                   comm));
+    if (rank == 0)
+    {
+        deserialize(all);
+        std::ofstream ofs(path, std::ios::trunc);
+        if (!ofs)
+        {
+            util::MPIPrintStreamError()
+                << "Failed to open convolution algorithm cache " << path;
+        }
+        else
+        {
+            ofs << serialize();
+            util::MPIPrintStreamInfo()
+                << "Saved " << this->size()
+                << " convolution algorithm cache entries to " << path;
+        }
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dirty = false;
+}
+
+} // namespace distconv
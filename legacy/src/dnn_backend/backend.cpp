@@ -3,10 +3,95 @@
 #include "distconv/util/util_cudnn.hpp"
 
 #include <limits>
+#include <sstream>
 
 namespace distconv {
 namespace cudnn {
 
+namespace {
+std::string get_device_arch_string() {
+  int dev, major, minor;
+  DISTCONV_CHECK_CUDA(cudaGetDevice(&dev));
+  DISTCONV_CHECK_CUDA(cudaDeviceGetAttribute(
+      &major, cudaDevAttrComputeCapabilityMajor, dev));
+  DISTCONV_CHECK_CUDA(cudaDeviceGetAttribute(
+      &minor, cudaDevAttrComputeCapabilityMinor, dev));
+  std::stringstream ss;
+  ss << "sm_" << major << minor;
+  return ss.str();
+}
+
+// Builds the key of the persistent algorithm cache. The descriptors
+// include the number of samples, so each local mini-batch size gets
+// its own entry.
+std::string get_algo_cache_key(const std::string &direction,
+                               const std::string &x_desc,
+                               const std::string &w_desc,
+                               const cudnnConvolutionDescriptor_t &conv_desc,
+                               const std::string &y_desc) {
+  int groups;
+  DISTCONV_CHECK_CUDNN(cudnnGetConvolutionGroupCount(conv_desc, &groups));
+  cudnnMathType_t math_type;
+  DISTCONV_CHECK_CUDNN(cudnnGetConvolutionMathType(conv_desc, &math_type));
+  std::stringstream ss;
+  ss << direction << "; " << x_desc << "; " << w_desc << "; "
+     << util::tostring(conv_desc) << ", groups=" << groups
+     << ", math=" << math_type << "; " << y_desc << "; "
+     << util::get_cudnn_version_number_string() << "; "
+     << get_device_arch_string();
+  return ss.str();
+}
+
+// A zero workspace size lets autotuning use as much memory as it
+// needs.
+size_t get_algo_cache_ws_limit(size_t ws_size) {
+  return ws_size ? ws_size : std::numeric_limits<size_t>::max();
+}
+
+size_t get_autotune_ws_size(size_t ws_limit) {
+  return ws_limit == std::numeric_limits<size_t>::max() ? 0 : ws_limit;
+}
+} // namespace
+
+int BackendCUDNN::get_or_tune_algorithm(const std::string &key,
+                                        size_t ws_size,
+                                        ConvAlgoCache::TuneFunc tune) {
+  const auto ws_limit = get_algo_cache_ws_limit(ws_size);
+  // The other processes may run their threads in a different order
+  if (m_opts.m_collective_autotune && !m_collective_autotune_suspended &&
+      !is_thread_attached()) {
+    return m_algo_cache.get_or_tune_collectively(key, ws_limit, m_comm, tune);
+  }
+  return m_algo_cache.get_or_tune(key, ws_limit, tune);
+}
+
+#ifdef DISTCONV_HAS_CUDNN_GRAPH_API
+bool BackendCUDNN::execute_graph_conv(cudnnHandle_t handle,
+                                      const GraphConvProblem &p,
+                                      void *ws, size_t ws_size) {
+  // The engines are not filtered by their numerical notes
+  if (m_opts.m_deterministic) {
+    return false;
+  }
+  std::string direction;
+  switch (p.kind) {
+    case GraphConvKind::FWD:
+      direction = p.bias_desc ? "graph_fwd_bias_relu" : "graph_fwd";
+      break;
+    case GraphConvKind::BWD_DATA: direction = "graph_bwd_data"; break;
+    case GraphConvKind::BWD_FILTER: direction = "graph_bwd_filter"; break;
+  }
+  // Scaling factors are fixed when an operation graph is built.
+  std::stringstream ss;
+  ss << get_algo_cache_key(direction, util::tostring(p.x_desc),
+                           util::tostring(p.w_desc), p.conv_desc,
+                           util::tostring(p.y_desc))
+     << "; alpha=" << p.alpha << ", beta=" << p.beta;
+  return m_graph_plans.execute(handle, p, ss.str(), ws, ws_size,
+                               m_algo_cache);
+}
+#endif // DISTCONV_HAS_CUDNN_GRAPH_API
+
 // Default workspace wize
 #if CUDNN_MAJOR < 8
 constexpr size_t CONVOLUTION_WORKSPACE_SIZE = 1 << 30;
@@ -21,14 +106,18 @@ cudnnConvolutionFwdAlgo_t BackendCUDNN::get_fwd_algorithm(
     const cudnnConvolutionDescriptor_t conv_desc,
     const cudnnTensorDescriptor_t output_desc,
     void *output,
-    size_t ws_size) {
+    size_t ws_size,
+    const std::string &key_prefix) {
+  // Reproducible runs autotune among the deterministic algorithms,
+  // which are cached separately
+  const bool deterministic =
+      name == "DETERMINISTIC" || m_opts.m_deterministic;
   std::string& n = name;
   if (name == "DEFAULT") {
     // Default selection
     n = "HEURISTIC";
   } else if (name == "DETERMINISTIC") {
-    // Use IMPLICIT_GEMM as it is deterministic
-    n = "IMPLICIT_GEMM";
+    n = "AUTOTUNE";
   }
 
   util::CUDNNConvolutionFwdAlgorithms algos;
@@ -41,9 +130,20 @@ cudnnConvolutionFwdAlgo_t BackendCUDNN::get_fwd_algorithm(
         input_desc, filter_desc, conv_desc, output_desc,
         ws_size);
   } else if (n == "AUTOTUNE") {
-    return autotune_fwd_algorithm(
-        input_desc, input, filter_desc, filter, conv_desc, output_desc,
-        output, ws_size);
+    const auto key = get_algo_cache_key(
+        key_prefix + (deterministic ? "deterministic_fwd" : "fwd"),
+        util::tostring(input_desc),
+        util::tostring(filter_desc), conv_desc, util::tostring(output_desc));
+    auto tune = [&](size_t ws_limit) {
+      auto algo = autotune_fwd_algorithm(
+          input_desc, input, filter_desc, filter, conv_desc, output_desc,
+          output, get_autotune_ws_size(ws_limit), deterministic);
+      return ConvAlgoCache::Entry{algo, get_conv_forward_workspace_size(
+          get_handle(), input_desc, filter_desc, conv_desc, output_desc,
+          algo)};
+    };
+    return static_cast<cudnnConvolutionFwdAlgo_t>(
+        get_or_tune_algorithm(key, ws_size, tune));
   }
 
   util::MPIRootPrintStreamError()
@@ -95,16 +195,25 @@ cudnnConvolutionFwdAlgo_t BackendCUDNN::get_fwd_algorithm_by_heuristics(
 #endif // CUDNN_MAJOR < 8
 }
 
+// Only considers the algorithms cuDNN reports as deterministic if
+// deterministic is set, returning fallback if none succeeded.
 template <typename AlgoType, typename PerfType>
-AlgoType find_best_algorithm(const std::vector<PerfType> &perf_results) {
+AlgoType find_best_algorithm(const std::vector<PerfType> &perf_results,
+                             bool deterministic, AlgoType fallback) {
   std::map<AlgoType, float> time_map;
   for (const auto &res: perf_results) {
     assert_always(res.status == CUDNN_STATUS_SUCCESS);
+    if (deterministic && res.determinism != CUDNN_DETERMINISTIC) {
+      continue;
+    }
     if (time_map.find(res.algo) == time_map.end()) {
       time_map[res.algo] = 0;
     }
     time_map[res.algo] += res.time;
   }
+  if (time_map.empty()) {
+    return fallback;
+  }
   AlgoType best_algo = time_map.begin()->first;
   float min_time = std::numeric_limits<float>::max();
   for (const auto &x: time_map) {
@@ -128,7 +237,8 @@ cudnnConvolutionFwdAlgo_t BackendCUDNN::autotune_fwd_algorithm(
     const cudnnConvolutionDescriptor_t &conv_desc,
     const cudnnTensorDescriptor_t &output_desc,
     void *output,
-    size_t ws_size) {
+    size_t ws_size,
+    bool deterministic) {
   constexpr int trial_count = 5;
   constexpr int skip = 5;
   int algo_count;
@@ -186,7 +296,8 @@ cudnnConvolutionFwdAlgo_t BackendCUDNN::autotune_fwd_algorithm(
   }
   auto best_algo = find_best_algorithm<
     cudnnConvolutionFwdAlgo_t, cudnnConvolutionFwdAlgoPerf_t>(
-        perf_results_all);
+        perf_results_all, deterministic,
+        CUDNN_CONVOLUTION_FWD_ALGO_IMPLICIT_GEMM);
   util::MPIPrintStreamDebug()
       << "Autotune best algorithm: "
       << util::CUDNNConvolutionFwdAlgorithms::get_name(best_algo);
@@ -202,14 +313,17 @@ cudnnConvolutionBwdDataAlgo_t BackendCUDNN::get_bwd_data_algorithm(
     const cudnnConvolutionDescriptor_t conv_desc,
     const cudnnTensorDescriptor_t d_input_desc,
     void *d_input,
-    size_t ws_size) {
+    size_t ws_size,
+    const std::string &key_prefix) {
+  // As in get_fwd_algorithm
+  const bool deterministic =
+      name == "DETERMINISTIC" || m_opts.m_deterministic;
   std::string& n = name;
   if (name == "DEFAULT") {
     // Default selection
     n = "HEURISTIC";
   } else if (name == "DETERMINISTIC") {
-    // Use ALGO_1 as it is deterministic
-    n = "ALGO_1";
+    n = "AUTOTUNE";
   }
 
   util::CUDNNConvolutionBwdDataAlgorithms algos;
@@ -222,9 +336,21 @@ cudnnConvolutionBwdDataAlgo_t BackendCUDNN::get_bwd_data_algorithm(
         filter_desc, d_output_desc, conv_desc, d_input_desc,
         ws_size);
   } else if (n == "AUTOTUNE") {
-    return autotune_bwd_data_algorithm(
-        filter_desc, filter, d_output_desc, d_output, conv_desc,
-        d_input_desc, d_input, ws_size);
+    const auto key = get_algo_cache_key(
+        key_prefix + (deterministic ? "deterministic_bwd_data" : "bwd_data"),
+        util::tostring(d_input_desc),
+        util::tostring(filter_desc), conv_desc, util::tostring(d_output_desc));
+    auto tune = [&](size_t ws_limit) {
+      auto algo = autotune_bwd_data_algorithm(
+          filter_desc, filter, d_output_desc, d_output, conv_desc,
+          d_input_desc, d_input, get_autotune_ws_size(ws_limit),
+          deterministic);
+      return ConvAlgoCache::Entry{algo, get_conv_bwd_data_workspace_size(
+          get_handle(), filter_desc, d_output_desc, conv_desc, d_input_desc,
+          algo)};
+    };
+    return static_cast<cudnnConvolutionBwdDataAlgo_t>(
+        get_or_tune_algorithm(key, ws_size, tune));
   }
 
   util::MPIRootPrintStreamError()
@@ -284,7 +410,8 @@ cudnnConvolutionBwdDataAlgo_t BackendCUDNN::autotune_bwd_data_algorithm(
     const cudnnConvolutionDescriptor_t &conv_desc,
     const cudnnTensorDescriptor_t &d_input_desc,
     void *d_input,
-    size_t ws_size) {
+    size_t ws_size,
+    bool deterministic) {
   constexpr int trial_count = 3;
   constexpr int skip = 1;
   int algo_count;
@@ -343,7 +470,8 @@ cudnnConvolutionBwdDataAlgo_t BackendCUDNN::autotune_bwd_data_algorithm(
   }
   auto best_algo = find_best_algorithm<
     cudnnConvolutionBwdDataAlgo_t, cudnnConvolutionBwdDataAlgoPerf_t>(
-        perf_results_all);
+        perf_results_all, deterministic,
+        CUDNN_CONVOLUTION_BWD_DATA_ALGO_1);
   util::MPIPrintStreamDebug()
       << "Autotune best algorithm: "
       << util::CUDNNConvolutionBwdDataAlgorithms::get_name(best_algo);
@@ -359,14 +487,17 @@ cudnnConvolutionBwdFilterAlgo_t BackendCUDNN::get_bwd_filter_algorithm(
     const cudnnConvolutionDescriptor_t conv_desc,
     const cudnnFilterDescriptor_t d_filter_desc,
     void *d_filter,
-    size_t ws_size) {
+    size_t ws_size,
+    const std::string &key_prefix) {
+  // As in get_fwd_algorithm
+  const bool deterministic =
+      name == "DETERMINISTIC" || m_opts.m_deterministic;
   std::string& n = name;
   if (name == "DEFAULT") {
     // Default selection
     n = "HEURISTIC";
   } else if (name == "DETERMINISTIC") {
-    // Use ALGO_1 as it is deterministic
-    n = "ALGO_1";
+    n = "AUTOTUNE";
   }
 
   util::CUDNNConvolutionBwdFilterAlgorithms algos;
@@ -384,9 +515,23 @@ cudnnConvolutionBwdFilterAlgo_t BackendCUDNN::get_bwd_filter_algorithm(
         input_desc, d_output_desc, conv_desc, d_filter_desc,
         ws_size);
   } else if (n == "AUTOTUNE") {
-    return autotune_bwd_filter_algorithm(
-        input_desc, input, d_output_desc, d_output, conv_desc,
-        d_filter_desc, d_filter, ws_size);
+    const auto key = get_algo_cache_key(
+        key_prefix +
+            (deterministic ? "deterministic_bwd_filter" : "bwd_filter"),
+        util::tostring(input_desc),
+        util::tostring(d_filter_desc), conv_desc,
+        util::tostring(d_output_desc));
+    auto tune = [&](size_t ws_limit) {
+      auto algo = autotune_bwd_filter_algorithm(
+          input_desc, input, d_output_desc, d_output, conv_desc,
+          d_filter_desc, d_filter, get_autotune_ws_size(ws_limit),
+          deterministic);
+      return ConvAlgoCache::Entry{algo, get_conv_bwd_filter_workspace_size(
+          get_handle(), input_desc, d_output_desc, conv_desc, d_filter_desc,
+          algo)};
+    };
+    return static_cast<cudnnConvolutionBwdFilterAlgo_t>(
+        get_or_tune_algorithm(key, ws_size, tune));
   }
 
   util::MPIRootPrintStreamError()
@@ -448,7 +593,8 @@ cudnnConvolutionBwdFilterAlgo_t BackendCUDNN::autotune_bwd_filter_algorithm(
     const cudnnConvolutionDescriptor_t &conv_desc,
     const cudnnFilterDescriptor_t &d_filter_desc,
     void *d_filter,
-    size_t ws_size) {
+    size_t ws_size,
+    bool deterministic) {
   constexpr int trial_count = 3;
   constexpr int skip = 1;
   int algo_count;
@@ -507,7 +653,8 @@ cudnnConvolutionBwdFilterAlgo_t BackendCUDNN::autotune_bwd_filter_algorithm(
   }
   auto best_algo = find_best_algorithm<
     cudnnConvolutionBwdFilterAlgo_t, cudnnConvolutionBwdFilterAlgoPerf_t>(
-        perf_results_all);
+        perf_results_all, deterministic,
+        CUDNN_CONVOLUTION_BWD_FILTER_ALGO_1);
   util::MPIPrintStreamDebug()
       << "Autotune best algorithm: "
       << util::CUDNNConvolutionBwdFilterAlgorithms::get_name(best_algo);
@@ -10,7 +10,10 @@
 #include "distconv/util/util_mpi.hpp"
 
 #include <limits>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <vector>
 
 namespace
 {
@@ -65,21 +68,26 @@ struct PerfAlgo<miopenConvBwdDataAlgorithm_t>
 };
 
 static std::unordered_map<miopenPoolingDescriptor_t, void*> workspace_map;
+// Layers may be run from several threads.
+static std::mutex workspace_map_mutex;
 } // namespace
 
 void distconv::miopen::details::set_workspace(
     miopenPoolingDescriptor_t const& desc, void* workspace)
 {
+    std::lock_guard<std::mutex> lock(workspace_map_mutex);
     workspace_map[desc] = workspace;
 }
 void* distconv::miopen::details::get_workspace(
     miopenPoolingDescriptor_t const& desc)
 {
+    std::lock_guard<std::mutex> lock(workspace_map_mutex);
     return workspace_map.at(desc);
 }
 void distconv::miopen::details::clear_workspace(
     miopenPoolingDescriptor_t const& desc)
 {
+    std::lock_guard<std::mutex> lock(workspace_map_mutex);
     if (workspace_map.count(desc))
     {
         ::distconv::internal::RuntimeHIP::get_device_memory_pool().release(
@@ -118,6 +126,41 @@ static AlgoType get_algo(miopenConvAlgoPerf_t const& perf)
     return PerfAlgo<AlgoType>::get(perf);
 }
 
+// Queried once, as keys are built for every immediate-mode
+// convolution and each process drives a single device.
+static std::string const& get_device_arch_string()
+{
+    static std::string const arch = [] {
+        int dev;
+        DISTCONV_CHECK_HIP(hipGetDevice(&dev));
+        hipDeviceProp_t prop;
+        DISTCONV_CHECK_HIP(hipGetDeviceProperties(&prop, dev));
+        return std::string(prop.gcnArchName);
+    }();
+    return arch;
+}
+
+// Builds the key of the persistent algorithm cache. The descriptors
+// include the number of samples, so each local mini-batch size gets
+// its own entry.
+static std::string
+get_algo_cache_key(std::string const& direction,
+                   miopenTensorDescriptor_t const& xdesc,
+                   miopenTensorDescriptor_t const& wdesc,
+                   miopenConvolutionDescriptor_t const& conv_desc,
+                   miopenTensorDescriptor_t const& ydesc)
+{
+    int groups;
+    DISTCONV_CHECK_MIOPEN(miopenGetConvolutionGroupCount(conv_desc, &groups));
+    std::ostringstream oss;
+    oss << direction << "; " << util::tostring(xdesc) << "; "
+        << util::tostring(wdesc) << "; " << util::tostring(conv_desc)
+        << ", groups=" << groups << "; " << util::tostring(ydesc) << "; "
+        << util::get_miopen_version_number_string() << "; "
+        << get_device_arch_string();
+    return oss.str();
+}
+
 static miopenConvFwdAlgorithm_t
 get_fwd_algorithm_by_heuristics(miopenHandle_t handle,
                                 miopenTensorDescriptor_t const& xdesc,
@@ -249,6 +292,252 @@ autotune_fwd_algorithm(miopenHandle_t handle,
     return best_algo;
 }
 
+// Immediate mode. The solutions of a problem are listed best first,
+// from the find-db of MIOpen when it has the problem and from its
+// heuristics otherwise. The descriptors are in the order of the
+// forward problem, as in BackendMIOpen.
+
+static char const*
+get_immediate_direction_name(BackendMIOpen::ConvDirection const dir)
+{
+    switch (dir)
+    {
+    case BackendMIOpen::ConvDirection::FORWARD: return "fwd-immediate";
+    case BackendMIOpen::ConvDirection::BACKWARD_DATA:
+        return "bwd-data-immediate";
+    case BackendMIOpen::ConvDirection::BACKWARD_FILTER:
+        return "bwd-filter-immediate";
+    }
+    return "";
+}
+
+static std::vector<miopenConvSolution_t>
+get_immediate_solutions(BackendMIOpen::ConvDirection const dir,
+                        miopenHandle_t handle,
+                        miopenTensorDescriptor_t const& xdesc,
+                        miopenTensorDescriptor_t const& wdesc,
+                        miopenConvolutionDescriptor_t const& conv_desc,
+                        miopenTensorDescriptor_t const& ydesc)
+{
+    size_t count = 0;
+    switch (dir)
+    {
+    case BackendMIOpen::ConvDirection::FORWARD:
+        DISTCONV_CHECK_MIOPEN(miopenConvolutionForwardGetSolutionCount(
+            handle, wdesc, xdesc, conv_desc, ydesc, &count));
+        break;
+    case BackendMIOpen::ConvDirection::BACKWARD_DATA:
+        DISTCONV_CHECK_MIOPEN(miopenConvolutionBackwardDataGetSolutionCount(
+            handle, ydesc, wdesc, conv_desc, xdesc, &count));
+        break;
+    case BackendMIOpen::ConvDirection::BACKWARD_FILTER:
+        DISTCONV_CHECK_MIOPEN(
+            miopenConvolutionBackwardWeightsGetSolutionCount(
+                handle, ydesc, xdesc, conv_desc, wdesc, &count));
+        break;
+    }
+    std::vector<miopenConvSolution_t> solutions(count);
+    switch (dir)
+    {
+    case BackendMIOpen::ConvDirection::FORWARD:
+        DISTCONV_CHECK_MIOPEN(
+            miopenConvolutionForwardGetSolution(handle,
+                                                wdesc,
+                                                xdesc,
+                                                conv_desc,
+                                                ydesc,
+                                                solutions.size(),
+                                                &count,
+                                                solutions.data()));
+        break;
+    case BackendMIOpen::ConvDirection::BACKWARD_DATA:
+        DISTCONV_CHECK_MIOPEN(
+            miopenConvolutionBackwardDataGetSolution(handle,
+                                                     ydesc,
+                                                     wdesc,
+                                                     conv_desc,
+                                                     xdesc,
+                                                     solutions.size(),
+                                                     &count,
+                                                     solutions.data()));
+        break;
+    case BackendMIOpen::ConvDirection::BACKWARD_FILTER:
+        DISTCONV_CHECK_MIOPEN(
+            miopenConvolutionBackwardWeightsGetSolution(handle,
+                                                        ydesc,
+                                                        xdesc,
+                                                        conv_desc,
+                                                        wdesc,
+                                                        solutions.size(),
+                                                        &count,
+                                                        solutions.data()));
+        break;
+    }
+    solutions.resize(count);
+    return solutions;
+}
+
+static void
+compile_immediate_solution(BackendMIOpen::ConvDirection const dir,
+                           miopenHandle_t handle,
+                           miopenTensorDescriptor_t const& xdesc,
+                           miopenTensorDescriptor_t const& wdesc,
+                           miopenConvolutionDescriptor_t const& conv_desc,
+                           miopenTensorDescriptor_t const& ydesc,
+                           uint64_t const solution)
+{
+    switch (dir)
+    {
+    case BackendMIOpen::ConvDirection::FORWARD:
+        DISTCONV_CHECK_MIOPEN(miopenConvolutionForwardCompileSolution(
+            handle, wdesc, xdesc, conv_desc, ydesc, solution));
+        break;
+    case BackendMIOpen::ConvDirection::BACKWARD_DATA:
+        DISTCONV_CHECK_MIOPEN(miopenConvolutionBackwardDataCompileSolution(
+            handle, ydesc, wdesc, conv_desc, xdesc, solution));
+        break;
+    case BackendMIOpen::ConvDirection::BACKWARD_FILTER:
+        DISTCONV_CHECK_MIOPEN(
+            miopenConvolutionBackwardWeightsCompileSolution(
+                handle, ydesc, xdesc, conv_desc, wdesc, solution));
+        break;
+    }
+}
+
+// Compiles the cached solution, if any (cached >= 0), or the best one
+// that fits in ws_limit. Does not touch the algorithm cache, so that
+// it can run on the initialization thread.
+static BackendMIOpen::ImmediateSolution
+resolve_immediate_solution(BackendMIOpen::ConvDirection const dir,
+                           miopenHandle_t handle,
+                           miopenTensorDescriptor_t const& xdesc,
+                           miopenTensorDescriptor_t const& wdesc,
+                           miopenConvolutionDescriptor_t const& conv_desc,
+                           miopenTensorDescriptor_t const& ydesc,
+                           size_t const ws_limit,
+                           int const cached)
+{
+    if (cached >= 0)
+    {
+        // The cache only returns solutions that fit in ws_limit.
+        compile_immediate_solution(
+            dir, handle, xdesc, wdesc, conv_desc, ydesc, cached);
+        return {static_cast<uint64_t>(cached), ws_limit, true};
+    }
+    for (auto const& s :
+         get_immediate_solutions(dir, handle, xdesc, wdesc, conv_desc, ydesc))
+    {
+        if (s.workspace_size <= ws_limit)
+        {
+            compile_immediate_solution(
+                dir, handle, xdesc, wdesc, conv_desc, ydesc, s.solution_id);
+            return {s.solution_id, s.workspace_size, false};
+        }
+    }
+    util::MPIPrintStreamError()
+        << "No " << get_immediate_direction_name(dir)
+        << " solution found for MIOpen";
+    std::abort();
+}
+
+uint64_t BackendMIOpen::get_immediate_solution(
+    ConvDirection const dir,
+    miopenTensorDescriptor_t const xdesc,
+    miopenTensorDescriptor_t const wdesc,
+    miopenConvolutionDescriptor_t const conv_desc,
+    miopenTensorDescriptor_t const ydesc,
+    size_t const ws_limit)
+{
+    auto const key = get_algo_cache_key(
+        get_immediate_direction_name(dir), xdesc, wdesc, conv_desc, ydesc);
+    std::lock_guard<std::mutex> lock(m_immediate_mutex);
+    auto& entry = m_immediate_solutions[key];
+    if (!entry.solution.valid() || entry.solution.get().ws_size > ws_limit)
+    {
+        int cached;
+        if (!m_algo_cache.lookup(key, ws_limit, cached))
+            cached = -1;
+        std::promise<ImmediateSolution> promise;
+        promise.set_value(resolve_immediate_solution(dir,
+                                                     get_handle(),
+                                                     xdesc,
+                                                     wdesc,
+                                                     conv_desc,
+                                                     ydesc,
+                                                     ws_limit,
+                                                     cached));
+        entry = {promise.get_future().share(), false};
+    }
+    auto const& solution = entry.solution.get();
+    // Solution ids are cached as ints; larger ones are not persisted.
+    auto const max_id = static_cast<uint64_t>(std::numeric_limits<int>::max());
+    if (!entry.persisted && !solution.cached && solution.id <= max_id)
+        m_algo_cache.insert(
+            key, static_cast<int>(solution.id), solution.ws_size);
+    entry.persisted = true;
+    return solution.id;
+}
+
+void BackendMIOpen::precompile_immediate_solution(
+    ConvDirection const dir,
+    miopenTensorDescriptor_t const xdesc,
+    miopenTensorDescriptor_t const wdesc,
+    miopenConvolutionDescriptor_t const conv_desc,
+    miopenTensorDescriptor_t const ydesc,
+    size_t const ws_limit)
+{
+    if (!m_opts.m_miopen_immediate || m_opts.m_deterministic || !xdesc
+        || !wdesc || !conv_desc || !ydesc)
+        return;
+    auto const key = get_algo_cache_key(
+        get_immediate_direction_name(dir), xdesc, wdesc, conv_desc, ydesc);
+    std::lock_guard<std::mutex> lock(m_immediate_mutex);
+    if (m_immediate_solutions.count(key))
+        return;
+    int cached;
+    if (!m_algo_cache.lookup(key, ws_limit, cached))
+        cached = -1;
+
+    // The layer may change its descriptors before the task runs.
+    auto x = make_tensor_descriptor();
+    auto w = make_filter_descriptor();
+    auto conv = make_convolution_descriptor();
+    auto y = make_tensor_descriptor();
+    copy_tensor_descriptor(x, xdesc);
+    copy_filter_descriptor(w, wdesc);
+    copy_convolution_descriptor(conv, conv_desc);
+    int groups;
+    DISTCONV_CHECK_MIOPEN(miopenGetConvolutionGroupCount(conv_desc, &groups));
+    set_convolution_group_count(conv, groups);
+    copy_tensor_descriptor(y, ydesc);
+    auto solution = h2::gpu::run_at_init([=]() {
+        if (!m_precompile_handle)
+            m_precompile_handle = make_handle();
+        auto const solution = resolve_immediate_solution(
+            dir, m_precompile_handle, x, w, conv, y, ws_limit, cached);
+        destroy_tensor_descriptor(x);
+        destroy_filter_descriptor(w);
+        destroy_convolution_descriptor(conv);
+        destroy_tensor_descriptor(y);
+        return solution;
+    });
+    m_immediate_solutions[key] = {solution.share(), false};
+}
+
+// Autotuning always searches with CONVOLUTION_WORKSPACE_SIZE, so that
+// is also the limit cached entries are checked against.
+int BackendMIOpen::get_or_tune_algorithm(std::string const& key,
+                                         size_t /*ws_size*/,
+                                         ConvAlgoCache::TuneFunc tune)
+{
+    // The other processes may run their threads in a different order
+    if (m_opts.m_collective_autotune && !m_collective_autotune_suspended
+        && !is_thread_attached())
+        return m_algo_cache.get_or_tune_collectively(
+            key, CONVOLUTION_WORKSPACE_SIZE, m_comm, tune);
+    return m_algo_cache.get_or_tune(key, CONVOLUTION_WORKSPACE_SIZE, tune);
+}
+
 // FIXME (trb 08/11/2022): CLEANUP THE ws_size ARGUMENT TO THE MIOpen CALLS!
 miopenConvFwdAlgorithm_t
 BackendMIOpen::get_fwd_algorithm(std::string const name,
@@ -259,22 +548,41 @@ BackendMIOpen::get_fwd_algorithm(std::string const name,
                                  miopenConvolutionDescriptor_t const conv_desc,
                                  miopenTensorDescriptor_t const output_desc,
                                  void* output,
-                                 size_t ws_size)
+                                 size_t ws_size,
+                                 std::string const& key_prefix)
 {
+    // Reproducible runs autotune among the deterministic solutions,
+    // which are cached separately.
+    bool const deterministic =
+        name == "DETERMINISTIC" || m_opts.m_deterministic;
     std::string const n =
-        (name == "DEFAULT"
-             ? "HEURISTIC"
-             : (name == "DETERMINISTIC" ? "IMPLICIT_GEMM" : name));
+        (name == "DEFAULT" ? "HEURISTIC"
+                           : (name == "DETERMINISTIC" ? "AUTOTUNE" : name));
+
+    precompile_immediate_solution(ConvDirection::FORWARD,
+                                  input_desc,
+                                  filter_desc,
+                                  conv_desc,
+                                  output_desc,
+                                  ws_size);
 
     util::MIOpenConvolutionFwdAlgorithms algos;
     for (auto const& p : algos.algo_map)
         if (p.second == n)
             return p.first;
 
+    // Immediate mode only falls back to the algorithm for scaled
+    // convolutions, which GEMM supports, so skip the search.
+    if (m_opts.m_miopen_immediate && !deterministic
+        && (n == "HEURISTIC" || n == "AUTOTUNE"))
+        return miopenConvolutionFwdAlgoGEMM;
+
     assert_always(input_desc);
     assert_always(filter_desc);
     assert_always(conv_desc);
     assert_always(output_desc);
+    if (deterministic)
+        set_convolution_deterministic(conv_desc);
 
     WSBuffer ws(CONVOLUTION_WORKSPACE_SIZE);
     if (n == "HEURISTIC")
@@ -289,16 +597,33 @@ BackendMIOpen::get_fwd_algorithm(std::string const name,
                                                ws,
                                                ws_size);
     else if (n == "AUTOTUNE")
-        return autotune_fwd_algorithm(get_handle(),
-                                      input_desc,
-                                      input,
-                                      filter_desc,
-                                      filter,
-                                      conv_desc,
-                                      output_desc,
-                                      output,
-                                      ws,
-                                      ws_size);
+    {
+        auto const key = get_algo_cache_key(
+            key_prefix + (deterministic ? "deterministic_fwd" : "fwd"),
+            input_desc, filter_desc, conv_desc, output_desc);
+        auto tune = [&](size_t ws_limit) {
+            auto const algo = autotune_fwd_algorithm(get_handle(),
+                                                     input_desc,
+                                                     input,
+                                                     filter_desc,
+                                                     filter,
+                                                     conv_desc,
+                                                     output_desc,
+                                                     output,
+                                                     ws,
+                                                     ws_limit);
+            return ConvAlgoCache::Entry{
+                algo,
+                get_conv_forward_workspace_size(get_handle(),
+                                                input_desc,
+                                                filter_desc,
+                                                conv_desc,
+                                                output_desc,
+                                                algo)};
+        };
+        return static_cast<miopenConvFwdAlgorithm_t>(
+            get_or_tune_algorithm(key, ws_size, tune));
+    }
 
     util::MPIRootPrintStreamError()
         << "No matching fwd algorithm found for MIOpen: " << n;
@@ -417,22 +742,40 @@ miopenConvBwdDataAlgorithm_t BackendMIOpen::get_bwd_data_algorithm(
     miopenConvolutionDescriptor_t const conv_desc,
     miopenTensorDescriptor_t const d_input_desc,
     void* d_input,
-    size_t ws_size)
+    size_t ws_size,
+    std::string const& key_prefix)
 {
+    // As in get_fwd_algorithm.
+    bool const deterministic =
+        name == "DETERMINISTIC" || m_opts.m_deterministic;
     std::string const n =
-        (name == "DEFAULT"
-             ? "HEURISTIC"
-             : (name == "DETERMINISTIC" ? "IMPLICIT_GEMM" : name));
+        (name == "DEFAULT" ? "HEURISTIC"
+                           : (name == "DETERMINISTIC" ? "AUTOTUNE" : name));
+
+    precompile_immediate_solution(ConvDirection::BACKWARD_DATA,
+                                  d_input_desc,
+                                  filter_desc,
+                                  conv_desc,
+                                  d_output_desc,
+                                  ws_size);
 
     auto const& algo_map = util::MIOpenConvolutionBwdDataAlgorithms::algo_map;
     for (auto const& p : algo_map)
         if (p.second == n)
             return p.first;
 
+    // Immediate mode only falls back to the algorithm for scaled
+    // convolutions, which GEMM supports, so skip the search.
+    if (m_opts.m_miopen_immediate && !deterministic
+        && (n == "HEURISTIC" || n == "AUTOTUNE"))
+        return miopenConvolutionBwdDataAlgoGEMM;
+
     assert_always(filter_desc);
     assert_always(d_output_desc);
     assert_always(conv_desc);
     assert_always(d_input_desc);
+    if (deterministic)
+        set_convolution_deterministic(conv_desc);
 
     WSBuffer ws(CONVOLUTION_WORKSPACE_SIZE);
     if (n == "HEURISTIC")
@@ -447,16 +790,34 @@ miopenConvBwdDataAlgorithm_t BackendMIOpen::get_bwd_data_algorithm(
                                                     ws,
                                                     ws_size);
     else if (n == "AUTOTUNE")
-        return autotune_bwd_data_algorithm(get_handle(),
-                                           filter_desc,
-                                           filter,
-                                           d_output_desc,
-                                           d_output,
-                                           conv_desc,
-                                           d_input_desc,
-                                           d_input,
-                                           ws,
-                                           ws_size);
+    {
+        auto const key = get_algo_cache_key(
+            key_prefix
+                + (deterministic ? "deterministic_bwd_data" : "bwd_data"),
+            d_input_desc, filter_desc, conv_desc, d_output_desc);
+        auto tune = [&](size_t ws_limit) {
+            auto const algo = autotune_bwd_data_algorithm(get_handle(),
+                                                          filter_desc,
+                                                          filter,
+                                                          d_output_desc,
+                                                          d_output,
+                                                          conv_desc,
+                                                          d_input_desc,
+                                                          d_input,
+                                                          ws,
+                                                          ws_limit);
+            return ConvAlgoCache::Entry{
+                algo,
+                get_conv_bwd_data_workspace_size(get_handle(),
+                                                 filter_desc,
+                                                 d_output_desc,
+                                                 conv_desc,
+                                                 d_input_desc,
+                                                 algo)};
+        };
+        return static_cast<miopenConvBwdDataAlgorithm_t>(
+            get_or_tune_algorithm(key, ws_size, tune));
+    }
 
     util::MPIRootPrintStreamError()
         << "No matching bwd data algorithm found for MIOpen: " << n;
@@ -574,12 +935,22 @@ miopenConvBwdWeightsAlgorithm_t BackendMIOpen::get_bwd_filter_algorithm(
     miopenConvolutionDescriptor_t const conv_desc,
     miopenTensorDescriptor_t const d_filter_desc,
     void* d_filter,
-    size_t ws_size)
+    size_t ws_size,
+    std::string const& key_prefix)
 {
+    // As in get_fwd_algorithm.
+    bool const deterministic =
+        name == "DETERMINISTIC" || m_opts.m_deterministic;
     std::string const n =
-        (name == "DEFAULT"
-             ? "HEURISTIC"
-             : (name == "DETERMINISTIC" ? "IMPLICIT_GEMM" : name));
+        (name == "DEFAULT" ? "HEURISTIC"
+                           : (name == "DETERMINISTIC" ? "AUTOTUNE" : name));
+
+    precompile_immediate_solution(ConvDirection::BACKWARD_FILTER,
+                                  input_desc,
+                                  d_filter_desc,
+                                  conv_desc,
+                                  d_output_desc,
+                                  ws_size);
 
     auto const& algo_map =
         util::MIOpenConvolutionBwdWeightsAlgorithms::algo_map;
@@ -589,10 +960,18 @@ miopenConvBwdWeightsAlgorithm_t BackendMIOpen::get_bwd_filter_algorithm(
             return p.first;
     }
 
+    // Immediate mode only falls back to the algorithm for scaled
+    // convolutions, which GEMM supports, so skip the search.
+    if (m_opts.m_miopen_immediate && !deterministic
+        && (n == "HEURISTIC" || n == "AUTOTUNE"))
+        return miopenConvolutionBwdWeightsAlgoGEMM;
+
     assert_always(input_desc);
     assert_always(d_output_desc);
     assert_always(conv_desc);
     assert_always(d_filter_desc);
+    if (deterministic)
+        set_convolution_deterministic(conv_desc);
 
     WSBuffer ws(CONVOLUTION_WORKSPACE_SIZE);
     if (n == "HEURISTIC")
@@ -610,16 +989,32 @@ miopenConvBwdWeightsAlgorithm_t BackendMIOpen::get_bwd_filter_algorithm(
     }
     else if (n == "AUTOTUNE")
     {
-        return autotune_bwd_weights_algorithm(get_handle(),
-                                              input_desc,
-                                              input,
-                                              d_output_desc,
-                                              d_output,
-                                              conv_desc,
-                                              d_filter_desc,
-                                              d_filter,
-                                              ws,
-                                              ws_size);
+        auto const key = get_algo_cache_key(
+            key_prefix
+                + (deterministic ? "deterministic_bwd_filter" : "bwd_filter"),
+            input_desc, d_filter_desc, conv_desc, d_output_desc);
+        auto tune = [&](size_t ws_limit) {
+            auto const algo = autotune_bwd_weights_algorithm(get_handle(),
+                                                             input_desc,
+                                                             input,
+                                                             d_output_desc,
+                                                             d_output,
+                                                             conv_desc,
+                                                             d_filter_desc,
+                                                             d_filter,
+                                                             ws,
+                                                             ws_limit);
+            return ConvAlgoCache::Entry{
+                algo,
+                get_conv_bwd_filter_workspace_size(get_handle(),
+                                                   input_desc,
+                                                   d_output_desc,
+                                                   conv_desc,
+                                                   d_filter_desc,
+                                                   algo)};
+        };
+        return static_cast<miopenConvBwdWeightsAlgorithm_t>(
+            get_or_tune_algorithm(key, ws_size, tune));
     }
 
     util::MPIRootPrintStreamError()
@@ -2,8 +2,12 @@
 #include "distconv/distconv.hpp"
 #include "distconv/runtime_gpu.hpp"
 #include "distconv/tensor/algorithms_cuda.hpp"
+#include "distconv/util/launch_config.hpp"
+#include "distconv/util/overflow_gpu.hpp"
 #include "distconv/util/util_mpi.hpp"
 
+#include <algorithm>
+#include <initializer_list>
 #include <type_traits>
 
 #if H2_HAS_CUDA
@@ -126,7 +130,7 @@ void channel_sums_and_sqsums_opt(int num_samples,
         return;
 
     const int num_channels = input.get_local_shape()[get_channel_dim()];
-    constexpr int block_size = 256;
+    constexpr int block_size = util::reduce_block_size;
     dim3 block_dim(block_size);
     constexpr index_t thread_work_size = 8;
     constexpr auto block_work_size = block_size * thread_work_size;
@@ -210,7 +214,7 @@ void channel_sums_and_sqsums(int num_samples,
     }
 
     const int num_channels = input.get_local_shape()[get_channel_dim()];
-    constexpr int block_size = 256;
+    constexpr int block_size = util::reduce_block_size;
     dim3 block_dim(block_size);
     index_t channel_size = input.get_local_size() / num_channels / num_samples;
     dim3 grid_dim((channel_size + block_size - 1) / block_size, num_channels);
@@ -326,10 +330,381 @@ INSTANTIATE_SUMS_TO_STATISTICS(float)
 INSTANTIATE_SUMS_TO_STATISTICS(double)
 #undef INSTANTIATE_SUMS_TO_STATISTICS
 
+// Number of values, mean and sum of squared deviations from the mean
+// of a set of values, computed with Welford's algorithm and merged
+// pairwise. Unlike the sums of squares, they do not lose precision
+// when the variance is small relative to the mean.
+template <typename DataType>
+struct Moments {
+  index_t count;
+  DataType mean;
+  DataType m2;
+};
+
+template <typename DataType>
+__device__ inline Moments<DataType> merge_moments(const Moments<DataType> &a,
+                                                  const Moments<DataType> &b) {
+  const index_t count = a.count + b.count;
+  if (count == 0) {
+    return a;
+  }
+  const DataType d = b.mean - a.mean;
+  const DataType wb = DataType(b.count) / DataType(count);
+  Moments<DataType> m;
+  m.count = count;
+  m.mean = a.mean + d * wb;
+  m.m2 = a.m2 + b.m2 + d * d * DataType(a.count) * wb;
+  return m;
+}
+
+template <typename DataType>
+struct merge_moments_functor {
+  __device__ Moments<DataType> operator()(const Moments<DataType> &a,
+                                          const Moments<DataType> &b) const {
+    return merge_moments(a, b);
+  }
+};
+
+template <int ND, typename DataType, int BLOCK_SIZE>
+__global__ void channel_moments_kernel(
+    const DataType * __restrict__ input,
+    Moments<DataType> * __restrict__ partials,
+    tensor::Array<ND> shape, tensor::Array<ND> input_strides) {
+  const int tid = threadIdx.x;
+  const index_t gidx = threadIdx.x + blockIdx.x * blockDim.x;
+  const int ch_idx = blockIdx.y;
+  const int num_channels = shape[get_channel_dim()];
+  const int num_samples = shape[get_sample_dim()];
+
+  Moments<DataType> m = {0, DataType(0), DataType(0)};
+
+  const index_t channel_size = shape.get_size() / num_channels / num_samples;
+
+  if (gidx < channel_size) {
+    index_t offset = gidx;
+    index_t input_offset = 0;
+    for (int d = 0; d < ND -2; ++d) {
+      int idx = offset % shape[d];
+      input_offset += idx * input_strides[d];
+      offset /= shape[d];
+    }
+    input_offset += ch_idx * input_strides[-2];
+    for (int s = 0; s < num_samples; ++s) {
+      const DataType x = input[input_offset];
+      ++m.count;
+      const DataType d = x - m.mean;
+      m.mean += d / DataType(m.count);
+      m.m2 += d * (x - m.mean);
+
+      input_offset += input_strides[-1];
+    }
+  }
+
+  using BlockReduce = cubns::BlockReduce<Moments<DataType>, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  m = BlockReduce(temp_storage).Reduce(m, merge_moments_functor<DataType>());
+  if (tid == 0) {
+    partials[ch_idx * gridDim.x + blockIdx.x] = m;
+  }
+}
+
+template <typename DataType, int BLOCK_SIZE>
+__global__ void merge_channel_moments_kernel(
+    const Moments<DataType> * __restrict__ partials,
+    const int num_partials,
+    DataType * __restrict__ mean, DataType * __restrict__ m2) {
+  const int tid = threadIdx.x;
+  const int ch_idx = blockIdx.x;
+
+  Moments<DataType> m = {0, DataType(0), DataType(0)};
+  for (int i = tid; i < num_partials; i += BLOCK_SIZE) {
+    m = merge_moments(m, partials[ch_idx * num_partials + i]);
+  }
+
+  using BlockReduce = cubns::BlockReduce<Moments<DataType>, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  m = BlockReduce(temp_storage).Reduce(m, merge_moments_functor<DataType>());
+  if (tid == 0) {
+    mean[ch_idx] = m.mean;
+    m2[ch_idx] = m.m2;
+  }
+}
+
+template <int ND, typename Tensor>
+void channel_moments(int num_samples,
+                     const Tensor& input,
+                     Tensor& mean,
+                     Tensor& m2,
+                     h2::gpu::DeviceStream stream)
+{
+    using DataType = typename Tensor::data_type;
+    using MomentsType = Moments<DataType>;
+    // Clear GPU memory
+    h2::gpu::mem_zero(mean.get_buffer(), mean.get_local_pitched_size(), stream);
+    h2::gpu::mem_zero(m2.get_buffer(), m2.get_local_pitched_size(), stream);
+
+    // Do not contribute to the accumulation if the local tensor is not
+    // a split root.
+    if (input.get_local_size() == 0 || !input.is_split_root())
+        return;
+
+    const int num_channels = input.get_local_shape()[get_channel_dim()];
+    constexpr int block_size = util::reduce_block_size;
+    dim3 block_dim(block_size);
+    index_t channel_size = input.get_local_size() / num_channels / num_samples;
+    const int num_blocks_per_channel = util::ceil(channel_size,
+                                                  (index_t) block_size);
+    dim3 grid_dim(num_blocks_per_channel, num_channels);
+    auto input_strides = input.get_strides();
+    auto shape = input.get_local_shape();
+    shape[get_sample_dim()] = num_samples;
+    // CUDA grid dimension limitation
+    assert_always(num_channels < 65535);
+
+    auto& pool = internal::RuntimeGPU::get_device_memory_pool();
+    auto partials = static_cast<MomentsType*>(pool.get(
+        sizeof(MomentsType) * num_blocks_per_channel * num_channels, stream));
+    channel_moments_kernel<ND, DataType, block_size>
+        <<<grid_dim, block_dim, 0, stream>>>(input.get_const_base_ptr(),
+                                             partials,
+                                             shape,
+                                             input_strides);
+    merge_channel_moments_kernel<DataType, block_size>
+        <<<num_channels, block_dim, 0, stream>>>(partials,
+                                                 num_blocks_per_channel,
+                                                 mean.get_base_ptr(),
+                                                 m2.get_base_ptr());
+    pool.release(partials);
+}
+
+template <typename Tensor>
+void channel_moments(int num_dims,
+                     int num_samples,
+                     const Tensor& input,
+                     Tensor& mean,
+                     Tensor& m2,
+                     h2::gpu::DeviceStream stream)
+{
+    switch (num_dims)
+    {
+    case 4:
+      channel_moments<4, Tensor>(num_samples, input, mean, m2, stream);
+      break;
+    case 5:
+      channel_moments<5, Tensor>(num_samples, input, mean, m2, stream);
+      break;
+    }
+}
+
+#define INSTANTIATE_CHANNEL_MOMENTS(TYPE)                                      \
+    template void channel_moments<Tensor<TYPE>>(int num_dims,                  \
+                                                int num_samples,               \
+                                                const Tensor<TYPE>& input,     \
+                                                Tensor<TYPE>& mean,            \
+                                                Tensor<TYPE>& m2,              \
+                                                h2::gpu::DeviceStream stream);
+INSTANTIATE_CHANNEL_MOMENTS(float)
+INSTANTIATE_CHANNEL_MOMENTS(double)
+#undef INSTANTIATE_CHANNEL_MOMENTS
+
+template <typename DataType>
+__global__ void moments_to_sums_kernel(DataType * __restrict__ mean,
+                                       DataType * __restrict__ local_mean,
+                                       const index_t count,
+                                       const DataType num_per_sum) {
+  const index_t idx = threadIdx.x + blockIdx.x * blockDim.x;
+  if (idx < count) {
+    local_mean[idx] = mean[idx];
+    mean[idx] *= num_per_sum;
+  }
+}
+
+template <typename DataType>
+void moments_to_sums(index_t count,
+                     index_t num_per_sum,
+                     DataType* mean,
+                     DataType* local_mean,
+                     h2::gpu::DeviceStream stream)
+{
+    constexpr int block_size = util::block_size;
+    moments_to_sums_kernel<DataType>
+        <<<util::ceil(count, (index_t) block_size), block_size, 0, stream>>>(
+            mean, local_mean, count, DataType(num_per_sum));
+}
+
+template <typename DataType>
+__global__ void sums_to_moments_kernel(DataType * __restrict__ mean,
+                                       DataType * __restrict__ m2,
+                                       const DataType * __restrict__ local_mean,
+                                       const index_t count,
+                                       const DataType local_num_per_sum,
+                                       const DataType num_per_sum) {
+  const index_t idx = threadIdx.x + blockIdx.x * blockDim.x;
+  if (idx < count) {
+    const DataType m = mean[idx] / num_per_sum;
+    const DataType d = local_mean[idx] - m;
+    mean[idx] = m;
+    m2[idx] += local_num_per_sum * d * d;
+  }
+}
+
+template <typename DataType>
+void sums_to_moments(index_t count,
+                     index_t local_num_per_sum,
+                     index_t num_per_sum,
+                     DataType* mean,
+                     DataType* m2,
+                     const DataType* local_mean,
+                     h2::gpu::DeviceStream stream)
+{
+    if (num_per_sum == 0)
+        return;
+    constexpr int block_size = util::block_size;
+    sums_to_moments_kernel<DataType>
+        <<<util::ceil(count, (index_t) block_size), block_size, 0, stream>>>(
+            mean,
+            m2,
+            local_mean,
+            count,
+            DataType(local_num_per_sum),
+            DataType(num_per_sum));
+}
+
+#define INSTANTIATE_MOMENTS_SUMS(TYPE)                                         \
+    template void moments_to_sums<TYPE>(index_t count,                         \
+                                        index_t num_per_sum,                   \
+                                        TYPE * mean,                           \
+                                        TYPE * local_mean,                     \
+                                        h2::gpu::DeviceStream stream);         \
+    template void sums_to_moments<TYPE>(index_t count,                         \
+                                        index_t local_num_per_sum,             \
+                                        index_t num_per_sum,                   \
+                                        TYPE * mean,                           \
+                                        TYPE * m2,                             \
+                                        const TYPE* local_mean,                \
+                                        h2::gpu::DeviceStream stream);
+INSTANTIATE_MOMENTS_SUMS(float)
+INSTANTIATE_MOMENTS_SUMS(double)
+#undef INSTANTIATE_MOMENTS_SUMS
+
+template <typename DataType>
+struct moments_to_statistics_functor {
+  index_t m_num_per_sum;
+  DataType m_decay;
+  moments_to_statistics_functor(index_t num_per_sum, DataType decay):
+      m_num_per_sum(num_per_sum),
+      m_decay(decay) {}
+
+  __device__ void operator()(DataType &global_mean, DataType &global_var,
+                             DataType &running_mean, DataType &running_var) {
+    const DataType mean = global_mean;
+    const DataType var = global_var / (m_num_per_sum - DataType(1));
+    global_var = var;
+
+    running_mean = m_decay * running_mean + (DataType(1) - m_decay) * mean;
+    running_var = m_decay * running_var + (DataType(1) - m_decay) * var;
+  }
+};
+
+template <typename TensorType>
+void moments_to_statistics(index_t num_per_sum,
+                           typename TensorType::data_type decay,
+                           TensorType& global_mean,
+                           TensorType& global_var,
+                           TensorType& running_mean,
+                           TensorType& running_var,
+                           h2::gpu::DeviceStream stream)
+{
+    using DataType = typename TensorType::data_type;
+    if (num_per_sum > 0)
+    {
+        tensor::Transform(
+            global_mean,
+            global_var,
+            running_mean,
+            running_var,
+            moments_to_statistics_functor<DataType>(num_per_sum, decay),
+            stream);
+    }
+    else
+    {
+        // Same as sums_to_statistics
+        tensor::Transform(
+            global_var,
+            [] __device__(DataType & global_var) { global_var = DataType(1); },
+            stream);
+    }
+}
+
+#define INSTANTIATE_MOMENTS_TO_STATISTICS(TYPE)                                \
+    template void moments_to_statistics<Tensor<TYPE>>(                         \
+        index_t num_per_sum,                                                   \
+        TYPE decay,                                                            \
+        Tensor<TYPE> & global_mean,                                            \
+        Tensor<TYPE> & global_var,                                             \
+        Tensor<TYPE> & running_mean,                                           \
+        Tensor<TYPE> & running_var,                                            \
+        h2::gpu::DeviceStream stream);
+INSTANTIATE_MOMENTS_TO_STATISTICS(float)
+INSTANTIATE_MOMENTS_TO_STATISTICS(double)
+#undef INSTANTIATE_MOMENTS_TO_STATISTICS
+
 __device__ inline float rsqrt(float x) {
   return rsqrtf(x);
 }
 
+// ReLU fused into the kernels writing the normalized output
+template <typename DataType, typename T>
+__device__ __forceinline__ T apply_relu(T y) {
+  if constexpr (util::IsVectorType<T>::value) {
+    return util::max(y, util::make_vector<DataType, T>(DataType(0)));
+  } else {
+    return y > DataType(0) ? y : DataType(0);
+  }
+}
+
+// Gradient dy of the fused ReLU output, masked by the normalized
+// output y before the ReLU
+template <typename DataType, typename T>
+__device__ __forceinline__ T apply_relu_backward(T dy, T y) {
+  if constexpr (util::IsVectorType<T>::value) {
+    static_assert(util::GetVectorWidth<T>::width == 4,
+                  "Only vectors of width 4 are used");
+    return util::make_vector<DataType, T>(
+        y.x > DataType(0) ? dy.x : DataType(0),
+        y.y > DataType(0) ? dy.y : DataType(0),
+        y.z > DataType(0) ? dy.z : DataType(0),
+        y.w > DataType(0) ? dy.w : DataType(0));
+  } else {
+    return y > DataType(0) ? dy : DataType(0);
+  }
+}
+
+// Whether only the outermost spatial dimension of the tensors has
+// halos, so that the interior of each channel of a sample is
+// contiguous
+template <int ND, typename TensorType>
+bool has_contiguous_planes(std::initializer_list<const TensorType*> tensors)
+{
+    for (const auto* t : tensors)
+    {
+        const auto overlap = t->get_overlap();
+        for (int i = 0; i < ND - 3; ++i)
+        {
+            if (overlap[i] != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Whether the halos before each plane keep the vectors aligned
+inline bool is_halo_vector_aligned(index_t spatial_size,
+                                   index_t spatial_real_size)
+{
+    return ((spatial_real_size - spatial_size) / 2) % 4 == 0;
+}
+
 template <int ND, typename DataType>
 void __global__ batch_normalization_kernel(
     const DataType * __restrict__ input,
@@ -337,7 +712,7 @@ void __global__ batch_normalization_kernel(
     const DataType * __restrict__ global_var,
     const DataType * __restrict__ global_scale,
     const DataType * __restrict__ global_bias,
-    DataType * __restrict__ output, DataType epsilon,
+    DataType * __restrict__ output, DataType epsilon, bool relu,
     tensor::Array<ND> shape, tensor::Array<ND> input_strides,
     tensor::Array<ND> output_strides) {
   const int ch_idx = blockIdx.y;
@@ -367,6 +742,7 @@ void __global__ batch_normalization_kernel(
       const DataType x = input[input_offset];
       DataType xhat = (x - mean) * inv_stdev;
       DataType y = scale * xhat + bias;
+      if (relu) y = apply_relu<DataType>(y);
       output[output_offset] = y;
 
       input_offset += input_strides[-1];
@@ -384,7 +760,10 @@ void __global__ batch_normalization_opt_kernel(
     const DataType * __restrict__ global_bias,
     DataTypeV * __restrict__ output,
     DataType epsilon,
+    bool relu,
     index_t spatial_size,
+    index_t input_spatial_real_size,
+    index_t output_spatial_real_size,
     int num_channels) {
   const auto ch_idx = blockIdx.y;
   const auto sample_idx = blockIdx.z;
@@ -396,15 +775,16 @@ void __global__ batch_normalization_opt_kernel(
 
   const auto num_threads_per_channel = blockDim.x * gridDim.x;
 
-  auto block_offset = (ch_idx + sample_idx * num_channels) * spatial_size;
-  input += block_offset;
-  output += block_offset;
+  const auto plane_idx = ch_idx + sample_idx * num_channels;
+  input += plane_idx * input_spatial_real_size;
+  output += plane_idx * output_spatial_real_size;
 
   for (index_t idx = threadIdx.x + blockIdx.x * blockDim.x;
        idx < spatial_size; idx += num_threads_per_channel) {
     auto x = input[idx];
     auto xhat = (x - mean) * inv_stdev;
     auto y = xhat * scale + bias;
+    if (relu) y = apply_relu<DataType>(y);
     output[idx] = y;
   }
 }
@@ -418,6 +798,7 @@ void batch_normalization_opt(int num_samples,
                              const TensorType& bias,
                              TensorType& output,
                              typename TensorType::data_type epsilon,
+                             bool relu,
                              h2::gpu::DeviceStream stream)
 {
     using DataType = typename TensorType::data_type;
@@ -426,27 +807,40 @@ void batch_normalization_opt(int num_samples,
         return;
     assert_eq(num_samples, (int) input.get_local_shape()[get_sample_dim()]);
     const int num_channels = input.get_local_shape()[get_channel_dim()];
-    constexpr int block_size = 256;
+    constexpr int block_size = util::block_size;
     dim3 block_dim(block_size);
     index_t channel_size = input.get_local_size() / num_channels / num_samples;
+    // The output may have halos, e.g., when it is the input of the
+    // next convolution, in which case only its interior is written
+    index_t i_channel_real_size =
+        input.get_local_real_size() / num_channels / num_samples;
+    index_t o_channel_real_size =
+        output.get_local_real_size() / num_channels / num_samples;
     constexpr index_t thread_work_size = 8;
     constexpr auto block_work_size = block_size * thread_work_size;
-    if (channel_size % 4 == 0)
+    if (channel_size % 4 == 0
+        && is_halo_vector_aligned(channel_size, i_channel_real_size)
+        && is_halo_vector_aligned(channel_size, o_channel_real_size))
     {
         channel_size /= 4;
+        i_channel_real_size /= 4;
+        o_channel_real_size /= 4;
         auto num_blocks_per_channel = util::ceil(channel_size, block_work_size);
         dim3 grid_dim(num_blocks_per_channel, num_channels, num_samples);
         using DataTypeV = typename util::GetVectorType<DataType, 4>::type;
         batch_normalization_opt_kernel<ND, DataType, DataTypeV>
             <<<grid_dim, block_dim, 0, stream>>>(
-                reinterpret_cast<const DataTypeV*>(input.get_const_buffer()),
+                reinterpret_cast<const DataTypeV*>(input.get_const_base_ptr()),
                 mean.get_const_base_ptr(),
                 var.get_const_base_ptr(),
                 scale.get_const_base_ptr(),
                 bias.get_const_base_ptr(),
-                reinterpret_cast<DataTypeV*>(output.get_buffer()),
+                reinterpret_cast<DataTypeV*>(output.get_base_ptr()),
                 epsilon,
+                relu,
                 channel_size,
+                i_channel_real_size,
+                o_channel_real_size,
                 num_channels);
     }
     else
@@ -454,14 +848,17 @@ void batch_normalization_opt(int num_samples,
         auto num_blocks_per_channel = util::ceil(channel_size, block_work_size);
         dim3 grid_dim(num_blocks_per_channel, num_channels, num_samples);
         batch_normalization_opt_kernel<ND, DataType, DataType>
-            <<<grid_dim, block_dim, 0, stream>>>(input.get_const_buffer(),
+            <<<grid_dim, block_dim, 0, stream>>>(input.get_const_base_ptr(),
                                                  mean.get_const_base_ptr(),
                                                  var.get_const_base_ptr(),
                                                  scale.get_const_base_ptr(),
                                                  bias.get_const_base_ptr(),
-                                                 output.get_buffer(),
+                                                 output.get_base_ptr(),
                                                  epsilon,
+                                                 relu,
                                                  channel_size,
+                                                 i_channel_real_size,
+                                                 o_channel_real_size,
                                                  num_channels);
     }
 }
@@ -475,11 +872,12 @@ void batch_normalization(int num_samples,
                          const TensorType& bias,
                          TensorType& output,
                          typename TensorType::data_type epsilon,
+                         bool relu,
                          h2::gpu::DeviceStream stream)
 {
     using DataType = typename TensorType::data_type;
 
-    if (input.get_local_real_shape() == output.get_local_real_shape())
+    if (has_contiguous_planes<ND, TensorType>({&input, &output}))
     {
         if (std::getenv("DISTCONV_DISABLE_BN_OPT"))
         {
@@ -495,6 +893,7 @@ void batch_normalization(int num_samples,
                                                     bias,
                                                     output,
                                                     epsilon,
+                                                    relu,
                                                     stream);
             return;
         }
@@ -505,7 +904,7 @@ void batch_normalization(int num_samples,
         return;
     assert_eq(num_samples, (int) input.get_local_shape()[get_sample_dim()]);
     const int num_channels = input.get_local_shape()[get_channel_dim()];
-    constexpr int block_size = 256;
+    constexpr int block_size = util::block_size;
     dim3 block_dim(block_size);
     index_t channel_size = input.get_local_size() / num_channels / num_samples;
     dim3 grid_dim((channel_size + block_size - 1) / block_size, num_channels);
@@ -522,6 +921,7 @@ void batch_normalization(int num_samples,
         bias.get_const_base_ptr(),
         output.get_base_ptr(),
         epsilon,
+        relu,
         shape,
         input_strides,
         output_strides);
@@ -537,6 +937,7 @@ void batch_normalization(int num_dims,
                          const TensorType& bias,
                          TensorType& output,
                          typename TensorType::data_type epsilon,
+                         bool relu,
                          h2::gpu::DeviceStream stream)
 {
     switch (num_dims)
@@ -544,12 +945,12 @@ void batch_normalization(int num_dims,
     case 4:
       batch_normalization<4, TensorType>(
           num_samples, input, mean, var,
-          scale, bias, output, epsilon, stream);
+          scale, bias, output, epsilon, relu, stream);
       break;
     case 5:
       batch_normalization<5, TensorType>(
           num_samples, input, mean, var,
-          scale, bias, output, epsilon, stream);
+          scale, bias, output, epsilon, relu, stream);
       break;
     }
 }
@@ -565,11 +966,362 @@ void batch_normalization(int num_dims,
         const Tensor<TYPE>& bias,                                              \
         Tensor<TYPE>& output,                                                  \
         TYPE epsilon,                                                          \
+        bool relu,                                                             \
         h2::gpu::DeviceStream stream);
 INSTANTIATE_BATCH_NORMALIZATION(float)
 INSTANTIATE_BATCH_NORMALIZATION(double)
 #undef INSTANTIATE_BATCH_NORMALIZATION
 
+// The running statistics are folded with the scale and the bias into
+// a per-channel factor and shift, so each element takes a single
+// multiply-add
+template <typename DataType, typename DataTypeV>
+void __global__ batch_normalization_inference_kernel(
+    const DataTypeV * __restrict__ input,
+    const DataType * __restrict__ running_mean,
+    const DataType * __restrict__ running_var,
+    const DataType * __restrict__ global_scale,
+    const DataType * __restrict__ global_bias,
+    DataTypeV * __restrict__ output,
+    DataType epsilon,
+    bool relu,
+    index_t spatial_size,
+    index_t input_spatial_real_size,
+    index_t output_spatial_real_size,
+    int num_channels) {
+  const auto ch_idx = blockIdx.y;
+  const auto sample_idx = blockIdx.z;
+  const DataType factor =
+      global_scale[ch_idx] * rsqrt(running_var[ch_idx] + epsilon);
+  const DataType shift = global_bias[ch_idx] - running_mean[ch_idx] * factor;
+
+  const auto num_threads_per_channel = blockDim.x * gridDim.x;
+
+  const auto plane_idx = ch_idx + sample_idx * num_channels;
+  input += plane_idx * input_spatial_real_size;
+  output += plane_idx * output_spatial_real_size;
+
+  for (index_t idx = threadIdx.x + blockIdx.x * blockDim.x;
+       idx < spatial_size; idx += num_threads_per_channel) {
+    auto y = input[idx] * factor + shift;
+    if (relu) y = apply_relu<DataType>(y);
+    output[idx] = y;
+  }
+}
+
+template <int ND, typename TensorType>
+void batch_normalization_inference(int num_samples,
+                                   const TensorType& input,
+                                   const TensorType& running_mean,
+                                   const TensorType& running_var,
+                                   const TensorType& scale,
+                                   const TensorType& bias,
+                                   TensorType& output,
+                                   typename TensorType::data_type epsilon,
+                                   bool relu,
+                                   h2::gpu::DeviceStream stream)
+{
+    using DataType = typename TensorType::data_type;
+    if (!has_contiguous_planes<ND, TensorType>({&input, &output})
+        || std::getenv("DISTCONV_DISABLE_BN_OPT"))
+    {
+        batch_normalization<ND, TensorType>(num_samples,
+                                            input,
+                                            running_mean,
+                                            running_var,
+                                            scale,
+                                            bias,
+                                            output,
+                                            epsilon,
+                                            relu,
+                                            stream);
+        return;
+    }
+    // local tensors can be empty
+    if (output.get_local_size() == 0)
+        return;
+    assert_eq(num_samples, (int) input.get_local_shape()[get_sample_dim()]);
+    const int num_channels = input.get_local_shape()[get_channel_dim()];
+    constexpr int block_size = util::block_size;
+    constexpr index_t thread_work_size = 8;
+    constexpr auto block_work_size = block_size * thread_work_size;
+    index_t channel_size = input.get_local_size() / num_channels / num_samples;
+    index_t i_channel_real_size =
+        input.get_local_real_size() / num_channels / num_samples;
+    index_t o_channel_real_size =
+        output.get_local_real_size() / num_channels / num_samples;
+    auto launch = [&](auto v) {
+        using DataTypeV = decltype(v);
+        constexpr int width = sizeof(DataTypeV) / sizeof(DataType);
+        const index_t size = channel_size / width;
+        dim3 grid_dim(util::ceil(size, block_work_size),
+                      num_channels,
+                      num_samples);
+        batch_normalization_inference_kernel<DataType, DataTypeV>
+            <<<grid_dim, block_size, 0, stream>>>(
+                reinterpret_cast<const DataTypeV*>(input.get_const_base_ptr()),
+                running_mean.get_const_base_ptr(),
+                running_var.get_const_base_ptr(),
+                scale.get_const_base_ptr(),
+                bias.get_const_base_ptr(),
+                reinterpret_cast<DataTypeV*>(output.get_base_ptr()),
+                epsilon,
+                relu,
+                size,
+                i_channel_real_size / width,
+                o_channel_real_size / width,
+                num_channels);
+    };
+    if (channel_size % 4 == 0
+        && is_halo_vector_aligned(channel_size, i_channel_real_size)
+        && is_halo_vector_aligned(channel_size, o_channel_real_size))
+    {
+        launch(typename util::GetVectorType<DataType, 4>::type());
+    }
+    else
+    {
+        launch(DataType());
+    }
+}
+
+template <typename TensorType>
+void batch_normalization_inference(int num_dims,
+                                   int num_samples,
+                                   const TensorType& input,
+                                   const TensorType& running_mean,
+                                   const TensorType& running_var,
+                                   const TensorType& scale,
+                                   const TensorType& bias,
+                                   TensorType& output,
+                                   typename TensorType::data_type epsilon,
+                                   bool relu,
+                                   h2::gpu::DeviceStream stream)
+{
+    switch (num_dims)
+    {
+    case 4:
+      batch_normalization_inference<4, TensorType>(
+          num_samples, input, running_mean, running_var,
+          scale, bias, output, epsilon, relu, stream);
+      break;
+    case 5:
+      batch_normalization_inference<5, TensorType>(
+          num_samples, input, running_mean, running_var,
+          scale, bias, output, epsilon, relu, stream);
+      break;
+    }
+}
+
+#define INSTANTIATE_BATCH_NORMALIZATION_INFERENCE(TYPE)                        \
+    template void batch_normalization_inference<Tensor<TYPE>>(                 \
+        int num_dims,                                                          \
+        int num_samples,                                                       \
+        const Tensor<TYPE>& input,                                             \
+        const Tensor<TYPE>& running_mean,                                      \
+        const Tensor<TYPE>& running_var,                                       \
+        const Tensor<TYPE>& scale,                                             \
+        const Tensor<TYPE>& bias,                                              \
+        Tensor<TYPE>& output,                                                  \
+        TYPE epsilon,                                                          \
+        bool relu,                                                             \
+        h2::gpu::DeviceStream stream);
+INSTANTIATE_BATCH_NORMALIZATION_INFERENCE(float)
+INSTANTIATE_BATCH_NORMALIZATION_INFERENCE(double)
+#undef INSTANTIATE_BATCH_NORMALIZATION_INFERENCE
+
+// Computes the statistics and normalizes each channel with a single
+// block. Used when the statistics are not reduced across processes,
+// so no host-side synchronization is needed between the two. The
+// second read of the input is mostly served from L2 when the channel
+// is small.
+template <int ND, typename DataType, typename DataTypeV, int BLOCK_SIZE>
+__global__ void forward_local_kernel(const DataTypeV * __restrict__ input,
+                                     DataType * __restrict__ mean,
+                                     DataType * __restrict__ var,
+                                     DataType * __restrict__ running_mean,
+                                     DataType * __restrict__ running_var,
+                                     const DataType * __restrict__ scale,
+                                     const DataType * __restrict__ bias,
+                                     DataTypeV * __restrict__ output,
+                                     DataType decay, DataType epsilon,
+                                     const bool relu,
+                                     const int num_samples,
+                                     const int num_channels,
+                                     const index_t spatial_size,
+                                     const index_t num_per_sum) {
+  const int tid = threadIdx.x;
+  const int ch_idx = blockIdx.x;
+  const auto sample_offset = spatial_size * num_channels;
+
+  auto sum = DataType(0);
+  auto sqsum = DataType(0);
+  index_t offset = spatial_size * ch_idx;
+  for (int s = 0; s < num_samples; ++s) {
+    for (index_t i = tid; i < spatial_size; i += BLOCK_SIZE) {
+      const auto x = input[offset + i];
+      sum += util::sum(x);
+      sqsum += util::sum(x * x);
+    }
+    offset += sample_offset;
+  }
+
+  using BlockReduce = cubns::BlockReduce<DataType, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage_sum;
+  __shared__ typename BlockReduce::TempStorage temp_storage_sqsum;
+  __shared__ DataType shared_stat[2];
+  sum = BlockReduce(temp_storage_sum).Sum(sum);
+  sqsum = BlockReduce(temp_storage_sqsum).Sum(sqsum);
+  if (tid == 0) {
+    sums_to_statistics_functor<DataType>(num_per_sum, decay)(
+        sum, sqsum, running_mean[ch_idx], running_var[ch_idx]);
+    mean[ch_idx] = sum;
+    var[ch_idx] = sqsum;
+    shared_stat[0] = sum;
+    shared_stat[1] = rsqrt(sqsum + epsilon);
+  }
+  __syncthreads();
+  const auto ch_mean = shared_stat[0];
+  const auto inv_stdev = shared_stat[1];
+  const auto scale_ch = scale[ch_idx];
+  const auto bias_ch = bias[ch_idx];
+
+  offset = spatial_size * ch_idx;
+  for (int s = 0; s < num_samples; ++s) {
+    for (index_t i = tid; i < spatial_size; i += BLOCK_SIZE) {
+      const auto idx = offset + i;
+      const auto x = input[idx];
+      auto xhat = (x - ch_mean) * inv_stdev;
+      auto y = xhat * scale_ch + bias_ch;
+      if (relu) y = apply_relu<DataType>(y);
+      output[idx] = y;
+    }
+    offset += sample_offset;
+  }
+}
+
+template <int ND, typename Tensor>
+void forward_local(const Tensor& input,
+                   Tensor& mean,
+                   Tensor& var,
+                   Tensor& running_mean,
+                   Tensor& running_var,
+                   const Tensor& scale,
+                   const Tensor& bias,
+                   Tensor& output,
+                   typename Tensor::data_type decay,
+                   typename Tensor::data_type epsilon,
+                   bool relu,
+                   h2::gpu::DeviceStream stream)
+{
+    using DataType = typename Tensor::data_type;
+
+    // local tensors can be empty
+    if (input.get_local_size() == 0)
+        return;
+
+    const auto shape = input.get_local_shape();
+    const int num_samples = shape[get_sample_dim()];
+    const int num_channels = shape[get_channel_dim()];
+    index_t spatial_size = input.get_local_size() / num_channels / num_samples;
+    const index_t num_per_sum = spatial_size * num_samples;
+
+    constexpr int block_size = util::max_reduce_block_size;
+    dim3 block_dim(block_size);
+    dim3 grid_dim(num_channels);
+    // CUDA grid dimension limitation
+    assert_always(grid_dim.x < 65535);
+
+    if (spatial_size % 4 == 0)
+    {
+        spatial_size /= 4;
+        using DataTypeV = typename util::GetVectorType<DataType, 4>::type;
+        forward_local_kernel<ND, DataType, DataTypeV, block_size>
+            <<<grid_dim, block_dim, 0, stream>>>(
+                reinterpret_cast<const DataTypeV*>(input.get_const_buffer()),
+                mean.get_base_ptr(),
+                var.get_base_ptr(),
+                running_mean.get_base_ptr(),
+                running_var.get_base_ptr(),
+                scale.get_const_base_ptr(),
+                bias.get_const_base_ptr(),
+                reinterpret_cast<DataTypeV*>(output.get_buffer()),
+                decay,
+                epsilon,
+                relu,
+                num_samples,
+                num_channels,
+                spatial_size,
+                num_per_sum);
+    }
+    else
+    {
+        forward_local_kernel<ND, DataType, DataType, block_size>
+            <<<grid_dim, block_dim, 0, stream>>>(input.get_const_buffer(),
+                                                 mean.get_base_ptr(),
+                                                 var.get_base_ptr(),
+                                                 running_mean.get_base_ptr(),
+                                                 running_var.get_base_ptr(),
+                                                 scale.get_const_base_ptr(),
+                                                 bias.get_const_base_ptr(),
+                                                 output.get_buffer(),
+                                                 decay,
+                                                 epsilon,
+                                                 relu,
+                                                 num_samples,
+                                                 num_channels,
+                                                 spatial_size,
+                                                 num_per_sum);
+    }
+}
+
+template <typename Tensor>
+void forward_local(int num_dims,
+                   const Tensor& input,
+                   Tensor& mean,
+                   Tensor& var,
+                   Tensor& running_mean,
+                   Tensor& running_var,
+                   const Tensor& scale,
+                   const Tensor& bias,
+                   Tensor& output,
+                   typename Tensor::data_type decay,
+                   typename Tensor::data_type epsilon,
+                   bool relu,
+                   h2::gpu::DeviceStream stream)
+{
+    switch (num_dims)
+    {
+    case 4:
+      forward_local<4, Tensor>(input, mean, var, running_mean, running_var,
+                               scale, bias, output, decay, epsilon, relu,
+                               stream);
+      break;
+    case 5:
+      forward_local<5, Tensor>(input, mean, var, running_mean, running_var,
+                               scale, bias, output, decay, epsilon, relu,
+                               stream);
+      break;
+    }
+}
+
+#define INSTANTIATE_FORWARD_LOCAL(TYPE)                                        \
+    template void forward_local<Tensor<TYPE>>(int num_dims,                    \
+                                              const Tensor<TYPE>& input,       \
+                                              Tensor<TYPE>& mean,              \
+                                              Tensor<TYPE>& var,               \
+                                              Tensor<TYPE>& running_mean,      \
+                                              Tensor<TYPE>& running_var,       \
+                                              const Tensor<TYPE>& scale,       \
+                                              const Tensor<TYPE>& bias,        \
+                                              Tensor<TYPE>& output,            \
+                                              TYPE decay,                      \
+                                              TYPE epsilon,                    \
+                                              bool relu,                       \
+                                              h2::gpu::DeviceStream stream);
+INSTANTIATE_FORWARD_LOCAL(float)
+INSTANTIATE_FORWARD_LOCAL(double)
+#undef INSTANTIATE_FORWARD_LOCAL
+
 #ifdef DISTCONV_HAS_NVSHMEM
 template <int ND, typename DataType, typename DataType2,
           typename DataTypeV, int BLOCK_SIZE>
@@ -586,7 +1338,7 @@ __global__ void forward_all_kernel(const DataTypeV * __restrict__ input,
                                    const int spatial_real_size,
                                    const size_t num_per_sum,
                                    AllreduceNVSHMEMDevice<DataType2> ar) {
-  __shared__ DataType2 shared_stat[BLOCK_SIZE];
+  __shared__ DataType2 shared_stat;
   const int tid = threadIdx.x;
   const int bid = blockIdx.x;
   const auto sample_offset = spatial_real_size * channel_size;
@@ -603,18 +1355,8 @@ __global__ void forward_all_kernel(const DataTypeV * __restrict__ input,
     offset += sample_offset;
   }
 
-  shared_stat[tid] = stat;
-
-  // Compute channel sum with shared memory reduction
-#pragma unroll
-  for(int stride = BLOCK_SIZE / 2; stride > 0; stride /= 2) {
-    __syncthreads();
-    if(tid < stride) {
-      shared_stat[tid] += shared_stat[tid + stride];
-    }
-  }
-
-  stat = shared_stat[0];
+  // Compute channel sum with warp shuffles
+  stat = util::block_reduce_sum<BLOCK_SIZE>(stat);
 
   // Output channel sum to global memory
   const int ch_idx = blockIdx.x;
@@ -631,10 +1373,10 @@ __global__ void forward_all_kernel(const DataTypeV * __restrict__ input,
     running_var[ch_idx] = decay * running_var[ch_idx] + (DataType(1) - decay) * stat.y;
 
     stat.y = rsqrt(stat.y + epsilon);
-    shared_stat[0] = stat;
+    shared_stat = stat;
   }
   __syncthreads();
-  stat = shared_stat[0];
+  stat = shared_stat;
 
   // fuse the batch_normalization kernel here
   const auto scale_ch = scale[ch_idx];
@@ -693,7 +1435,7 @@ void forward_all(const Tensor& input,
         assert_eq(overlap[1], 0);
     }
 
-    constexpr int block_size = 1024;
+    constexpr int block_size = util::max_reduce_block_size;
     dim3 block_dim(block_size);
     dim3 grid_dim(num_channels);
     // CUDA grid dimension limitation
@@ -801,6 +1543,7 @@ void __global__ backprop1_kernel(const DataType * __restrict__ input,
                                  const DataType * __restrict__ global_mean,
                                  const DataType * __restrict__ global_var,
                                  const DataType * __restrict__ global_scale,
+                                 const DataType * __restrict__ global_bias,
                                  DataType * __restrict__ global_dscale,
                                  DataType * __restrict__ global_dbias,
                                  DataType * __restrict__ global_dmean,
@@ -817,6 +1560,9 @@ void __global__ backprop1_kernel(const DataType * __restrict__ input,
   const DataType mean = global_mean[ch_idx];
   const DataType var = global_var[ch_idx];
   const DataType scale = global_scale[ch_idx];
+  // The bias is given when the output went through a fused ReLU
+  const bool relu = global_bias != nullptr;
+  const DataType bias = relu ? global_bias[ch_idx] : DataType(0);
   const DataType inv_stdev = rsqrt(var + epsilon);
   const DataType dvar_factor = inv_stdev * inv_stdev * inv_stdev / 2;
 
@@ -841,7 +1587,8 @@ void __global__ backprop1_kernel(const DataType * __restrict__ input,
     for (int sample_idx = 0; sample_idx < num_samples; ++sample_idx) {
       const DataType x = input[input_offset];
       const DataType xhat = (x - mean) * inv_stdev;
-      const DataType dy = d_output[d_output_offset];
+      DataType dy = d_output[d_output_offset];
+      if (relu) dy = apply_relu_backward<DataType>(dy, scale * xhat + bias);
       dscale += dy * xhat;
       dbias += dy;
       const DataType dxhat = dy * scale;
@@ -878,25 +1625,29 @@ void __global__ backprop1_opt_kernel(const DataTypeV * __restrict__ input,
                                      const DataType * __restrict__ global_mean,
                                      const DataType * __restrict__ global_var,
                                      const DataType * __restrict__ global_scale,
-                                     DataType * __restrict__ global_dscale,
-                                     DataType * __restrict__ global_dbias,
-                                     DataType * __restrict__ global_dmean,
-                                     DataType * __restrict__ global_dvar,
+                                     const DataType * __restrict__ global_bias,
+                                     DataType * __restrict__ partials,
                                      DataType epsilon,
                                      const int num_channels,
                                      const int num_samples,
+                                     const int num_samples_per_block,
                                      const index_t spatial_size,
                                      const index_t input_spatial_real_size,
                                      const index_t output_spatial_real_size) {
   const int tid = threadIdx.x;
   const index_t idx = threadIdx.x + blockIdx.x * blockDim.x;
   const int ch_idx = blockIdx.y;
+  const int sample_begin = blockIdx.z * num_samples_per_block;
+  const int sample_end = min(sample_begin + num_samples_per_block,
+                             num_samples);
   const auto i_sample_offset = input_spatial_real_size * num_channels;
   const auto o_sample_offset = output_spatial_real_size * num_channels;
 
   const auto mean = global_mean[ch_idx];
   const auto var = global_var[ch_idx];
   const auto scale = global_scale[ch_idx];
+  const bool relu = global_bias != nullptr;
+  const auto bias = relu ? global_bias[ch_idx] : DataType(0);
   const auto inv_stdev = rsqrt(var + epsilon);
   const auto dvar_factor = inv_stdev * inv_stdev * inv_stdev / 2;
 
@@ -905,14 +1656,17 @@ void __global__ backprop1_opt_kernel(const DataTypeV * __restrict__ input,
   DataType dmean = DataType(0);
   DataType dvar = DataType(0);
 
-  index_t i_offset = input_spatial_real_size * ch_idx;
-  index_t o_offset = output_spatial_real_size * ch_idx;
+  index_t i_offset = input_spatial_real_size * ch_idx
+      + i_sample_offset * sample_begin;
+  index_t o_offset = output_spatial_real_size * ch_idx
+      + o_sample_offset * sample_begin;
 
-  for (int s = 0; s < num_samples; ++s) {
+  for (int s = sample_begin; s < sample_end; ++s) {
     for (auto i = idx; i < spatial_size; i += BLOCK_SIZE * gridDim.x) {
       const auto x = input[i_offset + i];
       const auto xhat = (x - mean) * inv_stdev;
-      const auto dy = d_output[o_offset + i];
+      auto dy = d_output[o_offset + i];
+      if (relu) dy = apply_relu_backward<DataType>(dy, xhat * scale + bias);
       dscale += util::sum(dy * xhat);
       dbias += util::sum(dy);
       const auto dxhat = dy * scale;
@@ -933,12 +1687,61 @@ void __global__ backprop1_opt_kernel(const DataTypeV * __restrict__ input,
   dmean = BlockReduce(temp_storage_mean).Sum(dmean);
   dvar = BlockReduce(temp_storage_var).Sum(dvar);
 
-  // Output channel sum to global memory
+  // Output the partial sums of this block to global memory. They are
+  // summed up by reduce_backprop1_partials_kernel.
   if (tid == 0) {
-    atomic_add(&global_dscale[ch_idx], dscale);
-    atomic_add(&global_dbias[ch_idx], dbias);
-    atomic_add(&global_dmean[ch_idx], dmean);
-    atomic_add(&global_dvar[ch_idx], dvar);
+    const int num_partials = gridDim.x * gridDim.z;
+    const int partial_idx = blockIdx.x + blockIdx.z * gridDim.x;
+    const auto stride = num_partials * num_channels;
+    auto p = partials + ch_idx * num_partials + partial_idx;
+    p[0] = dscale;
+    p[stride] = dbias;
+    p[stride * 2] = dmean;
+    p[stride * 3] = dvar;
+  }
+}
+
+// Sums up the partial sums of each channel with one block per channel
+template <typename DataType, int BLOCK_SIZE>
+void __global__ reduce_backprop1_partials_kernel(
+    const DataType * __restrict__ partials,
+    DataType * __restrict__ global_dscale,
+    DataType * __restrict__ global_dbias,
+    DataType * __restrict__ global_dmean,
+    DataType * __restrict__ global_dvar,
+    const int num_channels,
+    const int num_partials) {
+  const int tid = threadIdx.x;
+  const int ch_idx = blockIdx.x;
+  const auto stride = num_partials * num_channels;
+  partials += ch_idx * num_partials;
+
+  DataType dscale = DataType(0);
+  DataType dbias = DataType(0);
+  DataType dmean = DataType(0);
+  DataType dvar = DataType(0);
+  for (int i = tid; i < num_partials; i += BLOCK_SIZE) {
+    dscale += partials[i];
+    dbias += partials[stride + i];
+    dmean += partials[stride * 2 + i];
+    dvar += partials[stride * 3 + i];
+  }
+
+  using BlockReduce = cubns::BlockReduce<DataType, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage_scale;
+  __shared__ typename BlockReduce::TempStorage temp_storage_bias;
+  __shared__ typename BlockReduce::TempStorage temp_storage_mean;
+  __shared__ typename BlockReduce::TempStorage temp_storage_var;
+  dscale = BlockReduce(temp_storage_scale).Sum(dscale);
+  dbias = BlockReduce(temp_storage_bias).Sum(dbias);
+  dmean = BlockReduce(temp_storage_mean).Sum(dmean);
+  dvar = BlockReduce(temp_storage_var).Sum(dvar);
+
+  if (tid == 0) {
+    global_dscale[ch_idx] = dscale;
+    global_dbias[ch_idx] = dbias;
+    global_dmean[ch_idx] = dmean;
+    global_dvar[ch_idx] = dvar;
   }
 }
 
@@ -954,14 +1757,19 @@ void backprop1_opt(int num_samples,
                    TensorType& mean_gradient,
                    TensorType& var_gradient,
                    typename TensorType::data_type epsilon,
+                   const TensorType* relu_bias,
                    h2::gpu::DeviceStream stream)
 {
     using DataType = typename TensorType::data_type;
     const int num_channels = input.get_local_shape()[get_channel_dim()];
-    constexpr int block_size = 256;
+    constexpr int block_size = util::reduce_block_size;
     dim3 block_dim(block_size);
     constexpr index_t thread_work_size = 8;
     constexpr auto block_work_size = block_size * thread_work_size;
+    // Samples are also split across blocks when there are not this
+    // many blocks otherwise, e.g., with few channels of small spatial
+    // size
+    constexpr index_t min_num_blocks = 1024;
     index_t spatial_size = input.get_local_size() / num_channels / num_samples;
     index_t i_spatial_real_size =
         input.get_local_real_size() / num_channels / num_samples;
@@ -969,16 +1777,38 @@ void backprop1_opt(int num_samples,
         d_output.get_local_real_size() / num_channels / num_samples;
     // halo size must be also divisible by a vector width for an
     // alignment requirement
-    if (spatial_size % 4 == 0
-        && ((i_spatial_real_size - spatial_size) / 2) % 4 == 0
-        && ((o_spatial_real_size - spatial_size) / 2) % 4 == 0)
+    const bool vectorized =
+        spatial_size % 4 == 0
+        && is_halo_vector_aligned(spatial_size, i_spatial_real_size)
+        && is_halo_vector_aligned(spatial_size, o_spatial_real_size);
+    if (vectorized)
     {
-        using DataTypeV = typename util::GetVectorType<DataType, 4>::type;
         spatial_size /= 4;
         i_spatial_real_size /= 4;
         o_spatial_real_size /= 4;
-        auto num_blocks_per_channel = util::ceil(spatial_size, block_work_size);
-        dim3 grid_dim(num_blocks_per_channel, num_channels);
+    }
+    const index_t num_blocks_per_channel =
+        util::ceil(spatial_size, block_work_size);
+    const index_t num_sample_blocks = std::min(
+        (index_t) num_samples,
+        util::ceil(min_num_blocks, num_blocks_per_channel * num_channels));
+    const int num_samples_per_block =
+        util::ceil((index_t) num_samples, num_sample_blocks);
+    dim3 grid_dim(num_blocks_per_channel,
+                  num_channels,
+                  util::ceil((index_t) num_samples,
+                             (index_t) num_samples_per_block));
+    const int num_partials = grid_dim.x * grid_dim.z;
+
+    auto& pool = internal::RuntimeGPU::get_device_memory_pool();
+    auto partials = static_cast<DataType*>(pool.get(
+        sizeof(DataType) * num_partials * num_channels * 4, stream));
+    const DataType* bias =
+        relu_bias ? relu_bias->get_const_base_ptr() : nullptr;
+
+    if (vectorized)
+    {
+        using DataTypeV = typename util::GetVectorType<DataType, 4>::type;
         backprop1_opt_kernel<ND, DataType, block_size, DataTypeV>
             <<<grid_dim, block_dim, 0, stream>>>(
                 reinterpret_cast<const DataTypeV*>(input.get_const_base_ptr()),
@@ -987,13 +1817,12 @@ void backprop1_opt(int num_samples,
                 mean.get_const_base_ptr(),
                 var.get_const_base_ptr(),
                 scale.get_const_base_ptr(),
-                scale_gradient.get_base_ptr(),
-                bias_gradient.get_base_ptr(),
-                mean_gradient.get_base_ptr(),
-                var_gradient.get_base_ptr(),
+                bias,
+                partials,
                 epsilon,
                 num_channels,
                 num_samples,
+                num_samples_per_block,
                 spatial_size,
                 i_spatial_real_size,
                 o_spatial_real_size);
@@ -1001,25 +1830,32 @@ void backprop1_opt(int num_samples,
     else
     {
         using DataTypeV = DataType;
-        auto num_blocks_per_channel = util::ceil(spatial_size, block_work_size);
-        dim3 grid_dim(num_blocks_per_channel, num_channels);
         backprop1_opt_kernel<ND, DataType, block_size, DataTypeV>
             <<<grid_dim, block_dim, 0, stream>>>(input.get_const_base_ptr(),
                                                  d_output.get_const_base_ptr(),
                                                  mean.get_const_base_ptr(),
                                                  var.get_const_base_ptr(),
                                                  scale.get_const_base_ptr(),
-                                                 scale_gradient.get_base_ptr(),
-                                                 bias_gradient.get_base_ptr(),
-                                                 mean_gradient.get_base_ptr(),
-                                                 var_gradient.get_base_ptr(),
+                                                 bias,
+                                                 partials,
                                                  epsilon,
                                                  num_channels,
                                                  num_samples,
+                                                 num_samples_per_block,
                                                  spatial_size,
                                                  i_spatial_real_size,
                                                  o_spatial_real_size);
     }
+
+    reduce_backprop1_partials_kernel<DataType, block_size>
+        <<<num_channels, block_dim, 0, stream>>>(partials,
+                                                 scale_gradient.get_base_ptr(),
+                                                 bias_gradient.get_base_ptr(),
+                                                 mean_gradient.get_base_ptr(),
+                                                 var_gradient.get_base_ptr(),
+                                                 num_channels,
+                                                 num_partials);
+    pool.release(partials);
 }
 
 template <int ND, typename TensorType>
@@ -1034,6 +1870,7 @@ void backprop1(int num_samples,
                TensorType& mean_gradient,
                TensorType& var_gradient,
                typename TensorType::data_type epsilon,
+               const TensorType* relu_bias,
                h2::gpu::DeviceStream stream)
 {
     using DataType = typename TensorType::data_type;
@@ -1055,20 +1892,8 @@ void backprop1(int num_samples,
         return;
     }
 
-    std::vector<IndexVector> overlaps = {input.get_overlap(),
-                                         d_output.get_overlap()};
-    bool opt_eligible = true;
-    for (auto overlap : overlaps)
-    {
-        for (int i = 0; i < ND - 3; ++i)
-        {
-            if (overlap[i] != 0)
-            {
-                opt_eligible = false;
-                break;
-            }
-        }
-    }
+    bool opt_eligible =
+        has_contiguous_planes<ND, TensorType>({&input, &d_output});
     if (std::getenv("DISTCONV_DISABLE_BN_OPT"))
     {
         util::MPIRootPrintStreamInfo() << "Disable BN optimization";
@@ -1087,6 +1912,7 @@ void backprop1(int num_samples,
                                       mean_gradient,
                                       var_gradient,
                                       epsilon,
+                                      relu_bias,
                                       stream);
         return;
     }
@@ -1096,18 +1922,21 @@ void backprop1(int num_samples,
     const int num_channels = input.get_local_shape()[get_channel_dim()];
     // CUDA grid dimension limitation
     assert_always(num_channels < 65535);
-    constexpr int block_size = 256;
+    constexpr int block_size = util::reduce_block_size;
     dim3 block_dim(block_size);
     auto shape = input.get_local_shape();
     shape[get_sample_dim()] = num_samples;
     index_t channel_size = input.get_local_size() / num_channels / num_samples;
     dim3 grid_dim((channel_size + block_size - 1) / block_size, num_channels);
+    const DataType* bias =
+        relu_bias ? relu_bias->get_const_base_ptr() : nullptr;
     backprop1_kernel<ND, DataType, block_size>
         <<<grid_dim, block_dim, 0, stream>>>(input.get_const_base_ptr(),
                                              d_output.get_const_base_ptr(),
                                              mean.get_const_base_ptr(),
                                              var.get_const_base_ptr(),
                                              scale.get_const_base_ptr(),
+                                             bias,
                                              scale_gradient.get_base_ptr(),
                                              bias_gradient.get_base_ptr(),
                                              mean_gradient.get_base_ptr(),
@@ -1131,6 +1960,7 @@ void backprop1(int num_dims,
                TensorType& mean_gradient,
                TensorType& var_gradient,
                typename TensorType::data_type epsilon,
+               const TensorType* relu_bias,
                h2::gpu::DeviceStream stream)
 {
     switch (num_dims)
@@ -1138,12 +1968,14 @@ void backprop1(int num_dims,
     case 4:
       backprop1<4, TensorType>(num_samples, input, d_output,
                                mean, var, scale, scale_gradient, bias_gradient,
-                               mean_gradient, var_gradient, epsilon, stream);
+                               mean_gradient, var_gradient, epsilon,
+                               relu_bias, stream);
       break;
     case 5:
       backprop1<5, TensorType>(num_samples, input, d_output,
                                mean, var, scale, scale_gradient, bias_gradient,
-                               mean_gradient, var_gradient, epsilon, stream);
+                               mean_gradient, var_gradient, epsilon,
+                               relu_bias, stream);
       break;
     }
 }
@@ -1161,6 +1993,7 @@ void backprop1(int num_dims,
                                           Tensor<TYPE>& mean_gradient,         \
                                           Tensor<TYPE>& var_gradient,          \
                                           TYPE epsilon,                        \
+                                          const Tensor<TYPE>* relu_bias,       \
                                           h2::gpu::DeviceStream stream);
 INSTANTIATE_BACKPROP1(float)
 INSTANTIATE_BACKPROP1(double)
@@ -1172,6 +2005,7 @@ void __global__ backprop2_kernel(const DataType * __restrict__ input,
                                  const DataType * __restrict__ global_mean,
                                  const DataType * __restrict__ global_var,
                                  const DataType * __restrict__ global_scale,
+                                 const DataType * __restrict__ global_bias,
                                  const DataType * __restrict__ global_dmean,
                                  const DataType * __restrict__ global_dvar,
                                  DataType * __restrict__ d_input,
@@ -1179,7 +2013,8 @@ void __global__ backprop2_kernel(const DataType * __restrict__ input,
                                  tensor::Array<ND> shape,
                                  tensor::Array<ND> input_strides,
                                  tensor::Array<ND> d_output_strides,
-                                 tensor::Array<ND> d_input_strides) {
+                                 tensor::Array<ND> d_input_strides,
+                                 int *overflow) {
   const index_t gidx = threadIdx.x + blockIdx.x * blockDim.x;
   const int ch_idx = blockIdx.y;
   const int num_channels = shape[get_channel_dim()];
@@ -1188,6 +2023,8 @@ void __global__ backprop2_kernel(const DataType * __restrict__ input,
   const DataType mean = global_mean[ch_idx];
   const DataType var = global_var[ch_idx];
   const DataType scale = global_scale[ch_idx];
+  const bool relu = global_bias != nullptr;
+  const DataType bias = relu ? global_bias[ch_idx] : DataType(0);
   const DataType dmean = global_dmean[ch_idx];
   const DataType dvar = global_dvar[ch_idx];
 
@@ -1212,12 +2049,17 @@ void __global__ backprop2_kernel(const DataType * __restrict__ input,
     d_input_offset += ch_idx * d_input_strides[-2];
     for (int s = 0; s < num_samples; ++s) {
       const DataType x = input[input_offset];
-      const DataType dy = d_output[d_output_offset];
+      DataType dy = d_output[d_output_offset];
+      if (relu) {
+        const DataType y = scale * (x - mean) * inv_stdev + bias;
+        dy = apply_relu_backward<DataType>(dy, y);
+      }
       const DataType dxhat = dy * scale;
       DataType dx = dxhat * inv_stdev;
       dx += dmean_term;
       dx += dvar_term * (x - mean);
       d_input[d_input_offset] = dx;
+      util::overflow::check(overflow, dx);
 
       input_offset += input_strides[-1];
       d_output_offset += d_output_strides[-1];
@@ -1232,16 +2074,24 @@ void __global__ backprop2_opt_kernel(const DataTypeV * __restrict__ input,
                                      const DataType * __restrict__ global_mean,
                                      const DataType * __restrict__ global_var,
                                      const DataType * __restrict__ global_scale,
+                                     const DataType * __restrict__ global_bias,
                                      const DataType * __restrict__ global_dmean,
                                      const DataType * __restrict__ global_dvar,
                                      DataTypeV * __restrict__ d_input,
                                      DataType epsilon, index_t num_per_sum,
-                                     index_t spatial_size, int num_channels) {
+                                     index_t spatial_size,
+                                     index_t input_spatial_real_size,
+                                     index_t d_output_spatial_real_size,
+                                     index_t d_input_spatial_real_size,
+                                     int num_channels,
+                                     int *overflow) {
   const auto ch_idx = blockIdx.y;
   const auto sample_idx = blockIdx.z;
   const auto mean = global_mean[ch_idx];
   const auto var = global_var[ch_idx];
   const auto scale = global_scale[ch_idx];
+  const bool relu = global_bias != nullptr;
+  const auto bias = relu ? global_bias[ch_idx] : DataType(0);
   const auto dmean = global_dmean[ch_idx];
   const auto dvar = global_dvar[ch_idx];
   const auto inv_stdev = rsqrt(var + epsilon);
@@ -1250,20 +2100,25 @@ void __global__ backprop2_opt_kernel(const DataTypeV * __restrict__ input,
 
   const auto num_threads_per_channel = blockDim.x * gridDim.x;
 
-  auto block_offset = (ch_idx + sample_idx * num_channels) * spatial_size;
-  input += block_offset;
-  d_output += block_offset;
-  d_input += block_offset;
+  const auto plane_idx = ch_idx + sample_idx * num_channels;
+  input += plane_idx * input_spatial_real_size;
+  d_output += plane_idx * d_output_spatial_real_size;
+  d_input += plane_idx * d_input_spatial_real_size;
 
   for (index_t idx = threadIdx.x + blockIdx.x * blockDim.x;
        idx < spatial_size; idx += num_threads_per_channel) {
     const auto x = input[idx];
-    const auto dy = d_output[idx];
+    auto dy = d_output[idx];
+    if (relu) {
+      const auto y = (x - mean) * inv_stdev * scale + bias;
+      dy = apply_relu_backward<DataType>(dy, y);
+    }
     const auto dxhat = dy * scale;
     auto dx = dxhat * inv_stdev;
     dx = dx + dmean_term;
     dx = dx + (x - mean) * dvar_term;
     d_input[idx] = dx;
+    util::overflow::check<DataType>(overflow, dx);
   }
 }
 
@@ -1279,6 +2134,7 @@ void backprop2_opt(index_t num_samples,
                    const TensorType& var_gradient,
                    TensorType& d_input,
                    typename TensorType::data_type epsilon,
+                   const TensorType* relu_bias,
                    h2::gpu::DeviceStream stream)
 {
     using DataType = typename TensorType::data_type;
@@ -1287,31 +2143,53 @@ void backprop2_opt(index_t num_samples,
         return;
     assert_eq(num_samples, (int) input.get_local_shape()[get_sample_dim()]);
     const int num_channels = input.get_local_shape()[get_channel_dim()];
-    constexpr int block_size = 256;
+    constexpr int block_size = util::block_size;
     dim3 block_dim(block_size);
     index_t channel_size = input.get_local_size() / num_channels / num_samples;
+    // The output gradients may have halos, e.g., when they are the
+    // input gradients of the next convolution
+    index_t i_channel_real_size =
+        input.get_local_real_size() / num_channels / num_samples;
+    index_t dy_channel_real_size =
+        d_output.get_local_real_size() / num_channels / num_samples;
+    index_t dx_channel_real_size =
+        d_input.get_local_real_size() / num_channels / num_samples;
     constexpr index_t thread_work_size = 8;
     constexpr auto block_work_size = block_size * thread_work_size;
-    if (channel_size % 4 == 0)
+    const DataType* bias =
+        relu_bias ? relu_bias->get_const_base_ptr() : nullptr;
+    if (channel_size % 4 == 0
+        && is_halo_vector_aligned(channel_size, i_channel_real_size)
+        && is_halo_vector_aligned(channel_size, dy_channel_real_size)
+        && is_halo_vector_aligned(channel_size, dx_channel_real_size))
     {
         channel_size /= 4;
+        i_channel_real_size /= 4;
+        dy_channel_real_size /= 4;
+        dx_channel_real_size /= 4;
         auto num_blocks_per_channel = util::ceil(channel_size, block_work_size);
         dim3 grid_dim(num_blocks_per_channel, num_channels, num_samples);
         using DataTypeV = typename util::GetVectorType<DataType, 4>::type;
         backprop2_opt_kernel<ND, DataType, DataTypeV>
             <<<grid_dim, block_dim, 0, stream>>>(
-                reinterpret_cast<const DataTypeV*>(input.get_const_buffer()),
-                reinterpret_cast<const DataTypeV*>(d_output.get_const_buffer()),
+                reinterpret_cast<const DataTypeV*>(input.get_const_base_ptr()),
+                reinterpret_cast<const DataTypeV*>(
+                    d_output.get_const_base_ptr()),
                 mean.get_const_base_ptr(),
                 var.get_const_base_ptr(),
                 scale.get_const_base_ptr(),
+                bias,
                 mean_gradient.get_const_base_ptr(),
                 var_gradient.get_const_base_ptr(),
-                reinterpret_cast<DataTypeV*>(d_input.get_buffer()),
+                reinterpret_cast<DataTypeV*>(d_input.get_base_ptr()),
                 epsilon,
                 num_per_sum,
                 channel_size,
-                num_channels);
+                i_channel_real_size,
+                dy_channel_real_size,
+                dx_channel_real_size,
+                num_channels,
+                util::overflow::get_flag());
     }
     else
     {
@@ -1319,18 +2197,23 @@ void backprop2_opt(index_t num_samples,
         dim3 grid_dim(num_blocks_per_channel, num_channels, num_samples);
         backprop2_opt_kernel<ND, DataType, DataType>
             <<<grid_dim, block_dim, 0, stream>>>(
-                input.get_const_buffer(),
-                d_output.get_const_buffer(),
+                input.get_const_base_ptr(),
+                d_output.get_const_base_ptr(),
                 mean.get_const_base_ptr(),
                 var.get_const_base_ptr(),
                 scale.get_const_base_ptr(),
+                bias,
                 mean_gradient.get_const_base_ptr(),
                 var_gradient.get_const_base_ptr(),
-                d_input.get_buffer(),
+                d_input.get_base_ptr(),
                 epsilon,
                 num_per_sum,
                 channel_size,
-                num_channels);
+                i_channel_real_size,
+                dy_channel_real_size,
+                dx_channel_real_size,
+                num_channels,
+                util::overflow::get_flag());
     }
 }
 
@@ -1346,12 +2229,12 @@ void backprop2(index_t num_samples,
                const TensorType& var_gradient,
                TensorType& d_input,
                typename TensorType::data_type epsilon,
+               const TensorType* relu_bias,
                h2::gpu::DeviceStream stream)
 {
     using DataType = typename TensorType::data_type;
 
-    if (input.get_local_real_shape() == d_output.get_local_real_shape()
-        && input.get_local_real_shape() == d_input.get_local_real_shape())
+    if (has_contiguous_planes<ND, TensorType>({&input, &d_output, &d_input}))
     {
         if (std::getenv("DISTCONV_DISABLE_BN_OPT"))
         {
@@ -1370,6 +2253,7 @@ void backprop2(index_t num_samples,
                                           var_gradient,
                                           d_input,
                                           epsilon,
+                                          relu_bias,
                                           stream);
             return;
         }
@@ -1378,7 +2262,7 @@ void backprop2(index_t num_samples,
     if (d_input.get_local_size() == 0)
         return;
     const int num_channels = input.get_local_shape()[get_channel_dim()];
-    constexpr int block_size = 256;
+    constexpr int block_size = util::block_size;
     dim3 block_dim(block_size);
     index_t channel_size = input.get_local_size() / num_channels / num_samples;
     dim3 grid_dim((channel_size + block_size - 1) / block_size, num_channels);
@@ -1389,12 +2273,15 @@ void backprop2(index_t num_samples,
     shape[get_sample_dim()] = num_samples;
     // CUDA grid dimension limitation
     assert_always(num_channels < 65535);
+    const DataType* bias =
+        relu_bias ? relu_bias->get_const_base_ptr() : nullptr;
     backprop2_kernel<ND, DataType>
         <<<grid_dim, block_dim, 0, stream>>>(input.get_const_base_ptr(),
                                              d_output.get_const_base_ptr(),
                                              mean.get_const_base_ptr(),
                                              var.get_const_base_ptr(),
                                              scale.get_const_base_ptr(),
+                                             bias,
                                              mean_gradient.get_const_base_ptr(),
                                              var_gradient.get_const_base_ptr(),
                                              d_input.get_base_ptr(),
@@ -1403,7 +2290,8 @@ void backprop2(index_t num_samples,
                                              shape,
                                              input_strides,
                                              d_output_strides,
-                                             d_input_strides);
+                                             d_input_strides,
+                                             util::overflow::get_flag());
 }
 
 template <typename TensorType>
@@ -1419,6 +2307,7 @@ void backprop2(int num_dims,
                const TensorType& var_gradient,
                TensorType& d_input,
                typename TensorType::data_type epsilon,
+               const TensorType* relu_bias,
                h2::gpu::DeviceStream stream)
 {
     switch (num_dims)
@@ -1426,12 +2315,14 @@ void backprop2(int num_dims,
     case 4:
       backprop2<4, TensorType>(num_samples, num_per_sum, input, d_output,
                                mean, var, scale, mean_gradient,
-                               var_gradient, d_input, epsilon, stream);
+                               var_gradient, d_input, epsilon, relu_bias,
+                               stream);
       break;
     case 5:
       backprop2<5, TensorType>(num_samples, num_per_sum, input, d_output,
                                mean, var, scale, mean_gradient,
-                               var_gradient, d_input, epsilon, stream);
+                               var_gradient, d_input, epsilon, relu_bias,
+                               stream);
       break;
     }
 }
@@ -1449,6 +2340,7 @@ void backprop2(int num_dims,
                                           const Tensor<TYPE>& var_gradient,    \
                                           Tensor<TYPE>& d_input,               \
                                           TYPE epsilon,                        \
+                                          const Tensor<TYPE>* relu_bias,       \
                                           h2::gpu::DeviceStream stream);
 INSTANTIATE_BACKPROP2(float)
 INSTANTIATE_BACKPROP2(double)
@@ -0,0 +1,77 @@
+#include "distconv/dnn_backend/channel_padded_convolution.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+#include <type_traits>
+
+namespace distconv {
+namespace channel_padding {
+
+namespace {
+
+constexpr int block_size = 256;
+
+// Reduced precision types are accumulated in float
+template <typename DataType>
+using AccType = typename std::conditional<
+    std::is_same<DataType, double>::value, double, float>::type;
+
+/*
+  - Each thread copies one element
+  - Consecutive threads copy consecutive innermost positions
+ */
+template <typename DataType>
+__global__ void copy_kernel(const Region r,
+                            const DataType * __restrict__ src,
+                            const DataType beta,
+                            DataType * __restrict__ dst,
+                            const index_t num_elements) {
+  index_t idx = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  if (idx >= num_elements) return;
+  index_t src_offset = 0;
+  index_t dst_offset = 0;
+#pragma unroll
+  for (int i = 0; i < max_num_dims; ++i) {
+    if (i < r.num_dims) {
+      const index_t c = idx % r.dims[i];
+      idx /= r.dims[i];
+      src_offset += c * r.src_strides[i];
+      dst_offset += c * r.dst_strides[i];
+    }
+  }
+  using Acc = AccType<DataType>;
+  const Acc x = static_cast<Acc>(src[src_offset]);
+  // dst is not read with beta == 0 as it may not be initialized
+  dst[dst_offset] = beta == DataType(0) ? DataType(x)
+      : DataType(x + static_cast<Acc>(beta)
+                 * static_cast<Acc>(dst[dst_offset]));
+}
+
+} // namespace
+
+template <typename DataType>
+void copy(const Region &region, const DataType *src, DataType beta,
+          DataType *dst, h2::gpu::DeviceStream stream) {
+  index_t num_elements = 1;
+  for (int i = 0; i < region.num_dims; ++i) {
+    num_elements *= region.dims[i];
+  }
+  if (num_elements == 0) return;
+  copy_kernel<DataType>
+      <<<util::ceil(num_elements, (index_t)block_size), block_size, 0,
+      stream>>>(region, src, beta, dst, num_elements);
+}
+
+#define PROTO(T)                                                        \
+  template void copy<T>(const Region &region, const T *src, T beta,     \
+                        T *dst, h2::gpu::DeviceStream stream);
+
+PROTO(float)
+PROTO(double)
+#if H2_HAS_CUDA
+PROTO(half)
+PROTO(__nv_bfloat16)
+#endif
+#undef PROTO
+
+} // namespace channel_padding
+} // namespace distconv
@@ -1,4 +1,5 @@
 #include "distconv/dnn_backend/cross_entropy.hpp"
+#include "distconv/dnn_backend/loss_reduce_cuda.hpp"
 #include "distconv/runtime_gpu.hpp"
 #include "distconv/tensor/algorithms_cuda.hpp"
 #include "distconv/util/util_gpu.hpp"
@@ -6,14 +7,6 @@
 
 #include <limits>
 
-#if H2_HAS_CUDA
-#include <cub/block/block_reduce.cuh>
-namespace cubns = cub;
-#elif H2_HAS_ROCM
-#include <hipcub/block/block_reduce.hpp>
-namespace cubns = hipcub;
-#endif
-
 using distconv::tensor::LocaleMPI;
 using distconv::tensor::CUDAAllocator;
 
@@ -24,58 +17,33 @@ using CrossEntopyCUDNN = distconv::CrossEntropy<distconv::BackendDNNLib>;
 namespace distconv {
 namespace cross_entropy {
 
-/*
-  - gridDim.y == number of samples
-  - Each sample is taken care by gridDim.x blocks
- */
-template <typename DataType, int BLOCK_SIZE>
-__global__ void fp_local(const DataType * __restrict__ prediction,
-                         const DataType * __restrict__ ground_truth,
-                         DataType * __restrict__ y,
-                         const index_t sample_size,
-                         const index_t sample_spatial_size,
-                         const index_t sample_channel_size,
-                         const bool use_labels,
-                         int thread_work_size) {
-  const int tid = threadIdx.x;
-  const int sample_idx = blockIdx.y;
-
-  prediction += sample_idx * sample_size;
-  ground_truth += sample_idx * sample_size;
-
-  index_t offset = tid + blockIdx.x * BLOCK_SIZE;
-  const int offset_stride = BLOCK_SIZE * gridDim.x;
-  const index_t offset_limit = min(
-      sample_size, offset + offset_stride * thread_work_size);
-
-  auto psum = DataType(0.);
-  for (; offset < offset_limit; offset += offset_stride) {
+// Cross entropy of an element of a sample
+template <typename DataType>
+struct element_cross_entropy {
+  const DataType * __restrict__ prediction;
+  const DataType * __restrict__ ground_truth;
+  index_t sample_size;
+  index_t sample_spatial_size;
+  index_t sample_channel_size;
+  bool use_labels;
+  __device__ __forceinline__ DataType operator()(int sample_idx,
+                                                 index_t offset) const {
     DataType xhat;
-    if(use_labels) {
-      const auto spatial = offset%sample_spatial_size;
-      const auto channel = (offset/sample_spatial_size)%sample_channel_size;
-      const auto sample = offset/sample_spatial_size/sample_channel_size;
-      const auto offset_truth = spatial+sample*sample_spatial_size;
-      const int truth_label = ground_truth[offset_truth];
+    if (use_labels) {
+      const auto spatial = offset % sample_spatial_size;
+      const auto channel = (offset / sample_spatial_size) % sample_channel_size;
+      const int truth_label =
+          ground_truth[sample_idx * sample_spatial_size + spatial];
       xhat = DataType(truth_label == channel ? 1. : 0.);
     } else {
-      xhat = ground_truth[offset];
+      xhat = ground_truth[sample_idx * sample_size + offset];
     }
     if (xhat > DataType(0.)) {
-      const auto x = prediction[offset];
-      psum += - xhat * log(x);
+      return - xhat * log(prediction[sample_idx * sample_size + offset]);
     }
+    return DataType(0.);
   }
-
-  using BlockReduce = cubns::BlockReduce<DataType, BLOCK_SIZE>;
-  __shared__ typename BlockReduce::TempStorage temp_storage;
-  psum = BlockReduce(temp_storage).Sum(psum);
-
-  if (tid == 0) {
-    atomic_add(&y[sample_idx], psum);
-  }
-}
-
+};
 
 /*
   - gridDim.y == number of samples
@@ -97,7 +65,8 @@ __global__ void bp_local(const DataType * __restrict__ x_pred,
 
   x_pred += sample_idx * sample_size;
   dx_pred += sample_idx * sample_size;
-  x_truth += sample_idx * sample_size;
+  // Labels have one channel
+  x_truth += sample_idx * (use_labels ? sample_spatial_size : sample_size);
   dx_truth += sample_idx * sample_size;
 
   index_t offset = tid + blockIdx.x * BLOCK_SIZE;
@@ -137,9 +106,6 @@ int CrossEntopyCUDNN::forward(const Tensor &x_pred, const Tensor &x_truth,
       << "Cross entropy FP: " << x_pred << ", "
       << x_truth << ", " << y;
 
-  constexpr int block_size = 256;
-  constexpr int thread_work_size = 8;
-
   // Assumes no halo for simplicity
   assert_eq(x_pred.get_local_size(), x_pred.get_local_real_size());
   assert_eq(x_truth.get_local_size(), x_truth.get_local_real_size());
@@ -148,31 +114,23 @@ int CrossEntopyCUDNN::forward(const Tensor &x_pred, const Tensor &x_truth,
 
   if (num_samples == 0) return 0;
 
-  y.zero(m_be.get_stream());
-
-  if (x_pred.get_local_size() > 0) {
-    auto sample_size = x_pred.get_local_size() / num_samples;
-    auto num_blocks_per_sample = util::ceil(
-        sample_size, (index_t)block_size * thread_work_size);
-
-    dim3 bdim(block_size);
-    dim3 gdim(num_blocks_per_sample, num_samples);
-
-    const auto sample_channel_size = x_pred.get_local_shape()[x_pred.get_num_spatial_dims()];
-    const auto sample_spatial_size = sample_size / sample_channel_size;
-    assert_eq(sample_channel_size*sample_spatial_size, sample_size);
+  const auto sample_size = x_pred.get_local_size() / num_samples;
+  const auto sample_channel_size = x_pred.get_local_shape()[x_pred.get_num_spatial_dims()];
+  const auto sample_spatial_size = sample_channel_size == 0 ? 0 :
+      sample_size / sample_channel_size;
+  assert_eq(sample_channel_size*sample_spatial_size, sample_size);
 
-    cross_entropy::fp_local<DataType, block_size>
-        <<<gdim, bdim, 0, m_be.get_stream()>>>(
-            x_pred.get_const_buffer(), x_truth.get_const_buffer(),
-            y.get_buffer(), sample_size, sample_spatial_size,
-            sample_channel_size, m_use_labels, thread_work_size);
-  }
+  loss_reduce::reduce_per_sample(
+      num_samples, sample_size,
+      cross_entropy::element_cross_entropy<DataType>{
+          x_pred.get_const_buffer(), x_truth.get_const_buffer(),
+          sample_size, sample_spatial_size, sample_channel_size,
+          m_use_labels},
+      DataType(1), y.get_buffer(), m_be.get_stream());
 
   if (m_num_procs_per_sample > 1) {
-    Al::Allreduce<Al::NCCLBackend, DataType>(
-        y.get_buffer(), num_samples,
-        Al::ReductionOperator::sum, *m_al.get());
+    m_al->allreduce(y.get_buffer(), num_samples,
+                    Al::ReductionOperator::sum);
   }
 
   return 0;
@@ -188,9 +146,7 @@ int CrossEntopyCUDNN::backward(const Tensor &x_pred, const Tensor &x_truth,
 
   if (m_num_procs_per_sample > 1) {
     const auto num_samples = x_pred.get_local_shape()[-1];
-    Al::Bcast<Al::NCCLBackend, DataType>(
-        dy.get_buffer(), num_samples, 0,
-        *m_al.get());
+    m_al->bcast(dy.get_buffer(), num_samples, 0);
   }
 
   constexpr int block_size = 256;
@@ -0,0 +1,580 @@
+#include "distconv/dnn_backend/cudnn_graph.hpp"
+#include "distconv/util/util_cudnn.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <cstdint>
+#include <initializer_list>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#ifdef DISTCONV_HAS_CUDNN_GRAPH_API
+
+namespace distconv
+{
+namespace cudnn
+{
+
+namespace
+{
+
+// Unique IDs of the tensors in a variant pack
+constexpr int64_t x_uid = 'x';
+constexpr int64_t w_uid = 'w';
+constexpr int64_t y_uid = 'y';
+constexpr int64_t bias_uid = 'b';
+constexpr int64_t conv_out_uid = 'c';
+constexpr int64_t bias_out_uid = 'a';
+
+constexpr int max_dims = 8;
+
+struct TensorShape
+{
+    cudnnDataType_t dt;
+    int nd;
+    int64_t dims[max_dims];
+    int64_t strides[max_dims];
+};
+
+TensorShape get_shape(const cudnnTensorDescriptor_t& desc)
+{
+    TensorShape s;
+    int dims[max_dims], strides[max_dims];
+    DISTCONV_CHECK_CUDNN(cudnnGetTensorNdDescriptor(
+        desc, max_dims, &s.dt, &s.nd, dims, strides));
+    for (int i = 0; i < s.nd; ++i)
+    {
+        s.dims[i] = dims[i];
+        s.strides[i] = strides[i];
+    }
+    return s;
+}
+
+TensorShape get_shape(const cudnnFilterDescriptor_t& desc)
+{
+    TensorShape s;
+    cudnnTensorFormat_t fmt;
+    int dims[max_dims];
+    DISTCONV_CHECK_CUDNN(
+        cudnnGetFilterNdDescriptor(desc, max_dims, &s.dt, &fmt, &s.nd, dims));
+    for (int i = 0; i < s.nd; ++i)
+    {
+        s.dims[i] = dims[i];
+    }
+    // Filters are fully packed, with the channel dimension innermost
+    // in the NHWC format.
+    int64_t stride = 1;
+    if (fmt == CUDNN_TENSOR_NHWC)
+    {
+        s.strides[1] = stride;
+        stride *= s.dims[1];
+        for (int i = s.nd - 1; i >= 2; --i)
+        {
+            s.strides[i] = stride;
+            stride *= s.dims[i];
+        }
+        s.strides[0] = stride;
+    }
+    else
+    {
+        for (int i = s.nd - 1; i >= 0; --i)
+        {
+            s.strides[i] = stride;
+            stride *= s.dims[i];
+        }
+    }
+    return s;
+}
+
+GraphDescriptor make_tensor(const TensorShape& s,
+                            cudnnDataType_t dt,
+                            int64_t uid,
+                            int64_t alignment,
+                            bool is_virtual)
+{
+    GraphDescriptor d(CUDNN_BACKEND_TENSOR_DESCRIPTOR);
+    d.set(CUDNN_ATTR_TENSOR_DATA_TYPE, CUDNN_TYPE_DATA_TYPE, 1, &dt);
+    d.set(CUDNN_ATTR_TENSOR_DIMENSIONS, CUDNN_TYPE_INT64, s.nd, s.dims);
+    d.set(CUDNN_ATTR_TENSOR_STRIDES, CUDNN_TYPE_INT64, s.nd, s.strides);
+    d.set(CUDNN_ATTR_TENSOR_UNIQUE_ID, CUDNN_TYPE_INT64, 1, &uid);
+    d.set(CUDNN_ATTR_TENSOR_BYTE_ALIGNMENT, CUDNN_TYPE_INT64, 1, &alignment);
+    d.set(CUDNN_ATTR_TENSOR_IS_VIRTUAL, CUDNN_TYPE_BOOLEAN, 1, &is_virtual);
+    d.finalize();
+    return d;
+}
+
+GraphDescriptor make_convolution(const cudnnConvolutionDescriptor_t& desc,
+                                 cudnnDataType_t& comp_type)
+{
+    int nsp;
+    int pads[max_dims], strides[max_dims], dilations[max_dims];
+    cudnnConvolutionMode_t mode;
+    DISTCONV_CHECK_CUDNN(cudnnGetConvolutionNdDescriptor(desc,
+                                                         max_dims,
+                                                         &nsp,
+                                                         pads,
+                                                         strides,
+                                                         dilations,
+                                                         &mode,
+                                                         &comp_type));
+    std::vector<int64_t> p(pads, pads + nsp);
+    std::vector<int64_t> s(strides, strides + nsp);
+    std::vector<int64_t> dl(dilations, dilations + nsp);
+    const int64_t nsp64 = nsp;
+    GraphDescriptor d(CUDNN_BACKEND_CONVOLUTION_DESCRIPTOR);
+    d.set(CUDNN_ATTR_CONVOLUTION_COMP_TYPE, CUDNN_TYPE_DATA_TYPE, 1, &comp_type);
+    d.set(CUDNN_ATTR_CONVOLUTION_CONV_MODE,
+          CUDNN_TYPE_CONVOLUTION_MODE,
+          1,
+          &mode);
+    d.set(CUDNN_ATTR_CONVOLUTION_SPATIAL_DIMS, CUDNN_TYPE_INT64, 1, &nsp64);
+    d.set(CUDNN_ATTR_CONVOLUTION_PRE_PADDINGS, CUDNN_TYPE_INT64, nsp, p.data());
+    d.set(
+        CUDNN_ATTR_CONVOLUTION_POST_PADDINGS, CUDNN_TYPE_INT64, nsp, p.data());
+    d.set(CUDNN_ATTR_CONVOLUTION_DILATIONS, CUDNN_TYPE_INT64, nsp, dl.data());
+    d.set(
+        CUDNN_ATTR_CONVOLUTION_FILTER_STRIDES, CUDNN_TYPE_INT64, nsp, s.data());
+    d.finalize();
+    return d;
+}
+
+// Scaling factors are double for double-precision convolutions and
+// float otherwise.
+void set_scale(GraphDescriptor& op,
+               cudnnBackendAttributeName_t name,
+               cudnnDataType_t comp_type,
+               double v)
+{
+    if (comp_type == CUDNN_DATA_DOUBLE)
+    {
+        op.set(name, CUDNN_TYPE_DOUBLE, 1, &v);
+    }
+    else
+    {
+        const float f = static_cast<float>(v);
+        op.set(name, CUDNN_TYPE_FLOAT, 1, &f);
+    }
+}
+
+GraphDescriptor make_pointwise_op(cudnnPointwiseMode_t mode,
+                                  cudnnDataType_t comp_type,
+                                  const GraphDescriptor& x,
+                                  const GraphDescriptor* b,
+                                  const GraphDescriptor& y,
+                                  std::vector<GraphDescriptor>& deps)
+{
+    GraphDescriptor pw(CUDNN_BACKEND_POINTWISE_DESCRIPTOR);
+    pw.set(CUDNN_ATTR_POINTWISE_MODE, CUDNN_TYPE_POINTWISE_MODE, 1, &mode);
+    pw.set(CUDNN_ATTR_POINTWISE_MATH_PREC, CUDNN_TYPE_DATA_TYPE, 1, &comp_type);
+    pw.finalize();
+    GraphDescriptor op(CUDNN_BACKEND_OPERATION_POINTWISE_DESCRIPTOR);
+    op.set(CUDNN_ATTR_OPERATION_POINTWISE_PW_DESCRIPTOR, pw);
+    op.set(CUDNN_ATTR_OPERATION_POINTWISE_XDESC, x);
+    if (b)
+    {
+        op.set(CUDNN_ATTR_OPERATION_POINTWISE_BDESC, *b);
+    }
+    op.set(CUDNN_ATTR_OPERATION_POINTWISE_YDESC, y);
+    op.finalize();
+    deps.push_back(std::move(pw));
+    return op;
+}
+
+GraphDescriptor build_operation_graph(cudnnHandle_t handle,
+                                      const GraphConvProblem& p,
+                                      int64_t alignment,
+                                      std::vector<GraphDescriptor>& deps)
+{
+    cudnnDataType_t comp_type;
+    auto conv = make_convolution(p.conv_desc, comp_type);
+    const auto xs = get_shape(p.x_desc);
+    const auto ws = get_shape(p.w_desc);
+    const auto ys = get_shape(p.y_desc);
+    const bool fused = p.bias_desc != nullptr;
+    auto x = make_tensor(xs, xs.dt, x_uid, alignment, false);
+    auto w = make_tensor(ws, ws.dt, w_uid, alignment, false);
+    auto y = make_tensor(ys, ys.dt, y_uid, alignment, false);
+    // With the epilogue, the convolution result stays in a virtual
+    // tensor of the compute type.
+    auto conv_out =
+        fused ? make_tensor(ys, comp_type, conv_out_uid, alignment, true)
+              : GraphDescriptor();
+    const auto& conv_y = fused ? conv_out : y;
+
+    std::vector<GraphDescriptor> ops;
+    switch (p.kind)
+    {
+    case GraphConvKind::FWD:
+    {
+        GraphDescriptor op(
+            CUDNN_BACKEND_OPERATION_CONVOLUTION_FORWARD_DESCRIPTOR);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_FORWARD_X, x);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_FORWARD_W, w);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_FORWARD_Y, conv_y);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_FORWARD_CONV_DESC, conv);
+        set_scale(op,
+                  CUDNN_ATTR_OPERATION_CONVOLUTION_FORWARD_ALPHA,
+                  comp_type,
+                  p.alpha);
+        set_scale(op,
+                  CUDNN_ATTR_OPERATION_CONVOLUTION_FORWARD_BETA,
+                  comp_type,
+                  p.beta);
+        op.finalize();
+        ops.push_back(std::move(op));
+        break;
+    }
+    case GraphConvKind::BWD_DATA:
+    {
+        GraphDescriptor op(
+            CUDNN_BACKEND_OPERATION_CONVOLUTION_BACKWARD_DATA_DESCRIPTOR);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_DATA_DX, x);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_DATA_W, w);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_DATA_DY, y);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_DATA_CONV_DESC, conv);
+        set_scale(op,
+                  CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_DATA_ALPHA,
+                  comp_type,
+                  p.alpha);
+        set_scale(op,
+                  CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_DATA_BETA,
+                  comp_type,
+                  p.beta);
+        op.finalize();
+        ops.push_back(std::move(op));
+        break;
+    }
+    case GraphConvKind::BWD_FILTER:
+    {
+        GraphDescriptor op(
+            CUDNN_BACKEND_OPERATION_CONVOLUTION_BACKWARD_FILTER_DESCRIPTOR);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_FILTER_X, x);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_FILTER_DW, w);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_FILTER_DY, y);
+        op.set(CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_FILTER_CONV_DESC, conv);
+        set_scale(op,
+                  CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_FILTER_ALPHA,
+                  comp_type,
+                  p.alpha);
+        set_scale(op,
+                  CUDNN_ATTR_OPERATION_CONVOLUTION_BWD_FILTER_BETA,
+                  comp_type,
+                  p.beta);
+        op.finalize();
+        ops.push_back(std::move(op));
+        break;
+    }
+    }
+
+    if (fused)
+    {
+        const auto bs = get_shape(p.bias_desc);
+        auto bias = make_tensor(bs, bs.dt, bias_uid, alignment, false);
+        auto bias_out =
+            make_tensor(ys, comp_type, bias_out_uid, alignment, true);
+        ops.push_back(make_pointwise_op(
+            CUDNN_POINTWISE_ADD, comp_type, conv_out, &bias, bias_out, deps));
+        ops.push_back(make_pointwise_op(
+            CUDNN_POINTWISE_RELU_FWD, comp_type, bias_out, nullptr, y, deps));
+        deps.push_back(std::move(bias));
+        deps.push_back(std::move(bias_out));
+        deps.push_back(std::move(conv_out));
+    }
+
+    std::vector<cudnnBackendDescriptor_t> raw_ops;
+    for (const auto& op : ops)
+    {
+        raw_ops.push_back(op.get());
+    }
+    GraphDescriptor graph(CUDNN_BACKEND_OPERATIONGRAPH_DESCRIPTOR);
+    graph.set(CUDNN_ATTR_OPERATIONGRAPH_OPS,
+              CUDNN_TYPE_BACKEND_DESCRIPTOR,
+              raw_ops.size(),
+              raw_ops.data());
+    graph.set(CUDNN_ATTR_OPERATIONGRAPH_HANDLE, CUDNN_TYPE_HANDLE, 1, &handle);
+    graph.finalize();
+
+    for (auto& op : ops)
+    {
+        deps.push_back(std::move(op));
+    }
+    deps.push_back(std::move(conv));
+    deps.push_back(std::move(x));
+    deps.push_back(std::move(w));
+    deps.push_back(std::move(y));
+    return graph;
+}
+
+std::vector<GraphDescriptor>
+get_heuristic_configs(const GraphDescriptor& graph)
+{
+    GraphDescriptor heur(CUDNN_BACKEND_ENGINEHEUR_DESCRIPTOR);
+    heur.set(CUDNN_ATTR_ENGINEHEUR_OPERATION_GRAPH, graph);
+    cudnnBackendHeurMode_t mode = CUDNN_HEUR_MODE_INSTANT;
+    heur.set(CUDNN_ATTR_ENGINEHEUR_MODE, CUDNN_TYPE_HEUR_MODE, 1, &mode);
+    heur.finalize();
+    int64_t count = 0;
+    DISTCONV_CHECK_CUDNN(
+        cudnnBackendGetAttribute(heur.get(),
+                                 CUDNN_ATTR_ENGINEHEUR_RESULTS,
+                                 CUDNN_TYPE_BACKEND_DESCRIPTOR,
+                                 0,
+                                 &count,
+                                 nullptr));
+    std::vector<GraphDescriptor> cfgs;
+    std::vector<cudnnBackendDescriptor_t> raw_cfgs;
+    for (int64_t i = 0; i < count; ++i)
+    {
+        cfgs.emplace_back(CUDNN_BACKEND_ENGINECFG_DESCRIPTOR);
+        raw_cfgs.push_back(cfgs.back().get());
+    }
+    DISTCONV_CHECK_CUDNN(
+        cudnnBackendGetAttribute(heur.get(),
+                                 CUDNN_ATTR_ENGINEHEUR_RESULTS,
+                                 CUDNN_TYPE_BACKEND_DESCRIPTOR,
+                                 count,
+                                 &count,
+                                 raw_cfgs.data()));
+    cfgs.resize(count);
+    return cfgs;
+}
+
+int64_t get_engine_index(const GraphDescriptor& cfg)
+{
+    GraphDescriptor engine(CUDNN_BACKEND_ENGINE_DESCRIPTOR);
+    auto raw_engine = engine.get();
+    int64_t count;
+    DISTCONV_CHECK_CUDNN(cudnnBackendGetAttribute(cfg.get(),
+                                                  CUDNN_ATTR_ENGINECFG_ENGINE,
+                                                  CUDNN_TYPE_BACKEND_DESCRIPTOR,
+                                                  1,
+                                                  &count,
+                                                  &raw_engine));
+    int64_t index;
+    DISTCONV_CHECK_CUDNN(
+        cudnnBackendGetAttribute(raw_engine,
+                                 CUDNN_ATTR_ENGINE_GLOBAL_INDEX,
+                                 CUDNN_TYPE_INT64,
+                                 1,
+                                 &count,
+                                 &index));
+    return index;
+}
+
+// Largest power of two up to 16 that divides all the addresses
+int64_t get_alignment(std::initializer_list<const void*> ptrs)
+{
+    int64_t alignment = 16;
+    for (auto p : ptrs)
+    {
+        if (p == nullptr)
+            continue;
+        const auto addr = reinterpret_cast<uintptr_t>(p);
+        while (addr % alignment)
+        {
+            alignment /= 2;
+        }
+    }
+    return alignment;
+}
+
+} // namespace
+
+GraphDescriptor::GraphDescriptor(cudnnBackendDescriptorType_t type)
+{
+    DISTCONV_CHECK_CUDNN(cudnnBackendCreateDescriptor(type, &m_desc));
+}
+
+GraphDescriptor::GraphDescriptor(GraphDescriptor&& d) noexcept
+    : m_desc(d.m_desc)
+{
+    d.m_desc = nullptr;
+}
+
+GraphDescriptor& GraphDescriptor::operator=(GraphDescriptor&& d) noexcept
+{
+    std::swap(m_desc, d.m_desc);
+    return *this;
+}
+
+GraphDescriptor::~GraphDescriptor()
+{
+    if (m_desc)
+    {
+        cudnnBackendDestroyDescriptor(m_desc);
+    }
+}
+
+void GraphDescriptor::set(cudnnBackendAttributeName_t name,
+                          cudnnBackendAttributeType_t type,
+                          int64_t count,
+                          const void* values)
+{
+    DISTCONV_CHECK_CUDNN(
+        cudnnBackendSetAttribute(m_desc, name, type, count, values));
+}
+
+void GraphDescriptor::set(cudnnBackendAttributeName_t name,
+                          const GraphDescriptor& d)
+{
+    auto raw = d.get();
+    set(name, CUDNN_TYPE_BACKEND_DESCRIPTOR, 1, &raw);
+}
+
+void GraphDescriptor::finalize()
+{
+    DISTCONV_CHECK_CUDNN(cudnnBackendFinalize(m_desc));
+}
+
+bool GraphDescriptor::try_finalize()
+{
+    return cudnnBackendFinalize(m_desc) == CUDNN_STATUS_SUCCESS;
+}
+
+bool GraphPlanCache::finalize_plan(cudnnHandle_t handle,
+                                   const GraphDescriptor& cfg,
+                                   Plan& plan)
+{
+    GraphDescriptor p(CUDNN_BACKEND_EXECUTION_PLAN_DESCRIPTOR);
+    p.set(CUDNN_ATTR_EXECUTION_PLAN_HANDLE, CUDNN_TYPE_HANDLE, 1, &handle);
+    p.set(CUDNN_ATTR_EXECUTION_PLAN_ENGINE_CONFIG, cfg);
+    if (!p.try_finalize())
+    {
+        return false;
+    }
+    int64_t count, ws_size;
+    DISTCONV_CHECK_CUDNN(
+        cudnnBackendGetAttribute(p.get(),
+                                 CUDNN_ATTR_EXECUTION_PLAN_WORKSPACE_SIZE,
+                                 CUDNN_TYPE_INT64,
+                                 1,
+                                 &count,
+                                 &ws_size));
+    plan.plan = std::move(p);
+    plan.ws_size = static_cast<size_t>(ws_size);
+    return true;
+}
+
+bool GraphPlanCache::build_plan(cudnnHandle_t handle,
+                                const GraphConvProblem& p,
+                                int64_t alignment,
+                                const std::string& key,
+                                size_t ws_size,
+                                ConvAlgoCache& algo_cache,
+                                Plan& plan)
+{
+    auto graph = build_operation_graph(handle, p, alignment, plan.deps);
+
+    // The cached engine is rebuilt with its default knobs.
+    int cached_index;
+    if (algo_cache.lookup(key, ws_size, cached_index))
+    {
+        const int64_t index = cached_index;
+        GraphDescriptor engine(CUDNN_BACKEND_ENGINE_DESCRIPTOR);
+        engine.set(CUDNN_ATTR_ENGINE_OPERATION_GRAPH, graph);
+        engine.set(CUDNN_ATTR_ENGINE_GLOBAL_INDEX, CUDNN_TYPE_INT64, 1, &index);
+        if (engine.try_finalize())
+        {
+            GraphDescriptor cfg(CUDNN_BACKEND_ENGINECFG_DESCRIPTOR);
+            cfg.set(CUDNN_ATTR_ENGINECFG_ENGINE, engine);
+            if (cfg.try_finalize() && finalize_plan(handle, cfg, plan)
+                && plan.ws_size <= ws_size)
+            {
+                util::MPIPrintStreamDebug()
+                    << "Using cached graph engine " << index << " for "
+                    << key;
+                plan.deps.push_back(std::move(cfg));
+                plan.deps.push_back(std::move(engine));
+                plan.deps.push_back(std::move(graph));
+                return true;
+            }
+        }
+    }
+
+    for (auto& cfg : get_heuristic_configs(graph))
+    {
+        if (!finalize_plan(handle, cfg, plan) || plan.ws_size > ws_size)
+        {
+            continue;
+        }
+        const auto index = get_engine_index(cfg);
+        util::MPIPrintStreamDebug()
+            << "Graph engine " << index << " selected for " << key
+            << " with workspace of " << plan.ws_size << " bytes";
+        algo_cache.insert(key, static_cast<int>(index), plan.ws_size);
+        plan.deps.push_back(std::move(cfg));
+        plan.deps.push_back(std::move(graph));
+        return true;
+    }
+    return false;
+}
+
+bool GraphPlanCache::execute(cudnnHandle_t handle,
+                             const GraphConvProblem& p,
+                             const std::string& key,
+                             void* ws,
+                             size_t ws_size,
+                             ConvAlgoCache& algo_cache)
+{
+    // Engines may require aligned tensors, so the alignment of the
+    // pointers is part of the plan.
+    const int64_t alignment = get_alignment({p.x, p.w, p.y, p.bias});
+    std::stringstream ss;
+    ss << key << ", align=" << alignment;
+    const auto plan_key = ss.str();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_plans.find(plan_key);
+    if (it == m_plans.end())
+    {
+        auto u = m_unsupported.find(plan_key);
+        if (u != m_unsupported.end() && u->second >= ws_size)
+        {
+            return false;
+        }
+        Plan plan;
+        if (!build_plan(
+                handle, p, alignment, plan_key, ws_size, algo_cache, plan))
+        {
+            util::MPIPrintStreamDebug()
+                << "No graph engine found for " << plan_key
+                << " with workspace of " << ws_size << " bytes";
+            m_unsupported[plan_key] = ws_size;
+            return false;
+        }
+        it = m_plans.emplace(plan_key, std::move(plan)).first;
+    }
+    if (it->second.ws_size > ws_size)
+    {
+        return false;
+    }
+
+    std::vector<int64_t> uids = {x_uid, w_uid, y_uid};
+    std::vector<void*> ptrs = {const_cast<void*>(p.x),
+                               const_cast<void*>(p.w),
+                               const_cast<void*>(p.y)};
+    if (p.bias_desc)
+    {
+        uids.push_back(bias_uid);
+        ptrs.push_back(const_cast<void*>(p.bias));
+    }
+    GraphDescriptor vp(CUDNN_BACKEND_VARIANT_PACK_DESCRIPTOR);
+    vp.set(CUDNN_ATTR_VARIANT_PACK_UNIQUE_IDS,
+           CUDNN_TYPE_INT64,
+           uids.size(),
+           uids.data());
+    vp.set(CUDNN_ATTR_VARIANT_PACK_DATA_POINTERS,
+           CUDNN_TYPE_VOID_PTR,
+           ptrs.size(),
+           ptrs.data());
+    vp.set(CUDNN_ATTR_VARIANT_PACK_WORKSPACE, CUDNN_TYPE_VOID_PTR, 1, &ws);
+    vp.finalize();
+    DISTCONV_CHECK_CUDNN(
+        cudnnBackendExecute(handle, it->second.plan.get(), vp.get()));
+    return true;
+}
+
+} // namespace cudnn
+} // namespace distconv
+
+#endif // DISTCONV_HAS_CUDNN_GRAPH_API
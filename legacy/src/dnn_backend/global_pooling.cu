@@ -0,0 +1,362 @@
+#include "distconv/dnn_backend/global_pooling.hpp"
+#include "distconv/distconv.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/util/launch_config.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <initializer_list>
+
+#if H2_HAS_CUDA
+#include <cub/block/block_reduce.cuh>
+namespace cubns = cub;
+#elif H2_HAS_ROCM
+#include <hipcub/block/block_reduce.hpp>
+namespace cubns = hipcub;
+#endif
+
+using distconv::tensor::LocaleMPI;
+using distconv::tensor::CUDAAllocator;
+
+template <typename DataType>
+using Tensor = distconv::tensor::Tensor<DataType, LocaleMPI, CUDAAllocator>;
+
+namespace distconv {
+namespace global_pooling {
+
+namespace {
+
+constexpr index_t thread_work_size = 8;
+// Partial results of a plane, kept small so that they are combined by
+// a single thread
+constexpr int max_blocks_per_plane = 64;
+
+// Elements of each channel of a sample, which must be contiguous
+// except for the halos of the outermost spatial dimension
+struct PlaneGeometry {
+  index_t size;
+  index_t real_size;
+};
+
+template <typename TensorType>
+PlaneGeometry get_plane_geometry(const TensorType &t) {
+  const int nd = t.get_num_dims();
+  const auto overlap = t.get_overlap();
+  for (int i = 0; i < nd - 3; ++i) {
+    assert_always(overlap[i] == 0);
+  }
+  const auto &shape = t.get_local_shape();
+  const index_t num_planes = shape[-1] * shape[-2];
+  return {(index_t)t.get_local_size() / num_planes,
+          (index_t)t.get_local_real_size() / num_planes};
+}
+
+// Whether the planes can be accessed with vectors of four
+inline bool is_vector_aligned(std::initializer_list<PlaneGeometry> planes) {
+  for (const auto &p: planes) {
+    if (p.size % 4 != 0 || ((p.real_size - p.size) / 2) % 4 != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline dim3 get_grid_dim(index_t spatial_size, int block_size,
+                         int num_channels, int num_samples) {
+  // CUDA grid dimension limitation
+  assert_always(num_channels < 65535 && num_samples < 65535);
+  return dim3(util::ceil(spatial_size, block_size * thread_work_size),
+              num_channels, num_samples);
+}
+
+template <GlobalPoolingMode MODE>
+struct ReduceOp {
+  template <typename T>
+  __device__ __forceinline__ static T init() {
+    return MODE == GlobalPoolingMode::MAX ? -util::max<T>() : T(0);
+  }
+  template <typename T>
+  __device__ __forceinline__ T operator()(T x, T y) const {
+    return MODE == GlobalPoolingMode::MAX ? util::max(x, y) : x + y;
+  }
+  // Reduces the elements of a vector
+  template <typename DataType, typename DataTypeV>
+  __device__ __forceinline__ DataType reduce(DataTypeV x) const {
+    if constexpr (MODE == GlobalPoolingMode::AVERAGE) {
+      return util::sum(x);
+    } else if constexpr (util::GetVectorWidth<DataTypeV>::width == 4) {
+      return util::max(util::max(x.x, x.y), util::max(x.z, x.w));
+    } else {
+      return x;
+    }
+  }
+};
+
+// Gradient of an input element x pooled to y with gradient dy
+template <GlobalPoolingMode MODE, typename DataType>
+__device__ __forceinline__ DataType backprop_element(DataType x, DataType y,
+                                                     DataType dy,
+                                                     DataType scale) {
+  if constexpr (MODE == GlobalPoolingMode::MAX) {
+    return x == y ? dy : DataType(0);
+  } else {
+    return dy * scale;
+  }
+}
+
+} // namespace
+
+// Reduces part of a plane per block, leaving the partial result of
+// block b of plane p at partials[p * gridDim.x + b]
+template <GlobalPoolingMode MODE, typename DataType, typename DataTypeV,
+          int BLOCK_SIZE>
+__global__ void reduce_partials_kernel(const DataTypeV * __restrict__ input,
+                                       DataType * __restrict__ partials,
+                                       index_t spatial_size,
+                                       index_t spatial_real_size,
+                                       int num_channels) {
+  const int ch_idx = blockIdx.y;
+  const int sample_idx = blockIdx.z;
+  const index_t plane_idx = ch_idx + sample_idx * (index_t)num_channels;
+  input += plane_idx * spatial_real_size;
+
+  const ReduceOp<MODE> op;
+  DataType r = ReduceOp<MODE>::template init<DataType>();
+  for (index_t i = threadIdx.x + blockIdx.x * BLOCK_SIZE; i < spatial_size;
+       i += BLOCK_SIZE * gridDim.x) {
+    r = op(r, op.template reduce<DataType>(input[i]));
+  }
+
+  using BlockReduce = cubns::BlockReduce<DataType, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  r = BlockReduce(temp_storage).Reduce(r, op);
+
+  if (threadIdx.x == 0) {
+    partials[plane_idx * gridDim.x + blockIdx.x] = r;
+  }
+}
+
+// Combines the partial results of each plane in order, so that the
+// result does not depend on the scheduling of the blocks
+template <GlobalPoolingMode MODE, typename DataType>
+__global__ void combine_partials_kernel(const DataType * __restrict__ partials,
+                                        DataType * __restrict__ output,
+                                        int num_partials,
+                                        index_t num_planes,
+                                        DataType scale) {
+  const index_t plane_idx = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  if (plane_idx >= num_planes) return;
+  const ReduceOp<MODE> op;
+  DataType r = ReduceOp<MODE>::template init<DataType>();
+  for (int i = 0; i < num_partials; ++i) {
+    r = op(r, partials[plane_idx * num_partials + i]);
+  }
+  if (MODE == GlobalPoolingMode::AVERAGE) {
+    r *= scale;
+  }
+  output[plane_idx] = r;
+}
+
+template <GlobalPoolingMode MODE, typename TensorType>
+void reduce_planes(const TensorType& input,
+                   TensorType& output,
+                   typename TensorType::data_type scale,
+                   h2::gpu::DeviceStream stream)
+{
+    using DataType = typename TensorType::data_type;
+    const auto& shape = input.get_local_shape();
+    const int num_samples = shape[-1];
+    const int num_channels = shape[-2];
+    const index_t num_planes = (index_t) num_samples * num_channels;
+    auto x = get_plane_geometry(input);
+    const bool vector_aligned = is_vector_aligned({x});
+    const index_t spatial_size = vector_aligned ? x.size / 4 : x.size;
+    constexpr int block_size = util::reduce_block_size;
+    auto grid_dim =
+        get_grid_dim(spatial_size, block_size, num_channels, num_samples);
+    grid_dim.x = std::max(
+        std::min<unsigned int>(grid_dim.x, max_blocks_per_plane), 1u);
+    auto& pool = internal::RuntimeGPU::get_device_memory_pool();
+    DataType* partials = static_cast<DataType*>(
+        pool.get(num_planes * grid_dim.x * sizeof(DataType), stream));
+    if (spatial_size > 0)
+    {
+        if (vector_aligned)
+        {
+            using DataTypeV = typename util::GetVectorType<DataType, 4>::type;
+            reduce_partials_kernel<MODE, DataType, DataTypeV, block_size>
+                <<<grid_dim, block_size, 0, stream>>>(
+                    reinterpret_cast<const DataTypeV*>(
+                        input.get_const_base_ptr()),
+                    partials,
+                    spatial_size,
+                    x.real_size / 4,
+                    num_channels);
+        }
+        else
+        {
+            reduce_partials_kernel<MODE, DataType, DataType, block_size>
+                <<<grid_dim, block_size, 0, stream>>>(
+                    input.get_const_base_ptr(),
+                    partials,
+                    spatial_size,
+                    x.real_size,
+                    num_channels);
+        }
+    }
+    // Planes without local elements are reduced to the identity
+    const int num_partials = spatial_size > 0 ? grid_dim.x : 0;
+    constexpr int combine_block_size = util::block_size;
+    combine_partials_kernel<MODE, DataType>
+        <<<util::ceil(num_planes, (index_t) combine_block_size),
+           combine_block_size,
+           0,
+           stream>>>(
+            partials, output.get_base_ptr(), num_partials, num_planes, scale);
+    pool.release(partials);
+}
+
+template <typename TensorType>
+void reduce_planes(GlobalPoolingMode mode,
+                   const TensorType& input,
+                   TensorType& output,
+                   typename TensorType::data_type scale,
+                   h2::gpu::DeviceStream stream)
+{
+    if (mode == GlobalPoolingMode::MAX)
+    {
+        reduce_planes<GlobalPoolingMode::MAX>(input, output, scale, stream);
+    }
+    else
+    {
+        reduce_planes<GlobalPoolingMode::AVERAGE>(
+            input, output, scale, stream);
+    }
+}
+
+template <GlobalPoolingMode MODE, typename DataType, typename DataTypeV>
+__global__ void backprop_kernel(const DataTypeV * __restrict__ input,
+                                const DataType * __restrict__ output,
+                                const DataType * __restrict__ d_output,
+                                DataTypeV * __restrict__ d_input,
+                                DataType scale,
+                                index_t spatial_size,
+                                index_t input_spatial_real_size,
+                                index_t d_input_spatial_real_size,
+                                int num_channels) {
+  const int ch_idx = blockIdx.y;
+  const int sample_idx = blockIdx.z;
+  const index_t plane_idx = ch_idx + sample_idx * (index_t)num_channels;
+  input += plane_idx * input_spatial_real_size;
+  d_input += plane_idx * d_input_spatial_real_size;
+  const DataType y = output[plane_idx];
+  const DataType dy = d_output[plane_idx];
+
+  for (index_t i = threadIdx.x + blockIdx.x * blockDim.x; i < spatial_size;
+       i += blockDim.x * gridDim.x) {
+    const auto x = input[i];
+    if constexpr (util::GetVectorWidth<DataTypeV>::width == 4) {
+      d_input[i] = util::make_vector<DataType, DataTypeV>(
+          backprop_element<MODE>(x.x, y, dy, scale),
+          backprop_element<MODE>(x.y, y, dy, scale),
+          backprop_element<MODE>(x.z, y, dy, scale),
+          backprop_element<MODE>(x.w, y, dy, scale));
+    } else {
+      d_input[i] = backprop_element<MODE>(x, y, dy, scale);
+    }
+  }
+}
+
+template <GlobalPoolingMode MODE, typename TensorType>
+void backprop(const TensorType& input,
+              const TensorType& output,
+              const TensorType& d_output,
+              TensorType& d_input,
+              typename TensorType::data_type scale,
+              h2::gpu::DeviceStream stream)
+{
+    using DataType = typename TensorType::data_type;
+    const auto& shape = input.get_local_shape();
+    const int num_samples = shape[-1];
+    const int num_channels = shape[-2];
+    auto x = get_plane_geometry(input);
+    auto dx = get_plane_geometry(d_input);
+    assert_eq(x.size, dx.size);
+    constexpr int block_size = util::block_size;
+    if (is_vector_aligned({x, dx}))
+    {
+        using DataTypeV = typename util::GetVectorType<DataType, 4>::type;
+        backprop_kernel<MODE, DataType, DataTypeV>
+            <<<get_grid_dim(x.size / 4, block_size, num_channels, num_samples),
+               block_size,
+               0,
+               stream>>>(
+                reinterpret_cast<const DataTypeV*>(input.get_const_base_ptr()),
+                output.get_const_base_ptr(),
+                d_output.get_const_base_ptr(),
+                reinterpret_cast<DataTypeV*>(d_input.get_base_ptr()),
+                scale,
+                x.size / 4,
+                x.real_size / 4,
+                dx.real_size / 4,
+                num_channels);
+    }
+    else
+    {
+        backprop_kernel<MODE, DataType, DataType>
+            <<<get_grid_dim(x.size, block_size, num_channels, num_samples),
+               block_size,
+               0,
+               stream>>>(input.get_const_base_ptr(),
+                         output.get_const_base_ptr(),
+                         d_output.get_const_base_ptr(),
+                         d_input.get_base_ptr(),
+                         scale,
+                         x.size,
+                         x.real_size,
+                         dx.real_size,
+                         num_channels);
+    }
+}
+
+template <typename TensorType>
+void backprop(GlobalPoolingMode mode,
+              const TensorType& input,
+              const TensorType& output,
+              const TensorType& d_output,
+              TensorType& d_input,
+              typename TensorType::data_type scale,
+              h2::gpu::DeviceStream stream)
+{
+    if (mode == GlobalPoolingMode::MAX)
+    {
+        backprop<GlobalPoolingMode::MAX>(
+            input, output, d_output, d_input, scale, stream);
+    }
+    else
+    {
+        backprop<GlobalPoolingMode::AVERAGE>(
+            input, output, d_output, d_input, scale, stream);
+    }
+}
+
+#define INSTANTIATE(TYPE)                                                      \
+    template void reduce_planes<Tensor<TYPE>>(GlobalPoolingMode mode,          \
+                                              const Tensor<TYPE>& input,       \
+                                              Tensor<TYPE>& output,            \
+                                              TYPE scale,                      \
+                                              h2::gpu::DeviceStream stream);   \
+    template void backprop<Tensor<TYPE>>(GlobalPoolingMode mode,               \
+                                         const Tensor<TYPE>& input,            \
+                                         const Tensor<TYPE>& output,           \
+                                         const Tensor<TYPE>& d_output,         \
+                                         Tensor<TYPE>& d_input,                \
+                                         TYPE scale,                           \
+                                         h2::gpu::DeviceStream stream);
+INSTANTIATE(float)
+INSTANTIATE(double)
+#undef INSTANTIATE
+
+} // namespace global_pooling
+} // namespace distconv
@@ -0,0 +1,110 @@
+#include "distconv/dnn_backend/grad_norm.hpp"
+#include "distconv/util/launch_config.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+#include <algorithm>
+
+namespace distconv {
+namespace grad_norm {
+
+namespace {
+
+constexpr int block_size = util::reduce_block_size;
+// Gradients are read by at most this many blocks each
+constexpr size_t max_num_blocks = 64;
+
+template <typename DataType>
+__device__ __forceinline__ void add_sum(AccType<DataType> psum,
+                                        AccType<DataType> *sums,
+                                        int slot, int total) {
+  psum = util::block_reduce_sum<block_size>(psum);
+  if (threadIdx.x == 0) {
+    atomic_add(&sums[slot], psum);
+    atomic_add(&sums[total], psum);
+  }
+}
+
+template <typename DataType>
+__global__ void accumulate_kernel(const DataType * __restrict__ buf,
+                                  const size_t count,
+                                  AccType<DataType> * __restrict__ sums,
+                                  const int slot, const int total) {
+  using Acc = AccType<DataType>;
+  Acc psum = Acc(0);
+  for (size_t i = threadIdx.x + blockIdx.x * (size_t)blockDim.x; i < count;
+       i += blockDim.x * (size_t)gridDim.x) {
+    const Acc x = static_cast<Acc>(buf[i]);
+    psum += x * x;
+  }
+  add_sum<DataType>(psum, sums, slot, total);
+}
+
+/*
+  - Each blockIdx.y copies one slice
+  - The squares are summed while copying if WITH_SUMS
+ */
+template <typename DataType, bool WITH_SUMS>
+__global__ void scatter_kernel(const Slice<DataType> *slices,
+                               AccType<DataType> * __restrict__ sums,
+                               const int total) {
+  using Acc = AccType<DataType>;
+  const auto s = slices[blockIdx.y];
+  Acc psum = Acc(0);
+  for (size_t i = threadIdx.x + blockIdx.x * (size_t)blockDim.x; i < s.count;
+       i += blockDim.x * (size_t)gridDim.x) {
+    const DataType x = s.src[i];
+    s.dst[i] = x;
+    if (WITH_SUMS) {
+      psum += static_cast<Acc>(x) * static_cast<Acc>(x);
+    }
+  }
+  // The slot is uniform within the block
+  if (WITH_SUMS && s.slot >= 0) {
+    add_sum<DataType>(psum, sums, s.slot, total);
+  }
+}
+
+} // namespace
+
+template <typename DataType>
+void accumulate(const DataType *buf, size_t count, AccType<DataType> *sums,
+                int slot, int total, h2::gpu::DeviceStream stream) {
+  if (count == 0) return;
+  const size_t num_blocks =
+      std::min(util::ceil(count, (size_t)block_size), max_num_blocks);
+  accumulate_kernel<DataType><<<num_blocks, block_size, 0, stream>>>(
+      buf, count, sums, slot, total);
+}
+
+template <typename DataType>
+void scatter(const Slice<DataType> *slices, int num_slices, size_t max_count,
+             AccType<DataType> *sums, int total, bool with_sums,
+             h2::gpu::DeviceStream stream) {
+  if (num_slices == 0 || max_count == 0) return;
+  dim3 grid_dim(
+      std::min(util::ceil(max_count, (size_t)block_size), max_num_blocks),
+      num_slices);
+  if (with_sums) {
+    scatter_kernel<DataType, true><<<grid_dim, block_size, 0, stream>>>(
+        slices, sums, total);
+  } else {
+    scatter_kernel<DataType, false><<<grid_dim, block_size, 0, stream>>>(
+        slices, sums, total);
+  }
+}
+
+#define PROTO(T)                                                        \
+  template void accumulate<T>(const T *buf, size_t count,               \
+                              AccType<T> *sums, int slot, int total,    \
+                              h2::gpu::DeviceStream stream);            \
+  template void scatter<T>(const Slice<T> *slices, int num_slices,      \
+                           size_t max_count, AccType<T> *sums,          \
+                           int total, bool with_sums,                   \
+                           h2::gpu::DeviceStream stream);
+
+PROTO(float)
+PROTO(double)
+#undef PROTO
+
+} // namespace grad_norm
+} // namespace distconv
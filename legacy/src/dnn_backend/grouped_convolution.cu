@@ -0,0 +1,314 @@
+#include "distconv/dnn_backend/grouped_convolution.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#if H2_HAS_CUDA
+#include <cub/block/block_reduce.cuh>
+namespace cubns = cub;
+#elif H2_HAS_ROCM
+#include <hipcub/block/block_reduce.hpp>
+namespace cubns = hipcub;
+#endif
+
+namespace distconv {
+namespace grouped_conv {
+
+namespace {
+
+constexpr int block_size = 256;
+
+// Splits idx into the coordinates of dims, innermost first
+template <int NUM_DIMS>
+__device__ __forceinline__ void get_coords(index_t idx, const int *dims,
+                                           int *coords) {
+#pragma unroll
+  for (int i = 0; i < NUM_DIMS; ++i) {
+    coords[i] = idx % dims[i];
+    idx /= dims[i];
+  }
+}
+
+template <int ND>
+__device__ __forceinline__ int get_filter_size(const Problem &p) {
+  int s = 1;
+#pragma unroll
+  for (int i = 0; i < ND; ++i) {
+    s *= p.w.dims[i];
+  }
+  return s;
+}
+
+template <typename DataType>
+__device__ __forceinline__ void store(DataType *p, DataType alpha,
+                                      DataType sum, DataType beta) {
+  // y is not read with beta == 0 as it may not be initialized
+  *p = beta == DataType(0) ? alpha * sum : alpha * sum + beta * *p;
+}
+
+/*
+  - Each thread computes one element of y
+  - Consecutive threads compute consecutive innermost positions
+ */
+template <int ND, typename DataType>
+__global__ void fp_kernel(const Problem p, const DataType alpha,
+                          const DataType * __restrict__ x,
+                          const DataType * __restrict__ w,
+                          const DataType beta,
+                          DataType * __restrict__ y,
+                          const index_t num_elements) {
+  const index_t gid = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  if (gid >= num_elements) return;
+
+  int yc[ND + 2];
+  get_coords<ND + 2>(gid, p.y.dims, yc);
+  const int k = yc[ND];
+  const int n = yc[ND + 1];
+  const int c_per_group = p.w.dims[ND];
+  const int k_per_group = p.y.dims[ND] / p.num_groups;
+  const int c_begin = (k / k_per_group) * c_per_group;
+  const int filter_size = get_filter_size<ND>(p);
+
+  const DataType *x_sample = x + n * p.x.strides[ND + 1]
+      + c_begin * p.x.strides[ND];
+  const DataType *w_filter = w + k * p.w.strides[ND + 1];
+
+  DataType sum = DataType(0);
+  for (int f = 0; f < filter_size; ++f) {
+    int fc[ND];
+    get_coords<ND>(f, p.w.dims, fc);
+    bool valid = true;
+    index_t x_offset = 0;
+    index_t w_offset = 0;
+#pragma unroll
+    for (int i = 0; i < ND; ++i) {
+      const int xi = yc[i] * p.strides[i] + fc[i] * p.dilations[i] - p.pads[i];
+      valid &= xi >= 0 && xi < p.x.dims[i];
+      x_offset += xi * p.x.strides[i];
+      w_offset += fc[i] * p.w.strides[i];
+    }
+    if (!valid) continue;
+    for (int c = 0; c < c_per_group; ++c) {
+      sum += x_sample[x_offset + c * p.x.strides[ND]]
+          * w_filter[w_offset + c * p.w.strides[ND]];
+    }
+  }
+
+  index_t y_offset = 0;
+#pragma unroll
+  for (int i = 0; i < ND + 2; ++i) {
+    y_offset += yc[i] * p.y.strides[i];
+  }
+  store(&y[y_offset], alpha, sum, beta);
+}
+
+/*
+  - Each thread computes one element of dx by gathering the elements
+    of dy whose windows cover it, so no atomics are needed
+ */
+template <int ND, typename DataType>
+__global__ void bp_data_kernel(const Problem p, const DataType alpha,
+                               const DataType * __restrict__ w,
+                               const DataType * __restrict__ dy,
+                               const DataType beta,
+                               DataType * __restrict__ dx,
+                               const index_t num_elements) {
+  const index_t gid = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  if (gid >= num_elements) return;
+
+  int xc[ND + 2];
+  get_coords<ND + 2>(gid, p.x.dims, xc);
+  const int c = xc[ND];
+  const int n = xc[ND + 1];
+  const int c_per_group = p.w.dims[ND];
+  const int k_per_group = p.y.dims[ND] / p.num_groups;
+  const int group = c / c_per_group;
+  const int k_begin = group * k_per_group;
+  const int filter_size = get_filter_size<ND>(p);
+
+  const DataType *dy_sample = dy + n * p.y.strides[ND + 1]
+      + k_begin * p.y.strides[ND];
+  const DataType *w_channel = w + k_begin * p.w.strides[ND + 1]
+      + (c - group * c_per_group) * p.w.strides[ND];
+
+  DataType sum = DataType(0);
+  for (int f = 0; f < filter_size; ++f) {
+    int fc[ND];
+    get_coords<ND>(f, p.w.dims, fc);
+    bool valid = true;
+    index_t y_offset = 0;
+    index_t w_offset = 0;
+#pragma unroll
+    for (int i = 0; i < ND; ++i) {
+      const int t = xc[i] + p.pads[i] - fc[i] * p.dilations[i];
+      const int yi = t / p.strides[i];
+      valid &= t >= 0 && yi * p.strides[i] == t && yi < p.y.dims[i];
+      y_offset += yi * p.y.strides[i];
+      w_offset += fc[i] * p.w.strides[i];
+    }
+    if (!valid) continue;
+    for (int k = 0; k < k_per_group; ++k) {
+      sum += dy_sample[y_offset + k * p.y.strides[ND]]
+          * w_channel[w_offset + k * p.w.strides[ND + 1]];
+    }
+  }
+
+  index_t x_offset = 0;
+#pragma unroll
+  for (int i = 0; i < ND + 2; ++i) {
+    x_offset += xc[i] * p.x.strides[i];
+  }
+  store(&dx[x_offset], alpha, sum, beta);
+}
+
+/*
+  - Each block computes one element of dw by reducing over the samples
+    and the spatial positions of dy
+ */
+template <int ND, typename DataType, int BLOCK_SIZE>
+__global__ void bp_filter_kernel(const Problem p, const DataType alpha,
+                                 const DataType * __restrict__ x,
+                                 const DataType * __restrict__ dy,
+                                 const DataType beta,
+                                 DataType * __restrict__ dw) {
+  int wc[ND + 2];
+  get_coords<ND + 2>(blockIdx.x, p.w.dims, wc);
+  const int k = wc[ND + 1];
+  const int c_per_group = p.w.dims[ND];
+  const int k_per_group = p.y.dims[ND] / p.num_groups;
+  const int c = (k / k_per_group) * c_per_group + wc[ND];
+
+  // Samples and spatial positions of dy, innermost first
+  int reduce_dims[ND + 1];
+  index_t num_elements = 1;
+#pragma unroll
+  for (int i = 0; i < ND; ++i) {
+    reduce_dims[i] = p.y.dims[i];
+    num_elements *= p.y.dims[i];
+  }
+  reduce_dims[ND] = p.y.dims[ND + 1];
+  num_elements *= p.y.dims[ND + 1];
+
+  const DataType *x_channel = x + c * p.x.strides[ND];
+  const DataType *dy_filter = dy + k * p.y.strides[ND];
+
+  DataType psum = DataType(0);
+  for (index_t idx = threadIdx.x; idx < num_elements; idx += BLOCK_SIZE) {
+    int rc[ND + 1];
+    get_coords<ND + 1>(idx, reduce_dims, rc);
+    bool valid = true;
+    index_t x_offset = rc[ND] * p.x.strides[ND + 1];
+    index_t y_offset = rc[ND] * p.y.strides[ND + 1];
+#pragma unroll
+    for (int i = 0; i < ND; ++i) {
+      const int xi = rc[i] * p.strides[i] + wc[i] * p.dilations[i] - p.pads[i];
+      valid &= xi >= 0 && xi < p.x.dims[i];
+      x_offset += xi * p.x.strides[i];
+      y_offset += rc[i] * p.y.strides[i];
+    }
+    if (valid) {
+      psum += x_channel[x_offset] * dy_filter[y_offset];
+    }
+  }
+
+  using BlockReduce = cubns::BlockReduce<DataType, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  psum = BlockReduce(temp_storage).Sum(psum);
+
+  if (threadIdx.x == 0) {
+    index_t w_offset = 0;
+#pragma unroll
+    for (int i = 0; i < ND + 2; ++i) {
+      w_offset += wc[i] * p.w.strides[i];
+    }
+    store(&dw[w_offset], alpha, psum, beta);
+  }
+}
+
+index_t get_num_elements(const Geometry &g, int num_dims) {
+  index_t n = 1;
+  for (int i = 0; i < num_dims; ++i) {
+    n *= g.dims[i];
+  }
+  return n;
+}
+
+// Calls f with the number of spatial dimensions as a compile-time
+// constant
+template <typename F>
+void dispatch_spatial_dims(const Problem &p, F &&f) {
+  assert_always(is_supported(p));
+  switch (p.num_spatial_dims) {
+    case 1:
+      f(std::integral_constant<int, 1>());
+      break;
+    case 2:
+      f(std::integral_constant<int, 2>());
+      break;
+    case 3:
+      f(std::integral_constant<int, 3>());
+      break;
+  }
+}
+
+} // namespace
+
+template <typename DataType>
+void forward(const Problem &p, DataType alpha, const DataType *x,
+             const DataType *w, DataType beta, DataType *y,
+             h2::gpu::DeviceStream stream) {
+  const auto num_elements = get_num_elements(p.y, p.num_spatial_dims + 2);
+  if (num_elements == 0) return;
+  dispatch_spatial_dims(p, [&](auto nd) {
+    constexpr int ND = decltype(nd)::value;
+    fp_kernel<ND, DataType>
+        <<<util::ceil(num_elements, (index_t)block_size), block_size, 0,
+        stream>>>(p, alpha, x, w, beta, y, num_elements);
+  });
+}
+
+template <typename DataType>
+void backward_data(const Problem &p, DataType alpha, const DataType *w,
+                   const DataType *dy, DataType beta, DataType *dx,
+                   h2::gpu::DeviceStream stream) {
+  const auto num_elements = get_num_elements(p.x, p.num_spatial_dims + 2);
+  if (num_elements == 0) return;
+  dispatch_spatial_dims(p, [&](auto nd) {
+    constexpr int ND = decltype(nd)::value;
+    bp_data_kernel<ND, DataType>
+        <<<util::ceil(num_elements, (index_t)block_size), block_size, 0,
+        stream>>>(p, alpha, w, dy, beta, dx, num_elements);
+  });
+}
+
+template <typename DataType>
+void backward_filter(const Problem &p, DataType alpha, const DataType *x,
+                     const DataType *dy, DataType beta, DataType *dw,
+                     h2::gpu::DeviceStream stream) {
+  const auto num_filter_elements =
+      get_num_elements(p.w, p.num_spatial_dims + 2);
+  if (num_filter_elements == 0) return;
+  dispatch_spatial_dims(p, [&](auto nd) {
+    constexpr int ND = decltype(nd)::value;
+    bp_filter_kernel<ND, DataType, block_size>
+        <<<num_filter_elements, block_size, 0, stream>>>(
+            p, alpha, x, dy, beta, dw);
+  });
+}
+
+#define PROTO(T)                                                        \
+  template void forward<T>(const Problem &p, T alpha, const T *x,       \
+                           const T *w, T beta, T *y,                    \
+                           h2::gpu::DeviceStream stream);               \
+  template void backward_data<T>(const Problem &p, T alpha, const T *w, \
+                                 const T *dy, T beta, T *dx,            \
+                                 h2::gpu::DeviceStream stream);         \
+  template void backward_filter<T>(const Problem &p, T alpha,           \
+                                   const T *x, const T *dy, T beta,     \
+                                   T *dw, h2::gpu::DeviceStream stream);
+
+PROTO(float)
+PROTO(double)
+#undef PROTO
+
+} // namespace grouped_conv
+} // namespace distconv
@@ -0,0 +1,571 @@
+#include "distconv/dnn_backend/groupnorm.hpp"
+#include "distconv/distconv.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/util/launch_config.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <algorithm>
+#include <initializer_list>
+
+#if H2_HAS_CUDA
+#include <cub/block/block_reduce.cuh>
+namespace cubns = cub;
+#elif H2_HAS_ROCM
+#include <hipcub/block/block_reduce.hpp>
+namespace cubns = hipcub;
+#endif
+
+using distconv::tensor::LocaleMPI;
+using distconv::tensor::CUDAAllocator;
+
+template <typename DataType>
+using Tensor = distconv::tensor::Tensor<DataType, LocaleMPI, CUDAAllocator>;
+
+namespace distconv {
+namespace groupnorm {
+
+namespace {
+
+constexpr index_t thread_work_size = 8;
+
+__device__ inline float rsqrt(float x) {
+  return rsqrtf(x);
+}
+
+__device__ inline double rsqrt(double x) {
+  return ::rsqrt(x);
+}
+
+// Mean and inverse standard deviation of statistics i
+template <typename DataType>
+__device__ __forceinline__ void get_stats(const DataType * __restrict__ sums,
+                                          int i, int num_stats,
+                                          index_t num_per_group,
+                                          DataType epsilon,
+                                          DataType &mean,
+                                          DataType &inv_stdev) {
+  mean = sums[i] / num_per_group;
+  // Sums of squares lose precision when the variance is small
+  // relative to the mean
+  const DataType var = util::max(
+      sums[num_stats + i] / num_per_group - mean * mean, DataType(0));
+  inv_stdev = rsqrt(var + epsilon);
+}
+
+// Elements of each channel of a sample, which must be contiguous
+// except for the halos of the outermost spatial dimension
+struct PlaneGeometry {
+  index_t size;
+  index_t real_size;
+};
+
+template <typename TensorType>
+PlaneGeometry get_plane_geometry(const TensorType &t) {
+  const int nd = t.get_num_dims();
+  const auto overlap = t.get_overlap();
+  for (int i = 0; i < nd - 3; ++i) {
+    assert_always(overlap[i] == 0);
+  }
+  const auto &shape = t.get_local_shape();
+  const index_t num_planes = shape[-1] * shape[-2];
+  return {(index_t)t.get_local_size() / num_planes,
+          (index_t)t.get_local_real_size() / num_planes};
+}
+
+// Whether the planes can be accessed with vectors of four
+inline bool is_vector_aligned(std::initializer_list<PlaneGeometry> planes) {
+  for (const auto &p: planes) {
+    if (p.size % 4 != 0 || ((p.real_size - p.size) / 2) % 4 != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline dim3 get_grid_dim(index_t spatial_size, int block_size,
+                         int num_channels, int num_samples) {
+  // CUDA grid dimension limitation
+  assert_always(num_channels < 65535 && num_samples < 65535);
+  return dim3(util::ceil(spatial_size, block_size * thread_work_size),
+              num_channels, num_samples);
+}
+
+} // namespace
+
+template <typename DataType, typename DataTypeV, int BLOCK_SIZE>
+__global__ void group_sums_kernel(const DataTypeV * __restrict__ input,
+                                  DataType * __restrict__ sums,
+                                  index_t spatial_size,
+                                  index_t spatial_real_size,
+                                  int num_channels,
+                                  int channels_per_group) {
+  const int ch_idx = blockIdx.y;
+  const int sample_idx = blockIdx.z;
+  input += (ch_idx + sample_idx * (index_t)num_channels) * spatial_real_size;
+
+  DataType sum = DataType(0);
+  DataType sqsum = DataType(0);
+  for (index_t i = threadIdx.x + blockIdx.x * BLOCK_SIZE; i < spatial_size;
+       i += BLOCK_SIZE * gridDim.x) {
+    const auto x = input[i];
+    sum += util::sum(x);
+    sqsum += util::sum(x * x);
+  }
+
+  using BlockReduce = cubns::BlockReduce<DataType, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage_sum;
+  __shared__ typename BlockReduce::TempStorage temp_storage_sqsum;
+  sum = BlockReduce(temp_storage_sum).Sum(sum);
+  sqsum = BlockReduce(temp_storage_sqsum).Sum(sqsum);
+
+  if (threadIdx.x == 0) {
+    const int num_groups = num_channels / channels_per_group;
+    const int num_stats = gridDim.z * num_groups;
+    const int i = sample_idx * num_groups + ch_idx / channels_per_group;
+    atomic_add(&sums[i], sum);
+    atomic_add(&sums[num_stats + i], sqsum);
+  }
+}
+
+template <typename TensorType>
+void group_sums(int num_groups,
+                const TensorType& input,
+                typename TensorType::data_type* sums,
+                h2::gpu::DeviceStream stream)
+{
+    using DataType = typename TensorType::data_type;
+    const auto& shape = input.get_local_shape();
+    const int num_samples = shape[-1];
+    const int num_channels = shape[-2];
+    h2::gpu::mem_zero(sums, num_samples * num_groups * 2, stream);
+    if (input.get_local_size() == 0)
+        return;
+    auto x = get_plane_geometry(input);
+    const int channels_per_group = num_channels / num_groups;
+    constexpr int block_size = util::reduce_block_size;
+    if (is_vector_aligned({x}))
+    {
+        using DataTypeV = typename util::GetVectorType<DataType, 4>::type;
+        group_sums_kernel<DataType, DataTypeV, block_size>
+            <<<get_grid_dim(x.size / 4, block_size, num_channels, num_samples),
+               block_size,
+               0,
+               stream>>>(
+                reinterpret_cast<const DataTypeV*>(input.get_const_base_ptr()),
+                sums,
+                x.size / 4,
+                x.real_size / 4,
+                num_channels,
+                channels_per_group);
+    }
+    else
+    {
+        group_sums_kernel<DataType, DataType, block_size>
+            <<<get_grid_dim(x.size, block_size, num_channels, num_samples),
+               block_size,
+               0,
+               stream>>>(input.get_const_base_ptr(),
+                         sums,
+                         x.size,
+                         x.real_size,
+                         num_channels,
+                         channels_per_group);
+    }
+}
+
+template <typename DataType, typename DataTypeV>
+__global__ void group_normalization_kernel(
+    const DataTypeV * __restrict__ input,
+    const DataType * __restrict__ sums,
+    const DataType * __restrict__ scale,
+    const DataType * __restrict__ bias,
+    DataTypeV * __restrict__ output,
+    DataType epsilon,
+    index_t num_per_group,
+    index_t spatial_size,
+    index_t input_spatial_real_size,
+    index_t output_spatial_real_size,
+    int num_channels,
+    int channels_per_group) {
+  const int ch_idx = blockIdx.y;
+  const int sample_idx = blockIdx.z;
+  const int num_groups = num_channels / channels_per_group;
+  DataType mean, inv_stdev;
+  get_stats(sums, sample_idx * num_groups + ch_idx / channels_per_group,
+            gridDim.z * num_groups, num_per_group, epsilon, mean, inv_stdev);
+  // y = (x - mean) * inv_stdev * scale + bias
+  const DataType a = scale[ch_idx] * inv_stdev;
+  const DataType b = bias[ch_idx] - mean * a;
+
+  const index_t plane_idx = ch_idx + sample_idx * (index_t)num_channels;
+  input += plane_idx * input_spatial_real_size;
+  output += plane_idx * output_spatial_real_size;
+
+  for (index_t i = threadIdx.x + blockIdx.x * blockDim.x; i < spatial_size;
+       i += blockDim.x * gridDim.x) {
+    output[i] = input[i] * a + b;
+  }
+}
+
+template <typename TensorType>
+void group_normalization(int num_groups,
+                         index_t num_per_group,
+                         const TensorType& input,
+                         const typename TensorType::data_type* sums,
+                         const TensorType& scale,
+                         const TensorType& bias,
+                         TensorType& output,
+                         typename TensorType::data_type epsilon,
+                         h2::gpu::DeviceStream stream)
+{
+    using DataType = typename TensorType::data_type;
+    if (output.get_local_size() == 0)
+        return;
+    const auto& shape = input.get_local_shape();
+    const int num_samples = shape[-1];
+    const int num_channels = shape[-2];
+    auto x = get_plane_geometry(input);
+    auto y = get_plane_geometry(output);
+    assert_eq(x.size, y.size);
+    const int channels_per_group = num_channels / num_groups;
+    constexpr int block_size = util::block_size;
+    if (is_vector_aligned({x, y}))
+    {
+        using DataTypeV = typename util::GetVectorType<DataType, 4>::type;
+        group_normalization_kernel<DataType, DataTypeV>
+            <<<get_grid_dim(x.size / 4, block_size, num_channels, num_samples),
+               block_size,
+               0,
+               stream>>>(
+                reinterpret_cast<const DataTypeV*>(input.get_const_base_ptr()),
+                sums,
+                scale.get_const_base_ptr(),
+                bias.get_const_base_ptr(),
+                reinterpret_cast<DataTypeV*>(output.get_base_ptr()),
+                epsilon,
+                num_per_group,
+                x.size / 4,
+                x.real_size / 4,
+                y.real_size / 4,
+                num_channels,
+                channels_per_group);
+    }
+    else
+    {
+        group_normalization_kernel<DataType, DataType>
+            <<<get_grid_dim(x.size, block_size, num_channels, num_samples),
+               block_size,
+               0,
+               stream>>>(input.get_const_base_ptr(),
+                         sums,
+                         scale.get_const_base_ptr(),
+                         bias.get_const_base_ptr(),
+                         output.get_base_ptr(),
+                         epsilon,
+                         num_per_group,
+                         x.size,
+                         x.real_size,
+                         y.real_size,
+                         num_channels,
+                         channels_per_group);
+    }
+}
+
+template <typename DataType, typename DataTypeV, int BLOCK_SIZE>
+__global__ void backprop_group_sums_kernel(
+    const DataTypeV * __restrict__ input,
+    const DataTypeV * __restrict__ d_output,
+    const DataType * __restrict__ sums,
+    const DataType * __restrict__ scale,
+    DataType * __restrict__ scale_gradient,
+    DataType * __restrict__ bias_gradient,
+    DataType * __restrict__ grad_sums,
+    DataType epsilon,
+    index_t num_per_group,
+    index_t spatial_size,
+    index_t input_spatial_real_size,
+    index_t d_output_spatial_real_size,
+    int num_channels,
+    int channels_per_group) {
+  const int ch_idx = blockIdx.y;
+  const int sample_idx = blockIdx.z;
+  const index_t plane_idx = ch_idx + sample_idx * (index_t)num_channels;
+  input += plane_idx * input_spatial_real_size;
+  d_output += plane_idx * d_output_spatial_real_size;
+
+  DataType sum_dy = DataType(0);
+  DataType sum_dy_x = DataType(0);
+  for (index_t i = threadIdx.x + blockIdx.x * BLOCK_SIZE; i < spatial_size;
+       i += BLOCK_SIZE * gridDim.x) {
+    const auto dy = d_output[i];
+    sum_dy += util::sum(dy);
+    sum_dy_x += util::sum(dy * input[i]);
+  }
+
+  using BlockReduce = cubns::BlockReduce<DataType, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage_dy;
+  __shared__ typename BlockReduce::TempStorage temp_storage_dy_x;
+  sum_dy = BlockReduce(temp_storage_dy).Sum(sum_dy);
+  sum_dy_x = BlockReduce(temp_storage_dy_x).Sum(sum_dy_x);
+
+  if (threadIdx.x == 0) {
+    const int num_groups = num_channels / channels_per_group;
+    const int num_stats = gridDim.z * num_groups;
+    const int i = sample_idx * num_groups + ch_idx / channels_per_group;
+    DataType mean, inv_stdev;
+    get_stats(sums, i, num_stats, num_per_group, epsilon, mean, inv_stdev);
+    const DataType s = scale[ch_idx];
+    // The statistics are constant over the plane, so the sum of
+    // dy * xhat follows from the sums of dy and dy * x
+    atomic_add(&scale_gradient[ch_idx], (sum_dy_x - mean * sum_dy) * inv_stdev);
+    atomic_add(&bias_gradient[ch_idx], sum_dy);
+    atomic_add(&grad_sums[i], sum_dy * s);
+    atomic_add(&grad_sums[num_stats + i], sum_dy_x * s);
+  }
+}
+
+template <typename TensorType>
+void backprop_group_sums(int num_groups,
+                         index_t num_per_group,
+                         const TensorType& input,
+                         const TensorType& d_output,
+                         const typename TensorType::data_type* sums,
+                         const TensorType& scale,
+                         TensorType& scale_gradient,
+                         TensorType& bias_gradient,
+                         typename TensorType::data_type* grad_sums,
+                         typename TensorType::data_type epsilon,
+                         h2::gpu::DeviceStream stream)
+{
+    using DataType = typename TensorType::data_type;
+    h2::gpu::mem_zero(scale_gradient.get_buffer(),
+                      scale_gradient.get_local_pitched_size(),
+                      stream);
+    h2::gpu::mem_zero(bias_gradient.get_buffer(),
+                      bias_gradient.get_local_pitched_size(),
+                      stream);
+    const auto& shape = input.get_local_shape();
+    const int num_samples = shape[-1];
+    const int num_channels = shape[-2];
+    if (num_samples == 0)
+        return;
+    h2::gpu::mem_zero(grad_sums, num_samples * num_groups * 2, stream);
+    if (input.get_local_size() == 0)
+        return;
+    auto x = get_plane_geometry(input);
+    auto dy = get_plane_geometry(d_output);
+    assert_eq(x.size, dy.size);
+    const int channels_per_group = num_channels / num_groups;
+    constexpr int block_size = util::reduce_block_size;
+    if (is_vector_aligned({x, dy}))
+    {
+        using DataTypeV = typename util::GetVectorType<DataType, 4>::type;
+        backprop_group_sums_kernel<DataType, DataTypeV, block_size>
+            <<<get_grid_dim(x.size / 4, block_size, num_channels, num_samples),
+               block_size,
+               0,
+               stream>>>(
+                reinterpret_cast<const DataTypeV*>(input.get_const_base_ptr()),
+                reinterpret_cast<const DataTypeV*>(
+                    d_output.get_const_base_ptr()),
+                sums,
+                scale.get_const_base_ptr(),
+                scale_gradient.get_base_ptr(),
+                bias_gradient.get_base_ptr(),
+                grad_sums,
+                epsilon,
+                num_per_group,
+                x.size / 4,
+                x.real_size / 4,
+                dy.real_size / 4,
+                num_channels,
+                channels_per_group);
+    }
+    else
+    {
+        backprop_group_sums_kernel<DataType, DataType, block_size>
+            <<<get_grid_dim(x.size, block_size, num_channels, num_samples),
+               block_size,
+               0,
+               stream>>>(input.get_const_base_ptr(),
+                         d_output.get_const_base_ptr(),
+                         sums,
+                         scale.get_const_base_ptr(),
+                         scale_gradient.get_base_ptr(),
+                         bias_gradient.get_base_ptr(),
+                         grad_sums,
+                         epsilon,
+                         num_per_group,
+                         x.size,
+                         x.real_size,
+                         dy.real_size,
+                         num_channels,
+                         channels_per_group);
+    }
+}
+
+template <typename DataType, typename DataTypeV>
+__global__ void backprop_group_normalization_kernel(
+    const DataTypeV * __restrict__ input,
+    const DataTypeV * __restrict__ d_output,
+    const DataType * __restrict__ sums,
+    const DataType * __restrict__ scale,
+    const DataType * __restrict__ grad_sums,
+    DataTypeV * __restrict__ d_input,
+    DataType epsilon,
+    index_t num_per_group,
+    index_t spatial_size,
+    index_t input_spatial_real_size,
+    index_t d_output_spatial_real_size,
+    index_t d_input_spatial_real_size,
+    int num_channels,
+    int channels_per_group) {
+  const int ch_idx = blockIdx.y;
+  const int sample_idx = blockIdx.z;
+  const int num_groups = num_channels / channels_per_group;
+  const int num_stats = gridDim.z * num_groups;
+  const int stat_idx = sample_idx * num_groups + ch_idx / channels_per_group;
+  DataType mean, inv_stdev;
+  get_stats(sums, stat_idx, num_stats, num_per_group, epsilon, mean,
+            inv_stdev);
+  // Means of dxhat and dxhat * xhat over the group
+  const DataType sum_dxhat = grad_sums[stat_idx];
+  const DataType sum_dxhat_x = grad_sums[num_stats + stat_idx];
+  const DataType mean_dxhat = sum_dxhat / num_per_group;
+  const DataType mean_dxhat_xhat =
+      (sum_dxhat_x - mean * sum_dxhat) * inv_stdev / num_per_group;
+  // dx = inv_stdev * (dy * scale - mean_dxhat - xhat * mean_dxhat_xhat)
+  const DataType a = scale[ch_idx] * inv_stdev;
+  const DataType b = -inv_stdev * inv_stdev * mean_dxhat_xhat;
+  const DataType c = inv_stdev * (mean * inv_stdev * mean_dxhat_xhat
+                                  - mean_dxhat);
+
+  const index_t plane_idx = ch_idx + sample_idx * (index_t)num_channels;
+  input += plane_idx * input_spatial_real_size;
+  d_output += plane_idx * d_output_spatial_real_size;
+  d_input += plane_idx * d_input_spatial_real_size;
+
+  for (index_t i = threadIdx.x + blockIdx.x * blockDim.x; i < spatial_size;
+       i += blockDim.x * gridDim.x) {
+    d_input[i] = d_output[i] * a + input[i] * b + c;
+  }
+}
+
+template <typename TensorType>
+void backprop_group_normalization(
+    int num_groups,
+    index_t num_per_group,
+    const TensorType& input,
+    const TensorType& d_output,
+    const typename TensorType::data_type* sums,
+    const TensorType& scale,
+    const typename TensorType::data_type* grad_sums,
+    TensorType& d_input,
+    typename TensorType::data_type epsilon,
+    h2::gpu::DeviceStream stream)
+{
+    using DataType = typename TensorType::data_type;
+    if (d_input.get_local_size() == 0)
+        return;
+    const auto& shape = input.get_local_shape();
+    const int num_samples = shape[-1];
+    const int num_channels = shape[-2];
+    auto x = get_plane_geometry(input);
+    auto dy = get_plane_geometry(d_output);
+    auto dx = get_plane_geometry(d_input);
+    assert_eq(x.size, dy.size);
+    assert_eq(x.size, dx.size);
+    const int channels_per_group = num_channels / num_groups;
+    constexpr int block_size = util::block_size;
+    if (is_vector_aligned({x, dy, dx}))
+    {
+        using DataTypeV = typename util::GetVectorType<DataType, 4>::type;
+        backprop_group_normalization_kernel<DataType, DataTypeV>
+            <<<get_grid_dim(x.size / 4, block_size, num_channels, num_samples),
+               block_size,
+               0,
+               stream>>>(
+                reinterpret_cast<const DataTypeV*>(input.get_const_base_ptr()),
+                reinterpret_cast<const DataTypeV*>(
+                    d_output.get_const_base_ptr()),
+                sums,
+                scale.get_const_base_ptr(),
+                grad_sums,
+                reinterpret_cast<DataTypeV*>(d_input.get_base_ptr()),
+                epsilon,
+                num_per_group,
+                x.size / 4,
+                x.real_size / 4,
+                dy.real_size / 4,
+                dx.real_size / 4,
+                num_channels,
+                channels_per_group);
+    }
+    else
+    {
+        backprop_group_normalization_kernel<DataType, DataType>
+            <<<get_grid_dim(x.size, block_size, num_channels, num_samples),
+               block_size,
+               0,
+               stream>>>(input.get_const_base_ptr(),
+                         d_output.get_const_base_ptr(),
+                         sums,
+                         scale.get_const_base_ptr(),
+                         grad_sums,
+                         d_input.get_base_ptr(),
+                         epsilon,
+                         num_per_group,
+                         x.size,
+                         x.real_size,
+                         dy.real_size,
+                         dx.real_size,
+                         num_channels,
+                         channels_per_group);
+    }
+}
+
+#define INSTANTIATE(TYPE)                                                      \
+    template void group_sums<Tensor<TYPE>>(int num_groups,                     \
+                                           const Tensor<TYPE>& input,          \
+                                           TYPE* sums,                         \
+                                           h2::gpu::DeviceStream stream);      \
+    template void group_normalization<Tensor<TYPE>>(                           \
+        int num_groups,                                                        \
+        index_t num_per_group,                                                 \
+        const Tensor<TYPE>& input,                                             \
+        const TYPE* sums,                                                      \
+        const Tensor<TYPE>& scale,                                             \
+        const Tensor<TYPE>& bias,                                              \
+        Tensor<TYPE>& output,                                                  \
+        TYPE epsilon,                                                          \
+        h2::gpu::DeviceStream stream);                                         \
+    template void backprop_group_sums<Tensor<TYPE>>(                           \
+        int num_groups,                                                        \
+        index_t num_per_group,                                                 \
+        const Tensor<TYPE>& input,                                             \
+        const Tensor<TYPE>& d_output,                                          \
+        const TYPE* sums,                                                      \
+        const Tensor<TYPE>& scale,                                             \
+        Tensor<TYPE>& scale_gradient,                                          \
+        Tensor<TYPE>& bias_gradient,                                           \
+        TYPE* grad_sums,                                                       \
+        TYPE epsilon,                                                          \
+        h2::gpu::DeviceStream stream);                                         \
+    template void backprop_group_normalization<Tensor<TYPE>>(                  \
+        int num_groups,                                                        \
+        index_t num_per_group,                                                 \
+        const Tensor<TYPE>& input,                                             \
+        const Tensor<TYPE>& d_output,                                          \
+        const TYPE* sums,                                                      \
+        const Tensor<TYPE>& scale,                                             \
+        const TYPE* grad_sums,                                                 \
+        Tensor<TYPE>& d_input,                                                 \
+        TYPE epsilon,                                                          \
+        h2::gpu::DeviceStream stream);
+INSTANTIATE(float)
+INSTANTIATE(double)
+#undef INSTANTIATE
+
+} // namespace groupnorm
+} // namespace distconv
@@ -1,8 +1,12 @@
 #include "distconv/dnn_backend/leaky_relu.hpp"
 #include "distconv/runtime_gpu.hpp"
 #include "distconv/tensor/algorithms_cuda.hpp"
+#include "distconv/util/launch_config.hpp"
 #include "distconv/util/util_mpi.hpp"
 
+#include <algorithm>
+#include <cstdint>
+
 using distconv::tensor::LocaleMPI;
 using distconv::tensor::CUDAAllocator;
 
@@ -64,6 +68,107 @@ void backward(TensorType& input,
     return;
 }
 
+using util::warp_size;
+constexpr int mask_block_size = util::block_size;
+
+/*
+  - Each warp works on consecutive elements, so that the signs of each
+    32 elements are packed into a mask word with one ballot
+  - input and output may be the same buffer
+ */
+template <typename DataType>
+__global__ void forward_masked_kernel(const DataType *input,
+                                      size_t size,
+                                      DataType negative_slope,
+                                      DataType *output,
+                                      uint32_t * __restrict__ mask) {
+  const size_t stride = (size_t)gridDim.x * blockDim.x;
+  for (size_t idx = blockIdx.x * blockDim.x + threadIdx.x;
+       idx - threadIdx.x % warp_size < size; idx += stride) {
+    const bool active = idx < size;
+    const auto x = active ? input[idx] : DataType(0);
+    const bool positive = x > 0;
+    if (active) {
+      output[idx] = positive ? x : x * negative_slope;
+    }
+#if H2_HAS_CUDA
+    const uint32_t bits = __ballot_sync(0xffffffffu, positive);
+    if (threadIdx.x % warp_size == 0) {
+      mask[idx / 32] = bits;
+    }
+#elif H2_HAS_ROCM
+    const uint64_t bits = __ballot(positive);
+    if (threadIdx.x % 32 == 0 && active) {
+      mask[idx / 32] = static_cast<uint32_t>(bits >> (threadIdx.x % warp_size));
+    }
+#endif
+  }
+}
+
+template <typename DataType>
+__global__ void backward_masked_kernel(const uint32_t * __restrict__ mask,
+                                       const DataType *d_output,
+                                       size_t size,
+                                       DataType negative_slope,
+                                       DataType *d_input) {
+  const size_t stride = (size_t)gridDim.x * blockDim.x;
+  for (size_t idx = blockIdx.x * blockDim.x + threadIdx.x; idx < size;
+       idx += stride) {
+    const bool positive = (mask[idx / 32] >> (idx % 32)) & 1;
+    const auto dy = d_output[idx];
+    d_input[idx] = positive ? dy : dy * negative_slope;
+  }
+}
+
+inline int get_mask_grid_size(size_t size) {
+  // Grid-stride loops beyond this
+  constexpr size_t max_grid_size = 65535;
+  return static_cast<int>(std::min(
+      util::ceil(size, (size_t)mask_block_size), max_grid_size));
+}
+
+// The whole local buffers, including halos, are processed, as their
+// layouts are the same.
+template <typename TensorType>
+void forward_masked(const TensorType& input,
+                    typename TensorType::data_type negative_slope,
+                    TensorType& output,
+                    uint32_t* mask,
+                    h2::gpu::DeviceStream stream)
+{
+    using DataType = typename TensorType::data_type;
+    assert_eq(input.get_local_real_shape(), output.get_local_real_shape());
+    const size_t size = input.get_local_real_size();
+    forward_masked_kernel<DataType>
+        <<<get_mask_grid_size(size), mask_block_size, 0, stream>>>(
+            input.get_const_buffer(),
+            size,
+            negative_slope,
+            output.get_buffer(),
+            mask);
+    DISTCONV_CHECK_GPU(GPU_GET_LAST_ERROR());
+}
+
+template <typename TensorType>
+void backward_masked(const uint32_t* mask,
+                     const TensorType& d_output,
+                     typename TensorType::data_type negative_slope,
+                     TensorType& d_input,
+                     h2::gpu::DeviceStream stream)
+{
+    using DataType = typename TensorType::data_type;
+    assert_eq(d_output.get_local_real_shape(), d_input.get_local_real_shape());
+    const size_t size = d_input.get_local_real_size();
+    backward_masked_kernel<DataType>
+        <<<get_mask_grid_size(size), mask_block_size, 0, stream>>>(
+            mask,
+            d_output.get_const_buffer(),
+            size,
+            negative_slope,
+            d_input.get_buffer());
+    DISTCONV_CHECK_GPU(GPU_GET_LAST_ERROR());
+}
+
 #define INSTANTIATE_FORWARD(TYPE)                                              \
     template void forward<Tensor<TYPE>>(Tensor<TYPE> & input,                  \
                                         TYPE negative_slope,                   \
@@ -83,5 +188,22 @@ INSTANTIATE_BACKWARD(float)
 INSTANTIATE_BACKWARD(double)
 #undef INSTANTIATE_BACKWARD
 
+#define INSTANTIATE_MASKED(TYPE)                                               \
+    template void forward_masked<Tensor<TYPE>>(                                \
+        const Tensor<TYPE>& input,                                             \
+        TYPE negative_slope,                                                   \
+        Tensor<TYPE>& output,                                                  \
+        uint32_t* mask,                                                        \
+        h2::gpu::DeviceStream stream);                                         \
+    template void backward_masked<Tensor<TYPE>>(                               \
+        const uint32_t* mask,                                                  \
+        const Tensor<TYPE>& d_output,                                          \
+        TYPE negative_slope,                                                   \
+        Tensor<TYPE>& d_input,                                                 \
+        h2::gpu::DeviceStream stream);
+INSTANTIATE_MASKED(float)
+INSTANTIATE_MASKED(double)
+#undef INSTANTIATE_MASKED
+
 } // namespace leaky_relu
 } // namespace distconv
@@ -1,3 +1,4 @@
+#include "distconv/dnn_backend/loss_reduce_cuda.hpp"
 #include "distconv/dnn_backend/mean_squared_error.hpp"
 #include "distconv/runtime_gpu.hpp"
 #include "distconv/tensor/algorithms_cuda.hpp"
@@ -6,14 +7,6 @@
 
 #include <limits>
 
-#if H2_HAS_CUDA
-#include <cub/block/block_reduce.cuh>
-namespace cubns = cub;
-#elif H2_HAS_ROCM
-#include <hipcub/block/block_reduce.hpp>
-namespace cubns = hipcub;
-#endif
-
 using distconv::tensor::LocaleMPI;
 using distconv::tensor::CUDAAllocator;
 
@@ -25,46 +18,19 @@ using MeanSquaredErrorCUDNN =
 namespace distconv {
 namespace mean_squared_error {
 
-/*
-  - gridDim.y == number of samples
-  - Each sample is taken care by gridDim.x blocks
-*/
-template <typename DataType, int BLOCK_SIZE>
-__global__ void fp_local(const DataType * __restrict__ prediction,
-                         const DataType * __restrict__ ground_truth,
-                         DataType * __restrict__ y,
-                         const index_t sample_size,
-                         const index_t sample_spatial_size,
-                         const index_t sample_channel_size,
-                         int thread_work_size) {
-  const int tid = threadIdx.x;
-  const int sample_idx = blockIdx.y;
-
-  prediction += sample_idx * sample_size;
-  ground_truth += sample_idx * sample_size;
-
-  index_t offset = tid + blockIdx.x * BLOCK_SIZE;
-  const int offset_stride = BLOCK_SIZE * gridDim.x;
-  const index_t offset_limit = min(
-      sample_size, offset + offset_stride * thread_work_size);
-
-  auto psum = DataType(0.);
-  for (; offset < offset_limit; offset += offset_stride) {
-    const DataType x = prediction[offset];
-    const DataType xhat = ground_truth[offset];
-    const DataType err = x - xhat;
-    psum += err * err;
-  }
-
-  using BlockReduce = cubns::BlockReduce<DataType, BLOCK_SIZE>;
-  __shared__ typename BlockReduce::TempStorage temp_storage;
-  psum = BlockReduce(temp_storage).Sum(psum) / sample_size;
-
-  if (tid == 0) {
-    atomic_add(&y[sample_idx], psum);
+// Squared error of an element of a sample
+template <typename DataType>
+struct squared_error {
+  const DataType * __restrict__ prediction;
+  const DataType * __restrict__ ground_truth;
+  index_t sample_size;
+  __device__ __forceinline__ DataType operator()(int sample_idx,
+                                                 index_t offset) const {
+    const auto idx = sample_idx * sample_size + offset;
+    const DataType err = prediction[idx] - ground_truth[idx];
+    return err * err;
   }
-}
-
+};
 
 /*
   - gridDim.y == number of samples
@@ -79,6 +45,7 @@ __global__ void bp_local(const DataType * __restrict__ x_pred,
                          const index_t sample_size,
                          const index_t sample_spatial_size,
                          const index_t sample_channel_size,
+                         const DataType scale,
                          int thread_work_size) {
   const int tid = threadIdx.x;
   const int sample_idx = blockIdx.y;
@@ -94,7 +61,6 @@ __global__ void bp_local(const DataType * __restrict__ x_pred,
       sample_size, offset + offset_stride * thread_work_size);
 
   const auto dy_sample = dy[sample_idx];
-  const DataType scale = static_cast<DataType>(DataType(2) / sample_size);
   for (; offset < offset_limit; offset += offset_stride) {
     const DataType x = x_pred[offset];
     const DataType xhat = x_truth[offset];
@@ -114,9 +80,6 @@ int MeanSquaredErrorCUDNN::forward(const Tensor &x_pred, const Tensor &x_truth,
       << "Mean squared error FP: " << x_pred << ", "
       << x_truth << ", " << y;
 
-  constexpr int block_size = 256;
-  constexpr int thread_work_size = 8;
-
   // Assumes no halo for simplicity
   assert_eq(x_pred.get_local_size(), x_pred.get_local_real_size());
   assert_eq(x_truth.get_local_size(), x_truth.get_local_real_size());
@@ -125,31 +88,20 @@ int MeanSquaredErrorCUDNN::forward(const Tensor &x_pred, const Tensor &x_truth,
 
   if (num_samples == 0) return 0;
 
-  y.zero(m_be.get_stream());
-
-  if (x_pred.get_local_size() > 0) {
-    auto sample_size = x_pred.get_local_size() / num_samples;
-    auto num_blocks_per_sample = util::ceil(
-        sample_size, (index_t)block_size * thread_work_size);
-
-    dim3 bdim(block_size);
-    dim3 gdim(num_blocks_per_sample, num_samples);
-
-    const auto sample_channel_size = x_pred.get_local_shape()[x_pred.get_num_spatial_dims()];
-    const auto sample_spatial_size = sample_size / sample_channel_size;
-    assert_eq(sample_channel_size*sample_spatial_size, sample_size);
-
-    mean_squared_error::fp_local<DataType, block_size>
-        <<<gdim, bdim, 0, m_be.get_stream()>>>(
-            x_pred.get_const_buffer(), x_truth.get_const_buffer(),
-            y.get_buffer(), sample_size, sample_spatial_size,
-            sample_channel_size, thread_work_size);
-  }
+  // The local partial sums are already divided by the global sample
+  // size, so that the allreduce yields the mean.
+  const auto sample_size = x_pred.get_local_size() / num_samples;
+  const auto scale = DataType(1) / get_global_sample_size(x_pred);
+  loss_reduce::reduce_per_sample(
+      num_samples, sample_size,
+      mean_squared_error::squared_error<DataType>{
+          x_pred.get_const_buffer(), x_truth.get_const_buffer(),
+          sample_size},
+      scale, y.get_buffer(), m_be.get_stream());
 
   if (m_num_procs_per_sample > 1) {
-    Al::Allreduce<Al::NCCLBackend, DataType>(
-        y.get_buffer(), num_samples,
-        Al::ReductionOperator::sum, *m_al.get());
+    m_al->allreduce(y.get_buffer(), num_samples,
+                    Al::ReductionOperator::sum);
   }
 
   return 0;
@@ -165,9 +117,7 @@ int MeanSquaredErrorCUDNN::backward(const Tensor &x_pred, const Tensor &x_truth,
 
   if (m_num_procs_per_sample > 1) {
     const auto num_samples = x_pred.get_local_shape()[-1];
-    Al::Bcast<Al::NCCLBackend, DataType>(
-        dy.get_buffer(), num_samples, 0,
-        *m_al.get());
+    m_al->bcast(dy.get_buffer(), num_samples, 0);
   }
 
   constexpr int block_size = 256;
@@ -197,7 +147,7 @@ int MeanSquaredErrorCUDNN::backward(const Tensor &x_pred, const Tensor &x_truth,
           dy.get_const_buffer(),
           dx_pred.get_buffer(), dx_truth.get_buffer(),
           sample_size, sample_spatial_size, sample_channel_size,
-          thread_work_size);
+          DataType(2) / get_global_sample_size(x_pred), thread_work_size);
   return 0;
 }
 
@@ -1,11 +1,31 @@
 #include "distconv/dnn_backend/backend.hpp"
 #include "h2/gpu/logger.hpp"
 
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <stdexcept>
+#include <tuple>
 #include <variant>
 #include <vector>
 
+// Note: The behavior of functions in this file may be impacted by the
+// following user-provided environment variables:
+//
+//   - H2_DISTCONV_FORCE_PACKED (bool): Whether the proxies pack and
+//                                      unpack strided tensors. Default:
+//                                      true on ROCm, false otherwise.
+//
+//   - H2_DISTCONV_PACKED_CACHE_SIZE (uint64): Maximum bytes of packed
+//                                             shadows kept for reuse by
+//                                             later proxies. Default: 0
+//                                             (no cache).
+
 #if H2_HAS_CUDA
 #define H2_DNN_BACKEND_NS cudnn
 #elif H2_HAS_ROCM
@@ -92,13 +112,16 @@ host_scalar make_host_scalar(DataType_t const dt, double const v)
     switch (dt)
     {
     case CUDNN_DATA_FLOAT: [[fallthrough]];
+#ifdef DISTCONV_HAS_CUDNN_BFLOAT16
+    case CUDNN_DATA_BFLOAT16: [[fallthrough]];
+#endif // DISTCONV_HAS_CUDNN_BFLOAT16
     case CUDNN_DATA_HALF:
         return host_scalar{static_cast<float>(v)};
     case CUDNN_DATA_DOUBLE:
         return host_scalar{v};
     default:
         throw std::runtime_error(
-            "Only float, double, and half are supported.");
+            "Only float, double, half, and bfloat16 are supported.");
     }
 #elif H2_HAS_ROCM
     switch (dt)
@@ -119,9 +142,12 @@ size_t datatype_size(DataType_t dt)
     case CUDNN_DATA_FLOAT: return sizeof(float);
     case CUDNN_DATA_DOUBLE: return sizeof(double);
     case CUDNN_DATA_HALF: return sizeof(short);
+#ifdef DISTCONV_HAS_CUDNN_BFLOAT16
+    case CUDNN_DATA_BFLOAT16: return sizeof(short);
+#endif // DISTCONV_HAS_CUDNN_BFLOAT16
     default:
         throw std::runtime_error(
-            "Only float, double, and half are supported.");
+            "Only float, double, half, and bfloat16 are supported.");
     }
 #elif H2_HAS_ROCM
     switch (dt)
@@ -227,16 +253,56 @@ TensorDescriptor_t make_backend_desc(MyTensorDesc my_desc)
     return desc;
 }
 
+// Descriptors shared by key, which the proxies would otherwise create
+// and destroy around every backend call
+class SharedDescriptorCache
+{
+public:
+    SharedTensorDescriptor get(MyTensorDesc desc)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto key = std::make_tuple(desc.dt, desc.dims, desc.strides);
+        auto it = m_descs.find(key);
+        if (it != m_descs.end())
+            return it->second;
+        SharedTensorDescriptor shared(
+            make_backend_desc(std::move(desc)),
+            [](TensorDescriptor_t d) { destroy_tensor_descriptor(d); });
+        m_descs.emplace(std::move(key), shared);
+        return shared;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_descs.clear();
+    }
+
+private:
+    using Key = std::tuple<DataType_t, std::vector<int>, std::vector<int>>;
+    std::mutex m_mutex;
+    std::map<Key, SharedTensorDescriptor> m_descs;
+};
+
+// Never destroyed, like the shadow cache
+SharedDescriptorCache& get_descriptor_cache()
+{
+    static auto* cache = new SharedDescriptorCache;
+    return *cache;
+}
+
 // If the input tensor descriptor is already packed, then return it
-// directly. Otherwise, create a new handle and set it up with the
-// same dimensions but fully packed strides.
-TensorDescriptor_t get_packed_desc(TensorDescriptor_t desc)
+// directly. Otherwise, return a shared descriptor with the same
+// dimensions but fully packed strides, which ref holds.
+TensorDescriptor_t get_packed_desc(TensorDescriptor_t desc,
+                                   SharedTensorDescriptor& ref)
 {
     auto const [dt, dims, strides] = get_details(desc);
     if (is_fully_packed(dims, strides))
         return desc;
-    else
-        return make_backend_desc({dt, dims, get_fully_packed_strides(dims)});
+    ref = get_descriptor_cache().get(
+        {dt, dims, get_fully_packed_strides(dims)});
+    return ref.get();
 }
 
 struct MyTypeErasedPtr
@@ -255,13 +321,132 @@ MyTypeErasedPtr allocate(Handle_t handle, TensorDescriptor_t desc)
     // Stream-aware allocation
     void* data;
     DISTCONV_CHECK_GPU(
-        h2::gpu::default_cub_allocator().DeviceAllocate(
+        h2::gpu::default_device_allocator().allocate(
             &data,
             mem_size,
             get_stream(handle)));
     return {data, dt};
 }
 
+// Frees a packed buffer once neither the cache nor a proxy uses it
+std::shared_ptr<void> make_shadow(void* data)
+{
+    return std::shared_ptr<void>(data, [](void* ptr) {
+        auto const status =
+            h2::gpu::default_device_allocator().deallocate(ptr);
+        if (!h2::gpu::ok(status))
+            H2_GPU_WARN("could not free a packed shadow");
+    });
+}
+
+size_t packed_cache_size() noexcept
+{
+    static size_t const val = []() {
+        char const* env = std::getenv("H2_DISTCONV_PACKED_CACHE_SIZE");
+        return env ? static_cast<size_t>(std::atoll(env)) : 0UL;
+    }();
+    return val;
+}
+
+// Packed copies of strided tensors, most recently used first. A
+// shadow is only reused on the stream it was packed on, which orders
+// the packing, its uses and its deallocation without events.
+class PackedShadowCache
+{
+public:
+    std::shared_ptr<void> find(void const* data,
+                               MyTensorDesc const& desc,
+                               h2::gpu::DeviceStream stream)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_shadows.begin(); it != m_shadows.end(); ++it)
+        {
+            if (it->data == data && it->stream == stream
+                && it->desc.dt == desc.dt && it->desc.dims == desc.dims
+                && it->desc.strides == desc.strides)
+            {
+                m_shadows.splice(m_shadows.begin(), m_shadows, it);
+                return it->packed;
+            }
+        }
+        return nullptr;
+    }
+
+    void insert(void const* data,
+                MyTensorDesc desc,
+                h2::gpu::DeviceStream stream,
+                std::shared_ptr<void> packed,
+                size_t packed_bytes)
+    {
+        if (packed_bytes > packed_cache_size())
+            return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t const bytes = desc.memory_size();
+        erase_overlapping(data, bytes);
+        m_shadows.push_front(Shadow{
+            data, bytes, std::move(desc), stream, std::move(packed),
+            packed_bytes});
+        m_packed_bytes += packed_bytes;
+        while (m_packed_bytes > packed_cache_size())
+        {
+            m_packed_bytes -= m_shadows.back().packed_bytes;
+            m_shadows.pop_back();
+        }
+    }
+
+    void invalidate(void const* data, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        erase_overlapping(data, bytes);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shadows.clear();
+        m_packed_bytes = 0;
+    }
+
+private:
+    struct Shadow
+    {
+        void const* data;
+        size_t bytes;
+        MyTensorDesc desc;
+        h2::gpu::DeviceStream stream;
+        std::shared_ptr<void> packed;
+        size_t packed_bytes;
+    };
+
+    std::mutex m_mutex;
+    std::list<Shadow> m_shadows;
+    size_t m_packed_bytes = 0;
+
+    void erase_overlapping(void const* data, size_t bytes)
+    {
+        auto const begin = reinterpret_cast<uintptr_t>(data);
+        for (auto it = m_shadows.begin(); it != m_shadows.end();)
+        {
+            auto const shadow_begin = reinterpret_cast<uintptr_t>(it->data);
+            if (shadow_begin < begin + bytes
+                && begin < shadow_begin + it->bytes)
+            {
+                m_packed_bytes -= it->packed_bytes;
+                it = m_shadows.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+};
+
+// Never destroyed: shadows may be released by static objects at exit.
+PackedShadowCache& get_shadow_cache()
+{
+    static auto* cache = new PackedShadowCache;
+    return *cache;
+}
+
 void copy_tensor(
     Handle_t handle,
     host_scalar const& alpha,
@@ -308,6 +493,30 @@ void copy_tensor(
 
 }// namespace
 
+void invalidate_packed_shadows(void const* data, size_t bytes)
+{
+    if (packed_cache_size() != 0)
+        get_shadow_cache().invalidate(data, bytes);
+}
+
+void clear_packed_shadows()
+{
+    get_shadow_cache().clear();
+}
+
+SharedTensorDescriptor
+get_shared_tensor_descriptor(DataType_t dt,
+                             std::vector<int> const& dims,
+                             std::vector<int> const& strides)
+{
+    return get_descriptor_cache().get({dt, dims, strides});
+}
+
+void clear_shared_tensor_descriptors()
+{
+    get_descriptor_cache().clear();
+}
+
 // Read proxy impl
 
 PackedTensorReadProxy::PackedTensorReadProxy(TensorDescriptor_t unpacked_desc,
@@ -318,7 +527,7 @@ PackedTensorReadProxy::PackedTensorReadProxy(TensorDescriptor_t unpacked_desc,
       m_packed_data{nullptr}
 {
     if (force || do_pack_unpack())
-        m_packed_desc = get_packed_desc(m_unpacked_desc);
+        m_packed_desc = get_packed_desc(m_unpacked_desc, m_packed_desc_ref);
 }
 
 PackedTensorReadProxy::PackedTensorReadProxy(Handle_t handle,
@@ -331,14 +540,37 @@ PackedTensorReadProxy::PackedTensorReadProxy(Handle_t handle,
       m_packed_data{nullptr}
 {
     if (force || do_pack_unpack())
-        m_packed_desc = get_packed_desc(m_unpacked_desc);
+        m_packed_desc = get_packed_desc(m_unpacked_desc, m_packed_desc_ref);
 
     if (m_unpacked_desc == m_packed_desc)
         m_packed_data = const_cast<void*>(m_unpacked_data);
+    else if (packed_cache_size() == 0)
+    {
+        DataType_t dt;
+        std::tie(m_packed_data, dt) = allocate(handle, m_packed_desc);
+        copy_tensor(handle,
+                    make_host_scalar(dt, 1.0),
+                    m_unpacked_desc,
+                    m_unpacked_data,
+                    make_host_scalar(dt, 0.0),
+                    m_packed_desc,
+                    m_packed_data);
+    }
     else
     {
+        auto& cache = get_shadow_cache();
+        auto const stream = get_stream(handle);
+        auto desc = get_details(m_unpacked_desc);
+        m_shadow = cache.find(m_unpacked_data, desc, stream);
+        if (m_shadow)
+        {
+            H2_GPU_TRACE("reusing the packed shadow of {}", m_unpacked_data);
+            m_packed_data = m_shadow.get();
+            return;
+        }
         DataType_t dt;
         std::tie(m_packed_data, dt) = allocate(handle, m_packed_desc);
+        m_shadow = make_shadow(m_packed_data);
         copy_tensor(handle,
                     make_host_scalar(dt, 1.0),
                     m_unpacked_desc,
@@ -346,21 +578,31 @@ PackedTensorReadProxy::PackedTensorReadProxy(Handle_t handle,
                     make_host_scalar(dt, 0.0),
                     m_packed_desc,
                     m_packed_data);
+        cache.insert(m_unpacked_data,
+                     std::move(desc),
+                     stream,
+                     m_shadow,
+                     get_details(m_packed_desc).memory_size());
     }
 }
 
 PackedTensorReadProxy::~PackedTensorReadProxy()
 {
-    if ((m_packed_data != m_unpacked_data)
+    if (m_shadow)
+    {
+        m_shadow.reset();
+        m_packed_data = nullptr;
+        m_unpacked_data = nullptr;
+    }
+    else if ((m_packed_data != m_unpacked_data)
         && m_packed_data)
     {
         DISTCONV_CHECK_GPU(
-            h2::gpu::default_cub_allocator().DeviceFree(m_packed_data));
+            h2::gpu::default_device_allocator().deallocate(m_packed_data));
         m_packed_data = nullptr;
         m_unpacked_data = nullptr;
     }
-    if (m_unpacked_desc != m_packed_desc)
-        destroy_tensor_descriptor(m_packed_desc);
+    m_packed_desc_ref.reset();
     m_packed_desc = 0;
     m_unpacked_desc = 0;
 }
@@ -375,7 +617,7 @@ PackedTensorWriteProxy::PackedTensorWriteProxy(TensorDescriptor_t unpacked_desc,
       m_packed_data{nullptr}
 {
     if (force || do_pack_unpack())
-        m_packed_desc = get_packed_desc(unpacked_desc);
+        m_packed_desc = get_packed_desc(unpacked_desc, m_packed_desc_ref);
 }
 
 PackedTensorWriteProxy::PackedTensorWriteProxy(Handle_t handle,
@@ -390,7 +632,11 @@ PackedTensorWriteProxy::PackedTensorWriteProxy(Handle_t handle,
       m_handle{handle}
 {
     if (force || do_pack_unpack())
-        m_packed_desc = get_packed_desc(unpacked_desc);
+        m_packed_desc = get_packed_desc(unpacked_desc, m_packed_desc_ref);
+
+    if (packed_cache_size() != 0)
+        get_shadow_cache().invalidate(
+            m_unpacked_data, get_details(m_unpacked_desc).memory_size());
 
     // When "unpacked" == "packed", we don't actually need dt, so we
     // leave it as the default.
@@ -431,10 +677,17 @@ PackedTensorWriteProxy::PackedTensorWriteProxy(Handle_t handle,
 // though, with std::uncaught_exceptions().
 PackedTensorWriteProxy::~PackedTensorWriteProxy()
 {
+    // Shadows may have been packed from the tensor by read proxies
+    // constructed after this one.
+    if (m_unpacked_data && m_unpacked_data == m_packed_data
+        && packed_cache_size() != 0)
+        get_shadow_cache().invalidate(
+            m_unpacked_data, get_details(m_unpacked_desc).memory_size());
     if ((m_unpacked_data != m_packed_data)
         && m_packed_data)
     {
-        if (!std::uncaught_exceptions())
+        bool const copied = !std::uncaught_exceptions();
+        if (copied)
         {
             copy_tensor(m_handle,
                         make_host_scalar(m_dt, 1.0),
@@ -444,12 +697,22 @@ PackedTensorWriteProxy::~PackedTensorWriteProxy()
                         m_unpacked_desc,
                         m_unpacked_data);
         }
-        DISTCONV_CHECK_GPU(h2::gpu::default_cub_allocator().DeviceFree(m_packed_data));
+        if (copied && packed_cache_size() != 0)
+        {
+            // The packed buffer now holds the values of the tensor.
+            get_shadow_cache().insert(
+                m_unpacked_data,
+                get_details(m_unpacked_desc),
+                get_stream(m_handle),
+                make_shadow(m_packed_data),
+                get_details(m_packed_desc).memory_size());
+        }
+        else
+            DISTCONV_CHECK_GPU(h2::gpu::default_device_allocator().deallocate(m_packed_data));
         m_packed_data = nullptr;
         m_unpacked_data = nullptr;
     }
-    if (m_unpacked_desc != m_packed_desc)
-        destroy_tensor_descriptor(m_packed_desc);
+    m_packed_desc_ref.reset();
     m_packed_desc = 0;
     m_unpacked_desc = 0;
 }
@@ -2,6 +2,8 @@
 #include "distconv/runtime_gpu.hpp"
 #include "distconv/util/util_mpi.hpp"
 
+#include <cstdint>
+
 namespace {
 
 //using namespace distconv;
@@ -16,113 +18,426 @@ using Array = tensor::Array<ND>;
 template <typename DataType>
 using Tensor = tensor::Tensor<DataType, tensor::LocaleMPI, tensor::CUDAAllocator>;
 
+// Pooling parameters of the spatial dimensions, padded to ND
+template <int ND>
+Array<ND, int> get_spatial_params(const dc::int_vector &params, int fill) {
+  Array<ND, int> a(fill);
+  for (size_t i = 0; i < params.size(); ++i) {
+    a[i] = params[i];
+  }
+  return a;
+}
+
+// Each thread computes one output element and records the offset of
+// the maximum within its window. The windows are read from the
+// halo-exchanged input, whose halos work as padding.
 template <int ND, typename DataType>
-__global__ void bp_accumulate_sum_kernel(DataType *tensor,
-                                         const Array<ND> tensor_shape,
-                                         const Array<ND> dst_offset,
-                                         const Array<ND> src_offset,
-                                         const Array<ND> region) {
-  index_t idx = threadIdx.x + blockIdx.x * blockDim.x;
-  if (idx >= region.get_size()) return;
-  Array<ND> offset;
+__global__ void max_pool_argmax_kernel(const DataType *input,
+                                       const Array<ND> input_dims,
+                                       const Array<ND> input_shape,
+                                       DataType *output,
+                                       const Array<ND> output_dims,
+                                       const Array<ND> output_shape,
+                                       const Array<ND, int> windows,
+                                       const Array<ND, int> pads,
+                                       const Array<ND, int> strides,
+                                       DataType alpha,
+                                       DataType beta,
+                                       uint8_t *argmax) {
+  const index_t num_outputs = output_dims.get_size();
+  const index_t gidx = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  if (gidx >= num_outputs) return;
+  index_t idx = gidx;
+  Array<ND> out_idx;
+  Array<ND, int> start;
   for (int i = 0; i < ND; ++i) {
-    offset[i] = idx % region[i];
-    idx = idx / region[i];
+    out_idx[i] = idx % output_dims[i];
+    idx = idx / output_dims[i];
+    start[i] = (int)out_idx[i] * strides[i] - pads[i];
+  }
+
+  DataType acc = DataType(0);
+  int acc_k = 0;
+  bool found = false;
+  const int window_size = windows.get_size();
+  for (int k = 0; k < window_size; ++k) {
+    Array<ND> in_idx;
+    bool is_pad = false;
+    for (int i = 0, x = k; i < ND; ++i) {
+      const int j = start[i] + x % windows[i];
+      x /= windows[i];
+      is_pad |= j < 0 || j >= (int)input_dims[i];
+      in_idx[i] = j;
+    }
+    if (is_pad) continue;
+    const DataType v = input[tensor::get_offset(in_idx, input_shape)];
+    if (!found || v > acc) {
+      acc = v;
+      acc_k = k;
+      found = true;
+    }
   }
-  DataType src = tensor[tensor::get_offset(src_offset + offset, tensor_shape)];
-  DataType &dst = tensor[tensor::get_offset(dst_offset + offset, tensor_shape)];
-  dst += src;
-#if 0
-  if (blockIdx.x == 0 && threadIdx.x < 32) {
-    printf("DST: %d\n",
-           (int)tensor::get_offset(dst_offset + offset, tensor_shape));
+  argmax[gidx] = static_cast<uint8_t>(acc_k);
+  DataType &y = output[tensor::get_offset(out_idx, output_shape)];
+  y = beta == DataType(0) ? alpha * acc : alpha * acc + beta * y;
+}
+
+// Adds the gradient of each output element to the input element
+// recorded by max_pool_argmax_kernel. Gradients of halo elements are
+// left in the halos of d_input for the reverse halo exchange.
+template <int ND, typename DataType>
+__global__ void max_pool_scatter_kernel(const DataType *d_output,
+                                        const Array<ND> output_dims,
+                                        const Array<ND> output_shape,
+                                        const uint8_t *argmax,
+                                        const Array<ND, int> windows,
+                                        const Array<ND, int> pads,
+                                        const Array<ND, int> strides,
+                                        DataType alpha,
+                                        DataType *d_input,
+                                        const Array<ND> d_input_shape) {
+  const index_t num_outputs = output_dims.get_size();
+  const index_t gidx = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  if (gidx >= num_outputs) return;
+  index_t idx = gidx;
+  Array<ND> out_idx;
+  Array<ND> in_idx;
+  int k = argmax[gidx];
+  for (int i = 0; i < ND; ++i) {
+    out_idx[i] = idx % output_dims[i];
+    idx = idx / output_dims[i];
+    in_idx[i] = (int)out_idx[i] * strides[i] - pads[i] + k % windows[i];
+    k /= windows[i];
   }
-#endif
+  const DataType dy = d_output[tensor::get_offset(out_idx, output_shape)];
+  atomic_add(&d_input[tensor::get_offset(in_idx, d_input_shape)], alpha * dy);
 }
 
 template <int ND, typename DataType>
-void bp_accumulate_sum_nd(Tensor<DataType> &tensor,
-                          const dc::IndexVector &dst,
-                          const dc::IndexVector &src,
-                          const dc::tensor::Shape &shape) {
-  auto size = shape.get_size();
+void max_pool_argmax_nd(DataType alpha,
+                        const Tensor<DataType> &input,
+                        const dc::IntVector &halo_bwd_recv,
+                        const dc::IntVector &halo_fwd_recv,
+                        DataType beta,
+                        Tensor<DataType> &output,
+                        const Array<ND, int> &windows,
+                        const Array<ND, int> &pads,
+                        const Array<ND, int> &strides,
+                        uint8_t *argmax,
+                        h2::gpu::DeviceStream stream) {
+  const DataType *input_ptr = input.get_const_base_ptr()
+      - input.get_local_offset(dc::IndexVector(halo_bwd_recv), true);
+  auto input_dims = input.get_local_shape();
+  for (int i = 0; i < ND; ++i) {
+    input_dims[i] += halo_bwd_recv[i] + halo_fwd_recv[i];
+  }
+  const auto output_dims = output.get_local_shape();
+  const index_t num_outputs = output_dims.get_size();
   const int bsize = 256;
-  int gsize = (size + bsize - 1) / bsize;
-  util::MPIPrintStreamDebug() <<
-    "Accumulating " << src << " to " << dst << " of sub tensor with shape "
-                    << shape << " of "
-                    << tensor.get_local_pitched_shape()
-                    << "\n";
-
-#if 0
-  {
-    DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
-    DataType *h = nullptr;
-    size_t s = tensor.get_local_real_size() * sizeof(DataType);
-    cudaMallocHost(&h, s);
-    DISTCONV_CHECK_CUDA(cudaMemcpy(h, tensor.get_buffer(), s,
-                                   cudaMemcpyDeviceToHost));
-    std::ofstream out;
-    out.open("before.out",
-             std::ios::out | std::ios::trunc | std::ios::binary);
-    out.write((char *)h, s);
-    out.close();
-    DISTCONV_CHECK_CUDA(cudaFreeHost(h));
+  const index_t gsize = (num_outputs + bsize - 1) / bsize;
+  max_pool_argmax_kernel<ND, DataType><<<gsize, bsize, 0, stream>>>(
+      input_ptr, input_dims, input.get_local_pitched_shape(),
+      output.get_base_ptr(), output_dims, output.get_local_pitched_shape(),
+      windows, pads, strides, alpha, beta, argmax);
+}
+
+template <int ND, typename DataType>
+void max_pool_scatter_nd(DataType alpha,
+                         const Tensor<DataType> &d_output,
+                         const uint8_t *argmax,
+                         const dc::IntVector &halo_bwd_recv,
+                         Tensor<DataType> &d_input,
+                         const Array<ND, int> &windows,
+                         const Array<ND, int> &pads,
+                         const Array<ND, int> &strides,
+                         h2::gpu::DeviceStream stream) {
+  DataType *d_input_ptr = d_input.get_base_ptr()
+      - d_input.get_local_offset(dc::IndexVector(halo_bwd_recv), true);
+  const auto output_dims = d_output.get_local_shape();
+  const index_t num_outputs = output_dims.get_size();
+  const int bsize = 256;
+  const index_t gsize = (num_outputs + bsize - 1) / bsize;
+  max_pool_scatter_kernel<ND, DataType><<<gsize, bsize, 0, stream>>>(
+      d_output.get_const_base_ptr(), output_dims,
+      d_output.get_local_pitched_shape(), argmax, windows, pads, strides,
+      alpha, d_input_ptr, d_input.get_local_pitched_shape());
+}
+
+#ifdef DISTCONV_HAS_NVSHMEM
+
+enum class FusedPoolingMode {MAX, AVERAGE, AVERAGE_NO_PAD};
+
+// Halos of the partitioned dimension. Input indices of the dimension
+// in [0, begin) and [end, ...) are in the LHS and RHS halos,
+// respectively.
+template <int ND, typename DataType>
+struct FusedHalo {
+  tensor::HaloRecvDevice<DataType> recv[2];
+  int dim;
+  index_t begin;
+  index_t end;
+  // Shape of the packed halo regions
+  Array<ND> region_shape;
+};
+
+template <int ND, typename DataType>
+__device__ __forceinline__ DataType load_fused_halo(
+    const DataType *input, const Array<ND> &input_shape,
+    const FusedHalo<ND, DataType> &halo, const Array<ND> &idx) {
+  const int dim = halo.dim;
+  if (idx[dim] < halo.begin && halo.recv[dc::LHS].m_buf) {
+    auto r = idx;
+    r[dim] = halo.region_shape[dim] - halo.begin + idx[dim];
+    return halo.recv[dc::LHS].m_buf[tensor::get_offset(r, halo.region_shape)];
+  } else if (idx[dim] >= halo.end && halo.recv[dc::RHS].m_buf) {
+    auto r = idx;
+    r[dim] = idx[dim] - halo.end;
+    return halo.recv[dc::RHS].m_buf[tensor::get_offset(r, halo.region_shape)];
+  }
+  return input[tensor::get_offset(idx, input_shape)];
+}
+
+// Each thread computes one output element. Blocks whose windows
+// cover a halo wait for its notification, so the others run while
+// the halos are in flight.
+template <int ND, typename DataType, FusedPoolingMode mode>
+__global__ void pool_fused_halo_kernel(const DataType *input,
+                                       const Array<ND> input_dims,
+                                       const Array<ND> input_shape,
+                                       DataType *output,
+                                       const Array<ND> output_dims,
+                                       const Array<ND> output_shape,
+                                       const Array<ND, int> windows,
+                                       const Array<ND, int> pads,
+                                       const Array<ND, int> strides,
+                                       FusedHalo<ND, DataType> halo,
+                                       DataType alpha,
+                                       DataType beta) {
+  const index_t num_outputs = output_dims.get_size();
+  index_t idx = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  Array<ND> out_idx;
+  // Start of the window, which is negative when padded
+  Array<ND, int> start;
+  bool wait_lhs = false;
+  bool wait_rhs = false;
+  if (idx < num_outputs) {
+    for (int i = 0; i < ND; ++i) {
+      out_idx[i] = idx % output_dims[i];
+      idx = idx / output_dims[i];
+      start[i] = (int)out_idx[i] * strides[i] - pads[i];
+    }
+    const int dim = halo.dim;
+    wait_lhs = halo.recv[dc::LHS].m_buf && start[dim] < (int)halo.begin;
+    wait_rhs = halo.recv[dc::RHS].m_buf
+        && start[dim] + windows[dim] > (int)halo.end;
+  }
+  wait_lhs = __syncthreads_or(wait_lhs);
+  wait_rhs = __syncthreads_or(wait_rhs);
+  if (threadIdx.x == 0) {
+    if (wait_lhs) halo.recv[dc::LHS].m_sync.wait();
+    if (wait_rhs) halo.recv[dc::RHS].m_sync.wait();
   }
-#endif
-
-  bp_accumulate_sum_kernel<ND><<<gsize, bsize>>>(tensor.get_buffer(),
-                                                 tensor.get_local_pitched_shape(),
-                                                 dst, src, shape);
-#if 0
-  {
-    DataType *h = nullptr;
-    size_t s = tensor.get_local_real_size() * sizeof(DataType);
-    cudaMallocHost(&h, s);
-    DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
-    DISTCONV_CHECK_CUDA(cudaMemcpy(h, tensor.get_buffer(), s,
-                                   cudaMemcpyDeviceToHost));
-    std::ofstream out;
-    out.open("after.out",
-             std::ios::out | std::ios::trunc | std::ios::binary);
-    out.write((char *)h, s);
-    out.close();
-    DISTCONV_CHECK_CUDA(cudaFreeHost(h));
+  __syncthreads();
+  if (threadIdx.x + blockIdx.x * (index_t)blockDim.x >= num_outputs) return;
+
+  DataType acc = DataType(0);
+  int count = 0;
+  const int window_size = windows.get_size();
+  for (int k = 0; k < window_size; ++k) {
+    Array<ND> in_idx;
+    bool is_pad = false;
+    for (int i = 0, x = k; i < ND; ++i) {
+      const int j = start[i] + x % windows[i];
+      x /= windows[i];
+      is_pad |= j < 0 || j >= (int)input_dims[i];
+      in_idx[i] = j;
+    }
+    if (is_pad) continue;
+    const DataType v = load_fused_halo(input, input_shape, halo, in_idx);
+    if (mode == FusedPoolingMode::MAX) {
+      acc = count == 0 || v > acc ? v : acc;
+    } else {
+      acc += v;
+    }
+    ++count;
+  }
+  if (mode == FusedPoolingMode::AVERAGE) {
+    acc /= DataType(window_size);
+  } else if (mode == FusedPoolingMode::AVERAGE_NO_PAD && count > 0) {
+    acc /= DataType(count);
+  }
+  DataType &y = output[tensor::get_offset(out_idx, output_shape)];
+  y = beta == DataType(0) ? alpha * acc : alpha * acc + beta * y;
+}
+
+template <int ND, FusedPoolingMode mode, typename DataType>
+void pool_fused_halo_nd(DataType alpha,
+                        const Tensor<DataType> &input,
+                        const dc::IntVector &halo_bwd_recv,
+                        const dc::IntVector &halo_fwd_recv,
+                        DataType beta,
+                        Tensor<DataType> &output,
+                        const Array<ND, int> &windows,
+                        const Array<ND, int> &pads,
+                        const Array<ND, int> &strides,
+                        const FusedHalo<ND, DataType> &halo,
+                        cudaStream_t stream) {
+  const DataType *input_ptr = input.get_const_base_ptr()
+      - input.get_local_offset(dc::IndexVector(halo_bwd_recv), true);
+  auto input_dims = input.get_local_shape();
+  for (int i = 0; i < ND; ++i) {
+    input_dims[i] += halo_bwd_recv[i] + halo_fwd_recv[i];
   }
-#endif
+  const auto output_dims = output.get_local_shape();
+  const index_t num_outputs = output_dims.get_size();
+  const int bsize = 256;
+  const index_t gsize = (num_outputs + bsize - 1) / bsize;
+  pool_fused_halo_kernel<ND, DataType, mode><<<gsize, bsize, 0, stream>>>(
+      input_ptr, input_dims, input.get_local_pitched_shape(),
+      output.get_base_ptr(), output_dims, output.get_local_pitched_shape(),
+      windows, pads, strides, halo, alpha, beta);
 }
 
+#endif // DISTCONV_HAS_NVSHMEM
+
 } // namespace
 
 namespace distconv {
 
 template <typename DataType>
-void Pooling<BackendDNNLib, DataType>::bp_accumulate_sum(
-    Tensor<DataType>& tensor,
-    IndexVector const& dst,
-    IndexVector const& src,
-    tensor::Shape const& shape)
+void Pooling<BackendDNNLib, DataType>::max_pool_argmax(
+    DataType alpha,
+    Tensor<DataType> const& input,
+    DataType beta,
+    Tensor<DataType>& output,
+    uint8_t* argmax)
 {
     switch (m_num_dims)
     {
+    case 3:
+        max_pool_argmax_nd<3>(alpha, input, m_halo_bwd_recv, m_halo_fwd_recv,
+                              beta, output, get_spatial_params<3>(m_windows, 1),
+                              get_spatial_params<3>(m_pads, 0),
+                              get_spatial_params<3>(m_strides, 1), argmax,
+                              m_be.get_stream());
+        break;
     case 4:
-      bp_accumulate_sum_nd<4, DataType>(tensor, dst, src, shape);
-      break;
+        max_pool_argmax_nd<4>(alpha, input, m_halo_bwd_recv, m_halo_fwd_recv,
+                              beta, output, get_spatial_params<4>(m_windows, 1),
+                              get_spatial_params<4>(m_pads, 0),
+                              get_spatial_params<4>(m_strides, 1), argmax,
+                              m_be.get_stream());
+        break;
     case 5:
-      bp_accumulate_sum_nd<5, DataType>(tensor, dst, src, shape);
-      break;
+        max_pool_argmax_nd<5>(alpha, input, m_halo_bwd_recv, m_halo_fwd_recv,
+                              beta, output, get_spatial_params<5>(m_windows, 1),
+                              get_spatial_params<5>(m_pads, 0),
+                              get_spatial_params<5>(m_strides, 1), argmax,
+                              m_be.get_stream());
+        break;
+    }
+}
+
+template <typename DataType>
+void Pooling<BackendDNNLib, DataType>::max_pool_scatter(
+    DataType alpha,
+    Tensor<DataType> const& d_output,
+    uint8_t const* argmax,
+    Tensor<DataType>& d_input)
+{
+    switch (m_num_dims)
+    {
+    case 3:
+        max_pool_scatter_nd<3>(alpha, d_output, argmax, m_halo_bwd_recv,
+                               d_input, get_spatial_params<3>(m_windows, 1),
+                               get_spatial_params<3>(m_pads, 0),
+                               get_spatial_params<3>(m_strides, 1),
+                               m_be.get_stream());
+        break;
+    case 4:
+        max_pool_scatter_nd<4>(alpha, d_output, argmax, m_halo_bwd_recv,
+                               d_input, get_spatial_params<4>(m_windows, 1),
+                               get_spatial_params<4>(m_pads, 0),
+                               get_spatial_params<4>(m_strides, 1),
+                               m_be.get_stream());
+        break;
+    case 5:
+        max_pool_scatter_nd<5>(alpha, d_output, argmax, m_halo_bwd_recv,
+                               d_input, get_spatial_params<5>(m_windows, 1),
+                               get_spatial_params<5>(m_pads, 0),
+                               get_spatial_params<5>(m_strides, 1),
+                               m_be.get_stream());
+        break;
+    }
+}
+
+#define INSTANTIATE_MAX_POOL_ARGMAX(TYPE)                                      \
+    template void Pooling<BackendDNNLib, TYPE>::max_pool_argmax(               \
+        TYPE alpha,                                                            \
+        Tensor<TYPE> const& input,                                             \
+        TYPE beta,                                                             \
+        Tensor<TYPE>& output,                                                  \
+        uint8_t* argmax);                                                      \
+    template void Pooling<BackendDNNLib, TYPE>::max_pool_scatter(              \
+        TYPE alpha,                                                            \
+        Tensor<TYPE> const& d_output,                                          \
+        uint8_t const* argmax,                                                 \
+        Tensor<TYPE>& d_input)
+INSTANTIATE_MAX_POOL_ARGMAX(float);
+INSTANTIATE_MAX_POOL_ARGMAX(double);
+#undef INSTANTIATE_MAX_POOL_ARGMAX
+
+#ifdef DISTCONV_HAS_NVSHMEM
+template <typename DataType>
+void Pooling<BackendDNNLib, DataType>::pool_fused_halo(
+    DataType alpha,
+    Tensor<DataType> const& input,
+    DataType beta,
+    Tensor<DataType>& output,
+    tensor::HaloRecvDevice<DataType> const& halo_lhs,
+    tensor::HaloRecvDevice<DataType> const& halo_rhs)
+{
+    FusedPoolingMode mode;
+    switch (m_mode)
+    {
+    case CUDNN_POOLING_MAX:
+    case CUDNN_POOLING_MAX_DETERMINISTIC:
+        mode = FusedPoolingMode::MAX;
+        break;
+    case CUDNN_POOLING_AVERAGE_COUNT_INCLUDE_PADDING:
+        mode = FusedPoolingMode::AVERAGE;
+        break;
+    case CUDNN_POOLING_AVERAGE_COUNT_EXCLUDE_PADDING:
+        mode = FusedPoolingMode::AVERAGE_NO_PAD;
+        break;
+    default:
+        util::MPIPrintStreamError()
+            << "Unsupported pooling mode in fused halo exchange";
+        std::abort();
+    }
+
+#define POOL_FUSED_HALO_MODE(ND, MODE)                                             case FusedPoolingMode::MODE:                                                       pool_fused_halo_nd<ND, FusedPoolingMode::MODE>(alpha,                                                                         input,                                                                         m_halo_bwd_recv,                                                               m_halo_fwd_recv,                                                               beta,                                                                          output,                                                                        windows,                                                                       pads,                                                                          strides,                                                                       halo,                                                                          m_be.get_stream());             break;
+#define POOL_FUSED_HALO(ND)                                                        case ND:                                                                       {                                                                                  Array<ND, int> windows(1), pads(0), strides(1);                                     for (int i = 0; i < m_num_spatial_dims; ++i)                                   {                                                                                  windows[i] = m_windows[i];                                                     pads[i] = m_pads[i];                                                           strides[i] = m_strides[i];                                                 }                                                                              FusedHalo<ND, DataType> halo;                                                  halo.recv[LHS] = halo_lhs;                                                     halo.recv[RHS] = halo_rhs;                                                     halo.dim = m_fused_halo_dim;                                                   halo.begin = m_halo_bwd_recv[m_fused_halo_dim];                                halo.end = halo.begin + input.get_local_shape()[m_fused_halo_dim];             halo.region_shape = input.get_local_real_shape();                              halo.region_shape[m_fused_halo_dim] =                                              input.get_halo_width(m_fused_halo_dim);                                    switch (mode)                                                                  {                                                                                  POOL_FUSED_HALO_MODE(ND, MAX)                                                  POOL_FUSED_HALO_MODE(ND, AVERAGE)                                              POOL_FUSED_HALO_MODE(ND, AVERAGE_NO_PAD)                                   }                                                                              break;                                                                     }
+
+    switch (m_num_dims)
+    {
+        POOL_FUSED_HALO(3)
+        POOL_FUSED_HALO(4)
+        POOL_FUSED_HALO(5)
+    default:
+        util::MPIPrintStreamError()
+            << "Unsupported number of dimensions in fused halo exchange: "
+            << m_num_dims;
+        std::abort();
     }
-  return;
+#undef POOL_FUSED_HALO
+#undef POOL_FUSED_HALO_MODE
 }
 
-#define INSTANTIATE_BP_ACCUMULATE_SUM(TYPE)                                    \
-    template void Pooling<BackendDNNLib, TYPE>::bp_accumulate_sum(             \
-        Tensor<TYPE>& tensor,                                                  \
-        const IndexVector& dst,                                                \
-        const IndexVector& src,                                                \
-        const tensor::Shape& shape)
-INSTANTIATE_BP_ACCUMULATE_SUM(float);
-INSTANTIATE_BP_ACCUMULATE_SUM(double);
-#undef INSTANTIATE_BP_ACCUMULATE_SUM
+#define INSTANTIATE_POOL_FUSED_HALO(TYPE)                                          template void Pooling<BackendDNNLib, TYPE>::pool_fused_halo(                       TYPE alpha,                                                                    Tensor<TYPE> const& input,                                                     TYPE beta,                                                                     Tensor<TYPE>& output,                                                          tensor::HaloRecvDevice<TYPE> const& halo_lhs,                                  tensor::HaloRecvDevice<TYPE> const& halo_rhs)
+INSTANTIATE_POOL_FUSED_HALO(float);
+INSTANTIATE_POOL_FUSED_HALO(double);
+#undef INSTANTIATE_POOL_FUSED_HALO
+#endif // DISTCONV_HAS_NVSHMEM
 
 } // namespace distconv
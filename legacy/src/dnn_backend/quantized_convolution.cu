@@ -0,0 +1,193 @@
+#include "distconv/dnn_backend/quantized_convolution.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <cstdlib>
+#include <type_traits>
+
+namespace distconv {
+namespace quantized_conv {
+
+using grouped_conv::Geometry;
+using grouped_conv::Problem;
+
+namespace {
+
+constexpr int block_size = 256;
+
+// Splits idx into the coordinates of dims, innermost first
+template <int NUM_DIMS>
+__device__ __forceinline__ void get_coords(index_t idx, const int *dims,
+                                           int *coords) {
+#pragma unroll
+  for (int i = 0; i < NUM_DIMS; ++i) {
+    coords[i] = idx % dims[i];
+    idx /= dims[i];
+  }
+}
+
+__device__ __forceinline__ int saturate(float v, int lower) {
+  return (int)fminf(fmaxf(v, (float)lower), (float)max_int8);
+}
+
+__device__ __forceinline__ void store(std::int8_t *p, int q, float) {
+  *p = (std::int8_t)q;
+}
+
+__device__ __forceinline__ void store(float *p, int q, float scale) {
+  *p = q * scale;
+}
+
+/*
+  - Each thread quantizes one element of x, including its halos
+  - q is densely packed in the order of x
+ */
+template <int ND>
+__global__ void quantize_kernel(const Geometry g, const float * __restrict__ x,
+                                const float inv_scale,
+                                std::int8_t * __restrict__ q,
+                                const index_t num_elements) {
+  const index_t gid = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  if (gid >= num_elements) return;
+  int xc[ND + 2];
+  get_coords<ND + 2>(gid, g.dims, xc);
+  index_t offset = 0;
+#pragma unroll
+  for (int i = 0; i < ND + 2; ++i) {
+    offset += xc[i] * g.strides[i];
+  }
+  q[gid] = (std::int8_t)saturate(rintf(x[offset] * inv_scale), -max_int8);
+}
+
+/*
+  - Each thread computes one element of y with INT32 sums, as the
+    forward kernel of grouped_conv does with one group
+  - The sum is requantized in registers before it is stored
+ */
+template <int ND, typename OutType>
+__global__ void fp_kernel(const Problem p,
+                          const std::int8_t * __restrict__ x,
+                          const std::int8_t * __restrict__ w,
+                          const Requantization rq,
+                          OutType * __restrict__ y,
+                          const index_t num_elements) {
+  const index_t gid = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  if (gid >= num_elements) return;
+
+  int yc[ND + 2];
+  get_coords<ND + 2>(gid, p.y.dims, yc);
+  const int k = yc[ND];
+  const int n = yc[ND + 1];
+  const int num_channels = p.w.dims[ND];
+  int filter_size = 1;
+#pragma unroll
+  for (int i = 0; i < ND; ++i) {
+    filter_size *= p.w.dims[i];
+  }
+
+  const std::int8_t *x_sample = x + n * p.x.strides[ND + 1];
+  const std::int8_t *w_filter = w + k * p.w.strides[ND + 1];
+
+  int sum = 0;
+  for (int f = 0; f < filter_size; ++f) {
+    int fc[ND];
+    get_coords<ND>(f, p.w.dims, fc);
+    bool valid = true;
+    index_t x_offset = 0;
+    index_t w_offset = 0;
+#pragma unroll
+    for (int i = 0; i < ND; ++i) {
+      const int xi = yc[i] * p.strides[i] + fc[i] * p.dilations[i] - p.pads[i];
+      valid &= xi >= 0 && xi < p.x.dims[i];
+      x_offset += xi * p.x.strides[i];
+      w_offset += fc[i] * p.w.strides[i];
+    }
+    if (!valid) continue;
+    for (int c = 0; c < num_channels; ++c) {
+      sum += (int)x_sample[x_offset + c * p.x.strides[ND]]
+          * (int)w_filter[w_offset + c * p.w.strides[ND]];
+    }
+  }
+
+  const int q = saturate(rintf((sum + rq.bias[k]) * rq.scales[k]),
+                         rq.relu ? 0 : -max_int8);
+  index_t y_offset = 0;
+#pragma unroll
+  for (int i = 0; i < ND + 2; ++i) {
+    y_offset += yc[i] * p.y.strides[i];
+  }
+  store(&y[y_offset], q, rq.output_scale);
+}
+
+index_t get_num_elements(const Geometry &g, int num_dims) {
+  index_t n = 1;
+  for (int i = 0; i < num_dims; ++i) {
+    n *= g.dims[i];
+  }
+  return n;
+}
+
+// Calls f with the number of spatial dimensions as a compile-time
+// constant
+template <typename F>
+void dispatch_spatial_dims(int num_spatial_dims, F &&f) {
+  switch (num_spatial_dims) {
+    case 1:
+      f(std::integral_constant<int, 1>());
+      break;
+    case 2:
+      f(std::integral_constant<int, 2>());
+      break;
+    case 3:
+      f(std::integral_constant<int, 3>());
+      break;
+    default:
+      util::MPIPrintStreamError()
+          << "Unsupported number of spatial dimensions: "
+          << num_spatial_dims;
+      std::abort();
+  }
+}
+
+} // namespace
+
+void quantize(const Geometry &g, int num_spatial_dims, const float *x,
+              float inv_scale, std::int8_t *q,
+              h2::gpu::DeviceStream stream) {
+  const auto num_elements = get_num_elements(g, num_spatial_dims + 2);
+  if (num_elements == 0) return;
+  dispatch_spatial_dims(num_spatial_dims, [&](auto nd) {
+    constexpr int ND = decltype(nd)::value;
+    quantize_kernel<ND>
+        <<<util::ceil(num_elements, (index_t)block_size), block_size, 0,
+        stream>>>(g, x, inv_scale, q, num_elements);
+  });
+}
+
+template <typename OutType>
+void forward(const Problem &p, const std::int8_t *x, const std::int8_t *w,
+             const Requantization &rq, OutType *y,
+             h2::gpu::DeviceStream stream) {
+  assert_always(grouped_conv::is_supported(p) && p.num_groups == 1);
+  const auto num_elements = get_num_elements(p.y, p.num_spatial_dims + 2);
+  if (num_elements == 0) return;
+  dispatch_spatial_dims(p.num_spatial_dims, [&](auto nd) {
+    constexpr int ND = decltype(nd)::value;
+    fp_kernel<ND, OutType>
+        <<<util::ceil(num_elements, (index_t)block_size), block_size, 0,
+        stream>>>(p, x, w, rq, y, num_elements);
+  });
+}
+
+#define PROTO(T)                                                        \
+  template void forward<T>(const Problem &p, const std::int8_t *x,      \
+                           const std::int8_t *w,                        \
+                           const Requantization &rq, T *y,              \
+                           h2::gpu::DeviceStream stream);
+
+PROTO(std::int8_t)
+PROTO(float)
+#undef PROTO
+
+} // namespace quantized_conv
+} // namespace distconv
@@ -1,9 +1,12 @@
 #include "distconv/dnn_backend/softmax.hpp"
 #include "distconv/runtime_gpu.hpp"
 #include "distconv/tensor/algorithms_cuda.hpp"
+#include "distconv/util/launch_config.hpp"
 #include "distconv/util/util_gpu.hpp"
 #include "distconv/util/util_mpi.hpp"
 
+#include <cstdint>
+#include <initializer_list>
 #include <limits>
 
 #if H2_HAS_CUDA
@@ -24,7 +27,7 @@ using SoftmaxCUDNN = distconv::Softmax<distconv::BackendDNNLib>;
 namespace distconv {
 namespace softmax {
 
-constexpr int block_size = 256;
+constexpr int block_size = util::block_size;
 
 template <typename DataType>
 struct exp;
@@ -138,11 +141,125 @@ void set_kernel_params(const Tensor &tensor,
   num_samples = tensor.get_local_shape()[-1];
   if (num_samples == 0) return;
   sample_size = tensor.get_local_size() / num_samples;
-  if (sample_size == 0) return;
+  // The grid only depends on the number of samples, which is the same
+  // for all processes of a sample.
   int num_blocks_per_sample = util::ceil(num_blocks, num_samples);
   gdim = dim3(num_blocks_per_sample, num_samples);
 }
 
+// Running maximum and sum of exp(x - maximum) of a set of values
+template <typename DataType>
+struct max_exp_sum {
+  DataType max;
+  DataType sum;
+};
+
+template <typename DataType>
+struct merge_max_exp_sum {
+  __device__ __forceinline__ max_exp_sum<DataType> init() const {
+    return {-util::max<DataType>(), DataType(0)};
+  }
+  __device__ __forceinline__ max_exp_sum<DataType> operator()(
+      const max_exp_sum<DataType> &x, const max_exp_sum<DataType> &y) const {
+    auto m = (x.max >= y.max) ? x.max : y.max;
+    return {m, x.sum * exp<DataType>()(x.max - m) +
+            y.sum * exp<DataType>()(y.max - m)};
+  }
+  // Adds a single value
+  __device__ __forceinline__ max_exp_sum<DataType> operator()(
+      const max_exp_sum<DataType> &x, DataType y) const {
+    if (y > x.max) {
+      return {y, x.sum * exp<DataType>()(x.max - y) + DataType(1)};
+    } else {
+      return {x.max, x.sum + exp<DataType>()(y - x.max)};
+    }
+  }
+};
+
+// Computes the max and exp-sum of each block of a sample in a single
+// pass over x. The pair of block b of sample s is stored at partials[(s
+// * gridDim.x + b) * 2].
+template <typename DataType, int BLOCK_SIZE>
+__global__ void online_reduce_per_sample_kernel(
+    const DataType * __restrict__ x,
+    size_t sample_size,
+    DataType * __restrict__ partials) {
+  auto num_blocks_per_sample = gridDim.x;
+  size_t work_per_block = (sample_size + num_blocks_per_sample - 1) /
+      num_blocks_per_sample;
+  size_t sample_offset = blockIdx.x * work_per_block + threadIdx.x;
+  size_t block_end = min((blockIdx.x + 1) * work_per_block, sample_size);
+  int sample_idx = blockIdx.y;
+
+  x += sample_idx * sample_size;
+
+  merge_max_exp_sum<DataType> merge;
+  auto local = merge.init();
+  for (; sample_offset < block_end; sample_offset += BLOCK_SIZE) {
+    local = merge(local, x[sample_offset]);
+  }
+
+  using BlockReduce = cubns::BlockReduce<max_exp_sum<DataType>, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  auto block_pair = BlockReduce(temp_storage).Reduce(local, merge);
+  if (threadIdx.x == 0) {
+    auto idx = (sample_idx * num_blocks_per_sample + blockIdx.x) * 2;
+    partials[idx] = block_pair.max;
+    partials[idx + 1] = block_pair.sum;
+  }
+}
+
+// Merges the block pairs of all processes of a sample and writes y =
+// exp(x - max) / sum. partials holds the pairs of each process one
+// after another.
+template <typename DataType, int BLOCK_SIZE>
+__global__ void online_normalize_per_sample_kernel(
+    const DataType * __restrict__ x,
+    size_t sample_size,
+    const DataType * __restrict__ partials,
+    int num_procs,
+    DataType min_output,
+    DataType * __restrict__ y) {
+  auto num_blocks_per_sample = gridDim.x;
+  size_t work_per_block = (sample_size + num_blocks_per_sample - 1) /
+      num_blocks_per_sample;
+  size_t sample_offset = blockIdx.x * work_per_block + threadIdx.x;
+  size_t block_end = min((blockIdx.x + 1) * work_per_block, sample_size);
+  int sample_idx = blockIdx.y;
+  const size_t partials_per_proc = num_blocks_per_sample * gridDim.y * 2;
+
+  merge_max_exp_sum<DataType> merge;
+  auto local = merge.init();
+  for (int i = threadIdx.x; i < num_procs * num_blocks_per_sample;
+       i += BLOCK_SIZE) {
+    auto proc = i / num_blocks_per_sample;
+    auto block = i % num_blocks_per_sample;
+    auto idx = proc * partials_per_proc +
+        (sample_idx * num_blocks_per_sample + block) * 2;
+    local = merge(local, max_exp_sum<DataType>{partials[idx],
+                                               partials[idx + 1]});
+  }
+
+  using BlockReduce = cubns::BlockReduce<max_exp_sum<DataType>, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  __shared__ DataType sample_max;
+  __shared__ DataType sample_inv_sum;
+  auto sample_pair = BlockReduce(temp_storage).Reduce(local, merge);
+  if (threadIdx.x == 0) {
+    sample_max = sample_pair.max;
+    sample_inv_sum = DataType(1) / sample_pair.sum;
+  }
+  __syncthreads();
+
+  x += sample_idx * sample_size;
+  y += sample_idx * sample_size;
+
+  for (; sample_offset < block_end; sample_offset += BLOCK_SIZE) {
+    auto y_i = exp<DataType>()(x[sample_offset] - sample_max) * sample_inv_sum;
+    y[sample_offset] = ::max(y_i, min_output);
+  }
+}
+
 template <typename DataType, int BLOCK_SIZE,
           typename Map, typename Reduce, typename AtomicReduce>
 __global__ void reduce_per_sample_kernel(const DataType * __restrict__ x,
@@ -233,107 +350,33 @@ __global__ void map_per_sample_kernel(const DataType * __restrict__ x,
   }
 }
 
-template <typename DataType, int BLOCK_SIZE,
-          typename Map, typename Reduce, typename AtomicReduce>
-__global__ void map_and_reduce_per_sample_kernel(
-    const DataType * __restrict__ x,
-    size_t sample_size,
-    const DataType * __restrict__ sample_values,
-    Map map,
-    Reduce reduce,
-    AtomicReduce atomic_reduce,
-    DataType * __restrict__ y,
-    DataType * __restrict__ reduction) {
-  auto num_blocks_per_sample = gridDim.x;
-  size_t work_per_block = (sample_size + sample_size - 1) / num_blocks_per_sample;
-  size_t sample_offset = blockIdx.x * work_per_block + threadIdx.x;
-  size_t block_end = min((blockIdx.x + 1) * work_per_block, sample_size);
-  int sample_idx = blockIdx.y;
-
-  x += sample_idx * sample_size;
-  y += sample_idx * sample_size;
-
-  const auto sample_value = sample_values[sample_idx];
-
-  DataType local_sum = reduce.init();
-  for (; sample_offset < block_end; sample_offset += BLOCK_SIZE) {
-    auto x_i = x[sample_offset];
-    x_i = map(x_i, sample_value);
-    local_sum = reduce(local_sum, x_i);
-    y[sample_offset] = x_i;
-  }
-
-  using BlockReduce = cubns::BlockReduce<DataType, BLOCK_SIZE>;
-  __shared__ typename BlockReduce::TempStorage temp_storage;
-  auto block_sum = BlockReduce(temp_storage).Sum(local_sum);
-  if (threadIdx.x == 0) {
-    atomic_reduce(reduction + sample_idx, block_sum);
-  }
-}
-
-template <typename DataType, int BLOCK_SIZE, typename Map>
-__global__ void update_per_sample_kernel(
-    DataType * __restrict__ x,
-    const DataType * __restrict__ sample_values,
-    size_t sample_size,
-    Map map) {
-  auto num_blocks_per_sample = gridDim.x;
-  size_t work_per_block = (sample_size + sample_size - 1) / num_blocks_per_sample;
-  size_t sample_offset = blockIdx.x * work_per_block + threadIdx.x;
-  size_t block_end = min((blockIdx.x + 1) * work_per_block, sample_size);
-  int sample_idx = blockIdx.y;
-
-  x += sample_idx * sample_size;
-
-  const auto sample_val = sample_values[sample_idx];
-
-  for (; sample_offset < block_end; sample_offset += BLOCK_SIZE) {
-    auto x_i = map(x[sample_offset], sample_val);
-    x[sample_offset] = x_i;
-  }
-}
-
 template <typename Tensor, typename DataType>
-void compute_max(const Tensor& tensor,
-                 DataType* sample_max,
-                 h2::gpu::DeviceStream stream)
+void online_reduce(const Tensor& x,
+                   DataType* partials,
+                   h2::gpu::DeviceStream stream)
 {
     dim3 gdim;
     int num_samples;
     size_t sample_size;
-    set_kernel_params(tensor, num_samples, sample_size, gdim);
+    set_kernel_params(x, num_samples, sample_size, gdim);
 
-    if (num_samples == 0 || sample_size == 0)
+    // Processes without local elements still contribute identity pairs
+    if (num_samples == 0)
     {
         return;
     }
 
-    reduce_per_sample_kernel<DataType,
-                             block_size,
-                             id<DataType>,
-                             max<DataType>,
-                             atomic_max<DataType>>
-        <<<gdim, block_size, 0, stream>>>(tensor.get_base_ptr(),
-                                          sample_size,
-                                          id<DataType>(),
-                                          max<DataType>(),
-                                          atomic_max<DataType>(),
-                                          sample_max);
+    online_reduce_per_sample_kernel<DataType, block_size>
+        <<<gdim, block_size, 0, stream>>>(
+            x.get_base_ptr(), sample_size, partials);
 }
 
-template <typename DataType>
-struct exp_shifted {
-  __device__ __forceinline__ DataType operator()(DataType x, DataType y) {
-    return exp<DataType>()(x - y);
-  }
-};
-
 template <typename Tensor, typename DataType>
-void compute_exp(const Tensor& x,
-                 const DataType* sample_max,
-                 Tensor& y,
-                 DataType* sample_exp,
-                 h2::gpu::DeviceStream stream)
+void online_normalize(const Tensor& x,
+                      const DataType* partials,
+                      int num_procs,
+                      Tensor& y,
+                      h2::gpu::DeviceStream stream)
 {
     dim3 gdim;
     int num_samples;
@@ -345,51 +388,24 @@ void compute_exp(const Tensor& x,
         return;
     }
 
-    map_and_reduce_per_sample_kernel<DataType,
-                                     block_size,
-                                     exp_shifted<DataType>,
-                                     sum<DataType>,
-                                     atomic_add_fn<DataType>>
+    online_normalize_per_sample_kernel<DataType, block_size>
         <<<gdim, block_size, 0, stream>>>(x.get_base_ptr(),
                                           sample_size,
-                                          sample_max,
-                                          exp_shifted<DataType>(),
-                                          sum<DataType>(),
-                                          atomic_add_fn<DataType>(),
-                                          y.get_base_ptr(),
-                                          sample_exp);
+                                          partials,
+                                          num_procs,
+                                          get_min<DataType>(),
+                                          y.get_base_ptr());
 }
 
-template <typename DataType>
-struct SoftmaxOp {
-  DataType m_min_output;
-  SoftmaxOp(DataType min_output): m_min_output(min_output) {}
-  __device__ __forceinline__ DataType operator()(DataType x, DataType y) {
-    return ::max(x / y, m_min_output);
-  }
-};
-
-template <typename Tensor, typename DataType>
-void compute_softmax(const DataType* sample_exp,
-                     Tensor& output_tensor,
-                     h2::gpu::DeviceStream stream)
+// Number of (max, exp-sum) pairs one process produces for x
+template <typename Tensor>
+int get_num_online_partials(const Tensor& x)
 {
     dim3 gdim;
     int num_samples;
     size_t sample_size;
-    set_kernel_params(output_tensor, num_samples, sample_size, gdim);
-
-    if (num_samples == 0 || sample_size == 0)
-    {
-        return;
-    }
-
-    update_per_sample_kernel<DataType, block_size, SoftmaxOp<DataType>>
-        <<<gdim, block_size, 0, stream>>>(
-            output_tensor.get_base_ptr(),
-            sample_exp,
-            sample_size,
-            SoftmaxOp<DataType>(get_min<DataType>()));
+    set_kernel_params(x, num_samples, sample_size, gdim);
+    return num_samples == 0 ? 0 : gdim.x * gdim.y;
 }
 
 template <typename Tensor, typename DataType>
@@ -516,6 +532,185 @@ __global__ void fp_channel_kernel(const DataType * __restrict__ x,
   }
 }
 
+// Channel counts up to which the channels of a position are kept in
+// registers
+constexpr int max_small_channels = 16;
+// Number of vector groups of positions each thread works on
+constexpr int small_channel_thread_work_size = 4;
+
+// Loads and stores VEC consecutive elements, with a single vector
+// access if VEC > 1.
+template <typename DataType, int VEC>
+struct vec_io {
+  using VecType = typename util::GetVectorType<DataType, VEC>::type;
+  __device__ __forceinline__ static void load(const DataType *p,
+                                              DataType (&v)[VEC]) {
+    auto x = *reinterpret_cast<const VecType*>(p);
+    v[0] = x.x;
+    v[1] = x.y;
+    if constexpr (VEC == 4) {
+      v[2] = x.z;
+      v[3] = x.w;
+    }
+  }
+  __device__ __forceinline__ static void store(DataType *p,
+                                               const DataType (&v)[VEC]) {
+    VecType x;
+    x.x = v[0];
+    x.y = v[1];
+    if constexpr (VEC == 4) {
+      x.z = v[2];
+      x.w = v[3];
+    }
+    *reinterpret_cast<VecType*>(p) = x;
+  }
+};
+
+template <typename DataType>
+struct vec_io<DataType, 1> {
+  __device__ __forceinline__ static void load(const DataType *p,
+                                              DataType (&v)[1]) {
+    v[0] = *p;
+  }
+  __device__ __forceinline__ static void store(DataType *p,
+                                               const DataType (&v)[1]) {
+    *p = v[0];
+  }
+};
+
+// Widest vector of at most 16 bytes
+template <typename DataType>
+constexpr int get_small_channel_vec_width() {
+  return 16 / sizeof(DataType);
+}
+
+/*
+  - gridDim.y == number of samples
+  - Each thread works on groups of VEC consecutive positions, keeping
+    all their channels in registers
+ */
+template <typename DataType, int NUM_CHANNELS, int VEC>
+__global__ void fp_channel_small_kernel(const DataType * __restrict__ x,
+                                        size_t spatial_size,
+                                        DataType * __restrict__ y) {
+  const size_t sample_size = spatial_size * NUM_CHANNELS;
+  const int sample_idx = blockIdx.y;
+  constexpr auto min_output = util::min<DataType>();
+
+  x += sample_idx * sample_size;
+  y += sample_idx * sample_size;
+
+  const size_t num_groups = spatial_size / VEC;
+  for (size_t group = blockIdx.x * blockDim.x + threadIdx.x;
+       group < num_groups; group += gridDim.x * blockDim.x) {
+    const size_t offset = group * VEC;
+    DataType v[NUM_CHANNELS][VEC];
+#pragma unroll
+    for (int c = 0; c < NUM_CHANNELS; ++c) {
+      vec_io<DataType, VEC>::load(x + offset + spatial_size * c, v[c]);
+    }
+#pragma unroll
+    for (int i = 0; i < VEC; ++i) {
+      auto ch_max = v[0][i];
+#pragma unroll
+      for (int c = 1; c < NUM_CHANNELS; ++c) {
+        ch_max = ::max(ch_max, v[c][i]);
+      }
+      DataType ch_sum = DataType(0);
+#pragma unroll
+      for (int c = 0; c < NUM_CHANNELS; ++c) {
+        v[c][i] = exp<DataType>()(v[c][i] - ch_max);
+        ch_sum += v[c][i];
+      }
+      ch_sum = 1 / ch_sum;
+#pragma unroll
+      for (int c = 0; c < NUM_CHANNELS; ++c) {
+        v[c][i] = ::max(v[c][i] * ch_sum, min_output);
+      }
+    }
+#pragma unroll
+    for (int c = 0; c < NUM_CHANNELS; ++c) {
+      vec_io<DataType, VEC>::store(y + offset + spatial_size * c, v[c]);
+    }
+  }
+}
+
+template <typename DataType, int NUM_CHANNELS, int VEC>
+__global__ void bp_channel_small_kernel(const DataType * __restrict__ y,
+                                        const DataType * __restrict__ dy,
+                                        size_t spatial_size,
+                                        DataType * __restrict__ dx) {
+  const size_t sample_size = spatial_size * NUM_CHANNELS;
+  const int sample_idx = blockIdx.y;
+  constexpr auto min_output = util::min<DataType>();
+
+  y += sample_idx * sample_size;
+  dy += sample_idx * sample_size;
+  dx += sample_idx * sample_size;
+
+  const size_t num_groups = spatial_size / VEC;
+  for (size_t group = blockIdx.x * blockDim.x + threadIdx.x;
+       group < num_groups; group += gridDim.x * blockDim.x) {
+    const size_t offset = group * VEC;
+    DataType y_v[NUM_CHANNELS][VEC];
+    DataType dy_v[NUM_CHANNELS][VEC];
+#pragma unroll
+    for (int c = 0; c < NUM_CHANNELS; ++c) {
+      vec_io<DataType, VEC>::load(y + offset + spatial_size * c, y_v[c]);
+      vec_io<DataType, VEC>::load(dy + offset + spatial_size * c, dy_v[c]);
+    }
+#pragma unroll
+    for (int i = 0; i < VEC; ++i) {
+      DataType dp = DataType(0);
+#pragma unroll
+      for (int c = 0; c < NUM_CHANNELS; ++c) {
+        dp += y_v[c][i] * dy_v[c][i];
+      }
+#pragma unroll
+      for (int c = 0; c < NUM_CHANNELS; ++c) {
+        const auto y_i = y_v[c][i];
+        dy_v[c][i] = y_i > min_output ? y_i * (dy_v[c][i] - dp) : DataType(0);
+      }
+    }
+#pragma unroll
+    for (int c = 0; c < NUM_CHANNELS; ++c) {
+      vec_io<DataType, VEC>::store(dx + offset + spatial_size * c, dy_v[c]);
+    }
+  }
+}
+
+// Calls f with the channel count as a ValueAsType and whether the
+// buffers ptrs can be accessed with vectors if the channel count is
+// small. Returns false otherwise.
+template <typename DataType, typename F>
+bool dispatch_small_channels(int num_channels, size_t spatial_size,
+                             std::initializer_list<const DataType*> ptrs,
+                             F &&f) {
+  if (num_channels < 2 || num_channels > max_small_channels) {
+    return false;
+  }
+  constexpr int vec = get_small_channel_vec_width<DataType>();
+  // Vector accesses need every channel of every sample aligned
+  bool vectorize = spatial_size % vec == 0;
+  for (const auto *p : ptrs) {
+    vectorize = vectorize &&
+        reinterpret_cast<uintptr_t>(p) % (vec * sizeof(DataType)) == 0;
+  }
+  tensor::algorithms_cuda::dispatch_rank(
+      num_channels,
+      [&](auto nc) { f(nc, vectorize); },
+      tensor::algorithms_cuda::RankRange<2, max_small_channels>{});
+  return true;
+}
+
+inline dim3 get_small_channel_grid(size_t spatial_size, int vec,
+                                   int num_samples) {
+  const size_t num_groups = spatial_size / vec;
+  return dim3(util::ceil(num_groups,
+                         (size_t) block_size * small_channel_thread_work_size),
+              num_samples);
+}
+
 template <typename Tensor>
 int fp_channel(const Tensor& x, Tensor& y, h2::gpu::DeviceStream stream)
 {
@@ -529,6 +724,40 @@ int fp_channel(const Tensor& x, Tensor& y, h2::gpu::DeviceStream stream)
     auto num_samples = x.get_local_shape()[-1];
     auto num_channels = x.get_local_shape()[-2];
     size_t spatial_size = x.get_local_size() / num_samples / num_channels;
+
+    if (dispatch_small_channels<DataType>(
+            num_channels,
+            spatial_size,
+            {x.get_base_ptr(), y.get_base_ptr()},
+            [&](auto nc, bool vectorize) {
+                constexpr int NC = decltype(nc)::value;
+                constexpr int VEC = get_small_channel_vec_width<DataType>();
+                if (vectorize)
+                {
+                    fp_channel_small_kernel<DataType, NC, VEC>
+                        <<<get_small_channel_grid(
+                               spatial_size, VEC, num_samples),
+                           block_size,
+                           0,
+                           stream>>>(
+                            x.get_base_ptr(), spatial_size, y.get_base_ptr());
+                }
+                else
+                {
+                    fp_channel_small_kernel<DataType, NC, 1>
+                        <<<get_small_channel_grid(
+                               spatial_size, 1, num_samples),
+                           block_size,
+                           0,
+                           stream>>>(
+                            x.get_base_ptr(), spatial_size, y.get_base_ptr());
+                }
+            }))
+    {
+        DISTCONV_CHECK_GPU(GPU_GET_LAST_ERROR());
+        return 0;
+    }
+
     auto num_blocks_per_sample = util::ceil(spatial_size, (size_t) block_size);
 
     dim3 gdim(num_blocks_per_sample, num_samples);
@@ -604,6 +833,44 @@ int bp_channel(const Tensor& y,
     auto num_samples = dx.get_local_shape()[-1];
     auto num_channels = dx.get_local_shape()[-2];
     size_t spatial_size = dx.get_local_size() / num_samples / num_channels;
+
+    if (dispatch_small_channels<DataType>(
+            num_channels,
+            spatial_size,
+            {y.get_base_ptr(), dy.get_base_ptr(), dx.get_base_ptr()},
+            [&](auto nc, bool vectorize) {
+                constexpr int NC = decltype(nc)::value;
+                constexpr int VEC = get_small_channel_vec_width<DataType>();
+                if (vectorize)
+                {
+                    bp_channel_small_kernel<DataType, NC, VEC>
+                        <<<get_small_channel_grid(
+                               spatial_size, VEC, num_samples),
+                           block_size,
+                           0,
+                           stream>>>(y.get_base_ptr(),
+                                     dy.get_base_ptr(),
+                                     spatial_size,
+                                     dx.get_base_ptr());
+                }
+                else
+                {
+                    bp_channel_small_kernel<DataType, NC, 1>
+                        <<<get_small_channel_grid(
+                               spatial_size, 1, num_samples),
+                           block_size,
+                           0,
+                           stream>>>(y.get_base_ptr(),
+                                     dy.get_base_ptr(),
+                                     spatial_size,
+                                     dx.get_base_ptr());
+                }
+            }))
+    {
+        DISTCONV_CHECK_GPU(GPU_GET_LAST_ERROR());
+        return 0;
+    }
+
     auto num_blocks_per_sample = util::ceil(spatial_size, (size_t) block_size);
 
     dim3 gdim(num_blocks_per_sample, num_samples);
@@ -640,29 +907,22 @@ int SoftmaxCUDNN::forward(const Tensor &x, Tensor &y) {
     return softmax::fp_channel(x, y, stream);
   }
 
+  // Per-block (max, exp-sum) pairs are computed in one pass over x,
+  // gathered from all processes of each sample with a single
+  // collective, and merged by the normalization kernel.
   auto& mempool = internal::RuntimeGPU::get_device_memory_pool();
-  auto ws_size = num_samples * sizeof(DataType);
-  DataType *sample_max = static_cast<DataType*>(
-      mempool.get(ws_size, stream));
-  DataType *sample_exp = static_cast<DataType*>(
-      mempool.get(ws_size, stream));
-
-  h2::gpu::mem_zero(sample_max, num_samples, stream);
-  h2::gpu::mem_zero(sample_exp, num_samples, stream);
-
-  // compute sample-wise max
-  softmax::compute_max(x, sample_max, stream);
-  allreduce(sample_max, num_samples, true);
-
-  // compute summation of exp
-  softmax::compute_exp(x, sample_max, y, sample_exp, stream);
-  allreduce(sample_exp, num_samples, false);
-
-  // update the output
-  softmax::compute_softmax(sample_exp, y, stream);
-
-  mempool.release(sample_max);
-  mempool.release(sample_exp);
+  const int num_partials = softmax::get_num_online_partials(x) * 2;
+  const int num_procs = m_num_procs_per_sample > 1 ?
+      m_num_procs_per_sample : 1;
+  DataType *partials = static_cast<DataType*>(
+      mempool.get(num_partials * num_procs * sizeof(DataType), stream));
+  DataType *local_partials = partials + num_partials * get_sample_rank();
+
+  softmax::online_reduce(x, local_partials, stream);
+  allgather(local_partials, partials, num_partials);
+  softmax::online_normalize(x, partials, num_procs, y, stream);
+
+  mempool.release(partials);
   return 0;
 }
 
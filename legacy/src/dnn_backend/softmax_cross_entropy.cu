@@ -0,0 +1,435 @@
+#include "distconv/dnn_backend/softmax_cross_entropy.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/tensor/algorithms_cuda.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#if H2_HAS_CUDA
+#include <cub/block/block_reduce.cuh>
+namespace cubns = cub;
+#elif H2_HAS_ROCM
+#include <hipcub/block/block_reduce.hpp>
+namespace cubns = hipcub;
+#endif
+
+using distconv::tensor::LocaleMPI;
+using distconv::tensor::CUDAAllocator;
+
+template <typename DataType>
+using TensorCUDA = distconv::tensor::Tensor<DataType, LocaleMPI, CUDAAllocator>;
+using SoftmaxCrossEntropyCUDNN =
+    distconv::SoftmaxCrossEntropy<distconv::BackendDNNLib>;
+
+namespace distconv {
+namespace softmax_cross_entropy {
+
+constexpr int block_size = 256;
+// Number of values per partial of a block in INSTANCE mode
+constexpr int num_partial_values = 4;
+
+__device__ __forceinline__ float exp_fn(float x) { return ::expf(x); }
+__device__ __forceinline__ double exp_fn(double x) { return ::exp(x); }
+__device__ __forceinline__ float log_fn(float x) { return ::logf(x); }
+__device__ __forceinline__ double log_fn(double x) { return ::log(x); }
+
+// Target of element offset of a sample. With labels,
+// truth holds one label per spatial position.
+template <typename DataType>
+__device__ __forceinline__ DataType get_truth(const DataType *truth,
+                                              index_t offset,
+                                              index_t spatial_size,
+                                              bool use_labels) {
+  if (use_labels) {
+    const auto spatial = offset % spatial_size;
+    const auto channel = offset / spatial_size;
+    const int label = truth[spatial];
+    return DataType(label == channel ? 1. : 0.);
+  } else {
+    return truth[offset];
+  }
+}
+
+template <typename DataType>
+__device__ __forceinline__ const DataType *get_sample_truth(
+    const DataType *truth, int sample_idx, index_t sample_size,
+    index_t spatial_size, bool use_labels) {
+  return truth + sample_idx * (use_labels ? spatial_size : sample_size);
+}
+
+// Running statistics of a set of logits x and targets t: max(x),
+// sum(exp(x - max)), sum(t * x) and sum(t)
+template <typename DataType>
+struct stats {
+  DataType max;
+  DataType exp_sum;
+  DataType tx_sum;
+  DataType t_sum;
+};
+
+template <typename DataType>
+struct merge_stats {
+  __device__ __forceinline__ stats<DataType> init() const {
+    return {-util::max<DataType>(), DataType(0), DataType(0), DataType(0)};
+  }
+  __device__ __forceinline__ stats<DataType> operator()(
+      const stats<DataType> &x, const stats<DataType> &y) const {
+    auto m = (x.max >= y.max) ? x.max : y.max;
+    return {m,
+            x.exp_sum * exp_fn(x.max - m) + y.exp_sum * exp_fn(y.max - m),
+            x.tx_sum + y.tx_sum,
+            x.t_sum + y.t_sum};
+  }
+  // Adds a single logit and its target
+  __device__ __forceinline__ stats<DataType> operator()(
+      const stats<DataType> &s, DataType x, DataType t) const {
+    stats<DataType> r = {s.max, s.exp_sum, s.tx_sum + t * x, s.t_sum + t};
+    if (x > s.max) {
+      r.max = x;
+      r.exp_sum = s.exp_sum * exp_fn(s.max - x) + DataType(1);
+    } else {
+      r.exp_sum += exp_fn(x - s.max);
+    }
+    return r;
+  }
+};
+
+template <typename Tensor>
+void set_instance_kernel_params(const Tensor &tensor,
+                                int &num_samples, index_t &sample_size,
+                                dim3 &gdim) {
+  int num_blocks = 80; // == V100 #SMs
+
+  num_samples = tensor.get_local_shape()[-1];
+  if (num_samples == 0) return;
+  sample_size = tensor.get_local_size() / num_samples;
+  // The grid only depends on the number of samples, which is the same
+  // for all processes of a sample.
+  int num_blocks_per_sample = util::ceil(num_blocks, num_samples);
+  gdim = dim3(num_blocks_per_sample, num_samples);
+}
+
+/*
+  - gridDim.y == number of samples
+  - Each sample is taken care by gridDim.x blocks, each of which
+    stores its statistics at partials[(sample * gridDim.x + block) *
+    num_partial_values]
+ */
+template <typename DataType, int BLOCK_SIZE>
+__global__ void fp_instance_local(const DataType * __restrict__ x,
+                                  const DataType * __restrict__ truth,
+                                  const index_t sample_size,
+                                  const index_t spatial_size,
+                                  const bool use_labels,
+                                  DataType * __restrict__ partials) {
+  const auto num_blocks_per_sample = gridDim.x;
+  const index_t work_per_block = (sample_size + num_blocks_per_sample - 1) /
+      num_blocks_per_sample;
+  index_t offset = blockIdx.x * work_per_block + threadIdx.x;
+  const index_t block_end = min((blockIdx.x + 1) * work_per_block,
+                                sample_size);
+  const int sample_idx = blockIdx.y;
+
+  x += sample_idx * sample_size;
+  truth = get_sample_truth(truth, sample_idx, sample_size, spatial_size,
+                           use_labels);
+
+  merge_stats<DataType> merge;
+  auto local = merge.init();
+  for (; offset < block_end; offset += BLOCK_SIZE) {
+    local = merge(local, x[offset],
+                  get_truth(truth, offset, spatial_size, use_labels));
+  }
+
+  using BlockReduce = cubns::BlockReduce<stats<DataType>, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  auto block_stats = BlockReduce(temp_storage).Reduce(local, merge);
+  if (threadIdx.x == 0) {
+    auto p = partials +
+        (sample_idx * num_blocks_per_sample + blockIdx.x) * num_partial_values;
+    p[0] = block_stats.max;
+    p[1] = block_stats.exp_sum;
+    p[2] = block_stats.tx_sum;
+    p[3] = block_stats.t_sum;
+  }
+}
+
+/*
+  - One block per sample
+  - Merges the partials of all processes of the sample, which are
+    stored one process after another, and computes the loss
+    sum(t) * lse - sum(t * x), where lse is the log-sum-exp of x.
+ */
+template <typename DataType, int BLOCK_SIZE>
+__global__ void fp_instance_finalize(const DataType * __restrict__ partials,
+                                     const int num_blocks_per_sample,
+                                     const int num_procs,
+                                     DataType * __restrict__ sample_stats,
+                                     DataType * __restrict__ y) {
+  const int sample_idx = blockIdx.x;
+  const index_t partials_per_proc =
+      (index_t)num_blocks_per_sample * gridDim.x * num_partial_values;
+
+  merge_stats<DataType> merge;
+  auto local = merge.init();
+  for (int i = threadIdx.x; i < num_procs * num_blocks_per_sample;
+       i += BLOCK_SIZE) {
+    const auto proc = i / num_blocks_per_sample;
+    const auto block = i % num_blocks_per_sample;
+    auto p = partials + proc * partials_per_proc +
+        (sample_idx * num_blocks_per_sample + block) * num_partial_values;
+    local = merge(local, stats<DataType>{p[0], p[1], p[2], p[3]});
+  }
+
+  using BlockReduce = cubns::BlockReduce<stats<DataType>, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  auto s = BlockReduce(temp_storage).Reduce(local, merge);
+  if (threadIdx.x == 0) {
+    const auto lse = s.max + log_fn(s.exp_sum);
+    sample_stats[sample_idx * 2] = lse;
+    sample_stats[sample_idx * 2 + 1] = s.t_sum;
+    y[sample_idx] = s.t_sum * lse - s.tx_sum;
+  }
+}
+
+template <typename DataType, int BLOCK_SIZE>
+__global__ void bp_instance(const DataType * __restrict__ x,
+                            const DataType * __restrict__ truth,
+                            const DataType * __restrict__ dy,
+                            const DataType * __restrict__ sample_stats,
+                            const index_t sample_size,
+                            const index_t spatial_size,
+                            const bool use_labels,
+                            DataType * __restrict__ dx) {
+  const int sample_idx = blockIdx.y;
+  index_t offset = threadIdx.x + blockIdx.x * BLOCK_SIZE;
+  const index_t offset_stride = BLOCK_SIZE * gridDim.x;
+
+  x += sample_idx * sample_size;
+  dx += sample_idx * sample_size;
+  truth = get_sample_truth(truth, sample_idx, sample_size, spatial_size,
+                           use_labels);
+
+  const auto lse = sample_stats[sample_idx * 2];
+  const auto t_sum = sample_stats[sample_idx * 2 + 1];
+  const auto dy_sample = dy[sample_idx];
+  for (; offset < sample_size; offset += offset_stride) {
+    const auto t = get_truth(truth, offset, spatial_size, use_labels);
+    dx[offset] = dy_sample * (t_sum * exp_fn(x[offset] - lse) - t);
+  }
+}
+
+/*
+  - gridDim.y == number of samples
+  - Each thread takes care of the channels of one spatial position
+ */
+template <typename DataType, int BLOCK_SIZE>
+__global__ void fp_channel_local(const DataType * __restrict__ x,
+                                 const DataType * __restrict__ truth,
+                                 const index_t spatial_size,
+                                 const int num_channels,
+                                 const bool use_labels,
+                                 DataType * __restrict__ y) {
+  const int sample_idx = blockIdx.y;
+  const index_t spatial = threadIdx.x + blockIdx.x * BLOCK_SIZE;
+  const index_t sample_size = spatial_size * num_channels;
+
+  x += sample_idx * sample_size;
+  truth = get_sample_truth(truth, sample_idx, sample_size, spatial_size,
+                           use_labels);
+
+  auto loss = DataType(0);
+  if (spatial < spatial_size) {
+    merge_stats<DataType> merge;
+    auto s = merge.init();
+    for (int c = 0; c < num_channels; ++c) {
+      const auto offset = spatial + spatial_size * c;
+      s = merge(s, x[offset],
+                get_truth(truth, offset, spatial_size, use_labels));
+    }
+    loss = s.t_sum * (s.max + log_fn(s.exp_sum)) - s.tx_sum;
+  }
+
+  using BlockReduce = cubns::BlockReduce<DataType, BLOCK_SIZE>;
+  __shared__ typename BlockReduce::TempStorage temp_storage;
+  loss = BlockReduce(temp_storage).Sum(loss);
+  if (threadIdx.x == 0) {
+    atomic_add(&y[sample_idx], loss);
+  }
+}
+
+template <typename DataType, int BLOCK_SIZE>
+__global__ void bp_channel(const DataType * __restrict__ x,
+                           const DataType * __restrict__ truth,
+                           const DataType * __restrict__ dy,
+                           const index_t spatial_size,
+                           const int num_channels,
+                           const bool use_labels,
+                           DataType * __restrict__ dx) {
+  const int sample_idx = blockIdx.y;
+  const index_t spatial = threadIdx.x + blockIdx.x * BLOCK_SIZE;
+  const index_t sample_size = spatial_size * num_channels;
+
+  if (spatial >= spatial_size) return;
+
+  x += sample_idx * sample_size;
+  dx += sample_idx * sample_size;
+  truth = get_sample_truth(truth, sample_idx, sample_size, spatial_size,
+                           use_labels);
+
+  merge_stats<DataType> merge;
+  auto s = merge.init();
+  for (int c = 0; c < num_channels; ++c) {
+    const auto offset = spatial + spatial_size * c;
+    s = merge(s, x[offset],
+              get_truth(truth, offset, spatial_size, use_labels));
+  }
+  const auto lse = s.max + log_fn(s.exp_sum);
+  const auto dy_sample = dy[sample_idx];
+  for (int c = 0; c < num_channels; ++c) {
+    const auto offset = spatial + spatial_size * c;
+    const auto t = get_truth(truth, offset, spatial_size, use_labels);
+    dx[offset] = dy_sample * (s.t_sum * exp_fn(x[offset] - lse) - t);
+  }
+}
+
+} // namespace softmax_cross_entropy
+
+template <typename Tensor>
+int SoftmaxCrossEntropyCUDNN::forward(const Tensor &x_pred,
+                                      const Tensor &x_truth,
+                                      Tensor &y) {
+  using DataType = typename Tensor::data_type;
+  using namespace softmax_cross_entropy;
+  util::MPIPrintStreamDebug()
+      << "Softmax cross entropy FP: " << x_pred << ", "
+      << x_truth << ", " << y;
+
+  // Assumes no halo for simplicity
+  assert_eq(x_pred.get_local_size(), x_pred.get_local_real_size());
+  assert_eq(x_truth.get_local_size(), x_truth.get_local_real_size());
+
+  const int num_samples = x_pred.get_local_shape()[-1];
+
+  if (num_samples == 0) return 0;
+
+  auto stream = m_be.get_stream();
+  const int num_channels = x_pred.get_local_shape()[-2];
+
+  if (m_mode == SoftmaxMode::CHANNEL) {
+    y.zero(stream);
+    if (x_pred.get_local_size() > 0) {
+      const index_t spatial_size =
+          x_pred.get_local_size() / num_samples / num_channels;
+      dim3 gdim(util::ceil(spatial_size, (index_t)block_size), num_samples);
+      fp_channel_local<DataType, block_size>
+          <<<gdim, block_size, 0, stream>>>(
+              x_pred.get_const_buffer(), x_truth.get_const_buffer(),
+              spatial_size, num_channels, m_use_labels, y.get_buffer());
+    }
+    if (m_num_procs_per_sample > 1) {
+      m_al->allreduce(y.get_buffer(), num_samples,
+                      Al::ReductionOperator::sum);
+    }
+    return 0;
+  }
+
+  // The block statistics of all processes of a sample are gathered
+  // with a single collective, so that each process computes the loss
+  // and keeps the log-sum-exp for the backward pass.
+  dim3 gdim;
+  int ns;
+  index_t sample_size;
+  set_instance_kernel_params(x_pred, ns, sample_size, gdim);
+  const index_t spatial_size = num_channels == 0 ? 0 :
+      sample_size / num_channels;
+
+  auto& mempool = internal::RuntimeGPU::get_device_memory_pool();
+  const int num_partials = gdim.x * num_samples * num_partial_values;
+  const int num_procs = m_num_procs_per_sample > 1 ?
+      m_num_procs_per_sample : 1;
+  DataType *partials = static_cast<DataType*>(
+      mempool.get(num_partials * num_procs * sizeof(DataType), stream));
+  DataType *local_partials = partials + num_partials * get_sample_rank();
+  DataType *sample_stats = static_cast<DataType*>(
+      get_sample_stats(num_samples * 2 * sizeof(DataType), stream));
+
+  // Processes without local elements still contribute empty statistics
+  fp_instance_local<DataType, block_size>
+      <<<gdim, block_size, 0, stream>>>(
+          x_pred.get_const_buffer(), x_truth.get_const_buffer(),
+          sample_size, spatial_size, m_use_labels, local_partials);
+
+  if (m_num_procs_per_sample > 1) {
+    m_al->allgather(local_partials, partials, num_partials);
+  }
+
+  fp_instance_finalize<DataType, block_size>
+      <<<num_samples, block_size, 0, stream>>>(
+          partials, gdim.x, num_procs, sample_stats, y.get_buffer());
+
+  mempool.release(partials);
+  return 0;
+}
+
+template <typename Tensor>
+int SoftmaxCrossEntropyCUDNN::backward(const Tensor &x_pred,
+                                       const Tensor &x_truth,
+                                       Tensor &dy,
+                                       Tensor &dx_pred) {
+  using DataType = typename Tensor::data_type;
+  using namespace softmax_cross_entropy;
+  util::MPIPrintStreamDebug()
+      << "Softmax cross entropy BP: " << dy << ", " << dx_pred;
+
+  const int num_samples = x_pred.get_local_shape()[-1];
+
+  if (m_num_procs_per_sample > 1) {
+    m_al->bcast(dy.get_buffer(), num_samples, 0);
+  }
+
+  // Assumes no halo for simplicity
+  assert_eq(dx_pred.get_local_size(), dx_pred.get_local_real_size());
+
+  if (x_pred.get_local_size() == 0) return 0;
+
+  auto stream = m_be.get_stream();
+  const int num_channels = x_pred.get_local_shape()[-2];
+  const index_t sample_size = x_pred.get_local_size() / num_samples;
+  const index_t spatial_size = sample_size / num_channels;
+
+  if (m_mode == SoftmaxMode::CHANNEL) {
+    dim3 gdim(util::ceil(spatial_size, (index_t)block_size), num_samples);
+    bp_channel<DataType, block_size>
+        <<<gdim, block_size, 0, stream>>>(
+            x_pred.get_const_buffer(), x_truth.get_const_buffer(),
+            dy.get_const_buffer(), spatial_size, num_channels,
+            m_use_labels, dx_pred.get_buffer());
+    return 0;
+  }
+
+  assert_always(m_sample_stats_size >= num_samples * 2 * sizeof(DataType));
+  constexpr int thread_work_size = 8;
+  dim3 gdim(util::ceil(sample_size, (index_t)block_size * thread_work_size),
+            num_samples);
+  bp_instance<DataType, block_size>
+      <<<gdim, block_size, 0, stream>>>(
+          x_pred.get_const_buffer(), x_truth.get_const_buffer(),
+          dy.get_const_buffer(),
+          static_cast<const DataType*>(m_sample_stats),
+          sample_size, spatial_size, m_use_labels, dx_pred.get_buffer());
+  return 0;
+}
+
+#define PROTO(T)                                                        \
+  template int SoftmaxCrossEntropyCUDNN::forward<TensorCUDA<T>>(        \
+      const TensorCUDA<T> &x_pred, const TensorCUDA<T> &x_truth,        \
+      TensorCUDA<T> &y);                                                \
+  template int SoftmaxCrossEntropyCUDNN::backward<TensorCUDA<T>>(       \
+      const TensorCUDA<T> &x_pred, const TensorCUDA<T> &x_truth,        \
+      TensorCUDA<T> &dy, TensorCUDA<T> &dx_pred);
+
+PROTO(float)
+PROTO(double)
+#undef PROTO
+
+} // namespace distconv
@@ -0,0 +1,375 @@
+#include "distconv/dnn_backend/upsample.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+namespace {
+
+namespace dc = distconv;
+namespace tensor = dc::tensor;
+namespace util = dc::util;
+using index_t = dc::index_t;
+using dc::UpsampleMode;
+
+template <int ND>
+using Array = tensor::Array<ND>;
+
+template <typename DataType>
+using Tensor = tensor::Tensor<DataType, tensor::LocaleMPI, tensor::CUDAAllocator>;
+
+// Two inputs of a spatial dimension an output is interpolated from,
+// in the local coordinates of the input including its halos, and the
+// weight of the second one. Nearest upsampling reads only the first.
+template <UpsampleMode MODE, typename DataType>
+__device__ __forceinline__ void get_source(index_t out_idx,
+                                           int scale,
+                                           index_t out_offset,
+                                           index_t in_offset,
+                                           index_t in_dim,
+                                           index_t halo,
+                                           index_t &i0,
+                                           index_t &i1,
+                                           DataType &w) {
+  if (MODE == UpsampleMode::NEAREST) {
+    i0 = i1 = out_idx / scale + halo;
+    w = DataType(0);
+    return;
+  }
+  // The global coordinates are used so that the clamping applies to
+  // the boundaries of the whole tensor only
+  DataType src = (out_idx + out_offset + DataType(0.5)) / scale
+      - DataType(0.5);
+  src = util::max(src, DataType(0));
+  const index_t g0 = static_cast<index_t>(src);
+  const index_t g1 = g0 + 1 < in_dim ? g0 + 1 : g0;
+  w = src - g0;
+  i0 = g0 - in_offset + halo;
+  i1 = g1 - in_offset + halo;
+}
+
+template <int ND, UpsampleMode MODE, typename DataType>
+struct Sources {
+  static constexpr int NSD = ND - 2;
+  Array<ND> i0;
+  Array<ND> i1;
+  DataType w[NSD];
+
+  // Sets the sources of the spatial dimensions from first, and the
+  // channel and sample of out_idx
+  __device__ __forceinline__ void set(const Array<ND> &out_idx,
+                                      int first,
+                                      const Array<ND> &scales,
+                                      const Array<ND> &out_offset,
+                                      const Array<ND> &in_offset,
+                                      const Array<ND> &in_dims,
+                                      const Array<ND> &halo) {
+    for (int d = first; d < NSD; ++d) {
+      get_source<MODE>(out_idx[d], scales[d], out_offset[d], in_offset[d],
+                       in_dims[d], halo[d], i0[d], i1[d], w[d]);
+    }
+    for (int d = NSD; d < ND; ++d) {
+      i0[d] = i1[d] = out_idx[d] + halo[d];
+    }
+  }
+
+  // Input index and weight of corner c, whose bit d selects the
+  // second input of spatial dimension d
+  __device__ __forceinline__ DataType get_corner(int c,
+                                                 Array<ND> &in_idx) const {
+    DataType weight = DataType(1);
+#pragma unroll
+    for (int d = 0; d < NSD; ++d) {
+      const bool second = (c >> d) & 1;
+      in_idx[d] = second ? i1[d] : i0[d];
+      weight *= second ? w[d] : DataType(1) - w[d];
+    }
+#pragma unroll
+    for (int d = NSD; d < ND; ++d) {
+      in_idx[d] = i0[d];
+    }
+    return weight;
+  }
+
+  static constexpr int get_num_corners() {
+    return MODE == UpsampleMode::NEAREST ? 1 : 1 << NSD;
+  }
+};
+
+template <int W, typename DataType>
+__device__ __forceinline__ void store(DataType *p, const DataType (&v)[W]) {
+  using DataTypeV = typename util::GetVectorType<DataType, W>::type;
+  if constexpr (W == 4) {
+    *reinterpret_cast<DataTypeV*>(p) =
+        util::make_vector<DataType, DataTypeV>(v[0], v[1], v[2], v[3]);
+  } else if constexpr (W == 2) {
+    *reinterpret_cast<DataTypeV*>(p) =
+        util::make_vector<DataType, DataTypeV>(v[0], v[1]);
+  } else {
+    *p = v[0];
+  }
+}
+
+// Each thread computes W consecutive outputs of the innermost
+// dimension, which share the sources of the other dimensions, and
+// stores them as a vector. The input is read including its halos.
+template <int ND, UpsampleMode MODE, int W, typename DataType>
+__global__ void upsample_forward_kernel(const DataType *input,
+                                        const Array<ND> input_shape,
+                                        const Array<ND> input_halo,
+                                        const Array<ND> input_offset,
+                                        const Array<ND> input_dims,
+                                        DataType *output,
+                                        const Array<ND> output_dims,
+                                        const Array<ND> output_shape,
+                                        const Array<ND> output_offset,
+                                        const Array<ND> scales) {
+  const index_t row_size = output_dims[0] / W;
+  const index_t num_threads = output_dims.get_size() / W;
+  const index_t gidx = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  if (gidx >= num_threads) return;
+  index_t idx = gidx;
+  Array<ND> out_idx;
+  out_idx[0] = idx % row_size * W;
+  idx /= row_size;
+  for (int i = 1; i < ND; ++i) {
+    out_idx[i] = idx % output_dims[i];
+    idx /= output_dims[i];
+  }
+
+  Sources<ND, MODE, DataType> src;
+  src.set(out_idx, 1, scales, output_offset, input_offset, input_dims,
+          input_halo);
+  DataType v[W];
+#pragma unroll
+  for (int k = 0; k < W; ++k) {
+    get_source<MODE>(out_idx[0] + k, scales[0], output_offset[0],
+                     input_offset[0], input_dims[0], input_halo[0],
+                     src.i0[0], src.i1[0], src.w[0]);
+    DataType sum = DataType(0);
+#pragma unroll
+    for (int c = 0; c < src.get_num_corners(); ++c) {
+      Array<ND> in_idx;
+      const DataType weight = src.get_corner(c, in_idx);
+      sum += weight * input[tensor::get_offset(in_idx, input_shape)];
+    }
+    v[k] = sum;
+  }
+  store<W>(&output[tensor::get_offset(out_idx, output_shape)], v);
+}
+
+// Adds the weighted gradient of each output to its sources. Gradients
+// of halo elements are left in the halos of d_input for the reverse
+// halo exchange.
+template <int ND, typename DataType>
+__global__ void upsample_linear_backward_kernel(const DataType *d_output,
+                                                const Array<ND> output_dims,
+                                                const Array<ND> output_shape,
+                                                const Array<ND> output_offset,
+                                                const Array<ND> scales,
+                                                DataType *d_input,
+                                                const Array<ND> input_shape,
+                                                const Array<ND> input_halo,
+                                                const Array<ND> input_offset,
+                                                const Array<ND> input_dims) {
+  const index_t num_outputs = output_dims.get_size();
+  const index_t gidx = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  if (gidx >= num_outputs) return;
+  index_t idx = gidx;
+  Array<ND> out_idx;
+  for (int i = 0; i < ND; ++i) {
+    out_idx[i] = idx % output_dims[i];
+    idx /= output_dims[i];
+  }
+  Sources<ND, UpsampleMode::LINEAR, DataType> src;
+  src.set(out_idx, 0, scales, output_offset, input_offset, input_dims,
+          input_halo);
+  const DataType dy = d_output[tensor::get_offset(out_idx, output_shape)];
+#pragma unroll
+  for (int c = 0; c < src.get_num_corners(); ++c) {
+    Array<ND> in_idx;
+    const DataType weight = src.get_corner(c, in_idx);
+    atomic_add(&d_input[tensor::get_offset(in_idx, input_shape)],
+               weight * dy);
+  }
+}
+
+// Each thread sums the gradients of the outputs copied from one
+// input element, so no atomics or halos are needed.
+template <int ND, typename DataType>
+__global__ void upsample_nearest_backward_kernel(const DataType *d_output,
+                                                 const Array<ND> output_shape,
+                                                 const Array<ND> scales,
+                                                 DataType *d_input,
+                                                 const Array<ND> input_dims,
+                                                 const Array<ND> input_shape) {
+  const index_t num_inputs = input_dims.get_size();
+  const index_t gidx = threadIdx.x + blockIdx.x * (index_t)blockDim.x;
+  if (gidx >= num_inputs) return;
+  index_t idx = gidx;
+  Array<ND> in_idx;
+  int window_size = 1;
+  for (int i = 0; i < ND; ++i) {
+    in_idx[i] = idx % input_dims[i];
+    idx /= input_dims[i];
+    window_size *= scales[i];
+  }
+  DataType sum = DataType(0);
+  for (int k = 0; k < window_size; ++k) {
+    Array<ND> out_idx;
+    for (int i = 0, x = k; i < ND; ++i) {
+      out_idx[i] = in_idx[i] * scales[i] + x % scales[i];
+      x /= scales[i];
+    }
+    sum += d_output[tensor::get_offset(out_idx, output_shape)];
+  }
+  d_input[tensor::get_offset(in_idx, input_shape)] = sum;
+}
+
+// Base of the local buffer of t including its halos
+template <typename DataType>
+DataType *get_halo_base_ptr(const Tensor<DataType> &t) {
+  return const_cast<DataType*>(t.get_const_base_ptr())
+      - t.get_local_offset(dc::IndexVector(t.get_overlap()), true);
+}
+
+// Widest vector of outputs of a row that a thread can store
+template <typename DataType>
+int get_vector_width(const Tensor<DataType> &output) {
+  const auto pitch = output.get_local_pitched_shape()[0];
+  const auto row = output.get_local_shape()[0];
+  for (int w : {4, 2}) {
+    if (pitch % w == 0 && row % w == 0) return w;
+  }
+  return 1;
+}
+
+template <int ND, UpsampleMode MODE, typename DataType>
+void upsample_forward_nd(const Tensor<DataType> &input,
+                         Tensor<DataType> &output,
+                         const Array<ND> &scales,
+                         h2::gpu::DeviceStream stream) {
+  const auto output_dims = output.get_local_shape();
+  const int w = get_vector_width(output);
+  const index_t num_threads = output_dims.get_size() / w;
+  const int bsize = 256;
+  const index_t gsize = (num_threads + bsize - 1) / bsize;
+#define CALL_KERNEL(W)                                                  \
+  upsample_forward_kernel<ND, MODE, W, DataType>                        \
+      <<<gsize, bsize, 0, stream>>>(                                    \
+          get_halo_base_ptr(input), input.get_local_pitched_shape(),    \
+          Array<ND>(dc::IndexVector(input.get_overlap())),              \
+          Array<ND>(input.get_global_index()), input.get_shape(),       \
+          output.get_base_ptr(), output_dims,                           \
+          output.get_local_pitched_shape(),                             \
+          Array<ND>(output.get_global_index()), scales)
+  switch (w) {
+    case 4: CALL_KERNEL(4); break;
+    case 2: CALL_KERNEL(2); break;
+    default: CALL_KERNEL(1); break;
+  }
+#undef CALL_KERNEL
+}
+
+template <int ND, typename DataType>
+void upsample_backward_nd(UpsampleMode mode,
+                          const Tensor<DataType> &d_output,
+                          Tensor<DataType> &d_input,
+                          const Array<ND> &scales,
+                          h2::gpu::DeviceStream stream) {
+  const int bsize = 256;
+  if (mode == UpsampleMode::NEAREST) {
+    const auto input_dims = d_input.get_local_shape();
+    const index_t gsize = (input_dims.get_size() + bsize - 1) / bsize;
+    upsample_nearest_backward_kernel<ND, DataType>
+        <<<gsize, bsize, 0, stream>>>(
+            d_output.get_const_base_ptr(),
+            d_output.get_local_pitched_shape(), scales,
+            d_input.get_base_ptr(), input_dims,
+            d_input.get_local_pitched_shape());
+    return;
+  }
+  d_input.zero(stream);
+  const auto output_dims = d_output.get_local_shape();
+  if (output_dims.get_size() == 0) return;
+  const index_t gsize = (output_dims.get_size() + bsize - 1) / bsize;
+  upsample_linear_backward_kernel<ND, DataType><<<gsize, bsize, 0, stream>>>(
+      d_output.get_const_base_ptr(), output_dims,
+      d_output.get_local_pitched_shape(),
+      Array<ND>(d_output.get_global_index()), scales,
+      get_halo_base_ptr(d_input), d_input.get_local_pitched_shape(),
+      Array<ND>(dc::IndexVector(d_input.get_overlap())),
+      Array<ND>(d_input.get_global_index()), d_input.get_shape());
+}
+
+} // namespace
+
+namespace distconv {
+
+template <typename DataType>
+void Upsample<BackendDNNLib, DataType>::upsample_forward(
+    Tensor<DataType> const& input,
+    Tensor<DataType>& output)
+{
+    auto stream = m_be.get_stream();
+    const IndexVector scales(m_scale_factors);
+    switch (m_num_dims)
+    {
+    case 4:
+        if (m_mode == UpsampleMode::NEAREST)
+            upsample_forward_nd<4, UpsampleMode::NEAREST>(
+                input, output, Array<4>(scales), stream);
+        else
+            upsample_forward_nd<4, UpsampleMode::LINEAR>(
+                input, output, Array<4>(scales), stream);
+        break;
+    case 5:
+        if (m_mode == UpsampleMode::NEAREST)
+            upsample_forward_nd<5, UpsampleMode::NEAREST>(
+                input, output, Array<5>(scales), stream);
+        else
+            upsample_forward_nd<5, UpsampleMode::LINEAR>(
+                input, output, Array<5>(scales), stream);
+        break;
+    default:
+        util::MPIPrintStreamError()
+            << "Upsampling of " << m_num_dims
+            << "-dimensional tensors not supported";
+        throw std::exception();
+    }
+}
+
+template <typename DataType>
+void Upsample<BackendDNNLib, DataType>::upsample_backward(
+    Tensor<DataType> const& d_output,
+    Tensor<DataType>& d_input)
+{
+    auto stream = m_be.get_stream();
+    const IndexVector scales(m_scale_factors);
+    switch (m_num_dims)
+    {
+    case 4:
+        upsample_backward_nd<4>(
+            m_mode, d_output, d_input, Array<4>(scales), stream);
+        break;
+    case 5:
+        upsample_backward_nd<5>(
+            m_mode, d_output, d_input, Array<5>(scales), stream);
+        break;
+    default:
+        util::MPIPrintStreamError()
+            << "Upsampling of " << m_num_dims
+            << "-dimensional tensors not supported";
+        throw std::exception();
+    }
+}
+
+#define INSTANTIATE(TYPE)                                                      \
+    template void Upsample<BackendDNNLib, TYPE>::upsample_forward(             \
+        Tensor<TYPE> const& input, Tensor<TYPE>& output);                      \
+    template void Upsample<BackendDNNLib, TYPE>::upsample_backward(            \
+        Tensor<TYPE> const& d_output, Tensor<TYPE>& d_input)
+INSTANTIATE(float);
+INSTANTIATE(double);
+#undef INSTANTIATE
+
+} // namespace distconv
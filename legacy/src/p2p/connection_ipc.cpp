@@ -4,7 +4,9 @@
 #include "p2p/logging.hpp"
 #include "p2p/mpi.hpp"
 
+#include <cstdlib>
 #include <cstring>
+#include <limits>
 
 using namespace p2p::logging;
 
@@ -42,11 +44,15 @@ bool ConnectionIPC::is_ipc_capable(int peer, internal::MPI &mpi,
 
 ConnectionIPC::ConnectionIPC(int peer, int dev,
                              const internal::MPI &mpi,
-                             util::EventPool &ev_pool):
+                             util::EventPool &ev_pool,
+                             bool same_process):
     Connection(peer, mpi, ev_pool), m_dev_peer(dev),
-    m_peer_event_opened(false), m_peer_enabled(false) {
+    m_same_process(same_process),
+    m_peer_event_opened(false), m_peer_enabled(false),
+    m_dev_relay(-1), m_relay_buf(nullptr), m_relay_size(0) {
   // enable peer access
   enable_peer_access_if_possible();
+  select_path();
   // set up event
   P2P_CHECK_CUDA_ALWAYS(cudaEventCreateWithFlags(
       &m_ev, cudaEventInterprocess | cudaEventDisableTiming));
@@ -62,6 +68,14 @@ ConnectionIPC::~ConnectionIPC() {
 
 Request ConnectionIPC::connect_nb() {
   logging::MPIPrintStreamDebug() << "ConnectIPC::connect_nb\n";
+  if (m_same_process) {
+    // The events are exchanged as they are
+    MPI_Request isend_req;
+    m_mpi.isend(&m_ev, sizeof(cudaEvent_t), m_peer, &isend_req);
+    MPI_Request irecv_req;
+    m_mpi.irecv(&m_ev_peer, sizeof(cudaEvent_t), m_peer, &irecv_req);
+    return Request(Request::Kind::CONNECT, this, isend_req, irecv_req);
+  }
   cudaIpcEventHandle_t ipc_handle_self;
   P2P_CHECK_CUDA_ALWAYS(cudaIpcGetEventHandle(&ipc_handle_self, m_ev));
   MPI_Request isend_req;
@@ -75,6 +89,11 @@ Request ConnectionIPC::connect_nb() {
 }
 
 int ConnectionIPC::connect_post() {
+  if (m_same_process) {
+    // The event of the peer is owned by the peer
+    m_connected = true;
+    return 0;
+  }
   P2P_CHECK_CUDA_ALWAYS(
       cudaIpcOpenEventHandle(&m_ev_peer, m_peer_ev_handle));
   m_peer_event_opened = true;
@@ -103,10 +122,101 @@ void ConnectionIPC::enable_peer_access_if_possible() {
   }
 }
 
+// Devices without peer access are connected through the device with
+// the best performance rank of the two hops if any. Otherwise, the
+// driver stages transfers through host memory. Relaying can be
+// disabled by setting P2P_IPC_RELAY=0.
+void ConnectionIPC::select_path() {
+  if (m_peer_enabled || m_dev == m_dev_peer) {
+    m_path = Path::DIRECT;
+    return;
+  }
+  m_path = Path::STAGED;
+  const char *env = std::getenv("P2P_IPC_RELAY");
+  if (env && std::atoi(env) == 0) return;
+  int num_devs;
+  P2P_CHECK_CUDA_ALWAYS(cudaGetDeviceCount(&num_devs));
+  int best_rank = std::numeric_limits<int>::max();
+  for (int dev = 0; dev < num_devs; ++dev) {
+    if (dev == m_dev || dev == m_dev_peer) continue;
+    int to_relay, from_relay;
+    P2P_CHECK_CUDA_ALWAYS(cudaDeviceGetP2PAttribute(
+        &to_relay, cudaDevP2PAttrAccessSupported, m_dev, dev));
+    P2P_CHECK_CUDA_ALWAYS(cudaDeviceGetP2PAttribute(
+        &from_relay, cudaDevP2PAttrAccessSupported, dev, m_dev_peer));
+    if (!to_relay || !from_relay) continue;
+    int rank_to, rank_from;
+    P2P_CHECK_CUDA_ALWAYS(cudaDeviceGetP2PAttribute(
+        &rank_to, cudaDevP2PAttrPerformanceRank, m_dev, dev));
+    P2P_CHECK_CUDA_ALWAYS(cudaDeviceGetP2PAttribute(
+        &rank_from, cudaDevP2PAttrPerformanceRank, dev, m_dev_peer));
+    if (rank_to + rank_from < best_rank) {
+      best_rank = rank_to + rank_from;
+      m_dev_relay = dev;
+    }
+  }
+  if (m_dev_relay < 0) return;
+  m_path = Path::RELAY;
+  cudaError_t e = cudaDeviceEnablePeerAccess(m_dev_relay, 0);
+  P2P_ASSERT_ALWAYS(e == cudaSuccess ||
+                    e == cudaErrorPeerAccessAlreadyEnabled);
+  P2P_CHECK_CUDA_ALWAYS(cudaSetDevice(m_dev_relay));
+  e = cudaDeviceEnablePeerAccess(m_dev_peer, 0);
+  P2P_ASSERT_ALWAYS(e == cudaSuccess ||
+                    e == cudaErrorPeerAccessAlreadyEnabled);
+  P2P_CHECK_CUDA_ALWAYS(cudaSetDevice(m_dev));
+  // clear the error status
+  cudaGetLastError();
+  P2P_CHECK_CUDA_ALWAYS(cudaEventCreateWithFlags(
+      &m_relay_ev, cudaEventDisableTiming));
+  MPIPrintStreamDebug() << "Relaying transfers from device " << m_dev
+                        << " to " << m_dev_peer << " through device "
+                        << m_dev_relay << "\n";
+}
+
+void ConnectionIPC::ensure_relay_buffer(size_t size) {
+  if (size <= m_relay_size) return;
+  P2P_CHECK_CUDA_ALWAYS(cudaSetDevice(m_dev_relay));
+  if (m_relay_buf) {
+    // Wait until the buffer is no longer used
+    P2P_CHECK_CUDA_ALWAYS(cudaEventSynchronize(m_relay_ev));
+    P2P_CHECK_CUDA_ALWAYS(cudaFree(m_relay_buf));
+  }
+  P2P_CHECK_CUDA_ALWAYS(cudaMalloc(&m_relay_buf, size));
+  P2P_CHECK_CUDA_ALWAYS(cudaSetDevice(m_dev));
+  m_relay_size = size;
+}
+
+int ConnectionIPC::put_relay(const void *src, void *dst, size_t size,
+                             cudaStream_t stream) {
+  ensure_relay_buffer(size);
+  // Serializes the puts using the relay buffer
+  P2P_CHECK_CUDA(cudaStreamWaitEvent(stream, m_relay_ev, 0));
+  P2P_CHECK_CUDA(cudaMemcpyPeerAsync(m_relay_buf, m_dev_relay,
+                                     src, m_dev, size, stream));
+  P2P_CHECK_CUDA(cudaMemcpyPeerAsync(dst, m_dev_peer,
+                                     m_relay_buf, m_dev_relay, size,
+                                     stream));
+  P2P_CHECK_CUDA(cudaEventRecord(m_relay_ev, stream));
+  return 0;
+}
+
 Request ConnectionIPC::register_addr_nb(void *self, void *peer) {
   MPIPrintStreamDebug()
       << "Registering local addr, " << self << ", and remote addr, "
       << peer << "\n";
+  if (m_same_process) {
+    // The address of the peer is valid here as well
+    if (peer) {
+      if (find_mapped_peer_memory(peer)) {
+        ++m_mapped_mem_refs[peer];
+      } else {
+        add_or_replace_mapped_peer_memory(peer, peer);
+        m_mapped_mem_refs[peer] = 1;
+      }
+    }
+    return Request();
+  }
   cudaIpcMemHandle_t self_handle;
   auto *peer_data = new register_addr_data();
   peer_data->first = peer;
@@ -151,6 +261,7 @@ int ConnectionIPC::register_addr_post(void *data) {
     MPIPrintStreamDebug()
         << "Remote memory " << peer << " from device " << m_dev_peer
         << " already opened at " << already_opened << "\n";
+    ++m_mapped_mem_refs[already_opened];
     return 0;
   }
 
@@ -175,11 +286,26 @@ int ConnectionIPC::register_addr_post(void *data) {
     P2P_CHECK_CUDA_ALWAYS(cudaSetDevice(m_dev));
   }
   add_or_replace_mapped_peer_memory(peer, mapped_mem);
+  m_mapped_mem_refs[mapped_mem] = 1;
   return 0;
 }
 
 int ConnectionIPC::deregister_addr(void *mapped_addr) {
   P2P_ASSERT_ALWAYS(mapped_addr);
+  auto it = m_mapped_mem_refs.find(mapped_addr);
+  if (it != m_mapped_mem_refs.end()) {
+    if (--it->second > 0) {
+      MPIPrintStreamDebug()
+          << "Remote memory mapped at " << mapped_addr
+          << " still registered " << it->second << " times\n";
+      return 0;
+    }
+    m_mapped_mem_refs.erase(it);
+  }
+  if (m_same_process) {
+    delete_mapped_addr(mapped_addr);
+    return 0;
+  }
   if (!m_peer_enabled) {
     P2P_CHECK_CUDA_ALWAYS(cudaSetDevice(m_dev_peer));
   }
@@ -220,12 +346,73 @@ int ConnectionIPC::put(const void *src, void *dst, size_t size,
       << get_peer() << " using device " << m_dev_peer
       << " mapped to " << dst << "\n";
   if (size == 0) return 0;
+  if (m_path == Path::RELAY) {
+    return put_relay(src, dst, size, stream);
+  }
   P2P_CHECK_CUDA(cudaMemcpyPeerAsync(dst, m_dev_peer,
                                      src, m_dev, size,
                                      stream));
   return 0;
 }
 
+int ConnectionIPC::put_3d(const void *src, size_t src_pitch,
+                          size_t src_height,
+                          void *dst, size_t dst_pitch, size_t dst_height,
+                          size_t width, size_t height, size_t depth,
+                          cudaStream_t stream) {
+  logging::MPIPrintStreamDebug()
+      << "Put " << depth << "x" << height << "x" << width << " bytes from "
+      << src << " to rank " << get_peer() << " mapped to " << dst << "\n";
+  P2P_ASSERT_ALWAYS(m_path == Path::DIRECT);
+  if (width == 0 || height == 0 || depth == 0) return 0;
+#if H2_HAS_ROCM
+  // Peer memory is accessible as the path is direct
+  hipMemcpy3DParms parms = {};
+  parms.srcPtr = make_hipPitchedPtr(const_cast<void*>(src), src_pitch,
+                                    width, src_height);
+  parms.dstPtr = make_hipPitchedPtr(dst, dst_pitch, width, dst_height);
+  parms.extent = make_hipExtent(width, height, depth);
+  parms.kind = hipMemcpyDefault;
+  P2P_CHECK_CUDA(hipMemcpy3DAsync(&parms, stream));
+#else
+  cudaMemcpy3DPeerParms parms = {};
+  parms.srcPtr = make_cudaPitchedPtr(const_cast<void*>(src), src_pitch,
+                                     width, src_height);
+  parms.srcDevice = m_dev;
+  parms.dstPtr = make_cudaPitchedPtr(dst, dst_pitch, width, dst_height);
+  parms.dstDevice = m_dev_peer;
+  parms.extent = make_cudaExtent(width, height, depth);
+  P2P_CHECK_CUDA(cudaMemcpy3DPeerAsync(&parms, stream));
+#endif
+  return 0;
+}
+
+bool ConnectionIPC::get_ipc_base(const void *ptr, void **base) {
+#if H2_HAS_ROCM
+  hipDeviceptr_t start;
+  size_t size;
+  if (hipMemGetAddressRange(&start, &size, const_cast<void*>(ptr))
+      != hipSuccess) {
+    hipGetLastError();
+    return false;
+  }
+  *base = start;
+#else
+  const auto dptr = reinterpret_cast<CUdeviceptr>(ptr);
+  int capable = 0;
+  if (cuPointerGetAttribute(&capable,
+                            CU_POINTER_ATTRIBUTE_IS_LEGACY_CUDA_IPC_CAPABLE,
+                            dptr) != CUDA_SUCCESS || !capable) {
+    return false;
+  }
+  CUdeviceptr start;
+  size_t size;
+  P2P_CHECK_CUDA_DRV_ALWAYS(cuMemGetAddressRange(&start, &size, dptr));
+  *base = reinterpret_cast<void*>(start);
+#endif
+  return true;
+}
+
 int ConnectionIPC::transfer(void *local_buf, void *peer_buf, size_t size,
                             cudaStream_t stream, bool is_src) {
   if (is_src) {
@@ -244,7 +431,8 @@ int ConnectionIPC::close_remote_resources() {
         << x.first << "\n";
     P2P_ASSERT_ALWAYS(x.first);
     P2P_ASSERT_ALWAYS(x.second);
-    if (x.second != nullptr) {
+    // Memory of the same process is not mapped
+    if (x.second != nullptr && !m_same_process) {
       if (!m_peer_enabled) {
         P2P_CHECK_CUDA_ALWAYS(cudaSetDevice(m_dev_peer));
       }
@@ -257,6 +445,7 @@ int ConnectionIPC::close_remote_resources() {
     }
   }
   m_remote_mem_map.clear();
+  m_mapped_mem_refs.clear();
   if (m_peer_event_opened) {
     P2P_CHECK_CUDA_ALWAYS(cudaEventDestroy(m_ev_peer));
     m_peer_event_opened = false;
@@ -267,6 +456,15 @@ int ConnectionIPC::close_remote_resources() {
 int ConnectionIPC::disconnect() {
   if (!m_connected) return 0;
   P2P_CHECK_CUDA_ALWAYS(cudaEventDestroy(m_ev));
+  if (m_path == Path::RELAY) {
+    P2P_CHECK_CUDA_ALWAYS(cudaEventSynchronize(m_relay_ev));
+    P2P_CHECK_CUDA_ALWAYS(cudaEventDestroy(m_relay_ev));
+    if (m_relay_buf) {
+      P2P_CHECK_CUDA_ALWAYS(cudaFree(m_relay_buf));
+      m_relay_buf = nullptr;
+      m_relay_size = 0;
+    }
+  }
   m_connected = false;
   return 0;
 }
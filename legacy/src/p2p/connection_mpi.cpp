@@ -4,6 +4,11 @@
 #include "p2p/logging.hpp"
 #include "p2p/nvtx.hpp"
 
+#include "h2/gpu/runtime.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
 namespace p2p {
 
 ConnectionMPI::ConnectionMPI(int peer, const internal::MPI &mpi,
@@ -15,6 +20,16 @@ ConnectionMPI::ConnectionMPI(int peer, const internal::MPI &mpi,
                                  << (m_use_stream_mem_ops ?
                                      "enabled" : "disabled")
                                  << "\n";
+  m_cuda_aware = util::is_mpi_cuda_aware();
+  m_eager_size = 8192;
+  if (const char *env = std::getenv("P2P_MPI_EAGER_SIZE")) {
+    m_eager_size = std::strtoul(env, nullptr, 10);
+  }
+  logging::MPIPrintStreamDebug() << "CUDA-aware MPI: "
+                                 << (m_cuda_aware ?
+                                     "enabled" : "disabled")
+                                 << ", eager size: " << m_eager_size
+                                 << "\n";
   if (m_use_stream_mem_ops) {
     P2P_CHECK_CUDA_ALWAYS(
         cudaMalloc(&m_wait_mem, sizeof(cuuint32_t)));
@@ -26,10 +41,15 @@ ConnectionMPI::ConnectionMPI(int peer, const internal::MPI &mpi,
                       cudaHostAllocMapped | cudaHostAllocWriteCombined));
     *m_wait_mem = 0;
   }
-  P2P_CHECK_CUDA_ALWAYS(
-      cudaStreamCreate(&m_internal_stream));
+  // Unblocking the waiting streams is on the critical path of the
+  // exchange, so it should not queue behind compute kernels. The
+  // stream is not shared: the streams that wait for the values it
+  // writes may be shared ones, and would never be released if the
+  // write queued behind their wait.
+  m_internal_stream = h2::gpu::make_stream_with_priority(
+      h2::gpu::stream_priority_range().greatest);
   m_connected = true;
-  m_worker = std::thread(&ConnectionMPI::run_worker, this);
+  internal::ProgressEngine::get_instance().attach(this, m_dev);
 }
 
 ConnectionMPI::~ConnectionMPI() {
@@ -56,9 +76,15 @@ int ConnectionMPI::block_stream(cudaStream_t stream,
                                    << wait_val
                                    << " at " << m_wait_mem
                                    << "\n";
+#if H2_HAS_ROCM
+    P2P_CHECK_CUDA_DRV(
+        hipStreamWaitValue32(stream, (void*)m_wait_mem,
+                             wait_val, hipStreamWaitValueEq));
+#else
     P2P_CHECK_CUDA_DRV(
         cuStreamWaitValue32(stream, (CUdeviceptr)m_wait_mem,
                             wait_val, CU_STREAM_WAIT_VALUE_EQ));
+#endif
     return 0;
   } else {
     return spin_wait_stream(stream, wait_val);
@@ -73,28 +99,36 @@ int ConnectionMPI::unblock_stream(cuuint32_t wait_val) {
                                  << " at " << m_wait_mem
                                  << "\n";
   if (m_use_stream_mem_ops) {
+#if H2_HAS_ROCM
+    P2P_CHECK_CUDA_DRV(hipStreamWriteValue32(
+        m_internal_stream, (void*)m_wait_mem, wait_val, 0));
+#else
     P2P_CHECK_CUDA_DRV(cuStreamWriteValue32(
         m_internal_stream, (CUdeviceptr)m_wait_mem, wait_val,
         CU_STREAM_WRITE_VALUE_DEFAULT));
+#endif
     return 0;
   } else {
     return unblock_spin_wait(wait_val);
   }
 }
 
-void ConnectionMPI::notify_callback(cudaStream_t stream,
-                                    cudaError_t status,
-                                    void *user_data) {
-  ConnectionMPI *conn = static_cast<ConnectionMPI*>(user_data);
-  P2P_ASSERT_ALWAYS(conn != nullptr);
-  conn->m_cv.notify_one();
-  return;
+// Messages of halo exchange are mostly above the eager size
+ConnectionMPI::Path ConnectionMPI::get_path() const {
+  return m_cuda_aware ? Path::DIRECT : Path::STAGED;
+}
+
+bool ConnectionMPI::is_direct(size_t size) const {
+  return m_cuda_aware && size > m_eager_size;
 }
 
 int ConnectionMPI::send(const void *buf, size_t size,
                         cudaStream_t stream) {
   logging::MPIPrintStreamDebug() << "Sending msg of size "
                                  << size << "\n";
+  if (is_direct(size)) {
+    return send_direct(buf, size, stream);
+  }
   void *host = m_pinned_mem_pool.get(size);
   P2P_ASSERT_ALWAYS(host != nullptr);
   P2P_CHECK_CUDA(
@@ -103,18 +137,27 @@ int ConnectionMPI::send(const void *buf, size_t size,
   cudaEvent_t ev = m_ev_pool.get();
   P2P_CHECK_CUDA(
       cudaEventRecord(ev, stream));
-  Req r = Req::create_send_request(host, size, stream, ev);
-  std::unique_lock<std::mutex> lock(m_mtx);
-  m_requests.push_back(r);
-  lock.unlock();
-  logging::MPIPrintStreamDebug() << "Notifying worker\n";
-  m_cv.notify_one();
+  internal::ProgressEngine::Task task;
+  // Posted once the transfer to the host buffer is done
+  task.ready_event = ev;
+  task.post = [this, host, size](MPI_Request *reqs) {
+    m_mpi.isend(host, size, m_peer, &reqs[0]);
+    return 1;
+  };
+  task.transferred = [this, host, ev]() {
+    m_ev_pool.release(ev);
+    m_pinned_mem_pool.release(host);
+  };
+  internal::ProgressEngine::get_instance().submit(this, std::move(task));
   return 0;
 }
 
 int ConnectionMPI::recv(void *dst, size_t size, cudaStream_t stream) {
   logging::MPIPrintStreamDebug() << "Receiving msg of size "
                                  << size << "\n";
+  if (is_direct(size)) {
+    return recv_direct(dst, size, stream);
+  }
   void *host = m_pinned_mem_pool.get(size);
   cudaEvent_t e = m_ev_pool.get();
   cuuint32_t wait_val = ++m_req_counter;
@@ -123,19 +166,32 @@ int ConnectionMPI::recv(void *dst, size_t size, cudaStream_t stream) {
       cudaMemcpyAsync(
           dst, host, size, cudaMemcpyHostToDevice, stream));
   P2P_CHECK_CUDA(cudaEventRecord(e, stream));
-  Req r = Req::create_recv_request(host, dst, size, stream,
-                                   e, wait_val);
-  std::unique_lock<std::mutex> lock(m_mtx);
-  m_requests.push_back(r);
-  lock.unlock();
-  logging::MPIPrintStreamDebug() << "Notifying worker\n";
-  m_cv.notify_one();
+  internal::ProgressEngine::Task task;
+  task.post = [this, host, size](MPI_Request *reqs) {
+    m_mpi.irecv(host, size, m_peer, &reqs[0]);
+    return 1;
+  };
+  // Unblocks the user stream
+  task.transferred = [this, wait_val]() {
+    unblock_stream(wait_val);
+  };
+  // The host buffer is released once copied to the device
+  task.done_event = e;
+  task.done = [this, host, e]() {
+    m_ev_pool.release(e);
+    m_pinned_mem_pool.release(host);
+  };
+  internal::ProgressEngine::get_instance().submit(this, std::move(task));
   return 0;
 }
 
 int ConnectionMPI::sendrecv(const void *send_buf, size_t send_size,
                             void *recv_buf, size_t recv_size,
                             cudaStream_t stream) {
+  if (is_direct(std::min(send_size, recv_size))) {
+    return sendrecv_direct(send_buf, send_size, recv_buf, recv_size,
+                           stream);
+  }
   void *host_send = m_pinned_mem_pool.get(send_size);
   void *host_recv = m_pinned_mem_pool.get(recv_size);
   cuuint32_t wait_val = ++m_req_counter;
@@ -148,7 +204,7 @@ int ConnectionMPI::sendrecv(const void *send_buf, size_t send_size,
       cudaEventRecord(ev, stream));
 
   block_stream(stream, wait_val);
-  
+
   P2P_CHECK_CUDA(
       cudaMemcpyAsync(
           recv_buf, host_recv, recv_size,
@@ -157,18 +213,92 @@ int ConnectionMPI::sendrecv(const void *send_buf, size_t send_size,
   P2P_CHECK_CUDA(
       cudaEventRecord(ev2, stream));
 
-  Req r = Req::create_sendrecv_request(
-      host_send, send_size, ev,
-      host_recv, recv_size, ev2, wait_val,
-      stream);
-  
-  std::unique_lock<std::mutex> lock(m_mtx);
-  m_requests.push_back(r);
-  lock.unlock();
-  
-  logging::MPIPrintStreamDebug() << "Notifying worker\n";
-  m_cv.notify_one();
-  
+  internal::ProgressEngine::Task task;
+  task.ready_event = ev;
+  task.post = [this, host_send, send_size, host_recv,
+               recv_size](MPI_Request *reqs) {
+    m_mpi.isend(host_send, send_size, m_peer, &reqs[0]);
+    m_mpi.irecv(host_recv, recv_size, m_peer, &reqs[1]);
+    return 2;
+  };
+  task.transferred = [this, wait_val, host_send, ev]() {
+    // Unblocks the user stream
+    unblock_stream(wait_val);
+    m_ev_pool.release(ev);
+    m_pinned_mem_pool.release(host_send);
+  };
+  task.done_event = ev2;
+  task.done = [this, host_recv, ev2]() {
+    m_ev_pool.release(ev2);
+    m_pinned_mem_pool.release(host_recv);
+  };
+  internal::ProgressEngine::get_instance().submit(this, std::move(task));
+  return 0;
+}
+
+// The device buffers are accessed by MPI once the preceding work on
+// the stream is done, and the stream is blocked until the transfers
+// complete.
+int ConnectionMPI::send_direct(const void *buf, size_t size,
+                               cudaStream_t stream) {
+  cudaEvent_t ev = m_ev_pool.get();
+  P2P_CHECK_CUDA(cudaEventRecord(ev, stream));
+  cuuint32_t wait_val = ++m_req_counter;
+  block_stream(stream, wait_val);
+  internal::ProgressEngine::Task task;
+  task.ready_event = ev;
+  task.post = [this, buf, size](MPI_Request *reqs) {
+    m_mpi.isend(buf, size, m_peer, &reqs[0]);
+    return 1;
+  };
+  task.transferred = [this, wait_val, ev]() {
+    unblock_stream(wait_val);
+    m_ev_pool.release(ev);
+  };
+  internal::ProgressEngine::get_instance().submit(this, std::move(task));
+  return 0;
+}
+
+int ConnectionMPI::recv_direct(void *buf, size_t size,
+                               cudaStream_t stream) {
+  cudaEvent_t ev = m_ev_pool.get();
+  P2P_CHECK_CUDA(cudaEventRecord(ev, stream));
+  cuuint32_t wait_val = ++m_req_counter;
+  block_stream(stream, wait_val);
+  internal::ProgressEngine::Task task;
+  task.ready_event = ev;
+  task.post = [this, buf, size](MPI_Request *reqs) {
+    m_mpi.irecv(buf, size, m_peer, &reqs[0]);
+    return 1;
+  };
+  task.transferred = [this, wait_val, ev]() {
+    unblock_stream(wait_val);
+    m_ev_pool.release(ev);
+  };
+  internal::ProgressEngine::get_instance().submit(this, std::move(task));
+  return 0;
+}
+
+int ConnectionMPI::sendrecv_direct(const void *send_buf, size_t send_size,
+                                   void *recv_buf, size_t recv_size,
+                                   cudaStream_t stream) {
+  cudaEvent_t ev = m_ev_pool.get();
+  P2P_CHECK_CUDA(cudaEventRecord(ev, stream));
+  cuuint32_t wait_val = ++m_req_counter;
+  block_stream(stream, wait_val);
+  internal::ProgressEngine::Task task;
+  task.ready_event = ev;
+  task.post = [this, send_buf, send_size, recv_buf,
+               recv_size](MPI_Request *reqs) {
+    m_mpi.isend(send_buf, send_size, m_peer, &reqs[0]);
+    m_mpi.irecv(recv_buf, recv_size, m_peer, &reqs[1]);
+    return 2;
+  };
+  task.transferred = [this, wait_val, ev]() {
+    unblock_stream(wait_val);
+    m_ev_pool.release(ev);
+  };
+  internal::ProgressEngine::get_instance().submit(this, std::move(task));
   return 0;
 }
 
@@ -189,119 +319,20 @@ int ConnectionMPI::transfer(void *local_buf, void *peer_buf, size_t size,
   }
 }
 
-void ConnectionMPI::run_worker() {
-  P2P_CHECK_CUDA_ALWAYS(cudaSetDevice(m_dev));
-  while (true) {
-    std::unique_lock<std::mutex> lock(m_mtx);
-    if (!m_connected) {
-      lock.unlock();
-      break;
-    }
-    if (m_requests.size() == 0) {
-      logging::MPIPrintStreamDebug() << "Worker starts waiting\n";    
-      m_cv.wait(lock);
-      logging::MPIPrintStreamDebug() << "Worker notified\n";
-    }
-    std::list<Req> requests(m_requests);
-    m_requests.clear();
-    lock.unlock();
-    process_requests(requests);
-  }
-  logging::MPIPrintStreamDebug() << "No longer connected; worker exiting\n";
-  return;
-}
-
-void ConnectionMPI::release_host_mem(cudaStream_t stream,
-                                     cudaError_t status,
-                                     void *user_data) {
-  logging::MPIPrintStreamDebug() << "CB: releasing pooled mem\n";
-  std::pair<util::PinnedMemoryPool*, void*> *pair =
-      static_cast<std::pair<util::PinnedMemoryPool*, void*>*>(user_data);
-  P2P_ASSERT_ALWAYS(pair != nullptr);
-  pair->first->release(pair->second);
-  delete pair;
-  return;
-}
-
-void ConnectionMPI::process_requests(std::list<Req> &requests) {
-  for (auto &r: requests) {
-    if (r.m_type == ReqType::SEND) {
-      logging::MPIPrintStreamDebug() << "Processing SEND (size: "
-                                     << r.m_size1 << ")\n";
-      P2P_CHECK_CUDA_ALWAYS(
-          cudaEventSynchronize(r.m_event1));
-      m_ev_pool.release(r.m_event1);
-      logging::MPIPrintStreamDebug() << "Transfer to host done\n";
-      internal::nvtx_start("MPI_Send");      
-      m_mpi.send(r.m_addr1, r.m_size1, m_peer);
-      internal::nvtx_end();
-      m_pinned_mem_pool.release(r.m_addr1);
-      logging::MPIPrintStreamDebug() << "Processing SEND done\n";      
-    } else if (r.m_type == ReqType::RECV) {
-      logging::MPIPrintStreamDebug() << "Processing RECV\n";
-      void *host = r.m_addr1;
-      internal::nvtx_start("MPI_recv");
-      m_mpi.recv(host, r.m_size1, m_peer);
-      internal::nvtx_end();
-      // Unblocks the user stream
-      unblock_stream(r.m_wait_val);
-      P2P_CHECK_CUDA_ALWAYS(
-          cudaEventSynchronize(r.m_event1));
-      m_ev_pool.release(r.m_event1);
-      m_pinned_mem_pool.release(r.m_addr1);      
-      logging::MPIPrintStreamDebug() << "Processing RECV done\n";
-    } else if (r.m_type == ReqType::SENDRECV) {
-      process_sendrecv(r);
-    } else {
-      P2P_ASSERT_ALWAYS(0 && "Should not reach here\n");
-    }
-  }
-}
-
-void ConnectionMPI::process_sendrecv(const Req &r) {
-  logging::MPIPrintStreamDebug() << "Processing SENDRECV\n";
-  void *send_buf = r.m_addr1;
-  size_t send_size = r.m_size1;
-  void *recv_buf = r.m_addr2;
-  size_t recv_size = r.m_size2;
-  // Wait for the transfer of send data to host buffer
-  P2P_CHECK_CUDA_ALWAYS(
-      cudaEventSynchronize(r.m_event1));
-  m_ev_pool.release(r.m_event1);
-  internal::nvtx_start("MPI_sendrecv");
-  m_mpi.sendrecv(send_buf, send_size, m_peer,
-                 recv_buf, recv_size, m_peer);
-  internal::nvtx_end();
-  // Unblocks the user stream
-  unblock_stream(r.m_wait_val);
-  m_pinned_mem_pool.release(send_buf);
-  P2P_CHECK_CUDA_ALWAYS(
-      cudaEventSynchronize(r.m_event2));
-  m_ev_pool.release(r.m_event2);
-  m_pinned_mem_pool.release(recv_buf);
-  logging::MPIPrintStreamDebug() << "Processing SENDRECV done\n";
-}
-
 int ConnectionMPI::disconnect() {
   logging::MPIPrintStreamInfo() << "ConnectionMPI::disconnect\n";
   if (!m_connected) return 0;
 
-  std::unique_lock<std::mutex> lock(m_mtx);  
   m_connected = false;
-  lock.unlock();
-  logging::MPIPrintStreamDebug() << "Notifying worker to quit\n";  
-  m_cv.notify_one();
-  std::this_thread::yield();
-  logging::MPIPrintStreamDebug() << "Joining worker\n";
-  m_worker.join();
-  logging::MPIPrintStreamDebug() << "Worker joined\n";  
+  // Waits for all the pending transfers
+  internal::ProgressEngine::get_instance().detach(this);
+  logging::MPIPrintStreamDebug() << "Detached from the progress engine\n";
   if (m_use_stream_mem_ops) {
     P2P_CHECK_CUDA_ALWAYS(cudaFree(m_wait_mem));
   } else {
     P2P_CHECK_CUDA_ALWAYS(cudaFreeHost(m_wait_mem));
   }
-  P2P_CHECK_CUDA_ALWAYS(
-      cudaStreamDestroy(m_internal_stream));
+  h2::gpu::destroy(m_internal_stream);
   return 0;
 }
 
@@ -0,0 +1,33 @@
+#include "p2p/device_sync.hpp"
+#include "p2p/util.hpp"
+#include "p2p/util_cuda.hpp"
+
+namespace p2p {
+
+namespace {
+__global__ void inc_counter_kernel(DeviceSyncDevice sync) {
+  sync.inc_counter();
+}
+} // namespace
+
+DeviceSync::DeviceSync(): m_peer_flag(nullptr) {
+  P2P_CHECK_CUDA_ALWAYS(cudaMalloc(&m_counter, sizeof(CounterType)));
+  P2P_CHECK_CUDA_ALWAYS(cudaMemset(m_counter, 0, sizeof(CounterType)));
+  P2P_CHECK_CUDA_ALWAYS(cudaMalloc(&m_flag, sizeof(CounterType)));
+  P2P_CHECK_CUDA_ALWAYS(cudaMemset(m_flag, 0, sizeof(CounterType)));
+}
+
+DeviceSync::~DeviceSync() {
+  P2P_CHECK_CUDA_ALWAYS(cudaFree(m_counter));
+  P2P_CHECK_CUDA_ALWAYS(cudaFree(m_flag));
+}
+
+void DeviceSync::inc_counter(cudaStream_t stream) {
+  inc_counter_kernel<<<1, 1, 0, stream>>>(get_for_device());
+}
+
+DeviceSyncDevice DeviceSync::get_for_device() {
+  return DeviceSyncDevice(m_counter, m_flag, m_peer_flag);
+}
+
+} // namespace p2p
@@ -27,6 +27,12 @@ int MPI::get_rank() const {
   return rank;
 }
 
+int MPI::get_size() const {
+  int size;
+  MPI_Comm_size(m_comm, &size);
+  return size;
+}
+
 MPI_Comm MPI::get_comm() {
   return m_comm;
 }
@@ -118,6 +124,12 @@ int MPI::barrier() {
   return 0;
 }
 
+int MPI::allgather(const void *send_buf, size_t size, void *recv_buf) {
+  P2P_CHECK_MPI(MPI_Allgather(send_buf, size, MPI_BYTE,
+                              recv_buf, size, MPI_BYTE, get_comm()));
+  return 0;
+}
+
 int MPI::wait_requests(MPI_Request *requests, int num_requests) {
 #ifdef P2P_MPI_LOGGING_DEBUG
   logging::MPIPrintStreamDebug() << "MPI_Waitall with " << num_requests << " requests\n";
@@ -126,5 +138,14 @@ int MPI::wait_requests(MPI_Request *requests, int num_requests) {
   return 0;
 }
 
+int MPI::test_requests(MPI_Request *requests, int num_requests,
+                       bool &completed) {
+  int flag = 0;
+  P2P_CHECK_MPI(MPI_Testall(num_requests, requests, &flag,
+                            MPI_STATUSES_IGNORE));
+  completed = flag != 0;
+  return 0;
+}
+
 } // namespace internal
 } // namespace p2p
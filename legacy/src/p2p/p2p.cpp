@@ -8,6 +8,9 @@
 #include "p2p/util_cuda.hpp"
 
 #include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
 
 using namespace p2p::internal;
 using namespace p2p::logging;
@@ -28,6 +31,7 @@ P2P::P2P(const internal::MPI &mpi): m_mpi(mpi),
 
   int name_len;
   MPI_Get_processor_name(m_proc_name, &name_len);
+  gather_peer_info();
 }
 
 P2P::~P2P() {
@@ -43,42 +47,31 @@ void P2P::disable_nvtx() const {
 }
 
 
-int P2P::get_peer_host_names(const int *peers,
-                             int num_peers,
-                             std::vector<char*> &names) {
-  std::vector<MPI_Request> requests;
-  names.clear();
-  for (int i = 0; i < num_peers; ++i) {
-    MPI_Request mr;
-    m_mpi.isend(m_proc_name, MPI_MAX_PROCESSOR_NAME,
-                peers[i], &mr);
-    requests.push_back(mr);
-    char *peer_name = new char[MPI_MAX_PROCESSOR_NAME];
-    m_mpi.irecv(peer_name, MPI_MAX_PROCESSOR_NAME,
-                peers[i], &mr);
-    requests.push_back(mr);
-    names.push_back(peer_name);
-  }
-  m_mpi.wait_requests(requests.data(), requests.size());
-  return 0;
-}
-
-int P2P::get_peer_devices(const int *peers,
-                          int num_peers,
-                          std::vector<int> &peer_devices) {
-  std::vector<MPI_Request> requests;
-  peer_devices.resize(num_peers, -1);
-  for (int i = 0; i < num_peers; ++i) {
-    MPI_Request mr;
-    logging::MPIPrintStreamDebug() << "sending device " << m_dev << " to " << peers[i] << "\n";
-    m_mpi.isend(&m_dev, sizeof(int), peers[i], &mr);
-    requests.push_back(mr);
-    logging::MPIPrintStreamDebug() << "receiving device from " << peers[i] << "\n";
-    MPI_Request irecv_mr;
-    m_mpi.irecv(&peer_devices[i], sizeof(int), peers[i], &irecv_mr);
-    requests.push_back(irecv_mr);
+// A single collective replaces per-connection exchanges of host
+// names, processes and devices
+int P2P::gather_peer_info() {
+  struct PeerInfo {
+    char name[MPI_MAX_PROCESSOR_NAME];
+    int dev;
+    pid_t pid;
+  };
+  PeerInfo self;
+  std::memset(&self, 0, sizeof(self));
+  std::strncpy(self.name, m_proc_name, MPI_MAX_PROCESSOR_NAME - 1);
+  self.dev = m_dev;
+  self.pid = getpid();
+  const int np = m_mpi.get_size();
+  std::vector<PeerInfo> info(np);
+  m_mpi.allgather(&self, sizeof(PeerInfo), info.data());
+  m_host_names.clear();
+  m_devices.clear();
+  m_same_process.clear();
+  for (const auto &x: info) {
+    m_host_names.emplace_back(x.name);
+    m_devices.push_back(x.dev);
+    m_same_process.push_back(x.pid == self.pid
+                             && m_host_names.back() == m_proc_name);
   }
-  m_mpi.wait_requests(requests.data(), requests.size());
   return 0;
 }
 
@@ -91,11 +84,18 @@ int P2P::get_connections(const std::vector<int> &peers,
 int P2P::get_connections(const int *peers,
                          connection_type *conns,
                          int num_peers) {
-  std::vector<char*> host_names;
-  std::vector<int> devices;
-  get_peer_host_names(peers, num_peers, host_names);
-  get_peer_devices(peers, num_peers, devices);
   std::vector<Request> requests;
+  get_connections_nb(peers, conns, num_peers, requests);
+  Request::process(requests.data(), requests.size(),
+                   m_mpi);
+  return 0;
+}
+
+int P2P::get_connections_nb(const int *peers,
+                            connection_type *conns,
+                            int num_peers,
+                            std::vector<Request> &requests) {
+  int num_new_conns = 0;
   for (int i = 0; i < num_peers; ++i) {
     int peer = peers[i];
     MPIPrintStreamDebug() << "Getting a connection to " << peer << "\n";
@@ -104,24 +104,27 @@ int P2P::get_connections(const int *peers,
     if (it != m_conn_map.end()) {
       conn = it->second;
     } else {
-      conn = connect(peer, host_names[i], devices[i]);
+      const bool is_rank = peer >= 0 && peer < (int)m_devices.size();
+      conn = connect(peer, is_rank ? m_host_names[peer].c_str() : "",
+                     is_rank ? m_devices[peer] : -1,
+                     is_rank && m_same_process[peer]);
       m_conn_map.insert(std::make_pair(peer, conn));
       if (conn) {
         requests.push_back(conn->connect_nb());
+        ++num_new_conns;
       }
     }
     conns[i] = conn;
   }
-  MPIPrintStreamDebug() << requests.size()
+  MPIPrintStreamDebug() << num_new_conns
                         << " new connections\n";
-  Request::process(requests.data(), requests.size(),
-                   m_mpi);
   return 0;
 }
 
 std::shared_ptr<Connection> P2P::connect(int peer,
-                                         char *peer_name,
-                                         int peer_dev) {
+                                         const char *peer_name,
+                                         int peer_dev,
+                                         bool same_process) {
   if (peer == MPI_PROC_NULL) {
     MPIPrintStreamDebug() << "Creating a null connection\n";
     return std::make_shared<ConnectionNULL>(peer, m_mpi, m_event_pool);
@@ -132,8 +135,10 @@ std::shared_ptr<Connection> P2P::connect(int peer,
       peer, m_mpi, m_proc_name, peer_name, m_dev, peer_dev)) {
     MPIPrintStreamDebug()
         << "Connecting to rank " << peer << " using device "
-        << peer_dev << " with IPC\n";
-    return std::make_shared<ConnectionIPC>(peer, peer_dev, m_mpi, m_event_pool);
+        << peer_dev << (same_process ? " in this process" : " with IPC")
+        << "\n";
+    return std::make_shared<ConnectionIPC>(peer, peer_dev, m_mpi, m_event_pool,
+                                           same_process);
 #if 0 // Disables MPI connection
   } else {
     MPIPrintStreamInfo() <<
@@ -192,6 +197,10 @@ int P2P::disconnect(connection_type *conns, int num_conns) {
 }
 
 int P2P::init_driver_api() {
+#if H2_HAS_ROCM
+  // HIP has no separate driver API context to set up
+  return 0;
+#else
   CUcontext current_ctxt;
   P2P_CHECK_CUDA_DRV_ALWAYS(cuCtxGetCurrent(&current_ctxt));
   CUdevice rt_dev;
@@ -207,6 +216,7 @@ int P2P::init_driver_api() {
     P2P_ASSERT_ALWAYS(rt_ctxt == current_ctxt);
   }
   return 0;
+#endif
 }
 
 int P2P::barrier(std::vector<std::shared_ptr<Connection>> &connections,
@@ -217,13 +227,33 @@ int P2P::barrier(std::vector<std::shared_ptr<Connection>> &connections,
 int P2P::barrier(std::shared_ptr<Connection> *connections,
                  cudaStream_t *streams,
                  int num_conns) {
-  Request *requests = new Request[num_conns*2];
+  std::vector<Request> requests(num_conns * 2);
+  barrier_nb(connections, streams, num_conns, requests.data());
+  Request::wait_all(requests.data(), requests.size(), m_mpi);
+  return 0;
+}
+
+int P2P::barrier_nb(std::shared_ptr<Connection> *connections,
+                    cudaStream_t *streams,
+                    int num_conns,
+                    Request *requests) {
   for (int i = 0; i < num_conns; ++i) {
     requests[i*2] = connections[i]->notify_nb(streams[i]);
     requests[i*2+1] = connections[i]->wait_nb(streams[i]);
   }
-  Request::process(requests, num_conns * 2, m_mpi);
-  delete[] requests;
+  return 0;
+}
+
+int P2P::test_some(Request *requests, int num_requests, int *indices) {
+  return Request::test_some(requests, num_requests, indices, m_mpi);
+}
+
+int P2P::wait_any(Request *requests, int num_requests) {
+  return Request::wait_any(requests, num_requests, m_mpi);
+}
+
+int P2P::wait_all(Request *requests, int num_requests) {
+  Request::wait_all(requests, num_requests, m_mpi);
   return 0;
 }
 
@@ -0,0 +1,230 @@
+#include "p2p/progress_engine.hpp"
+#include "p2p/logging.hpp"
+#include "p2p/util.hpp"
+#include "p2p/util_cuda.hpp"
+
+#include "h2/utils/HelperThreads.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace p2p {
+namespace internal {
+
+ProgressEngine &ProgressEngine::get_instance() {
+  static ProgressEngine engine;
+  return engine;
+}
+
+ProgressEngine::ProgressEngine():
+    m_core(-1), m_policy(Policy::BACKOFF), m_max_backoff_us(64) {
+  if (const char *env = std::getenv("P2P_PROGRESS_CORE")) {
+    m_core = std::atoi(env);
+  }
+  if (const char *env = std::getenv("P2P_PROGRESS_POLICY")) {
+    if (std::strcmp(env, "poll") == 0) {
+      m_policy = Policy::POLL;
+    } else if (std::strcmp(env, "backoff") == 0) {
+      m_policy = Policy::BACKOFF;
+    } else {
+      logging::MPIPrintStreamError() << "Unknown progress policy: "
+                                     << env << "\n";
+      std::abort();
+    }
+  }
+  if (const char *env = std::getenv("P2P_PROGRESS_MAX_BACKOFF_US")) {
+    m_max_backoff_us = std::max(std::atoi(env), 1);
+  }
+}
+
+void ProgressEngine::attach(const void *key, int dev) {
+  std::unique_lock<std::mutex> lock(m_mtx);
+  P2P_ASSERT_ALWAYS(m_keys.count(key) == 0);
+  m_keys[key] = 0;
+  if (!m_running) {
+    m_running = true;
+    m_dev = dev;
+    m_thread = std::thread(&ProgressEngine::run, this);
+  }
+}
+
+void ProgressEngine::detach(const void *key) {
+  std::unique_lock<std::mutex> lock(m_mtx);
+  m_drained_cv.wait(lock, [&]() { return m_keys.at(key) == 0; });
+  m_keys.erase(key);
+  if (!m_keys.empty()) return;
+  m_running = false;
+  lock.unlock();
+  m_cv.notify_one();
+  m_thread.join();
+  logging::MPIPrintStreamDebug() << "Progress engine stopped\n";
+}
+
+void ProgressEngine::submit(const void *key, Task task) {
+  std::unique_lock<std::mutex> lock(m_mtx);
+  ++m_keys.at(key);
+  ++m_num_tasks;
+  m_incoming.emplace_back(key, std::move(task));
+  lock.unlock();
+  m_cv.notify_one();
+}
+
+void ProgressEngine::pin_thread() {
+  if (m_core < 0) {
+    h2::register_helper_thread();
+    return;
+  }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(m_core, &cpus);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+    logging::MPIPrintStreamError() << "Failed to pin the progress thread to core "
+                                   << m_core << "\n";
+  }
+}
+
+void ProgressEngine::run() {
+  P2P_CHECK_CUDA_ALWAYS(cudaSetDevice(m_dev));
+  pin_thread();
+  int backoff_us = 0;
+  while (true) {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    if (m_num_tasks == 0) {
+      if (!m_running) break;
+      m_cv.wait(lock);
+      backoff_us = 0;
+    }
+    for (auto &x: m_incoming) {
+      auto &q = m_queues[x.first];
+      q.emplace_back();
+      q.back().key = x.first;
+      q.back().task = std::move(x.second);
+    }
+    m_incoming.clear();
+    lock.unlock();
+
+    if (progress()) {
+      backoff_us = 0;
+    } else if (m_policy == Policy::POLL) {
+      std::this_thread::yield();
+    } else {
+      backoff_us = std::min(std::max(backoff_us * 2, 1), m_max_backoff_us);
+      std::this_thread::sleep_for(std::chrono::microseconds(backoff_us));
+    }
+  }
+}
+
+bool ProgressEngine::progress() {
+  bool progressed = false;
+  for (auto &q: m_queues) {
+    progressed |= post(q.second);
+  }
+  progressed |= test();
+  for (auto it = m_queues.begin(); it != m_queues.end();) {
+    progressed |= complete(it->second);
+    if (it->second.empty()) {
+      it = m_queues.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  progressed |= drain();
+  return progressed;
+}
+
+// Tasks are posted in order so that the messages to the same peer
+// are matched in order.
+bool ProgressEngine::post(std::list<Entry> &queue) {
+  bool progressed = false;
+  for (auto &e: queue) {
+    if (e.state != State::WAITING) continue;
+    if (e.task.ready_event) {
+      const auto st = cudaEventQuery(e.task.ready_event);
+      if (st == cudaErrorNotReady) break;
+      P2P_CHECK_CUDA_ALWAYS(st);
+    }
+    e.num_pending = e.task.post(e.reqs);
+    P2P_ASSERT_ALWAYS(e.num_pending <= 2);
+    for (int i = 0; i < e.num_pending; ++i) {
+      m_reqs.push_back(e.reqs[i]);
+      m_req_entries.push_back(&e);
+    }
+    e.state = State::POSTED;
+    progressed = true;
+  }
+  return progressed;
+}
+
+bool ProgressEngine::test() {
+  if (m_reqs.empty()) return false;
+  int num_completed = 0;
+  std::vector<int> indices(m_reqs.size());
+  P2P_CHECK_MPI(MPI_Testsome(m_reqs.size(), m_reqs.data(), &num_completed,
+                             indices.data(), MPI_STATUSES_IGNORE));
+  if (num_completed <= 0) return false;
+  for (int i = 0; i < num_completed; ++i) {
+    --m_req_entries[indices[i]]->num_pending;
+  }
+  // Completed requests are set to MPI_REQUEST_NULL
+  size_t j = 0;
+  for (size_t i = 0; i < m_reqs.size(); ++i) {
+    if (m_reqs[i] == MPI_REQUEST_NULL) continue;
+    m_reqs[j] = m_reqs[i];
+    m_req_entries[j] = m_req_entries[i];
+    ++j;
+  }
+  m_reqs.resize(j);
+  m_req_entries.resize(j);
+  return true;
+}
+
+// Tasks complete in order as receives unblock streams with increasing
+// values.
+bool ProgressEngine::complete(std::list<Entry> &queue) {
+  bool progressed = false;
+  while (!queue.empty()) {
+    auto &e = queue.front();
+    if (e.state != State::POSTED || e.num_pending > 0) break;
+    if (e.task.transferred) {
+      e.task.transferred();
+    }
+    m_draining.emplace_back(e.key, std::move(e.task));
+    queue.pop_front();
+    progressed = true;
+  }
+  return progressed;
+}
+
+bool ProgressEngine::drain() {
+  bool progressed = false;
+  for (auto it = m_draining.begin(); it != m_draining.end();) {
+    auto &task = it->second;
+    if (task.done_event) {
+      const auto st = cudaEventQuery(task.done_event);
+      if (st == cudaErrorNotReady) {
+        ++it;
+        continue;
+      }
+      P2P_CHECK_CUDA_ALWAYS(st);
+    }
+    if (task.done) {
+      task.done();
+    }
+    std::unique_lock<std::mutex> lock(m_mtx);
+    --m_keys.at(it->first);
+    --m_num_tasks;
+    lock.unlock();
+    m_drained_cv.notify_all();
+    it = m_draining.erase(it);
+    progressed = true;
+  }
+  return progressed;
+}
+
+} // namespace internal
+} // namespace p2p
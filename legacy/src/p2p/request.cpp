@@ -125,6 +125,18 @@ int Request::wait_mpi() {
   }
 }
 
+bool Request::test_mpi(internal::MPI &mpi) {
+  if (m_num_requests == 0) return true;
+  bool completed = false;
+  mpi.test_requests(m_requests, m_num_requests, completed);
+  return completed;
+}
+
+bool Request::is_null() const {
+  return m_kind == Kind::NULL_REQUEST && m_num_requests == 0
+      && m_handler == nullptr;
+}
+
 int Request::process() {
   wait_mpi();
   Request req;
@@ -202,4 +214,51 @@ void Request::process(const Request *requests, int num_requests,
   }
 }
 
+bool Request::progress(Request &req, internal::MPI &mpi) {
+  // Post processing may continue with another request, which may
+  // be complete already
+  while (!req.is_null()) {
+    if (!req.test_mpi(mpi)) return false;
+    Request next;
+    if (req.run_post_process(&next)) {
+      req = Request();
+      return true;
+    }
+    req = next;
+  }
+  // A continuation that is null
+  return true;
+}
+
+int Request::test_some(Request *requests, int num_requests, int *indices,
+                       internal::MPI &mpi) {
+  int num_completed = 0;
+  for (int i = 0; i < num_requests; ++i) {
+    if (requests[i].is_null()) continue;
+    if (progress(requests[i], mpi)) {
+      indices[num_completed] = i;
+      ++num_completed;
+    }
+  }
+  return num_completed;
+}
+
+int Request::wait_any(Request *requests, int num_requests,
+                      internal::MPI &mpi) {
+  while (true) {
+    bool active = false;
+    for (int i = 0; i < num_requests; ++i) {
+      if (requests[i].is_null()) continue;
+      active = true;
+      if (progress(requests[i], mpi)) return i;
+    }
+    if (!active) return -1;
+  }
+}
+
+void Request::wait_all(Request *requests, int num_requests,
+                       internal::MPI &mpi) {
+  while (wait_any(requests, num_requests, mpi) >= 0) {}
+}
+
 } // namespace p2p
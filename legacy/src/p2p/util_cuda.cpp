@@ -2,134 +2,57 @@
 #include "p2p/util.hpp"
 #include "p2p/logging.hpp"
 
+#include "mpi.h"
+#if defined(OPEN_MPI)
+#include "mpi-ext.h"
+#endif
+
 namespace p2p {
 namespace util {
 
-PinnedMemoryPool::PinnedMemoryPool():
-    m_bin_growth(8),
-    m_min_bin(3), m_max_bin(12) {
-  setup_bins();
-}
-
-PinnedMemoryPool::~PinnedMemoryPool() {
-  deallocate_all_chunks();
-}
-
-void PinnedMemoryPool::setup_bins() {
-  m_bins.clear();
-  for (int i = m_min_bin; i <= m_max_bin; ++i) {
-    m_bins.push_back(std::list<void*>());
-  }
-}
-
-namespace {
-static size_t pow(int x, int y) {
-  size_t v = 1;
-  for (int i = 0; i < y; ++i) {
-    v *= x;
-  }
-  return v;
-}
-}
-
-int PinnedMemoryPool::find_bin(size_t size) {
-  // Finds the right bin
-  size_t bin_size = pow(m_bin_growth, m_min_bin);
-  int bin_idx = -1;
-  for (int i = m_min_bin; i <= m_max_bin; ++i) {
-    if (size <= bin_size) {
-      bin_idx = i - m_min_bin;
-      break;
-    }
-    bin_size *= m_bin_growth;
-  }
-  P2P_ASSERT_ALWAYS(bin_idx != -1 &&
-                    "Requested size too large");
-  return bin_idx;
-}
-
-void *PinnedMemoryPool::get_from_bin(int bin_idx) {
-  logging::MPIPrintStreamDebug() << "Bin idx: " << bin_idx << "\n";
-  auto &ch_list = m_bins[bin_idx];
-  std::unique_lock<std::mutex> lock(m_mutex);
-  if (ch_list.size() > 0) {
-    auto ch = ch_list.begin();
-    void *m = *ch;
-    ch_list.erase(ch);
-    lock.unlock();
-    return m;
-  }
-  void *new_mem = nullptr;
-  size_t bin_size = pow(m_bin_growth, m_min_bin + bin_idx);
-  logging::MPIPrintStreamDebug() << "Allocating new memory of size " << bin_size << "\n";
-  P2P_CHECK_CUDA_ALWAYS(cudaMallocHost(&new_mem, bin_size));
-  //new_mem = std::malloc(bin_size);
-  m_mem_map.insert(std::make_pair(new_mem, bin_size));
-  lock.unlock();  
-  return new_mem;
-}
-
-void *PinnedMemoryPool::get(size_t size) {
-  int bin_idx = find_bin(size);
-  return get_from_bin(bin_idx);
-}
-
-void PinnedMemoryPool::release(void *p) {
-  size_t size = m_mem_map.find(p)->second;
-  int bin_idx = find_bin(size);
-  std::unique_lock<std::mutex> lock(m_mutex); 
-  m_bins[bin_idx].push_back(p);
-  lock.unlock();
-  return;
-}
-
-void PinnedMemoryPool::deallocate_all_chunks() {
-  std::unique_lock<std::mutex> lock(m_mutex);   
-  for (auto &x: m_mem_map) {
-    cudaFreeHost(x.first);
-    //std::free(x.first);
-  }
-  m_mem_map.clear();
-  setup_bins();
-}
-
 EventPool::EventPool(int num_events, int expansion):
-    m_expansion(expansion) {
-  EventPool::expand_list(m_events, num_events);
+    m_expansion(expansion), m_events(m_capacity),
+    m_num_gets(0), m_num_created(0) {
+  for (int i = 0; i < num_events; ++i) {
+    release(create_event());
+  }
 }
 
 EventPool::~EventPool() {
-  for (auto x: m_events) {
-    P2P_CHECK_CUDA_ALWAYS(cudaEventDestroy(x));
+  cudaEvent_t e;
+  while (m_events.pop(e)) {
+    P2P_CHECK_CUDA_ALWAYS(cudaEventDestroy(e));
   }
-  m_events.clear();
 }
 
-void EventPool::expand_list(std::list<cudaEvent_t> &list, int num_events) {
-  for (int i = 0; i < num_events; ++i) {
-    cudaEvent_t e;
-    P2P_CHECK_CUDA_ALWAYS(cudaEventCreateWithFlags(&e, cudaEventDisableTiming));
-    list.push_back(e);
-  }
+cudaEvent_t EventPool::create_event() {
+  cudaEvent_t e;
+  P2P_CHECK_CUDA_ALWAYS(cudaEventCreateWithFlags(&e, cudaEventDisableTiming));
+  ++m_num_created;
+  return e;
 }
 
 void EventPool::expand() {
-  EventPool::expand_list(m_events, m_expansion);
+  for (int i = 0; i < m_expansion; ++i) {
+    release(create_event());
+  }
 }
 
 cudaEvent_t EventPool::get() {
-  std::unique_lock<std::mutex> lock(m_mutex);  
-  if (m_events.empty()) expand();
-  auto e = m_events.front();
-  m_events.pop_front();
-  lock.unlock();
-  return e;
+  ++m_num_gets;
+  cudaEvent_t e;
+  if (m_events.pop(e)) return e;
+  // Keeps the rest of the expansion in the pool
+  for (int i = 1; i < m_expansion; ++i) {
+    release(create_event());
+  }
+  return create_event();
 }
 
 void EventPool::release(cudaEvent_t e) {
-  std::unique_lock<std::mutex> lock(m_mutex);  
-  m_events.push_back(e);
-  lock.unlock();
+  if (!m_events.push(e)) {
+    P2P_CHECK_CUDA_ALWAYS(cudaEventDestroy(e));
+  }
 }
 
 size_t get_available_memory() {
@@ -146,6 +69,19 @@ size_t get_total_memory() {
   return total;
 }
 
+bool is_mpi_cuda_aware() {
+  if (const char *env = std::getenv("P2P_MPI_CUDA_AWARE")) {
+    return std::atoi(env) != 0;
+  }
+#if H2_HAS_ROCM && defined(MPIX_ROCM_AWARE_SUPPORT) && MPIX_ROCM_AWARE_SUPPORT
+  return MPIX_Query_rocm_support() == 1;
+#elif H2_HAS_CUDA && defined(MPIX_CUDA_AWARE_SUPPORT) && MPIX_CUDA_AWARE_SUPPORT
+  return MPIX_Query_cuda_support() == 1;
+#else
+  return false;
+#endif
+}
+
 } // namespace util
 } // namespace p2p
 
@@ -1,4 +1,5 @@
 #include "distconv/runtime.hpp"
+#include "h2/gpu/ranges.hpp"
 
 #include <cstdlib>
 
@@ -14,6 +15,10 @@ void initialize() {
       cfg.profiling = std::getenv("DISTCONV_PROFILING") != nullptr;
       if (!cfg.profiling)
           cfg.profiling = std::getenv("DISTCONV_NVTX") != nullptr;
+      if (cfg.profiling)
+          h2::gpu::set_ranges_enabled(true);
+      cfg.instrumentation =
+          std::getenv("DISTCONV_INSTRUMENTATION") != nullptr;
       initialized = true;
   }
 }
@@ -10,19 +10,24 @@ namespace distconv {
 namespace internal {
 
 CUDADeviceMemoryPool::CUDADeviceMemoryPool():
-    m_allocator(4, 8, cub::CachingDeviceAllocator::INVALID_BIN,
-                cub::CachingDeviceAllocator::INVALID_SIZE, false,
+    m_allocator(&h2::gpu::default_device_allocator()) {
+  if (m_allocator->backend() == h2::gpu::DeviceAllocator::Backend::CUB) {
 #ifdef DISTCONV_DEBUG
-                true
+    const bool debug = true;
 #else
-                false
+    const bool debug = false;
 #endif
-                ) {}
+    m_owned_allocator = h2::gpu::make_cub_device_allocator(
+        m_bin_growth, 8, cub::CachingDeviceAllocator::INVALID_BIN,
+        cub::CachingDeviceAllocator::INVALID_SIZE, debug, "distconv");
+    m_allocator = m_owned_allocator.get();
+  }
+}
 CUDADeviceMemoryPool::~CUDADeviceMemoryPool() {}
 
 void *CUDADeviceMemoryPool::get(size_t size, cudaStream_t st) {
   void *p = nullptr;
-  cudaError_t err = m_allocator.DeviceAllocate(&p, size, st);
+  cudaError_t err = m_allocator->allocate(&p, size, st);
   if (err != cudaSuccess) {
     size_t available;
     size_t total;
@@ -40,30 +45,35 @@ void *CUDADeviceMemoryPool::get(size_t size, cudaStream_t st) {
 }
 
 void CUDADeviceMemoryPool::release(void *p) {
-  DISTCONV_CHECK_CUDA(m_allocator.DeviceFree(p));
+  DISTCONV_CHECK_CUDA(m_allocator->deallocate(p));
+}
+
+void CUDADeviceMemoryPool::release_unused() {
+  m_allocator->release_unused();
+}
+
+h2::gpu::DeviceAllocatorStats CUDADeviceMemoryPool::get_stats(
+    int device) const {
+  return m_allocator->stats(device);
 }
 
 size_t CUDADeviceMemoryPool::get_max_allocatable_size(size_t limit) {
-  size_t bin_growth = m_allocator.bin_growth;
+  // The other backends do not round allocations up
+  if (m_allocator->backend() != h2::gpu::DeviceAllocator::Backend::CUB) {
+    return m_allocator->max_allocatable_size(limit, h2::gpu::current_gpu());
+  }
+  size_t bin_growth = m_bin_growth;
   size_t x = std::log(limit) / std::log(bin_growth);
   size_t max_allowed_size = std::pow(bin_growth, x);
   return max_allowed_size;
 }
 
-RuntimeCUDA *RuntimeCUDA::m_instance = nullptr;
-
-RuntimeCUDA::RuntimeCUDA() {
-  for (int i = 0; i < m_num_events; ++i) {
-    DISTCONV_CHECK_CUDA(cudaEventCreateWithFlags(
-        &m_events[i], cudaEventDisableTiming));
-  }
-}
+RuntimeCUDA::RuntimeCUDA() {}
 
 RuntimeCUDA &RuntimeCUDA::get_instance() {
-  if (m_instance == nullptr) {
-    m_instance = new RuntimeCUDA();
-  }
-  return *m_instance;
+  // Never destroyed; created once even if first used concurrently
+  static RuntimeCUDA *instance = new RuntimeCUDA();
+  return *instance;
 }
 #if 0
 PinnedMemoryPool &RuntimeCUDA::get_pinned_memory_pool() {
@@ -74,9 +84,16 @@ CUDADeviceMemoryPool &RuntimeCUDA::get_device_memory_pool() {
   return get_instance().m_dmp;
 }
 
-cudaEvent_t &RuntimeCUDA::get_event(int idx) {
-  assert_always(idx < m_num_events);
-  return get_instance().m_events[idx];
+cudaEvent_t RuntimeCUDA::get_event(int idx) {
+  assert_always(idx >= 0);
+  auto &runtime = get_instance();
+  const int device = h2::gpu::current_gpu();
+  std::lock_guard<std::mutex> lock(runtime.m_events_mutex);
+  auto &events = runtime.m_events[{device, std::this_thread::get_id()}];
+  while (static_cast<int>(events.size()) <= idx) {
+    events.push_back(h2::gpu::acquire_event_notiming());
+  }
+  return events[idx];
 }
 
 } // namespace internal
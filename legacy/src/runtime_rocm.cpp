@@ -7,6 +7,7 @@
 #include "distconv/runtime_rocm.hpp"
 
 #include "h2/gpu/memory_utils.hpp"
+#include "h2/gpu/pools.hpp"
 #include "h2/gpu/runtime.hpp"
 
 #include "distconv/util/util.hpp"
@@ -14,6 +15,11 @@
 
 #include <algorithm>
 #include <cmath>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <hip/hip_runtime.h>
 
@@ -23,19 +29,25 @@ namespace internal
 {
 
 HIPDeviceMemoryPool::HIPDeviceMemoryPool()
-    : m_allocator(
-        /*bin_growth=*/4,
-        /*min_bin=*/8,
-        /*max_bin=*/hipcub::CachingDeviceAllocator::INVALID_BIN,
-        /*max_cached_bytes=*/hipcub::CachingDeviceAllocator::INVALID_SIZE,
-        /*skip_cleanup=*/false,
+    : m_allocator(&h2::gpu::default_device_allocator())
+{
+    if (m_allocator->backend() == h2::gpu::DeviceAllocator::Backend::CUB)
+    {
 #ifdef DISTCONV_DEBUG
-        /*debug=*/true
+        bool const debug = true;
 #else
-        /*debug=*/false
+        bool const debug = false;
 #endif
-    )
-{}
+        m_owned_allocator = h2::gpu::make_cub_device_allocator(
+            /*bin_growth=*/m_bin_growth,
+            /*min_bin=*/8,
+            /*max_bin=*/hipcub::CachingDeviceAllocator::INVALID_BIN,
+            /*max_cached_bytes=*/hipcub::CachingDeviceAllocator::INVALID_SIZE,
+            /*debug=*/debug,
+            /*name=*/"distconv");
+        m_allocator = m_owned_allocator.get();
+    }
+}
 
 HIPDeviceMemoryPool::~HIPDeviceMemoryPool()
 {}
@@ -43,7 +55,7 @@ HIPDeviceMemoryPool::~HIPDeviceMemoryPool()
 void* HIPDeviceMemoryPool::get(size_t size, hipStream_t st)
 {
     void* p = nullptr;
-    hipError_t const err = m_allocator.DeviceAllocate(&p, size, st);
+    hipError_t const err = m_allocator->allocate(&p, size, st);
     if (err != hipSuccess)
     {
         auto [available, total] = h2::gpu::mem_info();
@@ -61,12 +73,26 @@ void* HIPDeviceMemoryPool::get(size_t size, hipStream_t st)
 
 void HIPDeviceMemoryPool::release(void* p)
 {
-    DISTCONV_CHECK_HIP(m_allocator.DeviceFree(p));
+    DISTCONV_CHECK_HIP(m_allocator->deallocate(p));
+}
+
+void HIPDeviceMemoryPool::release_unused()
+{
+    m_allocator->release_unused();
+}
+
+h2::gpu::DeviceAllocatorStats HIPDeviceMemoryPool::get_stats(int device) const
+{
+    return m_allocator->stats(device);
 }
 
 size_t HIPDeviceMemoryPool::get_max_allocatable_size(size_t const limit)
 {
-    size_t const bin_growth = m_allocator.bin_growth;
+    // The other backends do not round allocations up
+    if (m_allocator->backend() != h2::gpu::DeviceAllocator::Backend::CUB)
+        return m_allocator->max_allocatable_size(limit,
+                                                 h2::gpu::current_gpu());
+    size_t const bin_growth = m_bin_growth;
     size_t const x = std::log(limit) / std::log(bin_growth);
     size_t const max_allowed_size = std::pow(bin_growth, x);
     return max_allowed_size;
@@ -77,21 +103,14 @@ namespace
 
 struct RuntimeHIP_impl
 {
-    RuntimeHIP_impl();
-
     // PinnedMemoryPool m_pmp;
     HIPDeviceMemoryPool m_dmp;
-    std::array<hipEvent_t, 2> m_events;
+    std::mutex m_events_mutex;
+    std::map<std::pair<int, std::thread::id>,
+             std::vector<h2::gpu::PooledEvent>>
+        m_events;
 };
 
-RuntimeHIP_impl::RuntimeHIP_impl()
-{
-    for (int i = 0; i < m_events.size(); ++i)
-    {
-        m_events[i] = h2::gpu::make_event_notiming();
-    }
-}
-
 RuntimeHIP_impl& get_runtime()
 {
     static auto runtime = RuntimeHIP_impl{};
@@ -105,11 +124,18 @@ HIPDeviceMemoryPool& RuntimeHIP::get_device_memory_pool()
     return get_runtime().m_dmp;
 }
 
-hipEvent_t& RuntimeHIP::get_event(int const idx)
+hipEvent_t RuntimeHIP::get_event(int const idx)
 {
-    auto& rt = get_runtime();
-    assert_always(idx < rt.m_events.size());
-    return rt.m_events[idx];
+    assert_always(idx >= 0);
+    auto& runtime = get_runtime();
+    int const device = h2::gpu::current_gpu();
+    std::lock_guard<std::mutex> lock(runtime.m_events_mutex);
+    auto& events = runtime.m_events[{device, std::this_thread::get_id()}];
+    while (static_cast<int>(events.size()) <= idx)
+    {
+        events.push_back(h2::gpu::acquire_event_notiming());
+    }
+    return events[idx];
 }
 
 } // namespace internal
@@ -0,0 +1,108 @@
+#include "distconv/tensor/allreduce_fused.hpp"
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+#include "h2/gpu/memory_utils.hpp"
+
+#include <algorithm>
+
+namespace distconv {
+namespace tensor {
+
+namespace {
+
+// Each blockIdx.y handles one entry
+template <typename DataType, bool IS_PACK>
+__global__ void pack_or_unpack_kernel(
+    const typename AllreduceFused<DataType>::Entry *entries,
+    DataType *buf) {
+  const auto entry = entries[blockIdx.y];
+  const size_t num_threads = blockDim.x * gridDim.x;
+  buf += entry.offset;
+  for (size_t i = threadIdx.x + blockIdx.x * blockDim.x; i < entry.count;
+       i += num_threads) {
+    if (IS_PACK) {
+      buf[i] = entry.send_buf[i];
+    } else {
+      entry.recv_buf[i] = buf[i];
+    }
+  }
+}
+
+template <typename DataType, bool IS_PACK>
+void pack_or_unpack(const typename AllreduceFused<DataType>::Entry *entries,
+                    int num_entries, size_t max_count, DataType *buf,
+                    h2::gpu::DeviceStream stream) {
+  constexpr int block_size = 256;
+  // Small entries are copied by a single block
+  constexpr size_t max_num_blocks_per_entry = 32;
+  dim3 grid_dim(std::min(util::ceil(max_count, (size_t)block_size),
+                         max_num_blocks_per_entry),
+                num_entries);
+  pack_or_unpack_kernel<DataType, IS_PACK>
+      <<<grid_dim, block_size, 0, stream>>>(entries, buf);
+}
+
+} // namespace
+
+template <typename DataType>
+void AllreduceFused<DataType>::pack() {
+  const size_t len = m_entries.size() * sizeof(Entry);
+  if (m_entries_d.get_size() < len) {
+    m_entries_d.allocate(len);
+  }
+  if (m_buf.get_size() < m_count * sizeof(DataType)) {
+    m_buf.allocate(m_count * sizeof(DataType));
+  }
+  // m_entries can be modified once this returns as the source is
+  // pageable memory.
+  h2::gpu::mem_copy(static_cast<Entry*>(m_entries_d.get()),
+                    m_entries.data(), m_entries.size(), m_stream);
+  size_t max_count = 0;
+  for (const auto &e: m_entries) {
+    max_count = std::max(max_count, e.count);
+  }
+  pack_or_unpack<DataType, true>(
+      static_cast<const Entry*>(m_entries_d.get()), m_entries.size(),
+      max_count, static_cast<DataType*>(m_buf.get()), m_stream);
+}
+
+template <typename DataType>
+void AllreduceFused<DataType>::unpack() {
+  size_t max_count = 0;
+  for (const auto &e: m_entries) {
+    max_count = std::max(max_count, e.count);
+  }
+  pack_or_unpack<DataType, false>(
+      static_cast<const Entry*>(m_entries_d.get()), m_entries.size(),
+      max_count, static_cast<DataType*>(m_buf.get()), m_stream);
+}
+
+template <typename DataType>
+void AllreduceFused<DataType>::flush() {
+  if (m_entries.empty()) return;
+  if (m_entries.size() == 1) {
+    // No need to pack a single buffer
+    const auto &e = m_entries[0];
+    m_ar.allreduce(e.send_buf, e.recv_buf, e.count);
+  } else {
+    // CUDA grid dimension limitation
+    assert_always(m_entries.size() <= 65535);
+    pack();
+    m_ar.allreduce(static_cast<DataType*>(m_buf.get()), m_count);
+    unpack();
+  }
+  m_entries.clear();
+  m_count = 0;
+}
+
+#define INSTANTIATE_ALLREDUCE_FUSED(TYPE)                                      \
+  template class AllreduceFused<TYPE>;
+INSTANTIATE_ALLREDUCE_FUSED(float)
+INSTANTIATE_ALLREDUCE_FUSED(double)
+INSTANTIATE_ALLREDUCE_FUSED(int)
+INSTANTIATE_ALLREDUCE_FUSED(long)
+#undef INSTANTIATE_ALLREDUCE_FUSED
+
+} // namespace tensor
+} // namespace distconv
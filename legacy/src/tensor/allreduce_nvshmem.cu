@@ -1,4 +1,5 @@
 #include "distconv/tensor/allreduce_nvshmem.hpp"
+#include "distconv/util/overflow_gpu.hpp"
 
 using namespace distconv::util::nvshmem;
 
@@ -16,11 +17,13 @@ __global__ void copy_kernel(const DataType *src, DataType *dst, size_t count) {
 }
 
 template <typename DataType>
-__global__ void reduce_kernel(const DataType *src, DataType *dst, size_t count) {
+__global__ void reduce_kernel(const DataType *src, DataType *dst, size_t count,
+                              int *overflow) {
   size_t tid = threadIdx.x + blockIdx.x * blockDim.x;
   size_t num_threads = blockDim.x * gridDim.x;
   for (size_t i = tid; i < count; i += num_threads) {
     dst[i] += src[i];
+    util::overflow::check(overflow, dst[i]);
   }
 }
 
@@ -47,7 +50,8 @@ DEFINE_COPY(long)
                                       size_t count) {                   \
     int block_dim = 256;                                                \
     int grid_dim = std::min(128ul, (count + block_dim - 1)/ block_dim); \
-    reduce_kernel<<<grid_dim, block_dim, 0, m_stream>>>(src, dst, count); \
+    reduce_kernel<<<grid_dim, block_dim, 0, m_stream>>>(                \
+        src, dst, count, util::overflow::get_flag());                   \
   }
 DEFINE_REDUCE(float)
 DEFINE_REDUCE(double)
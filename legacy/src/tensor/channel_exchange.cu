@@ -85,101 +85,283 @@ __global__ void unpack_from_ag_kernel(const DataType * __restrict__ packed_buf,
   }
 }
 
-}  // namespace internal
-
-template <>
-void ChannelExchange<float>::pack_for_rs(TensorType& src,
-                                         TensorType& dst,
-                                         float* dst_buf,
-                                         size_t comm_size,
-                                         h2::gpu::DeviceStream stream)
-{
-    constexpr int block_size = 256;
-    dim3 block_dim(block_size);
-    dim3 grid_dim((src.get_local_size() + block_size - 1) / block_size);
-    auto src_shape = src.get_local_shape();
-    internal::pack_for_rs_kernel<<<grid_dim, block_dim, 0, stream>>>(
-        src.get_base_ptr(),
-        dst_buf,
-        src_shape[-1],
-        src_shape[-2],
-        comm_size,
-        src.get_local_size(),
-        get_sample_size(src),
-        get_channel_size(src),
-        dst.get_local_shape()[-2],
-        get_sample_size(dst),
-        dst.get_local_size());
+/**
+ * Copies between the spatial boxes of the peers, packed as
+ * <peer><sample><local channel><box>, and a channel-decomposed tensor
+ * with the whole spatial domain. The spatial dimensions are padded to
+ * three.
+ *
+ * @param box_offsets Offsets of the box of each peer, 3 per peer.
+ */
+template <typename DataType, bool to_tensor>
+__global__ void copy_spatial_boxes_kernel(DataType * __restrict__ packed_buf,
+                                          DataType * __restrict__ tensor,
+                                          const size_t size,
+                                          const size_t peer_buf_size,
+                                          const size_t num_channels,
+                                          const index_t box_x,
+                                          const index_t box_y,
+                                          const index_t box_z,
+                                          const index_t full_x,
+                                          const index_t full_y,
+                                          const index_t full_z,
+                                          const index_t * __restrict__ box_offsets) {
+  const size_t gid = threadIdx.x + blockIdx.x*blockDim.x;
+  const size_t num_threads = blockDim.x * gridDim.x;
+  const size_t box_size = box_x * box_y * box_z;
+  const size_t full_size = full_x * full_y * full_z;
+  for (size_t pos = gid; pos < size; pos += num_threads) {
+    const size_t peer = pos / peer_buf_size;
+    size_t offset = pos - peer*peer_buf_size;
+    const size_t channel = offset / box_size;
+    offset -= channel * box_size;
+    const size_t z = offset / (box_x * box_y);
+    offset -= z * box_x * box_y;
+    const size_t y = offset / box_x;
+    const size_t x = offset - y * box_x;
+    const index_t *box_offset = box_offsets + peer * 3;
+    // Channels of all samples are consecutive in both layouts
+    const size_t tensor_idx = channel * full_size +
+        ((z + box_offset[2]) * full_y + y + box_offset[1]) * full_x +
+        x + box_offset[0];
+    if (to_tensor) {
+      tensor[tensor_idx] = packed_buf[pos];
+    } else {
+      packed_buf[pos] = tensor[tensor_idx];
+    }
+  }
 }
 
-template <>
-void ChannelExchange<double>::pack_for_rs(TensorType& src,
-                                          TensorType& dst,
-                                          double* dst_buf,
-                                          size_t comm_size,
-                                          h2::gpu::DeviceStream stream)
+}  // namespace internal
+
+template <typename DataType>
+void ChannelExchange<DataType>::pack_for_rs(TensorType& src,
+                                            TensorType& dst,
+                                            DataType* dst_buf,
+                                            size_t comm_size,
+                                            index_t sample_offset,
+                                            index_t num_samples,
+                                            h2::gpu::DeviceStream stream)
 {
     constexpr int block_size = 256;
     dim3 block_dim(block_size);
-    dim3 grid_dim((src.get_local_size() + block_size - 1) / block_size);
+    const size_t src_size = num_samples * get_sample_size(src);
+    dim3 grid_dim((src_size + block_size - 1) / block_size);
     auto src_shape = src.get_local_shape();
     internal::pack_for_rs_kernel<<<grid_dim, block_dim, 0, stream>>>(
-        src.get_base_ptr(),
+        src.get_base_ptr() + sample_offset * get_sample_size(src),
         dst_buf,
-        src_shape[-1],
+        num_samples,
         src_shape[-2],
         comm_size,
-        src.get_local_size(),
+        src_size,
         get_sample_size(src),
         get_channel_size(src),
         dst.get_local_shape()[-2],
         get_sample_size(dst),
-        dst.get_local_size());
+        num_samples * get_sample_size(dst));
 }
 
-template <>
-void ChannelExchange<float>::unpack_from_ag(TensorType& src,
-                                            TensorType& dst,
-                                            float* packed_buf,
-                                            size_t comm_size,
-                                            h2::gpu::DeviceStream stream)
+template <typename DataType>
+void ChannelExchange<DataType>::unpack_from_ag(TensorType& src,
+                                               TensorType& dst,
+                                               DataType* packed_buf,
+                                               size_t comm_size,
+                                               index_t sample_offset,
+                                               index_t num_samples,
+                                               h2::gpu::DeviceStream stream)
 {
     constexpr int block_size = 256;
     dim3 block_dim(block_size);
-    dim3 grid_dim((src.get_local_size() + block_size - 1) / block_size);
-    auto src_shape = src.get_local_shape();
+    const size_t dst_size = num_samples * get_sample_size(dst);
+    dim3 grid_dim((dst_size + block_size - 1) / block_size);
     internal::unpack_from_ag_kernel<<<grid_dim, block_dim, 0, stream>>>(
         packed_buf,
-        dst.get_base_ptr(),
-        src_shape[-1],
+        dst.get_base_ptr() + sample_offset * get_sample_size(dst),
+        num_samples,
         comm_size,
-        dst.get_local_size(),
-        src.get_local_size(),
+        dst_size,
+        num_samples * get_sample_size(src),
         get_sample_size(src),
         get_sample_size(dst));
 }
 
-template <>
-void ChannelExchange<double>::unpack_from_ag(TensorType& src,
-                                             TensorType& dst,
-                                             double* packed_buf,
-                                             size_t comm_size,
-                                             h2::gpu::DeviceStream stream)
+template <typename DataType>
+ChannelSpatialShuffler<DataType>::ChannelSpatialShuffler(
+    const TensorType &spatial,
+    const TensorType &channel,
+    MPI_Comm comm,
+    h2::gpu::DeviceStream stream)
+    : m_comm(get_al_comm<Al::NCCLBackend>(comm, stream))
 {
-    constexpr int block_size = 256;
-    dim3 block_dim(block_size);
-    dim3 grid_dim((dst.get_local_size() + block_size - 1) / block_size);
-    auto src_shape = src.get_local_shape();
+    const int num_dims = spatial.get_num_dims();
+    const int num_spatial_dims = num_dims - 2;
+    assert_always(num_spatial_dims <= 3);
+    assert_always(spatial.get_shape() == channel.get_shape());
+    assert_eq(spatial.get_local_shape()[-1], channel.get_local_shape()[-1]);
+    assert_eq(spatial.get_local_shape()[-2], spatial.get_shape()[-2]);
+    assert_always(spatial.get_overlap().reduce_sum() == 0);
+    assert_always(channel.get_overlap().reduce_sum() == 0);
+    for (int i = 0; i < num_spatial_dims; ++i)
+    {
+        assert_eq(channel.get_local_shape()[i], channel.get_shape()[i]);
+        m_box_shape[i] = spatial.get_local_shape()[i];
+        m_full_shape[i] = spatial.get_shape()[i];
+    }
+
+    const int num_peers = m_comm->size();
+    std::vector<index_t> box_offsets(num_peers * 3, 0);
+    index_t local[5] = {0, 0, 0, 0, 0};
+    for (int i = 0; i < num_spatial_dims; ++i)
+    {
+        local[i] = spatial.get_global_index()[i];
+    }
+    // The spatial box size and the channel block, which must be equal
+    // on all peers and in the rank order, respectively
+    local[3] = spatial.get_local_size();
+    local[4] = channel.get_global_index()[-2];
+    std::vector<index_t> all(num_peers * 5);
+    DISTCONV_CHECK_MPI(MPI_Allgather(local,
+                                     5,
+                                     util::get_mpi_data_type<index_t>(),
+                                     all.data(),
+                                     5,
+                                     util::get_mpi_data_type<index_t>(),
+                                     comm));
+    const index_t num_local_channels = channel.get_local_shape()[-2];
+    for (int p = 0; p < num_peers; ++p)
+    {
+        std::copy_n(&all[p * 5], 3, &box_offsets[p * 3]);
+        assert_eq(all[p * 5 + 3], local[3]);
+        assert_eq(all[p * 5 + 4], p * num_local_channels);
+    }
+    assert_eq(num_local_channels * num_peers, channel.get_shape()[-2]);
+    m_box_offsets.allocate(box_offsets.size() * sizeof(index_t));
+    h2::gpu::mem_copy(static_cast<index_t*>(m_box_offsets.get()),
+                      box_offsets.data(),
+                      box_offsets.size());
+}
+
+template <typename DataType>
+size_t ChannelSpatialShuffler<DataType>::get_block_size(
+    const TensorType &channel) const
+{
+    return channel.get_local_shape()[-1] * channel.get_local_shape()[-2]
+           * m_box_shape[0] * m_box_shape[1] * m_box_shape[2];
+}
+
+template <typename DataType>
+void ChannelSpatialShuffler<DataType>::spatial_to_channel(
+    TensorType &spatial,
+    TensorType &channel,
+    h2::gpu::DeviceStream stream)
+{
+    DISTCONV_RANGE("channel_spatial_shuffle/spatial_to_channel", Shuffle);
+    const size_t block_size = get_block_size(channel);
+    const int num_peers = m_comm->size();
+    const size_t size = block_size * num_peers;
+    if (size == 0)
+        return;
+    auto &pool = distconv::internal::RuntimeGPU::get_device_memory_pool();
+    auto send_buf = static_cast<DataType*>(
+        pool.get(size * sizeof(DataType), stream));
+    auto recv_buf = static_cast<DataType*>(
+        pool.get(size * sizeof(DataType), stream));
+    const index_t num_samples = spatial.get_local_shape()[-1];
+    const size_t channel_size = this->get_channel_size(spatial);
+    const size_t dest_size_per_sample =
+        channel.get_local_shape()[-2] * channel_size;
+    constexpr int cuda_block_size = 256;
+    dim3 block_dim(cuda_block_size);
+    dim3 grid_dim((size + cuda_block_size - 1) / cuda_block_size);
+    // Channel blocks of each destination, as for reduce-scatter
+    internal::pack_for_rs_kernel<<<grid_dim, block_dim, 0, stream>>>(
+        spatial.get_base_ptr(),
+        send_buf,
+        num_samples,
+        spatial.get_local_shape()[-2],
+        num_peers,
+        size,
+        this->get_sample_size(spatial),
+        channel_size,
+        channel.get_local_shape()[-2],
+        dest_size_per_sample,
+        num_samples * dest_size_per_sample);
+    Al::Alltoall<Al::NCCLBackend, DataType>(
+        send_buf, recv_buf, block_size, *m_comm);
+    internal::copy_spatial_boxes_kernel<DataType, true>
+        <<<grid_dim, block_dim, 0, stream>>>(
+            recv_buf,
+            channel.get_base_ptr(),
+            size,
+            block_size,
+            num_samples * channel.get_local_shape()[-2],
+            m_box_shape[0],
+            m_box_shape[1],
+            m_box_shape[2],
+            m_full_shape[0],
+            m_full_shape[1],
+            m_full_shape[2],
+            static_cast<const index_t*>(m_box_offsets.get()));
+    pool.release(send_buf);
+    pool.release(recv_buf);
+}
+
+template <typename DataType>
+void ChannelSpatialShuffler<DataType>::channel_to_spatial(
+    TensorType &channel,
+    TensorType &spatial,
+    h2::gpu::DeviceStream stream)
+{
+    DISTCONV_RANGE("channel_spatial_shuffle/channel_to_spatial", Shuffle);
+    const size_t block_size = get_block_size(channel);
+    const int num_peers = m_comm->size();
+    const size_t size = block_size * num_peers;
+    if (size == 0)
+        return;
+    auto &pool = distconv::internal::RuntimeGPU::get_device_memory_pool();
+    auto send_buf = static_cast<DataType*>(
+        pool.get(size * sizeof(DataType), stream));
+    auto recv_buf = static_cast<DataType*>(
+        pool.get(size * sizeof(DataType), stream));
+    const index_t num_samples = spatial.get_local_shape()[-1];
+    constexpr int cuda_block_size = 256;
+    dim3 block_dim(cuda_block_size);
+    dim3 grid_dim((size + cuda_block_size - 1) / cuda_block_size);
+    internal::copy_spatial_boxes_kernel<DataType, false>
+        <<<grid_dim, block_dim, 0, stream>>>(
+            send_buf,
+            channel.get_base_ptr(),
+            size,
+            block_size,
+            num_samples * channel.get_local_shape()[-2],
+            m_box_shape[0],
+            m_box_shape[1],
+            m_box_shape[2],
+            m_full_shape[0],
+            m_full_shape[1],
+            m_full_shape[2],
+            static_cast<const index_t*>(m_box_offsets.get()));
+    Al::Alltoall<Al::NCCLBackend, DataType>(
+        send_buf, recv_buf, block_size, *m_comm);
+    // Channel blocks of each source, as for allgather
     internal::unpack_from_ag_kernel<<<grid_dim, block_dim, 0, stream>>>(
-        packed_buf,
-        dst.get_base_ptr(),
-        src_shape[-1],
-        comm_size,
-        dst.get_local_size(),
-        src.get_local_size(),
-        get_sample_size(src),
-        get_sample_size(dst));
+        recv_buf,
+        spatial.get_base_ptr(),
+        num_samples,
+        num_peers,
+        size,
+        block_size,
+        block_size / num_samples,
+        this->get_sample_size(spatial));
+    pool.release(send_buf);
+    pool.release(recv_buf);
 }
 
+template class ChannelExchange<float>;
+template class ChannelExchange<double>;
+template class ChannelSpatialShuffler<float>;
+template class ChannelSpatialShuffler<double>;
+
 }  // namespace tensor
 } // namespace distconv
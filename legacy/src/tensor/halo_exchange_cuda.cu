@@ -1,4 +1,5 @@
 #include "distconv/tensor/halo_exchange_cuda.hpp"
+#include "distconv/tensor/halo_exchange_cuda_batched.hpp"
 #include "distconv/tensor/halo_cuda.hpp"
 #include "distconv/util/util_mpi.hpp"
 #include "distconv/tensor/halo_packing_cuda.hpp"
@@ -19,8 +20,45 @@ void HaloExchange<float, CUDAAllocator, Al::NCCLBackend>::
                    bool is_reverse,
                    HaloExchangeAccumOp op)
 {
-    halo_exchange_cuda::pack_or_unpack<float>(
-        m_tensor, dim, side, width, stream, buf, is_pack, is_reverse, op);
+    const int step = get_row_step(dim);
+    if (step > 1)
+    {
+        halo_exchange_cuda::pack_or_unpack_rows<float>(m_tensor,
+                                                       dim,
+                                                       side,
+                                                       width,
+                                                       step,
+                                                       m_row_phases[dim],
+                                                       stream,
+                                                       buf,
+                                                       is_pack,
+                                                       is_reverse,
+                                                       op,
+                                                       m_accum_scale);
+        return;
+    }
+    halo_exchange_cuda::pack_or_unpack<float>(m_tensor,
+                                              dim,
+                                              side,
+                                              width,
+                                              stream,
+                                              buf,
+                                              is_pack,
+                                              is_reverse,
+                                              op,
+                                              m_comm_precision,
+                                              m_accum_scale);
+}
+
+template <>
+void HaloExchange<float, CUDAAllocator, Al::NCCLBackend>::
+    clear_boundary_halo(int dim,
+                        Side side,
+                        int width,
+                        h2::gpu::DeviceStream stream)
+{
+    halo_exchange_cuda::clear_boundary_halo<float>(
+        m_tensor, dim, side, width, stream);
 }
 
 template <>
@@ -34,8 +72,123 @@ void HaloExchange<double, CUDAAllocator, Al::NCCLBackend>::
                    bool is_reverse,
                    HaloExchangeAccumOp op)
 {
-    halo_exchange_cuda::pack_or_unpack<double>(
-        m_tensor, dim, side, width, stream, buf, is_pack, is_reverse, op);
+    const int step = get_row_step(dim);
+    if (step > 1)
+    {
+        halo_exchange_cuda::pack_or_unpack_rows<double>(m_tensor,
+                                                        dim,
+                                                        side,
+                                                        width,
+                                                        step,
+                                                        m_row_phases[dim],
+                                                        stream,
+                                                        buf,
+                                                        is_pack,
+                                                        is_reverse,
+                                                        op,
+                                                        m_accum_scale);
+        return;
+    }
+    halo_exchange_cuda::pack_or_unpack<double>(m_tensor,
+                                               dim,
+                                               side,
+                                               width,
+                                               stream,
+                                               buf,
+                                               is_pack,
+                                               is_reverse,
+                                               op,
+                                               m_comm_precision,
+                                               m_accum_scale);
+}
+
+template <>
+void HaloExchange<double, CUDAAllocator, Al::NCCLBackend>::
+    clear_boundary_halo(int dim,
+                        Side side,
+                        int width,
+                        h2::gpu::DeviceStream stream)
+{
+    halo_exchange_cuda::clear_boundary_halo<double>(
+        m_tensor, dim, side, width, stream);
+}
+
+template <>
+void HaloExchangeALBatched<float, CUDAAllocator, Al::NCCLBackend>::
+    pack_or_unpack_region(const Region& region,
+                          h2::gpu::DeviceStream stream,
+                          void* buf,
+                          bool is_pack,
+                          HaloExchangeAccumOp op)
+{
+    halo_exchange_cuda::pack_or_unpack_region<float>(m_tensor,
+                                                     region.offset,
+                                                     region.shape,
+                                                     stream,
+                                                     buf,
+                                                     is_pack,
+                                                     op,
+                                                     this->m_accum_scale);
+}
+
+template <>
+void HaloExchangeALBatched<double, CUDAAllocator, Al::NCCLBackend>::
+    pack_or_unpack_region(const Region& region,
+                          h2::gpu::DeviceStream stream,
+                          void* buf,
+                          bool is_pack,
+                          HaloExchangeAccumOp op)
+{
+    halo_exchange_cuda::pack_or_unpack_region<double>(m_tensor,
+                                                      region.offset,
+                                                      region.shape,
+                                                      stream,
+                                                      buf,
+                                                      is_pack,
+                                                      op,
+                                                      this->m_accum_scale);
+}
+
+template <>
+void HaloExchangeALBatched<float, CUDAAllocator, Al::NCCLBackend>::
+    pack_or_unpack_regions(const std::vector<const Region*>& regions,
+                           const std::vector<void*>& bufs,
+                           h2::gpu::DeviceStream stream,
+                           bool is_pack,
+                           HaloExchangeAccumOp op)
+{
+    std::vector<IndexVector> offsets;
+    std::vector<Shape> shapes;
+    std::vector<float*> typed_bufs;
+    for (size_t i = 0; i < regions.size(); ++i)
+    {
+        offsets.push_back(regions[i]->offset);
+        shapes.push_back(regions[i]->shape);
+        typed_bufs.push_back(static_cast<float*>(bufs[i]));
+    }
+    halo_exchange_cuda::pack_or_unpack_regions<float>(
+        m_tensor, offsets, shapes, typed_bufs, stream, is_pack, op);
+}
+
+template <>
+void HaloExchangeALBatched<double, CUDAAllocator, Al::NCCLBackend>::
+    pack_or_unpack_regions(const std::vector<const Region*>& regions,
+                           const std::vector<void*>& bufs,
+                           h2::gpu::DeviceStream stream,
+                           bool is_pack,
+                           HaloExchangeAccumOp op)
+{
+    std::vector<IndexVector> offsets;
+    std::vector<Shape> shapes;
+    std::vector<double*> typed_bufs;
+    for (size_t i = 0; i < regions.size(); ++i)
+    {
+        offsets.push_back(regions[i]->offset);
+        shapes.push_back(regions[i]->shape);
+        typed_bufs.push_back(static_cast<double*>(bufs[i]));
+    }
+    halo_exchange_cuda::pack_or_unpack_regions<double>(
+        m_tensor, offsets, shapes, typed_bufs, stream, is_pack, op);
 }
 
 } // namespace tensor
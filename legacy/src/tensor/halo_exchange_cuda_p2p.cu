@@ -0,0 +1,42 @@
+#include "distconv/tensor/halo_exchange_cuda_p2p.hpp"
+#include "distconv/tensor/halo_packing_cuda.hpp"
+
+// Definitions only for float and double as integer types are unlikely
+// to used.
+#define LIST_OF_TYPES \
+  DEFINE_FUNC(float) \
+  DEFINE_FUNC(double)
+
+namespace distconv {
+namespace tensor {
+
+#define DEFINE_FUNC(TYPE)                                               \
+  template <>                                                           \
+  void HaloExchangeP2PFusedNotify<TYPE, CUDAAllocator, Al::NCCLBackend>:: \
+  pack_put_notify(                                                      \
+      int dim, Side side, int width, cudaStream_t stream,               \
+      void *dst, bool is_reverse) {                                     \
+    halo_exchange_cuda::pack_put_notify_ipc<TYPE>(                      \
+        this->m_tensor, dim, side, width, stream,                       \
+        dst, is_reverse, *this->get_sync(dim, side));                   \
+  }
+
+LIST_OF_TYPES
+#undef DEFINE_FUNC
+
+#define DEFINE_FUNC(TYPE)                                               \
+  template <>                                                           \
+  void HaloExchangeP2PFusedNotify<TYPE, CUDAAllocator, Al::NCCLBackend>:: \
+  wait_and_unpack(                                                      \
+      int dim, Side side, int width, cudaStream_t stream,               \
+      void *buf, bool is_reverse, HaloExchangeAccumOp op) {             \
+    halo_exchange_cuda::wait_and_unpack_ipc<TYPE>(                      \
+        this->m_tensor, dim, side, width, stream,                       \
+        buf, is_reverse, op, *this->get_sync(dim, side));               \
+  }
+
+LIST_OF_TYPES
+#undef DEFINE_FUNC
+
+} // namespace tensor
+} // namespace distconv
@@ -1,6 +1,8 @@
 #include "distconv/tensor/runtime_cuda.hpp"
 #include "distconv/util/util.hpp"
 #include "distconv/util/util_cuda.hpp"
+#include "h2/gpu/error.hpp"
+#include "h2/gpu/memory_resource.hpp"
 
 #include <algorithm>
 #include <cuda_runtime.h>
@@ -9,49 +11,147 @@ namespace distconv {
 namespace tensor {
 namespace internal {
 
-PinnedMemoryPool::PinnedMemoryPool() {}
+PinnedMemoryPool::PinnedMemoryPool():
+    m_num_gets(0), m_num_hits(0), m_num_in_use(0), m_bytes_in_use(0),
+    m_peak_bytes_in_use(0), m_allocated_bytes(0) {
+  for (auto &b: m_bins) {
+    b.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
 PinnedMemoryPool::~PinnedMemoryPool() {
   deallocate_all_chunks();
 }
 
-void *PinnedMemoryPool::get(size_t size) {
-  for (auto it = m_chunks.begin(); it != m_chunks.end(); ++it) {
-    chunk_t &c = *it;
-    if (std::get<1>(c) >= size && !std::get<2>(c)) {
-      std::get<2>(c) = true;
-      return std::get<0>(c);
+// Bin 0 has chunks of up to 2^m_min_bin_shift bytes. Chunk sizes of
+// the other bins are (5, 6, 7, 8) * 2^(e-2) for sizes in (2^e, 2^(e+1)].
+int PinnedMemoryPool::find_bin(size_t size) {
+  const size_t min_size = size_t(1) << m_min_bin_shift;
+  if (size <= min_size) return 0;
+  const size_t s = size - 1;
+  int e = 0;
+  while ((s >> (e + 1)) != 0) ++e;
+  const int sub = (s >> (e - 2)) & 3;
+  const int bin = 1 + (e - m_min_bin_shift) * 4 + sub;
+  assert_always(bin < m_num_bins && "Requested size too large");
+  return bin;
+}
+
+size_t PinnedMemoryPool::get_bin_size(int bin) {
+  if (bin == 0) return size_t(1) << m_min_bin_shift;
+  const int e = (bin - 1) / 4 + m_min_bin_shift;
+  const int sub = (bin - 1) % 4;
+  return size_t(5 + sub) << (e - 2);
+}
+
+PinnedMemoryPool::free_list_t &PinnedMemoryPool::get_bin(int bin) {
+  auto *list = m_bins[bin].load(std::memory_order_acquire);
+  if (list == nullptr) {
+    auto *new_list = new free_list_t(m_bin_capacity);
+    if (m_bins[bin].compare_exchange_strong(list, new_list,
+                                            std::memory_order_acq_rel)) {
+      list = new_list;
+    } else {
+      // Another thread created the list
+      delete new_list;
     }
   }
+  return *list;
+}
+
+void *PinnedMemoryPool::allocate_chunk(int bin) {
+  const size_t size = get_bin_size(bin);
   util::PrintStreamDebug()
       << "Allocating a new pinned memory of size "
       << size << "\n";
-  void *new_mem;
-  DISTCONV_CHECK_CUDA(cudaMallocHost(&new_mem, size));
-  chunk_t c = std::make_tuple(new_mem, size, true);
-  m_chunks.emplace_back(c);
-  return std::get<0>(c);
+  void *chunk = h2::gpu::pinned_host_memory_resource().allocate(
+      size + m_header_size, nullptr);
+  auto *header = static_cast<Header*>(chunk);
+  header->magic = m_magic;
+  header->bin = bin;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_chunks.push_back(chunk);
+  m_allocated_bytes += size + m_header_size;
+  return static_cast<char*>(chunk) + m_header_size;
+}
+
+void PinnedMemoryPool::deallocate_chunk(void *chunk) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = std::find(m_chunks.begin(), m_chunks.end(), chunk);
+  assert_always(it != m_chunks.end());
+  m_chunks.erase(it);
+  m_allocated_bytes -= get_bin_size(static_cast<Header*>(chunk)->bin)
+      + m_header_size;
+  h2::gpu::pinned_host_memory_resource().deallocate(chunk);
+}
+
+void *PinnedMemoryPool::get(size_t size) {
+  const int bin = find_bin(size);
+  m_num_gets.fetch_add(1, std::memory_order_relaxed);
+  m_num_in_use.fetch_add(1, std::memory_order_relaxed);
+  const size_t in_use = m_bytes_in_use.fetch_add(
+      get_bin_size(bin), std::memory_order_relaxed) + get_bin_size(bin);
+  size_t peak = m_peak_bytes_in_use.load(std::memory_order_relaxed);
+  while (peak < in_use &&
+         !m_peak_bytes_in_use.compare_exchange_weak(
+             peak, in_use, std::memory_order_relaxed));
+  void *p;
+  if (get_bin(bin).pop(p)) {
+    m_num_hits.fetch_add(1, std::memory_order_relaxed);
+    return p;
+  }
+  return allocate_chunk(bin);
 }
 
 void PinnedMemoryPool::release(void *p) {
-  for (auto it = m_chunks.begin(); it != m_chunks.end(); ++it) {
-    chunk_t &c = *it;
-    if (std::get<0>(c) == p) {
-      assert_always(std::get<2>(c) &&
-                    "Error: Releasing unused pointer");
-      std::get<2>(c) = false;
-      return;
-    }
+  void *chunk = static_cast<char*>(p) - m_header_size;
+  const auto *header = static_cast<const Header*>(chunk);
+  assert_always(header->magic == m_magic &&
+                "Error: Releasing unknown pointer");
+  m_num_in_use.fetch_sub(1, std::memory_order_relaxed);
+  m_bytes_in_use.fetch_sub(get_bin_size(header->bin),
+                           std::memory_order_relaxed);
+  if (!get_bin(header->bin).push(p)) {
+    // More chunks of the bin than the free list can hold
+    deallocate_chunk(chunk);
   }
-  assert_always(false && "Error: Releasing unknown pointer");
+}
+
+PinnedMemoryPool::Stats PinnedMemoryPool::get_stats() const {
+  Stats stats;
+  stats.num_gets = m_num_gets.load(std::memory_order_relaxed);
+  stats.num_hits = m_num_hits.load(std::memory_order_relaxed);
+  stats.num_in_use = m_num_in_use.load(std::memory_order_relaxed);
+  stats.bytes_in_use = m_bytes_in_use.load(std::memory_order_relaxed);
+  stats.peak_bytes_in_use =
+      m_peak_bytes_in_use.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  stats.num_chunks = m_chunks.size();
+  stats.allocated_bytes = m_allocated_bytes;
+  return stats;
 }
 
 void PinnedMemoryPool::deallocate_all_chunks() {
-  std::for_each(m_chunks.begin(), m_chunks.end(),
-                [](chunk_t c) {
-                  assert_always(!std::get<2>(c));
-                  cudaFreeHost(std::get<0>(c));
-                });
+  const auto stats = get_stats();
+  util::PrintStreamDebug()
+      << "Pinned memory pool: " << stats.num_gets << " gets, "
+      << stats.num_hits << " hits, " << stats.num_chunks << " chunks of "
+      << stats.allocated_bytes << " bytes, peak in use: "
+      << stats.peak_bytes_in_use << " bytes\n";
+  assert_always(stats.num_in_use == 0);
+  for (auto &b: m_bins) {
+    delete b.exchange(nullptr);
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // Errors are ignored as the runtime may already be shut down
+  for (auto chunk: m_chunks) {
+    try {
+      h2::gpu::pinned_host_memory_resource().deallocate(chunk);
+    } catch (h2::gpu::GPUError const&) {
+    }
+  }
   m_chunks.clear();
+  m_allocated_bytes = 0;
 }
 
 RuntimeCUDA *RuntimeCUDA::m_instance = nullptr;
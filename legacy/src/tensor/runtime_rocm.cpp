@@ -8,6 +8,8 @@
 
 #include "distconv/util/util.hpp"
 #include "distconv/util/util_rocm.hpp"
+#include "h2/gpu/error.hpp"
+#include "h2/gpu/memory_resource.hpp"
 
 #include <algorithm>
 
@@ -40,8 +42,8 @@ void* PinnedMemoryPool::get(size_t size)
     }
     util::PrintStreamDebug()
         << "Allocating a new pinned memory of size " << size << "\n";
-    void* new_mem;
-    DISTCONV_CHECK_HIP(hipHostMalloc(&new_mem, size));
+    void* new_mem =
+        h2::gpu::pinned_host_memory_resource().allocate(size, nullptr);
     chunk_t& c = m_chunks.emplace_back(new_mem, size, true);
     return std::get<0>(c);
 }
@@ -65,7 +67,13 @@ void PinnedMemoryPool::deallocate_all_chunks()
 {
     std::for_each(m_chunks.begin(), m_chunks.end(), [](chunk_t c) {
         assert_always(!std::get<2>(c));
-        static_cast<void>(hipHostFree(std::get<0>(c)));
+        // Errors are ignored as the runtime may already be shut down.
+        try
+        {
+            h2::gpu::pinned_host_memory_resource().deallocate(std::get<0>(c));
+        }
+        catch (h2::gpu::GPUError const&)
+        {}
     });
     m_chunks.clear();
 }
@@ -1,7 +1,16 @@
+#include "distconv/tensor/comm_precision_cuda.hpp"
+#include "distconv/tensor/halo_cuda.hpp"
+#include "distconv/tensor/region_traversal.hpp"
 #include "distconv/tensor/shuffle_mpi_cuda.hpp"
+#include "distconv/util/instrumentation.hpp"
 #include "distconv/util/util_gpu.hpp"
 #include <distconv_config.hpp>
+#ifdef DISTCONV_HAS_NVSHMEM
+#include "distconv/tensor/shuffle_mpi_cuda_nvshmem.hpp"
+#endif // DISTCONV_HAS_NVSHMEM
 
+#include <algorithm>
+#include <cstdint>
 #include <sstream>
 #include <vector>
 
@@ -17,15 +26,19 @@ namespace {
 template <int ND>
 using Array = tensor::Array<ND>;
 using Shape = tensor::Shape;
+using tensor::ElementVector;
+using tensor::max_vector_width;
+// Offsets into local tensors may not fit in 32 bits.
+template <int ND>
+using FastDivShape = tensor::FastDivShape<ND, uint64_t>;
 
 template <int ND>
-__device__ Array<ND> get_idx(size_t linear_offset,
-                             const Array<ND> &shape) {
+__device__ Array<ND> get_idx(uint64_t linear_offset,
+                             const FastDivShape<ND> &shape) {
   Array<ND> idx;
 #pragma unroll
   for (int i = 0; i < ND; ++i) {
-    idx[i] = linear_offset % shape[i];
-    linear_offset /= shape[i];
+    idx[i] = shape.divmod(i, linear_offset);
   }
   return idx;
 }
@@ -41,7 +54,7 @@ __device__ Array<ND> get_idx(size_t linear_offset,
  */
 template <int ND>
 __device__ void find_destination(const Array<ND> &src_local_idx,
-                                 const Array<ND> &src_local_shape,
+                                 const FastDivShape<ND> &src_local_shape,
                                  const Array<ND> &dst_locale_shape,
                                  const int * __restrict__ rank_limits,
                                  int &dst_rank, size_t &dst_offset) {
@@ -98,27 +111,69 @@ __device__ void find_destination(const Array<ND> &src_local_idx,
 }
 
 template <int ND>
-__device__ size_t get_strided_offset(size_t offset,
-                                     const Array<ND> &shape,
+__device__ size_t get_strided_offset(const Array<ND> &idx,
                                      const Array<ND> &strides) {
   size_t real_offset = 0;
 #pragma unroll
   for (int i = 0; i < ND; ++i) {
-    auto x = offset % shape[i];
-    real_offset += x * strides[i];
-    offset /= shape[i];
+    real_offset += idx[i] * strides[i];
   }
   return real_offset;
 }
 
+/**
+   Returns max_vector_width<DataType>() if every run of elements along
+   the innermost dimension that goes to or comes from a rank starts and
+   ends at a multiple of it in both the tensor and the buffer, and both
+   are aligned to the vectors; 1 otherwise.
+
+   @param rank_limits_h host copy of the rank limits.
+   @param displs_h host copy of the buffer displacements of the ranks.
+ */
+template <typename DataType, typename BufType>
+int get_vector_width(const DataType *tensor, const BufType *buf,
+                     const Shape &shape, const IndexVector &strides,
+                     bool packed, const Shape &locale_shape,
+                     const int *rank_limits_h, const int *displs_h) {
+  constexpr int vw = max_vector_width<DataType>();
+  if (vw == 1 ||
+      reinterpret_cast<std::uintptr_t>(tensor) % (vw * sizeof(DataType)) ||
+      reinterpret_cast<std::uintptr_t>(buf) % (vw * sizeof(BufType)) ||
+      shape[0] % vw != 0 ||
+      (!packed && shape.num_dims() > 1 && strides[1] % vw != 0)) {
+    return 1;
+  }
+  // Limits of the innermost dimension come first
+  if (rank_limits_h[0] == -1) {
+    // Evenly partitioned; see optimize_find_destination
+    if (rank_limits_h[1] % vw != 0 || rank_limits_h[2] % vw != 0) {
+      return 1;
+    }
+  } else {
+    for (int j = 0; j < (int)locale_shape[0]; ++j) {
+      if (rank_limits_h[j] % vw != 0) {
+        return 1;
+      }
+    }
+  }
+  for (index_t i = 0; i < locale_shape.get_size(); ++i) {
+    if (displs_h[i] % vw != 0) {
+      return 1;
+    }
+  }
+  return vw;
+}
+
 #define PACK_USE_SHMEM
-template <int ND, typename DataType, bool packed>
+// Each thread packs VW consecutive elements at a time, which all go to
+// the same rank when VW is given by get_vector_width.
+template <int ND, int VW, typename DataType, bool packed, typename BufType>
 __global__ void pack_kernel(const DataType *src,
-                            const Array<ND> src_local_shape,
+                            const FastDivShape<ND> src_local_shape,
                             const Array<ND> src_strides,
                             const Array<ND> dst_locale_shape,
                             const int * __restrict__ rank_limits,
-                            DataType * __restrict__ buf,
+                            BufType * __restrict__ buf,
                             const int * __restrict__ displs) {
   const size_t size = src_local_shape.get_size();
   const size_t gid = threadIdx.x + blockIdx.x * blockDim.x;
@@ -144,44 +199,40 @@ __global__ void pack_kernel(const DataType *src,
   __syncthreads();
 #endif
 
-  for (size_t offset = gid; offset < size; offset += num_threads) {
-    size_t src_offset = packed ? offset :
-        get_strided_offset(offset, src_local_shape, src_strides);
-    DataType v = src[src_offset];
+  for (size_t offset = gid * VW; offset < size; offset += num_threads * VW) {
     const Array<ND> idx = get_idx(offset, src_local_shape);
+    size_t src_offset = packed ? offset :
+        get_strided_offset(idx, src_strides);
+    const auto v = *reinterpret_cast<const ElementVector<DataType, VW>*>(
+        src + src_offset);
+    ElementVector<BufType, VW> w;
+#pragma unroll
+    for (int i = 0; i < VW; ++i) {
+      w.v[i] = tensor::WireCast<BufType>::to_wire(v.v[i]);
+    }
     int rank;
     size_t dst_offset;
 #ifdef PACK_USE_SHMEM
     find_destination(idx, src_local_shape, dst_locale_shape,
                      rank_limits_s, rank, dst_offset);
-    buf[displs_s[rank] + dst_offset] = v;
+    *reinterpret_cast<ElementVector<BufType, VW>*>(
+        buf + displs_s[rank] + dst_offset) = w;
 #else
     find_destination(idx, src_local_shape, dst_locale_shape,
                      rank_limits, rank, dst_offset);
-#if 0
-    printf("rank: %d, displs[rank]: %d, dst_offset: %d\n",
-           rank, (int)displs[rank], (int)dst_offset);
-#endif
-    buf[displs[rank] + dst_offset] = v;
-#endif
-#if 0
-    if (offset < 8) {
-      printf("pack at %d (strided: %d) : %f, rank: %d, displs: %d, dst_offset: %d\n",
-             (int)offset,
-             (int)get_strided_offset(offset, src_local_shape, src_strides),
-             v, rank, displs[rank], (int)(dst_offset));
-    }
+    *reinterpret_cast<ElementVector<BufType, VW>*>(
+        buf + displs[rank] + dst_offset) = w;
 #endif
   }
 }
 
-template <typename DataType, bool packed>
+template <int VW, typename DataType, bool packed, typename BufType>
 void pack_kernel_dispatch(const DataType* src,
                           const Shape& src_local_shape,
                           const IndexVector& src_strides,
                           const Shape& dst_locale_shape,
                           const int* rank_limits,
-                          DataType* buf,
+                          BufType* buf,
                           const int* displs,
                           dim3 grid_dim,
                           dim3 block_dim,
@@ -191,10 +242,11 @@ void pack_kernel_dispatch(const DataType* src,
     const int num_dims = src_local_shape.num_dims();
 
 #define CALL_KERNEL(ND)                                                 \
-  pack_kernel<ND, DataType, packed><<<                                  \
+  pack_kernel<ND, VW, DataType, packed, BufType><<<                     \
       grid_dim, block_dim, shm_size, stream>>>(                         \
-          src, Array<ND>(src_local_shape), Array<ND>(src_strides),      \
-          Array<ND>(dst_locale_shape), rank_limits, buf, displs)
+          src, FastDivShape<ND>(src_local_shape),                       \
+          Array<ND>(src_strides), Array<ND>(dst_locale_shape),          \
+          rank_limits, buf, displs)
 
   switch (num_dims) {
     case 1:
@@ -222,19 +274,23 @@ void pack_kernel_dispatch(const DataType* src,
 #undef CALL_KERNEL
 }
 
-template <typename DataType, bool packed>
+// Packs the elements as BufType, which is DataType unless packed with
+// a reduced precision. vector_width is either 1 or the one returned by
+// get_vector_width.
+template <typename DataType, bool packed, typename BufType = DataType>
 void pack(const DataType* src,
           const Shape& src_local_shape,
           const IndexVector& src_strides,
           const Shape& dst_locale_shape,
           const int* rank_limits,
-          DataType* buf,
+          BufType* buf,
           const int* displs,
-          gpuStream_t stream)
+          gpuStream_t stream,
+          int vector_width = 1)
 {
     constexpr int block_size = 256;
     dim3 block_dim(block_size);
-    size_t work_size = src_local_shape.get_size();
+    size_t work_size = src_local_shape.get_size() / vector_width;
     dim3 grid_dim((work_size + block_size - 1) / block_size);
 #ifdef PACK_USE_SHMEM
   int shm_size = dst_locale_shape.reduce_sum() * sizeof(int)
@@ -242,19 +298,28 @@ void pack(const DataType* src,
 #else
   int shm_size = 0;
 #endif
-  pack_kernel_dispatch<DataType, packed>(
-      src, src_local_shape, src_strides, dst_locale_shape,
-      rank_limits, buf, displs, grid_dim, block_dim, shm_size, stream);
+  if (vector_width > 1) {
+    pack_kernel_dispatch<max_vector_width<DataType>(), DataType, packed,
+                         BufType>(
+        src, src_local_shape, src_strides, dst_locale_shape,
+        rank_limits, buf, displs, grid_dim, block_dim, shm_size, stream);
+  } else {
+    pack_kernel_dispatch<1, DataType, packed, BufType>(
+        src, src_local_shape, src_strides, dst_locale_shape,
+        rank_limits, buf, displs, grid_dim, block_dim, shm_size, stream);
+  }
 }
 
 #define PACK_USE_SHMEM
-template <int ND, typename DataType, bool packed>
+// Each thread unpacks VW consecutive elements at a time, as
+// pack_kernel.
+template <int ND, int VW, typename DataType, bool packed, typename BufType>
 __global__ void unpack_kernel2(DataType *tensor,
-                               const Array<ND> local_shape,
+                               const FastDivShape<ND> local_shape,
                                const Array<ND> strides,
                                const Array<ND> locale_shape,
                                const int * __restrict__ rank_limits,
-                               const DataType * __restrict__ packed_buf,
+                               const BufType * __restrict__ packed_buf,
                                const int * __restrict__ displs) {
   const size_t size = local_shape.get_size();
   const size_t gid = threadIdx.x + blockIdx.x * blockDim.x;
@@ -280,32 +345,39 @@ __global__ void unpack_kernel2(DataType *tensor,
   __syncthreads();
 #endif
 
-  for (size_t offset = gid; offset < size; offset += num_threads) {
-    size_t src_offset = packed ? offset :
-        get_strided_offset(offset, local_shape, strides);
+  for (size_t offset = gid * VW; offset < size; offset += num_threads * VW) {
     const Array<ND> idx = get_idx(offset, local_shape);
+    size_t src_offset = packed ? offset :
+        get_strided_offset(idx, strides);
     int rank;
     size_t dst_offset;
 #ifdef PACK_USE_SHMEM
     find_destination(idx, local_shape, locale_shape,
                      rank_limits_s, rank, dst_offset);
-    DataType v = packed_buf[displs_s[rank] + dst_offset];
+    const auto w = *reinterpret_cast<const ElementVector<BufType, VW>*>(
+        packed_buf + displs_s[rank] + dst_offset);
 #else
     find_destination(idx, local_shape, locale_shape,
                      rank_limits, rank, dst_offset);
-    DataType v = packed_buf[displs_s[rank] + dst_offset];
+    const auto w = *reinterpret_cast<const ElementVector<BufType, VW>*>(
+        packed_buf + displs[rank] + dst_offset);
 #endif
-    tensor[src_offset] = v;
+    ElementVector<DataType, VW> v;
+#pragma unroll
+    for (int i = 0; i < VW; ++i) {
+      v.v[i] = tensor::WireCast<BufType>::template from_wire<DataType>(w.v[i]);
+    }
+    *reinterpret_cast<ElementVector<DataType, VW>*>(tensor + src_offset) = v;
   }
 }
 
-template <typename DataType, bool packed>
+template <int VW, typename DataType, bool packed, typename BufType>
 void unpack_kernel_dispatch(DataType* tensor,
                             const Shape& local_shape,
                             const IndexVector& strides,
                             const Shape& locale_shape,
                             const int* rank_limits,
-                            const DataType* packed_buf,
+                            const BufType* packed_buf,
                             const int* displs,
                             dim3 grid_dim,
                             dim3 block_dim,
@@ -315,9 +387,9 @@ void unpack_kernel_dispatch(DataType* tensor,
     const int num_dims = local_shape.num_dims();
 
 #define CALL_KERNEL(ND)                                                 \
-  unpack_kernel2<ND, DataType, packed><<<                               \
+  unpack_kernel2<ND, VW, DataType, packed, BufType><<<                  \
       grid_dim, block_dim, shm_size, stream>>>(                         \
-          tensor, Array<ND>(local_shape), Array<ND>(strides),           \
+          tensor, FastDivShape<ND>(local_shape), Array<ND>(strides),    \
           Array<ND>(locale_shape), rank_limits, packed_buf, displs)
 
   switch (num_dims) {
@@ -346,19 +418,20 @@ void unpack_kernel_dispatch(DataType* tensor,
 #undef CALL_KERNEL
 }
 
-template <typename DataType, bool packed>
+template <typename DataType, bool packed, typename BufType = DataType>
 void unpack(DataType* dst,
             const Shape& shape,
             const IndexVector& strides,
             const Shape& locale_shape,
             const int* rank_limits,
-            const DataType* buf,
+            const BufType* buf,
             const int* displs,
-            gpuStream_t stream)
+            gpuStream_t stream,
+            int vector_width = 1)
 {
     constexpr int block_size = 256;
     dim3 block_dim(block_size);
-    size_t work_size = shape.get_size();
+    size_t work_size = shape.get_size() / vector_width;
     dim3 grid_dim((work_size + block_size - 1) / block_size);
 #ifdef PACK_USE_SHMEM
   int shm_size = locale_shape.reduce_sum() * sizeof(int)
@@ -366,34 +439,388 @@ void unpack(DataType* dst,
 #else
   int shm_size = 0;
 #endif
-  unpack_kernel_dispatch<DataType, packed>(
-      dst, shape, strides, locale_shape, rank_limits, buf, displs,
-      grid_dim, block_dim, shm_size, stream);
+  if (vector_width > 1) {
+    unpack_kernel_dispatch<max_vector_width<DataType>(), DataType, packed,
+                           BufType>(
+        dst, shape, strides, locale_shape, rank_limits, buf, displs,
+        grid_dim, block_dim, shm_size, stream);
+  } else {
+    unpack_kernel_dispatch<1, DataType, packed, BufType>(
+        dst, shape, strides, locale_shape, rank_limits, buf, displs,
+        grid_dim, block_dim, shm_size, stream);
+  }
+}
+
+// Range [begin, end) of the j-th rank of a segment of rank limits
+// over a local dimension of size n
+void get_rank_range(const int* limits, int j, index_t n,
+                    long& begin, long& end)
+{
+    if (limits[0] == -1)
+    {
+        // Evenly partitioned; see optimize_find_destination
+        const long dim = limits[2];
+        begin = j * dim - limits[1];
+        end = begin + dim;
+    }
+    else
+    {
+        begin = j == 0 ? 0 : limits[j - 1];
+        end = limits[j];
+    }
+    begin = std::min(std::max(begin, 0L), (long) n);
+    end = std::min(std::max(end, 0L), (long) n);
+}
+
+// Rank limits of a segment over a local dimension restricted to
+// [begin, begin + n)
+void shift_rank_limits(int* limits, int num_ranks, long begin, long n)
+{
+    if (limits[0] == -1)
+    {
+        limits[1] += begin;
+        return;
+    }
+    for (int j = 0; j < num_ranks; ++j)
+    {
+        limits[j] = std::min(std::max(limits[j] - begin, 0L), n);
+    }
 }
 
+// Copies the elements of a box to or from its buffer
+template <typename DataType, bool pack>
+struct BoxCopyFunctor
+{
+    static constexpr tensor::HaloTraversalOpGroup group =
+        tensor::HaloTraversalOpGroup::THREAD;
+    static constexpr bool modifies_tensor = !pack;
+
+    DataType* m_buf;
+    __host__ __device__ BoxCopyFunctor(DataType* buf) : m_buf(buf) {}
+    template <typename T>
+    __device__ void operator()(T& x, size_t offset)
+    {
+        if constexpr (pack)
+            m_buf[offset] = x;
+        else
+            x = m_buf[offset];
+    }
+};
+
+// Packs or unpacks boxes of a real local tensor with the given
+// strides, each to buf at its displacement
+template <bool pack, typename TensorDataType, typename DataType>
+void copy_boxes(TensorDataType* tensor,
+                const IndexVector& strides,
+                const std::vector<IndexVector>& offsets,
+                const std::vector<Shape>& shapes,
+                DataType* buf,
+                const std::vector<size_t>& displs,
+                gpuStream_t stream)
+{
+    if (offsets.empty())
+    {
+        return;
+    }
+    const int num_dims = strides.length();
+    // Only the strides matter for the last dimension
+    Shape pitched_shape(num_dims, 1);
+    for (int i = 0; i < num_dims - 1; ++i)
+    {
+        pitched_shape[i] = strides[i + 1] / strides[i];
+    }
+    std::vector<DataType*> bufs;
+    for (const auto d : displs)
+    {
+        bufs.push_back(buf + d);
+    }
+    using Functor = BoxCopyFunctor<DataType, pack>;
+#define CALL_TRAVERSE(ND)                                                          tensor::internal::traverse_regions<ND, TensorDataType, DataType, Functor>(         tensor, pitched_shape, offsets, shapes, bufs, stream)
+    switch (num_dims)
+    {
+    case 1: CALL_TRAVERSE(1); break;
+    case 2: CALL_TRAVERSE(2); break;
+    case 3: CALL_TRAVERSE(3); break;
+    case 4: CALL_TRAVERSE(4); break;
+    case 5: CALL_TRAVERSE(5); break;
+    case 6: CALL_TRAVERSE(6); break;
+    default: throw std::exception();
+    }
+#undef CALL_TRAVERSE
+}
+
+// Start of the real local tensor of which ptr is the interior
+template <typename DataType>
+DataType* get_real_ptr(DataType* ptr,
+                       const IntVector& overlap,
+                       const IndexVector& strides)
+{
+    size_t offset = 0;
+    for (int i = 0; i < overlap.length(); ++i)
+    {
+        offset += overlap[i] * strides[i];
+    }
+    return ptr - offset;
+}
+
+#ifdef DISTCONV_HAS_NVSHMEM
+#define DEFINE_REMOTE_STORE(TYPE)                                       \
+  __device__ __forceinline__ void remote_store(TYPE *dst, TYPE v,       \
+                                               int pe) {                \
+    nvshmem_##TYPE##_p(dst, v, pe);                                     \
+  }
+DEFINE_REMOTE_STORE(float)
+DEFINE_REMOTE_STORE(double)
+DEFINE_REMOTE_STORE(int)
+DEFINE_REMOTE_STORE(long)
+#undef DEFINE_REMOTE_STORE
+
+// Packs as pack_kernel, but stores each element at its destination
+// PE, directly when its receive buffer is mapped in peer_ptrs.
+template <int ND, typename DataType, bool packed>
+__global__ void pack_remote_kernel(const DataType *src,
+                                   const FastDivShape<ND> src_local_shape,
+                                   const Array<ND> src_strides,
+                                   const Array<ND> dst_locale_shape,
+                                   const int * __restrict__ rank_limits,
+                                   DataType * const * __restrict__ peer_ptrs,
+                                   DataType *recv_buf,
+                                   const int * __restrict__ put_displs) {
+  const size_t size = src_local_shape.get_size();
+  const size_t gid = threadIdx.x + blockIdx.x * blockDim.x;
+  const size_t num_threads = blockDim.x * gridDim.x;
+
+  extern __shared__ int shm[];
+  int rank_limits_size = 0;
+  int displs_size = 1;
+#pragma unroll
+  for (int i = 0; i < ND; ++i) {
+    rank_limits_size += dst_locale_shape[i];
+    displs_size *= dst_locale_shape[i];
+  }
+  int *rank_limits_s = shm;
+  int *displs_s = &(shm[rank_limits_size]);
+  for (int i = threadIdx.x; i < rank_limits_size; i += blockDim.x) {
+    rank_limits_s[i] = rank_limits[i];
+  }
+  for (int i = threadIdx.x; i < displs_size; i += blockDim.x) {
+    displs_s[i] = put_displs[i];
+  }
+  __syncthreads();
+
+  for (size_t offset = gid; offset < size; offset += num_threads) {
+    const Array<ND> idx = get_idx(offset, src_local_shape);
+    size_t src_offset = packed ? offset :
+        get_strided_offset(idx, src_strides);
+    int rank;
+    size_t dst_offset;
+    find_destination(idx, src_local_shape, dst_locale_shape,
+                     rank_limits_s, rank, dst_offset);
+    const size_t buf_offset = displs_s[rank] + dst_offset;
+    DataType *peer = peer_ptrs[rank];
+    if (peer != nullptr) {
+      peer[buf_offset] = src[src_offset];
+    } else {
+      remote_store(recv_buf + buf_offset, src[src_offset], rank);
+    }
+  }
+}
+
+template <typename DataType, bool packed>
+void pack_remote(const DataType* src,
+                 const Shape& src_local_shape,
+                 const IndexVector& src_strides,
+                 const Shape& dst_locale_shape,
+                 const int* rank_limits,
+                 DataType* const* peer_ptrs,
+                 DataType* recv_buf,
+                 const int* put_displs,
+                 gpuStream_t stream)
+{
+  constexpr int block_size = 256;
+  dim3 block_dim(block_size);
+  dim3 grid_dim((src_local_shape.get_size() + block_size - 1) / block_size);
+  int shm_size = dst_locale_shape.reduce_sum() * sizeof(int)
+      + dst_locale_shape.reduce_prod() * sizeof(int);
+
+#define CALL_KERNEL(ND)                                                 \
+  pack_remote_kernel<ND, DataType, packed><<<                           \
+      grid_dim, block_dim, shm_size, stream>>>(                         \
+          src, FastDivShape<ND>(src_local_shape),                       \
+          Array<ND>(src_strides), Array<ND>(dst_locale_shape),          \
+          rank_limits, peer_ptrs, recv_buf, put_displs)
+
+  switch (src_local_shape.num_dims()) {
+    case 1:
+      CALL_KERNEL(1);
+      break;
+    case 2:
+      CALL_KERNEL(2);
+      break;
+    case 3:
+      CALL_KERNEL(3);
+      break;
+    case 4:
+      CALL_KERNEL(4);
+      break;
+    case 5:
+      CALL_KERNEL(5);
+      break;
+    case 6:
+      CALL_KERNEL(6);
+      break;
+    default:
+      util::MPIPrintStreamError() << "Unsupported dimension";
+      throw std::exception();
+  }
+#undef CALL_KERNEL
+}
+
+// Notifies the peers at the counter of this PE, and waits for the
+// notifications at the counters of the waited peers.
+__global__ void signal_kernel(util::nvshmem::SyncArrayDevice sync,
+                              const int * __restrict__ notify_peers,
+                              int num_notify_peers,
+                              const int * __restrict__ wait_peers,
+                              int num_wait_peers,
+                              int pid,
+                              int idx_base) {
+  if (num_notify_peers > 0) {
+    const int idx = idx_base + pid;
+    for (int i = 0; i < num_notify_peers; ++i) {
+      sync.notify(notify_peers[i], util::nvshmem::SyncType::NONE, idx);
+    }
+    sync.inc_counter(idx);
+  }
+  for (int i = 0; i < num_wait_peers; ++i) {
+    const int idx = idx_base + wait_peers[i];
+    sync.wait(idx);
+    sync.inc_counter(idx);
+  }
+}
+#endif // DISTCONV_HAS_NVSHMEM
+
 } // namespace
 
 namespace tensor {
 
+template <typename DataType>
+void TensorMPICUDAShuffler<DataType>::shuffle_halo(const DataType* src,
+                                                   DataType* dst,
+                                                   gpuStream_t stream)
+{
+    auto& pool = distconv::internal::RuntimeGPU::get_device_memory_pool();
+    const auto& plan = m_halo_plan;
+    const int num_ranks = m_loc.get_size();
+    const size_t send_count =
+        plan.send_displs[num_ranks - 1] + plan.send_counts[num_ranks - 1];
+    const size_t recv_count =
+        plan.recv_displs[num_ranks - 1] + plan.recv_counts[num_ranks - 1];
+    DataType* send_buf =
+        send_count == 0 ? nullptr
+                        : static_cast<DataType*>(
+                            pool.get(send_count * sizeof(DataType), stream));
+    DataType* recv_buf =
+        recv_count == 0 ? nullptr
+                        : static_cast<DataType*>(
+                            pool.get(recv_count * sizeof(DataType), stream));
+    {
+        util::instrumentation::ScopedTimer timer(
+            util::instrumentation::Phase::SHUFFLE_PACK, stream);
+        copy_boxes<true>(get_real_ptr(src, m_src_overlap, m_src_strides),
+                         m_src_strides,
+                         plan.send_offsets,
+                         plan.send_shapes,
+                         send_buf,
+                         plan.send_box_displs,
+                         stream);
+    }
+    {
+        util::instrumentation::ScopedTimer timer(
+            util::instrumentation::Phase::SHUFFLE_TRANSFER, stream);
+        alltoallv(send_buf,
+                  send_count * sizeof(DataType),
+                  plan.send_counts.data(),
+                  plan.send_displs.data(),
+                  recv_buf,
+                  recv_count * sizeof(DataType),
+                  plan.recv_counts.data(),
+                  plan.recv_displs.data(),
+                  stream);
+    }
+    {
+        util::instrumentation::ScopedTimer timer(
+            util::instrumentation::Phase::SHUFFLE_UNPACK, stream);
+        copy_boxes<false>(get_real_ptr(dst, m_dst_overlap, m_dst_strides),
+                          m_dst_strides,
+                          plan.recv_offsets,
+                          plan.recv_shapes,
+                          recv_buf,
+                          plan.recv_box_displs,
+                          stream);
+    }
+    if (send_buf != nullptr)
+    {
+        pool.release(send_buf);
+    }
+    if (recv_buf != nullptr)
+    {
+        pool.release(recv_buf);
+    }
+}
+
 template <typename DataType>
 void TensorMPICUDAShuffler<DataType>::shuffle(const DataType* src,
                                               DataType* dst,
                                               gpuStream_t stream,
                                               bool is_forward)
 {
+    DISTCONV_RANGE(is_forward ? "shuffle_forward" : "shuffle_backward",
+                   Shuffle);
     // Poiners can be null if they are empty, which can happen in MPI
     // local tensors
     // assert_always(src != nullptr);
     // assert_always(dst != nullptr);
 
-    const int* rank_limits_fwd = get_rank_limits_fwd(is_forward);
-    const int* rank_limits_bwd = get_rank_limits_bwd(is_forward);
+    if (is_forward && m_fill_dst_halo && !m_halo_plan.send_counts.empty())
+    {
+        shuffle_halo(src, dst, stream);
+        return;
+    }
+
+    if (m_comm_precision != CommPrecision::FULL)
+    {
+        dispatch_wire_type<DataType>(m_comm_precision, [&](auto* wire_ptr) {
+            using WireType = std::remove_pointer_t<decltype(wire_ptr)>;
+            shuffle_wire<WireType>(src, dst, stream, is_forward);
+        });
+        return;
+    }
+
+    if (m_sample_slabs && is_transfer_buffer_independent())
+    {
+        // The tensors are used as the send and recv buffers.
+        util::instrumentation::ScopedTimer timer(
+            util::instrumentation::Phase::SHUFFLE_TRANSFER, stream);
+        transfer(src,
+                 get_src_local_shape(is_forward).get_size() * sizeof(DataType),
+                 dst,
+                 get_dst_local_shape(is_forward).get_size() * sizeof(DataType),
+                 is_forward,
+                 stream);
+        return;
+    }
+
+    if (m_chunk_size > 0 && is_transfer_buffer_independent())
+    {
+        shuffle_chunked(src, dst, stream, is_forward);
+        return;
+    }
+
     const int* send_counts = get_send_counts(is_forward);
     const int* recv_counts = get_recv_counts(is_forward);
     const int* send_displs_h = get_send_displs_h(is_forward);
     const int* recv_displs_h = get_recv_displs_h(is_forward);
-    const int* send_displs_d = get_send_displs_d(is_forward);
-    const int* recv_displs_d = get_recv_displs_d(is_forward);
 
     const int num_ranks = get_src_locale_shape(is_forward).get_size();
     const size_t send_buffer_size =
@@ -403,31 +830,7 @@ void TensorMPICUDAShuffler<DataType>::shuffle(const DataType* src,
         get_dst_local_shape(is_forward).get_size() * sizeof(DataType);
     DataType* recv_buf = get_dst_buf(is_forward, stream);
 
-    if (send_buffer_size && is_src_split_root(is_forward))
-    {
-        if (get_src_overlap(is_forward).reduce_sum() == 0)
-        {
-            pack<DataType, true>(src,
-                                 get_src_local_shape(is_forward),
-                                 get_src_strides(is_forward),
-                                 get_dst_locale_shape(is_forward),
-                                 rank_limits_fwd,
-                                 send_buf,
-                                 send_displs_d,
-                                 stream);
-        }
-        else
-        {
-            pack<DataType, false>(src,
-                                  get_src_local_shape(is_forward),
-                                  get_src_strides(is_forward),
-                                  get_dst_locale_shape(is_forward),
-                                  rank_limits_fwd,
-                                  send_buf,
-                                  send_displs_d,
-                                  stream);
-        }
-    }
+    pack_tensor(src, send_buf, stream, is_forward);
 
 #if 0
   {
@@ -451,28 +854,627 @@ void TensorMPICUDAShuffler<DataType>::shuffle(const DataType* src,
   }
 #endif
 
-  transfer(send_buf, send_buffer_size, recv_buf, recv_buffer_size,
-           is_forward, stream);
+  {
+    util::instrumentation::ScopedTimer timer(
+        util::instrumentation::Phase::SHUFFLE_TRANSFER, stream);
+    transfer(send_buf, send_buffer_size, recv_buf, recv_buffer_size,
+             is_forward, stream);
+  }
+
+  unpack_tensor(recv_buf, dst, stream, is_forward);
+
+  release_buf(send_buf);
+  release_buf(recv_buf);
+}
+
+template <typename DataType>
+void TensorMPICUDAShuffler<DataType>::pack_tensor(const DataType* src,
+                                                  DataType* send_buf,
+                                                  gpuStream_t stream,
+                                                  bool is_forward)
+{
+    util::instrumentation::ScopedTimer timer(
+        util::instrumentation::Phase::SHUFFLE_PACK, stream);
+    const size_t send_buffer_size =
+        get_src_local_shape(is_forward).get_size() * sizeof(DataType);
+    const int* rank_limits_fwd = get_rank_limits_fwd(is_forward);
+    const int* send_displs_d = get_send_displs_d(is_forward);
+
+    if (send_buffer_size && is_src_split_root(is_forward))
+    {
+        const bool src_packed = get_src_overlap(is_forward).reduce_sum() == 0;
+        const int vector_width =
+            get_vector_width(src,
+                             send_buf,
+                             get_src_local_shape(is_forward),
+                             get_src_strides(is_forward),
+                             src_packed,
+                             get_dst_locale_shape(is_forward),
+                             get_rank_limits_fwd_h(is_forward),
+                             get_send_displs_h(is_forward));
+        if (src_packed)
+        {
+            pack<DataType, true>(src,
+                                 get_src_local_shape(is_forward),
+                                 get_src_strides(is_forward),
+                                 get_dst_locale_shape(is_forward),
+                                 rank_limits_fwd,
+                                 send_buf,
+                                 send_displs_d,
+                                 stream,
+                                 vector_width);
+        }
+        else
+        {
+            pack<DataType, false>(src,
+                                  get_src_local_shape(is_forward),
+                                  get_src_strides(is_forward),
+                                  get_dst_locale_shape(is_forward),
+                                  rank_limits_fwd,
+                                  send_buf,
+                                  send_displs_d,
+                                  stream,
+                                  vector_width);
+        }
+    }
+}
+
+template <typename DataType>
+void TensorMPICUDAShuffler<DataType>::unpack_tensor(const DataType* recv_buf,
+                                                    DataType* dst,
+                                                    gpuStream_t stream,
+                                                    bool is_forward)
+{
+    util::instrumentation::ScopedTimer timer(
+        util::instrumentation::Phase::SHUFFLE_UNPACK, stream);
+    const size_t recv_buffer_size =
+        get_dst_local_shape(is_forward).get_size() * sizeof(DataType);
+    const int* rank_limits_bwd = get_rank_limits_bwd(is_forward);
+    const int* recv_displs_d = get_recv_displs_d(is_forward);
 
-  // unpack
   if (recv_buffer_size && is_dst_split_root(is_forward)) {
-    if (get_dst_overlap(is_forward).reduce_sum() == 0) {
+    const bool dst_packed = get_dst_overlap(is_forward).reduce_sum() == 0;
+    const int vector_width = get_vector_width(
+        dst, recv_buf, get_dst_local_shape(is_forward),
+        get_dst_strides(is_forward), dst_packed,
+        get_src_locale_shape(is_forward),
+        get_rank_limits_bwd_h(is_forward), get_recv_displs_h(is_forward));
+    if (dst_packed) {
       unpack<DataType, true>(
           dst, get_dst_local_shape(is_forward),
           get_dst_strides(is_forward),
           get_src_locale_shape(is_forward),
-          rank_limits_bwd, recv_buf, recv_displs_d, stream);
+          rank_limits_bwd, recv_buf, recv_displs_d, stream, vector_width);
     } else {
       unpack<DataType, false>(
           dst, get_dst_local_shape(is_forward),
           get_dst_strides(is_forward),
           get_src_locale_shape(is_forward),
-          rank_limits_bwd, recv_buf, recv_displs_d, stream);
+          rank_limits_bwd, recv_buf, recv_displs_d, stream, vector_width);
     }
   }
+}
 
-  release_buf(send_buf);
-  release_buf(recv_buf);
+template <typename DataType>
+template <typename WireType>
+void TensorMPICUDAShuffler<DataType>::shuffle_wire(const DataType* src,
+                                                   DataType* dst,
+                                                   gpuStream_t stream,
+                                                   bool is_forward)
+{
+    auto& pool = distconv::internal::RuntimeGPU::get_device_memory_pool();
+    const size_t send_size = get_src_local_shape(is_forward).get_size();
+    const size_t recv_size = get_dst_local_shape(is_forward).get_size();
+    WireType* send_buf =
+        send_size == 0 ? nullptr
+                       : static_cast<WireType*>(
+                           pool.get(send_size * sizeof(WireType), stream));
+    WireType* recv_buf =
+        recv_size == 0 ? nullptr
+                       : static_cast<WireType*>(
+                           pool.get(recv_size * sizeof(WireType), stream));
+
+    if (send_size > 0 && is_src_split_root(is_forward))
+    {
+        util::instrumentation::ScopedTimer timer(
+            util::instrumentation::Phase::SHUFFLE_PACK, stream);
+        const bool src_packed = get_src_overlap(is_forward).reduce_sum() == 0;
+        auto pack_wire = src_packed ? pack<DataType, true, WireType>
+                                    : pack<DataType, false, WireType>;
+        pack_wire(src,
+                  get_src_local_shape(is_forward),
+                  get_src_strides(is_forward),
+                  get_dst_locale_shape(is_forward),
+                  get_rank_limits_fwd(is_forward),
+                  send_buf,
+                  get_send_displs_d(is_forward),
+                  stream,
+                  get_vector_width(src,
+                                   send_buf,
+                                   get_src_local_shape(is_forward),
+                                   get_src_strides(is_forward),
+                                   src_packed,
+                                   get_dst_locale_shape(is_forward),
+                                   get_rank_limits_fwd_h(is_forward),
+                                   get_send_displs_h(is_forward)));
+    }
+
+    {
+        util::instrumentation::ScopedTimer timer(
+            util::instrumentation::Phase::SHUFFLE_TRANSFER, stream);
+        transfer_wire(send_buf, recv_buf, sizeof(WireType), is_forward, stream);
+    }
+
+    if (recv_size > 0 && is_dst_split_root(is_forward))
+    {
+        util::instrumentation::ScopedTimer timer(
+            util::instrumentation::Phase::SHUFFLE_UNPACK, stream);
+        const bool dst_packed = get_dst_overlap(is_forward).reduce_sum() == 0;
+        auto unpack_wire = dst_packed ? unpack<DataType, true, WireType>
+                                      : unpack<DataType, false, WireType>;
+        unpack_wire(dst,
+                    get_dst_local_shape(is_forward),
+                    get_dst_strides(is_forward),
+                    get_src_locale_shape(is_forward),
+                    get_rank_limits_bwd(is_forward),
+                    recv_buf,
+                    get_recv_displs_d(is_forward),
+                    stream,
+                    get_vector_width(dst,
+                                     recv_buf,
+                                     get_dst_local_shape(is_forward),
+                                     get_dst_strides(is_forward),
+                                     dst_packed,
+                                     get_src_locale_shape(is_forward),
+                                     get_rank_limits_bwd_h(is_forward),
+                                     get_recv_displs_h(is_forward)));
+    }
+
+    if (send_buf)
+    {
+        pool.release(send_buf);
+    }
+    if (recv_buf)
+    {
+        pool.release(recv_buf);
+    }
+}
+
+template <typename DataType>
+typename TensorMPICUDAShuffler<DataType>::Request
+TensorMPICUDAShuffler<DataType>::shuffle_async(const DataType* src,
+                                               DataType* dst,
+                                               gpuStream_t stream,
+                                               bool is_forward)
+{
+    if (is_transfer_stream_ordered()
+        || m_comm_precision != CommPrecision::FULL
+        || (is_forward && m_fill_dst_halo))
+    {
+        // Nothing is left to the host once enqueued, or the shuffle is
+        // not asynchronous.
+        shuffle(src, dst, stream, is_forward);
+        return Request();
+    }
+
+    // Buffers of the previous shuffle are not reused until completed.
+    auto& a = m_async[is_forward ? 0 : 1];
+    if (a.pending)
+    {
+        progress(is_forward, true);
+    }
+
+    a.send_size = get_src_local_shape(is_forward).get_size() * sizeof(DataType);
+    a.recv_size = get_dst_local_shape(is_forward).get_size() * sizeof(DataType);
+    a.dst = dst;
+    a.stream = stream;
+    a.sample_slabs = m_sample_slabs;
+    if (a.sample_slabs)
+    {
+        // The tensors are used as the send and recv buffers.
+        a.send_buf = src;
+        a.recv_buf = dst;
+    }
+    else
+    {
+        DataType* send_buf = get_src_buf(is_forward, stream);
+        pack_tensor(src, send_buf, stream, is_forward);
+        a.send_buf = send_buf;
+        a.recv_buf = get_dst_buf(is_forward, stream);
+    }
+    if (a.packed == nullptr)
+    {
+        a.packed = h2::gpu::make_event_notiming();
+    }
+    DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(a.packed, stream));
+    a.pending = true;
+    a.transferring = false;
+    return Request(this, is_forward);
+}
+
+template <typename DataType>
+bool TensorMPICUDAShuffler<DataType>::progress(bool is_forward, bool blocking)
+{
+    auto& a = m_async[is_forward ? 0 : 1];
+    if (!a.pending)
+    {
+        return true;
+    }
+
+    if (!a.transferring)
+    {
+        if (blocking)
+        {
+            h2::gpu::sync(a.packed);
+        }
+        else
+        {
+            const auto status = GPU_EVENT_QUERY(a.packed);
+            if (status == GPU_ERROR_NOT_READY)
+            {
+                return false;
+            }
+            DISTCONV_CHECK_GPU(status);
+        }
+        const void* send_buf = a.send_buf;
+        void* recv_buf = a.recv_buf;
+#ifndef DISTCONV_SHFL_USE_CUDA_AWARE
+        auto& pinned_pool = tensor::internal::RuntimeGPU::get_pinned_memory_pool();
+        a.send_buf_h = a.send_size == 0 ? nullptr
+                                        : static_cast<DataType*>(
+                                            pinned_pool.get(a.send_size));
+        a.recv_buf_h = a.recv_size == 0 ? nullptr
+                                        : static_cast<DataType*>(
+                                            pinned_pool.get(a.recv_size));
+        if (a.send_size > 0)
+        {
+            h2::gpu::mem_copy(
+                (void*) a.send_buf_h, (void*) a.send_buf, a.send_size);
+        }
+        send_buf = a.send_buf_h;
+        recv_buf = a.recv_buf_h;
+#endif
+        DISTCONV_CHECK_MPI(
+            MPI_Ialltoallv(send_buf,
+                           get_send_counts(is_forward),
+                           get_send_displs_h(is_forward),
+                           util::get_mpi_data_type<DataType>(),
+                           recv_buf,
+                           get_recv_counts(is_forward),
+                           get_recv_displs_h(is_forward),
+                           util::get_mpi_data_type<DataType>(),
+                           m_loc.get_comm(),
+                           &a.request));
+        a.transferring = true;
+    }
+
+    if (blocking)
+    {
+        DISTCONV_CHECK_MPI(MPI_Wait(&a.request, MPI_STATUS_IGNORE));
+    }
+    else
+    {
+        int flag = 0;
+        DISTCONV_CHECK_MPI(MPI_Test(&a.request, &flag, MPI_STATUS_IGNORE));
+        if (!flag)
+        {
+            return false;
+        }
+    }
+    util::MPIPrintStreamDebug() << "Transfer done\n";
+
+#ifndef DISTCONV_SHFL_USE_CUDA_AWARE
+    auto& pinned_pool = tensor::internal::RuntimeGPU::get_pinned_memory_pool();
+    if (a.recv_size > 0)
+    {
+        h2::gpu::mem_copy(
+            (void*) a.recv_buf, (void*) a.recv_buf_h, a.recv_size);
+    }
+    if (a.send_buf_h != nullptr)
+    {
+        pinned_pool.release(a.send_buf_h);
+    }
+    if (a.recv_buf_h != nullptr)
+    {
+        pinned_pool.release(a.recv_buf_h);
+    }
+#endif
+
+    if (!a.sample_slabs)
+    {
+        unpack_tensor(a.recv_buf, a.dst, a.stream, is_forward);
+        release_buf(const_cast<DataType*>(a.send_buf));
+        release_buf(a.recv_buf);
+    }
+    a.pending = false;
+    return true;
+}
+
+template <typename DataType>
+typename TensorMPICUDAShuffler<DataType>::Pipeline&
+TensorMPICUDAShuffler<DataType>::get_pipeline(bool is_forward)
+{
+    Pipeline& pl = m_pipelines[is_forward ? 0 : 1];
+    if (pl.chunk_size == m_chunk_size)
+    {
+        return pl;
+    }
+    if (pl.chunk_arrays_d)
+    {
+        DISTCONV_CHECK_GPU(GPU_FREE(pl.chunk_arrays_d));
+    }
+    pl = Pipeline();
+    pl.chunk_size = m_chunk_size;
+
+    const int num_ranks = m_loc.get_size();
+    const Shape& src_locale_shape = get_src_locale_shape(is_forward);
+    const Shape& dst_locale_shape = get_dst_locale_shape(is_forward);
+    const index_t src_num_samples = get_src_local_shape(is_forward)[-1];
+    const index_t dst_num_samples = get_dst_local_shape(is_forward)[-1];
+    const long src_offset =
+        is_forward ? m_src_sample_offset : m_dst_sample_offset;
+    const long dst_offset =
+        is_forward ? m_dst_sample_offset : m_src_sample_offset;
+    const auto& limits_fwd =
+        is_forward ? m_plan->m_rank_limits_fwd_h : m_plan->m_rank_limits_bwd_h;
+    const auto& limits_bwd =
+        is_forward ? m_plan->m_rank_limits_bwd_h : m_plan->m_rank_limits_fwd_h;
+    // The sample dimension is the last segment of the rank limits.
+    const int fwd_sample_seg = limits_fwd.size() - dst_locale_shape[-1];
+    const int bwd_sample_seg = limits_bwd.size() - src_locale_shape[-1];
+    const size_t arrays_size =
+        limits_fwd.size() + limits_bwd.size() + num_ranks * 2;
+
+    // Chunks are ranges of global samples, so all processes have the
+    // same number of chunks.
+    const index_t num_chunks = util::ceil(m_num_samples, m_chunk_size);
+    std::vector<int> arrays_h;
+    for (index_t k = 0; k < num_chunks; ++k)
+    {
+        const long begin = k * m_chunk_size;
+        const long end = std::min(begin + (long) m_chunk_size,
+                                  (long) m_num_samples);
+        Chunk c;
+        c.src_begin =
+            std::min(std::max(begin - src_offset, 0L), (long) src_num_samples);
+        c.src_end =
+            std::min(std::max(end - src_offset, 0L), (long) src_num_samples);
+        c.dst_begin =
+            std::min(std::max(begin - dst_offset, 0L), (long) dst_num_samples);
+        c.dst_end =
+            std::min(std::max(end - dst_offset, 0L), (long) dst_num_samples);
+        c.send_counts.resize(num_ranks);
+        c.send_displs.resize(num_ranks);
+        c.recv_counts.resize(num_ranks);
+        c.recv_displs.resize(num_ranks);
+        c.send_size = 0;
+        c.recv_size = 0;
+        for (int pid = 0; pid < num_ranks; ++pid)
+        {
+            // The sample dimension is the outermost one of the data
+            // exchanged with each peer, so the chunk is a contiguous
+            // part of it.
+            long lo, hi;
+            int count = get_send_counts(is_forward)[pid];
+            if (count > 0)
+            {
+                get_rank_range(&limits_fwd[fwd_sample_seg],
+                               dst_locale_shape.get_index(pid)[-1],
+                               src_num_samples, lo, hi);
+                count = count / (hi - lo)
+                        * std::max(std::min(hi, (long) c.src_end)
+                                       - std::max(lo, (long) c.src_begin),
+                                   0L);
+            }
+            c.send_counts[pid] = count;
+            c.send_displs[pid] = c.send_size;
+            c.send_size += count;
+            count = get_recv_counts(is_forward)[pid];
+            if (count > 0)
+            {
+                get_rank_range(&limits_bwd[bwd_sample_seg],
+                               src_locale_shape.get_index(pid)[-1],
+                               dst_num_samples, lo, hi);
+                count = count / (hi - lo)
+                        * std::max(std::min(hi, (long) c.dst_end)
+                                       - std::max(lo, (long) c.dst_begin),
+                                   0L);
+            }
+            c.recv_counts[pid] = count;
+            c.recv_displs[pid] = c.recv_size;
+            c.recv_size += count;
+        }
+        pl.max_send_size = std::max(pl.max_send_size, c.send_size);
+        pl.max_recv_size = std::max(pl.max_recv_size, c.recv_size);
+
+        c.arrays_offset = arrays_h.size();
+        arrays_h.insert(arrays_h.end(), limits_fwd.begin(), limits_fwd.end());
+        shift_rank_limits(&arrays_h[c.arrays_offset + fwd_sample_seg],
+                          dst_locale_shape[-1],
+                          c.src_begin,
+                          c.src_end - c.src_begin);
+        const size_t bwd_offset = arrays_h.size();
+        arrays_h.insert(arrays_h.end(), limits_bwd.begin(), limits_bwd.end());
+        shift_rank_limits(&arrays_h[bwd_offset + bwd_sample_seg],
+                          src_locale_shape[-1],
+                          c.dst_begin,
+                          c.dst_end - c.dst_begin);
+        arrays_h.insert(
+            arrays_h.end(), c.send_displs.begin(), c.send_displs.end());
+        arrays_h.insert(
+            arrays_h.end(), c.recv_displs.begin(), c.recv_displs.end());
+        pl.chunks.push_back(std::move(c));
+    }
+    assert_eq(arrays_h.size(), arrays_size * num_chunks);
+    DISTCONV_GPU_MALLOC(&pl.chunk_arrays_d, sizeof(int) * arrays_h.size());
+    h2::gpu::mem_copy(pl.chunk_arrays_d, arrays_h.data(), arrays_h.size());
+
+    if (m_pack_stream == nullptr)
+    {
+        m_pack_stream = h2::gpu::make_stream_nonblocking();
+        m_unpack_stream = h2::gpu::make_stream_nonblocking();
+        for (int i = 0; i < 2; ++i)
+        {
+            m_packed[i] = h2::gpu::make_event_notiming();
+            m_transferred[i] = h2::gpu::make_event_notiming();
+            m_unpacked[i] = h2::gpu::make_event_notiming();
+        }
+    }
+    util::MPIPrintStreamDebug()
+        << "Shuffle pipelined with " << num_chunks << " chunks of "
+        << m_chunk_size << " samples, staging buffers: "
+        << pl.max_send_size << " and " << pl.max_recv_size << " elements";
+    return pl;
+}
+
+// Chunk i+1 is packed on m_pack_stream and chunk i-1 is unpacked on
+// m_unpack_stream while chunk i is transferred on stream. Each
+// direction uses two send and two recv staging buffers.
+template <typename DataType>
+void TensorMPICUDAShuffler<DataType>::shuffle_chunked(const DataType* src,
+                                                      DataType* dst,
+                                                      gpuStream_t stream,
+                                                      bool is_forward)
+{
+    Pipeline& pl = get_pipeline(is_forward);
+    const int num_ranks = m_loc.get_size();
+    const auto& limits_fwd =
+        is_forward ? m_plan->m_rank_limits_fwd_h : m_plan->m_rank_limits_bwd_h;
+    const auto& limits_bwd =
+        is_forward ? m_plan->m_rank_limits_bwd_h : m_plan->m_rank_limits_fwd_h;
+    const bool pack_required = is_src_split_root(is_forward);
+    const bool unpack_required = is_dst_split_root(is_forward);
+    const IndexVector& src_strides = get_src_strides(is_forward);
+    const IndexVector& dst_strides = get_dst_strides(is_forward);
+    const bool src_packed = get_src_overlap(is_forward).reduce_sum() == 0;
+    const bool dst_packed = get_dst_overlap(is_forward).reduce_sum() == 0;
+
+    auto& pool = distconv::internal::RuntimeGPU::get_device_memory_pool();
+    DataType* send_bufs[2] = {nullptr, nullptr};
+    DataType* recv_bufs[2] = {nullptr, nullptr};
+    for (int i = 0; i < 2; ++i)
+    {
+        if (pl.max_send_size > 0)
+        {
+            send_bufs[i] = static_cast<DataType*>(
+                pool.get(pl.max_send_size * sizeof(DataType), stream));
+        }
+        if (pl.max_recv_size > 0)
+        {
+            recv_bufs[i] = static_cast<DataType*>(
+                pool.get(pl.max_recv_size * sizeof(DataType), stream));
+        }
+    }
+
+    auto pack_chunk = [&](const Chunk& c, int b) {
+        const int* arrays = pl.chunk_arrays_d + c.arrays_offset;
+        if (pack_required && c.send_size > 0)
+        {
+            auto shape = get_src_local_shape(is_forward);
+            shape[-1] = c.src_end - c.src_begin;
+            const DataType* chunk_src = src + c.src_begin * src_strides[-1];
+            const int* send_displs_d =
+                arrays + limits_fwd.size() + limits_bwd.size();
+            if (src_packed)
+            {
+                pack<DataType, true>(chunk_src, shape, src_strides,
+                                     get_dst_locale_shape(is_forward),
+                                     arrays, send_bufs[b], send_displs_d,
+                                     m_pack_stream);
+            }
+            else
+            {
+                pack<DataType, false>(chunk_src, shape, src_strides,
+                                      get_dst_locale_shape(is_forward),
+                                      arrays, send_bufs[b], send_displs_d,
+                                      m_pack_stream);
+            }
+        }
+        DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(m_packed[b], m_pack_stream));
+    };
+
+    auto unpack_chunk = [&](const Chunk& c, int b) {
+        const int* arrays = pl.chunk_arrays_d + c.arrays_offset;
+        if (unpack_required && c.recv_size > 0)
+        {
+            auto shape = get_dst_local_shape(is_forward);
+            shape[-1] = c.dst_end - c.dst_begin;
+            DataType* chunk_dst = dst + c.dst_begin * dst_strides[-1];
+            const int* rank_limits_bwd = arrays + limits_fwd.size();
+            const int* recv_displs_d =
+                arrays + limits_fwd.size() + limits_bwd.size() + num_ranks;
+            if (dst_packed)
+            {
+                unpack<DataType, true>(chunk_dst, shape, dst_strides,
+                                       get_src_locale_shape(is_forward),
+                                       rank_limits_bwd, recv_bufs[b],
+                                       recv_displs_d, m_unpack_stream);
+            }
+            else
+            {
+                unpack<DataType, false>(chunk_dst, shape, dst_strides,
+                                        get_src_locale_shape(is_forward),
+                                        rank_limits_bwd, recv_bufs[b],
+                                        recv_displs_d, m_unpack_stream);
+            }
+        }
+        DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(m_unpacked[b], m_unpack_stream));
+    };
+
+    // src is ready and dst is no longer used once the work queued on
+    // stream is done.
+    util::wait_stream(stream, m_pack_stream);
+    util::wait_stream(stream, m_unpack_stream);
+    const int num_chunks = pl.chunks.size();
+    if (num_chunks > 0)
+    {
+        pack_chunk(pl.chunks[0], 0);
+    }
+    for (int i = 0; i < num_chunks; ++i)
+    {
+        const int b = i % 2;
+        if (i + 1 < num_chunks)
+        {
+            // The staging buffer was used by the transfer of chunk i-1.
+            if (i >= 1)
+            {
+                DISTCONV_CHECK_GPU(GPU_STREAM_WAIT_EVENT(
+                    m_pack_stream, m_transferred[1 - b], 0));
+            }
+            pack_chunk(pl.chunks[i + 1], 1 - b);
+        }
+        DISTCONV_CHECK_GPU(GPU_STREAM_WAIT_EVENT(stream, m_packed[b], 0));
+        if (i >= 2)
+        {
+            DISTCONV_CHECK_GPU(
+                GPU_STREAM_WAIT_EVENT(stream, m_unpacked[b], 0));
+        }
+        const Chunk& c = pl.chunks[i];
+        transfer_chunk(send_bufs[b],
+                       c.send_counts.data(),
+                       c.send_displs.data(),
+                       recv_bufs[b],
+                       c.recv_counts.data(),
+                       c.recv_displs.data(),
+                       stream);
+        DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(m_transferred[b], stream));
+        DISTCONV_CHECK_GPU(
+            GPU_STREAM_WAIT_EVENT(m_unpack_stream, m_transferred[b], 0));
+        unpack_chunk(c, b);
+    }
+    util::wait_stream(m_unpack_stream, stream);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (send_bufs[i])
+        {
+            pool.release(send_bufs[i]);
+        }
+        if (recv_bufs[i])
+        {
+            pool.release(recv_bufs[i]);
+        }
+    }
 }
 
 #define INSTANTIATE_SHUFFLE(TYPE)                                              \
@@ -481,12 +1483,28 @@ void TensorMPICUDAShuffler<DataType>::shuffle(const DataType* src,
         const TYPE* src, TYPE* dst, gpuStream_t stream)                        \
     {                                                                          \
         shuffle(src, dst, stream, true);                                       \
+        util::sync_if_synchronous(stream);                                     \
     };                                                                         \
     template <>                                                                \
     void TensorMPICUDAShuffler<TYPE>::shuffle_backward(                        \
         const TYPE* src, TYPE* dst, gpuStream_t stream)                        \
     {                                                                          \
         shuffle(src, dst, stream, false);                                      \
+        util::sync_if_synchronous(stream);                                     \
+    };                                                                         \
+    template <>                                                                \
+    TensorMPICUDAShuffler<TYPE>::Request                                       \
+    TensorMPICUDAShuffler<TYPE>::shuffle_forward_async(                        \
+        const TYPE* src, TYPE* dst, gpuStream_t stream)                        \
+    {                                                                          \
+        return shuffle_async(src, dst, stream, true);                          \
+    };                                                                         \
+    template <>                                                                \
+    TensorMPICUDAShuffler<TYPE>::Request                                       \
+    TensorMPICUDAShuffler<TYPE>::shuffle_backward_async(                       \
+        const TYPE* src, TYPE* dst, gpuStream_t stream)                        \
+    {                                                                          \
+        return shuffle_async(src, dst, stream, false);                         \
     };
 
 INSTANTIATE_SHUFFLE(float)
@@ -498,6 +1516,81 @@ INSTANTIATE_SHUFFLE(unsigned short)
 INSTANTIATE_SHUFFLE(long)
 INSTANTIATE_SHUFFLE(unsigned long)
 
+#ifdef DISTCONV_HAS_NVSHMEM
+template <typename DataType>
+void TensorMPICUDAShufflerNVSHMEM<DataType>::signal(Signal sig,
+                                                    bool is_forward,
+                                                    cudaStream_t stream)
+{
+    const int dir = get_dir(is_forward);
+    const bool is_ready = sig == READY;
+    signal_kernel<<<1, 1, 0, stream>>>(
+        m_sync.get_for_device(),
+        is_ready ? m_recv_peers_d[dir] : m_send_peers_d[dir],
+        is_ready ? m_num_recv_peers[dir] : m_num_send_peers[dir],
+        is_ready ? m_send_peers_d[dir] : m_recv_peers_d[dir],
+        is_ready ? m_num_send_peers[dir] : m_num_recv_peers[dir],
+        m_pid,
+        (dir * 2 + sig) * m_np);
+}
+
+template <typename DataType>
+void TensorMPICUDAShufflerNVSHMEM<DataType>::pack_tensor(const DataType* src,
+                                                         DataType* send_buf,
+                                                         cudaStream_t stream,
+                                                         bool is_forward)
+{
+    util::instrumentation::ScopedTimer timer(
+        util::instrumentation::Phase::SHUFFLE_PACK, stream);
+    // The receive buffers must not be overwritten before the last
+    // shuffle is unpacked
+    signal(READY, is_forward, stream);
+    if (this->get_src_local_shape(is_forward).get_size() == 0
+        || !this->is_src_split_root(is_forward))
+    {
+        return;
+    }
+    const int dir = get_dir(is_forward);
+    auto recv_buf = static_cast<DataType*>(m_recv_shmem[dir].get());
+    if (this->get_src_overlap(is_forward).reduce_sum() == 0)
+    {
+        pack_remote<DataType, true>(src,
+                                    this->get_src_local_shape(is_forward),
+                                    this->get_src_strides(is_forward),
+                                    this->get_dst_locale_shape(is_forward),
+                                    this->get_rank_limits_fwd(is_forward),
+                                    m_peer_ptrs_d[dir],
+                                    recv_buf,
+                                    m_put_displs_d[dir],
+                                    stream);
+    }
+    else
+    {
+        pack_remote<DataType, false>(src,
+                                     this->get_src_local_shape(is_forward),
+                                     this->get_src_strides(is_forward),
+                                     this->get_dst_locale_shape(is_forward),
+                                     this->get_rank_limits_fwd(is_forward),
+                                     m_peer_ptrs_d[dir],
+                                     recv_buf,
+                                     m_put_displs_d[dir],
+                                     stream);
+    }
+}
+
+#define INSTANTIATE_SHUFFLE_NVSHMEM(TYPE)                                      \
+    template void TensorMPICUDAShufflerNVSHMEM<TYPE>::signal(                  \
+        TensorMPICUDAShufflerNVSHMEM<TYPE>::Signal, bool, cudaStream_t);       \
+    template void TensorMPICUDAShufflerNVSHMEM<TYPE>::pack_tensor(             \
+        const TYPE*, TYPE*, cudaStream_t, bool);
+
+INSTANTIATE_SHUFFLE_NVSHMEM(float)
+INSTANTIATE_SHUFFLE_NVSHMEM(double)
+INSTANTIATE_SHUFFLE_NVSHMEM(int)
+INSTANTIATE_SHUFFLE_NVSHMEM(long)
+#undef INSTANTIATE_SHUFFLE_NVSHMEM
+#endif // DISTCONV_HAS_NVSHMEM
+
 } // namespace tensor
 } // namespace distconv
 
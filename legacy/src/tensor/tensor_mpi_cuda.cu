@@ -1,9 +1,20 @@
 #include "distconv/tensor/algorithms/transform_cuda.hpp"
+#include "distconv/tensor/allreduce_al.hpp"
 #include "distconv/tensor/halo_cuda.hpp"
+#include "distconv/tensor/region_traversal.hpp"
 #include "distconv/tensor/tensor_mpi_cuda.hpp"
 #include "distconv/util/util.hpp"
 #include "distconv/util/util_gpu.hpp"
 #include "distconv/util/util_mpi.hpp"
+#include "h2/gpu/memory_utils.hpp"
+#include "h2/meta/TypeList.hpp"
+#include "h2/patterns/multimethods/Instantiation.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <vector>
 
 namespace distconv {
 namespace tensor {
@@ -97,43 +108,149 @@ DEFINE_SCALE(int)
 
 #undef DEFINE_SCALE
 
-#define DEFINE_CAST(T1, T2)                                                    \
-    template <>                                                                \
-    int Cast<T1, T2>(Tensor<T1, LocaleMPI, CUDAAllocator> & t_dest,            \
-                     const Tensor<T2, LocaleMPI, CUDAAllocator>& t_src,        \
-                     h2::gpu::DeviceStream stream)                             \
-    {                                                                          \
-        Transform(t_dest, t_src, internal::CastFuctor<T1, T2>(), stream);      \
-        return 0;                                                              \
+namespace internal {
+
+template <int ND, typename DataType>
+__global__ void copy_region_kernel(DataType *dst,
+                                   RegionTraversal<ND> dst_region,
+                                   const DataType *src,
+                                   RegionTraversal<ND> src_region) {
+  for_each_in_region(dst_region, [&](uint32_t i) {
+    const Array<ND> idx = dst_region.get_index(i);
+    dst[dst_region.get_offset(idx)] = src[src_region.get_offset(idx)];
+  });
+}
+
+// Copies the local elements of t outside of the halo to or from the
+// packed buffer buf
+template <bool IS_PACK, typename DataType>
+void copy_local_interior(Tensor<DataType, LocaleMPI, CUDAAllocator> &t,
+                         DataType *buf, h2::gpu::DeviceStream s) {
+  constexpr int block_dim = 256;
+  const auto shape = t.get_local_shape();
+  const int grid_dim = std::min(
+      util::ceil((size_t) shape.size(), (size_t) block_dim),
+      (size_t) std::numeric_limits<int>::max());
+  algorithms_cuda::dispatch_rank(
+      t.get_num_dims(),
+      [&](auto rank) {
+        constexpr int ND = decltype(rank)::value;
+        const RegionTraversal<ND> t_region(shape, t.get_strides());
+        const RegionTraversal<ND> buf_region(
+            shape, get_strides(shape, IntVector(ND, 0), shape[0]));
+        if (IS_PACK) {
+          copy_region_kernel<ND><<<grid_dim, block_dim, 0, s>>>(
+              buf, buf_region, t.get_const_base_ptr(), t_region);
+        } else {
+          copy_region_kernel<ND><<<grid_dim, block_dim, 0, s>>>(
+              t.get_base_ptr(), t_region, buf, buf_region);
+        }
+      },
+      algorithms_cuda::RankRange<1, algorithms_cuda::MAX_ND>{});
+}
+
+} // namespace internal
+
+template <typename DataType>
+void TensorImplHelper<DataType, CUDAAllocator>::allreduce(
+    const LocaleMPI &loc, h2::gpu::DeviceStream s) {
+  if (loc.get_size() == 1) return;
+  AllreduceAlNCCL<DataType> ar(
+      get_al_comm<Al::NCCLBackend>(loc.get_comm(), s));
+  allreduce(ar, s);
+}
+
+template <typename DataType>
+void TensorImplHelper<DataType, CUDAAllocator>::allreduce(
+    Allreduce<DataType> &ar, h2::gpu::DeviceStream s) {
+  auto &t = *m_impl.get_tensor();
+  const size_t size = t.get_local_size();
+  if (size == 0 || m_impl.is_local_interior_contiguous()) {
+    ar.allreduce(t.get_base_ptr(), size);
+    return;
+  }
+  auto &pool = distconv::internal::RuntimeGPU::get_device_memory_pool();
+  DataType *buf = static_cast<DataType*>(
+      pool.get(size * sizeof(DataType), s));
+  internal::copy_local_interior<true>(t, buf, s);
+  ar.allreduce(buf, size);
+  internal::copy_local_interior<false>(t, buf, s);
+  pool.release(buf);
+}
+
+#define DEFINE_ALLREDUCE(TYPE)                                                 \
+    template void TensorImplHelper<TYPE, CUDAAllocator>::allreduce(            \
+        const LocaleMPI& loc, h2::gpu::DeviceStream s);                        \
+    template void TensorImplHelper<TYPE, CUDAAllocator>::allreduce(            \
+        Allreduce<TYPE> & ar, h2::gpu::DeviceStream s);
+
+DEFINE_ALLREDUCE(float)
+DEFINE_ALLREDUCE(double)
+DEFINE_ALLREDUCE(int)
+
+#undef DEFINE_ALLREDUCE
+
+template <typename DataType1, typename DataType2>
+int Cast(Tensor<DataType1, LocaleMPI, CUDAAllocator>& t_dest,
+         const Tensor<DataType2, LocaleMPI, CUDAAllocator>& t_src,
+         h2::gpu::DeviceStream stream)
+{
+    Transform(t_dest,
+              t_src,
+              internal::CastFuctor<DataType1, DataType2>(),
+              stream);
+    return 0;
+}
+
+template <typename DataType1, typename DataType2>
+int CastScaleBias(Tensor<DataType1, LocaleMPI, CUDAAllocator>& t_dest,
+                  const Tensor<DataType2, LocaleMPI, CUDAAllocator>& t_src,
+                  const DataType1 alpha,
+                  const DataType1 beta,
+                  h2::gpu::DeviceStream stream)
+{
+    Transform(t_dest,
+              t_src,
+              internal::CastScaleBiasFuctor<DataType1, DataType2>(alpha, beta),
+              stream);
+    return 0;
+}
+
+namespace internal {
+
+template <typename DataType1, typename DataType2>
+struct InstantiateCast
+{
+    static void instantiate()
+    {
+        (void) &Cast<DataType1, DataType2>;
     }
-DEFINE_CAST(float, short)
-DEFINE_CAST(float, unsigned short)
-DEFINE_CAST(double, short)
-DEFINE_CAST(double, unsigned short)
-#undef DEFINE_CAST
+};
 
-#define DEFINE_CAST_SCALE_BIAS(T1, T2)                                         \
-    template <>                                                                \
-    int CastScaleBias<T1, T2>(                                                 \
-        Tensor<T1, LocaleMPI, CUDAAllocator> & t_dest,                         \
-        const Tensor<T2, LocaleMPI, CUDAAllocator>& t_src,                     \
-        const T1 alpha,                                                        \
-        const T1 beta,                                                         \
-        h2::gpu::DeviceStream stream)                                          \
-    {                                                                          \
-        Transform(t_dest,                                                      \
-                  t_src,                                                       \
-                  internal::CastScaleBiasFuctor<T1, T2>(alpha, beta),          \
-                  stream);                                                     \
-        return 0;                                                              \
+template <typename DataType1, typename DataType2>
+struct InstantiateCastScaleBias
+{
+    static void instantiate()
+    {
+        (void) &CastScaleBias<DataType1, DataType2>;
     }
-DEFINE_CAST_SCALE_BIAS(float, float)
-DEFINE_CAST_SCALE_BIAS(float, short)
-DEFINE_CAST_SCALE_BIAS(float, unsigned short)
-DEFINE_CAST_SCALE_BIAS(double, double)
-DEFINE_CAST_SCALE_BIAS(double, short)
-DEFINE_CAST_SCALE_BIAS(double, unsigned short)
-#undef DEFINE_CAST_SCALE_BIAS
+};
+
+// Casts of the data types from the integer types of labels
+using CastTypes =
+    h2::meta::tlist::CartesianProduct<h2::meta::TL<float, double>,
+                                      h2::meta::TL<short, unsigned short>>;
+using CastScaleBiasTypes =
+    h2::meta::tlist::Append<CastTypes,
+                            h2::meta::TL<h2::meta::TL<float, float>,
+                                         h2::meta::TL<double, double>>>;
+
+H2_INSTANTIATE_ALL(cast_instances, InstantiateCast, CastTypes);
+H2_INSTANTIATE_ALL(cast_scale_bias_instances,
+                   InstantiateCastScaleBias,
+                   CastScaleBiasTypes);
+
+} // namespace internal
 
 
 namespace internal {
@@ -152,66 +269,43 @@ __device__ __forceinline__ void assign(DataType1 &t1, const DataType2 &t2) {
   t1 = t2;
 }
 
-template <int ND, int INNER_DIM, bool is_concat,
-          typename DataType1, typename DataType2>
-__global__ void concat_or_slice_kernel(
-    DataType1 *dst, Array<ND> dst_shape, Array<ND> dst_strides,
-    DataType2 *src1, Array<ND> src1_shape, Array<ND> src1_strides,
-    DataType2 *src2, Array<ND> src2_shape, Array<ND> src2_strides,
-    int concat_dim) {
-  // NOTE: For simplicity, dimension of concat_dim is assumed to be traversed by
-  // different thread blocks.
-  const int tid = threadIdx.x;
-  int bid = blockIdx.x;
-  const int block_size = blockDim.x;
-  DataType2 *src = nullptr;
-  Array<ND> src_strides;
-  Array<ND> src_block_idx;
-  Array<ND> dst_block_idx;
-#pragma unroll
-  for (int i = INNER_DIM + 1; i < ND; ++i) {
-    auto idx = bid % dst_shape[i];
-    dst_block_idx[i] = idx;
-    bid /= dst_shape[i];
-    src_block_idx[i] = idx;
-    if (i == concat_dim) {
-      if (idx < src1_shape[i]) {
-        src = src1;
-        src_strides = src1_strides;
-      } else {
-        src = src2;
-        src_strides = src2_strides;
-        src_block_idx[i] = idx - src1_shape[i];
-      }
-    }
-  }
+// Operands a single concat_or_slice_kernel launch can take. More are
+// handled by successive launches over consecutive chunks of the
+// concatenated dimension.
+constexpr int MAX_CONCAT_OPERANDS = 16;
+
+// The parts of a concatenation passed to the kernel by value, so that
+// any number of operands up to MAX_CONCAT_OPERANDS needs neither a
+// separate launch nor a device allocation.
+template <int ND, typename DataType>
+struct ConcatTable {
+  DataType *ptrs[MAX_CONCAT_OPERANDS];
+  Array<ND> strides[MAX_CONCAT_OPERANDS];
+  // Exclusive local end of each part along the concatenated dimension
+  index_t ends[MAX_CONCAT_OPERANDS];
+};
 
-#pragma unroll
-  for (int i = INNER_DIM + 1; i < ND; ++i) {
-    dst += dst_block_idx[i] * dst_strides[i];
-    src += src_block_idx[i] * src_strides[i];
-  }
+static_assert(sizeof(ConcatTable<algorithms_cuda::MAX_ND, double>) <= 3072,
+              "ConcatTable must fit in the kernel parameter space");
 
-  // Assume the region a thread block traverses has the same shape
-  // between dst and src
-  int inner_size = 1;
-#pragma unroll
-  for (int i = 0; i <= INNER_DIM; ++i) {
-    inner_size *= dst_shape[i];
-  }
-  for (int inner_idx = tid; inner_idx < inner_size; inner_idx += block_size) {
-    int dst_offset = 0;
-    int src_offset = 0;
-    int inner_idx_i = inner_idx;
+template <int ND, bool is_concat, typename DataType1, typename DataType2>
+__global__ void concat_or_slice_kernel(
+    DataType1 *dst, RegionTraversal<ND> dst_region,
+    ConcatTable<ND, DataType2> parts, int concat_dim) {
+  for_each_in_region(dst_region, [&](uint32_t offset) {
+    const Array<ND> idx = dst_region.get_index(offset);
+    // The number of parts is small, so a linear search is enough
+    int part = 0;
+    while (idx[concat_dim] >= parts.ends[part]) ++part;
+    const index_t part_begin = part == 0 ? 0 : parts.ends[part - 1];
+    size_t src_offset = 0;
 #pragma unroll
-    for (int j = 0; j <= INNER_DIM; ++j) {
-      int idx_j = inner_idx_i % dst_shape[j];
-      dst_offset += dst_strides[j] * idx_j;
-      src_offset += src_strides[j] * idx_j;
-      inner_idx_i /= dst_shape[j];
+    for (int i = 0; i < ND; ++i) {
+      const index_t src_idx = i == concat_dim ? idx[i] - part_begin : idx[i];
+      src_offset += src_idx * parts.strides[part][i];
     }
-    assign(dst[dst_offset], src[src_offset]);
-  }
+    assign(dst[dst_region.get_offset(idx)], parts.ptrs[part][src_offset]);
+  });
 }
 
 template <bool B, typename T>
@@ -227,76 +321,251 @@ struct AddConstIf<false, T> {
   using type = T;
 };
 
+// Finds the dimension the parts are concatenated along and checks
+// that the parts tile the whole tensor both globally and locally.
+template <typename WholeTensor, typename PartTensor>
+int get_concat_dim(const WholeTensor &t_whole,
+                   const std::vector<PartTensor*> &t_parts) {
+  const int nd = t_whole.get_num_dims();
+  int concat_dim = -1;
+  for (int i = 0; i < nd; ++i) {
+    for (const auto *t_part: t_parts) {
+      if (t_part->get_shape()[i] != t_whole.get_shape()[i]) {
+        assert_always(concat_dim == -1 || concat_dim == i);
+        concat_dim = i;
+      }
+    }
+  }
+  // A single part equal to the whole tensor
+  if (concat_dim == -1) concat_dim = nd - 1;
+
+  index_t global_extent = 0;
+  index_t local_extent = 0;
+  for (const auto *t_part: t_parts) {
+    assert_always(t_part->get_num_dims() == nd);
+    global_extent += t_part->get_shape()[concat_dim];
+    local_extent += t_part->get_local_shape()[concat_dim];
+    for (int i = 0; i < nd; ++i) {
+      if (i == concat_dim) continue;
+      assert_always(t_part->get_local_shape()[i] ==
+                    t_whole.get_local_shape()[i]);
+    }
+  }
+  assert_always(global_extent == t_whole.get_shape()[concat_dim]);
+  // Concatenating local pieces along a partitioned dimension would
+  // interleave the parts globally.
+  assert_always(local_extent == t_whole.get_local_shape()[concat_dim]);
+  assert_always(
+      t_whole.get_distribution().get_locale_shape()[concat_dim] == 1);
+  return concat_dim;
+}
+
+// Set DISTCONV_CONCAT_KERNEL to always concatenate with the kernel.
+std::atomic<bool> concat_copies_enabled{
+    std::getenv("DISTCONV_CONCAT_KERNEL") == nullptr};
+
+// Runs shorter than this are left to the kernel, as the copy engines
+// move them slower than it does.
+constexpr size_t min_concat_copy_run_bytes = 512;
+
+// A part of a concatenation seen as equally spaced runs of elements
+// that are contiguous in both the part and the whole tensor.
+struct ConcatRuns
+{
+    size_t offset;      // Of the first run in the whole tensor.
+    size_t width;       // Elements per run.
+    size_t height;      // Number of runs.
+    size_t whole_pitch; // Elements between runs in the whole tensor.
+    size_t part_pitch;  // Elements between runs in the part.
+};
+
+// Whether dimensions first to last of the local data of a tensor are
+// packed, without halo or padding in between.
+template <typename TensorType>
+bool is_packed(const TensorType& t, int first, int last)
+{
+    const auto strides = t.get_strides();
+    const auto shape = t.get_local_shape();
+    if (first == 0 && strides[0] != 1)
+        return false;
+    for (int i = first; i < last; ++i)
+    {
+        if (strides[i + 1] != strides[i] * shape[i])
+            return false;
+    }
+    return true;
+}
+
+// The runs of a part beginning at begin along concat_dim, when the
+// dimensions below concat_dim are packed in both tensors, so that the
+// part is contiguous along it, and the dimensions above it collapse
+// into one.
+template <typename WholeType, typename PartType>
+bool get_concat_runs(const WholeType& t_whole,
+                     const PartType& t_part,
+                     int concat_dim,
+                     index_t begin,
+                     ConcatRuns& runs)
+{
+    const int nd = t_whole.get_num_dims();
+    const int above = concat_dim + 1;
+    if (!is_packed(t_whole, 0, concat_dim) || !is_packed(t_part, 0, concat_dim)
+        || (above < nd
+            && (!is_packed(t_whole, above, nd - 1)
+                || !is_packed(t_part, above, nd - 1))))
+    {
+        return false;
+    }
+    const auto shape = t_part.get_local_shape();
+    const auto whole_strides = t_whole.get_strides();
+    runs.offset = begin * whole_strides[concat_dim];
+    runs.width = whole_strides[concat_dim] * shape[concat_dim];
+    runs.height = 1;
+    for (int i = above; i < nd; ++i)
+        runs.height *= shape[i];
+    runs.whole_pitch = above < nd ? whole_strides[above] : runs.width;
+    runs.part_pitch = above < nd ? t_part.get_strides()[above] : runs.width;
+    return true;
+}
+
+// Concatenates or slices with one strided copy per part when every
+// part is made of long enough runs. Returns false, without copying
+// anything, otherwise.
+template <bool IS_CONCAT, typename WholeType, typename PartType>
+bool ConcatenateOrSliceByCopies(WholeType& t_whole,
+                                const std::vector<PartType*>& t_parts,
+                                int concat_dim,
+                                h2::gpu::DeviceStream s)
+{
+    using DataType = typename WholeType::data_type;
+    if (!concat_copies_enabled.load(std::memory_order_relaxed))
+        return false;
+    std::vector<ConcatRuns> runs(t_parts.size());
+    index_t begin = 0;
+    for (size_t i = 0; i < t_parts.size(); ++i)
+    {
+        if (!get_concat_runs(
+                t_whole, *t_parts[i], concat_dim, begin, runs[i]))
+            return false;
+        if (runs[i].height > 0
+            && runs[i].width * sizeof(DataType) < min_concat_copy_run_bytes)
+            return false;
+        begin += t_parts[i]->get_local_shape()[concat_dim];
+    }
+    for (size_t i = 0; i < t_parts.size(); ++i)
+    {
+        const auto& r = runs[i];
+        if (r.width == 0 || r.height == 0)
+            continue;
+        auto* whole_ptr = t_whole.get_base_ptr() + r.offset;
+        auto* part_ptr = t_parts[i]->get_base_ptr();
+        if constexpr (IS_CONCAT)
+            h2::gpu::mem_copy_2d(whole_ptr,
+                                 r.whole_pitch * sizeof(DataType),
+                                 part_ptr,
+                                 r.part_pitch * sizeof(DataType),
+                                 r.width * sizeof(DataType),
+                                 r.height,
+                                 s);
+        else
+            h2::gpu::mem_copy_2d(part_ptr,
+                                 r.part_pitch * sizeof(DataType),
+                                 whole_ptr,
+                                 r.whole_pitch * sizeof(DataType),
+                                 r.width * sizeof(DataType),
+                                 r.height,
+                                 s);
+    }
+    return true;
+}
+
 template <typename DataType, bool IS_CONCAT>
 int ConcatenateOrSlice(
     typename AddConstIf<!IS_CONCAT,
                         Tensor<DataType, LocaleMPI, CUDAAllocator>>::type&
-        t_dest,
-    typename AddConstIf<IS_CONCAT,
-                        Tensor<DataType, LocaleMPI, CUDAAllocator>>::type&
-        t_src1,
-    typename AddConstIf<IS_CONCAT,
-                        Tensor<DataType, LocaleMPI, CUDAAllocator>>::type&
-        t_src2,
+        t_whole,
+    const std::vector<typename AddConstIf<
+        IS_CONCAT,
+        Tensor<DataType, LocaleMPI, CUDAAllocator>>::type*>& t_parts,
     h2::gpu::DeviceStream s)
 {
-    const int nd = t_dest.get_num_dims();
-    int block_dim = 256; // tunable
+    using WholeDataType = typename AddConstIf<!IS_CONCAT, DataType>::type;
+    using PartDataType = typename AddConstIf<IS_CONCAT, DataType>::type;
+    constexpr int block_dim = 256; // tunable
+
+    assert_always(!t_parts.empty());
+    const int nd = t_whole.get_num_dims();
+    const int concat_dim = get_concat_dim(t_whole, t_parts);
+    if (t_whole.get_local_size() == 0)
+        return 0;
+    if (ConcatenateOrSliceByCopies<IS_CONCAT>(t_whole, t_parts, concat_dim, s))
+        return 0;
+
+    algorithms_cuda::dispatch_rank(
+        nd,
+        [&](auto rank) {
+            constexpr int ND = decltype(rank)::value;
+            const Array<ND> whole_strides(t_whole.get_strides());
+            // Halo-aware: base pointers and strides skip the halo of
+            // every operand.
+            WholeDataType* whole_ptr = t_whole.get_base_ptr();
+            for (size_t first = 0; first < t_parts.size();
+                 first += MAX_CONCAT_OPERANDS)
+            {
+                const size_t last = std::min(
+                    t_parts.size(), first + MAX_CONCAT_OPERANDS);
+                ConcatTable<ND, PartDataType> table;
+                index_t end = 0;
+                for (size_t i = first; i < last; ++i)
+                {
+                    table.ptrs[i - first] = t_parts[i]->get_base_ptr();
+                    table.strides[i - first] =
+                        Array<ND>(t_parts[i]->get_strides());
+                    end += t_parts[i]->get_local_shape()[concat_dim];
+                    table.ends[i - first] = end;
+                }
+                auto chunk_shape = t_whole.get_local_shape();
+                chunk_shape[concat_dim] = end;
+                const size_t chunk_size = chunk_shape.size();
+                if (chunk_size > 0)
+                {
+                    const int grid_dim = std::min(
+                        util::ceil(chunk_size, (size_t) block_dim),
+                        (size_t) std::numeric_limits<int>::max());
+                    concat_or_slice_kernel<ND, IS_CONCAT>
+                        <<<grid_dim, block_dim, 0, s>>>(
+                            whole_ptr,
+                            RegionTraversal<ND>(chunk_shape, whole_strides),
+                            table,
+                            concat_dim);
+                }
+                whole_ptr += end * whole_strides[concat_dim];
+            }
+        },
+        algorithms_cuda::RankRange<1, algorithms_cuda::MAX_ND>{});
+    return 0;
+}
+} // namespace internal
 
-    int concat_dim = -1;
-    for (int i = 0; i < nd; ++i)
-    {
-        auto dest_dim = t_dest.get_shape()[i];
-        auto src1_dim = t_src1.get_shape()[i];
-        auto src2_dim = t_src2.get_shape()[i];
-        if (dest_dim == src1_dim && dest_dim == src2_dim)
-        {
-            // this is not concat dim
-            continue;
-        }
-        assert_always(dest_dim == src1_dim + src2_dim);
-        concat_dim = i;
-        break;
-    }
+void set_concat_copies_enabled(bool enabled)
+{
+    internal::concat_copies_enabled.store(enabled, std::memory_order_relaxed);
+}
 
-    // TODO: only works for U-Net. Concat on channel dim
-    assert_always(concat_dim == nd - 2);
-
-#define CALL_KERNEL(ND, INNER_DIM)  do {                                \
-    assert_always(concat_dim > INNER_DIM);                              \
-    int grid_dim = 1;                                                   \
-    for (int i = INNER_DIM + 1; i < ND; ++i) {                          \
-      grid_dim *= t_dest.get_local_shape()[i];                          \
-    }                                                                   \
-    concat_or_slice_kernel<ND, INNER_DIM, IS_CONCAT>                    \
-          <<<grid_dim, block_dim, 0, s>>>(                              \
-              t_dest.get_base_ptr(), Array<ND>(t_dest.get_local_shape()), \
-              Array<ND>(t_dest.get_strides()),                          \
-              t_src1.get_base_ptr(), Array<ND>(t_src1.get_local_shape()), \
-              Array<ND>(t_src1.get_strides()),                          \
-              t_src2.get_base_ptr(), Array<ND>(t_src2.get_local_shape()), \
-              Array<ND>(t_src2.get_strides()),                          \
-              concat_dim);                                              \
-  } while (0)
-
-  switch (nd) {
-    case 3:
-      CALL_KERNEL(3, 1);
-      break;
-    case 4:
-      CALL_KERNEL(4, 1);
-      break;
-    case 5:
-      // Needs more robust tuning
-      CALL_KERNEL(5, 1);
-      break;
-    default:
-      throw std::exception();
-  }
-#undef CALL_KERNEL
-  return 0;
+bool get_concat_copies_enabled()
+{
+    return internal::concat_copies_enabled.load(std::memory_order_relaxed);
+}
+
+template <typename DataType>
+int Concatenate(
+    Tensor<DataType, LocaleMPI, CUDAAllocator>& t_dest,
+    const std::vector<const Tensor<DataType, LocaleMPI, CUDAAllocator>*>&
+        t_srcs,
+    h2::gpu::DeviceStream s)
+{
+    return internal::ConcatenateOrSlice<DataType, true>(t_dest, t_srcs, s);
 }
-} // namespace internal
 
 template <typename DataType>
 int Concatenate(Tensor<DataType, LocaleMPI, CUDAAllocator>& t_dest,
@@ -304,8 +573,16 @@ int Concatenate(Tensor<DataType, LocaleMPI, CUDAAllocator>& t_dest,
                 const Tensor<DataType, LocaleMPI, CUDAAllocator>& t_src2,
                 h2::gpu::DeviceStream s)
 {
-    return internal::ConcatenateOrSlice<DataType, true>(
-        t_dest, t_src1, t_src2, s);
+    return Concatenate(t_dest, {&t_src1, &t_src2}, s);
+}
+
+template <typename DataType>
+int Slice(const std::vector<Tensor<DataType, LocaleMPI, CUDAAllocator>*>&
+              t_dests,
+          const Tensor<DataType, LocaleMPI, CUDAAllocator>& t_src,
+          h2::gpu::DeviceStream s)
+{
+    return internal::ConcatenateOrSlice<DataType, false>(t_src, t_dests, s);
 }
 
 template <typename DataType>
@@ -314,21 +591,54 @@ int Slice(Tensor<DataType, LocaleMPI, CUDAAllocator>& t_dest1,
           const Tensor<DataType, LocaleMPI, CUDAAllocator>& t_src,
           h2::gpu::DeviceStream s)
 {
-    return internal::ConcatenateOrSlice<DataType, false>(
-        t_src, t_dest1, t_dest2, s);
+    return Slice({&t_dest1, &t_dest2}, t_src, s);
+}
+
+template <typename DataType>
+int ViewConcatenation(
+    Tensor<DataType, LocaleMPI, CUDAAllocator>& t_dest,
+    const std::vector<Tensor<DataType, LocaleMPI, CUDAAllocator>*>& t_srcs)
+{
+    assert_always(!t_srcs.empty());
+    const int concat_dim = internal::get_concat_dim(t_dest, t_srcs);
+    index_t offset = 0;
+    for (size_t i = 0; i < t_srcs.size(); ++i)
+    {
+        assert_always(t_srcs[i]->is_null());
+        if (ViewSlice(*t_srcs[i], t_dest, concat_dim, offset))
+        {
+            for (size_t j = 0; j < i; ++j)
+                t_srcs[j]->nullify();
+            return 1;
+        }
+        offset += t_srcs[i]->get_local_shape()[concat_dim];
+    }
+    return 0;
 }
 
 #define DEFINE_CONCATENATE(TYPE)                                               \
+    template int Concatenate<TYPE>(                                            \
+        Tensor<TYPE, LocaleMPI, CUDAAllocator> & t_dest,                       \
+        const std::vector<const Tensor<TYPE, LocaleMPI, CUDAAllocator>*>&      \
+            t_srcs,                                                            \
+        h2::gpu::DeviceStream s);                                              \
     template int Concatenate<TYPE>(                                            \
         Tensor<TYPE, LocaleMPI, CUDAAllocator> & t_dest,                       \
         const Tensor<TYPE, LocaleMPI, CUDAAllocator>& t_src1,                  \
         const Tensor<TYPE, LocaleMPI, CUDAAllocator>& t_src2,                  \
         h2::gpu::DeviceStream s);                                              \
+    template int Slice<TYPE>(                                                  \
+        const std::vector<Tensor<TYPE, LocaleMPI, CUDAAllocator>*>& t_dests,   \
+        const Tensor<TYPE, LocaleMPI, CUDAAllocator>& t_src,                   \
+        h2::gpu::DeviceStream s);                                              \
     template int Slice<TYPE>(                                                  \
         Tensor<TYPE, LocaleMPI, CUDAAllocator> & t_dest1,                      \
         Tensor<TYPE, LocaleMPI, CUDAAllocator> & t_dest2,                      \
         const Tensor<TYPE, LocaleMPI, CUDAAllocator>& t_src,                   \
-        h2::gpu::DeviceStream s);
+        h2::gpu::DeviceStream s);                                              \
+    template int ViewConcatenation<TYPE>(                                      \
+        Tensor<TYPE, LocaleMPI, CUDAAllocator> & t_dest,                       \
+        const std::vector<Tensor<TYPE, LocaleMPI, CUDAAllocator>*>& t_srcs);
 DEFINE_CONCATENATE(float)
 DEFINE_CONCATENATE(double)
 DEFINE_CONCATENATE(int)
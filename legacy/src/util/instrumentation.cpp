@@ -0,0 +1,566 @@
+#include "distconv/util/instrumentation.hpp"
+
+#include "distconv/runtime.hpp"
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/util/ranges.hpp"
+#include "distconv/util/util_mpi.hpp"
+#include "h2/gpu/pools.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <mutex>
+
+namespace distconv {
+namespace util {
+namespace instrumentation {
+
+namespace {
+
+struct Pending {
+  std::uint64_t id;
+  int layer;
+  Phase phase;
+  int peer;
+  h2::gpu::PooledEvent start;
+  h2::gpu::PooledEvent end;
+  bool ended = false;
+};
+
+struct Entry {
+  int layer;
+  Phase phase;
+  double start;
+  double duration;
+  int peer;
+};
+
+// Timings not collected yet beyond which end collects the completed ones
+constexpr std::size_t collect_threshold = 256;
+
+bool is_layer_phase(Phase phase) {
+  return phase == Phase::FORWARD || phase == Phase::BACKWARD_DATA ||
+      phase == Phase::BACKWARD_FILTER || phase == Phase::BACKWARD_BIAS;
+}
+
+bool is_done(h2::gpu::DeviceEvent event) {
+  const auto status = GPU_EVENT_QUERY(event);
+  if (status == GPU_ERROR_NOT_READY) {
+    // Clear the sticky status
+    GPU_GET_LAST_ERROR();
+    return false;
+  }
+  DISTCONV_CHECK_GPU(status);
+  return true;
+}
+
+// Events recorded in a captured graph have no timestamps to read
+bool is_capturing(h2::gpu::DeviceStream stream) {
+#if H2_HAS_CUDA
+  cudaStreamCaptureStatus status;
+  DISTCONV_CHECK_CUDA(cudaStreamIsCapturing(stream, &status));
+  return status != cudaStreamCaptureStatusNone;
+#elif H2_HAS_ROCM
+  hipStreamCaptureStatus status;
+  DISTCONV_CHECK_HIP(hipStreamIsCapturing(stream, &status));
+  return status != hipStreamCaptureStatusNone;
+#endif
+}
+
+double get_elapsed(h2::gpu::DeviceEvent start, h2::gpu::DeviceEvent end) {
+  float elapsed = 0;
+#if H2_HAS_CUDA
+  DISTCONV_CHECK_CUDA(cudaEventElapsedTime(&elapsed, start, end));
+#elif H2_HAS_ROCM
+  DISTCONV_CHECK_HIP(hipEventElapsedTime(&elapsed, start, end));
+#endif
+  return elapsed;
+}
+
+Stats compute_stats(std::vector<double> &durations) {
+  Stats s;
+  s.count = durations.size();
+  if (s.count == 0) return s;
+  std::sort(durations.begin(), durations.end());
+  for (auto d: durations) s.total += d;
+  s.mean = s.total / s.count;
+  s.min = durations.front();
+  s.max = durations.back();
+  // Nearest-rank percentiles
+  auto percentile = [&](double p) {
+    const std::size_t rank = static_cast<std::size_t>(
+        std::ceil(p / 100 * s.count));
+    return durations[std::max(rank, std::size_t(1)) - 1];
+  };
+  s.p50 = percentile(50);
+  s.p90 = percentile(90);
+  s.p99 = percentile(99);
+  return s;
+}
+
+int get_rank() {
+  int initialized = 0;
+  MPI_Initialized(&initialized);
+  int rank = 0;
+  if (initialized) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  return rank;
+}
+
+void write_json_string(std::ostream &os, const std::string &s) {
+  os << '"';
+  for (auto c: s) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      os << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+         << static_cast<int>(c) << std::dec << std::setfill(' ');
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+void write_json_stats(std::ostream &os, const Stats &s) {
+  os << "{\"count\": " << s.count
+     << ", \"total\": " << s.total
+     << ", \"mean\": " << s.mean
+     << ", \"min\": " << s.min
+     << ", \"max\": " << s.max
+     << ", \"p50\": " << s.p50
+     << ", \"p90\": " << s.p90
+     << ", \"p99\": " << s.p99 << "}";
+}
+
+// Layers of the layer operations being timed by the thread
+std::vector<std::string> &get_layer_stack() {
+  static thread_local std::vector<std::string> stack;
+  return stack;
+}
+
+class Recorder {
+ public:
+  static Recorder &get() {
+    static Recorder recorder;
+    return recorder;
+  }
+
+  std::atomic<bool> m_enabled{get_config().instrumentation};
+
+  std::uint64_t begin(const std::string &layer, Phase phase,
+                      h2::gpu::DeviceStream stream, int peer) {
+    if (is_capturing(stream)) return 0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_base) {
+      m_base = h2::gpu::acquire_event();
+      DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(m_base, stream));
+    }
+    const auto &name = layer.empty() ? get_current_layer() : layer;
+    Pending p;
+    p.id = ++m_last_id;
+    p.layer = intern(name);
+    p.phase = phase;
+    p.peer = peer;
+    p.start = h2::gpu::acquire_event();
+    p.end = h2::gpu::acquire_event();
+    DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(p.start, stream));
+    m_pending.push_back(std::move(p));
+    if (is_layer_phase(phase)) get_layer_stack().push_back(name);
+    return m_last_id;
+  }
+
+  void end(std::uint64_t id, h2::gpu::DeviceStream stream) {
+    if (id == 0) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Usually the latest one
+    auto it = std::find_if(m_pending.rbegin(), m_pending.rend(),
+                           [id](const Pending &p) { return p.id == id; });
+    // Dropped by clear
+    if (it == m_pending.rend()) return;
+    DISTCONV_CHECK_GPU(GPU_EVENT_RECORD(it->end, stream));
+    it->ended = true;
+    if (is_layer_phase(it->phase) && !get_layer_stack().empty()) {
+      get_layer_stack().pop_back();
+    }
+    if (m_pending.size() >= collect_threshold) collect_locked(false);
+  }
+
+  void collect(bool wait) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    collect_locked(wait);
+  }
+
+  void set_capacity(std::size_t capacity) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    assert_always(capacity > 0);
+    auto entries = get_entries_locked();
+    if (entries.size() > capacity) {
+      entries.erase(entries.begin(), entries.end() - capacity);
+    }
+    m_capacity = capacity;
+    m_entries = std::move(entries);
+    m_head = 0;
+  }
+
+  std::size_t get_capacity() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_capacity;
+  }
+
+  std::vector<Record> get_records(bool wait) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    collect_locked(wait);
+    std::vector<Record> records;
+    for (const auto &e: get_entries_locked()) {
+      records.push_back(Record{m_names[e.layer], e.phase, e.start,
+                               e.duration, e.peer});
+    }
+    return records;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.clear();
+    m_entries.clear();
+    m_head = 0;
+  }
+
+ private:
+  std::mutex m_mutex;
+  std::size_t m_capacity = 1 << 16;
+  // Ring buffer; m_head is the oldest entry once it is full
+  std::vector<Entry> m_entries;
+  std::size_t m_head = 0;
+  std::deque<Pending> m_pending;
+  std::uint64_t m_last_id = 0;
+  // Reference of the start times
+  h2::gpu::PooledEvent m_base;
+  std::vector<std::string> m_names;
+  std::map<std::string, int> m_name_ids;
+
+  Recorder() {
+    m_entries.reserve(m_capacity);
+  }
+
+  int intern(const std::string &name) {
+    auto it = m_name_ids.find(name);
+    if (it != m_name_ids.end()) return it->second;
+    const int id = m_names.size();
+    m_names.push_back(name);
+    m_name_ids.emplace(name, id);
+    return id;
+  }
+
+  void push(const Entry &e) {
+    if (m_entries.size() < m_capacity) {
+      m_entries.push_back(e);
+    } else {
+      m_entries[m_head] = e;
+      m_head = (m_head + 1) % m_capacity;
+    }
+  }
+
+  std::vector<Entry> get_entries_locked() const {
+    std::vector<Entry> entries(m_entries.begin() + m_head, m_entries.end());
+    entries.insert(entries.end(), m_entries.begin(),
+                   m_entries.begin() + m_head);
+    return entries;
+  }
+
+  void collect_locked(bool wait) {
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+      if (!it->ended) {
+        ++it;
+        continue;
+      }
+      if (wait) {
+        h2::gpu::sync(it->end.get());
+      } else if (!is_done(it->end)) {
+        ++it;
+        continue;
+      }
+      push(Entry{it->layer, it->phase, get_elapsed(m_base, it->start),
+                 get_elapsed(it->start, it->end), it->peer});
+      // The events go back to the pool
+      it = m_pending.erase(it);
+    }
+  }
+};
+
+} // namespace
+
+const char *to_string(Phase phase) {
+  switch (phase) {
+    case Phase::FORWARD: return "forward";
+    case Phase::BACKWARD_DATA: return "backward_data";
+    case Phase::BACKWARD_FILTER: return "backward_filter";
+    case Phase::BACKWARD_BIAS: return "backward_bias";
+    case Phase::HALO_PACK: return "halo_pack";
+    case Phase::HALO_TRANSFER: return "halo_transfer";
+    case Phase::HALO_UNPACK: return "halo_unpack";
+    case Phase::SHUFFLE_PACK: return "shuffle_pack";
+    case Phase::SHUFFLE_TRANSFER: return "shuffle_transfer";
+    case Phase::SHUFFLE_UNPACK: return "shuffle_unpack";
+    case Phase::ALLREDUCE: return "allreduce";
+  }
+  return "unknown";
+}
+
+void push_range(const std::string &layer, Phase phase) {
+  h2::gpu::RangeCategory category = h2::gpu::RangeCategory::Compute;
+  switch (phase) {
+    case Phase::HALO_PACK:
+    case Phase::HALO_TRANSFER:
+    case Phase::HALO_UNPACK:
+      category = h2::gpu::RangeCategory::HaloExchange;
+      break;
+    case Phase::SHUFFLE_PACK:
+    case Phase::SHUFFLE_TRANSFER:
+    case Phase::SHUFFLE_UNPACK:
+      category = h2::gpu::RangeCategory::Shuffle;
+      break;
+    case Phase::ALLREDUCE:
+      category = h2::gpu::RangeCategory::Collective;
+      break;
+    default:
+      break;
+  }
+  if (layer.empty()) {
+    h2::gpu::range_push(get_range_domain(), to_string(phase), category);
+  } else {
+    const std::string name = layer + "/" + to_string(phase);
+    h2::gpu::range_push(get_range_domain(), name.c_str(), category);
+  }
+}
+
+void pop_range() {
+  h2::gpu::range_pop(get_range_domain());
+}
+
+bool is_enabled() {
+  return Recorder::get().m_enabled.load(std::memory_order_relaxed);
+}
+
+void set_enabled(bool enabled) {
+  Recorder::get().m_enabled = enabled;
+}
+
+std::size_t get_capacity() {
+  return Recorder::get().get_capacity();
+}
+
+void set_capacity(std::size_t capacity) {
+  Recorder::get().set_capacity(capacity);
+}
+
+std::uint64_t begin(const std::string &layer, Phase phase,
+                    h2::gpu::DeviceStream stream, int peer) {
+  return Recorder::get().begin(layer, phase, stream, peer);
+}
+
+void end(std::uint64_t id, h2::gpu::DeviceStream stream) {
+  Recorder::get().end(id, stream);
+}
+
+const std::string &get_current_layer() {
+  static const std::string none;
+  const auto &stack = get_layer_stack();
+  return stack.empty() ? none : stack.back();
+}
+
+void collect(bool wait) {
+  Recorder::get().collect(wait);
+}
+
+std::vector<Record> get_records() {
+  return Recorder::get().get_records(false);
+}
+
+std::vector<std::string> get_layers() {
+  std::vector<std::string> layers;
+  for (const auto &r: get_records()) {
+    if (std::find(layers.begin(), layers.end(), r.layer) == layers.end()) {
+      layers.push_back(r.layer);
+    }
+  }
+  return layers;
+}
+
+Stats get_stats(const std::string &layer, Phase phase) {
+  std::vector<double> durations;
+  for (const auto &r: get_records()) {
+    if (r.layer == layer && r.phase == phase) durations.push_back(r.duration);
+  }
+  return compute_stats(durations);
+}
+
+Stats get_stats(Phase phase) {
+  std::vector<double> durations;
+  for (const auto &r: get_records()) {
+    if (r.phase == phase) durations.push_back(r.duration);
+  }
+  return compute_stats(durations);
+}
+
+std::map<int, Stats> get_peer_stats() {
+  std::map<int, std::vector<double>> durations;
+  for (const auto &r: get_records()) {
+    if (r.peer >= 0) durations[r.peer].push_back(r.duration);
+  }
+  std::map<int, Stats> stats;
+  for (auto &d: durations) {
+    stats.emplace(d.first, compute_stats(d.second));
+  }
+  return stats;
+}
+
+StragglerReport get_straggler_report(MPI_Comm comm, double window,
+                                     std::size_t num_pairs) {
+  int rank, np;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &rank));
+  DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &np));
+  const auto records = Recorder::get().get_records(true);
+  double last = 0;
+  for (const auto &r: records) last = std::max(last, r.start);
+  // Waits on each peer followed by the allreduce time
+  std::vector<double> local(np + 1, 0);
+  for (const auto &r: records) {
+    if (window > 0 && r.start < last - window) continue;
+    if (r.peer >= 0 && r.peer < np) {
+      local[r.peer] += r.duration;
+    } else if (r.phase == Phase::ALLREDUCE) {
+      local[np] += r.duration;
+    }
+  }
+  std::vector<double> all((np + 1) * np);
+  DISTCONV_CHECK_MPI(MPI_Allgather(local.data(), np + 1, MPI_DOUBLE,
+                                   all.data(), np + 1, MPI_DOUBLE, comm));
+  StragglerReport report;
+  report.scores.assign(np, 0);
+  report.collective_time.resize(np);
+  std::vector<PeerWait> waits;
+  for (int r = 0; r < np; ++r) {
+    report.collective_time[r] = all[r * (np + 1) + np];
+    for (int p = 0; p < np; ++p) {
+      const double w = all[r * (np + 1) + p];
+      if (w > 0) waits.push_back(PeerWait{r, p, w});
+    }
+  }
+  // Mean wait of the neighbors of each rank
+  std::vector<double> totals(np, 0);
+  std::vector<int> counts(np, 0);
+  for (const auto &w: waits) {
+    totals[w.peer] += w.total;
+    ++counts[w.peer];
+  }
+  std::vector<double> means;
+  for (int p = 0; p < np; ++p) {
+    if (counts[p] > 0) means.push_back(totals[p] / counts[p]);
+  }
+  if (!means.empty()) {
+    std::nth_element(means.begin(), means.begin() + means.size() / 2,
+                     means.end());
+    const double median = means[means.size() / 2];
+    for (int p = 0; p < np; ++p) {
+      if (counts[p] > 0 && median > 0) {
+        report.scores[p] = totals[p] / counts[p] / median;
+      }
+    }
+  }
+  std::sort(waits.begin(), waits.end(),
+            [](const PeerWait &x, const PeerWait &y) {
+              return x.total > y.total;
+            });
+  if (waits.size() > num_pairs) waits.resize(num_pairs);
+  report.worst_pairs = std::move(waits);
+  return report;
+}
+
+void clear() {
+  Recorder::get().clear();
+}
+
+void write_json(std::ostream &os) {
+  const auto records = Recorder::get().get_records(true);
+  // Durations of each phase of each layer in the order of appearance
+  std::vector<std::string> layers;
+  std::map<std::string, std::vector<std::vector<double>>> durations;
+  for (const auto &r: records) {
+    auto it = durations.find(r.layer);
+    if (it == durations.end()) {
+      layers.push_back(r.layer);
+      it = durations.emplace(
+          r.layer, std::vector<std::vector<double>>(num_phases)).first;
+    }
+    it->second[static_cast<int>(r.phase)].push_back(r.duration);
+  }
+  os << "{\"rank\": " << get_rank() << ", \"unit\": \"ms\", \"layers\": {";
+  for (std::size_t i = 0; i < layers.size(); ++i) {
+    os << (i ? ", " : "");
+    write_json_string(os, layers[i]);
+    os << ": {";
+    bool first = true;
+    for (int p = 0; p < num_phases; ++p) {
+      auto &d = durations[layers[i]][p];
+      if (d.empty()) continue;
+      os << (first ? "" : ", ") << "\""
+         << to_string(static_cast<Phase>(p)) << "\": ";
+      write_json_stats(os, compute_stats(d));
+      first = false;
+    }
+    os << "}";
+  }
+  os << "}}\n";
+}
+
+void write_json(std::ostream &os, const StragglerReport &report) {
+  os << "{\"unit\": \"ms\", \"scores\": [";
+  for (std::size_t i = 0; i < report.scores.size(); ++i) {
+    os << (i ? ", " : "") << report.scores[i];
+  }
+  os << "], \"collective_time\": [";
+  for (std::size_t i = 0; i < report.collective_time.size(); ++i) {
+    os << (i ? ", " : "") << report.collective_time[i];
+  }
+  os << "], \"worst_pairs\": [";
+  for (std::size_t i = 0; i < report.worst_pairs.size(); ++i) {
+    const auto &w = report.worst_pairs[i];
+    os << (i ? ", " : "") << "{\"rank\": " << w.rank
+       << ", \"peer\": " << w.peer << ", \"total\": " << w.total << "}";
+  }
+  os << "]}\n";
+}
+
+void write_chrome_trace(std::ostream &os) {
+  const auto records = Recorder::get().get_records(true);
+  const int rank = get_rank();
+  os << "{\"traceEvents\": [";
+  os << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << rank
+     << ", \"args\": {\"name\": \"rank " << rank << "\"}}";
+  for (int p = 0; p < num_phases; ++p) {
+    os << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << rank
+       << ", \"tid\": " << p << ", \"args\": {\"name\": \""
+       << to_string(static_cast<Phase>(p)) << "\"}}";
+  }
+  const auto flags = os.flags();
+  os << std::fixed << std::setprecision(3);
+  for (const auto &r: records) {
+    os << ",\n{\"name\": ";
+    write_json_string(os, r.layer.empty() ? to_string(r.phase) : r.layer);
+    // Times are in microseconds
+    os << ", \"cat\": \"" << to_string(r.phase) << "\", \"ph\": \"X\""
+       << ", \"ts\": " << r.start * 1000
+       << ", \"dur\": " << r.duration * 1000
+       << ", \"pid\": " << rank
+       << ", \"tid\": " << static_cast<int>(r.phase) << "}";
+  }
+  os.flags(flags);
+  os << "],\n\"displayTimeUnit\": \"ms\"}\n";
+}
+
+} // namespace instrumentation
+} // namespace util
+} // namespace distconv
@@ -0,0 +1,183 @@
+#include "distconv/util/jit_cuda.hpp"
+
+#include "distconv/util/util.hpp"
+#include "distconv/util/util_cuda.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include <nvrtc.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+namespace distconv {
+namespace util {
+namespace jit {
+
+namespace {
+
+std::mutex cache_mutex;
+// Kernels by architecture, name and source. Null for sources that
+// failed to compile.
+std::unordered_map<std::string, CUfunction> kernels;
+
+// FNV-1a, stable across runs unlike std::hash
+std::uint64_t hash(const std::string &s) {
+  std::uint64_t h = 14695981039346656037ull;
+  for (unsigned char c: s) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+int get_arch() {
+  int dev, major, minor;
+  DISTCONV_CHECK_CUDA(cudaGetDevice(&dev));
+  DISTCONV_CHECK_CUDA(cudaDeviceGetAttribute(
+      &major, cudaDevAttrComputeCapabilityMajor, dev));
+  DISTCONV_CHECK_CUDA(cudaDeviceGetAttribute(
+      &minor, cudaDevAttrComputeCapabilityMinor, dev));
+  return major * 10 + minor;
+}
+
+// Returns an empty binary if compilation fails
+std::vector<char> compile(const std::string &source, const std::string &name,
+                          int arch) {
+  nvrtcProgram prog;
+  if (nvrtcCreateProgram(&prog, source.c_str(), (name + ".cu").c_str(),
+                         0, nullptr, nullptr) != NVRTC_SUCCESS) {
+    return {};
+  }
+  const std::string arch_opt = "--gpu-architecture=sm_" + std::to_string(arch);
+  const char *opts[] = {arch_opt.c_str(), "--std=c++17", "-default-device"};
+  std::vector<char> bin;
+  if (nvrtcCompileProgram(prog, 3, opts) == NVRTC_SUCCESS) {
+    size_t size;
+    if (nvrtcGetCUBINSize(prog, &size) == NVRTC_SUCCESS) {
+      bin.resize(size);
+      if (nvrtcGetCUBIN(prog, bin.data()) != NVRTC_SUCCESS) bin.clear();
+    }
+  } else {
+    size_t log_size;
+    nvrtcGetProgramLogSize(prog, &log_size);
+    std::string log(log_size, '\0');
+    nvrtcGetProgramLog(prog, &log[0]);
+    util::MPIPrintStreamWarning()
+        << "Cannot compile " << name << " for sm_" << arch << ":\n" << log;
+  }
+  nvrtcDestroyProgram(&prog);
+  return bin;
+}
+
+std::vector<char> load(const std::string &path) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) return {};
+  return std::vector<char>(std::istreambuf_iterator<char>(ifs),
+                           std::istreambuf_iterator<char>());
+}
+
+// Written under a name of this process and renamed, so that processes
+// sharing the directory never read a partial binary
+void save(const std::string &path, const std::vector<char> &bin) {
+  std::error_code ec;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), ec);
+  const std::string tmp = path + "." + std::to_string(getpid());
+  {
+    std::ofstream ofs(tmp, std::ios::binary);
+    if (!ofs) return;
+    ofs.write(bin.data(), bin.size());
+    if (!ofs) return;
+  }
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) std::filesystem::remove(tmp, ec);
+}
+
+} // namespace
+
+bool is_enabled() {
+  static const bool enabled = [] {
+    const char *env = std::getenv("DISTCONV_JIT_KERNELS");
+    return env && env[0] != '\0' && env[0] != '0';
+  }();
+  return enabled;
+}
+
+std::string get_cache_dir() {
+  if (const char *env = std::getenv("DISTCONV_JIT_CACHE_DIR")) {
+    return env;
+  }
+  std::error_code ec;
+  const auto tmp = std::filesystem::temp_directory_path(ec);
+  return ((ec ? std::filesystem::path(".") : tmp) / "distconv_jit").string();
+}
+
+CUfunction get_kernel(const std::string &source, const std::string &name) {
+  // A process uses a single device
+  static const int arch = get_arch();
+  std::ostringstream key_ss;
+  key_ss << arch << ":" << name << ":" << source;
+  const std::string key = key_ss.str();
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto it = kernels.find(key);
+  if (it != kernels.end()) return it->second;
+
+  int nvrtc_major, nvrtc_minor;
+  nvrtcVersion(&nvrtc_major, &nvrtc_minor);
+  std::ostringstream file_ss;
+  file_ss << get_cache_dir() << "/" << name << "_sm" << arch << "_"
+          << std::hex << hash(key + ":" + std::to_string(nvrtc_major) + "."
+                              + std::to_string(nvrtc_minor))
+          << ".cubin";
+  const std::string path = file_ss.str();
+  auto bin = load(path);
+  const bool cached = !bin.empty();
+  if (!cached) bin = compile(source, name, arch);
+
+  CUfunction kernel = nullptr;
+  CUmodule module;
+  if (!bin.empty()
+      && cuModuleLoadData(&module, bin.data()) == CUDA_SUCCESS) {
+    // Modules stay loaded for the rest of the run
+    if (cuModuleGetFunction(&kernel, module, name.c_str()) != CUDA_SUCCESS) {
+      kernel = nullptr;
+    }
+  }
+  if (kernel && !cached) {
+    save(path, bin);
+  }
+  if (!kernel) {
+    util::MPIPrintStreamWarning()
+        << "Runtime-compiled kernel " << name
+        << " is not available; using the generic kernel";
+  }
+  kernels.emplace(key, kernel);
+  return kernel;
+}
+
+void launch(CUfunction kernel, unsigned grid, unsigned block,
+            cudaStream_t stream, void **args) {
+  const CUresult r = cuLaunchKernel(kernel, grid, 1, 1, block, 1, 1, 0,
+                                    stream, args, nullptr);
+  if (r != CUDA_SUCCESS) {
+    const char *msg;
+    cuGetErrorString(r, &msg);
+    util::MPIPrintStreamError() << "Launching a runtime-compiled kernel "
+                                << "failed: " << msg;
+    throw std::exception();
+  }
+}
+
+} // namespace jit
+} // namespace util
+} // namespace distconv
@@ -0,0 +1,68 @@
+#include "distconv/util/logging.hpp"
+
+#include <cstdlib>
+#include <vector>
+
+namespace distconv {
+namespace util {
+
+namespace {
+
+// Levels turned off by DISTCONV_PRINT_<LEVEL>=0.
+unsigned char get_disabled_levels() {
+  const std::pair<const char *, h2::Logger::LogLevelType> vars[] = {
+    {"DISTCONV_PRINT_DEBUG", h2::Logger::DEBUG},
+    {"DISTCONV_PRINT_INFO", h2::Logger::INFO},
+    {"DISTCONV_PRINT_WARNING", h2::Logger::WARN},
+    {"DISTCONV_PRINT_ERROR", h2::Logger::ERROR},
+  };
+  unsigned char disabled = 0;
+  for (const auto &v: vars) {
+    const char *env = std::getenv(v.first);
+    if (env && std::atoi(env) == 0) {
+      disabled |= v.second;
+    }
+  }
+  return disabled;
+}
+
+struct Loggers {
+  // Same order as LogSubsystem.
+  h2::Logger loggers[5] = {
+    {"distconv", "stderr", "[%w] [%^%l%$] "},
+    {"distconv.tensor", "stderr", "[%w] [%^%l%$] "},
+    {"distconv.shuffle", "stderr", "[%w] [%^%l%$] "},
+    {"distconv.halo", "stderr", "[%w] [%^%l%$] "},
+    {"distconv.dnn", "stderr", "[%w] [%^%l%$] "},
+  };
+
+  Loggers() {
+    std::vector<h2::Logger*> all;
+    for (auto &l: loggers) {
+      all.push_back(&l);
+    }
+#ifdef DISTCONV_DEBUG
+    h2::setup_levels(all, "DISTCONV_LOG_LEVEL", h2::Logger::DEBUG);
+#else
+    h2::setup_levels(all, "DISTCONV_LOG_LEVEL", h2::Logger::INFO);
+#endif
+    if (std::getenv("DISTCONV_LOG_MASK")) {
+      h2::setup_masks(all, "DISTCONV_LOG_MASK");
+    }
+    const auto disabled = get_disabled_levels();
+    for (auto &l: loggers) {
+      l.set_mask(l.mask() & ~disabled);
+    }
+    h2::setup_async(all, "DISTCONV_LOG_ASYNC");
+  }
+};
+
+} // namespace
+
+h2::Logger &get_logger(LogSubsystem subsystem) {
+  static Loggers loggers;
+  return loggers.loggers[static_cast<int>(subsystem)];
+}
+
+} // namespace util
+} // namespace distconv
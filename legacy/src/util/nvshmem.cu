@@ -1,6 +1,9 @@
 #include "distconv/util/nvshmem.hpp"
 #include "distconv/util/util_mpi.hpp"
-#include "distconv/util/util_cuda.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+#include <algorithm>
+#include <iterator>
 
 namespace distconv {
 namespace util {
@@ -8,14 +11,28 @@ namespace nvshmem {
 
 #ifdef DISTCONV_HAS_NVSHMEM
 void initialize(MPI_Comm comm) {
+#ifdef DISTCONV_HAS_ROCSHMEM
+  // rocSHMEM always spans the world
+  int result;
+  DISTCONV_CHECK_MPI(MPI_Comm_compare(comm, MPI_COMM_WORLD, &result));
+  if (result != MPI_IDENT && result != MPI_CONGRUENT) {
+    util::MPIPrintStreamError()
+        << "rocSHMEM must be initialized with all processes";
+    throw std::exception();
+  }
+  util::MPIRootPrintStreamInfo() << "Initializing rocSHMEM";
+  ::rocshmem::rocshmem_init();
+#else
   util::MPIRootPrintStreamInfo() << "Initializing NVSHMEM with MPI";
   nvshmemx_init_attr_t attr;
   attr.mpi_comm = &comm;
   DISTCONV_CHECK_NVSHMEM(nvshmemx_init_attr(NVSHMEMX_INIT_WITH_MPI_COMM, &attr));
+#endif // DISTCONV_HAS_ROCSHMEM
 }
 
 void finalize() {
   util::MPIRootPrintStreamInfo() << "Finalizing NVSHMEM";
+  SymmetricHeap::get_instance().release();
   nvshmem_finalize();
 }
 
@@ -27,6 +44,143 @@ void launch_barrier(cudaStream_t s) {
   nvshmemx_barrier_all_on_stream(s);
 }
 
+SymmetricHeap &SymmetricHeap::get_instance() {
+  static SymmetricHeap heap;
+  return heap;
+}
+
+void SymmetricHeap::reserve(size_t size) {
+  m_reservations.push_back(
+      (std::max(size, (size_t)1) + alignment - 1) / alignment * alignment);
+}
+
+void SymmetricHeap::grow() {
+  // No peer may still access the freed buffers once all PEs are here
+  DISTCONV_CHECK_CUDA(cudaDeviceSynchronize());
+  barrier();
+  for (void *p: m_freed) {
+    for (auto &segment: m_segments) {
+      const auto offset = static_cast<char*>(p) - segment.base;
+      if (offset >= 0 && (size_t)offset < segment.size) {
+        insert_free_block(segment, offset, m_allocated[p]);
+        break;
+      }
+    }
+    m_allocated.erase(p);
+  }
+  m_freed.clear();
+  // Place the reservations on a copy of the free blocks to find out
+  // how much does not fit
+  auto segments = m_segments;
+  size_t size = 0;
+  for (auto s: m_reservations) {
+    if (!fit(segments, s)) {
+      size += s;
+    }
+  }
+  m_reservations.clear();
+  if (size == 0) return;
+  void *p = nvshmem_malloc(size);
+  if (p == nullptr) {
+    util::MPIPrintStreamError()
+        << "NVSHMEM allocation of " << size << " bytes ("
+        << size / 1024.0 / 1024.0 / 1024.0 << " GiB) failed";
+    throw std::exception();
+  }
+  util::MPIRootPrintStreamInfo()
+      << "Added a segment of " << size
+      << " bytes to the NVSHMEM symmetric heap";
+  m_segments.push_back(Segment{static_cast<char*>(p), size, {{0, size}}});
+}
+
+void *SymmetricHeap::allocate(size_t size) {
+  size = (std::max(size, (size_t)1) + alignment - 1) / alignment * alignment;
+  void *p = nullptr;
+  if (!fit(m_segments, size, &p)) {
+    util::MPIRootPrintStreamInfo()
+        << "Growing the NVSHMEM symmetric heap for an unreserved buffer of "
+        << size << " bytes";
+    reserve(size);
+    grow();
+    assert_always(fit(m_segments, size, &p));
+  }
+  m_allocated.emplace(p, size);
+  return p;
+}
+
+void SymmetricHeap::deallocate(void *p) {
+  // Buffers may outlive the heap released at finalization
+  if (m_segments.empty()) return;
+  assert_always(m_allocated.count(p) == 1);
+  m_freed.push_back(p);
+}
+
+void SymmetricHeap::release() {
+  for (auto &segment: m_segments) {
+    nvshmem_free(segment.base);
+  }
+  m_segments.clear();
+  m_reservations.clear();
+  m_allocated.clear();
+  m_freed.clear();
+}
+
+size_t SymmetricHeap::get_capacity() const {
+  size_t size = 0;
+  for (const auto &segment: m_segments) {
+    size += segment.size;
+  }
+  return size;
+}
+
+size_t SymmetricHeap::get_allocated_size() const {
+  size_t size = 0;
+  for (const auto &kv: m_allocated) {
+    size += kv.second;
+  }
+  return size;
+}
+
+// Carves size bytes out of the first free block large enough
+bool SymmetricHeap::fit(std::vector<Segment> &segments, size_t size,
+                        void **p) {
+  for (auto &segment: segments) {
+    for (auto it = segment.free_blocks.begin();
+         it != segment.free_blocks.end(); ++it) {
+      if (it->second < size) continue;
+      const size_t offset = it->first;
+      const size_t rest = it->second - size;
+      segment.free_blocks.erase(it);
+      if (rest > 0) {
+        segment.free_blocks.emplace(offset + size, rest);
+      }
+      if (p != nullptr) {
+        *p = segment.base + offset;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+void SymmetricHeap::insert_free_block(Segment &segment, size_t offset,
+                                      size_t size) {
+  auto &blocks = segment.free_blocks;
+  auto it = blocks.emplace(offset, size).first;
+  auto next = std::next(it);
+  if (next != blocks.end() && it->first + it->second == next->first) {
+    it->second += next->second;
+    blocks.erase(next);
+  }
+  if (it != blocks.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second == it->first) {
+      prev->second += it->second;
+      blocks.erase(it);
+    }
+  }
+}
+
 namespace internal {
 
 __global__ void sync_pairwise_kernel(int peer,
@@ -79,8 +233,9 @@ void PairwiseSync::alloc_buffers() {
     // already allocated
     return;
   }
+  auto &heap = SymmetricHeap::get_instance();
   CounterType *shmem_counter = static_cast<CounterType*>(
-      nvshmem_malloc(sizeof(CounterType)));
+      heap.allocate(sizeof(CounterType)));
   //util::MPIPrintStreamDebug() << "shmem flag: " << p;
   if (shmem_counter == nullptr) {
     util::MPIPrintStreamError() << "Allocation of shmem buffer failed";
@@ -91,7 +246,7 @@ void PairwiseSync::alloc_buffers() {
   DISTCONV_CHECK_CUDA(cudaStreamSynchronize(0));
   barrier();
   m_shmem_counter = std::shared_ptr<CounterType>(
-      shmem_counter, [](CounterType *ptr) { nvshmem_free(ptr); });
+      shmem_counter, [&heap](CounterType *ptr) { heap.deallocate(ptr); });
 
   // Setup the device counter variable
   CounterType *local_counter = nullptr;
@@ -163,24 +318,25 @@ void SyncArray::alloc_counters() {
     // nothing to allocate
     return;
   }
+  auto &heap = SymmetricHeap::get_instance();
   CounterType *shmem_counter = static_cast<CounterType*>(
-      nvshmem_malloc(sizeof(CounterType) * m_size));
+      heap.allocate(sizeof(CounterType) * m_size));
   //util::MPIPrintStreamDebug() << "shmem flag: " << p;
   if (shmem_counter == nullptr) {
     util::MPIPrintStreamError() << "Allocation of shmem buffer failed";
     throw std::exception();
   }
   m_shmem_counter = std::shared_ptr<CounterType>(
-      shmem_counter, [](CounterType *ptr) { nvshmem_free(ptr); });
+      shmem_counter, [&heap](CounterType *ptr) { heap.deallocate(ptr); });
   // Setup the device counter variable
   CounterType *local_counter = static_cast<CounterType*>(
-      nvshmem_malloc(sizeof(CounterType) * m_size));
+      heap.allocate(sizeof(CounterType) * m_size));
   if (shmem_counter == nullptr) {
     util::MPIPrintStreamError() << "Allocation of local buffer failed";
     throw std::exception();
   }
   m_local_counter = std::shared_ptr<CounterType>(
-      local_counter, [](CounterType *ptr) { nvshmem_free(ptr); });
+      local_counter, [&heap](CounterType *ptr) { heap.deallocate(ptr); });
   init_counters();
 }
 
@@ -199,6 +355,9 @@ void SyncArray::init_counters() {
 void SyncArray::ensure_size(size_t size) {
   if (m_size < size) {
     m_size = size;
+    // Replace the counters, which are returned to the heap
+    m_shmem_counter.reset();
+    m_local_counter.reset();
     alloc_counters();
   }
 }
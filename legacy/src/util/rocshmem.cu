@@ -0,0 +1,75 @@
+#include "distconv/util/nvshmem.hpp"
+#include "distconv/util/util_gpu.hpp"
+
+namespace distconv {
+namespace util {
+namespace nvshmem {
+
+namespace internal {
+
+constexpr int wg_size = 256;
+
+__global__ void barrier_all_kernel() {
+  ::rocshmem::rocshmem_barrier_all();
+}
+
+__global__ void putmem_kernel(void *dest, const void *source,
+                              size_t nelems, int pe) {
+  ::rocshmem::rocshmem_putmem_wg(dest, source, nelems, pe);
+  __syncthreads();
+  // Complete the put before the next work on the stream
+  if (threadIdx.x == 0) {
+    ::rocshmem::rocshmem_quiet();
+  }
+}
+
+#define DEFINE_SUM_REDUCE(TYPE)                                         \
+  __device__ void sum_reduce_wg(TYPE *dest, const TYPE *source,         \
+                                int nreduce) {                          \
+    ::rocshmem::rocshmem_ctx_##TYPE##_sum_wg_reduce(                    \
+        ::rocshmem::ROCSHMEM_CTX_DEFAULT, ::rocshmem::ROCSHMEM_TEAM_WORLD, \
+        dest, source, nreduce);                                         \
+  }
+DEFINE_SUM_REDUCE(float)
+DEFINE_SUM_REDUCE(double)
+DEFINE_SUM_REDUCE(int)
+DEFINE_SUM_REDUCE(long)
+#undef DEFINE_SUM_REDUCE
+
+template <typename DataType>
+__global__ void sum_reduce_kernel(DataType *dest, const DataType *source,
+                                  int nreduce) {
+  sum_reduce_wg(dest, source, nreduce);
+}
+
+} // namespace internal
+
+void barrier_all_on_stream(hipStream_t s) {
+  internal::barrier_all_kernel<<<1, 1, 0, s>>>();
+}
+
+void putmem_on_stream(void *dest, const void *source, size_t nelems,
+                      int pe, hipStream_t s) {
+  internal::putmem_kernel<<<1, internal::wg_size, 0, s>>>(
+      dest, source, nelems, pe);
+}
+
+template <typename DataType>
+void sum_reduce_on_stream(DataType *dest, const DataType *source,
+                          size_t nreduce, hipStream_t s) {
+  internal::sum_reduce_kernel<DataType><<<1, internal::wg_size, 0, s>>>(
+      dest, source, nreduce);
+}
+
+#define INSTANTIATE_SUM_REDUCE(TYPE)                                    \
+  template void sum_reduce_on_stream<TYPE>(                             \
+      TYPE *dest, const TYPE *source, size_t nreduce, hipStream_t s);
+INSTANTIATE_SUM_REDUCE(float)
+INSTANTIATE_SUM_REDUCE(double)
+INSTANTIATE_SUM_REDUCE(int)
+INSTANTIATE_SUM_REDUCE(long)
+#undef INSTANTIATE_SUM_REDUCE
+
+} // namespace nvshmem
+} // namespace util
+} // namespace distconv
@@ -0,0 +1,293 @@
+#include "distconv/util/topology.hpp"
+
+#include "distconv/runtime_gpu.hpp"
+#include "distconv/util/util_gpu.hpp"
+#include "distconv/util/util_mpi.hpp"
+
+#include "h2/gpu/runtime.hpp"
+
+#include <Al.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace distconv {
+namespace util {
+
+namespace {
+
+constexpr const char *file_magic = "distconv-topology";
+constexpr int file_version = 1;
+
+// Seconds per send/recv of bytes with the processes shift away
+double time_shift(Al::NCCLBackend::comm_type &comm, int shift,
+                  void *send_buf, void *recv_buf, std::size_t bytes,
+                  int num_trials) {
+  const int np = comm.size();
+  const int dst = (comm.rank() + shift) % np;
+  const int src = (comm.rank() - shift + np) % np;
+  auto run = [&]() {
+    Al::SendRecv<Al::NCCLBackend, unsigned char>(
+        static_cast<unsigned char*>(send_buf), bytes, dst,
+        static_cast<unsigned char*>(recv_buf), bytes, src, comm);
+  };
+  run();
+  h2::gpu::sync(comm.get_stream());
+  const double start = MPI_Wtime();
+  for (int i = 0; i < num_trials; ++i) {
+    run();
+  }
+  h2::gpu::sync(comm.get_stream());
+  return (MPI_Wtime() - start) / num_trials;
+}
+
+} // namespace
+
+std::vector<int> TopologyMap::get_nodes(MPI_Comm comm) {
+  int rank, np;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &rank));
+  DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &np));
+  MPI_Comm node_comm;
+  DISTCONV_CHECK_MPI(MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank,
+                                         MPI_INFO_NULL, &node_comm));
+  int node = rank;
+  DISTCONV_CHECK_MPI(MPI_Allreduce(MPI_IN_PLACE, &node, 1, MPI_INT, MPI_MIN,
+                                   node_comm));
+  DISTCONV_CHECK_MPI(MPI_Comm_free(&node_comm));
+  std::vector<int> nodes(np);
+  DISTCONV_CHECK_MPI(MPI_Allgather(&node, 1, MPI_INT, nodes.data(), 1,
+                                   MPI_INT, comm));
+  return nodes;
+}
+
+TopologyMap TopologyMap::profile(MPI_Comm comm, const Options &opts) {
+  assert_always(opts.large_bytes > opts.small_bytes);
+  int rank, np;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &rank));
+  DISTCONV_CHECK_MPI(MPI_Comm_size(comm, &np));
+  TopologyMap map;
+  map.m_nodes = get_nodes(comm);
+  map.m_links.resize(np * np);
+
+  auto stream = h2::gpu::make_stream();
+  std::vector<double> local;
+  {
+    Al::NCCLBackend::comm_type al_comm(comm, stream);
+    void *send_buf, *recv_buf;
+    DISTCONV_GPU_MALLOC(&send_buf, opts.large_bytes);
+    DISTCONV_GPU_MALLOC(&recv_buf, opts.large_bytes);
+    DISTCONV_CHECK_MPI(MPI_Barrier(comm));
+    const double start = MPI_Wtime();
+    double last_shift_time = 0;
+    for (int shift = 1; shift < np; ++shift) {
+      // Rank 0 decides for all to stay in step
+      int next = MPI_Wtime() - start + last_shift_time <= opts.budget;
+      DISTCONV_CHECK_MPI(MPI_Bcast(&next, 1, MPI_INT, 0, comm));
+      if (!next) break;
+      const double shift_start = MPI_Wtime();
+      const double t_small = time_shift(al_comm, shift, send_buf, recv_buf,
+                                        opts.small_bytes, opts.num_trials);
+      const double t_large = time_shift(al_comm, shift, send_buf, recv_buf,
+                                        opts.large_bytes, opts.num_trials);
+      local.push_back(t_small);
+      local.push_back(
+          t_large > t_small
+          ? (opts.large_bytes - opts.small_bytes) / (t_large - t_small)
+          : opts.large_bytes / t_large);
+      last_shift_time = MPI_Wtime() - shift_start;
+      ++map.m_num_shifts;
+    }
+    DISTCONV_CHECK_GPU(GPU_FREE(send_buf));
+    DISTCONV_CHECK_GPU(GPU_FREE(recv_buf));
+  }
+  h2::gpu::destroy(stream);
+
+  const int num_values = map.m_num_shifts * 2;
+  std::vector<double> all(num_values * np);
+  DISTCONV_CHECK_MPI(MPI_Allgather(local.data(), num_values, MPI_DOUBLE,
+                                   all.data(), num_values, MPI_DOUBLE, comm));
+  for (int src = 0; src < np; ++src) {
+    for (int s = 0; s < map.m_num_shifts; ++s) {
+      auto &link = map.m_links[src * np + (src + s + 1) % np];
+      link.latency = all[src * num_values + s * 2];
+      link.bandwidth = all[src * num_values + s * 2 + 1];
+      link.measured = true;
+    }
+  }
+  map.estimate_unmeasured();
+  util::MPIRootPrintStreamInfo()
+      << "Profiled the topology of " << np << " processes with "
+      << map.m_num_shifts << " shifts";
+  return map;
+}
+
+void TopologyMap::estimate_unmeasured() {
+  const int np = get_size();
+  // Sums of the latencies and bandwidths, and counts, of the measured
+  // intra- and inter-node links
+  double sums[2][2] = {{0, 0}, {0, 0}};
+  int counts[2] = {0, 0};
+  for (int src = 0; src < np; ++src) {
+    for (int dst = 0; dst < np; ++dst) {
+      const auto &link = get_link(src, dst);
+      if (!link.measured) continue;
+      const int kind = is_intra_node(src, dst) ? 0 : 1;
+      sums[kind][0] += link.latency;
+      sums[kind][1] += link.bandwidth;
+      ++counts[kind];
+    }
+  }
+  for (int src = 0; src < np; ++src) {
+    for (int dst = 0; dst < np; ++dst) {
+      auto &link = m_links[src * np + dst];
+      if (link.measured || src == dst) continue;
+      // Links are mostly symmetric
+      const auto &reverse = get_link(dst, src);
+      if (reverse.measured) {
+        link.latency = reverse.latency;
+        link.bandwidth = reverse.bandwidth;
+        continue;
+      }
+      const int kind = is_intra_node(src, dst) ? 0 : 1;
+      if (counts[kind] > 0) {
+        link.latency = sums[kind][0] / counts[kind];
+        link.bandwidth = sums[kind][1] / counts[kind];
+      }
+    }
+  }
+}
+
+TopologyMap TopologyMap::load_or_profile(MPI_Comm comm,
+                                         const std::string &path,
+                                         const Options &opts) {
+  int rank;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &rank));
+  const auto nodes = get_nodes(comm);
+  TopologyMap map;
+  int loaded = 0;
+  if (rank == 0) {
+    std::ifstream ifs(path);
+    loaded = ifs && map.load(ifs) && map.m_nodes == nodes;
+  }
+  DISTCONV_CHECK_MPI(MPI_Bcast(&loaded, 1, MPI_INT, 0, comm));
+  if (loaded) {
+    map.bcast(comm);
+    util::MPIRootPrintStreamInfo() << "Loaded the topology from " << path;
+    return map;
+  }
+  map = profile(comm, opts);
+  if (rank == 0) {
+    std::ofstream ofs(path);
+    if (ofs) {
+      map.save(ofs);
+    } else {
+      util::MPIPrintStreamWarning() << "Cannot save the topology to " << path;
+    }
+  }
+  return map;
+}
+
+std::string TopologyMap::get_default_cache_path() {
+  if (const char *env = std::getenv("DISTCONV_TOPOLOGY_CACHE")) {
+    return env;
+  }
+  std::string job = "local";
+  for (const char *var: {"SLURM_JOB_ID", "LSB_JOBID", "FLUX_JOB_ID",
+                         "PBS_JOBID"}) {
+    if (const char *env = std::getenv(var)) {
+      job = env;
+      break;
+    }
+  }
+  return "distconv_topology_" + job + ".txt";
+}
+
+double TopologyMap::estimate_time(int src, int dst, std::size_t bytes) const {
+  if (src == dst) return 0;
+  const auto &link = get_link(src, dst);
+  if (link.bandwidth <= 0) return std::numeric_limits<double>::infinity();
+  return link.latency + bytes / link.bandwidth;
+}
+
+double TopologyMap::estimate_ring_step_time(const std::vector<int> &ranks,
+                                            std::size_t bytes) const {
+  double t = 0;
+  for (std::size_t i = 0; i < ranks.size(); ++i) {
+    t = std::max(t, estimate_time(ranks[i], ranks[(i + 1) % ranks.size()],
+                                  bytes));
+  }
+  return t;
+}
+
+void TopologyMap::save(std::ostream &os) const {
+  const int np = get_size();
+  const auto flags = os.flags();
+  const auto precision = os.precision(17);
+  os << file_magic << " " << file_version << "\n"
+     << np << " " << m_num_shifts << "\n";
+  for (int i = 0; i < np; ++i) {
+    os << m_nodes[i] << (i + 1 < np ? " " : "\n");
+  }
+  for (const auto &link: m_links) {
+    os << link.latency << " " << link.bandwidth << " " << link.measured
+       << "\n";
+  }
+  os.precision(precision);
+  os.flags(flags);
+}
+
+bool TopologyMap::load(std::istream &is) {
+  std::string magic;
+  int version, np, num_shifts;
+  if (!(is >> magic >> version >> np >> num_shifts) || magic != file_magic ||
+      version != file_version || np <= 0) {
+    return false;
+  }
+  std::vector<int> nodes(np);
+  for (auto &n: nodes) {
+    if (!(is >> n)) return false;
+  }
+  std::vector<Link> links(np * np);
+  for (auto &link: links) {
+    if (!(is >> link.latency >> link.bandwidth >> link.measured)) {
+      return false;
+    }
+  }
+  m_nodes = std::move(nodes);
+  m_links = std::move(links);
+  m_num_shifts = num_shifts;
+  return true;
+}
+
+void TopologyMap::bcast(MPI_Comm comm) {
+  int rank;
+  DISTCONV_CHECK_MPI(MPI_Comm_rank(comm, &rank));
+  int header[2] = {get_size(), m_num_shifts};
+  DISTCONV_CHECK_MPI(MPI_Bcast(header, 2, MPI_INT, 0, comm));
+  const int np = header[0];
+  m_num_shifts = header[1];
+  m_nodes.resize(np);
+  DISTCONV_CHECK_MPI(MPI_Bcast(m_nodes.data(), np, MPI_INT, 0, comm));
+  std::vector<double> values(np * np * 3);
+  if (rank == 0) {
+    for (int i = 0; i < np * np; ++i) {
+      values[i * 3] = m_links[i].latency;
+      values[i * 3 + 1] = m_links[i].bandwidth;
+      values[i * 3 + 2] = m_links[i].measured;
+    }
+  }
+  DISTCONV_CHECK_MPI(MPI_Bcast(values.data(), values.size(), MPI_DOUBLE, 0,
+                               comm));
+  m_links.resize(np * np);
+  for (int i = 0; i < np * np; ++i) {
+    m_links[i].latency = values[i * 3];
+    m_links[i].bandwidth = values[i * 3 + 1];
+    m_links[i].measured = values[i * 3 + 2] != 0;
+  }
+}
+
+} // namespace util
+} // namespace distconv
@@ -1,5 +1,8 @@
 #include "distconv/util/util_cuda.hpp"
 
+#include "h2/gpu/runtime.hpp"
+
+#include <cstring>
 #include <string>
 
 namespace distconv {
@@ -136,14 +139,29 @@ void sync_stream(cudaStream_t s1, cudaStream_t s2) {
   DISTCONV_CHECK_CUDA(cudaStreamWaitEvent(s1, ev2, 0));
 }
 
+h2::gpu::PooledEvent record_pooled_event(cudaStream_t s) {
+  auto ev = h2::gpu::acquire_event_notiming();
+  DISTCONV_CHECK_CUDA(cudaEventRecord(ev, s));
+  return ev;
+}
+
+bool is_synchronous() {
+  static const bool synchronous = [] {
+    const char *env = std::getenv("DISTCONV_SYNCHRONOUS");
+    return env && std::strlen(env) && env[0] != '0';
+  }();
+  return synchronous;
+}
+
+void sync_if_synchronous(cudaStream_t s) {
+  if (is_synchronous()) {
+    h2::gpu::sync(s);
+  }
+}
+
 cudaStream_t create_priority_stream() {
-  int least_priority, greatest_priority;
-  cudaStream_t s;
-  DISTCONV_CHECK_CUDA(cudaDeviceGetStreamPriorityRange(
-      &least_priority, &greatest_priority));
-  DISTCONV_CHECK_CUDA(cudaStreamCreateWithPriority(
-      &s, cudaStreamNonBlocking, greatest_priority));
-  return s;
+  return h2::gpu::make_stream_with_priority(
+      h2::gpu::stream_priority_range().greatest);
 }
 
 } // namespace util
@@ -9,6 +9,7 @@
 #include "h2/gpu/memory_utils.hpp"
 #include "h2/gpu/runtime.hpp"
 
+#include <cstring>
 #include <iostream>
 #include <string>
 
@@ -176,15 +177,34 @@ void sync_stream(hipStream_t const s1, hipStream_t const s2)
     DISTCONV_CHECK_HIP(hipStreamWaitEvent(s1, ev2, 0));
 }
 
+h2::gpu::PooledEvent record_pooled_event(hipStream_t const s)
+{
+    auto ev = h2::gpu::acquire_event_notiming();
+    DISTCONV_CHECK_HIP(hipEventRecord(ev, s));
+    return ev;
+}
+
+bool is_synchronous()
+{
+    static bool const synchronous = [] {
+        char const* const env = std::getenv("DISTCONV_SYNCHRONOUS");
+        return env && std::strlen(env) && env[0] != '0';
+    }();
+    return synchronous;
+}
+
+void sync_if_synchronous(hipStream_t const s)
+{
+    if (is_synchronous())
+    {
+        h2::gpu::sync(s);
+    }
+}
+
 hipStream_t create_priority_stream()
 {
-    int least_priority, greatest_priority;
-    hipStream_t s;
-    DISTCONV_CHECK_HIP(
-        hipDeviceGetStreamPriorityRange(&least_priority, &greatest_priority));
-    DISTCONV_CHECK_HIP(hipStreamCreateWithPriority(
-        &s, hipStreamNonBlocking, greatest_priority));
-    return s;
+    return h2::gpu::make_stream_with_priority(
+        h2::gpu::stream_priority_range().greatest);
 }
 
 } // namespace util
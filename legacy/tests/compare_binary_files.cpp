@@ -7,8 +7,22 @@
 #include <iterator>
 #include <cstdlib>
 
+#include "distconv/tensor/tensor_file_format.hpp"
 #include "distconv/util/util.hpp"
 
+// Offset of the elements, skipping the header of tensor files written
+// by distconv::tensor::WriteFile
+std::streamoff get_data_offset(std::ifstream &f) {
+  distconv::tensor::TensorFileHeader h;
+  std::vector<int64_t> shape;
+  std::streamoff offset = 0;
+  if (distconv::tensor::read_tensor_file_header(f, h, shape)) {
+    offset = h.data_offset;
+  }
+  f.clear();
+  return offset;
+}
+
 template <typename T>
 size_t compare(T threshold, std::string path1, std::string path2) {
   std::ifstream f1, f2;
@@ -23,17 +37,19 @@ size_t compare(T threshold, std::string path1, std::string path2) {
     std::exit(1);
   }
 
+  const auto offset1 = get_data_offset(f1);
+  const auto offset2 = get_data_offset(f2);
   f1.seekg(0, f1.end);
-  auto len1 = f1.tellg();
+  auto len1 = f1.tellg() - offset1;
   f2.seekg(0, f2.end);
-  auto len2 = f2.tellg();
+  auto len2 = f2.tellg() - offset2;
   if (len1 != len2) {
     std::cerr << "File length not equal.\n";
     std::exit(1);
   }
 
-  f1.seekg(0);
-  f2.seekg(0);
+  f1.seekg(offset1);
+  f2.seekg(offset2);
   T max_diff = 0;
   size_t mismatch_count = 0;
   while (true) {
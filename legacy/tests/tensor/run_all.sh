@@ -21,7 +21,8 @@ export MV2_USE_CUDA=1
 ####################################################
 TEST_PROC=(test_tensor)
 TEST_CUDA=(test_tensor_cuda)
-TEST_MPI=(test_tensor_mpi test_tensor_mpi_copy)
+TEST_MPI=(test_tensor_mpi test_tensor_mpi_copy test_halo_exchange_host
+		 test_deep_halo_host)
 TEST_MPI_CUDA=(test_tensor_mpi_cuda test_tensor_mpi_cuda_copy
 			   test_tensor_mpi_cuda_shuffle
 			   test_tensor_mpi_cuda_algorithms
@@ -120,7 +121,9 @@ function run_test_mpi() {
 	for t in ${TEST_MPI[*]}; do
 		echo "Running $t"
 		local args=""
-		if [[ $t = test_tensor_mpi_copy ]]; then
+		if [[ $t = test_tensor_mpi_copy ||
+				  $t = test_halo_exchange_host ||
+				  $t = test_deep_halo_host ]]; then
 			args+="$PX $PY"
 		fi
 		mpi_run ./$t $args
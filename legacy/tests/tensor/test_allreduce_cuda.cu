@@ -32,6 +32,8 @@ static std::vector<std::string> nvshmem_methods = {
   "AllreduceNVSHMEMRecursiveDoubling",
   "AllreduceNVSHMEMRecursiveDoublingBuffered",
   "AllreduceNVSHMEMRecursiveDoublingBlock",
+  "AllreduceNVSHMEMRing",
+  "AllreduceNVSHMEMAuto",
 };
 #endif
 
@@ -163,6 +165,12 @@ make_reducer(const std::string name, MPI_Comm comm, DeviceStream stream)
   } else if (name == "AllreduceNVSHMEMRecursiveDoublingBlock") {
     return std::make_unique<tensor::AllreduceNVSHMEM<DataType>>(
         stream, tensor::AllreduceNVSHMEM<DataType>::RECURSIVE_DOUBLING_BLOCK);
+  } else if (name == "AllreduceNVSHMEMRing") {
+    return std::make_unique<tensor::AllreduceNVSHMEM<DataType>>(
+        stream, tensor::AllreduceNVSHMEM<DataType>::RING);
+  } else if (name == "AllreduceNVSHMEMAuto") {
+    return std::make_unique<tensor::AllreduceNVSHMEM<DataType>>(
+        stream, tensor::AllreduceNVSHMEM<DataType>::AUTO);
 #endif // DISTCONV_HAS_NVSHMEM
   } else {
     util::MPIRootPrintStreamError() << "Unknown allreducer name: '" << name << "'";
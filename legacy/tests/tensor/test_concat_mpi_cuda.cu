@@ -129,6 +129,92 @@ inline int test_concat(const Shape &dst_shape,
   return num_errors;
 }
 
+template <typename TensorType>
+inline int test_concat_n(const Shape &dst_shape,
+                         const Distribution &dst_dist,
+                         const std::vector<Shape> &src_shapes,
+                         const Distribution &src_dist,
+                         int concat_dim) {
+  const int num_dims = dst_shape.num_dims();
+  using DataType = typename TensorType::data_type;
+  using LocaleType = typename TensorType::locale_type;
+  using TensorProcType = Tensor<DataType, LocaleProcess, BaseAllocator>;
+  LocaleType loc = get_locale<LocaleType>();
+  TensorType dst = get_tensor<TensorType>(dst_shape, loc, dst_dist);
+  assert0(dst.allocate());
+  dst.zero();
+
+  std::vector<TensorType> srcs;
+  srcs.reserve(src_shapes.size());
+  for (const auto &shape: src_shapes) {
+    srcs.push_back(get_tensor<TensorType>(shape, loc, src_dist));
+  }
+  std::vector<const TensorType*> src_ptrs;
+  std::vector<TensorType*> slice_ptrs;
+  for (size_t i = 0; i < srcs.size(); ++i) {
+    assert0(srcs[i].allocate());
+    auto size = srcs[i].get_local_real_size();
+    std::vector<DataType> init(size, static_cast<DataType>(i + 1));
+    h2::gpu::mem_copy(srcs[i].get_buffer(), init.data(), size);
+    src_ptrs.push_back(&srcs[i]);
+    slice_ptrs.push_back(&srcs[i]);
+  }
+  util::MPIRootPrintStreamInfo()
+      << "Concatenating " << srcs.size() << " tensors along dimension "
+      << concat_dim;
+
+  assert0(Concatenate(dst, src_ptrs, 0));
+  h2::gpu::sync();
+  MPI_Barrier(MPI_COMM_WORLD);
+
+  auto proc_dist = Distribution::make_localized_distribution(num_dims);
+  int num_errors = 0;
+  TensorProcType dst_host(LocaleProcess(), proc_dist);
+  assert0(tensor::Copy(dst_host, dst, 0));
+  if (loc.get_rank() == 0) {
+    for (auto it = dst_host.get_shape().index_begin();
+         it != dst_host.get_shape().index_end(); ++it) {
+      auto idx = *it;
+      size_t part = 0;
+      index_t end = src_shapes[0][concat_dim];
+      while (idx[concat_dim] >= end) {
+        end += src_shapes[++part][concat_dim];
+      }
+      DataType ref = static_cast<DataType>(part + 1);
+      if (dst_host.get(idx) != ref) {
+        util::MPIPrintStreamError() << "Error! Mismatch at " << idx
+                                    << ". Computed: " << dst_host.get(idx)
+                                    << ", ref: " << ref;
+        ++num_errors;
+      }
+    }
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+
+  for (auto &src: srcs) src.zero();
+  assert0(Slice(slice_ptrs, dst, 0));
+  h2::gpu::sync();
+  MPI_Barrier(MPI_COMM_WORLD);
+  for (size_t i = 0; i < srcs.size(); ++i) {
+    TensorProcType host(LocaleProcess(), proc_dist);
+    assert0(tensor::Copy(host, srcs[i], 0));
+    if (loc.get_rank() == 0) {
+      for (auto it = host.get_shape().index_begin();
+           it != host.get_shape().index_end(); ++it) {
+        if (host.get(*it) != static_cast<DataType>(i + 1)) {
+          util::MPIPrintStreamError() << "Error! Mismatch at " << *it
+                                      << " of slice " << i
+                                      << ". Computed: " << host.get(*it);
+          ++num_errors;
+        }
+      }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+  }
+
+  return num_errors;
+}
+
 int main(int argc, char *argv[]) {
     h2::gpu::set_gpu(util::choose_gpu());
     MPI_Init(&argc, &argv);
@@ -164,6 +250,24 @@ int main(int argc, char *argv[]) {
                                     src2_shape,
                                     overlapped_dist));
 
+    // concat three tensors along the outermost undistributed dimension
+    assert0(test_concat_n<TensorType>(
+        Shape({32, 32, 32, 6, np}),
+        overlapped_dist,
+        {Shape({32, 32, 32, 1, np}),
+         Shape({32, 32, 32, 3, np}),
+         Shape({32, 32, 32, 2, np})},
+        non_overlapped_dist,
+        3));
+    // concat along the innermost dimension
+    auto width_dist = Distribution::make_distribution({1, 1, 2, 1, np / 2});
+    assert0(test_concat_n<TensorType>(
+        Shape({24, 8, 8, 2, np}),
+        width_dist,
+        {Shape({8, 8, 8, 2, np}), Shape({16, 8, 8, 2, np})},
+        width_dist,
+        0));
+
     MPI_Barrier(MPI_COMM_WORLD);
     MPIRootPrintStreamInfo() << "Completed successfully.";
 
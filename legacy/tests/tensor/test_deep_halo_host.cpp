@@ -0,0 +1,265 @@
+#include "distconv/distconv.hpp"
+#include "distconv/util/util_mpi.hpp"
+#include "test_tensor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace distconv;
+using namespace distconv::tensor;
+
+using DataType = double;
+using TensorMPI = Tensor<DataType, LocaleMPI, BaseAllocator>;
+using ConvolutionType = Convolution<cpu::Backend, DataType>;
+using PoolingType = Pooling<cpu::Backend, DataType>;
+
+constexpr int num_dims = 4;
+constexpr int num_spatial_dims = 2;
+constexpr int num_channels = 2;
+
+// A layer of a chain: a same-padded convolution with a 3x3 filter
+// and dilation, or a 3x3 max pooling
+struct LayerConfig {
+  bool pooling;
+  int dilation;
+
+  int get_radius() const {
+    return dilation;
+  }
+};
+
+template <>
+inline LocaleMPI get_locale<LocaleMPI>() {
+  LocaleMPI loc(MPI_COMM_WORLD);
+  return loc;
+}
+
+template <typename F>
+void for_each_real_index(const TensorMPI &t, F &&f) {
+  const auto real_shape = t.get_local_real_shape();
+  for (index_t i = 0; i < real_shape.get_size(); ++i) {
+    IndexVector idx(t.get_num_dims(), 0);
+    index_t rem = i;
+    for (int d = 0; d < t.get_num_dims(); ++d) {
+      idx[d] = rem % real_shape[d];
+      rem /= real_shape[d];
+    }
+    // The real region is dense as rows are not padded
+    f(idx, i);
+  }
+}
+
+bool is_interior(const TensorMPI &t, const IndexVector &real_idx) {
+  for (int i = 0; i < t.get_num_dims(); ++i) {
+    const index_t h = t.get_halo_width(i);
+    if (real_idx[i] < h || real_idx[i] >= h + t.get_local_shape()[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+IndexVector get_global_index(const TensorMPI &t, const IndexVector &real_idx) {
+  IndexVector idx(real_idx);
+  for (int i = 0; i < t.get_num_dims(); ++i) {
+    idx[i] = t.get_global_index(i, 0) + real_idx[i] - t.get_halo_width(i);
+  }
+  return idx;
+}
+
+// Values that only depend on the global index, with zero halos
+void init(TensorMPI &t, int seed) {
+  DataType *buf = t.get_buffer();
+  for_each_real_index(t, [&](const IndexVector &idx, index_t offset) {
+      if (!is_interior(t, idx)) {
+        buf[offset] = 0;
+        return;
+      }
+      const auto g = get_global_index(t, idx);
+      const index_t v = g[0] * 7 + g[1] * 13 + g[2] * 3 + g[3] * 5 + seed;
+      buf[offset] = (DataType)(v % 17) / 17 - 0.5;
+    });
+}
+
+TensorMPI make_tensor(const Shape &shape, const Shape &locale_shape,
+                      const int_vector &halo) {
+  IntVector overlap(num_dims, 0);
+  for (int i = 0; i < num_spatial_dims; ++i) {
+    if (locale_shape[i] > 1) {
+      overlap[i] = halo[i];
+    }
+  }
+  auto loc = get_locale<LocaleMPI>();
+  auto t = get_tensor<TensorMPI>(
+      shape, loc,
+      Distribution::make_overlapped_distribution(locale_shape, overlap));
+  assert0(t.allocate());
+  init(t, 0);
+  return t;
+}
+
+// The filters are replicated on all processes
+TensorMPI make_filter(const Shape &locale_shape, int seed) {
+  auto loc = get_locale<LocaleMPI>();
+  auto t = get_tensor<TensorMPI>(
+      Shape({3, 3, num_channels, num_channels}), loc,
+      Distribution::make_shared_distribution(locale_shape));
+  assert0(t.allocate());
+  init(t, seed);
+  return t;
+}
+
+/*
+  Runs a chain of layers forward and, if backward, convolutions
+  backward through the data, and returns the final output or the
+  input gradient. With deep, the chain exchanges halos once in each
+  direction; otherwise, each layer exchanges its own.
+ */
+TensorMPI run_chain(const std::vector<LayerConfig> &layers,
+                    const Shape &shape, const Shape &locale_shape,
+                    bool deep, bool backward) {
+  const int n = layers.size();
+  std::vector<int_vector> radii;
+  for (const auto &l: layers) {
+    radii.push_back(int_vector(num_spatial_dims, l.get_radius()));
+  }
+  cpu::DeepHaloPlan plan(radii, backward);
+  cpu::Backend be;
+  std::vector<TensorMPI> xs, dxs, filters;
+  for (int t = 0; t <= n; ++t) {
+    int_vector halo(num_spatial_dims, 0);
+    if (deep) {
+      halo = plan.get_halo_width(t);
+    } else {
+      // Read by the forward pass of layer t and the backward pass of
+      // layer t-1
+      for (int i = 0; i < num_spatial_dims; ++i) {
+        if (t < n) halo[i] = std::max(halo[i], radii[t][i]);
+        if (t > 0) halo[i] = std::max(halo[i], radii[t - 1][i]);
+      }
+    }
+    xs.push_back(make_tensor(shape, locale_shape, halo));
+    dxs.push_back(make_tensor(shape, locale_shape, halo));
+  }
+  std::vector<std::unique_ptr<ConvolutionType>> convs(n);
+  std::vector<std::unique_ptr<PoolingType>> pools(n);
+  for (int i = 0; i < n; ++i) {
+    filters.push_back(make_filter(locale_shape, i + 1));
+  }
+  for (int i = 0; i < n; ++i) {
+    const int r = layers[i].get_radius();
+    if (layers[i].pooling) {
+      pools[i] = util::make_unique<PoolingType>(be, num_dims);
+      pools[i]->setup(xs[i], xs[i + 1], dxs[i], dxs[i + 1],
+                      int_vector(num_spatial_dims, 3),
+                      int_vector(num_spatial_dims, r),
+                      int_vector(num_spatial_dims, 1), "MAX");
+      if (deep) pools[i]->set_deep_halo(plan, i);
+    } else {
+      convs[i] = util::make_unique<ConvolutionType>(be, num_dims);
+      convs[i]->setup(xs[i], filters[i], xs[i + 1], dxs[i], filters[i],
+                      dxs[i + 1], int_vector(num_spatial_dims, r),
+                      int_vector(num_spatial_dims, 1),
+                      int_vector(num_spatial_dims, layers[i].dilation), 1,
+                      "DEFAULT", "DEFAULT", "DEFAULT", 0);
+      if (deep) convs[i]->set_deep_halo(plan, i);
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    if (layers[i].pooling) {
+      pools[i]->forward(1.0, xs[i], 0.0, xs[i + 1]);
+    } else {
+      convs[i]->forward(1.0, xs[i], filters[i], 0.0, xs[i + 1]);
+    }
+  }
+  if (!backward) {
+    return xs[n];
+  }
+  init(dxs[n], 1);
+  for (int i = n - 1; i >= 0; --i) {
+    convs[i]->backward_data(1.0, filters[i], dxs[i + 1], 0.0, dxs[i]);
+  }
+  return dxs[0];
+}
+
+// Number of interior elements of x that differ from those of ref
+int compare(const TensorMPI &x, const TensorMPI &ref) {
+  const DataType *x_buf = x.get_const_buffer();
+  const DataType *ref_buf = ref.get_const_buffer();
+  std::vector<DataType> ref_interior;
+  for_each_real_index(ref, [&](const IndexVector &idx, index_t offset) {
+      if (is_interior(ref, idx)) ref_interior.push_back(ref_buf[offset]);
+    });
+  int num_errors = 0;
+  size_t i = 0;
+  for_each_real_index(x, [&](const IndexVector &idx, index_t offset) {
+      if (!is_interior(x, idx)) return;
+      // The chains compute the same sums, but the tiles of the
+      // kernels may split them differently
+      const DataType ref_v = ref_interior[i];
+      if (std::abs(x_buf[offset] - ref_v) > 1e-12 * (1 + std::abs(ref_v))
+          && num_errors++ < 10) {
+        util::MPIPrintStreamError()
+            << "Mismatch at " << get_global_index(x, idx)
+            << "; ref: " << ref_v << ", stored: "
+            << x_buf[offset];
+      }
+      ++i;
+    });
+  return num_errors;
+}
+
+int test_chain(const std::vector<LayerConfig> &layers, const Shape &shape,
+               const Shape &locale_shape, bool backward) {
+  const auto ref = run_chain(layers, shape, locale_shape, false, backward);
+  const auto x = run_chain(layers, shape, locale_shape, true, backward);
+  return compare(x, ref);
+}
+
+/*
+  Usage: mpirun -np N ./test_deep_halo_host px py, where px * py
+  divides N
+ */
+int main(int argc, char *argv[]) {
+  MPI_Init(&argc, &argv);
+  int pid;
+  int np;
+  MPI_Comm_rank(MPI_COMM_WORLD, &pid);
+  MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+  if (argc != 3) {
+    if (pid == 0) {
+      std::cerr << "Error! Usage: " << argv[0] << " proc_x proc_y\n";
+    }
+    MPI_Finalize();
+    exit(1);
+  }
+
+  const int px = atoi(argv[1]);
+  const int py = atoi(argv[2]);
+  assert0(np % (px * py));
+  const int pn = np / (px * py);
+  const Shape locale_shape({px, py, 1, pn});
+  const Shape shape({13, 16, num_channels, pn * 2});
+
+  int num_errors = 0;
+  const std::vector<LayerConfig> conv_chain = {
+    {false, 1}, {false, 2}, {false, 1}};
+  util::MPIRootPrintStreamInfo() << "Test: convolutions, forward";
+  num_errors += test_chain(conv_chain, shape, locale_shape, false);
+  util::MPIRootPrintStreamInfo() << "Test: convolutions, backward";
+  num_errors += test_chain(conv_chain, shape, locale_shape, true);
+  util::MPIRootPrintStreamInfo() << "Test: convolutions and pooling";
+  num_errors += test_chain({{false, 1}, {false, 2}, {true, 1}},
+                           shape, locale_shape, false);
+
+  int total_errors = 0;
+  MPI_Allreduce(&num_errors, &total_errors, 1, MPI_INT, MPI_SUM,
+                MPI_COMM_WORLD);
+  util::MPIRootPrintStreamInfo() << "Number of errors: " << total_errors;
+  MPI_Finalize();
+  return total_errors == 0 ? 0 : 1;
+}
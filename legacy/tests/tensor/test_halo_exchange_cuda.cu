@@ -12,6 +12,7 @@
 #include "distconv/tensor/halo_exchange_cuda.hpp"
 #include "distconv/tensor/halo_exchange_cuda_mpi.hpp"
 #include "distconv/tensor/halo_exchange_cuda_al.hpp"
+#include "distconv/tensor/halo_exchange_cuda_graph.hpp"
 #ifdef DISTCONV_HAS_P2P
 #include "distconv/tensor/halo_exchange_cuda_p2p.hpp"
 #include "distconv/tensor/halo_exchange_cuda_hybrid.hpp"
@@ -109,6 +110,7 @@ __global__ void check_tensor(const DataType *buf,
                              const Array<ND> global_shape,
                              const Array<ND> global_index_base,
                              int check_dim,
+                             int periodic,
                              int *error_counter);
 
 template <>
@@ -119,6 +121,7 @@ __global__ void check_tensor<4>(const DataType *buf,
                                 const Array<4> global_shape,
                                 const Array<4> global_index_base,
                                 int dim,
+                                int periodic,
                                 int *error_counter) {
   auto local_real_shape = local_shape + halo * 2;
   auto halo_shape = local_real_shape;
@@ -134,7 +137,10 @@ __global__ void check_tensor<4>(const DataType *buf,
                 local_idx, local_real_shape, pitch);
             bool skip = false;
             for (int d = 0; d < 4; ++d) {
-              if (global_index_base[d] + local_idx[d] < halo[d]) {
+              // Halos of periodic dimensions wrap around
+              if (periodic & (1 << d)) {
+                continue;
+              } else if (global_index_base[d] + local_idx[d] < halo[d]) {
                 skip = true;
                 continue;
               } else if (global_index_base[d] + local_idx[d] - halo[d] >= global_shape[d]) {
@@ -144,6 +150,12 @@ __global__ void check_tensor<4>(const DataType *buf,
             }
             if (skip) continue;
             auto global_idx = global_index_base + local_idx - halo;
+            for (int d = 0; d < 4; ++d) {
+              if (periodic & (1 << d)) {
+                global_idx[d] = (global_index_base[d] + local_idx[d]
+                                 + global_shape[d] - halo[d]) % global_shape[d];
+              }
+            }
             size_t global_offset = get_offset(global_idx, global_shape);
             auto stored = buf[local_offset];
             if (stored != global_offset) {
@@ -177,6 +189,7 @@ __global__ void check_tensor<5>(const DataType *buf,
                                 const Array<5> global_shape,
                                 const Array<5> global_index_base,
                                 int dim,
+                                int periodic,
                                 int *error_counter) {
   auto local_real_shape = local_shape + halo * 2;
   auto halo_shape = local_real_shape;
@@ -193,7 +206,10 @@ __global__ void check_tensor<5>(const DataType *buf,
                   local_idx, local_real_shape, pitch);
               bool skip = false;
               for (int d = 0; d < 5; ++d) {
-                if (global_index_base[d] + local_idx[d] < halo[d]) {
+                // Halos of periodic dimensions wrap around
+                if (periodic & (1 << d)) {
+                  continue;
+                } else if (global_index_base[d] + local_idx[d] < halo[d]) {
                   skip = true;
                   continue;
                 } else if (global_index_base[d] + local_idx[d] - halo[d] >= global_shape[d]) {
@@ -203,6 +219,12 @@ __global__ void check_tensor<5>(const DataType *buf,
               }
               if (skip) continue;
               auto global_idx = global_index_base + local_idx - halo;
+              for (int d = 0; d < 5; ++d) {
+                if (periodic & (1 << d)) {
+                  global_idx[d] = (global_index_base[d] + local_idx[d]
+                                   + global_shape[d] - halo[d]) % global_shape[d];
+                }
+              }
               size_t global_offset = get_offset(global_idx, global_shape);
               auto stored = buf[local_offset];
               if (stored != global_offset) {
@@ -537,6 +559,13 @@ int test_halo_exchange(const Array<ND> &shape,
                                     Al::NCCLBackend>(tensor);
       util::MPIRootPrintStreamInfo() << "HaloExchangeAL created";
       break;
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+    case HaloExchangeMethod::AL_GRAPH:
+      halo_exc = new HaloExchangeGraph<HaloExchangeAL<
+        DataType, CUDAAllocator, Al::NCCLBackend>>(tensor);
+      util::MPIRootPrintStreamInfo() << "HaloExchangeGraph<AL> created";
+      break;
+#endif // DISTCONV_HAS_CUDA_GRAPH
 #ifdef DISTCONV_HAS_P2P
     case HaloExchangeMethod::P2P:
       halo_exc = new HaloExchangeP2P<
@@ -579,7 +608,11 @@ int test_halo_exchange(const Array<ND> &shape,
       std::abort();
   }
 
-  halo_exc->exchange(comms, stream_main, false, true, false, false);
+  // Exchanging again gives the same halos; graph methods capture the
+  // second exchange and replay the third
+  for (int i = 0; i < 3; ++i) {
+    halo_exc->exchange(comms, stream_main, false, true, false, false);
+  }
 
   sync(stream_main);
   util::MPIPrintStreamInfo() << "Exchange completed";
@@ -589,6 +622,11 @@ int test_halo_exchange(const Array<ND> &shape,
 
   util::MPIRootPrintStreamInfo() << "Checking results";
 
+  int periodic = 0;
+  for (int i = 0; i < ND; ++i) {
+    if (dist.is_periodic(i)) periodic |= 1 << i;
+  }
+
   int error_counter = 0;
   int *error_counter_d;
   GPU_MALLOC(&error_counter_d, sizeof(int));
@@ -602,7 +640,7 @@ int test_halo_exchange(const Array<ND> &shape,
           tensor.get_pitch(),
           tensor.get_shape(),
           tensor.get_global_index(),
-          dims[i], error_counter_d);
+          dims[i], periodic, error_counter_d);
       h2::gpu::sync();
       std::fflush(stdout);
       std::fflush(stderr);
@@ -704,6 +742,13 @@ int test_halo_exchange_reverse(const Array<ND> &shape,
                                     Al::NCCLBackend>(tensor);
       util::MPIRootPrintStreamInfo() << "HaloExchangeAL created";
       break;
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+    case HaloExchangeMethod::AL_GRAPH:
+      halo_exc = new HaloExchangeGraph<HaloExchangeAL<
+        DataType, CUDAAllocator, Al::NCCLBackend>>(tensor);
+      util::MPIRootPrintStreamInfo() << "HaloExchangeGraph<AL> created";
+      break;
+#endif // DISTCONV_HAS_CUDA_GRAPH
 #ifdef DISTCONV_HAS_P2P
     case HaloExchangeMethod::P2P:
       halo_exc = new HaloExchangeP2P<DataType, CUDAAllocator,
@@ -862,6 +907,34 @@ int dispatch_tests(int pid, int np,
   }
 #endif
 
+  // The boundary communicators and the implementations pairing the
+  // sides likewise need an even number of processes, and those
+  // telling the sides apart by their peers need more than two
+  const int np_periodic = proc_dim[0];
+  bool periodic_supported = false;
+  switch (method) {
+    case HaloExchangeMethod::MPI:
+    case HaloExchangeMethod::P2P:
+      periodic_supported = true;
+      break;
+    case HaloExchangeMethod::AL:
+    case HaloExchangeMethod::AL_GRAPH:
+      periodic_supported = np_periodic == 1 || np_periodic % 2 == 0;
+      break;
+    default:
+      periodic_supported = np_periodic > 2 && np_periodic % 2 == 0;
+      break;
+  }
+  if (periodic_supported) {
+    util::MPIRootPrintStreamInfo()
+        << "Test: periodic inner-most dimension (size: 1)";
+    auto dist = create_spatial_overlap(proc_dim, 1);
+    dist.set_periodic(0);
+    // Not kept by the distribution when the dimension is not split
+    dist.set_overlap(0, 1);
+    run_test<ND, Tensor>(pid, np, tensor_shape, method, dist);
+  }
+
   return 0;
 }
 
@@ -886,6 +959,9 @@ int main(int argc, char *argv[]) {
 #endif // DISTCONV_HAS_P2P
   };
 
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+  methods.push_back(HaloExchangeMethod::AL_GRAPH);
+#endif // DISTCONV_HAS_CUDA_GRAPH
 #ifdef DISTCONV_HAS_NVSHMEM
   methods.push_back(HaloExchangeMethod::NVSHMEM);
   methods.push_back(HaloExchangeMethod::NVSHMEM_GRAPH);
@@ -956,6 +1032,10 @@ int main(int argc, char *argv[]) {
       method = HaloExchangeMethod::MPI;
     } else if (name == "AL") {
       method = HaloExchangeMethod::AL;
+#ifdef DISTCONV_HAS_CUDA_GRAPH
+    } else if (name == "AL_GRAPH") {
+      method = HaloExchangeMethod::AL_GRAPH;
+#endif // DISTCONV_HAS_CUDA_GRAPH
 #ifdef DISTCONV_HAS_P2P
     } else if (name == "P2P") {
       method = HaloExchangeMethod::P2P;
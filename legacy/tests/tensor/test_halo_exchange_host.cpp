@@ -0,0 +1,197 @@
+#include "distconv/distconv.hpp"
+#include "distconv/tensor/halo_exchange_host.hpp"
+#include "distconv/tensor/tensor.hpp"
+#include "distconv/tensor/tensor_mpi.hpp"
+#include "distconv/util/util_mpi.hpp"
+#include "test_tensor.hpp"
+
+#include <iostream>
+
+using namespace distconv;
+using namespace distconv::tensor;
+
+using DataType = double;
+using TensorMPI = Tensor<DataType, LocaleMPI, BaseAllocator>;
+
+template <>
+inline LocaleMPI get_locale<LocaleMPI>() {
+  LocaleMPI loc(MPI_COMM_WORLD);
+  return loc;
+}
+
+// Global index of each element of the real region, which may be
+// outside the global tensor
+IndexVector get_real_global_index(const TensorMPI &t,
+                                  const IndexVector &real_idx) {
+  IndexVector idx(real_idx);
+  for (int i = 0; i < t.get_num_dims(); ++i) {
+    idx[i] = t.get_global_index(i, 0) + real_idx[i] - t.get_halo_width(i);
+  }
+  return idx;
+}
+
+bool is_inside(const TensorMPI &t, const IndexVector &global_idx) {
+  for (int i = 0; i < t.get_num_dims(); ++i) {
+    if ((long)global_idx[i] < 0 ||
+        (long)global_idx[i] >= (long)t.get_shape()[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool is_interior(const TensorMPI &t, const IndexVector &real_idx) {
+  for (int i = 0; i < t.get_num_dims(); ++i) {
+    const index_t h = t.get_halo_width(i);
+    if (real_idx[i] < h || real_idx[i] >= h + t.get_local_shape()[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Number of ranks whose real region covers the global index
+int get_num_copies(const TensorMPI &t, const IndexVector &global_idx) {
+  const auto &locale_shape = t.get_distribution().get_locale_shape();
+  int num_copies = 1;
+  for (int i = 0; i < t.get_num_dims(); ++i) {
+    const index_t h = t.get_halo_width(i);
+    int n = 0;
+    for (int p = 0; p < (int)locale_shape[i]; ++p) {
+      const index_t begin = t.get_dimension_rank_offset(i, p);
+      const index_t end = p + 1 < (int)locale_shape[i] ?
+          t.get_dimension_rank_offset(i, p + 1) : t.get_shape()[i];
+      if (begin == end) continue;
+      if ((long)global_idx[i] + (long)h >= (long)begin &&
+          global_idx[i] < end + h) {
+        ++n;
+      }
+    }
+    num_copies *= n;
+  }
+  return num_copies;
+}
+
+template <typename F>
+void for_each_real_index(const TensorMPI &t, F &&f) {
+  const auto real_shape = t.get_local_real_shape();
+  for (index_t i = 0; i < real_shape.get_size(); ++i) {
+    IndexVector idx(t.get_num_dims(), 0);
+    index_t rem = i;
+    for (int d = 0; d < t.get_num_dims(); ++d) {
+      idx[d] = rem % real_shape[d];
+      rem /= real_shape[d];
+    }
+    // The real region is dense as rows are not padded
+    f(idx, i);
+  }
+}
+
+int test_exchange(const Shape &shape, const Distribution &dist) {
+  auto loc = get_locale<LocaleMPI>();
+  auto t = get_tensor<TensorMPI>(shape, loc, dist);
+  assert0(t.allocate());
+  if (t.get_local_size() == 0) return 0;
+  DataType *buf = t.get_buffer();
+  for_each_real_index(t, [&](const IndexVector &idx, index_t offset) {
+      buf[offset] = is_interior(t, idx) ?
+          get_offset(get_real_global_index(t, idx), shape) : -1;
+    });
+  HaloExchangeHost<DataType> xch(t);
+  xch.exchange();
+  int num_errors = 0;
+  for_each_real_index(t, [&](const IndexVector &idx, index_t offset) {
+      const auto global_idx = get_real_global_index(t, idx);
+      if (!is_inside(t, global_idx)) return;
+      const DataType ref = get_offset(global_idx, shape);
+      if (buf[offset] != ref) {
+        if (num_errors++ < 10) {
+          util::MPIPrintStreamError()
+              << "Mismatch at " << global_idx << "; ref: " << ref
+              << ", stored: " << buf[offset];
+        }
+      }
+    });
+  return num_errors;
+}
+
+int test_exchange_reverse(const Shape &shape, const Distribution &dist) {
+  auto loc = get_locale<LocaleMPI>();
+  auto t = get_tensor<TensorMPI>(shape, loc, dist);
+  assert0(t.allocate());
+  if (t.get_local_size() == 0) return 0;
+  DataType *buf = t.get_buffer();
+  for_each_real_index(t, [&](const IndexVector &idx, index_t offset) {
+      const auto global_idx = get_real_global_index(t, idx);
+      buf[offset] = is_inside(t, global_idx) ?
+          get_offset(global_idx, shape) : 0;
+    });
+  HaloExchangeHost<DataType> xch(t);
+  xch.exchange_reverse();
+  int num_errors = 0;
+  for_each_real_index(t, [&](const IndexVector &idx, index_t offset) {
+      if (!is_interior(t, idx)) return;
+      const auto global_idx = get_real_global_index(t, idx);
+      const DataType ref = get_offset(global_idx, shape)
+          * get_num_copies(t, global_idx);
+      if (buf[offset] != ref) {
+        if (num_errors++ < 10) {
+          util::MPIPrintStreamError()
+              << "Mismatch at " << global_idx << "; ref: " << ref
+              << ", stored: " << buf[offset];
+        }
+      }
+    });
+  return num_errors;
+}
+
+/*
+  Usage: mpirun -np N ./test_halo_exchange_host px py, where px * py
+  divides N
+ */
+int main(int argc, char *argv[]) {
+  MPI_Init(&argc, &argv);
+  int pid;
+  int np;
+  MPI_Comm_rank(MPI_COMM_WORLD, &pid);
+  MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+  if (argc != 3) {
+    if (pid == 0) {
+      std::cerr << "Error! Usage: " << argv[0] << " proc_x proc_y\n";
+    }
+    MPI_Finalize();
+    exit(1);
+  }
+
+  const int px = atoi(argv[1]);
+  const int py = atoi(argv[2]);
+  assert0(np % (px * py));
+  const int pn = np / (px * py);
+
+  int num_errors = 0;
+  // Halos of width 5 span several processes along split dimensions
+  for (int halo: {1, 2, 5}) {
+    util::MPIRootPrintStreamInfo() << "Test: 4D, halo width " << halo;
+    auto dist = Distribution::make_overlapped_distribution(
+        Shape({px, py, 1, pn}), IntVector({halo, halo, 0, 0}));
+    Shape shape({13, 16, 3, pn * 2});
+    num_errors += test_exchange(shape, dist);
+    num_errors += test_exchange_reverse(shape, dist);
+  }
+  {
+    util::MPIRootPrintStreamInfo() << "Test: 5D";
+    auto dist = Distribution::make_overlapped_distribution(
+        Shape({1, px, py, 1, pn}), IntVector({0, 1, 1, 0, 0}));
+    Shape shape({5, 8, 11, 2, pn});
+    num_errors += test_exchange(shape, dist);
+    num_errors += test_exchange_reverse(shape, dist);
+  }
+
+  int total_errors = 0;
+  MPI_Allreduce(&num_errors, &total_errors, 1, MPI_INT, MPI_SUM,
+                MPI_COMM_WORLD);
+  util::MPIRootPrintStreamInfo() << "Number of errors: " << total_errors;
+  MPI_Finalize();
+  return total_errors == 0 ? 0 : 1;
+}
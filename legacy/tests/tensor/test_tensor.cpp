@@ -1,3 +1,4 @@
+#include "distconv/tensor/region_traversal.hpp"
 #include "distconv/tensor/tensor.hpp"
 #include "distconv/tensor/tensor_process.hpp"
 #include "distconv/util/util.hpp"
@@ -46,6 +47,55 @@ int test_view() {
   return 0;
 }
 
+// Visits a 6x3x2 region of a tensor with pitched second and third
+// dimensions by pairs of elements.
+int test_region_traversal() {
+  util::PrintStreamInfo() << "test_region_traversal";
+
+  const Shape shape({6, 3, 2});
+  const IndexVector strides({1, 8, 32});
+  RegionTraversal<3, 2> region(shape, strides);
+  if (region.get_size() != shape.size() / 2) {
+    util::PrintStreamError() << "Wrong number of vectors: "
+                             << region.get_size();
+    return -1;
+  }
+  uint32_t i = 0;
+  for (index_t k = 0; k < shape[2]; ++k) {
+    for (index_t j = 0; j < shape[1]; ++j) {
+      for (index_t l = 0; l < shape[0]; l += 2, ++i) {
+        const Array<3> ref_idx({l, j, k});
+        const size_t ref_offset = l + j * strides[1] + k * strides[2];
+        if (region.get_index(i) != ref_idx ||
+            region.get_offset(i) != ref_offset) {
+          util::PrintStreamError()
+              << "Mismatch at vector " << i << ": " << region.get_index(i)
+              << ", offset " << region.get_offset(i) << ", expected "
+              << ref_idx << ", offset " << ref_offset;
+          return -1;
+        }
+      }
+    }
+  }
+
+  alignas(16) float buf[4];
+  if (get_region_vector_width<float>(shape, strides, {buf}) != 2 ||
+      get_region_vector_width<float>(Shape({8, 3}), IndexVector({1, 8}),
+                                     {buf}) != 4 ||
+      get_region_vector_width<float>(Shape({8, 3}), IndexVector({1, 8}),
+                                     {buf + 1}) != 1) {
+    util::PrintStreamError() << "Wrong vector width";
+    return -1;
+  }
+  int vw = 0;
+  dispatch_vector_width<4>(2, [&](auto w) { vw = decltype(w)::value; });
+  if (vw != 2) {
+    util::PrintStreamError() << "Dispatched vector width " << vw;
+    return -1;
+  }
+  return 0;
+}
+
 /*
   Usage: ./test_tensor
  */
@@ -65,6 +115,7 @@ int main(int argc, char *argv[]) {
   assert0(test_data_access<PitchedTensorType>(Shape({2, 2, 2}), dist));
 
   assert0(test_view<BaseAllocator>());
+  assert0(test_region_traversal());
 
   util::PrintStreamInfo() << "Completed successfully.";
   return 0;
@@ -1,10 +1,13 @@
 #include "distconv/tensor/tensor.hpp"
+#include "distconv/tensor/tensor_file_reader.hpp"
 #include "distconv/tensor/tensor_mpi.hpp"
 #include "distconv/util/util_mpi.hpp"
 #include "test_tensor.hpp"
 
 #include <cassert>
+#include <cstdio>
 #include <iostream>
+#include <string>
 
 using namespace distconv;
 using namespace distconv::tensor;
@@ -231,6 +234,157 @@ int test_copy_redist(const Shape &shape,
   return 0;
 }
 
+template <typename TensorType>
+int test_file_io(const Shape &shape, const Distribution &dist,
+                 const Distribution &read_dist) {
+  util::MPIRootPrintStreamInfo() << "test_file_io\n";
+  auto loc = get_locale<typename TensorType::locale_type>();
+  auto t = get_tensor<TensorType>(shape, loc, dist);
+  auto t_read = get_tensor<TensorType>(shape, loc, read_dist);
+  assert0(t.allocate());
+  assert0(t_read.allocate());
+  t_read.zero();
+
+  const auto local_shape = t.get_local_shape();
+  for (auto it = local_shape.index_begin(); it != local_shape.index_end();
+       ++it) {
+    t.get_buffer()[t.get_local_offset(*it)] = get_linearlized_offset(
+        t.get_global_index(*it), t.get_shape());
+  }
+
+  const std::string path = "test_file_io.bin";
+  assert0(WriteFile(t, path));
+  assert0(ReadFile(t_read, path));
+  const auto read_shape = t_read.get_local_shape();
+  for (auto it = read_shape.index_begin(); it != read_shape.index_end();
+       ++it) {
+    const auto ref = get_linearlized_offset(
+        t_read.get_global_index(*it), t_read.get_shape());
+    const auto stored = t_read.get_buffer()[t_read.get_local_offset(*it)];
+    if (ref != stored) {
+      std::cerr << "Mismatch at: " << *it
+                << ", ref: " << ref << ", stored: " << stored << "\n";
+      return -1;
+    }
+  }
+  MPI_Barrier(loc.get_comm());
+  if (loc.get_rank() == 0) {
+    std::remove(path.c_str());
+  }
+  return 0;
+}
+
+template <typename TensorType>
+int test_sub_locale_cache(const Shape &shape, const Distribution &dist) {
+  util::MPIRootPrintStreamInfo() << "test_sub_locale_cache\n";
+  auto loc = get_locale<typename TensorType::locale_type>();
+  auto t = get_tensor<TensorType>(shape, loc, dist);
+  auto t2 = get_tensor<TensorType>(shape, loc, dist);
+  // Sub-locales of tensors with the same distribution share the
+  // communicator; -1 and the last dimension are the same key.
+  auto sub = t.get_sub_locale_except_dim(-1);
+  auto sub2 = t2.get_sub_locale_except_dim(shape.num_dims() - 1);
+  if (sub.get_comm() != sub2.get_comm()) {
+    std::cerr << "Sub-locales not shared\n";
+    return -1;
+  }
+  if (sub.get_size() != loc.get_size() /
+      (int)dist.get_locale_shape()[shape.num_dims() - 1]) {
+    std::cerr << "Invalid sub-locale size: " << sub.get_size() << "\n";
+    return -1;
+  }
+  // Different groupings are different communicators.
+  if (t.get_sub_locale(0).get_comm() == sub.get_comm()) {
+    std::cerr << "Distinct sub-locales shared\n";
+    return -1;
+  }
+  return 0;
+}
+
+template <typename TensorType>
+int test_allreduce(const Shape &shape, const Distribution &dist,
+                   const std::vector<int> &dims) {
+  util::MPIRootPrintStreamInfo() << "test_allreduce\n";
+  auto loc = get_locale<typename TensorType::locale_type>();
+  auto t = get_tensor<TensorType>(shape, loc, dist);
+  assert0(t.allocate());
+  const index_t buf_size = t.get_local_pitched_size();
+  for (index_t i = 0; i < buf_size; ++i) {
+    t.get_buffer()[i] = 1;
+  }
+  t.allreduce(dims);
+  const auto ref = t.get_reduction_locale(dims).get_size();
+  const auto local_shape = t.get_local_shape();
+  for (auto it = local_shape.index_begin(); it != local_shape.index_end();
+       ++it) {
+    const auto v = t.get_buffer()[t.get_local_offset(*it)];
+    if (v != ref) {
+      std::cerr << "Mismatch at: " << *it << ", ref: " << ref
+                << ", reduced: " << v << "\n";
+      return -1;
+    }
+  }
+  // The halo is left as it is
+  index_t num_untouched = 0;
+  for (index_t i = 0; i < buf_size; ++i) {
+    num_untouched += t.get_buffer()[i] == 1;
+  }
+  if (num_untouched != buf_size - (index_t)t.get_local_size()) {
+    std::cerr << "Halo reduced\n";
+    return -1;
+  }
+  return 0;
+}
+
+template <typename TensorType>
+int test_file_reader(const Shape &dataset_shape, const Distribution &dist,
+                     const Shape &shape, const Distribution &read_dist,
+                     index_t first_sample) {
+  util::MPIRootPrintStreamInfo() << "test_file_reader\n";
+  auto loc = get_locale<typename TensorType::locale_type>();
+  auto dataset = get_tensor<TensorType>(dataset_shape, loc, dist);
+  assert0(dataset.allocate());
+  const auto dataset_local_shape = dataset.get_local_shape();
+  for (auto it = dataset_local_shape.index_begin();
+       it != dataset_local_shape.index_end(); ++it) {
+    dataset.get_buffer()[dataset.get_local_offset(*it)] =
+        get_linearlized_offset(dataset.get_global_index(*it), dataset_shape);
+  }
+  const std::string path = "test_file_reader.bin";
+  assert0(WriteFile(dataset, path));
+  MPI_Barrier(loc.get_comm());
+
+  auto t = get_tensor<TensorType>(shape, loc, read_dist);
+  assert0(t.allocate());
+  TensorFileReader reader(path);
+  reader.read(t, first_sample);
+  const int nd = shape.num_dims();
+  const auto real_shape = t.get_local_real_shape();
+  for (auto it = real_shape.index_begin(); it != real_shape.index_end();
+       ++it) {
+    auto idx = t.get_global_index();
+    bool inside = true;
+    for (int i = 0; i < nd; ++i) {
+      const auto gi = (int64_t)(idx[i] + (*it)[i]) - t.get_halo_width()[i];
+      inside = inside && gi >= 0 && gi < (int64_t)shape[i];
+      idx[i] = inside ? gi : 0;
+    }
+    idx[nd - 1] += first_sample;
+    const auto ref = inside ? get_linearlized_offset(idx, dataset_shape) : 0;
+    const auto v = t.get_buffer()[t.get_local_offset(*it, true)];
+    if (v != ref) {
+      std::cerr << "Mismatch at: " << *it << ", ref: " << ref
+                << ", read: " << v << "\n";
+      return -1;
+    }
+  }
+  MPI_Barrier(loc.get_comm());
+  if (loc.get_rank() == 0) {
+    std::remove(path.c_str());
+  }
+  return 0;
+}
+
 /*
   Usage: mpirun -np N ./test_tensor_mpi, where N must be >= 8 and
   divisible by 8.
@@ -274,6 +428,29 @@ int main(int argc, char *argv[]) {
                                            dist, shared_dist, 0));
   util::MPIRootPrintStreamInfo() << "test_copy success";
 
+  assert0(test_file_io<TensorMPI>(Shape({2, 2, 4}), dist, dist));
+  // Read back with another distribution
+  assert0(test_file_io<TensorMPI>(
+      Shape({2, 2, 4}), dist,
+      Distribution::make_overlapped_distribution({2, 1, np/2}, {1, 0, 0})));
+  util::MPIRootPrintStreamInfo() << "test_file_io success";
+
+  // Reads the second mini-batch with its halo
+  assert0(test_file_reader<TensorMPI>(
+      Shape({2, 4, np}), dist, Shape({2, 4, np/2}),
+      Distribution::make_overlapped_distribution({1, 2, np/2}, {0, 1, 0}),
+      np/2));
+  util::MPIRootPrintStreamInfo() << "test_file_reader success";
+
+  assert0(test_sub_locale_cache<TensorMPI>(Shape({2, 2, 4}), dist));
+  util::MPIRootPrintStreamInfo() << "test_sub_locale_cache success";
+
+  // With a halo within the rows of the interior
+  auto halo_dist = Distribution::make_overlapped_distribution(
+      {1, 2, np/2}, {0, 1, 1});
+  assert0(test_allreduce<TensorMPI>(Shape({2, 4, 4}), halo_dist, {2}));
+  util::MPIRootPrintStreamInfo() << "test_allreduce success";
+
   util::MPIRootPrintStreamInfo() << "Testing 4D tensors";
   assert_always((np % 8) == 0 && np >= 8);
   using TensorMPI4 = Tensor<DataType, LocaleMPI, BaseAllocator>;
@@ -179,6 +179,28 @@ inline int test_transform(const Shape &shape,
   MPI_Barrier(MPI_COMM_WORLD);
   MPIRootPrintStreamInfo() << "Transform with copy_functor completed.";
 
+  // t holds 2x; copy it to t2, halve t2 and double it again in one pass.
+  using DataType = typename TensorType::data_type;
+  LazyTransform(t, t2)
+      .then(copy_functor<DataType>())
+      .then([] __device__ (DataType &, DataType &y) { y /= 2; })
+      .then([] __device__ (DataType &, DataType &y) { y *= 2; })
+      .eval();
+  check_tensor<<<1, 1>>>(t2.get_buffer(),
+                         t2.get_local_shape(),
+                         dist.get_overlap(),
+                         t2.get_pitch(),
+                         t2.get_shape(),
+                         t2.get_global_index(),
+                         times2_functor<DataType>(),
+                         error_counter_d);
+  h2::gpu::mem_copy(&error_counter, error_counter_d);
+  assert0(error_counter);
+
+  h2::gpu::sync();
+  MPI_Barrier(MPI_COMM_WORLD);
+  MPIRootPrintStreamInfo() << "Fused LazyTransform completed.";
+
   return 0;
 }
 
@@ -568,6 +590,20 @@ int main(int argc, char *argv[]) {
         [] __host__ __device__ (int x) {return x * 2;}));
   }
 
+  // Every subset of dimensions again with the deterministic kernels
+  algorithms::set_deterministic_reduction(true);
+  for (auto it = reduced_dim.index_begin();
+       it != reduced_dim.index_end(); ++it) {
+    auto reduce_shape = tensor_shape;
+    for (int i = 0; i < num_dims; ++i) {
+      if ((*it)[i] == 1) reduce_shape[i] = 1;
+    }
+    MPIRootPrintStreamInfo() << "test_reduce deterministically to "
+                             << reduce_shape;
+    assert0(test_reduce<num_dims, TensorMPI>(tensor_shape, reduce_shape, dist));
+  }
+  algorithms::set_deterministic_reduction(false);
+
   {
     auto reduce_shape1 = tensor_shape;
     reduce_shape1[1] = 1;
@@ -12,12 +12,17 @@
 #include "distconv/tensor/shuffle_mpi_cuda_p2p.hpp"
 #include "distconv/tensor/shuffle_mpi_cuda_hybrid.hpp"
 #endif // DISTCONV_HAS_P2P
+#ifdef DISTCONV_HAS_NVSHMEM
+#include "distconv/tensor/shuffle_mpi_cuda_nvshmem.hpp"
+#include "distconv/util/nvshmem.hpp"
+#endif // DISTCONV_HAS_NVSHMEM
 
 #include "h2/gpu/memory_utils.hpp"
 #include "h2/gpu/runtime.hpp"
 
 #include <Al.hpp>
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
@@ -289,6 +294,11 @@ int test_copy_shuffle(const Shape &shape,
           t_src, t_dest, *p2p_h, *al_comm);
       break;
 #endif // DISTCONV_HAS_P2P
+#ifdef DISTCONV_HAS_NVSHMEM
+    case ShuffleMethod::NVSHMEM:
+      shuffler = new TensorMPICUDAShufflerNVSHMEM<DataType>(t_src, t_dest);
+      break;
+#endif // DISTCONV_HAS_NVSHMEM
     default:
       util::MPIRootPrintStreamError() << "Unknown shuffle method";
       std::abort();
@@ -634,6 +644,10 @@ int main(int argc, char *argv[]) {
       methods.push_back(ShuffleMethod::P2P);
     } else if (method_name == "HYBRID") {
       methods.push_back(ShuffleMethod::HYBRID);
+#endif
+#ifdef DISTCONV_HAS_NVSHMEM
+    } else if (method_name == "NVSHMEM") {
+      methods.push_back(ShuffleMethod::NVSHMEM);
 #endif
     } else {
       util::MPIRootPrintStreamError() << "Unknown method name: "
@@ -650,6 +664,16 @@ int main(int argc, char *argv[]) {
     };
   }
 
+#ifdef DISTCONV_HAS_NVSHMEM
+  // NVSHMEM is only tested when selected explicitly
+  const bool use_nvshmem =
+      std::find(methods.begin(), methods.end(), ShuffleMethod::NVSHMEM)
+      != methods.end();
+  if (use_nvshmem) {
+    util::nvshmem::initialize(MPI_COMM_WORLD);
+  }
+#endif // DISTCONV_HAS_NVSHMEM
+
   MPI_Barrier(MPI_COMM_WORLD);
   for(const auto method : methods) {
     if(ND == 4) {
@@ -662,6 +686,11 @@ int main(int argc, char *argv[]) {
 
   util::MPIRootPrintStreamInfo() << "Completed successfully.";
 
+#ifdef DISTCONV_HAS_NVSHMEM
+  if (use_nvshmem) {
+    util::nvshmem::finalize();
+  }
+#endif // DISTCONV_HAS_NVSHMEM
   Al::Finalize();
   return 0;
 }
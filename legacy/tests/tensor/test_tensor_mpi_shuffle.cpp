@@ -277,6 +277,33 @@ int run_tests(const Shape &proc_dim,
         shape, dist2, dist1, method)) == 0);
   }
 
+  if (proc_dim[0] > 1) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    util::MPIRootPrintStreamInfo()
+        << "Test: copy between evenly and unevenly partitioned tensors.";
+    auto dist1 = Distribution::make_distribution(proc_dim);
+    auto dist2 = dist1;
+    // Move an element from the last split to the first one
+    const int num_splits = proc_dim[0];
+    std::vector<index_t> partition(num_splits, shape[0] / num_splits);
+    for (int i = 0; i < (int)(shape[0] % num_splits); ++i) {
+      ++partition[i];
+    }
+    if (partition.back() > 1) {
+      --partition.back();
+      ++partition.front();
+    }
+    dist2.set_partition(0, partition);
+    util::MPIRootPrintStreamInfo() << "dist1 (" << dist1
+                                   << ") to dist2 (" << dist2 << ")";
+    assert_always((test_copy_shuffle<ND, TensorMPI, TensorMPI>(
+        shape, dist1, dist2, method)) == 0);
+    MPI_Barrier(MPI_COMM_WORLD);
+    util::MPIRootPrintStreamInfo() << "dist2 to dist1";
+    assert_always((test_copy_shuffle<ND, TensorMPI, TensorMPI>(
+        shape, dist2, dist1, method)) == 0);
+  }
+
 #if 0
   {
     MPI_Barrier(MPI_COMM_WORLD);
@@ -16,6 +16,7 @@
 #include "distconv/dnn_backend/batchnorm.hpp"
 #include "distconv/dnn_backend/convolution.hpp"
 #include "distconv/dnn_backend/cross_entropy.hpp"
+#include "distconv/dnn_backend/groupnorm.hpp"
 #include "distconv/dnn_backend/leaky_relu.hpp"
 #include "distconv/dnn_backend/mean_squared_error.hpp"
 #include "distconv/dnn_backend/pooling.hpp"
@@ -7,9 +7,16 @@
 #include "h2/gpu/runtime.hpp"
 
 #include "h2/gpu/logger.hpp"
+#include "h2/gpu/pools.hpp"
+#include "h2/gpu/ranges.hpp"
+#include "h2/utils/HelperThreads.hpp"
+
+#include "../init_thread.hpp"
+#include "../topology.hpp"
 
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 #include <iostream> // FIXME: Eventually, Logger.hpp
 
 #include <cuda_runtime.h>
@@ -44,6 +51,26 @@
 //                          H2_SELECT_DEVICE_0, so if both are set,
 //                          device 0 will be selected.
 //
+//   - H2_SELECT_DEVICE_IGNORE_TOPOLOGY: If set to a truthy value,
+//                                       ranks keep the GPU of their
+//                                       local rank even if it is on
+//                                       another NUMA node than the
+//                                       CPUs they are bound to.
+//
+// The following take a value:
+//
+//   - H2_DEVICE_SCHEDULE: How host threads wait for the device: "spin",
+//                         "yield" or "blocking_sync" (see
+//                         cudaSetDeviceFlags). The default, "auto",
+//                         usually spins, which keeps a core of each
+//                         rank busy; blocking_sync frees it at the
+//                         cost of wake-up latency.
+//
+//   - H2_HELPER_CORES: Number of the cores of each rank reserved for
+//                      the helper threads of H2 and DistConv (see
+//                      h2/utils/HelperThreads.hpp). By default, none
+//                      are reserved.
+//
 // The behavior is undefined if the value of the H2_* variables
 // differs across processes in one MPI universe.
 
@@ -118,6 +145,23 @@ static bool force_round_robin() noexcept
     return check_bool_cstr(std::getenv("H2_SELECT_DEVICE_RR"));
 }
 
+static bool ignore_topology() noexcept
+{
+    return check_bool_cstr(std::getenv("H2_SELECT_DEVICE_IGNORE_TOPOLOGY"));
+}
+
+static std::vector<int> get_gpu_numa_nodes(int const ngpus)
+{
+    std::vector<int> nodes(ngpus);
+    char bus_id[32];
+    for (int gpu = 0; gpu < ngpus; ++gpu)
+    {
+        H2_CHECK_CUDA(cudaDeviceGetPCIBusId(bus_id, sizeof(bus_id), gpu));
+        nodes[gpu] = h2_internal::pci_numa_node(bus_id);
+    }
+    return nodes;
+}
+
 static void warn(char const* const msg)
 {
     std::clog << msg << std::endl;
@@ -140,9 +184,10 @@ static void error(std::string const& msg)
     std::terminate();
 }
 
-// This just uses the HIP runtime and/or user-provided environment
-// variables. A more robust solution might tap directly into HWLOC or
-// something of that nature. We should also look into whether we can
+// This just uses the HIP runtime, user-provided environment variables
+// and the NUMA nodes of the GPUs and bound CPUs from sysfs. A more
+// robust solution might tap directly into HWLOC or something of that
+// nature. We should also look into whether we can
 // (easily) access more information about the running job, such as the
 // REAL number of GPUs on a node (since the runtime is swayed by env
 // variables) or even just whether or not a job has been launched with
@@ -176,7 +221,18 @@ static int get_reasonable_default_gpu_id() noexcept
     // ngpus and nlocal_rnks. If we risk oversubscription, we can
     // error out at this point.
     if (lsize <= ngpus)
+    {
+        // Prefer a GPU on the NUMA node of the cores the rank is bound
+        // to, which is usually also closest to the NIC.
+        if (!ignore_topology())
+        {
+            int const gpu = h2_internal::select_gpu_by_topology(
+                get_gpu_numa_nodes(ngpus), lrank, lsize);
+            if (gpu >= 0)
+                return gpu;
+        }
         return lrank;
+    }
 
     error("More local ranks than (visible) GPUs.");
     return -1;
@@ -187,6 +243,42 @@ static void set_reasonable_default_gpu()
     h2::gpu::set_gpu(get_reasonable_default_gpu_id());
 }
 
+// Must be called before the context is created.
+static void set_device_schedule()
+{
+    char const* const env = std::getenv("H2_DEVICE_SCHEDULE");
+    if (!env || !std::strlen(env))
+        return;
+    unsigned int flags;
+    if (std::strcmp(env, "auto") == 0)
+        flags = cudaDeviceScheduleAuto;
+    else if (std::strcmp(env, "spin") == 0)
+        flags = cudaDeviceScheduleSpin;
+    else if (std::strcmp(env, "yield") == 0)
+        flags = cudaDeviceScheduleYield;
+    else if (std::strcmp(env, "blocking_sync") == 0)
+        flags = cudaDeviceScheduleBlockingSync;
+    else
+    {
+        H2_GPU_WARN("unknown H2_DEVICE_SCHEDULE \"{}\"; ignored", env);
+        return;
+    }
+    H2_GPU_TRACE("setting device schedule to {}", env);
+    // Fails if the context was created already, e.g., by the caller.
+    if (cudaSetDeviceFlags(flags) != cudaSuccess)
+    {
+        H2_GPU_WARN("cannot set the device schedule to {}", env);
+        static_cast<void>(cudaGetLastError());
+    }
+}
+
+static void reserve_helper_cores_from_env()
+{
+    if (char const* const env = std::getenv("H2_HELPER_CORES"))
+        h2::reserve_helper_cores(
+            std::atoi(env), guess_local_rank(), guess_local_size());
+}
+
 } // namespace
 
 int h2::gpu::num_gpus()
@@ -215,8 +307,15 @@ void h2::gpu::init_runtime()
         return;
 
     H2_GPU_TRACE("initializing gpu runtime");
+    H2_GPU_RANGE(h2_range_domain(), "init_runtime", RangeCategory::Runtime);
     H2_GPU_TRACE("found {} devices", num_gpus());
     set_reasonable_default_gpu();
+    set_device_schedule();
+    reserve_helper_cores_from_env();
+    // Freeing nullptr is the usual way to force creating the context.
+    h2_internal::start_runtime_init(current_gpu(), [] {
+        H2_CHECK_CUDA(cudaFree(nullptr));
+    });
     initialized_ = true;
 }
 
@@ -226,6 +325,9 @@ void h2::gpu::finalize_runtime()
         return;
 
     H2_GPU_TRACE("finalizing gpu runtime");
+    H2_GPU_RANGE(h2_range_domain(), "finalize_runtime", RangeCategory::Runtime);
+    h2_internal::stop_runtime_init();
+    release_pooled_resources();
     initialized_ = false;
 }
 
@@ -255,6 +357,25 @@ cudaStream_t h2::gpu::make_stream_nonblocking()
     return stream;
 }
 
+cudaStream_t h2::gpu::make_stream_with_priority(int const priority)
+{
+    cudaStream_t stream;
+    H2_CHECK_CUDA(cudaStreamCreateWithPriority(
+        &stream, cudaStreamNonBlocking, priority));
+    H2_GPU_TRACE("created non-blocking stream {} with priority {}",
+                 (void*) stream,
+                 priority);
+    return stream;
+}
+
+h2::gpu::StreamPriorityRange h2::gpu::stream_priority_range()
+{
+    StreamPriorityRange range;
+    H2_CHECK_CUDA(
+        cudaDeviceGetStreamPriorityRange(&range.least, &range.greatest));
+    return range;
+}
+
 void h2::gpu::destroy(cudaStream_t const stream)
 {
     H2_GPU_TRACE("destroy stream {}", (void*) stream);
@@ -283,20 +404,35 @@ void h2::gpu::destroy(cudaEvent_t const event)
     H2_CHECK_CUDA(cudaEventDestroy(event));
 }
 
+void h2::gpu::record_event(cudaEvent_t event, cudaStream_t stream)
+{
+    H2_GPU_TRACE("record event {} on stream {}", (void*) event, (void*) stream);
+    H2_CHECK_CUDA(cudaEventRecord(event, stream));
+}
+
 void h2::gpu::sync()
 {
     H2_GPU_TRACE("synchronizing gpu");
+    H2_GPU_RANGE(h2_range_domain(), "sync", RangeCategory::Runtime);
     H2_CHECK_CUDA(cudaDeviceSynchronize());
 }
 
 void h2::gpu::sync(cudaEvent_t event)
 {
     H2_GPU_TRACE("synchronizing event {}", (void*) event);
+    H2_GPU_RANGE(h2_range_domain(), "sync_event", RangeCategory::Runtime);
     H2_CHECK_CUDA(cudaEventSynchronize(event));
 }
 
 void h2::gpu::sync(cudaStream_t stream)
 {
     H2_GPU_TRACE("synchronizing stream {}", (void*) stream);
+    H2_GPU_RANGE(h2_range_domain(), "sync_stream", RangeCategory::Runtime);
     H2_CHECK_CUDA(cudaStreamSynchronize(stream));
 }
+
+void h2::gpu::sync(cudaStream_t stream, cudaEvent_t event)
+{
+    H2_GPU_TRACE("stream {} waits on event {}", (void*) stream, (void*) event);
+    H2_CHECK_CUDA(cudaStreamWaitEvent(stream, event, 0));
+}
@@ -0,0 +1,213 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#include "init_thread.hpp"
+
+#include "h2/gpu/logger.hpp"
+#include "h2/gpu/memory_utils.hpp"
+#include "h2/gpu/ranges.hpp"
+#include "h2/gpu/runtime.hpp"
+#include "h2/utils/HelperThreads.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+// Note: The behavior of functions in this file may be impacted by the
+// following user-provided environment variables:
+//
+//   - H2_ASYNC_INIT (bool): If true, init_runtime returns right away
+//                           and the device context is created, and
+//                           the default device allocator prewarmed,
+//                           on a background thread. Default: false.
+//
+//   - H2_PREWARM_BYTES (uint64): Bytes allocated from and returned to
+//                                the default device allocator at
+//                                initialization so that they stay
+//                                reserved. With the "async" allocator,
+//                                they are kept only up to
+//                                H2_ASYNC_RELEASE_THRESHOLD. Default:
+//                                0.
+//
+// As usual, boolean environment variables are truthy if they are set
+// to any nonempty value that does not begin with '0'.
+
+namespace
+{
+
+static bool async_init() noexcept
+{
+    char const* env = std::getenv("H2_ASYNC_INIT");
+    return (env && std::strlen(env) && env[0] != '0');
+}
+
+static size_t prewarm_bytes() noexcept
+{
+    char const* env = std::getenv("H2_PREWARM_BYTES");
+    return (env ? static_cast<size_t>(std::atoll(env)) : 0UL);
+}
+
+// The "reserved" allocator is always prewarmed, which reserves its
+// chunk.
+static void prewarm_device_allocator()
+{
+    size_t bytes = prewarm_bytes();
+    auto& alloc = h2::gpu::default_device_allocator();
+    if (alloc.backend() == h2::gpu::DeviceAllocator::Backend::RESERVED)
+        bytes = std::max(bytes, size_t{1});
+    if (bytes == 0)
+        return;
+    H2_GPU_DEBUG("prewarming the default device allocator with {} bytes",
+                 bytes);
+    void* ptr = nullptr;
+    auto const status = alloc.allocate(&ptr, bytes, nullptr);
+    if (!h2::gpu::ok(status))
+    {
+        H2_GPU_WARN("could not prewarm the default device allocator with {} "
+                    "bytes",
+                    bytes);
+        return;
+    }
+    h2::gpu::sync();
+    static_cast<void>(alloc.deallocate(ptr));
+}
+
+class InitThread
+{
+public:
+    void start(int device)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_thread.joinable())
+            return;
+        m_stop = false;
+        m_thread = std::thread([this, device] { run(device); });
+    }
+
+    // Returns false if the thread is not running.
+    bool submit(std::function<void()> task)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_thread.joinable() || m_stop)
+            return false;
+        m_tasks.push_back(std::move(task));
+        m_cv.notify_all();
+        return true;
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle_cv.wait(lock, [this] { return m_tasks.empty() && !m_busy; });
+        if (m_error)
+            std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_thread.joinable())
+                return;
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+        wait();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_idle_cv;
+    std::deque<std::function<void()>> m_tasks;
+    std::thread m_thread;
+    std::exception_ptr m_error;
+    bool m_busy = false;
+    bool m_stop = false;
+
+    // Queued tasks are run before stopping.
+    void run(int device)
+    {
+        h2::register_helper_thread();
+        h2::gpu::set_gpu(device);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_cv.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+            if (m_tasks.empty())
+                break;
+            auto task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            m_busy = true;
+            lock.unlock();
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                H2_GPU_ERROR("background initialization task failed");
+                lock.lock();
+                if (!m_error)
+                    m_error = std::current_exception();
+                lock.unlock();
+            }
+            lock.lock();
+            m_busy = false;
+            m_idle_cv.notify_all();
+        }
+    }
+};
+
+// Never destroyed so that it can be stopped by finalize_runtime from
+// a static destructor.
+InitThread& get_init_thread()
+{
+    static auto* thread = new InitThread;
+    return *thread;
+}
+
+} // namespace
+
+void h2_internal::start_runtime_init(int const device,
+                                     std::function<void()> create_context)
+{
+    if (!async_init())
+    {
+        prewarm_device_allocator();
+        return;
+    }
+    H2_GPU_TRACE("initializing device {} in the background", device);
+    auto& thread = get_init_thread();
+    thread.start(device);
+    thread.submit(std::move(create_context));
+    thread.submit(prewarm_device_allocator);
+}
+
+void h2_internal::stop_runtime_init()
+{
+    get_init_thread().stop();
+}
+
+void h2::gpu::submit_init_task(std::function<void()> task)
+{
+    if (!get_init_thread().submit(task))
+        task();
+}
+
+void h2::gpu::wait_for_runtime()
+{
+    H2_GPU_RANGE(h2_range_domain(), "wait_for_runtime", RangeCategory::Runtime);
+    get_init_thread().wait();
+}
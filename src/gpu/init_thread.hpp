@@ -0,0 +1,32 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#ifndef H2_SRC_GPU_INIT_THREAD_HPP_INCLUDED
+#define H2_SRC_GPU_INIT_THREAD_HPP_INCLUDED
+
+#include <functional>
+
+// The background initialization behind h2::gpu::submit_init_task. It
+// is started and stopped by the runtime of the backend.
+namespace h2_internal
+{
+
+/** @brief Start initializing the runtime on the given device.
+ *
+ *  With H2_ASYNC_INIT, a thread is started on device and queues
+ *  create_context followed by the prewarming of the default device
+ *  allocator (H2_PREWARM_BYTES). Otherwise, only the prewarming runs,
+ *  on the calling thread.
+ */
+void start_runtime_init(int device, std::function<void()> create_context);
+
+/** @brief Wait for the queued tasks and stop the thread, if any. */
+void stop_runtime_init();
+
+} // namespace h2_internal
+#endif // H2_SRC_GPU_INIT_THREAD_HPP_INCLUDED
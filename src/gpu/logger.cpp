@@ -6,6 +6,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 #include "h2/gpu/logger.hpp"
 
+#include <cstdlib>
 #include <memory>
 #include <stdexcept>
 
@@ -83,8 +84,27 @@ static std::shared_ptr<spdlog::logger> make_logger()
     return logger;
 }
 
+std::uint64_t get_trace_sample_period_env()
+{
+    char const* const str = std::getenv("H2_GPU_TRACE_SAMPLE");
+    if (!str)
+        return 1;
+    char* end = nullptr;
+    auto const period = std::strtoull(str, &end, 10);
+    return (end != str && period > 0) ? period : 1;
+}
+
 } // namespace
 
+std::atomic<std::uint64_t> h2_internal::gpu_trace_sample_period{
+    get_trace_sample_period_env()};
+
+void h2::gpu::set_trace_sample_period(std::uint64_t const period) noexcept
+{
+    h2_internal::gpu_trace_sample_period.store(period ? period : 1,
+                                               std::memory_order_relaxed);
+}
+
 spdlog::logger& h2::gpu::logger()
 {
     static auto logger = make_logger();
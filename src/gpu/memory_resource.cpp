@@ -0,0 +1,152 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#include "h2/gpu/memory_resource.hpp"
+
+#include "h2/gpu/error.hpp"
+#include "h2/gpu/logger.hpp"
+#include "h2/gpu/memory_utils.hpp"
+
+#include "h2_config.hpp"
+
+#if H2_HAS_CUDA
+#include <cuda_runtime.h>
+#elif H2_HAS_ROCM
+#include <hip/hip_runtime.h>
+#endif
+
+#include <string>
+#include <utility>
+
+namespace
+{
+
+void check(h2::gpu::DeviceError const status)
+{
+    if (!h2::gpu::ok(status))
+        throw h2::gpu::GPUError(status);
+}
+
+class NamedMemoryResource : public h2::gpu::MemoryResource
+{
+public:
+    NamedMemoryResource(std::string name) : m_name{std::move(name)} {}
+
+    std::string const& name() const noexcept final { return m_name; }
+
+private:
+    std::string m_name;
+};
+
+class DeviceMemoryResource final : public NamedMemoryResource
+{
+public:
+    DeviceMemoryResource() : NamedMemoryResource{"device"} {}
+
+    h2::gpu::MemoryKind kind() const noexcept final
+    {
+        return h2::gpu::MemoryKind::DEVICE;
+    }
+
+    void* allocate(size_t bytes, h2::gpu::DeviceStream stream) final
+    {
+        void* ptr = nullptr;
+        check(h2::gpu::default_device_allocator().allocate(&ptr, bytes, stream));
+        return ptr;
+    }
+
+    void deallocate(void* ptr) final
+    {
+        check(h2::gpu::default_device_allocator().deallocate(ptr));
+    }
+};
+
+class PinnedHostMemoryResource final : public NamedMemoryResource
+{
+public:
+    PinnedHostMemoryResource() : NamedMemoryResource{"pinned_host"} {}
+
+    h2::gpu::MemoryKind kind() const noexcept final
+    {
+        return h2::gpu::MemoryKind::PINNED_HOST;
+    }
+
+    void* allocate(size_t bytes, h2::gpu::DeviceStream) final
+    {
+        H2_GPU_TRACE("allocating {} bytes of pinned host memory", bytes);
+        void* ptr = nullptr;
+#if H2_HAS_CUDA
+        check(cudaHostAlloc(&ptr, bytes, cudaHostAllocPortable));
+#elif H2_HAS_ROCM
+        check(hipHostMalloc(&ptr, bytes, hipHostMallocPortable));
+#endif
+        return ptr;
+    }
+
+    void deallocate(void* ptr) final
+    {
+#if H2_HAS_CUDA
+        check(cudaFreeHost(ptr));
+#elif H2_HAS_ROCM
+        check(hipHostFree(ptr));
+#endif
+    }
+};
+
+class ManagedMemoryResource final : public NamedMemoryResource
+{
+public:
+    ManagedMemoryResource() : NamedMemoryResource{"managed"} {}
+
+    h2::gpu::MemoryKind kind() const noexcept final
+    {
+        return h2::gpu::MemoryKind::MANAGED;
+    }
+
+    void* allocate(size_t bytes, h2::gpu::DeviceStream) final
+    {
+        H2_GPU_TRACE("allocating {} bytes of managed memory", bytes);
+        void* ptr = nullptr;
+#if H2_HAS_CUDA
+        check(cudaMallocManaged(&ptr, bytes, cudaMemAttachGlobal));
+#elif H2_HAS_ROCM
+        check(hipMallocManaged(&ptr, bytes, hipMemAttachGlobal));
+#endif
+        return ptr;
+    }
+
+    void deallocate(void* ptr) final
+    {
+#if H2_HAS_CUDA
+        check(cudaFree(ptr));
+#elif H2_HAS_ROCM
+        check(hipFree(ptr));
+#endif
+    }
+};
+
+} // namespace
+
+// The resources are never destroyed so that memory held by static
+// objects can still be returned at exit.
+
+h2::gpu::MemoryResource& h2::gpu::device_memory_resource()
+{
+    static auto* resource = new DeviceMemoryResource;
+    return *resource;
+}
+
+h2::gpu::MemoryResource& h2::gpu::pinned_host_memory_resource()
+{
+    static auto* resource = new PinnedHostMemoryResource;
+    return *resource;
+}
+
+h2::gpu::MemoryResource& h2::gpu::managed_memory_resource()
+{
+    static auto* resource = new ManagedMemoryResource;
+    return *resource;
+}
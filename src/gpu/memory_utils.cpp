@@ -6,6 +6,9 @@
 ////////////////////////////////////////////////////////////////////////////////
 #include "h2/gpu/memory_utils.hpp"
 
+#include "h2/gpu/error.hpp"
+#include "h2/gpu/pools.hpp"
+
 #include "h2_config.hpp"
 
 #if H2_HAS_CUDA
@@ -16,7 +19,19 @@
 #include <hipcub/util_allocator.hpp>
 #endif
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 // Note: The behavior of functions in this file may be impacted by the
 // following user-provided environment variables (these corresponde
@@ -41,6 +56,34 @@
 //                          logs from (HIP)CUB to stdout. Default:
 //                          false.
 //
+// The default device allocator is selected with:
+//
+//   - H2_DEVICE_ALLOCATOR (string): "cub" for the (HIP)CUB allocator
+//                                   above, "async" for
+//                                   stream-ordered memory pools or
+//                                   "reserved" for one chunk
+//                                   reserved per device. Default:
+//                                   "cub".
+//
+//   - H2_ASYNC_RELEASE_THRESHOLD (uint64): Bytes of freed memory the
+//                                          "async" pools keep cached
+//                                          at synchronization
+//                                          points. Default: no limit
+//                                          (leave unset).
+//
+//   - H2_GPU_POOL_RESERVE (uint64 or float): Size of the chunk of the
+//                                            "reserved" allocator, in
+//                                            bytes, or as a fraction
+//                                            of the device memory if
+//                                            it has a decimal
+//                                            point. Default: 0.75.
+//
+//   - H2_ALLOCATOR_STATS_INTERVAL (uint32): If nonzero, every device
+//                                           allocator logs its
+//                                           statistics at info level
+//                                           after this many
+//                                           allocations. Default: 0.
+//
 // As usual, boolean environment variables are truthy if they are set
 // to any nonempty value that does not begin with '0'. That is, they
 // match '[^0].*'. The behavior is undefined if the value of the H2_*
@@ -58,6 +101,7 @@ namespace
     }
 H2_GET_UINT_ENV_FUNC(growth_factor, "H2_CUB_BIN_GROWTH", 2)
 H2_GET_UINT_ENV_FUNC(min_bin, "H2_CUB_MIN_BIN", 1)
+H2_GET_UINT_ENV_FUNC(stats_interval, "H2_ALLOCATOR_STATS_INTERVAL", 0)
 H2_GET_UINT_ENV_FUNC(max_bin,
                      "H2_CUB_MAX_BIN",
                      h2::gpu::RawCUBAllocType::INVALID_BIN)
@@ -76,6 +120,39 @@ static bool debug() noexcept
     return (env && std::strlen(env) && env[0] != '0');
 }
 
+static size_t async_release_threshold() noexcept
+{
+    char const* env = std::getenv("H2_ASYNC_RELEASE_THRESHOLD");
+    return (env ? static_cast<size_t>(std::atoll(env)) : ~size_t{0});
+}
+
+// Sets exactly one of bytes and fraction to nonzero.
+static void pool_reserve(size_t& bytes, double& fraction) noexcept
+{
+    char const* env = std::getenv("H2_GPU_POOL_RESERVE");
+    bytes = 0;
+    fraction = 0.75;
+    if (!env)
+        return;
+    if (std::strchr(env, '.'))
+        fraction = std::atof(env);
+    else if ((bytes = static_cast<size_t>(std::atoll(env))))
+        fraction = 0.0;
+}
+
+static h2::gpu::DeviceAllocator::Backend device_allocator_backend()
+{
+    char const* env = std::getenv("H2_DEVICE_ALLOCATOR");
+    if (!env || std::strcmp(env, "cub") == 0)
+        return h2::gpu::DeviceAllocator::Backend::CUB;
+    if (std::strcmp(env, "async") == 0)
+        return h2::gpu::DeviceAllocator::Backend::ASYNC;
+    if (std::strcmp(env, "reserved") == 0)
+        return h2::gpu::DeviceAllocator::Backend::RESERVED;
+    throw std::runtime_error(std::string("Unknown H2_DEVICE_ALLOCATOR: ")
+                             + env);
+}
+
 h2::gpu::RawCUBAllocType make_allocator(unsigned int const gf,
                                         unsigned int const min,
                                         unsigned int const max,
@@ -104,3 +181,747 @@ h2::gpu::RawCUBAllocType& h2::gpu::default_cub_allocator()
         growth_factor(), min_bin(), max_bin(), max_cached_size(), debug());
     return alloc;
 }
+
+namespace
+{
+
+void check(h2::gpu::DeviceError const status)
+{
+    if (!h2::gpu::ok(status))
+        throw h2::gpu::GPUError(status);
+}
+
+// Records the allocations and their statistics for the backends
+class TrackingDeviceAllocator : public h2::gpu::DeviceAllocator
+{
+public:
+    TrackingDeviceAllocator(std::string name)
+        : m_name{std::move(name)}, m_stats_interval{stats_interval()}
+    {}
+
+    std::string const& name() const noexcept final { return m_name; }
+
+    h2::gpu::DeviceError
+    allocate(void** ptr, size_t bytes, h2::gpu::DeviceStream stream) final
+    {
+        int const device = h2::gpu::current_gpu();
+        h2::gpu::DeviceError status;
+        bool log = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            bool hit = false;
+            status = do_allocate(ptr, bytes, stream, device, hit);
+            if (!h2::gpu::ok(status))
+                return status;
+            m_allocs[*ptr] = Allocation{bytes, device, stream};
+            auto& stats = m_stats[device];
+            ++stats.num_allocs;
+            if (hit)
+                ++stats.num_cache_hits;
+            stats.bytes_in_use += bytes;
+            stats.peak_bytes_in_use =
+                std::max(stats.peak_bytes_in_use, stats.bytes_in_use);
+            log = m_stats_interval
+                  && stats.num_allocs % m_stats_interval == 0;
+        }
+        if (log)
+            log_stats();
+        return status;
+    }
+
+    h2::gpu::DeviceError deallocate(void* ptr) final
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        auto const it = m_allocs.find(ptr);
+        if (it == m_allocs.end())
+            throw std::runtime_error("Deallocating device memory not "
+                                     "allocated by this allocator");
+        auto const alloc = it->second;
+        m_allocs.erase(it);
+        m_stats[alloc.device].bytes_in_use -= alloc.bytes;
+        return do_deallocate(ptr, alloc.device, alloc.stream);
+    }
+
+    h2::gpu::DeviceAllocatorStats stats(int const device) const final
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        h2::gpu::DeviceAllocatorStats stats;
+        auto const it = m_stats.find(device);
+        if (it != m_stats.end())
+            stats = it->second;
+        get_held_bytes(device, stats.bytes_reserved, stats.bytes_cached);
+        return stats;
+    }
+
+protected:
+    struct Allocation
+    {
+        size_t bytes;
+        int device;
+        h2::gpu::DeviceStream stream;
+    };
+
+    // Called with m_mtx held. hit is set if cached memory is used.
+    virtual h2::gpu::DeviceError do_allocate(void** ptr,
+                                             size_t bytes,
+                                             h2::gpu::DeviceStream stream,
+                                             int device,
+                                             bool& hit) = 0;
+    virtual h2::gpu::DeviceError
+    do_deallocate(void* ptr, int device, h2::gpu::DeviceStream stream) = 0;
+    virtual void
+    get_held_bytes(int device, size_t& in_use, size_t& cached) const = 0;
+
+private:
+    std::string const m_name;
+    unsigned int const m_stats_interval;
+    mutable std::mutex m_mtx;
+    std::unordered_map<void*, Allocation> m_allocs;
+    std::map<int, h2::gpu::DeviceAllocatorStats> m_stats;
+};
+
+class CUBDeviceAllocator final : public TrackingDeviceAllocator
+{
+public:
+    // Wraps an allocator owned elsewhere
+    CUBDeviceAllocator(h2::gpu::RawCUBAllocType& alloc, std::string name)
+        : TrackingDeviceAllocator{std::move(name)}, m_alloc{alloc}
+    {}
+    CUBDeviceAllocator(std::unique_ptr<h2::gpu::RawCUBAllocType> alloc,
+                       std::string name)
+        : TrackingDeviceAllocator{std::move(name)},
+          m_owned{std::move(alloc)},
+          m_alloc{*m_owned}
+    {}
+
+    Backend backend() const noexcept override { return Backend::CUB; }
+
+    void release_unused() override { check(m_alloc.FreeAllCached()); }
+
+protected:
+    h2::gpu::DeviceError do_allocate(void** ptr,
+                                     size_t bytes,
+                                     h2::gpu::DeviceStream stream,
+                                     int device,
+                                     bool& hit) override
+    {
+        size_t in_use, cached_before, cached_after;
+        get_held_bytes(device, in_use, cached_before);
+        auto const status = m_alloc.DeviceAllocate(device, ptr, bytes, stream);
+        get_held_bytes(device, in_use, cached_after);
+        hit = cached_after < cached_before;
+        return status;
+    }
+
+    h2::gpu::DeviceError do_deallocate(void* ptr,
+                                       int device,
+                                       h2::gpu::DeviceStream) override
+    {
+        return m_alloc.DeviceFree(device, ptr);
+    }
+
+    void get_held_bytes(int const device,
+                        size_t& in_use,
+                        size_t& cached) const override
+    {
+        std::lock_guard<std::mutex> lock(m_alloc.mutex);
+        auto const it = m_alloc.cached_bytes.find(device);
+        in_use = it != m_alloc.cached_bytes.end() ? it->second.live : 0;
+        cached = it != m_alloc.cached_bytes.end() ? it->second.free : 0;
+    }
+
+private:
+    std::unique_ptr<h2::gpu::RawCUBAllocType> m_owned;
+    h2::gpu::RawCUBAllocType& m_alloc;
+};
+
+#if H2_HAS_CUDA
+using MemPool = cudaMemPool_t;
+#elif H2_HAS_ROCM
+using MemPool = hipMemPool_t;
+#endif
+
+MemPool make_mem_pool(int device, size_t release_threshold)
+{
+    MemPool pool;
+    uint64_t threshold = release_threshold;
+#if H2_HAS_CUDA
+    cudaMemPoolProps props = {};
+    props.allocType = cudaMemAllocationTypePinned;
+    props.handleTypes = cudaMemHandleTypeNone;
+    props.location.type = cudaMemLocationTypeDevice;
+    props.location.id = device;
+    check(cudaMemPoolCreate(&pool, &props));
+    check(cudaMemPoolSetAttribute(
+        pool, cudaMemPoolAttrReleaseThreshold, &threshold));
+#elif H2_HAS_ROCM
+    hipMemPoolProps props = {};
+    props.allocType = hipMemAllocationTypePinned;
+    props.handleTypes = hipMemHandleTypeNone;
+    props.location.type = hipMemLocationTypeDevice;
+    props.location.id = device;
+    check(hipMemPoolCreate(&pool, &props));
+    check(hipMemPoolSetAttribute(
+        pool, hipMemPoolAttrReleaseThreshold, &threshold));
+#endif
+    H2_GPU_TRACE("memory pool(device={}, release_threshold={})",
+                 device,
+                 release_threshold);
+    return pool;
+}
+
+class AsyncDeviceAllocator final : public TrackingDeviceAllocator
+{
+public:
+    AsyncDeviceAllocator(size_t release_threshold, std::string name)
+        : TrackingDeviceAllocator{std::move(name)},
+          m_release_threshold{release_threshold}
+    {}
+
+    ~AsyncDeviceAllocator()
+    {
+        // Outstanding allocations are freed by destroying the pools
+        for (auto& pool : m_pools)
+        {
+            if (!pool)
+                continue;
+#if H2_HAS_CUDA
+            (void) cudaMemPoolDestroy(pool);
+#elif H2_HAS_ROCM
+            (void) hipMemPoolDestroy(pool);
+#endif
+        }
+    }
+
+    Backend backend() const noexcept override { return Backend::ASYNC; }
+
+    void release_unused() override
+    {
+        std::lock_guard<std::mutex> lock(m_pools_mtx);
+        for (auto& pool : m_pools)
+        {
+            if (!pool)
+                continue;
+#if H2_HAS_CUDA
+            check(cudaMemPoolTrimTo(pool, 0));
+#elif H2_HAS_ROCM
+            check(hipMemPoolTrimTo(pool, 0));
+#endif
+        }
+    }
+
+protected:
+    h2::gpu::DeviceError do_allocate(void** ptr,
+                                     size_t bytes,
+                                     h2::gpu::DeviceStream stream,
+                                     int device,
+                                     bool& hit) override
+    {
+        auto const pool = get_pool(device);
+        auto const reserved_before = get_attr(pool, ReservedMemCurrent);
+#if H2_HAS_CUDA
+        auto const status = cudaMallocFromPoolAsync(ptr, bytes, pool, stream);
+#elif H2_HAS_ROCM
+        auto const status = hipMallocFromPoolAsync(ptr, bytes, pool, stream);
+#endif
+        hit = get_attr(pool, ReservedMemCurrent) <= reserved_before;
+        return status;
+    }
+
+    h2::gpu::DeviceError do_deallocate(void* ptr,
+                                       int,
+                                       h2::gpu::DeviceStream stream) override
+    {
+#if H2_HAS_CUDA
+        return cudaFreeAsync(ptr, stream);
+#elif H2_HAS_ROCM
+        return hipFreeAsync(ptr, stream);
+#endif
+    }
+
+    void get_held_bytes(int const device,
+                        size_t& in_use,
+                        size_t& cached) const override
+    {
+        in_use = cached = 0;
+        std::lock_guard<std::mutex> lock(m_pools_mtx);
+        if (device >= static_cast<int>(m_pools.size()) || !m_pools[device])
+            return;
+        in_use = get_attr(m_pools[device], UsedMemCurrent);
+        cached = get_attr(m_pools[device], ReservedMemCurrent) - in_use;
+    }
+
+private:
+#if H2_HAS_CUDA
+    static constexpr auto ReservedMemCurrent =
+        cudaMemPoolAttrReservedMemCurrent;
+    static constexpr auto UsedMemCurrent = cudaMemPoolAttrUsedMemCurrent;
+#elif H2_HAS_ROCM
+    static constexpr auto ReservedMemCurrent = hipMemPoolAttrReservedMemCurrent;
+    static constexpr auto UsedMemCurrent = hipMemPoolAttrUsedMemCurrent;
+#endif
+
+    size_t const m_release_threshold;
+    mutable std::mutex m_pools_mtx;
+    // Indexed by device; created on first use
+    std::vector<MemPool> m_pools;
+
+    template <typename AttrT>
+    static size_t get_attr(MemPool pool, AttrT attr)
+    {
+        uint64_t value = 0;
+#if H2_HAS_CUDA
+        check(cudaMemPoolGetAttribute(pool, attr, &value));
+#elif H2_HAS_ROCM
+        check(hipMemPoolGetAttribute(pool, attr, &value));
+#endif
+        return value;
+    }
+
+    MemPool get_pool(int device)
+    {
+        std::lock_guard<std::mutex> lock(m_pools_mtx);
+        if (device >= static_cast<int>(m_pools.size()))
+            m_pools.resize(device + 1, nullptr);
+        if (!m_pools[device])
+            m_pools[device] = make_mem_pool(device, m_release_threshold);
+        return m_pools[device];
+    }
+};
+
+
+// Sub-allocates a chunk reserved on each device. Blocks are at least
+// block_alignment apart, and the free ones are kept by size for best
+// fit and merged with their free neighbors.
+//
+// Like with (HIP)CUB, work on the stream of a freed block may still
+// use it. An event recorded at deallocation guards the block until
+// the work completes, unless it is reused on the same stream.
+class ReservedDeviceAllocator final : public TrackingDeviceAllocator
+{
+public:
+    ReservedDeviceAllocator(size_t reserve_bytes,
+                            double reserve_fraction,
+                            std::string name)
+        : TrackingDeviceAllocator{std::move(name)},
+          m_reserve_bytes{reserve_bytes},
+          m_reserve_fraction{reserve_fraction}
+    {}
+
+    ~ReservedDeviceAllocator()
+    {
+        for (auto& [device, chunk] : m_chunks)
+        {
+            chunk.blocks.clear();
+            if (!chunk.base)
+                continue;
+#if H2_HAS_CUDA
+            (void) cudaFree(chunk.base);
+#elif H2_HAS_ROCM
+            (void) hipFree(chunk.base);
+#endif
+        }
+    }
+
+    Backend backend() const noexcept override { return Backend::RESERVED; }
+
+    // The chunks are kept for the lifetime of the allocator, and the
+    // cache of default_cub_allocator() is shared with other users.
+    void release_unused() override {}
+
+    size_t max_allocatable_size(size_t const limit,
+                                int const device) const override
+    {
+        std::lock_guard<std::mutex> lock(m_chunks_mtx);
+        auto const it = m_chunks.find(device);
+        if (it == m_chunks.end() || it->second.free_blocks.empty())
+            return limit;
+        return std::min(limit, it->second.free_blocks.rbegin()->first);
+    }
+
+protected:
+    h2::gpu::DeviceError do_allocate(void** ptr,
+                                     size_t bytes,
+                                     h2::gpu::DeviceStream stream,
+                                     int device,
+                                     bool& hit) override
+    {
+        std::lock_guard<std::mutex> lock(m_chunks_mtx);
+        auto& chunk = get_chunk(device);
+        size_t const size = round_up(std::max(bytes, size_t{1}));
+        auto it = chunk.free_blocks.lower_bound(size);
+        while (it != chunk.free_blocks.end()
+               && !is_usable(chunk.blocks.at(it->second), stream))
+            ++it;
+        if (it == chunk.free_blocks.end())
+        {
+            hit = false;
+            auto const status = h2::gpu::default_cub_allocator().DeviceAllocate(
+                device, ptr, bytes, stream);
+            if (h2::gpu::ok(status))
+                m_overflow.insert(*ptr);
+            return status;
+        }
+
+        size_t const offset = it->second;
+        chunk.free_blocks.erase(it);
+        auto& block = chunk.blocks.at(offset);
+        if (block.size > size)
+        {
+            // The rest stays guarded by the event, if any.
+            size_t const rest_offset = offset + size;
+            auto& rest = chunk.blocks[rest_offset];
+            rest.size = block.size - size;
+            rest.free = true;
+            rest.stream = block.stream;
+            rest.event = std::move(block.event);
+            chunk.free_blocks.emplace(rest.size, rest_offset);
+            block.size = size;
+        }
+        block.event.reset();
+        block.free = false;
+        block.stream = stream;
+        chunk.in_use += block.size;
+        *ptr = chunk.base + offset;
+        hit = true;
+        return h2::gpu::DeviceError{};
+    }
+
+    h2::gpu::DeviceError do_deallocate(void* ptr,
+                                       int device,
+                                       h2::gpu::DeviceStream) override
+    {
+        std::lock_guard<std::mutex> lock(m_chunks_mtx);
+        if (m_overflow.erase(ptr))
+            return h2::gpu::default_cub_allocator().DeviceFree(device, ptr);
+
+        auto& chunk = m_chunks.at(device);
+        size_t offset = static_cast<char*>(ptr) - chunk.base;
+        auto it = chunk.blocks.find(offset);
+        auto& block = it->second;
+        block.free = true;
+        chunk.in_use -= block.size;
+        {
+            h2::gpu::DeviceGuard guard{device};
+            block.event = h2::gpu::acquire_event_notiming();
+#if H2_HAS_CUDA
+            check(cudaEventRecord(block.event, block.stream));
+#elif H2_HAS_ROCM
+            check(hipEventRecord(block.event, block.stream));
+#endif
+        }
+
+        auto next = std::next(it);
+        if (next != chunk.blocks.end() && can_merge(block, next->second))
+        {
+            erase_free(chunk, next->first, next->second.size);
+            block.size += next->second.size;
+            chunk.blocks.erase(next);
+        }
+        if (it != chunk.blocks.begin())
+        {
+            auto prev = std::prev(it);
+            if (can_merge(block, prev->second))
+            {
+                erase_free(chunk, prev->first, prev->second.size);
+                prev->second.size += block.size;
+                prev->second.stream = block.stream;
+                prev->second.event = std::move(block.event);
+                chunk.blocks.erase(it);
+                it = prev;
+                offset = prev->first;
+            }
+        }
+        chunk.free_blocks.emplace(it->second.size, offset);
+        return h2::gpu::DeviceError{};
+    }
+
+    void get_held_bytes(int const device,
+                        size_t& in_use,
+                        size_t& cached) const override
+    {
+        std::lock_guard<std::mutex> lock(m_chunks_mtx);
+        auto const it = m_chunks.find(device);
+        in_use = it != m_chunks.end() ? it->second.in_use : 0;
+        cached = it != m_chunks.end() ? it->second.size - in_use : 0;
+    }
+
+private:
+    static constexpr size_t block_alignment = 256;
+
+    struct Block
+    {
+        size_t size = 0;
+        bool free = false;
+        // Stream of the last allocation of the block
+        h2::gpu::DeviceStream stream = nullptr;
+        // Set while work on stream may use the free block
+        h2::gpu::PooledEvent event;
+    };
+
+    struct Chunk
+    {
+        // Set on the first use, even if nothing could be reserved
+        bool set_up = false;
+        char* base = nullptr;
+        size_t size = 0;
+        size_t in_use = 0;
+        // By offset
+        std::map<size_t, Block> blocks;
+        // Offsets of the free blocks by size
+        std::multimap<size_t, size_t> free_blocks;
+    };
+
+    size_t const m_reserve_bytes;
+    double const m_reserve_fraction;
+    mutable std::mutex m_chunks_mtx;
+    std::map<int, Chunk> m_chunks;
+    // Allocations served by default_cub_allocator()
+    std::unordered_set<void*> m_overflow;
+
+    static size_t round_up(size_t const bytes) noexcept
+    {
+        return (bytes + block_alignment - 1) / block_alignment
+               * block_alignment;
+    }
+
+    static bool is_done(h2::gpu::DeviceEvent const event)
+    {
+#if H2_HAS_CUDA
+        auto const status = cudaEventQuery(event);
+        if (status == cudaErrorNotReady)
+            return false;
+#elif H2_HAS_ROCM
+        auto const status = hipEventQuery(event);
+        if (status == hipErrorNotReady)
+            return false;
+#endif
+        check(status);
+        return true;
+    }
+
+    static bool is_usable(Block& block, h2::gpu::DeviceStream const stream)
+    {
+        if (!block.event || block.stream == stream)
+            return true;
+        if (!is_done(block.event))
+            return false;
+        block.event.reset();
+        return true;
+    }
+
+    // block was just freed, so its event is the latest on its stream.
+    static bool can_merge(Block& block, Block& other)
+    {
+        return other.free && is_usable(other, block.stream);
+    }
+
+    static void erase_free(Chunk& chunk, size_t const offset, size_t const size)
+    {
+        auto range = chunk.free_blocks.equal_range(size);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second == offset)
+            {
+                chunk.free_blocks.erase(it);
+                return;
+            }
+        }
+    }
+
+    // Called on the device, which is current.
+    Chunk& get_chunk(int const device)
+    {
+        auto& chunk = m_chunks[device];
+        if (!chunk.set_up)
+        {
+            chunk.set_up = true;
+            size_t size = m_reserve_bytes;
+            if (size == 0)
+                size = static_cast<size_t>(m_reserve_fraction
+                                           * h2::gpu::mem_info().total);
+            size = size / block_alignment * block_alignment;
+            void* base = nullptr;
+#if H2_HAS_CUDA
+            auto const status = cudaMalloc(&base, size);
+#elif H2_HAS_ROCM
+            auto const status = hipMalloc(&base, size);
+#endif
+            if (size == 0 || !h2::gpu::ok(status))
+            {
+                H2_GPU_WARN("could not reserve {} bytes on device {}; "
+                            "falling back to the (HIP)CUB allocator",
+                            size,
+                            device);
+                return chunk;
+            }
+            H2_GPU_DEBUG("reserved {} bytes at {} on device {}",
+                         size,
+                         base,
+                         device);
+            chunk.base = static_cast<char*>(base);
+            chunk.size = size;
+            auto& block = chunk.blocks[0];
+            block.size = size;
+            block.free = true;
+            chunk.free_blocks.emplace(size, 0);
+        }
+        return chunk;
+    }
+};
+
+} // namespace
+
+std::string h2::gpu::to_string(DeviceAllocatorStats const& stats)
+{
+    std::ostringstream oss;
+    oss << "allocs=" << stats.num_allocs << ", hit_rate=" << stats.hit_rate()
+        << ", in_use=" << stats.bytes_in_use
+        << ", peak_in_use=" << stats.peak_bytes_in_use
+        << ", reserved=" << stats.bytes_reserved
+        << ", cached=" << stats.bytes_cached
+        << ", fragmentation=" << stats.fragmentation();
+    return oss.str();
+}
+
+void h2::gpu::DeviceAllocator::log_stats() const
+{
+    int const n = num_gpus();
+    for (int device = 0; device < n; ++device)
+    {
+        auto const s = stats(device);
+        if (s.num_allocs == 0)
+            continue;
+        H2_GPU_INFO("{} allocator on device {}: {}",
+                    name(),
+                    device,
+                    to_string(s));
+    }
+}
+
+std::unique_ptr<h2::gpu::DeviceAllocator>
+h2::gpu::make_cub_device_allocator(unsigned int const bin_growth,
+                                   unsigned int const min_bin,
+                                   unsigned int const max_bin,
+                                   size_t const max_cached_bytes,
+                                   bool const debug,
+                                   std::string name)
+{
+    return std::make_unique<CUBDeviceAllocator>(
+        std::make_unique<RawCUBAllocType>(/*bin_growth=*/bin_growth,
+                                          /*min_bin=*/min_bin,
+                                          /*max_bin=*/max_bin,
+                                          /*max_cached_bytes=*/max_cached_bytes,
+                                          /*skip_cleanup=*/false,
+                                          /*debug=*/debug),
+        std::move(name));
+}
+
+std::unique_ptr<h2::gpu::DeviceAllocator>
+h2::gpu::make_async_device_allocator(size_t const release_threshold,
+                                     std::string name)
+{
+    return std::make_unique<AsyncDeviceAllocator>(release_threshold,
+                                                  std::move(name));
+}
+
+std::unique_ptr<h2::gpu::DeviceAllocator>
+h2::gpu::make_reserved_device_allocator(size_t const reserve_bytes,
+                                        double const reserve_fraction,
+                                        std::string name)
+{
+    return std::make_unique<ReservedDeviceAllocator>(
+        reserve_bytes, reserve_fraction, std::move(name));
+}
+
+h2::gpu::DeviceAllocator& h2::gpu::default_device_allocator()
+{
+    static std::unique_ptr<DeviceAllocator> alloc =
+        []() -> std::unique_ptr<DeviceAllocator> {
+        auto const backend = device_allocator_backend();
+        if (backend == DeviceAllocator::Backend::ASYNC)
+            return make_async_device_allocator(async_release_threshold());
+        if (backend == DeviceAllocator::Backend::RESERVED)
+        {
+            size_t bytes;
+            double fraction;
+            pool_reserve(bytes, fraction);
+            return make_reserved_device_allocator(bytes, fraction);
+        }
+        return std::make_unique<CUBDeviceAllocator>(default_cub_allocator(),
+                                                    "cub");
+    }();
+    return *alloc;
+}
+
+void h2::gpu::mem_copy_batch(std::vector<MemCopyDesc> const& copies,
+                             DeviceStream const stream)
+{
+    std::vector<MemCopyDesc> merged;
+    merged.reserve(copies.size());
+    for (auto const& c : copies)
+    {
+        if (c.bytes == 0)
+            continue;
+        if (!merged.empty())
+        {
+            auto& last = merged.back();
+            if (static_cast<char*>(last.dst) + last.bytes == c.dst
+                && static_cast<char const*>(last.src) + last.bytes == c.src)
+            {
+                last.bytes += c.bytes;
+                continue;
+            }
+        }
+        merged.push_back(c);
+    }
+    H2_GPU_TRACE("mem_copy_batch(copies={}, merged={}, stream={})",
+                 copies.size(),
+                 merged.size(),
+                 (void*) stream);
+
+#if H2_HAS_CUDA && CUDART_VERSION >= 12080
+    // Batches may not be submitted to the legacy default stream.
+    if (merged.size() > 1 && stream != nullptr)
+    {
+        std::vector<void*> dsts, srcs;
+        std::vector<size_t> sizes;
+        dsts.reserve(merged.size());
+        srcs.reserve(merged.size());
+        sizes.reserve(merged.size());
+        for (auto const& c : merged)
+        {
+            dsts.push_back(c.dst);
+            srcs.push_back(const_cast<void*>(c.src));
+            sizes.push_back(c.bytes);
+        }
+        cudaMemcpyAttributes attrs = {};
+        attrs.srcAccessOrder = cudaMemcpySrcAccessOrderStream;
+        size_t attrs_idx = 0;
+#if CUDART_VERSION >= 13000
+        H2_CHECK_CUDA(cudaMemcpyBatchAsync(dsts.data(),
+                                           srcs.data(),
+                                           sizes.data(),
+                                           merged.size(),
+                                           &attrs,
+                                           &attrs_idx,
+                                           1,
+                                           stream));
+#else
+        size_t fail_idx;
+        H2_CHECK_CUDA(cudaMemcpyBatchAsync(dsts.data(),
+                                           srcs.data(),
+                                           sizes.data(),
+                                           merged.size(),
+                                           &attrs,
+                                           &attrs_idx,
+                                           1,
+                                           &fail_idx,
+                                           stream));
+#endif
+        return;
+    }
+#endif
+    for (auto const& c : merged)
+        mem_copy(c.dst, c.src, c.bytes, stream);
+}
@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#include "h2/gpu/pools.hpp"
+
+#include "h2/gpu/logger.hpp"
+#include "h2/gpu/runtime.hpp"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+// Kinds of pooled streams. Streams with an explicit priority p use
+// the kind PRIORITY_BASE + (p - greatest priority of the device).
+enum StreamKind : int
+{
+    STREAM_DEFAULT = 0,
+    STREAM_NONBLOCKING = 1,
+    STREAM_PRIORITY_BASE = 2,
+};
+
+enum EventKind : int
+{
+    EVENT_DEFAULT = 0,
+    EVENT_NOTIMING = 1,
+};
+
+template <typename HandleT>
+class Pool
+{
+public:
+    HandleT take(int device, int kind)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_idle.find({device, kind});
+        if (it == m_idle.end() || it->second.empty())
+            return nullptr;
+        auto const handle = it->second.back();
+        it->second.pop_back();
+        return handle;
+    }
+
+    void put(int device, int kind, HandleT handle)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle[{device, kind}].push_back(handle);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto const& [key, handles] : m_idle)
+            for (auto const& handle : handles)
+                h2::gpu::destroy(handle);
+        m_idle.clear();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::map<std::pair<int, int>, std::vector<HandleT>> m_idle;
+};
+
+// Never destroyed so that handles held by static objects can still be
+// returned at exit.
+template <typename HandleT>
+Pool<HandleT>& get_pool()
+{
+    static auto* pool = new Pool<HandleT>;
+    return *pool;
+}
+
+// Streams returned by {high,low}_priority_stream, keyed by device and
+// priority. Never destroyed for the same reason as the pools.
+struct SharedStreams
+{
+    std::mutex mutex;
+    std::map<std::pair<int, int>, h2::gpu::PooledStream> streams;
+};
+
+SharedStreams& get_shared_streams()
+{
+    static auto* streams = new SharedStreams;
+    return *streams;
+}
+
+h2::gpu::DeviceStream get_shared_stream(int priority)
+{
+    auto& shared = get_shared_streams();
+    int const device = h2::gpu::current_gpu();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    auto& stream = shared.streams[{device, priority}];
+    if (!stream)
+        stream = h2::gpu::acquire_stream_with_priority(priority);
+    return stream.get();
+}
+
+template <typename HandleT, typename MakeT>
+h2::gpu::PooledHandle<HandleT> acquire(int kind, MakeT make)
+{
+    int const device = h2::gpu::current_gpu();
+    HandleT handle = get_pool<HandleT>().take(device, kind);
+    if (handle)
+        H2_GPU_TRACE("reusing pooled handle {} on device {}",
+                     (void*) handle,
+                     device);
+    else
+        handle = make();
+    return {handle, device, kind};
+}
+
+} // namespace
+
+template <typename HandleT>
+void h2::gpu::PooledHandle<HandleT>::reset() noexcept
+{
+    if (!m_handle)
+        return;
+    get_pool<HandleT>().put(m_device, m_kind, m_handle);
+    m_handle = nullptr;
+}
+
+template class h2::gpu::PooledHandle<h2::gpu::DeviceStream>;
+template class h2::gpu::PooledHandle<h2::gpu::DeviceEvent>;
+
+h2::gpu::PooledStream h2::gpu::acquire_stream()
+{
+    return acquire<DeviceStream>(STREAM_DEFAULT,
+                                 [] { return make_stream(); });
+}
+
+h2::gpu::PooledStream h2::gpu::acquire_stream_nonblocking()
+{
+    return acquire<DeviceStream>(STREAM_NONBLOCKING,
+                                 [] { return make_stream_nonblocking(); });
+}
+
+h2::gpu::PooledStream h2::gpu::acquire_stream_with_priority(int priority)
+{
+    auto const range = stream_priority_range();
+    priority = std::clamp(priority, range.greatest, range.least);
+    return acquire<DeviceStream>(
+        STREAM_PRIORITY_BASE + (priority - range.greatest),
+        [priority] { return make_stream_with_priority(priority); });
+}
+
+h2::gpu::PooledEvent h2::gpu::acquire_event()
+{
+    return acquire<DeviceEvent>(EVENT_DEFAULT, [] { return make_event(); });
+}
+
+h2::gpu::PooledEvent h2::gpu::acquire_event_notiming()
+{
+    return acquire<DeviceEvent>(EVENT_NOTIMING,
+                                [] { return make_event_notiming(); });
+}
+
+h2::gpu::DeviceStream h2::gpu::high_priority_stream()
+{
+    return get_shared_stream(stream_priority_range().greatest);
+}
+
+h2::gpu::DeviceStream h2::gpu::low_priority_stream()
+{
+    return get_shared_stream(stream_priority_range().least);
+}
+
+void h2::gpu::release_pooled_resources()
+{
+    H2_GPU_TRACE("releasing pooled streams and events");
+    {
+        auto& shared = get_shared_streams();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.streams.clear();
+    }
+    get_pool<DeviceStream>().clear();
+    get_pool<DeviceEvent>().clear();
+}
@@ -0,0 +1,148 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#include "h2/gpu/ranges.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if H2_HAS_CUDA
+#include <nvToolsExt.h>
+#elif H2_HAS_ROCM
+#include <roctracer/roctx.h>
+#endif
+
+// Note: Ranges are enabled at startup if H2_GPU_RANGES is set to any
+// string that matches "[^0].*".
+
+namespace
+{
+
+bool check_bool_cstr(char const* const str)
+{
+    return (str && std::strlen(str) && str[0] != '0');
+}
+
+thread_local int range_depth_ = 0;
+
+#if H2_HAS_CUDA
+// ARGB colors of the categories, starting from Compute.
+constexpr std::uint32_t category_colors[] = {
+    0xFF4C72B0, // Compute
+    0xFFDD8452, // HaloExchange
+    0xFF55A868, // Shuffle
+    0xFFC44E52, // Collective
+    0xFF8172B3, // Memory
+    0xFF937860, // Runtime
+};
+#endif
+
+constexpr h2::gpu::RangeCategory all_categories[] = {
+    h2::gpu::RangeCategory::Compute,
+    h2::gpu::RangeCategory::HaloExchange,
+    h2::gpu::RangeCategory::Shuffle,
+    h2::gpu::RangeCategory::Collective,
+    h2::gpu::RangeCategory::Memory,
+    h2::gpu::RangeCategory::Runtime,
+};
+
+} // namespace
+
+std::atomic<bool> h2_internal::gpu_ranges_enabled{
+    check_bool_cstr(std::getenv("H2_GPU_RANGES"))};
+
+char const* h2::gpu::to_string(RangeCategory const category) noexcept
+{
+    switch (category)
+    {
+    case RangeCategory::Compute: return "compute";
+    case RangeCategory::HaloExchange: return "halo_exchange";
+    case RangeCategory::Shuffle: return "shuffle";
+    case RangeCategory::Collective: return "collective";
+    case RangeCategory::Memory: return "memory";
+    case RangeCategory::Runtime: return "runtime";
+    }
+    return "unknown";
+}
+
+void* h2::gpu::RangeDomain::handle() const
+{
+    void* handle = m_handle.load(std::memory_order_acquire);
+#if H2_HAS_CUDA
+    if (!handle)
+    {
+        auto const domain = nvtxDomainCreateA(m_name);
+        for (auto const c : all_categories)
+            nvtxDomainNameCategoryA(
+                domain, static_cast<std::uint32_t>(c), to_string(c));
+        if (m_handle.compare_exchange_strong(handle, domain))
+            handle = domain;
+        else
+            nvtxDomainDestroy(domain);
+    }
+#else
+    (void) all_categories;
+#endif
+    return handle;
+}
+
+h2::gpu::RangeDomain const& h2::gpu::h2_range_domain()
+{
+    static RangeDomain const domain{"h2"};
+    return domain;
+}
+
+void h2::gpu::set_ranges_enabled(bool const enabled) noexcept
+{
+    h2_internal::gpu_ranges_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void h2::gpu::range_push(RangeDomain const& domain,
+                         char const* const name,
+                         RangeCategory const category)
+{
+    ++range_depth_;
+#if H2_HAS_CUDA
+    nvtxEventAttributes_t attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.version = NVTX_VERSION;
+    attr.size = NVTX_EVENT_ATTRIB_STRUCT_SIZE;
+    attr.category = static_cast<std::uint32_t>(category);
+    attr.colorType = NVTX_COLOR_ARGB;
+    attr.color = category_colors[attr.category - 1];
+    attr.messageType = NVTX_MESSAGE_TYPE_ASCII;
+    attr.message.ascii = name;
+    nvtxDomainRangePushEx(
+        static_cast<nvtxDomainHandle_t>(domain.handle()), &attr);
+#elif H2_HAS_ROCM
+    (void) category;
+    roctxRangePushA((std::string(domain.name()) + ":" + name).c_str());
+#else
+    (void) domain;
+    (void) name;
+    (void) category;
+#endif
+}
+
+void h2::gpu::range_pop(RangeDomain const& domain)
+{
+    if (range_depth_ > 0)
+        --range_depth_;
+#if H2_HAS_CUDA
+    nvtxDomainRangePop(static_cast<nvtxDomainHandle_t>(domain.handle()));
+#elif H2_HAS_ROCM
+    (void) domain;
+    roctxRangePop();
+#else
+    (void) domain;
+#endif
+}
+
+int h2::gpu::range_depth() noexcept
+{
+    return range_depth_;
+}
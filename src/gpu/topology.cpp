@@ -0,0 +1,214 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#include "topology.hpp"
+
+#include "h2/gpu/logger.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <dirent.h>
+#include <sched.h>
+
+namespace
+{
+
+static std::string read_first_line(std::string const& path)
+{
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+// -1 if the file is missing or does not hold a node.
+static int read_numa_node(std::string const& path)
+{
+    auto const line = read_first_line(path);
+    if (line.empty())
+        return -1;
+    return std::max(std::atoi(line.c_str()), -1);
+}
+
+static std::vector<std::string> list_dir(std::string const& path)
+{
+    std::vector<std::string> entries;
+    if (DIR* dir = opendir(path.c_str()))
+    {
+        while (dirent* ent = readdir(dir))
+        {
+            if (ent->d_name[0] != '.')
+                entries.emplace_back(ent->d_name);
+        }
+        closedir(dir);
+    }
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+static std::string to_string(std::set<int> const& nodes)
+{
+    if (nodes.empty())
+        return "unknown";
+    std::ostringstream oss;
+    for (auto it = nodes.begin(); it != nodes.end(); ++it)
+        oss << (it == nodes.begin() ? "" : ",") << *it;
+    return oss.str();
+}
+
+} // namespace
+
+std::vector<int> h2_internal::parse_cpu_list(std::string const& str)
+{
+    std::vector<int> cpus;
+    std::istringstream iss(str);
+    std::string range;
+    while (std::getline(iss, range, ','))
+    {
+        if (range.empty() || !std::isdigit(range[0]))
+            continue;
+        auto const dash = range.find('-');
+        int const first = std::atoi(range.c_str());
+        int const last = (dash == std::string::npos)
+                             ? first
+                             : std::atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+int h2_internal::pci_numa_node(std::string const& pci_bus_id)
+{
+    // sysfs uses lower-case hex digits.
+    std::string id = pci_bus_id;
+    std::transform(id.begin(), id.end(), id.begin(), [](unsigned char c) {
+        return std::tolower(c);
+    });
+    return read_numa_node("/sys/bus/pci/devices/" + id + "/numa_node");
+}
+
+std::set<int> h2_internal::affinity_numa_nodes()
+{
+    std::set<int> nodes;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0)
+        return nodes;
+
+    std::string const root = "/sys/devices/system/node/";
+    for (auto const& entry : list_dir(root))
+    {
+        if (entry.compare(0, 4, "node") != 0 || !std::isdigit(entry[4]))
+            continue;
+        int const node = std::atoi(entry.c_str() + 4);
+        auto const cpus =
+            parse_cpu_list(read_first_line(root + entry + "/cpulist"));
+        if (std::any_of(cpus.begin(), cpus.end(), [&mask](int cpu) {
+                return cpu < CPU_SETSIZE && CPU_ISSET(cpu, &mask);
+            }))
+            nodes.insert(node);
+    }
+    return nodes;
+}
+
+std::set<int> h2_internal::nic_numa_nodes()
+{
+    std::set<int> nodes;
+    // InfiniBand and RoCE adapters, then HPE Slingshot ones.
+    for (char const* root : {"/sys/class/infiniband/", "/sys/class/cxi/"})
+    {
+        for (auto const& entry : list_dir(root))
+        {
+            int const node =
+                read_numa_node(std::string(root) + entry + "/device/numa_node");
+            if (node >= 0)
+                nodes.insert(node);
+        }
+    }
+    return nodes;
+}
+
+int h2_internal::choose_local_gpu(std::vector<int> const& gpu_nodes,
+                                  std::set<int> const& cpu_nodes,
+                                  int const local_rank,
+                                  int const local_size)
+{
+    if (local_rank < 0 || local_size <= 0 || gpu_nodes.empty()
+        || std::any_of(gpu_nodes.begin(), gpu_nodes.end(), [](int node) {
+               return node < 0;
+           }))
+        return -1;
+
+    std::set<int> const node_set(gpu_nodes.begin(), gpu_nodes.end());
+    std::vector<int> const nodes(node_set.begin(), node_set.end());
+    int const num_nodes = static_cast<int>(nodes.size());
+    if (num_nodes < 2)
+        return -1;
+
+    std::vector<int> bound;
+    for (int node : nodes)
+        if (cpu_nodes.count(node))
+            bound.push_back(node);
+    // Not bound, or bound across NUMA nodes.
+    if (bound.size() != 1)
+        return -1;
+    int const node = bound.front();
+
+    int const num_gpus = static_cast<int>(gpu_nodes.size());
+    std::vector<int> candidates;
+    for (int gpu = 0; gpu < num_gpus; ++gpu)
+        if (gpu_nodes[gpu] == node)
+            candidates.push_back(gpu);
+
+    // Position of the rank among the ranks bound to its NUMA node.
+    int const node_idx = static_cast<int>(
+        std::find(nodes.begin(), nodes.end(), node) - nodes.begin());
+    int idx = local_rank;
+    if (local_size % num_nodes == 0)
+    {
+        int const per_node = local_size / num_nodes;
+        if (local_rank / per_node == node_idx)
+            idx = local_rank % per_node;
+        else if (local_rank % num_nodes == node_idx)
+            idx = local_rank / num_nodes;
+    }
+    // Ranks whose default GPU is local may still need another one to
+    // leave theirs to a rank of the same node.
+    int const gpu = candidates[idx % candidates.size()];
+    return gpu == local_rank ? -1 : gpu;
+}
+
+int h2_internal::select_gpu_by_topology(std::vector<int> const& gpu_nodes,
+                                        int const local_rank,
+                                        int const local_size)
+{
+    auto const cpu_nodes = affinity_numa_nodes();
+    int const gpu =
+        choose_local_gpu(gpu_nodes, cpu_nodes, local_rank, local_size);
+    int const selected = (gpu >= 0 ? gpu : local_rank);
+    int const gpu_node =
+        (selected < static_cast<int>(gpu_nodes.size()) ? gpu_nodes[selected]
+                                                       : -1);
+
+    auto const nics = nic_numa_nodes();
+    H2_GPU_INFO("local rank {} on NUMA node(s) {} selects GPU {} on NUMA "
+                "node {} ({}); NICs on NUMA node(s) {}",
+                local_rank,
+                to_string(cpu_nodes),
+                selected,
+                gpu_node,
+                (gpu >= 0 ? "topology" : "local rank"),
+                to_string(nics));
+    if (gpu_node >= 0 && !nics.empty() && !nics.count(gpu_node))
+        H2_GPU_WARN("GPU {} has no NIC on its NUMA node {}", selected, gpu_node);
+    return gpu;
+}
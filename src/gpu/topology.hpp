@@ -0,0 +1,64 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#ifndef H2_SRC_GPU_TOPOLOGY_HPP_INCLUDED
+#define H2_SRC_GPU_TOPOLOGY_HPP_INCLUDED
+
+#include <set>
+#include <string>
+#include <vector>
+
+// Helpers for placing a process on a GPU close to its CPUs. The node
+// topology is read from sysfs; everything degrades to "unknown" (an
+// empty set or -1) where that is not available.
+namespace h2_internal
+{
+
+/** @brief Parse a Linux CPU list such as "0-3,8,10-11". */
+std::vector<int> parse_cpu_list(std::string const& str);
+
+/** @brief NUMA node of the PCI device with the given bus ID
+ *         ("domain:bus:device.function"), or -1 if unknown.
+ */
+int pci_numa_node(std::string const& pci_bus_id);
+
+/** @brief NUMA nodes of the CPUs the calling process may run on. */
+std::set<int> affinity_numa_nodes();
+
+/** @brief NUMA nodes of the high-speed network adapters. */
+std::set<int> nic_numa_nodes();
+
+/** @brief Choose a GPU on the NUMA node of the bound CPUs.
+ *
+ *  gpu_nodes holds the NUMA node of each visible GPU. The choice is
+ *  only made if the process is bound to exactly one NUMA node holding
+ *  GPUs, and it is always made through the ranks bound to that node,
+ *  even if the GPU of the local rank is on it already. Local ranks are
+ *  assumed to be bound either in blocks or round-robin over the NUMA
+ *  nodes, which keeps the choices of the ranks of a node distinct in
+ *  both cases.
+ *
+ *  @returns The GPU chosen, or -1 to keep the default.
+ */
+int choose_local_gpu(std::vector<int> const& gpu_nodes,
+                     std::set<int> const& cpu_nodes,
+                     int local_rank,
+                     int local_size);
+
+/** @brief Select a GPU for the local rank from the node topology.
+ *
+ *  Combines the functions above and logs the decision.
+ *
+ *  @returns The GPU selected, or -1 to keep the default.
+ */
+int select_gpu_by_topology(std::vector<int> const& gpu_nodes,
+                           int local_rank,
+                           int local_size);
+
+} // namespace h2_internal
+#endif // H2_SRC_GPU_TOPOLOGY_HPP_INCLUDED
@@ -0,0 +1,91 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#include "h2/tensor/stream_buffer.hpp"
+
+#include "h2/gpu/pools.hpp"
+
+#include <utility>
+
+namespace h2
+{
+
+void order_streams(gpu::DeviceStream earlier, gpu::DeviceStream later)
+{
+    if (earlier == later)
+        return;
+    // The wait captures the event as recorded, so the event can go
+    // back to its pool right away.
+    auto event = gpu::acquire_event_notiming();
+    gpu::record_event(event, earlier);
+    gpu::sync(later, event);
+}
+
+StreamBuffer::StreamBuffer(gpu::MemoryResource& resource,
+                           size_t bytes,
+                           gpu::DeviceStream stream)
+    : m_resource{&resource},
+      m_ptr{bytes ? resource.allocate(bytes, stream) : nullptr},
+      m_bytes{bytes},
+      m_alloc_stream{stream},
+      m_stream{stream}
+{}
+
+StreamBuffer::StreamBuffer(StreamBuffer&& other) noexcept
+    : m_resource{std::exchange(other.m_resource, nullptr)},
+      m_ptr{std::exchange(other.m_ptr, nullptr)},
+      m_bytes{std::exchange(other.m_bytes, 0)},
+      m_alloc_stream{other.m_alloc_stream},
+      m_stream{other.m_stream}
+{}
+
+StreamBuffer& StreamBuffer::operator=(StreamBuffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        m_resource = std::exchange(other.m_resource, nullptr);
+        m_ptr = std::exchange(other.m_ptr, nullptr);
+        m_bytes = std::exchange(other.m_bytes, 0);
+        m_alloc_stream = other.m_alloc_stream;
+        m_stream = other.m_stream;
+    }
+    return *this;
+}
+
+StreamBuffer::~StreamBuffer() { reset(); }
+
+void StreamBuffer::set_stream(gpu::DeviceStream stream)
+{
+    if (m_ptr)
+        order_streams(m_stream, stream);
+    m_stream = stream;
+}
+
+void StreamBuffer::reset() noexcept
+{
+    if (!m_ptr)
+        return;
+    // The resource reuses the memory once the work on the allocation
+    // stream is done, so that work must include the current one's.
+    try
+    {
+        order_streams(m_stream, m_alloc_stream);
+    }
+    catch (...)
+    {
+        // Leak the memory rather than let it be reused too early.
+        m_ptr = nullptr;
+        m_bytes = 0;
+        return;
+    }
+    m_resource->deallocate(m_ptr);
+    m_ptr = nullptr;
+    m_bytes = 0;
+}
+
+} // namespace h2
@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+#include "h2/utils/HelperThreads.hpp"
+
+#include "h2/gpu/logger.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace
+{
+
+std::mutex mutex_;
+std::vector<int> helper_cores_;
+// Registered threads that are still running.
+std::vector<pthread_t> helper_threads_;
+
+static std::string to_string(std::vector<int> const& cpus)
+{
+    std::ostringstream oss;
+    for (size_t i = 0; i < cpus.size(); ++i)
+        oss << (i ? "," : "") << cpus[i];
+    return oss.str();
+}
+
+static cpu_set_t make_cpu_set(std::vector<int> const& cpus)
+{
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &mask);
+    return mask;
+}
+
+static void pin(pthread_t thread, std::vector<int> const& cpus)
+{
+    auto const mask = make_cpu_set(cpus);
+    if (pthread_setaffinity_np(thread, sizeof(mask), &mask) != 0)
+        H2_GPU_WARN("failed to pin a helper thread to cores {}",
+                    to_string(cpus));
+}
+
+// Unregisters the thread it belongs to when the thread exits.
+struct Registration
+{
+    bool registered = false;
+    ~Registration()
+    {
+        if (!registered)
+            return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto const self = pthread_self();
+        helper_threads_.erase(
+            std::remove_if(helper_threads_.begin(),
+                           helper_threads_.end(),
+                           [&](pthread_t t) { return pthread_equal(t, self); }),
+            helper_threads_.end());
+    }
+};
+
+thread_local Registration registration_;
+
+// The CPUs of cpus that belong to the process.
+static std::vector<int> get_share(std::vector<int> const& cpus,
+                                  bool const bound,
+                                  int const local_rank,
+                                  int const local_size)
+{
+    if (bound || local_size <= 1 || local_rank < 0 || local_rank >= local_size)
+        return cpus;
+    auto const size = cpus.size() / local_size;
+    auto const first = cpus.begin() + local_rank * size;
+    return std::vector<int>(first, first + size);
+}
+
+} // namespace
+
+std::vector<int> h2::choose_helper_cores(std::vector<int> const& cpus,
+                                         int const num_cores,
+                                         bool const bound,
+                                         int const local_rank,
+                                         int const local_size)
+{
+    auto const share = get_share(cpus, bound, local_rank, local_size);
+    auto const size = static_cast<int>(share.size());
+    if (num_cores <= 0 || size <= 1)
+        return {};
+    return std::vector<int>(share.end() - std::min(num_cores, size - 1),
+                            share.end());
+}
+
+void h2::reserve_helper_cores(int const num_cores,
+                              int const local_rank,
+                              int const local_size)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (num_cores <= 0 || !helper_cores_.empty())
+        return;
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0)
+        return;
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &mask))
+            cpus.push_back(cpu);
+    bool const bound =
+        static_cast<long>(cpus.size()) < sysconf(_SC_NPROCESSORS_ONLN);
+
+    helper_cores_ =
+        choose_helper_cores(cpus, num_cores, bound, local_rank, local_size);
+    if (helper_cores_.empty())
+    {
+        H2_GPU_WARN("cannot reserve {} helper cores out of cores {}",
+                    num_cores,
+                    to_string(cpus));
+        return;
+    }
+    H2_GPU_INFO("reserved helper cores {}", to_string(helper_cores_));
+
+    // The calling thread keeps the rest of its share.
+    std::vector<int> rest;
+    for (int cpu : get_share(cpus, bound, local_rank, local_size))
+        if (!std::count(helper_cores_.begin(), helper_cores_.end(), cpu))
+            rest.push_back(cpu);
+    auto const rest_mask = make_cpu_set(rest);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(rest_mask), &rest_mask)
+        != 0)
+        H2_GPU_WARN("failed to move the calling thread off the helper cores");
+
+    for (auto thread : helper_threads_)
+        pin(thread, helper_cores_);
+}
+
+std::vector<int> h2::helper_cores()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return helper_cores_;
+}
+
+void h2::register_helper_thread()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (registration_.registered)
+        return;
+    registration_.registered = true;
+    helper_threads_.push_back(pthread_self());
+    if (!helper_cores_.empty())
+        pin(pthread_self(), helper_cores_);
+}
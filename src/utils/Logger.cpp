@@ -7,9 +7,11 @@
 
 #include "h2_config.hpp"
 
+#include "h2/utils/HelperThreads.hpp"
 #include "h2/utils/Logger.hpp"
 #include "logger_internals.hpp"
 
+#include <spdlog/async.h>
 #include <spdlog/pattern_formatter.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include "spdlog/sinks/basic_file_sink.h"
@@ -183,13 +185,25 @@ public:
 using LevelMapType = std::unordered_map<std::string, h2::Logger::LogLevelType>;
 using MaskMapType = std::unordered_map<std::string, unsigned char>;
 
+std::string h2_internal::expand_sink_name(std::string sinkname)
+{
+    auto n = sinkname.find("%w");
+    if (n == std::string::npos)
+        return sinkname;
+    auto const rank = MPIRankFlag::get_rank_str();
+    for (; n != std::string::npos; n = sinkname.find("%w", n + rank.size()))
+        sinkname.replace(n, 2, rank);
+    return sinkname;
+}
+
 ::spdlog::sink_ptr h2_internal::make_file_sink(std::string const& sinkname)
 {
     if (sinkname == "stdout")
         return std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
     if (sinkname == "stderr")
         return std::make_shared<spdlog::sinks::stderr_color_sink_mt>();
-    return std::make_shared<spdlog::sinks::basic_file_sink_mt>(sinkname);
+    return std::make_shared<spdlog::sinks::basic_file_sink_mt>(
+        expand_sink_name(sinkname));
 }
 
 ::spdlog::sink_ptr h2_internal::get_file_sink(std::string const& sinkname)
@@ -224,9 +238,21 @@ std::shared_ptr<::spdlog::logger> h2_internal::make_logger(
     logger->set_formatter(make_h2_formatter(pattern_prefix));
     ::spdlog::register_logger(logger);
     logger->set_level(::spdlog::level::trace);
+    // File sinks buffer the rest until the periodic flush.
+    logger->flush_on(::spdlog::level::err);
     return logger;
 }
 
+std::shared_ptr<::spdlog::details::thread_pool>
+h2_internal::get_log_thread_pool(h2::AsyncLogConfig const& config)
+{
+    static auto pool = std::make_shared<::spdlog::details::thread_pool>(
+        config.queue_size, config.threads, [] {
+            h2::register_helper_thread();
+        });
+    return pool;
+}
+
 // convert to uppercase
 std::string& h2_internal::to_upper(std::string &str)
 {
@@ -381,6 +407,49 @@ LevelMapType h2_internal::get_keys_and_levels(std::string const& str)
     return kl;
 }
 
+h2::AsyncLogConfig h2_internal::get_async_config(std::string const& str,
+                                                h2::AsyncLogConfig config)
+{
+    std::string token;
+    std::istringstream token_stream(str);
+    while (std::getline(token_stream, token, ','))
+    {
+        if (token.empty())
+            continue;
+
+        auto kv = extract_key_and_val('=', token);
+        auto& val = to_upper(trim(kv.second));
+        if (kv.first.empty() && (val == "ON" || val == "1"))
+            config.enabled = true;
+        else if (kv.first.empty() && (val == "OFF" || val == "0"))
+            config.enabled = false;
+        else if (kv.first == "queue")
+            config.queue_size = std::stoul(val);
+        else if (kv.first == "threads")
+            config.threads = std::stoul(val);
+        else if (kv.first == "flush")
+            config.flush_interval = std::chrono::seconds{std::stol(val)};
+        else if (kv.first == "overflow" && val == "BLOCK")
+            config.overflow = ::spdlog::async_overflow_policy::block;
+        else if (kv.first == "overflow" && val == "OVERRUN")
+            config.overflow = ::spdlog::async_overflow_policy::overrun_oldest;
+        else
+            throw std::runtime_error("Invalid async logging option: " + token);
+    }
+    return config;
+}
+
+bool h2_internal::is_logger_or_parent(std::string const& key,
+                                      std::vector<h2::Logger*> const& loggers)
+{
+    return std::any_of(loggers.cbegin(), loggers.cend(), [&](auto const& l) {
+        auto const name = l->name();
+        return name == key
+               || (name.size() > key.size() && name[key.size()] == '.'
+                   && name.compare(0, key.size(), key) == 0);
+    });
+}
+
 namespace h2
 {
 
@@ -408,12 +477,47 @@ void Logger::set_log_level(LogLevelType level)
 
 void Logger::set_mask(unsigned char mask)
 {
-    m_mask = mask;
+    m_mask.store(mask, std::memory_order_relaxed);
+}
+
+LogStream::~LogStream()
+{
+    auto msg = m_stream.str();
+    // Messages end with a newline of spdlog's.
+    while (!msg.empty() && msg.back() == '\n')
+        msg.pop_back();
+    m_logger.get().log(to_spdlog_level(m_level), "{}", msg);
 }
 
-bool Logger::should_log(LogLevelType level) const noexcept
+void Logger::set_async(AsyncLogConfig const& config)
 {
-    return ((m_mask & level) == level);
+    if (config.enabled == is_async())
+        return;
+
+    auto const& sinks = m_logger->sinks();
+    std::shared_ptr<::spdlog::logger> logger;
+    if (config.enabled)
+        logger = std::make_shared<::spdlog::async_logger>(
+            m_logger->name(),
+            sinks.begin(),
+            sinks.end(),
+            h2_internal::get_log_thread_pool(config),
+            config.overflow);
+    else
+        logger = std::make_shared<::spdlog::logger>(
+            m_logger->name(), sinks.begin(), sinks.end());
+    logger->set_level(m_logger->level());
+    logger->flush_on(m_logger->flush_level());
+
+    m_logger->flush();
+    ::spdlog::drop(m_logger->name());
+    ::spdlog::register_logger(logger);
+    m_logger = std::move(logger);
+}
+
+bool Logger::is_async() const noexcept
+{
+    return dynamic_cast<::spdlog::async_logger*>(m_logger.get()) != nullptr;
 }
 
 void setup_levels(std::vector<Logger*>& loggers,
@@ -431,17 +535,16 @@ void setup_levels(std::vector<Logger*>& loggers,
 
   for (auto& l : loggers)
   {
-    auto const name = l->name();
-    l->set_log_level(level_kv.count(name) ? level_kv.at(name) : default_level);
-    level_kv.erase(name);
+    auto const it = h2_internal::find_hierarchical(level_kv, l->name());
+    l->set_log_level(it != level_kv.cend() ? it->second : default_level);
   }
-  if (level_kv.size())
-  {
-    std::string err = "Unknown loggers: ";
-    for (auto const& [k, _] : level_kv)
+
+  std::string err;
+  for (auto const& [k, _] : level_kv)
+    if (!h2_internal::is_logger_or_parent(k, loggers))
       err += k + " ";
-    throw std::runtime_error(err);
-  }
+  if (err.size())
+    throw std::runtime_error("Unknown loggers: " + err);
 }
 
 void setup_masks(std::vector<Logger*>& loggers,
@@ -459,18 +562,31 @@ void setup_masks(std::vector<Logger*>& loggers,
 
   for (auto& l : loggers)
   {
-    auto const name = l->name();
-    l->set_mask(mask_kv.count(name) ? mask_kv.at(name) : default_mask);
-    mask_kv.erase(name);
+    auto const it = h2_internal::find_hierarchical(mask_kv, l->name());
+    l->set_mask(it != mask_kv.cend() ? it->second : default_mask);
   }
 
-  if (mask_kv.size())
-  {
-    std::string err = "Unknown loggers: ";
-    for (auto const& [k, _] : mask_kv)
+  std::string err;
+  for (auto const& [k, _] : mask_kv)
+    if (!h2_internal::is_logger_or_parent(k, loggers))
       err += k + " ";
-    throw std::runtime_error(err);
-  }
+  if (err.size())
+    throw std::runtime_error("Unknown loggers: " + err);
+}
+
+void setup_async(std::vector<Logger*>& loggers,
+                 char const* const async_env_var,
+                 AsyncLogConfig default_config)
+{
+  char const* const var = std::getenv(async_env_var);
+  auto const config =
+    (var ? h2_internal::get_async_config(var, default_config) : default_config);
+
+  for (auto& l : loggers)
+    l->set_async(config);
+
+  if (config.enabled && config.flush_interval.count() > 0)
+    ::spdlog::flush_every(config.flush_interval);
 }
 
 spdlog::level::level_enum to_spdlog_level(Logger::LogLevelType level)
@@ -16,6 +16,8 @@ namespace h2_internal
 using LevelMapType = std::unordered_map<std::string, h2::Logger::LogLevelType>;
 using MaskMapType = std::unordered_map<std::string, unsigned char>;
 
+std::string expand_sink_name(std::string sinkname);
+
 ::spdlog::sink_ptr make_file_sink(std::string const& sinkname);
 
 ::spdlog::sink_ptr get_file_sink(std::string const& sinkname);
@@ -46,6 +48,32 @@ MaskMapType get_keys_and_masks(std::string const& str);
 
 LevelMapType get_keys_and_levels(std::string const& str);
 
+// Find the entry of a logger, or else that of its closest parent: "a.b"
+// then "a" for a logger named "a.b.c".
+template <typename MapT>
+typename MapT::const_iterator find_hierarchical(MapT const& map,
+                                               std::string name)
+{
+  for (;;)
+  {
+    auto const it = map.find(name);
+    auto const n = name.rfind('.');
+    if (it != map.cend() || n == std::string::npos)
+      return it;
+    name.erase(n);
+  }
+}
+
+// Whether key names one of the loggers or one of their parents.
+bool is_logger_or_parent(std::string const& key,
+                         std::vector<h2::Logger*> const& loggers);
+
+h2::AsyncLogConfig get_async_config(std::string const& str,
+                                    h2::AsyncLogConfig config);
+
+std::shared_ptr<::spdlog::details::thread_pool> get_log_thread_pool(
+  h2::AsyncLogConfig const& config);
+
 }
 
 #endif // H2_UTILS_LOGGER_INTERNALS_HPP_INCLUDED
@@ -0,0 +1,56 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2020 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#include "h2/meta/EnumRegistry.hpp"
+
+using namespace h2::meta;
+
+namespace static_test_enum_registry
+{
+enum class Method
+{
+    A = 0,
+    B = 1,
+    C = 8,
+    D = -3,
+    Unlisted = 4,
+};
+
+constexpr auto registry = make_enum_registry<Method>({{Method::A, "A"},
+                                                      {Method::B, "B"},
+                                                      {Method::C, "C"},
+                                                      {Method::D, "D"}});
+
+constexpr bool eq(char const* a, char const* b)
+{
+    return std::string_view(a) == std::string_view(b);
+}
+
+static_assert(registry.size() == 4, "EnumRegistry size.");
+
+// Value to name
+static_assert(eq(registry.name(Method::A), "A"), "Name of A.");
+static_assert(eq(registry.name(Method::C), "C"), "Name of a sparse value.");
+static_assert(eq(registry.name(Method::D), "D"), "Name of a negative value.");
+static_assert(registry.name(Method::Unlisted) == nullptr,
+              "No name for an unlisted value.");
+static_assert(!registry.contains(Method::Unlisted),
+              "Unlisted value is not contained.");
+
+// Name to value
+static_assert(*registry.find("B") == Method::B, "Find B.");
+static_assert(*registry.find("D") == Method::D, "Find D.");
+static_assert(registry.find("E") == nullptr, "Unknown name is not found.");
+static_assert(registry.find("") == nullptr, "Empty name is not found.");
+static_assert(!registry.contains("a"), "Names are case-sensitive.");
+static_assert(registry.contains("C"), "Name is contained.");
+
+// Listing preserves order
+static_assert(registry.begin()->value == Method::A, "First entry.");
+static_assert((registry.end() - 1)->value == Method::D, "Last entry.");
+
+} // namespace static_test_enum_registry
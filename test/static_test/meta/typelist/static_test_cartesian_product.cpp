@@ -0,0 +1,28 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2020 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#include "h2/meta/Core.hpp"
+#include "h2/meta/typelist/CartesianProduct.hpp"
+
+using namespace h2::meta;
+
+static_assert(EqV<tlist::CartesianProduct<>, TL<tlist::Empty>>(),
+              "The product of no lists is the empty combination.");
+static_assert(
+    EqV<tlist::CartesianProduct<TL<int>, tlist::Empty>, tlist::Empty>(),
+    "The product with an empty list is empty.");
+static_assert(EqV<tlist::CartesianProduct<TL<int, float>>,
+                  TL<TL<int>, TL<float>>>(),
+              "The product of one list.");
+static_assert(
+    EqV<tlist::CartesianProduct<TL<int, float>, TL<char, bool>>,
+        TL<TL<int, char>, TL<int, bool>, TL<float, char>, TL<float, bool>>>(),
+    "The product of two lists.");
+static_assert(
+    EqV<tlist::CartesianProduct<TL<int>, TL<char, bool>, TL<float>>,
+        TL<TL<int, char, float>, TL<int, bool, float>>>(),
+    "The product of three lists.");
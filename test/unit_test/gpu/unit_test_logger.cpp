@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#include <catch2/catch.hpp>
+
+// Keep trace messages regardless of the build type.
+#define H2_GPU_LOG_ACTIVE_LEVEL H2_LOG_LEVEL_TRACE
+#include "h2/gpu/logger.hpp"
+
+#include <spdlog/sinks/ostream_sink.h>
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace h2::gpu;
+
+namespace
+{
+
+// Captures the messages of the GPU logger at trace level and restores
+// its state afterward.
+struct CaptureLogs
+{
+    std::ostringstream out;
+    std::shared_ptr<spdlog::sinks::ostream_sink_mt> sink =
+        std::make_shared<spdlog::sinks::ostream_sink_mt>(out);
+    spdlog::level::level_enum const level = logger().level();
+    std::uint64_t const period = trace_sample_period();
+
+    CaptureLogs()
+    {
+        sink->set_pattern("%v");
+        logger().sinks().push_back(sink);
+        logger().set_level(spdlog::level::trace);
+    }
+    ~CaptureLogs()
+    {
+        auto& sinks = logger().sinks();
+        sinks.erase(std::remove(sinks.begin(), sinks.end(), sink),
+                    sinks.end());
+        logger().set_level(level);
+        set_trace_sample_period(period);
+    }
+
+    long lines() const
+    {
+        auto const str = out.str();
+        return std::count(str.begin(), str.end(), '\n');
+    }
+};
+
+void trace_event(int i)
+{
+    H2_GPU_TRACE("event {}", i);
+}
+
+} // namespace
+
+TEST_CASE("Trace events are all logged without sampling", "[gpu][logger]")
+{
+    CaptureLogs logs;
+    set_trace_sample_period(1);
+    for (int i = 0; i < 10; ++i)
+        trace_event(i);
+    CHECK(logs.lines() == 10);
+}
+
+TEST_CASE("Sampled tracing logs 1 of N events", "[gpu][logger]")
+{
+    CaptureLogs logs;
+    set_trace_sample_period(4);
+    REQUIRE(trace_sample_period() == 4);
+    for (int i = 0; i < 20; ++i)
+        trace_event(i);
+    CHECK(logs.lines() == 5);
+
+    set_trace_sample_period(0);
+    CHECK(trace_sample_period() == 1);
+}
+
+TEST_CASE("Trace events below the logger level are not counted",
+          "[gpu][logger]")
+{
+    CaptureLogs logs;
+    set_trace_sample_period(1);
+    logger().set_level(spdlog::level::debug);
+    trace_event(0);
+    CHECK(logs.lines() == 0);
+}
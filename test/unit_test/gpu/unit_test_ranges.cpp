@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#include <catch2/catch.hpp>
+
+#include "h2/gpu/ranges.hpp"
+
+#include <string>
+
+using namespace h2::gpu;
+
+namespace
+{
+
+// Restores whether ranges are enabled.
+struct RangesEnabledGuard
+{
+    bool const enabled = ranges_enabled();
+    ~RangesEnabledGuard() { set_ranges_enabled(enabled); }
+};
+
+RangeDomain const& test_domain()
+{
+    static RangeDomain const domain{"h2_test"};
+    return domain;
+}
+
+} // namespace
+
+TEST_CASE("Range categories have names", "[gpu][ranges]")
+{
+    CHECK(std::string(to_string(RangeCategory::Compute)) == "compute");
+    CHECK(std::string(to_string(RangeCategory::HaloExchange))
+          == "halo_exchange");
+    CHECK(std::string(to_string(RangeCategory::Runtime)) == "runtime");
+    CHECK(std::string(h2_range_domain().name()) == "h2");
+}
+
+TEST_CASE("Scoped ranges nest when enabled", "[gpu][ranges]")
+{
+    RangesEnabledGuard guard;
+    set_ranges_enabled(true);
+    REQUIRE(range_depth() == 0);
+    {
+        ScopedRange outer(test_domain(), "outer", RangeCategory::Compute);
+        CHECK(range_depth() == 1);
+        {
+            H2_GPU_RANGE(test_domain(), "inner", RangeCategory::Collective);
+            CHECK(range_depth() == 2);
+        }
+        CHECK(range_depth() == 1);
+    }
+    CHECK(range_depth() == 0);
+}
+
+TEST_CASE("Scoped ranges are skipped when disabled", "[gpu][ranges]")
+{
+    RangesEnabledGuard guard;
+    set_ranges_enabled(false);
+    {
+        ScopedRange r(test_domain(), "skipped", RangeCategory::Shuffle);
+        CHECK(range_depth() == 0);
+        // Enabling does not close a range that was never opened.
+        set_ranges_enabled(true);
+    }
+    CHECK(range_depth() == 0);
+}
+
+TEST_CASE("Ranges can be pushed explicitly", "[gpu][ranges]")
+{
+    RangesEnabledGuard guard;
+    set_ranges_enabled(false);
+    range_push(test_domain(), "explicit", RangeCategory::Memory);
+    CHECK(range_depth() == 1);
+    range_pop(test_domain());
+    CHECK(range_depth() == 0);
+}
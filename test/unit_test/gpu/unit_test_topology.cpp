@@ -0,0 +1,90 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#include <catch2/catch.hpp>
+
+#include "../src/gpu/topology.hpp"
+
+#include <set>
+#include <vector>
+
+using namespace h2_internal;
+
+TEST_CASE("parse_cpu_list", "[gpu][topology]")
+{
+    CHECK(parse_cpu_list("").empty());
+    CHECK(parse_cpu_list("3") == std::vector<int>{3});
+    CHECK(parse_cpu_list("0-3") == std::vector<int>{0, 1, 2, 3});
+    CHECK(parse_cpu_list("0-1,8,10-11")
+          == std::vector<int>{0, 1, 8, 10, 11});
+    // sysfs files end with a newline.
+    CHECK(parse_cpu_list("4-5\n") == std::vector<int>{4, 5});
+}
+
+TEST_CASE("choose_local_gpu keeps the default", "[gpu][topology]")
+{
+    std::vector<int> const gpu_nodes = {0, 0, 1, 1};
+
+    SECTION("Unknown topology")
+    {
+        CHECK(choose_local_gpu({0, -1, 1, 1}, {1}, 1, 4) == -1);
+        CHECK(choose_local_gpu(gpu_nodes, {}, 1, 4) == -1);
+    }
+    SECTION("Bound across NUMA nodes")
+    {
+        CHECK(choose_local_gpu(gpu_nodes, {0, 1}, 1, 4) == -1);
+    }
+    SECTION("Single NUMA node")
+    {
+        CHECK(choose_local_gpu({0, 0, 0, 0}, {0}, 3, 4) == -1);
+    }
+    SECTION("Default GPU is local")
+    {
+        for (int rank = 0; rank < 4; ++rank)
+            CHECK(choose_local_gpu(gpu_nodes, {rank / 2}, rank, 4) == -1);
+    }
+}
+
+TEST_CASE("choose_local_gpu follows the binding", "[gpu][topology]")
+{
+    std::vector<int> const gpu_nodes = {0, 0, 1, 1};
+
+    SECTION("Round-robin binding")
+    {
+        // Rank r is bound to NUMA node r % 2.
+        std::set<int> chosen;
+        for (int rank = 0; rank < 4; ++rank)
+        {
+            int gpu = choose_local_gpu(gpu_nodes, {rank % 2}, rank, 4);
+            if (gpu < 0)
+                gpu = rank;
+            CHECK(gpu_nodes[gpu] == rank % 2);
+            chosen.insert(gpu);
+        }
+        CHECK(chosen.size() == 4);
+    }
+    SECTION("Block binding with interleaved GPUs")
+    {
+        // Ranks 0 and 1 are bound to NUMA node 0, 2 and 3 to node 1.
+        std::vector<int> const interleaved = {0, 1, 1, 0};
+        std::set<int> chosen;
+        for (int rank = 0; rank < 4; ++rank)
+        {
+            int gpu = choose_local_gpu(interleaved, {rank / 2}, rank, 4);
+            if (gpu < 0)
+                gpu = rank;
+            CHECK(interleaved[gpu] == rank / 2);
+            chosen.insert(gpu);
+        }
+        CHECK(chosen.size() == 4);
+    }
+    SECTION("Fewer ranks than GPUs")
+    {
+        CHECK(choose_local_gpu(gpu_nodes, {1}, 0, 2) == 2);
+        CHECK(choose_local_gpu(gpu_nodes, {0}, 1, 2) == -1);
+    }
+}
@@ -170,3 +170,140 @@ TEMPLATE_TEST_CASE(
         }
     }
 }
+
+TEMPLATE_TEST_CASE("testing the factory class with dense storage",
+                   "[factory][utilities]",
+                   int,
+                   GenericKey)
+{
+    using WidgetFactory =
+        h2::factory::ObjectFactory<WidgetBase,
+                                   TestType,
+                                   std::function<std::unique_ptr<WidgetBase>()>,
+                                   h2::factory::DefaultErrorPolicy,
+                                   h2::factory::DenseStorage>;
+
+    WidgetFactory factory;
+    auto const widget = static_cast<TestType>(GenericKey::WIDGET);
+    auto const gizmo = static_cast<TestType>(GenericKey::GIZMO);
+    // Beyond the flat array, so stored sparsely.
+    auto const sparse = static_cast<TestType>(1000);
+
+    CHECK(factory.register_builder(widget, MakeWidget));
+    CHECK(factory.register_builder(sparse, MakeGizmo));
+    CHECK_FALSE(factory.register_builder(widget, MakeGizmo));
+    CHECK(factory.size() == 2UL);
+
+    auto w = factory.create_object(widget);
+    auto const& w_ref = *w;
+    CHECK(typeid(w_ref) == typeid(Widget));
+    auto s = factory.create_object(sparse);
+    auto const& s_ref = *s;
+    CHECK(typeid(s_ref) == typeid(Gizmo));
+    CHECK_THROWS_WITH(factory.create_object(gizmo), "Unknown type identifier.");
+
+    auto names = factory.registered_ids();
+    CHECK(names.size() == 2UL);
+    CHECK(names.front() == widget);
+    CHECK(names.back() == sparse);
+
+    CHECK(factory.unregister(sparse));
+    CHECK_FALSE(factory.unregister(sparse));
+    CHECK_FALSE(factory.unregister(gizmo));
+    CHECK(factory.size() == 1UL);
+}
+
+TEST_CASE("testing pooled objects of the factory class",
+          "[factory][utilities]")
+{
+    using WidgetFactory = h2::factory::ObjectFactory<WidgetBase, int>;
+
+    WidgetFactory factory;
+    int built = 0;
+    factory.register_builder(1, [&built]() {
+        ++built;
+        return MakeWidget();
+    });
+
+    WidgetBase* first = nullptr;
+    {
+        auto obj = factory.create_pooled_object(1);
+        first = obj.get();
+        CHECK(built == 1);
+    }
+
+    SECTION("Destroyed objects are reused")
+    {
+        auto obj = factory.create_pooled_object(1);
+        CHECK(obj.get() == first);
+        CHECK(built == 1);
+
+        auto other = factory.create_pooled_object(1);
+        CHECK(other.get() != first);
+        CHECK(built == 2);
+    }
+
+    SECTION("Cleared pools build new objects")
+    {
+        factory.clear_pool();
+        auto obj = factory.create_pooled_object(1);
+        CHECK(built == 2);
+    }
+
+    SECTION("Objects may outlive the factory")
+    {
+        auto obj = std::make_unique<WidgetFactory>();
+        obj->register_builder(2, MakeGizmo);
+        auto gizmo = obj->create_pooled_object(2);
+        obj.reset();
+        gizmo.reset();
+    }
+
+    SECTION("Copies have pools of their own")
+    {
+        WidgetFactory copy(factory);
+        auto obj = copy.create_pooled_object(1);
+        CHECK(obj.get() != first);
+        CHECK(built == 2);
+        obj.reset();
+
+        // Clearing the pool of the copy keeps that of the original.
+        copy.clear_pool();
+        CHECK(copy.unregister(1));
+        auto orig = factory.create_pooled_object(1);
+        CHECK(orig.get() == first);
+
+        WidgetFactory assigned;
+        assigned = factory;
+        auto other = assigned.create_pooled_object(1);
+        CHECK(other.get() != first);
+        CHECK(built == 3);
+    }
+
+    SECTION("Moves take the pool")
+    {
+        WidgetFactory moved(std::move(factory));
+        auto obj = moved.create_pooled_object(1);
+        CHECK(obj.get() == first);
+        CHECK(built == 1);
+
+        // The moved-from factory is still usable.
+        factory.clear_pool();
+        CHECK_FALSE(factory.unregister(1));
+        CHECK_THROWS_WITH(factory.create_pooled_object(1),
+                          "Unknown type identifier.");
+
+        obj.reset();
+        WidgetFactory assigned;
+        assigned = std::move(moved);
+        auto again = assigned.create_pooled_object(1);
+        CHECK(again.get() == first);
+        CHECK(built == 1);
+    }
+
+    SECTION("Unknown IDs are errors")
+    {
+        CHECK_THROWS_WITH(factory.create_pooled_object(2),
+                          "Unknown type identifier.");
+    }
+}
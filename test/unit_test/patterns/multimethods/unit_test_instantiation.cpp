@@ -0,0 +1,65 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2020 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#include <catch2/catch.hpp>
+
+#include "h2/meta/TypeList.hpp"
+#include "h2/patterns/multimethods/Instantiation.hpp"
+
+#include <set>
+#include <string>
+#include <typeinfo>
+
+using namespace h2::meta;
+using namespace h2::multimethods;
+
+namespace
+{
+std::set<std::string> instantiated;
+
+template <typename T, typename U>
+struct TestInstantiator
+{
+    static void instantiate()
+    {
+        instantiated.insert(std::string(typeid(T).name()) + ","
+                            + typeid(U).name());
+    }
+};
+
+using Combinations =
+    tlist::CartesianProduct<TL<int, float, double>, TL<char, bool>>;
+
+} // namespace
+
+// Duplicate combinations are harmless.
+H2_INSTANTIATE_ALL(test_instances,
+                   TestInstantiator,
+                   tlist::Append<Combinations, TL<TL<int, char>>>);
+
+static_assert(
+    EqV<Shard<Combinations, 1, 4>, TL<TL<int, bool>, TL<double, bool>>>(),
+    "Shards take every NumShards-th combination.");
+static_assert(
+    EqV<Shard<TL<TL<int>, TL<int>, TL<float>>, 1, 2>, TL<TL<float>>>(),
+    "Shards are taken after removing duplicates.");
+static_assert(tlist::Length<Shard<Combinations, 0, 1>> == 6,
+              "A single shard has all combinations.");
+
+TEST_CASE("Instantiation of typelist combinations",
+          "[utilities][multimethods]")
+{
+    instantiated.clear();
+    CHECK(test_instances.size() == 7);
+    for (auto const& f : test_instances)
+        f();
+    CHECK(instantiated.size() == 6);
+
+    using Instances =
+        InstantiateAll<TestInstantiator, Shard<Combinations, 0, 4>>;
+    CHECK(Instances::entries.size() == 2);
+}
@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#include <catch2/catch.hpp>
+
+#include "h2/tensor/dist_layout.hpp"
+
+#include <vector>
+
+using namespace h2;
+
+TEST_CASE("Process grid ranks", "[tensor][layout]")
+{
+    ProcGrid<3> const grid({2, 3, 2});
+    CHECK(grid.size() == 12);
+    for (int r = 0; r < grid.size(); ++r)
+        CHECK(grid.rank(grid.coord(r)) == r);
+    // Dimension 0 varies the fastest.
+    CHECK(grid.coord(1) == std::array<int, 3>{1, 0, 0});
+    CHECK(grid.coord(2) == std::array<int, 3>{0, 1, 0});
+    CHECK(grid.rank({0, 0, 1}) == 6);
+    CHECK(grid.rank({2, 0, 0}) == -1);
+    CHECK(grid.rank({0, -1, 0}) == -1);
+}
+
+TEST_CASE("Block distribution", "[tensor][layout]")
+{
+    DistLayout<2> const dist({10, 4}, ProcGrid<2>({3, 1}), {1, 0});
+    CHECK(dist.local_box(0).offset == DimTuple<2>{0, 0});
+    CHECK(dist.local_box(0).extent == DimTuple<2>{4, 4});
+    CHECK(dist.local_box(1).offset == DimTuple<2>{4, 0});
+    CHECK(dist.local_box(1).extent == DimTuple<2>{3, 4});
+    CHECK(dist.local_box(2).offset == DimTuple<2>{7, 0});
+    CHECK(dist.local_box(2).extent == DimTuple<2>{3, 4});
+
+    auto const local = dist.local_layout(1);
+    CHECK(local.strides == DimTuple<2>{1, 5});
+    CHECK(local.origin() == 1);
+    CHECK(local.offset({-1, 0}) == 0);
+    CHECK(local.offset({2, 3}) == 18);
+    CHECK(local.span() == 20);
+}
+
+TEST_CASE("Box intersection", "[tensor][layout]")
+{
+    Box<2> const a{{0, 0}, {4, 4}};
+    Box<2> const b{{2, 3}, {4, 4}};
+    auto const c = intersect(a, b);
+    CHECK(c.offset == DimTuple<2>{2, 3});
+    CHECK(c.extent == DimTuple<2>{2, 1});
+    CHECK(intersect(a, Box<2>{{4, 0}, {1, 1}}).empty());
+}
+
+TEST_CASE("Planes of a box", "[tensor][layout]")
+{
+    std::vector<DimTuple<4>> planes;
+    for_each_plane<4>({5, 6, 2, 3},
+                      [&](DimTuple<4> const& idx) { planes.push_back(idx); });
+    REQUIRE(planes.size() == 6);
+    CHECK(planes[0] == DimTuple<4>{0, 0, 0, 0});
+    CHECK(planes[1] == DimTuple<4>{0, 0, 1, 0});
+    CHECK(planes[5] == DimTuple<4>{0, 0, 1, 2});
+
+    int count = 0;
+    for_each_plane<2>({5, 6}, [&](DimTuple<2> const&) { ++count; });
+    CHECK(count == 1);
+    for_each_plane<3>({5, 0, 2}, [&](DimTuple<3> const&) { ++count; });
+    CHECK(count == 1);
+}
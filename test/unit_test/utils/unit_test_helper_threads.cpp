@@ -0,0 +1,46 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright 2019-2022 Lawrence Livermore National Security, LLC and other
+// DiHydrogen Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: Apache-2.0
+////////////////////////////////////////////////////////////////////////////////
+
+#include <catch2/catch.hpp>
+
+#include "h2/utils/HelperThreads.hpp"
+
+#include <numeric>
+#include <vector>
+
+using namespace h2;
+
+TEST_CASE("Helper cores of bound processes", "[utilities][threads]")
+{
+    std::vector<int> const cpus = {4, 5, 6, 7};
+    CHECK(choose_helper_cores(cpus, 1, true, 0, 4) == std::vector<int>{7});
+    CHECK(choose_helper_cores(cpus, 2, true, 3, 4)
+          == std::vector<int>{6, 7});
+    // One CPU is always left out.
+    CHECK(choose_helper_cores(cpus, 8, true, 0, 1)
+          == std::vector<int>{5, 6, 7});
+    CHECK(choose_helper_cores({3}, 1, true, 0, 1).empty());
+    CHECK(choose_helper_cores(cpus, 0, true, 0, 1).empty());
+}
+
+TEST_CASE("Helper cores of unbound processes", "[utilities][threads]")
+{
+    std::vector<int> cpus(16);
+    std::iota(cpus.begin(), cpus.end(), 0);
+    CHECK(choose_helper_cores(cpus, 1, false, 0, 4) == std::vector<int>{3});
+    CHECK(choose_helper_cores(cpus, 2, false, 2, 4)
+          == std::vector<int>{10, 11});
+    CHECK(choose_helper_cores(cpus, 1, false, 0, 1) == std::vector<int>{15});
+    // Fewer CPUs than processes.
+    CHECK(choose_helper_cores(cpus, 1, false, 0, 32).empty());
+}
+
+TEST_CASE("No helper cores are reserved by default", "[utilities][threads]")
+{
+    register_helper_thread();
+    CHECK(helper_cores().empty());
+}
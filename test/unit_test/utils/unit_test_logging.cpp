@@ -251,3 +251,114 @@ TEST_CASE("Testing the internal functions used by the logging class",
     CHECK(m.at("training") == LogLevelType::DEBUG);
   }
 }
+
+TEST_CASE("Testing the asynchronous logging configuration",
+          "[logging][utilities]")
+{
+  SECTION("Parse async options")
+  {
+    auto c = h2_internal::get_async_config("on", h2::AsyncLogConfig{});
+    CHECK(c.enabled);
+    CHECK(c.queue_size == h2::AsyncLogConfig{}.queue_size);
+
+    c = h2_internal::get_async_config(
+      "on,queue=1024,threads=2,overflow=block,flush=10", h2::AsyncLogConfig{});
+    CHECK(c.enabled);
+    CHECK(c.queue_size == 1024);
+    CHECK(c.threads == 2);
+    CHECK(c.overflow == spdlog::async_overflow_policy::block);
+    CHECK(c.flush_interval == std::chrono::seconds{10});
+
+    c = h2_internal::get_async_config("off,overflow=overrun", c);
+    CHECK_FALSE(c.enabled);
+    CHECK(c.queue_size == 1024);
+    CHECK(c.overflow == spdlog::async_overflow_policy::overrun_oldest);
+
+    CHECK_THROWS_WITH(
+      h2_internal::get_async_config("overflow=drop", h2::AsyncLogConfig{}),
+      "Invalid async logging option: overflow=drop");
+  }
+
+  SECTION("Expand the rank in sink names")
+  {
+    CHECK(h2_internal::expand_sink_name("h2.log") == "h2.log");
+    CHECK(h2_internal::expand_sink_name("h2.%w.log").find("%w")
+          == std::string::npos);
+  }
+
+  SECTION("Switch a logger to asynchronous and back")
+  {
+    h2::Logger logger("async_test", "stderr");
+    CHECK_FALSE(logger.is_async());
+
+    h2::AsyncLogConfig config;
+    config.enabled = true;
+    logger.set_async(config);
+    CHECK(logger.is_async());
+    CHECK(spdlog::get("async_test").get() == &logger.get());
+    logger.flush();
+
+    config.enabled = false;
+    logger.set_async(config);
+    CHECK_FALSE(logger.is_async());
+    CHECK(spdlog::get("async_test").get() == &logger.get());
+  }
+}
+
+TEST_CASE("Testing hierarchical loggers and lazy log macros",
+          "[logging][utilities]")
+{
+  using LogLevelType = h2::Logger::LogLevelType;
+
+  // Loggers are registered by name, so they outlive the sections.
+  static h2::Logger parent("hier");
+  static h2::Logger child("hier.child");
+  static h2::Logger grandchild("hier.child.leaf");
+  std::vector<h2::Logger*> loggers = {&parent, &child, &grandchild};
+
+  SECTION("Children take the level of their closest parent")
+  {
+    setenv("H2_TEST_LOG_LEVEL", "error,hier.child=debug", 1);
+    h2::setup_levels(loggers, "H2_TEST_LOG_LEVEL");
+    CHECK_FALSE(parent.should_log(LogLevelType::WARN));
+    CHECK(child.should_log(LogLevelType::DEBUG));
+    CHECK(grandchild.should_log(LogLevelType::DEBUG));
+    CHECK_FALSE(grandchild.should_log(LogLevelType::TRACE));
+
+    setenv("H2_TEST_LOG_LEVEL", "hier=info,hier.child.leaf=trace", 1);
+    h2::setup_levels(loggers, "H2_TEST_LOG_LEVEL");
+    CHECK(child.should_log(LogLevelType::INFO));
+    CHECK_FALSE(child.should_log(LogLevelType::DEBUG));
+    CHECK(grandchild.should_log(LogLevelType::TRACE));
+
+    setenv("H2_TEST_LOG_LEVEL", "hier.other=info", 1);
+    CHECK_THROWS_WITH(h2::setup_levels(loggers, "H2_TEST_LOG_LEVEL"),
+                      "Unknown loggers: hier.other ");
+    unsetenv("H2_TEST_LOG_LEVEL");
+  }
+
+  SECTION("Children take the mask of their closest parent")
+  {
+    setenv("H2_TEST_LOG_MASK", "hier.child=debug|error", 1);
+    h2::setup_masks(loggers, "H2_TEST_LOG_MASK");
+    CHECK(parent.mask() == 0);
+    CHECK(grandchild.mask() == (LogLevelType::DEBUG | LogLevelType::ERROR));
+    unsetenv("H2_TEST_LOG_MASK");
+  }
+
+  SECTION("Disabled levels do not evaluate their arguments")
+  {
+    int evaluated = 0;
+    auto count = [&]() { return ++evaluated; };
+
+    child.set_log_level(LogLevelType::OFF);
+    H2_LOG(child, DEBUG, "{}", count());
+    H2_LOG_STREAM(child, DEBUG) << count();
+    CHECK(evaluated == 0);
+
+    child.set_log_level(LogLevelType::TRACE);
+    H2_LOG(child, DEBUG, "{}", count());
+    H2_LOG_STREAM(child, DEBUG) << count() << "\n";
+    CHECK(evaluated == 2);
+  }
+}